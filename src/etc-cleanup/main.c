@@ -21,6 +21,10 @@
 #include "../include/etc_groups.h"
 #include "../include/common.h"
 #include <stdarg.h>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #define MAX_BUF 4098
 #define MAX_ARR 1024
@@ -34,6 +38,7 @@ static char outbuf[256 * 1024];
 static char *outptr;
 static int arg_replace = 0;
 static int arg_debug = 0;
+static int arg_jobs = 0;
 
 void outprintf(char* fmt, ...) {
 	va_list args;
@@ -44,33 +49,106 @@ void outprintf(char* fmt, ...) {
 
 
 
-static int arr_check(const char *fname, char **pptr) {
-	assert(fname);
-	assert(pptr);
+// string hash set, open addressing; the strings are owned by the caller
+typedef struct {
+	const char *name;
+	int val;
+} SetEntry;
 
-	while (*pptr != NULL) {
-		if (strcmp(fname, *pptr) == 0)
-			return 1;
-		pptr++;
+typedef struct {
+	SetEntry *slot;
+	unsigned size;	// power of 2, at least twice cnt
+	unsigned cnt;
+} StrSet;
+
+static SetEntry *set_find(StrSet *set, const char *name) {
+	if (set->size == 0)
+		return NULL;
+	unsigned i = fnv1a32_str(name) & (set->size - 1);
+	while (set->slot[i].name) {
+		if (strcmp(set->slot[i].name, name) == 0)
+			return &set->slot[i];
+		i = (i + 1) & (set->size - 1);
+	}
+	return NULL;
+}
+
+// return 0 if the name was already in the set
+static int set_add(StrSet *set, const char *name, int val) {
+	if (set_find(set, name))
+		return 0;
+
+	if ((set->cnt + 1) * 2 > set->size) {
+		StrSet old = *set;
+		set->size = (old.size) ? old.size * 2 : 64;
+		set->slot = calloc(set->size, sizeof(SetEntry));
+		if (!set->slot)
+			errExit("calloc");
+		set->cnt = 0;
+		unsigned i;
+		for (i = 0; i < old.size; i++) {
+			if (old.slot[i].name)
+				set_add(set, old.slot[i].name, old.slot[i].val);
+		}
+		free(old.slot);
 	}
 
-	return 0;
+	unsigned i = fnv1a32_str(name) & (set->size - 1);
+	while (set->slot[i].name)
+		i = (i + 1) & (set->size - 1);
+	set->slot[i].name = name;
+	set->slot[i].val = val;
+	set->cnt++;
+	return 1;
 }
 
+static void set_clear(StrSet *set) {
+	if (set->size)
+		memset(set->slot, 0, set->size * sizeof(SetEntry));
+	set->cnt = 0;
+}
+
+// the files covered by @default, the sound and network groups are dropped,
+// the files in the other groups are replaced by the group name
+enum {
+	GROUP_DROP = 0,
+	GROUP_GAMES,
+	GROUP_TLS_CA,
+	GROUP_X11
+};
+static StrSet groups;	// file name: group
+static StrSet arr_set;	// the files already in arr[]
+
+static void groups_add(char **pptr, int group) {
+	for (; *pptr; pptr++)
+		set_add(&groups, *pptr, group);
+}
 
+static void groups_init(void) {
+	// the first group listing a file wins
+	groups_add(&etc_list[0], GROUP_DROP);
+	groups_add(&etc_group_sound[0], GROUP_DROP);
+	groups_add(&etc_group_network[0], GROUP_DROP);
+	set_add(&groups, "@games", GROUP_GAMES);
+	set_add(&groups, "@tls-ca", GROUP_TLS_CA);
+	set_add(&groups, "@x11", GROUP_X11);
+	groups_add(&etc_group_games[0], GROUP_GAMES);
+	groups_add(&etc_group_tls_ca[0], GROUP_TLS_CA);
+	groups_add(&etc_group_x11[0], GROUP_X11);
+}
 
 static void arr_add(const char *fname) {
 	assert(fname);
 	assert(arr_cnt < MAX_ARR);
 
-	int i;
-	for (i = 0; i < arr_cnt; i++)
-		if (strcmp(arr[i], fname) == 0)
-			return;
-
-	arr[arr_cnt] = strdup(fname);
-	if (!arr[arr_cnt])
+	char *name = strdup(fname);
+	if (!name)
 		errExit("strdup");
+	if (!set_add(&arr_set, name, 0)) {
+		free(name);
+		return;
+	}
+	arr[arr_cnt] = name;
 	arr_cnt++;
 }
 
@@ -86,6 +164,7 @@ static void arr_sort(void) {
 }
 
 static void arr_clean(void) {
+	set_clear(&arr_set);
 	int i;
 	for (i = 0; i < arr_cnt; i++) {
 		free(arr[i]);
@@ -168,23 +247,15 @@ static void process_file(const char *fname) {
 		while (ptr) {
 			if (arg_debug)
 				printf("%s\n", ptr);
-			if (arr_check(ptr, &etc_list[0]));
-			else if (arr_check(ptr, &etc_group_sound[0]));
-			else if (arr_check(ptr, &etc_group_network[0]));
-			else if (strcmp(ptr, "@games") == 0)
-				arr_games = 1;
-			else if (strcmp(ptr, "@tls-ca") == 0)
-				arr_tls_ca = 1;
-			else if (strcmp(ptr, "@x11") == 0)
-				arr_x11 = 1;
-			else if (arr_check(ptr, &etc_group_games[0]))
+			SetEntry *g = set_find(&groups, ptr);
+			if (!g)
+				arr_add(ptr);
+			else if (g->val == GROUP_GAMES)
 				arr_games = 1;
-			else if (arr_check(ptr, &etc_group_tls_ca[0]))
+			else if (g->val == GROUP_TLS_CA)
 				arr_tls_ca = 1;
-			else if (arr_check(ptr, &etc_group_x11[0]))
+			else if (g->val == GROUP_X11)
 				arr_x11 = 1;
-			else
-				arr_add(ptr);
 
 			ptr = strtok(NULL, ",");
 		}
@@ -212,12 +283,166 @@ static void process_file(const char *fname) {
 	}
 }
 
+// list of files to process
+static char **files = NULL;
+static int files_cnt = 0;
+static int files_max = 0;
+
+static void files_add(const char *fname) {
+	if (files_cnt == files_max) {
+		files_max = (files_max) ? files_max * 2 : 256;
+		files = realloc(files, files_max * sizeof(char *));
+		if (!files)
+			errExit("realloc");
+	}
+	files[files_cnt] = strdup(fname);
+	if (!files[files_cnt])
+		errExit("strdup");
+	files_cnt++;
+}
+
+static int has_suffix(const char *name, const char *suffix) {
+	size_t len = strlen(name);
+	size_t slen = strlen(suffix);
+	return len > slen && strcmp(name + len - slen, suffix) == 0;
+}
+
+static int name_cmp(const void *p1, const void *p2) {
+	return strcmp(*(char * const *) p1, *(char * const *) p2);
+}
+
+// the .profile and .inc files in the directory tree, sorted
+static void add_directory(const char *dname) {
+	DIR *dir = opendir(dname);
+	if (!dir) {
+		fprintf(stderr, "Error: cannot open directory %s\n", dname);
+		exit(1);
+	}
+
+	int start = files_cnt;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (*entry->d_name == '.')
+			continue;
+		char *fname;
+		if (asprintf(&fname, "%s/%s", dname, entry->d_name) == -1)
+			errExit("asprintf");
+		struct stat s;
+		if (stat(fname, &s) == 0) {
+			if (S_ISDIR(s.st_mode))
+				add_directory(fname);
+			else if (S_ISREG(s.st_mode) &&
+				 (has_suffix(entry->d_name, ".profile") || has_suffix(entry->d_name, ".inc")))
+				files_add(fname);
+		}
+		free(fname);
+	}
+	closedir(dir);
+	qsort(&files[start], files_cnt - start, sizeof(char *), name_cmp);
+}
+
+static void add_argument(const char *arg) {
+	struct stat s;
+	if (strpbrk(arg, "*?[")) {
+		glob_t globbuf;
+		int rv = glob(arg, 0, NULL, &globbuf);
+		if (rv == GLOB_NOMATCH) {
+			fprintf(stderr, "Error: no file matching %s\n", arg);
+			exit(1);
+		}
+		if (rv)
+			errExit("glob");
+		size_t i;
+		for (i = 0; i < globbuf.gl_pathc; i++) {
+			if (stat(globbuf.gl_pathv[i], &s) == 0 && S_ISDIR(s.st_mode))
+				add_directory(globbuf.gl_pathv[i]);
+			else
+				files_add(globbuf.gl_pathv[i]);
+		}
+		globfree(&globbuf);
+	}
+	else if (stat(arg, &s) == 0 && S_ISDIR(s.st_mode))
+		add_directory(arg);
+	else
+		files_add(arg);
+}
+
+// the files are split in contiguous blocks, one for each job; the report
+// of every job goes in a temporary file, and it is printed in the order of
+// the blocks once the job is done, the output doesn't depend on the
+// scheduling
+static int process_files(void) {
+	int jobs = arg_jobs;
+	if (jobs <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = (cpus > 0) ? (int) cpus : 1;
+	}
+	if (jobs > files_cnt)
+		jobs = files_cnt;
+	if (jobs <= 1) {
+		int i;
+		for (i = 0; i < files_cnt; i++)
+			process_file(files[i]);
+		return 0;
+	}
+
+	fflush(stdout);
+	pid_t *child = malloc(jobs * sizeof(pid_t));
+	FILE **report = malloc(jobs * sizeof(FILE *));
+	if (!child || !report)
+		errExit("malloc");
+
+	int j;
+	for (j = 0; j < jobs; j++) {
+		report[j] = tmpfile();
+		if (!report[j])
+			errExit("tmpfile");
+		child[j] = fork();
+		if (child[j] == -1)
+			errExit("fork");
+		if (child[j] == 0) {
+			if (dup2(fileno(report[j]), STDOUT_FILENO) == -1)
+				errExit("dup2");
+			int first = (int) ((long) files_cnt * j / jobs);
+			int last = (int) ((long) files_cnt * (j + 1) / jobs);
+			int i;
+			for (i = first; i < last; i++)
+				process_file(files[i]);
+			fflush(stdout);
+			_exit(0);
+		}
+	}
+
+	int rv = 0;
+	for (j = 0; j < jobs; j++) {
+		int status;
+		if (waitpid(child[j], &status, 0) == -1)
+			errExit("waitpid");
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			rv = 1;
+
+		rewind(report[j]);
+		char buf[MAX_BUF];
+		size_t len;
+		while ((len = fread(buf, 1, sizeof(buf), report[j])) > 0)
+			fwrite(buf, 1, len, stdout);
+		fclose(report[j]);
+	}
+	fflush(stdout);
+	free(child);
+	free(report);
+	return rv;
+}
+
 static const char *const usage_str =
-	"usage: cleanup-etc [options] file.profile [file.profile]\n"
+	"usage: cleanup-etc [options] file.profile|directory [file.profile|directory]\n"
 	"Group and clean private-etc entries in one or more profile files.\n"
+	"The .profile and .inc files in a directory are processed recursively;\n"
+	"file names with wildcards are expanded.\n"
 	"Options:\n"
 	"   --debug - print debug messages\n"
 	"   -h, -?, --help - this help screen\n"
+	"   --jobs=number - files processed in parallel, the number of cpus by default\n"
 	"   --replace - replace profile file\n";
 
 static void usage(void) {
@@ -243,6 +468,13 @@ int main(int argc, char **argv) {
 			arg_debug = 1;
 		else if (strcmp(argv[i], "--replace") == 0)
 			arg_replace = 1;
+		else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+			arg_jobs = atoi(argv[i] + 7);
+			if (arg_jobs < 1) {
+				fprintf(stderr, "Error: invalid --jobs value\n");
+				return 1;
+			}
+		}
 		else if (*argv[i] == '-') {
 			fprintf(stderr, "Error: invalid program option %s\n", argv[i]);
 			return 1;
@@ -252,7 +484,8 @@ int main(int argc, char **argv) {
 	}
 
 	for (; i < argc; i++)
-		process_file(argv[i]);
+		add_argument(argv[i]);
 
-	return 0;
+	groups_init();
+	return process_files();
 }
@@ -20,108 +20,6 @@
 
 #include "fbuilder.h"
 
-// common file processing function, using the callback for each line in the file
-static void process_file(const char *fname, const char *dir, void (*callback)(char *)) {
-	assert(fname);
-	assert(dir);
-	assert(callback);
-
-	int dir_len = strlen(dir);
-
-	// process trace file
-	FILE *fp = fopen(fname, "r");
-	if (!fp) {
-		fprintf(stderr, "Error fbuilder: cannot open %s\n", fname);
-		exit(1);
-	}
-
-	char buf[MAX_BUF];
-	while (fgets(buf, MAX_BUF, fp)) {
-		// remove \n
-		char *ptr = strchr(buf, '\n');
-		if (ptr)
-			*ptr = '\0';
-
-		// parse line: 4:galculator:access /etc/fonts/conf.d:0
-		// number followed by :
-		ptr = buf;
-		if (!isdigit(*ptr))
-			continue;
-		while (isdigit(*ptr))
-			ptr++;
-		if (*ptr != ':')
-			continue;
-		ptr++;
-
-		// next :
-		ptr = strchr(ptr, ':');
-		if (!ptr)
-			continue;
-		ptr++;
-		if (strncmp(ptr, "access ", 7) == 0)
-			ptr +=  7;
-		else if (strncmp(ptr, "fopen ", 6) == 0)
-			ptr += 6;
-		else if (strncmp(ptr, "fopen64 ", 8) == 0)
-			ptr += 8;
-		else if (strncmp(ptr, "open64 ", 7) == 0)
-			ptr += 7;
-		else if (strncmp(ptr, "open ", 5) == 0)
-			ptr += 5;
-		else if (strncmp(ptr, "opendir ", 8) == 0)
-			ptr += 8;
-		else if (strncmp(ptr, "connect ", 8) == 0) {
-			ptr += 8;
-			// file descriptor argument
-			if (!isdigit(*ptr))
-				continue;
-			while (isdigit(*ptr))
-				ptr++;
-			if (*ptr++ != ' ')
-				continue;
-			if (*ptr != '/')
-				continue;
-		}
-		else
-			continue;
-
-		if (strncmp(ptr, dir, dir_len) != 0)
-			continue;
-
-		// end of filename
-		char *ptr2 = strchr(ptr, ':');
-		if (!ptr2)
-			continue;
-		*ptr2 = '\0';
-
-		callback(ptr);
-	}
-
-	fclose(fp);
-}
-
-// process fname, fname.1, fname.2, fname.3, fname.4, fname.5
-static void process_files(const char *fname, const char *dir, void (*callback)(char *)) {
-	assert(fname);
-	assert(dir);
-	assert(callback);
-
-	// run fname
-	process_file(fname, dir, callback);
-
-	// run all the rest
-	struct stat s;
-	int i;
-	for (i = 1; i <= 5; i++) {
-		char *newname;
-		if (asprintf(&newname, "%s.%d", fname, i) == -1)
-			errExit("asprintf");
-		if (stat(newname, &s) == 0)
-			process_file(newname, dir, callback);
-		free(newname);
-	}
-}
-
 //*******************************************
 // etc directory
 //*******************************************
@@ -151,20 +49,12 @@ static void etc_callback(char *ptr) {
 	etc_out = filedb_add(etc_out, ptr);
 }
 
-void build_etc(const char *fname, FILE *fp) {
-	assert(fname);
-
-	process_files(fname, "/etc", etc_callback);
-
+void build_etc(FILE *fp) {
 	fprintf(fp, "private-etc ");
 	if (etc_out == NULL)
 		fprintf(fp, "none\n");
 	else {
-		FileDB *ptr = etc_out;
-		while (ptr) {
-			fprintf(fp, "%s,", ptr->fname);
-			ptr = ptr->next;
-		}
+		filedb_print_list(etc_out, fp);
 		fprintf(fp, "\n");
 	}
 }
@@ -210,12 +100,7 @@ static void var_callback(char *ptr) {
 		var_out = filedb_add(var_out, p1);
 }
 
-void build_var(const char *fname, FILE *fp) {
-	assert(fname);
-
-	var_skip = filedb_load_whitelist(var_skip, "whitelist-var-common.inc", "whitelist /var/");
-	process_files(fname, "/var", var_callback);
-
+void build_var(FILE *fp) {
 	// always whitelist /var
 	if (var_out)
 		filedb_print(var_out, "whitelist /var/", fp);
@@ -251,12 +136,7 @@ static void run_callback(char *ptr) {
 		run_out = filedb_add(run_out, p1);
 }
 
-void build_run(const char *fname, FILE *fp) {
-	assert(fname);
-
-	run_skip = filedb_load_whitelist(run_skip, "whitelist-run-common.inc", "whitelist /run/");
-	process_files(fname, "/run", run_callback);
-
+void build_run(FILE *fp) {
 	// always whitelist /run
 	if (run_out)
 		filedb_print(run_out, "whitelist /run/", fp);
@@ -287,18 +167,10 @@ static void runuser_callback(char *ptr) {
 		runuser_out = filedb_add(runuser_out, p1);
 }
 
-void build_runuser(const char *fname, FILE *fp) {
-	assert(fname);
-
-	if (asprintf(&runuser_fname, "/run/user/%d", getuid()) < 0)
-		errExit("asprintf");
-
-	if (!is_dir(runuser_fname))
+void build_runuser(FILE *fp) {
+	if (!runuser_fname)
 		return;
 
-	runuser_skip = filedb_load_whitelist(runuser_skip, "whitelist-runuser-common.inc", "whitelist ${RUNUSER}/");
-	process_files(fname, runuser_fname, runuser_callback);
-
 	// always whitelist /run/user/$UID
 	if (runuser_out)
 		filedb_print(runuser_out, "whitelist ${RUNUSER}/", fp);
@@ -332,12 +204,7 @@ static void share_callback(char *ptr) {
 		share_out = filedb_add(share_out, p1);
 }
 
-void build_share(const char *fname, FILE *fp) {
-	assert(fname);
-
-	share_skip = filedb_load_whitelist(share_skip, "whitelist-usr-share-common.inc", "whitelist /usr/share/");
-	process_files(fname, "/usr/share", share_callback);
-
+void build_share(FILE *fp) {
 	// always whitelist /usr/share
 	if (share_out)
 		filedb_print(share_out, "whitelist /usr/share/", fp);
@@ -357,23 +224,15 @@ static void tmp_callback(char *ptr) {
 	tmp_out = filedb_add(tmp_out, ptr);
 }
 
-void build_tmp(const char *fname, FILE *fp) {
-	assert(fname);
-
-	process_files(fname, "/tmp", tmp_callback);
-
+void build_tmp(FILE *fp) {
 	if (tmp_out == NULL)
 		fprintf(fp, "private-tmp\n");
 	else {
 		fprintf(fp, "#private-tmp\n");
 		fprintf(fp, "# File accessed in /tmp directory:\n");
 		fprintf(fp, "# ");
-		FileDB *ptr = tmp_out;
-		while (ptr) {
-			fprintf(fp, "%s,", ptr->fname);
-			ptr = ptr->next;
-		}
-		printf("\n");
+		filedb_print_list(tmp_out, fp);
+		fprintf(fp, "\n");
 	}
 }
 
@@ -432,22 +291,48 @@ static void dev_callback(char *ptr) {
 		dev_out = filedb_add(dev_out, ptr);
 }
 
-void build_dev(const char *fname, FILE *fp) {
-	assert(fname);
-
-	process_files(fname, "/dev", dev_callback);
-
+void build_dev(FILE *fp) {
 	if (dev_out == NULL)
 		fprintf(fp, "private-dev\n");
 	else {
 		fprintf(fp, "#private-dev\n");
 		fprintf(fp, "# This is the list of devices accessed on top of regular private-dev devices:\n");
 		fprintf(fp, "# ");
-		FileDB *ptr = dev_out;
-		while (ptr) {
-			fprintf(fp, "%s,", ptr->fname);
-			ptr = ptr->next;
-		}
+		filedb_print_list(dev_out, fp);
 		fprintf(fp, "\n");
 	}
 }
+
+//*******************************************
+// trace handlers
+//*******************************************
+void build_fs_handlers(void) {
+	unsigned kinds = TRACE_FILE | TRACE_CONNECT;
+
+	trace_add_handler(kinds, "/etc", etc_callback);
+
+	var_skip = filedb_load_whitelist(var_skip, "whitelist-var-common.inc", "whitelist /var/");
+	trace_add_handler(kinds, "/var", var_callback);
+
+	run_skip = filedb_load_whitelist(run_skip, "whitelist-run-common.inc", "whitelist /run/");
+	trace_add_handler(kinds, "/run", run_callback);
+
+	if (asprintf(&runuser_fname, "/run/user/%d", getuid()) < 0)
+		errExit("asprintf");
+	if (is_dir(runuser_fname)) {
+		runuser_skip = filedb_load_whitelist(runuser_skip, "whitelist-runuser-common.inc", "whitelist ${RUNUSER}/");
+		trace_add_handler(kinds, runuser_fname, runuser_callback);
+	}
+	else {
+		free(runuser_fname);
+		runuser_fname = NULL;
+	}
+
+	if (!arg_appimage) {
+		share_skip = filedb_load_whitelist(share_skip, "whitelist-usr-share-common.inc", "whitelist /usr/share/");
+		trace_add_handler(kinds, "/usr/share", share_callback);
+	}
+
+	trace_add_handler(kinds, "/tmp", tmp_callback);
+	trace_add_handler(kinds, "/dev", dev_callback);
+}
@@ -20,6 +20,8 @@
 
 #include "fbuilder.h"
 #include <sys/wait.h>
+#include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
@@ -61,6 +63,24 @@ static int parse_build_timeout(int argc, char **argv, int prog_index) {
 	return 0;
 }
 
+// the strace log is parsed on a thread of its own while the trace is processed,
+// the seccomp section is kept in memory until it is printed
+typedef struct {
+	const char *fname;
+	char *buf;
+	size_t len;
+} SeccompJob;
+
+static void *seccomp_thread(void *arg) {
+	SeccompJob *job = arg;
+	FILE *fp = open_memstream(&job->buf, &job->len);
+	if (!fp)
+		errExit("open_memstream");
+	build_seccomp(job->fname, fp);
+	fclose(fp);
+	return NULL;
+}
+
 static void kill_process_group(pid_t pgid) {
 	// terminate nicely first
 	kill(-pgid, SIGTERM);
@@ -189,6 +209,24 @@ void build_profile(int argc, char **argv, int index, FILE *fp) {
 		(void)waitpid(child, &status, 0);
 	}
 
+	// IMPORTANT: pass the STRACE syscall log here (not the firejail --trace log)
+	SeccompJob seccomp_job = { syscall_output, NULL, 0 };
+	pthread_t seccomp_tid;
+	int rv = pthread_create(&seccomp_tid, NULL, seccomp_thread, &seccomp_job);
+	if (rv) {
+		errno = rv;
+		errExit("pthread_create");
+	}
+
+	// read the trace once, the builders collect the records they need
+	build_home_handlers();
+	build_fs_handlers();
+	build_protocol_handlers();
+	if (!arg_appimage)
+		build_bin_handlers();
+	trace_process(trace_output);
+	pthread_join(seccomp_tid, NULL);
+
 	// Always emit the profile, even if the sandbox was killed by timeout/signal.
 	if (fp == stdout)
 		printf("--- Built profile begins after this line ---\n");
@@ -222,15 +260,15 @@ void build_profile(int argc, char **argv, int index, FILE *fp) {
 	fprintf(fp, "### Home Directory Whitelisting ###\n");
 	fprintf(fp, "### If something goes wrong, this section is the first one to comment out.\n");
 	fprintf(fp, "### Instead, you'll have to relay on the basic blacklisting above.\n");
-	build_home(trace_output, fp);
+	build_home(fp);
 	fprintf(fp, "\n");
 
 	fprintf(fp, "### Filesystem Whitelisting ###\n");
-	build_run(trace_output, fp);
-	build_runuser(trace_output, fp);
+	build_run(fp);
+	build_runuser(fp);
 	if (!arg_appimage)
-		build_share(trace_output, fp);
-	build_var(trace_output, fp);
+		build_share(fp);
+	build_var(fp);
 	fprintf(fp, "\n");
 
 	fprintf(fp, "#apparmor\t# if you have AppArmor running, try this one!\n");
@@ -251,22 +289,22 @@ void build_profile(int argc, char **argv, int index, FILE *fp) {
 	fprintf(fp, "#notv\t# disable DVB TV devices\n");
 	fprintf(fp, "#nou2f\t# disable U2F devices\n");
 	fprintf(fp, "#novideo\t# disable video capture devices\n");
-	build_protocol(trace_output, fp);
+	build_protocol(fp);
 
-	// IMPORTANT: pass the STRACE syscall log here (not the firejail --trace log)
-	build_seccomp(syscall_output, fp);
+	fwrite(seccomp_job.buf, 1, seccomp_job.len, fp);
+	free(seccomp_job.buf);
 
 	fprintf(fp, "#tracelog\t# send blacklist violations to syslog\n");
 	fprintf(fp, "\n");
 
 	fprintf(fp, "#disable-mnt\t# no access to /mnt, /media, /run/mount and /run/media\n");
 	if (!arg_appimage)
-		build_bin(trace_output, fp);
+		build_bin(fp);
 	fprintf(fp, "#private-cache\t# run with an empty ~/.cache directory\n");
-	build_dev(trace_output, fp);
-	build_etc(trace_output, fp);
+	build_dev(fp);
+	build_etc(fp);
 	fprintf(fp, "#private-lib\n");
-	build_tmp(trace_output, fp);
+	build_tmp(fp);
 	fprintf(fp, "\n");
 
 	fprintf(fp, "#dbus-user none\n");
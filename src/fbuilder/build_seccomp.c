@@ -175,76 +175,27 @@ static int netlink = 0;
 static int packet = 0;
 static int bluetooth = 0;
 
-static void process_protocol(const char *fname) {
-	assert(fname);
-
-	FILE *fp = fopen(fname, "r");
-	if (!fp) {
-		fprintf(stderr, "Error fbuilder: cannot open %s\n", fname);
-		exit(1);
-	}
-
-	char buf[MAX_BUF];
-	while (fgets(buf, MAX_BUF, fp)) {
-		char *ptr = strchr(buf, '\n');
-		if (ptr)
-			*ptr = '\0';
-
-		// parse line: 4:prog:socket AF_INET ...:0
-		ptr = buf;
-		if (!isdigit((unsigned char)*ptr))
-			continue;
-		while (isdigit((unsigned char)*ptr))
-			ptr++;
-		if (*ptr != ':')
-			continue;
-		ptr++;
-
-		ptr = strchr(ptr, ':');
-		if (!ptr)
-			continue;
-		ptr++;
-		if (strncmp(ptr, "socket ", 7) == 0)
-			ptr += 7;
-		else
-			continue;
-
-		if (strncmp(ptr, "AF_LOCAL ", 9) == 0)
-			unix_s = 1;
-		else if (strncmp(ptr, "AF_INET ", 8) == 0)
-			inet = 1;
-		else if (strncmp(ptr, "AF_INET6 ", 9) == 0)
-			inet6 = 1;
-		else if (strncmp(ptr, "AF_NETLINK ", 11) == 0)
-			netlink = 1;
-		else if (strncmp(ptr, "AF_PACKET ", 10) == 0)
-			packet = 1;
-		else if (strncmp(ptr, "AF_BLUETOOTH ", 13) == 0)
-			bluetooth = 1;
-	}
-
-	fclose(fp);
+static void protocol_callback(char *ptr) {
+	if (strncmp(ptr, "AF_LOCAL ", 9) == 0)
+		unix_s = 1;
+	else if (strncmp(ptr, "AF_INET ", 8) == 0)
+		inet = 1;
+	else if (strncmp(ptr, "AF_INET6 ", 9) == 0)
+		inet6 = 1;
+	else if (strncmp(ptr, "AF_NETLINK ", 11) == 0)
+		netlink = 1;
+	else if (strncmp(ptr, "AF_PACKET ", 10) == 0)
+		packet = 1;
+	else if (strncmp(ptr, "AF_BLUETOOTH ", 13) == 0)
+		bluetooth = 1;
 }
 
-// process fname, fname.1, fname.2, fname.3, fname.4, fname.5
-void build_protocol(const char *fname, FILE *fp) {
-	assert(fname);
-
-	// reset (important if build_protocol is called more than once)
+void build_protocol_handlers(void) {
 	unix_s = inet = inet6 = netlink = packet = bluetooth = 0;
+	trace_add_handler(TRACE_SOCKET, NULL, protocol_callback);
+}
 
-	process_protocol(fname);
-
-	struct stat s;
-	for (int i = 1; i <= 5; i++) {
-		char *newname;
-		if (asprintf(&newname, "%s.%d", fname, i) == -1)
-			errExit("asprintf");
-		if (stat(newname, &s) == 0)
-			process_protocol(newname);
-		free(newname);
-	}
-
+void build_protocol(FILE *fp) {
 	int net = 0;
 	if (unix_s || inet || inet6 || netlink || packet || bluetooth) {
 		fprintf(fp, "protocol ");
@@ -39,37 +39,46 @@ void build_profile(int argc, char **argv, int index, FILE *fp);
 
 // build_seccomp.c
 void build_seccomp(const char *fname, FILE *fp);
-void build_protocol(const char *fname, FILE *fp);
+void build_protocol_handlers(void);
+void build_protocol(FILE *fp);
 
 // build_fs.c
-void build_etc(const char *fname, FILE *fp);
-void build_var(const char *fname, FILE *fp);
-void build_tmp(const char *fname, FILE *fp);
-void build_dev(const char *fname, FILE *fp);
-void build_share(const char *fname, FILE *fp);
-void build_run(const char *fname, FILE *fp);
-void build_runuser(const char *fname, FILE *fp);
+void build_fs_handlers(void);
+void build_etc(FILE *fp);
+void build_var(FILE *fp);
+void build_tmp(FILE *fp);
+void build_dev(FILE *fp);
+void build_share(FILE *fp);
+void build_run(FILE *fp);
+void build_runuser(FILE *fp);
 
 // build_bin.c
-void build_bin(const char *fname, FILE *fp);
+void build_bin_handlers(void);
+void build_bin(FILE *fp);
 
 // build_home.c
-void build_home(const char *fname, FILE *fp);
+void build_home_handlers(void);
+void build_home(FILE *fp);
+
+// trace.c
+#define TRACE_FILE	1	// access, fopen, fopen64, open, open64, opendir
+#define TRACE_CONNECT	2	// connect to a unix socket path
+#define TRACE_EXEC	4
+#define TRACE_SOCKET	8
+void trace_add_handler(unsigned kinds, const char *dir, void (*callback)(char *arg));
+void trace_process(const char *fname);
 
 // utils.c
 int is_dir(const char *fname);
 char *extract_dir(char *fname);
 
 // filedb.c
-typedef struct filedb_t {
-	struct filedb_t *next;
-	char *fname;	// file name
-	unsigned len;	// length of file name
-} FileDB;
+typedef struct filedb_t FileDB;
 
-FileDB *filedb_add(FileDB *head, const char *fname);
-FileDB *filedb_find(FileDB *head, const char *fname);
-void filedb_print(FileDB *head, const char *prefix, FILE *fp);
-FileDB *filedb_load_whitelist(FileDB *head, const char *fname, const char *prefix);
+FileDB *filedb_add(FileDB *db, const char *fname);
+int filedb_find(FileDB *db, const char *fname);
+void filedb_print(FileDB *db, const char *prefix, FILE *fp);
+void filedb_print_list(FileDB *db, FILE *fp);
+FileDB *filedb_load_whitelist(FileDB *db, const char *fname, const char *prefix);
 
 #endif
@@ -20,72 +20,209 @@
 
 #include "fbuilder.h"
 
-// find exact name or an exact name in a parent directory
-FileDB *filedb_find(FileDB *head, const char *fname) {
-	assert(fname);
-	FileDB *ptr = head;
-	int found = 0;
-
-	while (ptr) {
-		// ptr->fname can be a pattern, like .mutter-Xwaylandauth.*
-		// check if fname is a match
-		if (fnmatch(ptr->fname, fname, FNM_PATHNAME) == 0) {
-			found = 1;
-			break;
-		}
+// The files are stored in a trie of path components, the children of a node
+// are kept sorted. A file is found if it is in the trie or if one of its
+// parent directories is; a file added under a directory already in the trie
+// is dropped, and a directory added after some of its files replaces them.
+// The entries with wildcards (.mutter-Xwaylandauth.* in the skip lists) are
+// matched with fnmatch() as before.
+typedef struct fnode_t {
+	char *name;		// path component
+	unsigned len;
+	char *fname;		// file name if this is an entry, NULL otherwise
+	unsigned cnt;		// children
+	unsigned size;
+	struct fnode_t **child;
+} FNode;
 
-		// parent directory in the list
-		if (strlen(fname) > ptr->len &&
-		    fname[ptr->len] == '/' &&
-		    strncmp(ptr->fname, fname, ptr->len) == 0) {
-			found = 1;
-			break;
+struct filedb_t {
+	FNode root;
+	char **patterns;
+	unsigned patterns_cnt;
+};
+
+// next path component, NULL at the end of the path
+static const char *next_component(const char *path, unsigned *len) {
+	while (*path == '/')
+		path++;
+	if (*path == '\0')
+		return NULL;
+	const char *end = strchrnul(path, '/');
+	*len = end - path;
+	return path;
+}
+
+static int component_cmp(const char *name1, unsigned len1, const char *name2, unsigned len2) {
+	int rv = memcmp(name1, name2, (len1 < len2) ? len1 : len2);
+	if (rv)
+		return rv;
+	return (len1 > len2) - (len1 < len2);
+}
+
+// index of the child, or the insertion point if not found
+static unsigned child_index(const FNode *node, const char *name, unsigned len, int *found) {
+	unsigned lo = 0;
+	unsigned hi = node->cnt;
+	*found = 0;
+	while (lo < hi) {
+		unsigned mid = (lo + hi) / 2;
+		int rv = component_cmp(name, len, node->child[mid]->name, node->child[mid]->len);
+		if (rv == 0) {
+			*found = 1;
+			return mid;
 		}
+		if (rv < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
 
-		ptr = ptr->next;
+static FNode *child_add(FNode *node, unsigned index, const char *name, unsigned len) {
+	if (node->cnt == node->size) {
+		node->size = (node->size) ? node->size * 2 : 4;
+		node->child = realloc(node->child, node->size * sizeof(FNode *));
+		if (!node->child)
+			errExit("realloc");
 	}
+	FNode *rv = malloc(sizeof(FNode));
+	if (!rv)
+		errExit("malloc");
+	memset(rv, 0, sizeof(FNode));
+	rv->name = strndup(name, len);
+	if (!rv->name)
+		errExit("strndup");
+	rv->len = len;
 
-	if (found)
-		return ptr;
+	memmove(&node->child[index + 1], &node->child[index], (node->cnt - index) * sizeof(FNode *));
+	node->child[index] = rv;
+	node->cnt++;
+	return rv;
+}
+
+static void node_free(FNode *node) {
+	unsigned i;
+	for (i = 0; i < node->cnt; i++) {
+		node_free(node->child[i]);
+		free(node->child[i]);
+	}
+	free(node->child);
+	free(node->name);
+	free(node->fname);
+	node->child = NULL;
+	node->cnt = 0;
+	node->size = 0;
+	node->name = NULL;
+	node->fname = NULL;
+}
 
-	return NULL;
+static int is_pattern(const char *fname) {
+	return strpbrk(fname, "*?[") != NULL;
 }
 
-FileDB *filedb_add(FileDB *head, const char *fname) {
+// find exact name or an exact name in a parent directory
+int filedb_find(FileDB *db, const char *fname) {
 	assert(fname);
+	if (!db)
+		return 0;
+
+	// fname can be matched by a pattern, like .mutter-Xwaylandauth.*
+	unsigned i;
+	for (i = 0; i < db->patterns_cnt; i++) {
+		if (fnmatch(db->patterns[i], fname, FNM_PATHNAME) == 0)
+			return 1;
+	}
+
+	const FNode *node = &db->root;
+	const char *ptr = fname;
+	unsigned len;
+	while ((ptr = next_component(ptr, &len)) != NULL) {
+		int found;
+		unsigned index = child_index(node, ptr, len, &found);
+		if (!found)
+			return 0;
+		node = node->child[index];
+		if (node->fname)
+			return 1;
+		ptr += len;
+	}
+	return 0;
+}
+
+FileDB *filedb_add(FileDB *db, const char *fname) {
+	assert(fname);
+
+	if (!db) {
+		db = malloc(sizeof(FileDB));
+		if (!db)
+			errExit("malloc");
+		memset(db, 0, sizeof(FileDB));
+	}
 
 	// don't add it if it is already there or if the parent directory is already in the list
-	if (filedb_find(head, fname))
-		return head;
+	if (filedb_find(db, fname))
+		return db;
 
-	// add a new entry
-	FileDB *entry = malloc(sizeof(FileDB));
-	if (!entry)
-		errExit("malloc");
-	memset(entry, 0, sizeof(FileDB));
-	entry->fname = strdup(fname);
-	if (!entry->fname)
+	FNode *node = &db->root;
+	const char *ptr = fname;
+	unsigned len;
+	while ((ptr = next_component(ptr, &len)) != NULL) {
+		int found;
+		unsigned index = child_index(node, ptr, len, &found);
+		node = (found) ? node->child[index] : child_add(node, index, ptr, len);
+		ptr += len;
+	}
+	if (node == &db->root)	// empty name or "/"
+		return db;
+
+	// the files already stored under this directory are not needed anymore
+	unsigned i;
+	for (i = 0; i < node->cnt; i++) {
+		node_free(node->child[i]);
+		free(node->child[i]);
+	}
+	node->cnt = 0;
+
+	node->fname = strdup(fname);
+	if (!node->fname)
 		errExit("strdup");
-	entry->len = strlen(entry->fname);
-	entry->next = head;
-	return entry;
-};
 
-void filedb_print(FileDB *head, const char *prefix, FILE *fp) {
-	assert(head);
+	if (is_pattern(fname)) {
+		db->patterns = realloc(db->patterns, (db->patterns_cnt + 1) * sizeof(char *));
+		if (!db->patterns)
+			errExit("realloc");
+		db->patterns[db->patterns_cnt] = strdup(fname);
+		if (!db->patterns[db->patterns_cnt])
+			errExit("strdup");
+		db->patterns_cnt++;
+	}
+	return db;
+}
+
+// the entries in sorted order
+static void node_print(const FNode *node, const char *prefix, const char *sep, FILE *fp) {
+	if (node->fname)
+		fprintf(fp, "%s%s%s", prefix, node->fname, sep);
+	unsigned i;
+	for (i = 0; i < node->cnt; i++)
+		node_print(node->child[i], prefix, sep, fp);
+}
+
+// one entry per line
+void filedb_print(FileDB *db, const char *prefix, FILE *fp) {
+	assert(db);
 	assert(prefix);
+	node_print(&db->root, prefix, "\n", (fp) ? fp : stdout);
+}
 
-	FileDB *ptr = head;
-	while (ptr) {
-		if (fp)
-			fprintf(fp, "%s%s\n", prefix, ptr->fname);
-		else
-			printf("%s%s\n", prefix, ptr->fname);
-		ptr = ptr->next;
-	}
+// comma-separated list, as used by private-etc etc.
+void filedb_print_list(FileDB *db, FILE *fp) {
+	assert(db);
+	node_print(&db->root, "", ",", (fp) ? fp : stdout);
 }
 
-FileDB *filedb_load_whitelist(FileDB *head, const char *fname, const char *prefix) {
+FileDB *filedb_load_whitelist(FileDB *db, const char *fname, const char *prefix) {
 	assert(fname);
 	assert(prefix);
 	int len = strlen(prefix);
@@ -111,13 +248,13 @@ FileDB *filedb_load_whitelist(FileDB *head, const char *fname, const char *prefi
 		*ptr = '\0';
 
 		// add the file to skip list
-		head = filedb_add(head, fn);
+		db = filedb_add(db, fn);
 	}
 
 	fclose(fp);
 	free(f);
 //printf("***************************************************\n");
-//filedb_print(head, prefix, NULL);
+//filedb_print(db, prefix, NULL);
 //printf("***************************************************\n");
-	return head;
+	return db;
 }
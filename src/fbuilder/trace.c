@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// The trace files are read once: every line is parsed, and the records not
+// seen before are stored in an index. A large program repeats the same few
+// thousand records millions of times, the duplicates are dropped with a hash
+// set before any builder sees them.
+//
+// The handlers registered by the builders do not share any state, they run
+// in parallel on worker threads over the index once the parsing is done.
+
+#include "fbuilder.h"
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_HANDLERS 16
+
+typedef struct {
+	unsigned kinds;		// TRACE_FILE etc.
+	const char *dir;	// path prefix, NULL for all the records
+	size_t dir_len;
+	void (*callback)(char *arg);
+} TraceHandler;
+
+static TraceHandler handlers[MAX_HANDLERS];
+static int handlers_cnt = 0;
+
+// distinct records, in the trace order
+typedef struct {
+	unsigned kind;
+	const char *arg;	// in the hash set key, read-only
+} TraceRecord;
+
+static TraceRecord *records = NULL;
+static size_t records_cnt = 0;
+static size_t records_size = 0;
+
+void trace_add_handler(unsigned kinds, const char *dir, void (*callback)(char *arg)) {
+	assert(callback);
+	assert(handlers_cnt < MAX_HANDLERS);
+	TraceHandler *h = &handlers[handlers_cnt++];
+	h->kinds = kinds;
+	h->dir = dir;
+	h->dir_len = (dir) ? strlen(dir) : 0;
+	h->callback = callback;
+}
+
+//*******************************************
+// records seen, open addressing
+//*******************************************
+static char **seen = NULL;
+static size_t seen_size = 0;	// power of 2
+static size_t seen_cnt = 0;
+
+static void seen_insert(char *str) {
+	size_t i = fnv1a32_str(str) & (seen_size - 1);
+	while (seen[i])
+		i = (i + 1) & (seen_size - 1);
+	seen[i] = str;
+}
+
+static void seen_resize(void) {
+	char **old = seen;
+	size_t old_size = seen_size;
+	seen_size = (seen_size) ? seen_size * 2 : 4096;
+	seen = calloc(seen_size, sizeof(char *));
+	if (!seen)
+		errExit("calloc");
+	size_t i;
+	for (i = 0; i < old_size; i++) {
+		if (old[i])
+			seen_insert(old[i]);
+	}
+	free(old);
+}
+
+// return the key stored in the set, NULL if it was already there
+static const char *seen_add(const char *key) {
+	if (2 * (seen_cnt + 1) > seen_size)
+		seen_resize();
+
+	size_t i = fnv1a32_str(key) & (seen_size - 1);
+	while (seen[i]) {
+		if (strcmp(seen[i], key) == 0)
+			return NULL;
+		i = (i + 1) & (seen_size - 1);
+	}
+	seen[i] = strdup(key);
+	if (!seen[i])
+		errExit("strdup");
+	seen_cnt++;
+	return seen[i];
+}
+
+//*******************************************
+// trace file parsing
+//*******************************************
+static const struct {
+	const char *name;
+	unsigned kind;
+} calls[] = {
+	{ "access ", TRACE_FILE },
+	{ "fopen ", TRACE_FILE },
+	{ "fopen64 ", TRACE_FILE },
+	{ "open64 ", TRACE_FILE },
+	{ "open ", TRACE_FILE },
+	{ "opendir ", TRACE_FILE },
+	{ "connect ", TRACE_CONNECT },
+	{ "exec ", TRACE_EXEC },
+	{ "socket ", TRACE_SOCKET },
+	{ NULL, 0 }
+};
+
+static void record_add(unsigned kind, const char *arg) {
+	// the key is the record kind followed by the argument
+	char key[MAX_BUF + 1];
+	key[0] = (char) ('0' + kind);
+	snprintf(key + 1, sizeof(key) - 1, "%s", arg);
+	const char *str = seen_add(key);
+	if (!str)
+		return;
+
+	if (records_cnt == records_size) {
+		records_size = (records_size) ? records_size * 2 : 4096;
+		records = realloc(records, records_size * sizeof(TraceRecord));
+		if (!records)
+			errExit("realloc");
+	}
+	records[records_cnt].kind = kind;
+	records[records_cnt].arg = str + 1;
+	records_cnt++;
+}
+
+//*******************************************
+// handlers
+//*******************************************
+static void run_handler(TraceHandler *h) {
+	size_t i;
+	for (i = 0; i < records_cnt; i++) {
+		TraceRecord *rec = &records[i];
+		if ((h->kinds & rec->kind) == 0)
+			continue;
+		if (h->dir && strncmp(rec->arg, h->dir, h->dir_len) != 0)
+			continue;
+
+		// the callbacks are allowed to modify the string
+		char buf[MAX_BUF];
+		snprintf(buf, sizeof(buf), "%s", rec->arg);
+		h->callback(buf);
+	}
+}
+
+static int next_handler = 0;
+
+static void *handler_thread(void *arg) {
+	(void) arg;
+	int i;
+	while ((i = __atomic_fetch_add(&next_handler, 1, __ATOMIC_RELAXED)) < handlers_cnt)
+		run_handler(&handlers[i]);
+	return NULL;
+}
+
+// one worker thread per handler, no more than the number of processors
+static void run_handlers(void) {
+	long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = (nproc > 0 && nproc < handlers_cnt) ? (int) nproc : handlers_cnt;
+	if (threads <= 1 || records_cnt == 0) {
+		int i;
+		for (i = 0; i < handlers_cnt; i++)
+			run_handler(&handlers[i]);
+		return;
+	}
+
+	pthread_t tid[MAX_HANDLERS];
+	int i;
+	for (i = 0; i < threads; i++) {
+		int rv = pthread_create(&tid[i], NULL, handler_thread, NULL);
+		if (rv) {
+			errno = rv;
+			errExit("pthread_create");
+		}
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+}
+
+static void process_file(const char *fname) {
+	assert(fname);
+
+	FILE *fp = fopen(fname, "r");
+	if (!fp) {
+		fprintf(stderr, "Error fbuilder: cannot open %s\n", fname);
+		exit(1);
+	}
+
+	char buf[MAX_BUF];
+	while (fgets(buf, MAX_BUF, fp)) {
+		// remove \n
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+
+		// parse line: 4:galculator:access /etc/fonts/conf.d:0
+		// number followed by :
+		ptr = buf;
+		if (!isdigit((unsigned char) *ptr))
+			continue;
+		while (isdigit((unsigned char) *ptr))
+			ptr++;
+		if (*ptr != ':')
+			continue;
+		ptr++;
+
+		// next :
+		ptr = strchr(ptr, ':');
+		if (!ptr)
+			continue;
+		ptr++;
+
+		int i;
+		for (i = 0; calls[i].name; i++) {
+			size_t len = strlen(calls[i].name);
+			if (strncmp(ptr, calls[i].name, len) == 0) {
+				ptr += len;
+				break;
+			}
+		}
+		unsigned kind = calls[i].kind;
+		if (kind == 0)
+			continue;
+
+		if (kind == TRACE_CONNECT) {
+			// file descriptor argument, followed by a socket path
+			if (!isdigit((unsigned char) *ptr))
+				continue;
+			while (isdigit((unsigned char) *ptr))
+				ptr++;
+			if (*ptr++ != ' ')
+				continue;
+			if (*ptr != '/')
+				continue;
+		}
+
+		// end of the argument
+		char *ptr2 = strchr(ptr, ':');
+		if (!ptr2)
+			continue;
+		*ptr2 = '\0';
+
+		record_add(kind, ptr);
+	}
+
+	fclose(fp);
+}
+
+// process fname, fname.1, fname.2, fname.3, fname.4, fname.5, and run the handlers
+void trace_process(const char *fname) {
+	assert(fname);
+
+	process_file(fname);
+
+	struct stat s;
+	int i;
+	for (i = 1; i <= 5; i++) {
+		char *newname;
+		if (asprintf(&newname, "%s.%d", fname, i) == -1)
+			errExit("asprintf");
+		if (stat(newname, &s) == 0)
+			process_file(newname);
+		free(newname);
+	}
+
+	if (arg_debug)
+		printf("%zu distinct trace records\n", records_cnt);
+	run_handlers();
+}
@@ -22,6 +22,7 @@
 #include <ftw.h>
 #include <errno.h>
 #include <pwd.h>
+#include <pthread.h>
 
 #include <fcntl.h>
 #ifndef O_PATH
@@ -42,18 +43,49 @@ int arg_debug = 0;
 static int arg_follow_link = 0;
 
 static unsigned long copy_limit = 500 * 1024 * 1024; // 500 MB
+static unsigned long copy_count_limit = 0; // number of files, 0 for no limit
 static unsigned long size_cnt = 0;
 static int size_limit_reached = 0;
 static unsigned file_cnt = 0;
 
+// totals for all the entries, reported to firejail in FIREJAIL_FCOPY_STATS
+static unsigned long long total_bytes = 0;
+static unsigned long total_files = 0;
+
 static char *outpath = NULL;
 static char *inpath = NULL;
 
 #if HAVE_SELINUX
 static struct selabel_handle *label_hnd = NULL;
 static int selinux_enabled = -1;
+static pthread_mutex_t selinux_mutex = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
+// the trees are walked and the directories are created by the main thread,
+// regular files are copied by a pool of worker threads; the pool is started
+// with the first file, and it is shared by all the entries of a batch
+#define COPY_MAX_THREADS 8
+#define COPY_QUEUE_LEN 256
+
+typedef struct copy_job_t {
+	char *infname;
+	char *outfname;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+} CopyJob;
+
+static CopyJob job_queue[COPY_QUEUE_LEN];
+static int job_head = 0;
+static int job_cnt = 0;
+static int job_end = 0;
+static int workers = 0;
+static int workers_started = 0;
+static pthread_t worker_thread[COPY_MAX_THREADS];
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_slot = PTHREAD_COND_INITIALIZER;
+
 // copy from firejail/selinux.c
 static void selinux_relabel_path(const char *path, const char *inside_path) {
 	assert(path);
@@ -64,14 +96,18 @@ static void selinux_relabel_path(const char *path, const char *inside_path) {
 	int fd;
 	struct stat st;
 
+	pthread_mutex_lock(&selinux_mutex);
 	if (selinux_enabled == -1)
 		selinux_enabled = is_selinux_enabled();
 
-	if (!selinux_enabled)
+	if (!selinux_enabled) {
+		pthread_mutex_unlock(&selinux_mutex);
 		return;
+	}
 
 	if (!label_hnd)
 		label_hnd = selabel_open(SELABEL_CTX_FILE, NULL, 0);
+	pthread_mutex_unlock(&selinux_mutex);
 
 	if (!label_hnd)
 		errExit("selabel_open");
@@ -119,9 +155,13 @@ static void copy_file(const char *srcname, const char *destname, mode_t mode, ui
 		return;
 	}
 
-	// open destination
-	int dst = open(destname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR);
+	// open destination; another entry of the batch could be copying it
+	int dst = open(destname, O_CREAT|O_EXCL|O_WRONLY, S_IRUSR | S_IWUSR);
 	if (dst < 0) {
+		if (errno == EEXIST) {
+			close(src);
+			return;
+		}
 		if (!arg_quiet)
 			fprintf(stderr, "Warning fcopy: cannot open %s, file not copied\n", destname);
 		close(src);
@@ -129,19 +169,7 @@ static void copy_file(const char *srcname, const char *destname, mode_t mode, ui
 	}
 
 	// copy
-	ssize_t len;
-	static const int BUFLEN = 1024;
-	unsigned char buf[BUFLEN];
-	while ((len = read(src, buf, BUFLEN)) > 0) {
-		int done = 0;
-		while (done != len) {
-			int rv = write(dst, buf + done, len - done);
-			if (rv == -1)
-				goto errexit;
-			done += rv;
-		}
-	}
-	if (len < 0)
+	if (copy_fd_data(src, dst))
 		goto errexit;
 
 	if (fchown(dst, uid, gid) == -1)
@@ -165,6 +193,88 @@ errexit:
 }
 
 
+static void *copy_worker(void *arg) {
+	(void) arg;
+	while (1) {
+		pthread_mutex_lock(&job_mutex);
+		while (job_cnt == 0 && !job_end)
+			pthread_cond_wait(&job_available, &job_mutex);
+		if (job_cnt == 0) {
+			pthread_mutex_unlock(&job_mutex);
+			return NULL;
+		}
+		CopyJob job = job_queue[job_head];
+		job_head = (job_head + 1) % COPY_QUEUE_LEN;
+		job_cnt--;
+		pthread_cond_signal(&job_slot);
+		pthread_mutex_unlock(&job_mutex);
+
+		copy_file(job.infname, job.outfname, job.mode, job.uid, job.gid);
+		free(job.infname);
+		free(job.outfname);
+	}
+}
+
+static void start_workers(void) {
+	workers_started = 1;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus <= 1)
+		return;
+	if (cpus > COPY_MAX_THREADS)
+		cpus = COPY_MAX_THREADS;
+
+	job_end = 0;
+	for (workers = 0; workers < cpus; workers++) {
+		if (pthread_create(&worker_thread[workers], NULL, copy_worker, NULL))
+			break;	// keep going with the threads already started
+	}
+	if (arg_debug)
+		printf("fcopy: %d copy threads\n", workers);
+}
+
+static void stop_workers(void) {
+	if (!workers)
+		return;
+
+	pthread_mutex_lock(&job_mutex);
+	job_end = 1;
+	pthread_cond_broadcast(&job_available);
+	pthread_mutex_unlock(&job_mutex);
+
+	int i;
+	for (i = 0; i < workers; i++)
+		pthread_join(worker_thread[i], NULL);
+	workers = 0;
+}
+
+// copy the file in a worker thread, or directly if no threads are running
+static void queue_copy_file(const char *srcname, const char *destname, mode_t mode, uid_t uid, gid_t gid) {
+	if (!workers_started)
+		start_workers();
+	if (!workers) {
+		copy_file(srcname, destname, mode, uid, gid);
+		return;
+	}
+
+	CopyJob job = {
+		.infname = strdup(srcname),
+		.outfname = strdup(destname),
+		.mode = mode,
+		.uid = uid,
+		.gid = gid
+	};
+	if (!job.infname || !job.outfname)
+		errExit("strdup");
+
+	pthread_mutex_lock(&job_mutex);
+	while (job_cnt == COPY_QUEUE_LEN)
+		pthread_cond_wait(&job_slot, &job_mutex);
+	job_queue[(job_head + job_cnt) % COPY_QUEUE_LEN] = job;
+	job_cnt++;
+	pthread_cond_signal(&job_available);
+	pthread_mutex_unlock(&job_mutex);
+}
+
 // modified version of the function in firejail/util.c
 static void mkdir_attr(const char *fname, mode_t mode, uid_t uid, gid_t gid) {
 	assert(fname);
@@ -292,18 +402,27 @@ static int fs_copydir(const char *infname, const struct stat *st, int ftype, str
 	gid_t gid = s.st_gid;
 	mode_t mode = s.st_mode;
 
-	// recalculate size
+	// recalculate size; stop the walk as soon as a limit is reached
 	if ((s.st_size + size_cnt) > copy_limit) {
 		fprintf(stderr, "Error fcopy: size limit of %lu MB reached\n", (copy_limit / 1024) / 1024);
 		size_limit_reached = 1;
-		goto out;
+		free(outfname);
+		return 1;
+	}
+	if (copy_count_limit && file_cnt >= copy_count_limit) {
+		fprintf(stderr, "Error fcopy: file count limit of %lu reached\n", copy_count_limit);
+		size_limit_reached = 1;
+		free(outfname);
+		return 1;
 	}
 
 	file_cnt++;
 	size_cnt += s.st_size;
+	total_files++;
+	total_bytes += s.st_size;
 
 	if(ftype == FTW_F) {
-		copy_file(infname, outfname, mode, uid, gid);
+		queue_copy_file(infname, outfname, mode, uid, gid);
 	}
 	else if (ftype == FTW_D) {
 		mkdir_attr(outfname, mode, uid, gid);
@@ -411,7 +530,8 @@ static void duplicate_dir(const char *src, const char *dest, struct stat *s) {
 	outpath = rdest;
 
 	// walk
-	if(nftw(rsrc, fs_copydir, 1, FTW_PHYS) != 0) {
+	int rv = nftw(rsrc, fs_copydir, 1, FTW_PHYS);
+	if (rv != 0 && !size_limit_reached) {
 		fprintf(stderr, "Error: unable to copy file\n");
 		exit(1);
 	}
@@ -436,7 +556,9 @@ static void duplicate_file(const char *src, const char *dest, struct stat *s) {
 		errExit("asprintf");
 
 	// copy
-	copy_file(rsrc, name, mode, uid, gid);
+	queue_copy_file(rsrc, name, mode, uid, gid);
+	total_files++;
+	total_bytes += s->st_size;
 
 	free(name);
 	free(rsrc);
@@ -469,17 +591,131 @@ static void duplicate_link(const char *src, const char *dest, struct stat *s) {
 
 static const char *const usage_str =
 	"Usage: fcopy [--follow-link] src dest\n"
+	"       fcopy [--follow-link] --batch\n"
 	"\n"
 	"Copy SRC to DEST/SRC. SRC may be a file, directory, or symbolic link.\n"
 	"If SRC is a directory it is copied recursively.  If it is a symlink,\n"
 	"the link itself is duplicated, unless --follow-link is given,\n"
 	"in which case the destination of the link is copied.\n"
-	"DEST must already exist and must be a directory.\n";
+	"DEST must already exist and must be a directory.\n"
+	"\n"
+	"With --batch, a list of NUL-separated SRC and DEST pairs is read\n"
+	"from stdin, and every pair is copied as above.\n";
 
 static void usage(void) {
 	fputs(usage_str, stderr);
 }
 
+// append the number of files and bytes copied to the file in
+// FIREJAIL_FCOPY_STATS; the file is created by firejail
+static void report_stats(void) {
+	const char *fname = getenv("FIREJAIL_FCOPY_STATS");
+	if (!fname || *fname == '\0')
+		return;
+
+	int fd = open(fname, O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return;
+	char buf[64];
+	int len = snprintf(buf, sizeof(buf), "%lu %llu\n", total_files, total_bytes);
+	ssize_t rv = write(fd, buf, len);
+	(void) rv;
+	close(fd);
+}
+
+static void copy_entry(char *src, char *dest) {
+	assert(src);
+	assert(dest);
+
+	// the size limit applies to every entry
+	size_cnt = 0;
+	file_cnt = 0;
+	size_limit_reached = 0;
+	first = 1;
+
+	// check the two files; remove ending /
+	size_t len = strlen(src);
+	while (len > 1 && src[len - 1] == '/')
+		src[--len] = '\0';
+	reject_meta_chars(src, 0);
+
+	len = strlen(dest);
+	while (len > 1 && dest[len - 1] == '/')
+		dest[--len] = '\0';
+	reject_meta_chars(dest, 0);
+
+	// the destination should be a directory;
+	struct stat s;
+	if (stat(dest, &s) == -1) {
+		fprintf(stderr, "Error fcopy: dest dir %s: %s\n", dest, strerror(errno));
+		exit(1);
+	}
+	if (!S_ISDIR(s.st_mode)) {
+		fprintf(stderr, "Error fcopy: dest %s is not a directory\n", dest);
+		exit(1);
+	}
+
+	// copy files
+	if ((arg_follow_link ? stat : lstat)(src, &s) == -1) {
+		fprintf(stderr, "Error fcopy: src %s: %s\n", src, strerror(errno));
+		exit(1);
+	}
+
+	if (S_ISDIR(s.st_mode))
+		duplicate_dir(src, dest, &s);
+	else if (S_ISREG(s.st_mode))
+		duplicate_file(src, dest, &s);
+	else if (S_ISLNK(s.st_mode))
+		duplicate_link(src, dest, &s);
+	else {
+		fprintf(stderr, "Error fcopy: src %s is an unsupported type of file\n", src);
+		exit(1);
+	}
+}
+
+// read NUL-separated src/dest pairs from stdin
+static void copy_batch(void) {
+	size_t size = 4096;
+	size_t len = 0;
+	char *buf = malloc(size);
+	if (!buf)
+		errExit("malloc");
+
+	ssize_t rv;
+	while ((rv = read(STDIN_FILENO, buf + len, size - len - 1)) != 0) {
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("read");
+		}
+		len += rv;
+		if (len + 1 == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+			if (!buf)
+				errExit("realloc");
+		}
+	}
+	buf[len] = '\0';
+
+	char *ptr = buf;
+	char *end = buf + len;
+	while (ptr < end) {
+		char *src = ptr;
+		ptr += strlen(ptr) + 1;
+		if (ptr >= end || *src == '\0' || *ptr == '\0') {
+			fprintf(stderr, "Error fcopy: invalid batch list\n");
+			exit(1);
+		}
+		char *dest = ptr;
+		ptr += strlen(ptr) + 1;
+
+		copy_entry(src, dest);
+	}
+
+	free(buf);
+}
+
 int main(int argc, char **argv) {
 #if 0
 	{
@@ -497,14 +733,23 @@ int main(int argc, char **argv) {
 	if (debug && strcmp(debug, "yes") == 0)
 		arg_debug = 1;
 
-	char *src;
-	char *dest;
+	int arg_batch = 0;
+	char *src = NULL;
+	char *dest = NULL;
 
-	if (argc == 3) {
+	if (argc == 3 && !strcmp(argv[1], "--follow-link") && !strcmp(argv[2], "--batch")) {
+		arg_follow_link = 1;
+		arg_batch = 1;
+	}
+	else if (argc == 3) {
 		src = argv[1];
 		dest = argv[2];
 		arg_follow_link = 0;
 	}
+	else if (argc == 2 && !strcmp(argv[1], "--batch")) {
+		arg_follow_link = 0;
+		arg_batch = 1;
+	}
 	else if (argc == 4 && !strcmp(argv[1], "--follow-link")) {
 		src = argv[2];
 		dest = argv[3];
@@ -518,28 +763,6 @@ int main(int argc, char **argv) {
 
 	warn_dumpable();
 
-	// check the two files; remove ending /
-	size_t len = strlen(src);
-	while (len > 1 && src[len - 1] == '/')
-		src[--len] = '\0';
-	reject_meta_chars(src, 0);
-
-	len = strlen(dest);
-	while (len > 1 && dest[len - 1] == '/')
-		dest[--len] = '\0';
-	reject_meta_chars(dest, 0);
-
-	// the destination should be a directory;
-	struct stat s;
-	if (stat(dest, &s) == -1) {
-		fprintf(stderr, "Error fcopy: dest dir %s: %s\n", dest, strerror(errno));
-		exit(1);
-	}
-	if (!S_ISDIR(s.st_mode)) {
-		fprintf(stderr, "Error fcopy: dest %s is not a directory\n", dest);
-		exit(1);
-	}
-
 	// extract copy limit size from env variable, if any
 	char *cl = getenv("FIREJAIL_FILE_COPY_LIMIT");
 	if (cl) {
@@ -547,23 +770,20 @@ int main(int argc, char **argv) {
 		if (arg_debug)
 			printf("file copy limit %lu bytes\n", copy_limit);
 	}
-
-	// copy files
-	if ((arg_follow_link ? stat : lstat)(src, &s) == -1) {
-		fprintf(stderr, "Error fcopy: src %s: %s\n", src, strerror(errno));
-		exit(1);
+	cl = getenv("FIREJAIL_FILE_COPY_COUNT_LIMIT");
+	if (cl) {
+		copy_count_limit = strtoul(cl, NULL, 10);
+		if (arg_debug)
+			printf("file copy count limit %lu files\n", copy_count_limit);
 	}
 
-	if (S_ISDIR(s.st_mode))
-		duplicate_dir(src, dest, &s);
-	else if (S_ISREG(s.st_mode))
-		duplicate_file(src, dest, &s);
-	else if (S_ISLNK(s.st_mode))
-		duplicate_link(src, dest, &s);
-	else {
-		fprintf(stderr, "Error fcopy: src %s is an unsupported type of file\n", src);
-		exit(1);
-	}
+	if (arg_batch)
+		copy_batch();
+	else
+		copy_entry(src, dest);
+	stop_workers();
+
+	report_stats();
 
 	return 0;
 }
@@ -21,49 +21,20 @@
 #include "firecfg.h"
 #include <ctype.h>
 
-static int check_profile(const char *name, const char *homedir) {
-	// build profile name
-	char *profname1;
-#ifndef HAVE_ONLY_SYSCFG_PROFILES
-	char *profname2;
-#endif
-	if (asprintf(&profname1, "%s/%s.profile", SYSCONFDIR, name) == -1)
-		errExit("asprintf");
-
-#ifndef HAVE_ONLY_SYSCFG_PROFILES
-	if (asprintf(&profname2, "%s/.config/firejail/%s.profile", homedir, name) == -1)
-		errExit("asprintf");
-#endif
-
-	int rv = 0;
-	if (access(profname1, R_OK) == 0) {
-		if (arg_debug)
-			printf("found %s\n", profname1);
-		rv = 1;
-	}
-#ifndef HAVE_ONLY_SYSCFG_PROFILES
-	else if (access(profname2, R_OK) == 0) {
-		if (arg_debug)
-			printf("found %s\n", profname2);
-		rv = 1;
-	}
-#endif
-
-	free(profname1);
-#ifndef HAVE_ONLY_SYSCFG_PROFILES
-	free(profname2);
-#endif
+static int check_profile(const char *name, FILE *out) {
+	int rv = have_profile_name(name);
+	if (rv && arg_debug)
+		fprintf(out, "found %s.profile\n", name);
 	return rv;
 }
 
 
 // look for a profile file in /etc/firejail and ~/.config/firejail
-static int have_profile(const char *filename, const char *homedir) {
+static int have_profile(const char *filename, FILE *out) {
 	assert(filename);
-	assert(homedir);
 
 	if (arg_debug)
-		printf("checking profile for %s\n", filename);
+		fprintf(out, "checking profile for %s\n", filename);
 
 	// we get strange names here, such as .org.gnome.gedit.desktop, com.uploadedlobster.peek.desktop,
 	// or io.github.Pithos.desktop; extract the word before .desktop
@@ -87,7 +58,7 @@ static int have_profile(const char *filename, const char *homedir) {
 	tmpfname[len - 8] = '\0';
 
 	// check full filename (without .desktop)
-	int rv = check_profile(tmpfname, homedir);
+	int rv = check_profile(tmpfname, out);
 	if (rv) {
 		free(tmpfname);
 		return rv;
@@ -102,7 +73,7 @@ static int have_profile(const char *filename, const char *homedir) {
 
 	// try lowercase
 	last_word[0] = tolower(last_word[0]);
-	rv = check_profile(last_word, homedir);
+	rv = check_profile(last_word, out);
 	if (rv) {
 		free(tmpfname);
 		return rv;
@@ -110,11 +81,219 @@ static int have_profile(const char *filename, const char *homedir) {
 
 	// try uppercase
 	last_word[0] = toupper(last_word[0]);
-	rv = check_profile(last_word, homedir);
+	rv = check_profile(last_word, out);
 	free(tmpfname);
 	return rv;
 }
 
+// remove the desktop file from ~/.local/share/applications if it was created by firecfg
+static void remove_desktop_file(const char *user_apps_dir, const char *filename) {
+	char *fname;
+	if (asprintf(&fname, "%s/%s", user_apps_dir, filename) == -1)
+		errExit("asprintf");
+
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		char buf[MAX_BUF];
+		int ours = fgets(buf, MAX_BUF, fp) && strcmp(buf, "# converted by firecfg\n") == 0;
+		fclose(fp);
+		if (ours) {
+			if (unlink(fname))
+				fprintf(stderr, "Warning: cannot remove %s\n", fname);
+			else
+				printf("   %s removed\n", filename);
+		}
+	}
+	free(fname);
+}
+
+typedef struct {
+	char **names;
+	const char *user_apps_dir;
+} DesktopFiles;
+
+static void fix_desktop_file(size_t i, void *arg, FILE *out, FILE *err) {
+	DesktopFiles *df = arg;
+	const char *filename = df->names[i];
+	const char *user_apps_dir = df->user_apps_dir;
+	struct stat sb;
+
+	// skip if not .desktop file
+	char *exec = strdup(filename);
+	if (!exec)
+		errExit("strdup");
+	char *ptr = strrchr(exec, '.');
+	if (ptr == NULL || strcmp(ptr, ".desktop") != 0) {
+		fprintf(out, "   %s skipped (not a .desktop file)\n", exec);
+		free(exec);
+		return;
+	}
+
+	// skip if program is in ignorelist
+	*ptr = '\0';
+	if (in_ignorelist(exec)) {
+		fprintf(out, "   %s ignored\n", exec);
+		free(exec);
+		return;
+	}
+
+	free(exec);
+
+	// skip links - Discord on Arch #4235 seems to be a symlink to /opt directory
+//		if (is_link(filename))
+//			return;
+
+	// no profile in /etc/firejail, no desktop file fixing
+	if (!have_profile(filename, out))
+		return;
+
+	//****************************************************
+	// load the file in memory and do some basic checking
+	//****************************************************
+	FILE *fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(err, "Warning: cannot open /usr/share/applications/%s\n", filename);
+		return;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	if (size == -1)
+		errExit("ftell");
+	fseek(fp, 0, SEEK_SET);
+	char *buf = malloc(size + 1);
+	if (!buf)
+		errExit("malloc");
+
+	size_t loaded = fread(buf, size, 1, fp);
+	fclose(fp);
+	if (loaded != 1) {
+		fprintf(err, "Warning: cannot read /usr/share/applications/%s\n", filename);
+		free(buf);
+		return;
+	}
+	buf[size] = '\0';
+
+	// check format
+	if (strstr(buf, "[Desktop Entry]\n") == NULL) {
+		if (arg_debug)
+			fprintf(out, "   %s - skipped: wrong format?\n", filename);
+		free(buf);
+		return;
+	}
+
+	// get executable name
+	ptr = strstr(buf,"\nExec=");
+	if (!ptr || strlen(ptr) < 7) {
+		if (arg_debug)
+			fprintf(out, "   %s - skipped: wrong format?\n", filename);
+		free(buf);
+		return;
+	}
+
+	char *execname = ptr + 6;
+	// executable name can be quoted, this is rare and currently unsupported, TODO
+	if (execname[0] == '"') {
+		if (arg_debug)
+			fprintf(out, "   %s - skipped: path quoting unsupported\n", filename);
+		free(buf);
+		return;
+	}
+
+	// try to decide if we need to convert this file
+	char *change_exec = NULL;
+	int change_dbus = 0;
+
+	if (strstr(buf, "\nDBusActivatable=true"))
+		change_dbus = 1;
+
+	// https://specifications.freedesktop.org/desktop-entry-spec/latest/ar01s06.html
+	// The executable program can either be specified with its full path
+	// or with the name of the executable only
+	if (execname[0] == '/') {
+		// mark end of line
+		char *end = strchr(execname, '\n');
+		if (end)
+			*end = '\0';
+		end = strchr(execname, ' ');
+		if (end)
+			*end = '\0';
+		char *start_name = strrchr(execname, '/');
+		if (start_name) {
+			start_name++;
+			// check if we have the executable on the regular path
+			if (which(start_name)) {
+				change_exec = strdup(start_name);
+				if (!change_exec)
+					errExit("strdup");
+			}
+		}
+	}
+
+	free(buf);
+	if (change_exec == NULL && change_dbus == 0)
+		return;
+
+	//****************************************************
+	// generate output file
+	//****************************************************
+	char *outname;
+	if (asprintf(&outname ,"%s/%s", user_apps_dir, filename) == -1)
+		errExit("asprintf");
+
+	if (stat(outname, &sb) == 0) {
+		fprintf(out, "   %s skipped: file exists\n", filename);
+		free(outname);
+		if (change_exec)
+			free(change_exec);
+		return;
+	}
+
+	FILE *fpin = fopen(filename, "r");
+	if (!fpin) {
+		fprintf(err, "Warning: cannot open /usr/share/applications/%s\n", filename);
+		free(outname);
+		if (change_exec)
+			free(change_exec);
+		return;
+	}
+
+	FILE *fpout = fopen(outname, "w");
+	if (!fpout) {
+		fprintf(err, "Warning: cannot open ~/.local/share/applications/%s\n", outname);
+		fclose(fpin);
+		free(outname);
+		if (change_exec)
+			free(change_exec);
+		return;
+	}
+	fprintf(fpout, "# converted by firecfg\n");
+	free(outname);
+
+	char fbuf[MAX_BUF];
+	while (fgets(fbuf, MAX_BUF, fpin)) {
+		if (change_dbus && strcmp(fbuf, "DBusActivatable=true\n") == 0)
+			fprintf(fpout, "DBusActivatable=false\n");
+		else if (change_exec && strncmp(fbuf, "Exec=", 5) == 0) {
+			char *start_params = strchr(fbuf + 5, ' ');
+			if (start_params) {
+				start_params++;
+				fprintf(fpout, "Exec=%s %s", change_exec, start_params);
+			}
+			else
+				fprintf(fpout, "Exec=%s\n", change_exec);
+		}
+		else
+			fprintf(fpout, "%s", fbuf);
+	}
+
+	if (change_exec)
+		free(change_exec);
+	fclose(fpin);
+	fclose(fpout);
+	fprintf(out, "   %s created\n", filename);
+}
+
 void fix_desktop_files(const char *homedir) {
 	assert(homedir);
 	struct stat sb;
@@ -127,6 +306,7 @@ void fix_desktop_files(const char *homedir) {
 
 	// build ignorelist
 	parse_config_all(0);
+	build_index(homedir);
 
 	// destination
 	// create ~/.local/share/applications directory if necessary
@@ -170,7 +350,26 @@ void fix_desktop_files(const char *homedir) {
 		return;
 	}
 
-	// copy
+	// --incremental: only the files modified since the last run are processed,
+	// all of them if the programs or the profiles changed
+	char *state_fname = NULL;
+	State old;
+	State cur;
+	memset(&old, 0, sizeof(old));
+	memset(&cur, 0, sizeof(cur));
+	int all = 1;
+	if (arg_incremental) {
+		if (asprintf(&state_fname, "%s/%s", user_apps_dir, FIRECFG_STATE_FILE) == -1)
+			errExit("asprintf");
+		state_load(&old, state_fname);
+		state_stamps(&cur, homedir);
+		all = !old.loaded || state_stamps_changed(&old, &cur);
+	}
+
+	// the files are processed in parallel, in the order of the directory
+	DesktopFiles df = { NULL, user_apps_dir };
+	size_t cnt = 0;
+	size_t size = 0;
 	struct dirent *entry;
 	while ((entry = readdir(dir)) != NULL) {
 		const char *filename = entry->d_name;
@@ -182,183 +381,50 @@ void fix_desktop_files(const char *homedir) {
 		if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
 			continue;
 
-		// skip if not .desktop file
-		char *exec = strdup(filename);
-		if (!exec)
-			errExit("strdup");
-		char *ptr = strrchr(exec, '.');
-		if (ptr == NULL || strcmp(ptr, ".desktop") != 0) {
-			printf("   %s skipped (not a .desktop file)\n", exec);
-			free(exec);
-			continue;
-		}
-
-		// skip if program is in ignorelist
-		*ptr = '\0';
-		if (in_ignorelist(exec)) {
-			printf("   %s ignored\n", exec);
-			free(exec);
-			continue;
-		}
-
-		free(exec);
-
-		// skip links - Discord on Arch #4235 seems to be a symlink to /opt directory
-//		if (is_link(filename))
-//			continue;
-
-		// no profile in /etc/firejail, no desktop file fixing
-		if (!have_profile(filename, homedir))
-			continue;
-
-		//****************************************************
-		// load the file in memory and do some basic checking
-		//****************************************************
-		FILE *fp = fopen(filename, "r");
-		if (!fp) {
-			fprintf(stderr, "Warning: cannot open /usr/share/applications/%s\n", filename);
-			continue;
+		if (arg_incremental) {
+			if (fstatat(dirfd(dir), filename, &sb, 0) == -1)
+				continue;
+			state_add(&cur, filename, &sb);
+			int changed = state_changed(&old, filename, &sb);
+			if (!all && !changed)
+				continue;
+			// the file is created again
+			if (state_find(&old, filename))
+				remove_desktop_file(user_apps_dir, filename);
 		}
 
-		fseek(fp, 0, SEEK_END);
-		long size = ftell(fp);
-		if (size == -1)
-			errExit("ftell");
-		fseek(fp, 0, SEEK_SET);
-		char *buf = malloc(size + 1);
-		if (!buf)
-			errExit("malloc");
-
-		size_t loaded = fread(buf, size, 1, fp);
-		fclose(fp);
-		if (loaded != 1) {
-			fprintf(stderr, "Warning: cannot read /usr/share/applications/%s\n", filename);
-			free(buf);
-			continue;
-		}
-		buf[size] = '\0';
-
-		// check format
-		if (strstr(buf, "[Desktop Entry]\n") == NULL) {
-			if (arg_debug)
-				printf("   %s - skipped: wrong format?\n", filename);
-			free(buf);
-			continue;
-		}
-
-		// get executable name
-		ptr = strstr(buf,"\nExec=");
-		if (!ptr || strlen(ptr) < 7) {
-			if (arg_debug)
-				printf("   %s - skipped: wrong format?\n", filename);
-			free(buf);
-			continue;
-		}
-
-		char *execname = ptr + 6;
-		// executable name can be quoted, this is rare and currently unsupported, TODO
-		if (execname[0] == '"') {
-			if (arg_debug)
-				printf("   %s - skipped: path quoting unsupported\n", filename);
-			free(buf);
-			continue;
-		}
-
-		// try to decide if we need to convert this file
-		char *change_exec = NULL;
-		int change_dbus = 0;
-
-		if (strstr(buf, "\nDBusActivatable=true"))
-			change_dbus = 1;
-
-		// https://specifications.freedesktop.org/desktop-entry-spec/latest/ar01s06.html
-		// The executable program can either be specified with its full path
-		// or with the name of the executable only
-		if (execname[0] == '/') {
-			// mark end of line
-			char *end = strchr(execname, '\n');
-			if (end)
-				*end = '\0';
-			end = strchr(execname, ' ');
-			if (end)
-				*end = '\0';
-			char *start_name = strrchr(execname, '/');
-			if (start_name) {
-				start_name++;
-				// check if we have the executable on the regular path
-				if (which(start_name)) {
-					change_exec = strdup(start_name);
-					if (!change_exec)
-						errExit("strdup");
-				}
-			}
-		}
-
-		free(buf);
-		if (change_exec == NULL && change_dbus == 0)
-			continue;
-
-		//****************************************************
-		// generate output file
-		//****************************************************
-		char *outname;
-		if (asprintf(&outname ,"%s/%s", user_apps_dir, filename) == -1)
-			errExit("asprintf");
-
-		if (stat(outname, &sb) == 0) {
-			printf("   %s skipped: file exists\n", filename);
-			free(outname);
-			if (change_exec)
-				free(change_exec);
-			continue;
-		}
-
-		FILE *fpin = fopen(filename, "r");
-		if (!fpin) {
-			fprintf(stderr, "Warning: cannot open /usr/share/applications/%s\n", filename);
-			free(outname);
-			if (change_exec)
-				free(change_exec);
-			continue;
+		if (cnt == size) {
+			size = size ? size * 2 : 256;
+			df.names = realloc(df.names, size * sizeof(char *));
+			if (!df.names)
+				errExit("realloc");
 		}
+		df.names[cnt] = strdup(filename);
+		if (!df.names[cnt])
+			errExit("strdup");
+		cnt++;
+	}
+	closedir(dir);
 
-		FILE *fpout = fopen(outname, "w");
-		if (!fpout) {
-			fprintf(stderr, "Warning: cannot open ~/.local/share/applications/%s\n", outname);
-			fclose(fpin);
-			free(outname);
-			if (change_exec)
-				free(change_exec);
-			continue;
-		}
-		fprintf(fpout, "# converted by firecfg\n");
-		free(outname);
+	run_parallel(cnt, fix_desktop_file, &df);
 
-		char fbuf[MAX_BUF];
-		while (fgets(fbuf, MAX_BUF, fpin)) {
-			if (change_dbus && strcmp(fbuf, "DBusActivatable=true\n") == 0)
-				fprintf(fpout, "DBusActivatable=false\n");
-			else if (change_exec && strncmp(fbuf, "Exec=", 5) == 0) {
-				char *start_params = strchr(fbuf + 5, ' ');
-				if (start_params) {
-					start_params++;
-					fprintf(fpout, "Exec=%s %s", change_exec, start_params);
-				}
-				else
-					fprintf(fpout, "Exec=%s\n", change_exec);
-			}
-			else
-				fprintf(fpout, "%s", fbuf);
+	size_t i;
+	if (arg_incremental) {
+		// desktop files removed
+		state_sort(&cur);
+		for (i = 0; i < old.cnt; i++) {
+			const char *filename = old.entries[i].name;
+			if (*filename != '/' && !state_find(&cur, filename))
+				remove_desktop_file(user_apps_dir, filename);
 		}
-
-		if (change_exec)
-			free(change_exec);
-		fclose(fpin);
-		fclose(fpout);
-		printf("   %s created\n", filename);
-
+		state_save(&cur, state_fname);
+		state_free(&old);
+		state_free(&cur);
+		free(state_fname);
 	}
 
-	closedir(dir);
+	for (i = 0; i < cnt; i++)
+		free(df.names[i]);
+	free(df.names);
 	free(user_apps_dir);
 }
@@ -50,17 +50,54 @@
 
 // main.c
 extern int arg_debug;
+extern int arg_incremental;
 int in_ignorelist(const char *const str);
 void parse_config_all(int do_symlink);
 
 // util.c
-int find(const char *program, const char *directory);
+#define MAX_THREADS 8
+typedef enum {
+	SCAN_BIN,
+	SCAN_SNAP,
+	SCAN_PROFILE
+} ScanKind;
+void scan_dirs(const char *homedir, void (*fn)(const char *dir, ScanKind kind, void *arg), void *arg);
+void build_index(const char *homedir);
 int which(const char *program);
+int is_snap(const char *program);
+int have_profile_name(const char *name);
+void run_parallel(size_t cnt, void (*fn)(size_t i, void *arg, FILE *out, FILE *err), void *arg);
 int is_link(const char *fname);
 
 // sound.c
 void sound(void);
 
+// state.c
+#define FIRECFG_STATE_FILE ".firecfg-state"
+typedef struct {
+	char *name;	// file name, or full path for the stamps
+	ino_t ino;
+	struct timespec mtime;
+} StateEntry;
+
+typedef struct {
+	StateEntry *entries;
+	size_t cnt;
+	size_t size;
+	int loaded;
+} State;
+
+void state_load(State *st, const char *fname);
+void state_add(State *st, const char *name, const struct stat *s);
+void state_stamps(State *st, const char *homedir);
+void state_sort(State *st);
+const StateEntry *state_find(const State *st, const char *name);
+int state_changed(const State *st, const char *name, const struct stat *s);
+int state_stamps_changed(const State *old, const State *cur);
+void state_create(const char *fname);
+void state_save(const State *st, const char *fname);
+void state_free(State *st);
+
 // desktop_files.c
 void fix_desktop_files(const char *homedir);
 
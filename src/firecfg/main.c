@@ -25,6 +25,7 @@
 int arg_debug = 0;
 char *arg_bindir = "/usr/local/bin";
 int arg_guide = 0;
+int arg_incremental = 0;
 int done_config = 0;
 
 static const char *const usage_str =
@@ -43,6 +44,8 @@ static const char *const usage_str =
 	"   --fix-sound - create ~/.config/pulse/client.conf file.\n\n"
 	"   --guide - guided configuration for new users.\n\n"
 	"   --help, -? - this help screen.\n\n"
+	"   --incremental - change only the symbolic links and the desktop files\n"
+	"\tof the programs installed or removed since the last run.\n\n"
 	"   --list - list all firejail symbolic links.\n\n"
 	"   --version - print program version and exit.\n\n"
 	"Example:\n\n"
@@ -178,7 +181,14 @@ int in_ignorelist(const char *const str) {
 	return 0;
 }
 
-static void set_file(const char *name, const char *firejail_exec) {
+// the symbolic links of a config file are created in parallel
+static char **link_queue = NULL;
+static size_t link_cnt = 0;
+static size_t link_size = 0;
+
+static void set_file(size_t i, void *arg, FILE *out, FILE *err) {
+	const char *name = link_queue[i];
+	const char *firejail_exec = arg;
 	assert(name);
 	assert(firejail_exec);
 
@@ -186,8 +196,8 @@ static void set_file(const char *name, const char *firejail_exec) {
 		return;
 
 	// if the application is a snap (Ubuntu), don't link it!
-	if (find(name, "/snap")) {
-		printf("   %s is a snap package, skipping...\n", name);
+	if (is_snap(name)) {
+		fprintf(out, "   %s is a snap package, skipping...\n", name);
 		return;
 	}
 
@@ -199,18 +209,51 @@ static void set_file(const char *name, const char *firejail_exec) {
 	if (stat(fname, &s) != 0) {
 		int rv = symlink(firejail_exec, fname);
 		if (rv) {
-			fprintf(stderr, "Error: cannot create %s symbolic link\n", fname);
-			perror("symlink");
+			fprintf(err, "Error: cannot create %s symbolic link\n", fname);
+			fprintf(err, "symlink: %s\n", strerror(errno));
 		} else {
-			printf("   %s created\n", name);
+			fprintf(out, "   %s created\n", name);
 		}
 	} else {
-		fprintf(stderr, "   %s already exists, skipping...\n", fname);
+		fprintf(err, "   %s already exists, skipping...\n", fname);
 	}
 
 	free(fname);
 }
 
+static void queue_file(const char *name) {
+	assert(name);
+	size_t i;
+	for (i = 0; i < link_cnt; i++) {
+		if (strcmp(link_queue[i], name) == 0)
+			return;
+	}
+
+	if (link_cnt == link_size) {
+		link_size = link_size ? link_size * 2 : 256;
+		link_queue = realloc(link_queue, link_size * sizeof(char *));
+		if (!link_queue)
+			errExit("realloc");
+	}
+	link_queue[link_cnt] = strdup(name);
+	if (!link_queue[link_cnt])
+		errExit("strdup");
+	link_cnt++;
+}
+
+static void set_queued_files(void) {
+	// with --incremental the links are set at the end, in set_links_incremental()
+	if (arg_incremental)
+		return;
+
+	run_parallel(link_cnt, set_file, FIREJAIL_EXEC);
+
+	size_t i;
+	for (i = 0; i < link_cnt; i++)
+		free(link_queue[i]);
+	link_cnt = 0;
+}
+
 // parse a single config file
 static void parse_config_file(const char *cfgfile, int do_symlink) {
 	if (do_symlink)
@@ -281,10 +324,11 @@ static void parse_config_file(const char *cfgfile, int do_symlink) {
 
 		// set link
 		if (do_symlink)
-			set_file(start, FIREJAIL_EXEC);
+			queue_file(start);
 	}
 
 	fclose(fp);
+	set_queued_files();
 	printf("\n");
 }
 
@@ -369,11 +413,127 @@ static void set_links_homedir(const char *homedir) {
 			goto next;
 		}
 
-		set_file(exec, FIREJAIL_EXEC);
+		queue_file(exec);
 next:
 		free(exec);
 	}
 	closedir(dir);
+	set_queued_files();
+}
+
+// remove the symbolic link if it points to firejail
+static void remove_link(const char *name) {
+	char *fname;
+	if (asprintf(&fname, "%s/%s", arg_bindir, name) == -1)
+		errExit("asprintf");
+
+	if (is_link(fname)) {
+		char *target = realpath(fname, NULL);
+		if (target) {
+			if (strcmp(target, FIREJAIL_EXEC) == 0) {
+				if (unlink(fname))
+					fprintf(stderr, "Warning: cannot remove %s\n", fname);
+				else
+					printf("   %s removed\n", name);
+			}
+			free(target);
+		}
+	}
+	free(fname);
+}
+
+// --incremental: set only the symbolic links of the programs installed since
+// the last run, and remove the links of the programs removed
+// return 1 if the config files or the programs changed
+static int set_links_incremental(const char *homedir) {
+	char *state_fname;
+	if (asprintf(&state_fname, "%s/%s", arg_bindir, FIRECFG_STATE_FILE) == -1)
+		errExit("asprintf");
+
+	State old;
+	State cur;
+	memset(&old, 0, sizeof(old));
+	memset(&cur, 0, sizeof(cur));
+	state_load(&old, state_fname);
+	state_stamps(&cur, homedir);
+	if (old.loaded && !state_stamps_changed(&old, &cur)) {
+		printf("No changes since the last run, nothing to do in %s\n", arg_bindir);
+		state_free(&old);
+		state_free(&cur);
+		free(state_fname);
+		return 0;
+	}
+
+	// on the first run the links set before are not known
+	if (!old.loaded)
+		clean();
+
+	build_index(homedir);
+	parse_config_all(1);
+	set_links_homedir(homedir);
+
+	// the links kept or set in this run
+	size_t i;
+	size_t keep = 0;
+	for (i = 0; i < link_cnt; i++) {
+		if (which(link_queue[i]) && !is_snap(link_queue[i]))
+			link_queue[keep++] = link_queue[i];
+		else
+			free(link_queue[i]);
+	}
+	link_cnt = keep;
+
+	State links;
+	memset(&links, 0, sizeof(links));
+	for (i = 0; i < link_cnt; i++)
+		state_add(&links, link_queue[i], NULL);
+	state_sort(&links);
+
+	// programs removed
+	for (i = 0; i < old.cnt; i++) {
+		const char *name = old.entries[i].name;
+		if (*name != '/' && !state_find(&links, name))
+			remove_link(name);
+	}
+	state_free(&links);
+
+	// programs installed, or links removed by hand
+	keep = 0;
+	for (i = 0; i < link_cnt; i++) {
+		char *fname;
+		if (asprintf(&fname, "%s/%s", arg_bindir, link_queue[i]) == -1)
+			errExit("asprintf");
+		struct stat s;
+		if (lstat(fname, &s) == -1) {
+			char *tmp = link_queue[keep];
+			link_queue[keep++] = link_queue[i];
+			link_queue[i] = tmp;
+		}
+		free(fname);
+	}
+	run_parallel(keep, set_file, FIREJAIL_EXEC);
+
+	// the stamps are taken again, the links directory could be in PATH
+	state_create(state_fname);
+	state_free(&cur);
+	state_stamps(&cur, homedir);
+	for (i = 0; i < link_cnt; i++) {
+		char *fname;
+		if (asprintf(&fname, "%s/%s", arg_bindir, link_queue[i]) == -1)
+			errExit("asprintf");
+		struct stat s;
+		if (lstat(fname, &s) == 0)
+			state_add(&cur, link_queue[i], &s);
+		free(fname);
+		free(link_queue[i]);
+	}
+	link_cnt = 0;
+	state_save(&cur, state_fname);
+
+	state_free(&old);
+	state_free(&cur);
+	free(state_fname);
+	return 1;
 }
 
 static const char *get_sudo_user(void) {
@@ -423,9 +583,11 @@ int main(int argc, char **argv) {
 	gid_t gid;
 	const char *home = get_homedir(user, &uid, &gid);
 
-	// check for --bindir
+	// check for --bindir and --incremental
 	for (i = 1; i < argc; i++) {
-		if (strncmp(argv[i], "--bindir=", 9) == 0) {
+		if (strcmp(argv[i], "--incremental") == 0)
+			arg_incremental = 1;
+		else if (strncmp(argv[i], "--bindir=", 9) == 0) {
 			if (strncmp(argv[i] + 9, "~/", 2) == 0) {
 				if (asprintf(&arg_bindir, "%s/%s", home, argv[i] + 11) == -1)
 					errExit("asprintf");
@@ -495,7 +657,8 @@ int main(int argc, char **argv) {
 			return 0;
 		}
 		else {
-			if (strncmp(argv[i], "--bindir=", 9) != 0) { // already handled
+			// already handled
+			if (strncmp(argv[i], "--bindir=", 9) != 0 && strcmp(argv[i], "--incremental") != 0) {
 				fprintf(stderr, "Error: invalid command line option\n");
 				usage();
 				return 1;
@@ -561,11 +724,20 @@ int main(int argc, char **argv) {
 			return 0;
 	}
 
-	// clear all symlinks
-	clean();
+	int changed = 1;
+	if (arg_incremental)
+		changed = set_links_incremental(home);
+	else {
+		// clear all symlinks
+		clean();
 
-	// set new symlinks based on config files
-	parse_config_all(1);
+		// the programs and the profiles installed, without the symlinks removed above
+		build_index(home);
+
+		// set new symlinks based on config files
+		parse_config_all(1);
+	}
+	(void) changed;
 
 	if (getuid() == 0) {
 		// add user to firejail access database - only for root
@@ -578,7 +750,7 @@ int main(int argc, char **argv) {
 #ifdef HAVE_APPARMOR
 		// enable firejail apparmor profile
 		struct stat s;
-		if (stat("/sbin/apparmor_parser", &s) == 0) {
+		if (changed && stat("/sbin/apparmor_parser", &s) == 0) {
 			char *cmd;
 
 			// SYSCONFDIR points to /etc/firejail, we have to go on level up (..)
@@ -593,7 +765,8 @@ int main(int argc, char **argv) {
 	}
 
 	// set new symlinks based on ~/.config/firejail directory
-	set_links_homedir(home);
+	if (!arg_incremental)
+		set_links_homedir(home);
 
 	// drop permissions
 	if (getuid() == 0) {
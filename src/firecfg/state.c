@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// state of the last --incremental run, stored in the directory updated by
+// firecfg: the symbolic links directory, or ~/.local/share/applications
+//
+// The file has one line for each entry, "<inode> <seconds> <nanoseconds> <name>".
+// The stamps are the directories and the config files firecfg looks at, saved
+// with their full path; if none of them changed, there is nothing to do.
+// The other entries are the symbolic links set, or the desktop files processed.
+
+#include "firecfg.h"
+#include <glob.h>
+
+static void state_grow(State *st) {
+	if (st->cnt == st->size) {
+		st->size = st->size ? st->size * 2 : 256;
+		st->entries = realloc(st->entries, st->size * sizeof(StateEntry));
+		if (!st->entries)
+			errExit("realloc");
+	}
+}
+
+// s is NULL if the file does not exist
+void state_add(State *st, const char *name, const struct stat *s) {
+	assert(st);
+	assert(name);
+	state_grow(st);
+	StateEntry *e = &st->entries[st->cnt];
+	memset(e, 0, sizeof(StateEntry));
+	e->name = strdup(name);
+	if (!e->name)
+		errExit("strdup");
+	if (s) {
+		e->ino = s->st_ino;
+		e->mtime = s->st_mtim;
+	}
+	st->cnt++;
+}
+
+static int cmp_entry(const void *a, const void *b) {
+	return strcmp(((const StateEntry *) a)->name, ((const StateEntry *) b)->name);
+}
+
+void state_sort(State *st) {
+	assert(st);
+	if (st->cnt)
+		qsort(st->entries, st->cnt, sizeof(StateEntry), cmp_entry);
+}
+
+const StateEntry *state_find(const State *st, const char *name) {
+	assert(st);
+	assert(name);
+	if (st->cnt == 0)
+		return NULL;
+	StateEntry key;
+	key.name = (char *) name;
+	return bsearch(&key, st->entries, st->cnt, sizeof(StateEntry), cmp_entry);
+}
+
+// return 1 if the file is not in the state, or it was modified since
+int state_changed(const State *st, const char *name, const struct stat *s) {
+	assert(s);
+	const StateEntry *e = state_find(st, name);
+	return !e || e->ino != s->st_ino ||
+		e->mtime.tv_sec != s->st_mtim.tv_sec || e->mtime.tv_nsec != s->st_mtim.tv_nsec;
+}
+
+void state_load(State *st, const char *fname) {
+	assert(st);
+	assert(fname);
+	FILE *fp = fopen(fname, "re");
+	if (!fp)
+		return;
+
+	char buf[MAX_BUF];
+	while (fgets(buf, MAX_BUF, fp)) {
+		if (*buf == '#')
+			continue;
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+
+		unsigned long ino;
+		long sec;
+		long nsec;
+		int n = 0;
+		if (sscanf(buf, "%lu %ld %ld %n", &ino, &sec, &nsec, &n) != 3 || n == 0 || buf[n] == '\0')
+			continue;
+		state_grow(st);
+		StateEntry *e = &st->entries[st->cnt];
+		e->name = strdup(buf + n);
+		if (!e->name)
+			errExit("strdup");
+		e->ino = ino;
+		e->mtime.tv_sec = sec;
+		e->mtime.tv_nsec = nsec;
+		st->cnt++;
+	}
+	fclose(fp);
+	st->loaded = 1;
+	state_sort(st);
+}
+
+static void stamp_path(State *st, const char *path) {
+	char *fname;
+	if (asprintf(&fname, "%s%s", (*path == '/') ? "" : "/", path) == -1)
+		errExit("asprintf");
+	struct stat s;
+	state_add(st, fname, (stat(fname, &s) == 0) ? &s : NULL);
+	free(fname);
+}
+
+static void stamp_scan(const char *dir, ScanKind kind, void *arg) {
+	(void) kind;
+	stamp_path(arg, dir);
+}
+
+// the directories of the programs and profiles, and the config files
+void state_stamps(State *st, const char *homedir) {
+	assert(st);
+	scan_dirs(homedir, stamp_scan, st);
+	stamp_path(st, FIRECFG_CFGFILE);
+	stamp_path(st, SYSCONFDIR "/firecfg.d");
+
+	// the files could be edited in place
+	glob_t globbuf;
+	if (glob(FIRECFG_CONF_GLOB, 0, NULL, &globbuf) == 0) {
+		size_t i;
+		for (i = 0; i < globbuf.gl_pathc; i++)
+			stamp_path(st, globbuf.gl_pathv[i]);
+	}
+	globfree(&globbuf);
+	state_sort(st);
+}
+
+// return 1 if a stamp was added, removed or modified
+int state_stamps_changed(const State *old, const State *cur) {
+	assert(old);
+	assert(cur);
+	size_t cnt_old = 0;
+	size_t i;
+	for (i = 0; i < old->cnt; i++) {
+		if (*old->entries[i].name == '/')
+			cnt_old++;
+	}
+
+	size_t cnt_cur = 0;
+	for (i = 0; i < cur->cnt; i++) {
+		const StateEntry *e = &cur->entries[i];
+		if (*e->name != '/')
+			continue;
+		cnt_cur++;
+		const StateEntry *o = state_find(old, e->name);
+		if (!o || o->ino != e->ino ||
+		    o->mtime.tv_sec != e->mtime.tv_sec || o->mtime.tv_nsec != e->mtime.tv_nsec) {
+			if (arg_debug)
+				printf("%s changed\n", e->name);
+			return 1;
+		}
+	}
+
+	return cnt_old != cnt_cur;
+}
+
+// create the file if it doesn't exist; the file is written in place
+// later, and the directory is not modified again, the directory could be
+// one of the stamps
+void state_create(const char *fname) {
+	assert(fname);
+	int fd = open(fname, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd != -1)
+		close(fd);
+}
+
+void state_save(const State *st, const char *fname) {
+	assert(st);
+	assert(fname);
+	int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+	FILE *fp = (fd == -1) ? NULL : fdopen(fd, "w");
+	if (!fp) {
+		fprintf(stderr, "Warning: cannot save the state in %s\n", fname);
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+
+	fprintf(fp, "# firecfg --incremental state, do not edit\n");
+	size_t i;
+	for (i = 0; i < st->cnt; i++) {
+		const StateEntry *e = &st->entries[i];
+		fprintf(fp, "%lu %ld %ld %s\n", (unsigned long) e->ino,
+			(long) e->mtime.tv_sec, (long) e->mtime.tv_nsec, e->name);
+	}
+
+	if (fclose(fp) != 0)
+		fprintf(stderr, "Warning: cannot save the state in %s\n", fname);
+}
+
+void state_free(State *st) {
+	assert(st);
+	size_t i;
+	for (i = 0; i < st->cnt; i++)
+		free(st->entries[i].name);
+	free(st->entries);
+	memset(st, 0, sizeof(State));
+}
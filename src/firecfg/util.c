@@ -19,61 +19,257 @@
 */
 
 #include "firecfg.h"
+#include <pthread.h>
 
-// return 1 if the program is found
-int find(const char *program, const char *directory) {
-	int retval = 0;
+// sorted list of file names, looked up with bsearch()
+typedef struct {
+	char **names;
+	size_t cnt;
+	size_t size;
+} NameIndex;
 
-	char *fname;
-	if (asprintf(&fname, "/%s/%s", directory, program) == -1)
-		errExit("asprintf");
+static NameIndex bin_index = { NULL, 0, 0 };
+static NameIndex snap_index = { NULL, 0, 0 };
+static NameIndex profile_index = { NULL, 0, 0 };
+static int index_done = 0;
 
-	struct stat s;
-	if (stat(fname, &s) == 0) {
-		if (arg_debug)
-			printf("found %s in directory %s\n", program, directory);
-		retval = 1;
+static void index_add(NameIndex *idx, const char *name) {
+	if (idx->cnt == idx->size) {
+		idx->size = idx->size ? idx->size * 2 : 1024;
+		idx->names = realloc(idx->names, idx->size * sizeof(char *));
+		if (!idx->names)
+			errExit("realloc");
 	}
+	idx->names[idx->cnt] = strdup(name);
+	if (!idx->names[idx->cnt])
+		errExit("strdup");
+	idx->cnt++;
+}
 
-	free(fname);
-	return retval;
+static int cmp_name(const void *a, const void *b) {
+	return strcmp(*(char * const *) a, *(char * const *) b);
 }
 
+static int index_find(const NameIndex *idx, const char *name) {
+	if (idx->cnt == 0)
+		return 0;
+	return bsearch(&name, idx->names, idx->cnt, sizeof(char *), cmp_name) != NULL;
+}
 
-// return 1 if program is installed on the system
-int which(const char *program) {
-	// check some well-known paths
-	if (find(program, "/bin") || find(program, "/usr/bin") ||
-	    find(program, "/sbin") || find(program, "/usr/sbin") ||
-	    find(program, "/usr/games"))
-		return 1;
+// add the files in the directory; the symbolic links are followed, as
+// with stat() in find(), except the links to firejail
+// if suffix is not NULL, only the files ending in suffix are added, without it
+static void index_dir(NameIndex *idx, const char *directory, const char *suffix) {
+	char *dirname;
+	if (asprintf(&dirname, "/%s", directory) == -1)
+		errExit("asprintf");
+	DIR *dir = opendir(dirname);
+	free(dirname);
+	if (!dir)
+		return;
+
+	size_t slen = suffix ? strlen(suffix) : 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+		// the firejail symbolic links are not programs
+		if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+			char target[sizeof(FIREJAIL_EXEC)];
+			ssize_t len = readlinkat(dirfd(dir), entry->d_name, target, sizeof(target));
+			if (len == sizeof(FIREJAIL_EXEC) - 1 && memcmp(target, FIREJAIL_EXEC, len) == 0)
+				continue;
+		}
+		if (entry->d_type != DT_REG && entry->d_type != DT_DIR) {
+			struct stat s;
+			if (fstatat(dirfd(dir), entry->d_name, &s, 0) == -1)
+				continue;
+		}
 
-	// check environment
+		if (suffix) {
+			size_t len = strlen(entry->d_name);
+			if (len <= slen || strcmp(entry->d_name + len - slen, suffix) != 0)
+				continue;
+			char *name = strndup(entry->d_name, len - slen);
+			if (!name)
+				errExit("strndup");
+			index_add(idx, name);
+			free(name);
+		}
+		else
+			index_add(idx, entry->d_name);
+	}
+	closedir(dir);
+}
+
+// call fn for the program and profile directories, in the order of the search
+void scan_dirs(const char *homedir, void (*fn)(const char *dir, ScanKind kind, void *arg), void *arg) {
+	// some well-known paths
+	fn("/bin", SCAN_BIN, arg);
+	fn("/usr/bin", SCAN_BIN, arg);
+	fn("/sbin", SCAN_BIN, arg);
+	fn("/usr/sbin", SCAN_BIN, arg);
+	fn("/usr/games", SCAN_BIN, arg);
+
+	// environment
 	char *path1 = getenv("PATH");
 	if (path1) {
 		char *path2 = strdup(path1);
 		if (!path2)
 			errExit("strdup");
 
-		// use path2 to count the entries
 		char *ptr = strtok(path2, ":");
 		while (ptr) {
 			// Ubuntu 18.04 is adding  /snap/bin to PATH;
 			// they populate /snap/bin with symbolic links to /usr/bin/ programs;
 			// most symlinked programs are not installed by default.
 			// Removing /snap/bin from our search
-			if (strcmp(ptr, "/snap/bin") != 0) {
-				if (find(program, ptr)) {
-					free(path2);
-					return 1;
-				}
-			}
+			if (strcmp(ptr, "/snap/bin") != 0)
+				fn(ptr, SCAN_BIN, arg);
 			ptr = strtok(NULL, ":");
 		}
 		free(path2);
 	}
+	fn("/snap", SCAN_SNAP, arg);
 
-	return 0;
+	// profiles
+	fn(SYSCONFDIR, SCAN_PROFILE, arg);
+#ifndef HAVE_ONLY_SYSCFG_PROFILES
+	if (homedir) {
+		char *dirname;
+		if (asprintf(&dirname, "%s/.config/firejail", homedir) == -1)
+			errExit("asprintf");
+		fn(dirname, SCAN_PROFILE, arg);
+		free(dirname);
+	}
+#else
+	(void) homedir;
+#endif
+}
+
+static void index_scan(const char *dir, ScanKind kind, void *arg) {
+	(void) arg;
+	if (kind == SCAN_BIN)
+		index_dir(&bin_index, dir, NULL);
+	else if (kind == SCAN_SNAP)
+		index_dir(&snap_index, dir, NULL);
+	else
+		index_dir(&profile_index, dir, ".profile");
+}
+
+// scan the program and profile directories once, before the worker
+// threads are started
+void build_index(const char *homedir) {
+	if (index_done)
+		return;
+	index_done = 1;
+
+	scan_dirs(homedir, index_scan, NULL);
+
+	qsort(bin_index.names, bin_index.cnt, sizeof(char *), cmp_name);
+	qsort(snap_index.names, snap_index.cnt, sizeof(char *), cmp_name);
+	qsort(profile_index.names, profile_index.cnt, sizeof(char *), cmp_name);
+	if (arg_debug)
+		printf("index: %zu programs, %zu profiles\n", bin_index.cnt, profile_index.cnt);
+}
+
+// return 1 if program is installed on the system
+int which(const char *program) {
+	build_index(NULL);
+	return index_find(&bin_index, program);
+}
+
+// return 1 if program is a snap package
+int is_snap(const char *program) {
+	build_index(NULL);
+	return index_find(&snap_index, program);
+}
+
+// return 1 if there is a profile for the program in /etc/firejail
+// or ~/.config/firejail
+int have_profile_name(const char *name) {
+	build_index(NULL);
+	return index_find(&profile_index, name);
+}
+
+typedef struct {
+	void (*fn)(size_t i, void *arg, FILE *out, FILE *err);
+	void *arg;
+	size_t cnt;
+	size_t next;
+	pthread_mutex_t mutex;
+	char **out;
+	size_t *outlen;
+	char **err;
+	size_t *errlen;
+} Tasks;
+
+static void *task_worker(void *arg) {
+	Tasks *t = arg;
+	while (1) {
+		pthread_mutex_lock(&t->mutex);
+		size_t i = t->next++;
+		pthread_mutex_unlock(&t->mutex);
+		if (i >= t->cnt)
+			return NULL;
+
+		FILE *out = open_memstream(&t->out[i], &t->outlen[i]);
+		FILE *err = open_memstream(&t->err[i], &t->errlen[i]);
+		if (!out || !err)
+			errExit("open_memstream");
+		t->fn(i, t->arg, out, err);
+		fclose(out);
+		fclose(err);
+	}
+}
+
+// run fn for the items 0 to cnt - 1 in a pool of threads; the messages
+// written in out and err are printed in the order of the items
+void run_parallel(size_t cnt, void (*fn)(size_t i, void *arg, FILE *out, FILE *err), void *arg) {
+	if (cnt == 0)
+		return;
+
+	Tasks t;
+	memset(&t, 0, sizeof(t));
+	t.fn = fn;
+	t.arg = arg;
+	t.cnt = cnt;
+	pthread_mutex_init(&t.mutex, NULL);
+	t.out = calloc(cnt, sizeof(char *));
+	t.outlen = calloc(cnt, sizeof(size_t));
+	t.err = calloc(cnt, sizeof(char *));
+	t.errlen = calloc(cnt, sizeof(size_t));
+	if (!t.out || !t.outlen || !t.err || !t.errlen)
+		errExit("calloc");
+
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+	if (threads > (long) cnt)
+		threads = cnt;
+	pthread_t tid[MAX_THREADS];
+	long started = 0;
+	while (started < threads && pthread_create(&tid[started], NULL, task_worker, &t) == 0)
+		started++;
+	if (started == 0)
+		task_worker(&t);	// no threads, run the items here
+	long i;
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+
+	size_t j;
+	for (j = 0; j < cnt; j++) {
+		fwrite(t.out[j], 1, t.outlen[j], stdout);
+		fwrite(t.err[j], 1, t.errlen[j], stderr);
+		free(t.out[j]);
+		free(t.err[j]);
+	}
+	fflush(stdout);
+	free(t.out);
+	free(t.outlen);
+	free(t.err);
+	free(t.errlen);
+	pthread_mutex_destroy(&t.mutex);
 }
 
 // return 1 if the file is a link
@@ -26,18 +26,12 @@
 #include <sys/stat.h>
 #include <sys/mount.h>
 #include <fcntl.h>
-#include <linux/loop.h>
-#include <errno.h>
 
 static char *devloop = NULL;	// device file
+static int devloop_fd = -1;	// keeps the device attached until the sandbox exits
 static long unsigned size = 0;	// offset into appimage file
 #define MAXBUF 4096
 
-static void err_loop(char *msg) {
-	fprintf(stderr, "%s\n", msg);
-	exit(1);
-}
-
 // return 1 if found
 int appimage_find_profile(const char *archive) {
 	assert(archive);
@@ -105,52 +99,9 @@ void appimage_set(const char *appimage) {
 	if (arg_debug)
 		printf("AppImage ELF size %lu\n", size);
 
-	// find or allocate a free loop device to use
-	EUID_ROOT();
-	int cfd; // loop control fd
-	if ((cfd = open("/dev/loop-control", O_RDWR|O_CLOEXEC)) == -1) {
-		sleep(1); // sleep 1 second and try again
-		if ((cfd = open("/dev/loop-control", O_RDWR|O_CLOEXEC)) == -1)
-			err_loop("cannot open /dev/loop-control");
-	}
-
-	int devnr; // loop device number
-	if ((devnr = ioctl(cfd, LOOP_CTL_GET_FREE)) == -1) {
-		sleep(1); // sleep 1 second and try again
-		if ((devnr = ioctl(cfd, LOOP_CTL_GET_FREE)) == -1)
-			err_loop("cannot get a free loop device number");
-	}
-	close(cfd);
-	if (asprintf(&devloop, "/dev/loop%d", devnr) == -1)
-		errExit("asprintf");
-
-	int lfd; // loopback fd
-	if ((lfd = open(devloop, O_RDONLY|O_CLOEXEC)) == -1) {
-		sleep (1); // sleep 1 second and try again
-		if ((lfd = open(devloop, O_RDONLY|O_CLOEXEC)) == -1)
-			err_loop("cannot open loop device");
-	}
-
-	// associate loop device with appimage
-	if (ioctl(lfd, LOOP_SET_FD, ffd) == -1) {
-		sleep(1); // sleep 1 second and try again
-		if (ioctl(lfd, LOOP_SET_FD, ffd) == -1)
-			err_loop("cannot associate loop device with appimage file");
-	}
-
-	if (size) {
-		struct loop_info64 info;
-		memset(&info, 0, sizeof(struct loop_info64));
-		info.lo_offset = size;
-		if (ioctl(lfd,  LOOP_SET_STATUS64, &info) == -1) {
-			sleep(1); // sleep 1 second and try again
-			if (ioctl(lfd,  LOOP_SET_STATUS64, &info) == -1)
-				err_loop("cannot set loop status");
-		}
-	}
-	close(lfd);
+	// the sandboxes running the same AppImage share the loop device
+	devloop_fd = loop_device_get(ffd, size, &devloop);
 	close(ffd);
-	EUID_USER();
 
 	// set environment
 	char* abspath = realpath(appimage, NULL);
@@ -196,13 +147,6 @@ void appimage_mount(void) {
 }
 
 void appimage_clear(void) {
-	EUID_ROOT();
-	if (devloop) {
-		int lfd = open(devloop, O_RDONLY|O_CLOEXEC);
-		if (lfd != -1) {
-			if (ioctl(lfd, LOOP_CLR_FD, 0) != -1)
-				fmessage("AppImage detached\n");
-			close(lfd);
-		}
-	}
+	loop_device_release(devloop_fd);
+	devloop_fd = -1;
 }
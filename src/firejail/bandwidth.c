@@ -23,116 +23,96 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/file.h>
 #include <net/if.h>
 #include "firejail.h"
 
 //***********************************
-// interface bandwidth linked list
+// run file handling
 //***********************************
-typedef struct ifbw_t {
-	struct ifbw_t *next;
-	char *txt;
-} IFBW;
-IFBW *ifbw = NULL;
-
-
-#if 0
-static void ifbw_print(void) {
-	IFBW *ptr = ifbw;
-	while (ptr) {
-		printf("#%s#\n", ptr->txt);
-		ptr = ptr->next;
-	}
-}
-#endif
-
-static void ifbw_add(IFBW *ptr) {
-	assert(ptr);
-
-	if (ifbw != NULL)
-		ptr->next = ifbw;
-	ifbw = ptr;
+// RUN_FIREJAIL_BANDWIDTH_DIR/<pid>-bandwidth holds one fixed-size record for
+// each interface with limits. A record is updated in place with pwrite()
+// under a flock() on the file; the readers get the limits without parsing.
+#define BANDWIDTH_MAGIC 0x46424431	// "FBD1"
+#define BANDWIDTH_RECORDS 4		// one for each network device of the sandbox
+
+typedef struct {
+	char dev[IFNAMSIZ];	// interface inside the sandbox, empty for a free record
+	uint32_t down;		// KB/s
+	uint32_t up;		// KB/s
+} BandwidthRecord;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t reserved;
+	BandwidthRecord rec[BANDWIDTH_RECORDS];
+} BandwidthFile;
+
+static char *bandwidth_fname(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d-bandwidth", RUN_FIREJAIL_BANDWIDTH_DIR, (int) pid) == -1)
+		errExit("asprintf");
+	return fname;
 }
 
-
-IFBW *ifbw_find(const char *dev) {
-	assert(dev);
-	int len = strlen(dev);
-	assert(len);
-
-	if (ifbw == NULL)
-		return NULL;
-
-	IFBW *ptr = ifbw;
-	while (ptr) {
-		if (strncmp(ptr->txt, dev, len) == 0 && ptr->txt[len] == ':')
-			return ptr;
-		ptr = ptr->next;
+// open and lock the run file, and read the records in bf; the file is created
+// if create is set, otherwise return -1 if the file doesn't exist
+static int bandwidth_open(pid_t pid, int create, BandwidthFile *bf) {
+	char *fname = bandwidth_fname(pid);
+	int flags = (create) ? O_RDWR | O_CREAT : O_RDONLY;
+	int fd = open(fname, flags | O_CLOEXEC | O_NOFOLLOW, 0644);
+	if (fd == -1) {
+		if (!create && errno == ENOENT) {
+			free(fname);
+			return -1;
+		}
+		goto errout;
 	}
+	if (flock(fd, (create) ? LOCK_EX : LOCK_SH) == -1)
+		goto errout;
 
-	return NULL;
-}
-
-void ifbw_remove(IFBW *r) {
-	if (ifbw == NULL)
-		return;
+	struct stat s;
+	if (fstat(fd, &s) == -1 || s.st_uid != 0 || !S_ISREG(s.st_mode))
+		goto errout;
 
-	// remove the first element
-	if (ifbw == r) {
-		ifbw = ifbw->next;
-		return;
+	memset(bf, 0, sizeof(BandwidthFile));
+	ssize_t len = pread(fd, bf, sizeof(BandwidthFile), 0);
+	if (len == 0 && create) {
+		// new file
+		bf->magic = BANDWIDTH_MAGIC;
+		if (pwrite(fd, bf, sizeof(BandwidthFile), 0) != sizeof(BandwidthFile))
+			goto errout;
+		SET_PERMS_FD(fd, 0, 0, 0644);
 	}
+	else if (len != sizeof(BandwidthFile) || bf->magic != BANDWIDTH_MAGIC)
+		goto errout;
 
-	// walk the list
-	IFBW *ptr = ifbw->next;
-	IFBW *prev = ifbw;
-	while (ptr) {
-		if (ptr == r) {
-			prev->next = ptr->next;
-			return;
-		}
-
-		prev = ptr;
-		ptr = ptr->next;
-	}
+	free(fname);
+	return fd;
 
-	return;
+errout:
+	fprintf(stderr, "Error: cannot use bandwidth file %s\n", fname);
+	exit(1);
 }
 
-int fibw_count(void) {
-	int rv = 0;
-	IFBW *ptr = ifbw;
-
-	while (ptr) {
-		rv++;
-		ptr = ptr->next;
+static void bandwidth_write(int fd, const BandwidthFile *bf, int i) {
+	off_t offset = offsetof(BandwidthFile, rec) + i * sizeof(BandwidthRecord);
+	if (pwrite(fd, &bf->rec[i], sizeof(BandwidthRecord), offset) != sizeof(BandwidthRecord)) {
+		fprintf(stderr, "Error: cannot write bandwidth file\n");
+		exit(1);
 	}
-
-	return rv;
 }
 
-
-//***********************************
-// run file handling
-//***********************************
-static void bandwidth_create_run_file(pid_t pid) {
-	char *fname;
-	if (asprintf(&fname, "%s/%d-bandwidth", RUN_FIREJAIL_BANDWIDTH_DIR, (int) pid) == -1)
-		errExit("asprintf");
-
-	// create an empty file and set mod and ownership
-	// if the file already exists, do nothing
-	FILE *fp = fopen(fname, "wxe");
-	free(fname);
-	if (!fp) {
-		if (errno == EEXIST)
-			return;
-		fprintf(stderr, "Error: cannot create bandwidth file\n");
-		exit(1);
+// record index for the device, -1 if not found; an empty device name finds a free record
+static int bandwidth_find(const BandwidthFile *bf, const char *dev) {
+	int i;
+	for (i = 0; i < BANDWIDTH_RECORDS; i++) {
+		if (strncmp(bf->rec[i].dev, dev, IFNAMSIZ) == 0)
+			return i;
 	}
-
-	SET_PERMS_STREAM(fp, 0, 0, 0644);
-	fclose(fp);
+	return -1;
 }
 
 
@@ -165,126 +145,105 @@ void network_set_run_file(pid_t pid) {
 }
 
 
-static void read_bandwidth_file(pid_t pid) {
-	assert(ifbw == NULL);
-
-	char *fname;
-	if (asprintf(&fname, "%s/%d-bandwidth", RUN_FIREJAIL_BANDWIDTH_DIR, (int) pid) == -1)
-		errExit("asprintf");
-
-	FILE *fp = fopen(fname, "re");
-	if (fp) {
-		char buf[1024];
-		while (fgets(buf, 1024,fp)) {
-			// remove '\n'
-			char *ptr = strchr(buf, '\n');
-			if (ptr)
-				*ptr = '\0';
-			if (strlen(buf) == 0)
-				continue;
-
-			// create a new IFBW entry
-			IFBW *ifbw_new = malloc(sizeof(IFBW));
-			if (!ifbw_new)
-				errExit("malloc");
-			memset(ifbw_new, 0, sizeof(IFBW));
-			ifbw_new->txt = strdup(buf);
-			if (!ifbw_new->txt)
-				errExit("strdup");
-
-			// add it to the linked list
-			ifbw_add(ifbw_new);
-		}
-
-		fclose(fp);
-	}
-
-	free(fname);
-}
-
-static void write_bandwidth_file(pid_t pid) {
-	if (ifbw == NULL)
-		return; // nothing to do
-
-	char *fname;
-	if (asprintf(&fname, "%s/%d-bandwidth", RUN_FIREJAIL_BANDWIDTH_DIR, (int) pid) == -1)
-		errExit("asprintf");
-
-	FILE *fp = fopen(fname, "we");
-	if (fp) {
-		IFBW *ptr = ifbw;
-		while (ptr) {
-			if (fprintf(fp, "%s\n", ptr->txt) < 0)
-				goto errout;
-			ptr = ptr->next;
-		}
-		fclose(fp);
-		free(fname);
-	}
-	else
-		goto errout;
-	return;
-
-errout:
-	fprintf(stderr, "Error: cannot write bandwidth file %s\n", fname);
-	exit(1);
-}
-
 //***********************************
 // add or remove interfaces
 //***********************************
 
 // remove interface from run file
 void bandwidth_remove(pid_t pid, const char *dev) {
-	bandwidth_create_run_file(pid);
-
-	// read bandwidth file
-	read_bandwidth_file(pid);
+	assert(dev);
+	BandwidthFile bf;
+	int fd = bandwidth_open(pid, 1, &bf);
 
-	// find the element and remove it
-	IFBW *elem = ifbw_find(dev);
-	if (elem) {
-		ifbw_remove(elem);
-		write_bandwidth_file(pid) ;
+	int i = bandwidth_find(&bf, dev);
+	if (i != -1) {
+		memset(&bf.rec[i], 0, sizeof(BandwidthRecord));
+		bandwidth_write(fd, &bf, i);
 	}
 
-	// remove the file if there are no entries in the list
-	if (ifbw == NULL)
-		 delete_bandwidth_run_file(pid);
+	// remove the file if there are no records left
+	for (i = 0; i < BANDWIDTH_RECORDS; i++) {
+		if (*bf.rec[i].dev)
+			break;
+	}
+	if (i == BANDWIDTH_RECORDS)
+		delete_bandwidth_run_file(pid);
+	close(fd);
 }
 
 // add interface to run file
 void bandwidth_set(pid_t pid, const char *dev, int down, int up) {
-	// create bandwidth directory & file in case they are not in the filesystem yet
-	bandwidth_create_run_file(pid);
+	assert(dev);
+	size_t len = strlen(dev);
+	size_t j;
+	for (j = 0; j < len; j++) {
+		if (!isalnum((unsigned char) dev[j]) && dev[j] != '-' && dev[j] != '_' && dev[j] != '.')
+			break;
+	}
+	if (len == 0 || len >= IFNAMSIZ || j != len) {
+		fprintf(stderr, "Error: invalid network device name %s\n", dev);
+		exit(1);
+	}
+	BandwidthFile bf;
+	int fd = bandwidth_open(pid, 1, &bf);
+
+	// replace the existing record, or use a free one
+	int i = bandwidth_find(&bf, dev);
+	if (i == -1)
+		i = bandwidth_find(&bf, "");
+	if (i == -1) {
+		fprintf(stderr, "Error: too many network devices with bandwidth limits\n");
+		exit(1);
+	}
 
-	// create the new text entry
-	char *txt;
-	if (asprintf(&txt, "%s: RX %dKB/s, TX %dKB/s", dev, down, up) == -1)
-		errExit("asprintf");
+	memset(&bf.rec[i], 0, sizeof(BandwidthRecord));
+	strncpy(bf.rec[i].dev, dev, IFNAMSIZ - 1);
+	bf.rec[i].down = down;
+	bf.rec[i].up = up;
+	bandwidth_write(fd, &bf, i);
+	close(fd);
+}
 
-	// read bandwidth file
-	read_bandwidth_file(pid);
+// the limits set at startup by the bandwidth profile command
+void bandwidth_set_run_file(pid_t pid) {
+	Bridge *br[] = { &cfg.bridge0, &cfg.bridge1, &cfg.bridge2, &cfg.bridge3 };
+	int i;
+	for (i = 0; i < 4; i++) {
+		if (br[i]->configured && br[i]->bw_down)
+			bandwidth_set(pid, br[i]->devsandbox, br[i]->bw_down, br[i]->bw_up);
+	}
+}
 
-	// look for an existing entry and replace the text
-	IFBW *ptr = ifbw_find(dev);
-	if (ptr) {
-		assert(ptr->txt);
-		free(ptr->txt);
-		ptr->txt = txt;
+// --bandwidth=name|pid status --format=json: the limits recorded for the sandbox
+void bandwidth_status_json(pid_t pid) {
+	EUID_ASSERT();
+	char *fname;
+	if (asprintf(&fname, "%s/%d-netmap", RUN_FIREJAIL_NETWORK_DIR, (int) pid) == -1)
+		errExit("asprintf");
+	if (access(fname, F_OK)) {
+		fprintf(stderr, "Error: the sandbox doesn't use a new network namespace (see --net)\n");
+		exit(1);
 	}
-	// ... or add a new entry
-	else {
-		IFBW *ifbw_new = malloc(sizeof(IFBW));
-		if (!ifbw_new)
-			errExit("malloc");
-		memset(ifbw_new, 0, sizeof(IFBW));
-		ifbw_new->txt = txt;
-
-		// add it to the linked list
-		ifbw_add(ifbw_new);
+	free(fname);
+
+	BandwidthFile bf;
+	memset(&bf, 0, sizeof(bf));
+	int fd = bandwidth_open(pid, 0, &bf);
+	if (fd != -1)
+		close(fd);
+
+	printf("{\"pid\":%d,\"interfaces\":[", (int) pid);
+	int i;
+	int cnt = 0;
+	for (i = 0; i < BANDWIDTH_RECORDS; i++) {
+		BandwidthRecord *r = &bf.rec[i];
+		if (!*r->dev)
+			continue;
+		// the device names are checked when the records are written
+		printf("%s{\"dev\":\"%.*s\",\"download\":%u,\"upload\":%u}", (cnt++) ? "," : "",
+		       IFNAMSIZ, r->dev, r->down, r->up);
 	}
-	write_bandwidth_file(pid) ;
+	printf("]}\n");
 }
 
 
@@ -362,34 +321,23 @@ void bandwidth_pid(pid_t pid, const char *command, const char *dev, int down, in
 	}
 	else assert(strcmp(command, "status") == 0);
 
-	// build fshaper.sh command
-	char *cmd = NULL;
+	//************************
+	// build command
+	//************************
+	char *arg[7];
+	int i = 0;
+	arg[i++] = PATH_FNET_MAIN;
+	arg[i++] = "shape";
+	arg[i++] = (char *) command;
 	if (devname) {
+		arg[i++] = devname;
 		if (strcmp(command, "set") == 0) {
-			if (asprintf(&cmd, "%s/firejail/fshaper.sh --%s %s %d %d",
-				LIBDIR, command, devname, down, up) == -1)
-				errExit("asprintf");
-		}
-		else {
-			if (asprintf(&cmd, "%s/firejail/fshaper.sh --%s %s",
-				LIBDIR, command, devname) == -1)
+			if (asprintf(&arg[i++], "%d", down) == -1 ||
+			    asprintf(&arg[i++], "%d", up) == -1)
 				errExit("asprintf");
 		}
 	}
-	else {
-		if (asprintf(&cmd, "%s/firejail/fshaper.sh --%s", LIBDIR, command) == -1)
-			errExit("asprintf");
-	}
-	assert(cmd);
-
-	//************************
-	// build command
-	//************************
-	char *arg[4];
-	arg[0] = "/bin/sh";
-	arg[1] = "-c";
-	arg[2] = cmd;
-	arg[3] = NULL;
+	arg[i] = NULL;
 	clearenv();
 	sbox_exec_v(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, arg);
 
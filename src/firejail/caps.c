@@ -184,20 +184,38 @@ static CapsEntry capslist[] = {
 //
 }; // end of capslist
 
-// return -1 if error, or syscall number
+// capslist indexes sorted by name, built on the first lookup
+#define CAPS_ELEMS ((int) (sizeof(capslist) / sizeof(capslist[0])))
+static const CapsEntry *caps_sorted[CAPS_ELEMS];
+static int caps_sorted_init = 0;
+
+static int caps_cmp(const void *a, const void *b) {
+	const CapsEntry *c1 = *(const CapsEntry * const *) a;
+	const CapsEntry *c2 = *(const CapsEntry * const *) b;
+	return strcmp(c1->name, c2->name);
+}
+
+static int caps_key_cmp(const void *key, const void *elem) {
+	const CapsEntry *c = *(const CapsEntry * const *) elem;
+	return strcmp((const char *) key, c->name);
+}
+
+// return -1 if error, or capability number
 static int caps_find_name(const char *name) {
-	int i;
-	int elems = sizeof(capslist) / sizeof(capslist[0]);
-	for (i = 0; i < elems; i++) {
-		if (strcmp(name, capslist[i].name) == 0)
-			return capslist[i].nr;
+	if (!caps_sorted_init) {
+		int i;
+		for (i = 0; i < CAPS_ELEMS; i++)
+			caps_sorted[i] = &capslist[i];
+		qsort(caps_sorted, CAPS_ELEMS, sizeof(caps_sorted[0]), caps_cmp);
+		caps_sorted_init = 1;
 	}
 
-	return -1;
+	const CapsEntry * const *ptr = bsearch(name, caps_sorted, CAPS_ELEMS, sizeof(caps_sorted[0]), caps_key_cmp);
+	return (ptr) ? (*ptr)->nr : -1;
 }
 
-// return 1 if error, 0 if OK
-void caps_check_list(const char *clist, void (*callback)(int)) {
+// return the capabilities in the list as a mask; exit if error
+uint64_t caps_parse_list(const char *clist) {
 	// don't allow empty lists
 	if (clist == NULL || *clist == '\0') {
 		fprintf(stderr, "Error: empty capabilities list\n");
@@ -209,37 +227,25 @@ void caps_check_list(const char *clist, void (*callback)(int)) {
 	if (!str)
 		errExit("strdup");
 
-	char *ptr = str;
+	uint64_t mask = 0;
 	char *start = str;
-	while (*ptr != '\0') {
-		if (islower(*ptr) || isdigit(*ptr) || *ptr == '_')
-			;
-		else if (*ptr == ',') {
-			*ptr = '\0';
-			int nr = caps_find_name(start);
-			if (nr == -1)
-				goto errexit;
-			else if (callback != NULL)
-				callback(nr);
-
-			start = ptr + 1;
-		}
-		ptr++;
-	}
-	if (*start != '\0') {
+	while (1) {
+		char *end = strchr(start, ',');
+		if (end)
+			*end = '\0';
 		int nr = caps_find_name(start);
-		if (nr == -1)
-			goto errexit;
-		else if (callback != NULL)
-			callback(nr);
+		if (nr == -1) {
+			fprintf(stderr, "Error: capability \"%s\" not found\n", start);
+			exit(1);
+		}
+		mask |= 1ULL << nr;
+		if (!end)
+			break;
+		start = end + 1;
 	}
 
 	free(str);
-	return;
-
-errexit:
-	fprintf(stderr, "Error: capability \"%s\" not found\n", start);
-	exit(1);
+	return mask;
 }
 
 void caps_print(void) {
@@ -357,32 +363,22 @@ void caps_set(uint64_t caps) {
 }
 
 
-static uint64_t filter;
-
-static void caps_set_bit(int nr) {
-	uint64_t mask = 1LLU << nr;
-	filter |= mask;
-}
-static void caps_reset_bit(int nr) {
-	uint64_t mask = 1LLU << nr;
-	filter &= ~mask;
-}
-
-void caps_drop_list(const char *clist) {
-	filter = 0;
-	filter--;
-	caps_check_list(clist, caps_reset_bit);
-	caps_set(filter);
+void caps_drop_list(uint64_t mask) {
+	caps_set(~mask);
 }
 
-void caps_keep_list(const char *clist) {
-	filter = 0;
-	caps_check_list(clist, caps_set_bit);
-	caps_set(filter);
+void caps_keep_list(uint64_t mask) {
+	caps_set(mask);
 }
 
 #define MAXBUF 4098
 static uint64_t extract_caps(ProcessHandle process) {
+	// the bounding set saved by the sandbox, see save_join_desc()
+	JoinDesc desc;
+	if (join_desc_read(process, &desc) == 0)
+		return desc.caps;
+
+	// sandboxes started by an older version
 	FILE *fp = process_fopen(process, "status");
 
 	char buf[MAXBUF];
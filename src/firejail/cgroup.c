@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <assert.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define MAXBUF 4096
+// waiting for the last processes to leave the cgroup on shutdown
+#define CGROUP_REMOVE_TRIES 20
+#define CGROUP_REMOVE_USEC 10000
+// waiting for the processes to be frozen or thawed
+#define CGROUP_FREEZE_TRIES 100
+#define CGROUP_FREEZE_MSEC 10
+
+static char *leaf_path = NULL;
+
+// The sandbox is moved in a leaf cgroup created under the cgroup of the
+// firejail process: the cgroup limits already in place for the user still
+// apply, and the subtree_control files of the parent are not modified.
+// The controllers enabled in the parent (cpu, memory, io) decide which
+// files are available in the leaf; cpu.stat is always there, the limits
+// need the controllers. The path of the
+// leaf is stored in RUN_FIREJAIL_CGROUP_DIR/<pid> for firemon.
+
+// cgroup v2 mount point, NULL if not mounted
+static char *cgroup2_mount(void) {
+	FILE *fp = fopen("/proc/self/mountinfo", "re");
+	if (!fp)
+		return NULL;
+
+	char buf[MAXBUF];
+	char *rv = NULL;
+	while (fgets(buf, MAXBUF, fp)) {
+		// mount ID, parent ID, major:minor, root, mount point, options, optional fields, -, fstype
+		char *sep = strstr(buf, " - ");
+		if (!sep || strncmp(sep + 3, "cgroup2 ", 8) != 0)
+			continue;
+
+		char root[MAXBUF];
+		char dir[MAXBUF];
+		if (sscanf(buf, "%*d %*d %*s %4095s %4095s", root, dir) != 2 || strcmp(root, "/") != 0)
+			continue;
+		// octal escapes for spaces etc. in the mount point are not supported
+		if (strchr(dir, '\\'))
+			continue;
+		rv = strdup(dir);
+		if (!rv)
+			errExit("strdup");
+		break;
+	}
+	fclose(fp);
+	return rv;
+}
+
+// cgroup v2 path of the current process, NULL if not available
+static char *cgroup2_self(void) {
+	FILE *fp = fopen("/proc/self/cgroup", "re");
+	if (!fp)
+		return NULL;
+
+	char buf[MAXBUF];
+	char *rv = NULL;
+	while (fgets(buf, MAXBUF, fp)) {
+		if (strncmp(buf, "0::/", 4) != 0)
+			continue;
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+		// the cgroup of a process moved out of our cgroup namespace
+		if (strstr(buf, "/.."))
+			break;
+		// no trailing '/' for the root cgroup
+		rv = strdup((strcmp(buf + 3, "/") == 0) ? "" : buf + 3);
+		if (!rv)
+			errExit("strdup");
+		break;
+	}
+	fclose(fp);
+	return rv;
+}
+
+static void set_cgroup_run_file(pid_t pid, const char *leaf) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_CGROUP_DIR, pid) == -1)
+		errExit("asprintf");
+
+	// the file is used for deleting the leaf, don't follow symlinks
+	FILE *fp = fopen(fname, "wxe");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot create %s\n", fname);
+		exit(1);
+	}
+	fprintf(fp, "%s\n", leaf);
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+	free(fname);
+}
+
+static int limits_configured(void) {
+	return cfg.cgroup_cpu_max || cfg.cgroup_cpu_weight || cfg.cgroup_memory_high ||
+		cfg.cgroup_memory_max || cfg.cgroup_io_max;
+}
+
+// the file is missing if the controller is not enabled in the parent cgroup
+static void write_limit(const char *leaf, const char *name, const char *val) {
+	char *fname;
+	if (asprintf(&fname, "%s/%s", leaf, name) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			fprintf(stderr, "Error: cannot set %s, the controller is not enabled for %s; "
+				"it needs to be enabled in cgroup.subtree_control of the parent cgroup\n", name, leaf);
+		else
+			fprintf(stderr, "Error: cannot open %s: %s\n", fname, strerror(errno));
+		exit(1);
+	}
+
+	ssize_t len = strlen(val);
+	if (write(fd, val, len) != len) {
+		fprintf(stderr, "Error: cannot set %s to %s: %s\n", name, val, strerror(errno));
+		exit(1);
+	}
+	close(fd);
+	free(fname);
+
+	if (arg_debug)
+		printf("cgroup %s set to %s\n", name, val);
+}
+
+static void write_limit_number(const char *leaf, const char *name, long long unsigned val) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%llu", val);
+	write_limit(leaf, name, buf);
+}
+
+static void set_limits(const char *leaf) {
+	if (cfg.cgroup_cpu_max) {
+		// percent of a cpu in the default 100 ms period
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%llu 100000", (long long unsigned) cfg.cgroup_cpu_max * 1000);
+		write_limit(leaf, "cpu.max", buf);
+	}
+	if (cfg.cgroup_cpu_weight)
+		write_limit_number(leaf, "cpu.weight", cfg.cgroup_cpu_weight);
+	if (cfg.cgroup_memory_high)
+		write_limit_number(leaf, "memory.high", cfg.cgroup_memory_high);
+	if (cfg.cgroup_memory_max)
+		write_limit_number(leaf, "memory.max", cfg.cgroup_memory_max);
+	if (cfg.cgroup_io_max) {
+		// the kernel accepts one device per write
+		char *lines = strdup(cfg.cgroup_io_max);
+		if (!lines)
+			errExit("strdup");
+		char *line = strtok(lines, "\n");
+		while (line) {
+			write_limit(leaf, "io.max", line);
+			line = strtok(NULL, "\n");
+		}
+		free(lines);
+	}
+}
+
+// "/dev/sda,rbps=10M,wbps=10M,riops=1000,wiops=1000" -> "8:0 rbps=10485760 ..."
+static void read_io_max(const char *str) {
+	char *tmp = strdup(str);
+	if (!tmp)
+		errExit("strdup");
+
+	char *dev = strtok(tmp, ",");
+	struct stat s;
+	if (!dev || stat(dev, &s) == -1 || !S_ISBLK(s.st_mode)) {
+		fprintf(stderr, "Error: invalid io-max %s, a block device is required\n", str);
+		exit(1);
+	}
+
+	char *line;
+	if (asprintf(&line, "%u:%u", major(s.st_rdev), minor(s.st_rdev)) == -1)
+		errExit("asprintf");
+
+	char *ptr;
+	int cnt = 0;
+	while ((ptr = strtok(NULL, ",")) != NULL) {
+		char *val = strchr(ptr, '=');
+		if (!val)
+			goto errexit;
+		*val++ = '\0';
+
+		long long unsigned limit;
+		if (strcmp(ptr, "rbps") == 0 || strcmp(ptr, "wbps") == 0)
+			limit = parse_arg_size(val);
+		else if (strcmp(ptr, "riops") == 0 || strcmp(ptr, "wiops") == 0) {
+			check_unsigned(val, "Error: invalid io-max");
+			sscanf(val, "%llu", &limit);
+		}
+		else
+			goto errexit;
+		if (limit == 0)
+			goto errexit;
+
+		char *newline;
+		if (asprintf(&newline, "%s %s=%llu", line, ptr, limit) == -1)
+			errExit("asprintf");
+		free(line);
+		line = newline;
+		cnt++;
+	}
+	if (cnt == 0)
+		goto errexit;
+
+	if (cfg.cgroup_io_max) {
+		char *newlist;
+		if (asprintf(&newlist, "%s\n%s", cfg.cgroup_io_max, line) == -1)
+			errExit("asprintf");
+		free(cfg.cgroup_io_max);
+		free(line);
+		cfg.cgroup_io_max = newlist;
+	}
+	else
+		cfg.cgroup_io_max = line;
+	free(tmp);
+	return;
+
+errexit:
+	fprintf(stderr, "Error: invalid io-max %s; use device,rbps=size,wbps=size,riops=number,wiops=number\n", str);
+	exit(1);
+}
+
+// options and profile commands: cpu-max, cpu-weight, memory-high,
+// memory-max, io-max; any of them starts the sandbox in its own cgroup
+void cgroup_read_limit(const char *name, const char *value) {
+	EUID_ASSERT();
+
+	if (strcmp(name, "cpu-max") == 0) {
+		check_unsigned(value, "Error: invalid cpu-max");
+		sscanf(value, "%u", &cfg.cgroup_cpu_max);
+		if (cfg.cgroup_cpu_max == 0) {
+			fprintf(stderr, "Error: invalid cpu-max %s, use a percentage of a CPU\n", value);
+			exit(1);
+		}
+	}
+	else if (strcmp(name, "cpu-weight") == 0) {
+		check_unsigned(value, "Error: invalid cpu-weight");
+		sscanf(value, "%u", &cfg.cgroup_cpu_weight);
+		if (cfg.cgroup_cpu_weight < 1 || cfg.cgroup_cpu_weight > 10000) {
+			fprintf(stderr, "Error: invalid cpu-weight %s, accepted values are between 1 and 10000\n", value);
+			exit(1);
+		}
+	}
+	else if (strcmp(name, "memory-high") == 0 || strcmp(name, "memory-max") == 0) {
+		char *tmp = strdup(value);
+		if (!tmp)
+			errExit("strdup");
+		long long unsigned size = parse_arg_size(tmp);
+		free(tmp);
+		if (size == 0) {
+			fprintf(stderr, "Error: invalid %s: %s; use only positive numbers and K, M or G suffix\n",
+				name, value);
+			exit(1);
+		}
+		if (strcmp(name, "memory-high") == 0)
+			cfg.cgroup_memory_high = size;
+		else
+			cfg.cgroup_memory_max = size;
+	}
+	else if (strcmp(name, "io-max") == 0)
+		read_io_max(value);
+	else
+		assert(0);
+
+	arg_cgroup_leaf = 1;
+}
+
+// create the cgroup of the sandbox and set the limits, before the sandbox
+// is started; without limits a missing cgroup v2 is not an error
+void cgroup_leaf_create(pid_t pid) {
+	EUID_ASSERT();
+	EUID_ROOT();
+
+	char *mnt = cgroup2_mount();
+	char *path = cgroup2_self();
+	if (!mnt || !path) {
+		if (limits_configured()) {
+			fprintf(stderr, "Error: cgroup v2 is not available, cannot set the cgroup limits\n");
+			exit(1);
+		}
+		fwarning("cgroup v2 is not available, --cgroup-leaf disabled\n");
+		goto out;
+	}
+
+	char *leaf;
+	if (asprintf(&leaf, "%s%s/firejail-%d", mnt, path, pid) == -1)
+		errExit("asprintf");
+	// a leftover from a sandbox with the same pid
+	cgroup_leaf_remove(pid);
+	set_cgroup_run_file(pid, leaf);
+	if (mkdir(leaf, 0755) == -1) {
+		if (limits_configured()) {
+			fprintf(stderr, "Error: cannot create cgroup %s: %s\n", leaf, strerror(errno));
+			exit(1);
+		}
+		fwarning("cannot create cgroup %s: %s, --cgroup-leaf disabled\n", leaf, strerror(errno));
+		cgroup_leaf_remove(pid);
+		free(leaf);
+		goto out;
+	}
+	set_limits(leaf);
+	leaf_path = leaf;
+
+out:
+	free(mnt);
+	free(path);
+	EUID_USER();
+}
+
+// open the cgroup of the sandbox for clone3(CLONE_INTO_CGROUP);
+// return -1 if the sandbox doesn't have a cgroup
+int cgroup_leaf_open(void) {
+	EUID_ASSERT();
+	if (!leaf_path)
+		return -1;
+	EUID_ROOT();
+	int fd = open(leaf_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	EUID_USER();
+	return fd;
+}
+
+// move the sandbox in its cgroup, the child is still waiting for the
+// parent and did not start any process
+void cgroup_leaf_join(pid_t pid, pid_t child) {
+	EUID_ASSERT();
+	if (!leaf_path)
+		return;
+	EUID_ROOT();
+
+	char *fname;
+	if (asprintf(&fname, "%s/cgroup.procs", leaf_path) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_WRONLY | O_CLOEXEC);
+	free(fname);
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "%d\n", child);
+	if (fd == -1 || write(fd, buf, len) != len) {
+		if (limits_configured()) {
+			// the parent shuts down and kills the child
+			fprintf(stderr, "Error: cannot move the sandbox in cgroup %s: %s\n", leaf_path, strerror(errno));
+			kill(child, SIGKILL);
+			exit(1);
+		}
+		fwarning("cannot move the sandbox in cgroup %s: %s, --cgroup-leaf disabled\n", leaf_path, strerror(errno));
+		cgroup_leaf_remove(pid);
+	}
+	else if (arg_debug)
+		printf("Sandbox moved in cgroup %s\n", leaf_path);
+	if (fd != -1)
+		close(fd);
+	EUID_USER();
+}
+
+// remove the leaf of a sandbox; if processes are still running in it,
+// the run file is kept and the leaf is removed later when cleaning the
+// run directory
+void cgroup_leaf_remove(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_CGROUP_DIR, pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	if (!fp) {
+		free(fname);
+		return;
+	}
+
+	char leaf[MAXBUF];
+	int removed = 1;
+	if (fgets(leaf, MAXBUF, fp)) {
+		char *ptr = strchr(leaf, '\n');
+		if (ptr)
+			*ptr = '\0';
+
+		// the processes of the sandbox could still be exiting
+		int i;
+		for (i = 0; i < CGROUP_REMOVE_TRIES; i++) {
+			if (rmdir(leaf) == 0 || errno == ENOENT)
+				break;
+			if (errno != EBUSY) {
+				i = CGROUP_REMOVE_TRIES;
+				break;
+			}
+			usleep(CGROUP_REMOVE_USEC);
+		}
+		if (i == CGROUP_REMOVE_TRIES) {
+			removed = 0;
+			if (arg_debug)
+				printf("Cannot remove cgroup %s: %s\n", leaf, strerror(errno));
+		}
+	}
+	fclose(fp);
+
+	if (removed) {
+		int rv = unlink(fname);
+		(void) rv;
+	}
+	free(fname);
+}
+
+// the cgroup of a sandbox, NULL if the sandbox was started without one
+char *cgroup_leaf_path(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_CGROUP_DIR, pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return NULL;
+
+	char leaf[MAXBUF];
+	char *rv = NULL;
+	if (fgets(leaf, MAXBUF, fp)) {
+		char *ptr = strchr(leaf, '\n');
+		if (ptr)
+			*ptr = '\0';
+		rv = strdup(leaf);
+		if (!rv)
+			errExit("strdup");
+	}
+	fclose(fp);
+	return rv;
+}
+
+// the value of a key in cgroup.events, -1 if not available
+static int read_event(int fd, const char *key) {
+	char buf[MAXBUF];
+	ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	size_t keylen = strlen(key);
+	char *ptr = buf;
+	while (ptr && *ptr) {
+		if (strncmp(ptr, key, keylen) == 0 && ptr[keylen] == ' ')
+			return atoi(ptr + keylen + 1);
+		ptr = strchr(ptr, '\n');
+		if (ptr)
+			ptr++;
+	}
+	return -1;
+}
+
+// 1 if all the processes in the cgroup are frozen, -1 on error
+int cgroup_leaf_frozen(const char *leaf) {
+	assert(leaf);
+	char *fname;
+	if (asprintf(&fname, "%s/cgroup.events", leaf) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_RDONLY | O_CLOEXEC);
+	free(fname);
+	if (fd == -1)
+		return -1;
+	int rv = read_event(fd, "frozen");
+	close(fd);
+	return rv;
+}
+
+// freeze or thaw the cgroup (cgroup.freeze, Linux 5.2); the kernel
+// freezes the processes one by one, wait until cgroup.events reports the
+// new state. Return -1 on error.
+int cgroup_leaf_freeze(const char *leaf, int freeze) {
+	assert(leaf);
+	char *fname;
+	if (asprintf(&fname, "%s/cgroup.freeze", leaf) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_WRONLY | O_CLOEXEC);
+	free(fname);
+	if (fd == -1)
+		return -1;
+	int rv = (write(fd, (freeze) ? "1" : "0", 1) == 1) ? 0 : -1;
+	close(fd);
+	if (rv == -1)
+		return -1;
+
+	// cgroup.events is modified when the state changes
+	if (asprintf(&fname, "%s/cgroup.events", leaf) == -1)
+		errExit("asprintf");
+	fd = open(fname, O_RDONLY | O_CLOEXEC);
+	free(fname);
+	if (fd == -1)
+		return -1;
+	int i;
+	rv = -1;
+	for (i = 0; i < CGROUP_FREEZE_TRIES; i++) {
+		if (read_event(fd, "frozen") == freeze) {
+			rv = 0;
+			break;
+		}
+		struct pollfd pfd = { fd, POLLPRI, 0 };
+		poll(&pfd, 1, CGROUP_FREEZE_MSEC);
+	}
+	close(fd);
+	if (rv == -1)
+		errno = ETIMEDOUT;
+	return rv;
+}
@@ -21,10 +21,11 @@
 #include "../include/seccomp.h"
 #include "../include/syscall.h"
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <linux/loop.h>
 #include <limits.h>
 
-#define MAX_READ 8192				  // line buffer for profile files
+#define MAX_READ 8192				  // initial buffer size if the file size is not known
 
 static int initialized = 0;
 static int cfg_val[CFG_MAX];
@@ -42,11 +43,47 @@ unsigned long join_timeout = 5000000; // microseconds
 char *config_seccomp_error_action_str = "EPERM";
 char *config_seccomp_filter_add = NULL;
 char **whitelist_reject_topdirs = NULL;
+long long unsigned config_tmpfs_size = 0;
+long long unsigned config_tmpfs_inodes = 0;
+char *config_tmpfs_huge = NULL;
+
+// read the configuration file, return NULL if the file cannot be opened
+static char *config_load(const char *fname) {
+	int fd = open(fname, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	struct stat s;
+	size_t size = (fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0) ? s.st_size : MAX_READ;
+	char *buf = malloc(size + 1);
+	if (!buf)
+		errExit("malloc");
+	size_t cnt = 0;
+	for (;;) {
+		if (cnt == size) {
+			size *= 2;
+			buf = realloc(buf, size + 1);
+			if (!buf)
+				errExit("realloc");
+		}
+		ssize_t rv = read(fd, buf + cnt, size - cnt);
+		if (rv == -1 && errno == EINTR)
+			continue;
+		if (rv <= 0)
+			break;
+		cnt += rv;
+	}
+	close(fd);
+
+	// a '\0' in the file ends the configuration, as with fgets() and string functions
+	buf[cnt] = '\0';
+	return buf;
+}
 
 int checkcfg(int val) {
 	assert(val < CFG_MAX);
 	int line = 0;
-	FILE *fp = NULL;
+	char *buf = NULL;
 	char *ptr;
 
 	if (!initialized) {
@@ -68,21 +105,38 @@ int checkcfg(int val) {
 		cfg_val[CFG_SECCOMP_LOG] = 0;
 		cfg_val[CFG_PRIVATE_LIB] = 0;
 		cfg_val[CFG_TRACELOG] = 0;
-
-		// open configuration file
+		cfg_val[CFG_FSLOGGER_BINARY] = 0;
+		cfg_val[CFG_PRIVATE_ETC_BIND] = 0;
+		cfg_val[CFG_PRIVATE_BIN_BIND] = 0;
+		cfg_val[CFG_PROFILE_BUNDLE] = 0;
+		cfg_val[CFG_SECCOMP_SPEC_ALLOW] = 0;
+		cfg_val[CFG_ARP_CHECK] = 0;
+		cfg_val[CFG_NFTABLES] = 0;
+		cfg_val[CFG_DBUS_PROXY_SHARED] = 0;
+		cfg_val[CFG_TMPFS_NOSWAP] = 0;
+
+		// read configuration file in one buffer
 		const char *fname = SYSCONFDIR "/firejail.config";
-		fp = fopen(fname, "re");
-		if (!fp) {
+		buf = config_load(fname);
+		if (!buf) {
 			fprintf(stderr, "Warning: Firejail configuration file %s not found, using defaults\n", fname);
 			initialized = 1;
 			return	cfg_val[val];
 		}
 
-		// read configuration file
-		char buf[MAX_READ];
-		while (fgets(buf,MAX_READ, fp)) {
+		// most lines are comments, skip them without copying
+		char *next = buf;
+		while (*next != '\0') {
+			char *start = next;
+			char *nl = strchr(start, '\n');
+			if (nl) {
+				*nl = '\0';
+				next = nl + 1;
+			}
+			else
+				next = start + strlen(start);
 			line++;
-			if (*buf == '#' || *buf == '\n')
+			if (*start == '#' || *start == '\0')
 				continue;
 
 #define PARSE_YESNO(key, string) \
@@ -96,9 +150,9 @@ int checkcfg(int val) {
 			}
 
 			// parse line
-			ptr = line_remove_spaces(buf);
-			if (!ptr)
-				continue;
+			ptr = line_remove_spaces_inplace(start);
+			if (*ptr == '\0')	// blank line, not allowed
+				goto errout;
 			PARSE_YESNO(CFG_FILE_TRANSFER, "file-transfer")
 			PARSE_YESNO(CFG_DBUS, "dbus")
 			PARSE_YESNO(CFG_JOIN, "join")
@@ -129,6 +183,23 @@ int checkcfg(int val) {
 			PARSE_YESNO(CFG_BROWSER_ALLOW_DRM, "browser-allow-drm")
 			PARSE_YESNO(CFG_ALLOW_TRAY, "allow-tray")
 			PARSE_YESNO(CFG_SECCOMP_LOG, "seccomp-log")
+			PARSE_YESNO(CFG_SECCOMP_CACHE, "seccomp-cache")
+			PARSE_YESNO(CFG_SECCOMP_SERVER, "seccomp-server")
+			PARSE_YESNO(CFG_SECCOMP_SPEC_ALLOW, "seccomp-spec-allow")
+			PARSE_YESNO(CFG_PRIVATE_LIB_CACHE, "private-lib-cache")
+			PARSE_YESNO(CFG_FSLOGGER_BINARY, "fslogger-binary")
+			PARSE_YESNO(CFG_PRIVATE_DEV_CACHE, "private-dev-cache")
+			PARSE_YESNO(CFG_PROFILE_BUNDLE, "profile-bundle")
+			PARSE_YESNO(CFG_ARP_CHECK, "arp-check")
+			PARSE_YESNO(CFG_NFTABLES, "nftables")
+			PARSE_YESNO(CFG_DBUS_PROXY_SHARED, "dbus-proxy-shared")
+			PARSE_YESNO(CFG_RESTRICT_USERS_CACHE, "restrict-users-cache")
+			PARSE_YESNO(CFG_LAUNCH_STATS, "launch-stats")
+			PARSE_YESNO(CFG_VAR_LOG_CACHE, "var-log-cache")
+			PARSE_YESNO(CFG_KPATH_CACHE, "kernel-paths-cache")
+			PARSE_YESNO(CFG_SECCOMP_STORE, "seccomp-store")
+			PARSE_YESNO(CFG_HOSTS_CACHE, "hosts-cache")
+			PARSE_YESNO(CFG_TMPFS_NOSWAP, "tmpfs-noswap")
 #undef PARSE_YESNO
 
 			// netfilter
@@ -264,8 +335,32 @@ int checkcfg(int val) {
 			}
 
 			// file copy limit
+			// tmpfs limits
+			else if (strncmp(ptr, "tmpfs-size ", 11) == 0) {
+				config_tmpfs_size = parse_arg_size(ptr + 11);
+				if (config_tmpfs_size == 0)
+					goto errout;
+			}
+			else if (strncmp(ptr, "tmpfs-inodes ", 13) == 0) {
+				char *end;
+				config_tmpfs_inodes = strtoull(ptr + 13, &end, 10);
+				if (end == ptr + 13 || *end != '\0' || config_tmpfs_inodes == 0)
+					goto errout;
+			}
+			else if (strncmp(ptr, "tmpfs-huge ", 11) == 0) {
+				const char *val = ptr + 11;
+				if (strcmp(val, "never") && strcmp(val, "always") &&
+				    strcmp(val, "within_size") && strcmp(val, "advise"))
+					goto errout;
+				config_tmpfs_huge = strdup(val);
+				if (!config_tmpfs_huge)
+					errExit("strdup");
+			}
+
 			else if (strncmp(ptr, "file-copy-limit ", 16) == 0)
 				env_store_name_val("FIREJAIL_FILE_COPY_LIMIT", ptr + 16, SETENV);
+			else if (strncmp(ptr, "file-copy-count-limit ", 22) == 0)
+				env_store_name_val("FIREJAIL_FILE_COPY_COUNT_LIMIT", ptr + 22, SETENV);
 
 			// timeout for join option
 			else if (strncmp(ptr, "join-timeout ", 13) == 0)
@@ -275,6 +370,26 @@ int checkcfg(int val) {
 			else if (strncmp(ptr, "seccomp-filter-add ", 19) == 0)
 				config_seccomp_filter_add = seccomp_check_list(ptr + 19);
 
+			// private-etc mode
+			else if (strncmp(ptr, "private-etc-mode ", 17) == 0) {
+				if (strcmp(ptr + 17, "copy") == 0)
+					cfg_val[CFG_PRIVATE_ETC_BIND] = 0;
+				else if (strcmp(ptr + 17, "bind") == 0)
+					cfg_val[CFG_PRIVATE_ETC_BIND] = 1;
+				else
+					goto errout;
+			}
+
+			// private-bin mode
+			else if (strncmp(ptr, "private-bin-mode ", 17) == 0) {
+				if (strcmp(ptr + 17, "copy") == 0)
+					cfg_val[CFG_PRIVATE_BIN_BIND] = 0;
+				else if (strcmp(ptr + 17, "bind") == 0)
+					cfg_val[CFG_PRIVATE_BIN_BIND] = 1;
+				else
+					goto errout;
+			}
+
 			// seccomp error action
 			else if (strncmp(ptr, "seccomp-error-action ", 21) == 0) {
 				if (strcmp(ptr + 21, "kill") == 0)
@@ -318,11 +433,9 @@ int checkcfg(int val) {
 
 			else
 				goto errout;
-
-			free(ptr);
 		}
 
-		fclose(fp);
+		free(buf);
 		initialized = 1;
 	}
 
@@ -336,10 +449,8 @@ int checkcfg(int val) {
 	return cfg_val[val];
 
 errout:
-	assert(ptr);
-	free(ptr);
-	assert(fp);
-	fclose(fp);
+	assert(buf);
+	free(buf);
 	fprintf(stderr, "Error: invalid line %d in firejail configuration file\n", line );
 	exit(1);
 }
@@ -274,9 +274,7 @@ void fs_chroot(const char *rootdir) {
 
 	// create all other /run/firejail files and directories
 	preproc_build_firejail_dir_unlocked();
-	preproc_lock_firejail_dir();
-	preproc_build_firejail_dir_locked();
-	preproc_unlock_firejail_dir();
+	preproc_build_firejail_dir();
 
 	// update /var directory in order to support multiple sandboxes running on the same root directory
 	//	if (!arg_private_dev)
@@ -19,6 +19,7 @@
 */
 #ifdef HAVE_DBUSPROXY
 #include "firejail.h"
+#include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -26,6 +27,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <string.h>
 
 #ifndef O_PATH
@@ -39,8 +41,7 @@
 #define DBUS_SESSION_BUS_ADDRESS_ENV "DBUS_SESSION_BUS_ADDRESS"
 #define DBUS_SYSTEM_BUS_ADDRESS_ENV "DBUS_SYSTEM_BUS_ADDRESS"
 #define DBUS_USER_DIR_FORMAT RUN_FIREJAIL_DBUS_DIR "/%d"
-#define DBUS_USER_PROXY_SOCKET_FORMAT DBUS_USER_DIR_FORMAT "/%d-user"
-#define DBUS_SYSTEM_PROXY_SOCKET_FORMAT DBUS_USER_DIR_FORMAT "/%d-system"
+#define DBUS_PROXY_DIR_FORMAT DBUS_USER_DIR_FORMAT "/%d"
 #define DBUS_MAX_NAME_LENGTH 255
 // moved to include/common.h - #define XDG_DBUS_PROXY_PATH "/usr/bin/xdg-dbus-proxy"
 
@@ -48,6 +49,9 @@ static pid_t dbus_proxy_pid = 0;
 static int dbus_proxy_status_fd = -1;
 static char *dbus_user_proxy_socket = NULL;
 static char *dbus_system_proxy_socket = NULL;
+// the proxy sockets are in this directory, mounted on RUN_DBUS_DIR in the
+// sandbox; the sockets can be created after the mount
+static char *dbus_proxy_dir = NULL;
 
 static int check_bus_or_interface_name(const char *name, int hyphens_allowed) {
 	unsigned long length = strlen(name);
@@ -167,12 +171,12 @@ static void dbus_check_bus_profile(char const *prefix, DbusPolicy *policy) {
 	}
 
 	size_t prefix_length = strlen(prefix);
-	ProfileEntry *it = cfg.profile;
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_DBUS];
 	int num_matches = 0;
 	const char *first_match = NULL;
-	while (it) {
-		char *data = it->data;
-		it = it->next;
+	int i;
+	for (i = 0; i < b->cnt; i++) {
+		char *data = b->entries[i]->data;
 		if (strncmp(prefix, data, prefix_length) == 0) {
 			++num_matches;
 			if (first_match == NULL)
@@ -199,7 +203,7 @@ void dbus_check_profile(void) {
 	dbus_check_bus_profile("dbus-system", &arg_dbus_system);
 }
 
-static void write_arg(int fd, char const *format, ...) {
+static void write_arg(FILE *fp, char const *format, ...) {
 	va_list ap;
 	va_start(ap, format);
 	char *arg;
@@ -207,20 +211,19 @@ static void write_arg(int fd, char const *format, ...) {
 	va_end(ap);
 	if (length == -1)
 		errExit("vasprintf");
-	length++;
 	if (arg_debug)
 		printf("xdg-dbus-proxy arg: %s\n", arg);
-	if (write(fd, arg, (size_t) length) != (ssize_t) length)
-		errExit("write");
+	if (fwrite(arg, 1, (size_t) length + 1, fp) != (size_t) length + 1)
+		errExit("fwrite");
 	free(arg);
 }
 
-static void write_profile(int fd, char const *prefix) {
+static void write_profile(FILE *fp, char const *prefix) {
 	size_t prefix_length = strlen(prefix);
-	ProfileEntry *it = cfg.profile;
-	while (it) {
-		char *data = it->data;
-		it = it->next;
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_DBUS];
+	int i;
+	for (i = 0; i < b->cnt; i++) {
+		char *data = b->entries[i]->data;
 		if (strncmp(prefix, data, prefix_length) != 0)
 			continue;
 		data += prefix_length;
@@ -229,7 +232,7 @@ static void write_profile(int fd, char const *prefix) {
 			arg_length++;
 		if (data[arg_length] != ' ')
 			continue;
-		write_arg(fd, "--%.*s=%s", arg_length, data, &data[arg_length + 1]);
+		write_arg(fp, "--%.*s=%s", arg_length, data, &data[arg_length + 1]);
 	}
 }
 
@@ -279,29 +282,118 @@ static char *find_user_socket(void) {
 	exit(1);
 }
 
-void dbus_proxy_start(void) {
-	dbus_create_user_dir();
+// build the xdg-dbus-proxy arguments, '\0' separated, for the proxy sockets
+// user_socket and system_socket
+static char *build_args(const char *user_socket, const char *system_socket, size_t *len) {
+	char *args = NULL;
+	FILE *fp = open_memstream(&args, len);
+	if (!fp)
+		errExit("open_memstream");
+
+	if (arg_dbus_user == DBUS_POLICY_FILTER) {
+		const char *user_env = env_get(DBUS_SESSION_BUS_ADDRESS_ENV);
+		if (user_env == NULL) {
+			char *dbus_user_socket = find_user_socket();
+			write_arg(fp, DBUS_SOCKET_PATH_PREFIX "%s",
+					  dbus_user_socket);
+			free(dbus_user_socket);
+		} else {
+			write_arg(fp, "%s", user_env);
+		}
+		write_arg(fp, "%s", user_socket);
+		if (arg_dbus_log_user) {
+			write_arg(fp, "--log");
+		}
+		write_arg(fp, "--filter");
+		write_profile(fp, "dbus-user.");
+	}
 
-	EUID_USER();
+	if (arg_dbus_system == DBUS_POLICY_FILTER) {
+		const char *system_env = env_get(DBUS_SYSTEM_BUS_ADDRESS_ENV);
+		if (system_env == NULL) {
+			write_arg(fp,
+					  DBUS_SOCKET_PATH_PREFIX DBUS_SYSTEM_SOCKET);
+		} else {
+			write_arg(fp, "%s", system_env);
+		}
+		write_arg(fp, "%s", system_socket);
+		if (arg_dbus_log_system) {
+			write_arg(fp, "--log");
+		}
+		write_arg(fp, "--filter");
+		write_profile(fp, "dbus-system.");
+	}
+
+	if (fclose(fp))
+		errExit("fclose");
+	return args;
+}
 
+// wait for xdg-dbus-proxy to be ready, it writes one byte on the status pipe
+static void proxy_wait(int fd) {
+	char buf[1];
+	ssize_t read_bytes = read(fd, buf, 1);
+	switch (read_bytes) {
+	case -1:
+		errExit("read");
+		break;
+	case 0:
+		fprintf(stderr, "xdg-dbus-proxy closed pipe unexpectedly\n");
+		exit(-1);
+		break;
+	case 1:
+		if (arg_debug)
+			printf("xdg-dbus-proxy initialized\n");
+		break;
+	default:
+		assert(0);
+	}
+}
+
+// start xdg-dbus-proxy; a shared proxy runs in the background, it doesn't
+// exit with the sandbox, and it is ready when the function returns
+// return the pid of the proxy
+static pid_t proxy_run(const char *proxy_args, size_t len, int shared) {
 	int status_pipe[2];
 	if (pipe(status_pipe) == -1)
 		errExit("pipe");
-	dbus_proxy_status_fd = status_pipe[0];
 
 	int args_pipe[2];
 	if (pipe(args_pipe) == -1)
 		errExit("pipe");
 
-	dbus_proxy_pid = fork();
-	if (dbus_proxy_pid == -1)
+	pid_t child = fork();
+	if (child == -1)
 		errExit("fork");
-	if (dbus_proxy_pid == 0) {
-		// close open files
-		int keep[2];
+	if (child == 0) {
+		// close open files; a shared proxy keeps the read end of the
+		// status pipe, so it doesn't exit when this sandbox closes it
+		int keep[3];
 		keep[0] = status_pipe[1];
 		keep[1] = args_pipe[0];
-		close_all(keep, ARRAY_SIZE(keep));
+		keep[2] = status_pipe[0];
+		close_all(keep, shared ? 3 : 2);
+
+		if (shared) {
+			setsid();
+			pid_t proxy = fork();
+			if (proxy == -1)
+				errExit("fork");
+			if (proxy)
+				_exit(0);
+			proxy = getpid();
+			if (write(status_pipe[1], &proxy, sizeof(proxy)) != sizeof(proxy))
+				errExit("write");
+
+			// the proxy outlives the terminal of this sandbox
+			int fd = open("/dev/null", O_RDWR);
+			if (fd != -1) {
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+				if (fd > STDERR_FILENO)
+					close(fd);
+			}
+		}
 
 		if (arg_dbus_log_file != NULL) {
 			int output_fd = creat(arg_dbus_log_file, 0666);
@@ -321,75 +413,310 @@ void dbus_proxy_start(void) {
 		if (arg_debug)
 			printf("starting xdg-dbus-proxy\n");
 		sbox_exec_v(SBOX_USER | SBOX_SECCOMP | SBOX_CAPS_NONE | SBOX_KEEP_FDS, args);
-	} else {
-		if (close(status_pipe[1]) == -1 || close(args_pipe[0]) == -1)
-			errExit("close");
-
-		if (arg_dbus_user == DBUS_POLICY_FILTER) {
-			const char *user_env = env_get(DBUS_SESSION_BUS_ADDRESS_ENV);
-			if (user_env == NULL) {
-				char *dbus_user_socket = find_user_socket();
-				write_arg(args_pipe[1], DBUS_SOCKET_PATH_PREFIX "%s",
-						  dbus_user_socket);
-				free(dbus_user_socket);
-			} else {
-				write_arg(args_pipe[1], "%s", user_env);
-			}
-			if (asprintf(&dbus_user_proxy_socket, DBUS_USER_PROXY_SOCKET_FORMAT,
-						 (int) getuid(), (int) getpid()) == -1)
-				errExit("asprintf");
-			write_arg(args_pipe[1], "%s", dbus_user_proxy_socket);
-			if (arg_dbus_log_user) {
-				write_arg(args_pipe[1], "--log");
-			}
-			write_arg(args_pipe[1], "--filter");
-			write_profile(args_pipe[1], "dbus-user.");
-		}
+	}
 
-		if (arg_dbus_system == DBUS_POLICY_FILTER) {
-			const char *system_env = env_get(DBUS_SYSTEM_BUS_ADDRESS_ENV);
-			if (system_env == NULL) {
-				write_arg(args_pipe[1],
-						  DBUS_SOCKET_PATH_PREFIX DBUS_SYSTEM_SOCKET);
-			} else {
-				write_arg(args_pipe[1], "%s", system_env);
-			}
-			if (asprintf(&dbus_system_proxy_socket, DBUS_SYSTEM_PROXY_SOCKET_FORMAT,
-						 (int) getuid(), (int) getpid()) == -1)
-				errExit("asprintf");
-			write_arg(args_pipe[1], "%s", dbus_system_proxy_socket);
-			if (arg_dbus_log_system) {
-				write_arg(args_pipe[1], "--log");
-			}
-			write_arg(args_pipe[1], "--filter");
-			write_profile(args_pipe[1], "dbus-system.");
-		}
+	if (close(status_pipe[1]) == -1 || close(args_pipe[0]) == -1)
+		errExit("close");
+	if (write(args_pipe[1], proxy_args, len) != (ssize_t) len)
+		errExit("write");
+	if (close(args_pipe[1]) == -1)
+		errExit("close");
+
+	// the proxy of the sandbox starts while the sandbox is set up, the
+	// sandbox waits for it before mounting the socket
+	if (!shared) {
+		dbus_proxy_status_fd = status_pipe[0];
+		return child;
+	}
+
+	pid_t proxy;
+	waitpid(child, NULL, 0);
+	if (read(status_pipe[0], &proxy, sizeof(proxy)) != sizeof(proxy)) {
+		fprintf(stderr, "xdg-dbus-proxy closed pipe unexpectedly\n");
+		exit(-1);
+	}
+	proxy_wait(status_pipe[0]);
+	close(status_pipe[0]);
+	return proxy;
+}
 
-		if (close(args_pipe[1]) == -1)
-			errExit("close");
-		char buf[1];
-		ssize_t read_bytes = read(status_pipe[0], buf, 1);
-		switch (read_bytes) {
-		case -1:
-			errExit("read");
-			break;
-		case 0:
-			fprintf(stderr, "xdg-dbus-proxy closed pipe unexpectedly\n");
-			// Wait for the subordinate process to write any errors to stderr and exit.
-			waitpid(dbus_proxy_pid, NULL, 0);
-			exit(-1);
-			break;
-		case 1:
-			if (arg_debug)
-				printf("xdg-dbus-proxy initialized\n");
-			break;
-		default:
-			assert(0);
+// create the socket directory of the proxy, with an empty file for the
+// blocked buses, as RUN_DBUS_USER_SOCKET and RUN_DBUS_SYSTEM_SOCKET
+// without a proxy
+static void proxy_dir_create(const char *dir) {
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+		errExit("mkdir");
+	struct stat s;
+	if (lstat(dir, &s) == -1 || !S_ISDIR(s.st_mode) || s.st_uid != getuid()) {
+		fprintf(stderr, "Error: invalid %s directory\n", dir);
+		exit(1);
+	}
+
+	const char *name[2] = { "user", "system" };
+	DbusPolicy policy[2] = { arg_dbus_user, arg_dbus_system };
+	int i;
+	for (i = 0; i < 2; i++) {
+		char *fname;
+		if (asprintf(&fname, "%s/%s", dir, name[i]) == -1)
+			errExit("asprintf");
+		unlink(fname);	// left by a sandbox gone
+		if (policy[i] == DBUS_POLICY_BLOCK) {
+			int fd = open(fname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+			if (fd == -1)
+				errExit("open");
+			close(fd);
 		}
+		free(fname);
 	}
 }
 
+static void proxy_dir_remove(const char *dir) {
+	const char *name[2] = { "user", "system" };
+	int i;
+	for (i = 0; i < 2; i++) {
+		char *fname;
+		if (asprintf(&fname, "%s/%s", dir, name[i]) == -1)
+			errExit("asprintf");
+		unlink(fname);
+		free(fname);
+	}
+	rmdir(dir);
+}
+
+// Shared proxies, "dbus-proxy-shared yes" in firejail.config: the sandboxes
+// of a user with the same policy connect to the same xdg-dbus-proxy. The
+// proxy filters every connection separately, sharing the process changes
+// nothing for the sandboxes. The files of a proxy are in the user directory,
+// named shared-<policy hash>: the policy to detect hash collisions, the pid
+// of the proxy, and the pids of the sandboxes using it.
+// The last sandbox stops the proxy. The sockets are in the shared-<policy hash>
+// directory.
+static char *shared_base = NULL;
+
+static char *shared_fname(const char *suffix) {
+	char *fname;
+	if (asprintf(&fname, "%s%s", shared_base, suffix) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+static int shared_lock(void) {
+	char *fname = shared_fname(".lock");
+	int fd = open(fname, O_RDONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+	if (fd == -1)
+		errExit("open");
+	if (flock(fd, LOCK_EX) == -1)
+		errExit("flock");
+	free(fname);
+	return fd;
+}
+
+// a proxy started by this user
+static int shared_proxy_running(pid_t pid) {
+	if (pid <= 0)
+		return 0;
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/cmdline", (int) pid) == -1)
+		errExit("asprintf");
+	int rv = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		char buf[sizeof(XDG_DBUS_PROXY_PATH)];
+		struct stat s;
+		if (fread(buf, 1, sizeof(buf), fp) == sizeof(buf) &&
+		    memcmp(buf, XDG_DBUS_PROXY_PATH, sizeof(buf)) == 0 &&
+		    fstat(fileno(fp), &s) == 0 && s.st_uid == getuid())
+			rv = 1;
+		fclose(fp);
+	}
+	free(fname);
+	return rv;
+}
+
+static pid_t shared_read_pid(void) {
+	char *fname = shared_fname(".pid");
+	int pid = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		if (fscanf(fp, "%d", &pid) != 1)
+			pid = 0;
+		fclose(fp);
+	}
+	free(fname);
+	return pid;
+}
+
+// the proxy was started with the same policy
+static int shared_same_policy(const char *policy, size_t len) {
+	char *fname = shared_fname(".policy");
+	int rv = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		char *buf = malloc(len + 1);
+		if (!buf)
+			errExit("malloc");
+		rv = (fread(buf, 1, len + 1, fp) == len && memcmp(buf, policy, len) == 0);
+		free(buf);
+		fclose(fp);
+	}
+	free(fname);
+	return rv;
+}
+
+static void shared_write_file(const char *suffix, const char *data, size_t len) {
+	char *fname = shared_fname(suffix);
+	FILE *fp = fopen(fname, "we");
+	if (!fp || fwrite(data, 1, len, fp) != len || fclose(fp)) {
+		fprintf(stderr, "Error: cannot write %s\n", fname);
+		exit(1);
+	}
+	free(fname);
+}
+
+// remove pid from the users of the proxy, and the sandboxes gone
+// return the number of users left
+static int shared_users_update(pid_t pid) {
+	char *fname = shared_fname(".users");
+	FILE *fp = fopen(fname, "r+e");
+	free(fname);
+	if (!fp)
+		return 0;
+
+	pid_t users[256];
+	int cnt = 0;
+	int p;
+	while (cnt < 256 && fscanf(fp, "%d", &p) == 1) {
+		if (p == pid || (kill(p, 0) == -1 && errno == ESRCH))
+			continue;
+		users[cnt++] = p;
+	}
+	rewind(fp);
+	if (ftruncate(fileno(fp), 0) == -1)
+		errExit("ftruncate");
+	int i;
+	for (i = 0; i < cnt; i++)
+		fprintf(fp, "%d\n", users[i]);
+	fclose(fp);
+	return cnt;
+}
+
+static void shared_proxy_remove(void) {
+	pid_t pid = shared_read_pid();
+	if (shared_proxy_running(pid))
+		kill(pid, SIGTERM);
+	const char *suffix[] = { ".pid", ".policy", ".users", NULL };
+	int i;
+	for (i = 0; suffix[i]; i++) {
+		char *fname = shared_fname(suffix[i]);
+		unlink(fname);
+		free(fname);
+	}
+	proxy_dir_remove(shared_base);
+}
+
+// connect the sandbox to the shared proxy of the policy, started if needed
+// return 0 if the sandbox has to start its own proxy
+static int shared_proxy_start(void) {
+	// the policy, without the sockets; the blocked buses have a file in
+	// the socket directory
+	size_t args_len;
+	char *args = build_args("user", "system", &args_len);
+	char *policy = realloc(args, args_len + 32);
+	if (!policy)
+		errExit("realloc");
+	size_t len = args_len + snprintf(policy + args_len, 32, "%d %d", arg_dbus_user, arg_dbus_system);
+	if (asprintf(&shared_base, DBUS_USER_DIR_FORMAT "/shared-%016llx", (int) getuid(),
+		     (unsigned long long) fnv1a64(policy, len)) == -1)
+		errExit("asprintf");
+
+	int lock = shared_lock();
+	pid_t pid = shared_read_pid();
+	int users = shared_users_update(0);
+	if (!shared_proxy_running(pid) || users == 0) {
+		// no proxy, or a proxy left by sandboxes killed before cleaning up
+		shared_proxy_remove();
+		shared_write_file(".policy", policy, len);
+		proxy_dir_create(shared_base);
+		char *user_socket = shared_fname("/user");
+		char *system_socket = shared_fname("/system");
+		args = build_args(user_socket, system_socket, &args_len);
+		pid = proxy_run(args, args_len, 1);
+		free(args);
+		free(user_socket);
+		free(system_socket);
+
+		char *pidstr;
+		if (asprintf(&pidstr, "%d\n", (int) pid) == -1)
+			errExit("asprintf");
+		shared_write_file(".pid", pidstr, strlen(pidstr));
+		free(pidstr);
+	}
+	else if (!shared_same_policy(policy, len)) {
+		// hash collision
+		close(lock);
+		free(policy);
+		free(shared_base);
+		shared_base = NULL;
+		return 0;
+	}
+	else if (arg_debug)
+		printf("using the shared xdg-dbus-proxy, pid %d\n", (int) pid);
+	free(policy);
+
+	char *fname = shared_fname(".users");
+	FILE *fp = fopen(fname, "ae");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot write %s\n", fname);
+		exit(1);
+	}
+	fprintf(fp, "%d\n", (int) getpid());
+	fclose(fp);
+	free(fname);
+	close(lock);
+
+	dbus_proxy_dir = shared_fname("");
+	return 1;
+}
+
+static void shared_proxy_stop(void) {
+	int lock = shared_lock();
+	if (shared_users_update(getpid()) == 0)
+		shared_proxy_remove();
+	close(lock);
+	free(shared_base);
+	shared_base = NULL;
+}
+
+void dbus_proxy_start(void) {
+	dbus_create_user_dir();
+
+	EUID_USER();
+
+	// the log of a shared proxy would mix the sandboxes
+	if (checkcfg(CFG_DBUS_PROXY_SHARED) && arg_dbus_log_file == NULL &&
+	    !arg_dbus_log_user && !arg_dbus_log_system && shared_proxy_start())
+		return;
+
+	if (asprintf(&dbus_proxy_dir, DBUS_PROXY_DIR_FORMAT, (int) getuid(), (int) getpid()) == -1)
+		errExit("asprintf");
+	proxy_dir_create(dbus_proxy_dir);
+	if (arg_dbus_user == DBUS_POLICY_FILTER) {
+		if (asprintf(&dbus_user_proxy_socket, "%s/user", dbus_proxy_dir) == -1)
+			errExit("asprintf");
+	}
+	if (arg_dbus_system == DBUS_POLICY_FILTER) {
+		if (asprintf(&dbus_system_proxy_socket, "%s/system", dbus_proxy_dir) == -1)
+			errExit("asprintf");
+	}
+	size_t len;
+	char *args = build_args(dbus_user_proxy_socket, dbus_system_proxy_socket, &len);
+	dbus_proxy_pid = proxy_run(args, len, 0);
+	free(args);
+}
+
 void dbus_proxy_stop(void) {
+	if (shared_base)
+		shared_proxy_stop();
 	if (dbus_proxy_pid == 0)
 		return;
 	assert(dbus_proxy_status_fd >= 0);
@@ -399,9 +726,12 @@ void dbus_proxy_stop(void) {
 	if (waitpid(dbus_proxy_pid, &status, 0) == -1)
 		errExit("waitpid");
 	if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
-		fwarning("xdg-dbus-proxy returned %s\n", WEXITSTATUS(status));
+		fwarning("xdg-dbus-proxy returned %d\n", WEXITSTATUS(status));
 	dbus_proxy_pid = 0;
 	dbus_proxy_status_fd = -1;
+	proxy_dir_remove(dbus_proxy_dir);
+	free(dbus_proxy_dir);
+	dbus_proxy_dir = NULL;
 	if (dbus_user_proxy_socket != NULL) {
 		free(dbus_user_proxy_socket);
 		dbus_user_proxy_socket = NULL;
@@ -412,20 +742,33 @@ void dbus_proxy_stop(void) {
 	}
 }
 
-static void socket_overlay(char *socket_path, char *proxy_path) {
-	int fd = safer_openat(-1, proxy_path, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+// in the sandbox, before the application is started: wait for the proxy
+// started by the parent; the parent keeps the status pipe open, the proxy
+// runs until the parent exits
+void dbus_proxy_wait(void) {
+	if (dbus_proxy_status_fd == -1)
+		return;
+	proxy_wait(dbus_proxy_status_fd);
+	close(dbus_proxy_status_fd);
+	dbus_proxy_status_fd = -1;
+}
+
+// mount the socket directory of the proxy on RUN_DBUS_DIR, read-only
+static void socket_dir_overlay(void) {
+	int fd = safer_openat(-1, dbus_proxy_dir, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
 	if (fd == -1)
-		errExit("opening DBus proxy socket");
+		errExit("opening DBus proxy socket directory");
 	struct stat s;
 	if (fstat(fd, &s) == -1)
 		errExit("fstat");
-	if (!S_ISSOCK(s.st_mode)) {
-		errno = ENOTSOCK;
-		errExit("mounting DBus proxy socket");
+	if (s.st_uid != getuid()) {
+		fprintf(stderr, "Error: invalid %s directory\n", dbus_proxy_dir);
+		exit(1);
 	}
-	if (bind_mount_fd_to_path(fd, socket_path))
+	if (bind_mount_fd_to_path(fd, RUN_DBUS_DIR))
 		errExit("mount bind");
 	close(fd);
+	fs_remount(RUN_DBUS_DIR, MOUNT_READONLY, 0);
 }
 
 static const char *get_socket_env(const char *name) {
@@ -469,15 +812,12 @@ void dbus_apply_policy(void) {
 	}
 
 	create_empty_dir_as_root(RUN_DBUS_DIR, 0755);
+	if (dbus_proxy_dir)
+		socket_dir_overlay();
 
 	if (arg_dbus_user != DBUS_POLICY_ALLOW) {
-		create_empty_file_as_root(RUN_DBUS_USER_SOCKET, 0600);
-
-		if (arg_dbus_user == DBUS_POLICY_FILTER) {
-			assert(dbus_user_proxy_socket != NULL);
-			socket_overlay(RUN_DBUS_USER_SOCKET, dbus_user_proxy_socket);
-			free(dbus_user_proxy_socket);
-		}
+		if (!dbus_proxy_dir)
+			create_empty_file_as_root(RUN_DBUS_USER_SOCKET, 0600);
 
 		char *dbus_user_socket;
 		if (asprintf(&dbus_user_socket, DBUS_USER_SOCKET_FORMAT,
@@ -510,13 +850,8 @@ void dbus_apply_policy(void) {
 	}
 
 	if (arg_dbus_system != DBUS_POLICY_ALLOW) {
-		create_empty_file_as_root(RUN_DBUS_SYSTEM_SOCKET, 0600);
-
-		if (arg_dbus_system == DBUS_POLICY_FILTER) {
-			assert(dbus_system_proxy_socket != NULL);
-			socket_overlay(RUN_DBUS_SYSTEM_SOCKET, dbus_system_proxy_socket);
-			free(dbus_system_proxy_socket);
-		}
+		if (!dbus_proxy_dir)
+			create_empty_file_as_root(RUN_DBUS_SYSTEM_SOCKET, 0600);
 
 		disable_file_or_dir(DBUS_SYSTEM_SOCKET);
 
@@ -25,9 +25,11 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 pid_t dhclient4_pid = 0;
 pid_t dhclient6_pid = 0;
+static int dhcp_pending = 0;	// clients left negotiating in the background
 
 typedef struct {
 	char *version_arg;
@@ -57,13 +59,13 @@ static const Dhclient dhclient6 = {
 	.arg_offset = offsetof(Bridge, arg_ip6_dhcp)
 };
 
-static void dhcp_run_dhclient(char *dhclient_path, const Dhclient *client) {
-	char *argv[256] = {
-		dhclient_path,
-		client->version_arg,
-		"-pf", client->pid_file,
-		"-lf", client->leases_file,
-	};
+static void dhcp_dhclient_args(char *dhclient_path, const Dhclient *client, char **argv) {
+	argv[0] = dhclient_path;
+	argv[1] = client->version_arg;
+	argv[2] = "-pf";
+	argv[3] = client->pid_file;
+	argv[4] = "-lf";
+	argv[5] = client->leases_file;
 	int i = 6;
 	if (client->generate_duid)
 		argv[i++] = "-i";
@@ -81,8 +83,28 @@ static void dhcp_run_dhclient(char *dhclient_path, const Dhclient *client) {
 		argv[i++] = cfg.bridge2.devsandbox;
 	if (*(uint8_t *)((char *)&cfg.bridge3 + client->arg_offset))
 		argv[i++] = cfg.bridge3.devsandbox;
+	argv[i] = NULL;
+}
+
+// start dhclient without waiting for it; the process exits once the lease
+// is acquired and the daemon is running in the background
+static pid_t dhcp_spawn_dhclient(char *dhclient_path, const Dhclient *client) {
+	char *argv[256];
+	dhcp_dhclient_args(dhclient_path, client, argv);
+	if (arg_debug) {
+		printf("sbox run: ");
+		int i;
+		for (i = 0; argv[i]; i++)
+			printf("%s ", argv[i]);
+		printf("\n");
+	}
 
-	sbox_run_v(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_CAPS_NET_SERVICE | SBOX_SECCOMP, argv);
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child == 0)
+		sbox_exec_v(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_CAPS_NET_SERVICE | SBOX_SECCOMP, argv);
+	return child;
 }
 
 static pid_t dhcp_read_pidfile(const Dhclient *client) {
@@ -110,9 +132,30 @@ static pid_t dhcp_read_pidfile(const Dhclient *client) {
 	return found;
 }
 
-static void dhcp_start_dhclient(char *dhclient_path, const Dhclient *client) {
-	dhcp_run_dhclient(dhclient_path, client);
+// check the dhclient started by dhcp_spawn_dhclient(); returns 1 once the
+// lease is acquired
+static int dhcp_check_dhclient(pid_t *child, const Dhclient *client) {
+	if (*child == 0)
+		return 1;
+
+	int status;
+	pid_t rv = waitpid(*child, &status, WNOHANG);
+	if (rv == -1)
+		errExit("waitpid");
+	if (rv == 0)
+		return 0;
+	if (WIFSIGNALED(status) ||
+	   (WIFEXITED(status) && WEXITSTATUS(status) != 0)) {
+		fprintf(stderr, "Error: failed to run dhclient %s: exit status %d, exiting...\n",
+		        client->version_arg, WEXITSTATUS(status));
+		exit(1);
+	}
+
+	*child = 0;
 	*(client->pid) = dhcp_read_pidfile(client);
+	if (arg_debug)
+		printf("Running dhclient %s in the background as pid %ld\n", client->version_arg, (long) *(client->pid));
+	return 1;
 }
 
 static void dhcp_waitll(const char *ifname) {
@@ -130,6 +173,27 @@ static void dhcp_waitll_all() {
 		dhcp_waitll(cfg.bridge3.devsandbox);
 }
 
+// the clients still negotiating when --dhcp-timeout expired are not known
+// by PID, they are recognized by name
+int dhcp_client(pid_t pid) {
+	if (pid == dhclient4_pid || pid == dhclient6_pid)
+		return 1;
+	if (!dhcp_pending)
+		return 0;
+
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/comm", (int) pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return 0;
+	char buf[32];
+	int rv = (fgets(buf, sizeof(buf), fp) && strcmp(buf, "dhclient\n") == 0);
+	fclose(fp);
+	return rv;
+}
+
 // Temporarily copy dhclient executable under /run/firejail/mnt and start it from there
 // in order to recognize it later in firemon and firetools
 void dhcp_store_exec(void) {
@@ -164,21 +228,49 @@ void dhcp_start(void) {
 	if (mkdir(RUN_DHCLIENT_DIR, 0700))
 		errExit("mkdir");
 
-	if (any_ip_dhcp()) {
-		dhcp_start_dhclient(dhclient_path, &dhclient4);
-		if (arg_debug)
-			printf("Running dhclient -4 in the background as pid %ld\n", (long) dhclient4_pid);
-	}
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// DHCPv4 negotiates while the IPv6 link-local addresses are set up
+	pid_t child4 = 0;
+	pid_t child6 = 0;
+	if (any_ip_dhcp())
+		child4 = dhcp_spawn_dhclient(dhclient_path, &dhclient4);
 	if (any_ip6_dhcp()) {
 		dhcp_waitll_all();
-		dhcp_start_dhclient(dhclient_path, &dhclient6);
-		if (arg_debug)
-			printf("Running dhclient -6 in the background as pid %ld\n", (long) dhclient6_pid);
-		if (dhclient4_pid == dhclient6_pid) {
-			fprintf(stderr, "Error: dhclient -4 and -6 have the same PID: %ld\n", (long) dhclient4_pid);
-			exit(1);
+		child6 = dhcp_spawn_dhclient(dhclient_path, &dhclient6);
+	}
+
+	// with --dhcp-timeout the application is started once the time is up,
+	// if at least one family is configured
+	while (1) {
+		int done4 = dhcp_check_dhclient(&child4, &dhclient4);
+		int done6 = dhcp_check_dhclient(&child6, &dhclient6);
+		if (done4 && done6)
+			break;
+
+		if (arg_dhcp_timeout) {
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec - start.tv_sec >= (time_t) arg_dhcp_timeout) {
+				if (dhclient4_pid == 0 && dhclient6_pid == 0) {
+					fprintf(stderr, "Error: no DHCP lease acquired in %u seconds\n", arg_dhcp_timeout);
+					exit(1);
+				}
+				fwarning("DHCP%s lease not acquired in %u seconds, dhclient left running in the background\n",
+					(done4) ? "v6" : "v4", arg_dhcp_timeout);
+				dhcp_pending = 1;
+				break;
+			}
 		}
+		usleep(10000);
+	}
+
+	if (dhclient4_pid && dhclient4_pid == dhclient6_pid) {
+		fprintf(stderr, "Error: dhclient -4 and -6 have the same PID: %ld\n", (long) dhclient4_pid);
+		exit(1);
 	}
 
+	// a client still running keeps the executable open
 	unlink(dhclient_path);
 }
@@ -123,6 +123,9 @@ void env_defaults(void) {
 	// spawn KIO slaves inside the sandbox
 	env_store_name_val("KDE_FORK_SLAVES", "1", SETENV);
 
+	// set by libpostexecseccomp.so once the filter is installed
+	env_store("FIREJAIL_POSTEXEC_SECCOMP", RMENV);
+
 	// set prompt color to green
 	int set_prompt = 0;
 	if (checkcfg(CFG_FIREJAIL_PROMPT))
@@ -266,10 +269,13 @@ static const char * const env_whitelist[] = {
 
 static const char * const env_whitelist_sbox[] = {
 	"FIREJAIL_DEBUG",
+	"FIREJAIL_FCOPY_STATS",
+	"FIREJAIL_FILE_COPY_COUNT_LIMIT",
 	"FIREJAIL_FILE_COPY_LIMIT",
 	"FIREJAIL_PLUGIN",
 	"FIREJAIL_QUIET",
 	"FIREJAIL_SECCOMP_ERROR_ACTION",
+	"FIREJAIL_SECCOMP_HOT",
 	"FIREJAIL_TEST_ARGUMENTS",
 	"FIREJAIL_TRACEFILE"
 };
@@ -103,6 +103,8 @@ typedef struct bridge_t {
 	int mtu;		// interface mtu
 
 	char *veth_name;	// veth name for the device connected to the bridge
+	int bw_down;		// bandwidth profile command, KB/s
+	int bw_up;
 
 	// inside the sandbox
 	char *devsandbox;	// name of the device inside the sandbox
@@ -137,9 +139,19 @@ typedef struct topdir_t {
 	int fd;
 } TopDir;
 
+// profile commands are also sorted by their consumer; every consumer walks
+// only its own bucket, in profile order
+typedef enum {
+	PCMD_OTHER = 0,		// blacklist, read-only, tmpfs, mkdir, bind etc. - fs_blacklist()
+	PCMD_WHITELIST,		// whitelist and nowhitelist - fs_whitelist()
+	PCMD_DBUS,		// dbus-user.* and dbus-system.* - dbus.c
+	PCMD_MAX
+} ProfileCmd;
+
 typedef struct profile_entry_t {
 	struct profile_entry_t *next;
 	char *data;	// command
+	ProfileCmd cmd;
 
 	// whitelist command parameters
 	struct wparam_t {
@@ -150,6 +162,12 @@ typedef struct profile_entry_t {
 
 } ProfileEntry;
 
+typedef struct profile_bucket_t {
+	ProfileEntry **entries;
+	int cnt;
+	int max;
+} ProfileBucket;
+
 typedef struct landlock_entry_t {
 	struct landlock_entry_t *next;
 #define LL_FS_READ 0
@@ -157,7 +175,9 @@ typedef struct landlock_entry_t {
 #define LL_FS_MAKEIPC 2
 #define LL_FS_MAKEDEV 3
 #define LL_FS_EXEC 4
-#define LL_MAX 5
+#define LL_NET_BIND 5
+#define LL_NET_CONNECT 6
+#define LL_MAX 7
 	int type;
 	char *data;
 } LandlockEntry;
@@ -170,6 +190,7 @@ typedef struct config_t {
 
 	// filesystem
 	ProfileEntry *profile;
+	ProfileBucket profile_bucket[PCMD_MAX];	// cfg.profile entries by command
 	ProfileEntry *profile_rebuild_etc;	// blacklist files in /etc directory used by fs_rebuild_etc()
 	LandlockEntry *lprofile;
 
@@ -177,8 +198,10 @@ typedef struct config_t {
 	char *profile_ignore[MAX_PROFILE_IGNORE];
 	char *keep_fd;		// inherit file descriptors to sandbox
 	char *chrootdir;	// chroot directory
+	char *rootfs_image;	// root filesystem image, mounted on chrootdir
 	char *home_private;	// private home directory
 	char *home_private_keep;	// keep list for private home directory
+	char *home_snapshot;	// private home snapshot name
 	char *etc_private_keep;	// keep list for private etc directory
 	char *opt_private_keep;	// keep list for private opt directory
 	char *srv_private_keep;	// keep list for private srv directory
@@ -189,6 +212,7 @@ typedef struct config_t {
 
 	// networking
 	char *name;		// sandbox name
+	char *pool;		// --pool
 	char *hostname;	// host name
 	char *hosts_file;		// hosts file to be installed in the sandbox
 	uint32_t defaultgw;	// default gateway
@@ -212,6 +236,8 @@ typedef struct config_t {
 	char *protocol;			// protocol list
 	char *restrict_namespaces;			// namespaces list
 	char *seccomp_error_action;			// error action: kill, log or errno
+	char *seccomp_hot;			// syscalls checked first in the filters, hottest first
+	char *seccomp_list_notify;		// syscalls sent to the seccomp supervisor
 
 	// rlimits
 	long long unsigned rlimit_as;
@@ -220,11 +246,27 @@ typedef struct config_t {
 	long long unsigned rlimit_nofile;
 	long long unsigned rlimit_nproc;
 	long long unsigned rlimit_sigpending;
+
+	// cgroup v2 limits
+	unsigned cgroup_cpu_max;	// percent of a cpu
+	unsigned cgroup_cpu_weight;
+	long long unsigned cgroup_memory_high;
+	long long unsigned cgroup_memory_max;
+	char *cgroup_io_max;	// io.max lines
+
+	// tmpfs limits
+	long long unsigned tmpfs_size;
+	long long unsigned tmpfs_inodes;
 	unsigned timeout;	// maximum time elapsed before killing the sandbox
 
 	// cpu affinity, nice and control groups
 	uint32_t cpus;
+	int numa_node;
+	int numa_bind;	// MPOL_BIND instead of MPOL_PREFERRED
 	int nice;
+	int ioprio;	// ioprio_set() value, 0 if not set
+	int sched_policy;	// valid if arg_sched is set
+	unsigned sched_slice;	// microseconds, 0 if not set
 
 	// command line
 	char *command_line;
@@ -288,6 +330,7 @@ extern int arg_private_cache;	// private home/.cache
 extern int arg_debug;		// print debug messages
 extern int arg_debug_blacklists;	// print debug messages for blacklists
 extern int arg_debug_whitelists;	// print debug messages for whitelists
+extern int arg_debug_macros;	// print macro expansion statistics
 extern int arg_debug_private_lib;	// print debug messages for private-lib
 extern int arg_nonetwork;	// --net=none
 extern int arg_command;	// -c
@@ -298,14 +341,18 @@ extern int arg_seccomp;	// enable default seccomp filter
 extern int arg_seccomp32;	// enable default seccomp filter for 32 bit arch
 extern int arg_seccomp_postexec;	// need postexec ld.preload library?
 extern int arg_seccomp_block_secondary;	// block any secondary architectures
+extern int arg_seccomp_spec_allow;	// install the filters with SECCOMP_FILTER_FLAG_SPEC_ALLOW
+extern int arg_seccomp_tsync;	// install the filters with SECCOMP_FILTER_FLAG_TSYNC
 
 extern int arg_caps_default_filter;	// enable default capabilities filter
 extern int arg_caps_drop;		// drop list
 extern int arg_caps_drop_all;		// drop all capabilities
 extern int arg_caps_keep;		// keep list
 extern char *arg_caps_list;		// optional caps list
+extern uint64_t arg_caps_mask;		// caps list resolved
 
 extern int arg_trace;		// syscall tracing support
+extern int arg_trace_fanotify;	// trace the opens with fanotify
 extern char *arg_tracefile;	// syscall tracing file
 extern int arg_tracelog;	// blacklist tracing support
 extern int arg_rlimit_as;	//rlimit as
@@ -321,7 +368,9 @@ extern int arg_netfilter;	// enable netfilter
 extern int arg_netfilter6;	// enable netfilter6
 extern char *arg_netfilter_file;	// netfilter file
 extern char *arg_netfilter6_file;	// netfilter file
+extern unsigned arg_dhcp_timeout;	// --dhcp-timeout, seconds
 extern char *arg_netns;		// "ip netns"-created network namespace to use
+extern char *arg_net_group;	// --net-group name
 extern int arg_doubledash;	// double dash
 extern int arg_private_dev;	// private dev directory
 extern int arg_keep_dev_ntsync; // preserve /dev/ntsync
@@ -344,6 +393,13 @@ extern int arg_quiet;		// no output for scripting
 extern int arg_join_network;	// join only the network namespace
 extern int arg_join_filesystem;	// join only the mount namespace
 extern int arg_nice;		// nice value configured
+extern int arg_sched;		// scheduling policy configured
+extern int arg_cgroup_leaf;	// move the sandbox in its own cgroup
+extern int arg_perf_stat;	// print the performance counters at exit
+extern int arg_memory_merge;	// KSM merging of the anonymous memory
+#define NUMA_NODE 1
+#define NUMA_AUTO 2
+extern int arg_numa;		// NUMA_NODE or NUMA_AUTO
 extern int arg_ipc;		// enable ipc namespace
 extern int arg_writable_etc;	// writable etc
 extern int arg_keep_config_pulse;	// disable automatic ~/.config/pulse init
@@ -353,6 +409,8 @@ extern int arg_keep_var_tmp; // don't overwrite /var/tmp
 extern int arg_writable_run_user;	// writable /run/user
 extern int arg_writable_var_log; // writable /var/log
 extern int arg_appimage;	// appimage
+extern int arg_instances;	// number of sandboxes started
+extern int arg_warm_cache_run;	// exit before the program is started
 extern int arg_apparmor;	// apparmor
 extern char *apparmor_profile;	// apparmor profile
 extern bool apparmor_replace; // whether apparmor should replace the profile (legacy behavior)
@@ -370,6 +428,8 @@ extern int arg_nou2f;	// --nou2f
 extern int arg_noinput;	// --noinput
 extern int arg_deterministic_exit_code;	// always exit with first child's exit status
 extern int arg_deterministic_shutdown;	// shut down the sandbox if first child dies
+#define SHUTDOWN_GRACE_DEFAULT 10000	// ms
+extern int arg_shutdown_grace;	// --shutdown-grace, ms, -1 for the default
 extern int arg_keep_fd_all;	// inherit all file descriptors to sandbox
 extern int arg_netlock;	// netlocker
 extern int arg_restrict_namespaces;
@@ -410,9 +470,20 @@ char *guess_shell(void);
 int sandbox(void* sandbox_arg);
 void start_application(int no_sandbox, int fd, char *set_sandbox_status) __attribute__((noreturn));
 
+// network.c: fnet commands run in a single fnet script process
+typedef struct fnet_script_t {
+	const char *fnet;	// PATH_FNET_MAIN or PATH_FNET
+	char **cmd;
+	int cnt;
+	int max;
+} FnetScript;
+
 // network_main.c
 void net_configure_sandbox_ip(Bridge *br);
-void net_configure_veth_pair(Bridge *br, const char *ifname, pid_t child);
+void net_configure_veth_pair(Bridge *br, const char *ifname, pid_t child, FnetScript *script);
+#define NET_POOL_MAX 64
+int net_pool_size(const char *bridge);
+void net_pool(const char *arg);
 void net_check_cfg(void);
 void net_dns_print(pid_t pid) __attribute__((noreturn));
 void network_main(pid_t child);
@@ -423,21 +494,22 @@ int check_ip46_address(const char *addr);
 void net_if_up(const char *ifname);
 void net_if_down(const char *ifname);
 void net_if_ip(const char *ifname, uint32_t ip, uint32_t mask, int mtu);
-void net_if_ip6(const char *ifname, const char *addr6);
 int net_get_if_addr(const char *bridge, uint32_t *ip, uint32_t *mask, uint8_t mac[6], int *mtu);
 int net_add_route(uint32_t dest, uint32_t mask, uint32_t gw);
 uint32_t network_get_defaultgw(void);
-int net_config_mac(const char *ifname, const unsigned char mac[6]);
 int net_get_mac(const char *ifname, unsigned char mac[6]);
-void net_config_interface(const char *dev, uint32_t ip, uint32_t mask, int mtu);
+void fnet_script_init(FnetScript *script, const char *fnet);
+void fnet_script_add(FnetScript *script, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void fnet_script_run(FnetScript *script);
 
 // preproc.c
 void preproc_lock_firejail_dir(void);
+int preproc_trylock_firejail_dir(void);
 void preproc_unlock_firejail_dir(void);
 void preproc_lock_firejail_network_dir(void);
 void preproc_unlock_firejail_network_dir(void);
 void preproc_build_firejail_dir_unlocked(void);
-void preproc_build_firejail_dir_locked(void);
+void preproc_build_firejail_dir(void);
 void preproc_mount_mnt_dir(void);
 void preproc_clean_run(void);
 
@@ -455,7 +527,10 @@ typedef enum {
 
 // blacklist files or directories by mounting empty files on top of them
 void fs_blacklist(void);
+const char *fs_blacklist_stats(void);
 // mount a writable tmpfs
+#define TMPFS_COPY 1	// copies of host files, huge pages and noswap apply
+int tmpfs_mount(const char *dir, unsigned long flags, const char *options, unsigned type);
 void fs_tmpfs(const char *dir, unsigned check_owner);
 // remount noexec/nodev/nosuid or read-only or read-write
 void fs_remount(const char *dir, OPERATION op, int rec);
@@ -490,6 +565,7 @@ void profile_add_ignore(const char *str);
 char *profile_list_normalize(char *list);
 char *profile_list_compress(char *list);
 void profile_list_augment(char **list, const char *items);
+void profile_list_merge(char **list, const char *items);
 
 // list.c
 void list(void);
@@ -514,7 +590,9 @@ int process_open_nofail(ProcessHandle process, const char *fname);
 int process_open(ProcessHandle process, const char *fname);
 FILE *process_fopen(ProcessHandle process, const char *fname);
 int process_join_namespace(ProcessHandle process, char *type);
+int process_join_namespaces(ProcessHandle process, char **types);
 void process_send_signal(ProcessHandle process, int signum);
+int process_wait_exit(ProcessHandle process, int ms);
 ProcessHandle pin_parent_process(ProcessHandle process);
 ProcessHandle pin_child_process(ProcessHandle process, pid_t child);
 void process_rootfs_chroot(ProcessHandle process);
@@ -522,6 +600,27 @@ int process_rootfs_stat(ProcessHandle process, const char *fname, struct stat *s
 int process_rootfs_open(ProcessHandle process, const char *fname);
 
 // join.c
+// the sandbox state needed by --join, saved in RUN_JOIN_DESC_FILE
+#define JOIN_DESC_MAGIC 0x464a4a31	// "FJJ1"
+typedef struct {
+	uint32_t magic;
+	uint32_t size;		// sizeof(JoinDesc)
+	uint64_t caps;		// capabilities bounding set
+	uint32_t cpus;		// --cpu mask, 0 if not set
+	uint32_t umask;		// original umask
+	int32_t numa_node;	// -1 if not set
+	int32_t numa_bind;
+	uint8_t nonewprivs;
+	uint8_t nogroups;
+	uint8_t nice_set;
+	uint8_t sched_set;
+	int32_t nice;
+	int32_t ioprio;		// 0 if not set
+	int32_t sched_policy;
+	uint32_t sched_slice;	// microseconds, 0 if not set
+} JoinDesc;
+void save_join_desc(void);
+int join_desc_read(ProcessHandle sandbox, JoinDesc *desc);
 ProcessHandle pin_sandbox_process(pid_t pid);
 void join(pid_t pid, int argc, char **argv, int index) __attribute__((noreturn));
 
@@ -538,12 +637,18 @@ int arp_check(const char *dev, uint32_t destaddr);
 // assign an IP address using arp scanning
 uint32_t arp_assign(const char *dev, Bridge *br);
 
+// lease.c
+uint32_t lease_assign(Bridge *br);
+void lease_reserve(Bridge *br);
+void lease_release(pid_t pid);
+
 // macros.c
 char *expand_macros(const char *path);
 char *resolve_macro(const char *name);
 void invalid_filename(const char *fname, int globbing);
 int is_macro(const char *name);
 int macro_id(const char *name);
+void macro_print_stats(void);
 
 
 // util.c
@@ -573,6 +678,7 @@ int stat_as_user(const char *fname, struct stat *s);
 int lstat_as_user(const char *fname, struct stat *s);
 void trim_trailing_slash_or_dot(char *path);
 char *line_remove_spaces(const char *buf);
+char *line_remove_spaces_inplace(char *buf);
 char *split_comma(char *str);
 char *clean_pathname(const char *path);
 void check_unsigned(const char *str, const char *msg);
@@ -590,14 +696,18 @@ void create_empty_file_as_root(const char *dir, mode_t mode);
 int set_perms(const char *fname, uid_t uid, gid_t gid, mode_t mode);
 void mkdir_attr(const char *fname, mode_t mode, uid_t uid, gid_t gid);
 unsigned extract_timeout(const char *str);
+int extract_shutdown_grace(const char *str);
 void disable_file_or_dir(const char *fname);
 void disable_file_path(const char *path, const char *file);
 int safer_openat(int dirfd, const char *path, int flags);
 int remount_by_fd(int dst, unsigned long mountflags);
+int remount_tree_by_fd(int dst, unsigned long attr_set);
 int bind_mount_by_fd(int src, int dst);
 int bind_mount_path_to_fd(const char *srcname, int dst);
 int bind_mount_fd_to_path(int src, const char *destname);
 void close_all(int *keep_list, size_t sz);
+size_t close_all_keep(int *keep, const int *keep_list, size_t sz);
+int close_all_range(const int *keep, size_t cnt);
 int has_handler(pid_t pid, int signal);
 void enter_network_namespace(pid_t pid);
 int read_pid(const char *name, pid_t *pid);
@@ -610,6 +720,8 @@ int ascii_isupper(unsigned char c);
 int ascii_isxdigit(unsigned char c);
 int invalid_name(const char *name);
 void check_homedir(const char *dir);
+#define RUN_THREADS_MAX 16
+int run_threads(int threads, int cnt, void (*fn)(int i, void *data), void *data);
 
 // Get info regarding the last kernel mount operation from /proc/self/mountinfo
 // The return value points to a static area, and will be overwritten by subsequent calls.
@@ -627,6 +739,7 @@ int get_mount_id(int fd);
 char **build_mount_array(const int mountid, const char *path);
 
 // fs_var.c
+void fs_var_cache_open(void);
 void fs_var_log(void);	// mounting /var/log
 void fs_var_lib(void);	// various other fixes for software in /var directory
 void fs_var_cache(void); // various other fixes for software in /var/cache directory
@@ -636,6 +749,7 @@ void fs_var_tmp(void);
 void fs_var_utmp(void);
 
 // fs_dev.c
+void fs_dev_cache_open(void);
 void fs_dev_shm(void);
 void fs_private_dev(void);
 void fs_dev_disable_sound(void);
@@ -658,27 +772,52 @@ void fs_check_private_dir(void);
 // check new private working directory (--private-cwd= option) - exit if it fails
 void fs_check_private_cwd(const char *dir);
 void fs_private_home_list(void);
+// private home snapshot (--private-home-snapshot=name)
+void fs_private_home_snapshot(void);
 
 
 // seccomp.c
 char *seccomp_check_list(const char *str);
 int seccomp_install_filters(void);
 int seccomp_load(const char *fname);
-int seccomp_filter_drop(bool native);
-int seccomp_filter_keep(bool native);
-int seccomp_filter_mdwx(bool native);
-int seccomp_filter_namespaces(bool native, const char *list);
-void seccomp_print_filter(pid_t pid) __attribute__((noreturn));
+void seccomp_configure(void);
+void seccomp_prebuild_start(void);
+void seccomp_prebuild_wait(void);
+void seccomp_print_filter(pid_t pid, int summary, int jsonl) __attribute__((noreturn));
+
+// seccomp_audit.c
+void seccomp_audit(pid_t pid) __attribute__((noreturn));
+void seccomp_server_open(void);
+void seccomp_server_close(void);
+
+// seccomp_cache.c
+void seccomp_cache_open(void);
+void seccomp_cache_close(void);
+int seccomp_cache_enabled(void);
+char *seccomp_cache_spec(const char *command, const char *list);
+int seccomp_cache_fetch(const char *spec, const char *filter, const char *postexec);
+void seccomp_cache_store(const char *spec, const char *filter, const char *postexec);
+void seccomp_store_open(void);
+void seccomp_store_close(void);
+int seccomp_store_fetch(const char *command, const char *list, const char *filter, const char *postexec);
 
 // caps.c
 void seccomp_load_file_list(void);
+void seccomp_save_flags(void);
+void seccomp_save_stack(void);
+
+// seccomp_notify.c
+void seccomp_notify_open(void);
+void seccomp_notify_start(void);
+int seccomp_notify_sock(void);
+void seccomp_notify_install(unsigned flags);
 int caps_default_filter(void);
 void caps_print(void);
 void caps_drop_all(void);
 void caps_set(uint64_t caps);
-void caps_check_list(const char *clist, void (*callback)(int));
-void caps_drop_list(const char *clist);
-void caps_keep_list(const char *clist);
+uint64_t caps_parse_list(const char *clist);
+void caps_drop_list(uint64_t mask);
+void caps_keep_list(uint64_t mask);
 void caps_print_filter(pid_t pid) __attribute__((noreturn));
 void caps_drop_dac_override(void);
 
@@ -688,6 +827,12 @@ void fs_trace_touch_or_store_preload(void);
 void fs_tracefile(void);
 void fs_trace(void);
 
+// trace_ring.c
+void trace_ring_create(void);
+void trace_fanotify_create(void);
+void trace_ring_start(void);
+void trace_ring_stop(void);
+
 // fs_hostname.c
 void fs_hostname(void);
 char *fs_check_hosts_file(const char *fname);
@@ -697,12 +842,56 @@ void fs_mount_hosts_file(void);
 // rlimit.c
 void set_rlimits(void);
 
+// cgroup.c
+void cgroup_read_limit(const char *name, const char *value);
+void cgroup_leaf_create(pid_t pid);
+int cgroup_leaf_open(void);
+void cgroup_leaf_join(pid_t pid, pid_t child);
+void cgroup_leaf_remove(pid_t pid);
+char *cgroup_leaf_path(pid_t pid);
+int cgroup_leaf_frozen(const char *leaf);
+int cgroup_leaf_freeze(const char *leaf, int freeze);
+
+// pause.c
+void sandbox_pause(pid_t pid);
+void sandbox_resume(pid_t pid);
+void sandbox_thaw(pid_t pid);
+void pool_join(const char *pool, int argc, char **argv, int index);
+
+// perf.c
+void perf_stat_start(pid_t child);
+void perf_stat_print(void);
+
+// stats.c
+int stats_enabled(void);
+void stats_add(int counter, uint64_t val);
+void stats_phase(const char *name, unsigned long long usec);
+void stats_set_owner(void);
+void stats_setup_done(void);
+void stats_app_started(void);
+void stats_init(void);
+
 // cpu.c
 void read_cpu_list(const char *str);
 void set_cpu_affinity(void);
 void save_cpu(void);
 void cpu_print_filter(pid_t pid) __attribute__((noreturn));
 
+// numa.c
+void read_numa_node(const char *str);
+void numa_select(pid_t pid);
+void delete_numa_run_file(pid_t pid);
+void save_numa(void);
+void extract_numa(ProcessHandle sandbox);
+void numa_join(int node, int bind);
+void set_numa_policy(void);
+
+// sched.c
+void read_ioprio(const char *str);
+void read_sched(const char *str);
+void read_sched_slice(const char *str);
+void set_sched(void);
+
 // output.c
 void check_output(int argc, char **argv);
 
@@ -719,7 +908,18 @@ void check_netns(const char *nsname);
 void netns(const char *nsname);
 void netns_mounts(const char *nsname);
 
+// netgroup.c
+int net_group_joined(void);
+void net_group_check(const char *name);
+int net_group_setup(const char *name);
+void net_group_publish(const char *name, pid_t child);
+void net_group_enter(void);
+void net_group_restore(void);
+void net_group_release(pid_t pid);
+
 // bandwidth.c
+void bandwidth_set_run_file(pid_t pid);
+void bandwidth_status_json(pid_t pid);
 void bandwidth_pid(pid_t pid, const char *command, const char *dev, int down, int up) __attribute__((noreturn));
 void network_set_run_file(pid_t pid);
 
@@ -757,6 +957,7 @@ void fs_whitelist(void);
 // pulseaudio.c
 void pipewire_disable(void);
 void pulseaudio_init(void);
+void pulseaudio_cache_open(void);
 void pulseaudio_disable(void);
 
 // fs_bin.c
@@ -767,12 +968,56 @@ int is_firejail_link(const char *fname);
 char *find_in_path(const char *program);
 void fs_private_lib(void);
 
+// path_trie.c
+typedef struct path_trie_t PathTrie;
+PathTrie *path_trie_new(void);
+void path_trie_add(PathTrie *t, const char *pattern, int literal);
+int path_trie_match(PathTrie *t, const char *path);
+int path_trie_count(const PathTrie *t);
+const char *path_trie_pattern(const PathTrie *t, int index);
+void path_trie_free(PathTrie *t);
+
+// fs_glob.c
+void fs_glob_queue(const char *pattern);
+void fs_glob_prefetch(void);
+char **fs_glob(const char *pattern, size_t *cnt);
+void fs_glob_free(char **paths);
+void fs_glob_hide(const char *path);
+void fs_glob_created(const char *path);
+void fs_glob_flush(void);
+
+// fs_prefetch.c
+void fs_prefetch_queue(const char *path);
+void fs_prefetch_run(void);
+
+// fs_kpath_cache.c
+void kpath_cache_open(void);
+int kpath_exists(const char *path);
+void kpath_cache_close(void);
+
+// fs_lib_cache.c
+void fslib_cache_open(void);
+void fslib_cache_close(void);
+int fslib_cache_fetch(const char *full_path, unsigned user, const char *fname);
+void fslib_cache_store(const char *full_path, unsigned user, const char *fname);
+
+// run_cache.c
+int run_cache_open(const char *dir, const char *name);
+void run_cache_close(int *fd);
+int run_cache_count(int fd, const char *ext);
+int run_cache_add_file_id(char **key, const char *fname);
+FILE *run_cache_load(int fd, const char *entry, const char *key);
+FILE *run_cache_create(int fd, const char *entry, const char *key);
+int run_cache_commit(int fd, const char *entry, FILE *fp);
+void run_cache_abort(int fd, const char *entry, FILE *fp);
+
 // protocol.c
 void protocol_filter_save(void);
 void protocol_filter_load(const char *fname);
 void protocol_print_filter(pid_t pid) __attribute__((noreturn));
 
 // restrict_users.c
+void restrict_users_cache_open(void);
 void restrict_users(void);
 
 // fs_logger.c
@@ -791,10 +1036,12 @@ void run_symlink(int argc, char **argv, int run_as_is);
 char **build_paths(void);
 unsigned int count_paths(void);
 int program_in_path(const char *program);
+int path_cache_lookup(const char *dir, const char *name);
 
 // fs_mkdir.c
 void fs_mkdir(const char *name);
 void fs_mkfile(const char *name);
+void fs_mkdir_flush(void);
 
 // x11.c
 
@@ -813,14 +1060,19 @@ void x11_start_xpra(int argc, char **argv) __attribute__((noreturn));
 void x11_start_xephyr(int argc, char **argv) __attribute__((noreturn));
 void x11_block(void);
 void x11_start_xvfb(int argc, char **argv) __attribute__((noreturn));
+void x11_pool(const char *arg);
 void x11_xorg(void);
 
+// xauth.c
+int xauth_generate(const char *display, const char *fname);
+
 // ls.c
 enum {
 	SANDBOX_FS_LS = 0,
 	SANDBOX_FS_CAT,
 	SANDBOX_FS_GET,
 	SANDBOX_FS_PUT,
+	SANDBOX_FS_LS_JSONL,
 	SANDBOX_FS_MAX // this should always be the last entry
 };
 void ls(const char *path);
@@ -863,6 +1115,25 @@ enum {
 	CFG_ALLOW_TRAY,
 	CFG_SECCOMP_LOG,
 	CFG_TRACELOG,
+	CFG_SECCOMP_CACHE,
+	CFG_SECCOMP_SERVER,
+	CFG_PRIVATE_LIB_CACHE,
+	CFG_FSLOGGER_BINARY,
+	CFG_PRIVATE_DEV_CACHE,
+	CFG_PRIVATE_ETC_BIND,
+	CFG_PRIVATE_BIN_BIND,
+	CFG_PROFILE_BUNDLE,
+	CFG_SECCOMP_SPEC_ALLOW,
+	CFG_ARP_CHECK,
+	CFG_NFTABLES,
+	CFG_DBUS_PROXY_SHARED,
+	CFG_RESTRICT_USERS_CACHE,
+	CFG_LAUNCH_STATS,
+	CFG_VAR_LOG_CACHE,
+	CFG_KPATH_CACHE,
+	CFG_SECCOMP_STORE,
+	CFG_HOSTS_CACHE,
+	CFG_TMPFS_NOSWAP,
 	CFG_MAX // this should always be the last entry
 };
 extern char *xephyr_screen;
@@ -877,6 +1148,9 @@ extern unsigned long join_timeout;
 extern char *config_seccomp_error_action_str;
 extern char *config_seccomp_filter_add;
 extern char **whitelist_reject_topdirs;
+extern long long unsigned config_tmpfs_size;
+extern long long unsigned config_tmpfs_inodes;
+extern char *config_tmpfs_huge;
 
 int checkcfg(int val);
 void print_compiletime_support(void);
@@ -887,6 +1161,23 @@ void appimage_set(const char *appimage_path);
 void appimage_mount(void);
 void appimage_clear(void);
 
+// loopdev.c
+int loop_device_get(int ffd, unsigned long long offset, char **devloop);
+void loop_device_release(int lfd);
+
+// instances.c
+char *instance_name(const char *tmpl, int index);
+void instances_check(const char *arg);
+void instances_start(void);
+
+// warm_cache.c
+void warm_cache(const char *list) __attribute__((noreturn));
+
+// rootfs.c
+void rootfs_image_set(const char *image);
+void rootfs_image_mount(void);
+void rootfs_image_clear(void);
+
 // appimage_size.c
 long unsigned int appimage2_size(int fd);
 
@@ -933,13 +1224,37 @@ void build_appimage_cmdline(char **command_line, char **window_title, int argc,
 int sbox_run(unsigned filter, int num, ...);
 int sbox_run_v(unsigned filter, char * const arg[]);
 void sbox_exec_v(unsigned filter, char * const arg[]) __attribute__((noreturn));
+pid_t sbox_run_server(unsigned filter, int *rfd, int *wfd, char * const arg[]);
+int sbox_run_batch(unsigned filter, int cnt, char ** const argv[], int status[]);
+typedef struct sbox_batch_t {
+	unsigned filtermask;
+	int cnt;
+	int max;
+	char ***argv;
+} SboxBatch;
+void sbox_batch_init(SboxBatch *batch, unsigned filter);
+void sbox_batch_add(SboxBatch *batch, int num, ...);
+void sbox_batch_run(SboxBatch *batch);
+typedef struct fcopy_batch_t {
+	unsigned filtermask;
+	int follow_link;
+	int cnt;
+	char *buf;
+	size_t len;
+	size_t size;
+} FcopyBatch;
+void fcopy_batch_init(FcopyBatch *batch, unsigned filter, int follow_link);
+void fcopy_batch_add(FcopyBatch *batch, const char *src, const char *dest);
+void fcopy_batch_run(FcopyBatch *batch);
 
 // run_files.c
 void delete_run_files(pid_t pid);
 void delete_bandwidth_run_file(pid_t pid);
 void set_name_run_file(pid_t pid);
 void set_x11_run_file(pid_t pid, int display);
+void set_pool_run_file(pid_t pid);
 void set_profile_run_file(pid_t pid, const char *fname);
+void set_instance_run_file(pid_t pid);
 void set_sandbox_run_file(pid_t pid, pid_t child);
 void release_sandbox_lock(void);
 
@@ -949,6 +1264,7 @@ int dbus_check_call_rule(const char *name);
 void dbus_check_profile(void);
 void dbus_proxy_start(void);
 void dbus_proxy_stop(void);
+void dbus_proxy_wait(void);
 void dbus_set_session_bus_env(void);
 void dbus_set_system_bus_env(void);
 void dbus_apply_policy(void);
@@ -958,6 +1274,7 @@ extern pid_t dhclient4_pid;
 extern pid_t dhclient6_pid;
 void dhcp_store_exec(void);
 void dhcp_start(void);
+int dhcp_client(pid_t pid);
 
 // selinux.c
 void selinux_relabel_path(const char *path, const char *inside_path);
@@ -965,9 +1282,31 @@ void selinux_relabel_path(const char *path, const char *inside_path);
 // oom.c
 void oom_set(const char *oom_string);
 
+// startup_profile.c
+#define SPROF_TID_PARENT 1	// firejail parent process
+#define SPROF_TID_SANDBOX 2	// sandbox process (pid 1 in the new pid namespace)
+#define SPROF_TID_APP 3	// application process, before execvp
+#define SPROF_TID_SECCOMP 4	// seccomp filters built by seccomp_prebuild_start()
+int sprof_get_fd(void);
+void sprof_init(const char *fname);
+void sprof_thread(int tid, const char *name);
+void sprof_begin(const char *name);
+void sprof_end(void);
+void sprof_end_args(const char *args);
+unsigned long long sprof_elapsed(void);
+unsigned long long sprof_now(void);
+void sprof_span(const char *name, unsigned long long ts, unsigned long long dur, const char *args);
+void sprof_finish(void);
+
 // landlock.c
 int ll_get_fd(void);
 int ll_restrict(uint32_t flags);
+const char *ll_stats_args(void);
 void ll_add_profile(int type, const char *data);
+extern int arg_blacklist_landlock;	// blacklist-mode landlock
+void ll_blacklist_mode(const char *mode);
+int ll_blacklist_add(const char *fname, mode_t mode);
+void ll_blacklist_save(void);
+void ll_blacklist_restrict(void);
 
 #endif
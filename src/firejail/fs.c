@@ -21,12 +21,17 @@
 #include "../include/gcov_wrapper.h"
 #include <sys/mount.h>
 #include <sys/statvfs.h>
-#include <fnmatch.h>
-#include <glob.h>
 #include <dirent.h>
 #include <errno.h>
 
 #include <fcntl.h>
+
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#define MOUNT_ATTR_NOSUID 0x00000002
+#define MOUNT_ATTR_NODEV 0x00000004
+#define MOUNT_ATTR_NOEXEC 0x00000008
+#endif
 #ifndef O_PATH
 #define O_PATH 010000000
 #endif
@@ -40,7 +45,9 @@
 //***********************************************
 // process profile file
 //***********************************************
-static void fs_remount_rec(const char *dir, OPERATION op);
+// set of remount operations, applied together
+#define OP_MASK(op) (1U << (op))
+static void fs_remount_rec(const char *dir, unsigned ops);
 
 static char *opstr[] = {
 	[BLACKLIST_FILE] = "blacklist",
@@ -52,16 +59,82 @@ static char *opstr[] = {
 	[MOUNT_RDWR_NOCHECK] = "read-write",
 };
 
+// In fs_blacklist() the blacklist mounts are queued and done together by
+// disable_flush(), with a single switch to root around all of them; every
+// seteuid/setegid call is broadcast to all the threads of the process. The
+// queue is flushed before any other operation. A path below a queued
+// directory is skipped, as it would be once the directory is mounted over.
+#define DISABLE_QUEUE_MAX 256
+typedef struct {
+	int fd;		// O_PATH
+	int dir;
+	char *path;	// directories only
+} DisableMount;
+static DisableMount dqueue[DISABLE_QUEUE_MAX];
+static int dqueue_cnt = 0;
+static int dqueue_active = 0;
+
+static void disable_flush(void) {
+	if (dqueue_cnt == 0)
+		return;
+
+	EUID_ROOT();
+	int i;
+	for (i = 0; i < dqueue_cnt; i++) {
+		if (bind_mount_path_to_fd((dqueue[i].dir) ? RUN_RO_DIR : RUN_RO_FILE, dqueue[i].fd) < 0)
+			errExit("disable file");
+		close(dqueue[i].fd);
+		free(dqueue[i].path);
+	}
+	EUID_USER();
+	dqueue_cnt = 0;
+}
+
+static int disable_queued_below(const char *fname) {
+	int i;
+	for (i = 0; i < dqueue_cnt; i++) {
+		const char *dir = dqueue[i].path;
+		if (!dir)
+			continue;
+		size_t len = strlen(dir);
+		if (strncmp(fname, dir, len) == 0 && (fname[len] == '/' || len == 1))
+			return 1;
+	}
+	return 0;
+}
+
+// fd is closed by disable_flush()
+static void disable_queue(int fd, int dir, const char *fname) {
+	if (dqueue_cnt == DISABLE_QUEUE_MAX)
+		disable_flush();
+	dqueue[dqueue_cnt].fd = fd;
+	dqueue[dqueue_cnt].dir = dir;
+	dqueue[dqueue_cnt].path = NULL;
+	if (dir) {
+		dqueue[dqueue_cnt].path = strdup(fname);
+		if (!dqueue[dqueue_cnt].path)
+			errExit("strdup");
+	}
+	dqueue_cnt++;
+}
+
 static void disable_file(OPERATION op, const char *filename) {
 	assert(filename);
 	assert(op <OPERATION_MAX);
 	EUID_ASSERT();
 
+	if (op != BLACKLIST_FILE && op != BLACKLIST_NOLOG)
+		disable_flush();
+
 	// Resolve all symlinks
 	char* fname = realpath(filename, NULL);
 	if (fname == NULL && errno != EACCES) {
 		return;
 	}
+	if (fname && disable_queued_below(fname)) {
+		free(fname);
+		return;
+	}
 	if (fname == NULL && errno == EACCES) {
 		// realpath and stat functions will fail on FUSE filesystems
 		// they don't seem to like a uid of 0
@@ -142,16 +215,27 @@ static void disable_file(OPERATION op, const char *filename) {
 					printf(" - no logging\n");
 			}
 
-			EUID_ROOT();
-			if (S_ISDIR(s.st_mode)) {
-				if (bind_mount_path_to_fd(RUN_RO_DIR, fd) < 0)
-					errExit("disable file");
+			if (ll_blacklist_add(fname, s.st_mode)) {
+				if (arg_debug)
+					printf("%s blacklisted with landlock\n", fname);
+			}
+			else if (dqueue_active) {
+				disable_queue(fd, S_ISDIR(s.st_mode), fname);
+				fd = -1;
 			}
 			else {
-				if (bind_mount_path_to_fd(RUN_RO_FILE, fd) < 0)
-					errExit("disable file");
+				EUID_ROOT();
+				if (S_ISDIR(s.st_mode)) {
+					if (bind_mount_path_to_fd(RUN_RO_DIR, fd) < 0)
+						errExit("disable file");
+				}
+				else {
+					if (bind_mount_path_to_fd(RUN_RO_FILE, fd) < 0)
+						errExit("disable file");
+				}
+				EUID_USER();
 			}
-			EUID_USER();
+			fs_glob_hide(fname);
 
 			if (op == BLACKLIST_FILE)
 				fs_logger2("blacklist", fname);
@@ -173,7 +257,7 @@ static void disable_file(OPERATION op, const char *filename) {
 		}
 	}
 	else if (op == MOUNT_READONLY || op == MOUNT_RDWR || op == MOUNT_NOEXEC) {
-		fs_remount_rec(fname, op);
+		fs_remount_rec(fname, OP_MASK(op));
 	}
 	else if (op == MOUNT_TMPFS) {
 		if (!S_ISDIR(s.st_mode)) {
@@ -194,12 +278,14 @@ static void disable_file(OPERATION op, const char *filename) {
 
 		fs_tmpfs(fname, uid);
 		selinux_relabel_path(fname, fname);
+		fs_glob_hide(fname);
 	}
 	else
 		assert(0);
 
 out:
-	close(fd);
+	if (fd != -1)
+		close(fd);
 	free(fname);
 }
 
@@ -209,58 +295,59 @@ static size_t nbcheck_size = 0;
 static int *nbcheck = NULL;
 #endif
 
+// statistics for the last fs_blacklist() run
+static struct {
+	unsigned entries;
+	unsigned blacklist;	// blacklist, blacklist-nolog, read-only, read-write, noexec, tmpfs
+	unsigned noblacklist;	// expanded noblacklist patterns
+	unsigned other;		// bind, mkdir, mkfile
+	unsigned paths;		// glob results checked against noblacklist patterns
+	double ms;
+} bstats;
+
 // Treat pattern as a shell glob pattern and blacklist matching files
-static void globbing(OPERATION op, const char *pattern, const char *noblacklist[], size_t noblacklist_len) {
+static void globbing(OPERATION op, const char *pattern, PathTrie *noblacklist) {
 	assert(pattern);
+	assert(noblacklist);
 	EUID_ASSERT();
 
 #ifdef TEST_NO_BLACKLIST_MATCHING
 	if (nbcheck_start == 0) {
 		nbcheck_start = 1;
-		nbcheck_size = noblacklist_len;
-		nbcheck = malloc(sizeof(int) * noblacklist_len);
+		nbcheck_size = path_trie_count(noblacklist);
+		nbcheck = calloc(nbcheck_size + 1, sizeof(int));
 		if (nbcheck == NULL)
-			errExit("malloc");
-		memset(nbcheck, 0, sizeof(int) * noblacklist_len);
+			errExit("calloc");
 	}
 #endif
 
-	glob_t globbuf;
 	// Profiles contain blacklists for files that might not exist on a user's machine.
 	// GLOB_NOCHECK makes that okay.
-	int globerr = glob(pattern, GLOB_NOCHECK | GLOB_NOSORT | GLOB_PERIOD, NULL, &globbuf);
-	if (globerr) {
+	size_t cnt;
+	char **paths = fs_glob(pattern, &cnt);
+	if (!paths) {
 		fprintf(stderr, "Error: failed to glob pattern %s\n", pattern);
 		exit(1);
 	}
 
-	size_t i, j;
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		char *path = globbuf.gl_pathv[i];
+	size_t i;
+	for (i = 0; i < cnt; i++) {
+		char *path = paths[i];
 		assert(path);
 		// /home/me/.* can glob to /home/me/.. which would blacklist /home/
 		const char *base = gnu_basename(path);
 		if (strcmp(base, ".") == 0 || strcmp(base, "..") == 0)
 			continue;
-		// noblacklist is expected to be short in normal cases, so stupid and correct brute force is okay
 		bool okay_to_blacklist = true;
 		if (op == BLACKLIST_FILE || op == BLACKLIST_NOLOG) {
-			for (j = 0; j < noblacklist_len; j++) {
-				int result = fnmatch(noblacklist[j], path, FNM_PATHNAME);
-				if (result == FNM_NOMATCH)
-					continue;
-				else if (result == 0) {
-					okay_to_blacklist = false;
+			bstats.paths++;
+			int j = path_trie_match(noblacklist, path);
+			if (j != -1) {
+				okay_to_blacklist = false;
 #ifdef TEST_NO_BLACKLIST_MATCHING
-					if (j < nbcheck_size)	// noblacklist checking
-						nbcheck[j] = 1;
+				if ((size_t) j < nbcheck_size)	// noblacklist checking
+					nbcheck[j] = 1;
 #endif
-					break;
-				}
-				else {
-					fprintf(stderr, "Error: failed to compare path %s with pattern %s\n", path, noblacklist[j]);
-					exit(1);
-				}
 			}
 		}
 
@@ -269,42 +356,168 @@ static void globbing(OPERATION op, const char *pattern, const char *noblacklist[
 		else if (arg_debug)
 			printf("Not blacklist %s\n", path);
 	}
-	globfree(&globbuf);
+	fs_glob_free(paths);
+}
+
+
+// profile commands handled by fs_blacklist()
+typedef enum {
+	BCMD_SKIP = 0,		// handled somewhere else
+	BCMD_BIND,
+	BCMD_NOBLACKLIST,
+	BCMD_OPERATION,		// blacklist, read-only, tmpfs etc.
+	BCMD_MKDIR,
+	BCMD_MKFILE,
+	BCMD_INVALID
+} BlacklistCmd;
+
+typedef struct {
+	const char *name;	// command including the trailing space
+	size_t len;
+	BlacklistCmd cmd;
+	OPERATION op;
+} BlacklistCmdDef;
+
+#define BCMD(name, cmd, op) { name, sizeof(name) - 1, cmd, op }
+static const BlacklistCmdDef bcmd_table[] = {
+	BCMD("whitelist ", BCMD_SKIP, OPERATION_MAX),
+	BCMD("nowhitelist ", BCMD_SKIP, OPERATION_MAX),
+	BCMD("dbus-", BCMD_SKIP, OPERATION_MAX),
+	BCMD("bind ", BCMD_BIND, OPERATION_MAX),
+	BCMD("noblacklist ", BCMD_NOBLACKLIST, OPERATION_MAX),
+	BCMD("blacklist ", BCMD_OPERATION, BLACKLIST_FILE),
+	BCMD("blacklist-nolog ", BCMD_OPERATION, BLACKLIST_NOLOG),
+	BCMD("read-only ", BCMD_OPERATION, MOUNT_READONLY),
+	BCMD("read-write ", BCMD_OPERATION, MOUNT_RDWR),
+	BCMD("noexec ", BCMD_OPERATION, MOUNT_NOEXEC),
+	BCMD("tmpfs ", BCMD_OPERATION, MOUNT_TMPFS),
+	BCMD("mkdir ", BCMD_MKDIR, OPERATION_MAX),
+	BCMD("mkfile ", BCMD_MKFILE, OPERATION_MAX),
+	{ NULL, 0, BCMD_INVALID, OPERATION_MAX }
+};
+
+// the commands are bucketed by their first character
+static const BlacklistCmdDef *bcmd_bucket[256][8];
+
+static void bcmd_init(void) {
+	static int initialized = 0;
+	if (initialized)
+		return;
+	initialized = 1;
+
+	const BlacklistCmdDef *def;
+	for (def = bcmd_table; def->name; def++) {
+		const BlacklistCmdDef **bucket = bcmd_bucket[(unsigned char) def->name[0]];
+		int i = 0;
+		while (bucket[i])
+			i++;
+		assert(i < 7);
+		bucket[i] = def;
+	}
+}
+
+static const BlacklistCmdDef *bcmd_find(const char *data, BlacklistCmd *cmd) {
+	if (*data == '\0') {
+		*cmd = BCMD_SKIP;
+		return NULL;
+	}
+
+	const BlacklistCmdDef **bucket = bcmd_bucket[(unsigned char) *data];
+	int i;
+	for (i = 0; bucket[i]; i++) {
+		if (strncmp(data, bucket[i]->name, bucket[i]->len) == 0) {
+			*cmd = bucket[i]->cmd;
+			return bucket[i];
+		}
+	}
+
+	*cmd = BCMD_INVALID;
+	return NULL;
+}
+
+// JSON arguments for the startup profiler, describing the last run
+const char *fs_blacklist_stats(void) {
+	static char buf[256];
+	snprintf(buf, sizeof(buf),
+		"\"entries\":%u,\"blacklist\":%u,\"noblacklist\":%u,\"other\":%u,\"paths\":%u,\"ms\":%.02f",
+		bstats.entries, bstats.blacklist, bstats.noblacklist, bstats.other, bstats.paths, bstats.ms);
+	return buf;
 }
 
+// expand the patterns of blacklist, read-only, tmpfs etc. commands in advance
+static void blacklist_prefetch(void) {
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_OTHER];
+	int k;
+	for (k = 0; k < b->cnt; k++) {
+		const ProfileEntry *entry = b->entries[k];
+		BlacklistCmd cmd;
+		const BlacklistCmdDef *def = bcmd_find(entry->data, &cmd);
+		if (cmd != BCMD_OPERATION)
+			continue;
+
+		char *name = expand_macros(entry->data + def->len);
+		if (!name)
+			continue;
+		if (strncmp(name, "${PATH}", 7) == 0) {
+			char **paths = build_paths();
+			int i;
+			for (i = 0; paths[i]; i++) {
+				char *pattern;
+				if (asprintf(&pattern, "%s%s", paths[i], name + 7) == -1)
+					errExit("asprintf");
+				fs_glob_queue(pattern);
+				free(pattern);
+			}
+		}
+		else
+			fs_glob_queue(name);
+		free(name);
+	}
+	fs_glob_prefetch();
+}
 
 // blacklist files or directories by mounting empty files on top of them
 void fs_blacklist(void) {
 	EUID_ASSERT();
 
-	ProfileEntry *entry = cfg.profile;
-	if (!entry)
+	if (!cfg.profile)
 		return;
 
 	timetrace_start();
-
-	size_t noblacklist_c = 0;
-	size_t noblacklist_m = 32;
-	char **noblacklist = calloc(noblacklist_m, sizeof(*noblacklist));
-
-	if (noblacklist == NULL)
-		errExit("failed allocating memory for noblacklist entries");
-
-	while (entry) {
+	bcmd_init();
+	memset(&bstats, 0, sizeof(bstats));
+	dqueue_active = 1;
+	PathTrie *noblacklist = path_trie_new();
+	blacklist_prefetch();
+
+	// whitelist and dbus commands are in their own buckets
+	int k;
+	for (k = 0; k < PCMD_MAX; k++)
+		bstats.entries += cfg.profile_bucket[k].cnt;
+
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_OTHER];
+	for (k = 0; k < b->cnt; k++) {
+		ProfileEntry *entry = b->entries[k];
+		BlacklistCmd cmd;
+		const BlacklistCmdDef *def = bcmd_find(entry->data, &cmd);
 		OPERATION op = OPERATION_MAX;
 		char *ptr;
 
 		// whitelist commands handled by fs_whitelist()
-		if (strncmp(entry->data, "whitelist ", 10) == 0 ||
-		    strncmp(entry->data, "nowhitelist ", 12) == 0 ||
-		    strncmp(entry->data, "dbus-", 5) == 0 ||
-		   *entry->data == '\0') {
-			entry = entry->next;
+		if (cmd == BCMD_SKIP)
 			continue;
-		}
+
+		// consecutive mkdir and mkfile commands are created together, the
+		// paths exist before the next command is applied
+		if (cmd != BCMD_MKDIR && cmd != BCMD_MKFILE)
+			fs_mkdir_flush();
+		// the same for the blacklist mounts
+		if (cmd != BCMD_OPERATION && cmd != BCMD_NOBLACKLIST)
+			disable_flush();
 
 		// process bind command
-		if (strncmp(entry->data, "bind ", 5) == 0)  {
+		if (cmd == BCMD_BIND)  {
+			bstats.other++;
 			struct stat s;
 			char *dname1 = entry->data + 5;
 			char *dname2 = split_comma(dname1);
@@ -312,7 +525,6 @@ void fs_blacklist(void) {
 			    stat(dname1, &s) == -1 ||
 			    stat(dname2, &s) == -1) {
 				fprintf(stderr, "Error: invalid bind command, directory missing\n");
-				entry = entry->next;
 				continue;
 			}
 
@@ -323,102 +535,62 @@ void fs_blacklist(void) {
 			// EUID_ROOT(); - option not accessible to non-root users
 			if (mount(dname1, dname2, NULL, MS_BIND|MS_REC, NULL) < 0)
 				errExit("mount bind");
+			fs_glob_flush();
 			/* coverity[toctou] */
 			if (set_perms(dname2,  s.st_uid, s.st_gid,s.st_mode))
 				errExit("set_perms");
 			// EUID_USER();
 
-			entry = entry->next;
 			continue;
 		}
 
 		// Process noblacklist command
-		if (strncmp(entry->data, "noblacklist ", 12) == 0) {
-			char **enames;
-			int i;
-
+		if (cmd == BCMD_NOBLACKLIST) {
 			if (strncmp(entry->data + 12, "${PATH}", 7) == 0) {
 				// expand ${PATH} macro
 				char **paths = build_paths();
-				unsigned int npaths = count_paths();
-				enames = calloc(npaths, sizeof(char *));
-				if (!enames)
-					errExit("calloc");
-
+				int i;
 				for (i = 0; paths[i]; i++) {
-					if (asprintf(&enames[i], "%s%s", paths[i],
-						entry->data + 19) == -1)
+					char *ename;
+					if (asprintf(&ename, "%s%s", paths[i], entry->data + 19) == -1)
 						errExit("asprintf");
+					path_trie_add(noblacklist, ename, 0);
+					bstats.noblacklist++;
+					free(ename);
 				}
-				assert(enames[npaths-1] == 0);
-
 			}
 			else {
 				// expand ${HOME} macro if found or pass as is
-				enames = calloc(2, sizeof(char *));
-				if (!enames)
-					errExit("calloc");
-				enames[0] = expand_macros(entry->data + 12);
-				assert(enames[1] == 0);
-			}
-
-			for (i = 0; enames[i]; i++) {
-				if (noblacklist_c >= noblacklist_m) {
-					noblacklist_m *= 2;
-					noblacklist = realloc(noblacklist, sizeof(*noblacklist) * noblacklist_m);
-					if (noblacklist == NULL)
-						errExit("failed increasing memory for noblacklist entries");
-				}
-				noblacklist[noblacklist_c++] = enames[i];
+				char *ename = expand_macros(entry->data + 12);
+				path_trie_add(noblacklist, ename, 0);
+				bstats.noblacklist++;
+				free(ename);
 			}
 
-			free(enames);
-
-			entry = entry->next;
 			continue;
 		}
 
-		// process blacklist command
-		if (strncmp(entry->data, "blacklist ", 10) == 0)  {
-			ptr = entry->data + 10;
-			op = BLACKLIST_FILE;
-		}
-		else if (strncmp(entry->data, "blacklist-nolog ", 16) == 0)  {
-			ptr = entry->data + 16;
-			op = BLACKLIST_NOLOG;
-		}
-		else if (strncmp(entry->data, "read-only ", 10) == 0) {
-			ptr = entry->data + 10;
-			op = MOUNT_READONLY;
-		}
-		else if (strncmp(entry->data, "read-write ", 11) == 0) {
-			ptr = entry->data + 11;
-			op = MOUNT_RDWR;
-		}
-		else if (strncmp(entry->data, "noexec ", 7) == 0) {
-			ptr = entry->data + 7;
-			op = MOUNT_NOEXEC;
-		}
-		else if (strncmp(entry->data, "tmpfs ", 6) == 0) {
-			ptr = entry->data + 6;
-			op = MOUNT_TMPFS;
-		}
-		else if (strncmp(entry->data, "mkdir ", 6) == 0) {
+		if (cmd == BCMD_MKDIR) {
+			bstats.other++;
 			fs_mkdir(entry->data + 6);
-			entry = entry->next;
 			continue;
 		}
-		else if (strncmp(entry->data, "mkfile ", 7) == 0) {
+		else if (cmd == BCMD_MKFILE) {
+			bstats.other++;
 			fs_mkfile(entry->data + 7);
-			entry = entry->next;
 			continue;
 		}
-		else {
+		else if (cmd == BCMD_INVALID) {
 			fprintf(stderr, "Error: invalid profile line %s\n", entry->data);
-			entry = entry->next;
 			continue;
 		}
 
+		// process blacklist, read-only, read-write, noexec and tmpfs commands
+		assert(cmd == BCMD_OPERATION && def);
+		bstats.blacklist++;
+		ptr = entry->data + def->len;
+		op = def->op;
+
 		// replace home macro in blacklist array
 		char *new_name = expand_macros(ptr);
 		ptr = new_name;
@@ -435,25 +607,27 @@ void fs_blacklist(void) {
 					i++;
 					char newname[strlen(path) + fname_len + 1];
 					sprintf(newname, "%s%s", path, fname);
-					globbing(op, newname, (const char**)noblacklist, noblacklist_c);
+					globbing(op, newname, noblacklist);
 				}
 			}
 			else
-				globbing(op, ptr, (const char**)noblacklist, noblacklist_c);
+				globbing(op, ptr, noblacklist);
 		}
 
 		if (new_name)
 			free(new_name);
-		entry = entry->next;
 	}
+	fs_mkdir_flush();
+	disable_flush();
+	dqueue_active = 0;
 
-	size_t i;
 #ifdef TEST_NO_BLACKLIST_MATCHING
 	// noblacklist checking
+	size_t i;
 	for (i = 0; i < nbcheck_size; i++)
 		if (!arg_quiet && !nbcheck[i])
 			printf("TESTING warning: noblacklist %s not matched by a proper blacklist command in disable*.inc\n",
-				 noblacklist[i]);
+				 path_trie_pattern(noblacklist, i));
 
 	// free memory
 	if (nbcheck) {
@@ -462,17 +636,75 @@ void fs_blacklist(void) {
 		nbcheck_size = 0;
 	}
 #endif
-	for (i = 0; i < noblacklist_c; i++)
-		free(noblacklist[i]);
-	free(noblacklist);
+	path_trie_free(noblacklist);
+	fs_glob_flush();
 
-	fmessage("Base filesystem installed in %0.2f ms\n", timetrace_end());
+	bstats.ms = timetrace_end();
+	if (arg_debug)
+		printf("Blacklist: %u profile entries, %u blacklist, %u noblacklist, %u other, %u paths checked\n",
+			bstats.entries, bstats.blacklist, bstats.noblacklist, bstats.other, bstats.paths);
+	fmessage("Base filesystem installed in %0.2f ms\n", bstats.ms);
 }
 
 //***********************************************
 // mount namespace
 //***********************************************
 
+static long long unsigned tmpfs_limit(long long unsigned config, long long unsigned profile) {
+	if (config == 0 || (profile && profile < config))
+		return profile;
+	return config;
+}
+
+// mount a tmpfs with the size and inode limits from firejail.config and the
+// profile; the copies of host files (TMPFS_COPY) get the huge and noswap
+// options if configured, these are dropped if the kernel doesn't support
+// them
+int tmpfs_mount(const char *dir, unsigned long flags, const char *options, unsigned type) {
+	assert(dir);
+	assert(options);
+	int noswap = checkcfg(CFG_TMPFS_NOSWAP) && (type & TMPFS_COPY);
+	const char *huge = (type & TMPFS_COPY) ? config_tmpfs_huge : NULL;
+
+	char *limits = strdup(options);
+	if (!limits)
+		errExit("strdup");
+	long long unsigned size = tmpfs_limit(config_tmpfs_size, cfg.tmpfs_size);
+	long long unsigned inodes = tmpfs_limit(config_tmpfs_inodes, cfg.tmpfs_inodes);
+	char *tmp;
+	if (size) {
+		if (asprintf(&tmp, "%s,size=%llu", limits, size) == -1)
+			errExit("asprintf");
+		free(limits);
+		limits = tmp;
+	}
+	if (inodes) {
+		if (asprintf(&tmp, "%s,nr_inodes=%llu", limits, inodes) == -1)
+			errExit("asprintf");
+		free(limits);
+		limits = tmp;
+	}
+
+	int rv;
+	if (huge || noswap) {
+		char *all;
+		if (asprintf(&all, "%s%s%s%s", limits, (huge) ? ",huge=" : "", (huge) ? huge : "",
+			     (noswap) ? ",noswap" : "") == -1)
+			errExit("asprintf");
+		rv = mount("tmpfs", dir, "tmpfs", flags, all);
+		if (rv == 0 || errno != EINVAL) {
+			free(all);
+			free(limits);
+			return rv;
+		}
+		fwarning("tmpfs options %s not supported by the kernel, ignored\n", all + strlen(limits) + 1);
+		free(all);
+	}
+	rv = mount("tmpfs", dir, "tmpfs", flags, limits);
+	free(limits);
+	return rv;
+}
+
 // mount a writable tmpfs on directory; requires a resolved path
 void fs_tmpfs(const char *dir, unsigned check_owner) {
 	EUID_ASSERT();
@@ -504,7 +736,7 @@ void fs_tmpfs(const char *dir, unsigned check_owner) {
 	if (asprintf(&proc, "/proc/self/fd/%d", fd) == -1)
 		errExit("asprintf");
 	EUID_ROOT();
-	if (mount("tmpfs", proc, "tmpfs", flags|MS_NOSUID|MS_NODEV, options) < 0)
+	if (tmpfs_mount(proc, flags|MS_NOSUID|MS_NODEV, options, 0) < 0)
 		errExit("mounting tmpfs");
 	EUID_USER();
 	// check the last mount operation
@@ -517,10 +749,33 @@ void fs_tmpfs(const char *dir, unsigned check_owner) {
 	close(fd);
 }
 
-// remount path, preserving other mount flags; requires a resolved path
-static void fs_remount_simple(const char *path, OPERATION op) {
+static const char *ops_str(unsigned ops) {
+	if (ops == (OP_MASK(MOUNT_READONLY) | OP_MASK(MOUNT_NOEXEC)))
+		return "read-only/noexec";
+	int op;
+	for (op = 0; op < OPERATION_MAX; op++) {
+		if (ops == OP_MASK(op))
+			return opstr[op];
+	}
+	assert(0);
+	return NULL;
+}
+
+// one log entry per operation
+static void ops_log(unsigned ops, const char *path) {
+	int op;
+	for (op = 0; op < OPERATION_MAX; op++) {
+		if (ops & OP_MASK(op))
+			fs_logger2(opstr[op], path);
+	}
+}
+
+// remount path, preserving other mount flags; requires a resolved path;
+// read-only and noexec can be combined in a single remount
+static void fs_remount_simple(const char *path, unsigned ops) {
 	EUID_ASSERT();
 	assert(path);
+	assert(ops);
 
 	// open path without following symbolic links
 	int fd = safer_openat(-1, path, O_PATH|O_NOFOLLOW|O_CLOEXEC);
@@ -547,43 +802,37 @@ static void fs_remount_simple(const char *path, OPERATION op) {
 	unsigned long flags = buf.f_flag;
 
 	// read-write option
-	if (op == MOUNT_RDWR || op == MOUNT_RDWR_NOCHECK) {
+	if (ops == OP_MASK(MOUNT_RDWR) || ops == OP_MASK(MOUNT_RDWR_NOCHECK)) {
 		// nothing to do if there is no read-only flag
 		if ((flags & MS_RDONLY) == 0) {
 			close(fd);
 			return;
 		}
 		// allow only user owned directories, except the user is root
-		if (op != MOUNT_RDWR_NOCHECK && getuid() != 0 && s.st_uid != getuid()) {
+		if (ops == OP_MASK(MOUNT_RDWR) && getuid() != 0 && s.st_uid != getuid()) {
 			fwarning("you are not allowed to change %s to read-write\n", path);
 			close(fd);
 			return;
 		}
 		flags &= ~MS_RDONLY;
 	}
-	// noexec option
-	else if (op == MOUNT_NOEXEC) {
-		// nothing to do if path is mounted noexec already
-		if ((flags & (MS_NOEXEC|MS_NODEV|MS_NOSUID)) == (MS_NOEXEC|MS_NODEV|MS_NOSUID)) {
-			close(fd);
-			return;
-		}
-		flags |= MS_NOEXEC|MS_NODEV|MS_NOSUID;
-	}
-	// read-only option
-	else if (op == MOUNT_READONLY) {
-		// nothing to do if path is mounted read-only already
-		if ((flags & MS_RDONLY) == MS_RDONLY) {
+	else {
+		assert((ops & ~(OP_MASK(MOUNT_READONLY) | OP_MASK(MOUNT_NOEXEC))) == 0);
+		// noexec option
+		if (ops & OP_MASK(MOUNT_NOEXEC))
+			flags |= MS_NOEXEC|MS_NODEV|MS_NOSUID;
+		// read-only option
+		if (ops & OP_MASK(MOUNT_READONLY))
+			flags |= MS_RDONLY;
+		// nothing to do if path has all the flags already
+		if (flags == buf.f_flag) {
 			close(fd);
 			return;
 		}
-		flags |= MS_RDONLY;
 	}
-	else
-		assert(0);
 
 	if (arg_debug)
-		printf("Mounting %s %s\n", opstr[op], path);
+		printf("Mounting %s %s\n", ops_str(ops), path);
 
 	// make path a mount point:
 	// mount --bind path path
@@ -607,7 +856,7 @@ static void fs_remount_simple(const char *path, OPERATION op) {
 	if (fstat(fd2, &s2) < 0)
 		errExit("fstat");
 	if (s.st_dev != s2.st_dev || s.st_ino != s2.st_ino)
-		errLogExit("invalid %s mount", opstr[op]);
+		errLogExit("invalid %s mount", ops_str(ops));
 
 	EUID_ROOT();
 	err = remount_by_fd(fd2, flags);
@@ -624,25 +873,98 @@ static void fs_remount_simple(const char *path, OPERATION op) {
 	if ((strncmp(mptr->dir, path, len) != 0 ||
 	   (*(mptr->dir + len) != '\0' && *(mptr->dir + len) != '/'))
 	   && strcmp(path, "/") != 0) // support read-only=/
-		errLogExit("invalid %s mount", opstr[op]);
+		errLogExit("invalid %s mount", ops_str(ops));
 
-	fs_logger2(opstr[op], path);
+	ops_log(ops, path);
 	return;
 
 out:
 	fwarning("not remounting %s\n", path);
 }
 
+// mount_setattr is tried once, after a failure submounts are remounted one by one
+static int remount_tree_disabled = 0;
+
+// remount path and all mounts below it with a single mount_setattr call;
+// returns -1 if the caller should remount every mount point separately
+static int fs_remount_tree(const char *path, unsigned ops) {
+	EUID_ASSERT();
+	assert(path);
+
+	// read-write needs the ownership check on every mount point
+	if (ops & ~(OP_MASK(MOUNT_READONLY) | OP_MASK(MOUNT_NOEXEC)))
+		return -1;
+	unsigned long attr = 0;
+	if (ops & OP_MASK(MOUNT_READONLY))
+		attr |= MOUNT_ATTR_RDONLY;
+	if (ops & OP_MASK(MOUNT_NOEXEC))
+		attr |= MOUNT_ATTR_NOEXEC|MOUNT_ATTR_NODEV|MOUNT_ATTR_NOSUID;
+	if (remount_tree_disabled)
+		return -1;
+
+	int fd = safer_openat(-1, path, O_PATH|O_NOFOLLOW|O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	struct stat s;
+	if (fstat(fd, &s) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// make path a mount point, submounts are copied along:
+	// mount --rbind path path
+	EUID_ROOT();
+	int err = bind_mount_by_fd(fd, fd);
+	EUID_USER();
+	close(fd);
+	if (err)
+		return -1;
+
+	int fd2 = safer_openat(-1, path, O_PATH|O_NOFOLLOW|O_CLOEXEC);
+	if (fd2 < 0)
+		return -1;
+	struct stat s2;
+	if (fstat(fd2, &s2) < 0)
+		errExit("fstat");
+	if (s.st_dev != s2.st_dev || s.st_ino != s2.st_ino)
+		errLogExit("invalid %s mount", ops_str(ops));
+
+	EUID_ROOT();
+	err = remount_tree_by_fd(fd2, attr);
+	EUID_USER();
+	close(fd2);
+	if (err) {
+		// the bind mount stays in place, the slow path stacks
+		// its own mounts on top of it
+		if (errno == ENOSYS)
+			remount_tree_disabled = 1;
+		return -1;
+	}
+
+	// same sanity check as in fs_remount_simple
+	MountData *mptr = get_last_mount();
+	size_t len = strlen(path);
+	if ((strncmp(mptr->dir, path, len) != 0 ||
+	   (*(mptr->dir + len) != '\0' && *(mptr->dir + len) != '/'))
+	   && strcmp(path, "/") != 0)
+		errLogExit("invalid %s mount", ops_str(ops));
+
+	if (arg_debug)
+		printf("Mounting %s %s (recursive)\n", ops_str(ops), path);
+	ops_log(ops, path);
+	return 0;
+}
+
 // remount recursively; requires a resolved path
-static void fs_remount_rec(const char *path, OPERATION op) {
+static void fs_remount_rec(const char *path, unsigned ops) {
 	EUID_ASSERT();
-	assert(op < OPERATION_MAX);
+	assert(ops && ops < OP_MASK(OPERATION_MAX));
 	assert(path);
 
 	// no need to search /proc/self/mountinfo for submounts if not a directory
 	int fd = open(path, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
 	if (fd < 0) {
-		fs_remount_simple(path, op);
+		fs_remount_simple(path, ops);
 		return;
 	}
 
@@ -651,8 +973,8 @@ static void fs_remount_rec(const char *path, OPERATION op) {
 	close(fd);
 	if (mountid < 0) {
 		// falling back to a simple remount
-		fwarning("%s %s not applied recursively\n", opstr[op], path);
-		fs_remount_simple(path, op);
+		fwarning("%s %s not applied recursively\n", ops_str(ops), path);
+		fs_remount_simple(path, ops);
 		return;
 	}
 
@@ -660,10 +982,12 @@ static void fs_remount_rec(const char *path, OPERATION op) {
 	char **arr = build_mount_array(mountid, path);
 	if (!arr)
 		return;
-	// remount
+	// remount; if there are submounts, try to do it in one go first
 	int i;
+	int done = (arr[0] && arr[1] && fs_remount_tree(path, ops) == 0);
 	for (i = 0; arr[i]; i++) {
-		fs_remount_simple(arr[i], op);
+		if (!done)
+			fs_remount_simple(arr[i], ops);
 		free(arr[i]);
 	}
 	free(arr);
@@ -683,9 +1007,9 @@ void fs_remount(const char *path, OPERATION op, int rec) {
 	char *rpath = realpath(path, NULL);
 	if (rpath) {
 		if (rec)
-			fs_remount_rec(rpath, op);
+			fs_remount_rec(rpath, OP_MASK(op));
 		else
-			fs_remount_simple(rpath, op);
+			fs_remount_simple(rpath, OP_MASK(op));
 		free(rpath);
 	}
 
@@ -693,6 +1017,86 @@ void fs_remount(const char *path, OPERATION op, int rec) {
 		EUID_ROOT();
 }
 
+// remount plan for fs_basic_fs(): the paths are resolved first, the
+// operations on the same path are merged in one remount, and a path already
+// covered by the recursive remount of a parent directory is dropped; on
+// usr-merged systems /bin, /sbin and /lib* all end up in /usr
+#define REMOUNT_PLAN_MAX 16
+typedef struct {
+	char *path;	// resolved
+	unsigned ops;
+} RemountEntry;
+
+typedef struct {
+	RemountEntry entry[REMOUNT_PLAN_MAX];
+	int cnt;
+} RemountPlan;
+
+// path is dir or a file below it
+static int path_below(const char *dir, const char *path) {
+	size_t len = strlen(dir);
+	if (strcmp(dir, "/") == 0)
+		return 1;
+	return strncmp(dir, path, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+static void plan_add(RemountPlan *plan, const char *path, OPERATION op) {
+	EUID_ASSERT();
+	assert(plan);
+	assert(path);
+	assert(op == MOUNT_READONLY || op == MOUNT_NOEXEC);
+
+	char *rpath = realpath(path, NULL);
+	if (!rpath)
+		return;
+	unsigned ops = OP_MASK(op);
+
+	int i;
+	for (i = 0; i < plan->cnt; i++) {
+		RemountEntry *e = &plan->entry[i];
+		if (strcmp(e->path, rpath) == 0) {
+			e->ops |= ops;
+			free(rpath);
+			return;
+		}
+		if (path_below(e->path, rpath) && (e->ops & ops) == ops) {
+			if (arg_debug)
+				printf("%s %s covered by %s\n", opstr[op], rpath, e->path);
+			free(rpath);
+			return;
+		}
+	}
+
+	// drop the entries covered by the new one
+	int j = 0;
+	for (i = 0; i < plan->cnt; i++) {
+		RemountEntry *e = &plan->entry[i];
+		if (path_below(rpath, e->path) && (e->ops & ops) == e->ops) {
+			free(e->path);
+			continue;
+		}
+		plan->entry[j++] = *e;
+	}
+	plan->cnt = j;
+
+	assert(plan->cnt < REMOUNT_PLAN_MAX);
+	plan->entry[plan->cnt].path = rpath;
+	plan->entry[plan->cnt].ops = ops;
+	plan->cnt++;
+}
+
+static void plan_apply(RemountPlan *plan) {
+	EUID_ASSERT();
+	assert(plan);
+
+	int i;
+	for (i = 0; i < plan->cnt; i++) {
+		fs_remount_rec(plan->entry[i].path, plan->entry[i].ops);
+		free(plan->entry[i].path);
+	}
+	plan->cnt = 0;
+}
+
 // Disable /mnt, /media, /run/mount and /run/media access
 void fs_mnt(const int enforce) {
 	EUID_USER();
@@ -736,6 +1140,13 @@ out:
 
 
 // mount /proc and /sys directories
+// the paths in /proc and /sys missing on the running kernel are not probed
+// on every launch, see fs_kpath_cache.c
+static void disable_kernel_file(const char *path) {
+	if (kpath_exists(path))
+		disable_file(BLACKLIST_FILE, path);
+}
+
 void fs_proc_sys_dev_boot(void) {
 	// remount /proc/sys readonly
 	if (arg_debug)
@@ -757,8 +1168,8 @@ void fs_proc_sys_dev_boot(void) {
 
 	EUID_USER();
 
-	disable_file(BLACKLIST_FILE, "/sys/firmware");
-	disable_file(BLACKLIST_FILE, "/sys/hypervisor");
+	disable_kernel_file("/sys/firmware");
+	disable_kernel_file("/sys/hypervisor");
 
 	// Soft-block some paths in /sys/ (can be undone in profiles).
 	profile_add("blacklist /sys/fs");
@@ -773,33 +1184,33 @@ void fs_proc_sys_dev_boot(void) {
 		profile_add("blacklist /sys/module");
 	}
 
-	disable_file(BLACKLIST_FILE, "/sys/power");
-	disable_file(BLACKLIST_FILE, "/sys/kernel/debug");
-	disable_file(BLACKLIST_FILE, "/sys/kernel/vmcoreinfo");
-	disable_file(BLACKLIST_FILE, "/sys/kernel/uevent_helper");
+	disable_kernel_file("/sys/power");
+	disable_kernel_file("/sys/kernel/debug");
+	disable_kernel_file("/sys/kernel/vmcoreinfo");
+	disable_kernel_file("/sys/kernel/uevent_helper");
 
 	// various /proc/sys files
-	disable_file(BLACKLIST_FILE, "/proc/sys/security");
-	disable_file(BLACKLIST_FILE, "/proc/sys/efi/vars");
-	disable_file(BLACKLIST_FILE, "/proc/sys/fs/binfmt_misc");
-	disable_file(BLACKLIST_FILE, "/proc/sys/kernel/core_pattern");
-	disable_file(BLACKLIST_FILE, "/proc/sys/kernel/modprobe");
-	disable_file(BLACKLIST_FILE, "/proc/sysrq-trigger");
-	disable_file(BLACKLIST_FILE, "/proc/sys/kernel/hotplug");
-	disable_file(BLACKLIST_FILE, "/proc/sys/vm/panic_on_oom");
+	disable_kernel_file("/proc/sys/security");
+	disable_kernel_file("/proc/sys/efi/vars");
+	disable_kernel_file("/proc/sys/fs/binfmt_misc");
+	disable_kernel_file("/proc/sys/kernel/core_pattern");
+	disable_kernel_file("/proc/sys/kernel/modprobe");
+	disable_kernel_file("/proc/sysrq-trigger");
+	disable_kernel_file("/proc/sys/kernel/hotplug");
+	disable_kernel_file("/proc/sys/vm/panic_on_oom");
 
 	// various /proc files
-	disable_file(BLACKLIST_FILE, "/proc/irq");
-	disable_file(BLACKLIST_FILE, "/proc/bus");
+	disable_kernel_file("/proc/irq");
+	disable_kernel_file("/proc/bus");
 	// move /proc/config.gz to disable-common.inc
 	//disable_file(BLACKLIST_FILE, "/proc/config.gz");
-	disable_file(BLACKLIST_FILE, "/proc/sched_debug");
-	disable_file(BLACKLIST_FILE, "/proc/timer_list");
-	disable_file(BLACKLIST_FILE, "/proc/timer_stats");
-	disable_file(BLACKLIST_FILE, "/proc/kcore");
-	disable_file(BLACKLIST_FILE, "/proc/kallsyms");
-	disable_file(BLACKLIST_FILE, "/proc/mem");
-	disable_file(BLACKLIST_FILE, "/proc/kmem");
+	disable_kernel_file("/proc/sched_debug");
+	disable_kernel_file("/proc/timer_list");
+	disable_kernel_file("/proc/timer_stats");
+	disable_kernel_file("/proc/kcore");
+	disable_kernel_file("/proc/kallsyms");
+	disable_kernel_file("/proc/mem");
+	disable_kernel_file("/proc/kmem");
 
 	// remove kernel symbol information
 	if (!arg_allow_debuggers) {
@@ -845,10 +1256,11 @@ void fs_proc_sys_dev_boot(void) {
 	if (getuid() != 0) {
 		// disable /dev/kmsg and /proc/kmsg
 		disable_file(BLACKLIST_FILE, "/dev/kmsg");
-		disable_file(BLACKLIST_FILE, "/proc/kmsg");
+		disable_kernel_file("/proc/kmsg");
 	}
 
 	EUID_ROOT();
+	kpath_cache_close();
 }
 
 // disable firejail configuration in ~/.config/firejail
@@ -866,9 +1278,19 @@ void disable_config(void) {
 	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_SANDBOX_DIR);
 	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_NETWORK_DIR);
 	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_BANDWIDTH_DIR);
-	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_NAME_DIR);
-	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_PROFILE_DIR);
-	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_X11_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_RECORD_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_NAME_INDEX_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_CGROUP_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_NUMA_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_SECCOMP_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_FLDD_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_DEV_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_USERS_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_VAR_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_KPATH_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_HOSTS_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_FIREJAIL_PULSE_CACHE_DIR);
+	disable_file(BLACKLIST_FILE, RUN_STATS_FILE);
 	EUID_ROOT();
 }
 
@@ -886,23 +1308,25 @@ void fs_basic_fs(void) {
 	EUID_USER();
 	if (arg_debug)
 		printf("Basic read-only filesystem:\n");
+	RemountPlan plan = { .cnt = 0 };
 	if (!arg_writable_etc) {
-		fs_remount("/etc", MOUNT_READONLY, 1);
+		plan_add(&plan, "/etc", MOUNT_READONLY);
 		if (uid)
-			fs_remount("/etc", MOUNT_NOEXEC, 1);
+			plan_add(&plan, "/etc", MOUNT_NOEXEC);
 	}
 	if (!arg_writable_var) {
-		fs_remount("/var", MOUNT_READONLY, 1);
+		plan_add(&plan, "/var", MOUNT_READONLY);
 		if (uid)
-			fs_remount("/var", MOUNT_NOEXEC, 1);
-	}
-	fs_remount("/usr", MOUNT_READONLY, 1);
-	fs_remount("/bin", MOUNT_READONLY, 1);
-	fs_remount("/sbin", MOUNT_READONLY, 1);
-	fs_remount("/lib", MOUNT_READONLY, 1);
-	fs_remount("/lib64", MOUNT_READONLY, 1);
-	fs_remount("/lib32", MOUNT_READONLY, 1);
-	fs_remount("/libx32", MOUNT_READONLY, 1);
+			plan_add(&plan, "/var", MOUNT_NOEXEC);
+	}
+	plan_add(&plan, "/usr", MOUNT_READONLY);
+	plan_add(&plan, "/bin", MOUNT_READONLY);
+	plan_add(&plan, "/sbin", MOUNT_READONLY);
+	plan_add(&plan, "/lib", MOUNT_READONLY);
+	plan_add(&plan, "/lib64", MOUNT_READONLY);
+	plan_add(&plan, "/lib32", MOUNT_READONLY);
+	plan_add(&plan, "/libx32", MOUNT_READONLY);
+	plan_apply(&plan);
 	EUID_ROOT();
 
 	// update /var directory in order to support multiple sandboxes running on the same root directory
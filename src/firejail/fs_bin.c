@@ -20,13 +20,125 @@
 #include "firejail.h"
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <unistd.h>
-#include <glob.h>
 
 static int prog_cnt = 0;
 
+// all the programs are copied in a single fcopy run
+static FcopyBatch copy_batch;
+
+// cfg.bin_private_lib, grown in place
+static size_t lib_len = 0;
+static size_t lib_max = 0;
+
+static void lib_add(const char *fname, const char *full_path) {
+	size_t len = strlen(fname) + strlen(full_path) + 2;	// two commas, or a comma and '\0'
+	if (lib_len + len + 1 > lib_max) {
+		lib_max = (lib_len + len + 1) * 2;
+		cfg.bin_private_lib = realloc(cfg.bin_private_lib, lib_max);
+		if (!cfg.bin_private_lib)
+			errExit("realloc");
+	}
+	lib_len += sprintf(cfg.bin_private_lib + lib_len, "%s%s,%s",
+			   (lib_len) ? "," : "", fname, full_path);
+}
+
+// private-bin-mode bind: the programs are mounted read-only on empty files
+// in RUN_BIN_DIR, the symbolic links are created directly
+static int bind_mode = 0;
+static char **bind_list = NULL;
+static int bind_cnt = 0;
+static int bind_max = 0;
+
+static void bind_add(const char *path) {
+	EUID_ASSERT();
+	char *fname = strrchr(path, '/');
+	assert(fname);
+	char *dst;
+	if (asprintf(&dst, "%s%s", RUN_BIN_DIR, fname) == -1)
+		errExit("asprintf");
+
+	EUID_ROOT();
+	struct stat s;
+	if (lstat(dst, &s) == 0)	// already there
+		goto out;
+	if (lstat(path, &s) == -1)
+		goto out;
+
+	if (S_ISLNK(s.st_mode)) {
+		// same as fcopy: the link points to the absolute path of the target
+		char *target = realpath(path, NULL);
+		if (!target || symlink(target, dst) == -1)
+			fwarning("cannot create symbolic link %s\n", dst);
+		free(target);
+		goto out;
+	}
+	if (!S_ISREG(s.st_mode))
+		goto out;
+
+	int fd = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0755);
+	if (fd == -1)
+		errExit("open");
+	close(fd);
+	if (bind_cnt == bind_max) {
+		bind_max = (bind_max) ? bind_max * 2 : 64;
+		bind_list = realloc(bind_list, bind_max * 2 * sizeof(char *));
+		if (!bind_list)
+			errExit("realloc");
+	}
+	bind_list[2 * bind_cnt] = strdup(path);
+	if (!bind_list[2 * bind_cnt])
+		errExit("strdup");
+	bind_list[2 * bind_cnt + 1] = dst;
+	bind_cnt++;
+	dst = NULL;
+out:
+	EUID_USER();
+	free(dst);
+}
+
+static void bind_run(void) {
+	EUID_ASSERT();
+	EUID_ROOT();
+	int i;
+	for (i = 0; i < bind_cnt; i++) {
+		const char *src = bind_list[2 * i];
+		const char *dst = bind_list[2 * i + 1];
+		if (arg_debug)
+			printf("Mounting %s on %s\n", src, dst);
+		if (mount(src, dst, NULL, MS_BIND, NULL) < 0)
+			errExit("mount bind");
+		// keep the flags of the original mount, the ones locked in a
+		// user namespace cannot be dropped
+		struct statvfs buf;
+		if (statvfs(dst, &buf) < 0)
+			errExit("statvfs");
+		unsigned long flags = buf.f_flag | MS_RDONLY | MS_NOSUID | MS_NODEV;
+		if (mount(NULL, dst, NULL, flags|MS_BIND|MS_REMOUNT, NULL) < 0)
+			errExit("remounting read-only");
+		free(bind_list[2 * i]);
+		free(bind_list[2 * i + 1]);
+	}
+	EUID_USER();
+
+	free(bind_list);
+	bind_list = NULL;
+	bind_cnt = 0;
+	bind_max = 0;
+}
+
+static void install_file(const char *path) {
+	if (bind_mode)
+		bind_add(path);
+	else
+		fcopy_batch_add(&copy_batch, path, RUN_BIN_DIR);
+	prog_cnt++;
+}
+
 static const char * const paths[] = {
 	"/usr/local/bin",
 	"/usr/bin",
@@ -54,6 +166,10 @@ static const char *check_dir_or_file(const char *name) {
 		}
 
 		// check file
+		if (!path_cache_lookup(paths[i], name)) {
+			i++;
+			continue;
+		}
 		char *fname;
 		if (asprintf(&fname, "%s/%s", paths[i], name) == -1)
 			errExit("asprintf");
@@ -168,17 +284,7 @@ static void duplicate(char *fname) {
 	}
 
 	// add to private-lib list
-	if (cfg.bin_private_lib == NULL) {
-		if (asprintf(&cfg.bin_private_lib, "%s,%s",fname, full_path) == -1)
-			errExit("asprintf");
-	}
-	else {
-		char *tmp;
-		if (asprintf(&tmp, "%s,%s,%s", cfg.bin_private_lib, fname, full_path) == -1)
-			errExit("asprintf");
-		free(cfg.bin_private_lib);
-		cfg.bin_private_lib = tmp;
-	}
+	lib_add(fname, full_path);
 
 	// if full_path is symlink, and the link is in our path, copy both the file and the symlink
 	if (is_link(full_path)) {
@@ -187,8 +293,7 @@ static void duplicate(char *fname) {
 			if (valid_full_path_file(actual_path)) {
 				// solving problems such as /bin/sh -> /bin/dash
 				// copy the real file pointed by symlink
-				sbox_run(SBOX_ROOT| SBOX_SECCOMP, 3, PATH_FCOPY, actual_path, RUN_BIN_DIR);
-				prog_cnt++;
+				install_file(actual_path);
 				char *f = strrchr(actual_path, '/');
 				if (f && *(++f) !='\0')
 					report_duplication(f);
@@ -198,8 +303,7 @@ static void duplicate(char *fname) {
 	}
 
 	// copy a file or a symlink
-	sbox_run(SBOX_ROOT| SBOX_SECCOMP, 3, PATH_FCOPY, full_path, RUN_BIN_DIR);
-	prog_cnt++;
+	install_file(full_path);
 	free(full_path);
 	report_duplication(fname);
 }
@@ -229,32 +333,56 @@ static void globbing(char *fname) {
 			errExit("asprintf");
 
 		// globbing
-		glob_t globbuf;
-		int globerr = glob(pattern, GLOB_NOCHECK | GLOB_NOSORT | GLOB_PERIOD, NULL, &globbuf);
-		if (globerr) {
+		size_t cnt;
+		char **matches = fs_glob(pattern, &cnt);
+		if (!matches) {
 			fprintf(stderr, "Error: failed to glob private-bin pattern %s\n", pattern);
 			exit(1);
 		}
 
 		size_t j;
-		for (j = 0; j < globbuf.gl_pathc; j++) {
-			assert(globbuf.gl_pathv[j]);
+		for (j = 0; j < cnt; j++) {
+			assert(matches[j]);
 			// testing for GLOB_NOCHECK - no pattern matched returns the original pattern
-			if (strcmp(globbuf.gl_pathv[j], pattern) == 0)
+			if (strcmp(matches[j], pattern) == 0)
 				continue;
 			// skip symlinks to firejail executable, as created by firecfg
-			if (is_firejail_link(globbuf.gl_pathv[j]))
+			if (is_firejail_link(matches[j]))
 				continue;
 
-			duplicate(globbuf.gl_pathv[j]);
+			duplicate(matches[j]);
 		}
 
-		globfree(&globbuf);
+		fs_glob_free(matches);
 		free(pattern);
 		i++;
 	}
 }
 
+// expand the glob patterns of the private-bin list in advance
+static void prefetch(const char *private_list) {
+	char *dlist = strdup(private_list);
+	if (!dlist)
+		errExit("strdup");
+
+	char *ptr;
+	for (ptr = strtok(dlist, ","); ptr; ptr = strtok(NULL, ",")) {
+		int i;
+		for (i = 0; paths[i]; i++) {
+			// same as in globbing()
+			if (checkcfg(CFG_PRIVATE_BIN_NO_LOCAL) && strstr(paths[i], "local/"))
+				continue;
+			char *pattern;
+			if (asprintf(&pattern, "%s/%s", paths[i], ptr) == -1)
+				errExit("asprintf");
+			fs_glob_queue(pattern);
+			free(pattern);
+		}
+	}
+	free(dlist);
+	fs_glob_prefetch();
+}
+
 void fs_private_bin_list(void) {
 	EUID_ASSERT();
 	char *private_list = cfg.bin_private_keep;
@@ -268,10 +396,12 @@ void fs_private_bin_list(void) {
 	mkdir_attr(RUN_BIN_DIR, 0755, 0, 0);
 	EUID_USER();
 
+	bind_mode = checkcfg(CFG_PRIVATE_BIN_BIND);
 	if (arg_debug)
-		printf("Copying files in the new bin directory\n");
+		printf("%s files in the new bin directory\n", (bind_mode) ? "Mounting" : "Copying");
 
 	// copy the list of files in the new home directory
+	prefetch(private_list);
 	char *dlist = strdup(private_list);
 	if (!dlist)
 		errExit("strdup");
@@ -281,12 +411,16 @@ void fs_private_bin_list(void) {
 		fprintf(stderr, "Error: invalid private-bin argument\n");
 		exit(1);
 	}
+	fcopy_batch_init(&copy_batch, SBOX_ROOT | SBOX_SECCOMP, 0);
 	globbing(ptr);
 	while ((ptr = strtok(NULL, ",")) != NULL)
 		globbing(ptr);
 	free(dlist);
 	if (!arg_allow_bwrap)
 		globbing("/usr/bin/bwrap");
+	fs_glob_flush();
+	fcopy_batch_run(&copy_batch);
+	bind_run();
 
 	// mount-bind
 	EUID_ROOT();
@@ -24,6 +24,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <glob.h>
 #include <libgen.h>
 #include <pwd.h>
@@ -168,7 +169,179 @@ static void deventry_mount(const char *source,
 	fs_logger2("whitelist", target);
 }
 
-// For every path in source_pattern, mount it on the dirname of target_pattern.
+// The device table is resolved with a single scan of RUN_DEV_DIR; all the
+// patterns are top-level /dev entries. The result is stored in
+// RUN_FIREJAIL_DEV_CACHE_DIR (root only) together with the inode and the
+// mtime/ctime of /dev. Creating, removing or renaming a device node updates
+// the mtime of the directory, the next sandbox scans /dev again.
+//
+// File format: the key, an empty line, and "index name" lines, where index is
+// the position in dev[] and the names are sorted the same way as glob() does.
+#define DEV_CACHE_FILE "dev.list"
+#define DEV_ENTRIES ((int) (sizeof(dev) / sizeof(dev[0]) - 1))
+#define MAXBUF 4096
+
+typedef struct {
+	char **names;
+	size_t cnt;
+	size_t max;
+} DevMatch;
+
+static DevMatch matches[DEV_ENTRIES];
+static int cache_fd = -1;
+
+// open the cache directory before the filesystem is modified
+void fs_dev_cache_open(void) {
+	if (cache_fd != -1)
+		return;
+	if (!checkcfg(CFG_PRIVATE_DEV_CACHE))
+		return;
+
+	cache_fd = run_cache_open(RUN_FIREJAIL_DEV_CACHE_DIR, "device");
+}
+
+static void add_match(int index, const char *name) {
+	DevMatch *m = &matches[index];
+	if (m->cnt == m->max) {
+		m->max = (m->max) ? m->max * 2 : 8;
+		m->names = realloc(m->names, m->max * sizeof(char *));
+		if (!m->names)
+			errExit("realloc");
+	}
+	m->names[m->cnt] = strdup(name);
+	if (!m->names[m->cnt])
+		errExit("strdup");
+	m->cnt++;
+}
+
+static void free_matches(void) {
+	int i;
+	for (i = 0; i < DEV_ENTRIES; i++) {
+		size_t j;
+		for (j = 0; j < matches[i].cnt; j++)
+			free(matches[i].names[j]);
+		free(matches[i].names);
+		memset(&matches[i], 0, sizeof(DevMatch));
+	}
+}
+
+static char *build_key(void) {
+	struct stat s;
+	if (stat(RUN_DEV_DIR, &s) == -1)
+		return NULL;
+
+	char *key;
+	if (asprintf(&key, "version %s\ndevice %lu\ninode %lu\nmtime %lld.%09ld\nctime %lld.%09ld\n",
+		     VERSION, (unsigned long) s.st_dev, (unsigned long) s.st_ino,
+		     (long long) s.st_mtim.tv_sec, s.st_mtim.tv_nsec,
+		     (long long) s.st_ctim.tv_sec, s.st_ctim.tv_nsec) == -1)
+		errExit("asprintf");
+
+	int i;
+	for (i = 0; i < DEV_ENTRIES; i++) {
+		char *tmp;
+		if (asprintf(&tmp, "%s%s\n", key, dev[i].run_pattern) == -1)
+			errExit("asprintf");
+		free(key);
+		key = tmp;
+	}
+	return key;
+}
+
+// return 0 if the matches were loaded from the cache
+static int cache_load(const char *key) {
+	if (cache_fd == -1 || !key)
+		return -1;
+	FILE *fp = run_cache_load(cache_fd, DEV_CACHE_FILE, key);
+	if (!fp)
+		return -1;
+
+	int rv = -1;
+	char line[MAXBUF];
+	while (fgets(line, sizeof(line), fp)) {
+		char *ptr = strchr(line, '\n');
+		if (!ptr)
+			goto out;
+		*ptr = '\0';
+
+		char *name;
+		long index = strtol(line, &name, 10);
+		if (name == line || *name != ' ' || index < 0 || index >= DEV_ENTRIES)
+			goto out;
+		name++;
+		if (*name == '\0' || strchr(name, '/') ||
+		    strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			goto out;
+		add_match((int) index, name);
+	}
+	rv = 0;
+
+out:
+	fclose(fp);
+	if (rv)
+		free_matches();
+	return rv;
+}
+
+// errors are not fatal
+static void cache_store(const char *key) {
+	if (cache_fd == -1 || !key)
+		return;
+
+	FILE *fp = run_cache_create(cache_fd, DEV_CACHE_FILE, key);
+	if (!fp)
+		goto errout;
+
+	int i;
+	for (i = 0; i < DEV_ENTRIES; i++) {
+		size_t j;
+		for (j = 0; j < matches[i].cnt; j++)
+			fprintf(fp, "%d %s\n", i, matches[i].names[j]);
+	}
+	if (run_cache_commit(cache_fd, DEV_CACHE_FILE, fp))
+		goto errout;
+
+	if (arg_debug)
+		printf("Device list stored in cache\n");
+	return;
+
+errout:
+	if (arg_debug)
+		printf("Cannot store the device list in cache\n");
+}
+
+static int name_cmp(const void *p1, const void *p2) {
+	// same order as glob()
+	return strcoll(*(char * const *) p1, *(char * const *) p2);
+}
+
+// match every entry of RUN_DEV_DIR against all the patterns
+static void scan_dev(void) {
+	EUID_USER();
+	DIR *dir = opendir(RUN_DEV_DIR);
+	if (dir) {
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+				continue;
+			int i;
+			for (i = 0; i < DEV_ENTRIES; i++) {
+				const char *base = gnu_basename(dev[i].run_pattern);
+				if (fnmatch(base, entry->d_name, FNM_PERIOD) == 0)
+					add_match(i, entry->d_name);
+			}
+		}
+		closedir(dir);
+	}
+	EUID_ROOT();
+
+	int i;
+	for (i = 0; i < DEV_ENTRIES; i++)
+		if (matches[i].cnt > 1)
+			qsort(matches[i].names, matches[i].cnt, sizeof(char *), name_cmp);
+}
+
+// For every match of source_pattern, mount it on the dirname of target_pattern.
 //
 // Example:
 //
@@ -177,10 +350,12 @@ static void deventry_mount(const char *source,
 //                   mount("/run/foo2", "/dev/foo2")
 //                   ...
 static void deventry_mount_glob(const char *source_pattern,
-                                const char *target_pattern, DEV_TYPE type) {
+                                const char *target_pattern, DEV_TYPE type,
+                                const DevMatch *m) {
 	assert(source_pattern);
 	assert(target_pattern);
 	assert(type >= DEV_NONE && type < DEV_MAX);
+	assert(m);
 
 	const char *typestr = dev_type_str[type].str;
 	if (arg_debug) {
@@ -197,20 +372,12 @@ static void deventry_mount_glob(const char *source_pattern,
 		exit(1);
 	}
 
-	EUID_USER();
-	glob_t globbuf;
-	int globerr = glob(source_pattern, 0, NULL, &globbuf);
-	EUID_ROOT();
-	if (globerr == GLOB_NOMATCH) {
+	if (m->cnt == 0) {
 		if (arg_debug) {
 			printf("No match %s (type=%s)\n", source_pattern,
 			       typestr);
 		}
 		return;
-	} else if (globerr) {
-		fwarning("failed to glob pattern %s (type=%s): %s\n",
-		         source_pattern, typestr, strerror(errno));
-		return;
 	}
 
 	// strdup for dirname
@@ -226,28 +393,22 @@ static void deventry_mount_glob(const char *source_pattern,
 	}
 
 	size_t i;
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		const char *source = globbuf.gl_pathv[i];
-		assert(source);
-
-		const char *source_base = gnu_basename(source);
-		if (strcmp(source_base, ".") == 0 ||
-		    strcmp(source_base, "..") == 0) {
-			fprintf(stderr, "Error: invalid source_base: %s -> %s -> %s (type=%s)\n",
-			        source_pattern, source, source_base, typestr);
-			exit(1);
-		}
+	for (i = 0; i < m->cnt; i++) {
+		const char *source_base = m->names[i];
+		assert(source_base);
 
+		char *source = NULL;
 		char *target = NULL;
-		if (asprintf(&target, "%s/%s", target_dir, source_base) == -1)
+		if (asprintf(&source, "%s/%s", RUN_DEV_DIR, source_base) == -1 ||
+		    asprintf(&target, "%s/%s", target_dir, source_base) == -1)
 			errExit("asprintf");
 
 		deventry_mount(source, target, type);
+		free(source);
 		free(target);
 	}
 
 	free(tmp);
-	globfree(&globbuf);
 }
 
 // Note: By the time that this function is called for private-dev, RUN_DEV_DIR
@@ -255,12 +416,26 @@ static void deventry_mount_glob(const char *source_pattern,
 // run_pattern is the source path and dev_pattern is the target path when
 // bind-mounting.
 static void deventry_mount_all(void) {
-	int i = 0;
-	while (dev[i].dev_pattern != NULL) {
+	timetrace_start();
+	char *key = build_key();
+	int cached = (cache_load(key) == 0);
+	if (!cached)
+		scan_dev();
+	float ms = timetrace_end();
+	if (arg_debug)
+		printf("Device list %s in %.02f ms\n", (cached) ? "loaded from cache" : "built", ms);
+	if (!cached)
+		cache_store(key);
+	free(key);
+	run_cache_close(&cache_fd);
+
+	int i;
+	for (i = 0; i < DEV_ENTRIES; i++) {
+		assert(strncmp(dev[i].run_pattern, RUN_DEV_DIR "/", strlen(RUN_DEV_DIR "/")) == 0);
 		deventry_mount_glob(dev[i].run_pattern, dev[i].dev_pattern,
-		                    dev[i].type);
-		i++;
+		                    dev[i].type, &matches[i]);
 	}
+	free_matches();
 }
 
 static void create_char_dev(const char *path, mode_t mode, int major, int minor) {
@@ -352,7 +527,7 @@ void fs_private_dev(void) {
 	}
 
 	// mount tmpfs on top of /dev
-	if (mount("tmpfs", "/dev", "tmpfs", MS_NOSUID | MS_STRICTATIME, "mode=755,gid=0") < 0)
+	if (tmpfs_mount("/dev", MS_NOSUID | MS_STRICTATIME, "mode=755,gid=0", 0) < 0)
 		errExit("mounting /dev");
 	fs_logger("tmpfs /dev");
 	selinux_relabel_path("/dev", "/dev");
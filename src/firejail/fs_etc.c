@@ -19,8 +19,10 @@
 */
 #include "firejail.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -266,6 +268,107 @@ errexit:
 	exit(1);
 }
 
+// all the files are copied in a single fcopy run; links are followed
+// except for /etc/mtab
+static FcopyBatch copy_batch;
+static FcopyBatch copy_batch_nofollow;
+
+// private-etc-mode bind: instead of copying the files, they are mounted
+// read-only on empty files and directories created in private_run_dir
+typedef struct {
+	char *src;
+	char *dst;
+	int dir;
+} BindEntry;
+
+static BindEntry *bind_list = NULL;
+static int bind_cnt = 0;
+static int bind_max = 0;
+static int bind_mode = 0;
+
+static void bind_add(const char *src, const char *dst, int dir) {
+	if (bind_cnt == bind_max) {
+		bind_max = (bind_max) ? bind_max * 2 : 64;
+		bind_list = realloc(bind_list, bind_max * sizeof(BindEntry));
+		if (!bind_list)
+			errExit("realloc");
+	}
+	bind_list[bind_cnt].src = strdup(src);
+	bind_list[bind_cnt].dst = strdup(dst);
+	if (!bind_list[bind_cnt].src || !bind_list[bind_cnt].dst)
+		errExit("strdup");
+	bind_list[bind_cnt].dir = dir;
+	bind_cnt++;
+}
+
+// '/' sorts before any other character, a directory comes right before
+// the paths inside it
+static int bind_cmp(const void *p1, const void *p2) {
+	const unsigned char *s1 = (const unsigned char *) ((const BindEntry *) p1)->dst;
+	const unsigned char *s2 = (const unsigned char *) ((const BindEntry *) p2)->dst;
+	while (*s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+	}
+	int c1 = (*s1 == '/') ? 1 : (*s1) ? *s1 + 1 : 0;
+	int c2 = (*s2 == '/') ? 1 : (*s2) ? *s2 + 1 : 0;
+	return c1 - c2;
+}
+
+static void bind_mount(const BindEntry *e) {
+	if (!e->dir) {
+		int fd = open(e->dst, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+		if (fd == -1)
+			errExit("open");
+		close(fd);
+	}
+
+	if (mount(e->src, e->dst, NULL, MS_BIND|MS_REC, NULL) < 0)
+		errExit("mount bind");
+	// keep the flags of the original mount, the ones locked in a user namespace
+	// cannot be dropped
+	struct statvfs buf;
+	if (statvfs(e->dst, &buf) < 0)
+		errExit("statvfs");
+	unsigned long flags = buf.f_flag | MS_RDONLY | MS_NOSUID | MS_NODEV;
+	if (mount(NULL, e->dst, NULL, flags|MS_BIND|MS_REMOUNT, NULL) < 0)
+		errExit("remounting read-only");
+}
+
+static void bind_run(void) {
+	if (bind_cnt == 0)
+		return;
+	qsort(bind_list, bind_cnt, sizeof(BindEntry), bind_cmp);
+
+	const BindEntry *last = NULL;	// last directory mounted
+	size_t last_len = 0;
+	int i;
+	for (i = 0; i < bind_cnt; i++) {
+		BindEntry *e = &bind_list[i];
+		if (last && strncmp(e->dst, last->dst, last_len) == 0 &&
+		    (e->dst[last_len] == '/' || e->dst[last_len] == '\0')) {
+			if (arg_debug)
+				printf("%s covered by %s\n", e->src, last->src);
+		}
+		else {
+			bind_mount(e);
+			if (e->dir) {
+				last = e;
+				last_len = strlen(e->dst);
+			}
+		}
+	}
+
+	for (i = 0; i < bind_cnt; i++) {
+		free(bind_list[i].src);
+		free(bind_list[i].dst);
+	}
+	free(bind_list);
+	bind_list = NULL;
+	bind_cnt = 0;
+	bind_max = 0;
+}
+
 static void duplicate(const char *fname, const char *private_dir, const char *private_run_dir) {
 	char *src;
 	if (asprintf(&src,  "%s/%s", private_dir, fname) == -1)
@@ -276,13 +379,27 @@ static void duplicate(const char *fname, const char *private_dir, const char *pr
 		return;
 	}
 
+	// /etc/mtab is a symbolic link, it is always copied
+	int bind = bind_mode && strcmp(src, "/etc/mtab") != 0;
 	if (arg_debug)
-		printf("Copying %s to private %s\n", src, private_dir);
+		printf("%s %s to private %s\n", (bind) ? "Mounting" : "Copying", src, private_dir);
 
 	char *dst;
 	if (asprintf(&dst, "%s/%s", private_run_dir, fname) == -1)
 		errExit("asprintf");
 
+	if (bind) {
+		char *target = strdup(dst);
+		if (!target)
+			errExit("strdup");
+		build_dirs(src, dst, strlen(private_dir), strlen(private_run_dir));
+		bind_add(src, target, is_dir(src));
+		free(target);
+		free(dst);
+		fs_logger2("mount", src);
+		return;
+	}
+
 	build_dirs(src, dst, strlen(private_dir), strlen(private_run_dir));
 
 	// follow links by default, thus making a copy of the file or directory pointed by the symlink
@@ -290,9 +407,9 @@ static void duplicate(const char *fname, const char *private_dir, const char *pr
 	//
 	// don't follow links to dynamic directories such as /proc
 	if (strcmp(src, "/etc/mtab") == 0)
-		sbox_run(SBOX_ROOT | SBOX_SECCOMP, 3, PATH_FCOPY, src, dst);
+		fcopy_batch_add(&copy_batch_nofollow, src, dst);
 	else
-		sbox_run(SBOX_ROOT | SBOX_SECCOMP, 4, PATH_FCOPY, "--follow-link", src, dst);
+		fcopy_batch_add(&copy_batch, src, dst);
 
 	free(dst);
 	fs_logger2("clone", src);
@@ -329,6 +446,27 @@ static void duplicate_globbing(const char *fname, const char *private_dir, const
 	free(pattern);
 }
 
+// look up the files of the list in advance, see fs_prefetch.c
+static void prefetch(const char *private_dir, const char *private_list) {
+	char *dlist = strdup(private_list);
+	if (!dlist)
+		errExit("strdup");
+
+	char *ptr;
+	for (ptr = strtok(dlist, ","); ptr; ptr = strtok(NULL, ",")) {
+		// invalid names are reported by duplicate_globbing
+		if (*ptr == '~' || *ptr == '/' || strstr(ptr, "..") || strpbrk(ptr, "*?["))
+			continue;
+		char *path;
+		if (asprintf(&path, "%s/%s", private_dir, ptr) == -1)
+			errExit("asprintf");
+		fs_prefetch_queue(path);
+		free(path);
+	}
+	free(dlist);
+	fs_prefetch_run();
+}
+
 void fs_private_dir_copy(const char *private_dir, const char *private_run_dir, const char *private_list) {
 	assert(private_dir);
 	assert(private_run_dir);
@@ -356,6 +494,8 @@ void fs_private_dir_copy(const char *private_dir, const char *private_run_dir, c
 		if (arg_debug)
 			printf("Copying files in the new %s directory:\n", private_dir);
 
+		prefetch(private_dir, private_list);
+
 		// copy the list of files in the new home directory
 		char *dlist = strdup(private_list);
 		if (!dlist)
@@ -367,10 +507,19 @@ void fs_private_dir_copy(const char *private_dir, const char *private_run_dir, c
 			fprintf(stderr, "Error: invalid private %s argument\n", private_dir);
 			exit(1);
 		}
+		// bind mode applies to private-etc only
+		bind_mode = checkcfg(CFG_PRIVATE_ETC_BIND) &&
+			(strcmp(private_dir, "/etc") == 0 || strcmp(private_dir, "/usr/etc") == 0);
+		fcopy_batch_init(&copy_batch, SBOX_ROOT | SBOX_SECCOMP, 1);
+		fcopy_batch_init(&copy_batch_nofollow, SBOX_ROOT | SBOX_SECCOMP, 0);
 		duplicate_globbing(ptr, private_dir, private_run_dir);
 
 		while ((ptr = strtok(NULL, ",")) != NULL)
 			duplicate_globbing(ptr, private_dir, private_run_dir);
+		fcopy_batch_run(&copy_batch);
+		fcopy_batch_run(&copy_batch_nofollow);
+		bind_run();
+		bind_mode = 0;
 		free(dlist);
 		fs_logger_print();
 	}
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Glob expansion for blacklist, whitelist and private-bin patterns.
+//
+// Before a module starts working on the filesystem, it hands all its
+// patterns to fs_glob_prefetch(), which expands them on a few threads;
+// on cold dentry caches most of the time is spent waiting for the disk.
+// fs_glob() hands the stored result over to the caller, or runs glob() if
+// the pattern was not prefetched. Duplicate patterns are expanded only once.
+// The patterns without wildcards are looked up by fs_prefetch.c.
+//
+// The results are valid as long as the filesystem does not change. A mount
+// hiding a directory makes every result with a path in that directory stale
+// (fs_glob_hide), creating a file or directory makes every pattern matching
+// it stale (fs_glob_created). A stale pattern is expanded again on the next
+// request.
+//
+// All patterns use GLOB_NOCHECK: a pattern without a match expands to itself.
+
+#include "firejail.h"
+#include <glob.h>
+#include <fnmatch.h>
+
+#define GLOB_MAX_THREADS 4
+#define GLOB_MIN_PATTERNS 8	// no threads for fewer patterns
+
+typedef struct {
+	char *pattern;
+	char **paths;
+	size_t cnt;
+	int valid;
+} GlobEntry;
+
+static GlobEntry *table = NULL;	// open addressing
+static unsigned tsize = 0;	// power of 2
+static unsigned tcnt = 0;
+
+// all paths found by fs_glob_prefetch, sorted, for fs_glob_hide
+typedef struct {
+	char *path;
+	GlobEntry *e;
+} GlobIndex;
+
+static GlobIndex *gindex = NULL;
+static size_t gindex_cnt = 0;
+
+static int has_magic(const char *pattern) {
+	return strpbrk(pattern, "*?[") != NULL;
+}
+
+// make room for n more entries
+static void reserve(unsigned n) {
+	while ((tcnt + n) * 2 > tsize) {
+		GlobEntry *old = table;
+		unsigned oldsize = tsize;
+		tsize = (tsize) ? tsize * 2 : 256;
+		table = calloc(tsize, sizeof(GlobEntry));
+		if (!table)
+			errExit("calloc");
+
+		unsigned i;
+		for (i = 0; i < oldsize; i++) {
+			if (!old[i].pattern)
+				continue;
+			unsigned pos = fnv1a32_str(old[i].pattern) & (tsize - 1);
+			while (table[pos].pattern)
+				pos = (pos + 1) & (tsize - 1);
+			table[pos] = old[i];
+		}
+		free(old);
+	}
+}
+
+static GlobEntry *find_entry(const char *pattern, int create) {
+	if (create)
+		reserve(1);
+	if (tsize == 0)
+		return NULL;
+
+	unsigned pos = fnv1a32_str(pattern) & (tsize - 1);
+	while (table[pos].pattern) {
+		if (strcmp(table[pos].pattern, pattern) == 0)
+			return &table[pos];
+		pos = (pos + 1) & (tsize - 1);
+	}
+	if (!create)
+		return NULL;
+
+	table[pos].pattern = strdup(pattern);
+	if (!table[pos].pattern)
+		errExit("strdup");
+	tcnt++;
+	return &table[pos];
+}
+
+static void free_paths(GlobEntry *e) {
+	size_t i;
+	for (i = 0; i < e->cnt; i++)
+		free(e->paths[i]);
+	free(e->paths);
+	e->paths = NULL;
+	e->cnt = 0;
+	e->valid = 0;
+}
+
+// expand e->pattern; can run in a worker thread, touches only e
+static int expand(GlobEntry *e) {
+	glob_t globbuf;
+	int globerr = glob(e->pattern, GLOB_NOCHECK | GLOB_NOSORT | GLOB_PERIOD, NULL, &globbuf);
+	if (globerr)
+		return -1;
+
+	e->paths = malloc((globbuf.gl_pathc + 1) * sizeof(char *));
+	if (!e->paths)
+		errExit("malloc");
+	size_t i;
+	for (i = 0; i < globbuf.gl_pathc; i++) {
+		e->paths[i] = strdup(globbuf.gl_pathv[i]);
+		if (!e->paths[i])
+			errExit("strdup");
+	}
+	e->paths[i] = NULL;
+	e->cnt = globbuf.gl_pathc;
+	e->valid = 1;
+	globfree(&globbuf);
+	return 0;
+}
+
+static int index_cmp(const void *p1, const void *p2) {
+	return strcmp(((const GlobIndex *) p1)->path, ((const GlobIndex *) p2)->path);
+}
+
+static void free_index(void) {
+	size_t i;
+	for (i = 0; i < gindex_cnt; i++)
+		free(gindex[i].path);
+	free(gindex);
+	gindex = NULL;
+	gindex_cnt = 0;
+}
+
+static void build_index(void) {
+	free_index();
+
+	size_t cnt = 0;
+	unsigned i;
+	for (i = 0; i < tsize; i++)
+		if (table[i].valid)
+			cnt += table[i].cnt;
+	if (cnt == 0)
+		return;
+
+	gindex = malloc(cnt * sizeof(GlobIndex));
+	if (!gindex)
+		errExit("malloc");
+	for (i = 0; i < tsize; i++) {
+		GlobEntry *e = &table[i];
+		if (!e->valid)
+			continue;
+		size_t j;
+		for (j = 0; j < e->cnt; j++) {
+			gindex[gindex_cnt].path = strdup(e->paths[j]);
+			if (!gindex[gindex_cnt].path)
+				errExit("strdup");
+			gindex[gindex_cnt].e = e;
+			gindex_cnt++;
+		}
+	}
+	qsort(gindex, gindex_cnt, sizeof(GlobIndex), index_cmp);
+}
+
+static void expand_job(int i, void *data) {
+	GlobEntry **jobs = data;
+	// an error is reported when the pattern is requested
+	expand(jobs[i]);
+}
+
+static char **pending = NULL;	// patterns waiting for fs_glob_prefetch
+static int pending_cnt = 0;
+static int pending_max = 0;
+
+// add a pattern for the next fs_glob_prefetch call; the plain paths
+// are handed over to fs_prefetch_queue
+void fs_glob_queue(const char *pattern) {
+	assert(pattern);
+	if (!has_magic(pattern)) {
+		fs_prefetch_queue(pattern);
+		return;
+	}
+
+	if (pending_cnt == pending_max) {
+		pending_max = (pending_max) ? pending_max * 2 : 64;
+		pending = realloc(pending, pending_max * sizeof(char *));
+		if (!pending)
+			errExit("realloc");
+	}
+	pending[pending_cnt] = strdup(pattern);
+	if (!pending[pending_cnt])
+		errExit("strdup");
+	pending_cnt++;
+}
+
+// expand the queued patterns in parallel and store the results
+void fs_glob_prefetch(void) {
+	EUID_ASSERT();
+	fs_prefetch_run();
+	if (pending_cnt == 0)
+		return;
+
+	timetrace_start();
+	GlobEntry **jobs = malloc(pending_cnt * sizeof(GlobEntry *));
+	if (!jobs)
+		errExit("malloc");
+	int cnt = 0;
+
+	// the table does not move while the workers are running,
+	// all entries are created here
+	reserve(pending_cnt);
+	int i;
+	for (i = 0; i < pending_cnt; i++) {
+		unsigned before = tcnt;
+		GlobEntry *e = find_entry(pending[i], 1);
+		// new entries only, duplicates are expanded once
+		if (tcnt != before)
+			jobs[cnt++] = e;
+		free(pending[i]);
+	}
+	free(pending);
+	pending = NULL;
+	pending_cnt = 0;
+	pending_max = 0;
+
+	// no more threads than CPUs: with warm dentry caches glob() is cpu bound,
+	// and on a single CPU the context switches cost more than they save
+	int threads = 1;
+	if (cnt >= GLOB_MIN_PATTERNS) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (ncpu > GLOB_MAX_THREADS) ? GLOB_MAX_THREADS : (int) ncpu;
+	}
+	threads = run_threads(threads, cnt, expand_job, jobs);
+
+	build_index();
+	float ms = timetrace_end();
+	if (arg_debug && cnt)
+		printf("Expanded %d glob patterns on %d threads in %.02f ms\n",
+		       cnt, threads, ms);
+	free(jobs);
+}
+
+// expand pattern; the caller releases the result with fs_glob_free;
+// returns NULL if glob() fails
+char **fs_glob(const char *pattern, size_t *cnt) {
+	assert(pattern);
+	assert(cnt);
+
+	GlobEntry tmp;
+	GlobEntry *e = find_entry(pattern, 0);
+	if (!e || !e->valid) {
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.pattern = (char *) pattern;
+		e = &tmp;
+		if (expand(e))
+			return NULL;
+	}
+
+	char **rv = e->paths;
+	*cnt = e->cnt;
+	e->paths = NULL;
+	e->cnt = 0;
+	e->valid = 0;
+	return rv;
+}
+
+void fs_glob_free(char **paths) {
+	if (!paths)
+		return;
+	char **ptr;
+	for (ptr = paths; *ptr; ptr++)
+		free(*ptr);
+	free(paths);
+}
+
+// path was mounted over, stored results with paths at or below path are stale
+void fs_glob_hide(const char *path) {
+	assert(path);
+	if (gindex_cnt == 0)
+		return;
+
+	// paths starting with path are contiguous in the index
+	size_t len = strlen(path);
+	size_t lo = 0;
+	size_t hi = gindex_cnt;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(gindex[mid].path, path) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < gindex_cnt && strncmp(gindex[lo].path, path, len) == 0; lo++) {
+		char c = gindex[lo].path[len];
+		if ((c == '\0' || c == '/') && gindex[lo].e->valid)
+			free_paths(gindex[lo].e);
+	}
+}
+
+// path and possibly some of its parent directories were created
+void fs_glob_created(const char *path) {
+	assert(path);
+	if (tcnt == 0)
+		return;
+
+	char *dup = strdup(path);
+	if (!dup)
+		errExit("strdup");
+	unsigned i;
+	for (i = 0; i < tsize; i++) {
+		GlobEntry *e = &table[i];
+		if (!e->valid)
+			continue;
+
+		// check path and all its parent directories
+		char *ptr = dup + strlen(dup);
+		while (ptr > dup) {
+			char c = *ptr;
+			*ptr = '\0';
+			int rv = fnmatch(e->pattern, dup, FNM_PATHNAME);
+			*ptr = c;
+			if (rv == 0) {
+				free_paths(e);
+				break;
+			}
+			do
+				ptr--;
+			while (ptr > dup && *ptr != '/');
+		}
+	}
+	free(dup);
+}
+
+// drop all results
+void fs_glob_flush(void) {
+	free_index();
+	unsigned i;
+	for (i = 0; i < tsize; i++) {
+		if (table[i].pattern) {
+			free_paths(&table[i]);
+			free(table[i].pattern);
+		}
+	}
+	free(table);
+	table = NULL;
+	tsize = 0;
+	tcnt = 0;
+}
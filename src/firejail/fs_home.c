@@ -18,6 +18,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "firejail.h"
+#include "../include/gcov_wrapper.h"
 #include <sys/mount.h>
 #include <dirent.h>
 #include <errno.h>
@@ -26,6 +27,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <grp.h>
+#include <sys/file.h>
 //#include <ftw.h>
 
 #include <fcntl.h>
@@ -55,6 +57,90 @@ static void disable_tab_completion(const char *homedir) {
 }
 
 
+// the files restored in the new home directory (the skel file, .Xauthority
+// and .asoundrc) are opened before the home directory is masked, and copied
+// by a single process running as the user once the new home is in place
+typedef struct {
+	int fd;		// source, -1 for an empty file
+	char *dest;
+	mode_t mode;
+} HomeFile;
+
+#define HOME_FILES_MAX 4
+static HomeFile home_files[HOME_FILES_MAX];
+static int home_files_cnt = 0;
+
+static void home_file_add(int fd, const char *dest, mode_t mode) {
+	assert(home_files_cnt < HOME_FILES_MAX);
+	HomeFile *f = &home_files[home_files_cnt];
+	f->fd = fd;
+	f->dest = strdup(dest);
+	if (!f->dest)
+		errExit("strdup");
+	f->mode = mode;
+	home_files_cnt++;
+}
+
+static void home_files_copy(void) {
+	EUID_ASSERT();
+	if (home_files_cnt == 0)
+		return;
+
+	pid_t child = fork();
+	if (child < 0)
+		errExit("fork");
+	if (child == 0) {
+		// drop privileges
+		drop_privs(0);
+
+		int i;
+		for (i = 0; i < home_files_cnt; i++) {
+			HomeFile *f = &home_files[i];
+			int dst = open(f->dest, O_CREAT|O_WRONLY|O_TRUNC|O_NOFOLLOW|O_CLOEXEC, S_IRUSR | S_IWUSR);
+			if (dst < 0) {
+				fwarning("cannot open destination file %s, file not copied\n", f->dest);
+				continue;
+			}
+			if (f->fd != -1 && copy_file_by_fd(f->fd, dst))
+				fwarning("cannot copy %s\n", f->dest);
+			else if (fchmod(dst, f->mode) == -1)
+				errExit("fchmod");
+			close(dst);
+		}
+
+		__gcov_flush();
+
+		_exit(0);
+	}
+	// wait for the child to finish
+	waitpid(child, NULL, 0);
+
+	int i;
+	for (i = 0; i < home_files_cnt; i++) {
+		HomeFile *f = &home_files[i];
+		selinux_relabel_path(f->dest, f->dest);
+		if (f->fd != -1)
+			close(f->fd);
+		free(f->dest);
+	}
+	home_files_cnt = 0;
+}
+
+// open a skel file for home_files_copy()
+static void skel_add(const char *src, const char *dest) {
+	int fd = open(src, O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+	struct stat s;
+	if (fd == -1 || fstat(fd, &s) == -1 || !S_ISREG(s.st_mode)) {
+		fwarning("cannot open source file %s, file not copied\n", src);
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+	home_file_add(fd, dest, 0644);
+	fs_logger2("clone", src);
+	fs_logger2("clone", dest);
+}
+
 static void skel(const char *homedir) {
 	EUID_ASSERT();
 	char *fname;
@@ -76,15 +162,12 @@ static void skel(const char *homedir) {
 			exit(1);
 		}
 		if (access("/etc/skel/.zshrc", R_OK) == 0) {
-			copy_file_as_user("/etc/skel/.zshrc", fname, 0644); // regular user
-			fs_logger("clone /etc/skel/.zshrc");
-			fs_logger2("clone", fname);
+			skel_add("/etc/skel/.zshrc", fname);
 		}
 		else {
-			touch_file_as_user(fname, 0644);
+			home_file_add(-1, fname, 0644);
 			fs_logger2("touch", fname);
 		}
-		selinux_relabel_path(fname, fname);
 		free(fname);
 	}
 	// csh
@@ -102,15 +185,12 @@ static void skel(const char *homedir) {
 			exit(1);
 		}
 		if (access("/etc/skel/.cshrc", R_OK) == 0) {
-			copy_file_as_user("/etc/skel/.cshrc", fname, 0644); // regular user
-			fs_logger("clone /etc/skel/.cshrc");
-			fs_logger2("clone", fname);
+			skel_add("/etc/skel/.cshrc", fname);
 		}
 		else {
-			touch_file_as_user(fname, 0644);
+			home_file_add(-1, fname, 0644);
 			fs_logger2("touch", fname);
 		}
-		selinux_relabel_path(fname, fname);
 		free(fname);
 	}
 	// bash etc.
@@ -128,51 +208,41 @@ static void skel(const char *homedir) {
 			exit(1);
 		}
 		if (access("/etc/skel/.bashrc", R_OK) == 0) {
-			copy_file_as_user("/etc/skel/.bashrc", fname, 0644); // regular user
-			fs_logger("clone /etc/skel/.bashrc");
-			fs_logger2("clone", fname);
+			skel_add("/etc/skel/.bashrc", fname);
 		}
-		selinux_relabel_path(fname, fname);
 		free(fname);
 	}
 }
 
+// .Xauthority and .asoundrc are kept open until they are copied in the new
+// home directory
+static int xauthority_fd = -1;
+static int asoundrc_fd = -1;
+
 static int store_xauthority(void) {
 	EUID_ASSERT();
 	if (arg_x11_block)
 		return 0;
 
-	// put a copy of .Xauthority in XAUTHORITY_FILE
-	char *dest = RUN_XAUTHORITY_FILE;
 	char *src;
 	if (asprintf(&src, "%s/.Xauthority", cfg.homedir) == -1)
 		errExit("asprintf");
 
 	struct stat s;
 	if (lstat(src, &s) == 0) {
-		if (S_ISLNK(s.st_mode)) {
+		int fd = -1;
+		if (S_ISLNK(s.st_mode) ||
+		    (fd = open(src, O_RDONLY|O_NONBLOCK|O_NOFOLLOW|O_CLOEXEC)) == -1 ||
+		    fstat(fd, &s) == -1 || !S_ISREG(s.st_mode)) {
 			fwarning("invalid .Xauthority file\n");
+			if (fd != -1)
+				close(fd);
 			free(src);
 			return 0;
 		}
-
-		// create an empty file as root, and change ownership to user
-		EUID_ROOT();
-		FILE *fp = fopen(dest, "we");
-		if (fp) {
-			fprintf(fp, "\n");
-			SET_PERMS_STREAM(fp, getuid(), getgid(), 0600);
-			fclose(fp);
-		}
-		else
-			errExit("fopen");
-		EUID_USER();
-
-		copy_file_as_user(src, dest, 0600); // regular user
-		selinux_relabel_path(dest, src);
-		fs_logger2("clone", dest);
+		xauthority_fd = fd;
 		free(src);
-		return 1; // file copied
+		return 1; // file stored
 	}
 
 	free(src);
@@ -184,8 +254,6 @@ static int store_asoundrc(void) {
 	if (arg_nosound)
 		return 0;
 
-	// put a copy of .asoundrc in ASOUNDRC_FILE
-	char *dest = RUN_ASOUNDRC_FILE;
 	char *src;
 	if (asprintf(&src, "%s/.asoundrc", cfg.homedir) == -1)
 		errExit("asprintf");
@@ -198,23 +266,18 @@ static int store_asoundrc(void) {
 			return 0;
 		}
 
-		// create an empty file as root, and change ownership to user
-		EUID_ROOT();
-		FILE *fp = fopen(dest, "we");
-		if (fp) {
-			fprintf(fp, "\n");
-			SET_PERMS_STREAM(fp, getuid(), getgid(), 0644);
-			fclose(fp);
+		// same checks on the file actually opened
+		int fd = open(src, O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+		if (fd == -1 || fstat(fd, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != getuid()) {
+			fwarning("invalid .asoundrc file, skipping...\n");
+			if (fd != -1)
+				close(fd);
+			free(src);
+			return 0;
 		}
-		else
-			errExit("fopen");
-		EUID_USER();
-
-		copy_file_as_user(src, dest, 0644); // regular user
-		fs_logger2("clone", dest);
-		selinux_relabel_path(dest, src);
+		asoundrc_fd = fd;
 		free(src);
-		return 1; // file copied
+		return 1; // file stored
 	}
 
 	free(src);
@@ -223,8 +286,7 @@ static int store_asoundrc(void) {
 
 static void copy_xauthority(void) {
 	EUID_ASSERT();
-	// copy XAUTHORITY_FILE in the new home directory
-	char *src = RUN_XAUTHORITY_FILE ;
+	assert(xauthority_fd != -1);
 	char *dest;
 	if (asprintf(&dest, "%s/.Xauthority", cfg.homedir) == -1)
 		errExit("asprintf");
@@ -235,20 +297,15 @@ static void copy_xauthority(void) {
 		exit(1);
 	}
 
-	copy_file_as_user(src, dest, S_IRUSR | S_IWUSR); // regular user
+	home_file_add(xauthority_fd, dest, S_IRUSR | S_IWUSR);
+	xauthority_fd = -1;
 	fs_logger2("clone", dest);
-	selinux_relabel_path(dest, dest);
 	free(dest);
-
-	EUID_ROOT();
-	unlink(src); // delete the temporary file
-	EUID_USER();
 }
 
 static void copy_asoundrc(void) {
 	EUID_ASSERT();
-	// copy ASOUNDRC_FILE in the new home directory
-	char *src = RUN_ASOUNDRC_FILE ;
+	assert(asoundrc_fd != -1);
 	char *dest;
 	if (asprintf(&dest, "%s/.asoundrc", cfg.homedir) == -1)
 		errExit("asprintf");
@@ -259,14 +316,10 @@ static void copy_asoundrc(void) {
 		exit(1);
 	}
 
-	copy_file_as_user(src, dest, S_IRUSR | S_IWUSR); // regular user
+	home_file_add(asoundrc_fd, dest, S_IRUSR | S_IWUSR);
+	asoundrc_fd = -1;
 	fs_logger2("clone", dest);
-	selinux_relabel_path(dest, dest);
 	free(dest);
-
-	EUID_ROOT();
-	unlink(src); // delete the temporary file
-	EUID_USER();
 }
 
 // private mode (--private=homedir):
@@ -364,6 +417,7 @@ void fs_private_homedir(void) {
 		copy_xauthority();
 	if (aflag)
 		copy_asoundrc();
+	home_files_copy();
 }
 
 // private mode (--private):
@@ -434,6 +488,7 @@ void fs_private(void) {
 		copy_xauthority();
 	if (aflag)
 		copy_asoundrc();
+	home_files_copy();
 }
 
 // check new private home directory (--private= option) - exit if it fails
@@ -547,6 +602,10 @@ errexit:
 	exit(1);
 }
 
+// all the files are copied in a single fcopy run, in copy_dest
+static FcopyBatch copy_batch;
+static const char *copy_dest = RUN_HOME_DIR;
+
 static void duplicate(char *name) {
 	EUID_ASSERT();
 	char *fname = check_dir_or_file(name);
@@ -565,20 +624,86 @@ static void duplicate(char *name) {
 		char *path;
 		char *ptr = strrchr(fname, '/');
 		ptr++;
-		if (asprintf(&path, "%s/%s", RUN_HOME_DIR, ptr) == -1)
+		if (asprintf(&path, "%s/%s", copy_dest, ptr) == -1)
 			errExit("asprintf");
 		create_empty_dir_as_user(path, 0755);
-		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FCOPY, fname, path);
+		fcopy_batch_add(&copy_batch, fname, path);
 		free(path);
 	}
 	else
-		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FCOPY, fname, RUN_HOME_DIR);
+		fcopy_batch_add(&copy_batch, fname, copy_dest);
 	fs_logger2("clone", fname);
 	fs_logger_print();	// save the current log
 
 	free(fname);
 }
 
+// add the files and directories of the private-home list to the batch
+static void duplicate_list(void) {
+	if (arg_debug)
+		printf("Copying files in %s:\n", copy_dest);
+	char *dlist = strdup(cfg.home_private_keep);
+	if (!dlist)
+		errExit("strdup");
+
+	char *ptr = strtok(dlist, ",");
+	if (!ptr) {
+		fprintf(stderr, "Error: invalid private-home argument\n");
+		exit(1);
+	}
+	duplicate(ptr);
+	while ((ptr = strtok(NULL, ",")) != NULL)
+		duplicate(ptr);
+	free(dlist);
+}
+
+// copy a regular file owned by the user from the home directory in the same
+// fcopy run as the private-home list
+// return 0 if the file has to be copied the usual way
+static int duplicate_home_file(const char *name) {
+	EUID_ASSERT();
+	char *fname;
+	if (asprintf(&fname, "%s/%s", cfg.homedir, name) == -1)
+		errExit("asprintf");
+
+	struct stat s;
+	if (lstat(fname, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != getuid()) {
+		free(fname);
+		return 0;
+	}
+	if (arg_debug)
+		printf("Private home: duplicating %s\n", fname);
+	fcopy_batch_add(&copy_batch, fname, RUN_HOME_DIR);
+	fs_logger2("clone", fname);
+	free(fname);
+	return 1;
+}
+
+// tmpfs on top of /root in nonroot mode, tmpfs on top of /home in root mode
+static void mask_root_home(uid_t uid) {
+	EUID_ASSERT();
+	EUID_ROOT();
+	if (uid != 0) {
+		// mask /root
+		if (arg_debug)
+			printf("Mounting a new /root directory\n");
+		if (mount("tmpfs", "/root", "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=700,gid=0") < 0)
+			errExit("mounting /root directory");
+		selinux_relabel_path("/root", "/root");
+		fs_logger("tmpfs /root");
+	}
+	if (uid == 0 && !arg_allusers) {
+		// mask /home
+		if (arg_debug)
+			printf("Mounting a new /home directory\n");
+		if (mount("tmpfs", "/home", "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
+			errExit("mounting /home directory");
+		selinux_relabel_path("/home", "/home");
+		fs_logger("tmpfs /home");
+	}
+	EUID_USER();
+}
+
 // private mode (--private-home=list):
 // 	mount homedir on top of /home/user,
 // 	tmpfs on top of  /root in nonroot mode,
@@ -597,9 +722,6 @@ void fs_private_home_list(void) {
 	uid_t uid = getuid();
 	gid_t gid = getgid();
 
-	int xflag = store_xauthority();
-	int aflag = store_asoundrc();
-
 	EUID_ROOT();
 	// create /run/firejail/mnt/home directory
 	mkdir_attr(RUN_HOME_DIR, 0755, uid, gid);
@@ -610,23 +732,32 @@ void fs_private_home_list(void) {
 	EUID_USER();
 
 	// copy the list of files in the new home directory
-	if (arg_debug)
-		printf("Copying files in the new home:\n");
-	char *dlist = strdup(cfg.home_private_keep);
-	if (!dlist)
-		errExit("strdup");
-
-	char *ptr = strtok(dlist, ",");
-	if (!ptr) {
-		fprintf(stderr, "Error: invalid private-home argument\n");
-		exit(1);
+	fcopy_batch_init(&copy_batch, SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 0);
+	copy_dest = RUN_HOME_DIR;
+	duplicate_list();
+
+	// .Xauthority and .asoundrc go in the same run, unless they need the checks
+	// done when they are stored
+	int xflag = 0;
+	if (!arg_x11_block && !duplicate_home_file(".Xauthority"))
+		xflag = store_xauthority();
+	int abatch = 0;
+	int aflag = 0;
+	if (!arg_nosound && !(abatch = duplicate_home_file(".asoundrc")))
+		aflag = store_asoundrc();
+	fcopy_batch_run(&copy_batch);
+
+	if (abatch) {
+		// same permissions as copy_asoundrc()
+		int afd = open(RUN_HOME_DIR "/.asoundrc", O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+		if (afd != -1) {
+			if (fchmod(afd, S_IRUSR | S_IWUSR) == -1)
+				errExit("fchmod");
+			close(afd);
+		}
 	}
-	duplicate(ptr);
-	while ((ptr = strtok(NULL, ",")) != NULL)
-		duplicate(ptr);
 
 	fs_logger_print();	// save the current log
-	free(dlist);
 
 	if (arg_debug)
 		printf("Mount-bind %s on top of %s\n", RUN_HOME_DIR, homedir);
@@ -656,28 +787,196 @@ void fs_private_home_list(void) {
 		errLogExit("invalid private-home mount");
 	fs_logger2("tmpfs", homedir);
 
+	mask_root_home(uid);
+
 	EUID_ROOT();
-	if (uid != 0) {
-		// mask /root
-		if (arg_debug)
-			printf("Mounting a new /root directory\n");
-		if (mount("tmpfs", "/root", "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=700,gid=0") < 0)
-			errExit("mounting /root directory");
-		selinux_relabel_path("/root", "/root");
-		fs_logger("tmpfs /root");
+	// mask RUN_HOME_DIR, it is writable and not noexec
+	if (mount("tmpfs", RUN_HOME_DIR, "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
+		errExit("mounting tmpfs");
+	EUID_USER();
+
+	if (!arg_keep_shell_rc)
+		skel(homedir);
+	if (xflag)
+		copy_xauthority();
+	if (aflag)
+		copy_asoundrc();
+	home_files_copy();
+
+	if (!arg_quiet)
+		fprintf(stderr, "Home directory installed in %0.2f ms\n", timetrace_end());
+}
+
+// the snapshot is complete when the private-home list used to build it is
+// stored next to it
+// return 1 if the snapshot is ready, 0 if it has to be built
+static int snapshot_ready(int dirfd, const char *name) {
+	EUID_ASSERT();
+	char *fname;
+	if (asprintf(&fname, "%s.list", name) == -1)
+		errExit("asprintf");
+	int fd = openat(dirfd, fname, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+	free(fname);
+	if (fd == -1)
+		return 0;
+
+	FILE *fp = fdopen(fd, "r");
+	if (!fp)
+		errExit("fdopen");
+	char *list = NULL;
+	size_t len = 0;
+	ssize_t rv = getdelim(&list, &len, '\0', fp);
+	fclose(fp);
+	if (rv == -1 || strcmp(list, cfg.home_private_keep) != 0) {
+		fprintf(stderr, "Error: home snapshot %s was built from a different private-home list\n", name);
+		exit(1);
 	}
-	if (uid == 0 && !arg_allusers) {
-		// mask /home
-		if (arg_debug)
-			printf("Mounting a new /home directory\n");
-		if (mount("tmpfs", "/home", "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
-			errExit("mounting /home directory");
-		selinux_relabel_path("/home", "/home");
-		fs_logger("tmpfs /home");
+	free(list);
+	return 1;
+}
+
+static void snapshot_build(int dirfd, const char *dirname, const char *name) {
+	EUID_ASSERT();
+	char *path;
+	if (asprintf(&path, "%s/%s", dirname, name) == -1)
+		errExit("asprintf");
+	if (arg_debug)
+		printf("Building home snapshot %s\n", path);
+
+	// a directory left by a failed build is completed, fcopy skips the
+	// files already there
+	if (mkdirat(dirfd, name, 0755) == -1 && errno != EEXIST)
+		errExit("mkdir");
+	copy_dest = path;
+	fcopy_batch_init(&copy_batch, SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 0);
+	duplicate_list();
+	fcopy_batch_run(&copy_batch);
+	copy_dest = RUN_HOME_DIR;
+
+	char *fname;
+	if (asprintf(&fname, "%s.list", name) == -1)
+		errExit("asprintf");
+	int fd = openat(dirfd, fname, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC, 0644);
+	if (fd == -1)
+		errExit("open");
+	size_t len = strlen(cfg.home_private_keep) + 1;
+	if (write(fd, cfg.home_private_keep, len) != (ssize_t) len)
+		errExit("write");
+	close(fd);
+	free(fname);
+	free(path);
+}
+
+// private home snapshot (--private-home=list --private-home-snapshot=name):
+// 	copy the list once in RUN_FIREJAIL_SNAPSHOT_DIR/<uid>/<name>,
+// 	mount an overlayfs on top of /home/user, the snapshot is the lower
+// 	directory and the upper directory is in a tmpfs,
+// 	tmpfs on top of  /root in nonroot mode,
+// 	set skel files,
+// 	restore .Xauthority
+void fs_private_home_snapshot(void) {
+	char *homedir = cfg.homedir;
+	const char *name = cfg.home_snapshot;
+	assert(homedir);
+	assert(name);
+	assert(cfg.home_private_keep);
+	EUID_ASSERT();
+
+	timetrace_start();
+
+	uid_t uid = getuid();
+	gid_t gid = getgid();
+
+	int xflag = store_xauthority();
+	int aflag = store_asoundrc();
+
+	// save the current log
+	EUID_ROOT();
+	fs_logger_print();
+	EUID_USER();
+
+	// the snapshots of the user are in a directory owned by the user
+	char *dirname;
+	if (asprintf(&dirname, "%s/%u", RUN_FIREJAIL_SNAPSHOT_DIR, uid) == -1)
+		errExit("asprintf");
+	struct stat s;
+	if (lstat(dirname, &s) == -1) {
+		EUID_ROOT();
+		mkdir_attr(dirname, 0700, uid, gid);
+		EUID_USER();
+	}
+	int dirfd = open(dirname, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+	if (dirfd == -1 || fstat(dirfd, &s) == -1 || s.st_uid != uid) {
+		fprintf(stderr, "Error: invalid %s directory\n", dirname);
+		exit(1);
 	}
 
-	// mask RUN_HOME_DIR, it is writable and not noexec
-	if (mount("tmpfs", RUN_HOME_DIR, "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
+	// the sandboxes using the snapshot wait for the first one to build it
+	if (flock(dirfd, LOCK_EX) == -1)
+		errExit("flock");
+	if (!snapshot_ready(dirfd, name))
+		snapshot_build(dirfd, dirname, name);
+	fs_logger_print();	// save the current log
+
+	int lowerfd = openat(dirfd, name, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+	if (lowerfd == -1 || fstat(lowerfd, &s) == -1 || s.st_uid != uid) {
+		fprintf(stderr, "Error: invalid home snapshot %s\n", name);
+		exit(1);
+	}
+
+	int fd = safer_openat(-1, homedir, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+	if (fd == -1)
+		errExit("opening home directory");
+	// home directory should be owned by the user
+	if (fstat(fd, &s) == -1)
+		errExit("fstat");
+	if (s.st_uid != uid) {
+		fprintf(stderr, "Error: cannot mount private directory:\n"
+			"Home directory is not owned by the current user\n");
+		exit(1);
+	}
+
+	// upper and work directories in a tmpfs
+	EUID_ROOT();
+	mkdir_attr(RUN_HOME_UPPER_DIR, 0755, 0, 0);
+	if (mount("tmpfs", RUN_HOME_UPPER_DIR, "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
+		errExit("mounting tmpfs");
+	mkdir_attr(RUN_HOME_UPPER_DIR "/upper", 0755, uid, gid);
+	selinux_relabel_path(RUN_HOME_UPPER_DIR "/upper", homedir);
+	mkdir_attr(RUN_HOME_UPPER_DIR "/work", 0700, 0, 0);
+
+	if (arg_debug)
+		printf("Mounting home snapshot %s/%s on top of %s\n", dirname, name, homedir);
+	char *options;
+	if (asprintf(&options, "lowerdir=/proc/self/fd/%d,upperdir=%s,workdir=%s",
+		     lowerfd, RUN_HOME_UPPER_DIR "/upper", RUN_HOME_UPPER_DIR "/work") == -1)
+		errExit("asprintf");
+	char *proc;
+	if (asprintf(&proc, "/proc/self/fd/%d", fd) == -1)
+		errExit("asprintf");
+	if (mount("overlay", proc, "overlay", MS_NOSUID | MS_NODEV, options) < 0) {
+		fprintf(stderr, "Error: cannot mount home snapshot %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+	free(proc);
+	free(options);
+	EUID_USER();
+	close(fd);
+	close(lowerfd);
+	close(dirfd);	// this also releases the lock
+	free(dirname);
+
+	// check /proc/self/mountinfo to confirm the mount is ok
+	MountData *mptr = get_last_mount();
+	if (strcmp(mptr->dir, homedir) != 0 || strcmp(mptr->fstype, "overlay") != 0)
+		errLogExit("invalid private-home-snapshot mount");
+	fs_logger2("overlay", homedir);
+
+	mask_root_home(uid);
+
+	EUID_ROOT();
+	// mask RUN_HOME_UPPER_DIR, the overlayfs keeps using it
+	if (mount("tmpfs", RUN_HOME_UPPER_DIR, "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
 		errExit("mounting tmpfs");
 	EUID_USER();
 
@@ -687,6 +986,7 @@ void fs_private_home_list(void) {
 		copy_xauthority();
 	if (aflag)
 		copy_asoundrc();
+	home_files_copy();
 
 	if (!arg_quiet)
 		fprintf(stderr, "Home directory installed in %0.2f ms\n", timetrace_end());
@@ -23,6 +23,154 @@
 #include <glob.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <errno.h>
+
+// A sandbox started with --hostname gets a copy of /etc/hosts (or of the
+// --hosts-file) with the 127.0.0.1 line replaced. The generated file is kept
+// in RUN_FIREJAIL_HOSTS_CACHE_DIR (root only) and the next sandbox with the
+// same hostname bind-mounts it directly instead of copying and rewriting the
+// source again. The key has the user id, the hostname, and the path, inode,
+// size, mtime and ctime of the source. The content always comes from a copy
+// made with the privileges of the user, an entry is never shared between
+// users. Random hostnames are not cached.
+//
+// For every entry <hash>.hosts is the file mounted on /etc/hosts, and
+// <hash>.key is the key, an empty line and the inode and size of
+// <hash>.hosts; the key file is written last.
+#define HOSTS_CACHE_MAX_ENTRIES 16
+
+static int cache_fd = -1;
+static char *cache_key = NULL;
+static uint64_t cache_hash = 0;
+static int cached_hosts_fd = -1;
+static off_t cache_src_size = 0;
+
+static char *build_key(const char *src) {
+	struct stat s;
+	if (stat(src, &s) == -1 || !S_ISREG(s.st_mode))
+		return NULL;
+
+	char *k;
+	if (asprintf(&k, "version %s\nuid %u\nhostname %s\nsource %s\n"
+		     "file %llu %llu %lld %lld.%09ld %lld.%09ld\n",
+		     VERSION, (unsigned) getuid(), cfg.hostname, src,
+		     (unsigned long long) s.st_dev, (unsigned long long) s.st_ino,
+		     (long long) s.st_size,
+		     (long long) s.st_mtim.tv_sec, s.st_mtim.tv_nsec,
+		     (long long) s.st_ctim.tv_sec, s.st_ctim.tv_nsec) == -1)
+		errExit("asprintf");
+	cache_src_size = s.st_size;
+	return k;
+}
+
+// open the hosts file of a matching entry, -1 if none
+static int cache_lookup(void) {
+	char fname[64];
+	snprintf(fname, sizeof(fname), "%016llx.key", (unsigned long long) cache_hash);
+	FILE *fp = run_cache_load(cache_fd, fname, cache_key);
+	if (!fp)
+		return -1;
+
+	int rv = -1;
+	unsigned long long ino;
+	long long size;
+	if (fscanf(fp, "hosts %llu %lld\n", &ino, &size) != 2)
+		goto out;
+
+	snprintf(fname, sizeof(fname), "%016llx.hosts", (unsigned long long) cache_hash);
+	rv = openat(cache_fd, fname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	struct stat s;
+	if (rv != -1 && (fstat(rv, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != 0 ||
+	    (unsigned long long) s.st_ino != ino || (long long) s.st_size != size)) {
+		close(rv);
+		rv = -1;
+	}
+
+out:
+	fclose(fp);
+	return rv;
+}
+
+// store the generated RUN_HOSTS_FILE; errors are not fatal
+static void cache_store(void) {
+	int cnt = run_cache_count(cache_fd, "key");
+	if (cnt < 0 || cnt >= HOSTS_CACHE_MAX_ENTRIES) {
+		if (arg_debug)
+			printf("Hosts cache full, /etc/hosts not stored\n");
+		return;
+	}
+
+	char fname[64];
+	snprintf(fname, sizeof(fname), "%016llx.hosts", (unsigned long long) cache_hash);
+	FILE *fp = run_cache_create(cache_fd, fname, NULL);
+	if (!fp)
+		goto errout;
+	int fdin = open(RUN_HOSTS_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	int rv = -1;
+	struct stat s;
+	if (fdin != -1) {
+		rv = copy_file_by_fd(fdin, fileno(fp));
+		close(fdin);
+	}
+	if (rv == 0 && (fchmod(fileno(fp), 0644) == -1 || fstat(fileno(fp), &s) == -1))
+		rv = -1;
+	if (rv) {
+		run_cache_abort(cache_fd, fname, fp);
+		goto errout;
+	}
+	if (run_cache_commit(cache_fd, fname, fp))
+		goto errout;
+
+	snprintf(fname, sizeof(fname), "%016llx.key", (unsigned long long) cache_hash);
+	fp = run_cache_create(cache_fd, fname, cache_key);
+	if (!fp)
+		goto errout;
+	fprintf(fp, "hosts %llu %lld\n", (unsigned long long) s.st_ino, (long long) s.st_size);
+	if (run_cache_commit(cache_fd, fname, fp))
+		goto errout;
+
+	if (arg_debug)
+		printf("/etc/hosts stored in cache (%016llx)\n", (unsigned long long) cache_hash);
+	return;
+
+errout:
+	if (arg_debug)
+		printf("Cannot store /etc/hosts in cache: %s\n", strerror(errno));
+}
+
+static void cache_close(void) {
+	run_cache_close(&cache_fd);
+	free(cache_key);
+	cache_key = NULL;
+	if (cached_hosts_fd != -1)
+		close(cached_hosts_fd);
+	cached_hosts_fd = -1;
+}
+
+// called before the filesystem is modified; on a hit the hosts file is
+// not copied
+static int cache_open(const char *src) {
+	if (!cfg.hostname || !checkcfg(CFG_HOSTS_CACHE))
+		return 0;
+
+	cache_fd = run_cache_open(RUN_FIREJAIL_HOSTS_CACHE_DIR, "hosts");
+	if (cache_fd == -1)
+		return 0;
+
+	cache_key = build_key(src);
+	if (!cache_key) {
+		cache_close();
+		return 0;
+	}
+	cache_hash = fnv1a64_str(cache_key);
+	cached_hosts_fd = cache_lookup();
+	if (cached_hosts_fd == -1)
+		return 0;
+
+	if (arg_debug)
+		printf("/etc/hosts loaded from cache (%016llx)\n", (unsigned long long) cache_hash);
+	return 1;
+}
 
 // build a random host name
 static char *random_hostname(void) {
@@ -76,8 +224,13 @@ void fs_hostname(void) {
 		fs_logger("create /etc/hostname");
 	}
 
+	// the hosts file generated by a previous sandbox
+	if (cached_hosts_fd != -1) {
+		fs_mount_hosts_file();
+		cache_close();
+	}
 	// create a new /etc/hosts
-	if (stat(RUN_HOSTS_FILE2, &s) == 0) {
+	else if (stat(RUN_HOSTS_FILE2, &s) == 0) {
 		if (arg_debug)
 			printf("Creating a new /etc/hosts file\n");
 		// copy /etc/host into our new file, and modify it on the fly
@@ -115,7 +268,11 @@ void fs_hostname(void) {
 
 		// bind-mount the file on top of /etc/hostname
 		fs_mount_hosts_file();
+		// a partial copy of the source is not stored
+		if (cache_fd != -1 && cache_key && s.st_size == cache_src_size)
+			cache_store();
 	}
+	cache_close();
 	return;
 
 errexit:
@@ -139,10 +296,10 @@ errexit:
 }
 
 void fs_store_hosts_file(void) {
-	if (cfg.hosts_file)
-		copy_file_from_user_to_root(cfg.hosts_file, RUN_HOSTS_FILE2, 0, 0, 0644); // root needed
-	else
-		copy_file_from_user_to_root("/etc/hosts", RUN_HOSTS_FILE2, 0, 0, 0644); // root needed
+	const char *src = (cfg.hosts_file) ? cfg.hosts_file : "/etc/hosts";
+	if (cache_open(src))
+		return;
+	copy_file_from_user_to_root(src, RUN_HOSTS_FILE2, 0, 0, 0644); // root needed
 }
 
 void fs_mount_hosts_file(void) {
@@ -158,7 +315,11 @@ void fs_mount_hosts_file(void) {
 		goto errexit;
 
 	// bind-mount the file on top of /etc/hostname
-	if (mount(RUN_HOSTS_FILE, "/etc/hosts", NULL, MS_BIND|MS_REC, NULL) < 0)
+	if (cached_hosts_fd != -1) {
+		if (bind_mount_fd_to_path(cached_hosts_fd, "/etc/hosts") < 0)
+			errExit("mount bind /etc/hosts");
+	}
+	else if (mount(RUN_HOSTS_FILE, "/etc/hosts", NULL, MS_BIND|MS_REC, NULL) < 0)
 		errExit("mount bind /etc/hosts");
 	fs_logger("create /etc/hosts");
 	return;
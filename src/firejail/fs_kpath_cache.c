@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+
+// The /proc and /sys files blacklisted in every sandbox are the same on
+// every launch, and most of them do not exist on a given kernel. Whether a
+// path exists is stored in RUN_FIREJAIL_KPATH_CACHE_DIR (root only), keyed
+// by the boot id and by the set of modules in /sys/module; a module loaded
+// after the cache was created invalidates it, the next sandbox probes all
+// the paths again.
+//
+// File format: the key, an empty line, and "0 path" or "1 path" lines.
+#define KPATH_CACHE_FILE "kpath.list"
+#define MAXBUF 4096
+
+typedef struct {
+	char *path;
+	int exists;
+} KPath;
+
+static KPath *known = NULL;
+static size_t known_cnt = 0;
+static size_t known_max = 0;
+static int dirty = 0;
+static char *key = NULL;
+static int cache_fd = -1;
+
+static void known_add(const char *path, int exists) {
+	if (known_cnt == known_max) {
+		known_max = (known_max) ? known_max * 2 : 32;
+		known = realloc(known, known_max * sizeof(KPath));
+		if (!known)
+			errExit("realloc");
+	}
+	known[known_cnt].path = strdup(path);
+	if (!known[known_cnt].path)
+		errExit("strdup");
+	known[known_cnt].exists = exists;
+	known_cnt++;
+}
+
+static void known_free(void) {
+	size_t i;
+	for (i = 0; i < known_cnt; i++)
+		free(known[i].path);
+	free(known);
+	known = NULL;
+	known_cnt = 0;
+	known_max = 0;
+}
+
+static char *build_key(void) {
+	char boot_id[64] = "";
+	FILE *fp = fopen("/proc/sys/kernel/random/boot_id", "re");
+	if (!fp)
+		return NULL;
+	char *rv = fgets(boot_id, sizeof(boot_id), fp);
+	fclose(fp);
+	if (!rv || !strchr(boot_id, '\n'))
+		return NULL;
+
+	// the module names, not only their number: a module unloaded and
+	// another one loaded keep the count; the sum of the hashes does not
+	// depend on the directory order
+	DIR *dir = opendir("/sys/module");
+	if (!dir)
+		return NULL;
+	unsigned long cnt = 0;
+	uint64_t sum = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		cnt++;
+		sum += fnv1a64_str(entry->d_name);
+	}
+	closedir(dir);
+
+	char *k;
+	if (asprintf(&k, "version %s\nboot_id %smodules %lu %016llx\n",
+		     VERSION, boot_id, cnt, (unsigned long long) sum) == -1)
+		errExit("asprintf");
+	return k;
+}
+
+static void cache_load(void) {
+	FILE *fp = run_cache_load(cache_fd, KPATH_CACHE_FILE, key);
+	if (!fp)
+		return;
+
+	char line[MAXBUF];
+	while (fgets(line, sizeof(line), fp)) {
+		char *ptr = strchr(line, '\n');
+		if (!ptr || (line[0] != '0' && line[0] != '1') || line[1] != ' ' ||
+		    (strncmp(line + 2, "/proc/", 6) != 0 && strncmp(line + 2, "/sys/", 5) != 0)) {
+			known_free();
+			goto out;
+		}
+		*ptr = '\0';
+		known_add(line + 2, line[0] == '1');
+	}
+	if (arg_debug)
+		printf("/proc and /sys paths loaded from cache\n");
+
+out:
+	fclose(fp);
+}
+
+// errors are not fatal
+static void cache_store(void) {
+	FILE *fp = run_cache_create(cache_fd, KPATH_CACHE_FILE, key);
+	if (!fp)
+		goto errout;
+
+	size_t i;
+	for (i = 0; i < known_cnt; i++)
+		fprintf(fp, "%d %s\n", known[i].exists, known[i].path);
+	if (run_cache_commit(cache_fd, KPATH_CACHE_FILE, fp))
+		goto errout;
+
+	if (arg_debug)
+		printf("/proc and /sys paths stored in cache\n");
+	return;
+
+errout:
+	if (arg_debug)
+		printf("Cannot store /proc and /sys paths in cache\n");
+}
+
+// open the cache directory before the filesystem is modified
+void kpath_cache_open(void) {
+	if (cache_fd != -1)
+		return;
+	if (!checkcfg(CFG_KPATH_CACHE))
+		return;
+
+	cache_fd = run_cache_open(RUN_FIREJAIL_KPATH_CACHE_DIR, "/proc and /sys paths");
+	if (cache_fd == -1)
+		return;
+
+	key = build_key();
+	if (key)
+		cache_load();
+}
+
+// return 0 if the path does not exist; for a path that cannot be checked,
+// or outside /proc and /sys, 1 is returned and the caller does the work
+int kpath_exists(const char *path) {
+	assert(path);
+	if (strncmp(path, "/proc/", 6) != 0 && strncmp(path, "/sys/", 5) != 0)
+		return 1;
+
+	size_t i;
+	for (i = 0; i < known_cnt; i++) {
+		if (strcmp(known[i].path, path) == 0)
+			return known[i].exists;
+	}
+
+	struct stat s;
+	int exists = (stat(path, &s) == 0 || (errno != ENOENT && errno != ENOTDIR));
+	known_add(path, exists);
+	dirty = 1;
+	return exists;
+}
+
+void kpath_cache_close(void) {
+	if (cache_fd != -1 && key && dirty)
+		cache_store();
+	run_cache_close(&cache_fd);
+	free(key);
+	key = NULL;
+	known_free();
+	dirty = 0;
+}
@@ -66,6 +66,11 @@ char *find_in_path(const char *program) {
 		errExit("strdup");
 	char *tok = strtok(dup, ":");
 	while (tok) {
+		if (!path_cache_lookup(tok, program)) {
+			tok = strtok(NULL, ":");
+			continue;
+		}
+
 		char *fname;
 		if (asprintf(&fname, "%s/%s", tok, program) == -1)
 			errExit("asprintf");
@@ -223,15 +228,18 @@ void fslib_mount_libs(const char *full_path, unsigned user) {
 	if (user && chown(RUN_LIB_FILE, getuid(), getgid()))
 		errExit("chown");
 
-	// run fldd to extract the list of files
-	if (arg_debug || arg_debug_private_lib)
-		printf("    running fldd %s as %s\n", full_path, user ? "user" : "root");
+	// run fldd to extract the list of files, unless it is already in the cache
 	unsigned mask;
 	if (user)
 		mask = SBOX_USER;
 	else
 		mask = SBOX_ROOT;
-	sbox_run(mask | SBOX_SECCOMP | SBOX_CAPS_NONE, 3, PATH_FLDD, full_path, RUN_LIB_FILE);
+	if (!fslib_cache_fetch(full_path, user, RUN_LIB_FILE)) {
+		if (arg_debug || arg_debug_private_lib)
+			printf("    running fldd %s as %s\n", full_path, user ? "user" : "root");
+		sbox_run(mask | SBOX_SECCOMP | SBOX_CAPS_NONE, 3, PATH_FLDD, full_path, RUN_LIB_FILE);
+		fslib_cache_store(full_path, user, RUN_LIB_FILE);
+	}
 
 	// open the list of libraries and install them on by one
 	FILE *fp = fopen(RUN_LIB_FILE, "re");
@@ -165,10 +165,6 @@ void fslib_install_firejail(void) {
 	if (any_dhcp())
 		fslib_mount_libs(RUN_MNT_DIR "/dhclient", 1); // parse as user
 
-	// bring in xauth libraries
-	if (arg_x11_xorg)
-		fslib_mount_libs("/usr/bin/xauth", 1); // parse as user
-
 	fmessage("Firejail libraries installed in %0.2f ms\n", timetrace_end());
 }
 
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Cache of the library lists extracted by fldd for --private-lib.
+//
+// Every entry is a single file <hash>.list in RUN_FIREJAIL_FLDD_CACHE_DIR
+// (root only): the specification of the fldd run, an empty line, and the
+// libraries found by fldd, one per line, followed by their inode, mtime
+// and size. The specification covers the program (path, inode, mtime, size),
+// the user running fldd, the fldd executable and the default library
+// directories, so installing or removing a library invalidates the entry.
+// On a hit every library is checked again; a library replaced by a package
+// update is a plain cache miss.
+//
+// Only regular files are cached; fldd walking a directory runs every time.
+
+#include "firejail.h"
+#include "../include/ldd_utils.h"
+#include <sys/stat.h>
+
+#ifdef HAVE_PRIVATE_LIB
+#define FLDD_CACHE_MAX_ENTRIES 1024
+#define MAXBUF 4096
+
+static int cache_fd = -1;
+
+// open the cache directory before the filesystem is modified
+void fslib_cache_open(void) {
+	if (cache_fd != -1)
+		return;
+	if (!checkcfg(CFG_PRIVATE_LIB_CACHE))
+		return;
+	cache_fd = run_cache_open(RUN_FIREJAIL_FLDD_CACHE_DIR, "fldd");
+}
+
+void fslib_cache_close(void) {
+	run_cache_close(&cache_fd);
+}
+
+static char *build_spec(const char *full_path, unsigned user) {
+	char *spec;
+	if (asprintf(&spec, "version %s\nuid %d\nuser %u\n", VERSION, (int) getuid(), user) == -1)
+		errExit("asprintf");
+	if (run_cache_add_file_id(&spec, full_path)) {
+		free(spec);
+		return NULL;
+	}
+	run_cache_add_file_id(&spec, PATH_FLDD);
+
+	int i;
+	for (i = 0; default_lib_paths[i]; i++)
+		run_cache_add_file_id(&spec, default_lib_paths[i]);
+	return spec;
+}
+
+// extract the file name from a "path inode mtime size" line
+static char *line_to_path(char *line) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		char *ptr = strrchr(line, ' ');
+		if (!ptr)
+			return NULL;
+		*ptr = '\0';
+	}
+	return line;
+}
+
+// return 1 if the list of libraries was found in the cache and written in fname
+int fslib_cache_fetch(const char *full_path, unsigned user, const char *fname) {
+	assert(full_path);
+	assert(fname);
+	if (cache_fd == -1)
+		return 0;
+
+	struct stat s;
+	if (stat(full_path, &s) == -1 || !S_ISREG(s.st_mode))
+		return 0;
+
+	char *spec = build_spec(full_path, user);
+	if (!spec)
+		return 0;
+	uint64_t h = fnv1a64_str(spec);
+	char entry[64];
+	snprintf(entry, sizeof(entry), "%016llx.list", (unsigned long long) h);
+
+	int rv = 0;
+	FILE *out = NULL;
+	FILE *fp = run_cache_load(cache_fd, entry, spec);
+	if (!fp)
+		goto out;
+
+	out = fopen(fname, "we");
+	if (!out)
+		goto close;
+
+	// check the libraries
+	char line[MAXBUF];
+	while (fgets(line, sizeof(line), fp)) {
+		char *copy = strdup(line);
+		if (!copy)
+			errExit("strdup");
+		char *tmp = strdup("");
+		if (!tmp)
+			errExit("strdup");
+
+		char *ptr = strchr(copy, '\n');
+		if (ptr)
+			*ptr = '\0';
+		char *path = line_to_path(copy);
+		int valid = (path && run_cache_add_file_id(&tmp, path) == 0 && strcmp(tmp, line) == 0);
+		if (valid)
+			fprintf(out, "%s\n", path);
+		free(tmp);
+		free(copy);
+		if (!valid)
+			goto close;
+	}
+	rv = 1;
+
+close:
+	fclose(fp);
+out:
+	if (out) {
+		// drop a partial list, fldd will run again
+		fflush(out);
+		if (!rv && ftruncate(fileno(out), 0) == -1)
+			errExit("ftruncate");
+		fclose(out);
+	}
+	if (rv && (arg_debug || arg_debug_private_lib))
+		printf("    fldd %s loaded from cache (%016llx)\n", full_path, (unsigned long long) h);
+	free(spec);
+	return rv;
+}
+
+// store the list of libraries produced by fldd in fname; errors are not fatal
+void fslib_cache_store(const char *full_path, unsigned user, const char *fname) {
+	assert(full_path);
+	assert(fname);
+	if (cache_fd == -1)
+		return;
+
+	struct stat s;
+	if (stat(full_path, &s) == -1 || !S_ISREG(s.st_mode))
+		return;
+	int cnt = run_cache_count(cache_fd, "list");
+	if (cnt < 0 || cnt >= FLDD_CACHE_MAX_ENTRIES)
+		return;
+
+	char *spec = build_spec(full_path, user);
+	if (!spec)
+		return;
+	char *data = strdup("");
+	if (!data)
+		errExit("strdup");
+
+	// add the libraries
+	FILE *fp = fopen(fname, "re");
+	if (!fp)
+		goto errout;
+	char line[MAXBUF];
+	while (fgets(line, sizeof(line), fp)) {
+		char *ptr = strchr(line, '\n');
+		if (ptr)
+			*ptr = '\0';
+		if (*line == '\0')
+			continue;
+		if (run_cache_add_file_id(&data, line)) {
+			fclose(fp);
+			goto errout;
+		}
+	}
+	fclose(fp);
+
+	uint64_t h = fnv1a64_str(spec);
+	char entry[64];
+	snprintf(entry, sizeof(entry), "%016llx.list", (unsigned long long) h);
+	fp = run_cache_create(cache_fd, entry, spec);
+	if (!fp)
+		goto errout;
+	fputs(data, fp);
+	if (run_cache_commit(cache_fd, entry, fp))
+		goto errout;
+
+	if (arg_debug || arg_debug_private_lib)
+		printf("    fldd %s stored in cache (%016llx)\n", full_path, (unsigned long long) h);
+	free(data);
+	free(spec);
+	return;
+
+errout:
+	if (arg_debug || arg_debug_private_lib)
+		printf("    cannot store fldd %s in cache\n", full_path);
+	free(data);
+	free(spec);
+}
+#endif
@@ -23,74 +23,175 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #define MAXBUF 4098
 
-typedef struct fs_msg_t {
-	struct fs_msg_t *next;
-	char *msg;
-} FsMsg;
+// Messages are kept as fixed-size records in a growing array, with the
+// arguments in a string arena; both are reused after every flush.
+// The first word of fs_logger2/fs_logger3 messages is always a string
+// literal ("blacklist", "tmpfs" ...), it is stored once in the operation table.
+//
+// The log file is text, one message per line. With fslogger-binary enabled
+// in firejail.config every flush appends a binary chunk instead:
+//	FsChunkHeader
+//	operation names, NUL terminated (opsize bytes)
+//	FsRecord records (nrec)
+//	arguments, NUL terminated (strsize bytes)
+// --fs.print reads both formats.
+#define FSLOG_MAGIC "FJFSLOG1"
+#define FSLOG_NOARG 0xffffffffU
+#define FSLOG_MAX_OPS 256
+#define FSLOG_RECORDS_INIT 1024
+#define FSLOG_ARENA_INIT (64 * 1024)
 
-static FsMsg *head = NULL;
+typedef struct {
+	uint32_t op;	// index in the operation table; 0: no operation, the argument is the message
+	uint32_t arg;	// offset in the string arena, FSLOG_NOARG if none
+	uint64_t ts;	// CLOCK_MONOTONIC, nanoseconds
+} FsRecord;
 
-static inline FsMsg *newmsg(void) {
-	FsMsg *ptr = malloc(sizeof(FsMsg));
-	if (!ptr)
-		errExit("malloc");
-	memset(ptr, 0, sizeof(FsMsg));
-	return ptr;
+typedef struct {
+	char magic[8];
+	uint32_t nops;
+	uint32_t opsize;
+	uint32_t nrec;
+	uint32_t strsize;
+} FsChunkHeader;
+
+static const char *ops[FSLOG_MAX_OPS] = { "" };
+static unsigned nops = 1;
+
+static FsRecord *records = NULL;
+static size_t nrec = 0;
+static size_t maxrec = 0;
+
+static char *arena = NULL;
+static size_t arena_len = 0;
+static size_t arena_size = 0;
+
+// operation names are string literals, the pointer is checked first
+static uint32_t op_index(const char *name) {
+	unsigned i;
+	for (i = 1; i < nops; i++)
+		if (ops[i] == name)
+			return i;
+	for (i = 1; i < nops; i++)
+		if (strcmp(ops[i], name) == 0)
+			return i;
+	if (nops == FSLOG_MAX_OPS)
+		return 0;
+	ops[nops] = name;
+	return nops++;
 }
 
-static inline void insertmsg(FsMsg *ptr) {
-	static FsMsg *last = NULL;
-	if (head == NULL) {
-		head = ptr;
-		last = ptr;
-		return;
+// reserve len bytes in the arena, return the offset
+static uint32_t arena_alloc(size_t len) {
+	if (arena_len + len > arena_size) {
+		size_t size = (arena_size) ? arena_size : FSLOG_ARENA_INIT;
+		while (arena_len + len > size)
+			size *= 2;
+		arena = realloc(arena, size);
+		if (!arena)
+			errExit("realloc");
+		arena_size = size;
 	}
+	uint32_t rv = arena_len;
+	arena_len += len;
+	return rv;
+}
 
-	assert(last);
-	last->next = ptr;
-	last = ptr;
+static uint32_t arena_add(const char *str1, const char *str2) {
+	size_t len1 = strlen(str1);
+	size_t len2 = (str2) ? strlen(str2) + 1 : 0;
+	uint32_t off = arena_alloc(len1 + len2 + 1);
+	memcpy(arena + off, str1, len1);
+	if (str2) {
+		arena[off + len1] = ' ';
+		memcpy(arena + off + len1 + 1, str2, len2 - 1);
+	}
+	arena[off + len1 + len2] = '\0';
+	return off;
+}
+
+static void add_record(uint32_t op, uint32_t arg) {
+	if (nrec == maxrec) {
+		maxrec = (maxrec) ? maxrec * 2 : FSLOG_RECORDS_INIT;
+		records = realloc(records, maxrec * sizeof(FsRecord));
+		if (!records)
+			errExit("realloc");
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	records[nrec].op = op;
+	records[nrec].arg = arg;
+	records[nrec].ts = (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+	nrec++;
 }
 
 void fs_logger(const char *msg) {
-	FsMsg *ptr = newmsg();
-	ptr->msg = strdup(msg);
-	if (!ptr->msg)
-		errExit("strdup");
-	insertmsg(ptr);
+	add_record(0, arena_add(msg, NULL));
 }
 
 void fs_logger2(const char *msg1, const char *msg2) {
-	FsMsg *ptr = newmsg();
-	char *str;
-	if (asprintf(&str, "%s %s", msg1, msg2) == -1)
-		errExit("asprintf");
-	ptr->msg = str;
-	insertmsg(ptr);
+	uint32_t op = op_index(msg1);
+	if (op)
+		add_record(op, arena_add(msg2, NULL));
+	else
+		add_record(0, arena_add(msg1, msg2));
 }
 
 void fs_logger2int(const char *msg1, int d) {
-	FsMsg *ptr = newmsg();
-	char *str;
-	if (asprintf(&str, "%s %d", msg1, d) == -1)
-		errExit("asprintf");
-	ptr->msg = str;
-	insertmsg(ptr);
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%d", d);
+	fs_logger2(msg1, buf);
 }
 
 void fs_logger3(const char *msg1, const char *msg2, const char *msg3) {
-	FsMsg *ptr = newmsg();
-	char *str;
-	if (asprintf(&str, "%s %s %s", msg1, msg2, msg3) == -1)
-		errExit("asprintf");
-	ptr->msg = str;
-	insertmsg(ptr);
+	uint32_t op = op_index(msg1);
+	if (op)
+		add_record(op, arena_add(msg2, msg3));
+	else {
+		char *str;
+		if (asprintf(&str, "%s %s", msg1, msg2) == -1)
+			errExit("asprintf");
+		add_record(0, arena_add(str, msg3));
+		free(str);
+	}
+}
+
+static void print_text(FILE *fp) {
+	size_t i;
+	for (i = 0; i < nrec; i++) {
+		const FsRecord *r = &records[i];
+		if (r->op == 0)
+			fprintf(fp, "%s\n", arena + r->arg);
+		else
+			fprintf(fp, "%s %s\n", ops[r->op], arena + r->arg);
+	}
+}
+
+static void print_binary(FILE *fp) {
+	FsChunkHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, FSLOG_MAGIC, sizeof(hdr.magic));
+	hdr.nops = nops;
+	hdr.nrec = nrec;
+	hdr.strsize = arena_len;
+	unsigned i;
+	for (i = 0; i < nops; i++)
+		hdr.opsize += strlen(ops[i]) + 1;
+
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	for (i = 0; i < nops; i++)
+		fwrite(ops[i], strlen(ops[i]) + 1, 1, fp);
+	fwrite(records, sizeof(FsRecord), nrec, fp);
+	fwrite(arena, 1, arena_len, fp);
 }
 
 void fs_logger_print(void) {
-	if (!head)
+	if (nrec == 0)
 		return;
 
 	FILE *fp = fopen(RUN_FSLOGGER_FILE, "ae");
@@ -100,17 +201,16 @@ void fs_logger_print(void) {
 	}
 	SET_PERMS_STREAM_NOERR(fp, getuid(), getgid(), 0644);
 
-	FsMsg *ptr = head;
-	while (ptr) {
-		fprintf(fp, "%s\n", ptr->msg);
-		FsMsg *next = ptr->next;
-		// remove message
-		free(ptr->msg);
-		free(ptr);
-		ptr = next;
-	}
-	head = NULL;
+	// libtracelog reads the text format
+	if (checkcfg(CFG_FSLOGGER_BINARY) && !arg_tracelog)
+		print_binary(fp);
+	else
+		print_text(fp);
 	fclose(fp);
+
+	// keep the memory for the next messages
+	nrec = 0;
+	arena_len = 0;
 }
 
 void fs_logger_change_owner(void) {
@@ -118,6 +218,64 @@ void fs_logger_change_owner(void) {
 		errExit("chown");
 }
 
+// print a binary chunk; returns -1 and leaves the stream position alone
+// if the data at the current position is not a valid chunk
+static int print_chunk(FILE *fp) {
+	long start = ftell(fp);
+	FsChunkHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, FSLOG_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.nops == 0 || hdr.nops > FSLOG_MAX_OPS ||
+	    hdr.opsize > FSLOG_MAX_OPS * MAXBUF ||
+	    hdr.nrec > (1U << 24) || hdr.strsize > (1U << 30))
+		goto errout;
+
+	char *opbuf = malloc(hdr.opsize + 1);
+	FsRecord *rec = malloc((hdr.nrec + 1) * sizeof(FsRecord));
+	char *str = malloc(hdr.strsize + 1);
+	if (!opbuf || !rec || !str)
+		errExit("malloc");
+	if (fread(opbuf, 1, hdr.opsize, fp) != hdr.opsize ||
+	    fread(rec, sizeof(FsRecord), hdr.nrec, fp) != hdr.nrec ||
+	    fread(str, 1, hdr.strsize, fp) != hdr.strsize) {
+		free(opbuf);
+		free(rec);
+		free(str);
+		goto errout;
+	}
+	opbuf[hdr.opsize] = '\0';
+	str[hdr.strsize] = '\0';
+
+	// operation names
+	const char *name[FSLOG_MAX_OPS];
+	const char *ptr = opbuf;
+	unsigned i;
+	for (i = 0; i < hdr.nops; i++) {
+		name[i] = (ptr < opbuf + hdr.opsize) ? ptr : "";
+		ptr += strlen(ptr) + 1;
+	}
+
+	uint32_t j;
+	for (j = 0; j < hdr.nrec; j++) {
+		const char *arg = (rec[j].arg < hdr.strsize) ? str + rec[j].arg : "";
+		if (arg_debug)
+			printf("[%.3f ms] ", (double) (rec[j].ts - rec[0].ts) / 1000000.0);
+		if (rec[j].op == 0 || rec[j].op >= hdr.nops)
+			printf("%s\n", arg);
+		else
+			printf("%s %s\n", name[rec[j].op], arg);
+	}
+
+	free(opbuf);
+	free(rec);
+	free(str);
+	return 0;
+
+errout:
+	fseek(fp, start, SEEK_SET);
+	return -1;
+}
+
 void fs_logger_print_log(pid_t pid) {
 	EUID_ASSERT();
 
@@ -137,8 +295,15 @@ void fs_logger_print_log(pid_t pid) {
 	}
 
 	char buf[MAXBUF];
-	while (fgets(buf, MAXBUF, fp))
+	int c;
+	while ((c = fgetc(fp)) != EOF) {
+		ungetc(c, fp);
+		if (c == FSLOG_MAGIC[0] && print_chunk(fp) == 0)
+			continue;
+		if (!fgets(buf, MAXBUF, fp))
+			break;
 		printf("%s", buf);
+	}
 	fclose(fp);
 
 	exit(0);
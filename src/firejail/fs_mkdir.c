@@ -25,6 +25,8 @@
 #include <grp.h>
 #include <sys/wait.h>
 #include <string.h>
+#include <fcntl.h>
+#include <errno.h>
 
 static void check(const char *fname) {
 	// manufacture /run/user directory
@@ -41,51 +43,85 @@ static void check(const char *fname) {
 	free(runuser);
 }
 
-static void mkdir_recursive(char *path) {
-	char *subdir = NULL;
-	struct stat s;
+// The mkdir and mkfile lines are checked when they are read, the paths
+// missing are queued and created by fs_mkdir_flush() in a single child
+// process running with the user privileges. The paths are walked with
+// openat()/mkdirat() starting from the home directory or from /, a missing
+// directory is created with mode 0700; the symlinks are followed as the
+// user, the same way mkdir(1) would.
+typedef struct {
+	char *path;
+	int file;	// mkfile
+} MkdirEntry;
+
+static MkdirEntry *queue = NULL;
+static int queue_cnt = 0;
+static int queue_max = 0;
+
+static void queue_add(char *path, int file) {
+	if (queue_cnt == queue_max) {
+		queue_max = (queue_max) ? queue_max * 2 : 16;
+		queue = realloc(queue, queue_max * sizeof(MkdirEntry));
+		if (!queue)
+			errExit("realloc");
+	}
+	queue[queue_cnt].path = path;
+	queue[queue_cnt].file = file;
+	queue_cnt++;
+}
 
-	if (chdir("/")) {
-		fprintf(stderr, "Error: can't chdir to /\n");
+// walk path starting from dirfd; running as the user, errors are not fatal
+static void create_path(int dirfd, const char *fullpath, char *path, int file) {
+	int fd = dup(dirfd);
+	if (fd == -1) {
+		fwarning("cannot create %s\n", fullpath);
 		return;
 	}
 
-	subdir = strtok(path, "/");
-	while(subdir) {
-		if (stat(subdir, &s) == -1) {
+	char *subdir = strtok(path, "/");
+	while (subdir) {
+		char *next = strtok(NULL, "/");
+		if (file && !next) {
+			// last component of a mkfile path, the parent directories are not created
+			int ffd = openat(fd, subdir, O_RDONLY|O_CREAT|O_EXCL|O_CLOEXEC, S_IRUSR | S_IWUSR);
+			if (ffd > -1) {
+				int err = fchmod(ffd, 0600);
+				(void) err;
+				close(ffd);
+			}
+			else
+				fwarning("cannot create %s\n", fullpath);
+			break;
+		}
+
+		int nfd = openat(fd, subdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+		if (nfd == -1 && errno == ENOENT && !file) {
 			/* coverity[toctou] */
-			if (mkdir(subdir, 0700) == -1) {
+			if (mkdirat(fd, subdir, 0700) == -1 && errno != EEXIST) {
 				fwarning("cannot create %s directory\n", subdir);
-				return;
+				break;
 			}
-		} else if (!S_ISDIR(s.st_mode)) {
-			fwarning("'%s exists, but is not a directory\n", subdir);
-			return;
+			nfd = openat(fd, subdir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
 		}
-		if (chdir(subdir)) {
-			fprintf(stderr, "Error: can't chdir to %s\n", subdir);
-			return;
+		if (nfd == -1) {
+			if (errno == ENOTDIR)
+				fwarning("'%s exists, but is not a directory\n", subdir);
+			else
+				fwarning("cannot create %s\n", fullpath);
+			break;
 		}
-
-		subdir = strtok(NULL, "/");
+		close(fd);
+		fd = nfd;
+		subdir = next;
 	}
+	close(fd);
 }
 
-void fs_mkdir(const char *name) {
+void fs_mkdir_flush(void) {
 	EUID_ASSERT();
+	if (queue_cnt == 0)
+		return;
 
-	// check directory name
-	invalid_filename(name, 0); // no globbing
-	char *expanded = expand_macros(name);
-	check(expanded); // will exit if wrong path
-
-	struct stat s;
-	if (stat(expanded, &s) == 0) {
-		// file exists, do nothing
-		goto doexit;
-	}
-
-	// create directory
 	pid_t child = fork();
 	if (child < 0)
 		errExit("fork");
@@ -93,8 +129,31 @@ void fs_mkdir(const char *name) {
 		// drop privileges
 		drop_privs(0);
 
-		// create directory
-		mkdir_recursive(expanded);
+		int rootfd = open("/", O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+		if (rootfd == -1)
+			errExit("open");
+		int homefd = -1;
+		size_t homelen = strlen(cfg.homedir);
+
+		int i;
+		for (i = 0; i < queue_cnt; i++) {
+			char *dup = strdup(queue[i].path);
+			if (!dup)
+				errExit("strdup");
+
+			int dirfd = rootfd;
+			char *rel = dup;
+			if (strncmp(dup, cfg.homedir, homelen) == 0 && dup[homelen] == '/') {
+				if (homefd == -1)
+					homefd = open(cfg.homedir, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+				if (homefd != -1) {
+					dirfd = homefd;
+					rel = dup + homelen;
+				}
+			}
+			create_path(dirfd, queue[i].path, rel, queue[i].file);
+			free(dup);
+		}
 
 		__gcov_flush();
 
@@ -103,8 +162,31 @@ void fs_mkdir(const char *name) {
 	// wait for the child to finish
 	waitpid(child, NULL, 0);
 
-doexit:
-	free(expanded);
+	int i;
+	for (i = 0; i < queue_cnt; i++) {
+		fs_glob_created(queue[i].path);
+		free(queue[i].path);
+	}
+	queue_cnt = 0;
+}
+
+void fs_mkdir(const char *name) {
+	EUID_ASSERT();
+
+	// check directory name
+	invalid_filename(name, 0); // no globbing
+	char *expanded = expand_macros(name);
+	check(expanded); // will exit if wrong path
+
+	struct stat s;
+	if (stat(expanded, &s) == 0) {
+		// file exists, do nothing
+		free(expanded);
+		return;
+	}
+
+	// created by fs_mkdir_flush()
+	queue_add(expanded, 0);
 }
 
 void fs_mkfile(const char *name) {
@@ -118,12 +200,10 @@ void fs_mkfile(const char *name) {
 	struct stat s;
 	if (stat(expanded, &s) == 0) {
 		// file exists, do nothing
-		goto doexit;
+		free(expanded);
+		return;
 	}
 
-	// create file
-	touch_file_as_user(expanded, 0600);
-
-doexit:
-	free(expanded);
+	// created by fs_mkdir_flush()
+	queue_add(expanded, 1);
 }
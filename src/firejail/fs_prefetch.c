@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Batched path lookups for blacklist, whitelist, private-bin and
+// private-etc entries.
+//
+// The modules check their paths one at a time with stat(), realpath() and
+// the *_as_user() helpers. On cold caches, and on network filesystems in
+// particular, every check is a blocking round trip. fs_prefetch_run()
+// submits a statx() for all the queued paths at once in an io_uring; the
+// kernel runs them in parallel on its worker threads, with the credentials
+// of the caller. Without io_uring (old kernel, kernel.io_uring_disabled)
+// the paths are looked up with stat() on a few threads.
+//
+// On local filesystems the lookups are fast, and the prefetch costs more
+// than it saves with warm caches. Only the paths on network filesystems
+// are queued: the filesystem of the home directory, or of the top level
+// directory of the path, is checked once.
+//
+// The results are not used: the modules run their checks as before, with
+// the same credentials and symlink rules, and find the dentries and the
+// inode attributes in the kernel caches.
+
+#include "firejail.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_OP_STATX is an enum value, added in Linux 5.6 with this flag
+#ifdef IORING_FEAT_CUR_PERSONALITY
+#define HAVE_URING_STATX
+#endif
+#endif
+
+#define PREFETCH_MIN 8		// fewer paths are not worth it
+#define PREFETCH_MAX_THREADS 4
+#define URING_ENTRIES 64
+#define FSDIR_MAX 32
+
+static char **pending = NULL;
+static int pending_cnt = 0;
+static int pending_max = 0;
+
+// see <linux/magic.h>
+static const unsigned long remote_magic[] = {
+	0x6969,		// NFS
+	0xff534d42,	// CIFS
+	0xfe534d42,	// SMB2
+	0x517b,		// SMB
+	0x65735546,	// FUSE: sshfs etc.
+	0x6b414653,	// AFS
+	0x00c36400,	// Ceph
+	0x01021997,	// 9p
+	0
+};
+
+typedef struct {
+	char *dir;
+	size_t len;
+	int remote;
+} FsDir;
+
+static FsDir fsdir[FSDIR_MAX];
+static int fsdir_cnt = 0;
+
+static int is_remote(const char *path) {
+	// the home directory is often a separate mount
+	size_t len;
+	size_t hlen = (cfg.homedir) ? strlen(cfg.homedir) : 0;
+	if (hlen && strncmp(path, cfg.homedir, hlen) == 0 && (path[hlen] == '/' || path[hlen] == '\0'))
+		len = hlen;
+	else {
+		const char *ptr = strchr(path + 1, '/');
+		len = (ptr) ? (size_t) (ptr - path) : strlen(path);
+	}
+
+	int i;
+	for (i = 0; i < fsdir_cnt; i++) {
+		if (fsdir[i].len == len && strncmp(fsdir[i].dir, path, len) == 0)
+			return fsdir[i].remote;
+	}
+
+	char *dir = strndup(path, len);
+	if (!dir)
+		errExit("strndup");
+	int remote = 0;
+	struct statfs fs;
+	if (statfs(dir, &fs) == 0) {
+		const unsigned long *m;
+		for (m = remote_magic; *m; m++) {
+			if ((unsigned long) fs.f_type == *m)
+				remote = 1;
+		}
+	}
+	if (fsdir_cnt < FSDIR_MAX) {
+		fsdir[fsdir_cnt].dir = dir;
+		fsdir[fsdir_cnt].len = len;
+		fsdir[fsdir_cnt].remote = remote;
+		fsdir_cnt++;
+	}
+	else
+		free(dir);
+	return remote;
+}
+
+// add an absolute path for the next fs_prefetch_run call
+void fs_prefetch_queue(const char *path) {
+	assert(path);
+	if (*path != '/' || !is_remote(path))
+		return;
+
+	if (pending_cnt == pending_max) {
+		pending_max = (pending_max) ? pending_max * 2 : 64;
+		pending = realloc(pending, pending_max * sizeof(char *));
+		if (!pending)
+			errExit("realloc");
+	}
+	pending[pending_cnt] = strdup(path);
+	if (!pending[pending_cnt])
+		errExit("strdup");
+	pending_cnt++;
+}
+
+#ifdef HAVE_URING_STATX
+typedef struct {
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_map;
+	size_t sq_map_size;
+	void *cq_map;
+	size_t cq_map_size;
+	size_t sqes_size;
+} Uring;
+
+static void uring_close(Uring *r) {
+	if (r->sqes && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_size);
+	if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+		munmap(r->cq_map, r->cq_map_size);
+	if (r->sq_map && r->sq_map != MAP_FAILED)
+		munmap(r->sq_map, r->sq_map_size);
+	if (r->fd != -1)
+		close(r->fd);
+}
+
+// returns -1 if io_uring is not available
+static int uring_open(Uring *r) {
+	memset(r, 0, sizeof(Uring));
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	r->fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (r->fd == -1)
+		return -1;
+	fcntl(r->fd, F_SETFD, FD_CLOEXEC);
+
+	r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_map_size > r->sq_map_size)
+			r->sq_map_size = r->cq_map_size;
+		r->cq_map_size = r->sq_map_size;
+	}
+	r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_map == MAP_FAILED)
+		goto errout;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_map = r->sq_map;
+	else {
+		r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_map == MAP_FAILED)
+			goto errout;
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto errout;
+
+	char *sq = r->sq_map;
+	r->sq_head = (unsigned *) (sq + p.sq_off.head);
+	r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *) (sq + p.sq_off.array);
+	char *cq = r->cq_map;
+	r->cq_head = (unsigned *) (cq + p.cq_off.head);
+	r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+	return 0;
+
+errout:
+	uring_close(r);
+	return -1;
+}
+
+// returns the number of paths found, or -1 if the kernel does not
+// support statx in io_uring
+static int uring_statx(char **paths, int cnt) {
+	Uring r;
+	if (uring_open(&r))
+		return -1;
+
+	struct statx *buf = malloc(URING_ENTRIES * sizeof(struct statx));
+	if (!buf)
+		errExit("malloc");
+	int slot_free[URING_ENTRIES];	// statx buffers
+	int free_cnt = URING_ENTRIES;
+	int i;
+	for (i = 0; i < URING_ENTRIES; i++)
+		slot_free[i] = i;
+
+	int found = 0;
+	int next = 0;
+	int to_submit = 0;	// in the submission queue
+	int inflight = 0;
+	int unsupported = 0;
+	while ((next < cnt && !unsupported) || to_submit || inflight) {
+		// fill the submission queue
+		unsigned tail = *r.sq_tail;
+		while (next < cnt && !unsupported && free_cnt) {
+			int slot = slot_free[--free_cnt];
+			unsigned index = tail & *r.sq_mask;
+			struct io_uring_sqe *sqe = &r.sqes[index];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uint64_t) (uintptr_t) paths[next];
+			sqe->len = STATX_TYPE | STATX_MODE;
+			sqe->off = (uint64_t) (uintptr_t) &buf[slot];
+			sqe->user_data = slot;
+			r.sq_array[index] = index;
+			tail++;
+			next++;
+			to_submit++;
+		}
+		__atomic_store_n(r.sq_tail, tail, __ATOMIC_RELEASE);
+
+		int rv = (int) syscall(__NR_io_uring_enter, r.fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			unsupported = 1;
+			break;
+		}
+		to_submit -= rv;
+		inflight += rv;
+
+		// collect the results
+		unsigned head = *r.cq_head;
+		while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+			if (cqe->res == 0)
+				found++;
+			else if (cqe->res == -EINVAL)
+				unsupported = 1;
+			slot_free[free_cnt++] = (int) cqe->user_data;
+			inflight--;
+			head++;
+		}
+		__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	uring_close(&r);
+	// the kernel could still write in the buffers of the canceled requests
+	if (!inflight)
+		free(buf);
+	return (unsupported) ? -1 : found;
+}
+#endif
+
+typedef struct {
+	char **paths;
+	int found;
+} PrefetchJobs;
+
+static void stat_job(int i, void *data) {
+	PrefetchJobs *jobs = data;
+	struct stat s;
+	if (stat(jobs->paths[i], &s) == 0)
+		__atomic_add_fetch(&jobs->found, 1, __ATOMIC_RELAXED);
+}
+
+// the lookups are waiting for the disk or for the server,
+// the threads are not limited to the number of CPUs
+static int thread_stat(char **paths, int cnt) {
+	PrefetchJobs jobs = { paths, 0 };
+	run_threads(PREFETCH_MAX_THREADS, cnt, stat_job, &jobs);
+	return jobs.found;
+}
+
+// look up the queued paths in parallel
+void fs_prefetch_run(void) {
+	if (pending_cnt < PREFETCH_MIN)
+		goto out;
+
+	timetrace_start();
+	int found = -1;
+	const char *method = "io_uring";
+#ifdef HAVE_URING_STATX
+	found = uring_statx(pending, pending_cnt);
+#endif
+	if (found == -1) {
+		method = "threads";
+		found = thread_stat(pending, pending_cnt);
+	}
+	float ms = timetrace_end();
+	if (arg_debug)
+		printf("Prefetched %d paths (%d found) with %s in %.02f ms\n",
+		       pending_cnt, found, method, ms);
+
+out:;
+	int i;
+	for (i = 0; i < pending_cnt; i++)
+		free(pending[i]);
+	free(pending);
+	pending = NULL;
+	pending_cnt = 0;
+	pending_max = 0;
+}
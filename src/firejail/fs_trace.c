@@ -96,6 +96,9 @@ void fs_trace(void) {
 
 	if (arg_trace) {
 		fprintf(fp, "%s/libtrace.so\n", prefix);
+		trace_ring_create();
+		if (arg_trace_fanotify)
+			trace_fanotify_create();
 	}
 	else if (arg_tracelog) {
 		fprintf(fp, "%s/libtracelog.so\n", prefix);
@@ -26,84 +26,221 @@
 #include <pwd.h>
 #include <utmp.h>
 #include <time.h>
-
-typedef struct dirdata_t{
-	struct dirdata_t *next;
+#include <errno.h>
+
+// The directories below /var/log are recreated on the tmpfs mounted on
+// /var/log. The skeleton (name, mode, owner of every directory) is stored
+// in RUN_FIREJAIL_VAR_CACHE_DIR (root only) together with the inode and the
+// mtime/ctime of /var/log; creating, removing or renaming a directory updates
+// the mtime, and the next sandbox scans /var/log again. Only the top level is
+// recreated, the applications create their own files and subdirectories.
+//
+// File format: the key, an empty line, and "mode uid gid name" lines, mode
+// in octal.
+#define VAR_LOG_CACHE_FILE "log.list"
+#define MAXBUF 4096
+
+typedef struct {
 	char *name;
-	mode_t st_mode;
-	uid_t st_uid;
-	gid_t st_gid;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
 } DirData;
 
-static DirData *dirlist = NULL;
+typedef struct {
+	DirData *dirs;
+	size_t cnt;
+	size_t max;
+} Skeleton;
+
+static int cache_fd = -1;
+
+// open the cache directory before the filesystem is modified
+void fs_var_cache_open(void) {
+	if (cache_fd != -1)
+		return;
+	if (!checkcfg(CFG_VAR_LOG_CACHE))
+		return;
+
+	cache_fd = run_cache_open(RUN_FIREJAIL_VAR_CACHE_DIR, "/var/log");
+}
 
-static void release_all(void) {
-	DirData *ptr = dirlist;
-	while (ptr) {
-		DirData *next = ptr->next;
-		free(ptr->name);
-		free(ptr);
-		ptr = next;
+static void skel_add(Skeleton *sk, const char *name, mode_t mode, uid_t uid, gid_t gid) {
+	if (sk->cnt == sk->max) {
+		sk->max = (sk->max) ? sk->max * 2 : 32;
+		sk->dirs = realloc(sk->dirs, sk->max * sizeof(DirData));
+		if (!sk->dirs)
+			errExit("realloc");
 	}
-	dirlist = NULL;
+	DirData *d = &sk->dirs[sk->cnt++];
+	d->name = strdup(name);
+	if (!d->name)
+		errExit("strdup");
+	d->mode = mode & 07777;
+	d->uid = uid;
+	d->gid = gid;
 }
 
-static void build_list(const char *srcdir) {
-	// extract current /var/log directory data
-	struct dirent *dir;
-	DIR *d = opendir(srcdir);
-	if (d == NULL)
+static void skel_free(Skeleton *sk) {
+	size_t i;
+	for (i = 0; i < sk->cnt; i++)
+		free(sk->dirs[i].name);
+	free(sk->dirs);
+	memset(sk, 0, sizeof(Skeleton));
+}
+
+static char *build_key(int dirfd) {
+	struct stat s;
+	if (fstat(dirfd, &s) == -1)
+		return NULL;
+
+	char *key;
+	if (asprintf(&key, "version %s\ndevice %lu\ninode %lu\nmtime %lld.%09ld\nctime %lld.%09ld\n",
+		     VERSION, (unsigned long) s.st_dev, (unsigned long) s.st_ino,
+		     (long long) s.st_mtim.tv_sec, s.st_mtim.tv_nsec,
+		     (long long) s.st_ctim.tv_sec, s.st_ctim.tv_nsec) == -1)
+		errExit("asprintf");
+	return key;
+}
+
+// return 0 if the skeleton was loaded from the cache
+static int cache_load(const char *key, Skeleton *sk) {
+	if (cache_fd == -1 || !key)
+		return -1;
+	FILE *fp = run_cache_load(cache_fd, VAR_LOG_CACHE_FILE, key);
+	if (!fp)
+		return -1;
+
+	int rv = -1;
+	char line[MAXBUF];
+	while (fgets(line, sizeof(line), fp)) {
+		char *ptr = strchr(line, '\n');
+		if (!ptr)
+			goto out;
+		*ptr = '\0';
+
+		unsigned mode;
+		unsigned uid;
+		unsigned gid;
+		int pos;
+		if (sscanf(line, "%o %u %u %n", &mode, &uid, &gid, &pos) != 3)
+			goto out;
+		const char *name = line + pos;
+		if (*name == '\0' || strchr(name, '/') ||
+		    strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || mode > 07777)
+			goto out;
+		skel_add(sk, name, (mode_t) mode, (uid_t) uid, (gid_t) gid);
+	}
+	rv = 0;
+
+out:
+	fclose(fp);
+	if (rv)
+		skel_free(sk);
+	else if (arg_debug)
+		printf("/var/log directories loaded from cache\n");
+	return rv;
+}
+
+// errors are not fatal
+static void cache_store(const char *key, const Skeleton *sk) {
+	if (cache_fd == -1 || !key)
 		return;
 
+	FILE *fp = run_cache_create(cache_fd, VAR_LOG_CACHE_FILE, key);
+	if (!fp)
+		goto errout;
+
+	size_t i;
+	for (i = 0; i < sk->cnt; i++)
+		fprintf(fp, "%o %u %u %s\n", (unsigned) sk->dirs[i].mode,
+			(unsigned) sk->dirs[i].uid, (unsigned) sk->dirs[i].gid, sk->dirs[i].name);
+	if (run_cache_commit(cache_fd, VAR_LOG_CACHE_FILE, fp))
+		goto errout;
+
+	if (arg_debug)
+		printf("/var/log directories stored in cache\n");
+	return;
+
+errout:
+	if (arg_debug)
+		printf("Cannot store /var/log directories in cache\n");
+}
+
+// a name containing a newline cannot be stored in the cache
+static int scan_dirs(int dirfd, Skeleton *sk) {
+	int fd = dup(dirfd);
+	if (fd == -1)
+		errExit("dup");
+	DIR *d = fdopendir(fd);
+	if (d == NULL) {
+		close(fd);
+		return 0;
+	}
+
+	int cacheable = 1;
+	struct dirent *dir;
 	while ((dir = readdir(d))) {
-		if(strcmp(dir->d_name, "." ) == 0 || strcmp(dir->d_name, ".." ) == 0)
+		if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+			continue;
+		if (dir->d_type != DT_DIR && dir->d_type != DT_UNKNOWN)
 			continue;
 
-		if (dir->d_type == DT_DIR ) {
-			// get properties
-			struct stat s;
-			char *name;
-			if (asprintf(&name, "%s/%s", srcdir, dir->d_name) == -1)
-				errExit("asprintf");
-			if (stat(name, &s) == -1 ||
-			    S_ISLNK(s.st_mode)) {
-				free(name);
-				continue;
-			}
-
-//			printf("directory %u %u:%u %s\n",
-//				s.st_mode,
-//				s.st_uid,
-//				s.st_gid,
-//				dir->d_name);
-
-			DirData *ptr = malloc(sizeof(DirData));
-			if (ptr == NULL)
-				errExit("malloc");
-			memset(ptr, 0, sizeof(DirData));
-			ptr->name = name;
-			ptr->st_mode = s.st_mode;
-			ptr->st_uid = s.st_uid;
-			ptr->st_gid = s.st_gid;
-			ptr->next = dirlist;
-			dirlist = ptr;
-		}
+		// get properties, symbolic links are skipped
+		struct stat s;
+		if (fstatat(dirfd, dir->d_name, &s, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISDIR(s.st_mode))
+			continue;
+		if (strchr(dir->d_name, '\n'))
+			cacheable = 0;
+		skel_add(sk, dir->d_name, s.st_mode, s.st_uid, s.st_gid);
 	}
 	closedir(d);
+	return cacheable;
 }
 
-static void build_dirs(void) {
-	// create directories under /var/log
-	DirData *ptr = dirlist;
-	while (ptr) {
-		mkdir_attr(ptr->name, ptr->st_mode, ptr->st_uid, ptr->st_gid);
-		fs_logger2("mkdir", ptr->name);
-		ptr = ptr->next;
+// create the directories in one pass, relative to the new tmpfs
+static void build_dirs(const Skeleton *sk) {
+	int dirfd = open("/var/log", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (dirfd == -1)
+		errExit("open /var/log");
+
+	size_t i;
+	for (i = 0; i < sk->cnt; i++) {
+		const DirData *d = &sk->dirs[i];
+		if (mkdirat(dirfd, d->name, d->mode) == -1) {
+			fprintf(stderr, "Error: failed to create /var/log/%s directory\n", d->name);
+			errExit("mkdirat");
+		}
+		int fd = openat(dirfd, d->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1 || fchown(fd, d->uid, d->gid) == -1 || fchmod(fd, d->mode) == -1) {
+			fprintf(stderr, "Error: failed to create /var/log/%s directory\n", d->name);
+			errExit("fchown/fchmod");
+		}
+		close(fd);
+
+		char *name;
+		if (asprintf(&name, "/var/log/%s", d->name) == -1)
+			errExit("asprintf");
+		fs_logger2("mkdir", name);
+		free(name);
 	}
+	close(dirfd);
 }
 
 void fs_var_log(void) {
-	build_list("/var/log");
+	Skeleton sk;
+	memset(&sk, 0, sizeof(Skeleton));
+	int srcfd = open("/var/log", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (srcfd != -1) {
+		char *key = build_key(srcfd);
+		if (cache_load(key, &sk)) {
+			if (scan_dirs(srcfd, &sk))
+				cache_store(key, &sk);
+		}
+		free(key);
+		close(srcfd);
+	}
+	run_cache_close(&cache_fd);
 
 	// note: /var/log is not created here, if it does not exist, this section fails.
 	// create /var/log if it doesn't exit
@@ -121,8 +258,7 @@ void fs_var_log(void) {
 			errExit("mounting /var/log");
 		fs_logger("tmpfs /var/log");
 
-		build_dirs();
-		release_all();
+		build_dirs(&sk);
 
 		// create an empty /var/log/wtmp file
 		/* coverity[toctou] */
@@ -143,6 +279,7 @@ void fs_var_log(void) {
 	}
 	else
 		fwarning("cannot hide /var/log directory\n");
+	skel_free(&sk);
 }
 
 void fs_var_lib(void) {
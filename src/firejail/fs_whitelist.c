@@ -21,7 +21,6 @@
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <fnmatch.h>
-#include <glob.h>
 #include <errno.h>
 
 #include <fcntl.h>
@@ -49,84 +48,171 @@ static void whitelist_error(const char *path) {
 	exit(1);
 }
 
-static int whitelist_mkpath(const char *parentdir, const char *relpath, mode_t mode) {
-	// starting from top level directory
-	int parentfd = safer_openat(-1, parentdir, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
-	if (parentfd < 0)
-		errExit("open");
+// cache of directories opened or created by whitelist_mkpath, keyed by the
+// absolute path; whitelist targets in the same directory (~/.config/foo,
+// ~/.config/bar) reuse the parent fd instead of walking the path again.
+// Every directory was checked when it was added (opened with O_NOFOLLOW,
+// same mount id as its top level directory); entries at or below a new
+// mount point are dropped. All fds are O_CLOEXEC and are closed when
+// fs_whitelist returns.
+#define MKPATH_CACHE_MAX 64
+
+typedef struct {
+	char *path;	// NULL if the slot is unused
+	unsigned hash;
+	int fd;
+	int mountid;	// mount id of the top level directory
+} MkpathEntry;
+
+static MkpathEntry mkcache[MKPATH_CACHE_MAX];
+static int mkcache_next = 0; // next slot to replace
+
+static void mkpath_cache_drop(MkpathEntry *e) {
+	free(e->path);
+	close(e->fd);
+	e->path = NULL;
+	e->fd = -1;
+}
 
-	// top level directory mount id
-	int mountid = get_mount_id(parentfd);
-	if (mountid < 0) {
-		close(parentfd);
-		return -1;
+static MkpathEntry *mkpath_cache_find(const char *path, size_t len) {
+	unsigned h = fnv1a32(path, len);
+	int i;
+	for (i = 0; i < MKPATH_CACHE_MAX; i++) {
+		MkpathEntry *e = &mkcache[i];
+		if (e->path && e->hash == h && strncmp(e->path, path, len) == 0 && e->path[len] == '\0')
+			return e;
 	}
+	return NULL;
+}
 
-	// work on a copy of the path
-	char *dup = strdup(relpath);
-	if (!dup)
-		errExit("strdup");
+// the cache takes ownership of fd
+static MkpathEntry *mkpath_cache_add(const char *path, size_t len, int fd, int mountid) {
+	MkpathEntry *e = &mkcache[mkcache_next];
+	mkcache_next = (mkcache_next + 1) % MKPATH_CACHE_MAX;
+	if (e->path)
+		mkpath_cache_drop(e);
+
+	e->path = strndup(path, len);
+	if (!e->path)
+		errExit("strndup");
+	e->hash = fnv1a32(path, len);
+	e->fd = fd;
+	e->mountid = mountid;
+	return e;
+}
+
+// something was mounted on path
+static void mkpath_cache_invalidate(const char *path) {
+	size_t len = strlen(path);
+	int i;
+	for (i = 0; i < MKPATH_CACHE_MAX; i++) {
+		MkpathEntry *e = &mkcache[i];
+		if (e->path && strncmp(e->path, path, len) == 0 &&
+		    (e->path[len] == '\0' || e->path[len] == '/'))
+			mkpath_cache_drop(e);
+	}
+}
+
+static void mkpath_cache_reset(void) {
+	int i;
+	for (i = 0; i < MKPATH_CACHE_MAX; i++)
+		if (mkcache[i].path)
+			mkpath_cache_drop(&mkcache[i]);
+	mkcache_next = 0;
+}
+
+static int dup_fd(int fd) {
+	int rv = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (rv == -1)
+		errExit("fcntl");
+	return rv;
+}
+
+static int whitelist_mkpath(const char *parentdir, const char *relpath, mode_t mode) {
+	char *abspath;
+	if (asprintf(&abspath, "%s/%s", parentdir, relpath) < 0)
+		errExit("asprintf");
+	size_t toplen = strlen(parentdir);
 
 	// only create leading directories, don't create the file
-	char *p = strrchr(dup, '/');
-	if (!p) { // nothing to do
-		free(dup);
-		return parentfd;
+	const char *end = strrchr(abspath + toplen + 1, '/');
+	size_t len = (end) ? (size_t) (end - abspath) : toplen;
+
+	// start from the longest leading directory in the cache
+	size_t start = len;
+	MkpathEntry *e;
+	while ((e = mkpath_cache_find(abspath, start)) == NULL && start > toplen) {
+		start--;
+		while (start > toplen && abspath[start] != '/')
+			start--;
+	}
+
+	if (!e) {
+		// starting from top level directory
+		int topfd = safer_openat(-1, parentdir, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		if (topfd < 0)
+			errExit("open");
+
+		// top level directory mount id
+		int mountid = get_mount_id(topfd);
+		if (mountid < 0) {
+			close(topfd);
+			free(abspath);
+			return -1;
+		}
+		e = mkpath_cache_add(abspath, toplen, topfd, mountid);
 	}
-	*p = '\0';
+	int parentfd = e->fd;
+	int mountid = e->mountid;
 
-	// traverse the path, return -1 if a symlink is encountered
-	int fd = -1;
+	// traverse the rest of the path, return -1 if a symlink is encountered
 	int done = 0;
-	char *tok = strtok(dup, "/");
-	assert(tok);
-	while (tok) {
+	while (start < len) {
+		const char *tok = abspath + start + 1;
+		size_t next = start + 1 + strcspn(tok, "/");
+		char *name = strndup(tok, next - start - 1);
+		if (!name)
+			errExit("strndup");
+
 		// create the directory if necessary
-		if (mkdirat(parentfd, tok, mode) == -1) {
+		if (mkdirat(parentfd, name, mode) == -1) {
 			if (errno != EEXIST) {
 				if (arg_debug || arg_debug_whitelists)
 					perror("mkdir");
-				close(parentfd);
-				free(dup);
+				free(name);
+				free(abspath);
 				return -1;
 			}
 		}
 		else
 			done = 1;
 		// open the directory
-		fd = openat(parentfd, tok, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		int fd = openat(parentfd, name, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		free(name);
 		if (fd == -1) {
 			if (arg_debug || arg_debug_whitelists)
 				perror("open");
-			close(parentfd);
-			free(dup);
+			free(abspath);
 			return -1;
 		}
 		// different mount id indicates earlier whitelist mount
 		if (get_mount_id(fd) != mountid) {
 			if (arg_debug || arg_debug_whitelists)
 				printf("Debug %d: whitelisted already\n", __LINE__);
-			close(parentfd);
 			close(fd);
-			free(dup);
+			free(abspath);
 			return -1;
 		}
 		// move on to next path segment
-		close(parentfd);
-		parentfd = fd;
-		tok = strtok(NULL, "/");
+		parentfd = mkpath_cache_add(abspath, next, fd, mountid)->fd;
+		start = next;
 	}
 
-	if (done) {
-		char *abspath;
-		if (asprintf(&abspath, "%s/%s", parentdir, relpath) < 0)
-			errExit("asprintf");
+	if (done)
 		fs_logger2("mkpath", abspath);
-		free(abspath);
-	}
 
-	free(dup);
-	return fd;
+	free(abspath);
+	return dup_fd(parentfd);
 }
 
 static void whitelist_file(const TopDir * const top, const char *path) {
@@ -221,6 +307,7 @@ static void whitelist_file(const TopDir * const top, const char *path) {
 	if (bind_mount_by_fd(fd, fd3))
 		errExit("mount bind");
 	EUID_USER();
+	mkpath_cache_invalidate(path);
 	// check the last mount operation
 	MountData *mptr = get_last_mount(); // will do exit(1) if the mount cannot be found
 #ifdef TEST_MOUNTINFO
@@ -288,28 +375,28 @@ static void globbing(const char *pattern) {
 	assert(pattern);
 
 	// globbing
-	glob_t globbuf;
-	int globerr = glob(pattern, GLOB_NOCHECK | GLOB_NOSORT | GLOB_PERIOD, NULL, &globbuf);
-	if (globerr) {
+	size_t cnt;
+	char **paths = fs_glob(pattern, &cnt);
+	if (!paths) {
 		fprintf(stderr, "Error: failed to glob private-bin pattern %s\n", pattern);
 		exit(1);
 	}
 
 	size_t i;
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		assert(globbuf.gl_pathv[i]);
+	for (i = 0; i < cnt; i++) {
+		assert(paths[i]);
 		// testing for GLOB_NOCHECK - no pattern matched returns the original pattern
-		if (strcmp(globbuf.gl_pathv[i], pattern) == 0)
+		if (strcmp(paths[i], pattern) == 0)
 			continue;
 		// foo/* expands to foo/. and foo/..
-		const char *base = gnu_basename(globbuf.gl_pathv[i]);
+		const char *base = gnu_basename(paths[i]);
 		if (strcmp(base, ".") == 0 ||
 		    strcmp(base, "..") == 0)
 			continue;
 
 		// build the new profile command
 		char *newcmd;
-		if (asprintf(&newcmd, "whitelist %s", globbuf.gl_pathv[i]) == -1)
+		if (asprintf(&newcmd, "whitelist %s", paths[i]) == -1)
 			errExit("asprintf");
 
 		// add the new profile command at the end of the list
@@ -318,7 +405,28 @@ static void globbing(const char *pattern) {
 		profile_add(newcmd);
 	}
 
-	globfree(&globbuf);
+	fs_glob_free(paths);
+}
+
+// expand the glob patterns of all whitelist commands in advance
+static void whitelist_prefetch(void) {
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_WHITELIST];
+	int i;
+	for (i = 0; i < b->cnt; i++) {
+		const ProfileEntry *entry = b->entries[i];
+		if (strncmp(entry->data, "whitelist ", 10) != 0)
+			continue;
+
+		// same transformations as in fs_whitelist
+		char *expanded = expand_macros(entry->data + 10);
+		if (expanded[0] == '/' && !is_macro(expanded)) {
+			char *new_name = clean_pathname(expanded);
+			fs_glob_queue(new_name);
+			free(new_name);
+		}
+		free(expanded);
+	}
+	fs_glob_prefetch();
 }
 
 // mount tmpfs on all top level directories
@@ -418,6 +526,9 @@ static void tmpfs_topdirs(const TopDir * const topdirs) {
 		fs_tmpfs(runuser, 0);
 		selinux_relabel_path(runuser, runuser);
 	}
+
+	// the new tmpfs mounts can hide directories in the mkpath cache
+	mkpath_cache_reset();
 }
 
 static int reject_topdir(const char *dir) {
@@ -500,13 +611,20 @@ static TopDir *add_topdir(const char *dir, TopDir *topdirs, const char *path) {
 static TopDir *have_topdir(const char *dir, TopDir *topdirs) {
 	assert(dir);
 
+	// most profiles whitelist long runs of ${HOME} paths
+	static TopDir *last = NULL;
+	if (last && last->path && strcmp(dir, last->path) == 0)
+		return last;
+
 	int i;
 	for (i = 0; i < TOP_MAX; i++) {
 		TopDir *rv = topdirs + i;
 		if (!rv->path)
 			break;
-		if (strcmp(dir, rv->path) == 0)
+		if (strcmp(dir, rv->path) == 0) {
+			last = rv;
 			return rv;
+		}
 	}
 	return NULL;
 }
@@ -549,30 +667,117 @@ static char *extract_topdir(const char *path) {
 	return dup;
 }
 
+// compare paths, '/' sorts before any other character;
+// this way a directory is followed directly by its contents
+static int path_cmp(const char *a, const char *b) {
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+	unsigned char ca = (*a == '/') ? 1 : (unsigned char) *a;
+	unsigned char cb = (*b == '/') ? 1 : (unsigned char) *b;
+	return (int) ca - (int) cb;
+}
+
+typedef struct {
+	struct wparam_t *w;
+	int index;	// profile order
+} PlanEntry;
+
+static int plan_cmp(const void *p1, const void *p2) {
+	const PlanEntry *e1 = p1;
+	const PlanEntry *e2 = p2;
+	int rv = path_cmp(e1->w->file, e2->w->file);
+	if (rv)
+		return rv;
+	// keep profile order for duplicates
+	return e1->index - e2->index;
+}
+
+static int inside_topdir(const TopDir *top, const char *path) {
+	size_t len = strlen(top->path);
+	return strncmp(top->path, path, len) == 0 && path[len] == '/';
+}
+
+// build the list of files to mount: sorted, without duplicates, and without
+// files inside a directory that is whitelisted in the same top level directory;
+// mounting the ancestor makes them visible anyway, and whitelist_mkpath has
+// to walk each shared parent directory only once
+static struct wparam_t **whitelist_plan(int *cnt) {
+	assert(cnt);
+
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_WHITELIST];
+	int n = 0;
+	int i;
+	for (i = 0; i < b->cnt; i++)
+		if (b->entries[i]->wparam)
+			n++;
+
+	PlanEntry *sorted = calloc(n + 1, sizeof(PlanEntry));
+	struct wparam_t **plan = calloc(n + 1, sizeof(struct wparam_t *));
+	if (!sorted || !plan)
+		errExit("calloc");
+	int j = 0;
+	for (i = 0; i < b->cnt; i++) {
+		ProfileEntry *entry = b->entries[i];
+		if (entry->wparam) {
+			sorted[j].w = entry->wparam;
+			sorted[j].index = j;
+			j++;
+		}
+	}
+	qsort(sorted, n, sizeof(PlanEntry), plan_cmp);
+
+	int out = 0;
+	const struct wparam_t *prev = NULL;
+	for (i = 0; i < n; i++) {
+		struct wparam_t *w = sorted[i].w;
+		// whitelist_file ignores files outside their top level directory
+		if (!inside_topdir(w->top, w->file))
+			continue;
+		if (prev && prev->top == w->top) {
+			size_t len = strlen(prev->file);
+			if (strncmp(prev->file, w->file, len) == 0 &&
+			    (w->file[len] == '\0' || w->file[len] == '/')) {
+				if (arg_debug || arg_debug_whitelists)
+					printf("Debug %d: %s covered by %s\n", __LINE__, w->file, prev->file);
+				continue;
+			}
+		}
+		plan[out++] = w;
+		prev = w;
+	}
+	free(sorted);
+
+	*cnt = out;
+	return plan;
+}
+
 void fs_whitelist(void) {
 	EUID_ASSERT();
 
-	ProfileEntry *entry = cfg.profile;
-	if (!entry)
+	if (!cfg.profile)
 		return;
+	const ProfileBucket *b = &cfg.profile_bucket[PCMD_WHITELIST];
+	int k;
 
 	if (asprintf(&runuser, "/run/user/%u", getuid()) == -1)
 		errExit("asprintf");
 	runuser_len = strlen(runuser);
 	homedir_len = strlen(cfg.homedir);
 
-	size_t nowhitelist_c = 0;
-	size_t nowhitelist_m = 32;
-	char **nowhitelist = calloc(nowhitelist_m, sizeof(*nowhitelist));
-	if (nowhitelist == NULL)
-		errExit("calloc");
+	PathTrie *nowhitelist = path_trie_new();
 
 	TopDir *topdirs = calloc(TOP_MAX, sizeof(*topdirs));
 	if (topdirs == NULL)
 		errExit("calloc");
 
+	whitelist_prefetch();
+
 	// verify whitelist files, extract symbolic links, etc.
-	while (entry) {
+	// globbing() adds new entries at the end of the bucket
+	for (k = 0; k < b->cnt; k++) {
+		ProfileEntry *entry = b->entries[k];
 		int nowhitelist_flag = 0;
 
 		// handle only whitelist and nowhitelist commands
@@ -580,10 +785,8 @@ void fs_whitelist(void) {
 			nowhitelist_flag = 0;
 		else if (strncmp(entry->data, "nowhitelist ", 12) == 0)
 			nowhitelist_flag = 1;
-		else {
-			entry = entry->next;
+		else
 			continue;
-		}
 		if (arg_debug || arg_debug_whitelists)
 			printf("Debug %d: %s\n", __LINE__, entry->data);
 
@@ -600,7 +803,6 @@ void fs_whitelist(void) {
 				fprintf(stderr, "*** Any file saved in this directory will be lost when the sandbox is closed.\n");
 				fprintf(stderr, "***\n");
 			}
-			entry = entry->next;
 			free(expanded);
 			continue;
 		}
@@ -634,7 +836,6 @@ void fs_whitelist(void) {
 			if (!current_top) { // got new top level directory
 				current_top = add_topdir(dir, topdirs, new_name);
 				if (!current_top) { // skip this command, top level directory not valid
-					entry = entry->next;
 					free(new_name);
 					free(dir);
 					continue;
@@ -645,7 +846,6 @@ void fs_whitelist(void) {
 
 		// /run/firejail directory is internal and not allowed
 		if (strncmp(new_name, RUN_FIREJAIL_DIR, strlen(RUN_FIREJAIL_DIR)) == 0) {
-			entry = entry->next;
 			free(new_name);
 			continue;
 		}
@@ -681,14 +881,12 @@ void fs_whitelist(void) {
 				globbing(new_name);
 			}
 
-			entry = entry->next;
 			free(new_name);
 			continue;
 		}
 
 		// /run/firejail directory is internal and not allowed
 		if (strncmp(fname, RUN_FIREJAIL_DIR, strlen(RUN_FIREJAIL_DIR)) == 0) {
-			entry = entry->next;
 			free(new_name);
 			free(fname);
 			continue;
@@ -699,33 +897,16 @@ void fs_whitelist(void) {
 			if (arg_debug || arg_debug_whitelists)
 				printf("Storing nowhitelist %s\n", fname);
 
-			if (nowhitelist_c >= nowhitelist_m) {
-				nowhitelist_m *= 2;
-				nowhitelist = realloc(nowhitelist, sizeof(*nowhitelist) * nowhitelist_m);
-				if (nowhitelist == NULL)
-					errExit("failed increasing memory for nowhitelist entries");
-			}
-			nowhitelist[nowhitelist_c++] = fname;
-			entry = entry->next;
+			path_trie_add(nowhitelist, fname, 1);
 			free(new_name);
+			free(fname);
 			continue;
 		}
 		else {
 			// check if the path is in nowhitelist array
-			size_t i;
-			int found = 0;
-			for (i = 0; i < nowhitelist_c; i++) {
-				if (nowhitelist[i] == NULL)
-					break;
-				if (strcmp(nowhitelist[i], fname) == 0) {
-					found = 1;
-					break;
-				}
-			}
-			if (found) {
+			if (path_trie_match(nowhitelist, fname) != -1) {
 				if (arg_debug || arg_debug_whitelists)
 					printf("Skip nowhitelisted path %s\n", fname);
-				entry = entry->next;
 				free(new_name);
 				free(fname);
 				continue;
@@ -747,24 +928,30 @@ void fs_whitelist(void) {
 		else
 			free(new_name);
 
-		entry = entry->next;
 	}
 
+	fs_glob_flush();
+
 	// mount tmpfs on all top level directories
 	tmpfs_topdirs(topdirs);
 
-	// go through profile rules again, and interpret whitelist commands
-	entry = cfg.profile;
-	while (entry) {
+	// sort the whitelisted files and drop the ones covered by
+	// an earlier entry, then interpret whitelist commands
+	int cnt;
+	struct wparam_t **plan = whitelist_plan(&cnt);
+	int i;
+	for (i = 0; i < cnt; i++)
+		whitelist_file(plan[i]->top, plan[i]->file);
+	free(plan);
+
+	// go through profile rules again and create the links
+	for (k = 0; k < b->cnt; k++) {
+		ProfileEntry *entry = b->entries[k];
 		if (entry->wparam) {
 			char *file = entry->wparam->file;
 			char *link = entry->wparam->link;
 			const TopDir * const current_top = entry->wparam->top;
 
-			// top level directories of link and file can differ
-			// will whitelist the file only if it is in same top level directory
-			whitelist_file(current_top, file);
-
 			// create the link if any
 			if (link) {
 				whitelist_symlink(current_top, link, file);
@@ -775,15 +962,11 @@ void fs_whitelist(void) {
 			free(entry->wparam);
 			entry->wparam = NULL;
 		}
-
-		entry = entry->next;
 	}
 
 	// release resources
-	size_t i;
-	for (i = 0; i < nowhitelist_c; i++)
-		free(nowhitelist[i]);
-	free(nowhitelist);
+	mkpath_cache_reset();
+	path_trie_free(nowhitelist);
 
 	for (i = 0; i < TOP_MAX && topdirs[i].path; i++) {
 		free(topdirs[i].path);
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --instances=N: N identical sandboxes started by one command. The command
+// line and the profiles are processed once, and the seccomp filters are
+// built once into the seccomp cache, in a mount namespace thrown away
+// afterwards. A firejail parent process is then forked for every instance.
+// Each one goes on with the regular startup from the prepared
+// configuration: its own namespaces, run files and network address, and
+// seccomp filters found in the cache. The launcher waits for all the
+// instances.
+//
+// "%d" in the sandbox name is replaced with the instance number, starting
+// with 1; without it the number is appended to the name.
+
+#include "firejail.h"
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#define INSTANCES_MAX 1024
+
+// sandbox name for an instance; the first "%d" in the template is replaced
+char *instance_name(const char *tmpl, int index) {
+	assert(tmpl);
+	char *rv;
+	const char *ptr = strstr(tmpl, "%d");
+	if (ptr) {
+		if (asprintf(&rv, "%.*s%d%s", (int) (ptr - tmpl), tmpl, index, ptr + 2) == -1)
+			errExit("asprintf");
+	}
+	else if (asprintf(&rv, "%s-%d", tmpl, index) == -1)
+		errExit("asprintf");
+	return rv;
+}
+
+void instances_check(const char *arg) {
+	assert(arg);
+	char *end;
+	long n = strtol(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || n < 1 || n > INSTANCES_MAX) {
+		fprintf(stderr, "Error: invalid --instances option, a number between 1 and %d is expected\n", INSTANCES_MAX);
+		exit(1);
+	}
+	arg_instances = (int) n;
+}
+
+// fill the seccomp cache; as in the sandbox, the filters are written in a
+// tmpfs mounted on RUN_MNT_DIR and the helper programs run from
+// RUN_FIREJAIL_LIB_DIR, in a new mount namespace
+static void prebuild_seccomp(void) {
+	pid_t pid = fork();
+	if (pid == -1)
+		errExit("fork");
+	if (pid == 0) {
+		EUID_ROOT();
+		if (unshare(CLONE_NEWNS) == -1 ||
+		    mount(NULL, "/", NULL, MS_SLAVE | MS_REC, NULL) == -1)
+			_exit(1);
+		arg_tracefile = NULL;
+		preproc_mount_mnt_dir();
+		if (mount(LIBDIR "/firejail", RUN_FIREJAIL_LIB_DIR, NULL, MS_BIND, NULL) == -1)
+			_exit(1);
+		seccomp_cache_open();
+		seccomp_store_open();
+		seccomp_prebuild_start();
+		seccomp_prebuild_wait();
+		fflush(0);
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) == -1)
+		errExit("waitpid");
+	if (arg_debug && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+		printf("Seccomp filters not prepared for the instances\n");
+}
+
+static pid_t *instance = NULL;
+
+static void forward_signal(int sig) {
+	int i;
+	for (i = 0; i < arg_instances; i++) {
+		if (instance[i] > 0)
+			kill(instance[i], sig);
+	}
+}
+
+// returns in the process of an instance, exits in the launcher
+void instances_start(void) {
+	EUID_ASSERT();
+	if (!arg_instances) {
+		if (cfg.name && strstr(cfg.name, "%d")) {
+			fprintf(stderr, "Error: %%d in the sandbox name requires --instances\n");
+			exit(1);
+		}
+		return;
+	}
+
+	sprof_begin("instances");
+	prebuild_seccomp();
+	sprof_end();
+
+	instance = calloc(arg_instances, sizeof(pid_t));
+	if (!instance)
+		errExit("calloc");
+	const char *tmpl = cfg.name;
+	fflush(0);
+
+	int i;
+	for (i = 0; i < arg_instances; i++) {
+		pid_t pid = fork();
+		if (pid == -1) {
+			fprintf(stderr, "Error: cannot start instance %d: %s\n", i + 1, strerror(errno));
+			break;
+		}
+		if (pid == 0) {
+			free(instance);
+			instance = NULL;
+			sandbox_pid = getpid();
+			srand(time(NULL) ^ sandbox_pid);
+			if (tmpl)
+				cfg.name = instance_name(tmpl, i + 1);
+			set_instance_run_file(sandbox_pid);
+			return;
+		}
+		instance[i] = pid;
+	}
+	if (arg_debug)
+		printf("%d instances started\n", i);
+
+	// Ctrl-C goes to the process group, the other signals are passed on
+	signal(SIGINT, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+	signal(SIGTERM, forward_signal);
+	signal(SIGHUP, forward_signal);
+
+	// the exit status of the first instance that failed
+	int rv = (i == arg_instances) ? 0 : 1;
+	int first = arg_instances;
+	int running = i;
+	while (running) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		int j;
+		for (j = 0; j < arg_instances; j++) {
+			if (instance[j] == pid)
+				break;
+		}
+		if (j == arg_instances)
+			continue;
+		instance[j] = 0;
+		running--;
+
+		int code = (WIFEXITED(status)) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		if (code && j < first) {
+			first = j;
+			rv = code;
+		}
+	}
+
+	EUID_ROOT();
+	delete_run_files(getpid());
+	exit(rv);
+}
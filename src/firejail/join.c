@@ -18,6 +18,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "firejail.h"
+#include "../include/run_record.h"
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -56,21 +57,10 @@ static void install_handler(void) {
 }
 
 static void extract_x11_display(pid_t pid) {
-	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_X11_DIR, pid) == -1)
-		errExit("asprintf");
-
-	FILE *fp = fopen(fname, "re");
-	free(fname);
-	if (!fp)
+	RunRecord rec;
+	if (run_record_read(pid, &rec) == -1 || rec.x11 == 0)
 		return;
-
-	if (1 != fscanf(fp, "%u", &display)) {
-		fprintf(stderr, "Error: cannot read X11 display file\n");
-		fclose(fp);
-		return;
-	}
-	fclose(fp);
+	display = rec.x11;
 
 	// check display range
 	if (display < X11_DISPLAY_START || display > X11_DISPLAY_END) {
@@ -78,7 +68,7 @@ static void extract_x11_display(pid_t pid) {
 		return;
 	}
 
-	// store the display number for join process in /run/firejail/x11
+	// store the display number for join process in the run record
 	EUID_ROOT();
 	set_x11_run_file(getpid(), display);
 	EUID_USER();
@@ -223,6 +213,93 @@ static void extract_umask(ProcessHandle sandbox) {
 	fclose(fp);
 }
 
+// called in the sandbox once the capabilities are set; the file is read by
+// --join in one go instead of the umask, cpu, numa, groups and nonewprivs
+// files, it also carries the nice value and the scheduling settings
+void save_join_desc(void) {
+	JoinDesc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.magic = JOIN_DESC_MAGIC;
+	desc.size = sizeof(desc);
+
+	int cap;
+	for (cap = 0; cap < 64; cap++) {
+		int rv = prctl(PR_CAPBSET_READ, cap, 0, 0, 0);
+		if (rv < 0)
+			break;
+		if (rv)
+			desc.caps |= 1ULL << cap;
+	}
+	desc.cpus = cfg.cpus;
+	desc.umask = orig_umask;
+	desc.numa_node = (arg_numa) ? cfg.numa_node : -1;
+	desc.numa_bind = cfg.numa_bind;
+	desc.nonewprivs = (arg_nonewprivs) ? 1 : 0;
+	desc.nogroups = (arg_nogroups) ? 1 : 0;
+	desc.nice_set = (arg_nice) ? 1 : 0;
+	desc.nice = cfg.nice;
+	desc.ioprio = cfg.ioprio;
+	desc.sched_set = (arg_sched) ? 1 : 0;
+	desc.sched_policy = cfg.sched_policy;
+	desc.sched_slice = cfg.sched_slice;
+
+	int fd = open(RUN_JOIN_DESC_FILE, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+	if (fd == -1 || write(fd, &desc, sizeof(desc)) != sizeof(desc)) {
+		fprintf(stderr, "Error: cannot save the join state: %s: %s\n",
+		        RUN_JOIN_DESC_FILE, strerror(errno));
+		exit(1);
+	}
+	SET_PERMS_FD(fd, 0, 0, 0644);
+	close(fd);
+}
+
+// return -1 if the sandbox has no descriptor, it was started by an older version
+int join_desc_read(ProcessHandle sandbox, JoinDesc *desc) {
+	int fd = process_rootfs_open(sandbox, RUN_JOIN_DESC_FILE);
+	if (fd < 0)
+		return -1;
+
+	struct stat s;
+	if (fstat(fd, &s) == -1)
+		errExit("fstat");
+	if (!S_ISREG(s.st_mode) || s.st_uid != 0 || s.st_size != sizeof(*desc) ||
+	    read(fd, desc, sizeof(*desc)) != sizeof(*desc) ||
+	    desc->magic != JOIN_DESC_MAGIC || desc->size != sizeof(*desc)) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int extract_join_desc(ProcessHandle sandbox) {
+	JoinDesc desc;
+	if (join_desc_read(sandbox, &desc) == -1)
+		return -1;
+
+	apply_caps = 1;
+	caps = desc.caps;
+	cfg.cpus = desc.cpus;
+	orig_umask = desc.umask & 0777;
+	if (desc.numa_node >= 0)
+		numa_join(desc.numa_node, desc.numa_bind);
+	if (desc.nonewprivs)
+		arg_nonewprivs = 1;
+	if (desc.nogroups)
+		arg_nogroups = 1;
+	if (desc.nice_set) {
+		arg_nice = 1;
+		cfg.nice = desc.nice;
+	}
+	cfg.ioprio = desc.ioprio;
+	if (desc.sched_set) {
+		arg_sched = 1;
+		cfg.sched_policy = desc.sched_policy;
+	}
+	cfg.sched_slice = desc.sched_slice;
+	return 0;
+}
+
 // returns false if the sandbox is not fully set up yet,
 // or true if the sandbox is complete
 static bool has_join_file(ProcessHandle sandbox) {
@@ -286,39 +363,31 @@ static ProcessHandle find_pidns_parent(pid_t pid) {
 	return process;
 }
 
-static void check_firejail_comm(ProcessHandle process) {
-	// open /proc/pid/comm
-	// note: comm value is under control of the target process
-	FILE *fp = process_fopen(process, "comm");
-
-	char comm[16];
-	if (fscanf(fp, "%15s", comm) != 1) {
-		fprintf(stderr, "Error: cannot read /proc file\n");
-		exit(1);
-	}
-	fclose(fp);
-
-	if (strcmp(comm, "firejail") != 0) {
-		fprintf(stderr, "Error: no valid sandbox\n");
-		exit(1);
-	}
-
-	return;
-}
-
-static void check_firejail_credentials(ProcessHandle process) {
-	// open /proc/pid/status
+// the process is a firejail process, privileged and owned by the user;
+// the name and the ids are read from a single /proc/pid/status file
+static void check_firejail_process(ProcessHandle process) {
 	FILE *fp = process_fopen(process, "status");
 
+	// note: the name is under control of the target process
+	char comm[16] = "";
 	uid_t ruid = -1;
 	uid_t suid = -1;
 	char buf[4096];
 	while (fgets(buf, sizeof(buf), fp)) {
-		if (sscanf(buf, "Uid: %u %*u %u", &ruid, &suid) == 2)
+		if (strncmp(buf, "Name:", 5) == 0) {
+			if (sscanf(buf + 5, "%15s", comm) != 1) {
+				fprintf(stderr, "Error: cannot read /proc file\n");
+				exit(1);
+			}
+		}
+		else if (sscanf(buf, "Uid: %u %*u %u", &ruid, &suid) == 2)
 			break;
 	}
 	fclose(fp);
 
+	if (strcmp(comm, "firejail") != 0)
+		goto errexit;
+
 	// target process should be privileged and owned by the user
 	if (suid != 0)
 		goto errexit;
@@ -393,8 +462,7 @@ ProcessHandle pin_sandbox_process(pid_t pid) {
 	EUID_ASSERT();
 
 	ProcessHandle parent = find_pidns_parent(pid);
-	check_firejail_comm(parent);
-	check_firejail_credentials(parent);
+	check_firejail_process(parent);
 
 	ProcessHandle sandbox = switch_to_sandbox(parent);
 	check_joinable(sandbox);
@@ -418,12 +486,15 @@ void join(pid_t pid, int argc, char **argv, int index) {
 
 	// in user mode set caps seccomp, cpu etc.
 	if (getuid() != 0) {
-		extract_nonewprivs(sandbox);  // redundant on Linux >= 4.10; duplicated in function extract_caps
-		extract_caps(sandbox);
-		extract_cpu(sandbox);
-		extract_nogroups(sandbox);
+		if (extract_join_desc(sandbox) == -1) {
+			extract_nonewprivs(sandbox);  // redundant on Linux >= 4.10; duplicated in function extract_caps
+			extract_caps(sandbox);
+			extract_cpu(sandbox);
+			extract_numa(sandbox);
+			extract_nogroups(sandbox);
+			extract_umask(sandbox);
+		}
 		extract_user_namespace(sandbox);
-		extract_umask(sandbox);
 	}
 
 	// join namespaces
@@ -437,11 +508,8 @@ void join(pid_t pid, int argc, char **argv, int index) {
 			exit(1);
 	}
 	else {
-		if (process_join_namespace(sandbox, "ipc") ||
-		    process_join_namespace(sandbox, "net") ||
-		    process_join_namespace(sandbox, "pid") ||
-		    process_join_namespace(sandbox, "uts") ||
-		    process_join_namespace(sandbox, "mnt"))
+		char *types[] = {"ipc", "net", "pid", "uts", "mnt", NULL};
+		if (process_join_namespaces(sandbox, types))
 			exit(1);
 	}
 
@@ -452,6 +520,10 @@ void join(pid_t pid, int argc, char **argv, int index) {
 		// drop discretionary access control capabilities for root sandboxes
 		caps_drop_dac_override();
 
+		// before the seccomp filters, set_mempolicy could be blocked
+		if (arg_numa)	// not available for uid 0
+			set_numa_policy();
+
 		if (!arg_join_network) {
 			// mount namespace doesn't know about --chroot
 			fmessage("Changing root to /proc/%d/root\n", process_get_pid(sandbox));
@@ -520,10 +592,13 @@ void join(pid_t pid, int argc, char **argv, int index) {
 		else if (arg_debug)
 			printf("Extracted command #%s#\n", cfg.command_line);
 
-		// set cpu affinity
-		if (cfg.cpus)	// not available for uid 0
+		// set cpu affinity, already set with the NUMA node
+		if (cfg.cpus && !arg_numa)	// not available for uid 0
 			set_cpu_affinity();
 
+		// the postexec seccomp filter is not inherited from the caller
+		env_store("FIREJAIL_POSTEXEC_SECCOMP", RMENV);
+
 		// add x11 display
 		if (display) {
 			char *display_str;
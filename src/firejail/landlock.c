@@ -22,13 +22,37 @@
 #include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#ifdef __NR_openat2
+#include <linux/openat2.h>
+#endif
 
 #ifdef HAVE_LANDLOCK
 
 #include <linux/landlock.h>
 
+#define MAXBUF 4096
+
+// network rules, ABI 4 (Linux 6.7); the system headers could be older
+#ifndef LANDLOCK_ACCESS_NET_BIND_TCP
+#define LANDLOCK_ACCESS_NET_BIND_TCP (1ULL << 0)
+#define LANDLOCK_ACCESS_NET_CONNECT_TCP (1ULL << 1)
+#define LANDLOCK_RULE_NET_PORT 2
+struct landlock_net_port_attr {
+	__u64 allowed_access;
+	__u64 port;
+};
+#endif
+#define LL_NET_ABI 4
+#define LL_MAX_PORT 65535
+
+struct ll_ruleset_attr {
+	__u64 handled_access_fs;
+	__u64 handled_access_net;
+};
+
 static int ll_ruleset_fd = -1;
 static int ll_abi = -1;
 
@@ -84,9 +108,13 @@ out:
 	return ll_abi;
 }
 
-static int ll_create_full_ruleset(void) {
-	struct landlock_ruleset_attr attr = {0};
-	attr.handled_access_fs =
+// fs: create a ruleset handling all the filesystem access rights
+// net: the network access rights handled
+static int ll_create_ruleset(int fs, __u64 net) {
+	struct ll_ruleset_attr attr = {0};
+	attr.handled_access_net = net;
+	if (fs)
+		attr.handled_access_fs =
 		LANDLOCK_ACCESS_FS_EXECUTE |
 		LANDLOCK_ACCESS_FS_MAKE_BLOCK |
 		LANDLOCK_ACCESS_FS_MAKE_CHAR |
@@ -102,55 +130,93 @@ static int ll_create_full_ruleset(void) {
 		LANDLOCK_ACCESS_FS_WRITE_FILE;
 
 	if (arg_debug) {
-		fprintf(stderr, "%s: Creating Landlock ruleset (abi=%d fs=%llx)\n",
-		        __func__, ll_abi, attr.handled_access_fs);
+		fprintf(stderr, "%s: Creating Landlock ruleset (abi=%d fs=%llx net=%llx)\n",
+		        __func__, ll_abi, attr.handled_access_fs, attr.handled_access_net);
 	}
 
-	int ruleset_fd = landlock_create_ruleset(&attr, sizeof(attr), 0);
+	// the kernels before ABI 4 accept the larger structure, the field is 0
+	int ruleset_fd = landlock_create_ruleset((const struct landlock_ruleset_attr *) &attr,
+	                                         sizeof(attr), 0);
 	if (ruleset_fd < 0) {
 		fprintf(stderr, "Error: %s: failed to create Landlock ruleset "
-		                "(abi=%d fs=%llx): %s\n",
-		        __func__, ll_abi, attr.handled_access_fs,
+		                "(abi=%d fs=%llx net=%llx): %s\n",
+		        __func__, ll_abi, attr.handled_access_fs, attr.handled_access_net,
 		        strerror(errno));
 	}
 	return ruleset_fd;
 }
 
-static void _ll_fs(const char *allowed_path, const __u64 allowed_access,
-                   const char *caller) {
-	if (ll_ruleset_fd == -1)
-		ll_ruleset_fd = ll_create_full_ruleset();
-
-	if (arg_debug) {
-		fprintf(stderr, "%s: Adding Landlock rule (abi=%d fs=%llx) for %s\n",
-		        caller, ll_abi, allowed_access, allowed_path);
-	}
-
-	int allowed_fd = open(allowed_path, O_PATH | O_CLOEXEC);
-	if (allowed_fd < 0) {
-		if (arg_debug) {
-			fprintf(stderr, "%s: failed to open %s: %s\n",
-			        caller, allowed_path, strerror(errno));
-		}
-		return;
-	}
+// access rights for LL_FS_READ ... LL_FS_EXEC
+static const __u64 ll_access[LL_MAX] = {
+	// read
+	LANDLOCK_ACCESS_FS_READ_DIR |
+	LANDLOCK_ACCESS_FS_READ_FILE,
+	// write
+	LANDLOCK_ACCESS_FS_MAKE_DIR |
+	LANDLOCK_ACCESS_FS_MAKE_REG |
+	LANDLOCK_ACCESS_FS_MAKE_SYM |
+	LANDLOCK_ACCESS_FS_REMOVE_DIR |
+	LANDLOCK_ACCESS_FS_REMOVE_FILE |
+	LANDLOCK_ACCESS_FS_WRITE_FILE,
+	// makeipc
+	LANDLOCK_ACCESS_FS_MAKE_FIFO |
+	LANDLOCK_ACCESS_FS_MAKE_SOCK,
+	// makedev
+	LANDLOCK_ACCESS_FS_MAKE_BLOCK |
+	LANDLOCK_ACCESS_FS_MAKE_CHAR,
+	// exec
+	LANDLOCK_ACCESS_FS_EXECUTE,
+	// net.bind
+	LANDLOCK_ACCESS_NET_BIND_TCP,
+	// net.connect
+	LANDLOCK_ACCESS_NET_CONNECT_TCP
+};
+
+static int ll_is_net(int type) {
+	return type == LL_NET_BIND || type == LL_NET_CONNECT;
+}
 
-	struct landlock_path_beneath_attr target = {0};
-	target.parent_fd = allowed_fd;
-	target.allowed_access = allowed_access;
-	int error = landlock_add_rule(ll_ruleset_fd, LANDLOCK_RULE_PATH_BENEATH,
-	                              &target, 0);
-	if (error) {
-		fprintf(stderr, "Error: %s: failed to add Landlock rule "
-		                "(abi=%d fs=%llx) for %s: %s\n",
-		        caller, ll_abi, allowed_access, allowed_path,
-		        strerror(errno));
+// The profile entries are expanded, sorted and merged before the rules are
+// added: a path listed several times gets a single rule with all the access
+// rights, and a path under a directory already granting the same access
+// rights gets no rule at all. The second case is checked with openat2()
+// and RESOLVE_BENEATH, a symbolic link pointing outside the directory still
+// gets its own rule.
+typedef struct {
+	char *path;
+	__u64 access;
+} LlRule;
+
+typedef struct {
+	LlRule *rules;
+	int cnt;
+	int max;
+	int entries;		// profile entries
+	int merged;		// duplicate paths
+	int collapsed;		// paths covered by a parent directory
+	int missing;		// paths not found
+	int added;		// rules added to the ruleset
+	int net;		// network rules added
+	double ms;
+} LlStats;
+
+static LlStats ll_stats;
+
+static void ll_rule_add(const char *path, __u64 access) {
+	if (ll_stats.cnt == ll_stats.max) {
+		ll_stats.max = (ll_stats.max) ? ll_stats.max * 2 : 64;
+		ll_stats.rules = realloc(ll_stats.rules, ll_stats.max * sizeof(LlRule));
+		if (!ll_stats.rules)
+			errExit("realloc");
 	}
-	close(allowed_fd);
+	LlRule *r = &ll_stats.rules[ll_stats.cnt++];
+	r->path = strdup(path);
+	if (!r->path)
+		errExit("strdup");
+	r->access = access;
 }
 
-static void ll_fs(const char *allowed_path, const __u64 allowed_access,
-                  const char *caller) {
+static void ll_expand(const char *allowed_path, const __u64 allowed_access) {
 	char *expanded_path;
 
 	// ${PATH} macro is not included by default in expand_macros()
@@ -163,7 +229,7 @@ static void ll_fs(const char *allowed_path, const __u64 allowed_access,
 			if (arg_debug)
 				fprintf(stderr, "landlock expand path %s\n", expanded_path);
 
-			_ll_fs(expanded_path, allowed_access, caller);
+			ll_rule_add(expanded_path, allowed_access);
 			free(expanded_path);
 			i++;
 		}
@@ -171,51 +237,229 @@ static void ll_fs(const char *allowed_path, const __u64 allowed_access,
 	}
 
 	expanded_path = expand_macros(allowed_path);
-	_ll_fs(expanded_path, allowed_access, caller);
+	ll_rule_add(expanded_path, allowed_access);
 	free(expanded_path);
 }
 
-static void ll_fs_read(const char *allowed_path) {
-	__u64 allowed_access =
-		LANDLOCK_ACCESS_FS_READ_DIR |
-		LANDLOCK_ACCESS_FS_READ_FILE;
+// '/' sorts before any other character, a directory is followed by its subtree
+static int ll_rule_cmp(const void *a, const void *b) {
+	const unsigned char *s1 = (const unsigned char *) ((const LlRule *) a)->path;
+	const unsigned char *s2 = (const unsigned char *) ((const LlRule *) b)->path;
+	while (*s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+	}
+	int c1 = (*s1 == '/') ? 1 : *s1;
+	int c2 = (*s2 == '/') ? 1 : *s2;
+	return c1 - c2;
+}
 
-	ll_fs(allowed_path, allowed_access, __func__);
+// return the path relative to dir if path is an absolute path under dir, NULL otherwise
+static const char *ll_under(const char *dir, const char *path) {
+	if (*dir != '/')
+		return NULL;
+	size_t len = strlen(dir);
+	while (len && dir[len - 1] == '/')
+		len--;
+	if (strncmp(dir, path, len) != 0 || path[len] != '/')
+		return NULL;
+	path += len;
+	while (*path == '/')
+		path++;
+	return (*path) ? path : ".";
 }
 
-static void ll_fs_write(const char *allowed_path) {
-	__u64 allowed_access =
-		LANDLOCK_ACCESS_FS_MAKE_DIR |
-		LANDLOCK_ACCESS_FS_MAKE_REG |
-		LANDLOCK_ACCESS_FS_MAKE_SYM |
-		LANDLOCK_ACCESS_FS_REMOVE_DIR |
-		LANDLOCK_ACCESS_FS_REMOVE_FILE |
-		LANDLOCK_ACCESS_FS_WRITE_FILE;
+// open path beneath the directory; return -1 if the path is not found there
+static int ll_open_beneath(int dirfd, const char *rel) {
+#ifdef __NR_openat2
+	struct open_how oh;
+	memset(&oh, 0, sizeof(oh));
+	oh.flags = O_PATH | O_CLOEXEC;
+	oh.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+	return syscall(__NR_openat2, dirfd, rel, &oh, sizeof(struct open_how));
+#else
+	(void) dirfd;
+	(void) rel;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
 
-	ll_fs(allowed_path, allowed_access, __func__);
+static void ll_add_rule(int fd, const LlRule *r) {
+	if (arg_debug) {
+		fprintf(stderr, "%s: Adding Landlock rule (abi=%d fs=%llx) for %s\n",
+		        __func__, ll_abi, r->access, r->path);
+	}
+
+	struct landlock_path_beneath_attr target = {0};
+	target.parent_fd = fd;
+	target.allowed_access = r->access;
+	int error = landlock_add_rule(ll_ruleset_fd, LANDLOCK_RULE_PATH_BENEATH,
+	                              &target, 0);
+	if (error) {
+		fprintf(stderr, "Error: %s: failed to add Landlock rule "
+		                "(abi=%d fs=%llx) for %s: %s\n",
+		        __func__, ll_abi, r->access, r->path,
+		        strerror(errno));
+	}
+	else
+		ll_stats.added++;
 }
 
-static void ll_fs_makeipc(const char *allowed_path) {
-	__u64 allowed_access =
-		LANDLOCK_ACCESS_FS_MAKE_FIFO |
-		LANDLOCK_ACCESS_FS_MAKE_SOCK;
+// the directories with a rule above the current path
+#define LL_MAX_DEPTH 64
+typedef struct {
+	const LlRule *rule;
+	int fd;
+} LlParent;
 
-	ll_fs(allowed_path, allowed_access, __func__);
+static void ll_add_rules(void) {
+	if (ll_stats.cnt == 0)
+		return;
+	qsort(ll_stats.rules, ll_stats.cnt, sizeof(LlRule), ll_rule_cmp);
+
+	// merge the duplicates
+	int i, n = 0;
+	for (i = 0; i < ll_stats.cnt; i++) {
+		LlRule *r = &ll_stats.rules[i];
+		if (n && strcmp(ll_stats.rules[n - 1].path, r->path) == 0) {
+			ll_stats.rules[n - 1].access |= r->access;
+			free(r->path);
+			ll_stats.merged++;
+			continue;
+		}
+		ll_stats.rules[n++] = *r;
+	}
+	ll_stats.cnt = n;
+
+	LlParent stack[LL_MAX_DEPTH];
+	int depth = 0;
+	for (i = 0; i < ll_stats.cnt; i++) {
+		const LlRule *r = &ll_stats.rules[i];
+		while (depth && !ll_under(stack[depth - 1].rule->path, r->path))
+			close(stack[--depth].fd);
+
+		// look for a directory granting all the access rights
+		int fd = -1;
+		int k;
+		for (k = depth - 1; k >= 0; k--) {
+			const LlRule *parent = stack[k].rule;
+			if ((r->access & ~parent->access) != 0)
+				continue;
+			fd = ll_open_beneath(stack[k].fd, ll_under(parent->path, r->path));
+			if (fd != -1) {
+				if (arg_debug)
+					fprintf(stderr, "%s: Landlock rule for %s covered by %s\n",
+					        __func__, r->path, parent->path);
+				ll_stats.collapsed++;
+				close(fd);
+				break;
+			}
+		}
+		if (k >= 0)
+			continue;
+
+		fd = open(r->path, O_PATH | O_CLOEXEC);
+		if (fd < 0) {
+			if (arg_debug) {
+				fprintf(stderr, "%s: failed to open %s: %s\n",
+				        __func__, r->path, strerror(errno));
+			}
+			ll_stats.missing++;
+			continue;
+		}
+		ll_add_rule(fd, r);
+
+		if (depth < LL_MAX_DEPTH) {
+			stack[depth].rule = r;
+			stack[depth].fd = fd;
+			depth++;
+		}
+		else
+			close(fd);
+	}
+	while (depth)
+		close(stack[--depth].fd);
 }
 
-static void ll_fs_makedev(const char *allowed_path) {
-	__u64 allowed_access =
-		LANDLOCK_ACCESS_FS_MAKE_BLOCK |
-		LANDLOCK_ACCESS_FS_MAKE_CHAR;
+static void ll_free_rules(void) {
+	int i;
+	for (i = 0; i < ll_stats.cnt; i++)
+		free(ll_stats.rules[i].path);
+	free(ll_stats.rules);
+	ll_stats.rules = NULL;
+	ll_stats.cnt = 0;
+	ll_stats.max = 0;
+}
 
-	ll_fs(allowed_path, allowed_access, __func__);
+// Parse a list of TCP ports and port ranges, such as "80,443,8000-8010";
+// the access rights are added to ports[] if not NULL. Return -1 if the list is invalid.
+static int ll_parse_ports(const char *str, unsigned char *ports, unsigned char access) {
+	const char *ptr = str;
+	while (1) {
+		char *end;
+		errno = 0;
+		long first = strtol(ptr, &end, 10);
+		if (end == ptr || *ptr < '0' || *ptr > '9' || errno || first > LL_MAX_PORT)
+			return -1;
+		long last = first;
+		if (*end == '-') {
+			ptr = end + 1;
+			last = strtol(ptr, &end, 10);
+			if (end == ptr || *ptr < '0' || *ptr > '9' || errno || last > LL_MAX_PORT || last < first)
+				return -1;
+		}
+		if (ports) {
+			long port;
+			for (port = first; port <= last; port++)
+				ports[port] |= access;
+		}
+		if (*end == '\0')
+			return 0;
+		if (*end != ',')
+			return -1;
+		ptr = end + 1;
+	}
 }
 
-static void ll_fs_exec(const char *allowed_path) {
-	__u64 allowed_access =
-		LANDLOCK_ACCESS_FS_EXECUTE;
+// add a rule for every port in the list
+static void ll_add_net_rules(const unsigned char *ports) {
+	long port;
+	for (port = 0; port <= LL_MAX_PORT; port++) {
+		if (!ports[port])
+			continue;
+		struct landlock_net_port_attr target = {0};
+		if (ports[port] & (1 << LL_NET_BIND))
+			target.allowed_access |= ll_access[LL_NET_BIND];
+		if (ports[port] & (1 << LL_NET_CONNECT))
+			target.allowed_access |= ll_access[LL_NET_CONNECT];
+		target.port = port;
+
+		if (arg_debug) {
+			fprintf(stderr, "%s: Adding Landlock rule (abi=%d net=%llx) for TCP port %ld\n",
+			        __func__, ll_abi, target.allowed_access, port);
+		}
+		int error = landlock_add_rule(ll_ruleset_fd, LANDLOCK_RULE_NET_PORT,
+		                              &target, 0);
+		if (error) {
+			fprintf(stderr, "Error: %s: failed to add Landlock rule "
+			                "(abi=%d net=%llx) for TCP port %ld: %s\n",
+			        __func__, ll_abi, target.allowed_access, port,
+			        strerror(errno));
+		}
+		else
+			ll_stats.net++;
+	}
+}
 
-	ll_fs(allowed_path, allowed_access, __func__);
+// arguments for the startup profiler
+const char *ll_stats_args(void) {
+	static char buf[256];
+	snprintf(buf, sizeof(buf),
+		"\"entries\":%d,\"merged\":%d,\"collapsed\":%d,\"missing\":%d,\"rules\":%d,\"net_rules\":%d,\"ms\":%.02f",
+		ll_stats.entries, ll_stats.merged, ll_stats.collapsed, ll_stats.missing,
+		ll_stats.added, ll_stats.net, ll_stats.ms);
+	return buf;
 }
 
 int ll_restrict(uint32_t flags) {
@@ -227,22 +471,42 @@ int ll_restrict(uint32_t flags) {
 	if (arg_debug)
 		fprintf(stderr, "%s: Starting Landlock restrict\n", __func__);
 
-	void (*fnc[])(const char *) = {
-		ll_fs_read,
-		ll_fs_write,
-		ll_fs_makeipc,
-		ll_fs_makedev,
-		ll_fs_exec,
-		NULL
-	};
-
+	// TCP ports, a bit for every LL_NET_* entry type
+	unsigned char *ports = NULL;
+	__u64 net = 0;
+	int net_ignored = 0;
 	LandlockEntry *ptr = cfg.lprofile;
-	int rules = 0;
 	while (ptr) {
-		rules++;
-		fnc[ptr->type](ptr->data);
+		ll_stats.entries++;
+		if (!ll_is_net(ptr->type))
+			ll_expand(ptr->data, ll_access[ptr->type]);
+		else if (ll_abi < LL_NET_ABI)
+			net_ignored = 1;
+		else {
+			if (!ports) {
+				ports = calloc(LL_MAX_PORT + 1, 1);
+				if (!ports)
+					errExit("calloc");
+			}
+			// validated in ll_add_profile()
+			ll_parse_ports(ptr->data, ports, 1 << ptr->type);
+			net |= ll_access[ptr->type];
+		}
 		ptr = ptr->next;
 	}
+	if (net_ignored)
+		fprintf(stderr, "Warning: Landlock ABI %d does not support network rules (ABI %d or newer required), "
+		                "ignoring landlock.net commands\n", ll_abi, LL_NET_ABI);
+
+	if (ll_stats.cnt || net)
+		ll_ruleset_fd = ll_create_ruleset(ll_stats.cnt != 0, net);
+	if (ll_ruleset_fd != -1) {
+		ll_add_rules();
+		if (ports)
+			ll_add_net_rules(ports);
+	}
+	ll_free_rules();
+	free(ports);
 
 	if (ll_ruleset_fd == -1)
 		return 0;
@@ -260,7 +524,8 @@ int ll_restrict(uint32_t flags) {
 		        __func__, strerror(errno));
 		goto out;
 	}
-	fmessage("%d Landlock rules initialized in %0.2f ms\n", rules, timetrace_end());
+	ll_stats.ms = timetrace_end();
+	fmessage("%d Landlock rules initialized in %0.2f ms\n", ll_stats.added + ll_stats.net, ll_stats.ms);
 
 out:
 	close(ll_ruleset_fd);
@@ -274,6 +539,10 @@ void ll_add_profile(int type, const char *data) {
 
 	while (*data == ' ' || *data == '\t')
 		data++;
+	if (ll_is_net(type) && ll_parse_ports(data, NULL, 0)) {
+		fprintf(stderr, "Error: invalid Landlock TCP port list \"%s\"\n", data);
+		exit(1);
+	}
 
 	LandlockEntry *entry = malloc(sizeof(LandlockEntry));
 	if (!entry)
@@ -284,19 +553,400 @@ void ll_add_profile(int type, const char *data) {
 	if (!entry->data)
 		errExit("strdup");
 
-	// add entry to the list
-	if (cfg.lprofile == NULL) {
+	// add entry at the end of the list
+	static LandlockEntry *last = NULL;
+	if (cfg.lprofile == NULL)
 		cfg.lprofile = entry;
+	else
+		last->next = entry;
+	last = entry;
+}
+
+//*******************************************
+// blacklist-mode landlock
+//*******************************************
+// The blacklisted paths are recorded by fs_blacklist() instead of being
+// mounted over, and they are denied by a second ruleset applied before the
+// program is started, stacked on the ruleset of the landlock.* commands.
+// Landlock only grants access, the ruleset grants everything except the
+// blacklisted paths: full access to every entry of the directories leading
+// to a blacklisted path, the entries leading to other blacklisted paths
+// excepted, and directory listing on /.
+//
+// The rights granted to / apply to every file below it. A directory on the
+// way to a blacklisted path cannot allow the creation of new files without
+// allowing it in the blacklisted directories, and the entries added after
+// the ruleset is built get no access. The mounts are kept for the paths
+// below a directory writable by the user, below /proc, /sys, /dev, /run,
+// /tmp or /var, and for root. The entries of a blacklisted directory can be
+// listed, their content cannot be read, written or executed.
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+#define LL_REFER_ABI 2
+#define LL_TRUNCATE_ABI 3
+
+int arg_blacklist_landlock = 0;
+
+static char **bl_path = NULL;
+static int bl_cnt = 0;
+static int bl_max = 0;
+
+// the mounts are kept for these directories
+static const char *const bl_mount_dirs[] = {
+	"/proc", "/sys", "/dev", "/run", "/tmp", "/var", NULL
+};
+
+void ll_blacklist_mode(const char *mode) {
+	if (strcmp(mode, "landlock") == 0)
+		arg_blacklist_landlock = 1;
+	else if (strcmp(mode, "mount") == 0)
+		arg_blacklist_landlock = 0;
+	else {
+		fprintf(stderr, "Error: invalid blacklist mode %s, landlock or mount expected\n", mode);
+		exit(1);
+	}
+}
+
+// the directories leading to the path should be owned by root, not
+// writable by anybody else, and readable by everybody
+static int bl_path_ok(const char *fname) {
+	if (*fname != '/' || fname[1] == '\0')
+		return 0;
+	int i;
+	for (i = 0; bl_mount_dirs[i]; i++) {
+		size_t len = strlen(bl_mount_dirs[i]);
+		if (strncmp(fname, bl_mount_dirs[i], len) == 0 && (fname[len] == '/' || fname[len] == '\0'))
+			return 0;
+	}
+
+	char *dir = strdup(fname);
+	if (!dir)
+		errExit("strdup");
+	int rv = 1;
+	int depth = 0;
+	char *ptr;
+	while (rv && (ptr = strrchr(dir, '/')) != NULL) {
+		if (ptr == dir)
+			ptr[1] = '\0';
+		else
+			*ptr = '\0';
+		struct stat s;
+		if (++depth > LL_MAX_DEPTH || lstat(dir, &s) == -1 || !S_ISDIR(s.st_mode) || s.st_uid != 0 ||
+		    (s.st_mode & (S_IWGRP | S_IWOTH)) || (s.st_mode & (S_IROTH | S_IXOTH)) != (S_IROTH | S_IXOTH))
+			rv = 0;
+		if (ptr == dir)
+			break;
+	}
+	free(dir);
+	return rv;
+}
+
+// fname is the real path of a blacklisted file or directory; return 1 if
+// the path is handled by landlock, 0 if it should be mounted over
+int ll_blacklist_add(const char *fname, mode_t mode) {
+	assert(fname);
+	if (!arg_blacklist_landlock || getuid() == 0)
+		return 0;
+	if (!S_ISDIR(mode) && !S_ISREG(mode))
+		return 0;
+	if (!ll_is_supported() || !bl_path_ok(fname))
+		return 0;
+	// without the truncate right, the file permissions protect the file
+	if (ll_abi < LL_TRUNCATE_ABI && S_ISREG(mode) && access(fname, W_OK) == 0)
+		return 0;
+
+	int i;
+	for (i = 0; i < bl_cnt; i++) {
+		if (strcmp(bl_path[i], fname) == 0)
+			return 1;
+	}
+	if (bl_cnt == bl_max) {
+		bl_max = (bl_max) ? bl_max * 2 : 64;
+		bl_path = realloc(bl_path, bl_max * sizeof(char *));
+		if (!bl_path)
+			errExit("realloc");
+	}
+	bl_path[bl_cnt] = strdup(fname);
+	if (!bl_path[bl_cnt])
+		errExit("strdup");
+	bl_cnt++;
+	return 1;
+}
+
+// the list is read again before the program is started, also by --join;
+// the file is saved even if the list is empty, a missing file is an error
+void ll_blacklist_save(void) {
+	FILE *fp = fopen(RUN_BLACKLIST_LANDLOCK_FILE, "wxe");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot save the landlock blacklist: fopen %s: %s\n",
+		        RUN_BLACKLIST_LANDLOCK_FILE, strerror(errno));
+		exit(1);
+	}
+	int i;
+	for (i = 0; i < bl_cnt; i++)
+		fprintf(fp, "%s\n", bl_path[i]);
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+}
+
+typedef struct {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	int dir;
+} BlEntry;
+
+typedef struct {
+	BlEntry *entry;
+	int cnt;
+	int fd;		// ruleset
+	__u64 dir_access;
+	__u64 file_access;
+	int rules;
+} BlRuleset;
+
+static int bl_entry_cmp(const void *a, const void *b) {
+	LlRule r1 = { ((const BlEntry *) a)->path, 0 };
+	LlRule r2 = { ((const BlEntry *) b)->path, 0 };
+	return ll_rule_cmp(&r1, &r2);
+}
+
+// first entry not less than path
+static int bl_lower_bound(const BlRuleset *rs, const char *path) {
+	BlEntry key = { (char *) path, 0, 0, 0 };
+	int lo = 0, hi = rs->cnt;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (bl_entry_cmp(&rs->entry[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// a hard link to a blacklisted file gets no rule, the rules are attached to inodes
+static int bl_same_inode(const BlRuleset *rs, const struct stat *s) {
+	int i;
+	for (i = 0; i < rs->cnt; i++) {
+		if (!rs->entry[i].dir && rs->entry[i].dev == s->st_dev && rs->entry[i].ino == s->st_ino)
+			return 1;
+	}
+	return 0;
+}
+
+static void bl_add_rule(BlRuleset *rs, int fd, __u64 access, const char *path) {
+	struct landlock_path_beneath_attr target = {0};
+	target.parent_fd = fd;
+	target.allowed_access = access;
+	if (landlock_add_rule(rs->fd, LANDLOCK_RULE_PATH_BENEATH, &target, 0)) {
+		fprintf(stderr, "Error: %s: failed to add Landlock rule (abi=%d fs=%llx) for %s: %s\n",
+		        __func__, ll_abi, access, path, strerror(errno));
+		exit(1);
+	}
+	rs->rules++;
+}
+
+// grant access to the entries of dir, except the blacklisted ones; the
+// entries leading to a blacklisted path are processed recursively
+static void bl_walk(BlRuleset *rs, int dirfd, const char *dir) {
+	int fd = dup(dirfd);
+	if (fd == -1)
+		errExit("dup");
+	DIR *d = fdopendir(fd);
+	if (!d) {
+		fprintf(stderr, "Error: cannot build the landlock blacklist, cannot read %s: %s\n", dir, strerror(errno));
+		exit(1);
+	}
+
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		char *path;
+		if (asprintf(&path, "%s/%s", (strcmp(dir, "/") == 0) ? "" : dir, de->d_name) == -1)
+			errExit("asprintf");
+
+		size_t len = strlen(path);
+		int i = bl_lower_bound(rs, path);
+		int blacklisted = (i < rs->cnt && strcmp(rs->entry[i].path, path) == 0);
+		int parent = (!blacklisted && i < rs->cnt &&
+			strncmp(rs->entry[i].path, path, len) == 0 && rs->entry[i].path[len] == '/');
+		if (blacklisted) {
+			free(path);
+			continue;
+		}
+
+		int efd = openat(dirfd, de->d_name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+		struct stat s;
+		if (efd == -1 || fstat(efd, &s) == -1) {
+			// the entry could be gone
+			if (parent) {
+				fprintf(stderr, "Error: cannot build the landlock blacklist, cannot open %s: %s\n",
+				        path, strerror(errno));
+				exit(1);
+			}
+		}
+		else if (parent) {
+			close(efd);
+			efd = openat(dirfd, de->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (efd == -1) {
+				fprintf(stderr, "Error: cannot build the landlock blacklist, cannot read %s: %s\n",
+				        path, strerror(errno));
+				exit(1);
+			}
+			bl_walk(rs, efd, path);
+		}
+		else if (S_ISDIR(s.st_mode))
+			bl_add_rule(rs, efd, rs->dir_access, path);
+		else if (!S_ISLNK(s.st_mode) && !bl_same_inode(rs, &s))
+			bl_add_rule(rs, efd, rs->file_access, path);
+
+		if (efd != -1)
+			close(efd);
+		free(path);
+	}
+	closedir(d);
+}
+
+static void bl_read(BlRuleset *rs) {
+	FILE *fp = fopen(RUN_BLACKLIST_LANDLOCK_FILE, "re");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot read the landlock blacklist: fopen %s: %s\n",
+		        RUN_BLACKLIST_LANDLOCK_FILE, strerror(errno));
+		exit(1);
+	}
+
+	int max = 0;
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+		if (*buf != '/')
+			continue;
+
+		// gone, or replaced by a later mount
+		struct stat s;
+		if (lstat(buf, &s) == -1) {
+			if (errno == ENOENT)
+				continue;
+			fprintf(stderr, "Error: cannot build the landlock blacklist, cannot access %s: %s\n",
+			        buf, strerror(errno));
+			exit(1);
+		}
+
+		if (rs->cnt == max) {
+			max = (max) ? max * 2 : 64;
+			rs->entry = realloc(rs->entry, max * sizeof(BlEntry));
+			if (!rs->entry)
+				errExit("realloc");
+		}
+		BlEntry *e = &rs->entry[rs->cnt++];
+		e->path = strdup(buf);
+		if (!e->path)
+			errExit("strdup");
+		e->dev = s.st_dev;
+		e->ino = s.st_ino;
+		e->dir = S_ISDIR(s.st_mode);
+	}
+	fclose(fp);
+	if (rs->cnt)
+		qsort(rs->entry, rs->cnt, sizeof(BlEntry), bl_entry_cmp);
+}
+
+// apply the blacklist ruleset saved by the sandbox; the sandbox exits if
+// the list is missing or the ruleset cannot be built, the paths are not
+// mounted over
+void ll_blacklist_restrict(void) {
+	BlRuleset rs;
+	memset(&rs, 0, sizeof(rs));
+	bl_read(&rs);
+	if (rs.cnt == 0)
 		return;
+
+	timetrace_start();
+	if (ll_is_supported() == 0) {
+		fprintf(stderr, "Error: Landlock is not available, cannot enforce the blacklist\n");
+		exit(1);
 	}
-	LandlockEntry *ptr = cfg.lprofile;
-	while (ptr->next != NULL)
-		ptr = ptr->next;
-	ptr->next = entry;
+
+	struct ll_ruleset_attr attr = {0};
+	attr.handled_access_fs =
+		ll_access[LL_FS_READ] | ll_access[LL_FS_WRITE] | ll_access[LL_FS_MAKEIPC] |
+		ll_access[LL_FS_MAKEDEV] | ll_access[LL_FS_EXEC];
+	rs.file_access = LANDLOCK_ACCESS_FS_READ_FILE | LANDLOCK_ACCESS_FS_WRITE_FILE |
+		LANDLOCK_ACCESS_FS_EXECUTE;
+	// moving files into another directory is always denied without the refer right
+	if (ll_abi >= LL_REFER_ABI)
+		attr.handled_access_fs |= LANDLOCK_ACCESS_FS_REFER;
+	if (ll_abi >= LL_TRUNCATE_ABI) {
+		attr.handled_access_fs |= LANDLOCK_ACCESS_FS_TRUNCATE;
+		rs.file_access |= LANDLOCK_ACCESS_FS_TRUNCATE;
+	}
+	rs.dir_access = attr.handled_access_fs;
+
+	rs.fd = landlock_create_ruleset((const struct landlock_ruleset_attr *) &attr, sizeof(attr), 0);
+	if (rs.fd < 0) {
+		fprintf(stderr, "Error: %s: failed to create Landlock ruleset (abi=%d fs=%llx): %s\n",
+		        __func__, ll_abi, attr.handled_access_fs, strerror(errno));
+		exit(1);
+	}
+
+	int rootfd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (rootfd == -1)
+		errExit("open");
+	// the rules are inherited by everything below the directory, READ_DIR
+	// cannot be granted on / without granting it on a blacklisted directory:
+	// the entries of a blacklisted directory can still be listed, the
+	// entries themselves cannot be opened
+	bl_add_rule(&rs, rootfd, LANDLOCK_ACCESS_FS_READ_DIR, "/");
+	bl_walk(&rs, rootfd, "/");
+	close(rootfd);
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0)) {
+		fprintf(stderr, "Error: %s: failed to restrict privileges: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	if (landlock_restrict_self(rs.fd, 0)) {
+		fprintf(stderr, "Error: %s: failed to enforce Landlock: %s\n", __func__, strerror(errno));
+		exit(1);
+	}
+	close(rs.fd);
+	fmessage("%d paths blacklisted with %d Landlock rules in %0.2f ms\n", rs.cnt, rs.rules, timetrace_end());
+
+	int i;
+	for (i = 0; i < rs.cnt; i++)
+		free(rs.entry[i].path);
+	free(rs.entry);
 }
 
 #else
 
+int arg_blacklist_landlock = 0;
+
+// the paths are mounted over
+void ll_blacklist_mode(const char *mode) {
+	if (strcmp(mode, "landlock") != 0 && strcmp(mode, "mount") != 0) {
+		fprintf(stderr, "Error: invalid blacklist mode %s, landlock or mount expected\n", mode);
+		exit(1);
+	}
+}
+
+int ll_blacklist_add(const char *fname, mode_t mode) {
+	(void) fname;
+	(void) mode;
+
+	return 0;
+}
+
+void ll_blacklist_save(void) {
+}
+
+void ll_blacklist_restrict(void) {
+}
+
 int ll_get_fd(void) {
 	return -1;
 }
@@ -307,6 +957,10 @@ int ll_restrict(uint32_t flags) {
 	return 0;
 }
 
+const char *ll_stats_args(void) {
+	return NULL;
+}
+
 void ll_add_profile(int type, const char *data) {
 	(void) type;
 	(void) data;
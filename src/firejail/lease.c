@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// IP address leases for the sandboxes connected to a bridge device.
+//
+// Every bridge subnet has a bitmap in RUN_FIREJAIL_NETWORK_DIR/lease-<network>-<bits>,
+// one bit for each address in the subnet. The addresses are handed out under
+// the network directory lock; the lease file itself is locked with flock() for
+// each update, so the release doesn't need the directory lock. The addresses
+// leased by a sandbox are listed in RUN_FIREJAIL_NETWORK_DIR/<pid>-lease, and
+// they are released by delete_run_files(). The leases of the sandboxes killed
+// before they could clean up are reclaimed on the next allocation.
+//
+// The other hosts on the bridge are not known; with "arp-check yes" in
+// firejail.config the leased address is verified with ARP.
+
+#include "firejail.h"
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#define LEASE_MAGIC 0x4c454131	// "LEA1"
+#define LEASE_MAX_BITS 8	// no bitmaps for networks larger than /8
+#define MAXBUF 4096
+
+typedef struct {
+	uint32_t magic;
+	uint32_t network;
+	uint32_t mask;
+	uint32_t next;		// the next address index to try
+	uint64_t map[];		// one bit per address in the subnet
+} LeaseMap;
+
+typedef struct {
+	int fd;
+	LeaseMap *lm;
+	size_t size;
+} Lease;
+
+static size_t lease_size(uint32_t mask) {
+	uint64_t range = (uint64_t) ~mask + 1;
+	return sizeof(LeaseMap) + ((range + 63) / 64) * sizeof(uint64_t);
+}
+
+// open, lock and map the lease file; the bitmap is initialized if the file is new
+// return -1 if the file cannot be used
+static int lease_open(Lease *l, const char *fname, uint32_t network, uint32_t mask) {
+	l->fd = open(fname, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+	if (l->fd == -1)
+		return -1;
+	if (flock(l->fd, LOCK_EX) == -1)
+		goto errout;
+
+	struct stat s;
+	if (fstat(l->fd, &s) == -1 || s.st_uid != 0 || !S_ISREG(s.st_mode))
+		goto errout;
+	l->size = lease_size(mask);
+	int new = (s.st_size == 0);
+	if (!new && (size_t) s.st_size != l->size)
+		goto errout;
+	if (new && ftruncate(l->fd, l->size) == -1)
+		goto errout;
+
+	l->lm = mmap(NULL, l->size, PROT_READ | PROT_WRITE, MAP_SHARED, l->fd, 0);
+	if (l->lm == MAP_FAILED)
+		goto errout;
+	if (new) {
+		l->lm->magic = LEASE_MAGIC;
+		l->lm->network = network;
+		l->lm->mask = mask;
+	}
+	if (l->lm->magic != LEASE_MAGIC || l->lm->network != network || l->lm->mask != mask) {
+		munmap(l->lm, l->size);
+		goto errout;
+	}
+	return 0;
+
+errout:
+	close(l->fd);	// this also releases the lock
+	return -1;
+}
+
+static void lease_close(Lease *l) {
+	munmap(l->lm, l->size);
+	close(l->fd);
+}
+
+static char *lease_fname(uint32_t network, uint32_t mask) {
+	char *fname;
+	if (asprintf(&fname, "%s/lease-%d.%d.%d.%d-%d", RUN_FIREJAIL_NETWORK_DIR,
+		     PRINT_IP(network), mask2bits(mask)) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+static char *pid_fname(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d-lease", RUN_FIREJAIL_NETWORK_DIR, (int) pid) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+static inline int bit_test(const uint64_t *map, uint32_t i) {
+	return (map[i / 64] >> (i % 64)) & 1;
+}
+
+// first clear bit in [from, to], -1 if none
+static int64_t bit_find_clear(const uint64_t *map, uint32_t from, uint32_t to) {
+	while (from <= to) {
+		uint64_t word = ~map[from / 64] & (~0ULL << (from % 64));
+		if (word) {
+			uint32_t i = (from & ~63U) + __builtin_ctzll(word);
+			return (i <= to) ? (int64_t) i : -1;
+		}
+		from = (from | 63U) + 1;
+	}
+	return -1;
+}
+
+// record the lease in the run file of the sandbox
+static void lease_record(const char *lease, uint32_t ip) {
+	char *fname = pid_fname(sandbox_pid);
+	FILE *fp = fopen(fname, "ae");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot create %s\n", fname);
+		exit(1);
+	}
+	fprintf(fp, "%s %u\n", lease, ip);
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+	free(fname);
+}
+
+// release the leases of the sandbox
+void lease_release(pid_t pid) {
+	char *fname = pid_fname(pid);
+	FILE *fp = fopen(fname, "re");
+	if (!fp) {
+		free(fname);
+		return;
+	}
+
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		char lease[MAXBUF];
+		uint32_t ip;
+		if (sscanf(buf, "%4095s %u", lease, &ip) != 2)
+			continue;
+		// lease-<network>-<bits> in RUN_FIREJAIL_NETWORK_DIR
+		if (strncmp(lease, "lease-", 6) || strchr(lease, '/'))
+			continue;
+
+		char *leasefile;
+		if (asprintf(&leasefile, "%s/%s", RUN_FIREJAIL_NETWORK_DIR, lease) == -1)
+			errExit("asprintf");
+		int fd = open(leasefile, O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+		free(leasefile);
+		if (fd == -1)
+			continue;
+
+		struct stat s;
+		if (flock(fd, LOCK_EX) == 0 && fstat(fd, &s) == 0 && (size_t) s.st_size > sizeof(LeaseMap)) {
+			LeaseMap *lm = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (lm != MAP_FAILED) {
+				uint32_t i = ip - lm->network;
+				if (lm->magic == LEASE_MAGIC && (ip & lm->mask) == lm->network &&
+				    lease_size(lm->mask) == (size_t) s.st_size) {
+					lm->map[i / 64] &= ~(1ULL << (i % 64));
+					if (arg_debug)
+						printf("Release IP address %d.%d.%d.%d\n", PRINT_IP(ip));
+				}
+				munmap(lm, s.st_size);
+			}
+		}
+		close(fd);
+	}
+	fclose(fp);
+
+	unlink(fname);
+	free(fname);
+}
+
+// release the leases of the sandboxes gone
+static void lease_reclaim(void) {
+	DIR *dir = opendir(RUN_FIREJAIL_NETWORK_DIR);
+	if (!dir)
+		return;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		char *end;
+		pid_t pid = strtol(entry->d_name, &end, 10);
+		if (end == entry->d_name || strcmp(end, "-lease") != 0 || pid <= 0)
+			continue;
+		if (pid == sandbox_pid)
+			continue;
+		if (kill(pid, 0) == -1 && errno == ESRCH)
+			lease_release(pid);
+	}
+	closedir(dir);
+}
+
+// lease the address configured with --ip; exit if it is leased by another sandbox
+void lease_reserve(Bridge *br) {
+	assert(br);
+	assert(br->ipsandbox);
+	if (mask2bits(br->mask) < LEASE_MAX_BITS)
+		return;
+
+	uint32_t network = br->ip & br->mask;
+	char *fname = lease_fname(network, br->mask);
+	Lease l;
+	if (lease_open(&l, fname, network, br->mask) == -1) {
+		fwarning("cannot use %s\n", fname);
+		free(fname);
+		return;
+	}
+
+	uint32_t i = br->ipsandbox - network;
+	if (bit_test(l.lm->map, i)) {
+		// the sandbox holding the lease could be gone
+		lease_close(&l);
+		lease_reclaim();
+		if (lease_open(&l, fname, network, br->mask) == -1)
+			errExit("lease_open");
+		if (bit_test(l.lm->map, i)) {
+			fprintf(stderr, "Error: IP address %d.%d.%d.%d is already in use\n", PRINT_IP(br->ipsandbox));
+			exit(1);
+		}
+	}
+	l.lm->map[i / 64] |= 1ULL << (i % 64);
+	lease_close(&l);
+
+	lease_record(strrchr(fname, '/') + 1, br->ipsandbox);
+	free(fname);
+}
+
+// scan the bitmap from the last address leased, the addresses released
+// recently are not handed out again right away
+static uint32_t lease_find(Lease *l, Bridge *br, uint32_t first, uint32_t last) {
+	uint32_t network = l->lm->network;
+	uint32_t start = (l->lm->next >= first && l->lm->next <= last) ? l->lm->next : first;
+	int arp = checkcfg(CFG_ARP_CHECK);
+	int pass;
+	for (pass = 0; pass < 2; pass++) {
+		uint32_t from = (pass == 0) ? start : first;
+		uint32_t to = (pass == 0) ? last : start - 1;
+		while (from <= to) {
+			int64_t i = bit_find_clear(l->lm->map, from, to);
+			if (i == -1)
+				break;
+			from = i + 1;
+
+			uint32_t ip = network + i;
+			// do not allow the interface address or the default gateway
+			if (ip == br->ip || ip == cfg.defaultgw)
+				continue;
+			// the address could be used by a host not started by firejail
+			if (arp && arp_check(br->dev, ip))
+				continue;
+
+			l->lm->map[i / 64] |= 1ULL << (i % 64);
+			l->lm->next = i + 1;
+			return ip;
+		}
+	}
+	return 0;
+}
+
+// lease an IP address for a bridge device; the caller holds the network directory lock
+// return 0 if the leases are not available for this network
+uint32_t lease_assign(Bridge *br) {
+	assert(br);
+	uint32_t ifip = br->ip;
+	uint32_t ifmask = br->mask;
+	assert(ifip);
+	assert(ifmask);
+	if (mask2bits(ifmask) < LEASE_MAX_BITS)
+		return 0;
+
+	// range based on network address, without the network address and the broadcast address
+	uint32_t network = ifip & ifmask;
+	uint32_t range = ~ifmask + 1;
+	if (range < 4)
+		return 0;
+	uint32_t first = 1;
+	uint32_t last = range - 2;
+	// adjust the range based on --iprange params
+	if (br->iprange_start && br->iprange_end) {
+		first = br->iprange_start - network;
+		last = br->iprange_end - network;
+	}
+	if (arg_debug)
+		printf("Lease IP address range from %d.%d.%d.%d to %d.%d.%d.%d\n",
+			PRINT_IP(network + first), PRINT_IP(network + last));
+
+	char *fname = lease_fname(network, ifmask);
+	Lease l;
+	if (lease_open(&l, fname, network, ifmask) == -1) {
+		fwarning("cannot use %s, falling back to ARP scanning\n", fname);
+		free(fname);
+		return 0;
+	}
+
+	uint32_t ip = lease_find(&l, br, first, last);
+	if (!ip) {
+		// the range could be full of leases of sandboxes gone
+		lease_close(&l);
+		lease_reclaim();
+		if (lease_open(&l, fname, network, ifmask) == -1)
+			errExit("lease_open");
+		ip = lease_find(&l, br, first, last);
+	}
+	lease_close(&l);
+
+	if (!ip) {
+		fprintf(stderr, "Error: cannot assign an IP address; it looks like all of them are in use.\n");
+		logerr("Cannot assign an IP address; it looks like all of them are in use.");
+		exit(1);
+	}
+	if (arg_debug)
+		printf("Lease IP address %d.%d.%d.%d\n", PRINT_IP(ip));
+
+	lease_record(strrchr(fname, '/') + 1, ip);
+	free(fname);
+	return ip;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <linux/loop.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+
+#ifndef LOOP_CONFIGURE
+#define LOOP_CONFIGURE 0x4C0A
+struct loop_config {
+	__u32 fd;
+	__u32 block_size;
+	struct loop_info64 info;
+	__u64 __reserved[8];
+};
+#endif
+
+#define LOOP_TAG "firejail-appimage"	// kept for the devices attached by older versions
+
+static void err_loop(char *msg) {
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+// The loop devices are set up read-only with LO_FLAGS_AUTOCLEAR, the kernel
+// detaches them when the last mount is gone and the last descriptor is closed.
+// The sandboxes running the same AppImage or the same --rootfs-image share
+// the device, and the filesystem mounted from it in every sandbox shares the
+// page cache. The device is
+// tagged in lo_file_name with the modification time of the file, a file
+// modified in place gets a new device. Each sandbox keeps a descriptor on
+// the device until it exits, so the device found cannot go away or be
+// attached to another file before the sandbox has mounted it.
+
+// wait up to one second for udev to create a device node
+static int open_dev(const char *dev) {
+	int fd = open(dev, O_RDONLY|O_CLOEXEC);
+	if (fd != -1 || errno != ENOENT)
+		return fd;
+
+	int ifd = inotify_init1(IN_CLOEXEC);
+	if (ifd == -1)
+		return -1;
+	if (inotify_add_watch(ifd, "/dev", IN_CREATE | IN_ATTRIB) == -1) {
+		close(ifd);
+		return -1;
+	}
+	int i;
+	for (i = 0; i < 10; i++) {
+		fd = open(dev, O_RDONLY|O_CLOEXEC);
+		if (fd != -1 || errno != ENOENT)
+			break;
+		struct pollfd pfd = { ifd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) > 0) {
+			char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+			if (read(ifd, buf, sizeof(buf)) == -1)
+				break;
+		}
+	}
+	close(ifd);
+	return fd;
+}
+
+static void loop_tag(char *tag, const struct stat *s) {
+	snprintf(tag, LO_NAME_SIZE, LOOP_TAG " %lld.%09ld", (long long) s->st_mtim.tv_sec, s->st_mtim.tv_nsec);
+}
+
+// find a loop device attached to the file by another sandbox
+// return an open descriptor, -1 if not found
+static int loop_find(const struct stat *s, unsigned long long size, const char *tag, char **devloop) {
+	DIR *dir = opendir("/sys/block");
+	if (!dir)
+		return -1;
+
+	int lfd = -1;
+	struct dirent *entry;
+	while (lfd == -1 && (entry = readdir(dir)) != NULL) {
+		int devnr;
+		char c;
+		if (sscanf(entry->d_name, "loop%d%c", &devnr, &c) != 1)
+			continue;
+
+		// attached devices only
+		char *fname;
+		if (asprintf(&fname, "/sys/block/%s/loop/offset", entry->d_name) == -1)
+			errExit("asprintf");
+		FILE *fp = fopen(fname, "re");
+		free(fname);
+		if (!fp)
+			continue;
+		unsigned long long offset;
+		int rv = fscanf(fp, "%llu", &offset);
+		fclose(fp);
+		if (rv != 1 || offset != size)
+			continue;
+
+		char *dev;
+		if (asprintf(&dev, "/dev/%s", entry->d_name) == -1)
+			errExit("asprintf");
+		lfd = open(dev, O_RDONLY|O_CLOEXEC);
+		if (lfd == -1) {
+			free(dev);
+			continue;
+		}
+
+		// the device is checked once it is open: it cannot change anymore
+		struct loop_info64 info;
+		if (ioctl(lfd, LOOP_GET_STATUS64, &info) == -1 ||
+		    info.lo_device != s->st_dev || info.lo_inode != s->st_ino ||
+		    info.lo_offset != size ||
+		    (info.lo_flags & (LO_FLAGS_READ_ONLY | LO_FLAGS_AUTOCLEAR)) != (LO_FLAGS_READ_ONLY | LO_FLAGS_AUTOCLEAR) ||
+		    strncmp((char *) info.lo_file_name, tag, LO_NAME_SIZE) != 0) {
+			close(lfd);
+			lfd = -1;
+			free(dev);
+			continue;
+		}
+		*devloop = dev;
+	}
+	closedir(dir);
+	return lfd;
+}
+
+// attach the file to a free loop device
+// return an open descriptor
+static int loop_attach(int ffd, unsigned long long size, const char *tag, char **devloop) {
+	int cfd; // loop control fd
+	if ((cfd = open_dev("/dev/loop-control")) == -1)
+		err_loop("cannot open /dev/loop-control");
+
+	struct loop_config config;
+	memset(&config, 0, sizeof(config));
+	config.fd = ffd;
+	config.info.lo_offset = size;
+	config.info.lo_flags = LO_FLAGS_READ_ONLY | LO_FLAGS_AUTOCLEAR;
+	memcpy(config.info.lo_file_name, tag, LO_NAME_SIZE);
+
+	// the free device could be taken by another process before it is attached
+	int lfd = -1;
+	int i;
+	for (i = 0; i < 10 && lfd == -1; i++) {
+		int devnr; // loop device number
+		if ((devnr = ioctl(cfd, LOOP_CTL_GET_FREE)) == -1)
+			err_loop("cannot get a free loop device number");
+		free(*devloop);
+		if (asprintf(devloop, "/dev/loop%d", devnr) == -1)
+			errExit("asprintf");
+
+		if ((lfd = open_dev(*devloop)) == -1)
+			err_loop("cannot open loop device");
+
+		// associate loop device with the file, in one call if the kernel
+		// supports it (Linux 5.8)
+		if (ioctl(lfd, LOOP_CONFIGURE, &config) == 0)
+			break;
+		if (errno == EBUSY) {
+			close(lfd);
+			lfd = -1;
+			continue;
+		}
+		if (errno != EINVAL && errno != ENOTTY)
+			err_loop("cannot associate loop device with the image file");
+
+		if (ioctl(lfd, LOOP_SET_FD, ffd) == -1) {
+			if (errno != EBUSY)
+				err_loop("cannot associate loop device with the image file");
+			close(lfd);
+			lfd = -1;
+			continue;
+		}
+		if (ioctl(lfd, LOOP_SET_STATUS64, &config.info) == -1)
+			err_loop("cannot set loop status");
+	}
+	close(cfd);
+	if (lfd == -1)
+		err_loop("cannot associate loop device with the image file");
+	return lfd;
+}
+
+// find a loop device attached to the file at this offset, or attach a free
+// one; return an open descriptor, the device name in devloop
+int loop_device_get(int ffd, unsigned long long offset, char **devloop) {
+	assert(devloop);
+	struct stat s;
+	if (fstat(ffd, &s) == -1)
+		errExit("fstat");
+
+	// the sandboxes starting on the same file are serialized
+	char tag[LO_NAME_SIZE];
+	loop_tag(tag, &s);
+	EUID_ROOT();
+	int lock = open(RUN_APPIMAGE_LOCK_FILE, O_RDONLY|O_CREAT|O_CLOEXEC|O_NOFOLLOW, S_IRUSR|S_IWUSR);
+	if (lock == -1)
+		errExit("open");
+	if (flock(lock, LOCK_EX) == -1)
+		errExit("flock");
+	int lfd = loop_find(&s, offset, tag, devloop);
+	if (lfd != -1) {
+		if (arg_debug)
+			printf("Using %s, already attached to the file\n", *devloop);
+	}
+	else
+		lfd = loop_attach(ffd, offset, tag, devloop);
+	close(lock);
+	EUID_USER();
+	return lfd;
+}
+
+// the device is detached by the kernel when the other sandboxes using it
+// are gone
+void loop_device_release(int lfd) {
+	if (lfd == -1)
+		return;
+	EUID_ROOT();
+	if (ioctl(lfd, LOOP_CLR_FD, 0) != -1 && arg_debug)
+		printf("Loop device detached\n");
+	close(lfd);
+}
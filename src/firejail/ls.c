@@ -28,168 +28,210 @@
 #include <pwd.h>
 #include <grp.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/syscall.h>
 //#include <dirent.h>
 //#include <stdio.h>
 //#include <stdlib.h>
 
-// uid/gid cache
-static uid_t c_uid = 0;
-static char *c_uid_name = NULL;
-
-static void print_file_or_dir(const char *path, const char *fname) {
-	assert(fname);
-
+// uid/gid name cache, kept for the whole listing; the names come from the
+// passwd and group files of the sandbox, every NSS lookup reads them again
+#define NAME_CACHE_MAX 64
+typedef struct {
+	unsigned id;
 	char *name;
-	if (asprintf(&name, "%s/%s", path, fname) == -1)
-		errExit("asprintf");
-
-	struct stat s;
-	if (stat(name, &s) == -1) {
-		if (lstat(name, &s) == -1) {
-			printf("Error: cannot access %s\n", do_replace_cntrl_chars(name, '?'));
-			free(name);
-			return;
-		}
+} IdName;
+static IdName uid_cache[NAME_CACHE_MAX];
+static int uid_cnt = 0;
+static IdName gid_cache[NAME_CACHE_MAX];
+static int gid_cnt = 0;
+
+static const char *id_name(unsigned id, int group) {
+	if (id == 0)
+		return "root";
+	IdName *cache = (group) ? gid_cache : uid_cache;
+	int *cnt = (group) ? &gid_cnt : &uid_cnt;
+	int i;
+	for (i = 0; i < *cnt; i++) {
+		if (cache[i].id == id)
+			return cache[i].name;
 	}
-	free(name);
 
-	// permissions
-	if (S_ISLNK(s.st_mode))
-		printf("l");
-	else if (S_ISDIR(s.st_mode))
-		printf("d");
-	else if (S_ISCHR(s.st_mode))
-		printf("c");
-	else if (S_ISBLK(s.st_mode))
-		printf("b");
-	else if (S_ISSOCK(s.st_mode))
-		printf("s");
-	else
-		printf("-");
-	printf( (s.st_mode & S_IRUSR) ? "r" : "-");
-	printf( (s.st_mode & S_IWUSR) ? "w" : "-");
-	printf( (s.st_mode & S_IXUSR) ? "x" : "-");
-	printf( (s.st_mode & S_IRGRP) ? "r" : "-");
-	printf( (s.st_mode & S_IWGRP) ? "w" : "-");
-	printf( (s.st_mode & S_IXGRP) ? "x" : "-");
-	printf( (s.st_mode & S_IROTH) ? "r" : "-");
-	printf( (s.st_mode & S_IWOTH) ? "w" : "-");
-	printf( (s.st_mode & S_IXOTH) ? "x" : "-");
-	printf(" ");
-
-	// user name
-	char *username;
-	int allocated = 0;
-	if (s.st_uid == 0)
-		username = "root";
-	else if (s.st_uid == c_uid) {
-		assert(c_uid_name);
-		username = c_uid_name;
+	char *name = NULL;
+	if (group) {
+		struct group *g = getgrgid(id);
+		if (g && (name = strdup(g->gr_name)) == NULL)
+			errExit("strdup");
 	}
 	else {
-		struct passwd *pw = getpwuid(s.st_uid);
-		allocated = 1;
-		if (!pw) {
-			if (asprintf(&username, "%d", s.st_uid) == -1)
-				errExit("asprintf");
-		}
-		else {
-			username = strdup(pw->pw_name);
-			if (!username)
-				errExit("asprintf");
-		}
-
-		if (c_uid == 0) {
-			c_uid = s.st_uid;
-			c_uid_name = strdup(username);
-			if (!c_uid_name)
-				errExit("asprintf");
-		}
+		struct passwd *pw = getpwuid(id);
+		if (pw && (name = strdup(pw->pw_name)) == NULL)
+			errExit("strdup");
 	}
+	if (!name && asprintf(&name, "%u", id) == -1)
+		errExit("asprintf");
+
+	// a full cache recycles the last entry
+	if (*cnt == NAME_CACHE_MAX)
+		free(cache[--(*cnt)].name);
+	cache[*cnt].id = id;
+	cache[*cnt].name = name;
+	(*cnt)++;
+	return name;
+}
 
-	// print user name, 8 chars maximum
-	int len = strlen(username);
-	if (len > 8) {
-		username[8] = '\0';
-		len = 8;
+// only the fields printed are requested from the filesystem; the links
+// are followed, a broken link is reported as a link
+static int ls_stat(int dirfd, const char *name, struct stat *s) {
+#ifdef STATX_TYPE
+	struct statx sx;
+	unsigned mask = STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_SIZE;
+	if (statx(dirfd, name, AT_NO_AUTOMOUNT, mask, &sx) == 0 ||
+	    statx(dirfd, name, AT_NO_AUTOMOUNT | AT_SYMLINK_NOFOLLOW, mask, &sx) == 0) {
+		memset(s, 0, sizeof(*s));
+		s->st_mode = sx.stx_mode;
+		s->st_uid = sx.stx_uid;
+		s->st_gid = sx.stx_gid;
+		s->st_size = (off_t) sx.stx_size;
+		return 0;
 	}
-	printf("%s ", username);
-	int i;
-	for (i = len; i < 8; i++)
-		printf(" ");
-	if (allocated)
-		free(username);
+	if (errno != ENOSYS)
+		return -1;
+#endif
+	if (fstatat(dirfd, name, s, 0) == 0 ||
+	    fstatat(dirfd, name, s, AT_SYMLINK_NOFOLLOW) == 0)
+		return 0;
+	return -1;
+}
 
+static const char *file_type(mode_t mode) {
+	if (S_ISLNK(mode))
+		return "l";
+	else if (S_ISDIR(mode))
+		return "d";
+	else if (S_ISCHR(mode))
+		return "c";
+	else if (S_ISBLK(mode))
+		return "b";
+	else if (S_ISSOCK(mode))
+		return "s";
+	return "-";
+}
 
-	// group name
-	char *groupname;
-	allocated = 0;
-	if (s.st_uid == 0)
-		groupname = "root";
-	else {
-		struct group *g = getgrgid(s.st_gid);
-		allocated = 1;
-		if (!g) {
-			if (asprintf(&groupname, "%d", s.st_gid) == -1)
-				errExit("asprintf");
-		}
-		else {
-			groupname = strdup(g->gr_name);
-			if (!groupname)
-				errExit("asprintf");
+static void print_file_or_dir(int dirfd, const char *path, const char *fname, int jsonl) {
+	assert(path);
+	assert(fname);
+
+	struct stat s;
+	if (ls_stat(dirfd, fname, &s) == -1) {
+		char *name;
+		if (asprintf(&name, "%s/%s", path, fname) == -1)
+			errExit("asprintf");
+		if (jsonl) {
+			fputs("{\"name\":", stdout);
+			json_print_string(stdout, fname);
+			fputs(",\"error\":\"cannot access\"}\n", stdout);
 		}
+		else
+			printf("Error: cannot access %s\n", do_replace_cntrl_chars(name, '?'));
+		free(name);
+		return;
 	}
-
-	// print group name, 8 chars maximum
-	len = strlen(groupname);
-	if (len > 8) {
-		groupname[8] = '\0';
-		len = 8;
+	const char *username = id_name(s.st_uid, 0);
+	const char *groupname = id_name(s.st_gid, 1);
+
+	if (jsonl) {
+		fputs("{\"name\":", stdout);
+		json_print_string(stdout, fname);
+		printf(",\"type\":\"%s\",\"mode\":%u,\"uid\":%u,\"user\":",
+		       file_type(s.st_mode), (unsigned) (s.st_mode & 07777), (unsigned) s.st_uid);
+		json_print_string(stdout, username);
+		printf(",\"gid\":%u,\"group\":", (unsigned) s.st_gid);
+		json_print_string(stdout, groupname);
+		printf(",\"size\":%jd}\n", (intmax_t) s.st_size);
+		return;
 	}
-	printf("%s ", groupname);
-	for (i = len; i < 8; i++)
-		printf(" ");
-	if (allocated)
-		free(groupname);
 
-	// file size
+	// permissions
+	char perm[10];
+	const char *rwx = "rwxrwxrwx";
+	int i;
+	for (i = 0; i < 9; i++)
+		perm[i] = (s.st_mode & (S_IRUSR >> i)) ? rwx[i] : '-';
+	perm[9] = '\0';
+
+	// user and group names, 8 chars maximum
 	char *sz;
 	if (asprintf(&sz, "%jd", (intmax_t) s.st_size) == -1)
 		errExit("asprintf");
-
-	// file name
 	char *fname_print = replace_cntrl_chars(fname, '?');
 
-	printf("%11.10s %s\n", sz, fname_print);
+	printf("%s%s %-8.8s %-8.8s %11.10s %s\n", file_type(s.st_mode), perm,
+	       username, groupname, sz, fname_print);
 	free(sz);
 	free(fname_print);
 }
 
-static void print_directory(const char *path) {
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static int compare_names(const void *a, const void *b) {
+	return strcoll(*(char * const *) a, *(char * const *) b);
+}
+
+// the names are read in large batches with getdents64, sorted the same way
+// as alphasort()
+static void print_directory(const char *path, int jsonl) {
 	assert(path);
-	struct stat s;
-	if (stat(path, &s) == -1)
+	int fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (fd == -1)
 		return;
-	assert(S_ISDIR(s.st_mode));
-
-	struct dirent **namelist;
-	int i;
-	int n;
 
-	n = scandir(path, &namelist, 0, alphasort);
-	if (n < 0)
-		errExit("scandir");
-	else {
-		for (i = 0; i < n; i++)
-			print_file_or_dir(path, namelist[i]->d_name);
-		// get rid of false psitive reported by GCC -fanalyzer
-		for (i = 0; i < n; i++)
-			free(namelist[i]);
+	char **names = NULL;
+	size_t cnt = 0;
+	size_t max = 0;
+	char *buf = malloc(64 * 1024);
+	if (!buf)
+		errExit("malloc");
+	long len;
+	while ((len = syscall(SYS_getdents64, fd, buf, 64 * 1024)) > 0) {
+		long off = 0;
+		while (off < len) {
+			struct linux_dirent64 *d = (struct linux_dirent64 *) (buf + off);
+			off += d->d_reclen;
+			if (cnt == max) {
+				max = (max) ? max * 2 : 256;
+				names = realloc(names, max * sizeof(char *));
+				if (!names)
+					errExit("realloc");
+			}
+			names[cnt] = strdup(d->d_name);
+			if (!names[cnt])
+				errExit("strdup");
+			cnt++;
+		}
+	}
+	if (len == -1)
+		errExit("getdents64");
+	free(buf);
+
+	qsort(names, cnt, sizeof(char *), compare_names);
+	size_t i;
+	for (i = 0; i < cnt; i++) {
+		print_file_or_dir(fd, path, names[i], jsonl);
+		free(names[i]);
 	}
-	free(namelist);
+	free(names);
+	close(fd);
 }
 
-void ls(const char *path) {
+static void ls_format(const char *path, int jsonl) {
 	EUID_ASSERT();
 	assert(path);
 
@@ -210,7 +252,7 @@ void ls(const char *path) {
 		exit(1);
 	}
 	if (S_ISDIR(s.st_mode))
-		print_directory(rp);
+		print_directory(rp, jsonl);
 	else {
 		char *split = strrchr(rp, '/');
 		if (split) {
@@ -218,12 +260,22 @@ void ls(const char *path) {
 			char *rp2 = split + 1;
 			if (arg_debug)
 				printf("path %s, file %s\n", rp, rp2);
-			print_file_or_dir(rp, rp2);
+			int fd = open((*rp) ? rp : "/", O_PATH|O_DIRECTORY|O_CLOEXEC);
+			if (fd == -1) {
+				fprintf(stderr, "Error: cannot access %s\n", path);
+				exit(1);
+			}
+			print_file_or_dir(fd, rp, rp2, jsonl);
+			close(fd);
 		}
 	}
 	free(rp);
 }
 
+void ls(const char *path) {
+	ls_format(path, 0);
+}
+
 void cat(const char *path) {
 	EUID_ASSERT();
 	assert(path);
@@ -246,6 +298,13 @@ void cat(const char *path) {
 		exit(1);
 	}
 	int tty = isatty(STDOUT_FILENO);
+	if (!tty) {
+		// no filtering, the kernel moves the data
+		if (copy_file_by_fd(fd, STDOUT_FILENO) != 0)
+			fwarning("an error occurred during copying\n");
+		fclose(fp);
+		return;
+	}
 
 	int c;
 	while ((c = fgetc(fp)) != EOF) {
@@ -282,6 +341,181 @@ char *expand_path(const char *path) {
 	return fname;
 }
 
+// file transfer: the files above TRANSFER_FORK_SIZE are copied in parallel,
+// by up to one child process per cpu, TRANSFER_MAX_JOBS at most
+#define TRANSFER_FORK_SIZE (1024 * 1024)
+#define TRANSFER_MAX_JOBS 8
+static int transfer_max_jobs = 0;
+static int transfer_jobs = 0;
+static int transfer_errors = 0;
+
+static void transfer_wait(void) {
+	int status;
+	while (wait(&status) == -1) {
+		if (errno != EINTR)
+			errExit("wait");
+	}
+	transfer_jobs--;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		transfer_errors++;
+}
+
+// src and dst are closed
+static void transfer_file(int src, int dst, off_t size, const char *name) {
+	if (transfer_max_jobs == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		transfer_max_jobs = (cpus < 1) ? 1 : (cpus > TRANSFER_MAX_JOBS) ? TRANSFER_MAX_JOBS : (int) cpus;
+	}
+
+	if (size >= TRANSFER_FORK_SIZE && transfer_max_jobs > 1) {
+		while (transfer_jobs >= transfer_max_jobs)
+			transfer_wait();
+		pid_t child = fork();
+		if (child == -1)
+			errExit("fork");
+		if (child == 0) {
+			int rv = copy_file_by_fd(src, dst);
+			if (rv)
+				fwarning("an error occurred during copying %s\n", name);
+			_exit(rv ? 1 : 0);
+		}
+		transfer_jobs++;
+	}
+	else if (copy_file_by_fd(src, dst) != 0) {
+		fwarning("an error occurred during copying %s\n", name);
+		transfer_errors++;
+	}
+	close(src);
+	close(dst);
+}
+
+// copy the content of directory src into directory dst; every entry is
+// opened relative to its parent without following symbolic links, a
+// process in the sandbox replacing a directory with a link doesn't redirect
+// the copy. Symbolic links are copied as links, special files are skipped.
+static void transfer_tree(int src, int dst, const char *path) {
+	int fd = dup(src);
+	if (fd == -1)
+		errExit("dup");
+	DIR *dir = fdopendir(fd);
+	if (!dir)
+		errExit("fdopendir");
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		const char *name = entry->d_name;
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			continue;
+		char *fname;
+		if (asprintf(&fname, "%s/%s", path, name) == -1)
+			errExit("asprintf");
+
+		struct stat s;
+		if (fstatat(src, name, &s, AT_SYMLINK_NOFOLLOW) == -1) {
+			fwarning("cannot access %s\n", fname);
+			transfer_errors++;
+		}
+		else if (S_ISDIR(s.st_mode)) {
+			int dsrc = openat(src, name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+			mkdirat(dst, name, S_IRWXU);	// it could exist already
+			int ddst = openat(dst, name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+			if (dsrc == -1 || ddst == -1) {
+				fwarning("cannot copy directory %s\n", fname);
+				transfer_errors++;
+			}
+			else {
+				transfer_tree(dsrc, ddst, fname);
+				// only the permission bits
+				if (fchmod(ddst, (s.st_mode & 0777) | S_IRWXU) == -1)
+					errExit("fchmod");
+			}
+			if (dsrc != -1)
+				close(dsrc);
+			if (ddst != -1)
+				close(ddst);
+		}
+		else if (S_ISREG(s.st_mode)) {
+			int fsrc = openat(src, name, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+			int fdst = openat(dst, name, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW|O_CLOEXEC,
+				(s.st_mode & 0777) | S_IRUSR | S_IWUSR);
+			if (fsrc == -1 || fdst == -1) {
+				fwarning("cannot copy %s\n", fname);
+				transfer_errors++;
+				if (fsrc != -1)
+					close(fsrc);
+				if (fdst != -1)
+					close(fdst);
+			}
+			else
+				transfer_file(fsrc, fdst, s.st_size, fname);
+		}
+		else if (S_ISLNK(s.st_mode)) {
+			char target[PATH_MAX];
+			ssize_t len = readlinkat(src, name, target, sizeof(target) - 1);
+			if (len != -1) {
+				target[len] = '\0';
+				// replace a link left by a previous copy
+				struct stat old;
+				if (fstatat(dst, name, &old, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(old.st_mode))
+					unlinkat(dst, name, 0);
+			}
+			if (len == -1 || symlinkat(target, dst, name) == -1) {
+				fwarning("cannot copy symbolic link %s\n", fname);
+				transfer_errors++;
+			}
+		}
+		else
+			fwarning("%s is not a regular file, skipped\n", fname);
+		free(fname);
+	}
+	closedir(dir);
+}
+
+// the source is a directory: create dest_fname in dirfd and copy the tree
+static void transfer_directory(int src, int dirfd, const char *dest_fname) {
+	if (mkdirat(dirfd, dest_fname, S_IRWXU) == -1 && errno != EEXIST) {
+		fprintf(stderr, "Error: cannot create directory %s\n", dest_fname);
+		exit(1);
+	}
+	int dest = openat(dirfd, dest_fname, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (dest == -1) {
+		fprintf(stderr, "Error: %s is not a directory\n", dest_fname);
+		exit(1);
+	}
+
+	transfer_tree(src, dest, dest_fname);
+	while (transfer_jobs > 0)
+		transfer_wait();
+	close(dest);
+
+	if (transfer_errors) {
+		fprintf(stderr, "Error: %d files not copied\n", transfer_errors);
+		exit(1);
+	}
+}
+
+// src is a regular file: create or truncate dest_fname in dirfd and copy
+static void transfer_regular(int src, int dirfd, const char *dest_fname) {
+	int dest = openat(dirfd, dest_fname, O_WRONLY|O_CREAT|O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (dest == -1) {
+		fprintf(stderr, "Error: cannot open %s for writing\n", dest_fname);
+		exit(1);
+	}
+	struct stat s;
+	if (fstat(dest, &s) == -1)
+		errExit("fstat");
+	if (!S_ISREG(s.st_mode)) {
+		fprintf(stderr, "Error: %s is not a regular file\n", dest_fname);
+		exit(1);
+	}
+	if (ftruncate(dest, 0) == -1)
+		errExit("ftruncate");
+
+	if (copy_file_by_fd(src, dest) != 0)
+		fwarning("an error occurred during copying\n");
+	close(dest);
+}
+
 void sandboxfs(int op, pid_t pid, const char *path1, const char *path2) {
 	EUID_ASSERT();
 	assert(path1);
@@ -299,41 +533,43 @@ void sandboxfs(int op, pid_t pid, const char *path1, const char *path2) {
 		printf("file2 %s\n", fname2 ? fname2 : "(null)");
 	}
 
-	// get file from sandbox and store it in the current directory
-	// implemented using --cat
+	// get file or directory from sandbox and store it in the current directory
 	if (op == SANDBOX_FS_GET) {
 		char *dest_fname = strrchr(fname1, '/');
 		if (!dest_fname || *(++dest_fname) == '\0') {
 			fprintf(stderr, "Error: invalid file name %s\n", fname1);
 			exit(1);
 		}
-		// create destination file if necessary
 		EUID_ASSERT();
-		int dest = open(dest_fname, O_WRONLY|O_CREAT|O_CLOEXEC, S_IRUSR | S_IWUSR);
-		if (dest == -1) {
-			fprintf(stderr, "Error: cannot open %s for writing\n", dest_fname);
+		int cwd = open(".", O_PATH|O_DIRECTORY|O_CLOEXEC);
+		if (cwd == -1)
+			errExit("open");
+
+		// chroot into the sandbox
+		process_rootfs_chroot(sandbox);
+		unpin_process(sandbox);
+
+		// drop privileges
+		drop_privs(0);
+
+		int src = open(fname1, O_RDONLY|O_CLOEXEC);
+		struct stat s;
+		if (src == -1 || fstat(src, &s) == -1) {
+			fprintf(stderr, "Error: cannot read %s\n", fname1);
 			exit(1);
 		}
-		struct stat s;
-		if (fstat(dest, &s) == -1)
-			errExit("fstat");
-		if (!S_ISREG(s.st_mode)) {
-			fprintf(stderr, "Error: %s is not a regular file\n", dest_fname);
+		if (S_ISDIR(s.st_mode))
+			transfer_directory(src, cwd, dest_fname);
+		else if (S_ISREG(s.st_mode))
+			transfer_regular(src, cwd, dest_fname);
+		else {
+			fprintf(stderr, "Error: %s is not a regular file\n", fname1);
 			exit(1);
 		}
-		if (ftruncate(dest, 0) == -1)
-			errExit("ftruncate");
-		// go quiet - messages on stdout will corrupt the file
-		arg_debug = 0;
-		arg_quiet = 1;
-		// redirection
-		if (dup2(dest, STDOUT_FILENO) == -1)
-			errExit("dup2");
-		close(dest);
-		op = SANDBOX_FS_CAT;
-	}
-
-	if (op == SANDBOX_FS_LS || op == SANDBOX_FS_CAT) {
+		close(src);
+		close(cwd);
+	}
+	else if (op == SANDBOX_FS_LS || op == SANDBOX_FS_LS_JSONL || op == SANDBOX_FS_CAT) {
 		// chroot into the sandbox
 		process_rootfs_chroot(sandbox);
 		unpin_process(sandbox);
@@ -341,19 +577,20 @@ void sandboxfs(int op, pid_t pid, const char *path1, const char *path2) {
 		// drop privileges
 		drop_privs(0);
 
-		if (op == SANDBOX_FS_LS)
-			ls(fname1);
+		if (op == SANDBOX_FS_LS || op == SANDBOX_FS_LS_JSONL)
+			ls_format(fname1, op == SANDBOX_FS_LS_JSONL);
 		else
 			cat(fname1);
 	}
-	// get file from host and store it in the sandbox
+	// get file or directory from host and store it in the sandbox
 	else if (op == SANDBOX_FS_PUT && path2) {
 		char *src_fname = fname1;
 		char *dest_fname = fname2;
 
 		EUID_ASSERT();
 		int src = open(src_fname, O_RDONLY|O_CLOEXEC);
-		if (src == -1) {
+		struct stat s;
+		if (src == -1 || fstat(src, &s) == -1) {
 			fprintf(stderr, "Error: cannot open %s for reading\n", src_fname);
 			exit(1);
 		}
@@ -365,25 +602,11 @@ void sandboxfs(int op, pid_t pid, const char *path1, const char *path2) {
 		// drop privileges
 		drop_privs(0);
 
-		int dest = open(dest_fname, O_WRONLY|O_CREAT|O_CLOEXEC, S_IRUSR | S_IWUSR);
-		if (dest == -1) {
-			fprintf(stderr, "Error: cannot open %s for writing\n", dest_fname);
-			exit(1);
-		}
-		struct stat s;
-		if (fstat(dest, &s) == -1)
-			errExit("fstat");
-		if (!S_ISREG(s.st_mode)) {
-			fprintf(stderr, "Error: %s is not a regular file\n", dest_fname);
-			exit(1);
-		}
-		if (ftruncate(dest, 0) == -1)
-			errExit("ftruncate");
-
-		if (copy_file_by_fd(src, dest) != 0)
-			fwarning("an error occurred during copying\n");
+		if (S_ISDIR(s.st_mode))
+			transfer_directory(src, AT_FDCWD, dest_fname);
+		else
+			transfer_regular(src, AT_FDCWD, dest_fname);
 		close(src);
-		close(dest);
 	}
 
 	__gcov_flush();
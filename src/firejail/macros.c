@@ -70,6 +70,21 @@ Macro macro[] = {
 	{ 0 }
 };
 
+// Resolved directories are remembered for the life of the process, and
+// ~/.config/user-dirs.dirs is read only once. A directory not found is
+// looked up again on the next request, it might have been created meanwhile.
+#define MACRO_CNT ((int) (sizeof(macro) / sizeof(macro[0]) - 1))
+static char *resolved[MACRO_CNT];
+static char *user_dirs = NULL;	// content of ~/.config/user-dirs.dirs
+static int user_dirs_loaded = 0;
+
+static struct {
+	unsigned expansions;	// expand_macros calls
+	unsigned lookups;	// directory macros resolved
+	unsigned hits;		// ... found in the memo table
+	unsigned reads;		// user-dirs.dirs reads
+} mstats;
+
 // return -1 if not found
 int macro_id(const char *name) {
 	int i = 0;
@@ -92,6 +107,61 @@ int is_macro(const char *name) {
 	return 0;
 }
 
+// read ~/.config/user-dirs.dirs in memory
+static void load_user_dirs(void) {
+	EUID_ASSERT();
+	if (user_dirs_loaded)
+		return;
+	user_dirs_loaded = 1;
+
+	char *fname;
+	if (asprintf(&fname, "%s/.config/user-dirs.dirs", cfg.homedir) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return;
+	mstats.reads++;
+
+	size_t len = 0;
+	size_t size = MAXBUF;
+	user_dirs = malloc(size);
+	if (!user_dirs)
+		errExit("malloc");
+	size_t n;
+	while ((n = fread(user_dirs + len, 1, size - len - 1, fp)) > 0) {
+		len += n;
+		if (len + 1 == size) {
+			size *= 2;
+			user_dirs = realloc(user_dirs, size);
+			if (!user_dirs)
+				errExit("realloc");
+		}
+	}
+	user_dirs[len] = '\0';
+	fclose(fp);
+}
+
+// copy the next line of *data in buf, return 0 at the end of the data
+static int next_line(const char **data, char *buf, size_t size) {
+	const char *ptr = *data;
+	if (*ptr == '\0')
+		return 0;
+	const char *end = strchrnul(ptr, '\n');
+	size_t len = end - ptr;
+	if (*end == '\n')
+		len++;
+	*data = ptr + len;
+	// long lines are split, same as fgets
+	if (len > size - 1) {
+		*data = ptr + size - 1;
+		len = size - 1;
+	}
+	memcpy(buf, ptr, len);
+	buf[len] = '\0';
+	return 1;
+}
+
 // returns mallocated memory
 static char *resolve_xdg(const char *var) {
 	EUID_ASSERT();
@@ -99,17 +169,13 @@ static char *resolve_xdg(const char *var) {
 	struct stat s;
 	size_t length = strlen(var);
 
-	if (asprintf(&fname, "%s/.config/user-dirs.dirs", cfg.homedir) == -1)
-		errExit("asprintf");
-	FILE *fp = fopen(fname, "re");
-	if (!fp) {
-		free(fname);
+	load_user_dirs();
+	if (!user_dirs)
 		return NULL;
-	}
-	free(fname);
 
+	const char *data = user_dirs;
 	char buf[MAXBUF];
-	while (fgets(buf, MAXBUF, fp)) {
+	while (next_line(&data, buf, MAXBUF)) {
 		char *ptr = buf;
 
 		// skip blanks
@@ -122,7 +188,6 @@ static char *resolve_xdg(const char *var) {
 			char *ptr1 = ptr + length;
 			char *ptr2 = strchr(ptr1, '"');
 			if (ptr2) {
-				fclose(fp);
 				*ptr2 = '\0';
 				if (strlen(ptr1) != 0) {
 					if (asprintf(&fname, "%s/%s", cfg.homedir, ptr1) == -1)
@@ -145,7 +210,6 @@ static char *resolve_xdg(const char *var) {
 		}
 	}
 
-	fclose(fp);
 	return NULL;
 }
 
@@ -181,10 +245,24 @@ char *resolve_macro(const char *name) {
 	if (id == -1)
 		return NULL;
 
-	rv = resolve_xdg(macro[id].xdg);
-	if (rv == NULL)
-		rv = resolve_hardcoded(macro[id].translation);
-	if (rv && arg_debug)
+	mstats.lookups++;
+	if (resolved[id]) {
+		mstats.hits++;
+		rv = strdup(resolved[id]);
+		if (!rv)
+			errExit("strdup");
+	}
+	else {
+		rv = resolve_xdg(macro[id].xdg);
+		if (rv == NULL)
+			rv = resolve_hardcoded(macro[id].translation);
+		if (rv) {
+			resolved[id] = strdup(rv);
+			if (!resolved[id])
+				errExit("strdup");
+		}
+	}
+	if (rv && (arg_debug || arg_debug_macros))
 		printf("Directory %s resolved as %s\n", name, rv);
 
 	return rv;
@@ -208,6 +286,7 @@ char *expand_macros(const char *path) {
 	}
 
 	EUID_ASSERT();
+	mstats.expansions++;
 
 	// Replace home macro
 	char *new_name = NULL;
@@ -265,6 +344,15 @@ char *expand_macros(const char *path) {
 	return rv;
 }
 
+void macro_print_stats(void) {
+	if (!arg_debug_macros)
+		return;
+	printf("Macros: %u expansions, %u directory lookups, %u cached (%.0f%%), user-dirs.dirs read %u %s\n",
+	       mstats.expansions, mstats.lookups, mstats.hits,
+	       (mstats.lookups) ? 100.0 * mstats.hits / mstats.lookups : 0.0,
+	       mstats.reads, (mstats.reads == 1) ? "time" : "times");
+}
+
 void invalid_filename(const char *fname, int globbing) {
 //	EUID_ASSERT();
 	assert(fname);
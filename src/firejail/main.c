@@ -19,6 +19,7 @@
  */
 #include "firejail.h"
 #include "../include/pid.h"
+#include "../include/run_record.h"
 #include "../include/firejail_user.h"
 #include "../include/gcov_wrapper.h"
 #include "../include/syscall.h"
@@ -62,6 +63,28 @@ gid_t firejail_gid = 0;
 #define STACK_ALIGNMENT 16
 static char child_stack[STACK_SIZE] __attribute__((aligned(STACK_ALIGNMENT)));		// space for child's stack
 
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+// struct clone_args, Linux 5.7
+typedef struct {
+	uint64_t flags;
+	uint64_t pidfd;
+	uint64_t child_tid;
+	uint64_t parent_tid;
+	uint64_t exit_signal;
+	uint64_t stack;
+	uint64_t stack_size;
+	uint64_t tls;
+	uint64_t set_tid;
+	uint64_t set_tid_size;
+	uint64_t cgroup;
+} CloneArgs;
+
 Config cfg;					// configuration
 int lockfd_directory = -1;
 int lockfd_network = -1;
@@ -70,6 +93,7 @@ int arg_private_cache = 0;		// mount private home/.cache
 int arg_debug = 0;				// print debug messages
 int arg_debug_blacklists = 0;			// print debug messages for blacklists
 int arg_debug_whitelists = 0;			// print debug messages for whitelists
+int arg_debug_macros = 0;			// print macro expansion statistics
 int arg_debug_private_lib = 0;			// print debug messages for private-lib
 int arg_nonetwork = 0;				// --net=none
 int arg_command = 0;				// -c
@@ -80,6 +104,8 @@ int arg_seccomp = 0;				// enable default seccomp filter
 int arg_seccomp32 = 0;				// enable default seccomp filter for 32 bit arch
 int arg_seccomp_postexec = 0;			// need postexec ld.preload library?
 int arg_seccomp_block_secondary = 0;		// block any secondary architectures
+int arg_seccomp_spec_allow = 0;		// install the filters with SECCOMP_FILTER_FLAG_SPEC_ALLOW
+int arg_seccomp_tsync = 0;			// install the filters with SECCOMP_FILTER_FLAG_TSYNC
 int arg_seccomp_error_action = 0;
 
 int arg_caps_default_filter = 0;			// enable default capabilities filter
@@ -87,8 +113,10 @@ int arg_caps_drop = 0;				// drop list
 int arg_caps_drop_all = 0;			// drop all capabilities
 int arg_caps_keep = 0;			// keep list
 char *arg_caps_list = NULL;			// optional caps list
+uint64_t arg_caps_mask = 0;			// caps list resolved
 
 int arg_trace = 0;				// syscall tracing support
+int arg_trace_fanotify = 0;			// trace the opens with fanotify
 char *arg_tracefile = NULL;			// syscall tracing file
 int arg_tracelog = 0;				// blacklist tracing support
 int arg_rlimit_as = 0;				// rlimit as
@@ -108,7 +136,9 @@ int arg_netfilter;				// enable netfilter
 int arg_netfilter6;				// enable netfilter6
 char *arg_netfilter_file = NULL;			// netfilter file
 char *arg_netfilter6_file = NULL;		// netfilter6 file
+unsigned arg_dhcp_timeout = 0;			// --dhcp-timeout, seconds
 char *arg_netns = NULL;			// "ip netns"-created network namespace to use
+char *arg_net_group = NULL;		// --net-group name
 int arg_doubledash = 0;			// double dash
 int arg_private_dev = 0;			// private dev directory
 int arg_keep_dev_ntsync = 0;			// preserve /dev/ntsync
@@ -131,6 +161,11 @@ int arg_quiet = 0;				// no output for scripting
 int arg_join_network = 0;			// join only the network namespace
 int arg_join_filesystem = 0;			// join only the mount namespace
 int arg_nice = 0;				// nice value configured
+int arg_sched = 0;				// scheduling policy configured
+int arg_cgroup_leaf = 0;			// move the sandbox in its own cgroup
+int arg_perf_stat = 0;			// print the performance counters at exit
+int arg_numa = 0;				// NUMA_NODE or NUMA_AUTO
+int arg_memory_merge = 0;			// KSM merging of the anonymous memory
 int arg_ipc = 0;					// enable ipc namespace
 int arg_writable_etc = 0;			// writable etc
 int arg_keep_config_pulse = 0;			// disable automatic ~/.config/pulse init
@@ -140,6 +175,8 @@ int arg_keep_var_tmp = 0;			// don't overwrite /var/tmp
 int arg_writable_run_user = 0;			// writable /run/user
 int arg_writable_var_log = 0;		// writable /var/log
 int arg_appimage = 0;				// appimage
+int arg_instances = 0;				// number of sandboxes started
+int arg_warm_cache_run = 0;			// exit before the program is started
 int arg_apparmor = 0;				// apparmor
 char *apparmor_profile = NULL;	// apparmor profile
 bool apparmor_replace = false;	// apparmor profile
@@ -158,6 +195,7 @@ int arg_nou2f = 0; // --nou2f
 int arg_noinput = 0; // --noinput
 int arg_deterministic_exit_code = 0;	// always exit with first child's exit status
 int arg_deterministic_shutdown = 0;	// shut down the sandbox if first child dies
+int arg_shutdown_grace = -1;	// --shutdown-grace, ms, -1 for the default
 int arg_keep_fd_all = 0;		// inherit all file descriptors to sandbox
 DbusPolicy arg_dbus_user = DBUS_POLICY_ALLOW;	// --dbus-user
 DbusPolicy arg_dbus_system = DBUS_POLICY_ALLOW;	// --dbus-system
@@ -187,6 +225,7 @@ static void clear_atexit(void) {
 
 static void myexit(int rv) {
 	logmsg("exiting...");
+	perf_stat_print();
 	if (!arg_command)
 		fmessage("\nParent is shutting down, bye...\n");
 
@@ -198,10 +237,59 @@ static void myexit(int rv) {
 	EUID_ROOT();
 	delete_run_files(sandbox_pid);
 	appimage_clear();
+#ifdef HAVE_CHROOT
+	rootfs_image_clear();
+#endif
 	flush_stdin();
 	exit(rv);
 }
 
+// start the sandbox child; with clone3() and a cgroup descriptor the child
+// is created directly in its cgroup, and *in_cgroup is set
+static pid_t clone_sandbox(int flags, int cgroup_fd, int *in_cgroup) {
+	*in_cgroup = 0;
+	CloneArgs args;
+	memset(&args, 0, sizeof(args));
+	args.flags = flags & ~0xff;
+	args.exit_signal = flags & 0xff;
+	if (cgroup_fd != -1) {
+		args.flags |= CLONE_INTO_CGROUP;
+		args.cgroup = cgroup_fd;
+	}
+
+	// no stack: the child runs on a copy of the parent stack, as after fork()
+	pid_t pid = syscall(SYS_clone3, &args, sizeof(args));
+	if (pid == -1 && cgroup_fd != -1 && errno != ENOSYS) {
+		// the cgroup is set up later by cgroup_leaf_join(), errors included
+		args.flags &= ~CLONE_INTO_CGROUP;
+		args.cgroup = 0;
+		cgroup_fd = -1;
+		pid = syscall(SYS_clone3, &args, sizeof(args));
+	}
+	if (pid == 0)
+		_exit(sandbox(NULL));
+	if (pid > 0) {
+		*in_cgroup = (cgroup_fd != -1);
+		return pid;
+	}
+	if (errno != ENOSYS)
+		return -1;
+
+	// Linux < 5.3
+#ifdef __ia64__
+	return __clone2(sandbox,
+		child_stack,
+		STACK_SIZE,
+		flags,
+		NULL);
+#else
+	return clone(sandbox,
+		child_stack + STACK_SIZE,
+		flags,
+		NULL);
+#endif
+}
+
 static void my_handler(int s) {
 	fmessage("\nParent received signal %d, shutting down the child process...\n", s);
 	logsignal(s);
@@ -406,6 +494,14 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 		else
 			exit_err_feature("x11");
 	}
+	else if (strncmp(argv[i], "--x11-pool=", 11) == 0) {
+		if (checkcfg(CFG_X11)) {
+			x11_pool(argv[i] + 11);
+			exit(0);
+		}
+		else
+			exit_err_feature("x11");
+	}
 #endif
 	else if (strcmp(argv[i], "--nettrace") == 0) {
 		if (checkcfg(CFG_NETWORK)) {
@@ -564,9 +660,31 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 				}
 			}
 
+			// status --format=json prints the limits recorded for the sandbox
+			int json = 0;
+			if (strcmp(cmd, "status") == 0 && (i + 2) < argc) {
+				if (strcmp(argv[i + 2], "--format=json") != 0) {
+					fprintf(stderr, "Error: invalid --bandwidth status command\n");
+					exit(1);
+				}
+				json = 1;
+			}
+
 			// extract pid or sandbox name
 			pid_t pid = require_pid(argv[i] + 12);
-			bandwidth_pid(pid, cmd, dev, down, up);
+			if (json)
+				bandwidth_status_json(pid);
+			else
+				bandwidth_pid(pid, cmd, dev, down, up);
+		}
+		else
+			exit_err_feature("networking");
+		exit(0);
+	}
+	else if (strncmp(argv[i], "--net-pool=", 11) == 0) {
+		if (checkcfg(CFG_NETWORK)) {
+			logargs(argc, argv);
+			net_pool(argv[i] + 11);
 		}
 		else
 			exit_err_feature("networking");
@@ -615,9 +733,33 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 	}
 	else if (strncmp(argv[i], "--seccomp.print=", 16) == 0) {
 		if (checkcfg(CFG_SECCOMP)) {
-			// print seccomp filter for a sandbox specified by pid or by name
+			// print seccomp filter for a sandbox specified by pid or by name,
+			// the options following it are passed to fsec-print
+			int summary = 0;
+			int jsonl = 0;
+			int j;
+			for (j = i + 1; j < argc; j++) {
+				if (strcmp(argv[j], "--summary") == 0)
+					summary = 1;
+				else if (strcmp(argv[j], "--format=jsonl") == 0)
+					jsonl = 1;
+				else {
+					fprintf(stderr, "Error: invalid --seccomp.print option %s\n", argv[j]);
+					exit(1);
+				}
+			}
 			pid_t pid = require_pid(argv[i] + 16);
-			seccomp_print_filter(pid);
+			seccomp_print_filter(pid, summary, jsonl);
+		}
+		else
+			exit_err_feature("seccomp");
+		exit(0);
+	}
+	else if (strncmp(argv[i], "--seccomp.audit=", 16) == 0) {
+		if (checkcfg(CFG_SECCOMP)) {
+			// live seccomp violations of a sandbox specified by pid or by name
+			pid_t pid = require_pid(argv[i] + 16);
+			seccomp_audit(pid);
 		}
 		else
 			exit_err_feature("seccomp");
@@ -640,20 +782,13 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 	else if (strncmp(argv[i], "--profile.print=", 16) == 0) {
 		pid_t pid = require_pid(argv[i] + 16);
 
-		// print /run/firejail/profile/<PID> file
-		char *fname;
-		if (asprintf(&fname, RUN_FIREJAIL_PROFILE_DIR "/%d", pid) == -1)
-			errExit("asprintf");
-		FILE *fp = fopen(fname, "re");
-		if (!fp) {
+		// print the profile from the run record
+		RunRecord rec;
+		if (run_record_read(pid, &rec) == -1 || *rec.profile == '\0') {
 			fprintf(stderr, "Error: sandbox %s not found\n", argv[i] + 16);
 			exit(1);
 		}
-#define MAXBUF 4096
-		char buf[MAXBUF];
-		if (fgets(buf, MAXBUF, fp))
-			printf("%s", buf);
-		fclose(fp);
+		printf("%s\n", rec.profile);
 		exit(0);
 
 	}
@@ -663,6 +798,16 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 		cpu_print_filter(pid);
 		exit(0);
 	}
+	else if (strncmp(argv[i], "--memory.print=", 15) == 0) {
+		// join sandbox by pid or by name
+		pid_t pid = require_pid(argv[i] + 15);
+		char *pidstr;
+		if (asprintf(&pidstr, "%u", pid) == -1)
+			errExit("asprintf");
+		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FIREMON, "--memory", pidstr);
+		free(pidstr);
+		exit(0);
+	}
 	else if (strncmp(argv[i], "--apparmor.print=", 17) == 0) {
 		// join sandbox by pid or by name
 		pid_t pid = require_pid(argv[i] + 17);
@@ -814,12 +959,15 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 				exit(1);
 			}
 
-			// verify path
-			if ((i + 2) != argc) {
+			// verify path, optionally preceded by the output format
+			int op = SANDBOX_FS_LS;
+			if ((i + 3) == argc && strcmp(argv[i + 1], "--format=jsonl") == 0)
+				op = SANDBOX_FS_LS_JSONL;
+			else if ((i + 2) != argc) {
 				fprintf(stderr, "Error: invalid --ls option, path expected\n");
 				exit(1);
 			}
-			char *path = argv[i + 1];
+			char *path = argv[argc - 1];
 			invalid_filename(path, 0); // no globbing
 			if (strstr(path, "..")) {
 				fprintf(stderr, "Error: invalid file name %s\n", path);
@@ -830,7 +978,7 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 			if (!arg_debug)
 				arg_quiet = 1;
 			pid_t pid = require_pid(argv[i] + 5);
-			sandboxfs(SANDBOX_FS_LS, pid, path, NULL);
+			sandboxfs(op, pid, path, NULL);
 			exit(0);
 		}
 		else
@@ -952,6 +1100,49 @@ static void run_cmd_and_exit(int i, int argc, char **argv) {
 		shut(pid);
 		exit(0);
 	}
+	else if (strncmp(argv[i], "--pause=", 8) == 0) {
+		logargs(argc, argv);
+		pid_t pid = require_pid(argv[i] + 8);
+		sandbox_pause(pid);
+		exit(0);
+	}
+	else if (strncmp(argv[i], "--resume=", 9) == 0) {
+		logargs(argc, argv);
+		pid_t pid = require_pid(argv[i] + 9);
+		sandbox_resume(pid);
+		exit(0);
+	}
+	else if (strcmp(argv[i], "--warm-cache") == 0) {
+		logargs(argc, argv);
+		warm_cache(NULL);
+	}
+	else if (strncmp(argv[i], "--warm-cache=", 13) == 0) {
+		logargs(argc, argv);
+		if (argv[i][13] == '\0') {
+			fprintf(stderr, "Error: invalid --warm-cache option\n");
+			exit(1);
+		}
+		warm_cache(argv[i] + 13);
+	}
+	else if (strncmp(argv[i], "--pool-join=", 12) == 0) {
+		if (checkcfg(CFG_JOIN) || getuid() == 0) {
+			logargs(argc, argv);
+			if (argv[i][12] == '\0') {
+				fprintf(stderr, "Error: invalid pool name\n");
+				exit(1);
+			}
+
+			if (argc <= (i+1))
+				just_run_the_shell = 1;
+			cfg.original_program_index = i + 1;
+
+			// join an idle sandbox of the pool
+			pool_join(argv[i] + 12, argc, argv, i + 1);
+		}
+		else
+			exit_err_feature("join");
+		exit(0);
+	}
 
 }
 
@@ -1025,11 +1216,10 @@ void filter_add_blacklist_override(int fd, int syscall, int arg, void *ptrarg, b
 }
 
 static int check_postexec(const char *list) {
-	char *prelist, *postlist;
-
 	if (list && list[0]) {
-		syscalls_in_list(list, "@default-keep", -1, &prelist, &postlist, true);
-		if (postlist)
+		SyscallSet prelist, postlist;
+		syscalls_in_list(list, "@default-keep", &prelist, &postlist, NULL, true);
+		if (!syscall_set_empty(&postlist))
 			return 1;
 	}
 	return 0;
@@ -1155,12 +1345,16 @@ int main(int argc, char **argv, char **envp) {
 
 	// build /run/firejail directory structure
 	preproc_build_firejail_dir_unlocked();
-	preproc_lock_firejail_dir();
-	preproc_build_firejail_dir_locked();
+	preproc_build_firejail_dir();
+
+	// the leftover run files are removed by one process at a time;
+	// if another process is already cleaning, there is no need to wait
 	const char *container_name = env_get("container");
-	if (!container_name || strcmp(container_name, "firejail"))
+	if ((!container_name || strcmp(container_name, "firejail")) &&
+	    preproc_trylock_firejail_dir()) {
 		preproc_clean_run();
-	preproc_unlock_firejail_dir();
+		preproc_unlock_firejail_dir();
+	}
 
 	delete_run_files(getpid());
 	atexit(clear_atexit);
@@ -1347,6 +1541,10 @@ int main(int argc, char **argv, char **envp) {
 	if ((i = check_arg(argc, argv, "--oom=", 0)) != 0)
 		oom_set(argv[i] + 6);
 
+	// check shutdown grace period, used also by --shutdown
+	if ((i = check_arg(argc, argv, "--shutdown-grace=", 0)) != 0)
+		arg_shutdown_grace = extract_shutdown_grace(argv[i] + 17);
+
 	// parse arguments
 	for (i = 1; i < argc; i++) {
 		run_cmd_and_exit(i, argc, argv); // will exit if the command is recognized
@@ -1357,6 +1555,8 @@ int main(int argc, char **argv, char **envp) {
 		}
 		else if (strcmp(argv[i], "--debug-blacklists") == 0)
 			arg_debug_blacklists = 1;
+		else if (strcmp(argv[i], "--debug-macros") == 0)
+			arg_debug_macros = 1;
 		else if (strcmp(argv[i], "--debug-whitelists") == 0)
 			arg_debug_whitelists = 1;
 #ifdef HAVE_PRIVATE_LIB
@@ -1502,6 +1702,18 @@ int main(int argc, char **argv, char **envp) {
 			else
 				exit_err_feature("seccomp");
 		}
+		else if (strncmp(argv[i], "--seccomp.hot=", 14) == 0) {
+			if (checkcfg(CFG_SECCOMP))
+				cfg.seccomp_hot = seccomp_check_list(argv[i] + 14);
+			else
+				exit_err_feature("seccomp");
+		}
+		else if (strncmp(argv[i], "--seccomp.notify=", 17) == 0) {
+			if (checkcfg(CFG_SECCOMP))
+				cfg.seccomp_list_notify = seccomp_check_list(argv[i] + 17);
+			else
+				exit_err_feature("seccomp");
+		}
 		else if (strcmp(argv[i], "--seccomp.block-secondary") == 0) {
 			if (checkcfg(CFG_SECCOMP)) {
 				if (arg_seccomp32) {
@@ -1513,7 +1725,22 @@ int main(int argc, char **argv, char **envp) {
 			else
 				exit_err_feature("seccomp");
 		}
+		else if (strcmp(argv[i], "--seccomp.spec-allow") == 0) {
+			if (!checkcfg(CFG_SECCOMP))
+				exit_err_feature("seccomp");
+			if (!checkcfg(CFG_SECCOMP_SPEC_ALLOW))
+				exit_err_feature("seccomp-spec-allow");
+			arg_seccomp_spec_allow = 1;
+		}
+		else if (strcmp(argv[i], "--seccomp.tsync") == 0) {
+			if (checkcfg(CFG_SECCOMP))
+				arg_seccomp_tsync = 1;
+			else
+				exit_err_feature("seccomp");
+		}
 #ifdef HAVE_LANDLOCK
+		else if (strncmp(argv[i], "--blacklist-mode=", 17) == 0)
+			ll_blacklist_mode(argv[i] + 17);
 		else if (strncmp(argv[i], "--landlock.enforce", 18) == 0)
 			arg_landlock_enforce = 1;
 		else if (strncmp(argv[i], "--landlock.fs.read=", 19) == 0)
@@ -1526,6 +1753,10 @@ int main(int argc, char **argv, char **envp) {
 			ll_add_profile(LL_FS_MAKEDEV, argv[i] + 22);
 		else if (strncmp(argv[i], "--landlock.fs.execute=", 22) == 0)
 			ll_add_profile(LL_FS_EXEC, argv[i] + 22);
+		else if (strncmp(argv[i], "--landlock.net.bind=", 20) == 0)
+			ll_add_profile(LL_NET_BIND, argv[i] + 20);
+		else if (strncmp(argv[i], "--landlock.net.connect=", 23) == 0)
+			ll_add_profile(LL_NET_CONNECT, argv[i] + 23);
 #endif
 		else if (strcmp(argv[i], "--memory-deny-write-execute") == 0) {
 			if (checkcfg(CFG_SECCOMP))
@@ -1583,7 +1814,7 @@ int main(int argc, char **argv, char **envp) {
 			if (!arg_caps_list)
 				errExit("strdup");
 			// verify caps list and exit if problems
-			caps_check_list(arg_caps_list, NULL);
+			arg_caps_mask = caps_parse_list(arg_caps_list);
 			arg_caps_cmdline = 1;
 		}
 		else if (strncmp(argv[i], "--caps.keep=", 12) == 0) {
@@ -1592,11 +1823,15 @@ int main(int argc, char **argv, char **envp) {
 			if (!arg_caps_list)
 				errExit("strdup");
 			// verify caps list and exit if problems
-			caps_check_list(arg_caps_list, NULL);
+			arg_caps_mask = caps_parse_list(arg_caps_list);
 			arg_caps_cmdline = 1;
 		}
 		else if (strcmp(argv[i], "--trace") == 0)
 			arg_trace = 1;
+		else if (strcmp(argv[i], "--trace-fanotify") == 0) {
+			arg_trace = 1;
+			arg_trace_fanotify = 1;
+		}
 		else if (strncmp(argv[i], "--trace=", 8) == 0) {
 			arg_trace = 1;
 			arg_tracefile = expand_macros(argv[i] + 8);
@@ -1616,6 +1851,22 @@ int main(int argc, char **argv, char **envp) {
 			else
 				exit_err_feature("tracelog");
 		}
+		else if (strncmp(argv[i], "--profile-startup=", 18) == 0) {
+			char *fname = expand_macros(argv[i] + 18);
+			if (*fname == '\0') {
+				fprintf(stderr, "Error: invalid profile-startup option\n");
+				exit(1);
+			}
+			invalid_filename(fname, 0); // no globbing
+			if (strstr(fname, "..") || has_cntrl_chars(fname)) {
+				fprintf(stderr, "Error: invalid file name %s\n", fname);
+				exit(1);
+			}
+			sprof_init(fname);
+			free(fname);
+		}
+		else if (strcmp(argv[i], "--perf-stat") == 0)
+			arg_perf_stat = 1;
 		else if (strncmp(argv[i], "--rlimit-as=", 12) == 0) {
 			cfg.rlimit_as = parse_arg_size(argv[i] + 12);
 			if (cfg.rlimit_as == 0) {
@@ -1658,12 +1909,34 @@ int main(int argc, char **argv, char **envp) {
 			arg_ipc = 1;
 		else if (strncmp(argv[i], "--cpu=", 6) == 0)
 			read_cpu_list(argv[i] + 6);
+		else if (strncmp(argv[i], "--numa-node=", 12) == 0)
+			read_numa_node(argv[i] + 12);
+		else if (strcmp(argv[i], "--cgroup-leaf") == 0)
+			arg_cgroup_leaf = 1;
+		else if (strncmp(argv[i], "--cpu-max=", 10) == 0)
+			cgroup_read_limit("cpu-max", argv[i] + 10);
+		else if (strncmp(argv[i], "--cpu-weight=", 13) == 0)
+			cgroup_read_limit("cpu-weight", argv[i] + 13);
+		else if (strncmp(argv[i], "--memory-high=", 14) == 0)
+			cgroup_read_limit("memory-high", argv[i] + 14);
+		else if (strncmp(argv[i], "--memory-max=", 13) == 0)
+			cgroup_read_limit("memory-max", argv[i] + 13);
+		else if (strncmp(argv[i], "--io-max=", 9) == 0)
+			cgroup_read_limit("io-max", argv[i] + 9);
+		else if (strcmp(argv[i], "--memory-merge") == 0)
+			arg_memory_merge = 1;
 		else if (strncmp(argv[i], "--nice=", 7) == 0) {
 			cfg.nice = atoi(argv[i] + 7);
 			if (getuid() != 0 &&cfg.nice < 0)
 				cfg.nice = 0;
 			arg_nice = 1;
 		}
+		else if (strncmp(argv[i], "--ioprio=", 9) == 0)
+			read_ioprio(argv[i] + 9);
+		else if (strncmp(argv[i], "--sched=", 8) == 0)
+			read_sched(argv[i] + 8);
+		else if (strncmp(argv[i], "--sched-slice=", 14) == 0)
+			read_sched_slice(argv[i] + 14);
 
 		//*************************************
 		// filesystem
@@ -1682,6 +1955,16 @@ int main(int argc, char **argv, char **envp) {
 			else
 				exit_err_feature("bind");
 		}
+		else if (strncmp(argv[i], "--tmpfs-size=", 13) == 0 || strncmp(argv[i], "--tmpfs-inodes=", 15) == 0) {
+			char *line;
+			if (asprintf(&line, "%s", argv[i] + 2) == -1)
+				errExit("asprintf");
+			line[strcspn(line, "=")] = ' ';
+
+			// the limits are set while the line is checked
+			profile_check_line(line, 0, NULL);	// will exit if something wrong
+			free(line);
+		}
 		else if (strncmp(argv[i], "--tmpfs=", 8) == 0) {
 			char *line;
 			if (asprintf(&line, "tmpfs %s", argv[i] + 8) == -1)
@@ -1728,7 +2011,7 @@ int main(int argc, char **argv, char **envp) {
 			char *line;
 			if (asprintf(&line, "mkdir %s", argv[i] + 8) == -1)
 				errExit("asprintf");
-			/* Note: Applied both immediately in profile_check_line()
+			/* Note: Applied both once the profiles are loaded
 			 *       and later on via fs_blacklist().
 			 */
 			profile_check_line(line, 0, NULL);
@@ -1738,7 +2021,7 @@ int main(int argc, char **argv, char **envp) {
 			char *line;
 			if (asprintf(&line, "mkfile %s", argv[i] + 9) == -1)
 				errExit("asprintf");
-			/* Note: Applied both immediately in profile_check_line()
+			/* Note: Applied both once the profiles are loaded
 			 *       and later on via fs_blacklist().
 			 */
 			profile_check_line(line, 0, NULL);
@@ -1882,6 +2165,10 @@ int main(int argc, char **argv, char **envp) {
 					exit(1);
 				}
 				invalid_filename(cfg.chrootdir, 0); // no globbing
+				if (cfg.rootfs_image) {
+					fprintf(stderr, "Error: --chroot and --rootfs-image are mutually exclusive\n");
+					exit(1);
+				}
 
 				// check chroot directory
 				fs_check_chroot_dir();
@@ -1889,6 +2176,23 @@ int main(int argc, char **argv, char **envp) {
 			else
 				exit_err_feature("chroot");
 		}
+		else if (strncmp(argv[i], "--rootfs-image=", 15) == 0) {
+			if (checkcfg(CFG_CHROOT)) {
+				if (cfg.chrootdir) {
+					fprintf(stderr, "Error: --chroot and --rootfs-image are mutually exclusive\n");
+					exit(1);
+				}
+				char *image = expand_macros(argv[i] + 15);
+				if (*image == '\0') {
+					fprintf(stderr, "Error: invalid rootfs-image option\n");
+					exit(1);
+				}
+				rootfs_image_set(image);
+				free(image);
+			}
+			else
+				exit_err_feature("chroot");
+		}
 #endif
 		else if (strcmp(argv[i], "--writable-etc") == 0) {
 			if (cfg.etc_private_keep) {
@@ -1965,6 +2269,17 @@ int main(int argc, char **argv, char **envp) {
 			else
 				exit_err_feature("private-home");
 		}
+		else if (strncmp(argv[i], "--private-home-snapshot=", 24) == 0) {
+			if (checkcfg(CFG_PRIVATE_HOME)) {
+				cfg.home_snapshot = argv[i] + 24;
+				if (invalid_name(cfg.home_snapshot)) {
+					fprintf(stderr, "Error: invalid private-home-snapshot name\n");
+					exit(1);
+				}
+			}
+			else
+				exit_err_feature("private-home");
+		}
 #endif
 		else if (strcmp(argv[i], "--private-dev") == 0) {
 			arg_private_dev = 1;
@@ -2001,11 +2316,7 @@ int main(int argc, char **argv, char **envp) {
 					fprintf(stderr, "Error: invalid private-etc option\n");
 					exit(1);
 				}
-				if (cfg.etc_private_keep) {
-					if ( asprintf(&cfg.etc_private_keep, "%s,%s", cfg.etc_private_keep, argv[i] + 14) < 0 )
-						errExit("asprintf");
-				} else
-					cfg.etc_private_keep = argv[i] + 14;
+				profile_list_merge(&cfg.etc_private_keep, argv[i] + 14);
 				arg_private_etc = 1;
 			}
 			else
@@ -2052,11 +2363,7 @@ int main(int argc, char **argv, char **envp) {
 					fprintf(stderr, "Error: invalid private-bin option\n");
 					exit(1);
 				}
-				if (cfg.bin_private_keep) {
-					if ( asprintf(&cfg.bin_private_keep, "%s,%s", cfg.bin_private_keep, argv[i] + 14) < 0 )
-						errExit("asprintf");
-				} else
-					cfg.bin_private_keep = argv[i] + 14;
+				profile_list_merge(&cfg.bin_private_keep, argv[i] + 14);
 				arg_private_bin = 1;
 			}
 			else
@@ -2113,11 +2420,30 @@ int main(int argc, char **argv, char **envp) {
 				fprintf(stderr, "Error: invalid sandbox name: cannot be empty\n");
 				return 1;
 			}
-			if (invalid_name(cfg.name)) {
+			// %d is replaced with the number of the instance
+			char *name = (strstr(cfg.name, "%d")) ? instance_name(cfg.name, 1) : strdup(cfg.name);
+			if (!name)
+				errExit("strdup");
+			int invalid = invalid_name(name);
+			free(name);
+			if (invalid) {
 				fprintf(stderr, "Error: invalid sandbox name\n");
 				return 1;
 			}
 		}
+		else if (strncmp(argv[i], "--instances=", 12) == 0)
+			instances_check(argv[i] + 12);
+		else if (strcmp(argv[i], "--warm-cache-run") == 0)
+			arg_warm_cache_run = 1;
+		else if (strncmp(argv[i], "--pool=", 7) == 0) {
+			cfg.pool = argv[i] + 7;
+			if (*cfg.pool == '\0' || invalid_name(cfg.pool) || strlen(cfg.pool) >= RUN_RECORD_POOL_MAX) {
+				fprintf(stderr, "Error: invalid pool name\n");
+				return 1;
+			}
+			// the sandboxes are paused with cgroup.freeze
+			arg_cgroup_leaf = 1;
+		}
 		else if (strncmp(argv[i], "--hostname=", 11) == 0) {
 			cfg.hostname = argv[i] + 11;
 			if (strlen(cfg.hostname) == 0) {
@@ -2624,6 +2950,20 @@ int main(int argc, char **argv, char **envp) {
 		}
 
 
+		else if (strncmp(argv[i], "--dhcp-timeout=", 15) == 0) {
+			if (checkcfg(CFG_NETWORK)) {
+				char *end;
+				errno = 0;
+				unsigned long val = strtoul(argv[i] + 15, &end, 10);
+				if (!isdigit((unsigned char) argv[i][15]) || *end != '\0' || errno || val == 0 || val > 3600) {
+					fprintf(stderr, "Error: invalid --dhcp-timeout, expecting a number of seconds between 1 and 3600\n");
+					exit(1);
+				}
+				arg_dhcp_timeout = val;
+			}
+			else
+				exit_err_feature("networking");
+		}
 		else if (strncmp(argv[i], "--defaultgw=", 12) == 0) {
 			if (checkcfg(CFG_NETWORK)) {
 				if (atoip(argv[i] + 12, &cfg.defaultgw)) {
@@ -2690,6 +3030,15 @@ int main(int argc, char **argv, char **envp) {
 				exit_err_feature("networking");
 		}
 
+		else if (strncmp(argv[i], "--net-group=", 12) == 0) {
+			if (checkcfg(CFG_NETWORK)) {
+				arg_net_group = argv[i] + 12;
+				net_group_check(arg_net_group);
+			}
+			else
+				exit_err_feature("networking");
+		}
+
 		else if (strncmp(argv[i], "--netns=", 8) == 0) {
 			if (checkcfg(CFG_NETWORK)) {
 				arg_netns = argv[i] + 8;
@@ -2704,6 +3053,9 @@ int main(int argc, char **argv, char **envp) {
 		//*************************************
 		else if (strncmp(argv[i], "--timeout=", 10) == 0)
 			cfg.timeout = extract_timeout(argv[i] + 10);
+		else if (strncmp(argv[i], "--shutdown-grace=", 17) == 0) {
+			// already handled
+		}
 		else if (strcmp(argv[i], "--appimage") == 0) {
 			// already handled
 		}
@@ -2875,7 +3227,11 @@ int main(int argc, char **argv, char **envp) {
 		printf("Command name #%s#\n", cfg.command_name);
 
 
+	// global launch counters in /run/firejail/stats
+	stats_init();
+
 	// load the profile
+	sprof_begin("load profile");
 	if (!arg_noprofile && !custom_profile) {
 		if (arg_appimage)
 			custom_profile = appimage_find_profile(cfg.command_name);
@@ -2901,6 +3257,9 @@ int main(int argc, char **argv, char **envp) {
 		if (custom_profile)
 			fmessage("\n** Note: you can use --noprofile to disable %s.profile **\n\n", profile_name);
 	}
+	// create the mkdir and mkfile paths queued by the profiles and the command line
+	fs_mkdir_flush();
+	sprof_end();
 	EUID_ASSERT();
 
 	// Note: Only attempt to print non-debug information after all profiles
@@ -2912,6 +3271,12 @@ int main(int argc, char **argv, char **envp) {
 	if (arg_x11_block)
 		x11_block();
 
+	// the snapshot is a copy of the private-home list
+	if (cfg.home_snapshot && !cfg.home_private_keep) {
+		fprintf(stderr, "Error: --private-home-snapshot requires --private-home\n");
+		exit(1);
+	}
+
 	// check network configuration options - it will exit if anything went wrong
 	net_check_cfg();
 
@@ -2931,23 +3296,44 @@ int main(int argc, char **argv, char **envp) {
 	if (need_preload && (cfg.seccomp_list32 || cfg.seccomp_list_drop32 || cfg.seccomp_list_keep32))
 		fwarning("preload libraries (trace, tracelog, postexecseccomp due to seccomp.drop=execve etc.) are incompatible with 32 bit filters\n");
 
+	// --instances: the launcher doesn't return
+	instances_start();
+
 	// check and assign an IP address - for macvlan it will be done again in the sandbox!
 	if (any_bridge_configured()) {
+		sprof_begin("check network");
 		EUID_ROOT();
 		preproc_lock_firejail_network_dir();
 
-		if (cfg.bridge0.configured && cfg.bridge0.arg_ip_none == 0)
-			check_network(&cfg.bridge0);
-		if (cfg.bridge1.configured && cfg.bridge1.arg_ip_none == 0)
-			check_network(&cfg.bridge1);
-		if (cfg.bridge2.configured && cfg.bridge2.arg_ip_none == 0)
-			check_network(&cfg.bridge2);
-		if (cfg.bridge3.configured && cfg.bridge3.arg_ip_none == 0)
-			check_network(&cfg.bridge3);
-
-		// save network mapping in shared memory
-		network_set_run_file(sandbox_pid);
+		if (arg_net_group && net_group_setup(arg_net_group)) {
+			// the sandbox is started in the network namespace of the group,
+			// already configured by the first sandbox
+			memset(&cfg.bridge0, 0, sizeof(Bridge));
+			memset(&cfg.bridge1, 0, sizeof(Bridge));
+			memset(&cfg.bridge2, 0, sizeof(Bridge));
+			memset(&cfg.bridge3, 0, sizeof(Bridge));
+		}
+		else {
+			if (cfg.bridge0.configured && cfg.bridge0.arg_ip_none == 0)
+				check_network(&cfg.bridge0);
+			if (cfg.bridge1.configured && cfg.bridge1.arg_ip_none == 0)
+				check_network(&cfg.bridge1);
+			if (cfg.bridge2.configured && cfg.bridge2.arg_ip_none == 0)
+				check_network(&cfg.bridge2);
+			if (cfg.bridge3.configured && cfg.bridge3.arg_ip_none == 0)
+				check_network(&cfg.bridge3);
+
+			// save network mapping in shared memory
+			network_set_run_file(sandbox_pid);
+			bandwidth_set_run_file(sandbox_pid);
+		}
+
+		// the addresses are leased and recorded in the run files; the first
+		// sandbox of a network group keeps the lock until the group is published
+		if (!arg_net_group || net_group_joined())
+			preproc_unlock_firejail_network_dir();
 		EUID_USER();
+		sprof_end();
 	}
 	EUID_ASSERT();
 
@@ -2958,28 +3344,40 @@ int main(int argc, char **argv, char **envp) {
 
 
 	// set name and x11 run files
-	EUID_ROOT();
-	preproc_lock_firejail_dir();
-	if (cfg.name)
-		set_name_run_file(sandbox_pid);
 	int display = x11_display();
-	if (display > 0)
-		set_x11_run_file(sandbox_pid, display);
-	preproc_unlock_firejail_dir();
-	EUID_USER();
+	if (cfg.name || cfg.pool || display > 0 || arg_numa) {
+		EUID_ROOT();
+		preproc_lock_firejail_dir();
+		if (cfg.name)
+			set_name_run_file(sandbox_pid);
+		if (cfg.pool)
+			set_pool_run_file(sandbox_pid);
+		if (display > 0)
+			set_x11_run_file(sandbox_pid, display);
+		if (arg_numa)
+			numa_select(sandbox_pid);
+		preproc_unlock_firejail_dir();
+		EUID_USER();
+	}
 
 #ifdef HAVE_DBUSPROXY
 	if (checkcfg(CFG_DBUS)) {
 		dbus_check_profile();
 		if (arg_dbus_user == DBUS_POLICY_FILTER ||
 			arg_dbus_system == DBUS_POLICY_FILTER) {
+			sprof_begin("dbus proxy");
 			EUID_ROOT();
 			dbus_proxy_start();
 			EUID_USER();
+			sprof_end();
 		}
 	}
 #endif
 
+	// sandbox cgroup and limits
+	if (arg_cgroup_leaf)
+		cgroup_leaf_create(sandbox_pid);
+
 	// create the parent-child communication pipe
 	if (pipe2(parent_to_child_fds, O_CLOEXEC) < 0)
 		errExit("pipe");
@@ -3004,26 +3402,36 @@ int main(int argc, char **argv, char **envp) {
 		printf("Using the local network stack\n");
 
 	EUID_ASSERT();
+	int cgroup_fd = (arg_cgroup_leaf) ? cgroup_leaf_open() : -1;
+	int in_cgroup;
+	sprof_begin("clone");
 	EUID_ROOT();
-#ifdef __ia64__
-	child = __clone2(sandbox,
-		child_stack,
-		STACK_SIZE,
-		flags,
-		NULL);
-#else
-	child = clone(sandbox,
-		child_stack + STACK_SIZE,
-		flags,
-		NULL);
-#endif
+	if (net_group_joined())
+		net_group_enter();
+	child = clone_sandbox(flags, cgroup_fd, &in_cgroup);
 	if (child == -1)
 		errExit("clone");
+	if (net_group_joined())
+		net_group_restore();
 	EUID_USER();
+	sprof_end();
+	if (cgroup_fd != -1)
+		close(cgroup_fd);
 
 	// sandbox pidfile
 	set_sandbox_run_file(getpid(), child);
 
+	if (in_cgroup) {
+		if (arg_debug)
+			printf("Sandbox started in its cgroup\n");
+	}
+	else if (arg_cgroup_leaf)
+		cgroup_leaf_join(sandbox_pid, child);
+
+	// the child is still waiting, the counters see all its processes
+	if (arg_perf_stat)
+		perf_stat_start(child);
+
 	if (!arg_command && !arg_quiet) {
 		fmessage("Parent pid %u, child pid %u\n", sandbox_pid, child);
 		// print the path of the new log directory
@@ -3032,6 +3440,7 @@ int main(int argc, char **argv, char **envp) {
 	}
 
 	if (!arg_nonetwork) {
+		sprof_begin("host network");
 		EUID_ROOT();
 		pid_t net_child = fork();
 		if (net_child < 0)
@@ -3053,7 +3462,13 @@ int main(int argc, char **argv, char **envp) {
 
 		// wait for the child to finish
 		waitpid(net_child, NULL, 0);
+		if (arg_net_group && !net_group_joined()) {
+			net_group_publish(arg_net_group, child);
+			if (any_bridge_configured())
+				preproc_unlock_firejail_network_dir();
+		}
 		EUID_USER();
+		sprof_end();
 	}
 	EUID_ASSERT();
 
@@ -3064,11 +3479,16 @@ int main(int argc, char **argv, char **envp) {
 	// notify child that base setup is complete
 	notify_other(parent_to_child_fds[1]);
 
-	// wait for child to create new user namespace with CLONE_NEWUSER
-	wait_for_other(child_to_parent_fds[0]);
+	// wait for child to create new user namespace with CLONE_NEWUSER;
+	// the child reports arg_noroot=0 if it fails, and without --noroot
+	// it doesn't wait for the maps
+	int map_sync = arg_noroot;
+	if (map_sync)
+		wait_for_other(child_to_parent_fds[0]);
 	close(child_to_parent_fds[0]);
 
 	if (arg_noroot) {
+		sprof_begin("uid/gid map");
 		// update the UID and GID maps in the new child user namespace
 		// uid
 		char *map_path;
@@ -3213,16 +3633,15 @@ int main(int argc, char **argv, char **envp) {
 		update_map(gidmap, map_path);
 		EUID_USER();
 		free(map_path);
+		sprof_end();
 	}
 	EUID_ASSERT();
 
 	// notify child that UID/GID mapping is complete
-	notify_other(parent_to_child_fds[1]);
+	if (map_sync)
+		notify_other(parent_to_child_fds[1]);
 	close(parent_to_child_fds[1]);
-
-	EUID_ROOT();
-	preproc_unlock_firejail_network_dir();
-	EUID_USER();
+	stats_setup_done();
 
 	// lock netfilter firewall
 	if (arg_netlock) {
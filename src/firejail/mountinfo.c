@@ -20,6 +20,10 @@
 
 #include "firejail.h"
 #include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include <fcntl.h>
 #ifndef O_PATH
@@ -31,6 +35,90 @@
 static char mbuf[MAX_BUF];
 static MountData mdata;
 
+// struct statx from the kernel headers has stx_mnt_id
+#if defined(_LINUX_STAT_H) && defined(STATX_MNT_ID)
+#define HAVE_STATX_MNT_ID
+#endif
+
+// statmount()/listmount(), Linux 6.8
+#ifndef __NR_statmount
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__arm__) || \
+    defined(__riscv) || defined(__powerpc__) || defined(__s390__) || defined(__loongarch__)
+#define __NR_statmount 457
+#define __NR_listmount 458
+#endif
+#endif
+
+#ifndef STATMOUNT_MNT_BASIC
+#define STATMOUNT_MNT_BASIC 0x00000002U
+#endif
+#ifndef STATMOUNT_MNT_POINT
+#define STATMOUNT_MNT_POINT 0x00000010U
+#endif
+#ifndef STATX_MNT_ID_UNIQUE
+#define STATX_MNT_ID_UNIQUE 0x00004000U
+#endif
+
+// version 0 of struct mnt_id_req
+typedef struct {
+	uint32_t size;
+	uint32_t spare;
+	uint64_t mnt_id;
+	uint64_t param;
+} MntIdReq;
+
+// the fixed part of struct statmount, the strings start at offset 512
+typedef struct {
+	uint32_t size;
+	uint32_t mnt_opts;
+	uint64_t mask;
+	uint32_t sb_dev_major;
+	uint32_t sb_dev_minor;
+	uint64_t sb_magic;
+	uint32_t sb_flags;
+	uint32_t fs_type;
+	uint64_t mnt_id;
+	uint64_t mnt_parent_id;
+	uint32_t mnt_id_old;
+	uint32_t mnt_parent_id_old;
+	uint64_t mnt_attr;
+	uint64_t mnt_propagation;
+	uint64_t mnt_peer_group;
+	uint64_t mnt_master;
+	uint64_t propagate_from;
+	uint32_t mnt_root;
+	uint32_t mnt_point;
+	uint64_t spare2[50];
+	char str[];
+} StatMount;
+
+// Snapshot of /proc/self/mountinfo.
+//
+// The file stays open, and the kernel flags it with POLLPRI every time the
+// mount table of the namespace changes; as long as poll() reports nothing,
+// the last copy is still valid and build_mount_array() does not read the
+// file again. The raw text is read in one go, and it is parsed only when a
+// mount id or mount point lookup is needed. get_last_mount() always reads
+// the file, it runs a security check right after a mount operation.
+typedef struct {
+	int fd;
+	pid_t pid;		// the snapshot is not shared with child processes
+	dev_t dev;		// identity of fd and of the mount namespace
+	ino_t ino;
+	ino_t ns;
+	char *raw;		// file content
+	size_t rawlen;
+	size_t rawsize;
+	int parsed;
+	char *strings;		// parse_line() buffer, a copy of raw
+	MountData *mounts;	// in file order
+	size_t cnt;
+	size_t max;
+	size_t *by_id;		// mounts sorted by mount id
+	size_t *by_dir;		// mounts sorted by mount point, for prefix lookups
+} MountSnapshot;
+static MountSnapshot snap = { .fd = -1 };
+
 
 // Convert octal escape sequence to decimal value
 static unsigned read_oct(char *s) {
@@ -134,19 +222,193 @@ errexit:
 	exit(1);
 }
 
-// The return value points to a static area, and will be overwritten by subsequent calls.
-MountData *get_last_mount(void) {
-	// open /proc/self/mountinfo
-	FILE *fp = fopen("/proc/self/mountinfo", "re");
-	if (!fp) {
+static ino_t mount_ns(void) {
+	struct stat s;
+	if (stat("/proc/self/ns/mnt", &s) == -1)
+		return 0;
+	return s.st_ino;
+}
+
+static void snapshot_open(void) {
+	if (snap.fd != -1)
+		close(snap.fd);
+
+	snap.fd = open("/proc/self/mountinfo", O_RDONLY|O_CLOEXEC);
+	if (snap.fd == -1) {
 		fprintf(stderr, "Error: cannot read /proc/self/mountinfo\n");
-		errExit("fopen");
+		errExit("open");
 	}
+	struct stat s;
+	if (fstat(snap.fd, &s) == -1)
+		errExit("fstat");
+	snap.pid = getpid();
+	snap.dev = s.st_dev;
+	snap.ino = s.st_ino;
+	snap.ns = mount_ns();
+}
+
+// return 1 if the mount table could have changed since the last read;
+// poll() acknowledges the kernel event
+static int snapshot_changed(void) {
+	if (snap.fd == -1 || snap.pid != getpid())
+		return 1;
+
+	// the descriptor might have been closed and reused
+	struct stat s;
+	if (fstat(snap.fd, &s) == -1 || s.st_dev != snap.dev || s.st_ino != snap.ino) {
+		snap.fd = -1;
+		return 1;
+	}
+	if (snap.ns != mount_ns())
+		return 1;
+
+	struct pollfd pfd = { .fd = snap.fd, .events = POLLPRI };
+	int rv = poll(&pfd, 1, 0);
+	if (rv == -1 || (rv > 0 && (pfd.revents & (POLLERR|POLLPRI|POLLNVAL))))
+		return 1;
+	return 0;
+}
+
+static void snapshot_read(void) {
+	if (snap.fd == -1 || snap.pid != getpid() || snap.ns != mount_ns())
+		snapshot_open();
+	else {
+		// acknowledge pending events, the file is read below
+		struct pollfd pfd = { .fd = snap.fd, .events = POLLPRI };
+		if (poll(&pfd, 1, 0) == -1)
+			errExit("poll");
+		if (lseek(snap.fd, 0, SEEK_SET) == -1)
+			errExit("lseek");
+	}
+
+	snap.rawlen = 0;
+	snap.parsed = 0;
+	while (1) {
+		if (snap.rawsize - snap.rawlen < MAX_BUF) {
+			snap.rawsize = (snap.rawsize) ? snap.rawsize * 2 : 4 * MAX_BUF;
+			snap.raw = realloc(snap.raw, snap.rawsize + 1);
+			if (!snap.raw)
+				errExit("realloc");
+		}
+		ssize_t len = read(snap.fd, snap.raw + snap.rawlen, snap.rawsize - snap.rawlen);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error: cannot read /proc/self/mountinfo\n");
+			errExit("read");
+		}
+		if (len == 0)
+			break;
+		snap.rawlen += len;
+	}
+	snap.raw[snap.rawlen] = '\0';
+}
+
+static int cmp_by_id(const void *a, const void *b) {
+	int id1 = snap.mounts[*(const size_t *) a].mountid;
+	int id2 = snap.mounts[*(const size_t *) b].mountid;
+	if (id1 != id2)
+		return (id1 < id2) ? -1 : 1;
+	// keep file order for duplicates
+	return (*(const size_t *) a < *(const size_t *) b) ? -1 : 1;
+}
+
+static int cmp_by_dir(const void *a, const void *b) {
+	int rv = strcmp(snap.mounts[*(const size_t *) a].dir, snap.mounts[*(const size_t *) b].dir);
+	if (rv)
+		return rv;
+	return (*(const size_t *) a < *(const size_t *) b) ? -1 : 1;
+}
+
+static void snapshot_parse(void) {
+	if (snap.parsed)
+		return;
+
+	free(snap.strings);
+	snap.strings = strdup(snap.raw);
+	if (!snap.strings)
+		errExit("strdup");
+
+	snap.cnt = 0;
+	char *line = snap.strings;
+	while (*line) {
+		char *next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		if (snap.cnt == snap.max) {
+			snap.max = (snap.max) ? snap.max * 2 : 256;
+			snap.mounts = realloc(snap.mounts, snap.max * sizeof(MountData));
+			snap.by_id = realloc(snap.by_id, snap.max * sizeof(size_t));
+			snap.by_dir = realloc(snap.by_dir, snap.max * sizeof(size_t));
+			if (!snap.mounts || !snap.by_id || !snap.by_dir)
+				errExit("realloc");
+		}
+		parse_line(line, &snap.mounts[snap.cnt]);
+		snap.by_id[snap.cnt] = snap.cnt;
+		snap.by_dir[snap.cnt] = snap.cnt;
+		snap.cnt++;
+		line = next;
+	}
+
+	qsort(snap.by_id, snap.cnt, sizeof(size_t), cmp_by_id);
+	qsort(snap.by_dir, snap.cnt, sizeof(size_t), cmp_by_dir);
+	snap.parsed = 1;
+}
+
+// return the position of the first mount with this id in file order, -1 if not found
+static ssize_t snapshot_find_id(int mountid) {
+	size_t lo = 0, hi = snap.cnt;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (snap.mounts[snap.by_id[mid]].mountid < mountid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < snap.cnt && snap.mounts[snap.by_id[lo]].mountid == mountid)
+		return snap.by_id[lo];
+	return -1;
+}
+
+// return the first position in by_dir with a mount point >= dir
+static size_t snapshot_lower_dir(const char *dir) {
+	size_t lo = 0, hi = snap.cnt;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(snap.mounts[snap.by_dir[mid]].dir, dir) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int cmp_size(const void *a, const void *b) {
+	size_t x = *(const size_t *) a;
+	size_t y = *(const size_t *) b;
+	return (x < y) ? -1 : (x > y);
+}
+
+// The return value points to a static area, and will be overwritten by subsequent calls.
+MountData *get_last_mount(void) {
+	snapshot_read();
 
-	mbuf[0] = '\0';
 	// go to the last line
-	while (fgets(mbuf, MAX_BUF, fp));
-	fclose(fp);
+	mbuf[0] = '\0';
+	if (snap.rawlen) {
+		char *end = snap.raw + snap.rawlen;
+		char *start = end - 1;	// skip the trailing '\n'
+		while (start > snap.raw && *(start - 1) != '\n')
+			start--;
+		size_t len = end - start;
+		if (len > MAX_BUF - 1)
+			len = MAX_BUF - 1;
+		memcpy(mbuf, start, len);
+		mbuf[len] = '\0';
+	}
 	if (arg_debug)
 		printf("%s", mbuf);
 
@@ -216,78 +478,268 @@ static int get_mount_id_from_fdinfo(int fd) {
 	return rv;
 }
 
+// Returns mount id, or -1 if statx() does not report it (kernels < 5.8)
+static int get_mount_id_from_statx(int fd) {
+#ifdef HAVE_STATX_MNT_ID
+	struct statx sx;
+	if (statx(fd, "", AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW, STATX_MNT_ID, &sx) == 0 &&
+	    (sx.stx_mask & STATX_MNT_ID))
+		return (int) sx.stx_mnt_id;
+#else
+	(void) fd;
+#endif
+	return -1;
+}
+
 int get_mount_id(int fd) {
-	int rv = get_mount_id_from_handle(fd);
+	int rv = get_mount_id_from_statx(fd);
+	if (rv >= 0)
+		return rv;
+	rv = get_mount_id_from_handle(fd);
 	if (rv < 0)
 		rv = get_mount_id_from_fdinfo(fd);
 	return rv;
 }
 
-// Check /proc/self/mountinfo if path contains any mounts points.
-// Returns an array that can be iterated over for recursive remounting.
-char **build_mount_array(const int mountid, const char *path) {
-	assert(path);
+#if defined(__NR_statmount) && defined(HAVE_STATX_MNT_ID)
+#define HAVE_MOUNT_SYSCALLS
+#endif
 
-	FILE *fp = fopen("/proc/self/mountinfo", "re");
-	if (!fp) {
-		fprintf(stderr, "Error: cannot read /proc/self/mountinfo\n");
-		errExit("fopen");
+#ifdef HAVE_MOUNT_SYSCALLS
+static int mount_syscalls = 1;	// cleared if statmount/listmount are not available
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x < y) ? -1 : (x > y);
+}
+
+static int cmp_dir_pos(const void *a, const void *b) {
+	const char * const *x = *(const char * const * const *) a;
+	const char * const *y = *(const char * const * const *) b;
+	int rv = strcmp(*x, *y);
+	if (rv)
+		return rv;
+	return (x < y) ? -1 : (x > y);
+}
+
+// mounts stacked on the same directory are remounted through the same path;
+// drop the duplicates, keeping the first entry and the order of the others
+static size_t drop_duplicates(char **arr, size_t cnt) {
+	if (cnt < 2)
+		return cnt;
+
+	char ***idx = malloc(cnt * sizeof(char **));
+	if (!idx)
+		errExit("malloc");
+	size_t i;
+	for (i = 0; i < cnt; i++)
+		idx[i] = &arr[i];
+	qsort(idx, cnt, sizeof(char **), cmp_dir_pos);
+
+	// the first entry of every run of equal strings is kept
+	char **dup = calloc(cnt, sizeof(char *));
+	if (!dup)
+		errExit("calloc");
+	for (i = 1; i < cnt; i++)
+		if (strcmp(*idx[i], *idx[i - 1]) == 0)
+			dup[idx[i] - arr] = *idx[i];
+	free(idx);
+
+	size_t j = 0;
+	for (i = 0; i < cnt; i++) {
+		if (dup[i])
+			free(arr[i]);
+		else
+			arr[j++] = arr[i];
 	}
+	free(dup);
+	return j;
+}
 
-	// try to find line with mount id
-	int found = 0;
-	MountData mntp;
-	char line[MAX_BUF];
-	while (fgets(line, MAX_BUF, fp)) {
-		parse_line(line, &mntp);
-		if (mntp.mountid == mountid) {
-			found = 1;
-			break;
+// statmount() into a buffer grown as needed; returns NULL on error with errno set
+static StatMount *do_statmount(uint64_t id, uint64_t mask, StatMount **buf, size_t *size) {
+	MntIdReq req = { .size = sizeof(MntIdReq), .mnt_id = id, .param = mask };
+	while (1) {
+		if (*size == 0) {
+			*size = 4096;
+			*buf = malloc(*size);
+			if (!*buf)
+				errExit("malloc");
 		}
+		if (syscall(__NR_statmount, &req, *buf, *size, 0) == 0)
+			return *buf;
+		if (errno != EOVERFLOW)
+			return NULL;
+		*size *= 2;
+		free(*buf);
+		*buf = malloc(*size);
+		if (!*buf)
+			errExit("malloc");
 	}
+}
 
-	if (!found) {
-		fclose(fp);
-		return NULL;
+// Walk the mount tree below the mount of path with listmount()/statmount().
+// Returns 0 and sets *result, or -1 if the caller should fall back to
+// /proc/self/mountinfo.
+static int build_mount_array_syscalls(const int mountid, const char *path, char ***result) {
+	if (!mount_syscalls)
+		return -1;
+
+	// unique id of the mount
+	struct statx sx;
+	if (statx(AT_FDCWD, path, AT_SYMLINK_NOFOLLOW, STATX_MNT_ID_UNIQUE, &sx) == -1 ||
+	    (sx.stx_mask & STATX_MNT_ID_UNIQUE) == 0) {
+		mount_syscalls = 0;
+		return -1;
+	}
+	uint64_t root = sx.stx_mnt_id;
+	StatMount *sm = NULL;
+	size_t smsize = 0;
+	if (!do_statmount(root, STATMOUNT_MNT_BASIC, &sm, &smsize)) {
+		if (errno == ENOSYS || errno == EINVAL || errno == EPERM)
+			mount_syscalls = 0;
+		free(sm);
+		return -1;
+	}
+	if (sm->mnt_id_old != (uint32_t) mountid) {
+		// the path was remounted in the meantime, let the text parser decide
+		free(sm);
+		return -1;
 	}
 
-	// allocate array
-	size_t size = 32;
-	char **rv = malloc(size * sizeof(*rv));
-	if (!rv)
+	// collect all the mounts in the subtree; stale mounts left under a
+	// mount stacked on top of them are not part of it
+	size_t qsize = 64;
+	size_t qlen = 0;
+	size_t qpos = 0;
+	uint64_t *queue = malloc(qsize * sizeof(uint64_t));
+	if (!queue)
 		errExit("malloc");
+	queue[qlen++] = root;
+	uint64_t ids[256];
+	while (qpos < qlen) {
+		MntIdReq req = { .size = sizeof(MntIdReq), .mnt_id = queue[qpos++], .param = 0 };
+		while (1) {
+			long n = syscall(__NR_listmount, &req, ids, sizeof(ids) / sizeof(ids[0]), 0);
+			if (n == -1) {
+				if (errno == ENOENT) // unmounted in the meantime
+					break;
+				if (errno == ENOSYS)
+					mount_syscalls = 0;
+				free(queue);
+				free(sm);
+				return -1;
+			}
+			if (n == 0)
+				break;
+			if (qlen + n > qsize) {
+				while (qlen + n > qsize)
+					qsize *= 2;
+				queue = realloc(queue, qsize * sizeof(uint64_t));
+				if (!queue)
+					errExit("realloc");
+			}
+			memcpy(queue + qlen, ids, n * sizeof(uint64_t));
+			qlen += n;
+			req.param = ids[n - 1];
+		}
+	}
 
-	// add directory itself
+	char **rv = malloc((qlen + 1) * sizeof(*rv));
+	if (!rv)
+		errExit("malloc");
 	size_t cnt = 0;
 	rv[cnt] = strdup(path);
 	if (rv[cnt] == NULL)
 		errExit("strdup");
+	cnt++;
+
+	// mount order, as in /proc/self/mountinfo: the unique ids are never
+	// reused, and only the mounts created after this one are considered
+	qsort(queue + 1, qlen - 1, sizeof(uint64_t), cmp_u64);
 
-	// and add all following mountpoints contained in this directory
 	size_t pathlen = strlen(path);
-	while (fgets(line, MAX_BUF, fp)) {
-		parse_line(line, &mntp);
-		if (strncmp(mntp.dir, path, pathlen) == 0 && mntp.dir[pathlen] == '/') {
-			if (++cnt == size) {
-				size *= 2;
-				rv = realloc(rv, size * sizeof(*rv));
-				if (!rv)
-					errExit("realloc");
-			}
-			rv[cnt] = strdup(mntp.dir);
+	size_t i;
+	for (i = 1; i < qlen; i++) {
+		if (queue[i] <= root)
+			continue;
+		if (!do_statmount(queue[i], STATMOUNT_MNT_POINT, &sm, &smsize))
+			continue; // unmounted in the meantime
+		if (!(sm->mask & STATMOUNT_MNT_POINT))
+			continue;
+		const char *dir = sm->str + sm->mnt_point;
+		if (strncmp(dir, path, pathlen) == 0 && dir[pathlen] == '/') {
+			rv[cnt] = strdup(dir);
 			if (rv[cnt] == NULL)
 				errExit("strdup");
+			cnt++;
 		}
 	}
-	fclose(fp);
+	cnt = drop_duplicates(rv, cnt);
+	rv[cnt] = NULL;
+
+	free(queue);
+	free(sm);
+	*result = rv;
+	return 0;
+}
+#endif
+
+// Check /proc/self/mountinfo if path contains any mounts points.
+// Returns an array that can be iterated over for recursive remounting.
+char **build_mount_array(const int mountid, const char *path) {
+	assert(path);
+
+#ifdef HAVE_MOUNT_SYSCALLS
+	char **result = NULL;
+	if (build_mount_array_syscalls(mountid, path, &result) == 0)
+		return result;
+#endif
 
-	// end of array
-	if (++cnt == size) {
-		++size;
-		rv = realloc(rv, size * sizeof(*rv));
-		if (!rv)
-			errExit("realloc");
+	if (snapshot_changed())
+		snapshot_read();
+	snapshot_parse();
+
+	// try to find line with mount id
+	ssize_t pos = snapshot_find_id(mountid);
+	if (pos < 0)
+		return NULL;
+
+	// all following mountpoints contained in this directory
+	char *prefix;
+	if (asprintf(&prefix, "%s/", path) == -1)
+		errExit("asprintf");
+	size_t pathlen = strlen(path);
+	size_t *found = malloc((snap.cnt + 1) * sizeof(size_t));
+	if (!found)
+		errExit("malloc");
+	size_t cnt = 0;
+	size_t i;
+	for (i = snapshot_lower_dir(prefix); i < snap.cnt; i++) {
+		size_t j = snap.by_dir[i];
+		const char *dir = snap.mounts[j].dir;
+		if (strncmp(dir, path, pathlen) != 0 || dir[pathlen] != '/')
+			break;
+		if (j > (size_t) pos)
+			found[cnt++] = j;
 	}
-	rv[cnt] = NULL;
+	free(prefix);
+	qsort(found, cnt, sizeof(size_t), cmp_size);
+
+	// directory itself and the mount points in file order
+	char **rv = malloc((cnt + 2) * sizeof(*rv));
+	if (!rv)
+		errExit("malloc");
+	rv[0] = strdup(path);
+	if (rv[0] == NULL)
+		errExit("strdup");
+	for (i = 0; i < cnt; i++) {
+		rv[i + 1] = strdup(snap.mounts[found[i]].dir);
+		if (rv[i + 1] == NULL)
+			errExit("strdup");
+	}
+	rv[cnt + 1] = NULL;
+	free(found);
 	return rv;
 }
@@ -131,7 +131,63 @@ void check_netfilter_file(const char *fname) {
 	free(tmp);
 }
 
+// the filter files with a .nft extension are nftables rulesets
+static int is_nft_file(const char *fname) {
+	assert(fname);
+	const char *end = strchr(fname, ',');	// template arguments
+	size_t len = end ? (size_t) (end - fname) : strlen(fname);
+	return len > 4 && strncmp(fname + len - 4, ".nft", 4) == 0;
+}
+
+static const char *nft_command(void) {
+	struct stat s;
+	if (stat("/sbin/nft", &s) == 0)
+		return "/sbin/nft";
+	if (stat("/usr/sbin/nft", &s) == 0)
+		return "/usr/sbin/nft";
+	return NULL;
+}
+
+// load a nftables ruleset; nft sends all the tables, chains, sets and rules
+// in the file to the kernel as a single netlink batch, applied atomically
+static void netfilter_nft(const char *fname) {
+	const char *nft = nft_command();
+	if (nft == NULL) {
+		fprintf(stderr, "Error: nft command not found, netfilter not configured\n");
+		return;
+	}
+
+	if (arg_debug)
+		printf("Installing nftables firewall\n");
+
+	// create an empty user-owned SBOX_STDIN_FILE
+	create_empty_file_as_root(SBOX_STDIN_FILE, 0644);
+	if (set_perms(SBOX_STDIN_FILE, getuid(), getgid(), 0644))
+		errExit("set_perms");
+
+	// the template arguments are substituted by fnetfilter, the same as for iptables
+	if (fname)
+		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FNETFILTER, fname, SBOX_STDIN_FILE);
+	else
+		sbox_run(SBOX_USER| SBOX_CAPS_NONE | SBOX_SECCOMP, 3, PATH_FNETFILTER, "--nftables", SBOX_STDIN_FILE);
+
+	// caps and seccomp disabled in order to allow the loading of nf_tables kernel modules
+	sbox_run(SBOX_ROOT, 3, nft, "-f", SBOX_STDIN_FILE);
+	unlink(SBOX_STDIN_FILE);
+
+	// debug
+	if (arg_debug)
+		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 3, nft, "list", "ruleset");
+}
+
 void netfilter(const char *fname) {
+	// nftables ruleset file, or the default filter with "nftables yes" in firejail.config
+	const char *src = fname ? fname : netfilter_default;
+	if (src ? is_nft_file(src) : checkcfg(CFG_NFTABLES)) {
+		netfilter_nft(src);
+		return;
+	}
+
 	// find iptables command
 	struct stat s;
 	char *iptables = NULL;
@@ -181,6 +237,10 @@ void netfilter(const char *fname) {
 void netfilter6(const char *fname) {
 	if (fname == NULL)
 		return;
+	if (is_nft_file(fname)) {
+		netfilter_nft(fname);
+		return;
+	}
 
 	// find iptables command
 	char *ip6tables = NULL;
@@ -243,10 +303,15 @@ void netfilter_print(pid_t pid, int ipv6) {
 			iptables = "/usr/sbin/iptables";
 	}
 
-	if (iptables == NULL) {
+	// the nftables rulesets cover both IPv4 and IPv6
+	const char *nft = nft_command();
+	if (iptables == NULL && nft == NULL) {
 		fprintf(stderr, "Error: iptables command not found\n");
 		exit(1);
 	}
 
-	sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 2, iptables, "-nvL");
+	if (nft)
+		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 3, nft, "list", "ruleset");
+	if (iptables)
+		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 2, iptables, "-nvL");
 }
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --net-group: sandboxes sharing one network namespace.
+//
+// The first sandbox of a group sets up the network namespace as for --net,
+// and the namespace is bind-mounted on RUN_FIREJAIL_NETWORK_DIR/groups/<name>.
+// The next sandboxes are started in this namespace, without any network
+// setup. The members of the group are listed in RUN_FIREJAIL_NETWORK_DIR/group-<name>,
+// updated under flock(); the group of a sandbox is written in
+// RUN_FIREJAIL_NETWORK_DIR/<pid>-group. The IP address lease and the network
+// run files belong to the owner of the group, they are handed over to
+// another member when the owner exits. The namespace is unmounted when the
+// last member exits, and the kernel removes the interfaces.
+
+#include "firejail.h"
+#include <sys/file.h>
+#include <sys/mount.h>
+#include <sys/vfs.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <linux/magic.h>
+
+#ifndef NSFS_MAGIC
+#define NSFS_MAGIC 0x6e736673
+#endif
+
+#define NET_GROUP_NAME_MAX 32
+#define NET_GROUP_DIR RUN_FIREJAIL_NETWORK_DIR "/groups"
+#define MAXBUF 4096
+
+typedef struct {
+	uid_t uid;
+	pid_t owner;
+	int cnt;
+	int max;
+	pid_t *member;
+} NetGroup;
+
+static int group_fd = -1;	// network namespace of the group joined
+static int saved_fd = -1;	// network namespace of the parent, around clone()
+
+int net_group_joined(void) {
+	return group_fd != -1;
+}
+
+void net_group_check(const char *name) {
+	size_t len = strlen(name);
+	if (len == 0 || len > NET_GROUP_NAME_MAX ||
+	    strspn(name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.") != len ||
+	    name[0] == '.') {
+		fprintf(stderr, "Error: invalid network group name %s\n", name);
+		exit(1);
+	}
+}
+
+static char *group_fname(const char *name) {
+	char *fname;
+	if (asprintf(&fname, "%s/group-%s", RUN_FIREJAIL_NETWORK_DIR, name) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+static char *group_ns_fname(const char *name) {
+	char *fname;
+	if (asprintf(&fname, "%s/%s", NET_GROUP_DIR, name) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+static char *pid_fname(pid_t pid, const char *dir, const char *suffix) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d-%s", dir, (int) pid, suffix) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+// open and lock the member list; the file could be removed by the last
+// member while we wait for the lock
+static int group_open(const char *fname) {
+	while (1) {
+		int fd = open(fname, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+		if (fd == -1)
+			return -1;
+		if (flock(fd, LOCK_EX) == -1)
+			errExit("flock");
+		struct stat s;
+		if (fstat(fd, &s) == -1)
+			errExit("fstat");
+		if (s.st_nlink != 0) {
+			if (s.st_uid != 0 || !S_ISREG(s.st_mode)) {
+				close(fd);
+				return -1;
+			}
+			return fd;
+		}
+		close(fd);
+	}
+}
+
+static void group_add(NetGroup *g, pid_t pid) {
+	if (g->cnt == g->max) {
+		g->max = (g->max) ? g->max * 2 : 16;
+		g->member = realloc(g->member, g->max * sizeof(pid_t));
+		if (!g->member)
+			errExit("realloc");
+	}
+	g->member[g->cnt++] = pid;
+}
+
+// read the member list; the members gone without cleaning up are dropped
+static void group_read(int fd, NetGroup *g) {
+	memset(g, 0, sizeof(NetGroup));
+	int dupfd = dup(fd);
+	if (dupfd == -1)
+		errExit("dup");
+	FILE *fp = fdopen(dupfd, "r");
+	if (!fp)
+		errExit("fdopen");
+	rewind(fp);
+
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		unsigned val;
+		if (sscanf(buf, "uid %u", &val) == 1)
+			g->uid = val;
+		else if (sscanf(buf, "owner %u", &val) == 1)
+			g->owner = val;
+		else if (sscanf(buf, "member %u", &val) == 1) {
+			pid_t pid = val;
+			if (pid > 0 && !(kill(pid, 0) == -1 && errno == ESRCH))
+				group_add(g, pid);
+		}
+	}
+	fclose(fp);
+}
+
+static void group_write(int fd, const NetGroup *g) {
+	if (ftruncate(fd, 0) == -1)
+		errExit("ftruncate");
+	if (lseek(fd, 0, SEEK_SET) == -1)
+		errExit("lseek");
+	dprintf(fd, "uid %u\nowner %d\n", (unsigned) g->uid, (int) g->owner);
+	int i;
+	for (i = 0; i < g->cnt; i++)
+		dprintf(fd, "member %d\n", (int) g->member[i]);
+}
+
+static int group_has_member(const NetGroup *g, pid_t pid) {
+	int i;
+	for (i = 0; i < g->cnt; i++)
+		if (g->member[i] == pid)
+			return 1;
+	return 0;
+}
+
+// the namespace is mounted, and it is a network namespace
+static int group_ns_open(const char *nsname) {
+	int fd = open(nsname, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	if (fd == -1)
+		return -1;
+	struct statfs fs;
+	if (fstatfs(fd, &fs) == -1 || fs.f_type != NSFS_MAGIC) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void group_ns_remove(const char *nsname) {
+	if (umount2(nsname, MNT_DETACH) == -1 && errno != EINVAL && errno != ENOENT)
+		fwarning("cannot unmount %s: %s\n", nsname, strerror(errno));
+	unlink(nsname);
+}
+
+static void record_group(const char *name) {
+	char *fname = pid_fname(sandbox_pid, RUN_FIREJAIL_NETWORK_DIR, "group");
+	FILE *fp = fopen(fname, "we");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot create %s\n", fname);
+		exit(1);
+	}
+	fprintf(fp, "%s\n", name);
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+	free(fname);
+}
+
+// called as root with the network directory lock held; the sandbox joins
+// the group if its namespace is already set up
+// return 1 if the group is joined, 0 if the sandbox creates the group
+int net_group_setup(const char *name) {
+	assert(name);
+	char *fname = group_fname(name);
+	int fd = group_open(fname);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot use %s\n", fname);
+		exit(1);
+	}
+
+	NetGroup g;
+	group_read(fd, &g);
+	char *nsname = group_ns_fname(name);
+	int joined = 0;
+	if (g.cnt) {
+		if (g.uid != getuid()) {
+			fprintf(stderr, "Error: network group %s belongs to another user\n", name);
+			exit(1);
+		}
+		group_fd = group_ns_open(nsname);
+		if (group_fd == -1) {
+			fprintf(stderr, "Error: network group %s is not available\n", name);
+			exit(1);
+		}
+		joined = 1;
+	}
+	else {
+		// nobody left: a new namespace replaces the old one
+		group_ns_remove(nsname);
+		g.uid = getuid();
+		g.owner = sandbox_pid;
+	}
+	group_add(&g, sandbox_pid);
+	group_write(fd, &g);
+	close(fd);
+	record_group(name);
+
+	if (arg_debug)
+		printf("Network group %s %s, %d members\n", name, (joined) ? "joined" : "created", g.cnt);
+	free(g.member);
+	free(nsname);
+	free(fname);
+	return joined;
+}
+
+// bind-mount the network namespace of the first sandbox; the group directory
+// is a shared mount, the unmount reaches the copies in the sandbox mount namespaces
+void net_group_publish(const char *name, pid_t child) {
+	assert(name);
+	if (mkdir(NET_GROUP_DIR, 0755) == -1 && errno != EEXIST)
+		errExit("mkdir");
+	if (mount(NULL, NET_GROUP_DIR, NULL, MS_SHARED | MS_REC, NULL) == -1) {
+		if (errno != EINVAL ||
+		    mount(NET_GROUP_DIR, NET_GROUP_DIR, NULL, MS_BIND | MS_REC, NULL) == -1 ||
+		    mount(NULL, NET_GROUP_DIR, NULL, MS_SHARED | MS_REC, NULL) == -1)
+			errExit("mount " NET_GROUP_DIR);
+	}
+
+	char *nsname = group_ns_fname(name);
+	int fd = open(nsname, O_RDONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd == -1)
+		errExit("open");
+	close(fd);
+
+	char *proc;
+	if (asprintf(&proc, "/proc/%d/ns/net", (int) child) == -1)
+		errExit("asprintf");
+	if (mount(proc, nsname, NULL, MS_BIND, NULL) == -1)
+		errExit("mount");
+	if (arg_debug)
+		printf("Network namespace of group %s mounted on %s\n", name, nsname);
+	free(proc);
+	free(nsname);
+}
+
+// the sandbox is cloned in the namespace of the group
+void net_group_enter(void) {
+	assert(group_fd != -1);
+	saved_fd = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+	if (saved_fd == -1)
+		errExit("open /proc/self/ns/net");
+	if (setns(group_fd, CLONE_NEWNET) == -1)
+		errExit("setns");
+}
+
+void net_group_restore(void) {
+	assert(saved_fd != -1);
+	if (setns(saved_fd, CLONE_NEWNET) == -1)
+		errExit("setns");
+	close(saved_fd);
+	saved_fd = -1;
+	close(group_fd);
+}
+
+// hand the network run files over to the new owner of the group
+static void group_transfer(pid_t from, pid_t to) {
+	static const struct {
+		const char *dir;
+		const char *suffix;
+	} files[] = {
+		{ RUN_FIREJAIL_NETWORK_DIR, "lease" },
+		{ RUN_FIREJAIL_NETWORK_DIR, "netmap" },
+		{ RUN_FIREJAIL_BANDWIDTH_DIR, "bandwidth" },
+	};
+	size_t i;
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		char *src = pid_fname(from, files[i].dir, files[i].suffix);
+		char *dest = pid_fname(to, files[i].dir, files[i].suffix);
+		if (rename(src, dest) == -1 && errno != ENOENT)
+			fwarning("cannot rename %s: %s\n", src, strerror(errno));
+		free(src);
+		free(dest);
+	}
+}
+
+// called by delete_run_files() as root, before the network run files are removed
+void net_group_release(pid_t pid) {
+	char *recname = pid_fname(pid, RUN_FIREJAIL_NETWORK_DIR, "group");
+	FILE *fp = fopen(recname, "re");
+	if (!fp) {
+		free(recname);
+		return;
+	}
+	char name[MAXBUF];
+	int rv = (fgets(name, MAXBUF, fp) != NULL);
+	fclose(fp);
+	unlink(recname);
+	free(recname);
+	if (!rv)
+		return;
+	char *ptr = strchr(name, '\n');
+	if (ptr)
+		*ptr = '\0';
+	if (strlen(name) == 0 || strlen(name) > NET_GROUP_NAME_MAX || strchr(name, '/'))
+		return;
+
+	char *fname = group_fname(name);
+	int fd = group_open(fname);
+	if (fd == -1) {
+		free(fname);
+		return;
+	}
+
+	NetGroup g;
+	group_read(fd, &g);
+	NetGroup left = g;
+	left.cnt = 0;
+	left.max = 0;
+	left.member = NULL;
+	int i;
+	for (i = 0; i < g.cnt; i++)
+		if (g.member[i] != pid)
+			group_add(&left, g.member[i]);
+
+	if (left.cnt == 0) {
+		char *nsname = group_ns_fname(name);
+		group_ns_remove(nsname);
+		free(nsname);
+		unlink(fname);
+		if (arg_debug)
+			printf("Network group %s removed\n", name);
+	}
+	else {
+		if (!group_has_member(&left, left.owner)) {
+			group_transfer(left.owner, left.member[0]);
+			left.owner = left.member[0];
+		}
+		group_write(fd, &left);
+	}
+	close(fd);	// this also releases the lock
+
+	free(g.member);
+	free(left.member);
+	free(fname);
+}
@@ -141,19 +141,6 @@ void net_if_up(const char *ifname) {
 }
 
 
-// configure interface ipv6 address
-// ex: firejail --net=eth0 --ip6=2001:0db8:0:f101::1/64
-void net_if_ip6(const char *ifname, const char *addr6) {
-	if (strchr(addr6, ':') == NULL) {
-		fprintf(stderr, "Error: invalid IPv6 address %s\n", addr6);
-		exit(1);
-	}
-
-	sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 5,
-		PATH_FNET, "config", "ipv6", ifname, addr6);
-
-}
-
 // add an IP route, return -1 if error, 0 if the route was added
 int net_add_route(uint32_t ip, uint32_t mask, uint32_t gw) {
 	int sock;
@@ -222,19 +209,6 @@ uint32_t network_get_defaultgw(void) {
 	return retval;
 }
 
-int net_config_mac(const char *ifname, const unsigned char mac[6]) {
-	char *macstr;
-	if (asprintf(&macstr, "%02x:%02x:%02x:%02x:%02x:%02x",
-		mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]) == -1)
-		errExit("asprintf");
-
-	sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 5,
-		PATH_FNET, "config", "mac", ifname, macstr);
-
-	free(macstr);
-	return 0;
-}
-
 int net_get_mac(const char *ifname, unsigned char mac[6]) {
 
 	struct ifreq ifr;
@@ -255,25 +229,55 @@ int net_get_mac(const char *ifname, unsigned char mac[6]) {
 	return 0;
 }
 
-void net_config_interface(const char *dev, uint32_t ip, uint32_t mask, int mtu) {
-	assert(dev);
-
-	char *ipstr;
-	if (asprintf(&ipstr, "%llu", (long long unsigned) ip) == -1)
-		errExit("asprintf");
+// The interface setup of a sandbox runs in a single fnet process: the
+// commands are queued, and fnet script sends all the netlink requests over
+// one socket before running the other commands in order.
+void fnet_script_init(FnetScript *script, const char *fnet) {
+	assert(script);
+	assert(fnet);
+	memset(script, 0, sizeof(FnetScript));
+	script->fnet = fnet;
+}
 
-	char *maskstr;
-	if (asprintf(&maskstr, "%llu", (long long unsigned) mask) == -1)
-		errExit("asprintf");
+// queue a command, same arguments as on the fnet command line
+void fnet_script_add(FnetScript *script, const char *fmt, ...) {
+	assert(script);
+	assert(fmt);
 
-	char *mtustr;
-	if (asprintf(&mtustr, "%d", mtu) == -1)
-		errExit("asprintf");
+	if (script->cnt == script->max) {
+		script->max = (script->max) ? script->max * 2 : 16;
+		script->cmd = realloc(script->cmd, script->max * sizeof(char *));
+		if (!script->cmd)
+			errExit("realloc");
+	}
 
-	sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 7,
-		PATH_FNET, "config", "interface", dev, ipstr, maskstr, mtustr);
+	va_list valist;
+	va_start(valist, fmt);
+	if (vasprintf(&script->cmd[script->cnt], fmt, valist) == -1)
+		errExit("vasprintf");
+	va_end(valist);
+	script->cnt++;
+}
 
-	free(ipstr);
-	free(maskstr);
-	free(mtustr);
+// run the queued commands and release the memory; exit on failure, same as sbox_run()
+void fnet_script_run(FnetScript *script) {
+	assert(script);
+	if (script->cnt == 0)
+		return;
+
+	char **arg = calloc(script->cnt + 3, sizeof(char *));
+	if (!arg)
+		errExit("calloc");
+	arg[0] = (char *) script->fnet;
+	arg[1] = "script";
+	int i;
+	for (i = 0; i < script->cnt; i++)
+		arg[i + 2] = script->cmd[i];
+	sbox_run_v(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, arg);
+
+	for (i = 0; i < script->cnt; i++)
+		free(script->cmd[i]);
+	free(script->cmd);
+	free(arg);
+	fnet_script_init(script, script->fnet);
 }
@@ -128,10 +128,14 @@ void net_configure_sandbox_ip(Bridge *br) {
 			fprintf(stderr, "Error: IP address %d.%d.%d.%d is already in use\n", PRINT_IP(br->ipsandbox));
 			exit(1);
 		}
+		lease_reserve(br);
+	}
+	else {
+		// ip address leased from the bridge subnet, or assigned by arp-scan
+		br->ipsandbox = lease_assign(br);
+		if (!br->ipsandbox)
+			br->ipsandbox = arp_assign(br->dev, br); //br->ip, br->mask);
 	}
-	else
-		// ip address assigned by arp-scan for a bridge device
-		br->ipsandbox = arp_assign(br->dev, br); //br->ip, br->mask);
 }
 
 
@@ -139,8 +143,9 @@ void net_configure_sandbox_ip(Bridge *br) {
 // - br - bridge device
 // - ifname - interface name in sandbox namespace
 // - child - child process running the namespace
+// - script - the fnet command is queued in this script
 
-void net_configure_veth_pair(Bridge *br, const char *ifname, pid_t child) {
+void net_configure_veth_pair(Bridge *br, const char *ifname, pid_t child, FnetScript *script) {
 	assert(br);
 	if (br->configured == 0)
 		return;
@@ -154,11 +159,13 @@ void net_configure_veth_pair(Bridge *br, const char *ifname, pid_t child) {
 	else
 		dev = br->veth_name;
 
-	char *cstr;
-	if (asprintf(&cstr, "%d", child) == -1)
-		errExit("asprintf");
-	sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 7, PATH_FNET_MAIN, "create", "veth", dev, ifname, br->dev, cstr);
-	free(cstr);
+	// a pair is taken from the veth pool of the bridge, if there is one;
+	// the pool pairs have their own names, not available with --veth-name
+	int size = (br->veth_name == NULL) ? net_pool_size(br->dev) : 0;
+	if (size)
+		fnet_script_add(script, "create veth %s %s %s %d %d", dev, ifname, br->dev, child, size);
+	else
+		fnet_script_add(script, "create veth %s %s %s %d", dev, ifname, br->dev, child);
 
 	char *msg;
 	if (asprintf(&msg, "%d.%d.%d.%d address assigned to sandbox", PRINT_IP(br->ipsandbox)) == -1)
@@ -168,6 +175,93 @@ void net_configure_veth_pair(Bridge *br, const char *ifname, pid_t child) {
 	free(msg);
 }
 
+static char *pool_fname(const char *bridge) {
+	char *fname;
+	if (asprintf(&fname, "%s/pool-%s", RUN_FIREJAIL_NETWORK_DIR, bridge) == -1)
+		errExit("asprintf");
+	return fname;
+}
+
+// size of the veth pool of the bridge, 0 if there is no pool
+int net_pool_size(const char *bridge) {
+	assert(bridge);
+	char *fname = pool_fname(bridge);
+	int size = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		if (fscanf(fp, "%d", &size) != 1 || size < 0 || size > NET_POOL_MAX)
+			size = 0;
+		fclose(fp);
+	}
+	free(fname);
+	return size;
+}
+
+// --net-pool=bridge,size: keep size veth pairs ready on the bridge for the
+// sandboxes started with --net=bridge; size 0 removes the pool
+void net_pool(const char *arg) {
+	EUID_ASSERT();
+	if (getuid() != 0) {
+		fprintf(stderr, "Error: --net-pool is only available to root user\n");
+		exit(1);
+	}
+
+	char *bridge = strdup(arg);
+	if (!bridge)
+		errExit("strdup");
+	char *ptr = strchr(bridge, ',');
+	if (!ptr) {
+		fprintf(stderr, "Error: invalid --net-pool option, bridge,size expected\n");
+		exit(1);
+	}
+	*ptr++ = '\0';
+	char *end;
+	long size = strtol(ptr, &end, 10);
+	if (end == ptr || *end != '\0' || size < 0 || size > NET_POOL_MAX) {
+		fprintf(stderr, "Error: invalid veth pool size, a number between 0 and %d expected\n", NET_POOL_MAX);
+		exit(1);
+	}
+
+	// check the bridge device
+	if (*bridge == '\0' || strlen(bridge) >= IFNAMSIZ || strchr(bridge, '/')) {
+		fprintf(stderr, "Error: invalid network device name %s\n", bridge);
+		exit(1);
+	}
+	char *sysbridge;
+	if (asprintf(&sysbridge, "/sys/class/net/%s/bridge", bridge) == -1)
+		errExit("asprintf");
+	if (access(sysbridge, F_OK)) {
+		fprintf(stderr, "Error: cannot find bridge device %s\n", bridge);
+		exit(1);
+	}
+	free(sysbridge);
+
+	// the sandboxes stop using the pool before it is emptied
+	EUID_ROOT();
+	char *fname = pool_fname(bridge);
+	if (size) {
+		FILE *fp = fopen(fname, "we");
+		if (!fp) {
+			fprintf(stderr, "Error: cannot create %s\n", fname);
+			exit(1);
+		}
+		fprintf(fp, "%ld\n", size);
+		SET_PERMS_STREAM(fp, 0, 0, 0644);
+		fclose(fp);
+	}
+	else
+		unlink(fname);
+	free(fname);
+
+	char *sizestr;
+	if (asprintf(&sizestr, "%ld", size) == -1)
+		errExit("asprintf");
+	sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 4, PATH_FNET_MAIN, "pool", bridge, sizestr);
+	EUID_USER();
+	free(sizestr);
+	free(bridge);
+}
+
 // the default address should be in the range of at least on of the bridge devices
 void check_default_gw(uint32_t defaultgw) {
 	assert(defaultgw);
@@ -232,6 +326,18 @@ void net_check_cfg(void) {
 		exit(1);
 	}
 
+	// --net-group
+	if (arg_net_group) {
+		if (net_configured == 0) {
+			fprintf(stderr, "Error: --net-group requires a --net network\n");
+			exit(1);
+		}
+		if (if_configured || arg_netns) {
+			fprintf(stderr, "Error: --net-group is not compatible with --interface and --netns\n");
+			exit(1);
+		}
+	}
+
 	if (net_configured == 0) // nothing to check
 		return;
 
@@ -294,55 +400,50 @@ void net_dns_print(pid_t pid) {
 }
 
 void network_main(pid_t child) {
-	char *cstr;
-	if (asprintf(&cstr, "%d", child) == -1)
-		errExit("asprintf");
+	FnetScript script;
+	fnet_script_init(&script, PATH_FNET_MAIN);
 
 	// create veth pair or macvlan device
 	if (cfg.bridge0.configured) {
 		if (cfg.bridge0.macvlan == 0) {
-			net_configure_veth_pair(&cfg.bridge0, "eth0", child);
+			net_configure_veth_pair(&cfg.bridge0, "eth0", child, &script);
 		}
 		else
-			sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 6, PATH_FNET_MAIN, "create", "macvlan", cfg.bridge0.devsandbox, cfg.bridge0.dev, cstr);
+			fnet_script_add(&script, "create macvlan %s %s %d", cfg.bridge0.devsandbox, cfg.bridge0.dev, child);
 	}
 
 	if (cfg.bridge1.configured) {
 		if (cfg.bridge1.macvlan == 0)
-			net_configure_veth_pair(&cfg.bridge1, "eth1", child);
+			net_configure_veth_pair(&cfg.bridge1, "eth1", child, &script);
 		else
-			sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 6, PATH_FNET_MAIN, "create", "macvlan", cfg.bridge1.devsandbox, cfg.bridge1.dev, cstr);
+			fnet_script_add(&script, "create macvlan %s %s %d", cfg.bridge1.devsandbox, cfg.bridge1.dev, child);
 	}
 
 	if (cfg.bridge2.configured) {
 		if (cfg.bridge2.macvlan == 0)
-			net_configure_veth_pair(&cfg.bridge2, "eth2", child);
+			net_configure_veth_pair(&cfg.bridge2, "eth2", child, &script);
 		else
-			sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 6, PATH_FNET_MAIN, "create", "macvlan", cfg.bridge2.devsandbox, cfg.bridge2.dev, cstr);
+			fnet_script_add(&script, "create macvlan %s %s %d", cfg.bridge2.devsandbox, cfg.bridge2.dev, child);
 	}
 
 	if (cfg.bridge3.configured) {
 		if (cfg.bridge3.macvlan == 0)
-			net_configure_veth_pair(&cfg.bridge3, "eth3", child);
+			net_configure_veth_pair(&cfg.bridge3, "eth3", child, &script);
 		else
-			sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 6, PATH_FNET_MAIN, "create", "macvlan", cfg.bridge3.devsandbox, cfg.bridge3.dev, cstr);
+			fnet_script_add(&script, "create macvlan %s %s %d", cfg.bridge3.devsandbox, cfg.bridge3.dev, child);
 	}
 
 	// move interfaces in sandbox
-	if (cfg.interface0.configured) {
-		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 4, PATH_FNET_MAIN, "moveif", cfg.interface0.dev, cstr);
-	}
-	if (cfg.interface1.configured) {
-		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 4, PATH_FNET_MAIN, "moveif", cfg.interface1.dev, cstr);
-	}
-	if (cfg.interface2.configured) {
-		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 4, PATH_FNET_MAIN, "moveif", cfg.interface2.dev, cstr);
-	}
-	if (cfg.interface3.configured) {
-		sbox_run(SBOX_ROOT | SBOX_CAPS_NETWORK | SBOX_SECCOMP, 4, PATH_FNET_MAIN, "moveif", cfg.interface3.dev, cstr);
-	}
+	if (cfg.interface0.configured)
+		fnet_script_add(&script, "moveif %s %d", cfg.interface0.dev, child);
+	if (cfg.interface1.configured)
+		fnet_script_add(&script, "moveif %s %d", cfg.interface1.dev, child);
+	if (cfg.interface2.configured)
+		fnet_script_add(&script, "moveif %s %d", cfg.interface2.dev, child);
+	if (cfg.interface3.configured)
+		fnet_script_add(&script, "moveif %s %d", cfg.interface3.dev, child);
 
-	free(cstr);
+	fnet_script_run(&script);
 }
 
 void net_print(pid_t pid) {
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define MAXBUF 4096
+#define NUMA_SYSFS "/sys/devices/system/node"
+// the largest MAX_NUMNODES in distribution kernels
+#define NUMA_MAX_NODES 1024
+
+// --numa-node=node|auto[,bind]: CPU affinity and memory policy for the
+// node, the CPU list of the node is read on the host before the sandbox
+// is started; the node is stored in RUN_FIREJAIL_NUMA_DIR/<pid> for
+// --numa-node=auto, and in RUN_NUMA_CFG for --join
+static cpu_set_t numa_cpus;
+
+void read_numa_node(const char *str) {
+	EUID_ASSERT();
+
+	char *tmp = strdup(str);
+	if (!tmp)
+		errExit("strdup");
+	char *ptr = strchr(tmp, ',');
+	cfg.numa_bind = 0;
+	if (ptr) {
+		*ptr++ = '\0';
+		if (strcmp(ptr, "bind") != 0)
+			goto errexit;
+		cfg.numa_bind = 1;
+	}
+
+	if (strcmp(tmp, "auto") == 0)
+		arg_numa = NUMA_AUTO;
+	else {
+		if (*tmp == '\0')
+			goto errexit;
+		for (ptr = tmp; *ptr; ptr++) {
+			if (!isdigit(*ptr))
+				goto errexit;
+		}
+		cfg.numa_node = atoi(tmp);
+		if (cfg.numa_node >= NUMA_MAX_NODES)
+			goto errexit;
+		arg_numa = NUMA_NODE;
+	}
+	free(tmp);
+	return;
+
+errexit:
+	fprintf(stderr, "Error: invalid numa-node %s; use a node number or auto, optionally followed by ,bind\n", str);
+	exit(1);
+}
+
+// node cpu list, for example "0-7,16-23"; -1 if the node does not exist
+static int node_cpus(int node, cpu_set_t *set) {
+	char *fname;
+	if (asprintf(&fname, "%s/node%d/cpulist", NUMA_SYSFS, node) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return -1;
+
+	char buf[MAXBUF];
+	CPU_ZERO(set);
+	if (fgets(buf, MAXBUF, fp)) {
+		char *ptr = strtok(buf, ",\n");
+		while (ptr) {
+			unsigned first, last;
+			int rv = sscanf(ptr, "%u-%u", &first, &last);
+			if (rv == 1)
+				last = first;
+			if (rv >= 1) {
+				for (; first <= last && first < CPU_SETSIZE; first++)
+					CPU_SET(first, set);
+			}
+			ptr = strtok(NULL, ",\n");
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+static void node_add(int *nodes, int *cnt, int node) {
+	int i;
+	for (i = 0; i < *cnt; i++) {
+		if (nodes[i] == node)
+			return;
+	}
+	nodes[(*cnt)++] = node;
+}
+
+// nodes with memory and cpus
+static int online_nodes(int *nodes) {
+	int cnt = 0;
+	DIR *dir = opendir(NUMA_SYSFS);
+	if (!dir)
+		return 0;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL && cnt < NUMA_MAX_NODES) {
+		int node;
+		char c;
+		if (sscanf(entry->d_name, "node%d%c", &node, &c) != 1 || node < 0 || node >= NUMA_MAX_NODES)
+			continue;
+		cpu_set_t set;
+		if (node_cpus(node, &set) == 0 && CPU_COUNT(&set) > 0)
+			node_add(nodes, &cnt, node);
+	}
+	closedir(dir);
+	return cnt;
+}
+
+static unsigned long long node_free_kb(int node) {
+	char *fname;
+	if (asprintf(&fname, "%s/node%d/meminfo", NUMA_SYSFS, node) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return 0;
+
+	char buf[MAXBUF];
+	unsigned long long rv = 0;
+	while (fgets(buf, MAXBUF, fp)) {
+		// "Node 0 MemFree:        1234567 kB"
+		char *ptr = strstr(buf, "MemFree:");
+		if (ptr && sscanf(ptr + 8, "%llu", &rv) == 1)
+			break;
+	}
+	fclose(fp);
+	return rv;
+}
+
+// sandboxes placed on the node by --numa-node
+static int node_sandboxes(int node) {
+	DIR *dir = opendir(RUN_FIREJAIL_NUMA_DIR);
+	if (!dir)
+		return 0;
+
+	int cnt = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!isdigit(entry->d_name[0]))
+			continue;
+		char *fname;
+		if (asprintf(&fname, "%s/%s", RUN_FIREJAIL_NUMA_DIR, entry->d_name) == -1)
+			errExit("asprintf");
+		FILE *fp = fopen(fname, "re");
+		free(fname);
+		if (!fp)
+			continue;
+		int val;
+		if (fscanf(fp, "%d", &val) == 1 && val == node)
+			cnt++;
+		fclose(fp);
+	}
+	closedir(dir);
+	return cnt;
+}
+
+// the node with the fewest sandboxes, then with the most free memory
+static int numa_auto(void) {
+	int *nodes = malloc(NUMA_MAX_NODES * sizeof(int));
+	if (!nodes)
+		errExit("malloc");
+	int cnt = online_nodes(nodes);
+	if (cnt == 0) {
+		fprintf(stderr, "Error: no NUMA node found in %s\n", NUMA_SYSFS);
+		exit(1);
+	}
+
+	int rv = -1;
+	int rv_sandboxes = 0;
+	unsigned long long rv_free = 0;
+	int i;
+	for (i = 0; i < cnt; i++) {
+		int sandboxes = node_sandboxes(nodes[i]);
+		unsigned long long free_kb = node_free_kb(nodes[i]);
+		if (rv == -1 || sandboxes < rv_sandboxes ||
+		    (sandboxes == rv_sandboxes && free_kb > rv_free)) {
+			rv = nodes[i];
+			rv_sandboxes = sandboxes;
+			rv_free = free_kb;
+		}
+	}
+	free(nodes);
+	return rv;
+}
+
+// the cpus of the node, restricted to --cpu if configured
+static void numa_prepare(void) {
+	if (node_cpus(cfg.numa_node, &numa_cpus) == -1) {
+		fprintf(stderr, "Error: NUMA node %d not found\n", cfg.numa_node);
+		exit(1);
+	}
+
+	if (cfg.cpus) {
+		int i;
+		for (i = 0; i < CPU_SETSIZE; i++) {
+			if (CPU_ISSET(i, &numa_cpus) && (i >= 32 || (cfg.cpus & (1U << i)) == 0))
+				CPU_CLR(i, &numa_cpus);
+		}
+	}
+	if (CPU_COUNT(&numa_cpus) == 0) {
+		fprintf(stderr, "Error: no CPU available on NUMA node %d\n", cfg.numa_node);
+		exit(1);
+	}
+}
+
+// select the node before the sandbox is started; called with the run
+// directory locked, the sandboxes started with auto at the same time
+// see each other
+void numa_select(pid_t pid) {
+	if (arg_numa == NUMA_AUTO)
+		cfg.numa_node = numa_auto();
+	numa_prepare();
+	if (arg_debug)
+		printf("NUMA node %d, %d CPUs\n", cfg.numa_node, CPU_COUNT(&numa_cpus));
+
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NUMA_DIR, pid) == -1)
+		errExit("asprintf");
+	// a leftover from a sandbox with the same pid
+	unlink(fname);
+	FILE *fp = fopen(fname, "wxe");
+	if (!fp) {
+		fprintf(stderr, "Error: cannot create %s\n", fname);
+		exit(1);
+	}
+	fprintf(fp, "%d\n", cfg.numa_node);
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+	free(fname);
+}
+
+void delete_numa_run_file(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NUMA_DIR, pid) == -1)
+		errExit("asprintf");
+	int rv = unlink(fname);
+	(void) rv;
+	free(fname);
+}
+
+void save_numa(void) {
+	if (!arg_numa)
+		return;
+
+	FILE *fp = fopen(RUN_NUMA_CFG, "wxe");
+	if (fp) {
+		fprintf(fp, "%d %d\n", cfg.numa_node, cfg.numa_bind);
+		SET_PERMS_STREAM(fp, 0, 0, 0600);
+		fclose(fp);
+	}
+	else {
+		fprintf(stderr, "Error: cannot save NUMA node\n");
+		exit(1);
+	}
+}
+
+// --join: the node of the sandbox
+void extract_numa(ProcessHandle sandbox) {
+	int fd = process_rootfs_open(sandbox, RUN_NUMA_CFG);
+	if (fd < 0)
+		return; // not configured
+
+	FILE *fp = fdopen(fd, "r");
+	if (!fp)
+		errExit("fdopen");
+
+	int node, bind;
+	if (fscanf(fp, "%d %d", &node, &bind) == 2)
+		numa_join(node, bind);
+	fclose(fp);
+}
+
+// --join: use the node of the sandbox
+void numa_join(int node, int bind) {
+	if (node < 0 || node >= NUMA_MAX_NODES)
+		return;
+	cfg.numa_node = node;
+	cfg.numa_bind = bind;
+	arg_numa = NUMA_NODE;
+	numa_prepare();
+}
+
+// cpu affinity and memory policy, inherited by all the processes
+// started in the sandbox
+void set_numa_policy(void) {
+	if (sched_setaffinity(0, sizeof(numa_cpus), &numa_cpus) == -1)
+		fwarning("cannot set cpu affinity for NUMA node %d\n", cfg.numa_node);
+
+	unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+	memset(mask, 0, sizeof(mask));
+	mask[cfg.numa_node / (8 * sizeof(unsigned long))] |= 1UL << (cfg.numa_node % (8 * sizeof(unsigned long)));
+	int mode = (cfg.numa_bind) ? MPOL_BIND : MPOL_PREFERRED;
+	// the kernel reads maxnode - 1 bits
+	if (syscall(SYS_set_mempolicy, mode, mask, (unsigned long) NUMA_MAX_NODES + 1) == -1)
+		fwarning("cannot set the memory policy for NUMA node %d: %s\n", cfg.numa_node, strerror(errno));
+	else if (arg_debug)
+		printf("Memory policy set to NUMA node %d (%s)\n", cfg.numa_node, (cfg.numa_bind) ? "bind" : "preferred");
+}
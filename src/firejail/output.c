@@ -29,26 +29,40 @@ void check_output(int argc, char **argv) {
 	int i;
 	int outindex = 0;
 	int enable_stderr = 0;
+	const char *compress = NULL;
 
 	for (i = 1; i < argc; i++) {
 		if (strncmp(argv[i], "--", 2) != 0) {
-			return;
+			break;
 		}
 		if (strcmp(argv[i], "--") == 0) {
-			return;
+			break;
 		}
-		if (strncmp(argv[i], "--output=", 9) == 0) {
+		if (!outindex && strncmp(argv[i], "--output=", 9) == 0) {
 			outindex = i;
-			break;
 		}
-		if (strncmp(argv[i], "--output-stderr=", 16) == 0) {
+		else if (!outindex && strncmp(argv[i], "--output-stderr=", 16) == 0) {
 			outindex = i;
 			enable_stderr = 1;
-			break;
+		}
+		else if (strcmp(argv[i], "--output-compress") == 0) {
+			compress = "gzip";
+		}
+		else if (strncmp(argv[i], "--output-compress=", 18) == 0) {
+			compress = argv[i] + 18;
+			if (strcmp(compress, "gzip") != 0 && strcmp(compress, "zstd") != 0) {
+				fprintf(stderr, "Error: invalid --output-compress option, expecting gzip or zstd\n");
+				exit(1);
+			}
 		}
 	}
-	if (!outindex)
+	if (!outindex) {
+		if (compress) {
+			fprintf(stderr, "Error: --output-compress requires --output or --output-stderr\n");
+			exit(1);
+		}
 		return;
+	}
 
 	drop_privs(0);
 	char *outfile = argv[outindex];
@@ -107,10 +121,17 @@ void check_output(int argc, char **argv) {
 		// restore some environment variables
 		env_apply_whitelist_sbox();
 
-		char *args[3];
-		args[0] = LIBDIR "/firejail/ftee";
-		args[1] = outfile;
-		args[2] = NULL;
+		char *args[4];
+		int n = 0;
+		args[n++] = LIBDIR "/firejail/ftee";
+		char *arg_compress = NULL;
+		if (compress) {
+			if (asprintf(&arg_compress, "--compress=%s", compress) == -1)
+				errExit("asprintf");
+			args[n++] = arg_compress;
+		}
+		args[n++] = outfile;
+		args[n] = NULL;
 		execv(args[0], args);
 		perror("execvp");
 		exit(1);
@@ -143,6 +164,10 @@ void check_output(int argc, char **argv) {
 			if (strncmp(argv[i], "--output-stderr=", 16) == 0) {
 				continue;
 			}
+			if (strcmp(argv[i], "--output-compress") == 0 ||
+			    strncmp(argv[i], "--output-compress=", 18) == 0) {
+				continue;
+			}
 			if (strncmp(argv[i], "--", 2) != 0 || strcmp(argv[i], "--") == 0) {
 				found_separator = true;
 			}
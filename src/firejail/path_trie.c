@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Path-component trie for noblacklist/nowhitelist patterns.
+//
+// A pattern is split on '/' (empty components are kept, "a//b" matches only
+// "a//b", same as fnmatch). Literal components are looked up in a hash table
+// keyed by (parent node, component); components with '*' or '?' are kept in
+// a per-node list and matched with a small glob matcher. With FNM_PATHNAME
+// a wildcard never matches '/', so matching component by component gives the
+// same result as fnmatch(pattern, path, FNM_PATHNAME) on the full path.
+// Patterns using '[' or '\' are not split, they are checked with fnmatch().
+//
+// Every pattern gets an index in insertion order; a lookup returns the
+// lowest index of the matching patterns, or -1.
+
+#include "firejail.h"
+#include <fnmatch.h>
+
+typedef struct trie_node_t {
+	struct trie_node_t *parent;
+	char *comp;			// component, NULL for the root node
+	struct trie_node_t *wild;	// wildcard children
+	struct trie_node_t *wild_next;	// next wildcard sibling
+	int index;			// lowest pattern index ending here, -1 if none
+} TrieNode;
+
+struct path_trie_t {
+	TrieNode root;
+	TrieNode **table;	// literal children, open addressing
+	unsigned tsize;		// power of 2
+	unsigned tcnt;
+	char **patterns;	// insertion order
+	int cnt;
+	int max;
+	int *slow;		// indexes of patterns checked with fnmatch()
+	int slow_cnt;
+};
+
+// FNV-1a over the parent pointer and the component
+static unsigned node_hash(const TrieNode *parent, const char *comp, size_t len) {
+	return fnv1a32_update(fnv1a32(&parent, sizeof(parent)), comp, len);
+}
+
+static TrieNode *literal_find(PathTrie *t, const TrieNode *parent, const char *comp, size_t len) {
+	if (t->tcnt == 0)
+		return NULL;
+	unsigned pos = node_hash(parent, comp, len) & (t->tsize - 1);
+	TrieNode *n;
+	while ((n = t->table[pos]) != NULL) {
+		if (n->parent == parent && strncmp(n->comp, comp, len) == 0 && n->comp[len] == '\0')
+			return n;
+		pos = (pos + 1) & (t->tsize - 1);
+	}
+	return NULL;
+}
+
+static void literal_insert(PathTrie *t, TrieNode *n) {
+	unsigned pos = node_hash(n->parent, n->comp, strlen(n->comp)) & (t->tsize - 1);
+	while (t->table[pos])
+		pos = (pos + 1) & (t->tsize - 1);
+	t->table[pos] = n;
+}
+
+static void literal_grow(PathTrie *t) {
+	TrieNode **old = t->table;
+	unsigned oldsize = t->tsize;
+
+	t->tsize = (oldsize) ? oldsize * 2 : 256;
+	t->table = calloc(t->tsize, sizeof(TrieNode *));
+	if (!t->table)
+		errExit("calloc");
+
+	unsigned i;
+	for (i = 0; i < oldsize; i++)
+		if (old[i])
+			literal_insert(t, old[i]);
+	free(old);
+}
+
+static TrieNode *node_new(TrieNode *parent, const char *comp, size_t len) {
+	TrieNode *n = calloc(1, sizeof(TrieNode));
+	if (!n)
+		errExit("calloc");
+	n->parent = parent;
+	n->comp = strndup(comp, len);
+	if (!n->comp)
+		errExit("strndup");
+	n->index = -1;
+	return n;
+}
+
+static int is_wild(const char *comp, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++)
+		if (comp[i] == '*' || comp[i] == '?')
+			return 1;
+	return 0;
+}
+
+// '*' and '?' only, the string is a single path component
+static int wild_match(const char *p, const char *s, size_t slen) {
+	const char *star = NULL;
+	size_t star_s = 0;
+	size_t i = 0;
+
+	while (i < slen) {
+		if (*p == '?') {
+			p++;
+			i++;
+		}
+		else if (*p == '*') {
+			star = ++p;
+			star_s = i;
+		}
+		else if (*p && *p == s[i]) {
+			p++;
+			i++;
+		}
+		else if (star) {
+			p = star;
+			i = ++star_s;
+		}
+		else
+			return 0;
+	}
+	while (*p == '*')
+		p++;
+	return *p == '\0';
+}
+
+PathTrie *path_trie_new(void) {
+	PathTrie *t = calloc(1, sizeof(PathTrie));
+	if (!t)
+		errExit("calloc");
+	t->root.index = -1;
+	return t;
+}
+
+// add a pattern; with literal set, '*', '?', '[' and '\' are regular characters
+void path_trie_add(PathTrie *t, const char *pattern, int literal) {
+	assert(t);
+	assert(pattern);
+
+	if (t->cnt == t->max) {
+		t->max = (t->max) ? t->max * 2 : 64;
+		t->patterns = realloc(t->patterns, t->max * sizeof(char *));
+		if (!t->patterns)
+			errExit("realloc");
+	}
+	int index = t->cnt++;
+	t->patterns[index] = strdup(pattern);
+	if (!t->patterns[index])
+		errExit("strdup");
+
+	if (!literal && strpbrk(pattern, "[\\")) {
+		t->slow = realloc(t->slow, (t->slow_cnt + 1) * sizeof(int));
+		if (!t->slow)
+			errExit("realloc");
+		t->slow[t->slow_cnt++] = index;
+		return;
+	}
+
+	TrieNode *node = &t->root;
+	const char *ptr = pattern;
+	while (1) {
+		const char *end = strchrnul(ptr, '/');
+		size_t len = end - ptr;
+
+		TrieNode *next;
+		if (!literal && is_wild(ptr, len)) {
+			for (next = node->wild; next; next = next->wild_next)
+				if (strncmp(next->comp, ptr, len) == 0 && next->comp[len] == '\0')
+					break;
+			if (!next) {
+				next = node_new(node, ptr, len);
+				next->wild_next = node->wild;
+				node->wild = next;
+			}
+		}
+		else {
+			next = literal_find(t, node, ptr, len);
+			if (!next) {
+				if ((t->tcnt + 1) * 2 > t->tsize)
+					literal_grow(t);
+				next = node_new(node, ptr, len);
+				literal_insert(t, next);
+				t->tcnt++;
+			}
+		}
+		node = next;
+
+		if (*end == '\0')
+			break;
+		ptr = end + 1;
+	}
+
+	if (node->index == -1)
+		node->index = index;
+}
+
+static int min_index(int a, int b) {
+	if (a == -1)
+		return b;
+	if (b == -1)
+		return a;
+	return (a < b) ? a : b;
+}
+
+static int match_node(PathTrie *t, const TrieNode *node, const char *ptr) {
+	const char *end = strchrnul(ptr, '/');
+	size_t len = end - ptr;
+	int rv = -1;
+
+	const TrieNode *next = literal_find(t, node, ptr, len);
+	if (next)
+		rv = (*end == '\0') ? next->index : match_node(t, next, end + 1);
+
+	for (next = node->wild; next; next = next->wild_next) {
+		if (!wild_match(next->comp, ptr, len))
+			continue;
+		int r = (*end == '\0') ? next->index : match_node(t, next, end + 1);
+		rv = min_index(rv, r);
+	}
+
+	return rv;
+}
+
+// return the lowest index of the patterns matching path, -1 if none
+int path_trie_match(PathTrie *t, const char *path) {
+	assert(t);
+	assert(path);
+
+	int rv = match_node(t, &t->root, path);
+
+	int i;
+	for (i = 0; i < t->slow_cnt; i++) {
+		int index = t->slow[i];
+		if (rv != -1 && index > rv)
+			break;
+		int result = fnmatch(t->patterns[index], path, FNM_PATHNAME);
+		if (result == 0)
+			rv = min_index(rv, index);
+		else if (result != FNM_NOMATCH) {
+			fprintf(stderr, "Error: failed to compare path %s with pattern %s\n", path, t->patterns[index]);
+			exit(1);
+		}
+	}
+
+	return rv;
+}
+
+int path_trie_count(const PathTrie *t) {
+	assert(t);
+	return t->cnt;
+}
+
+const char *path_trie_pattern(const PathTrie *t, int index) {
+	assert(t);
+	assert(index >= 0 && index < t->cnt);
+	return t->patterns[index];
+}
+
+static void free_wild(TrieNode *n) {
+	while (n) {
+		TrieNode *next = n->wild_next;
+		free_wild(n->wild);
+		free(n->comp);
+		free(n);
+		n = next;
+	}
+}
+
+void path_trie_free(PathTrie *t) {
+	if (!t)
+		return;
+
+	// literal nodes are in the hash table, wildcard nodes are reachable only
+	// from the wild list of their parent
+	free_wild(t->root.wild);
+	unsigned i;
+	for (i = 0; i < t->tsize; i++) {
+		TrieNode *n = t->table[i];
+		if (n)
+			free_wild(n->wild);
+	}
+	for (i = 0; i < t->tsize; i++) {
+		TrieNode *n = t->table[i];
+		if (n) {
+			free(n->comp);
+			free(n);
+		}
+	}
+	free(t->table);
+
+	int j;
+	for (j = 0; j < t->cnt; j++)
+		free(t->patterns[j]);
+	free(t->patterns);
+	free(t->slow);
+	free(t);
+}
@@ -19,6 +19,9 @@
 */
 #include "firejail.h"
 #include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
 
 static char **paths = 0;
 static unsigned int path_cnt = 0;
@@ -158,7 +161,8 @@ int program_in_path(const char *program) {
 		// the end of 'program'.
 		memcpy(scratch + dlen, program, proglen+1);
 
-		if (access(scratch, X_OK) == 0) {
+		if (path_cache_lookup(dir, program) &&
+		    access(scratch, X_OK) == 0) {
 			// must also verify that this is a regular file
 			// ('x' permission means something different for directories).
 			// exec follows symlinks, so use stat, not lstat.
@@ -177,3 +181,136 @@ int program_in_path(const char *program) {
 	free(scratch);
 	return found;
 }
+
+//***********************************************************************
+// Directory entry cache for the program lookups in $PATH and in the
+// private-bin directories: every directory is read once, and its names are
+// kept in an open addressing hash set. A lookup only says if the name is
+// not in the directory, the callers still stat() the files found. The cache
+// is dropped when the mount table changes, this is detected with poll() on
+// /proc/self/mountinfo, and in a new process.
+//***********************************************************************
+typedef struct dir_cache_t {
+	struct dir_cache_t *next;
+	char *dir;
+	int valid;		// 0 if the directory could not be read
+	uint32_t mask;		// hash table size - 1
+	uint32_t *tab;		// name offset + 1, 0 for an empty slot
+	char *names;		// '\0' terminated names
+} DirCache;
+
+static DirCache *dir_cache = NULL;
+static int dir_cache_fd = -1;	// /proc/self/mountinfo
+static pid_t dir_cache_pid = 0;
+
+static void dir_cache_flush(void) {
+	while (dir_cache) {
+		DirCache *next = dir_cache->next;
+		free(dir_cache->dir);
+		free(dir_cache->tab);
+		free(dir_cache->names);
+		free(dir_cache);
+		dir_cache = next;
+	}
+}
+
+static void dir_cache_check(void) {
+	if (dir_cache_pid == getpid() && dir_cache_fd != -1) {
+		struct pollfd pfd = { .fd = dir_cache_fd, .events = POLLPRI };
+		int rv = poll(&pfd, 1, 0);
+		if (rv == 0)
+			return;
+	}
+
+	dir_cache_flush();
+	if (dir_cache_fd != -1)
+		close(dir_cache_fd);
+	dir_cache_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+	dir_cache_pid = getpid();
+	if (dir_cache_fd != -1) {
+		// acknowledge the events so far
+		struct pollfd pfd = { .fd = dir_cache_fd, .events = POLLPRI };
+		if (poll(&pfd, 1, 0) == -1) {
+			close(dir_cache_fd);
+			dir_cache_fd = -1;
+		}
+	}
+}
+
+static DirCache *dir_cache_read(const char *dir) {
+	DirCache *dc = calloc(1, sizeof(DirCache));
+	if (!dc)
+		errExit("calloc");
+	dc->dir = strdup(dir);
+	if (!dc->dir)
+		errExit("strdup");
+	dc->next = dir_cache;
+	dir_cache = dc;
+
+	DIR *d = opendir(dir);
+	if (!d)
+		return dc;
+
+	size_t len = 0, max = 4096;
+	size_t cnt = 0;
+	dc->names = malloc(max);
+	if (!dc->names)
+		errExit("malloc");
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		size_t l = strlen(entry->d_name) + 1;
+		if (len + l > max) {
+			max *= 2;
+			dc->names = realloc(dc->names, max);
+			if (!dc->names)
+				errExit("realloc");
+		}
+		memcpy(dc->names + len, entry->d_name, l);
+		len += l;
+		cnt++;
+	}
+	closedir(d);
+
+	uint32_t size = 64;
+	while (size < cnt * 2)
+		size *= 2;
+	dc->mask = size - 1;
+	dc->tab = calloc(size, sizeof(uint32_t));
+	if (!dc->tab)
+		errExit("calloc");
+	size_t off;
+	for (off = 0; off < len; off += strlen(dc->names + off) + 1) {
+		uint32_t i = fnv1a32_str(dc->names + off) & dc->mask;
+		while (dc->tab[i])
+			i = (i + 1) & dc->mask;
+		dc->tab[i] = off + 1;
+	}
+	dc->valid = 1;
+	return dc;
+}
+
+// return 0 if dir doesn't have an entry called name, 1 if it could have one
+int path_cache_lookup(const char *dir, const char *name) {
+	assert(dir);
+	assert(name);
+	if (*name == '\0' || strchr(name, '/'))
+		return 1;
+
+	dir_cache_check();
+	DirCache *dc;
+	for (dc = dir_cache; dc; dc = dc->next)
+		if (strcmp(dc->dir, dir) == 0)
+			break;
+	if (!dc)
+		dc = dir_cache_read(dir);
+	if (!dc->valid)
+		return 1;
+
+	uint32_t i = fnv1a32_str(name) & dc->mask;
+	while (dc->tab[i]) {
+		if (strcmp(dc->names + dc->tab[i] - 1, name) == 0)
+			return 1;
+		i = (i + 1) & dc->mask;
+	}
+	return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --pause, --resume: freeze and thaw the cgroup of a sandbox started with
+// --cgroup-leaf. A frozen sandbox keeps its memory and its file
+// descriptors, and it is not scheduled until it is thawed.
+//
+// --pool=name, --pool-join=name: the sandboxes started with --pool are
+// kept ready, usually paused once they finished their startup. A job
+// started with --pool-join claims one of them, preferring the paused
+// ones, resumes it, runs the program with --join and pauses it again
+// when the program exits. The claim is a flock on the cgroup directory of
+// the sandbox, released when the --pool-join process exits.
+
+#include "firejail.h"
+#include "../include/run_record.h"
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+
+static char *require_leaf(pid_t pid) {
+	char *leaf = cgroup_leaf_path(pid);
+	if (!leaf) {
+		fprintf(stderr, "Error: sandbox %d does not have its own cgroup, start it with --cgroup-leaf\n", pid);
+		exit(1);
+	}
+	return leaf;
+}
+
+static void freeze(pid_t pid, int on) {
+	EUID_ASSERT();
+
+	// check the owner of the sandbox
+	ProcessHandle sandbox = pin_sandbox_process(pid);
+	unpin_process(sandbox);
+
+	char *leaf = require_leaf(pid);
+	EUID_ROOT();
+	int rv = cgroup_leaf_freeze(leaf, on);
+	int err = errno;
+	EUID_USER();
+	if (rv == -1) {
+		fprintf(stderr, "Error: cannot %s sandbox %d: %s\n", (on) ? "pause" : "resume", pid, strerror(err));
+		exit(1);
+	}
+	free(leaf);
+}
+
+void sandbox_pause(pid_t pid) {
+	freeze(pid, 1);
+}
+
+void sandbox_resume(pid_t pid) {
+	freeze(pid, 0);
+}
+
+// a paused sandbox would handle SIGTERM only when it is killed at the end
+// of the grace period; the checks of --shutdown are already done
+void sandbox_thaw(pid_t pid) {
+	char *leaf = cgroup_leaf_path(pid);
+	if (!leaf)
+		return;
+	EUID_ROOT();
+	if (cgroup_leaf_frozen(leaf) == 1)
+		cgroup_leaf_freeze(leaf, 0);
+	EUID_USER();
+	free(leaf);
+}
+
+// real uid of the firejail process, -1 if not found
+static uid_t process_uid(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/status", pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return (uid_t) -1;
+
+	char buf[256];
+	uid_t uid = (uid_t) -1;
+	while (fgets(buf, sizeof(buf), fp)) {
+		unsigned u;
+		if (sscanf(buf, "Uid: %u", &u) == 1) {
+			uid = u;
+			break;
+		}
+	}
+	fclose(fp);
+	return uid;
+}
+
+// claim a sandbox of the pool, paused sandboxes first; return the pid,
+// 0 if all the sandboxes are busy
+static pid_t pool_claim(const char *pool, int frozen, int *lock_fd, int *was_frozen) {
+	DIR *dir = opendir(RUN_FIREJAIL_RECORD_DIR);
+	if (!dir)
+		return 0;
+
+	pid_t rv = 0;
+	uid_t uid = getuid();
+	struct dirent *entry;
+	while (!rv && (entry = readdir(dir)) != NULL) {
+		pid_t pid;
+		RunRecord rec;
+		if (sscanf(entry->d_name, "%d", &pid) != 1 || run_record_read(pid, &rec) == -1 ||
+		    rec.child == 0 || strcmp(rec.pool, pool) != 0)
+			continue;
+		if (uid != 0 && process_uid(pid) != uid)
+			continue;
+		char *leaf = cgroup_leaf_path(pid);
+		if (!leaf)
+			continue;
+
+		EUID_ROOT();
+		int state = cgroup_leaf_frozen(leaf);
+		if (state == frozen) {
+			int fd = open(leaf, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd != -1 && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+				*lock_fd = fd;
+				*was_frozen = state;
+				rv = pid;
+			}
+			else if (fd != -1)
+				close(fd);
+		}
+		EUID_USER();
+		free(leaf);
+	}
+	closedir(dir);
+	return rv;
+}
+
+static pid_t job = 0;
+
+static void forward_signal(int sig) {
+	if (job)
+		kill(job, sig);
+}
+
+void pool_join(const char *pool, int argc, char **argv, int index) {
+	EUID_ASSERT();
+
+	int lock_fd = -1;
+	int was_frozen = 0;
+	pid_t pid = pool_claim(pool, 1, &lock_fd, &was_frozen);
+	if (!pid)
+		pid = pool_claim(pool, 0, &lock_fd, &was_frozen);
+	if (!pid) {
+		fprintf(stderr, "Error: no sandbox available in pool %s\n", pool);
+		exit(1);
+	}
+	if (arg_debug)
+		printf("Pool %s: sandbox %d%s\n", pool, pid, (was_frozen) ? ", paused" : "");
+
+	if (was_frozen)
+		sandbox_resume(pid);
+
+	// the program runs in a child and the sandbox is paused again when
+	// it exits; Ctrl-C goes to the process group, signals sent to this
+	// process are passed on
+	fflush(0);
+	job = fork();
+	if (job == -1)
+		errExit("fork");
+	if (job == 0) {
+		close(lock_fd);
+		join(pid, argc, argv, index);
+		__builtin_unreachable();
+	}
+	signal(SIGINT, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+	signal(SIGTERM, forward_signal);
+	signal(SIGHUP, forward_signal);
+
+	int status;
+	while (waitpid(job, &status, 0) == -1) {
+		if (errno != EINTR)
+			errExit("waitpid");
+	}
+
+	if (was_frozen) {
+		char *leaf = cgroup_leaf_path(pid);
+		if (leaf) {
+			EUID_ROOT();
+			// the sandbox could be gone
+			if (cgroup_leaf_freeze(leaf, 1) == -1 && arg_debug)
+				printf("Cannot pause sandbox %d again\n", pid);
+			EUID_USER();
+			free(leaf);
+		}
+	}
+	close(lock_fd);
+
+	if (WIFEXITED(status))
+		exit(WEXITSTATUS(status));
+	exit(128 + WTERMSIG(status));
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include "../include/perf_counters.h"
+#include <errno.h>
+
+// --perf-stat: the counters are opened by the parent, outside the sandbox,
+// before the child is released, and they are printed when the sandbox
+// exits. A sandbox with a cgroup is counted with one counter per cpu for
+// the cgroup, otherwise the counters are inherited by all the processes
+// started by the child.
+static PerfCounters counters;
+static int counting = 0;
+
+// counting in kernel mode is allowed to regular users only with
+// perf_event_paranoid 1 or lower, the parent doesn't bypass the setting
+static int kernel_allowed(void) {
+	if (getuid() == 0)
+		return 1;
+	FILE *fp = fopen("/proc/sys/kernel/perf_event_paranoid", "re");
+	if (!fp)
+		return 0;
+	int paranoid = 2;
+	if (fscanf(fp, "%d", &paranoid) != 1)
+		paranoid = 2;
+	fclose(fp);
+	return paranoid <= 1;
+}
+
+void perf_stat_start(pid_t child) {
+	EUID_ASSERT();
+	perf_counters_init(&counters);
+	int kernel = kernel_allowed();
+	int cgroup_fd = (arg_cgroup_leaf) ? cgroup_leaf_open() : -1;
+
+	EUID_ROOT();
+	int opened = 0;
+	if (cgroup_fd != -1) {
+		opened = perf_counters_cgroup(&counters, cgroup_fd, kernel);
+		close(cgroup_fd);
+		if (arg_debug && opened)
+			printf("Performance counters opened for the sandbox cgroup\n");
+	}
+	if (!opened) {
+		opened = perf_counters_task(&counters, child, kernel);
+		if (arg_debug && opened)
+			printf("Performance counters opened for process %d\n", child);
+	}
+	int err = errno;
+	EUID_USER();
+
+	if (opened)
+		counting = 1;
+	else
+		fwarning("cannot open the performance counters: %s, --perf-stat disabled\n", strerror(err));
+}
+
+// on stderr, the output of the application could go to a pipe
+void perf_stat_print(void) {
+	if (!counting)
+		return;
+	counting = 0;
+
+	PerfValues v;
+	perf_counters_read(&counters, &v);
+	perf_counters_close(&counters);
+	fprintf(stderr, "\nPerformance counters for the sandbox:\n");
+	perf_values_print(stderr, &v, NULL, "  ");
+}
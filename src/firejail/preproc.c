@@ -18,9 +18,11 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "firejail.h"
+#include "../include/launch_stats.h"
 #include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
@@ -77,7 +79,9 @@ static void uninstall_ignore_tstp_signal_handler(struct sigaction* backup_action
 	}
 }
 
-static void preproc_lock_file(const char *path, int *lockfd_ptr) {
+// with nowait set, return 0 without waiting if the lock is taken
+// by another process; return 1 if the lock is acquired
+static int preproc_lock_file(const char *path, int *lockfd_ptr, int nowait) {
 	assert(path);
 	assert(lockfd_ptr);
 
@@ -88,7 +92,7 @@ static void preproc_lock_file(const char *path, int *lockfd_ptr) {
 	if (*lockfd_ptr != -1) {
 		if (arg_debug)
 			printf("pid=%ld: already locked %s\n", pid, path);
-		return;
+		return 1;
 	}
 
 	int lockfd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
@@ -104,9 +108,18 @@ static void preproc_lock_file(const char *path, int *lockfd_ptr) {
 
 	unsigned long sleep_usec = LOCK_INITIAL_SLEEP_USEC;
 	unsigned long wait_total = 0U;
+	unsigned retries = 0;
+	unsigned long long start = sprof_now();
 
 	while (flock(lockfd, LOCK_EX | LOCK_NB) == -1) {
 		if (errno == EWOULDBLOCK) {
+			if (nowait) {
+				if (arg_debug)
+					printf("pid=%ld: %s is busy\n", pid, path);
+				close(lockfd);
+				return 0;
+			}
+			retries++;
 			if (wait_total >= LOCK_TIMEOUT_USEC) {
 				fprintf(stderr, "Error: timeout occurred while trying to lock %s\n", path);
 				errExit("flock");
@@ -129,9 +142,22 @@ static void preproc_lock_file(const char *path, int *lockfd_ptr) {
 		}
 	}
 
+	// time spent waiting for the lock, for --profile-startup
+	char name[64];
+	snprintf(name, sizeof(name), "lock wait %s", gnu_basename(path));
+	char args[64];
+	snprintf(args, sizeof(args), "\"retries\":%u", retries);
+	unsigned long long waited = sprof_now() - start;
+	sprof_span(name, start, waited, args);
+	if (retries) {
+		stats_add(STATS_LOCK_WAITS, 1);
+		stats_add(STATS_LOCK_WAIT_USEC, waited);
+	}
+
 	*lockfd_ptr = lockfd;
 	if (arg_debug)
 		printf("pid=%ld: locked %s\n", pid, path);
+	return 1;
 }
 
 static void preproc_unlock_file(const char *path, int *lockfd_ptr) {
@@ -166,7 +192,16 @@ static void preproc_unlock_file(const char *path, int *lockfd_ptr) {
 
 void preproc_lock_firejail_dir(void) {
 	install_ignore_tstp_signal_handler(&backup_tstp_directory_action);
-	preproc_lock_file(RUN_DIRECTORY_LOCK_FILE, &lockfd_directory);
+	preproc_lock_file(RUN_DIRECTORY_LOCK_FILE, &lockfd_directory, 0);
+}
+
+// return 0 if another process holds the lock
+int preproc_trylock_firejail_dir(void) {
+	install_ignore_tstp_signal_handler(&backup_tstp_directory_action);
+	if (preproc_lock_file(RUN_DIRECTORY_LOCK_FILE, &lockfd_directory, 1))
+		return 1;
+	uninstall_ignore_tstp_signal_handler(&backup_tstp_directory_action);
+	return 0;
 }
 
 void preproc_unlock_firejail_dir(void) {
@@ -176,7 +211,7 @@ void preproc_unlock_firejail_dir(void) {
 
 void preproc_lock_firejail_network_dir(void) {
 	install_ignore_tstp_signal_handler(&backup_tstp_network_action);
-	preproc_lock_file(RUN_NETWORK_LOCK_FILE, &lockfd_network);
+	preproc_lock_file(RUN_NETWORK_LOCK_FILE, &lockfd_network, 0);
 }
 
 void preproc_unlock_firejail_network_dir(void) {
@@ -199,19 +234,38 @@ void preproc_build_firejail_dir_unlocked(void) {
 	create_empty_dir_as_root(RUN_FIREJAIL_DIR, 0755);
 }
 
+// RUN_RO_FILE is remounted last; once it is read-only, the directory
+// hierarchy was built by a previous sandbox
+static int firejail_dir_built(void) {
+	struct statvfs buf;
+	return statvfs(RUN_RO_FILE, &buf) == 0 && (buf.f_flag & ST_RDONLY);
+}
+
 // build directory hierarchy under /run/firejail
 //
-// Note: Remounts have timing hazards. This function should
-// only be called after acquiring the directory lock via
-// preproc_lock_firejail_dir().
-void preproc_build_firejail_dir_locked(void) {
+// The directories and files are created without the directory lock,
+// concurrent sandboxes are fine with EEXIST. Remounts have timing hazards,
+// they are done under the lock, and only until the hierarchy is complete.
+void preproc_build_firejail_dir(void) {
 	create_empty_dir_as_root(RUN_FIREJAIL_NETWORK_DIR, 0755);
 	create_empty_dir_as_root(RUN_FIREJAIL_BANDWIDTH_DIR, 0755);
-	create_empty_dir_as_root(RUN_FIREJAIL_NAME_DIR, 0755);
-	create_empty_dir_as_root(RUN_FIREJAIL_PROFILE_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_RECORD_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_NAME_INDEX_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_CGROUP_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_NUMA_DIR, 0755);
 	create_empty_dir_as_root(RUN_FIREJAIL_X11_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_SNAPSHOT_DIR, 0755);
 	create_empty_dir_as_root(RUN_FIREJAIL_APPIMAGE_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_ROOTFS_DIR, 0755);
 	create_empty_dir_as_root(RUN_FIREJAIL_LIB_DIR, 0755);
+	create_empty_dir_as_root(RUN_FIREJAIL_SECCOMP_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_FLDD_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_DEV_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_USERS_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_VAR_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_KPATH_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_HOSTS_CACHE_DIR, 0700);
+	create_empty_dir_as_root(RUN_FIREJAIL_PULSE_CACHE_DIR, 0700);
 	create_empty_dir_as_root(RUN_MNT_DIR, 0755);
 
 	// restricted search permission
@@ -220,14 +274,19 @@ void preproc_build_firejail_dir_locked(void) {
 
 #ifdef HAVE_DBUSPROXY
 	create_empty_dir_as_root(RUN_FIREJAIL_DBUS_DIR, 0755);
-	fs_remount(RUN_FIREJAIL_DBUS_DIR, MOUNT_NOEXEC, 0);
 #endif
-
 	create_empty_dir_as_root(RUN_RO_DIR, S_IRUSR);
-	fs_remount(RUN_RO_DIR, MOUNT_READONLY, 0);
-
 	create_empty_file_as_root(RUN_RO_FILE, S_IRUSR);
+	if (firejail_dir_built())
+		return;
+
+	preproc_lock_firejail_dir();
+#ifdef HAVE_DBUSPROXY
+	fs_remount(RUN_FIREJAIL_DBUS_DIR, MOUNT_NOEXEC, 0);
+#endif
+	fs_remount(RUN_RO_DIR, MOUNT_READONLY, 0);
 	fs_remount(RUN_RO_FILE, MOUNT_READONLY, 0);
+	preproc_unlock_firejail_dir();
 }
 
 // build /run/firejail/mnt directory
@@ -236,7 +295,7 @@ void preproc_mount_mnt_dir(void) {
 	if (!tmpfs_mounted) {
 		if (arg_debug)
 			printf("Mounting tmpfs on %s directory\n", RUN_MNT_DIR);
-		if (mount("tmpfs", RUN_MNT_DIR, "tmpfs", MS_NOSUID | MS_STRICTATIME,  "mode=755,gid=0") < 0)
+		if (tmpfs_mount(RUN_MNT_DIR, MS_NOSUID | MS_STRICTATIME, "mode=755,gid=0", TMPFS_COPY) < 0)
 			errExit("mounting /run/firejail/mnt");
 		tmpfs_mounted = 1;
 		fs_logger2("tmpfs", RUN_MNT_DIR);
@@ -288,7 +347,32 @@ void preproc_mount_mnt_dir(void) {
 	}
 }
 
-static void clean_dir(const char *name, int *pidarr, int start_pid, int max_pids) {
+// the firejail process of a running sandbox holds a lock on its sandbox run
+// file; without the lock, the sandbox could be still starting
+static int sandbox_alive(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_SANDBOX_DIR, pid) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	free(fname);
+	if (fd != -1) {
+		struct flock lock = {
+			.l_type = F_WRLCK,
+			.l_whence = SEEK_SET,
+			.l_start = 0,
+			.l_len = 0,
+			.l_pid = 0,
+		};
+		int rv = fcntl(fd, F_GETLK, &lock);
+		close(fd);
+		if (rv == 0 && lock.l_type != F_UNLCK && lock.l_pid == pid)
+			return 1;
+	}
+
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+static void clean_dir(const char *name) {
 	DIR *dir;
 	if (!(dir = opendir(name))) {
 		fwarning("cannot clean %s directory\n", name);
@@ -299,71 +383,22 @@ static void clean_dir(const char *name, int *pidarr, int start_pid, int max_pids
 	struct dirent *entry;
 	char *end;
 	while ((entry = readdir(dir)) != NULL) {
-		pid_t pid = strtol(entry->d_name, &end, 10);
-		pid %= max_pids;
+		long pid = strtol(entry->d_name, &end, 10);
 		if (end == entry->d_name || *end)
 			continue;
 
-		if (pid < start_pid)
+		if (pid < 100 || pid > 4194304)	// this is the max value supported on 64 bit Linux kernels
 			continue;
-		if (pidarr[pid] == 0)
+		if (!sandbox_alive(pid))
 			delete_run_files(pid);
 	}
 	closedir(dir);
 }
 
-
-// clean run directory
+// clean run directory; only the pids with run files are checked
 void preproc_clean_run(void) {
-	int max_pids=32769;
-	int start_pid = 100;
-	// extract real max_pids
-	FILE *fp = fopen("/proc/sys/kernel/pid_max", "re");
-	if (fp) {
-		int val;
-		if (fscanf(fp, "%d", &val) == 1) {
-			if (val > 4194304)	// this is the max value supported on 64 bit Linux kernels
-				val = 4194304;
-			if (val >= max_pids)
-				max_pids = val + 1;
-		}
-		fclose(fp);
-	}
-	int *pidarr = malloc(max_pids * sizeof(int));
-	if (!pidarr)
-		errExit("malloc");
-
-	memset(pidarr, 0, max_pids * sizeof(int));
-
-	// open /proc directory
-	DIR *dir;
-	if (!(dir = opendir("/proc"))) {
-		// sleep 2 seconds and try again
-		sleep(2);
-		if (!(dir = opendir("/proc"))) {
-			fprintf(stderr, "Error: cannot open /proc directory\n");
-			exit(1);
-		}
-	}
-
-	// read /proc and populate pidarr with all active processes
-	struct dirent *entry;
-	char *end;
-	while ((entry = readdir(dir)) != NULL) {
-		pid_t pid = strtol(entry->d_name, &end, 10);
-		pid %= max_pids;
-		if (end == entry->d_name || *end)
-			continue;
-
-		if (pid < start_pid)
-			continue;
-		pidarr[pid] = 1;
-	}
-	closedir(dir);
-
-	// clean profile and name directories
-	clean_dir(RUN_FIREJAIL_PROFILE_DIR, pidarr, start_pid, max_pids);
-	clean_dir(RUN_FIREJAIL_NAME_DIR, pidarr, start_pid, max_pids);
-
-	free(pidarr);
+	clean_dir(RUN_FIREJAIL_SANDBOX_DIR);
+	clean_dir(RUN_FIREJAIL_RECORD_DIR);
+	clean_dir(RUN_FIREJAIL_CGROUP_DIR);
+	clean_dir(RUN_FIREJAIL_NUMA_DIR);
 }
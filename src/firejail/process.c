@@ -19,7 +19,9 @@
  */
 #include "firejail.h"
 #include <errno.h>
+#include <poll.h>
 #include <signal.h>
+#include <time.h>
 
 #include <fcntl.h>
 #ifndef O_PATH
@@ -30,12 +32,16 @@
 #ifndef __NR_pidfd_send_signal
 #define __NR_pidfd_send_signal 424
 #endif
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
 
 #define BUFLEN 4096
 
 struct processhandle_instance_t {
 	pid_t pid;
 	int fd;  // file descriptor referring to /proc/[PID]
+	int pidfd;  // pidfd, opened on first use, -1 if not available
 };
 
 
@@ -61,12 +67,15 @@ ProcessHandle pin_process(pid_t pid) {
 		exit(1);
 	}
 	rv->fd = fd;
+	rv->pidfd = -2;
 
 	return rv;
 }
 
 void unpin_process(ProcessHandle process) {
 	close(process->fd);
+	if (process->pidfd >= 0)
+		close(process->pidfd);
 	free(process);
 }
 
@@ -78,6 +87,28 @@ int process_get_fd(ProcessHandle process) {
 	return process->fd;
 }
 
+// pidfd for the pinned process (Linux >= 5.3), -1 if not available
+static int process_get_pidfd(ProcessHandle process) {
+	if (process->pidfd != -2)
+		return process->pidfd;
+
+	process->pidfd = syscall(__NR_pidfd_open, process->pid, 0);
+	if (process->pidfd < 0) {
+		process->pidfd = -1;
+		return -1;
+	}
+	fcntl(process->pidfd, F_SETFD, FD_CLOEXEC);
+
+	// the pid could have been reused before the pidfd was opened:
+	// if the pinned process is still alive, both refer to the same process
+	struct stat s;
+	if (fstatat(process->fd, "stat", &s, 0) < 0) {
+		close(process->pidfd);
+		process->pidfd = -1;
+	}
+	return process->pidfd;
+}
+
 /*********************************************
  * access path in proc filesystem
  *********************************************/
@@ -137,6 +168,39 @@ int process_join_namespace(ProcessHandle process, char *type) {
 	return join_namespace_by_fd(process_get_fd(process), type);
 }
 
+// join a NULL terminated list of namespaces; with a pidfd (Linux >= 5.8)
+// all the namespaces are joined at once in a single setns() call
+int process_join_namespaces(ProcessHandle process, char **types) {
+	int pidfd = process_get_pidfd(process);
+	if (pidfd >= 0) {
+		int flags = 0;
+		int i;
+		for (i = 0; types[i]; i++) {
+			// same ownership check as for the namespace files
+			int fd = open_namespace_by_fd(process_get_fd(process), types[i]);
+			if (fd < 0) {
+				fprintf(stderr, "Error: cannot join namespace %s\n", types[i]);
+				return -1;
+			}
+			close(fd);
+			flags |= namespace_type(types[i]);
+		}
+
+		if (syscall(__NR_setns, pidfd, flags) == 0)
+			return 0;
+		// older kernels don't accept a pidfd, fall back to the namespace files
+		if (errno != EINVAL)
+			fwarning("cannot join the namespaces through the pidfd: %s\n", strerror(errno));
+	}
+
+	int i;
+	for (i = 0; types[i]; i++) {
+		if (process_join_namespace(process, types[i]))
+			return -1;
+	}
+	return 0;
+}
+
 /*********************************************
  * sending a signal
  *********************************************/
@@ -144,10 +208,50 @@ int process_join_namespace(ProcessHandle process, char *type) {
 void process_send_signal(ProcessHandle process, int signum) {
 	fmessage("Sending signal %d to pid %d\n", signum, process_get_pid(process));
 
-	if (syscall(__NR_pidfd_send_signal, process_get_fd(process), signum, NULL, 0) == -1 && errno == ENOSYS)
+	int pidfd = process_get_pidfd(process);
+	if (syscall(__NR_pidfd_send_signal, (pidfd >= 0) ? pidfd : process_get_fd(process), signum, NULL, 0) == -1 && errno == ENOSYS)
 		kill(process_get_pid(process), signum);
 }
 
+// the process is gone, or it is a zombie
+static int process_exited(ProcessHandle process) {
+	int fd = process_open_nofail(process, "cmdline");
+	if (fd < 0)
+		return 1;
+	char c;
+	ssize_t count = read(fd, &c, 1);
+	close(fd);
+	return count == 0;
+}
+
+// wait for the process to exit, no more than ms milliseconds
+// return 1 if the process exited
+int process_wait_exit(ProcessHandle process, int ms) {
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// the pidfd is readable as soon as the process exits;
+	// without it, the process is checked every 50ms
+	int pidfd = process_get_pidfd(process);
+	while (1) {
+		if (process_exited(process))
+			return 1;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int left = ms - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+		if (left <= 0)
+			return 0;
+
+		if (pidfd >= 0) {
+			struct pollfd pfd = { .fd = pidfd, .events = POLLIN };
+			if (poll(&pfd, 1, left) == -1 && errno != EINTR)
+				errExit("poll");
+		}
+		else
+			usleep(((left < 50) ? left : 50) * 1000);
+	}
+}
+
 /*********************************************
  * parent and child process
  *********************************************/
@@ -176,6 +280,7 @@ static ProcessHandle pin_process_relative_to(ProcessHandle process, pid_t pid) {
 	snprintf(proc, sizeof(proc), "../%d", pid);
 
 	rv->fd = process_open(process, proc);
+	rv->pidfd = -2;
 
 	return rv;
 }
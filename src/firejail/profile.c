@@ -19,15 +19,120 @@
 */
 #include "firejail.h"
 #include "../include/gcov_wrapper.h"
+#include "../include/profile_bundle.h"
 #include "../include/seccomp.h"
 #include "../include/syscall.h"
-#include <dirent.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 
 extern char *xephyr_screen;
 
-#define MAX_READ 8192		// line buffer for profile files
 #define MAX_LIST 16384		// size limit for argument lists
+#define PROFILE_POOL_SIZE 256	// profile entries allocated at once
+
+//***************************************************
+// profile bundle
+//***************************************************
+// snapshot of SYSCONFDIR built by make install, see profile_bundle.h
+static const char *bundle = NULL;
+static size_t bundle_size = 0;
+static int bundle_state = 0;	// 0 not checked yet, 1 in use, -1 not available
+
+static int bundle_open(void) {
+	if (bundle_state)
+		return bundle_state == 1;
+	bundle_state = -1;
+	if (!checkcfg(CFG_PROFILE_BUNDLE))
+		return 0;
+
+	int fd = open(PATH_PROFILE_BUNDLE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1) {
+		if (arg_debug)
+			printf("Cannot open profile bundle %s: %s\n", PATH_PROFILE_BUNDLE, strerror(errno));
+		return 0;
+	}
+	struct stat s;
+	if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != 0 || (s.st_mode & 0022) ||
+	    (size_t) s.st_size < sizeof(ProfileBundleHeader)) {
+		fwarning("invalid profile bundle %s\n", PATH_PROFILE_BUNDLE);
+		close(fd);
+		return 0;
+	}
+	void *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+
+	// check the header and every index entry once, the lookups do not check again
+	const ProfileBundleHeader *hdr = map;
+	const ProfileBundleEntry *index = (const ProfileBundleEntry *) (hdr + 1);
+	size_t size = s.st_size;
+	int ok = memcmp(hdr->magic, PROFILE_BUNDLE_MAGIC, sizeof(hdr->magic)) == 0 &&
+		hdr->version == PROFILE_BUNDLE_VERSION &&
+		hdr->count <= (size - sizeof(*hdr)) / sizeof(*index);
+	uint32_t i;
+	for (i = 0; ok && i < hdr->count; i++) {
+		const ProfileBundleEntry *e = index + i;
+		ok = e->name_off < size && memchr((char *) map + e->name_off, '\0', size - e->name_off) &&
+			e->data_off <= size && e->data_len <= size - e->data_off;
+	}
+	if (!ok) {
+		fwarning("invalid profile bundle %s\n", PATH_PROFILE_BUNDLE);
+		munmap(map, size);
+		return 0;
+	}
+
+	// a file added, removed or replaced in SYSCONFDIR since make install
+	struct stat sdir;
+	if (stat(SYSCONFDIR, &sdir) == -1 ||
+	    hdr->dir_dev != (uint64_t) sdir.st_dev || hdr->dir_ino != (uint64_t) sdir.st_ino ||
+	    hdr->dir_mtime_sec != (int64_t) sdir.st_mtim.tv_sec ||
+	    hdr->dir_mtime_nsec != (int64_t) sdir.st_mtim.tv_nsec) {
+		if (arg_debug)
+			printf("Profile bundle %s is out of date, reading %s\n", PATH_PROFILE_BUNDLE, SYSCONFDIR);
+		munmap(map, size);
+		return 0;
+	}
+
+	if (arg_debug)
+		printf("Using profile bundle %s, %u files\n", PATH_PROFILE_BUNDLE, hdr->count);
+	bundle = map;
+	bundle_size = size;
+	bundle_state = 1;
+	return 1;
+}
+
+static int bundle_cmp(const void *key, const void *entry) {
+	return strcmp(key, bundle + ((const ProfileBundleEntry *) entry)->name_off);
+}
+
+// return the bundle entry for a file name, or NULL if not found
+static const ProfileBundleEntry *bundle_find(const char *name) {
+	const ProfileBundleHeader *hdr = (const ProfileBundleHeader *) bundle;
+	return bsearch(name, hdr + 1, hdr->count, sizeof(ProfileBundleEntry), bundle_cmp);
+}
+
+// return the name of a file stored directly in SYSCONFDIR, or NULL
+static const char *bundle_name(const char *fname) {
+	size_t len = strlen(SYSCONFDIR);
+	if (strncmp(fname, SYSCONFDIR, len) != 0 || fname[len] != '/')
+		return NULL;
+	fname += len + 1;
+	if (*fname == '\0' || strchr(fname, '/'))
+		return NULL;
+	return fname;
+}
+
+// return 1 if the user configuration directory exists
+static int usercfg_exists(const char *dir) {
+	static int state = 0; // 0 not checked yet, 1 found, -1 not found
+	if (!state) {
+		struct stat s;
+		state = (stat(dir, &s) == 0 && S_ISDIR(s.st_mode)) ? 1 : -1;
+	}
+	return state == 1;
+}
 
 // find and read the profile specified by name from dir directory
 // return  1 if a profile was found
@@ -37,7 +142,6 @@ static int profile_find(const char *name, const char *dir, int add_ext) {
 	assert(dir);
 
 	int rv = 0;
-	DIR *dp;
 	char *pname = NULL;
 	if (add_ext) {
 		if (asprintf(&pname, "%s.profile", name) == -1)
@@ -46,23 +150,26 @@ static int profile_find(const char *name, const char *dir, int add_ext) {
 			name = pname;
 	}
 
-	dp = opendir (dir);
-	if (dp != NULL) {
-		struct dirent *ep;
-		while ((ep = readdir(dp)) != NULL) {
-			if (strcmp(ep->d_name, name) == 0) {
-				if (arg_debug)
-					printf("Found %s profile in %s directory\n", name, dir);
-				char *etcpname;
-				if (asprintf(&etcpname, "%s/%s", dir, name) == -1)
-					errExit("asprintf");
-				profile_read(etcpname);
-				free(etcpname);
-				rv = 1;
-				break;
-			}
+	// look up the directory entry directly instead of scanning the directory,
+	// SYSCONFDIR holds more than a thousand profiles; a name with a '/' is
+	// never a directory entry
+	if (*name != '\0' && strchr(name, '/') == NULL) {
+		char *etcpname;
+		if (asprintf(&etcpname, "%s/%s", dir, name) == -1)
+			errExit("asprintf");
+		struct stat s;
+		int found;
+		if (strcmp(dir, SYSCONFDIR) == 0 && bundle_open())
+			found = bundle_find(name) != NULL;
+		else
+			found = lstat(etcpname, &s) == 0;
+		if (found) {
+			if (arg_debug)
+				printf("Found %s profile in %s directory\n", name, dir);
+			profile_read(etcpname);
+			rv = 1;
 		}
-		(void) closedir (dp);
+		free(etcpname);
 	}
 
 	if (pname)
@@ -78,7 +185,9 @@ int profile_find_firejail(const char *name, int add_ext) {
 	char *usercfgdir;
 	if (asprintf(&usercfgdir, "%s/.config/firejail", cfg.homedir) == -1)
 		errExit("asprintf");
-	int rv = profile_find(name, usercfgdir, add_ext);
+	int rv = 0;
+	if (usercfg_exists(usercfgdir))
+		rv = profile_find(name, usercfgdir, add_ext);
 	free(usercfgdir);
 
 	if (!rv)
@@ -100,7 +209,18 @@ static void warning_feature_disabled(const char *feature) {
 }
 
 
+// one bit per hashed first word of the ignore entries; most profile lines
+// start with a word no ignore entry starts with, and are rejected here
+static uint64_t ignore_mask = 0;
+
+static uint64_t ignore_bit(const char *str) {
+	return 1ULL << (fnv1a32(str, strcspn(str, " ")) & 63);
+}
+
 static int is_in_ignore_list(char *ptr) {
+	if ((ignore_mask & ignore_bit(ptr)) == 0)
+		return 0;
+
 	// check ignore list
 	int i;
 	for (i = 0; i < MAX_PROFILE_IGNORE; i++) {
@@ -140,6 +260,7 @@ void profile_add_ignore(const char *str) {
 		cfg.profile_ignore[i] = strdup(str);
 		if (!cfg.profile_ignore[i])
 			errExit("strdup");
+		ignore_mask |= ignore_bit(str);
 	}
 }
 
@@ -230,11 +351,7 @@ int profile_check_conditional(char *ptr, int lineno, const char *fname) {
 		// if set, continue processing statement in caller
 		int value = cond->check();
 		if (value) {
-			// move ptr to start of profile line
-			ptr = strdup(ptr);
-			if (!ptr)
-				errExit("strdup");
-
+			// ptr is the start of the profile line, in the profile file buffer
 			// check that the profile line does not contain either
 			// quiet or include directives
 			if ((strncmp(ptr, "quiet", 5) == 0) ||
@@ -243,7 +360,6 @@ int profile_check_conditional(char *ptr, int lineno, const char *fname) {
 				ptr = tmp;
 				goto error;
 			}
-			free(tmp);
 
 			// verify syntax, exit in case of error
 			if (arg_debug)
@@ -276,6 +392,82 @@ error:
 }
 
 
+// Filesystem commands make up most of the lines in a profile; they are
+// looked up in a sorted table before going through the other commands.
+typedef enum {
+	FS_CMD_DEFAULT = 0,
+	FS_CMD_WHITELIST,
+	FS_CMD_TMPFS
+} FsCommandType;
+
+typedef struct {
+	const char *name;
+	FsCommandType type;
+} FsCommand;
+
+// sorted by name
+static const FsCommand fs_commands[] = {
+	{"blacklist", FS_CMD_DEFAULT},
+	{"blacklist-nolog", FS_CMD_DEFAULT},
+	{"noblacklist", FS_CMD_DEFAULT},
+	{"noexec", FS_CMD_DEFAULT},
+	{"nowhitelist", FS_CMD_DEFAULT},
+	{"read-only", FS_CMD_DEFAULT},
+	{"read-write", FS_CMD_DEFAULT},
+	{"tmpfs", FS_CMD_TMPFS},
+	{"whitelist", FS_CMD_WHITELIST}
+};
+
+// return the filesystem command in front of ptr, NULL if none
+static const FsCommand *fs_command_find(const char *ptr) {
+	const char *end = strchr(ptr, ' ');
+	if (!end)
+		return NULL;
+	size_t len = end - ptr;
+
+	size_t lo = 0;
+	size_t hi = sizeof(fs_commands) / sizeof(fs_commands[0]);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *name = fs_commands[mid].name;
+		int rv = strncmp(name, ptr, len);
+		if (rv == 0 && name[len] != '\0')
+			rv = 1;
+		if (rv == 0)
+			return &fs_commands[mid];
+		if (rv < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+static int profile_check_fs_command(const FsCommand *cmd, char *ptr, int lineno, const char *fname) {
+	if (cmd->type == FS_CMD_WHITELIST)
+		arg_whitelist = 1;
+#ifndef HAVE_USERTMPFS
+	if (cmd->type == FS_CMD_TMPFS && getuid() != 0) {
+		fprintf(stderr, "Error: tmpfs available only when running the sandbox as root\n");
+		exit(1);
+	}
+#endif
+	ptr += strlen(cmd->name) + 1;
+
+	// some characters just don't belong in filenames
+	invalid_filename(ptr, 1); // globbing
+	if (strstr(ptr, "..")) {
+		if (lineno == 0)
+			fprintf(stderr, "Error: \"%s\" is an invalid filename\n", ptr);
+		else if (fname != NULL)
+			fprintf(stderr, "Error: line %d in %s is invalid\n", lineno, fname);
+		else
+			fprintf(stderr, "Error: line %d in the custom profile is invalid\n", lineno);
+		exit(1);
+	}
+	return 1;
+}
+
 // check profile line; if line == 0, this was generated from a command line option
 // return 1 if the command is to be added to the linked list of profile commands
 // return 0 if the command was already executed inside the function
@@ -290,6 +482,10 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 	if (is_in_ignore_list(ptr))
 		return 0;
 
+	const FsCommand *cmd = fs_command_find(ptr);
+	if (cmd)
+		return profile_check_fs_command(cmd, ptr, lineno, fname);
+
 	if (strncmp(ptr, "ignore ", 7) == 0) {
 		profile_add_ignore(ptr + 7);
 		return 0;
@@ -402,6 +598,20 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		}
 		else
 			warning_feature_disabled("private-home");
+#endif
+		return 0;
+	}
+	else if (strncmp(ptr, "private-home-snapshot ", 22) == 0) {
+#ifdef HAVE_PRIVATE_HOME
+		if (checkcfg(CFG_PRIVATE_HOME)) {
+			cfg.home_snapshot = ptr + 22;
+			if (invalid_name(cfg.home_snapshot)) {
+				fprintf(stderr, "Error: invalid private-home-snapshot name\n");
+				exit(1);
+			}
+		}
+		else
+			warning_feature_disabled("private-home");
 #endif
 		return 0;
 	}
@@ -833,6 +1043,27 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		return 0;
 	}
 
+	else if (strncmp(ptr, "bandwidth ", 10) == 0) {
+#ifdef HAVE_NETWORK
+		if (checkcfg(CFG_NETWORK)) {
+			Bridge *br = last_bridge_configured();
+			if (br == NULL) {
+				fprintf(stderr, "Error: no network device configured\n");
+				exit(1);
+			}
+
+			// download and upload speeds in KB/s
+			if (sscanf(ptr + 10, "%d %d", &br->bw_down, &br->bw_up) != 2 ||
+			    br->bw_down <= 0 || br->bw_up <= 0) {
+				fprintf(stderr, "Error: invalid bandwidth, download and upload speeds expected\n");
+				exit(1);
+			}
+		}
+		else
+			warning_feature_disabled("networking");
+#endif
+		return 0;
+	}
 	else if (strncmp(ptr, "mtu ", 4) == 0) {
 #ifdef HAVE_NETWORK
 		if (checkcfg(CFG_NETWORK)) {
@@ -1056,6 +1287,22 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 			warning_feature_disabled("seccomp");
 		return 0;
 	}
+	if (strcmp(ptr, "seccomp.spec-allow") == 0) {
+		if (!checkcfg(CFG_SECCOMP))
+			warning_feature_disabled("seccomp");
+		else if (!checkcfg(CFG_SECCOMP_SPEC_ALLOW))
+			warning_feature_disabled("seccomp-spec-allow");
+		else
+			arg_seccomp_spec_allow = 1;
+		return 0;
+	}
+	if (strcmp(ptr, "seccomp.tsync") == 0) {
+		if (checkcfg(CFG_SECCOMP))
+			arg_seccomp_tsync = 1;
+		else
+			warning_feature_disabled("seccomp");
+		return 0;
+	}
 	// seccomp drop list without default list
 	if (strncmp(ptr, "seccomp.drop ", 13) == 0) {
 		if (checkcfg(CFG_SECCOMP)) {
@@ -1096,6 +1343,29 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		return 0;
 	}
 
+	// syscalls checked first in the seccomp filters
+	if (strncmp(ptr, "seccomp.hot ", 12) == 0) {
+		if (checkcfg(CFG_SECCOMP))
+			cfg.seccomp_hot = seccomp_check_list(ptr + 12);
+		else
+			warning_feature_disabled("seccomp");
+		return 0;
+	}
+
+	// syscalls sent to the seccomp supervisor
+	if (strncmp(ptr, "seccomp.notify ", 15) == 0) {
+		if (checkcfg(CFG_SECCOMP))
+			cfg.seccomp_list_notify = seccomp_check_list(ptr + 15);
+		else
+			warning_feature_disabled("seccomp");
+		return 0;
+	}
+
+	if (strncmp(ptr, "blacklist-mode ", 15) == 0) {
+		ll_blacklist_mode(ptr + 15);
+		return 0;
+	}
+
 //#ifdef HAVE_LANDLOCK
 // landlock-common.inc is included by default.profile, so the entries of the
 // former should be processed or ignored instead of aborting.
@@ -1125,6 +1395,14 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		ll_add_profile(LL_FS_EXEC, ptr + 20);
 		return 0;
 	}
+	if (strncmp(ptr, "landlock.net.bind ", 18) == 0) {
+		ll_add_profile(LL_NET_BIND, ptr + 18);
+		return 0;
+	}
+	if (strncmp(ptr, "landlock.net.connect ", 21) == 0) {
+		ll_add_profile(LL_NET_CONNECT, ptr + 21);
+		return 0;
+	}
 //#endif
 
 	// memory deny write&execute
@@ -1190,7 +1468,7 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		if (!arg_caps_list)
 			errExit("strdup");
 		// verify caps list and exit if problems
-		caps_check_list(arg_caps_list, NULL);
+		arg_caps_mask = caps_parse_list(arg_caps_list);
 		return 0;
 	}
 
@@ -1201,7 +1479,7 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		if (!arg_caps_list)
 			errExit("strdup");
 		// verify caps list and exit if problems
-		caps_check_list(arg_caps_list, NULL);
+		arg_caps_mask = caps_parse_list(arg_caps_list);
 		return 0;
 	}
 
@@ -1257,6 +1535,63 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		return 0;
 	}
 
+	// NUMA node
+	if (strncmp(ptr, "numa-node ", 10) == 0) {
+		read_numa_node(ptr + 10);
+		return 0;
+	}
+
+	// cgroup v2 leaf
+	if (strcmp(ptr, "cgroup-leaf") == 0) {
+		arg_cgroup_leaf = 1;
+		return 0;
+	}
+
+	// cgroup v2 limits
+	if (strncmp(ptr, "cpu-max ", 8) == 0) {
+		cgroup_read_limit("cpu-max", ptr + 8);
+		return 0;
+	}
+	if (strncmp(ptr, "cpu-weight ", 11) == 0) {
+		cgroup_read_limit("cpu-weight", ptr + 11);
+		return 0;
+	}
+	if (strncmp(ptr, "memory-high ", 12) == 0) {
+		cgroup_read_limit("memory-high", ptr + 12);
+		return 0;
+	}
+	if (strncmp(ptr, "memory-max ", 11) == 0) {
+		cgroup_read_limit("memory-max", ptr + 11);
+		return 0;
+	}
+	if (strcmp(ptr, "memory-merge") == 0) {
+		arg_memory_merge = 1;
+		return 0;
+	}
+	if (strncmp(ptr, "io-max ", 7) == 0) {
+		cgroup_read_limit("io-max", ptr + 7);
+		return 0;
+	}
+
+	// tmpfs limits, only lower than the limits in firejail.config
+	if (strncmp(ptr, "tmpfs-size ", 11) == 0) {
+		cfg.tmpfs_size = parse_arg_size(ptr + 11);
+		if (cfg.tmpfs_size == 0) {
+			fprintf(stderr, "Error: invalid tmpfs-size %s; use only positive numbers and K, M or G suffix\n", ptr + 11);
+			exit(1);
+		}
+		return 0;
+	}
+	if (strncmp(ptr, "tmpfs-inodes ", 13) == 0) {
+		check_unsigned(ptr + 13, "Error: invalid tmpfs-inodes");
+		sscanf(ptr + 13, "%llu", &cfg.tmpfs_inodes);
+		if (cfg.tmpfs_inodes == 0) {
+			fprintf(stderr, "Error: invalid tmpfs-inodes %s\n", ptr + 13);
+			exit(1);
+		}
+		return 0;
+	}
+
 	// nice value
 	if (strncmp(ptr, "nice ", 5) == 0) {
 		cfg.nice = atoi(ptr + 5);
@@ -1265,6 +1600,18 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		arg_nice = 1;
 		return 0;
 	}
+	if (strncmp(ptr, "ioprio ", 7) == 0) {
+		read_ioprio(ptr + 7);
+		return 0;
+	}
+	if (strncmp(ptr, "sched ", 6) == 0) {
+		read_sched(ptr + 6);
+		return 0;
+	}
+	if (strncmp(ptr, "sched-slice ", 12) == 0) {
+		read_sched_slice(ptr + 12);
+		return 0;
+	}
 
 	// writable-etc
 	if (strcmp(ptr, "writable-etc") == 0) {
@@ -1422,12 +1769,7 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 				fprintf(stderr, "Error: --private-etc and --writable-etc are mutually exclusive\n");
 				exit(1);
 			}
-			if (cfg.etc_private_keep) {
-				if ( asprintf(&cfg.etc_private_keep, "%s,%s", cfg.etc_private_keep, ptr + 12) < 0 )
-					errExit("asprintf");
-			} else {
-				cfg.etc_private_keep = ptr + 12;
-			}
+			profile_list_merge(&cfg.etc_private_keep, ptr + 12);
 			arg_private_etc = 1;
 		}
 		else
@@ -1484,12 +1826,7 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 	// private /bin list of files
 	if (strncmp(ptr, "private-bin ", 12) == 0) {
 		if (checkcfg(CFG_PRIVATE_BIN)) {
-			if (cfg.bin_private_keep) {
-				if ( asprintf(&cfg.bin_private_keep, "%s,%s", cfg.bin_private_keep, ptr + 12) < 0 )
-					errExit("asprintf");
-			} else {
-				cfg.bin_private_keep = ptr + 12;
-			}
+			profile_list_merge(&cfg.bin_private_keep, ptr + 12);
 			arg_private_bin = 1;
 		}
 		else
@@ -1652,78 +1989,150 @@ int profile_check_line(char *ptr, int lineno, const char *fname) {
 		return 0;
 	}
 
-	// rest of filesystem
-	if (strncmp(ptr, "blacklist ", 10) == 0)
-		ptr += 10;
-	else if (strncmp(ptr, "blacklist-nolog ", 16) == 0)
-		ptr += 16;
-	else if (strncmp(ptr, "noblacklist ", 12) == 0)
-		ptr += 12;
-	else if (strncmp(ptr, "whitelist ", 10) == 0) {
-		arg_whitelist = 1;
-		ptr += 10;
-	}
-	else if (strncmp(ptr, "nowhitelist ", 12) == 0)
-		ptr += 12;
-	else if (strncmp(ptr, "read-only ", 10) == 0)
-		ptr += 10;
-	else if (strncmp(ptr, "read-write ", 11) == 0)
-		ptr += 11;
-	else if (strncmp(ptr, "noexec ", 7) == 0)
-		ptr += 7;
-	else if (strncmp(ptr, "tmpfs ", 6) == 0) {
-#ifndef HAVE_USERTMPFS
-		if (getuid() != 0) {
-			fprintf(stderr, "Error: tmpfs available only when running the sandbox as root\n");
-			exit(1);
-		}
-#endif
-		ptr += 6;
-	}
-	else {
-		if (lineno == 0)
-			fprintf(stderr, "Error: \"%s\" as a command line option is invalid\n", ptr);
-		else if (fname != NULL)
-			fprintf(stderr, "Error: line %d in %s is invalid\n", lineno, fname);
-		else
-			fprintf(stderr, "Error: line %d in the custom profile is invalid\n", lineno);
-		exit(1);
-	}
+	if (lineno == 0)
+		fprintf(stderr, "Error: \"%s\" as a command line option is invalid\n", ptr);
+	else if (fname != NULL)
+		fprintf(stderr, "Error: line %d in %s is invalid\n", lineno, fname);
+	else
+		fprintf(stderr, "Error: line %d in the custom profile is invalid\n", lineno);
+	exit(1);
+}
 
-	// some characters just don't belong in filenames
-	invalid_filename(ptr, 1); // globbing
-	if (strstr(ptr, "..")) {
-		if (lineno == 0)
-			fprintf(stderr, "Error: \"%s\" is an invalid filename\n", ptr);
-		else if (fname != NULL)
-			fprintf(stderr, "Error: line %d in %s is invalid\n", lineno, fname);
-		else
-			fprintf(stderr, "Error: line %d in the custom profile is invalid\n", lineno);
-		exit(1);
-	}
-	return 1;
+static ProfileCmd profile_cmd(const char *str) {
+	if (strncmp(str, "whitelist ", 10) == 0 || strncmp(str, "nowhitelist ", 12) == 0)
+		return PCMD_WHITELIST;
+	if (strncmp(str, "dbus-", 5) == 0)
+		return PCMD_DBUS;
+	return PCMD_OTHER;
 }
 
 // add a profile entry in cfg.profile list; use str to populate the list
+static ProfileEntry *profile_tail = NULL;	// last entry in cfg.profile
 void profile_add(char *str) {
 	EUID_ASSERT();
 
-	ProfileEntry *prf = malloc(sizeof(ProfileEntry));
-	if (!prf)
-		errExit("malloc");
-	memset(prf, 0, sizeof(ProfileEntry));
-	prf->next = NULL;
+	// the entries are never released, allocate them in blocks
+	static ProfileEntry *pool = NULL;
+	static int pool_left = 0;
+	if (pool_left == 0) {
+		pool = calloc(PROFILE_POOL_SIZE, sizeof(ProfileEntry));
+		if (!pool)
+			errExit("calloc");
+		pool_left = PROFILE_POOL_SIZE;
+	}
+	ProfileEntry *prf = pool++;
+	pool_left--;
 	prf->data = str;
+	prf->cmd = profile_cmd(str);
+
+	// add prf to its bucket
+	ProfileBucket *b = &cfg.profile_bucket[prf->cmd];
+	if (b->cnt == b->max) {
+		b->max = (b->max) ? b->max * 2 : 64;
+		b->entries = realloc(b->entries, b->max * sizeof(ProfileEntry *));
+		if (!b->entries)
+			errExit("realloc");
+	}
+	b->entries[b->cnt++] = prf;
 
 	// add prf to the list
 	if (cfg.profile == NULL) {
 		cfg.profile = prf;
+		profile_tail = prf;
 		return;
 	}
-	ProfileEntry *ptr = cfg.profile;
+	ProfileEntry *ptr = (profile_tail) ? profile_tail : cfg.profile;
 	while (ptr->next != NULL)
 		ptr = ptr->next;
 	ptr->next = prf;
+	profile_tail = prf;
+}
+
+// .inc files already read, identified by device and inode; an .inc file
+// included a second time, usually through another profile, is skipped
+typedef struct {
+	dev_t dev;
+	ino_t ino;	// index + 1 for a file read from the profile bundle
+	int in_bundle;
+} IncludeId;
+
+static IncludeId *inc_read = NULL;
+static int inc_cnt = 0;
+static int inc_max = 0;
+
+// return 1 if fname is an .inc file read before, otherwise remember it
+// be: the bundle entry of the file, or NULL
+static int include_seen(const char *fname, const ProfileBundleEntry *be) {
+	size_t len = strlen(fname);
+	if (len < 4 || strcmp(fname + len - 4, ".inc") != 0)
+		return 0;
+
+	struct stat s;
+	if (be) {
+		s.st_dev = 0;
+		s.st_ino = be - (const ProfileBundleEntry *) ((const ProfileBundleHeader *) bundle + 1) + 1;
+	}
+	else if (stat(fname, &s) == -1)
+		return 0;
+	int in_bundle = be != NULL;
+	int i;
+	for (i = 0; i < inc_cnt; i++)
+		if (inc_read[i].dev == s.st_dev && inc_read[i].ino == s.st_ino &&
+		    inc_read[i].in_bundle == in_bundle)
+			return 1;
+
+	if (inc_cnt == inc_max) {
+		inc_max = (inc_max) ? inc_max * 2 : 32;
+		inc_read = realloc(inc_read, inc_max * sizeof(IncludeId));
+		if (!inc_read)
+			errExit("realloc");
+	}
+	inc_read[inc_cnt].dev = s.st_dev;
+	inc_read[inc_cnt].ino = s.st_ino;
+	inc_read[inc_cnt].in_bundle = in_bundle;
+	inc_cnt++;
+	return 0;
+}
+
+// read a profile file in one buffer
+static char *profile_load(const char *fname, size_t *len) {
+	int fd = open(fname, O_RDONLY | O_CLOEXEC);
+	struct stat s;
+	if (fd == -1 || fstat(fd, &s) == -1) {
+		fprintf(stderr, "Error: cannot open profile file %s: %s\n",
+		        fname, strerror(errno));
+		exit(1);
+	}
+
+	// the size is only a hint, read until the end of the file
+	size_t size = (S_ISREG(s.st_mode) && s.st_size > 0) ? s.st_size + 1 : 4096;
+	char *buf = malloc(size + 1);
+	if (!buf)
+		errExit("malloc");
+	size_t cnt = 0;
+	for (;;) {
+		if (cnt == size) {
+			size *= 2;
+			buf = realloc(buf, size + 1);
+			if (!buf)
+				errExit("realloc");
+		}
+		ssize_t rv = read(fd, buf + cnt, size - cnt);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error: cannot read profile file %s: %s\n",
+			        fname, strerror(errno));
+			exit(1);
+		}
+		if (rv == 0)
+			break;
+		cnt += rv;
+	}
+	close(fd);
+
+	*len = cnt;
+	return buf;
 }
 
 // read a profile file
@@ -1739,26 +2148,47 @@ void profile_read(const char *fname) {
 
 	// check file
 	invalid_filename(fname, 0); // no globbing
-	if (strlen(fname) == 0 || is_dir(fname)) {
-		fprintf(stderr, "Error: invalid profile file '%s'\n", fname);
-		exit(1);
-	}
-	if (access(fname, R_OK)) {
-		int errsv = errno;
-		// if the file ends in ".local", do not exit
-		const char *base = gnu_basename(fname);
-		char *ptr = strstr(base, ".local");
-		if (ptr && strlen(ptr) == 6 && errsv != EACCES) {
-			if (arg_debug) {
-				printf("Cannot access .local file %s: %s, skipping...\n",
-				       fname, strerror(errsv));
+
+	// files in SYSCONFDIR are taken from the profile bundle
+	const ProfileBundleEntry *be = NULL;
+	const char *bname = bundle_name(fname);
+	if (bname && bundle_open()) {
+		be = bundle_find(bname);
+		if (!be) {
+			// if the file ends in ".local", do not exit
+			const char *ptr = strstr(bname, ".local");
+			if (ptr && strlen(ptr) == 6) {
+				if (arg_debug)
+					printf("Cannot access .local file %s: %s, skipping...\n",
+					       fname, strerror(ENOENT));
+				return;
 			}
-			return;
+			// not in the bundle, report the error on the real file
+		}
+	}
+
+	if (!be) {
+		if (strlen(fname) == 0 || is_dir(fname)) {
+			fprintf(stderr, "Error: invalid profile file '%s'\n", fname);
+			exit(1);
 		}
+		if (access(fname, R_OK)) {
+			int errsv = errno;
+			// if the file ends in ".local", do not exit
+			const char *base = gnu_basename(fname);
+			char *ptr = strstr(base, ".local");
+			if (ptr && strlen(ptr) == 6 && errsv != EACCES) {
+				if (arg_debug) {
+					printf("Cannot access .local file %s: %s, skipping...\n",
+					       fname, strerror(errsv));
+				}
+				return;
+			}
 
-		fprintf(stderr, "Error: cannot access profile file %s: %s\n",
-		        fname, strerror(errsv));
-		exit(1);
+			fprintf(stderr, "Error: cannot access profile file %s: %s\n",
+			        fname, strerror(errsv));
+			exit(1);
+		}
 	}
 
 	// --allow-debuggers - skip disable-devel.inc file
@@ -1780,14 +2210,27 @@ void profile_read(const char *fname) {
 		}
 	}
 
-	// open profile file:
-	FILE *fp = fopen(fname, "re");
-	if (fp == NULL) {
-		fprintf(stderr, "Error: cannot open profile file %s: %s\n",
-		        fname, strerror(errno));
-		exit(1);
+	if (include_seen(fname, be)) {
+		if (arg_debug)
+			printf("Skipping %s, already included\n", fname);
+		return;
 	}
 
+	// read the whole file; the buffer is never released, the profile
+	// entries are tokenized in place and point into it
+	char *buf;
+	size_t len;
+	if (be) {
+		len = be->data_len;
+		buf = malloc(len + 1);
+		if (!buf)
+			errExit("malloc");
+		memcpy(buf, bundle + be->data_off, len);
+	}
+	else
+		buf = profile_load(fname, &len);
+	buf[len] = '\0';
+
 	// save the name of the file for --profile.print option
 	if (include_level == 0)
 		set_profile_run_file(getpid(), fname);
@@ -1795,24 +2238,29 @@ void profile_read(const char *fname) {
 	int msg_printed = 0;
 
 	// read the file line by line
-	char buf[MAX_READ + 1];
+	char *next = buf;
+	char *end = buf + len;
 	int lineno = 0;
-	while (fgets(buf, MAX_READ, fp)) {
+	while (next < end) {
 		++lineno;
+		char *line = next;
+		char *nl = memchr(line, '\n', end - line);
+		if (nl) {
+			*nl = '\0';
+			next = nl + 1;
+		}
+		else
+			next = end;
 
 		// remove comments
-		char *ptr = strchr(buf, '#');
+		char *ptr = strchr(line, '#');
 		if (ptr)
 			*ptr = '\0';
 
-		// remove empty space - ptr in allocated memory
-		ptr = line_remove_spaces(buf);
-		if (ptr == NULL)
+		// remove empty space - ptr in the file buffer
+		ptr = line_remove_spaces_inplace(line);
+		if (*ptr == '\0')
 			continue;
-		if (*ptr == '\0') {
-			free(ptr);
-			continue;
-		}
 
 		if (strncmp(ptr, "whitelist-ro ", 13) == 0) {
 			char *whitelist, *readonly;
@@ -1822,7 +2270,6 @@ void profile_read(const char *fname) {
 			if (asprintf(&readonly, "read-only %s", ptr + 13) == -1)
 				errExit("asprintf");
 			profile_add(readonly);
-			free(ptr);
 			continue;
 		}
 
@@ -1833,7 +2280,6 @@ void profile_read(const char *fname) {
 				arg_quiet = 0;
 			else if (!arg_debug)
 				arg_quiet = 1;
-			free(ptr);
 			continue;
 		}
 		if (!msg_printed) {
@@ -1867,21 +2313,57 @@ void profile_read(const char *fname) {
 
 			include_level--;
 			free(newprofile);
-			free(ptr);
 			continue;
 		}
 
 		// verify syntax, exit in case of error
 		if (profile_check_line(ptr, lineno, fname))
 			profile_add(ptr);
-// we cannot free ptr here, data is extracted from ptr and linked as a pointer in cfg structure
-//		else {
-//			free(ptr);
-//		}
+// ptr is not released, data is extracted from ptr and linked as a pointer in cfg structure
 
 		__gcov_flush();
 	}
-	fclose(fp);
+}
+
+/* Open addressing hash set over the items of a comma separated list.
+ * Keys point into the list being processed, idx is the position of the
+ * item in the list, or -1 once the item was removed.
+ */
+typedef struct {
+	const char *key;
+	ssize_t idx;
+} ListSetEntry;
+
+typedef struct {
+	ListSetEntry *tab;
+	size_t mask;
+} ListSet;
+
+static void list_set_init(ListSet *set, size_t count) {
+	size_t size = 16;
+	while (size < 2 * count)
+		size <<= 1;
+	set->tab = calloc(size, sizeof(ListSetEntry));
+	if (!set->tab)
+		errExit("calloc");
+	set->mask = size - 1;
+}
+
+static void list_set_clear(ListSet *set) {
+	memset(set->tab, 0, (set->mask + 1) * sizeof(ListSetEntry));
+}
+
+static void list_set_free(ListSet *set) {
+	free(set->tab);
+	set->tab = NULL;
+}
+
+// returns the entry holding key, or the empty entry where key belongs
+static ListSetEntry *list_set_find(ListSet *set, const char *key) {
+	size_t i = fnv1a32_str(key) & set->mask;
+	while (set->tab[i].key && strcmp(set->tab[i].key, key))
+		i = (i + 1) & set->mask;
+	return &set->tab[i];
 }
 
 char *profile_list_normalize(char *list) {
@@ -1948,10 +2430,13 @@ char *profile_list_compress(char *list)
 	}
 
 	/* Filter array: add, remove, reset, filter out duplicates */
+	ListSet set;
+	list_set_init(&set, count);
 	for (i = 0; i < count; ++i) {
 		char *item = in[i];
 		assert(item);
 
+		ListSetEntry *e;
 		size_t k;
 		switch (*item) {
 		case '-':
@@ -1959,11 +2444,10 @@ char *profile_list_compress(char *list)
 			/* Do not include this item */
 			in[i] = 0;
 			/* Remove if already included */
-			for (k = 0; k < i; ++k) {
-				if (in[k] && !strcmp(in[k], item)) {
-					in[k] = 0;
-					break;
-				}
+			e = list_set_find(&set, item);
+			if (e->key && e->idx >= 0) {
+				in[e->idx] = 0;
+				e->idx = -1;
 			}
 			break;
 		case '+':
@@ -1977,24 +2461,32 @@ char *profile_list_compress(char *list)
 				break;
 			}
 			/* Include item unless it is already included */
-			for (k = 0; k < i; ++k) {
-				if (in[k] && !strcmp(in[k], item)) {
-					in[i] = 0;
-					break;
-				}
+			e = list_set_find(&set, item);
+			if (e->key && e->idx >= 0)
+				in[i] = 0;
+			else {
+				e->key = item;
+				e->idx = i;
 			}
 			break;
 		case '=':
 			in[i] = ++item;
-			/* Include non-empty item */
-			if (!*item)
-				in[i] = 0;
 			/* Remove all already included items */
 			for (k = 0; k < i; ++k)
 				in[k] = 0;
+			list_set_clear(&set);
+			/* Include non-empty item */
+			if (!*item)
+				in[i] = 0;
+			else {
+				e = list_set_find(&set, item);
+				e->key = item;
+				e->idx = i;
+			}
 			break;
 		}
 	}
+	list_set_free(&set);
 
 	/* Copying back using in-place data works because the
 	 * original order is retained and no item gets longer
@@ -2014,6 +2506,61 @@ char *profile_list_compress(char *list)
 	return list;
 }
 
+/* Append the items of a comma separated list to *list, skipping empty items
+ * and items already present. Unlike profile_list_augment(), no -item/=item
+ * processing is done. The old list is not released, it can point inside a
+ * profile line or argv.
+ */
+void profile_list_merge(char **list, const char *items)
+{
+	assert(list);
+	assert(items);
+
+	char *tmp = 0;
+	if (asprintf(&tmp, "%s,%s", *list ?: "", items) < 0)
+		errExit("asprintf");
+	profile_list_normalize(tmp);
+
+	size_t count = 1;
+	char *ptr;
+	for (ptr = tmp; *ptr; ptr++) {
+		if (*ptr == ',')
+			++count;
+	}
+
+	// kept items are moved down, still separated by '\0' so that the keys
+	// stay valid, and joined at the end
+	ListSet set;
+	list_set_init(&set, count);
+	char *pos = tmp;
+	char *item = tmp;
+	while (item) {
+		char *next = strchr(item, ',');
+		if (next)
+			*next++ = '\0';
+		ListSetEntry *e = list_set_find(&set, item);
+		if (*item && !e->key) {
+			size_t len = strlen(item);
+			memmove(pos, item, len + 1);
+			e->key = pos;
+			e->idx = 0;
+			pos += len + 1;
+		}
+		item = next;
+	}
+	list_set_free(&set);
+
+	if (pos > tmp)
+		--pos;
+	*pos = '\0';
+	for (ptr = tmp; ptr < pos; ptr++) {
+		if (*ptr == '\0')
+			*ptr = ',';
+	}
+
+	*list = tmp;
+}
+
 void profile_list_augment(char **list, const char *items)
 {
 	char *tmp = 0;
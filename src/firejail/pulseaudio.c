@@ -25,7 +25,6 @@
 #include <dirent.h>
 #include <errno.h>
 #include <sys/wait.h>
-#include <glob.h>
 
 #include <fcntl.h>
 #ifndef O_PATH
@@ -33,36 +32,35 @@
 #endif
 
 #define PULSE_CLIENT_SYSCONF "/etc/pulse/client.conf"
+#define PULSE_CLIENT_CACHE_FILE "client.conf"
+#define PULSE_CLIENT_CACHE RUN_FIREJAIL_PULSE_CACHE_DIR "/" PULSE_CLIENT_CACHE_FILE
+#define PULSE_CLIENT_NOSHM "\nenable-shm = no\n"
 
-
-
+// pipewire-0, pipewire-0.lock, pipewire-0-manager etc. in path, found in a
+// single directory scan
 static void disable_rundir_pipewire(const char *path) {
 	assert(path);
 
-	// globbing for path/pipewire-*
-	char *pattern;
-	if (asprintf(&pattern, "%s/pipewire-*", path) == -1)
-		errExit("asprintf");
-
-	glob_t globbuf;
-	int globerr = glob(pattern, GLOB_NOCHECK | GLOB_NOSORT, NULL, &globbuf);
-	if (globerr) {
-		fprintf(stderr, "Error: failed to glob pattern %s\n", pattern);
-		exit(1);
-	}
-
-	size_t i;
-	for (i = 0; i < globbuf.gl_pathc; i++) {
-		char *dir = globbuf.gl_pathv[i];
-		assert(dir);
+	DIR *dir = opendir(path);
+	if (!dir)
+		return;
 
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, "pipewire-", 9) != 0)
+			continue;
 		// don't disable symlinks - disable_file_or_dir will bind-mount an empty directory on top of it!
-		if (is_link(dir))
+		if (entry->d_type == DT_LNK)
 			continue;
-		disable_file_or_dir(dir);
+
+		char *fname;
+		if (asprintf(&fname, "%s/%s", path, entry->d_name) == -1)
+			errExit("asprintf");
+		if (entry->d_type != DT_UNKNOWN || !is_link(fname))
+			disable_file_or_dir(fname);
+		free(fname);
 	}
-	globfree(&globbuf);
-	free(pattern);
+	closedir(dir);
 }
 
 
@@ -79,11 +77,12 @@ void pipewire_disable(void) {
 	if (name)
 		disable_rundir_pipewire(name);
 
-	// try the default location anyway
+	// try the default location anyway, usually it is the same directory
 	char *path;
 	if (asprintf(&path, "/run/user/%d", getuid()) == -1)
 		errExit("asprintf");
-	disable_rundir_pipewire(path);
+	if (!name || strcmp(name, path) != 0)
+		disable_rundir_pipewire(path);
 	free(path);
 }
 
@@ -129,6 +128,84 @@ void pulseaudio_disable(void) {
 	closedir(dir);
 }
 
+// The client.conf of the sandboxes is /etc/pulse/client.conf with shm
+// disabled. It is generated once in RUN_FIREJAIL_PULSE_CACHE_DIR (root only)
+// with the mtime of the source, and every sandbox mounts it read-only; the
+// file is generated again when the mtime or the size of the source change.
+// The content doesn't depend on the user.
+static int cache_fd = -1;
+
+static int cache_valid(int dirfd, const struct stat *src) {
+	struct stat s;
+	if (fstatat(dirfd, PULSE_CLIENT_CACHE_FILE, &s, AT_SYMLINK_NOFOLLOW) == -1)
+		return 0;
+	return S_ISREG(s.st_mode) && s.st_uid == 0 &&
+		s.st_size == src->st_size + (off_t) strlen(PULSE_CLIENT_NOSHM) &&
+		s.st_mtim.tv_sec == src->st_mtim.tv_sec && s.st_mtim.tv_nsec == src->st_mtim.tv_nsec;
+}
+
+// return -1 if the file cannot be generated
+static int cache_build(int dirfd, const struct stat *src) {
+	int in = open(PULSE_CLIENT_SYSCONF, O_RDONLY | O_CLOEXEC);
+	if (in == -1)
+		return -1;
+	FILE *fp = run_cache_create(dirfd, PULSE_CLIENT_CACHE_FILE, NULL);
+	if (!fp) {
+		close(in);
+		return -1;
+	}
+
+	// a source modified during the copy has a newer mtime, the next
+	// sandbox generates the file again
+	int fd = fileno(fp);
+	ssize_t len = strlen(PULSE_CLIENT_NOSHM);
+	struct timespec ts[2] = { src->st_atim, src->st_mtim };
+	int rv = -1;
+	if (copy_file_by_fd(in, fd) == 0 && write(fd, PULSE_CLIENT_NOSHM, len) == len &&
+	    fchmod(fd, 0644) == 0 && futimens(fd, ts) == 0)
+		rv = run_cache_commit(dirfd, PULSE_CLIENT_CACHE_FILE, fp);
+	else
+		run_cache_abort(dirfd, PULSE_CLIENT_CACHE_FILE, fp);
+	close(in);
+	if (rv == -1) {
+		if (arg_debug)
+			printf("Cannot store %s\n", PULSE_CLIENT_CACHE);
+	}
+	else if (arg_debug)
+		printf("%s generated\n", PULSE_CLIENT_CACHE);
+	return rv;
+}
+
+// called before the filesystem is modified
+void pulseaudio_cache_open(void) {
+	assert(cache_fd == -1);
+	struct stat src;
+	if (stat(PULSE_CLIENT_SYSCONF, &src) == -1)
+		return;
+	int dirfd = run_cache_open(RUN_FIREJAIL_PULSE_CACHE_DIR, "pulseaudio");
+	if (dirfd == -1)
+		return;
+	if (cache_valid(dirfd, &src) || cache_build(dirfd, &src) == 0)
+		cache_fd = openat(dirfd, PULSE_CLIENT_CACHE_FILE, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+	run_cache_close(&dirfd);
+}
+
+// mount the shared client.conf on pulsecfg; return -1 if not available
+static int mount_cached_client_conf(const char *pulsecfg) {
+	if (cache_fd == -1)
+		return -1;
+
+	create_empty_file_as_root(pulsecfg, 0644);
+	if (bind_mount_fd_to_path(cache_fd, pulsecfg) < 0 ||
+	    mount(NULL, pulsecfg, NULL, MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL) < 0)
+		errExit("mount pulseaudio client.conf");
+	if (arg_debug)
+		printf("Mounting %s on %s\n", PULSE_CLIENT_CACHE, pulsecfg);
+	close(cache_fd);
+	cache_fd = -1;
+	return 0;
+}
+
 // disable shm in pulseaudio (issue #69)
 void pulseaudio_init(void) {
 	// do we have pulseaudio in the system?
@@ -161,14 +238,17 @@ void pulseaudio_init(void) {
 	char *pulsecfg = NULL;
 	if (asprintf(&pulsecfg, "%s/client.conf", RUN_PULSE_DIR) == -1)
 		errExit("asprintf");
-	if (copy_file(PULSE_CLIENT_SYSCONF, pulsecfg, -1, -1, 0644)) // root needed
-		errExit("copy_file");
-	FILE *fp = fopen(pulsecfg, "ae");
-	if (!fp)
-		errExit("fopen");
-	fprintf(fp, "%s", "\nenable-shm = no\n");
-	SET_PERMS_STREAM(fp, getuid(), getgid(), 0644);
-	fclose(fp);
+	int cached = (mount_cached_client_conf(pulsecfg) == 0);
+	if (!cached) {
+		if (copy_file(PULSE_CLIENT_SYSCONF, pulsecfg, -1, -1, 0644)) // root needed
+			errExit("copy_file");
+		FILE *fp = fopen(pulsecfg, "ae");
+		if (!fp)
+			errExit("fopen");
+		fprintf(fp, "%s", PULSE_CLIENT_NOSHM);
+		SET_PERMS_STREAM(fp, getuid(), getgid(), 0644);
+		fclose(fp);
+	}
 	// hand over the directory to the user
 	if (set_perms(RUN_PULSE_DIR, getuid(), getgid(), 0700))
 		errExit("set_perms");
@@ -194,9 +274,15 @@ void pulseaudio_init(void) {
 		printf("Mounting %s on %s\n", RUN_PULSE_DIR, homeusercfg);
 	if (bind_mount_path_to_fd(RUN_PULSE_DIR, fd))
 		errExit("mount pulseaudio");
-	// check /proc/self/mountinfo to confirm the mount is ok
+	// check /proc/self/mountinfo to confirm the mount is ok; the shared
+	// client.conf is mounted in the directory and it comes last
 	MountData *mptr = get_last_mount();
-	if (strcmp(mptr->dir, homeusercfg) != 0 || strcmp(mptr->fstype, "tmpfs") != 0)
+	size_t len = strlen(homeusercfg);
+	if (cached) {
+		if (strncmp(mptr->dir, homeusercfg, len) != 0 || strcmp(mptr->dir + len, "/client.conf") != 0)
+			errLogExit("invalid pulseaudio mount");
+	}
+	else if (strcmp(mptr->dir, homeusercfg) != 0 || strcmp(mptr->fstype, "tmpfs") != 0)
 		errLogExit("invalid pulseaudio mount");
 	fs_logger2("tmpfs", homeusercfg);
 	close(fd);
@@ -25,44 +25,381 @@
 #include <glob.h>
 #include <dirent.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
 
 #include <fcntl.h>
 #ifndef O_PATH
 #define O_PATH 010000000
 #endif
 
-#define MAXBUF 1024
+// The user names dropped from /etc/passwd are removed from the member lists
+// in /etc/group. The names point in the memory map of /etc/passwd.
+typedef struct {
+	const char *name;
+	size_t len;
+} UserEntry;
+
+static UserEntry *uset = NULL;
+static size_t uset_size = 0;	// power of 2
+static size_t uset_cnt = 0;
+
+static void uset_insert(const char *name, size_t len) {
+	size_t i = fnv1a32(name, len) & (uset_size - 1);
+	while (uset[i].name) {
+		if (uset[i].len == len && memcmp(uset[i].name, name, len) == 0)
+			return;
+		i = (i + 1) & (uset_size - 1);
+	}
+	uset[i].name = name;
+	uset[i].len = len;
+	uset_cnt++;
+}
+
+static void uset_add(const char *name, size_t len) {
+	assert(name);
+
+	// keep the table at most half full
+	if (2 * (uset_cnt + 1) > uset_size) {
+		UserEntry *old = uset;
+		size_t old_size = uset_size;
+		uset_size = (uset_size) ? uset_size * 2 : 256;
+		uset = calloc(uset_size, sizeof(UserEntry));
+		if (!uset)
+			errExit("calloc");
+		uset_cnt = 0;
+		size_t i;
+		for (i = 0; i < old_size; i++)
+			if (old[i].name)
+				uset_insert(old[i].name, old[i].len);
+		free(old);
+	}
+	uset_insert(name, len);
+}
 
-// linked list of users
-typedef struct user_list {
-	struct user_list *next;
-	const char *user;
-} USER_LIST;
-USER_LIST *ulist = NULL;
+static int uset_find(const char *name, size_t len) {
+	if (!uset_cnt)
+		return 0;
+	size_t i = fnv1a32(name, len) & (uset_size - 1);
+	while (uset[i].name) {
+		if (uset[i].len == len && memcmp(uset[i].name, name, len) == 0)
+			return 1;
+		i = (i + 1) & (uset_size - 1);
+	}
+	return 0;
+}
 
-static void ulist_add(const char *user) {
-	assert(user);
+static void uset_free(void) {
+	free(uset);
+	uset = NULL;
+	uset_size = 0;
+	uset_cnt = 0;
+}
 
-	USER_LIST *nlist = malloc(sizeof(USER_LIST));
-	if (!nlist)
-		errExit("malloc");
-	memset(nlist, 0, sizeof(USER_LIST));
-	nlist->user = user;
-	nlist->next = ulist;
-	ulist = nlist;
+// the sanitized files are built in memory and written with a single write()
+typedef struct {
+	char *data;
+	size_t len;
+	size_t max;
+} OutBuf;
+
+static void out_append(OutBuf *out, const char *str, size_t len) {
+	if (out->len + len > out->max) {
+		out->max = (out->max) ? out->max : 4096;
+		while (out->len + len > out->max)
+			out->max *= 2;
+		out->data = realloc(out->data, out->max);
+		if (!out->data)
+			errExit("realloc");
+	}
+	memcpy(out->data + out->len, str, len);
+	out->len += len;
+}
+
+static void out_free(OutBuf *out) {
+	free(out->data);
+	memset(out, 0, sizeof(OutBuf));
+}
+
+typedef struct {
+	char *data;	// NULL for an empty file
+	size_t len;
+} MappedFile;
+
+// return -1 if the file cannot be mapped
+static int map_file(int dirfd, const char *fname, MappedFile *m) {
+	memset(m, 0, sizeof(MappedFile));
+	/* coverity[toctou] */
+	int fd = openat(dirfd, fname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	struct stat s;
+	if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode)) {
+		close(fd);
+		return -1;
+	}
+	if (s.st_size) {
+		void *ptr = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		m->data = ptr;
+		m->len = s.st_size;
+	}
+	close(fd);
+	return 0;
+}
+
+static void unmap_file(MappedFile *m) {
+	if (m->data)
+		munmap(m->data, m->len);
+	memset(m, 0, sizeof(MappedFile));
+}
+
+// parse the uid or gid field; return -1 if the field is not a number
+static int parse_id(const char *ptr, const char *end) {
+	long id = 0;
+	if (ptr == end || *ptr < '0' || *ptr > '9')
+		return -1;
+	while (ptr < end && *ptr >= '0' && *ptr <= '9') {
+		id = id * 10 + (*ptr - '0');
+		if (id > INT_MAX)
+			return -1;
+		ptr++;
+	}
+	return (int) id;
+}
+
+// advance past the next ':' in the line; return NULL if not found
+static const char *next_field(const char *ptr, const char *end) {
+	const char *p = memchr(ptr, ':', end - ptr);
+	return (p) ? p + 1 : NULL;
+}
+
+// return 0 if OK, 1 if the file cannot be parsed
+static int filter_passwd(const MappedFile *in, OutBuf *out) {
+	uid_t myuid = getuid();
+	const char *ptr = in->data;
+	const char *end = in->data + in->len;
+
+	while (ptr < end) {
+		const char *eol = memchr(ptr, '\n', end - ptr);
+		if (!eol)
+			eol = end;
+		const char *line = ptr;
+		ptr = eol + 1;
+
+		// comments and empty lines
+		if (line == eol || *line == '#')
+			continue;
+
+		// sample line:
+		// 	www-data:x:33:33:www-data:/var/www:/bin/sh
+		// drop lines with uid > 1000 and not the current user
+		const char *f = next_field(line, eol);
+		if (f)
+			f = next_field(f, eol);
+		if (!f)
+			return 1;
+		int uid = parse_id(f, eol);
+		if (uid < 0)
+			return 1;
+		assert(uid_min);
+		if (uid >= uid_min && uid != 65534 && (uid_t) uid != myuid) { // on Debian platforms user nobody is 65534
+			// store user name - necessary to process /etc/group
+			uset_add(line, (const char *) memchr(line, ':', eol - line) - line);
+			continue; // skip line
+		}
+		out_append(out, line, eol - line);
+		out_append(out, "\n", 1);
+	}
+	return 0;
 }
 
-static USER_LIST *ulist_find(const char *user) {
-	assert(user);
+// copy the line, removing the users dropped from /etc/passwd from the member list
+// members: 115:netblue,bingo
+static int copy_line(OutBuf *out, const char *line, const char *members, const char *eol) {
+	members = next_field(members, eol);
+	if (!members)
+		return 1;
+	out_append(out, line, members - line);
 
-	USER_LIST *ptr = ulist;
-	while (ptr) {
-		if (strcmp(ptr->user, user) == 0)
-			return ptr;
-		ptr = ptr->next;
+	int first = 1;
+	while (members < eol) {
+		const char *comma = memchr(members, ',', eol - members);
+		if (!comma)
+			comma = eol;
+		size_t len = comma - members;
+		if (len && !uset_find(members, len)) {
+			if (!first)
+				out_append(out, ",", 1);
+			first = 0;
+			out_append(out, members, len);
+		}
+		members = comma + 1;
 	}
+	out_append(out, "\n", 1);
+	return 0;
+}
+
+// return 0 if OK, 1 if the file cannot be parsed
+static int filter_group(const MappedFile *in, OutBuf *out) {
+	gid_t mygid = getgid();
+	const char *ptr = in->data;
+	const char *end = in->data + in->len;
+
+	while (ptr < end) {
+		const char *eol = memchr(ptr, '\n', end - ptr);
+		if (!eol)
+			eol = end;
+		const char *line = ptr;
+		ptr = eol + 1;
 
-	return NULL;
+		// comments and empty lines
+		if (line == eol || *line == '#')
+			continue;
+
+		// sample line:
+		// 	pulse:x:115:netblue,bingo
+		// drop lines with gid > 1000 and not the current user group
+		const char *f = next_field(line, eol);
+		if (f)
+			f = next_field(f, eol);
+		if (!f)
+			return 1;
+		int gid = parse_id(f, eol);
+		if (gid < 0)
+			return 1;
+		assert(gid_min);
+		if (gid >= gid_min && gid != 65534 && (gid_t) gid != mygid) // on Debian platforms 65534 is group nogroup
+			continue; // skip line
+		if (copy_line(out, line, f, eol))
+			return 1;
+	}
+	return 0;
+}
+
+//*******************************************
+// cache
+//*******************************************
+// The sanitized files are stored in RUN_FIREJAIL_USERS_CACHE_DIR (root only),
+// one entry <uid>.users for every user. The entry starts with the key: the
+// current uid and gid, UID_MIN, GID_MIN, and the inode, mtime and size of
+// /etc/passwd and /etc/group. The key is followed by an empty line, and by
+// the two files, each of them preceded by a "<name> <size>" line.
+static int cache_fd = -1;
+
+// open the cache directory before the filesystem is modified
+void restrict_users_cache_open(void) {
+	if (cache_fd != -1)
+		return;
+	if (!checkcfg(CFG_RESTRICT_USERS_CACHE))
+		return;
+
+	cache_fd = run_cache_open(RUN_FIREJAIL_USERS_CACHE_DIR, "users");
+}
+
+static char *build_key(void) {
+	if (cache_fd == -1)
+		return NULL;
+
+	char *key;
+	if (asprintf(&key, "version %s\nuid %u\ngid %u\nuid_min %d\ngid_min %d\n",
+		     VERSION, (unsigned) getuid(), (unsigned) getgid(), uid_min, gid_min) == -1)
+		errExit("asprintf");
+	if (run_cache_add_file_id(&key, "/etc/passwd") || run_cache_add_file_id(&key, "/etc/group")) {
+		free(key);
+		return NULL;
+	}
+	return key;
+}
+
+static void cache_entry_name(char *entry, size_t size) {
+	snprintf(entry, size, "%u.users", (unsigned) getuid());
+}
+
+// read a "<name> <size>" line followed by the data; return -1 on error
+static int cache_read_file(FILE *fp, const char *name, OutBuf *out) {
+	char line[64];
+	if (!fgets(line, sizeof(line), fp))
+		return -1;
+	size_t len = strlen(name);
+	if (strncmp(line, name, len) != 0 || line[len] != ' ')
+		return -1;
+
+	size_t size = 0;
+	const char *ptr;
+	for (ptr = line + len + 1; *ptr != '\n'; ptr++) {
+		if (*ptr < '0' || *ptr > '9' || size > SIZE_MAX / 10)
+			return -1;
+		size = size * 10 + (*ptr - '0');
+	}
+	if (ptr == line + len + 1)
+		return -1;
+
+	char *buf = malloc(size + 1);
+	if (!buf)
+		errExit("malloc");
+	int rv = -1;
+	if (fread(buf, 1, size, fp) == size) {
+		out_append(out, buf, size);
+		rv = 0;
+	}
+	free(buf);
+	return rv;
+}
+
+// return 0 if the sanitized files were loaded from the cache
+static int cache_load(const char *key, OutBuf *passwd, OutBuf *group) {
+	if (!key)
+		return -1;
+	char entry[64];
+	cache_entry_name(entry, sizeof(entry));
+	FILE *fp = run_cache_load(cache_fd, entry, key);
+	if (!fp)
+		return -1;
+
+	int rv = -1;
+	if (cache_read_file(fp, "passwd", passwd) == 0 &&
+	    cache_read_file(fp, "group", group) == 0 && fgetc(fp) == EOF)
+		rv = 0;
+	fclose(fp);
+
+	if (rv) {
+		out_free(passwd);
+		out_free(group);
+	}
+	else if (arg_debug)
+		printf("Sanitized /etc/passwd and /etc/group loaded from cache\n");
+	return rv;
+}
+
+// errors are not fatal
+static void cache_store(const char *key, const OutBuf *passwd, const OutBuf *group) {
+	if (!key)
+		return;
+
+	char entry[64];
+	cache_entry_name(entry, sizeof(entry));
+	FILE *fp = run_cache_create(cache_fd, entry, key);
+	if (!fp)
+		goto errout;
+
+	fprintf(fp, "passwd %zu\n", passwd->len);
+	fwrite(passwd->data, 1, passwd->len, fp);
+	fprintf(fp, "group %zu\n", group->len);
+	fwrite(group->data, 1, group->len, fp);
+	if (run_cache_commit(cache_fd, entry, fp))
+		goto errout;
+
+	if (arg_debug)
+		printf("Sanitized /etc/passwd and /etc/group stored in cache\n");
+	return;
+
+errout:
+	if (arg_debug)
+		printf("Cannot store the sanitized /etc/passwd and /etc/group in cache\n");
 }
 
 static void sanitize_home(void) {
@@ -157,236 +494,111 @@ static void sanitize_run(void) {
 	free(runuser);
 }
 
-static void sanitize_passwd(void) {
+// return -1 if the file does not exist
+static int check_file(const char *fname) {
 	struct stat s;
-	if (stat("/etc/passwd", &s) == -1)
-		return;
-	assert(uid_min);
-	if (arg_debug)
-		printf("Sanitizing /etc/passwd, UID_MIN %d\n", uid_min);
-	if (is_link("/etc/passwd")) {
-		fprintf(stderr, "Error: invalid /etc/passwd\n");
+	if (stat(fname, &s) == -1)
+		return -1;
+	if (is_link(fname)) {
+		fprintf(stderr, "Error: invalid %s\n", fname);
 		exit(1);
 	}
+	return 0;
+}
 
-	FILE *fpin = NULL;
-	FILE *fpout = NULL;
-
-	// open files
-	/* coverity[toctou] */
-	fpin = fopen("/etc/passwd", "re");
-	if (!fpin)
-		goto errout;
-	fpout = fopen(RUN_PASSWD_FILE, "we");
-	if (!fpout)
+// write the sanitized file and mount it on top of the original one
+static void install_file(const OutBuf *out, const char *runfile, const char *fname) {
+	int fd = open(runfile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
 		goto errout;
-
-	// read the file line by line
-	char buf[MAXBUF];
-	uid_t myuid = getuid();
-	while (fgets(buf, MAXBUF, fpin)) {
-		// comments and empty lines
-		if (*buf == '\0' || *buf == '#')
-			continue;
-
-		// sample line:
-		// 	www-data:x:33:33:www-data:/var/www:/bin/sh
-		// drop lines with uid > 1000 and not the current user
-		char *ptr = buf;
-
-		// advance to uid
-		while (*ptr != ':' && *ptr != '\0')
-			ptr++;
-		if (*ptr == '\0')
-			goto errout;
-		char *ptr1 = ptr;
-		ptr++;
-		while (*ptr != ':' && *ptr != '\0')
-			ptr++;
-		if (*ptr == '\0')
-			goto errout;
-		ptr++;
-		if (*ptr == '\0')
+	size_t done = 0;
+	while (done < out->len) {
+		ssize_t rv = write(fd, out->data + done, out->len - done);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			close(fd);
 			goto errout;
-
-		// process uid
-		int uid = -1;
-		int rv = sscanf(ptr, "%d:", &uid);
-		if (rv != 1 || uid < 0)
-			goto errout;
-		assert(uid_min);
-		if (uid < uid_min || uid == 65534) { // on Debian platforms user nobody is 65534
-			fprintf(fpout, "%s", buf);
-			continue;
 		}
-		if ((uid_t) uid != myuid) {
-			// store user name - necessary to process /etc/group
-			*ptr1 = '\0';
-			char *user = strdup(buf);
-			if (!user)
-				errExit("malloc");
-			ulist_add(user);
-			continue; // skip line
-		}
-		fprintf(fpout, "%s", buf);
+		done += rv;
 	}
-	fclose(fpin);
-	SET_PERMS_STREAM(fpout, 0, 0, 0644);
-	fclose(fpout);
+	SET_PERMS_FD(fd, 0, 0, 0644);
+	close(fd);
 
-	// mount-bind the new password file
-	if (mount(RUN_PASSWD_FILE, "/etc/passwd", "none", MS_BIND, "mode=400,gid=0") < 0)
+	// mount-bind the new file
+	if (mount(runfile, fname, "none", MS_BIND, "mode=400,gid=0") < 0)
 		errExit("mount");
 
-	// blacklist RUN_PASSWD_FILE
-	if (mount(RUN_RO_FILE, RUN_PASSWD_FILE, "none", MS_BIND, "mode=400,gid=0") < 0)
+	// blacklist the file in RUN_MNT_DIR
+	if (mount(RUN_RO_FILE, runfile, "none", MS_BIND, "mode=400,gid=0") < 0)
 		errExit("mount");
 
-	fs_logger("create /etc/passwd");
-
+	fs_logger2("create", fname);
 	return;
 
 errout:
-	fwarning("failed to clean up /etc/passwd\n");
-	if (fpin)
-		fclose(fpin);
-	if (fpout)
-		fclose(fpout);
+	fwarning("failed to clean up %s\n", fname);
 }
 
-// returns 1 if fails, 0 if OK
-static int copy_line(FILE *fpout, char *buf, char *ptr) {
-	// fpout: GROUP_FILE
-	// buf: pulse:x:115:netblue,bingo
-	// ptr: 115:neblue,bingo
-
-	while (*ptr != ':' && *ptr != '\0')
-		ptr++;
-	if (*ptr == '\0')
-		return 1;
-
-	ptr++;
-	if (*ptr == '\n' || *ptr == '\0') {
-		fprintf(fpout, "%s", buf);
-		return 0;
-	}
-
-	// print what we have so far
-	char tmp = *ptr;
-	*ptr = '\0';
-	fprintf(fpout, "%s", buf);
-	*ptr = tmp;
-
-	// tokenize
-	char *token = strtok(ptr, ",\n");
-	int first = 1;
-	while (token) {
-		char *newtoken = strtok(NULL, ",\n");
-		if (ulist_find(token)) {
-			//skip
-			token = newtoken;
-			continue;
-		}
-		if (!first)
-			fprintf(fpout, ",");
-		first = 0;
-		fprintf(fpout, "%s", token);
-		token = newtoken;
-	}
-	fprintf(fpout, "\n");
-	return 0;
-}
-
-static void sanitize_group(void) {
-	struct stat s;
-	if (stat("/etc/group", &s) == -1)
-		return;
+// /etc/passwd and /etc/group are mapped in memory and filtered in a single
+// pass each; the result is reused as long as the two files are not modified
+static void sanitize_users(void) {
+	int have_passwd = (check_file("/etc/passwd") == 0);
+	int have_group = (check_file("/etc/group") == 0);
+	assert(uid_min);
 	assert(gid_min);
-	if (arg_debug)
-		printf("Sanitizing /etc/group, GID_MIN %d\n", gid_min);
-	if (is_link("/etc/group")) {
-		fprintf(stderr, "Error: invalid /etc/group\n");
-		exit(1);
+	if (arg_debug) {
+		if (have_passwd)
+			printf("Sanitizing /etc/passwd, UID_MIN %d\n", uid_min);
+		if (have_group)
+			printf("Sanitizing /etc/group, GID_MIN %d\n", gid_min);
 	}
 
-	FILE *fpin = NULL;
-	FILE *fpout = NULL;
-
-	// open files
-	/* coverity[toctou] */
-	fpin = fopen("/etc/group", "re");
-	if (!fpin)
-		goto errout;
-	fpout = fopen(RUN_GROUP_FILE, "we");
-	if (!fpout)
-		goto errout;
-
-	// read the file line by line
-	char buf[MAXBUF];
-	gid_t mygid = getgid();
-	while (fgets(buf, MAXBUF, fpin)) {
-		// comments and empty lines
-		if (*buf == '\0' || *buf == '#')
-			continue;
-
-		// sample line:
-		// 	pulse:x:115:netblue,bingo
-		// drop lines with uid > 1000 and not the current user group
-		char *ptr = buf;
-
-		// advance to uid
-		while (*ptr != ':' && *ptr != '\0')
-			ptr++;
-		if (*ptr == '\0')
-			goto errout;
-		ptr++;
-		while (*ptr != ':' && *ptr != '\0')
-			ptr++;
-		if (*ptr == '\0')
-			goto errout;
-		ptr++;
-		if (*ptr == '\0')
-			goto errout;
-
-		// process uid
-		int gid = -1;
-		int rv = sscanf(ptr, "%d:", &gid);
-		if (rv != 1 || gid < 0)
-			goto errout;
-		assert(gid_min);
-		if (gid < gid_min || gid == 65534) { // on Debian platforms 65534 is group nogroup
-			if (copy_line(fpout, buf, ptr))
-				goto errout;
-			continue;
-		}
-		if ((gid_t) gid != mygid) {
-			continue; // skip line
+	OutBuf passwd = { NULL, 0, 0 };
+	OutBuf group = { NULL, 0, 0 };
+	int ok_passwd = 0;
+	int ok_group = 0;
+	char *key = (have_passwd && have_group) ? build_key() : NULL;
+
+	if (cache_load(key, &passwd, &group) == 0)
+		ok_passwd = ok_group = 1;
+	else {
+		// the user names stored in the set point in the passwd map
+		MappedFile map_passwd = { NULL, 0 };
+		if (have_passwd) {
+			if (map_file(AT_FDCWD, "/etc/passwd", &map_passwd) == 0) {
+				ok_passwd = (filter_passwd(&map_passwd, &passwd) == 0);
+				if (!ok_passwd)
+					fwarning("failed to clean up /etc/passwd\n");
+			}
+			else
+				fwarning("failed to clean up /etc/passwd\n");
 		}
-		if (copy_line(fpout, buf, ptr))
-			goto errout;
-	}
-	fclose(fpin);
-	SET_PERMS_STREAM(fpout, 0, 0, 0644);
-	fclose(fpout);
-
-	// mount-bind the new group file
-	if (mount(RUN_GROUP_FILE, "/etc/group", "none", MS_BIND, "mode=400,gid=0") < 0)
-		errExit("mount");
-
-	// blacklist RUN_GROUP_FILE
-	if (mount(RUN_RO_FILE, RUN_GROUP_FILE, "none", MS_BIND, "mode=400,gid=0") < 0)
-		errExit("mount");
 
-	fs_logger("create /etc/group");
-
-	return;
+		if (have_group) {
+			MappedFile map_group;
+			if (map_file(AT_FDCWD, "/etc/group", &map_group) == 0) {
+				ok_group = (filter_group(&map_group, &group) == 0);
+				unmap_file(&map_group);
+			}
+			if (!ok_group)
+				fwarning("failed to clean up /etc/group\n");
+		}
+		uset_free();
+		unmap_file(&map_passwd);
 
-errout:
-	fwarning("failed to clean up /etc/group\n");
-	if (fpin)
-		fclose(fpin);
-	if (fpout)
-		fclose(fpout);
+		if (ok_passwd && ok_group)
+			cache_store(key, &passwd, &group);
+	}
+	free(key);
+	run_cache_close(&cache_fd);
+
+	if (ok_passwd)
+		install_file(&passwd, RUN_PASSWD_FILE, "/etc/passwd");
+	if (ok_group)
+		install_file(&group, RUN_GROUP_FILE, "/etc/group");
+	out_free(&passwd);
+	out_free(&group);
 }
 
 void restrict_users(void) {
@@ -407,7 +619,6 @@ void restrict_users(void) {
 			fs_logger("tmpfs /home");
 		}
 		sanitize_run();
-		sanitize_passwd();
-		sanitize_group();
+		sanitize_users();
 	}
 }
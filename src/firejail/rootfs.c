@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --rootfs-image=file: a read-only EROFS or squashfs image used as the root
+// filesystem of the sandbox. The image is attached to a loop device shared
+// with the other sandboxes running it (see loopdev.c), mounted on
+// RUN_FIREJAIL_ROOTFS_DIR in the mount namespace of the sandbox, and the
+// sandbox is started in it with the --chroot code. /tmp, /var/tmp and /run
+// are tmpfs filesystems, /var/lib, /var/cache and /var/log are handled by
+// fs_chroot() as in any chroot.
+
+#ifdef HAVE_CHROOT
+#include "firejail.h"
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#ifndef O_PATH
+#define O_PATH 010000000
+#endif
+
+static char *devloop = NULL;	// device file
+static int devloop_fd = -1;	// keeps the device attached until the sandbox exits
+
+void rootfs_image_set(const char *image) {
+	assert(image);
+	assert(devloop == NULL);
+	EUID_ASSERT();
+
+	invalid_filename(image, 0); // no globbing
+	int ffd = open(image, O_RDONLY|O_CLOEXEC);
+	if (ffd == -1) {
+		fprintf(stderr, "Error: cannot read root filesystem image %s\n", image);
+		exit(1);
+	}
+	struct stat s;
+	if (fstat(ffd, &s) == -1)
+		errExit("fstat");
+	if (!S_ISREG(s.st_mode)) {
+		fprintf(stderr, "Error: invalid root filesystem image %s\n", image);
+		exit(1);
+	}
+	// the filesystem is parsed by the kernel, regular users can only start
+	// images installed by root
+	if (getuid() != 0 && (s.st_uid != 0 || ((S_IWGRP|S_IWOTH) & s.st_mode) != 0)) {
+		fprintf(stderr, "Error: root filesystem image %s should be owned and writable only by root\n", image);
+		exit(1);
+	}
+
+	cfg.rootfs_image = realpath(image, NULL);
+	if (!cfg.rootfs_image)
+		errExit("realpath");
+	cfg.chrootdir = RUN_FIREJAIL_ROOTFS_DIR;
+
+	devloop_fd = loop_device_get(ffd, 0, &devloop);
+	close(ffd);
+	if (arg_debug)
+		printf("Root filesystem image %s on %s\n", cfg.rootfs_image, devloop);
+}
+
+// mount a tmpfs on a directory of the image, if the directory exists
+static void writable_dir(int rootfd, const char *dir, const char *mode) {
+	int fd = safer_openat(rootfd, dir, O_PATH|O_DIRECTORY|O_CLOEXEC);
+	if (fd == -1)
+		return;	// reported by fs_chroot()
+	if (arg_debug)
+		printf("Mounting tmpfs on image /%s\n", dir);
+
+	char *proc;
+	if (asprintf(&proc, "/proc/self/fd/%d", fd) == -1)
+		errExit("asprintf");
+	if (tmpfs_mount(proc, MS_NOSUID | MS_NODEV | MS_STRICTATIME, mode, 0) < 0)
+		errExit("mounting tmpfs");
+	free(proc);
+	close(fd);
+}
+
+// mount the image and the writable directories; fs_chroot() does the rest
+void rootfs_image_mount(void) {
+	assert(devloop);
+	assert(cfg.rootfs_image);
+
+	unsigned long flags = MS_RDONLY;
+	if (getuid())
+		flags |= MS_NODEV|MS_NOSUID;
+
+	fmessage("Mounting root filesystem image %s\n", cfg.rootfs_image);
+	if (mount(devloop, RUN_FIREJAIL_ROOTFS_DIR, "erofs", flags, NULL) < 0) {
+		if (errno != EINVAL && errno != ENODEV)
+			errExit("mounting root filesystem image");
+		if (mount(devloop, RUN_FIREJAIL_ROOTFS_DIR, "squashfs", flags, NULL) < 0) {
+			fprintf(stderr, "Error: %s is not an EROFS or squashfs image\n", cfg.rootfs_image);
+			exit(1);
+		}
+	}
+	fs_logger2("rootfs image:", cfg.rootfs_image);
+
+	int rootfd = open(RUN_FIREJAIL_ROOTFS_DIR, O_PATH|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+	if (rootfd == -1)
+		errExit("open");
+	writable_dir(rootfd, "tmp", "mode=1777,gid=0");
+	writable_dir(rootfd, "var/tmp", "mode=1777,gid=0");
+	writable_dir(rootfd, "run", "mode=755,gid=0");
+
+	// fs_chroot() cannot update /etc/resolv.conf in the image, the file of
+	// the host is mounted on top of it
+	int fd = safer_openat(rootfd, "etc/resolv.conf", O_PATH|O_CLOEXEC);
+	if (fd != -1) {
+		struct stat s;
+		if (fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && access("/etc/resolv.conf", R_OK) == 0 &&
+		    bind_mount_path_to_fd("/etc/resolv.conf", fd) < 0)
+			errExit("mounting resolv.conf");
+		close(fd);
+	}
+	close(rootfd);
+}
+
+void rootfs_image_clear(void) {
+	loop_device_release(devloop_fd);
+	devloop_fd = -1;
+}
+
+#endif // HAVE_CHROOT
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Common code for the caches in /run/firejail (root only).
+//
+// A cache is a directory owned by root and not writable by anybody else,
+// opened before the filesystem is modified. An entry is a file starting with
+// the key it was built for and an empty line; the key is compared on every
+// lookup, an entry built for another key is a plain cache miss. Entries are
+// written in a temporary file renamed in place, a reader never finds a
+// partial entry.
+
+#include "firejail.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+
+// return the directory descriptor, -1 if the cache is not available;
+// name is used in the messages
+int run_cache_open(const char *dir, const char *name) {
+	assert(dir);
+	assert(name);
+
+	int fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1) {
+		if (arg_debug)
+			printf("%s cache not available: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	// the directory should be owned by root and not writable by anybody else
+	struct stat s;
+	if (fstat(fd, &s) == -1 || s.st_uid != 0 || (s.st_mode & 0022)) {
+		fwarning("invalid %s cache directory %s, cache disabled\n", name, dir);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void run_cache_close(int *fd) {
+	assert(fd);
+	if (*fd != -1)
+		close(*fd);
+	*fd = -1;
+}
+
+// number of entries with the extension ext, -1 on error
+int run_cache_count(int fd, const char *ext) {
+	assert(ext);
+	int dupfd = dup(fd);
+	if (dupfd == -1)
+		return -1;
+	DIR *dir = fdopendir(dupfd);
+	if (!dir) {
+		close(dupfd);
+		return -1;
+	}
+	rewinddir(dir);
+
+	int cnt = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		const char *ptr = strrchr(entry->d_name, '.');
+		if (ptr && strcmp(ptr + 1, ext) == 0)
+			cnt++;
+	}
+	closedir(dir);
+	return cnt;
+}
+
+// append "path inode mtime size"; return -1 if the file cannot be found
+int run_cache_add_file_id(char **key, const char *fname) {
+	assert(key && *key);
+	assert(fname);
+	struct stat s;
+	if (stat(fname, &s) == -1)
+		return -1;
+
+	char *tmp;
+	if (asprintf(&tmp, "%s%s %lu %lld %lld\n", *key, fname,
+		     (unsigned long) s.st_ino, (long long) s.st_mtime, (long long) s.st_size) == -1)
+		errExit("asprintf");
+	free(*key);
+	*key = tmp;
+	return 0;
+}
+
+// open the entry; the stream is positioned after the key and the empty line,
+// NULL if the entry is missing or was built for another key
+FILE *run_cache_load(int fd, const char *entry, const char *key) {
+	assert(entry);
+	assert(key);
+	int efd = openat(fd, entry, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (efd == -1)
+		return NULL;
+	FILE *fp = fdopen(efd, "r");
+	if (!fp) {
+		close(efd);
+		return NULL;
+	}
+
+	size_t len = strlen(key);
+	char *buf = malloc(len + 1);
+	if (!buf)
+		errExit("malloc");
+	int match = (fread(buf, 1, len, fp) == len && memcmp(buf, key, len) == 0 && fgetc(fp) == '\n');
+	free(buf);
+	if (!match) {
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static void tmp_name(char *tmp, size_t size, const char *entry) {
+	snprintf(tmp, size, "%s.tmp%d", entry, (int) getpid());
+}
+
+// start a new entry in a temporary file; the key and the empty line are
+// written first unless key is NULL
+FILE *run_cache_create(int fd, const char *entry, const char *key) {
+	assert(entry);
+	char tmp[128];
+	tmp_name(tmp, sizeof(tmp), entry);
+	int efd = openat(fd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (efd == -1)
+		return NULL;
+	FILE *fp = fdopen(efd, "w");
+	if (!fp) {
+		close(efd);
+		unlinkat(fd, tmp, 0);
+		return NULL;
+	}
+	if (key)
+		fprintf(fp, "%s\n", key);
+	return fp;
+}
+
+// close the temporary file and rename it in place; return -1 if the
+// entry could not be written, the temporary file is removed
+int run_cache_commit(int fd, const char *entry, FILE *fp) {
+	assert(entry);
+	assert(fp);
+	char tmp[128];
+	tmp_name(tmp, sizeof(tmp), entry);
+
+	int rv = (ferror(fp)) ? -1 : 0;
+	if (fclose(fp))
+		rv = -1;
+	if (rv == 0 && renameat(fd, tmp, fd, entry) == -1)
+		rv = -1;
+	if (rv)
+		unlinkat(fd, tmp, 0);
+	return rv;
+}
+
+// drop the temporary file
+void run_cache_abort(int fd, const char *entry, FILE *fp) {
+	assert(entry);
+	assert(fp);
+	char tmp[128];
+	tmp_name(tmp, sizeof(tmp), entry);
+	fclose(fp);
+	unlinkat(fd, tmp, 0);
+}
@@ -20,8 +20,8 @@
 
 #include "firejail.h"
 #include "../include/pid.h"
+#include "../include/run_record.h"
 #include <fcntl.h>
-#define BUFLEN 4096
 
 static void delete_sandbox_run_file(pid_t pid) {
 	char *fname;
@@ -32,31 +32,31 @@ static void delete_sandbox_run_file(pid_t pid) {
 	free(fname);
 }
 
-static void delete_x11_run_file(pid_t pid) {
+static void delete_run_record(pid_t pid) {
 	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_X11_DIR, pid) == -1)
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_RECORD_DIR, pid) == -1)
 		errExit("asprintf");
 	int rv = unlink(fname);
 	(void) rv;
 	free(fname);
 }
 
-static void delete_profile_run_file(pid_t pid) {
-	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_PROFILE_DIR, pid) == -1)
-		errExit("asprintf");
-	int rv = unlink(fname);
-	(void) rv;
-	free(fname);
-}
-
-static void delete_name_run_file(pid_t pid) {
-	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NAME_DIR, pid) == -1)
-		errExit("asprintf");
-	int rv = unlink(fname);
-	(void) rv;
-	free(fname);
+// remove the index entry if it still points to the sandbox
+static void delete_name_index(pid_t pid) {
+	RunRecord rec;
+	if (run_record_read(pid, &rec) == -1 || *rec.name == '\0')
+		return;
+
+	pid_t index_pid;
+	unsigned long long start;
+	if (name_index_read(rec.name, &index_pid, &start) == 0 && index_pid == pid) {
+		char *fname;
+		if (asprintf(&fname, "%s/%s", RUN_FIREJAIL_NAME_INDEX_DIR, rec.name) == -1)
+			errExit("asprintf");
+		int rv = unlink(fname);
+		(void) rv;
+		free(fname);
+	}
 }
 
 void delete_bandwidth_run_file(pid_t pid) {
@@ -78,12 +78,15 @@ static void delete_network_run_file(pid_t pid) {
 
 
 void delete_run_files(pid_t pid) {
+	net_group_release(pid);
 	delete_sandbox_run_file(pid);
 	delete_bandwidth_run_file(pid);
 	delete_network_run_file(pid);
-	delete_name_run_file(pid);
-	delete_x11_run_file(pid);
-	delete_profile_run_file(pid);
+	lease_release(pid);
+	delete_name_index(pid);
+	delete_run_record(pid);
+	delete_numa_run_file(pid);
+	cgroup_leaf_remove(pid);
 }
 
 static char *newname(char *name) {
@@ -104,66 +107,122 @@ static char *newname(char *name) {
 }
 
 
-void set_name_run_file(pid_t pid) {
-	cfg.name = newname(cfg.name);
+// name -> pid index, the file is replaced atomically; the start time
+// of the sandbox protects against pid reuse
+static void set_name_index(pid_t pid) {
+	unsigned long long start = pid_proc_start_time(pid);
+	if (start == 0)
+		return;
 
-	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NAME_DIR, pid) == -1)
+	char *tmp;
+	if (asprintf(&tmp, "%s/.%d", RUN_FIREJAIL_NAME_INDEX_DIR, pid) == -1)
 		errExit("asprintf");
-
-	// the file is deleted first
-	FILE *fp = fopen(fname, "we");
+	FILE *fp = fopen(tmp, "we");
 	if (!fp) {
-		fprintf(stderr, "Error: cannot create %s\n", fname);
-		exit(1);
+		// the index is optional, name lookups fall back to the name files
+		free(tmp);
+		return;
 	}
-	fprintf(fp, "%s\n", cfg.name);
-
-	// mode and ownership
+	fprintf(fp, "%d %llu\n", pid, start);
 	SET_PERMS_STREAM(fp, 0, 0, 0644);
 	fclose(fp);
+
+	char *fname;
+	if (asprintf(&fname, "%s/%s", RUN_FIREJAIL_NAME_INDEX_DIR, cfg.name) == -1)
+		errExit("asprintf");
+	if (rename(tmp, fname) == -1)
+		unlink(tmp);
 	free(fname);
+	free(tmp);
 }
 
+// the record of this process, written again for every update
+static RunRecord record;
 
-void set_x11_run_file(pid_t pid, int display) {
+static void run_record_write(pid_t pid) {
+	record.magic = RUN_RECORD_MAGIC;
+	record.size = sizeof(RunRecord);
+	if (record.pid != pid) {
+		record.pid = pid;
+		record.start = pid_proc_start_time(pid);
+	}
+
+	char *tmp;
+	if (asprintf(&tmp, "%s/.%d", RUN_FIREJAIL_RECORD_DIR, pid) == -1)
+		errExit("asprintf");
 	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_X11_DIR, pid) == -1)
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_RECORD_DIR, pid) == -1)
 		errExit("asprintf");
 
-	// the file is deleted first
-	FILE *fp = fopen(fname, "we");
-	if (!fp) {
-		fprintf(stderr, "Error: cannot create %s\n", fname);
+	int root = (geteuid() == 0);
+	if (!root)
+		EUID_ROOT();
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Error: cannot create %s\n", tmp);
 		exit(1);
 	}
-	fprintf(fp, "%d\n", display);
+	const char *ptr = (const char *) &record;
+	size_t done = 0;
+	while (done != sizeof(record)) {
+		ssize_t rv = write(fd, ptr + done, sizeof(record) - done);
+		if (rv < 0)
+			errExit("write");
+		done += rv;
+	}
 
 	// mode and ownership
-	SET_PERMS_STREAM(fp, 0, 0, 0644);
-	fclose(fp);
+	SET_PERMS_FD(fd, 0, 0, 0644);
+	close(fd);
+
+	// readers see either the old record or the new one
+	if (rename(tmp, fname) == -1)
+		errExit("rename");
+	if (!root)
+		EUID_USER();
 	free(fname);
+	free(tmp);
 }
 
-void set_profile_run_file(pid_t pid, const char *fname) {
-	char *runfile;
-	if (asprintf(&runfile, "%s/%d", RUN_FIREJAIL_PROFILE_DIR, pid) == -1)
-		errExit("asprintf");
+void set_name_run_file(pid_t pid) {
+	cfg.name = newname(cfg.name);
+	if (strlen(cfg.name) >= RUN_RECORD_NAME_MAX) {
+		fprintf(stderr, "Error: invalid sandbox name\n");
+		exit(1);
+	}
+	strcpy(record.name, cfg.name);
+	run_record_write(pid);
 
-	EUID_ROOT();
-	// the file is deleted first
-	FILE *fp = fopen(runfile, "we");
-	if (!fp) {
-		fprintf(stderr, "Error: cannot create %s\n", runfile);
+	set_name_index(pid);
+}
+
+void set_x11_run_file(pid_t pid, int display) {
+	record.x11 = display;
+	run_record_write(pid);
+}
+
+void set_pool_run_file(pid_t pid) {
+	assert(cfg.pool);
+	if (strlen(cfg.pool) >= RUN_RECORD_POOL_MAX) {
+		fprintf(stderr, "Error: invalid pool name\n");
 		exit(1);
 	}
-	fprintf(fp, "%s\n", fname);
+	strcpy(record.pool, cfg.pool);
+	run_record_write(pid);
+}
 
-	// mode and ownership
-	SET_PERMS_STREAM(fp, 0, 0, 0644);
-	fclose(fp);
-	EUID_USER();
-	free(runfile);
+void set_profile_run_file(pid_t pid, const char *fname) {
+	if (strlen(fname) >= PATH_MAX) {
+		fprintf(stderr, "Error: invalid profile file name\n");
+		exit(1);
+	}
+	strcpy(record.profile, fname);
+	run_record_write(pid);
+}
+
+// the record of the --instances launcher, taken over by every instance
+void set_instance_run_file(pid_t pid) {
+	run_record_write(pid);
 }
 
 static int sandbox_lock_fd = -1;
@@ -206,6 +265,12 @@ void set_sandbox_run_file(pid_t pid, pid_t child) {
 		errExit("fcntl");
 
 	sandbox_lock_fd = fd;
+
+	// the sandbox is started
+	record.child = child;
+	if (any_bridge_configured() || any_interface_configured() || arg_netns || net_group_joined())
+		record.options |= RUN_RECORD_NETWORK;
+	run_record_write(pid);
 }
 
 void release_sandbox_lock(void) {
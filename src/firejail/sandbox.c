@@ -21,8 +21,11 @@
 #include "firejail.h"
 #include "../include/gcov_wrapper.h"
 #include "../include/seccomp.h"
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/mount.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -45,6 +48,9 @@
 #ifndef PR_GET_NO_NEW_PRIVS
 #define PR_GET_NO_NEW_PRIVS 39
 #endif
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE 67
+#endif
 
 #ifdef HAVE_APPARMOR
 #include <sys/apparmor.h>
@@ -53,70 +59,61 @@
 extern int just_run_the_shell;
 
 static int monitored_pid = 0;
-static void sandbox_handler(int sig){
-	usleep(10000); // don't race to print a message
-	fmessage("\nChild received signal %d, shutting down the sandbox...\n", sig);
 
-	// broadcast sigterm to all processes in the group
+// SIGTERM all the processes in the sandbox, and SIGKILL the ones still running
+// at the end of the grace period, --shutdown-grace or ms by default;
+// SIGCHLD is blocked in the sandbox monitor
+static void sandbox_shutdown(int ms) {
 	kill(-1, SIGTERM);
-	sleep(1);
-
-	if (monitored_pid) {
-		int monsec = 9;
-		char *monfile;
-		if (asprintf(&monfile, "/proc/%d/cmdline", monitored_pid) == -1)
-			errExit("asprintf");
-		while (monsec) {
-			FILE *fp = fopen(monfile, "re");
-			if (!fp)
-				break;
-
-			char c;
-			size_t count = fread(&c, 1, 1, fp);
-			fclose(fp);
-			if (count == 0)
-				break;
 
+	int grace = (arg_shutdown_grace >= 0) ? arg_shutdown_grace : ms;
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sigset_t chld;
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	while (1) {
+		while (waitpid(-1, NULL, WNOHANG) > 0);
+		// kill() doesn't signal the sandbox monitor, it is pid 1
+		if (kill(-1, 0) == -1 && errno == ESRCH) {
 			if (arg_debug)
-				printf("Waiting on PID %d to finish\n", monitored_pid);
-			sleep(1);
-			monsec--;
+				printf("Sandbox monitor: all processes exited\n");
+			return;
 		}
-		free(monfile);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long left = grace - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+		if (left <= 0)
+			break;
+
+		// wake up on the next child exiting; the processes joining the
+		// sandbox are not children, they are checked every 20ms
+		struct timespec ts = { 0, ((left < 20) ? left : 20) * 1000000 };
+		sigtimedwait(&chld, NULL, &ts);
 	}
 
 	// broadcast a SIGKILL
 	kill(-1, SIGKILL);
+}
+
+static void sandbox_handler(int sig){
+	usleep(10000); // don't race to print a message
+	fmessage("\nChild received signal %d, shutting down the sandbox...\n", sig);
+	if (arg_debug && monitored_pid)
+		printf("Waiting on PID %d to finish\n", monitored_pid);
+	sandbox_shutdown(SHUTDOWN_GRACE_DEFAULT);
 
 	flush_stdin();
 	exit(128 + sig);
 }
 
-static void install_handler(void) {
-	struct sigaction sga;
-
-	// block SIGTERM while handling SIGINT
-	sigemptyset(&sga.sa_mask);
-	sigaddset(&sga.sa_mask, SIGTERM);
-	sga.sa_handler = sandbox_handler;
-	sga.sa_flags = 0;
-	sigaction(SIGINT, &sga, NULL);
-
-	// block SIGINT while handling SIGTERM
-	sigemptyset(&sga.sa_mask);
-	sigaddset(&sga.sa_mask, SIGINT);
-	sga.sa_handler = sandbox_handler;
-	sga.sa_flags = 0;
-	sigaction(SIGTERM, &sga, NULL);
-}
-
 static void set_caps(void) {
 	if (arg_caps_drop_all)
 		caps_drop_all();
 	else if (arg_caps_drop)
-		caps_drop_list(arg_caps_list);
+		caps_drop_list(arg_caps_mask);
 	else if (arg_caps_keep)
-		caps_keep_list(arg_caps_list);
+		caps_keep_list(arg_caps_mask);
 	else if (arg_caps_default_filter)
 		caps_default_filter();
 
@@ -226,13 +223,20 @@ static char *create_join_file(void) {
 	return rv;
 }
 
-static void sandbox_if_up(Bridge *br) {
+// queue the interface configuration; the commands queued so far are run
+// before the ARP checks of a macvlan device
+static void sandbox_if_up(Bridge *br, FnetScript *script) {
 	assert(br);
 	if (!br->configured)
 		return;
 
 	char *dev = br->devsandbox;
-	net_if_up(dev);
+	if (mac_not_zero(br->macsandbox)) {
+		unsigned char *mac = br->macsandbox;
+		fnet_script_add(script, "config mac %s %02x:%02x:%02x:%02x:%02x:%02x", dev,
+			mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	}
+	fnet_script_add(script, "ifup %s", dev);
 
 	if (br->arg_ip_none == 1);	// do nothing
 	else if (br->arg_ip_none == 0 && br->macvlan == 0) {
@@ -245,10 +249,12 @@ static void sandbox_if_up(Bridge *br) {
 		assert(br->ipsandbox);
 		if (arg_debug)
 			printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(br->ipsandbox), dev);
-		net_config_interface(dev, br->ipsandbox, br->mask, br->mtu);
-		arp_announce(dev, br);
+		fnet_script_add(script, "config interface %s %u %u %d", dev, br->ipsandbox, br->mask, br->mtu);
 	}
 	else if (br->arg_ip_none == 0 && br->macvlan == 1) {
+		// the ARP requests go out on the interface
+		fnet_script_run(script);
+
 		// reassign the macvlan address
 		if (br->ipsandbox == 0)
 			// ip address assigned by arp-scan for a macvlan device
@@ -272,12 +278,27 @@ static void sandbox_if_up(Bridge *br) {
 
 		if (arg_debug)
 			printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(br->ipsandbox), dev);
-		net_config_interface(dev, br->ipsandbox, br->mask, br->mtu);
-		arp_announce(dev, br);
+		fnet_script_add(script, "config interface %s %u %u %d", dev, br->ipsandbox, br->mask, br->mtu);
 	}
 
-	if (br->ip6sandbox)
-		net_if_ip6(dev, br->ip6sandbox);
+	if (br->ip6sandbox) {
+		if (strchr(br->ip6sandbox, ':') == NULL) {
+			fprintf(stderr, "Error: invalid IPv6 address %s\n", br->ip6sandbox);
+			exit(1);
+		}
+		fnet_script_add(script, "config ipv6 %s %s", dev, br->ip6sandbox);
+	}
+
+	// bandwidth profile command
+	if (br->bw_down)
+		fnet_script_add(script, "shape set %s %d %d", dev, br->bw_down, br->bw_up);
+}
+
+// announce the address once the interface is configured
+static void sandbox_if_announce(Bridge *br) {
+	assert(br);
+	if (br->configured && br->arg_ip_none == 0)
+		arp_announce(br->devsandbox, br);
 }
 
 static void chk_chroot(void) {
@@ -295,116 +316,198 @@ static void chk_chroot(void) {
 	errExit("cannot mount filesystem as slave");
 }
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// the wait status of a process reaped with waitid()
+static int wait_status(const siginfo_t *info) {
+	if (info->si_code == CLD_EXITED)
+		return (info->si_status & 0xff) << 8;
+	return (info->si_status & 0x7f) | ((info->si_code == CLD_DUMPED) ? 0x80 : 0);
+}
+
+// pick the next process to monitor, 0 if the sandbox is empty
+static pid_t monitor_next(void) {
+	DIR *dir;
+	if (!(dir = opendir("/proc"))) {
+		// sleep 2 seconds and try again
+		sleep(2);
+		if (!(dir = opendir("/proc"))) {
+			fprintf(stderr, "Error: cannot open /proc directory: %s\n",
+			        strerror(errno));
+			exit(1);
+		}
+	}
+
+	struct dirent *entry;
+	pid_t next = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		unsigned pid;
+		if (sscanf(entry->d_name, "%u", &pid) != 1)
+			continue;
+		if (pid == 1)
+			continue;
+		if (dhcp_client((pid_t) pid))
+			continue;
+
+		next = pid;
+		break;
+	}
+	closedir(dir);
+	return next;
+}
+
+// start monitoring pid; the pidfd is added to the epoll set, and it becomes
+// readable when the process exits, also for the processes joining the sandbox
+// return -1 if the process is already gone
+static int monitor_pid(int epfd, pid_t pid, int *pidfd) {
+	char *msg;
+	if (asprintf(&msg, "monitoring pid %d\n", pid) == -1)
+		errExit("asprintf");
+	logmsg(msg);
+	if (arg_debug)
+		printf("Sandbox monitor: %s", msg);
+	free(msg);
+
+	// without pidfd_open (Linux 5.3) the process is checked every second
+	*pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (*pidfd == -1)
+		return (errno == ESRCH) ? -1 : 0;
+
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = *pidfd };
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, *pidfd, &ev) == -1)
+		errExit("epoll_ctl");
+	return 0;
+}
+
+static void monitor_timeout(void) {
+	// SIGTERM might fail if the process ignores it (SIG_IGN)
+	// we give it 100ms to close properly and after that we SIGKILL it
+	sandbox_shutdown(100);
+	flush_stdin();
+	_exit(1);
+}
+
+// the monitor sleeps in epoll_wait() until a signal arrives, a child exits,
+// the monitored process exits, or the --timeout timer expires
 static int monitor_application(pid_t app_pid) {
 	EUID_ASSERT();
 	monitored_pid = app_pid;
 
-	// block signals and install handler
-	sigset_t oldmask, newmask;
-	sigemptyset(&oldmask);
-	sigemptyset(&newmask);
-	sigaddset(&newmask, SIGTERM);
-	sigaddset(&newmask, SIGINT);
-	sigprocmask(SIG_BLOCK, &newmask, &oldmask);
-	install_handler();
+	// the signals are read from a signalfd; the threads started by the
+	// monitor have all the signals blocked
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	int sigfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (sigfd == -1)
+		errExit("signalfd");
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		errExit("epoll_create1");
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = sigfd };
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) == -1)
+		errExit("epoll_ctl");
 
 	// handle --timeout
-	int options = 0;;
-	unsigned timeout = 0;
+	int tfd = -1;
 	if (cfg.timeout) {
-		options = WNOHANG;
-		timeout = cfg.timeout;
-		sleep(1);
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (tfd == -1)
+			errExit("timerfd_create");
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = cfg.timeout;
+		if (timerfd_settime(tfd, 0, &its, NULL) == -1)
+			errExit("timerfd_settime");
+		ev.data.fd = tfd;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) == -1)
+			errExit("epoll_ctl");
 	}
 
+	int pidfd = -1;
+	if (monitor_pid(epfd, monitored_pid, &pidfd) == -1)
+		monitored_pid = 0;
+
 	int status = 0;
 	int app_status = 0;
+	int gone = (monitored_pid == 0);
 	while (monitored_pid) {
-		usleep(20000);
-		char *msg;
-		if (asprintf(&msg, "monitoring pid %d\n", monitored_pid) == -1)
-			errExit("asprintf");
-		logmsg(msg);
-		if (arg_debug)
-			printf("%s\n", msg);
-		free(msg);
-
-		pid_t rv;
-		do {
-			// handle signals asynchronously
-			sigprocmask(SIG_SETMASK, &oldmask, NULL);
-
-			rv = waitpid(-1, &status, options);
-
-			// block signals again
-			sigprocmask(SIG_BLOCK, &newmask, NULL);
+		if (!gone) {
+			struct epoll_event events[4];
+			int nfds = epoll_wait(epfd, events, 4, (pidfd == -1) ? 1000 : -1);
+			if (nfds == -1) {
+				if (errno == EINTR)
+					continue;
+				errExit("epoll_wait");
+			}
 
-			if (rv == -1) { // we can get here if we have processes joining the sandbox (ECHILD)
-				sleep(1);
-				break;
+			int i;
+			for (i = 0; i < nfds; i++) {
+				int fd = events[i].data.fd;
+				if (fd == sigfd) {
+					struct signalfd_siginfo si;
+					while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {
+						if (si.ssi_signo == SIGTERM || si.ssi_signo == SIGINT)
+							sandbox_handler(si.ssi_signo);	// this function does not return
+					}
+				}
+				else if (fd == tfd)
+					monitor_timeout();
+				else if (fd == pidfd)
+					gone = 1;
 			}
-			else if (rv == app_pid)
-				app_status = status;
-
-			// handle --timeout
-			if (options) {
-				if (--timeout == 0)  {
-					// SIGTERM might fail if the process ignores it (SIG_IGN)
-					// we give it 100ms to close properly and after that we SIGKILL it
-					kill(-1, SIGTERM);
-					usleep(100000);
-					kill(-1, SIGKILL);
-					flush_stdin();
-					_exit(1);
+
+			// reap all the children exited
+			siginfo_t info;
+			while (1) {
+				memset(&info, 0, sizeof(info));
+				if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG) == -1 || info.si_pid == 0)
+					break;
+				if (info.si_pid == app_pid)
+					app_status = wait_status(&info);
+				if (info.si_pid == monitored_pid) {
+					status = wait_status(&info);
+					gone = 1;
 				}
-				else
-					sleep(1);
 			}
+			if (!gone && pidfd == -1 && kill(monitored_pid, 0) == -1 && errno == ESRCH)
+				gone = 1;
+			if (!gone)
+				continue;
 		}
-		while(rv != monitored_pid);
+
 		if (arg_debug)
-			printf("Sandbox monitor: waitpid %d retval %d status %d\n", monitored_pid, rv, status);
+			printf("Sandbox monitor: pid %d exited, status %d\n", monitored_pid, status);
+		if (pidfd != -1) {
+			close(pidfd);	// also removed from the epoll set
+			pidfd = -1;
+		}
 
 		if (arg_deterministic_shutdown) {
 			if (arg_debug)
 				printf("Sandbox monitor: monitored process died, shut down the sandbox\n");
-			kill(-1, SIGTERM);
-			usleep(100000);
-			kill(-1, SIGKILL);
+			sandbox_shutdown(100);
 			break;
 		}
 
-		DIR *dir;
-		if (!(dir = opendir("/proc"))) {
-			// sleep 2 seconds and try again
-			sleep(2);
-			if (!(dir = opendir("/proc"))) {
-				fprintf(stderr, "Error: cannot open /proc directory: %s\n",
-				        strerror(errno));
-				exit(1);
-			}
-		}
-
-		struct dirent *entry;
-		monitored_pid = 0;
-		while ((entry = readdir(dir)) != NULL) {
-			unsigned pid;
-			if (sscanf(entry->d_name, "%u", &pid) != 1)
-				continue;
-			if (pid == 1)
-				continue;
-			if ((pid_t) pid == dhclient4_pid || (pid_t) pid == dhclient6_pid)
-				continue;
-
-			monitored_pid = pid;
-			break;
-		}
-		closedir(dir);
-
-		if (monitored_pid != 0 && arg_debug)
-			printf("Sandbox monitor: monitoring %d\n", monitored_pid);
+		monitored_pid = monitor_next();
+		gone = 0;
+		if (monitored_pid && monitor_pid(epfd, monitored_pid, &pidfd) == -1)
+			gone = 1;	// exited already, pick another one
 	}
 
+	close(epfd);
+	if (tfd != -1)
+		close(tfd);
+	close(sigfd);
+	sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
 	// return the appropriate exit status.
 	return arg_deterministic_exit_code ? app_status : status;
 }
@@ -477,8 +580,10 @@ static void close_file_descriptors(void) {
 	if (arg_debug)
 		printf("Closing non-standard file descriptors\n");
 
+	// the seccomp supervisor socket is closed after installing the filters
+	int notify = seccomp_notify_sock();
 	if (!cfg.keep_fd) {
-		close_all(NULL, 0);
+		close_all(&notify, (notify == -1) ? 0 : 1);
 		return;
 	}
 
@@ -488,6 +593,12 @@ static void close_file_descriptors(void) {
 		fprintf(stderr, "Error: invalid keep-fd option: %s\n", cfg.keep_fd);
 		exit(1);
 	}
+	if (notify != -1) {
+		keep = realloc(keep, (sz + 1) * sizeof(int));
+		if (!keep)
+			errExit("realloc");
+		keep[sz++] = notify;
+	}
 	close_all(keep, sz);
 	free(keep);
 }
@@ -503,8 +614,13 @@ void start_application(int no_sandbox, int fd, char *set_sandbox_status) {
 		// set nice and rlimits
 		if (arg_nice)
 			set_nice(cfg.nice);
+		set_sched();
 		set_rlimits();
 
+		// the flag is inherited by the child processes and kept across execve
+		if (arg_memory_merge && prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0) != 0)
+			fwarning("cannot enable KSM memory merging: %s\n", strerror(errno));
+
 		env_defaults();
 	}
 
@@ -523,6 +639,10 @@ void start_application(int no_sandbox, int fd, char *set_sandbox_status) {
 	//****************************
 	// Configure Landlock
 	//****************************
+	sprof_begin("landlock");
+	// blacklist-mode landlock, the list is saved in the sandbox filesystem
+	if (no_sandbox == 0 || arg_join_filesystem)
+		ll_blacklist_restrict();
 	if (!arg_landlock_enforce) {
 		if (arg_debug)
 			fprintf(stderr, "Not enforcing Landlock (see landlock.enforce)\n");
@@ -532,6 +652,7 @@ void start_application(int no_sandbox, int fd, char *set_sandbox_status) {
 		// enabled and the "landlock_restrict_self" syscall has failed.
 		errExit("ll_restrict() failed, exiting...");
 	}
+	sprof_end_args(ll_stats_args());
 #endif
 
 	if (just_run_the_shell) {
@@ -544,7 +665,10 @@ void start_application(int no_sandbox, int fd, char *set_sandbox_status) {
 
 		__gcov_dump();
 
+		sprof_begin("seccomp install");
 		seccomp_install_filters();
+		sprof_end();
+		sprof_finish();
 
 		if (set_sandbox_status)
 			*set_sandbox_status = SANDBOX_DONE;
@@ -578,7 +702,10 @@ void start_application(int no_sandbox, int fd, char *set_sandbox_status) {
 
 		__gcov_dump();
 
+		sprof_begin("seccomp install");
 		seccomp_install_filters();
+		sprof_end();
+		sprof_finish();
 
 		if (set_sandbox_status)
 			*set_sandbox_status = SANDBOX_DONE;
@@ -630,7 +757,10 @@ void start_application(int no_sandbox, int fd, char *set_sandbox_status) {
 
 		__gcov_dump();
 
+		sprof_begin("seccomp install");
 		seccomp_install_filters();
+		sprof_end();
+		sprof_finish();
 
 		if (set_sandbox_status)
 			*set_sandbox_status = SANDBOX_DONE;
@@ -675,6 +805,9 @@ int sandbox(void* sandbox_arg) {
 
 	if (arg_debug && child_pid == 1)
 		printf("PID namespace installed\n");
+	sprof_thread(SPROF_TID_SANDBOX, "sandbox");
+	stats_set_owner();
+	sprof_begin("sandbox");
 
 
 	//****************************
@@ -689,6 +822,7 @@ int sandbox(void* sandbox_arg) {
 	// mount namespace
 	//****************************
 	// mount events are not forwarded between the host the sandbox
+	sprof_begin("mount namespace");
 	if (mount(NULL, "/", NULL, MS_SLAVE | MS_REC, NULL) < 0) {
 		chk_chroot();
 	}
@@ -700,6 +834,25 @@ int sandbox(void* sandbox_arg) {
 		errExit("mounting " RUN_FIREJAIL_LIB_DIR);
 	// keep a copy of dhclient executable before the filesystem is modified
 	dhcp_store_exec();
+	// open the seccomp filter cache before the filesystem is modified
+	seccomp_cache_open();
+	seccomp_store_open();
+#ifdef HAVE_PRIVATE_LIB
+	if (arg_private_lib)
+		fslib_cache_open();
+#endif
+	if (arg_private_dev)
+		fs_dev_cache_open();
+	if (getuid() && !arg_allusers)
+		restrict_users_cache_open();
+	if (!arg_writable_var_log)
+		fs_var_cache_open();
+	kpath_cache_open();
+	if (!arg_nosound && !arg_keep_config_pulse)
+		pulseaudio_cache_open();
+	// the seccomp filters not in the cache yet are built while the filesystem is set up
+	seccomp_prebuild_start();
+	sprof_end();
 
 	//****************************
 	// log sandbox data
@@ -716,17 +869,20 @@ int sandbox(void* sandbox_arg) {
 	//****************************
 	// netfilter
 	//****************************
+	sprof_begin("netfilter");
 	if (arg_netfilter && any_bridge_configured()) { // assuming by default the client filter
 		netfilter(arg_netfilter_file);
 	}
 	if (arg_netfilter6 && any_bridge_configured()) { // assuming by default the client filter
 		netfilter6(arg_netfilter6_file);
 	}
+	sprof_end();
 
 	//****************************
 	// networking
 	//****************************
 	int gw_cfg_failed = 0; // default gw configuration flag
+	sprof_begin("network");
 	if (arg_nonetwork) {
 		net_if_up("lo");
 		if (arg_debug)
@@ -737,49 +893,37 @@ int sandbox(void* sandbox_arg) {
 		if (arg_debug)
 			printf("Network namespace '%s' activated\n", arg_netns);
 	}
+	else if (net_group_joined()) {
+		if (arg_debug)
+			printf("Network namespace of group %s activated\n", arg_net_group);
+	}
 	else if (any_bridge_configured() || any_interface_configured()) {
 		// configure lo and eth0...eth3
-		net_if_up("lo");
-
-		if (mac_not_zero(cfg.bridge0.macsandbox))
-			net_config_mac(cfg.bridge0.devsandbox, cfg.bridge0.macsandbox);
-		sandbox_if_up(&cfg.bridge0);
-
-		if (mac_not_zero(cfg.bridge1.macsandbox))
-			net_config_mac(cfg.bridge1.devsandbox, cfg.bridge1.macsandbox);
-		sandbox_if_up(&cfg.bridge1);
-
-		if (mac_not_zero(cfg.bridge2.macsandbox))
-			net_config_mac(cfg.bridge2.devsandbox, cfg.bridge2.macsandbox);
-		sandbox_if_up(&cfg.bridge2);
-
-		if (mac_not_zero(cfg.bridge3.macsandbox))
-			net_config_mac(cfg.bridge3.devsandbox, cfg.bridge3.macsandbox);
-		sandbox_if_up(&cfg.bridge3);
-
+		FnetScript script;
+		fnet_script_init(&script, PATH_FNET);
+		fnet_script_add(&script, "ifup lo");
+		sandbox_if_up(&cfg.bridge0, &script);
+		sandbox_if_up(&cfg.bridge1, &script);
+		sandbox_if_up(&cfg.bridge2, &script);
+		sandbox_if_up(&cfg.bridge3, &script);
 
 		// moving an interface in a namespace using --interface will reset the interface configuration;
 		// we need to put the configuration back
-		if (cfg.interface0.configured && cfg.interface0.ip) {
-			if (arg_debug)
-				printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(cfg.interface0.ip), cfg.interface0.dev);
-			net_config_interface(cfg.interface0.dev, cfg.interface0.ip, cfg.interface0.mask, cfg.interface0.mtu);
-		}
-		if (cfg.interface1.configured && cfg.interface1.ip) {
-			if (arg_debug)
-				printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(cfg.interface1.ip), cfg.interface1.dev);
-			net_config_interface(cfg.interface1.dev, cfg.interface1.ip, cfg.interface1.mask, cfg.interface1.mtu);
-		}
-		if (cfg.interface2.configured && cfg.interface2.ip) {
-			if (arg_debug)
-				printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(cfg.interface2.ip), cfg.interface2.dev);
-			net_config_interface(cfg.interface2.dev, cfg.interface2.ip, cfg.interface2.mask, cfg.interface2.mtu);
-		}
-		if (cfg.interface3.configured && cfg.interface3.ip) {
-			if (arg_debug)
-				printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(cfg.interface3.ip), cfg.interface3.dev);
-			net_config_interface(cfg.interface3.dev, cfg.interface3.ip, cfg.interface3.mask, cfg.interface3.mtu);
+		Interface *ifs[] = { &cfg.interface0, &cfg.interface1, &cfg.interface2, &cfg.interface3 };
+		int i;
+		for (i = 0; i < 4; i++) {
+			if (ifs[i]->configured && ifs[i]->ip) {
+				if (arg_debug)
+					printf("Configuring %d.%d.%d.%d address on interface %s\n", PRINT_IP(ifs[i]->ip), ifs[i]->dev);
+				fnet_script_add(&script, "config interface %s %u %u %d", ifs[i]->dev, ifs[i]->ip, ifs[i]->mask, ifs[i]->mtu);
+			}
 		}
+		fnet_script_run(&script);
+
+		sandbox_if_announce(&cfg.bridge0);
+		sandbox_if_announce(&cfg.bridge1);
+		sandbox_if_announce(&cfg.bridge2);
+		sandbox_if_announce(&cfg.bridge3);
 
 		// add a default route
 		if (cfg.defaultgw) {
@@ -822,6 +966,7 @@ int sandbox(void* sandbox_arg) {
 			fmessage("\n");
 		}
 	}
+	sprof_end();
 
 	// load IBUS env variables
 	if (arg_nonetwork || any_bridge_configured() || any_interface_configured()) {
@@ -835,20 +980,8 @@ int sandbox(void* sandbox_arg) {
 
 	//****************************
 	// fs pre-processing:
-	//  - build seccomp filters
 	//  - create an empty /etc/ld.so.preload
 	//****************************
-	if (cfg.protocol) {
-		if (arg_debug)
-			printf("Build protocol filter: %s\n", cfg.protocol);
-
-		// build the seccomp filter as a regular user
-		int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
-			PATH_FSECCOMP, "protocol", "build", cfg.protocol, RUN_SECCOMP_PROTOCOL);
-		if (rv)
-			exit(rv);
-	}
-
 	// for --appimage, and --chroot we force NO_NEW_PRIVS
 	// and drop all capabilities
 	if (getuid() != 0 && (arg_appimage || cfg.chrootdir))
@@ -867,8 +1000,11 @@ int sandbox(void* sandbox_arg) {
 	//****************************
 	// configure filesystem
 	//****************************
+	sprof_begin("basic filesystem");
 #ifdef HAVE_CHROOT
 	if (cfg.chrootdir) {
+		if (cfg.rootfs_image)
+			rootfs_image_mount();
 		fs_chroot(cfg.chrootdir);
 
 		//****************************
@@ -883,17 +1019,22 @@ int sandbox(void* sandbox_arg) {
 	else
 #endif
 		fs_basic_fs();
+	sprof_end();
 
 	//****************************
 	// appimage
 	//****************************
-	if (arg_appimage)
+	if (arg_appimage) {
+		sprof_begin("appimage");
 		appimage_mount();
+		sprof_end();
+	}
 
 	//****************************
 	// private mode
 	//****************************
 	if (arg_private) {
+		sprof_begin("private home");
 		EUID_USER();
 		if (cfg.home_private) {	// --private=
 			if (cfg.chrootdir)
@@ -904,22 +1045,33 @@ int sandbox(void* sandbox_arg) {
 		else if (cfg.home_private_keep) { // --private-home=
 			if (cfg.chrootdir)
 				fwarning("private-home= feature is disabled in chroot\n");
+			else if (cfg.home_snapshot)
+				fs_private_home_snapshot();
 			else
 				fs_private_home_list();
 		}
 		else // --private
 			fs_private();
 		EUID_ROOT();
+		sprof_end();
 	}
 
-	if (arg_private_dev)
+	// the home snapshots of the user are not visible in the sandbox
+	disable_file_or_dir(RUN_FIREJAIL_SNAPSHOT_DIR);
+
+	if (arg_private_dev) {
+		sprof_begin("private-dev");
 		fs_private_dev();
+		sprof_end();
+	}
 
 	if (arg_private_opt) {
 		if (cfg.chrootdir)
 			fwarning("private-opt feature is disabled in chroot\n");
 		else {
+			sprof_begin("private-opt");
 			fs_private_dir_list("/opt", RUN_OPT_DIR, cfg.opt_private_keep);
+			sprof_end();
 		}
 	}
 
@@ -927,7 +1079,9 @@ int sandbox(void* sandbox_arg) {
 		if (cfg.chrootdir)
 			fwarning("private-srv feature is disabled in chroot\n");
 		else {
+			sprof_begin("private-srv");
 			fs_private_dir_list("/srv", RUN_SRV_DIR, cfg.srv_private_keep);
+			sprof_end();
 		}
 	}
 
@@ -942,14 +1096,9 @@ int sandbox(void* sandbox_arg) {
 			fwarning("private-bin feature is disabled in chroot\n");
 		else {
 			EUID_USER();
-			// for --x11=xorg we need to add xauth command
-			if (arg_x11_xorg) {
-				char *tmp;
-				if (asprintf(&tmp, "%s,xauth", cfg.bin_private_keep) == -1)
-					errExit("asprintf");
-				cfg.bin_private_keep = tmp;
-			}
+			sprof_begin("private-bin");
 			fs_private_bin_list();
+			sprof_end();
 			EUID_ROOT();
 		}
 	}
@@ -960,8 +1109,11 @@ int sandbox(void* sandbox_arg) {
 		if (cfg.chrootdir)
 			fwarning("private-lib feature is disabled in chroot\n");
 		else {
+			sprof_begin("private-lib");
 			fs_private_lib();
+			sprof_end();
 		}
+		fslib_cache_close();
 	}
 #endif
 
@@ -976,7 +1128,9 @@ int sandbox(void* sandbox_arg) {
 	if (arg_private_tmp) {
 		// private-tmp is implemented as a whitelist
 		EUID_USER();
+		sprof_begin("private-tmp");
 		fs_private_tmp();
+		sprof_end();
 		EUID_ROOT();
 	}
 
@@ -984,13 +1138,17 @@ int sandbox(void* sandbox_arg) {
 	// Session D-BUS
 	//****************************
 #ifdef HAVE_DBUSPROXY
+	sprof_begin("dbus");
 	dbus_apply_policy();
+	sprof_end();
 #endif
 
 	//****************************
 	// hosts and hostname
 	//****************************
+	sprof_begin("hostname");
 	fs_hostname();
+	sprof_end();
 
 	//****************************
 	// /etc overrides from the network namespace
@@ -1001,7 +1159,9 @@ int sandbox(void* sandbox_arg) {
 	//****************************
 	// update /proc, /sys, /dev, /boot directory
 	//****************************
+	sprof_begin("proc/sys/dev/boot");
 	fs_proc_sys_dev_boot();
+	sprof_end();
 
 	//****************************
 	// handle /mnt and /media
@@ -1027,6 +1187,7 @@ int sandbox(void* sandbox_arg) {
 			 * 2. unmount bind mounts from /etc
 			 * 3. mount RUN_ETC_DIR at /etc
 			 */
+			sprof_begin("private-etc");
 			timetrace_start();
 			cfg.etc_private_keep = fs_etc_build(cfg.etc_private_keep);
 			fs_private_dir_copy("/etc", RUN_ETC_DIR, cfg.etc_private_keep);
@@ -1047,6 +1208,7 @@ int sandbox(void* sandbox_arg) {
 			// process private-etc a second time
 			if (access("/usr/etc", F_OK) == 0)
 				fs_private_dir_list("/usr/etc", RUN_USR_ETC_DIR, cfg.etc_private_keep);
+			sprof_end();
 		}
 	}
 
@@ -1055,15 +1217,21 @@ int sandbox(void* sandbox_arg) {
 	//****************************
 	// apply all whitelist commands ...
 	EUID_USER();
+	sprof_begin("whitelist");
 	fs_whitelist();
+	sprof_end();
 
 	// ... followed by blacklist commands
+	sprof_begin("blacklist");
 	fs_blacklist(); // mkdir and mkfile are processed all over again
+	sprof_end_args(fs_blacklist_stats());
+	macro_print_stats();
 	EUID_ROOT();
 
 	//****************************
 	// nosound/no3d/notv/novideo and fix for pulseaudio 7.0
 	//****************************
+	sprof_begin("devices");
 	if (arg_nosound) {
 		// disable pulseaudio
 		pulseaudio_disable();
@@ -1100,10 +1268,12 @@ int sandbox(void* sandbox_arg) {
 
 	if (!arg_keep_dev_ntsync)
 		fs_dev_disable_ntsync();
+	sprof_end();
 
 	//****************************
 	// set DNS
 	//****************************
+	sprof_begin("dns");
 	if (cfg.dns1 != NULL || any_dhcp())
 		fs_resolvconf();
 
@@ -1111,6 +1281,7 @@ int sandbox(void* sandbox_arg) {
 	// start dhcp client
 	//****************************
 	dhcp_start();
+	sprof_end();
 
 	//****************************
 	// set application environment
@@ -1161,6 +1332,7 @@ int sandbox(void* sandbox_arg) {
 
 	// save original umask
 	save_umask();
+	ll_blacklist_save();
 
 	//****************************
 	// fs post-processing
@@ -1176,85 +1348,49 @@ int sandbox(void* sandbox_arg) {
 
 	// save cpu affinity mask to CPU_CFG file
 	save_cpu();
+	save_numa();
 
 	// set seccomp
-	// install protocol filter
+	sprof_begin("seccomp");
+	seccomp_prebuild_wait();
+	seccomp_server_open();
+	seccomp_configure();
 #ifdef SYS_socket
-	if (cfg.protocol) {
-		if (arg_debug)
-			printf("Install protocol filter: %s\n", cfg.protocol);
-		seccomp_load(RUN_SECCOMP_PROTOCOL);	// install filter
+	if (cfg.protocol)
 		protocol_filter_save();	// save filter in RUN_PROTOCOL_CFG
-	}
 	else {
 		int rv = unlink(RUN_SECCOMP_PROTOCOL);
 		(void) rv;
 	}
 #endif
 
-	// if a keep list is available, disregard the drop list
-	if (arg_seccomp == 1) {
-		if (cfg.seccomp_list_keep)
-			seccomp_filter_keep(true);
-		else
-			seccomp_filter_drop(true);
-	}
-	if (arg_seccomp32 == 1) {
-		if (cfg.seccomp_list_keep32)
-			seccomp_filter_keep(false);
-		else
-			seccomp_filter_drop(false);
-
-	}
-
-	if (arg_memory_deny_write_execute) {
-		if (arg_seccomp_error_action != EPERM) {
-			seccomp_filter_mdwx(true);
-			seccomp_filter_mdwx(false);
-		}
-		if (arg_debug)
-			printf("Install memory write&execute filter\n");
-		seccomp_load(RUN_SECCOMP_MDWX);	// install filter
-		seccomp_load(RUN_SECCOMP_MDWX_32);
-	}
-
-	if (arg_restrict_namespaces) {
-		if (arg_seccomp_error_action != EPERM) {
-			seccomp_filter_namespaces(true, cfg.restrict_namespaces);
-			seccomp_filter_namespaces(false, cfg.restrict_namespaces);
-		}
-
-		if (arg_debug)
-			printf("Install namespaces filter\n");
-		seccomp_load(RUN_SECCOMP_NS);	// install filter
-		seccomp_load(RUN_SECCOMP_NS_32);
-
-	}
-	else if (cfg.restrict_namespaces) {
-		seccomp_filter_namespaces(true, cfg.restrict_namespaces);
-		seccomp_filter_namespaces(false, cfg.restrict_namespaces);
-
-		if (arg_debug)
-			printf("Install namespaces filter\n");
-		seccomp_load(RUN_SECCOMP_NS);	// install filter
-		seccomp_load(RUN_SECCOMP_NS_32);
-	}
-
 	// make seccomp filters read-only
+	seccomp_save_flags();
+	seccomp_save_stack();
 	fs_remount(RUN_SECCOMP_DIR, MOUNT_READONLY, 0);
 	seccomp_debug();
+	seccomp_server_close();
+	seccomp_cache_close();
+	seccomp_store_close();
+	sprof_end();
 
 	//****************************
 	// install trace - still need capabilities
 	//****************************
-	if (need_preload)
+	if (need_preload) {
+		sprof_begin("trace");
 		fs_trace();
+		sprof_end();
+	}
 
 	//****************************
 	// continue security filters
 	//****************************
 	// set capabilities
+	sprof_begin("caps");
 	set_caps();
+	sprof_end();
+	save_join_desc();
 
 	//****************************************
 	// relay status information to join option
@@ -1266,6 +1402,9 @@ int sandbox(void* sandbox_arg) {
 	//     - too early to drop privileges
 	//****************************************
 	save_nogroups();
+	sprof_begin("user namespace");
+	// the parent sets up the maps only if it started the sandbox with --noroot
+	int map_sync = arg_noroot;
 	if (arg_noroot) {
 		int rv = unshare(CLONE_NEWUSER);
 		if (rv == -1) {
@@ -1276,11 +1415,13 @@ int sandbox(void* sandbox_arg) {
 
 	// notify parent that new user namespace has been created so a proper
 	// UID/GID map can be setup
-	notify_other(child_to_parent_fds[1]);
+	if (map_sync)
+		notify_other(child_to_parent_fds[1]);
 	close(child_to_parent_fds[1]);
 
 	// wait for parent to finish setting up a proper UID/GID map
-	wait_for_other(parent_to_child_fds[0]);
+	if (map_sync)
+		wait_for_other(parent_to_child_fds[0]);
 	close(parent_to_child_fds[0]);
 
 	// somehow, the new user namespace resets capabilities;
@@ -1290,6 +1431,7 @@ int sandbox(void* sandbox_arg) {
 			printf("noroot user namespace installed\n");
 		set_caps();
 	}
+	sprof_end();
 
 	//****************************************
 	// Set NO_NEW_PRIVS if desired
@@ -1313,23 +1455,45 @@ int sandbox(void* sandbox_arg) {
 	//****************************************
 	// set cpu affinity
 	//****************************************
-	if (cfg.cpus)
+	if (arg_numa)
+		set_numa_policy();	// the node cpus, restricted to --cpu
+	else if (cfg.cpus)
 		set_cpu_affinity();
 
+#ifdef HAVE_DBUSPROXY
+	// the proxy was started in parallel with the sandbox setup
+	sprof_begin("dbus proxy wait");
+	dbus_proxy_wait();
+	sprof_end();
+#endif
+	sprof_end(); // sandbox
+
+	// --warm-cache: the caches are filled, the program is not started
+	if (arg_warm_cache_run) {
+		fflush(0);
+		_exit(0);
+	}
+
 	//****************************************
 	// fork the application and monitor it
 	//****************************************
+	seccomp_notify_open();
+	stats_app_started();
 	pid_t app_pid = fork();
 	if (app_pid == -1)
 		errExit("fork");
 
 	if (app_pid == 0) {
+		sprof_thread(SPROF_TID_APP, "application");
 		start_application(0, -1, set_sandbox_status);	// this function does not return
 	}
 
 	munmap(set_sandbox_status, 1);
+	seccomp_notify_start();
+	trace_ring_start();
 
 	int status = monitor_application(app_pid);	// monitor application
+	trace_ring_stop();
 
 	if (WIFEXITED(status)) {
 		// if we had a proper exit, return that exit status
@@ -18,6 +18,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "firejail.h"
+#include "../include/launch_stats.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -25,6 +26,9 @@
 #include <stdarg.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <sched.h>
+#include <signal.h>
+#include <grp.h>
 #include "../include/seccomp.h"
 #include "../include/gcov_wrapper.h"
 
@@ -33,195 +37,231 @@
 #define O_PATH 010000000
 #endif
 
-static int __attribute__((noreturn)) sbox_do_exec_v(unsigned filtermask, char * const arg[]) {
-	// build a new, clean environment
+#define SBOX_MAX_ENV 256
+
+static void env_add(char *new_environment[SBOX_MAX_ENV], int *env_index, const char *name, const char *value) {
+	assert(*env_index < SBOX_MAX_ENV - 1);
+	if (asprintf(&new_environment[(*env_index)++], "%s=%s", name, value) == -1)
+		errExit("asprintf");
+}
+
+// build a new, clean environment for the helper programs; the strings are
+// allocated, see sbox_environment_free()
+static void sbox_environment(char *new_environment[SBOX_MAX_ENV]) {
 	int env_index = 0;
-	char *new_environment[256] = { NULL };
+	memset(new_environment, 0, SBOX_MAX_ENV * sizeof(char *));
 	// preserve firejail-specific env vars
 	const char *cl = env_get("FIREJAIL_FILE_COPY_LIMIT");
-	if (cl) {
-		if (asprintf(&new_environment[env_index++], "FIREJAIL_FILE_COPY_LIMIT=%s", cl) == -1)
-			errExit("asprintf");
-	}
+	if (cl)
+		env_add(new_environment, &env_index, "FIREJAIL_FILE_COPY_LIMIT", cl);
+	cl = env_get("FIREJAIL_FILE_COPY_COUNT_LIMIT");
+	if (cl)
+		env_add(new_environment, &env_index, "FIREJAIL_FILE_COPY_COUNT_LIMIT", cl);
+	if (sprof_get_fd() != -1 || stats_enabled()) // fcopy reports the amount of data copied
+		env_add(new_environment, &env_index, "FIREJAIL_FCOPY_STATS", RUN_FCOPY_STATS_FILE);
 	if (arg_quiet) // --quiet is passed as an environment variable
-		new_environment[env_index++] = "FIREJAIL_QUIET=yes";
+		env_add(new_environment, &env_index, "FIREJAIL_QUIET", "yes");
 	if (arg_debug) // --debug is passed as an environment variable
-		new_environment[env_index++] = "FIREJAIL_DEBUG=yes";
+		env_add(new_environment, &env_index, "FIREJAIL_DEBUG", "yes");
 	if (cfg.seccomp_error_action)
-		if (asprintf(&new_environment[env_index++], "FIREJAIL_SECCOMP_ERROR_ACTION=%s", cfg.seccomp_error_action) == -1)
-			errExit("asprintf");
-	new_environment[env_index++] = "FIREJAIL_PLUGIN="; // always set
-
-	if (filtermask & SBOX_STDIN_FROM_FILE) {
-		int fd;
-		if((fd = open(SBOX_STDIN_FILE, O_RDONLY)) == -1) {
-			fprintf(stderr,"Error: cannot open %s: %s\n",
-			        SBOX_STDIN_FILE, strerror(errno));
-			exit(1);
-		}
-		if (dup2(fd, STDIN_FILENO) == -1)
-			errExit("dup2");
-		close(fd);
-	}
-	else if ((filtermask & SBOX_ALLOW_STDIN) == 0) {
-		int fd = open("/dev/null",O_RDWR, 0);
-		if (fd != -1) {
-			if (dup2(fd, STDIN_FILENO) == -1)
-				errExit("dup2");
-			close(fd);
-		}
-		else // the user could run the sandbox without /dev/null
-			close(STDIN_FILENO);
-	}
+		env_add(new_environment, &env_index, "FIREJAIL_SECCOMP_ERROR_ACTION", cfg.seccomp_error_action);
+	if (cfg.seccomp_hot)
+		env_add(new_environment, &env_index, "FIREJAIL_SECCOMP_HOT", cfg.seccomp_hot);
+	env_add(new_environment, &env_index, "FIREJAIL_PLUGIN", ""); // always set
+}
 
-	// close all other file descriptors
-	if ((filtermask & SBOX_KEEP_FDS) == 0)
-		close_all(NULL, 0);
+static void sbox_environment_free(char *new_environment[SBOX_MAX_ENV]) {
+	int i;
+	for (i = 0; i < SBOX_MAX_ENV && new_environment[i]; i++)
+		free(new_environment[i]);
+}
 
-	umask(027);
+// the capabilities kept in the bounding set: 0 drops all of them, ~0 keeps
+// the bounding set unchanged
+static uint64_t sbox_caps(unsigned filtermask) {
+	if (filtermask & SBOX_CAPS_NONE)
+		return 0;
 
-	// apply filters
-	if (filtermask & SBOX_CAPS_NONE) {
-		caps_drop_all();
-	} else {
-		uint64_t set = 0;
-		if (filtermask & SBOX_CAPS_NETWORK) {
-#ifndef HAVE_GCOV // the following filter will prevent GCOV from saving info in .gcda files
-			set |= ((uint64_t) 1) << CAP_NET_ADMIN;
-			set |= ((uint64_t) 1) << CAP_NET_RAW;
-#endif
-		}
-		if (filtermask & SBOX_CAPS_HIDEPID) {
+	uint64_t set = 0;
+	if (filtermask & SBOX_CAPS_NETWORK) {
 #ifndef HAVE_GCOV // the following filter will prevent GCOV from saving info in .gcda files
-			set |= ((uint64_t) 1) << CAP_SYS_PTRACE;
-			set |= ((uint64_t) 1) << CAP_SYS_PACCT;
+		set |= ((uint64_t) 1) << CAP_NET_ADMIN;
+		set |= ((uint64_t) 1) << CAP_NET_RAW;
 #endif
-		}
-		if (filtermask & SBOX_CAPS_NET_SERVICE) {
+	}
+	if (filtermask & SBOX_CAPS_HIDEPID) {
 #ifndef HAVE_GCOV // the following filter will prevent GCOV from saving info in .gcda files
-			set |= ((uint64_t) 1) << CAP_NET_BIND_SERVICE;
-			set |= ((uint64_t) 1) << CAP_NET_BROADCAST;
+		set |= ((uint64_t) 1) << CAP_SYS_PTRACE;
+		set |= ((uint64_t) 1) << CAP_SYS_PACCT;
 #endif
-		}
-		if (set != 0) { // some SBOX_CAPS_ flag was specified, drop all other capabilities
+	}
+	if (filtermask & SBOX_CAPS_NET_SERVICE) {
 #ifndef HAVE_GCOV // the following filter will prevent GCOV from saving info in .gcda files
-			caps_set(set);
+		set |= ((uint64_t) 1) << CAP_NET_BIND_SERVICE;
+		set |= ((uint64_t) 1) << CAP_NET_BROADCAST;
 #endif
-		}
 	}
+	return (set) ? set : ~((uint64_t) 0);
+}
 
-	if (filtermask & SBOX_SECCOMP) {
-		struct sock_filter filter[] = {
-			VALIDATE_ARCHITECTURE,
-			EXAMINE_SYSCALL,
+// the seccomp filter of the helper programs; only system calls, it runs
+// in the sbox_run() child sharing the memory of the parent
+static int sbox_seccomp(void) {
+	struct sock_filter filter[] = {
+		VALIDATE_ARCHITECTURE,
+		EXAMINE_SYSCALL,
 
 #if defined(__x86_64__)
 #define X32_SYSCALL_BIT 0x40000000
-			// handle X32 ABI
-			BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, X32_SYSCALL_BIT, 1, 0),
-			BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, 0, 1, 0),
-			KILL_OR_RETURN_ERRNO,
+		// handle X32 ABI
+		BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, X32_SYSCALL_BIT, 1, 0),
+		BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, 0, 1, 0),
+		KILL_OR_RETURN_ERRNO,
 #endif
 
-		// syscall list
+	// syscall list
 #ifdef SYS_mount
-			BLACKLIST(SYS_mount), // mount/unmount filesystems
+		BLACKLIST(SYS_mount), // mount/unmount filesystems
 #endif
 #ifdef SYS_umount
-			BLACKLIST(SYS_umount),
+		BLACKLIST(SYS_umount),
 #endif
 #ifdef SYS_umount2
-			BLACKLIST(SYS_umount2),
+		BLACKLIST(SYS_umount2),
 #endif
 #ifdef SYS_fsopen
-			BLACKLIST(SYS_fsopen), // mount syscalls introduced 2019
+		BLACKLIST(SYS_fsopen), // mount syscalls introduced 2019
 #endif
 #ifdef SYS_fsconfig
-			BLACKLIST(SYS_fsconfig),
+		BLACKLIST(SYS_fsconfig),
 #endif
 #ifdef SYS_fsmount
-			BLACKLIST(SYS_fsmount),
+		BLACKLIST(SYS_fsmount),
 #endif
 #ifdef SYS_move_mount
-			BLACKLIST(SYS_move_mount),
+		BLACKLIST(SYS_move_mount),
 #endif
 #ifdef SYS_fspick
-			BLACKLIST(SYS_fspick),
+		BLACKLIST(SYS_fspick),
 #endif
 #ifdef SYS_open_tree
-			BLACKLIST(SYS_open_tree),
+		BLACKLIST(SYS_open_tree),
 #endif
 #ifdef SYS_ptrace
-			BLACKLIST(SYS_ptrace), // trace processes
+		BLACKLIST(SYS_ptrace), // trace processes
 #endif
 #ifdef SYS_process_vm_readv
-			BLACKLIST(SYS_process_vm_readv),
+		BLACKLIST(SYS_process_vm_readv),
 #endif
 #ifdef SYS_process_vm_writev
-			BLACKLIST(SYS_process_vm_writev),
+		BLACKLIST(SYS_process_vm_writev),
 #endif
 #ifdef SYS_kexec_file_load
-			BLACKLIST(SYS_kexec_file_load), // loading a different kernel
+		BLACKLIST(SYS_kexec_file_load), // loading a different kernel
 #endif
 #ifdef SYS_kexec_load
-			BLACKLIST(SYS_kexec_load),
+		BLACKLIST(SYS_kexec_load),
 #endif
 #ifdef SYS_name_to_handle_at
-			BLACKLIST(SYS_name_to_handle_at),
+		BLACKLIST(SYS_name_to_handle_at),
 #endif
 #ifdef SYS_open_by_handle_at
-			BLACKLIST(SYS_open_by_handle_at), // open by handle
+		BLACKLIST(SYS_open_by_handle_at), // open by handle
 #endif
 #ifdef SYS_init_module
-			BLACKLIST(SYS_init_module), // kernel module handling
+		BLACKLIST(SYS_init_module), // kernel module handling
 #endif
 #ifdef SYS_finit_module // introduced in 2013
-			BLACKLIST(SYS_finit_module),
+		BLACKLIST(SYS_finit_module),
 #endif
 #ifdef SYS_create_module
-			BLACKLIST(SYS_create_module),
+		BLACKLIST(SYS_create_module),
 #endif
 #ifdef SYS_delete_module
-			BLACKLIST(SYS_delete_module),
+		BLACKLIST(SYS_delete_module),
 #endif
 #ifdef SYS_iopl
-			BLACKLIST(SYS_iopl), // io permissions
+		BLACKLIST(SYS_iopl), // io permissions
 #endif
 #ifdef SYS_ioperm
-			BLACKLIST(SYS_ioperm),
+		BLACKLIST(SYS_ioperm),
 #endif
 #ifdef SYS_ioprio_set
-			BLACKLIST(SYS_ioprio_set),
+		BLACKLIST(SYS_ioprio_set),
 #endif
 #ifdef SYS_ni_syscall // new io permissions call on arm devices
-			BLACKLIST(SYS_ni_syscall),
+		BLACKLIST(SYS_ni_syscall),
 #endif
 #ifdef SYS_swapon
-			BLACKLIST(SYS_swapon), // swap on/off
+		BLACKLIST(SYS_swapon), // swap on/off
 #endif
 #ifdef SYS_swapoff
-			BLACKLIST(SYS_swapoff),
+		BLACKLIST(SYS_swapoff),
 #endif
 #ifdef SYS_syslog
-			BLACKLIST(SYS_syslog), // kernel printk control
+		BLACKLIST(SYS_syslog), // kernel printk control
 #endif
 #ifdef SYS_personality
-			BLACKLIST(SYS_personality), // execution domain
+		BLACKLIST(SYS_personality), // execution domain
 #endif
-			RETURN_ALLOW
-		};
+		RETURN_ALLOW
+	};
 
-		struct sock_fprog prog = {
-			.len = (unsigned short)(sizeof(filter) / sizeof(filter[0])),
-			.filter = filter,
-		};
+	struct sock_fprog prog = {
+		.len = (unsigned short)(sizeof(filter) / sizeof(filter[0])),
+		.filter = filter,
+	};
 
-		if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0)) {
-			perror("prctl(NO_NEW_PRIVS)");
+	return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+}
+
+// set up the process for running the helper programs: file descriptors,
+// capabilities, seccomp and user id; keep_fd is not closed
+static void sbox_prepare(unsigned filtermask, int keep_fd) {
+	if (filtermask & SBOX_STDIN_FROM_FILE) {
+		int fd;
+		if((fd = open(SBOX_STDIN_FILE, O_RDONLY)) == -1) {
+			fprintf(stderr,"Error: cannot open %s: %s\n",
+			        SBOX_STDIN_FILE, strerror(errno));
+			exit(1);
 		}
-		if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog)) {
-			perror("prctl(PR_SET_SECCOMP)");
+		if (dup2(fd, STDIN_FILENO) == -1)
+			errExit("dup2");
+		close(fd);
+	}
+	else if ((filtermask & SBOX_ALLOW_STDIN) == 0) {
+		int fd = open("/dev/null",O_RDWR, 0);
+		if (fd != -1) {
+			if (dup2(fd, STDIN_FILENO) == -1)
+				errExit("dup2");
+			close(fd);
 		}
+		else // the user could run the sandbox without /dev/null
+			close(STDIN_FILENO);
+	}
+
+	// close all other file descriptors
+	if ((filtermask & SBOX_KEEP_FDS) == 0) {
+		if (keep_fd != -1)
+			close_all(&keep_fd, 1);
+		else
+			close_all(NULL, 0);
+	}
+
+	umask(027);
+
+	// apply filters
+	uint64_t caps = sbox_caps(filtermask);
+	if (caps == 0)
+		caps_drop_all();
+	else if (caps != ~((uint64_t) 0))
+		caps_set(caps);
+
+	if (filtermask & SBOX_SECCOMP) {
+		if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0))
+			perror("prctl(NO_NEW_PRIVS)");
+		if (sbox_seccomp())
+			perror("prctl(PR_SET_SECCOMP)");
 	}
 
 	if (filtermask & SBOX_USER)
@@ -239,7 +279,9 @@ static int __attribute__((noreturn)) sbox_do_exec_v(unsigned filtermask, char *
 			errExit("setregid");
 	}
 	else assert(0);
+}
 
+static void __attribute__((noreturn)) sbox_exec(char * const arg[], char * const new_environment[]) {
 	if (arg[0]) { // get rid of scan-build warning
 		int fd = open(arg[0], O_PATH | O_CLOEXEC);
 		if (fd == -1) {
@@ -270,6 +312,277 @@ static int __attribute__((noreturn)) sbox_do_exec_v(unsigned filtermask, char *
 	_exit(1);
 }
 
+static void __attribute__((noreturn)) sbox_do_exec_v(unsigned filtermask, char * const arg[]) {
+	char *new_environment[SBOX_MAX_ENV];
+	sbox_environment(new_environment);
+	sbox_prepare(filtermask, -1);
+	sbox_exec(arg, new_environment);
+}
+
+// sbox_run_v(): the helper program is started by a child sharing the memory
+// of this process, as with vfork(), instead of a copy of the full firejail
+// process; the parent is suspended until the program is executed or the
+// child exits. The environment and the file descriptors kept open are set
+// up by the parent, the child runs on its own stack and makes only system
+// calls, on its own file descriptors, credentials and signal handlers.
+// exit() or stdio in the child would run the atexit handlers and flush the
+// streams of the parent in the shared memory: a failure is reported to the
+// parent on a close-on-exec pipe, and the child calls _exit().
+#define SBOX_STACK_SIZE (256 * 1024)
+#define SBOX_SPAWN_KEEP 8
+
+typedef enum {
+	SPAWN_STDIN = 1,	// cannot open SBOX_STDIN_FILE
+	SPAWN_DUP2,
+	SPAWN_CLOSE,
+	SPAWN_CAPS,
+	SPAWN_SETGROUPS,
+	SPAWN_SETRESGID,
+	SPAWN_SETRESUID,
+	SPAWN_SETRLIMIT,
+	SPAWN_SETREUID,
+	SPAWN_SETREGID,
+	SPAWN_OPEN,
+	SPAWN_FSTAT,
+	SPAWN_OWNER,		// not owned by root
+	SPAWN_WRITABLE,		// world writable
+	SPAWN_EXEC
+} SpawnStep;
+
+static const char * const spawn_call[] = {
+	[SPAWN_DUP2] = "dup2",
+	[SPAWN_CLOSE] = "close_range",
+	[SPAWN_CAPS] = "PR_CAPBSET_DROP",
+	[SPAWN_SETGROUPS] = "setgroups",
+	[SPAWN_SETRESGID] = "setresgid",
+	[SPAWN_SETRESUID] = "setresuid",
+	[SPAWN_SETRLIMIT] = "setrlimit",
+	[SPAWN_SETREUID] = "setreuid",
+	[SPAWN_SETREGID] = "setregid",
+	[SPAWN_OPEN] = "open",
+	[SPAWN_FSTAT] = "fstat",
+	[SPAWN_EXEC] = "fexecve"
+};
+
+typedef struct {
+	int step;
+	int err;
+} SpawnError;
+
+typedef struct {
+	unsigned filtermask;
+	char * const *arg;
+	char * const *env;
+	const sigset_t *mask;
+	int keep[SBOX_SPAWN_KEEP];
+	size_t keep_cnt;
+	int err_fd;
+} SboxSpawn;
+
+static void __attribute__((noreturn)) spawn_fail(SboxSpawn *sp, int step) {
+	SpawnError e = { step, errno };
+	ssize_t rv = write(sp->err_fd, &e, sizeof(e));
+	(void) rv;
+	_exit(127);
+}
+
+static int __attribute__((noreturn)) spawn_child(void *data) {
+	SboxSpawn *sp = data;
+
+	// the signal handlers of the parent would run in the shared memory;
+	// all the signals were blocked by the parent
+	int sig;
+	for (sig = 1; sig < _NSIG; sig++) {
+		struct sigaction sa;
+		if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL) {
+			sa.sa_handler = SIG_DFL;
+			sa.sa_flags = 0;
+			sigaction(sig, &sa, NULL);
+		}
+	}
+	sigprocmask(SIG_SETMASK, sp->mask, NULL);
+
+	// the same steps as sbox_prepare() and sbox_exec()
+	EUID_ROOT();
+	unsigned filtermask = sp->filtermask;
+	if (filtermask & SBOX_STDIN_FROM_FILE) {
+		int fd = open(SBOX_STDIN_FILE, O_RDONLY);
+		if (fd == -1)
+			spawn_fail(sp, SPAWN_STDIN);
+		if (dup2(fd, STDIN_FILENO) == -1)
+			spawn_fail(sp, SPAWN_DUP2);
+		close(fd);
+	}
+	else if ((filtermask & SBOX_ALLOW_STDIN) == 0) {
+		int fd = open("/dev/null", O_RDWR, 0);
+		if (fd != -1) {
+			if (dup2(fd, STDIN_FILENO) == -1)
+				spawn_fail(sp, SPAWN_DUP2);
+			close(fd);
+		}
+		else // the user could run the sandbox without /dev/null
+			close(STDIN_FILENO);
+	}
+
+	if (close_all_range(sp->keep, sp->keep_cnt))
+		spawn_fail(sp, SPAWN_CLOSE);
+
+	umask(027);
+
+	uint64_t caps = sbox_caps(filtermask);
+	if (caps != ~((uint64_t) 0)) {
+		unsigned long i;
+		for (i = 0; i < 64; i++) {
+			if ((caps & (((uint64_t) 1) << i)) == 0 &&
+			    prctl(PR_CAPBSET_DROP, i, 0, 0, 0) == -1 && errno != EINVAL)
+				spawn_fail(sp, SPAWN_CAPS);
+		}
+	}
+
+	// the seccomp filter is not fatal, as in sbox_prepare()
+	if (filtermask & SBOX_SECCOMP) {
+		prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+		sbox_seccomp();
+	}
+
+	if (filtermask & SBOX_USER) {
+		// drop_privs(1)
+		if (setgroups(0, NULL) < 0)
+			spawn_fail(sp, SPAWN_SETGROUPS);
+		if (setresgid(-1, getgid(), getgid()) != 0)
+			spawn_fail(sp, SPAWN_SETRESGID);
+		if (setresuid(-1, getuid(), getuid()) != 0)
+			spawn_fail(sp, SPAWN_SETRESUID);
+	}
+	else {
+		// https://seclists.org/oss-sec/2021/q4/43
+		struct rlimit tozero = { .rlim_cur = 0, .rlim_max = 0 };
+		if (setrlimit(RLIMIT_CORE, &tozero))
+			spawn_fail(sp, SPAWN_SETRLIMIT);
+
+		// elevate privileges in order to get grsecurity working
+		if (setreuid(0, 0))
+			spawn_fail(sp, SPAWN_SETREUID);
+		if (setregid(0, 0))
+			spawn_fail(sp, SPAWN_SETREGID);
+	}
+
+	// the coverage counters are in the shared memory, the parent saves
+	// them; no __gcov_dump() here
+	int fd = open(sp->arg[0], O_PATH | O_CLOEXEC);
+	if (fd == -1)
+		spawn_fail(sp, SPAWN_OPEN);
+	struct stat s;
+	if (fstat(fd, &s) == -1)
+		spawn_fail(sp, SPAWN_FSTAT);
+	if (s.st_uid != 0 && s.st_gid != 0)
+		spawn_fail(sp, SPAWN_OWNER);
+	if (s.st_mode & 00002)
+		spawn_fail(sp, SPAWN_WRITABLE);
+	fexecve(fd, sp->arg, sp->env);
+	spawn_fail(sp, SPAWN_EXEC);
+}
+
+// print the failure reported by the child, in the words of sbox_prepare()
+// and sbox_exec()
+static void spawn_error(const char *prog, const SpawnError *e) {
+	if (e->step == SPAWN_STDIN)
+		fprintf(stderr, "Error: cannot open %s: %s\n", SBOX_STDIN_FILE, strerror(e->err));
+	else if (e->step == SPAWN_OPEN && e->err == ENOENT)
+		fprintf(stderr, "Error: %s does not exist\n", prog);
+	else if (e->step == SPAWN_OWNER)
+		fprintf(stderr, "Error: %s is not owned by root, refusing to execute\n", prog);
+	else if (e->step == SPAWN_WRITABLE)
+		fprintf(stderr, "Error: %s is world writable, refusing to execute\n", prog);
+	else if (e->step == SPAWN_EXEC)
+		fprintf(stderr, "Error: fexecve %s: %s\n", prog, strerror(e->err));
+	else if (e->step > 0 && e->step <= SPAWN_EXEC && spawn_call[e->step])
+		fprintf(stderr, "Error: cannot start %s: %s: %s\n", prog, spawn_call[e->step], strerror(e->err));
+	else
+		fprintf(stderr, "Error: cannot start %s\n", prog);
+}
+
+// with other threads running, the glibc wrappers of the credential system
+// calls made in the child would signal the threads of the parent; the task
+// directory has a link for every thread
+static int single_threaded(void) {
+	struct stat s;
+	return stat("/proc/self/task", &s) == 0 && s.st_nlink == 3;
+}
+
+// the child closes the file descriptors with close_range() (Linux 5.9),
+// the /proc/self/fd fallback of close_all() allocates memory
+static int have_close_range(void) {
+	static int rv = -1;
+	if (rv == -1)
+		rv = (syscall(SYS_close_range, ~0U, ~0U, 0) == 0);
+	return rv;
+}
+
+static pid_t sbox_spawn(unsigned filtermask, char * const arg[]) {
+	static char stack[SBOX_STACK_SIZE] __attribute__((aligned(16)));
+	assert(arg[0]);
+
+	// not 0, 1 or 2, in case the standard streams are closed
+	int fd[2];
+	if (pipe2(fd, O_CLOEXEC) == -1)
+		errExit("pipe2");
+	if (fd[1] <= STDERR_FILENO) {
+		int tmp = fcntl(fd[1], F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+		if (tmp == -1)
+			errExit("fcntl");
+		close(fd[1]);
+		fd[1] = tmp;
+	}
+
+	char *new_environment[SBOX_MAX_ENV];
+	sbox_environment(new_environment);
+
+	if (arg_debug) {
+		uint64_t caps = sbox_caps(filtermask);
+		if (caps == 0)
+			printf("Dropping all capabilities\n");
+		else if (caps != ~((uint64_t) 0))
+			printf("Set caps filter %llx\n", (unsigned long long) caps);
+		if (filtermask & SBOX_USER)
+			printf("Drop privileges: uid %d, gid %d, force_nogroups 1\n", getuid(), getgid());
+	}
+	fflush(NULL);
+
+	SboxSpawn sp;
+	memset(&sp, 0, sizeof(sp));
+	sp.filtermask = filtermask;
+	sp.arg = arg;
+	sp.env = new_environment;
+	sp.err_fd = fd[1];
+	assert(5 + 1 <= SBOX_SPAWN_KEEP);
+	sp.keep_cnt = close_all_keep(sp.keep, &fd[1], 1);
+
+	sigset_t all, old;
+	sigfillset(&all);
+	sigprocmask(SIG_BLOCK, &all, &old);
+	sp.mask = &old;
+	pid_t child = clone(spawn_child, stack + sizeof(stack), CLONE_VM | CLONE_VFORK | SIGCHLD, &sp);
+	int err = errno;
+	sigprocmask(SIG_SETMASK, &old, NULL);
+	close(fd[1]);
+	sbox_environment_free(new_environment);
+
+	if (child == -1) {
+		close(fd[0]);
+		errno = err;
+		errExit("clone");
+	}
+
+	// the child has executed the program or exited; the exit status is
+	// checked by the caller
+	SpawnError e;
+	if (read(fd[0], &e, sizeof(e)) == sizeof(e))
+		spawn_error(arg[0], &e);
+	close(fd[0]);
+	return child;
+}
+
 int sbox_run(unsigned filtermask, int num, ...) {
 	va_list valist;
 	va_start(valist, num);
@@ -307,12 +620,26 @@ int sbox_run_v(unsigned filtermask, char * const arg[]) {
 	// KEEP_FDS only makes sense with sbox_exec_v
 	assert((filtermask & SBOX_KEEP_FDS) == 0);
 
-	pid_t child = fork();
-	if (child < 0)
-		errExit("fork");
-	if (child == 0) {
-		EUID_ROOT();
-		sbox_do_exec_v(filtermask, arg);
+	if (sprof_get_fd() != -1 || stats_enabled()) {
+		char *name;
+		if (asprintf(&name, "sbox %s", gnu_basename(arg[0])) == -1)
+			errExit("asprintf");
+		sprof_begin(name);
+		free(name);
+	}
+	stats_add(STATS_SBOX_RUNS, 1);
+
+	pid_t child;
+	if (single_threaded() && have_close_range())
+		child = sbox_spawn(filtermask, arg);
+	else {
+		child = fork();
+		if (child < 0)
+			errExit("fork");
+		if (child == 0) {
+			EUID_ROOT();
+			sbox_do_exec_v(filtermask, arg);
+		}
 	}
 
 	int status;
@@ -325,10 +652,318 @@ int sbox_run_v(unsigned filtermask, char * const arg[]) {
 		        arg[0], WEXITSTATUS(status));
 		exit(1);
 	}
+	sprof_end();
 
 	return status;
 }
 
+// run several helper programs with the same filters: the filters are set up
+// only once, in a child process forking again for each program; the wait
+// status of every program is stored in status[], -1 if the program was not
+// started; returns the number of programs that failed
+int sbox_run_batch(unsigned filtermask, int cnt, char ** const argv[], int status[]) {
+	assert(cnt >= 0);
+	assert(argv);
+	assert(status);
+	if (cnt == 0)
+		return 0;
+
+	// SBOX_KEEP_FDS only makes sense with sbox_exec_v
+	assert((filtermask & SBOX_KEEP_FDS) == 0);
+
+	int i;
+	if (arg_debug) {
+		for (i = 0; i < cnt; i++) {
+			printf("sbox batch: ");
+			int j = 0;
+			while (argv[i][j]) {
+				printf("%s ", argv[i][j]);
+				j++;
+			}
+			printf("\n");
+		}
+	}
+
+	if (sprof_get_fd() != -1) {
+		char *name;
+		if (asprintf(&name, "sbox batch %s (%d)", gnu_basename(argv[0][0]), cnt) == -1)
+			errExit("asprintf");
+		sprof_begin(name);
+		free(name);
+	}
+	else if (stats_enabled()) {
+		// a single phase for all the batch sizes
+		char *name;
+		if (asprintf(&name, "sbox batch %s", gnu_basename(argv[0][0])) == -1)
+			errExit("asprintf");
+		sprof_begin(name);
+		free(name);
+	}
+	stats_add(STATS_SBOX_RUNS, cnt);
+
+	// the status of each program is sent back on a pipe
+	int fd[2];
+	if (pipe2(fd, O_CLOEXEC) == -1)
+		errExit("pipe2");
+
+	pid_t child = fork();
+	if (child < 0)
+		errExit("fork");
+	if (child == 0) {
+		close(fd[0]);
+		EUID_ROOT();
+		char *new_environment[SBOX_MAX_ENV];
+		sbox_environment(new_environment);
+		sbox_prepare(filtermask, fd[1]);
+
+		for (i = 0; i < cnt; i++) {
+			int st = -1;
+			pid_t pid = fork();
+			if (pid == 0)
+				sbox_exec(argv[i], new_environment);
+			if (pid > 0 && waitpid(pid, &st, 0) == -1)
+				st = -1;
+			if (write(fd[1], &st, sizeof(st)) != sizeof(st))
+				_exit(1);
+		}
+		_exit(0);
+	}
+	close(fd[1]);
+
+	int failed = 0;
+	for (i = 0; i < cnt; i++) {
+		if (read(fd[0], &status[i], sizeof(int)) != sizeof(int))
+			status[i] = -1;
+		if (status[i] == -1 || WIFSIGNALED(status[i]) ||
+		   (WIFEXITED(status[i]) && WEXITSTATUS(status[i]) != 0))
+			failed++;
+	}
+	close(fd[0]);
+
+	int st;
+	if (waitpid(child, &st, 0) == -1)
+		errExit("waitpid");
+	sprof_end();
+
+	return failed;
+}
+
+void sbox_batch_init(SboxBatch *batch, unsigned filtermask) {
+	assert(batch);
+	memset(batch, 0, sizeof(SboxBatch));
+	batch->filtermask = filtermask;
+}
+
+// queue a program; the arguments are copied
+void sbox_batch_add(SboxBatch *batch, int num, ...) {
+	assert(batch);
+	assert(num > 0);
+
+	if (batch->cnt == batch->max) {
+		batch->max = (batch->max) ? batch->max * 2 : 16;
+		batch->argv = realloc(batch->argv, batch->max * sizeof(char **));
+		if (!batch->argv)
+			errExit("realloc");
+	}
+
+	char **arg = calloc(num + 1, sizeof(char *));
+	if (!arg)
+		errExit("calloc");
+	va_list valist;
+	va_start(valist, num);
+	int i;
+	for (i = 0; i < num; i++) {
+		arg[i] = strdup(va_arg(valist, char *));
+		if (!arg[i])
+			errExit("strdup");
+	}
+	va_end(valist);
+	batch->argv[batch->cnt++] = arg;
+}
+
+// run all the queued programs and release the memory; exit on failure,
+// same as sbox_run()
+void sbox_batch_run(SboxBatch *batch) {
+	assert(batch);
+	if (batch->cnt == 0)
+		return;
+
+	int *status = malloc(batch->cnt * sizeof(int));
+	if (!status)
+		errExit("malloc");
+
+	int i;
+	if (sbox_run_batch(batch->filtermask, batch->cnt, batch->argv, status)) {
+		for (i = 0; i < batch->cnt; i++) {
+			if (status[i] == -1 || WIFSIGNALED(status[i]) ||
+			   (WIFEXITED(status[i]) && WEXITSTATUS(status[i]) != 0)) {
+				fprintf(stderr, "Error: failed to run %s: exit status %d, exiting...\n",
+				        batch->argv[i][0], (status[i] == -1) ? -1 : WEXITSTATUS(status[i]));
+				exit(1);
+			}
+		}
+	}
+
+	for (i = 0; i < batch->cnt; i++) {
+		char **arg = batch->argv[i];
+		while (*arg)
+			free(*arg++);
+		free(batch->argv[i]);
+	}
+	free(batch->argv);
+	free(status);
+	sbox_batch_init(batch, batch->filtermask);
+}
+
+// end the "fcopy batch" span with the copy rates reported by fcopy, and add
+// the totals to the launch statistics
+static void fcopy_batch_stats(int entries) {
+	unsigned long files = 0;
+	unsigned long long bytes = 0;
+	FILE *fp = fopen(RUN_FCOPY_STATS_FILE, "re");
+	if (fp) {
+		if (fscanf(fp, "%lu %llu", &files, &bytes) != 2)
+			files = bytes = 0;
+		fclose(fp);
+	}
+	stats_add(STATS_FCOPY_FILES, files);
+	stats_add(STATS_FCOPY_BYTES, bytes);
+
+	unsigned long long us = sprof_elapsed();
+	if (us == 0)
+		us = 1;
+	char args[256];
+	snprintf(args, sizeof(args),
+		"\"entries\":%d,\"files\":%lu,\"bytes\":%llu,\"files_per_sec\":%llu,\"bytes_per_sec\":%llu",
+		entries, files, bytes, (unsigned long long) files * 1000000ULL / us, bytes * 1000000ULL / us);
+	if (arg_debug)
+		printf("fcopy batch: %lu files, %llu bytes in %llu us\n", files, bytes, us);
+	sprof_end_args(args);
+}
+
+void fcopy_batch_init(FcopyBatch *batch, unsigned filtermask, int follow_link) {
+	assert(batch);
+	memset(batch, 0, sizeof(FcopyBatch));
+	batch->filtermask = filtermask;
+	batch->follow_link = follow_link;
+}
+
+// queue a src/dest pair for fcopy --batch
+void fcopy_batch_add(FcopyBatch *batch, const char *src, const char *dest) {
+	assert(batch);
+	assert(src && *src);
+	assert(dest && *dest);
+
+	size_t len = strlen(src) + strlen(dest) + 2;
+	if (batch->len + len > batch->size) {
+		batch->size = (batch->len + len) * 2;
+		batch->buf = realloc(batch->buf, batch->size);
+		if (!batch->buf)
+			errExit("realloc");
+	}
+	strcpy(batch->buf + batch->len, src);
+	batch->len += strlen(src) + 1;
+	strcpy(batch->buf + batch->len, dest);
+	batch->len += strlen(dest) + 1;
+	batch->cnt++;
+}
+
+// copy all the queued files in a single fcopy run; the list is passed
+// on stdin using SBOX_STDIN_FILE
+void fcopy_batch_run(FcopyBatch *batch) {
+	assert(batch);
+	if (batch->cnt == 0)
+		return;
+
+	int euid = geteuid();
+	EUID_ROOT();
+	int fd = open(SBOX_STDIN_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd == -1)
+		errExit("open");
+	size_t done = 0;
+	while (done < batch->len) {
+		ssize_t rv = write(fd, batch->buf + done, batch->len - done);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("write");
+		}
+		done += rv;
+	}
+	close(fd);
+
+	// --profile-startup and the launch statistics: fcopy reports the number
+	// of files and bytes copied
+	int stats = (sprof_get_fd() != -1 || stats_enabled());
+	if (stats) {
+		create_empty_file_as_root(RUN_FCOPY_STATS_FILE, 0600);
+		if (set_perms(RUN_FCOPY_STATS_FILE, getuid(), getgid(), 0600))
+			errExit("set_perms");
+		sprof_begin("fcopy batch");
+	}
+
+	if (arg_debug)
+		printf("fcopy batch: %d %s\n", batch->cnt, (batch->cnt == 1) ? "entry" : "entries");
+	if (batch->follow_link)
+		sbox_run(batch->filtermask | SBOX_STDIN_FROM_FILE, 3, PATH_FCOPY, "--follow-link", "--batch");
+	else
+		sbox_run(batch->filtermask | SBOX_STDIN_FROM_FILE, 2, PATH_FCOPY, "--batch");
+
+	unlink(SBOX_STDIN_FILE);
+	if (stats) {
+		fcopy_batch_stats(batch->cnt);
+		unlink(RUN_FCOPY_STATS_FILE);
+	}
+	if (euid != 0)
+		EUID_USER();
+
+	free(batch->buf);
+	fcopy_batch_init(batch, batch->filtermask, batch->follow_link);
+}
+
+// start a helper program serving requests on its stdin; the replies are
+// read from its stdout; returns the pid of the helper
+pid_t sbox_run_server(unsigned filtermask, int *rfd, int *wfd, char * const arg[]) {
+	assert(rfd);
+	assert(wfd);
+	assert(arg);
+
+	if (arg_debug) {
+		printf("sbox server: ");
+		int i = 0;
+		while (arg[i]) {
+			printf("%s ", arg[i]);
+			i++;
+		}
+		printf("\n");
+	}
+
+	// SBOX_KEEP_FDS only makes sense with sbox_exec_v
+	assert((filtermask & (SBOX_KEEP_FDS | SBOX_STDIN_FROM_FILE)) == 0);
+
+	int req[2];
+	int reply[2];
+	if (pipe2(req, O_CLOEXEC) == -1 || pipe2(reply, O_CLOEXEC) == -1)
+		errExit("pipe2");
+	fflush(0);
+
+	pid_t child = fork();
+	if (child < 0)
+		errExit("fork");
+	if (child == 0) {
+		if (dup2(req[0], STDIN_FILENO) == -1 || dup2(reply[1], STDOUT_FILENO) == -1)
+			errExit("dup2");
+		EUID_ROOT();
+		sbox_do_exec_v(filtermask | SBOX_ALLOW_STDIN, arg);
+	}
+
+	close(req[0]);
+	close(reply[1]);
+	*wfd = req[1];
+	*rfd = reply[0];
+	return child;
+}
+
 void sbox_exec_v(unsigned filtermask, char * const arg[]) {
 	EUID_ROOT();
 
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include <ctype.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+// --ioprio=class[,level], --sched=policy and --sched-slice=usec: I/O and CPU
+// scheduling of the sandbox, set in start_application() and inherited by all
+// the processes started in the sandbox; they are stored in the join
+// descriptor for --join
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_LEVELS 8
+
+#ifndef SCHED_BATCH
+#define SCHED_BATCH 3
+#endif
+#ifndef SCHED_IDLE
+#define SCHED_IDLE 5
+#endif
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+// the EEVDF custom slice of the fair policies, Linux 6.12 and later
+#define SLICE_MIN_USEC 100
+#define SLICE_MAX_USEC 100000
+
+// first version of struct sched_attr, see sched_setattr(2)
+typedef struct {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+} SchedAttr;
+
+static int read_number(const char *str, int min, int max) {
+	const char *ptr = str;
+	if (*ptr == '\0')
+		return -1;
+	for (; *ptr; ptr++) {
+		if (!isdigit(*ptr))
+			return -1;
+	}
+	if (strlen(str) > 6)
+		return -1;
+	int val = atoi(str);
+	if (val < min || val > max)
+		return -1;
+	return val;
+}
+
+void read_ioprio(const char *str) {
+	char *tmp = strdup(str);
+	if (!tmp)
+		errExit("strdup");
+	char *level = strchr(tmp, ',');
+	if (level)
+		*level++ = '\0';
+
+	int class;
+	if (strcmp(tmp, "realtime") == 0)
+		class = IOPRIO_CLASS_RT;
+	else if (strcmp(tmp, "best-effort") == 0)
+		class = IOPRIO_CLASS_BE;
+	else if (strcmp(tmp, "idle") == 0)
+		class = IOPRIO_CLASS_IDLE;
+	else
+		goto errexit;
+
+	// the level is not used by the idle class
+	int val = IOPRIO_LEVELS / 2;
+	if (level) {
+		if (class == IOPRIO_CLASS_IDLE)
+			goto errexit;
+		val = read_number(level, 0, IOPRIO_LEVELS - 1);
+		if (val == -1)
+			goto errexit;
+	}
+	cfg.ioprio = class << IOPRIO_CLASS_SHIFT | val;
+	free(tmp);
+	return;
+
+errexit:
+	fprintf(stderr, "Error: invalid ioprio %s; use realtime[,level], best-effort[,level] or idle, with a level from 0 to 7\n", str);
+	exit(1);
+}
+
+void read_sched(const char *str) {
+	if (strcmp(str, "other") == 0)
+		cfg.sched_policy = SCHED_OTHER;
+	else if (strcmp(str, "batch") == 0)
+		cfg.sched_policy = SCHED_BATCH;
+	else if (strcmp(str, "idle") == 0)
+		cfg.sched_policy = SCHED_IDLE;
+	else {
+		fprintf(stderr, "Error: invalid sched %s; use other, batch or idle\n", str);
+		exit(1);
+	}
+	arg_sched = 1;
+}
+
+void read_sched_slice(const char *str) {
+	int val = read_number(str, SLICE_MIN_USEC, SLICE_MAX_USEC);
+	if (val == -1) {
+		fprintf(stderr, "Error: invalid sched-slice %s; use a time in microseconds from %d to %d\n",
+			str, SLICE_MIN_USEC, SLICE_MAX_USEC);
+		exit(1);
+	}
+	cfg.sched_slice = (unsigned) val;
+}
+
+static void set_ioprio(void) {
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, cfg.ioprio) == -1)
+		fwarning("cannot set the I/O priority: %s\n", strerror(errno));
+	else if (arg_debug)
+		printf("I/O priority set to class %d, level %d\n",
+		       cfg.ioprio >> IOPRIO_CLASS_SHIFT, cfg.ioprio & (IOPRIO_LEVELS - 1));
+}
+
+// the policy and the slice are set together, the nice value set by
+// --nice is kept
+static void set_policy(void) {
+	int policy = cfg.sched_policy;
+	if (!arg_sched) {
+		policy = sched_getscheduler(0);
+		if (policy == -1)
+			errExit("sched_getscheduler");
+		policy &= ~SCHED_RESET_ON_FORK;
+		if (policy != SCHED_OTHER && policy != SCHED_BATCH && policy != SCHED_IDLE) {
+			fwarning("the sched-slice applies only to the other, batch and idle policies\n");
+			return;
+		}
+	}
+
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, 0);
+	if (nice == -1 && errno)
+		errExit("getpriority");
+
+	SchedAttr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = (uint32_t) policy;
+	attr.sched_nice = nice;
+	attr.sched_runtime = (uint64_t) cfg.sched_slice * 1000;	// nanoseconds
+	if (syscall(SYS_sched_setattr, 0, &attr, 0) == -1)
+		fwarning("cannot set the scheduling policy: %s\n", strerror(errno));
+	else if (arg_debug)
+		printf("Scheduling policy set to %d, slice %u us\n", policy, cfg.sched_slice);
+}
+
+void set_sched(void) {
+	if (cfg.ioprio)
+		set_ioprio();
+	if (arg_sched || cfg.sched_slice)
+		set_policy();
+}
@@ -21,17 +21,147 @@
 #include "firejail.h"
 #include "../include/seccomp.h"
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <signal.h>
 
 typedef struct filter_list {
 	struct filter_list *next;
 	struct sock_fprog prog;
 	const char *fname;
+	int merged;		// already merged, from RUN_SECCOMP_STACK
 } FilterList;
 
 static FilterList *filter_list_head = NULL;
 static int err_printed = 0;
 
+// seccomp_prebuild_start(): the filters are built for the cache in a
+// separate process while the filesystem is set up, nothing is loaded there
+static int prebuild = 0;
+static pid_t prebuild_pid = 0;
+
+// fseccomp server: all the filters are built by a single fseccomp process
+// started on the first request and terminated by seccomp_server_close()
+static int server_enabled = 0;
+static pid_t server_pid = 0;
+static FILE *server_wfp = NULL;
+static FILE *server_rfp = NULL;
+
+void seccomp_server_open(void) {
+	server_enabled = checkcfg(CFG_SECCOMP_SERVER);
+}
+
+static void __attribute__((noreturn)) server_failed(void) {
+	// a server still running would wait for the next request forever
+	fclose(server_wfp);
+	fclose(server_rfp);
+
+	int status = 0;
+	if (waitpid(server_pid, &status, 0) == -1)
+		errExit("waitpid");
+	fprintf(stderr, "Error: failed to run %s: exit status %d, exiting...\n",
+		PATH_FSECCOMP, WEXITSTATUS(status));
+	exit(1);
+}
+
+void seccomp_server_close(void) {
+	server_enabled = 0;
+	if (!server_pid)
+		return;
+
+	// end of file on stdin terminates the server
+	fclose(server_wfp);
+	fclose(server_rfp);
+	server_wfp = NULL;
+	server_rfp = NULL;
+
+	int status;
+	if (waitpid(server_pid, &status, 0) == -1)
+		errExit("waitpid");
+	if (WIFSIGNALED(status) ||
+	   (WIFEXITED(status) && WEXITSTATUS(status) != 0)) {
+		fprintf(stderr, "Error: failed to run %s: exit status %d, exiting...\n",
+			PATH_FSECCOMP, WEXITSTATUS(status));
+		exit(1);
+	}
+	server_pid = 0;
+}
+
+static void server_request(char * const arg[]) {
+	if (!server_pid) {
+		char *server_arg[] = { PATH_FSECCOMP, "server", NULL };
+		int rfd, wfd;
+		server_pid = sbox_run_server(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, &rfd, &wfd, server_arg);
+		server_wfp = fdopen(wfd, "w");
+		server_rfp = fdopen(rfd, "r");
+		if (!server_wfp || !server_rfp)
+			errExit("fdopen");
+	}
+
+	if (arg_debug) {
+		printf("fseccomp server request:");
+		int i;
+		for (i = 1; arg[i]; i++)
+			printf(" %s", arg[i]);
+		printf("\n");
+	}
+
+	char *name;
+	if (asprintf(&name, "fseccomp %s", arg[1]) == -1)
+		errExit("asprintf");
+	sprof_begin(name);
+	free(name);
+
+	// a server gone away is detected when reading the reply; don't get killed by SIGPIPE
+	void (*old_handler)(int) = signal(SIGPIPE, SIG_IGN);
+	int i;
+	for (i = 1; arg[i]; i++)
+		fprintf(server_wfp, "%s%c", arg[i], (arg[i + 1]) ? '\t' : '\n');
+	fflush(server_wfp);
+	signal(SIGPIPE, old_handler);
+
+	// with --debug the sandbox setup messages of the server come first,
+	// they are passed on to stdout
+	char buf[16];
+	int line_start = 1;
+	while (1) {
+		if (!fgets(buf, sizeof(buf), server_rfp))
+			server_failed();
+		if (line_start && strcmp(buf, "ok\n") == 0)
+			break;
+		fputs(buf, stdout);
+		line_start = (buf[strlen(buf) - 1] == '\n');
+	}
+	sprof_end();
+}
+
+// run fseccomp as a regular user, in the server if available
+static int fseccomp_run(int num, ...) {
+	va_list valist;
+	va_start(valist, num);
+
+	char **arg = calloc(num + 2, sizeof(char *));
+	if (!arg)
+		errExit("calloc");
+	arg[0] = PATH_FSECCOMP;
+	int i;
+	for (i = 0; i < num; i++)
+		arg[i + 1] = va_arg(valist, char *);
+	arg[i + 1] = NULL;
+	va_end(valist);
+
+	int rv = 0;
+	if (server_enabled)
+		server_request(arg);
+	else
+		rv = sbox_run_v(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, arg);
+
+	free(arg);
+	return rv;
+}
+
 char *seccomp_check_list(const char *str) {
 	assert(str);
 	if (strlen(str) == 0) {
@@ -49,7 +179,9 @@ char *seccomp_check_list(const char *str) {
 	char *ptr2 = rv;
 	while (*ptr1 != '\0') {
 	if (isalnum(*ptr1) || *ptr1 == '_' || *ptr1 == ',' || *ptr1 == ':'
-				   || *ptr1 == '@' || *ptr1 == '-' || *ptr1 == '$' || *ptr1 == '!')
+				   || *ptr1 == '@' || *ptr1 == '-' || *ptr1 == '$' || *ptr1 == '!'
+				   // argument rules
+				   || *ptr1 == '&' || *ptr1 == '=' || *ptr1 == '<' || *ptr1 == '>')
 			*ptr2++ = *ptr1++;
 		else {
 			fprintf(stderr, "Error: invalid syscall list entry %s\n", str);
@@ -60,6 +192,248 @@ char *seccomp_check_list(const char *str) {
 	return rv;
 }
 
+// return the architecture if the filter starts with an architecture
+// check returning ALLOW for all the other architectures, 0 otherwise
+static uint32_t filter_arch(const struct sock_fprog *prog) {
+	const struct sock_filter *f = prog->filter;
+	if (prog->len > 3 &&
+	    f[0].code == BPF_LD + BPF_W + BPF_ABS && f[0].k == offsetof(struct seccomp_data, arch) &&
+	    f[1].code == BPF_JMP + BPF_JEQ + BPF_K && 2 + f[1].jf < prog->len &&
+	    f[2 + f[1].jf].code == BPF_RET + BPF_K && f[2 + f[1].jf].k == SECCOMP_RET_ALLOW)
+		return f[1].k;
+	return 0;
+}
+
+// Filters for different architectures never return anything but ALLOW
+// for the same syscall, so they can be chained in a single program: the
+// second filter is placed on the false branch of the architecture check of
+// the first one, and no syscall runs both.
+static struct sock_fprog filter_chain(const struct sock_fprog *first, const struct sock_fprog *second) {
+	struct sock_fprog prog;
+	prog.len = first->len + second->len + 1;
+	struct sock_filter *f = malloc(prog.len * sizeof(struct sock_filter));
+	if (!f)
+		errExit("malloc");
+	prog.filter = f;
+
+	// ld arch; jeq arch, 0, 1; ja first; second; first
+	const struct sock_filter *src = first->filter;
+	f[0] = src[0];
+	f[1] = src[1];
+	f[1].jt = 0;
+	f[1].jf = 1;
+	f[2].code = BPF_JMP + BPF_JA;
+	f[2].jt = f[2].jf = 0;
+	f[2].k = src[1].jt + second->len;
+	memcpy(f + 3, second->filter, second->len * sizeof(struct sock_filter));
+	memcpy(f + 3 + second->len, src + 2, (first->len - 2) * sizeof(struct sock_filter));
+	return prog;
+}
+
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#endif
+
+// the kernel returns the action with the lowest value, compared as signed
+static inline int32_t filter_action(uint32_t ret) {
+	return (int32_t) (ret & SECCOMP_RET_ACTION_FULL);
+}
+
+// filters loading the syscall data first and returning only constants
+static int filter_composable(const struct sock_fprog *prog) {
+	const struct sock_filter *f = prog->filter;
+	if (prog->len < 2 || f[0].code != BPF_LD + BPF_W + BPF_ABS)
+		return 0;
+	unsigned i;
+	for (i = 0; i < prog->len; i++) {
+		if (BPF_CLASS(f[i].code) == BPF_RET && BPF_RVAL(f[i].code) != BPF_K)
+			return 0;
+	}
+	return BPF_CLASS(f[prog->len - 1].code) == BPF_RET;
+}
+
+// Combine two filters for the same architecture, the second one installed
+// after the first one. The second filter runs first; every return value the
+// first filter can override is replaced with a jump to a copy of the first
+// filter, its return values resolved the way the kernel resolves the results
+// of stacked filters: lowest action wins, the newer filter wins ties.
+// Return 0 if the program would be too long.
+#define MAX_COMPOSE_COPIES 4
+static int filter_compose(const struct sock_fprog *first, const struct sock_fprog *second, struct sock_fprog *prog) {
+	// actions of the first filter
+	int32_t strongest = INT32_MAX;
+	unsigned i;
+	for (i = 0; i < first->len; i++) {
+		if (BPF_CLASS(first->filter[i].code) == BPF_RET &&
+		    filter_action(first->filter[i].k) < strongest)
+			strongest = filter_action(first->filter[i].k);
+	}
+
+	// return values of the second filter needing a copy of the first one
+	uint32_t val[MAX_COMPOSE_COPIES];
+	int cnt = 0;
+	for (i = 0; i < second->len; i++) {
+		const struct sock_filter *f = second->filter + i;
+		if (BPF_CLASS(f->code) != BPF_RET || strongest >= filter_action(f->k))
+			continue;
+		int j;
+		for (j = 0; j < cnt && val[j] != f->k; j++);
+		if (j < cnt)
+			continue;
+		if (cnt == MAX_COMPOSE_COPIES)
+			return 0;
+		val[cnt++] = f->k;
+	}
+
+	unsigned len = second->len + cnt * first->len;
+	if (len > BPF_MAXINSNS)
+		return 0;
+	struct sock_filter *out = malloc(len * sizeof(struct sock_filter));
+	if (!out)
+		errExit("malloc");
+	prog->filter = out;
+	prog->len = len;
+
+	memcpy(out, second->filter, second->len * sizeof(struct sock_filter));
+	for (i = 0; i < second->len; i++) {
+		struct sock_filter *f = out + i;
+		if (BPF_CLASS(f->code) != BPF_RET)
+			continue;
+		int j;
+		for (j = 0; j < cnt && val[j] != f->k; j++);
+		if (j == cnt)
+			continue;
+		f->code = BPF_JMP + BPF_JA;
+		f->k = second->len + j * first->len - i - 1;
+	}
+
+	int j;
+	for (j = 0; j < cnt; j++) {
+		struct sock_filter *copy = out + second->len + j * first->len;
+		memcpy(copy, first->filter, first->len * sizeof(struct sock_filter));
+		for (i = 0; i < first->len; i++) {
+			if (BPF_CLASS(copy[i].code) == BPF_RET &&
+			    filter_action(copy[i].k) >= filter_action(val[j]))
+				copy[i].k = val[j];
+		}
+	}
+	return 1;
+}
+
+// merge filters at the start of the list in a single program, return the
+// number of list elements merged in prog; filters that can't be merged
+// are installed separately
+#define MAX_MERGE 8
+static int filter_merge(FilterList *fl, struct sock_fprog *prog) {
+	*prog = fl->prog;
+	if (!filter_composable(prog))
+		return 1;
+
+	// architectures in prog while it is a chain of filter_chain() calls
+	uint32_t arch[MAX_MERGE];
+	int arch_cnt = 0;
+	uint32_t a = filter_arch(prog);
+	if (a)
+		arch[arch_cnt++] = a;
+
+	int cnt = 1;
+	FilterList *ptr;
+	for (ptr = fl->next; ptr && cnt < MAX_MERGE; ptr = ptr->next, cnt++) {
+		if (!filter_composable(&ptr->prog))
+			break;
+
+		struct sock_fprog tmp;
+		a = filter_arch(&ptr->prog);
+		int i;
+		for (i = 0; i < arch_cnt && arch[i] != a; i++);
+		if (a && arch_cnt && i == arch_cnt && prog->len + ptr->prog.len + 1 <= BPF_MAXINSNS) {
+			// the new filter allows the architectures already in prog
+			// and the other way around
+			tmp = filter_chain(&ptr->prog, prog);
+			arch[arch_cnt++] = a;
+		}
+		else if (filter_compose(prog, &ptr->prog, &tmp))
+			arch_cnt = 0;
+		else
+			break;
+
+		if (cnt > 1)
+			free(prog->filter);
+		*prog = tmp;
+	}
+
+	if (cnt > 1 && arg_debug)
+		printf("Merging %d seccomp filters in a single program\n", cnt);
+	return cnt;
+}
+
+// SECCOMP_FILTER_FLAG_SPEC_ALLOW and SECCOMP_FILTER_FLAG_TSYNC for the
+// sandbox; when joining, they are read from RUN_SECCOMP_FLAGS
+static int sandbox_flags = -1;
+
+static unsigned get_sandbox_flags(void) {
+	if (sandbox_flags == -1) {
+		sandbox_flags = 0;
+		if (arg_seccomp_spec_allow)
+			sandbox_flags |= SECCOMP_FILTER_FLAG_SPEC_ALLOW;
+		if (arg_seccomp_tsync)
+			sandbox_flags |= SECCOMP_FILTER_FLAG_TSYNC;
+	}
+	return sandbox_flags;
+}
+
+void seccomp_save_flags(void) {
+	unsigned flags = get_sandbox_flags();
+	if (flags == 0)
+		return;
+
+	// the post-exec library reads the file as a regular user
+	FILE *fp = fopen(RUN_SECCOMP_FLAGS, "wxe");
+	if (!fp)
+		errExit("fopen");
+	fprintf(fp, "%u\n", flags);
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+}
+
+static void seccomp_load_flags(void) {
+	sandbox_flags = 0;
+	FILE *fp = fopen(RUN_SECCOMP_FLAGS, "re");
+	if (!fp)
+		return;
+	unsigned flags;
+	if (fscanf(fp, "%u", &flags) == 1)
+		sandbox_flags = flags & (SECCOMP_FILTER_FLAG_SPEC_ALLOW | SECCOMP_FILTER_FLAG_TSYNC);
+	fclose(fp);
+}
+
+static int install_prog(struct sock_fprog *prog) {
+	unsigned flags = get_sandbox_flags();
+#ifdef SECCOMP_FILTER_FLAG_LOG
+	if (checkcfg(CFG_SECCOMP_LOG))
+		flags |= SECCOMP_FILTER_FLAG_LOG;
+#endif
+	if (flags == 0)
+		return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, prog);
+
+	int rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, prog);
+	if (rv == -1 && errno == EINVAL && (flags & SECCOMP_FILTER_FLAG_SPEC_ALLOW)) {
+		// SECCOMP_FILTER_FLAG_SPEC_ALLOW requires Linux 4.17
+		fwarning("cannot disable the Speculative Store Bypass mitigation for seccomp filters, "
+			 "it requires a Linux kernel version 4.17 or newer\n");
+		sandbox_flags &= ~SECCOMP_FILTER_FLAG_SPEC_ALLOW;
+		flags &= ~SECCOMP_FILTER_FLAG_SPEC_ALLOW;
+		rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, prog);
+	}
+	if (rv > 0) {
+		// SECCOMP_FILTER_FLAG_TSYNC: thread rv could not be synchronized,
+		// install the filter for this thread only
+		fwarning("cannot synchronize the seccomp filter with thread %d\n", rv);
+		rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags & ~SECCOMP_FILTER_FLAG_TSYNC, prog);
+	}
+	return rv;
+}
+
 // install seccomp filters
 int seccomp_install_filters(void) {
 	int r = 0;
@@ -67,19 +441,26 @@ int seccomp_install_filters(void) {
 	if (fl) {
 		prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
 
-		for (; fl; fl = fl->next) {
-			assert(fl->fname);
-			if (arg_debug)
-				printf("Installing %s seccomp filter\n", fl->fname);
-			int rv = 0;
-#ifdef SECCOMP_FILTER_FLAG_LOG
-			if (checkcfg(CFG_SECCOMP_LOG))
-				rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_LOG, &fl->prog);
-			else
-				rv = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &fl->prog);
-#else
-			rv = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &fl->prog);
-#endif
+		while (fl) {
+			struct sock_fprog prog = fl->prog;
+			int cnt = (fl->merged) ? 1 : filter_merge(fl, &prog);
+			FilterList *ptr = fl;
+			int i;
+			for (i = 0; i < cnt; i++, fl = fl->next) {
+				assert(fl->fname);
+				if (arg_debug)
+					printf("Installing %s seccomp filter\n", fl->fname);
+			}
+
+			int rv = install_prog(&prog);
+			if (rv == -1 && cnt > 1) {
+				// fall back to stacking the filters
+				if (arg_debug)
+					printf("Cannot install the merged seccomp filter, installing %d filters\n", cnt);
+				free(prog.filter);
+				for (i = 0, rv = 0; i < cnt && rv == 0; i++, ptr = ptr->next)
+					rv = install_prog(&ptr->prog);
+			}
 
 			if (rv == -1) {
 				if (!err_printed)
@@ -89,6 +470,9 @@ int seccomp_install_filters(void) {
 			}
 		}
 	}
+
+	// the supervisor filter needs its own listener, it is never merged
+	seccomp_notify_install(get_sandbox_flags() & SECCOMP_FILTER_FLAG_SPEC_ALLOW);
 	return r;
 }
 
@@ -105,14 +489,127 @@ static void seccomp_save_file_list(const char *fname) {
 	(void) rv;
 }
 
+#define SECCOMP_STACK_MAGIC 0x46535431	// "FST1"
+
+// the filters merged as they are installed in the sandbox, for --join:
+// magic, sandbox flags, number of programs, and for every program the number
+// of instructions followed by the instructions
+void seccomp_save_stack(void) {
+	if (!filter_list_head)
+		return;
+
+	FILE *fp = fopen(RUN_SECCOMP_STACK, "wxe");
+	if (!fp)
+		errExit("fopen");
+	uint32_t hdr[3] = { SECCOMP_STACK_MAGIC, get_sandbox_flags(), 0 };
+	if (fwrite(hdr, sizeof(hdr), 1, fp) != 1)
+		errExit("fwrite");
+
+	FilterList *fl = filter_list_head;
+	while (fl) {
+		struct sock_fprog prog;
+		int cnt = filter_merge(fl, &prog);
+		uint32_t len = prog.len;
+		if (fwrite(&len, sizeof(len), 1, fp) != 1 ||
+		    fwrite(prog.filter, sizeof(struct sock_filter), prog.len, fp) != prog.len)
+			errExit("fwrite");
+		if (cnt > 1)
+			free(prog.filter);
+		hdr[2]++;
+		while (cnt--)
+			fl = fl->next;
+	}
+
+	rewind(fp);
+	if (fwrite(hdr, sizeof(hdr), 1, fp) != 1)
+		errExit("fwrite");
+	SET_PERMS_STREAM(fp, 0, 0, 0644);
+	fclose(fp);
+}
+
+// load the filters from RUN_SECCOMP_STACK with a single read()
+// return -1 if the file is not available, the sandbox was started by an older version
+static int seccomp_load_stack(void) {
+	int fd = open(RUN_SECCOMP_STACK, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	struct stat s;
+	if (fstat(fd, &s) == -1)
+		errExit("fstat");
+	if (!S_ISREG(s.st_mode) || s.st_uid != 0 || s.st_size < 3 * (off_t) sizeof(uint32_t) ||
+	    s.st_size > 64 * 1024 * 1024) {
+		close(fd);
+		return -1;
+	}
+
+	char *buf = malloc(s.st_size);
+	if (!buf)
+		errExit("malloc");
+	ssize_t len = read(fd, buf, s.st_size);
+	close(fd);
+	if (len != s.st_size)
+		goto errout;
+
+	uint32_t hdr[3];
+	memcpy(hdr, buf, sizeof(hdr));
+	if (hdr[0] != SECCOMP_STACK_MAGIC)
+		goto errout;
+
+	// the programs are installed in the order they are stored
+	FilterList *head = NULL;
+	FilterList **tail = &head;
+	size_t off = sizeof(hdr);
+	uint32_t i;
+	for (i = 0; i < hdr[2]; i++) {
+		uint32_t entries;
+		if (off + sizeof(entries) > (size_t) len)
+			goto errout;
+		memcpy(&entries, buf + off, sizeof(entries));
+		off += sizeof(entries);
+		if (entries == 0 || entries > BPF_MAXINSNS ||
+		    off + entries * sizeof(struct sock_filter) > (size_t) len)
+			goto errout;
+
+		FilterList *fl = malloc(sizeof(FilterList));
+		if (!fl)
+			errExit("malloc");
+		fl->next = NULL;
+		fl->prog.len = entries;
+		fl->prog.filter = (struct sock_filter *) (buf + off);
+		fl->fname = RUN_SECCOMP_STACK;
+		fl->merged = 1;
+		*tail = fl;
+		tail = &fl->next;
+		off += entries * sizeof(struct sock_filter);
+	}
+	if (off != (size_t) len)
+		goto errout;
+
+	if (arg_debug)
+		printf("Loaded %u seccomp programs from %s\n", hdr[2], RUN_SECCOMP_STACK);
+	*tail = filter_list_head;
+	filter_list_head = head;
+	sandbox_flags = hdr[1] & (SECCOMP_FILTER_FLAG_SPEC_ALLOW | SECCOMP_FILTER_FLAG_TSYNC);
+	return 0;
+
+errout:
+	fprintf(stderr, "Error: invalid %s\n", RUN_SECCOMP_STACK);
+	exit(1);
+}
+
 #define MAXBUF 4096
 static int load_file_list_flag = 0;
 void seccomp_load_file_list(void) {
+	// the filters of the sandbox, already merged
+	if (seccomp_load_stack() == 0)
+		return;
+
 	FILE *fp = fopen(RUN_SECCOMP_LIST, "re");
 	if (!fp)
 		return; // no seccomp configuration whatsoever
 
 	load_file_list_flag = 1;
+	seccomp_load_flags();
 	char buf[MAXBUF];
 	while (fgets(buf, MAXBUF, fp)) {
 		// clean '\n'
@@ -129,6 +626,8 @@ void seccomp_load_file_list(void) {
 
 int seccomp_load(const char *fname) {
 	assert(fname);
+	if (prebuild)
+		return 0;
 
 	// open filter file
 	int fd = open(fname, O_RDONLY|O_CLOEXEC);
@@ -159,6 +658,7 @@ int seccomp_load(const char *fname) {
 	fl->next = filter_list_head;
 	fl->prog.len = entries;
 	fl->prog.filter = filter;
+	fl->merged = 0;
 	fl->fname = strdup(fname);
 	if (fl->fname == NULL)
 		errExit("strdup");
@@ -199,7 +699,7 @@ static void seccomp_filter_block_secondary(void) {
 }
 
 // drop filter for seccomp option
-int seccomp_filter_drop(bool native) {
+static int seccomp_filter_drop(bool native) {
 	const char *filter, *postexec_filter;
 
 	if (native) {
@@ -216,9 +716,9 @@ int seccomp_filter_drop(bool native) {
 	//	- seccomp list
 	//	- seccomp
 	if (cfg.seccomp_list_drop == NULL) {
-		// default seccomp if error action is not changed
+		// default seccomp if error action and hot syscalls are not changed
 		if ((cfg.seccomp_list == NULL || cfg.seccomp_list[0] == '\0')
-		    && arg_seccomp_error_action == DEFAULT_SECCOMP_ERROR_ACTION) {
+		    && arg_seccomp_error_action == DEFAULT_SECCOMP_ERROR_ACTION && cfg.seccomp_hot == NULL) {
 			if (arg_seccomp_block_secondary)
 				seccomp_filter_block_secondary();
 			else {
@@ -235,32 +735,37 @@ int seccomp_filter_drop(bool native) {
 
 			if (arg_seccomp_block_secondary) {
 				if (arg_seccomp_error_action != DEFAULT_SECCOMP_ERROR_ACTION) {
-					if (arg_debug)
-						printf("Rebuild secondary block seccomp filter\n");
-					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 4,
-						      PATH_FSECCOMP, "secondary", "block", RUN_SECCOMP_BLOCK_SECONDARY);
-					if (rv)
-						exit(rv);
+					char *spec = seccomp_cache_spec("secondary block", NULL);
+					if (!seccomp_cache_fetch(spec, RUN_SECCOMP_BLOCK_SECONDARY, NULL)) {
+						if (arg_debug)
+							printf("Rebuild secondary block seccomp filter\n");
+						rv = fseccomp_run(3, "secondary", "block", RUN_SECCOMP_BLOCK_SECONDARY);
+						if (rv)
+							exit(rv);
+						seccomp_cache_store(spec, RUN_SECCOMP_BLOCK_SECONDARY, NULL);
+					}
+					free(spec);
 				}
 				seccomp_filter_block_secondary();
 			} else {
 #if defined(__x86_64__)
 #if defined(__LP64__)
 				if (arg_seccomp_error_action != DEFAULT_SECCOMP_ERROR_ACTION) {
-					if (arg_debug)
-						printf("Rebuild 32 bit seccomp filter\n");
-					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 4,
-						      PATH_FSECCOMP, "secondary", "32", RUN_SECCOMP_32);
-					if (rv)
-						exit(rv);
+					char *spec = seccomp_cache_spec("secondary 32", NULL);
+					if (!seccomp_cache_fetch(spec, RUN_SECCOMP_32, NULL)) {
+						if (arg_debug)
+							printf("Rebuild 32 bit seccomp filter\n");
+						rv = fseccomp_run(3, "secondary", "32", RUN_SECCOMP_32);
+						if (rv)
+							exit(rv);
+						seccomp_cache_store(spec, RUN_SECCOMP_32, NULL);
+					}
+					free(spec);
 				}
 				seccomp_filter_32();
 #endif
 #endif
 			}
-			if (arg_debug)
-				printf("Build default+drop seccomp filter\n");
-
 			const char *command, *list;
 			if (native) {
 				command = "default";
@@ -270,21 +775,25 @@ int seccomp_filter_drop(bool native) {
 				list = cfg.seccomp_list32;
 			}
 
+			char *spec = seccomp_cache_spec(command, list);
+			if (seccomp_store_fetch(command, list, filter, postexec_filter) ||
+			    seccomp_cache_fetch(spec, filter, postexec_filter))
+				goto load_filter;
+
+			if (arg_debug)
+				printf("Build default+drop seccomp filter\n");
+
 			// build the seccomp filter as a regular user
 			if (list && list[0])
 				if (arg_allow_debuggers)
-					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 7,
-						      PATH_FSECCOMP, command, "drop", filter, postexec_filter, list, "allow-debuggers");
+					rv = fseccomp_run(6, command, "drop", filter, postexec_filter, list, "allow-debuggers");
 				else
-					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 6,
-						      PATH_FSECCOMP, command, "drop", filter, postexec_filter, list);
+					rv = fseccomp_run(5, command, "drop", filter, postexec_filter, list);
 			else
 				if (arg_allow_debuggers)
-					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 4,
-						      PATH_FSECCOMP, command, filter, "allow-debuggers");
+					rv = fseccomp_run(3, command, filter, "allow-debuggers");
 				else
-					rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 3,
-						      PATH_FSECCOMP, command, filter);
+					rv = fseccomp_run(2, command, filter);
 
 			if (rv)
 				exit(rv);
@@ -293,6 +802,10 @@ int seccomp_filter_drop(bool native) {
 			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, filter);
 			if (rv)
 				exit(rv);
+
+			seccomp_cache_store(spec, filter, postexec_filter);
+load_filter:
+			free(spec);
 		}
 	}
 
@@ -301,8 +814,6 @@ int seccomp_filter_drop(bool native) {
 	else { // cfg.seccomp_list_drop != NULL
 		if (arg_seccomp_block_secondary)
 			seccomp_filter_block_secondary();
-		if (arg_debug)
-			printf("Build drop seccomp filter\n");
 
 		const char *command, *list;
 		if (native) {
@@ -313,14 +824,22 @@ int seccomp_filter_drop(bool native) {
 			list = cfg.seccomp_list_drop32;
 		}
 
+		char *spec = seccomp_cache_spec(command, list);
+		if (seccomp_store_fetch(command, list, filter, postexec_filter) ||
+		    seccomp_cache_fetch(spec, filter, postexec_filter)) {
+			free(spec);
+			goto load_drop_filter;
+		}
+
+		if (arg_debug)
+			printf("Build drop seccomp filter\n");
+
 		// build the seccomp filter as a regular user
 		int rv;
 		if (arg_allow_debuggers)
-			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 6,
-				      PATH_FSECCOMP, command, filter, postexec_filter, list,  "allow-debuggers");
+			rv = fseccomp_run(5, command, filter, postexec_filter, list, "allow-debuggers");
 		else
-			rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
-				      PATH_FSECCOMP, command, filter, postexec_filter, list);
+			rv = fseccomp_run(4, command, filter, postexec_filter, list);
 
 		if (rv)
 			exit(rv);
@@ -329,15 +848,19 @@ int seccomp_filter_drop(bool native) {
 		rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, filter);
 		if (rv)
 			exit(rv);
+
+		seccomp_cache_store(spec, filter, postexec_filter);
+		free(spec);
 	}
 
+load_drop_filter:
 	// load the filter
 	if (seccomp_load(filter) == 0) {
 		if (arg_debug)
 			printf("seccomp filter configured\n");
 	}
 
-	if (arg_debug && access(PATH_FSEC_PRINT, X_OK) == 0) {
+	if (arg_debug && !prebuild && access(PATH_FSEC_PRINT, X_OK) == 0) {
 		struct stat st;
 		if (stat(postexec_filter, &st) != -1 && st.st_size != 0) {
 			printf("configuring postexec seccomp filter in %s\n", postexec_filter);
@@ -350,7 +873,7 @@ int seccomp_filter_drop(bool native) {
 }
 
 // keep filter for seccomp option
-int seccomp_filter_keep(bool native) {
+static int seccomp_filter_keep(bool native) {
 	// secondary filters are not installed except when secondary
 	// architectures are explicitly blocked
 	if (arg_seccomp_block_secondary)
@@ -371,13 +894,25 @@ int seccomp_filter_keep(bool native) {
 	}
 
 	// build the seccomp filter as a regular user
-	int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
-		 PATH_FSECCOMP, "keep", filter, postexec_filter, list);
+	const char *command = (native) ? "keep" : "keep32";
+	char *spec = seccomp_cache_spec(command, list);
+	if (!seccomp_store_fetch(command, list, filter, postexec_filter) &&
+	    !seccomp_cache_fetch(spec, filter, postexec_filter)) {
+		int rv = fseccomp_run(4, "keep", filter, postexec_filter, list);
+
+		if (rv) {
+			fprintf(stderr, "Error: cannot configure seccomp filter\n");
+			exit(rv);
+		}
+
+		// optimize the keep filter
+		rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 2, PATH_FSEC_OPTIMIZE, filter);
+		if (rv)
+			exit(rv);
 
-	if (rv) {
-		fprintf(stderr, "Error: cannot configure seccomp filter\n");
-		exit(rv);
+		seccomp_cache_store(spec, filter, postexec_filter);
 	}
+	free(spec);
 
 	if (arg_debug)
 		printf("seccomp filter configured\n");
@@ -388,7 +923,7 @@ int seccomp_filter_keep(bool native) {
 			printf("seccomp filter configured\n");
 	}
 
-	if (arg_debug && access(PATH_FSEC_PRINT, X_OK) == 0) {
+	if (arg_debug && !prebuild && access(PATH_FSEC_PRINT, X_OK) == 0) {
 		struct stat st;
 		if (stat(postexec_filter, &st) != -1 && st.st_size != 0) {
 			printf("configuring postexec seccomp filter in %s\n", postexec_filter);
@@ -401,7 +936,7 @@ int seccomp_filter_keep(bool native) {
 }
 
 // create mdwx filter for non-default error action
-int seccomp_filter_mdwx(bool native) {
+static int seccomp_filter_mdwx(bool native) {
 	if (arg_debug)
 		printf("Build memory-deny-write-execute filter\n");
 
@@ -415,13 +950,17 @@ int seccomp_filter_mdwx(bool native) {
 	}
 
 	// build the seccomp filter as a regular user
-	int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 3,
-		PATH_FSECCOMP, command, filter);
+	char *spec = seccomp_cache_spec(command, NULL);
+	if (!seccomp_cache_fetch(spec, filter, NULL)) {
+		int rv = fseccomp_run(2, command, filter);
 
-	if (rv) {
-		fprintf(stderr, "Error: cannot build memory-deny-write-execute filter\n");
-		exit(rv);
+		if (rv) {
+			fprintf(stderr, "Error: cannot build memory-deny-write-execute filter\n");
+			exit(rv);
+		}
+		seccomp_cache_store(spec, filter, NULL);
 	}
+	free(spec);
 
 	if (arg_debug)
 		printf("Memory-deny-write-execute filter configured\n");
@@ -430,7 +969,7 @@ int seccomp_filter_mdwx(bool native) {
 }
 
 // create namespaces filter
-int seccomp_filter_namespaces(bool native, const char *list) {
+static int seccomp_filter_namespaces(bool native, const char *list) {
 	if (arg_debug)
 		printf("Build restrict-namespaces filter\n");
 
@@ -444,13 +983,17 @@ int seccomp_filter_namespaces(bool native, const char *list) {
 	}
 
 	// build the seccomp filter as a regular user
-	int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 4,
-		PATH_FSECCOMP, command, filter, list);
+	char *spec = seccomp_cache_spec(command, list);
+	if (!seccomp_cache_fetch(spec, filter, NULL)) {
+		int rv = fseccomp_run(3, command, filter, list);
 
-	if (rv) {
-		fprintf(stderr, "Error: cannot build restrict-namespaces filter\n");
-		exit(rv);
+		if (rv) {
+			fprintf(stderr, "Error: cannot build restrict-namespaces filter\n");
+			exit(rv);
+		}
+		seccomp_cache_store(spec, filter, NULL);
 	}
+	free(spec);
 
 	if (arg_debug)
 		printf("restrict-namespaces filter configured\n");
@@ -458,7 +1001,131 @@ int seccomp_filter_namespaces(bool native, const char *list) {
 	return 0;
 }
 
-void seccomp_print_filter(pid_t pid) {
+#ifdef SYS_socket
+static void seccomp_filter_protocol(void) {
+	if (arg_debug)
+		printf("Build protocol filter: %s\n", cfg.protocol);
+
+	// build the seccomp filter as a regular user
+	sprof_begin("protocol filter");
+	char *spec = seccomp_cache_spec("protocol", cfg.protocol);
+	if (!seccomp_cache_fetch(spec, RUN_SECCOMP_PROTOCOL, NULL)) {
+		int rv = sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 5,
+			PATH_FSECCOMP, "protocol", "build", cfg.protocol, RUN_SECCOMP_PROTOCOL);
+		if (rv)
+			exit(rv);
+		seccomp_cache_store(spec, RUN_SECCOMP_PROTOCOL, NULL);
+	}
+	free(spec);
+	sprof_end();
+}
+#endif
+
+// build the filters of the sandbox, or fetch them from the cache, and load them
+void seccomp_configure(void) {
+	// install protocol filter
+#ifdef SYS_socket
+	if (cfg.protocol) {
+		seccomp_filter_protocol();
+		if (arg_debug)
+			printf("Install protocol filter: %s\n", cfg.protocol);
+		seccomp_load(RUN_SECCOMP_PROTOCOL);	// install filter
+	}
+#endif
+
+	// if a keep list is available, disregard the drop list
+	if (arg_seccomp == 1) {
+		if (cfg.seccomp_list_keep)
+			seccomp_filter_keep(true);
+		else
+			seccomp_filter_drop(true);
+	}
+	if (arg_seccomp32 == 1) {
+		if (cfg.seccomp_list_keep32)
+			seccomp_filter_keep(false);
+		else
+			seccomp_filter_drop(false);
+
+	}
+
+	if (arg_memory_deny_write_execute) {
+		if (arg_seccomp_error_action != EPERM) {
+			seccomp_filter_mdwx(true);
+			seccomp_filter_mdwx(false);
+		}
+		if (arg_debug)
+			printf("Install memory write&execute filter\n");
+		seccomp_load(RUN_SECCOMP_MDWX);	// install filter
+		seccomp_load(RUN_SECCOMP_MDWX_32);
+	}
+
+	if (arg_restrict_namespaces) {
+		if (arg_seccomp_error_action != EPERM) {
+			seccomp_filter_namespaces(true, cfg.restrict_namespaces);
+			seccomp_filter_namespaces(false, cfg.restrict_namespaces);
+		}
+
+		if (arg_debug)
+			printf("Install namespaces filter\n");
+		seccomp_load(RUN_SECCOMP_NS);	// install filter
+		seccomp_load(RUN_SECCOMP_NS_32);
+
+	}
+	else if (cfg.restrict_namespaces) {
+		seccomp_filter_namespaces(true, cfg.restrict_namespaces);
+		seccomp_filter_namespaces(false, cfg.restrict_namespaces);
+
+		if (arg_debug)
+			printf("Install namespaces filter\n");
+		seccomp_load(RUN_SECCOMP_NS);	// install filter
+		seccomp_load(RUN_SECCOMP_NS_32);
+	}
+}
+
+// Start building the filters in a separate process, right after the mount
+// namespace is set up. The results go in the filter cache, seccomp_configure()
+// in the sandbox finds them there once the filesystem is done. A build failing
+// in this process is only a cache miss, the output is discarded.
+void seccomp_prebuild_start(void) {
+	if (!seccomp_cache_enabled() || cfg.chrootdir)
+		return;
+	if (!arg_seccomp && !arg_seccomp32 && !cfg.protocol &&
+	    !arg_memory_deny_write_execute && !arg_restrict_namespaces && !cfg.restrict_namespaces)
+		return;
+
+	int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+	pid_t pid = fork();
+	if (pid == -1)
+		errExit("fork");
+	if (pid == 0) {
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		sprof_thread(SPROF_TID_SECCOMP, "seccomp prebuild");
+		prebuild = 1;
+		seccomp_server_open();
+		seccomp_configure();
+		seccomp_server_close();
+		_exit(0);
+	}
+	close(fd);
+	prebuild_pid = pid;
+}
+
+void seccomp_prebuild_wait(void) {
+	if (!prebuild_pid)
+		return;
+
+	int status = 0;
+	pid_t rv = waitpid(prebuild_pid, &status, 0);
+	prebuild_pid = 0;
+	if (arg_debug)
+		printf("Seccomp filter prebuild %s\n",
+		       (rv != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "done" : "failed");
+}
+
+void seccomp_print_filter(pid_t pid, int summary, int jsonl) {
 	EUID_ASSERT();
 
 	ProcessHandle sandbox = pin_sandbox_process(pid);
@@ -483,19 +1150,35 @@ void seccomp_print_filter(pid_t pid) {
 		if (ptr)
 			*ptr = '\0';
 
-		printf("FILE: %s\n", buf); fflush(0);
+		// in jsonl mode the file name is printed by fsec-print
+		if (!jsonl) {
+			printf("FILE: %s\n", buf);
+			fflush(0);
+		}
 
 		// read and print the filter
 		pid_t child = fork();
 		if (child < 0)
 			errExit("fork");
 		if (child == 0) {
-			execl(PATH_FSEC_PRINT, PATH_FSEC_PRINT, buf, NULL);
-			errExit("execl");
+			const char *args[5];
+			int cnt = 0;
+			args[cnt++] = PATH_FSEC_PRINT;
+			if (summary)
+				args[cnt++] = "--summary";
+			if (jsonl)
+				args[cnt++] = "--format=jsonl";
+			args[cnt++] = buf;
+			args[cnt] = NULL;
+			execv(PATH_FSEC_PRINT, (char **) args);
+			errExit("execv");
 		}
 		waitpid(child, NULL, 0);
 
-		printf("\n"); fflush(0);
+		if (!jsonl) {
+			printf("\n");
+			fflush(0);
+		}
 	}
 	fclose(fp);
 
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --seccomp.audit=name|pid: the AUDIT_SECCOMP records of a sandbox, read
+// live from the audit multicast group (CAP_AUDIT_READ is needed only to
+// bind the socket). The kernel logs the syscalls stopped by a filter with
+// the log and kill actions, see --seccomp-error-action; the syscalls
+// returning an errno are not logged. A process belongs to the sandbox if
+// it runs in the sandbox pid namespace. The violations are counted by
+// syscall, a new syscall is printed as soon as it shows up, and the full
+// list is printed when the sandbox exits or on Ctrl-C.
+
+#include "firejail.h"
+#include "../include/seccomp.h"
+#include "../include/syscall.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/audit.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+
+#ifndef AUDIT_NLGRP_READLOG
+#define AUDIT_NLGRP_READLOG 1
+#endif
+#ifndef AUDIT_SECCOMP
+#define AUDIT_SECCOMP 1326
+#endif
+
+#define AUDIT_BUFSIZE (64 * 1024)
+#define AUDIT_RCVBUF (4 * 1024 * 1024)
+#define PID_CACHE 64		// pids already checked
+
+typedef struct {
+	int nr;
+	int compat;		// 32-bit syscall on a 64-bit kernel
+	unsigned long long cnt;
+	char comm[16];		// first process
+} Violation;
+
+static Violation *violation = NULL;
+static int violation_cnt = 0;
+static int violation_max = 0;
+
+typedef struct {
+	pid_t pid;
+	int member;
+} PidCheck;
+
+static PidCheck pid_cache[PID_CACHE];
+static int pid_cache_next = 0;
+static dev_t ns_dev;
+static ino_t ns_ino;
+
+static volatile sig_atomic_t audit_exit = 0;
+
+static void audit_signal(int sig) {
+	(void) sig;
+	audit_exit = 1;
+}
+
+static const char *violation_name(const Violation *v, char *buf, size_t len) {
+	const char *name = (v->compat) ? syscall_find_nr_32(v->nr) : syscall_find_nr(v->nr);
+	if (name)
+		snprintf(buf, len, "%s%s", name, (v->compat) ? " (32-bit)" : "");
+	else
+		snprintf(buf, len, "%d%s", v->nr, (v->compat) ? " (32-bit)" : "");
+	return buf;
+}
+
+// the processes that exited before the record was read are not found, the
+// last results are cached for the bursts coming from the same process
+static int pid_in_sandbox(pid_t pid) {
+	int i;
+	for (i = 0; i < PID_CACHE; i++) {
+		if (pid_cache[i].pid == pid)
+			return pid_cache[i].member;
+	}
+
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/ns/pid", pid) == -1)
+		errExit("asprintf");
+	struct stat s;
+	EUID_ROOT();
+	int rv = stat(fname, &s);
+	EUID_USER();
+	free(fname);
+	int member = (rv == 0 && s.st_dev == ns_dev && s.st_ino == ns_ino);
+	if (rv == 0) {
+		pid_cache[pid_cache_next].pid = pid;
+		pid_cache[pid_cache_next].member = member;
+		pid_cache_next = (pid_cache_next + 1) % PID_CACHE;
+	}
+	return member;
+}
+
+// value of a key=value field in the record; the keys are preceded by a space
+static const char *audit_field(const char *msg, const char *key) {
+	size_t len = strlen(key);
+	const char *ptr = msg;
+	while ((ptr = strstr(ptr, key)) != NULL) {
+		if (ptr > msg && ptr[-1] == ' ' && ptr[len] == '=')
+			return ptr + len + 1;
+		ptr += len;
+	}
+	return NULL;
+}
+
+// comm="name", or hex encoded if the name has special characters
+static void audit_comm(const char *msg, char *comm, size_t len) {
+	*comm = '\0';
+	const char *ptr = audit_field(msg, "comm");
+	if (!ptr)
+		return;
+	size_t i = 0;
+	if (*ptr == '"') {
+		ptr++;
+		while (*ptr && *ptr != '"' && i < len - 1)
+			comm[i++] = *ptr++;
+	}
+	else {
+		unsigned c;
+		while (i < len - 1 && sscanf(ptr, "%2x", &c) == 1 && ptr[1]) {
+			comm[i++] = (c >= 0x20 && c < 0x7f) ? (char) c : '?';
+			ptr += 2;
+			if (*ptr == ' ' || *ptr == '\0')
+				break;
+		}
+	}
+	comm[i] = '\0';
+}
+
+static void audit_record(const char *msg) {
+	const char *ptr = audit_field(msg, "pid");
+	if (!ptr)
+		return;
+	pid_t pid = (pid_t) strtol(ptr, NULL, 10);
+	if (pid <= 0 || !pid_in_sandbox(pid))
+		return;
+
+	ptr = audit_field(msg, "syscall");
+	if (!ptr)
+		return;
+	int nr = (int) strtol(ptr, NULL, 10);
+	int compat = 0;
+	ptr = audit_field(msg, "compat");
+	if (ptr)
+		compat = (*ptr == '1');
+	else if ((ptr = audit_field(msg, "arch")) != NULL)
+		compat = (strtoul(ptr, NULL, 16) != ARCH_NR);
+
+	int i;
+	for (i = 0; i < violation_cnt; i++) {
+		if (violation[i].nr == nr && violation[i].compat == compat) {
+			violation[i].cnt++;
+			return;
+		}
+	}
+
+	// a new syscall
+	if (violation_cnt == violation_max) {
+		violation_max = (violation_max) ? violation_max * 2 : 32;
+		violation = realloc(violation, violation_max * sizeof(Violation));
+		if (!violation)
+			errExit("realloc");
+	}
+	Violation *v = &violation[violation_cnt++];
+	v->nr = nr;
+	v->compat = compat;
+	v->cnt = 1;
+	audit_comm(msg, v->comm, sizeof(v->comm));
+
+	char name[64];
+	printf("%s, pid %d (%s)\n", violation_name(v, name, sizeof(name)), pid, v->comm);
+	fflush(0);
+}
+
+static int violation_cmp(const void *a, const void *b) {
+	const Violation *v1 = a;
+	const Violation *v2 = b;
+	if (v1->cnt != v2->cnt)
+		return (v1->cnt < v2->cnt) ? 1 : -1;
+	return v1->nr - v2->nr;
+}
+
+static void audit_summary(void) {
+	if (violation_cnt == 0) {
+		printf("\nNo seccomp violations\n");
+		return;
+	}
+
+	qsort(violation, violation_cnt, sizeof(Violation), violation_cmp);
+	printf("\n%12s  %-28s %s\n", "count", "syscall", "first process");
+	int i;
+	for (i = 0; i < violation_cnt; i++) {
+		char name[64];
+		printf("%12llu  %-28s %s\n", violation[i].cnt,
+		       violation_name(&violation[i], name, sizeof(name)), violation[i].comm);
+	}
+}
+
+static int audit_open(void) {
+	EUID_ROOT();
+	int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_AUDIT);
+	if (sock == -1) {
+		fprintf(stderr, "Error: cannot open the audit socket: %s\n", strerror(errno));
+		exit(1);
+	}
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1 << (AUDIT_NLGRP_READLOG - 1);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error: cannot subscribe to the audit log: %s\n", strerror(errno));
+		exit(1);
+	}
+	int bsize = AUDIT_RCVBUF;
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bsize, sizeof(bsize)) == -1)
+		fwarning("cannot set rx buffer size\n");
+	EUID_USER();
+	return sock;
+}
+
+void seccomp_audit(pid_t pid) {
+	EUID_ASSERT();
+
+	ProcessHandle sandbox = pin_sandbox_process(pid);
+	struct stat s;
+	process_stat(sandbox, "ns/pid", &s);
+	ns_dev = s.st_dev;
+	ns_ino = s.st_ino;
+
+	int sock = audit_open();
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = audit_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("Reading the seccomp audit records of sandbox %d, press Ctrl-C to stop\n", pid);
+	fflush(0);
+
+	char *buf = malloc(AUDIT_BUFSIZE);
+	if (!buf)
+		errExit("malloc");
+	while (!audit_exit) {
+		struct pollfd pfd = { sock, POLLIN, 0 };
+		int rv = poll(&pfd, 1, 1000);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("poll");
+		}
+		if (rv == 0) {
+			// the sandbox is gone
+			if (process_stat_nofail(sandbox, "ns/pid", &s))
+				break;
+			continue;
+		}
+
+		ssize_t len = recv(sock, buf, AUDIT_BUFSIZE - 1, MSG_DONTWAIT);
+		if (len == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			if (errno == ENOBUFS) {
+				fwarning("audit records lost, the counts are incomplete\n");
+				continue;
+			}
+			errExit("recv");
+		}
+
+		struct nlmsghdr *nlh;
+		for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, (unsigned) len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type != AUDIT_SECCOMP)
+				continue;
+			// the record text is not terminated
+			char *msg = NLMSG_DATA(nlh);
+			size_t msglen = nlh->nlmsg_len - NLMSG_HDRLEN;
+			char saved = msg[msglen];
+			msg[msglen] = '\0';
+			audit_record(msg);
+			msg[msglen] = saved;
+		}
+	}
+
+	audit_summary();
+	free(buf);
+	close(sock);
+	unpin_process(sandbox);
+	exit(0);
+}
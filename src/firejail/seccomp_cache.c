@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// Cache of compiled and optimized seccomp filters.
+//
+// Every entry is stored in RUN_FIREJAIL_SECCOMP_CACHE_DIR (root only) as
+// three files sharing the same hash: <hash>.bpf, <hash>.postexec and
+// <hash>.spec. The spec file holds the full filter specification followed
+// by an empty line (see run_cache.c) and it is compared on every lookup, a
+// hash collision is a plain cache miss. The
+// spec file is renamed in place last, a reader finding it is guaranteed to
+// find the other two files complete.
+//
+// The specification includes the user id: the filters are built by fseccomp
+// running as the regular user, and entries are never shared between users.
+//
+// The filters used by the stock profiles are also built during make install,
+// in PATH_SECCOMP_STORE (see seccomp_store.h); the store is checked first.
+
+#include "firejail.h"
+#include "../include/launch_stats.h"
+#include "../include/seccomp.h"
+#include "../include/seccomp_store.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define SECCOMP_CACHE_MAX_ENTRIES 256
+#define SECCOMP_CACHE_MAX_SPEC (64 * 1024)
+
+static int cache_fd = -1;
+
+// open the cache directory; the directory is not accessible any more
+// after the filesystem is set up, so we do it early and keep the descriptor
+void seccomp_cache_open(void) {
+	if (cache_fd != -1)
+		return;
+	if (!checkcfg(CFG_SECCOMP_CACHE))
+		return;
+
+	cache_fd = run_cache_open(RUN_FIREJAIL_SECCOMP_CACHE_DIR, "seccomp");
+}
+
+int seccomp_cache_enabled(void) {
+	return cache_fd != -1;
+}
+
+void seccomp_cache_close(void) {
+	run_cache_close(&cache_fd);
+}
+
+static void add_program_id(char **spec, const char *program) {
+	struct stat s;
+	char *str;
+	if (stat(program, &s) == -1)
+		s.st_ino = s.st_mtime = s.st_size = 0;
+	if (asprintf(&str, "%s\n%s %lu %lld %lld", *spec, program,
+		     (unsigned long) s.st_ino, (long long) s.st_mtime, (long long) s.st_size) == -1)
+		errExit("asprintf");
+	free(*spec);
+	*spec = str;
+}
+
+// build the specification string for the filter produced by
+// "fseccomp command ... list"; native/32 bit is part of the command
+char *seccomp_cache_spec(const char *command, const char *list) {
+	assert(command);
+	char *spec;
+	if (asprintf(&spec, "version %s\nuid %d\ncommand %s\nlist %s\nallow-debuggers %d\nerror-action %d %s\nhot %s",
+		     VERSION, (int) getuid(), command, (list) ? list : "",
+		     arg_allow_debuggers, arg_seccomp_error_action,
+		     (cfg.seccomp_error_action) ? cfg.seccomp_error_action : "",
+		     (cfg.seccomp_hot) ? cfg.seccomp_hot : "") == -1)
+		errExit("asprintf");
+
+	// a new build of the helper programs invalidates the cache
+	add_program_id(&spec, PATH_FSECCOMP);
+	add_program_id(&spec, PATH_FSEC_OPTIMIZE);
+	return spec;
+}
+
+static int copy_entry(const char *src, const char *dst) {
+	int fdin = openat(cache_fd, src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fdin == -1)
+		return -1;
+	int fdout = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fdout == -1) {
+		close(fdin);
+		return -1;
+	}
+	int rv = copy_file_by_fd(fdin, fdout);
+	close(fdin);
+	close(fdout);
+	return rv;
+}
+
+static int cache_lookup(const char *spec, const char *filter, const char *postexec) {
+	uint64_t h = fnv1a64_str(spec);
+	char fname[64];
+	snprintf(fname, sizeof(fname), "%016llx.spec", (unsigned long long) h);
+
+	// compare the specification
+	FILE *fp = run_cache_load(cache_fd, fname, spec);
+	if (!fp)
+		return 0;
+	fclose(fp);
+
+	snprintf(fname, sizeof(fname), "%016llx.bpf", (unsigned long long) h);
+	if (copy_entry(fname, filter))
+		return 0;
+	if (postexec) {
+		snprintf(fname, sizeof(fname), "%016llx.postexec", (unsigned long long) h);
+		if (copy_entry(fname, postexec))
+			return 0;
+	}
+
+	if (arg_debug)
+		printf("Seccomp filter %s loaded from cache (%016llx)\n", filter, (unsigned long long) h);
+	return 1;
+}
+
+// return 1 if the filter was found in the cache and copied in filter
+// and postexec files, 0 otherwise
+int seccomp_cache_fetch(const char *spec, const char *filter, const char *postexec) {
+	assert(spec);
+	assert(filter);
+	if (cache_fd == -1)
+		return 0;
+
+	int rv = cache_lookup(spec, filter, postexec);
+	stats_add((rv) ? STATS_SECCOMP_CACHE_HITS : STATS_SECCOMP_CACHE_MISSES, 1);
+	return rv;
+}
+
+// copy src in a new entry
+static int store_file(const char *src, const char *final) {
+	FILE *fp = run_cache_create(cache_fd, final, NULL);
+	if (!fp)
+		return -1;
+
+	int rv = -1;
+	if (src) {
+		int fdin = open(src, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (fdin != -1) {
+			rv = copy_file_by_fd(fdin, fileno(fp));
+			close(fdin);
+		}
+	}
+	else
+		rv = 0;
+	if (rv) {
+		run_cache_abort(cache_fd, final, fp);
+		return -1;
+	}
+	return run_cache_commit(cache_fd, final, fp);
+}
+
+// store a freshly built filter in the cache; errors are not fatal
+void seccomp_cache_store(const char *spec, const char *filter, const char *postexec) {
+	assert(spec);
+	assert(filter);
+	if (cache_fd == -1)
+		return;
+	if (strlen(spec) > SECCOMP_CACHE_MAX_SPEC)
+		return;
+
+	int cnt = run_cache_count(cache_fd, "spec");
+	if (cnt < 0 || cnt >= SECCOMP_CACHE_MAX_ENTRIES) {
+		if (arg_debug)
+			printf("Seccomp cache full, %s not stored\n", filter);
+		return;
+	}
+
+	uint64_t h = fnv1a64_str(spec);
+	char fname[64];
+	snprintf(fname, sizeof(fname), "%016llx.bpf", (unsigned long long) h);
+	if (store_file(filter, fname))
+		goto errout;
+
+	// an empty file if there is no postexec filter
+	snprintf(fname, sizeof(fname), "%016llx.postexec", (unsigned long long) h);
+	if (store_file(postexec, fname))
+		goto errout;
+
+	snprintf(fname, sizeof(fname), "%016llx.spec", (unsigned long long) h);
+	FILE *fp = run_cache_create(cache_fd, fname, spec);
+	if (!fp || run_cache_commit(cache_fd, fname, fp))
+		goto errout;
+
+	if (arg_debug)
+		printf("Seccomp filter %s stored in cache (%016llx)\n", filter, (unsigned long long) h);
+	return;
+
+errout:
+	if (arg_debug)
+		printf("Cannot store seccomp filter %s in cache: %s\n", filter, strerror(errno));
+}
+
+//*******************************************
+// filter store built by make install
+//*******************************************
+static const char *store = NULL;
+static size_t store_size = 0;
+
+static int store_helper_ok(const char *program, int64_t size, int64_t mtime) {
+	struct stat s;
+	return stat(program, &s) == 0 && (int64_t) s.st_size == size && (int64_t) s.st_mtime == mtime;
+}
+
+// map the store before the filesystem is modified
+void seccomp_store_open(void) {
+	if (store)
+		return;
+	if (!checkcfg(CFG_SECCOMP_STORE))
+		return;
+
+	int fd = open(PATH_SECCOMP_STORE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1) {
+		if (arg_debug)
+			printf("Seccomp filter store not available: %s\n", strerror(errno));
+		return;
+	}
+	struct stat s;
+	if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != 0 || (s.st_mode & 0022) ||
+	    (size_t) s.st_size < sizeof(SeccompStoreHeader)) {
+		fwarning("invalid seccomp filter store %s\n", PATH_SECCOMP_STORE);
+		close(fd);
+		return;
+	}
+	void *map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return;
+
+	// check the header and every index entry once, the lookups do not check again
+	const SeccompStoreHeader *hdr = map;
+	const SeccompStoreEntry *index = (const SeccompStoreEntry *) (hdr + 1);
+	size_t size = s.st_size;
+	int ok = memcmp(hdr->magic, SECCOMP_STORE_MAGIC, sizeof(hdr->magic)) == 0 &&
+		hdr->version == SECCOMP_STORE_VERSION &&
+		hdr->count <= (size - sizeof(*hdr)) / sizeof(*index);
+	uint32_t i;
+	for (i = 0; ok && i < hdr->count; i++) {
+		const SeccompStoreEntry *e = index + i;
+		ok = e->spec_off <= size && e->spec_len <= size - e->spec_off &&
+			e->bpf_off <= size && e->bpf_len <= size - e->bpf_off &&
+			e->postexec_off <= size && e->postexec_len <= size - e->postexec_off &&
+			(i == 0 || index[i - 1].hash <= e->hash);
+	}
+	if (!ok) {
+		fwarning("invalid seccomp filter store %s\n", PATH_SECCOMP_STORE);
+		munmap(map, size);
+		return;
+	}
+
+	// fseccomp or fsec-optimize were replaced after make install
+	if (strncmp(hdr->fj_version, VERSION, sizeof(hdr->fj_version)) != 0 ||
+	    !store_helper_ok(PATH_FSECCOMP, hdr->fseccomp_size, hdr->fseccomp_mtime) ||
+	    !store_helper_ok(PATH_FSEC_OPTIMIZE, hdr->optimize_size, hdr->optimize_mtime)) {
+		if (arg_debug)
+			printf("Seccomp filter store %s is out of date\n", PATH_SECCOMP_STORE);
+		munmap(map, size);
+		return;
+	}
+
+	if (arg_debug)
+		printf("Using seccomp filter store %s, %u filters\n", PATH_SECCOMP_STORE, hdr->count);
+	store = map;
+	store_size = size;
+}
+
+void seccomp_store_close(void) {
+	if (store)
+		munmap((void *) store, store_size);
+	store = NULL;
+	store_size = 0;
+}
+
+static int store_write(const char *fname, const char *data, size_t len) {
+	int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return -1;
+	int rv = 0;
+	while (len) {
+		ssize_t n = write(fd, data, len);
+		if (n == -1) {
+			rv = -1;
+			break;
+		}
+		data += n;
+		len -= n;
+	}
+	if (close(fd) == -1)
+		rv = -1;
+	return rv;
+}
+
+// return 1 if the filter built by "fseccomp command ... list" was found in
+// the store and copied in filter and postexec files, 0 otherwise
+int seccomp_store_fetch(const char *command, const char *list, const char *filter, const char *postexec) {
+	assert(command);
+	assert(filter);
+	if (!store || !list)
+		return 0;
+	// the store has only the filters built with the defaults
+	if (arg_allow_debuggers || arg_seccomp_error_action != DEFAULT_SECCOMP_ERROR_ACTION ||
+	    cfg.seccomp_hot)
+		return 0;
+
+	char *spec;
+	if (asprintf(&spec, "%s\n%s", command, list) == -1)
+		errExit("asprintf");
+	size_t len = strlen(spec);
+	uint64_t h = fnv1a64(spec, len);
+
+	// binary search for the first entry with this hash
+	const SeccompStoreHeader *hdr = (const SeccompStoreHeader *) store;
+	const SeccompStoreEntry *index = (const SeccompStoreEntry *) (hdr + 1);
+	uint32_t lo = 0, hi = hdr->count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (index[mid].hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	int rv = 0;
+	for (; lo < hdr->count && index[lo].hash == h; lo++) {
+		const SeccompStoreEntry *e = &index[lo];
+		if (e->spec_len != len || memcmp(store + e->spec_off, spec, len) != 0)
+			continue;
+		if (store_write(filter, store + e->bpf_off, e->bpf_len) == 0 &&
+		    (!postexec || store_write(postexec, store + e->postexec_off, e->postexec_len) == 0)) {
+			if (arg_debug)
+				printf("Seccomp filter %s loaded from the filter store\n", filter);
+			rv = 1;
+		}
+		break;
+	}
+	free(spec);
+	return rv;
+}
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// seccomp supervisor: the syscalls in the seccomp.notify list are sent to
+// the sandbox monitor process (SECCOMP_RET_USER_NOTIF), which allows or
+// denies each call based on the argument rules in the list. All the other
+// syscalls stay on the in-kernel filters.
+//
+// The supervisor only sees the syscalls allowed by the other filters, a
+// blocked syscall never reaches it. Pointer arguments are not followed,
+// the memory of the process can change after the check and before the
+// kernel runs the syscall.
+
+#include "firejail.h"
+#include "../include/seccomp.h"
+#include "../include/syscall.h"
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+
+#if defined(SECCOMP_FILTER_FLAG_NEW_LISTENER) && defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE)
+#define HAVE_SECCOMP_NOTIFY
+#endif
+
+#ifdef HAVE_SECCOMP_NOTIFY
+static SyscallSet notify_set;
+// socket used by the application to pass the listener to the monitor
+static int notify_sock[2] = {-1, -1};
+
+// allow or deny a syscall, the syscall is allowed if the return is 0
+static int notify_action(const struct seccomp_data *data) {
+	int i;
+	for (i = 0; i < notify_set.rules; i++) {
+		const SyscallRule *r = notify_set.rule + i;
+		if (r->nr != data->nr)
+			continue;
+
+		uint64_t arg = data->args[r->arg] & r->mask;
+		bool match;
+		switch (r->op) {
+		case SYSCALL_CMP_EQ:
+			match = arg == r->value;
+			break;
+		case SYSCALL_CMP_NE:
+			match = arg != r->value;
+			break;
+		case SYSCALL_CMP_LT:
+			match = arg < r->value;
+			break;
+		case SYSCALL_CMP_LE:
+			match = arg <= r->value;
+			break;
+		case SYSCALL_CMP_GT:
+			match = arg > r->value;
+			break;
+		case SYSCALL_CMP_GE:
+			match = arg >= r->value;
+			break;
+		default:
+			assert(0);
+		}
+		if (match)
+			return r->action;
+	}
+
+	// syscall without a matching rule
+	if (syscall_set_has(&notify_set, data->nr))
+		return notify_set.arg[data->nr];
+	if (arg_seccomp_error_action == (int) SECCOMP_RET_KILL)
+		return ERRNO_KILL;
+	if (arg_seccomp_error_action == (int) SECCOMP_RET_LOG)
+		return 0;
+	return arg_seccomp_error_action;
+}
+
+static void notify_print(const struct seccomp_notif *req, int action) {
+	const char *name = syscall_find_nr(req->data.nr);
+	char *msg;
+	if (asprintf(&msg, "seccomp supervisor: pid %d, %s(0x%llx, 0x%llx, 0x%llx, 0x%llx, 0x%llx, 0x%llx) %s%s",
+		     req->pid, name,
+		     (unsigned long long) req->data.args[0], (unsigned long long) req->data.args[1],
+		     (unsigned long long) req->data.args[2], (unsigned long long) req->data.args[3],
+		     (unsigned long long) req->data.args[4], (unsigned long long) req->data.args[5],
+		     (action == 0) ? "allowed" : (action == ERRNO_KILL) ? "killed" : "denied, ",
+		     (action > 0) ? errno_find_nr(action) : "") == -1)
+		errExit("asprintf");
+	logmsg(msg);
+	fprintf(stderr, "%s\n", msg);
+	free(msg);
+}
+
+static int notify_recv_listener(void) {
+	int fd = -1;
+	char buf[CMSG_SPACE(sizeof(int))];
+	memset(buf, 0, sizeof(buf));
+	char c;
+	struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+
+	// the socket is closed if the application exits before installing the filters
+	if (recvmsg(notify_sock[0], &msg, MSG_CMSG_CLOEXEC) > 0) {
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	}
+	close(notify_sock[0]);
+	return fd;
+}
+
+static void *notify_thread(void *arg) {
+	(void) arg;
+	int fd = notify_recv_listener();
+	if (fd == -1)
+		return NULL;
+
+	struct seccomp_notif_sizes sizes;
+	if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == -1)
+		errExit("seccomp");
+	struct seccomp_notif *req = malloc(sizes.seccomp_notif);
+	struct seccomp_notif_resp *resp = malloc(sizes.seccomp_notif_resp);
+	if (!req || !resp)
+		errExit("malloc");
+
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	while (1) {
+		// POLLHUP: all the processes using the filter are gone
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("poll");
+		}
+		if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+			break;
+
+		memset(req, 0, sizes.seccomp_notif);
+		if (ioctl(fd, SECCOMP_IOCTL_NOTIF_RECV, req) == -1) {
+			// the process was killed while waiting for us
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			errExit("ioctl");
+		}
+
+		int action = notify_action(&req->data);
+		if (arg_debug || (action != 0 && !arg_quiet))
+			notify_print(req, action);
+
+		memset(resp, 0, sizes.seccomp_notif_resp);
+		resp->id = req->id;
+		if (action == 0)
+			resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+		else if (action == ERRNO_KILL) {
+			// make sure the pid was not reused
+			if (ioctl(fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &req->id) == 0)
+				kill(req->pid, SIGKILL);
+			resp->error = -EPERM;
+		}
+		else
+			resp->error = -action;
+
+		// ENOENT: the process is gone
+		if (ioctl(fd, SECCOMP_IOCTL_NOTIF_SEND, resp) == -1 && errno != ENOENT) {
+			// a kernel without SECCOMP_USER_NOTIF_FLAG_CONTINUE (Linux 5.5)
+			if (errno == EINVAL && action == 0) {
+				fwarning("the seccomp supervisor requires a Linux kernel version 5.5 or newer, "
+					 "%s denied\n", syscall_find_nr(req->data.nr));
+				resp->flags = 0;
+				resp->error = -ENOSYS;
+				if (ioctl(fd, SECCOMP_IOCTL_NOTIF_SEND, resp) == 0 || errno == ENOENT)
+					continue;
+			}
+			errExit("ioctl");
+		}
+	}
+
+	free(req);
+	free(resp);
+	close(fd);
+	return NULL;
+}
+#endif
+
+// check the list and prepare the supervisor, called before the application is started
+void seccomp_notify_open(void) {
+	if (!cfg.seccomp_list_notify)
+		return;
+#ifdef HAVE_SECCOMP_NOTIFY
+	syscall_set_clear(&notify_set);
+	syscall_set_build(&notify_set, NULL, cfg.seccomp_list_notify, true);
+
+	// the listener is passed with sendmsg() after installing the filter
+	int nr;
+#ifdef SYS_sendmsg
+	nr = SYS_sendmsg;
+#else
+	nr = -1;
+#endif
+	int i;
+	for (i = 0; i < notify_set.rules && notify_set.rule[i].nr != nr; i++)
+		;
+	if (syscall_set_has(&notify_set, nr) || i < notify_set.rules) {
+		fprintf(stderr, "Error: sendmsg cannot be handled by the seccomp supervisor\n");
+		exit(1);
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, notify_sock) == -1)
+		errExit("socketpair");
+#else
+	fprintf(stderr, "Error: seccomp.notify is not supported, firejail was built without "
+		"seccomp user notifications\n");
+	exit(1);
+#endif
+}
+
+// start the supervisor in the monitor process, after the application was forked
+void seccomp_notify_start(void) {
+#ifdef HAVE_SECCOMP_NOTIFY
+	if (notify_sock[0] == -1)
+		return;
+	close(notify_sock[1]);
+	notify_sock[1] = -1;
+
+	// the signals are handled by the main thread
+	sigset_t set, oldset;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &oldset);
+	pthread_t thread;
+	int rv = pthread_create(&thread, NULL, notify_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	if (rv) {
+		errno = rv;
+		errExit("pthread_create");
+	}
+	pthread_detach(thread);
+#endif
+}
+
+// the application end of the socket, -1 if there is no supervisor
+int seccomp_notify_sock(void) {
+#ifdef HAVE_SECCOMP_NOTIFY
+	return notify_sock[1];
+#else
+	return -1;
+#endif
+}
+
+// install the supervisor filter in the application and pass the listener
+// to the monitor; the filter only traps the native architecture syscalls
+void seccomp_notify_install(unsigned flags) {
+#ifdef HAVE_SECCOMP_NOTIFY
+	if (notify_sock[1] == -1)
+		return;
+	close(notify_sock[0]);
+	notify_sock[0] = -1;
+
+	SyscallSet set = notify_set;
+	int i;
+	for (i = 0; i < notify_set.rules; i++)
+		syscall_set_add(&set, notify_set.rule[i].nr, 0);
+
+	struct sock_filter filter[4 + 2 * SYSCALL_SET_MAX];
+	struct sock_filter head[] = {
+		VALIDATE_ARCHITECTURE,
+		EXAMINE_SYSCALL
+	};
+	memcpy(filter, head, sizeof(head));
+	int len = sizeof(head) / sizeof(head[0]);
+	int nr;
+	for (nr = 0; nr < SYSCALL_SET_MAX; nr++) {
+		if (!syscall_set_has(&set, nr))
+			continue;
+		filter[len++] = (struct sock_filter) BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, nr, 0, 1);
+		filter[len++] = (struct sock_filter) BPF_STMT(BPF_RET+BPF_K, SECCOMP_RET_USER_NOTIF);
+	}
+	filter[len++] = (struct sock_filter) RETURN_ALLOW;
+	struct sock_fprog prog = { .len = len, .filter = filter };
+
+	if (arg_debug)
+		printf("Installing seccomp supervisor filter\n");
+	prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+	int fd = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags | SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+	if (fd == -1) {
+		// the syscalls would be allowed without the supervisor
+		fprintf(stderr, "Error: cannot install the seccomp supervisor filter, "
+			"it requires a Linux kernel version 5.5 or newer\n");
+		exit(1);
+	}
+
+	char buf[CMSG_SPACE(sizeof(int))];
+	memset(buf, 0, sizeof(buf));
+	char c = 0;
+	struct iovec iov = { .iov_base = &c, .iov_len = 1 };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof(buf);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	if (sendmsg(notify_sock[1], &msg, 0) == -1)
+		errExit("sendmsg");
+	close(fd);
+	close(notify_sock[1]);
+	notify_sock[1] = -1;
+#else
+	(void) flags;
+#endif
+}
@@ -25,36 +25,17 @@ void shut(pid_t pid) {
 	EUID_ASSERT();
 
 	ProcessHandle sandbox = pin_sandbox_process(pid);
+	sandbox_thaw(pid);
 
 	process_send_signal(sandbox, SIGTERM);
 
-	// wait for not more than 11 seconds
-	int monsec = 11;
-	int killdone = 0;
-
-	while (monsec) {
-		sleep(1);
-		monsec--;
-
-		int monfd = process_open_nofail(sandbox, "cmdline");
-		if (monfd < 0) {
-			killdone = 1;
-			break;
-		}
-
-		char c;
-		ssize_t count = read(monfd, &c, 1);
-		close(monfd);
-		if (count == 0) {
-			// all done
-			killdone = 1;
-			break;
-		}
-	}
-
-	// force SIGKILL
-	if (!killdone)
+	// the sandbox shuts down its processes in its own grace period, by default
+	// a second is left for that on top of it; return as soon as it is gone
+	int grace = (arg_shutdown_grace >= 0) ? arg_shutdown_grace : SHUTDOWN_GRACE_DEFAULT + 1000;
+	if (!process_wait_exit(sandbox, grace)) {
+		// force SIGKILL
 		process_send_signal(sandbox, SIGKILL);
+	}
 
 	unpin_process(sandbox);
 }
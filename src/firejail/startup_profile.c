@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --profile-startup: record named, nested spans for the startup phases and
+// write them in Chrome trace-event format (JSON array). The file is opened
+// once in the parent and inherited by the sandbox child through clone();
+// every event goes out in a single write() on an O_APPEND descriptor, so
+// the parent and the child can share the file without extra locking.
+//
+// The array is closed by the last process writing into it, right before
+// the application is started. If the sandbox exits early the closing
+// bracket is missing, which trace viewers accept.
+//
+// The spans are also kept without a trace file when the launch statistics
+// are enabled, the time of every phase is added in RUN_STATS_FILE.
+
+#include "firejail.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+
+#define SPROF_MAX_DEPTH 32
+#define SPROF_NAME_LEN 64
+#define SPROF_MAXBUF 512
+
+typedef struct {
+	char name[SPROF_NAME_LEN];
+	unsigned long long ts;	// start time in microseconds
+} SprofSpan;
+
+// spans recorded before the file is opened, for example the lock taken
+// before the command line is parsed
+#define SPROF_MAX_PENDING 8
+#define SPROF_ARGS_LEN 128
+
+typedef struct {
+	char name[SPROF_NAME_LEN];
+	unsigned long long ts;
+	unsigned long long dur;
+	char args[SPROF_ARGS_LEN];
+} SprofPending;
+
+static int sprof_fd = -1;
+static int sprof_tid = SPROF_TID_PARENT;
+static SprofSpan stack[SPROF_MAX_DEPTH];
+static int depth = 0;
+static SprofPending pending[SPROF_MAX_PENDING];
+static int pending_cnt = 0;
+
+static unsigned long long now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000ULL + (unsigned long long) ts.tv_nsec / 1000ULL;
+}
+
+// the clock used for the spans, in microseconds
+unsigned long long sprof_now(void) {
+	return now_us();
+}
+
+// copy the name into dst escaping double quotes and backslashes
+static void copy_name(char *dst, size_t sz, const char *src) {
+	size_t i = 0;
+	while (*src && i + 2 < sz) {
+		unsigned char c = (unsigned char) *src++;
+		if (c == '"' || c == '\\')
+			dst[i++] = '\\';
+		else if (c < 0x20)
+			c = ' ';
+		dst[i++] = (char) c;
+	}
+	dst[i] = '\0';
+}
+
+static void sprof_write(const char *buf, int len) {
+	if (len <= 0)
+		return;
+	if (len >= SPROF_MAXBUF)
+		len = SPROF_MAXBUF - 1;
+	ssize_t rv = write(sprof_fd, buf, len);
+	(void) rv; // profiling is best effort
+}
+
+int sprof_get_fd(void) {
+	return sprof_fd;
+}
+
+void sprof_init(const char *fname) {
+	EUID_ASSERT();
+	assert(fname);
+	if (sprof_fd != -1)
+		return;
+
+	int fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot open startup profile file %s: %s\n", fname, strerror(errno));
+		exit(1);
+	}
+	struct stat s;
+	if (fstat(fd, &s) == -1)
+		errExit("fstat");
+	if (!S_ISREG(s.st_mode)) {
+		fprintf(stderr, "Error: startup profile file %s is not a regular file\n", fname);
+		exit(1);
+	}
+	sprof_fd = fd;
+
+	char buf[SPROF_MAXBUF];
+	int len = snprintf(buf, sizeof(buf),
+		"[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"firejail\"}}",
+		sandbox_pid, sprof_tid);
+	sprof_write(buf, len);
+	sprof_thread(SPROF_TID_PARENT, "parent");
+
+	int i;
+	for (i = 0; i < pending_cnt; i++)
+		sprof_span(pending[i].name, pending[i].ts, pending[i].dur,
+			(*pending[i].args) ? pending[i].args : NULL);
+	pending_cnt = 0;
+}
+
+// label the track of the current process; after clone()/fork() the child
+// uses its own track and drops the spans inherited from the parent
+void sprof_thread(int tid, const char *name) {
+	sprof_tid = tid;
+	depth = 0;
+	if (sprof_fd == -1)
+		return;
+
+	char tmp[SPROF_NAME_LEN];
+	copy_name(tmp, sizeof(tmp), name);
+	char buf[SPROF_MAXBUF];
+	int len = snprintf(buf, sizeof(buf),
+		",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		sandbox_pid, sprof_tid, tmp);
+	sprof_write(buf, len);
+}
+
+void sprof_begin(const char *name) {
+	if (sprof_fd == -1 && !stats_enabled())
+		return;
+	assert(name);
+
+	if (depth >= SPROF_MAX_DEPTH) {
+		depth++; // keep begin/end balanced
+		return;
+	}
+
+	copy_name(stack[depth].name, SPROF_NAME_LEN, name);
+	stack[depth].ts = now_us();
+	depth++;
+}
+
+// time spent in the current span, in microseconds
+unsigned long long sprof_elapsed(void) {
+	if ((sprof_fd == -1 && !stats_enabled()) || depth == 0 || depth > SPROF_MAX_DEPTH)
+		return 0;
+	return now_us() - stack[depth - 1].ts;
+}
+
+// end the current span; args is the content of the JSON "args" object, or NULL
+void sprof_end_args(const char *args) {
+	if (depth == 0)
+		return;
+
+	depth--;
+	if (depth >= SPROF_MAX_DEPTH)
+		return;
+
+	unsigned long long end = now_us();
+	SprofSpan *span = &stack[depth];
+	stats_phase(span->name, end - span->ts);
+	if (sprof_fd == -1)
+		return;
+
+	char buf[SPROF_MAXBUF];
+	int len = snprintf(buf, sizeof(buf),
+		",\n{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d%s%s%s}",
+		span->name, span->ts, end - span->ts, sandbox_pid, sprof_tid,
+		(args) ? ",\"args\":{" : "", (args) ? args : "", (args) ? "}" : "");
+	sprof_write(buf, len);
+}
+
+void sprof_end(void) {
+	sprof_end_args(NULL);
+}
+
+// write a span measured by the caller, ts and dur in microseconds from
+// sprof_now(); before sprof_init() the span is kept and written later
+void sprof_span(const char *name, unsigned long long ts, unsigned long long dur, const char *args) {
+	assert(name);
+	if (sprof_fd == -1) {
+		if (pending_cnt < SPROF_MAX_PENDING) {
+			SprofPending *p = &pending[pending_cnt++];
+			snprintf(p->name, sizeof(p->name), "%s", name);
+			p->ts = ts;
+			p->dur = dur;
+			snprintf(p->args, sizeof(p->args), "%s", (args) ? args : "");
+		}
+		return;
+	}
+
+	char tmp[SPROF_NAME_LEN];
+	copy_name(tmp, sizeof(tmp), name);
+	char buf[SPROF_MAXBUF];
+	int len = snprintf(buf, sizeof(buf),
+		",\n{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d%s%s%s}",
+		tmp, ts, dur, sandbox_pid, sprof_tid,
+		(args) ? ",\"args\":{" : "", (args) ? args : "", (args) ? "}" : "");
+	sprof_write(buf, len);
+}
+
+// close the JSON array; called by the last process writing into the file
+void sprof_finish(void) {
+	while (depth > 0)
+		sprof_end();
+	if (sprof_fd == -1)
+		return;
+
+	sprof_write("\n]\n", 3);
+	close(sprof_fd);
+	sprof_fd = -1;
+}
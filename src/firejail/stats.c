@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include "../include/launch_stats.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+// launch counters in RUN_STATS_FILE, see launch_stats.h. The segment is
+// mapped by the parent before the sandbox child is created, the child
+// inherits the mapping through clone() and loses it on execve(). The
+// failures are counted at exit by the process in charge of the launch:
+// the parent until the child is released, then the sandbox child until
+// the application is started.
+static StatsSegment *seg = NULL;
+static uint64_t pending[STATS_COUNTER_MAX];	// counted before stats_init()
+static pid_t owner = 0;
+static int done = 0;
+
+int stats_enabled(void) {
+	return seg != NULL;
+}
+
+void stats_add(int counter, uint64_t val) {
+	assert(counter >= 0 && counter < STATS_COUNTER_MAX);
+	if (seg)
+		__atomic_fetch_add(&seg->counter[counter], val, __ATOMIC_RELAXED);
+	else
+		pending[counter] += val;
+}
+
+static StatsPhase *find_phase(const char *name) {
+	int i;
+	for (i = 0; i < STATS_PHASES; i++) {
+		StatsPhase *p = &seg->phase[i];
+		uint32_t state = __atomic_load_n(&p->state, __ATOMIC_ACQUIRE);
+		if (state == STATS_PHASE_FREE) {
+			uint32_t expected = STATS_PHASE_FREE;
+			if (__atomic_compare_exchange_n(&p->state, &expected, STATS_PHASE_CLAIMED, 0,
+			    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+				snprintf(p->name, STATS_PHASE_NAME, "%s", name);
+				__atomic_store_n(&p->state, STATS_PHASE_READY, __ATOMIC_RELEASE);
+				return p;
+			}
+			state = expected;
+		}
+
+		// another process is writing the name; a process killed in the
+		// middle leaves the slot claimed forever, it is skipped
+		int spin = 1000;
+		while (state == STATS_PHASE_CLAIMED && spin-- > 0) {
+			sched_yield();
+			state = __atomic_load_n(&p->state, __ATOMIC_ACQUIRE);
+		}
+		if (state == STATS_PHASE_READY && strncmp(p->name, name, STATS_PHASE_NAME - 1) == 0)
+			return p;
+	}
+	return NULL;
+}
+
+// cumulative time of a --profile-startup phase
+void stats_phase(const char *name, unsigned long long usec) {
+	assert(name);
+	if (!seg)
+		return;
+	StatsPhase *p = find_phase(name);
+	if (!p)
+		return;
+	__atomic_fetch_add(&p->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&p->usec, usec, __ATOMIC_RELAXED);
+}
+
+static void stats_exit(void) {
+	if (seg && !done && getpid() == owner)
+		stats_add(STATS_FAILURES, 1);
+}
+
+// the current process becomes responsible for the launch
+void stats_set_owner(void) {
+	owner = getpid();
+}
+
+// the parent released the sandbox child
+void stats_setup_done(void) {
+	done = 1;
+}
+
+// the sandbox child is starting the application
+void stats_app_started(void) {
+	if (done)
+		return;
+	done = 1;
+	stats_add(STATS_STARTED, 1);
+}
+
+static StatsSegment *stats_map(void) {
+	int fd = open(RUN_STATS_FILE, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return NULL;
+
+	struct stat s;
+	if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode) || s.st_uid != 0 || s.st_nlink != 1 ||
+	    (s.st_size != 0 && s.st_size != sizeof(StatsSegment))) {
+		// a segment written by a different version is left alone
+		close(fd);
+		return NULL;
+	}
+	// if two processes create the file at the same time, both extend it
+	// with zeros
+	if (s.st_size == 0 && (ftruncate(fd, sizeof(StatsSegment)) == -1 || fchmod(fd, 0644) == -1)) {
+		close(fd);
+		return NULL;
+	}
+
+	void *ptr = mmap(NULL, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	StatsSegment *sp = ptr;
+	uint32_t expected = 0;
+	if (__atomic_compare_exchange_n(&sp->magic, &expected, STATS_MAGIC, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		sp->created = (uint64_t) time(NULL);
+		__atomic_store_n(&sp->version, STATS_VERSION, __ATOMIC_RELEASE);
+	}
+	else {
+		uint32_t version = __atomic_load_n(&sp->version, __ATOMIC_ACQUIRE);
+		// version 0: the segment is being initialized by another process
+		if (expected != STATS_MAGIC || (version != 0 && version != STATS_VERSION)) {
+			munmap(ptr, sizeof(StatsSegment));
+			return NULL;
+		}
+	}
+	return sp;
+}
+
+// called in the parent once the command line is parsed; the statistics are
+// best effort, the sandbox starts without them
+void stats_init(void) {
+	EUID_ASSERT();
+	if (seg || !checkcfg(CFG_LAUNCH_STATS))
+		return;
+
+	EUID_ROOT();
+	seg = stats_map();
+	EUID_USER();
+	if (!seg) {
+		if (arg_debug)
+			printf("Launch statistics not available\n");
+		return;
+	}
+
+	int i;
+	for (i = 0; i < STATS_COUNTER_MAX; i++) {
+		if (pending[i])
+			__atomic_fetch_add(&seg->counter[i], pending[i], __ATOMIC_RELAXED);
+		pending[i] = 0;
+	}
+	stats_add(STATS_LAUNCHES, 1);
+	stats_set_owner();
+	atexit(stats_exit);
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --trace reader: libtrace.so writes binary records in the rings of
+// RUN_TRACE_RING_FILE, a thread in the sandbox monitor process prints them
+// in the text format of libtrace.so. The segment is writable by the
+// sandbox, the records are checked before they are printed.
+//
+// --trace-fanotify adds the files opened in the sandbox mounts as seen by
+// the kernel, this covers the programs that do not go through libc:
+// static binaries, raw system calls, io_uring, openat2().
+
+#include "firejail.h"
+#include "../include/trace_ring.h"
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/fanotify.h>
+
+#define TRACE_POLL 10	// ms
+#define MAXBUF 4096
+
+static TraceSegment *seg = NULL;
+static FILE *trace_fp = NULL;
+static pthread_t trace_thread_id;
+static int trace_stop = 0;
+static uint64_t trace_drops = 0;
+static int fan_fd = -1;
+static pid_t monitor_pid = 0;
+
+// create the segment, called as root before the privileges are dropped
+void trace_ring_create(void) {
+	int fd = open(RUN_TRACE_RING_FILE, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		errExit("open " RUN_TRACE_RING_FILE);
+	if (ftruncate(fd, sizeof(TraceSegment)) == -1)
+		errExit("ftruncate");
+	SET_PERMS_FD(fd, getuid(), getgid(), S_IRUSR | S_IWUSR);
+
+	seg = mmap(NULL, sizeof(TraceSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (seg == MAP_FAILED)
+		errExit("mmap");
+	close(fd);
+	seg->magic = TRACE_RING_MAGIC;
+	fs_logger("create " RUN_TRACE_RING_FILE);
+}
+
+// mount points in /proc/self/mountinfo are escaped: \040 etc.
+static void unescape_mountinfo(char *str) {
+	char *src = str;
+	char *dst = str;
+	while (*src) {
+		if (src[0] == '\\' && src[1] >= '0' && src[1] <= '3' &&
+		    src[2] >= '0' && src[2] <= '7' && src[3] >= '0' && src[3] <= '7') {
+			*dst++ = (char) (((src[1] - '0') << 6) | ((src[2] - '0') << 3) | (src[3] - '0'));
+			src += 4;
+		}
+		else
+			*dst++ = *src++;
+	}
+	*dst = '\0';
+}
+
+// --trace-fanotify: mark all the mounts of the sandbox, called as root after
+// the filesystem is set up; the mounts are not shared with the host, and
+// /proc and /sys are not traced
+void trace_fanotify_create(void) {
+	fan_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+	if (fan_fd == -1) {
+		fwarning("fanotify is not available, --trace-fanotify disabled\n");
+		return;
+	}
+
+	FILE *fp = fopen("/proc/self/mountinfo", "re");
+	if (!fp)
+		errExit("fopen /proc/self/mountinfo");
+	char buf[MAXBUF];
+	char dir[MAXBUF];
+	unsigned cnt = 0;
+	while (fgets(buf, MAXBUF, fp)) {
+		// 36 35 98:0 /mnt1 /mnt2 rw,noatime ... - the mount point is the fifth field
+		if (sscanf(buf, "%*s %*s %*s %*s %4095s", dir) != 1)
+			continue;
+		unescape_mountinfo(dir);
+		if (strcmp(dir, "/proc") == 0 || strncmp(dir, "/proc/", 6) == 0 ||
+		    strcmp(dir, "/sys") == 0 || strncmp(dir, "/sys/", 5) == 0)
+			continue;
+		if (fanotify_mark(fan_fd, FAN_MARK_ADD | FAN_MARK_MOUNT, FAN_OPEN, AT_FDCWD, dir) == 0)
+			cnt++;
+		else if (arg_debug)
+			printf("Cannot set a fanotify mark on %s: %s\n", dir, strerror(errno));
+	}
+	fclose(fp);
+
+	if (cnt == 0) {
+		fwarning("cannot set fanotify marks, --trace-fanotify disabled\n");
+		close(fan_fd);
+		fan_fd = -1;
+		return;
+	}
+	if (arg_debug)
+		printf("fanotify marks set on %u mounts\n", cnt);
+	fs_logger("fanotify trace");
+}
+
+static void print_record(const TraceRecord *rec) {
+	if (rec->call >= TRACE_CALL_MAX)
+		return;
+	const TraceCall *call = &trace_calls[rec->call];
+	int len = (rec->len < TRACE_ARG_MAX) ? rec->len : TRACE_ARG_MAX;
+
+	fprintf(trace_fp, "%u:%.*s:%s %.*s", rec->pid,
+		(int) strnlen(rec->name, TRACE_NAME_MAX), rec->name,
+		call->name, len, rec->arg);
+	if (call->ptr)
+		fprintf(trace_fp, ":%p\n", (void *) (intptr_t) rec->rv);
+	else
+		fprintf(trace_fp, ":%d\n", (int) rec->rv);
+}
+
+// print the records available, merged in time order across the rings;
+// returns the number of records printed
+static unsigned trace_drain(void) {
+	unsigned cnt = 0;
+	while (1) {
+		TraceRing *first = NULL;
+		TraceRecord *rec = NULL;
+		int i;
+		for (i = 0; i < TRACE_RINGS; i++) {
+			TraceRing *ring = &seg->ring[i];
+			uint32_t tail = ring->tail;	// only written here
+			TraceRecord *r = &ring->rec[tail & (TRACE_RING_RECORDS - 1)];
+			if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != tail + 1)
+				continue;
+			if (!rec || r->time < rec->time) {
+				first = ring;
+				rec = r;
+			}
+		}
+		if (!rec)
+			break;
+
+		// the record can be overwritten once the tail moves
+		TraceRecord copy = *rec;
+		__atomic_store_n(&first->tail, first->tail + 1, __ATOMIC_RELEASE);
+		print_record(&copy);
+		cnt++;
+	}
+
+	uint64_t drops = __atomic_load_n(&seg->drops, __ATOMIC_RELAXED);
+	if (drops != trace_drops) {
+		fprintf(trace_fp, "trace: %llu records dropped\n", (unsigned long long) (drops - trace_drops));
+		trace_drops = drops;
+	}
+	if (cnt)
+		fflush(trace_fp);
+	return cnt;
+}
+
+// print the fanotify events available; returns the number of events printed
+static unsigned trace_fanotify_read(void) {
+	if (fan_fd == -1)
+		return 0;
+
+	char buf[4096] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+	unsigned cnt = 0;
+	ssize_t len;
+	while ((len = read(fan_fd, buf, sizeof(buf))) > 0) {
+		struct fanotify_event_metadata *ev = (struct fanotify_event_metadata *) buf;
+		for (; FAN_EVENT_OK(ev, len); ev = FAN_EVENT_NEXT(ev, len)) {
+			if (ev->vers != FANOTIFY_METADATA_VERSION) {
+				fprintf(trace_fp, "trace: unsupported fanotify version, kernel-open disabled\n");
+				close(fan_fd);
+				fan_fd = -1;
+				return cnt + 1;
+			}
+			if (ev->mask & FAN_Q_OVERFLOW) {
+				fprintf(trace_fp, "trace: kernel-open events dropped\n");
+				cnt++;
+				continue;
+			}
+			if (ev->fd < 0)
+				continue;
+
+			// the pid is 0 for the processes outside the pid namespace of the sandbox
+			if (ev->pid > 0 && ev->pid != monitor_pid) {
+				TraceRecord rec;
+				memset(&rec, 0, sizeof(rec));
+				rec.call = TRACE_KERNEL_OPEN;
+				rec.pid = ev->pid;
+
+				char fname[64];
+				snprintf(fname, sizeof(fname), "/proc/self/fd/%d", ev->fd);
+				ssize_t n = readlink(fname, rec.arg, TRACE_ARG_MAX);
+				if (n > 0) {
+					rec.len = n;
+					strcpy(rec.name, "unknown");
+					snprintf(fname, sizeof(fname), "/proc/%d/comm", ev->pid);
+					int fd = open(fname, O_RDONLY | O_CLOEXEC);
+					if (fd != -1) {
+						ssize_t m = read(fd, rec.name, TRACE_NAME_MAX - 1);
+						if (m > 0) {
+							rec.name[m] = '\0';
+							char *ptr = strchr(rec.name, '\n');
+							if (ptr)
+								*ptr = '\0';
+						}
+						close(fd);
+					}
+					print_record(&rec);
+					cnt++;
+				}
+			}
+			close(ev->fd);
+		}
+	}
+
+	if (cnt)
+		fflush(trace_fp);
+	return cnt;
+}
+
+static void *trace_thread(void *arg) {
+	(void) arg;
+	while (!__atomic_load_n(&trace_stop, __ATOMIC_ACQUIRE)) {
+		unsigned cnt = trace_drain();
+		cnt += trace_fanotify_read();
+		if (cnt == 0) {
+			// poll() ignores the descriptor if fanotify is not used
+			struct pollfd pfd = { .fd = fan_fd, .events = POLLIN };
+			poll(&pfd, 1, TRACE_POLL);
+		}
+	}
+	return NULL;
+}
+
+// start the reader in the sandbox monitor process, after the privileges are dropped
+void trace_ring_start(void) {
+	if (!seg)
+		return;
+
+	// the same output as libtrace.so: the trace file if it exists, or the terminal
+	trace_fp = fopen((access(RUN_TRACE_FILE, F_OK) == 0) ? RUN_TRACE_FILE : "/dev/tty", "ae");
+	if (!trace_fp)
+		trace_fp = stderr;
+	monitor_pid = getpid();
+
+	// the signals are handled by the main thread
+	sigset_t set, oldset;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &oldset);
+	int rv = pthread_create(&trace_thread_id, NULL, trace_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+	if (rv) {
+		errno = rv;
+		errExit("pthread_create");
+	}
+}
+
+// stop the reader and print the records left
+void trace_ring_stop(void) {
+	if (!seg || !trace_fp)
+		return;
+	__atomic_store_n(&trace_stop, 1, __ATOMIC_RELEASE);
+	pthread_join(trace_thread_id, NULL);
+	trace_drain();
+	trace_fanotify_read();
+	fflush(trace_fp);
+}
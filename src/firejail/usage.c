@@ -44,6 +44,10 @@ static const char *const usage_str =
 	"    --bind=dirname1,dirname2 - mount-bind dirname1 on top of dirname2.\n"
 	"    --bind=filename1,filename2 - mount-bind filename1 on top of filename2.\n"
 	"    --blacklist=filename - blacklist directory or file.\n"
+#ifdef HAVE_LANDLOCK
+	"    --blacklist-mode=landlock|mount - enforce the blacklist with a Landlock\n"
+	"\truleset or with mounts.\n"
+#endif
 	"    --build - build a whitelisted profile for the application.\n"
 	"    --build=filename - build a whitelisted profile for the application.\n"
 	"    --caps - enable default Linux capabilities filter.\n"
@@ -55,9 +59,12 @@ static const char *const usage_str =
 	"    --cat=name|pid filename - print content of file from sandbox container.\n"
 #endif
 #ifdef HAVE_CHROOT
+	"    --cgroup-leaf - move the sandbox in its own cgroup v2 leaf.\n"
 	"    --chroot=dirname - chroot into directory.\n"
 #endif
 	"    --cpu=cpu-number,cpu-number - set cpu affinity.\n"
+	"    --cpu-max=percent - limit the cpu time to a percentage of one cpu.\n"
+	"    --cpu-weight=number - set the cpu weight, 1 to 10000.\n"
 	"    --cpu.print=name|pid - print the cpus in use.\n"
 #ifdef HAVE_DBUSPROXY
 	"    --dbus-log=file - set DBus log file location.\n"
@@ -82,6 +89,7 @@ static const char *const usage_str =
 	"    --debug-blacklists - debug blacklisting.\n"
 	"    --debug-caps - print all recognized capabilities.\n"
 	"    --debug-errnos - print all recognized error numbers.\n"
+	"    --debug-macros - print macro expansion statistics.\n"
 #ifdef HAVE_PRIVATE_LIB
 	"    --debug-private-lib - debug for --private-lib option.\n"
 #endif
@@ -94,6 +102,10 @@ static const char *const usage_str =
 #endif
 	"    --deterministic-exit-code - always exit with first child's status code.\n"
 	"    --deterministic-shutdown - terminate orphan processes.\n"
+#ifdef HAVE_NETWORK
+	"    --dhcp-timeout=seconds - start the application after this time if one\n"
+	"\tIP family is configured by DHCP.\n"
+#endif
 	"    --dns=address - set DNS server.\n"
 	"    --dns.print=name|pid - print DNS configuration.\n"
 #ifdef HAVE_NETWORK
@@ -113,6 +125,7 @@ static const char *const usage_str =
 	"    --ids-check - verify file system.\n"
 	"    --ids-init - initialize IDS database.\n"
 	"    --ignore=command - ignore command in profile files.\n"
+	"    --instances=number - start a number of identical sandboxes.\n"
 #ifdef HAVE_NETWORK
 	"    --interface=name - move interface in sandbox.\n"
 	"    --ip=address - set interface IP address.\n"
@@ -122,6 +135,9 @@ static const char *const usage_str =
 	"    --ip6=dhcp - acquire IPv6 address by running dhclient.\n"
 	"    --iprange=address,address - configure an IP address in this range.\n"
 #endif
+	"    --io-max=device,rbps=size,wbps=size,riops=number,wiops=number - limit\n"
+	"\tthe I/O on a block device.\n"
+	"    --ioprio=class[,level] - set the I/O scheduling class and level.\n"
 	"    --ipc-namespace - enable a new IPC namespace.\n"
 	"    --join=name|pid - join the sandbox.\n"
 	"    --join-filesystem=name|pid - join the mount namespace.\n"
@@ -143,10 +159,13 @@ static const char *const usage_str =
 	"    --landlock.fs.makeipc=path - add an access rule for the path to the Landlock ruleset for creating named pipes and sockets.\n"
 	"    --landlock.fs.makedev=path - add an access rule for the path to the Landlock ruleset for creating block/char devices.\n"
 	"    --landlock.fs.execute=path - add an execute access rule for the path to the Landlock ruleset.\n"
+	"    --landlock.net.bind=port,port - allow binding only the TCP ports listed.\n"
+	"    --landlock.net.connect=port,port - allow TCP connections only to the ports listed.\n"
 #endif
 	"    --list - list all sandboxes.\n"
 #ifdef HAVE_FILE_TRANSFER
-	"    --ls=name|pid dir_or_filename - list files in sandbox container.\n"
+	"    --ls=name|pid [--format=jsonl] dir_or_filename - list files in sandbox\n"
+	"\tcontainer.\n"
 #endif
 #ifdef HAVE_NETWORK
 	"    --mac=xx:xx:xx:xx:xx:xx - set interface MAC address.\n"
@@ -154,6 +173,10 @@ static const char *const usage_str =
 	"    --machine-id - spoof /etc/machine-id with a random id\n"
 	"    --memory-deny-write-execute - seccomp filter to block attempts to create\n"
 	"\tmemory mappings that are both writable and executable.\n"
+	"    --memory-high=size - throttle the sandbox above the memory size.\n"
+	"    --memory-max=size - limit the memory size of the sandbox.\n"
+	"    --memory-merge - let KSM merge the identical memory pages of the sandbox.\n"
+	"    --memory.print=name|pid - print the memory footprint of the sandbox.\n"
 	"    --mkdir=dirname - create a directory.\n"
 	"    --mkfile=filename - create a file.\n"
 #ifdef HAVE_NETWORK
@@ -165,6 +188,10 @@ static const char *const usage_str =
 	"    --net=ethernet_interface - enable network namespaces and connect to this\n"
 	"\tEthernet interface.\n"
 	"    --net=none - enable a new, unconnected network namespace.\n"
+	"    --net-group=name - share the network namespace with the sandboxes started\n"
+	"\twith the same group name.\n"
+	"    --net-pool=bridge,size - keep veth pairs ready on the bridge for the\n"
+	"\tsandboxes, root user only.\n"
 	"    --net.print=name|pid - print network interface configuration.\n"
 	"    --netfilter[=filename,arg1,arg2,arg3 ...] - enable firewall.\n"
 	"    --netfilter.print=name|pid - print the firewall.\n"
@@ -195,17 +222,26 @@ static const char *const usage_str =
 	"    --novideo - disable video devices.\n"
 	"    --nou2f - disable U2F devices.\n"
 	"    --nowhitelist=filename - disable whitelist for file or directory.\n"
+	"    --numa-node=node|auto[,bind] - run the sandbox on a NUMA node.\n"
 	"    --oom=value - configure OutOfMemory killer for the sandbox\n"
 #ifdef HAVE_OUTPUT
 	"    --output=logfile - stdout logging and log rotation.\n"
+	"    --output-compress[=gzip|zstd] - compress the rotated log files.\n"
 	"    --output-stderr=logfile - stdout and stderr logging and log rotation.\n"
 #endif
+	"    --pause=name|pid - freeze the processes of a sandbox started with\n"
+	"\t--cgroup-leaf.\n"
+	"    --perf-stat - print the performance counters of the sandbox at exit.\n"
+	"    --pool=name - start the sandbox in a pool of sandboxes kept ready.\n"
+	"    --pool-join=name - run a program in an idle sandbox of the pool.\n"
 	"    --private - temporary home directory.\n"
 	"    --private=directory - use directory as user home.\n"
 	"    --private-cache - temporary ~/.cache directory.\n"
 	"    --private-home=file,directory - build a new user home in a temporary\n"
 	"\tfilesystem, and copy the files and directories in the list in the\n"
 	"\tnew home.\n"
+	"    --private-home-snapshot=name - copy the private-home list once in a\n"
+	"\tsnapshot, and mount it with an overlay in the next sandboxes.\n"
 	"    --private-bin=file,file - build a new /bin in a temporary filesystem,\n"
 	"\tand copy the programs in the list.\n"
 	"    --private-dev - create a new /dev directory with a small number of\n"
@@ -222,6 +258,8 @@ static const char *const usage_str =
 	"    --private-srv=file,directory - build a new /srv in a temporary filesystem.\n"
 	"    --profile=filename|profile_name - use a custom profile.\n"
 	"    --profile.print=name|pid - print the name of profile file.\n"
+	"    --profile-startup=filename - record the duration of the sandbox startup\n"
+	"\tphases in Chrome trace-event format.\n"
 	"    --protocol=protocol,protocol,protocol - enable protocol filter.\n"
 	"    --protocol.print=name|pid - print the protocol filter.\n"
 #ifdef HAVE_FILE_TRANSFER
@@ -234,6 +272,7 @@ static const char *const usage_str =
 	"    --restrict-namespaces - seccomp filter that blocks attempts to create new namespaces.\n"
 	"    --restrict-namespaces=namespace,namespace - seccomp filter that blocks attempts\n"
 	"\tto create specified namespaces.\n"
+	"    --resume=name|pid - resume a sandbox stopped with --pause.\n"
 	"    --rlimit-as=number - set the maximum size of the process's virtual memory.\n"
 	"\t(address space) in bytes.\n"
 	"    --rlimit-cpu=number - set the maximum CPU time in seconds.\n"
@@ -246,30 +285,52 @@ static const char *const usage_str =
 	"    --rlimit-sigpending=number - set the maximum number of pending signals\n"
 	"\tfor a process.\n"
 	"    --rmenv=name - remove environment variable in the new sandbox.\n"
+#ifdef HAVE_CHROOT
+	"    --rootfs-image=file - use an EROFS or squashfs image as root filesystem.\n"
+#endif
+	"    --sched=other|batch|idle - set the CPU scheduling policy.\n"
+	"    --sched-slice=usec - set the CPU time slice of the scheduler.\n"
 #ifdef HAVE_NETWORK
 	"    --scan - ARP-scan all the networks from inside a network namespace.\n"
 #endif
 	"    --seccomp - enable seccomp filter and apply the default blacklist.\n"
 	"    --seccomp=syscall,syscall,syscall - enable seccomp filter, blacklist the\n"
 	"\tdefault syscall list and the syscalls specified by the command.\n"
+	"    --seccomp.audit=name|pid - print the seccomp violations of the sandbox\n"
+	"\tidentified by name or PID, as logged by the kernel audit.\n"
 	"    --seccomp.block-secondary - build only the native architecture filters.\n"
 	"    --seccomp.drop=syscall,syscall,syscall - enable seccomp filter, and\n"
 	"\tblacklist the syscalls specified by the command.\n"
+	"    --seccomp.hot=syscall,syscall,syscall - check the syscalls first in the\n"
+	"\tseccomp filters, the most frequent first.\n"
 	"    --seccomp.keep=syscall,syscall,syscall - enable seccomp filter, and\n"
 	"\twhitelist the syscalls specified by the command.\n"
-	"    --seccomp.print=name|pid - print the seccomp filter for the sandbox\n"
-	"\tidentified by name or PID.\n"
+	"    --seccomp.notify=syscall,syscall,syscall - allow or deny the syscalls in\n"
+	"\tthe sandbox monitor, based on the argument rules in the list.\n"
+	"    --seccomp.print=name|pid [--summary] [--format=jsonl] - print the seccomp\n"
+	"\tfilter for the sandbox identified by name or PID.\n"
+	"    --seccomp.spec-allow - don't enable the Speculative Store Bypass\n"
+	"\tmitigation for the seccomp filters.\n"
+	"    --seccomp.tsync - synchronize the seccomp filters on all threads.\n"
 	"    --seccomp.32[.drop,.keep][=syscall] - like above but for 32 bit architecture.\n"
 	"    --seccomp-error-action=errno|kill|log - change error code, kill process\n"
 	"\tor log the attempt.\n"
 	"    --shutdown=name|pid - shutdown the sandbox identified by name or PID.\n"
+	"    --shutdown-grace=ms - time left to the processes to exit after SIGTERM\n"
+	"\tbefore they are killed.\n"
 	"    --tab - enable shell tab completion in sandboxes using private or\n"
 	"\twhitelisted home directories.\n"
 	"    --timeout=hh:mm:ss - kill the sandbox automatically after the time\n"
 	"\thas elapsed.\n"
 	"    --tmpfs=dirname - mount a tmpfs filesystem on directory dirname.\n"
+	"    --tmpfs-inodes=number - limit the number of inodes of the tmpfs\n"
+	"\tfilesystems mounted in the sandbox.\n"
+	"    --tmpfs-size=size - limit the size of the tmpfs filesystems mounted\n"
+	"\tin the sandbox.\n"
 	"    --top - monitor the most CPU-intensive sandboxes.\n"
 	"    --trace - trace open, access and connect system calls.\n"
+	"    --trace-fanotify - --trace, and the files opened in the sandbox\n"
+	"\tas seen by the kernel.\n"
 	"    --tracelog - add a syslog message for every access to files or\n"
 	"\tdirectories blacklisted by the security profile.\n"
 	"    --tree - print a tree of all sandboxed processes.\n"
@@ -279,6 +340,9 @@ static const char *const usage_str =
 #ifdef HAVE_NETWORK
 	"    --veth-name=name - use this name for the interface connected to the bridge.\n"
 #endif
+	"    --warm-cache - fill the startup caches for the programs configured\n"
+	"\tby firecfg.\n"
+	"    --warm-cache=program,program - fill the startup caches for the programs.\n"
 	"    --whitelist=filename - whitelist directory or file.\n"
 	"    --writable-etc - /etc directory is mounted read-write.\n"
 	"    --writable-run-user - allow access to /run/user/$UID/systemd and\n"
@@ -294,6 +358,8 @@ static const char *const usage_str =
 	"    --x11=xorg - enable X11 security extension.\n"
 	"    --x11=xpra - enable Xpra X11 server.\n"
 	"    --x11=xvfb - enable Xvfb X11 server.\n"
+	"    --x11-pool=xvfb,size - keep Xvfb servers ready for the sandboxes started\n"
+	"\twith --x11=xvfb.\n"
 	"    --xephyr-extra-params=OPTIONS - set Xephyr server command extra parameters\n"
 	"\tfor --x11=xephyr.\n"
 	"    --xephyr-screen=WIDTHxHEIGHT - set screen size for --x11=xephyr.\n"
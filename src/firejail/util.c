@@ -29,6 +29,7 @@
 #include <termios.h>
 #include <sys/wait.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <fcntl.h>
 #ifndef O_PATH
@@ -39,6 +40,9 @@
 #ifdef __NR_openat2
 #include <linux/openat2.h>
 #endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
 
 #define MAX_GROUPS 1024
 #define MAXBUF 4096
@@ -423,21 +427,7 @@ int copy_file_by_fd(int src, int dst) {
 	assert(src >= 0);
 	assert(dst >= 0);
 
-	ssize_t len;
-	static const int BUFLEN = 1024;
-	unsigned char buf[BUFLEN];
-	while ((len = read(src, buf, BUFLEN)) > 0) {
-		int done = 0;
-		while (done != len) {
-			int rv = write(dst, buf + done, len - done);
-			if (rv == -1)
-				return -1;
-			done += rv;
-		}
-	}
-	if (len == 0)
-		return 0;
-	return -1;
+	return copy_fd_data(src, dst);
 }
 
 // return -1 if error, 0 if no error; if destname already exists, return error
@@ -696,6 +686,50 @@ void trim_trailing_slash_or_dot(char *path) {
 	}
 }
 
+// remove multiple spaces in place, same rules as line_remove_spaces();
+// return a pointer in buf
+char *line_remove_spaces_inplace(char *buf) {
+	assert(buf);
+
+	// remove space at start of line
+	while (*buf == ' ' || *buf == '\t')
+		buf++;
+
+	// the line ends at the first '\n' or '\r'
+	char *end = buf + strcspn(buf, "\n\r");
+	*end = '\0';
+
+	// most profile lines have no tabs and no double spaces, skip the part
+	// of the line that is already clean
+	char *ptr1 = buf;
+	for (;;) {
+		ptr1 += strcspn(ptr1, " \t");
+		if (*ptr1 == '\0')
+			return buf;
+		if (*ptr1 == '\t' || ptr1[1] == ' ' || ptr1[1] == '\t' || ptr1[1] == '\0')
+			break;
+		ptr1++;
+	}
+
+	// copy data and remove additional spaces
+	char *ptr2 = ptr1;
+	while (*ptr1 != '\0') {
+		if (*ptr1 != ' ' && *ptr1 != '\t')
+			*ptr2++ = *ptr1++;
+		else {
+			*ptr2++ = ' ';
+			while (*ptr1 == ' ' || *ptr1 == '\t')
+				ptr1++;
+		}
+	}
+
+	// strip last blank character if any
+	if (ptr2 > buf && *(ptr2 - 1) == ' ')
+		--ptr2;
+	*ptr2 = '\0';
+	return buf;
+}
+
 // remove multiple spaces and return allocated memory
 char *line_remove_spaces(const char *buf) {
 	EUID_ASSERT();
@@ -1138,6 +1172,18 @@ unsigned extract_timeout(const char *str) {
 	return timeout;
 }
 
+// grace period in milliseconds, 0 to 600000
+int extract_shutdown_grace(const char *str) {
+	char *end;
+	errno = 0;
+	unsigned long val = strtoul(str, &end, 10);
+	if (!isdigit((unsigned char) *str) || *end != '\0' || errno || val > 600000) {
+		fprintf(stderr, "Error: invalid --shutdown-grace, expecting a number of milliseconds between 0 and 600000\n");
+		exit(1);
+	}
+	return (int) val;
+}
+
 void disable_file_or_dir(const char *fname) {
 	assert(geteuid() == 0);
 	assert(fname);
@@ -1274,6 +1320,31 @@ int remount_by_fd(int dst, unsigned long mountflags) {
 	return rv;
 }
 
+// apply mount attributes (MOUNT_ATTR_*) to the mount at dst and all mounts below it;
+// returns -1 with errno set to ENOSYS if the kernel does not provide mount_setattr
+int remount_tree_by_fd(int dst, unsigned long attr_set) {
+#ifdef __NR_mount_setattr // kernel 5.12 or better
+	struct {
+		uint64_t attr_set;
+		uint64_t attr_clr;
+		uint64_t propagation;
+		uint64_t userns_fd;
+	} attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.attr_set = attr_set;
+
+	int rv = (int) syscall(__NR_mount_setattr, dst, "", AT_EMPTY_PATH|AT_RECURSIVE, &attr, sizeof(attr));
+	if (rv < 0 && arg_debug && errno != ENOSYS)
+		printf("Failed to set mount attributes recursively: %s\n", strerror(errno));
+	return rv;
+#else
+	(void) dst;
+	(void) attr_set;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 int bind_mount_by_fd(int src, int dst) {
 	char *proc_src, *proc_dst;
 	if (asprintf(&proc_src, "/proc/self/fd/%d", src) < 0 ||
@@ -1339,7 +1410,66 @@ int bind_mount_path_to_fd(const char *srcname, int dst) {
 	return rv;
 }
 
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
+static int cmp_fd(const void *a, const void *b) {
+	return *(const int *) a - *(const int *) b;
+}
+
+// the file descriptors close_all() keeps open, sorted; keep has room for
+// sz + 5 entries, return the number of entries
+size_t close_all_keep(int *keep, const int *keep_list, size_t sz) {
+	size_t cnt = 0;
+	keep[cnt++] = STDIN_FILENO;
+	keep[cnt++] = STDOUT_FILENO;
+	keep[cnt++] = STDERR_FILENO;
+	size_t i;
+	for (i = 0; i < sz; i++) {
+		if (keep_list[i] >= 0)
+			keep[cnt++] = keep_list[i];
+	}
+	// The --profile-startup file is opened with O_CLOEXEC and it
+	// is still needed until the application is started.
+	if (sprof_get_fd() >= 0)
+		keep[cnt++] = sprof_get_fd();
+#ifdef HAVE_LANDLOCK
+	// the Landlock ruleset is closed by the "ll_restrict" wrapper function
+	if (ll_get_fd() >= 0)
+		keep[cnt++] = ll_get_fd();
+#endif
+	qsort(keep, cnt, sizeof(int), cmp_fd);
+	return cnt;
+}
+
+// close everything between the file descriptors kept, with one system call
+// for each gap; return -1 if close_range() is not available (Linux < 5.9).
+// Only system calls, it runs in the sbox_run() child sharing the memory of
+// the parent.
+int close_all_range(const int *keep, size_t cnt) {
+	size_t i;
+	for (i = 0; i < cnt; i++) {
+		unsigned first = keep[i] + 1;
+		unsigned last = (i + 1 < cnt) ? (unsigned) keep[i + 1] - 1 : ~0U;
+		if (first > last)
+			continue;	// no gap, or the same fd twice
+		if (syscall(SYS_close_range, first, last, 0) == -1)
+			return -1;
+	}
+	return 0;
+}
+
 void close_all(int *keep_list, size_t sz) {
+	int *keep = malloc((sz + 5) * sizeof(int));
+	if (!keep)
+		errExit("malloc");
+	size_t cnt = close_all_keep(keep, keep_list, sz);
+	int rv = close_all_range(keep, cnt);
+	free(keep);
+	if (rv == 0)
+		return;
+
 	DIR *dir;
 	if (!(dir = opendir("/proc/self/fd"))) {
 		// sleep 2 seconds and try again
@@ -1380,6 +1510,11 @@ void close_all(int *keep_list, size_t sz) {
 		if (keep)
 			continue;
 
+		// The --profile-startup file is opened with O_CLOEXEC and it
+		// is still needed until the application is started.
+		if (fd == sprof_get_fd())
+			continue;
+
 #ifdef HAVE_LANDLOCK
 		// Don't close the file descriptor of the Landlock ruleset; it
 		// will be automatically closed by the "ll_restrict" wrapper
@@ -1583,3 +1718,41 @@ void check_homedir(const char *dir) {
 		fmessage("No full support for symbolic links in path of user directory.\n"
 			"Please provide resolved path in password database (/etc/passwd).\n\n");
 }
+
+typedef struct {
+	void (*fn)(int i, void *data);
+	void *data;
+	int cnt;
+	int next;
+} ThreadJobs;
+
+static void *run_threads_worker(void *arg) {
+	ThreadJobs *jobs = arg;
+	int i;
+	while ((i = __atomic_fetch_add(&jobs->next, 1, __ATOMIC_RELAXED)) < jobs->cnt)
+		jobs->fn(i, jobs->data);
+	return NULL;
+}
+
+// run fn(i, data) for i from 0 to cnt - 1, on at most threads threads; the
+// calling thread is one of them. Returns the number of threads used.
+int run_threads(int threads, int cnt, void (*fn)(int i, void *data), void *data) {
+	assert(fn);
+	ThreadJobs jobs = { fn, data, cnt, 0 };
+
+	pthread_t tid[RUN_THREADS_MAX - 1];
+	if (threads > RUN_THREADS_MAX)
+		threads = RUN_THREADS_MAX;
+	if (threads > cnt)
+		threads = cnt;
+	int started = 0;
+	while (started < threads - 1 &&
+	       pthread_create(&tid[started], NULL, run_threads_worker, &jobs) == 0)
+		started++;
+
+	run_threads_worker(&jobs);
+	int i;
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	return started + 1;
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// --warm-cache[=program,...]: fill the caches used during the sandbox
+// startup ahead of the first launch. The programs are the ones configured
+// by firecfg (firecfg.config and firecfg.d/*.conf), or the list on the
+// command line. Every program installed in $PATH gets a regular sandbox,
+// started with --warm-cache-run: it builds the filesystem and the seccomp
+// filters as usual, storing the seccomp filters, the fldd library lists and
+// the rest of the caches, and it exits just before the program would be
+// started. The sandboxes run in parallel, one for every CPU.
+//
+// Before that, the entries of the seccomp and fldd caches built by another
+// firejail version, or referencing a file replaced or removed since, are
+// deleted: they would never be used again, and they count against the size
+// limit of the cache.
+//
+// The cache entries are specific to the user; the caches are filled for
+// the user running the command.
+
+#include "firejail.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <errno.h>
+
+#define MAXBUF 4096
+#define FIRECFG_CFGFILE SYSCONFDIR "/firecfg.config"
+#define FIRECFG_CONF_GLOB SYSCONFDIR "/firecfg.d/*.conf"
+
+typedef struct app_t {
+	struct app_t *next;
+	char *name;
+	char *path;	// NULL if the program is not installed
+	int ignored;
+	pid_t pid;
+} App;
+
+static App *apps = NULL;
+static App *apps_last = NULL;
+
+static App *app_find(const char *name) {
+	App *app = apps;
+	while (app) {
+		if (strcmp(app->name, name) == 0)
+			return app;
+		app = app->next;
+	}
+	return NULL;
+}
+
+static App *app_add(const char *name) {
+	App *app = app_find(name);
+	if (app)
+		return app;
+
+	app = calloc(1, sizeof(App));
+	if (!app)
+		errExit("calloc");
+	app->name = strdup(name);
+	if (!app->name)
+		errExit("strdup");
+	if (apps_last)
+		apps_last->next = app;
+	else
+		apps = app;
+	apps_last = app;
+	return app;
+}
+
+// the same syntax as in firecfg: one program per line, '#' comments,
+// "!program" removes the program
+static void parse_list_file(const char *fname) {
+	FILE *fp = fopen(fname, "re");
+	if (!fp) {
+		if (arg_debug)
+			printf("Cannot open %s\n", fname);
+		return;
+	}
+
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		char *ptr = strchr(buf, '#');
+		if (ptr)
+			*ptr = '\0';
+		ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+		char *start = buf;
+		while (*start == ' ' || *start == '\t')
+			start++;
+		char *end = start + strlen(start);
+		while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+			*--end = '\0';
+
+		int ignored = 0;
+		if (*start == '!') {
+			ignored = 1;
+			start++;
+		}
+		// firecfg rejects these lines
+		if (*start == '\0' || strstr(start, "..") || strchr(start, '/'))
+			continue;
+
+		App *app = app_add(start);
+		if (ignored)
+			app->ignored = 1;
+	}
+	fclose(fp);
+}
+
+static void parse_list_all(void) {
+	glob_t globbuf;
+	if (glob(FIRECFG_CONF_GLOB, 0, NULL, &globbuf) == 0) {
+		size_t i;
+		for (i = 0; i < globbuf.gl_pathc; i++)
+			parse_list_file(globbuf.gl_pathv[i]);
+		globfree(&globbuf);
+	}
+	parse_list_file(FIRECFG_CFGFILE);
+}
+
+static void parse_list_arg(const char *arg) {
+	char *dup = strdup(arg);
+	if (!dup)
+		errExit("strdup");
+	char *tok = strtok(dup, ",");
+	while (tok) {
+		if (strstr(tok, "..") || strchr(tok, '/')) {
+			fprintf(stderr, "Error: invalid program name %s in --warm-cache\n", tok);
+			exit(1);
+		}
+		app_add(tok);
+		tok = strtok(NULL, ",");
+	}
+	free(dup);
+}
+
+//*******************************************
+// stale cache entries
+//*******************************************
+
+// check a "path inode mtime size" line against the file; the helper
+// programs in RUN_FIREJAIL_LIB_DIR are mounted from LIBDIR/firejail
+static int file_id_stale(const char *line) {
+	char *path = strdup(line);
+	if (!path)
+		errExit("strdup");
+	char *ptr = NULL;
+	int i;
+	for (i = 0; i < 3; i++) {
+		ptr = strrchr(path, ' ');
+		if (!ptr)
+			break;
+		*ptr = '\0';
+	}
+	unsigned long ino;
+	long long mtime, size;
+	if (!ptr || sscanf(line + (ptr - path) + 1, "%lu %lld %lld", &ino, &mtime, &size) != 3) {
+		free(path);
+		return 1;
+	}
+
+	char *fname = path;
+	size_t len = strlen(RUN_FIREJAIL_LIB_DIR);
+	if (strncmp(path, RUN_FIREJAIL_LIB_DIR "/", len + 1) == 0) {
+		if (asprintf(&fname, "%s/firejail%s", LIBDIR, path + len) == -1)
+			errExit("asprintf");
+	}
+
+	struct stat s;
+	int rv;
+	if (stat(fname, &s) == -1)
+		rv = (ino || mtime || size);	// the seccomp specification records a missing program as 0 0 0
+	else
+		rv = ((unsigned long) s.st_ino != ino || (long long) s.st_mtime != mtime || (long long) s.st_size != size);
+	if (fname != path)
+		free(fname);
+	free(path);
+	return rv;
+}
+
+// return 1 if the entry was built by another version or one of the files
+// recorded in it changed
+static int entry_stale(int dirfd, const char *fname) {
+	int fd = openat(dirfd, fname, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return 0;
+	FILE *fp = fdopen(fd, "r");
+	if (!fp) {
+		close(fd);
+		return 0;
+	}
+
+	int rv = 0;
+	char *buf = NULL;
+	size_t size = 0;
+	while (!rv && getline(&buf, &size, fp) != -1) {
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+		if (strncmp(buf, "version ", 8) == 0)
+			rv = strcmp(buf + 8, VERSION) != 0;
+		else if (*buf == '/')
+			rv = file_id_stale(buf);
+	}
+	free(buf);
+	fclose(fp);
+	return rv;
+}
+
+// delete the stale entries; an entry is a set of files named
+// <hash>.<extension>, the first extension is checked
+static void prune_cache(const char *dir, const char *name, const char **ext) {
+	int dirfd = run_cache_open(dir, name);
+	if (dirfd == -1)
+		return;
+	int fd = dup(dirfd);
+	if (fd == -1)
+		errExit("dup");
+	DIR *d = fdopendir(fd);
+	if (!d)
+		errExit("fdopendir");
+
+	int cnt = 0;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		const char *ptr = strrchr(entry->d_name, '.');
+		if (!ptr || strcmp(ptr + 1, ext[0]) != 0)
+			continue;
+		if (!entry_stale(dirfd, entry->d_name))
+			continue;
+
+		// the checked file goes first, as it is written last when the
+		// entry is stored
+		if (unlinkat(dirfd, entry->d_name, 0) == -1)
+			continue;
+		cnt++;
+		int len = ptr - entry->d_name;
+		int i;
+		for (i = 1; ext[i]; i++) {
+			char *fname;
+			if (asprintf(&fname, "%.*s.%s", len, entry->d_name, ext[i]) == -1)
+				errExit("asprintf");
+			unlinkat(dirfd, fname, 0);
+			free(fname);
+		}
+	}
+	closedir(d);
+	run_cache_close(&dirfd);
+
+	if (arg_debug)
+		printf("%d stale entries removed from %s\n", cnt, dir);
+}
+
+static void prune_caches(void) {
+	const char *seccomp_ext[] = {"spec", "bpf", "postexec", NULL};
+	const char *fldd_ext[] = {"list", NULL};
+
+	EUID_ROOT();
+	prune_cache(RUN_FIREJAIL_SECCOMP_CACHE_DIR, "seccomp", seccomp_ext);
+	prune_cache(RUN_FIREJAIL_FLDD_CACHE_DIR, "fldd", fldd_ext);
+	EUID_USER();
+}
+
+//*******************************************
+// warm-up sandboxes
+//*******************************************
+
+static pid_t start_app(App *app) {
+	pid_t pid = fork();
+	if (pid == -1)
+		errExit("fork");
+	if (pid == 0) {
+		if (!arg_debug) {
+			int fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+			if (fd != -1) {
+				dup2(fd, STDIN_FILENO);
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+			}
+		}
+
+		char *cmd[5];
+		cmd[0] = BINDIR "/firejail";
+		cmd[1] = (arg_debug) ? "--debug" : "--quiet";
+		cmd[2] = "--warm-cache-run";
+		cmd[3] = app->path;
+		cmd[4] = NULL;
+		execv(cmd[0], cmd);
+		_exit(127);
+	}
+	return pid;
+}
+
+static void wait_app(int *running, int *failed) {
+	int status;
+	pid_t pid = waitpid(-1, &status, 0);
+	if (pid == -1) {
+		if (errno == EINTR)
+			return;
+		errExit("waitpid");
+	}
+
+	App *app = apps;
+	while (app && app->pid != pid)
+		app = app->next;
+	if (!app)
+		return;
+	app->pid = 0;
+	(*running)--;
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		if (!arg_quiet)
+			printf("   %s\n", app->name);
+	}
+	else {
+		(*failed)++;
+		if (!arg_quiet)
+			printf("   %s failed\n", app->name);
+	}
+}
+
+void warm_cache(const char *list) {
+	EUID_ASSERT();
+
+	if (list)
+		parse_list_arg(list);
+	else
+		parse_list_all();
+
+	prune_caches();
+
+	int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs < 1)
+		jobs = 1;
+
+	if (!arg_quiet)
+		printf("Warming up the caches for %s programs\n", (list) ? "the listed" : "the firecfg");
+	fflush(0);
+
+	int total = 0;
+	int running = 0;
+	int failed = 0;
+	App *app = apps;
+	while (app) {
+		if (!app->ignored) {
+			app->path = find_in_path(app->name);
+			if (app->path) {
+				while (running >= jobs)
+					wait_app(&running, &failed);
+				app->pid = start_app(app);
+				running++;
+				total++;
+			}
+			else if (list) {
+				fprintf(stderr, "Error: cannot find %s in $PATH\n", app->name);
+				failed++;
+			}
+		}
+		app = app->next;
+	}
+	while (running)
+		wait_app(&running, &failed);
+
+	if (!arg_quiet)
+		printf("%d programs, %d failed\n", total, failed);
+	exit((failed) ? 1 : 0);
+}
@@ -29,6 +29,10 @@
 #include <dirent.h>
 #include <sys/mount.h>
 #include <sys/wait.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <time.h>
 #include <errno.h>
 #include <limits.h>
 
@@ -201,40 +205,115 @@ static int random_display_number(void) {
 #endif
 
 #ifdef HAVE_X11
-void x11_start_xvfb(int argc, char **argv) {
-	EUID_ASSERT();
-	int i;
-	pid_t jail = 0;
-	pid_t server = 0;
+// The X servers started here write the display number on the -displayfd
+// descriptor once they accept connections. The server end of the pipe is
+// inherited across exec, and the string for the command line is in fd_str.
+static void x11_displayfd_open(int *fd, char *fd_str, size_t len) {
+	if (pipe2(fd, O_CLOEXEC) == -1)
+		errExit("pipe2");
+	snprintf(fd_str, len, "%d", fd[1]);
+}
 
-	env_store_name_val("FIREJAIL_X11", "yes", SETENV);
+// in the server process, after fork
+static void x11_displayfd_child(int *fd) {
+	close(fd[0]);
+	int flags = fcntl(fd[1], F_GETFD);
+	if (flags == -1 || fcntl(fd[1], F_SETFD, flags & ~FD_CLOEXEC) == -1)
+		errExit("fcntl");
+}
 
-	// never try to run X servers as root!!!
-	if (getuid() == 0) {
-		fprintf(stderr, "Error: X11 sandboxing is not available when running as root\n");
-		exit(1);
+// wait for the display number written by the server, 10 seconds at most;
+// the pipe is at end of file if the server doesn't start
+// return 0 if the server is ready
+static int x11_displayfd_wait(int *fd) {
+	close(fd[1]);
+	char buf[32];
+	size_t len = 0;
+	int rv = -1;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += 10;
+
+	while (len < sizeof(buf) - 1) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long ms = (end.tv_sec - now.tv_sec) * 1000 + (end.tv_nsec - now.tv_nsec) / 1000000;
+		if (ms <= 0)
+			break;
+		struct pollfd pfd = { fd[0], POLLIN, 0 };
+		int n = poll(&pfd, 1, (int) ms);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		ssize_t r = read(fd[0], buf + len, sizeof(buf) - 1 - len);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			break;
+		len += r;
+		if (memchr(buf, '\n', len)) {
+			rv = 0;
+			break;
+		}
 	}
-	drop_privs(0);
+	close(fd[0]);
+	return rv;
+}
 
-	// check xvfb
-	if (!program_in_path("Xvfb")) {
-		fprintf(stderr, "\nError: Xvfb program was not found in /usr/bin directory, please install it:\n");
-		fprintf(stderr, "   Debian/Ubuntu/Mint: sudo apt-get install xvfb\n");
-		fprintf(stderr, "   Arch: sudo pacman -S xorg-server-xvfb\n");
-		fprintf(stderr, "   Fedora: sudo dnf install xorg-x11-server-Xvfb\n");
-		exit(0);
+// wait for the socket of the display, 10 seconds at most, for the servers
+// without -displayfd; the socket directory is watched with inotify
+// return 0 if the socket is present
+static int x11_socket_wait(int display, pid_t server) {
+	char *fname;
+	if (asprintf(&fname, "/tmp/.X11-unix/X%d", display) == -1)
+		errExit("asprintf");
+	int ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ifd == -1)
+		errExit("inotify_init1");
+	int watchdir = 0;
+	int rv = -1;
+	int n;
+	// the server could still be creating the directory, it is checked
+	// again at most every 100 ms
+	for (n = 0; n < 100; n++) {
+		if (!watchdir && inotify_add_watch(ifd, "/tmp/.X11-unix", IN_CREATE | IN_MOVED_TO) != -1)
+			watchdir = 1;
+		if (access(fname, F_OK) == 0) {
+			rv = 0;
+			break;
+		}
+		if (waitpid(server, NULL, WNOHANG) == server)
+			break;
+
+		struct pollfd pfd = { ifd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) > 0) {
+			char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+			while (read(ifd, buf, sizeof(buf)) > 0)
+				;
+		}
 	}
+	close(ifd);
+	free(fname);
+	return rv;
+}
 
-	int display = random_display_number();
-	char *display_str;
-	if (asprintf(&display_str, ":%d", display) == -1)
-		errExit("asprintf");
+#define XVFB_ARGV_MAX 256
 
+// build the Xvfb command line; return the buffer holding the extra
+// parameters, to be freed by the caller
+static char *xvfb_argv(char **server_argv, char *display_str, char *fd_str) {
+	int i;
 	assert(xvfb_screen);
 
-	char *server_argv[256] = {		  // rest initialized to NULL
-		"Xvfb", display_str, "-screen", "0", xvfb_screen
-	};
+	memset(server_argv, 0, XVFB_ARGV_MAX * sizeof(char *));
+	server_argv[0] = "Xvfb";
+	server_argv[1] = display_str;
+	server_argv[2] = "-screen";
+	server_argv[3] = "0";
+	server_argv[4] = xvfb_screen;
+	server_argv[5] = "-displayfd";
+	server_argv[6] = fd_str;
 	unsigned pos = 0;
 	while (server_argv[pos] != NULL) pos++;
 	assert(xvfb_extra_params);		  // should be "" if empty
@@ -271,7 +350,7 @@ void x11_start_xvfb(int argc, char **argv) {
 
 		server_argv[pos++] = temp;
 		for (i = 0; i < (int) strlen(xvfb_extra_params)-1; i++) {
-			if (pos >= (sizeof(server_argv)/sizeof(*server_argv)) - 2) {
+			if (pos >= XVFB_ARGV_MAX - 2) {
 				fprintf(stderr, "Error: arg count limit exceeded while parsing xvfb_extra_params\n");
 				exit(1);
 			}
@@ -282,8 +361,23 @@ void x11_start_xvfb(int argc, char **argv) {
 
 	server_argv[pos++] = NULL;
 
-	assert(pos < (sizeof(server_argv)/sizeof(*server_argv))); // no overrun
+	assert(pos < XVFB_ARGV_MAX);		  // no overrun
 	assert(server_argv[pos-1] == NULL);	  // last element is null
+	return temp;
+}
+
+// start Xvfb on the display and wait until it is ready; a detached server
+// runs in its own session, without a terminal
+// return the pid of the server, 0 if the server didn't start
+static pid_t xvfb_start(int display, int detach) {
+	char *display_str;
+	if (asprintf(&display_str, ":%d", display) == -1)
+		errExit("asprintf");
+	int fd[2];
+	char fd_str[16];
+	x11_displayfd_open(fd, fd_str, sizeof(fd_str));
+	char *server_argv[XVFB_ARGV_MAX];
+	char *temp = xvfb_argv(server_argv, display_str, fd_str);
 
 	if (arg_debug) {
 		size_t i = 0;
@@ -295,40 +389,30 @@ void x11_start_xvfb(int argc, char **argv) {
 		printf(" ***\n\n");
 	}
 
-	// remove --x11 arg
-	char *jail_argv[argc+2];
-	int j = 0;
-	for (i = 0; i < argc; i++) {
-		if (strncmp(argv[i], "--x11", 5) == 0)
-			continue;
-		jail_argv[j] = argv[i];
-		j++;
-	}
-	jail_argv[j] = NULL;
-
-	assert(j < argc+2);			  // no overrun
-
-	if (arg_debug) {
-		size_t i = 0;
-		printf("\n*** Starting xvfb client:");
-		while (jail_argv[i]!=NULL) {
-			printf(" \"%s\"", jail_argv[i]);
-			i++;
-		}
-		printf(" ***\n\n");
-	}
-
-	server = fork();
+	pid_t server = fork();
 	if (server < 0)
 		errExit("fork");
 	if (server == 0) {
 		if (arg_debug)
 			printf("Starting xvfb...\n");
 
+		x11_displayfd_child(fd);
+		if (detach) {
+			setsid();
+			int fd = open("/dev/null", O_RDWR);
+			if (fd != -1) {
+				dup2(fd, STDIN_FILENO);
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+				if (fd > STDERR_FILENO)
+					close(fd);
+			}
+		}
+
 		// restore original environment variables
 		env_apply_all();
 
-		// running without privileges - see drop_privs call above
+		// running without privileges - see drop_privs calls
 		assert(env_get("LD_PRELOAD") == NULL);
 		assert(secure_getenv("LD_PRELOAD") == NULL);
 		execvp(server_argv[0], server_argv);
@@ -339,25 +423,344 @@ void x11_start_xvfb(int argc, char **argv) {
 	if (arg_debug)
 		printf("xvfb server pid %d\n", server);
 
-	// check X11 socket
+	int rv = x11_displayfd_wait(fd);
+	free(display_str);
+	free(temp);
+
+	if (rv) {
+		kill(server, SIGTERM);
+		return 0;
+	}
+	return server;
+}
+
+// Xvfb pool: servers started in advance by firejail --x11-pool=xvfb,size
+//
+// The servers run with the privileges of the user, and they are listed in
+// RUN_FIREJAIL_X11_DIR/<uid>: xvfb-<display> holds the pid of an idle server.
+// A sandbox claims a server by renaming its file to used-<display>-<pid>,
+// only one rename can succeed. The server is killed when the sandbox exits,
+// and the pool is refilled in the background; the servers are not reused,
+// a new client would find the windows and the selections of the old one.
+#define X11_POOL_MAX 16
+
+static char *x11_pool_fname(const char *name) {
 	char *fname;
-	if (asprintf(&fname, "/tmp/.X11-unix/X%d", display) == -1)
+	if (asprintf(&fname, "%s/%u/%s", RUN_FIREJAIL_X11_DIR, getuid(), name) == -1)
 		errExit("asprintf");
-	int n = 0;
-	// wait for x11 server to start
-	while (++n < 10) {
-		sleep(1);
-		if (access(fname, F_OK) == 0)
+	return fname;
+}
+
+// the server is an Xvfb process of the user
+static int xvfb_running(pid_t pid) {
+	if (pid <= 0)
+		return 0;
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/comm", (int) pid) == -1)
+		errExit("asprintf");
+	int rv = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		char comm[32];
+		struct stat s;
+		if (fgets(comm, sizeof(comm), fp) && strcmp(comm, "Xvfb\n") == 0 &&
+		    fstat(fileno(fp), &s) == 0 && s.st_uid == getuid())
+			rv = 1;
+		fclose(fp);
+	}
+	free(fname);
+	return rv;
+}
+
+static pid_t pool_read_pid(const char *fname) {
+	int pid = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		if (fscanf(fp, "%d", &pid) != 1)
+			pid = 0;
+		fclose(fp);
+	}
+	return pid;
+}
+
+static void pool_kill(const char *fname) {
+	pid_t pid = pool_read_pid(fname);
+	if (xvfb_running(pid))
+		kill(pid, SIGTERM);
+	unlink(fname);
+}
+
+static int pool_size(void) {
+	char *fname = x11_pool_fname("pool");
+	int size = 0;
+	FILE *fp = fopen(fname, "re");
+	if (fp) {
+		if (fscanf(fp, "%d", &size) != 1 || size < 0 || size > X11_POOL_MAX)
+			size = 0;
+		fclose(fp);
+	}
+	free(fname);
+	return size;
+}
+
+// count the idle servers, stop the servers above size and the servers of
+// the sandboxes gone
+static int pool_count(int size) {
+	char *dirname = x11_pool_fname("");
+	DIR *dir = opendir(dirname);
+	free(dirname);
+	if (!dir)
+		return 0;
+
+	int cnt = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		int display;
+		int owner;
+		char *fname = x11_pool_fname(entry->d_name);
+		if (sscanf(entry->d_name, "used-%d-%d", &display, &owner) == 2) {
+			if (kill(owner, 0) == -1 && errno == ESRCH)
+				pool_kill(fname);
+		}
+		else if (sscanf(entry->d_name, "xvfb-%d", &display) == 1) {
+			if (cnt >= size || !xvfb_running(pool_read_pid(fname)))
+				pool_kill(fname);
+			else
+				cnt++;
+		}
+		free(fname);
+	}
+	closedir(dir);
+	return cnt;
+}
+
+// start servers or stop idle servers until the pool has the configured size
+static void pool_fill(void) {
+	char *fname = x11_pool_fname("pool.lock");
+	int fd = open(fname, O_RDONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+	free(fname);
+	if (fd == -1 || flock(fd, LOCK_EX) == -1) {
+		fwarning("cannot lock the Xvfb pool\n");
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+
+	int size = pool_size();
+	int cnt = pool_count(size);
+	for (; cnt < size; cnt++) {
+		int display = random_display_number();
+		pid_t server = xvfb_start(display, 1);
+		if (!server) {
+			fwarning("cannot start Xvfb for the pool\n");
 			break;
-	};
+		}
+
+		// the server is visible only once the pid is in the file
+		char *tmp;
+		char *name;
+		if (asprintf(&tmp, "tmp-%d", display) == -1 ||
+		    asprintf(&name, "xvfb-%d", display) == -1)
+			errExit("asprintf");
+		char *tmpfname = x11_pool_fname(tmp);
+		char *fname = x11_pool_fname(name);
+		FILE *fp = fopen(tmpfname, "we");
+		if (!fp)
+			errExit("fopen");
+		fprintf(fp, "%d\n", server);
+		fclose(fp);
+		if (rename(tmpfname, fname) == -1)
+			errExit("rename");
+		free(tmpfname);
+		free(fname);
+		free(tmp);
+		free(name);
+	}
+	close(fd);	// this also releases the lock
+}
+
+// refill the pool in a process running in the background
+static void pool_refill(void) {
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child)
+		return;
+
+	// detach from the sandbox: nobody waits for this process
+	setsid();
+	int fd = open("/dev/null", O_RDWR);
+	if (fd != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+	pool_fill();
+	_exit(0);
+}
+
+// claim an idle server; return its pid, 0 if the pool is empty
+static pid_t pool_claim(int *display, char **used) {
+	char *dirname = x11_pool_fname("");
+	DIR *dir = opendir(dirname);
+	free(dirname);
+	if (!dir)
+		return 0;
+
+	pid_t server = 0;
+	struct dirent *entry;
+	while (!server && (entry = readdir(dir)) != NULL) {
+		if (sscanf(entry->d_name, "xvfb-%d", display) != 1)
+			continue;
+		char *name;
+		if (asprintf(&name, "used-%d-%d", *display, (int) getpid()) == -1)
+			errExit("asprintf");
+		char *fname = x11_pool_fname(entry->d_name);
+		*used = x11_pool_fname(name);
+		free(name);
+		// another sandbox could be faster
+		if (rename(fname, *used) == 0) {
+			server = pool_read_pid(*used);
+			if (!xvfb_running(server)) {
+				unlink(*used);
+				server = 0;
+			}
+		}
+		if (!server)
+			free(*used);
+		free(fname);
+	}
+	closedir(dir);
+	return server;
+}
+
+// --x11-pool=xvfb,size: keep size Xvfb servers ready for the sandboxes
+// started with --x11=xvfb; size 0 stops the servers
+void x11_pool(const char *arg) {
+	EUID_ASSERT();
+	if (strncmp(arg, "xvfb,", 5)) {
+		fprintf(stderr, "Error: invalid --x11-pool option, xvfb,size expected\n");
+		exit(1);
+	}
+	char *end;
+	long size = strtol(arg + 5, &end, 10);
+	if (end == arg + 5 || *end != '\0' || size < 0 || size > X11_POOL_MAX) {
+		fprintf(stderr, "Error: invalid Xvfb pool size, a number between 0 and %d expected\n", X11_POOL_MAX);
+		exit(1);
+	}
+
+	// never try to run X servers as root!!!
+	if (getuid() == 0) {
+		fprintf(stderr, "Error: X11 sandboxing is not available when running as root\n");
+		exit(1);
+	}
+	if (size && !program_in_path("Xvfb")) {
+		fprintf(stderr, "Error: Xvfb program was not found\n");
+		exit(1);
+	}
 
-	if (n == 10) {
-		fprintf(stderr, "Error: failed to start xvfb\n");
+	// the directory of the user in RUN_FIREJAIL_X11_DIR
+	char *dirname = x11_pool_fname("");
+	struct stat s;
+	if (lstat(dirname, &s) == -1) {
+		EUID_ROOT();
+		mkdir_attr(dirname, 0700, getuid(), getgid());
+		EUID_USER();
+	}
+	else if (!S_ISDIR(s.st_mode) || s.st_uid != getuid()) {
+		fprintf(stderr, "Error: invalid %s directory\n", dirname);
 		exit(1);
 	}
+	free(dirname);
+	drop_privs(0);
+
+	char *fname = x11_pool_fname("pool");
+	if (size) {
+		FILE *fp = fopen(fname, "we");
+		if (!fp) {
+			fprintf(stderr, "Error: cannot create %s\n", fname);
+			exit(1);
+		}
+		fprintf(fp, "%ld\n", size);
+		fclose(fp);
+	}
+	else
+		unlink(fname);
 	free(fname);
 
-	assert(display_str);
+	pool_fill();
+}
+
+void x11_start_xvfb(int argc, char **argv) {
+	EUID_ASSERT();
+	int i;
+	pid_t jail = 0;
+	pid_t server = 0;
+
+	env_store_name_val("FIREJAIL_X11", "yes", SETENV);
+
+	// never try to run X servers as root!!!
+	if (getuid() == 0) {
+		fprintf(stderr, "Error: X11 sandboxing is not available when running as root\n");
+		exit(1);
+	}
+	drop_privs(0);
+
+	// check xvfb
+	if (!program_in_path("Xvfb")) {
+		fprintf(stderr, "\nError: Xvfb program was not found in /usr/bin directory, please install it:\n");
+		fprintf(stderr, "   Debian/Ubuntu/Mint: sudo apt-get install xvfb\n");
+		fprintf(stderr, "   Arch: sudo pacman -S xorg-server-xvfb\n");
+		fprintf(stderr, "   Fedora: sudo dnf install xorg-x11-server-Xvfb\n");
+		exit(0);
+	}
+
+	// a server from the pool, or a new one
+	int display;
+	char *used = NULL;
+	if (pool_size() && (server = pool_claim(&display, &used)) != 0) {
+		if (arg_debug)
+			printf("xvfb server pid %d from the pool\n", server);
+		pool_refill();
+	}
+	else {
+		display = random_display_number();
+		server = xvfb_start(display, 0);
+		if (!server) {
+			fprintf(stderr, "Error: failed to start xvfb\n");
+			exit(1);
+		}
+	}
+
+	char *display_str;
+	if (asprintf(&display_str, ":%d", display) == -1)
+		errExit("asprintf");
+
+	// remove --x11 arg
+	char *jail_argv[argc+2];
+	int j = 0;
+	for (i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--x11", 5) == 0)
+			continue;
+		jail_argv[j] = argv[i];
+		j++;
+	}
+	jail_argv[j] = NULL;
+
+	assert(j < argc+2);			  // no overrun
+
+	if (arg_debug) {
+		size_t i = 0;
+		printf("\n*** Starting xvfb client:");
+		while (jail_argv[i]!=NULL) {
+			printf(" \"%s\"", jail_argv[i]);
+			i++;
+		}
+		printf(" ***\n\n");
+	}
+
 	env_store_name_val("DISPLAY", display_str, SETENV);
 	// run attach command
 	jail = fork();
@@ -379,7 +782,14 @@ void x11_start_xvfb(int argc, char **argv) {
 
 	// cleanup
 	free(display_str);
-	free(temp);
+
+	// a pool server is not a child of this process
+	if (used) {
+		waitpid(jail, NULL, 0);
+		pool_kill(used);
+		free(used);
+		exit(0);
+	}
 
 	// wait for either server or jail termination
 	pid_t pid = wait(NULL);
@@ -400,7 +810,6 @@ void x11_start_xvfb(int argc, char **argv) {
 	exit(0);
 }
 
-
 static char *extract_setting(int argc, char **argv, const char *argument) {
 	int i;
 	int len = strlen(argument);
@@ -520,6 +929,11 @@ void x11_start_xephyr(int argc, char **argv) {
 		}
 	}
 
+	int fd[2];
+	char fd_str[16];
+	x11_displayfd_open(fd, fd_str, sizeof(fd_str));
+	server_argv[pos++] = "-displayfd";
+	server_argv[pos++] = fd_str;
 	server_argv[pos++] = display_str;
 	server_argv[pos++] = NULL;
 
@@ -566,6 +980,7 @@ void x11_start_xephyr(int argc, char **argv) {
 	if (server == 0) {
 		if (arg_debug)
 			printf("Starting xephyr...\n");
+		x11_displayfd_child(fd);
 
 		// restore original environment variables
 		env_apply_all();
@@ -581,23 +996,11 @@ void x11_start_xephyr(int argc, char **argv) {
 	if (arg_debug)
 		printf("xephyr server pid %d\n", server);
 
-	// check X11 socket
-	char *fname;
-	if (asprintf(&fname, "/tmp/.X11-unix/X%d", display) == -1)
-		errExit("asprintf");
-	int n = 0;
 	// wait for x11 server to start
-	while (++n < 10) {
-		sleep(1);
-		if (access(fname, F_OK) == 0)
-			break;
-	};
-
-	if (n == 10) {
+	if (x11_displayfd_wait(fd)) {
 		fprintf(stderr, "Error: failed to start xephyr\n");
 		exit(1);
 	}
-	free(fname);
 
 	assert(display_str);
 	env_store_name_val("DISPLAY", display_str, SETENV);
@@ -812,23 +1215,11 @@ static void __attribute__((noreturn)) x11_start_xpra_old(int argc, char **argv,
 	// add a small delay, on some systems it takes some time for the server to start
 	sleep(5);
 
-	// check X11 socket
-	char *fname;
-	if (asprintf(&fname, "/tmp/.X11-unix/X%d", display) == -1)
-		errExit("asprintf");
-	int n = 0;
 	// wait for x11 server to start
-	while (++n < 10) {
-		sleep(1);
-		if (access(fname, F_OK) == 0)
-			break;
-	}
-
-	if (n == 10) {
+	if (x11_socket_wait(display, server)) {
 		fprintf(stderr, "Error: failed to start xpra\n");
 		exit(1);
 	}
-	free(fname);
 
 	// build attach command
 
@@ -927,6 +1318,7 @@ static void __attribute__((noreturn)) x11_start_xpra_old(int argc, char **argv,
 			}
 
 			// wait for xpra server to stop, 10 seconds limit
+			int n = 0;
 			while (++n < 10) {
 				sleep(1);
 				pid = waitpid(server, NULL, WNOHANG);
@@ -1180,32 +1572,6 @@ void x11_xorg(void) {
 		exit(1);
 	}
 
-	// check xauth utility is present in the system
-	struct stat s;
-	if (stat("/usr/bin/xauth", &s) == -1) {
-		fprintf(stderr, "Error: xauth utility not found in /usr/bin. Please install it:\n");
-		fprintf(stderr, "   Debian/Ubuntu/Mint: sudo apt-get install xauth\n");
-		fprintf(stderr, "   Arch: sudo pacman -S xorg-xauth\n");
-		fprintf(stderr, "   Fedora: sudo dnf install xorg-x11-xauth\n");
-		exit(1);
-	}
-	if ((s.st_uid != 0 && s.st_gid != 0) || (s.st_mode & S_IWOTH)) {
-		fprintf(stderr, "Error: invalid /usr/bin/xauth executable\n");
-		exit(1);
-	}
-	if (s.st_size > 1024 * 1024) {
-		fprintf(stderr, "Error: /usr/bin/xauth executable is too large\n");
-		exit(1);
-	}
-	// copy /usr/bin/xauth in the sandbox and set mode to 0711
-	// users are not able to trace the running xauth this way
-	if (arg_debug)
-		printf("Copying /usr/bin/xauth to %s\n", RUN_XAUTH_FILE);
-	if (copy_file("/usr/bin/xauth", RUN_XAUTH_FILE, 0, 0, 0711)) {
-		fprintf(stderr, "Error: cannot copy /usr/bin/xauth executable\n");
-		exit(1);
-	}
-
 	fmessage("Generating a new .Xauthority file\n");
 	mkdir_attr(RUN_XAUTHORITY_SEC_DIR, 0700, getuid(), getgid());
 	// create new Xauthority file in RUN_XAUTHORITY_SEC_DIR
@@ -1218,13 +1584,11 @@ void x11_xorg(void) {
 	}
 	close(fd);
 
-	// run xauth
-	if (arg_debug)
-		sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 8, RUN_XAUTH_FILE, "-v", "-f", tmpfname,
-			"generate", display, "MIT-MAGIC-COOKIE-1", "untrusted");
-	else
-		sbox_run(SBOX_USER | SBOX_CAPS_NONE | SBOX_SECCOMP, 7, RUN_XAUTH_FILE, "-f", tmpfname,
-			"generate", display, "MIT-MAGIC-COOKIE-1", "untrusted");
+	// request an untrusted cookie from the X server
+	if (xauth_generate(display, tmpfname)) {
+		fprintf(stderr, "Error: cannot generate a new .Xauthority file\n");
+		exit(1);
+	}
 
 	// ensure there is already a file ~/.Xauthority, so that bind-mount below will work.
 	char *dest;
@@ -1238,6 +1602,7 @@ void x11_xorg(void) {
 		}
 	}
 	// get a file descriptor for ~/.Xauthority
+	struct stat s;
 	int dst = safer_openat(-1, dest, O_PATH|O_NOFOLLOW|O_CLOEXEC);
 	if (dst == -1)
 		errExit("safer_openat");
@@ -1312,9 +1677,6 @@ void x11_xorg(void) {
 	if (mount("tmpfs", RUN_XAUTHORITY_SEC_DIR, "tmpfs", MS_NOSUID | MS_NODEV | MS_STRICTATIME,  "mode=755,gid=0") < 0)
 		errExit("mounting tmpfs");
 	fs_logger2("tmpfs", RUN_XAUTHORITY_SEC_DIR);
-
-	// cleanup
-	unlink(RUN_XAUTH_FILE);
 #endif
 }
 
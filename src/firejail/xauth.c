@@ -0,0 +1,548 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firejail.h"
+#include "../include/gcov_wrapper.h"
+
+#ifdef HAVE_X11
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// --x11=xorg: an untrusted MIT-MAGIC-COOKIE-1 authorization is requested
+// from the X server with the SECURITY extension and written in an
+// .Xauthority file, the same as "xauth generate display MIT-MAGIC-COOKIE-1
+// untrusted". The user's own cookie for the display is looked up in
+// XAUTHORITY or ~/.Xauthority, the connection is attempted without one if
+// none is found. The protocol is handled by a child process running as the
+// user.
+#define X_TCP_PORT 6000
+#define X_UNIX_PATH "/tmp/.X11-unix/X"
+#define X_TIMEOUT 10			// seconds
+#define AUTH_FILE_MAX (1024 * 1024)
+#define AUTH_NAME "MIT-MAGIC-COOKIE-1"
+#define AUTH_NAME_LEN 18
+
+// Xauth families, see Xauth.h and X.h
+#define FAMILY_INTERNET 0
+#define FAMILY_INTERNET6 6
+#define FAMILY_LOCAL 256
+#define FAMILY_WILD 65535
+
+// protocol requests and SECURITY extension values, see Xproto.h and
+// securproto.h
+#define X_QUERY_EXTENSION 98
+#define X_SECURITY_QUERY_VERSION 0
+#define X_SECURITY_GENERATE_AUTHORIZATION 1
+#define X_SECURITY_TRUST_LEVEL (1 << 1)
+#define X_SECURITY_CLIENT_UNTRUSTED 1
+
+typedef struct {
+	int unix_socket;	// unix domain socket, otherwise TCP
+	char *host;
+	int number;
+	char number_str[16];
+	// authorization key
+	uint16_t family;
+	unsigned char addr[256];
+	uint16_t addr_len;
+} XDisplay;
+
+typedef struct {
+	unsigned char *data;
+	uint16_t len;
+} XCookie;
+
+static inline size_t pad4(size_t len) {
+	return (len + 3) & ~((size_t) 3);
+}
+
+// DISPLAY is [protocol/][host]:number[.screen]
+static int parse_display(const char *display, XDisplay *d) {
+	memset(d, 0, sizeof(*d));
+	const char *ptr = strrchr(display, ':');
+	if (!ptr || ptr == display + strlen(display) - 1)
+		return -1;
+	const char *slash = strchr(display, '/');
+	if (slash && slash < ptr) {
+		if (strncmp(display, "unix/", 5) != 0 && strncmp(display, "tcp/", 4) != 0 &&
+		    strncmp(display, "inet/", 5) != 0 && strncmp(display, "inet6/", 6) != 0)
+			return -1;
+		display = slash + 1;
+	}
+	if (ptr > display && ptr[-1] == ':')	// DECnet
+		return -1;
+	d->host = strndup(display, ptr - display);
+	if (!d->host)
+		errExit("strndup");
+	// [::1]:0
+	if (d->host[0] == '[' && strlen(d->host) > 2 && d->host[strlen(d->host) - 1] == ']') {
+		memmove(d->host, d->host + 1, strlen(d->host) - 2);
+		d->host[strlen(d->host) - 2] = '\0';
+	}
+
+	ptr++;
+	char *end;
+	errno = 0;
+	long n = strtol(ptr, &end, 10);
+	if (errno || end == ptr || (*end != '\0' && *end != '.') || n < 0 || n > 65535 - X_TCP_PORT)
+		return -1;
+	d->number = (int) n;
+	snprintf(d->number_str, sizeof(d->number_str), "%d", d->number);
+	d->unix_socket = (*d->host == '\0' || strcmp(d->host, "unix") == 0);
+	return 0;
+}
+
+// the cookies of local displays are stored under the host name
+static void set_local_key(XDisplay *d) {
+	char hostname[sizeof(d->addr)];
+	if (gethostname(hostname, sizeof(hostname)) == -1)
+		errExit("gethostname");
+	hostname[sizeof(hostname) - 1] = '\0';
+	d->family = FAMILY_LOCAL;
+	d->addr_len = strlen(hostname);
+	memcpy(d->addr, hostname, d->addr_len);
+}
+
+static int connect_unix(XDisplay *d) {
+	set_local_key(d);
+
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s%d", X_UNIX_PATH, d->number);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &sa, sizeof(sa)) == 0)
+		return fd;
+
+	// abstract socket, not available in a new network namespace
+	memmove(sa.sun_path + 1, sa.sun_path, strlen(sa.sun_path) + 1);
+	sa.sun_path[0] = '\0';
+	socklen_t len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(sa.sun_path + 1);
+	if (connect(fd, (struct sockaddr *) &sa, len) == 0)
+		return fd;
+	close(fd);
+	return -1;
+}
+
+static int connect_tcp(XDisplay *d) {
+	char port[16];
+	snprintf(port, sizeof(port), "%d", X_TCP_PORT + d->number);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *res;
+	if (getaddrinfo(d->host, port, &hints, &res) != 0)
+		return -1;
+
+	int fd = -1;
+	struct addrinfo *ai;
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd == -1)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	if (fd == -1) {
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	// a loopback connection is a local display, as in Xlib
+	if (ai->ai_family == AF_INET) {
+		struct in_addr *a = &((struct sockaddr_in *) ai->ai_addr)->sin_addr;
+		if ((ntohl(a->s_addr) >> 24) == 127)
+			set_local_key(d);
+		else {
+			d->family = FAMILY_INTERNET;
+			d->addr_len = sizeof(*a);
+			memcpy(d->addr, a, d->addr_len);
+		}
+	}
+	else {
+		struct in6_addr *a = &((struct sockaddr_in6 *) ai->ai_addr)->sin6_addr;
+		if (IN6_IS_ADDR_LOOPBACK(a))
+			set_local_key(d);
+		else if (IN6_IS_ADDR_V4MAPPED(a)) {
+			d->family = FAMILY_INTERNET;
+			d->addr_len = 4;
+			memcpy(d->addr, a->s6_addr + 12, d->addr_len);
+		}
+		else {
+			d->family = FAMILY_INTERNET6;
+			d->addr_len = sizeof(*a);
+			memcpy(d->addr, a, d->addr_len);
+		}
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+	unsigned char *ptr = buf;
+	while (len) {
+		ssize_t rv = read(fd, ptr, len);
+		if (rv == -1 && errno == EINTR)
+			continue;
+		if (rv <= 0)
+			return -1;
+		ptr += rv;
+		len -= rv;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+	const unsigned char *ptr = buf;
+	while (len) {
+		ssize_t rv = write(fd, ptr, len);
+		if (rv == -1 && errno == EINTR)
+			continue;
+		if (rv <= 0)
+			return -1;
+		ptr += rv;
+		len -= rv;
+	}
+	return 0;
+}
+
+// big-endian counted string, as stored in .Xauthority files
+static int read_counted(const unsigned char **ptr, const unsigned char *end, const unsigned char **str, uint16_t *len) {
+	if (end - *ptr < 2)
+		return -1;
+	*len = (uint16_t) ((*ptr)[0] << 8 | (*ptr)[1]);
+	*ptr += 2;
+	if (end - *ptr < *len)
+		return -1;
+	*str = *ptr;
+	*ptr += *len;
+	return 0;
+}
+
+// the user's MIT-MAGIC-COOKIE-1 for the display; for a local display an
+// entry stored under a different host name is used if there is no exact
+// match, the host name of the sandbox can be changed with --hostname
+static void find_cookie(const XDisplay *d, XCookie *cookie) {
+	cookie->data = NULL;
+	cookie->len = 0;
+
+	char *fname = NULL;
+	const char *env = env_get("XAUTHORITY");
+	if (env && *env)
+		fname = strdup(env);
+	else if (asprintf(&fname, "%s/.Xauthority", cfg.homedir) == -1)
+		errExit("asprintf");
+	if (!fname)
+		errExit("strdup");
+	int fd = open(fname, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	free(fname);
+	if (fd == -1)
+		return;
+	struct stat s;
+	if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode) || s.st_size > AUTH_FILE_MAX) {
+		close(fd);
+		return;
+	}
+	unsigned char *buf = malloc(s.st_size + 1);
+	if (!buf)
+		errExit("malloc");
+	if (read_full(fd, buf, s.st_size) == -1) {
+		close(fd);
+		free(buf);
+		return;
+	}
+	close(fd);
+
+	const unsigned char *ptr = buf;
+	const unsigned char *end = buf + s.st_size;
+	int best = 0;		// 2 exact match, 1 local entry with a different host name
+	while (end - ptr >= 2) {
+		uint16_t family = (uint16_t) (ptr[0] << 8 | ptr[1]);
+		ptr += 2;
+		const unsigned char *addr, *number, *name, *data;
+		uint16_t addr_len, number_len, name_len, data_len;
+		if (read_counted(&ptr, end, &addr, &addr_len) ||
+		    read_counted(&ptr, end, &number, &number_len) ||
+		    read_counted(&ptr, end, &name, &name_len) ||
+		    read_counted(&ptr, end, &data, &data_len))
+			break;
+
+		if (name_len != AUTH_NAME_LEN || memcmp(name, AUTH_NAME, AUTH_NAME_LEN) != 0)
+			continue;
+		if (number_len && (number_len != strlen(d->number_str) || memcmp(number, d->number_str, number_len) != 0))
+			continue;
+		int match = 0;
+		if (family == FAMILY_WILD ||
+		    (family == d->family && addr_len == d->addr_len && memcmp(addr, d->addr, addr_len) == 0))
+			match = 2;
+		else if (family == FAMILY_LOCAL && d->family == FAMILY_LOCAL)
+			match = 1;
+		if (match > best) {
+			best = match;
+			free(cookie->data);
+			cookie->data = malloc(data_len ? data_len : 1);
+			if (!cookie->data)
+				errExit("malloc");
+			memcpy(cookie->data, data, data_len);
+			cookie->len = data_len;
+			if (best == 2)
+				break;
+		}
+	}
+	free(buf);
+}
+
+static int x_setup(int fd, const XCookie *cookie) {
+	uint16_t one = 1;
+	unsigned char req[12 + pad4(AUTH_NAME_LEN) + pad4(UINT16_MAX)];
+	memset(req, 0, sizeof(req));
+	req[0] = (*(unsigned char *) &one) ? 'l' : 'B';	// native byte order
+	uint16_t val = 11;	// protocol version 11.0
+	memcpy(req + 2, &val, 2);
+	val = 0;
+	memcpy(req + 4, &val, 2);
+	size_t len = 12;
+	if (cookie->data) {
+		val = AUTH_NAME_LEN;
+		memcpy(req + 6, &val, 2);
+		memcpy(req + 8, &cookie->len, 2);
+		memcpy(req + len, AUTH_NAME, AUTH_NAME_LEN);
+		len += pad4(AUTH_NAME_LEN);
+		memcpy(req + len, cookie->data, cookie->len);
+		len += pad4(cookie->len);
+	}
+	if (write_full(fd, req, len) == -1)
+		return -1;
+
+	// success, failure or authenticate, followed by the additional data
+	unsigned char reply[8];
+	if (read_full(fd, reply, sizeof(reply)) == -1)
+		return -1;
+	uint16_t extra;
+	memcpy(&extra, reply + 6, 2);
+	size_t extra_len = (size_t) extra * 4;
+	unsigned char *data = malloc(extra_len + 1);
+	if (!data)
+		errExit("malloc");
+	if (read_full(fd, data, extra_len) == -1) {
+		free(data);
+		return -1;
+	}
+	if (reply[0] != 1) {
+		size_t reason = (reply[0] == 0) ? reply[1] : extra_len;
+		if (reason > extra_len)
+			reason = extra_len;
+		fprintf(stderr, "Error: the X server refused the connection: %.*s\n", (int) reason, (char *) data);
+		free(data);
+		return -1;
+	}
+	free(data);
+	return 0;
+}
+
+// 32 bytes reply and the additional data; -1 for an X error
+static int x_reply(int fd, unsigned char reply[32], unsigned char **extra, size_t *extra_len) {
+	if (read_full(fd, reply, 32) == -1)
+		return -1;
+	if (reply[0] == 0) {
+		fprintf(stderr, "Error: X protocol error %u, request %u.%u\n", reply[1], reply[10], reply[8]);
+		return -1;
+	}
+	if (reply[0] != 1)	// an event, the client did not select any
+		return -1;
+	uint32_t len;
+	memcpy(&len, reply + 4, 4);
+	if (len > AUTH_FILE_MAX / 4)
+		return -1;
+	*extra_len = (size_t) len * 4;
+	*extra = malloc(*extra_len + 1);
+	if (!*extra)
+		errExit("malloc");
+	if (read_full(fd, *extra, *extra_len) == -1) {
+		free(*extra);
+		*extra = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int x_generate(int fd, XCookie *untrusted) {
+	// QueryExtension SECURITY, SECURITY QueryVersion 1.0 and
+	// GenerateAuthorization go in a single write once the opcode is known
+	unsigned char req[8 + 12 + 20 + 4];
+	memset(req, 0, sizeof(req));
+	req[0] = X_QUERY_EXTENSION;
+	uint16_t val = 4;
+	memcpy(req + 2, &val, 2);
+	val = 8;
+	memcpy(req + 4, &val, 2);
+	memcpy(req + 8, "SECURITY", 8);
+	if (write_full(fd, req, 16) == -1)
+		return -1;
+	unsigned char reply[32];
+	unsigned char *extra;
+	size_t extra_len;
+	if (x_reply(fd, reply, &extra, &extra_len) == -1)
+		return -1;
+	free(extra);
+	if (!reply[8]) {
+		fprintf(stderr, "Error: the X server does not support the SECURITY extension\n");
+		return -1;
+	}
+	unsigned char opcode = reply[9];
+
+	memset(req, 0, sizeof(req));
+	req[0] = opcode;
+	req[1] = X_SECURITY_QUERY_VERSION;
+	val = 2;
+	memcpy(req + 2, &val, 2);
+	val = 1;
+	memcpy(req + 4, &val, 2);
+	unsigned char *gen = req + 8;
+	gen[0] = opcode;
+	gen[1] = X_SECURITY_GENERATE_AUTHORIZATION;
+	val = (12 + pad4(AUTH_NAME_LEN) + 4) / 4;	// header, padded name and one value
+	memcpy(gen + 2, &val, 2);
+	val = AUTH_NAME_LEN;
+	memcpy(gen + 4, &val, 2);
+	uint32_t mask = X_SECURITY_TRUST_LEVEL;
+	memcpy(gen + 8, &mask, 4);
+	memcpy(gen + 12, AUTH_NAME, AUTH_NAME_LEN);
+	uint32_t trust = X_SECURITY_CLIENT_UNTRUSTED;
+	memcpy(gen + 12 + pad4(AUTH_NAME_LEN), &trust, 4);
+	if (write_full(fd, req, sizeof(req)) == -1)
+		return -1;
+
+	if (x_reply(fd, reply, &extra, &extra_len) == -1)
+		return -1;
+	free(extra);
+	if (x_reply(fd, reply, &extra, &extra_len) == -1)
+		return -1;
+	uint16_t data_len;
+	memcpy(&data_len, reply + 12, 2);
+	if (data_len == 0 || data_len > extra_len) {
+		free(extra);
+		return -1;
+	}
+	untrusted->data = extra;
+	untrusted->len = data_len;
+	return 0;
+}
+
+static void put_counted(unsigned char **ptr, const void *data, uint16_t len) {
+	(*ptr)[0] = (unsigned char) (len >> 8);
+	(*ptr)[1] = (unsigned char) len;
+	memcpy(*ptr + 2, data, len);
+	*ptr += 2 + len;
+}
+
+static int write_auth_file(const char *fname, const XDisplay *d, const XCookie *cookie) {
+	unsigned char buf[2 + 2 + sizeof(d->addr) + 2 + sizeof(d->number_str) + 2 + AUTH_NAME_LEN + 2 + UINT16_MAX];
+	unsigned char *ptr = buf;
+	ptr[0] = (unsigned char) (d->family >> 8);
+	ptr[1] = (unsigned char) d->family;
+	ptr += 2;
+	put_counted(&ptr, d->addr, d->addr_len);
+	put_counted(&ptr, d->number_str, strlen(d->number_str));
+	put_counted(&ptr, AUTH_NAME, AUTH_NAME_LEN);
+	put_counted(&ptr, cookie->data, cookie->len);
+
+	int fd = open(fname, O_WRONLY | O_TRUNC | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	int rv = write_full(fd, buf, ptr - buf);
+	if (close(fd))
+		rv = -1;
+	return rv;
+}
+
+static int generate(const char *display, const char *fname) {
+	XDisplay d;
+	if (parse_display(display, &d) == -1) {
+		fprintf(stderr, "Error: cannot parse DISPLAY %s\n", display);
+		return -1;
+	}
+	int fd = (d.unix_socket) ? connect_unix(&d) : connect_tcp(&d);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot connect to X server %s\n", display);
+		return -1;
+	}
+	struct timeval tv = { X_TIMEOUT, 0 };
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1 ||
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1)
+		errExit("setsockopt");
+
+	XCookie cookie;
+	find_cookie(&d, &cookie);
+	if (arg_debug)
+		printf("Connecting to X server %s %s\n", display, (cookie.data) ? "with the user's cookie" : "without a cookie");
+	int rv = x_setup(fd, &cookie);
+	free(cookie.data);
+	if (rv == 0) {
+		XCookie untrusted;
+		rv = x_generate(fd, &untrusted);
+		if (rv == 0) {
+			rv = write_auth_file(fname, &d, &untrusted);
+			free(untrusted.data);
+		}
+	}
+	close(fd);
+	free(d.host);
+	return rv;
+}
+
+// return 0 if the file was written
+int xauth_generate(const char *display, const char *fname) {
+	EUID_ASSERT();
+	assert(display);
+	assert(fname);
+
+	pid_t child = fork();
+	if (child < 0)
+		errExit("fork");
+	if (child == 0) {
+		// drop privileges
+		drop_privs(0);
+
+		int rv = generate(display, fname);
+		if (rv == 0 && arg_debug)
+			printf("Untrusted X11 cookie written in %s\n", fname);
+
+		__gcov_flush();
+
+		_exit((rv == 0) ? 0 : 1);
+	}
+	// wait for the child to finish
+	int status;
+	if (waitpid(child, &status, 0) == -1)
+		errExit("waitpid");
+	return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+#endif
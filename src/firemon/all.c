@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+
+// --all: the per-sandbox views in a single report. For every sandbox
+// /proc/<pid> is opened once, status is read once for the CPU affinity, the
+// capabilities and the seccomp mode, and a single netlink socket in the
+// network namespace of the sandbox is used for the route and ARP tables.
+void all(pid_t pid) {
+	static const char *const fields[] = { "CapBnd:", "Seccomp:", "Cpus_allowed_list:", NULL };
+	pid_snapshot(pid);
+
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level != 1)
+			continue;
+		pid_print_list(i, arg_wrap);
+		x11_print(pids[i].pid);
+		int child = find_child(i);
+		if (child == -1) {
+			printf("\n");
+			continue;
+		}
+
+		int procfd = proc_open(child);
+		proc_print_status(child, procfd, fields);
+		apparmor_print(child);
+#ifdef HAVE_NETWORK
+		int sock = rtnl_open(procfd);
+		route_print(procfd, sock);
+		arp_print(procfd, sock);
+		rtnl_close(sock);
+#endif
+		if (procfd != -1)
+			close(procfd);
+		printf("\n");
+	}
+}
@@ -22,7 +22,7 @@
 #ifdef HAVE_APPARMOR
 #include <sys/apparmor.h>
 
-static void print_apparmor(int pid) {
+void apparmor_print(pid_t pid) {
 	char *label = NULL;
 	char *mode = NULL;
 	int rv = aa_gettaskcon(pid, &label, &mode);
@@ -37,17 +37,17 @@ static void print_apparmor(int pid) {
 }
 
 void apparmor(pid_t pid, int print_procs) {
-	pid_read(pid);
+	pid_snapshot(pid);
 
 	// print processes
 	int i;
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
 			if (print_procs || pid == 0)
 				pid_print_list(i, arg_wrap);
 			int child = find_child(i);
 			if (child != -1)
-				print_apparmor(child);
+				apparmor_print(child);
 		}
 	}
 	printf("\n");
@@ -55,6 +55,10 @@ void apparmor(pid_t pid, int print_procs) {
 
 #else
 
+void apparmor_print(pid_t pid) {
+	(void) pid;
+}
+
 void apparmor(pid_t pid, int print_procs) {
 	(void) pid;
 	(void) print_procs;
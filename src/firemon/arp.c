@@ -20,8 +20,7 @@
 #include "firemon.h"
 #define MAXBUF 4096
 
-static void print_arp(const char *fname) {
-	FILE *fp = fopen(fname, "r");
+static void print_arp(FILE *fp) {
 	if (!fp)
 		return;
 
@@ -72,22 +71,34 @@ static void print_arp(const char *fname) {
 
 }
 
+// ARP table of the network namespace of the process
+// sock: NETLINK_ROUTE socket opened with rtnl_open, or -1
+void arp_print(int procfd, int sock) {
+	if (sock != -1 && rtnl_print_arp(sock) == 0)
+		return;
+	if (procfd == -1)
+		return;
+
+	print_arp(proc_fopen(procfd, "net/arp"));
+}
+
 void arp(pid_t pid, int print_procs) {
-	pid_read(pid);
+	pid_snapshot(pid);
 
 	// print processes
 	int i;
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
 			if (print_procs || pid == 0)
 				pid_print_list(i, arg_wrap);
 			int child = find_child(i);
 			if (child != -1) {
-				char *fname;
-				if (asprintf(&fname, "/proc/%d/net/arp", child) == -1)
-					errExit("asprintf");
-				print_arp(fname);
-				free(fname);
+				int procfd = proc_open(child);
+				int sock = rtnl_open(procfd);
+				arp_print(procfd, sock);
+				rtnl_close(sock);
+				if (procfd != -1)
+					close(procfd);
 			}
 		}
 	}
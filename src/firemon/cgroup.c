@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include "../include/rundefs.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MAXBUF 4096
+
+// Sandboxes started with --cgroup-leaf run in their own cgroup v2 leaf,
+// the path is stored in RUN_FIREJAIL_CGROUP_DIR/<pid>. A few files in
+// the leaf replace the /proc reads for every process in the sandbox,
+// and they include the processes already exited.
+
+static FILE *leaf_fopen(const char *leaf, const char *name) {
+	char *fname;
+	if (asprintf(&fname, "%s/%s", leaf, name) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	return fp;
+}
+
+// flat keyed file: "key value" lines
+static int read_key(const char *leaf, const char *name, const char *key, unsigned long long *val) {
+	FILE *fp = leaf_fopen(leaf, name);
+	if (!fp)
+		return -1;
+
+	char buf[MAXBUF];
+	int len = strlen(key);
+	int rv = -1;
+	while (fgets(buf, MAXBUF, fp)) {
+		if (strncmp(buf, key, len) == 0 && buf[len] == ' ' &&
+		    sscanf(buf + len + 1, "%llu", val) == 1) {
+			rv = 0;
+			break;
+		}
+	}
+	fclose(fp);
+	return rv;
+}
+
+static void read_cpu(const char *leaf, CgroupStats *st) {
+	FILE *fp = leaf_fopen(leaf, "cpu.stat");
+	if (!fp)
+		return;
+
+	char buf[MAXBUF];
+	int found = 0;
+	while (fgets(buf, MAXBUF, fp)) {
+		if (sscanf(buf, "user_usec %llu", &st->user_usec) == 1)
+			found |= 1;
+		else if (sscanf(buf, "system_usec %llu", &st->system_usec) == 1)
+			found |= 2;
+	}
+	fclose(fp);
+	st->cpu = (found == 3);
+}
+
+static void read_memory(const char *leaf, CgroupStats *st) {
+	// the files are present only if the memory controller is enabled
+	FILE *fp = leaf_fopen(leaf, "memory.current");
+	if (!fp)
+		return;
+	int rv = fscanf(fp, "%llu", &st->memory);
+	fclose(fp);
+	if (rv != 1)
+		return;
+
+	// mapped file pages, including shared memory, the closest to the SHR
+	// field in /proc/<pid>/statm
+	if (read_key(leaf, "memory.stat", "file_mapped", &st->shared) == -1)
+		st->shared = 0;
+	st->mem = 1;
+}
+
+static void read_io(const char *leaf, CgroupStats *st) {
+	// one line per device: "major:minor rbytes=N wbytes=N rios=N wios=N ..."
+	FILE *fp = leaf_fopen(leaf, "io.stat");
+	if (!fp)
+		return;
+
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		char *ptr = strtok(buf, " \n");
+		while ((ptr = strtok(NULL, " \n")) != NULL) {
+			unsigned long long val;
+			if (sscanf(ptr, "rbytes=%llu", &val) == 1)
+				st->rbytes += val;
+			else if (sscanf(ptr, "wbytes=%llu", &val) == 1)
+				st->wbytes += val;
+		}
+	}
+	fclose(fp);
+	st->io = 1;
+}
+
+// the cgroup path of the sandbox started by firejail process pid
+static int read_leaf(pid_t pid, char *leaf) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_CGROUP_DIR, pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return -1;
+
+	char *rv = fgets(leaf, MAXBUF, fp);
+	fclose(fp);
+	if (!rv)
+		return -1;
+	char *ptr = strchr(leaf, '\n');
+	if (ptr)
+		*ptr = '\0';
+	return 0;
+}
+
+// statistics for the sandbox started by firejail process pid, -1 if the
+// sandbox is not running in its own cgroup
+int cgroup_stats(pid_t pid, CgroupStats *st) {
+	memset(st, 0, sizeof(CgroupStats));
+
+	char leaf[MAXBUF];
+	if (read_leaf(pid, leaf) == -1)
+		return -1;
+
+	read_cpu(leaf, st);
+	read_memory(leaf, st);
+	read_io(leaf, st);
+	return (st->cpu || st->mem || st->io) ? 0 : -1;
+}
+
+// the cgroup directory of the sandbox, -1 if not running in its own cgroup
+int cgroup_open(pid_t pid) {
+	char leaf[MAXBUF];
+	if (read_leaf(pid, leaf) == -1)
+		return -1;
+	return open(leaf, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// cpu time in clock ticks, the unit used in /proc/<pid>/stat
+void cgroup_cpu_ticks(const CgroupStats *st, unsigned *utime, unsigned *stime) {
+	static long clocktick = 0;
+	if (clocktick == 0)
+		clocktick = sysconf(_SC_CLK_TCK);
+	*utime = (unsigned) (st->user_usec * clocktick / 1000000);
+	*stime = (unsigned) (st->system_usec * clocktick / 1000000);
+}
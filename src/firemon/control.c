@@ -0,0 +1,863 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include "../include/rundefs.h"
+#include "../include/run_record.h"
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// --control: a unix socket answering list, status, stats, shutdown and
+// bandwidth requests, for the programs managing many sandboxes. The
+// process table is kept current from the process events (see pid.c), a
+// request costs a round trip instead of a firejail or firemon process.
+//
+// Protocol: one request per line, one JSON object per line in reply.
+//	list
+//	status <name|pid>
+//	stats
+//	shutdown <name|pid>
+//	bandwidth <name|pid> set <device> <down> <up>
+//	bandwidth <name|pid> clear <device>
+//	bandwidth <name|pid> status
+// The errors are returned as {"error":"message"}.
+//
+// The socket is owned by root and open to all users; the peer credentials
+// are checked for every connection. Root sees and controls every sandbox,
+// the other users only their own. The bandwidth requests run firejail
+// --bandwidth with the credentials of the peer, firejail does the checks;
+// the other connections are served while the command runs, and the
+// command is killed after COMMAND_TIMEOUT.
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+#define CONTROL_CLIENTS 64
+#define CONTROL_LINE 1024		// maximum request length
+#define CONTROL_OUTPUT 4096		// bandwidth command output
+#define CONTROL_TIMEOUT 1		// seconds, send timeout
+#define COMMAND_TIMEOUT 10000		// ms, bandwidth command
+#define SHUTDOWN_GRACE 11000		// ms, firejail grace period and one more second
+#define SHUTDOWN_MAX 64
+
+typedef struct {
+	int fd;
+	uid_t uid;
+	gid_t gid;
+	size_t len;
+	char buf[CONTROL_LINE];
+
+	// bandwidth command running for the client; the output is read from
+	// the epoll loop, the reply is sent when the command exits, and the
+	// next requests wait until then
+	pid_t child;		// 0 if none
+	int out_fd;		// -1 after the end of the output
+	size_t out_len;
+	char *out;
+	struct timespec deadline;
+} Client;
+
+static Client *clients[CONTROL_CLIENTS];
+
+// epoll ids: 0 the listening socket, 1 to CONTROL_CLIENTS the clients, then
+// the output of their bandwidth commands
+#define ID_CLIENT(slot) ((slot) + 1)
+#define ID_COMMAND(slot) ((slot) + 1 + CONTROL_CLIENTS)
+
+// sandboxes waiting for SIGKILL after a shutdown request
+typedef struct {
+	int pidfd;
+	struct timespec deadline;
+} Shutdown;
+
+static Shutdown shutdown_list[SHUTDOWN_MAX];
+static int shutdown_cnt = 0;
+
+static volatile sig_atomic_t control_exit = 0;
+
+static void control_signal(int sig) {
+	(void) sig;
+	control_exit = 1;
+}
+
+//*************************
+// reply buffer
+//*************************
+typedef struct {
+	char *data;
+	size_t len;
+	size_t max;
+} Reply;
+
+static void reply_add(Reply *r, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void reply_add(Reply *r, const char *fmt, ...) {
+	va_list ap;
+	while (1) {
+		va_start(ap, fmt);
+		int len = vsnprintf(r->data + r->len, r->max - r->len, fmt, ap);
+		va_end(ap);
+		if (len < 0)
+			errExit("vsnprintf");
+		if (r->len + len < r->max) {
+			r->len += len;
+			return;
+		}
+		r->max = (r->max + len + 1) * 2;
+		r->data = realloc(r->data, r->max);
+		if (!r->data)
+			errExit("realloc");
+	}
+}
+
+static void reply_string(Reply *r, const char *str) {
+	char *json = json_string(str);
+	reply_add(r, "%s", json);
+	free(json);
+}
+
+static void reply_error(Reply *r, const char *msg) {
+	r->len = 0;
+	reply_add(r, "{\"error\":");
+	reply_string(r, msg);
+	reply_add(r, "}");
+}
+
+static void deadline_set(struct timespec *t, int ms) {
+	clock_gettime(CLOCK_MONOTONIC, t);
+	t->tv_sec += ms / 1000;
+	t->tv_nsec += (ms % 1000) * 1000000L;
+	if (t->tv_nsec >= 1000000000L) {
+		t->tv_sec++;
+		t->tv_nsec -= 1000000000L;
+	}
+}
+
+// milliseconds left
+static long long deadline_ms(const struct timespec *t, const struct timespec *now) {
+	return (t->tv_sec - now->tv_sec) * 1000LL + (t->tv_nsec - now->tv_nsec) / 1000000;
+}
+
+//*************************
+// sandboxes
+//*************************
+typedef struct {
+	unsigned processes;
+	unsigned threads;
+	unsigned rss;		// pages
+	unsigned shared;	// pages
+	unsigned long long cpu;	// clock ticks
+} Totals;
+
+// the sandbox index in pids[], -1 if not found or not visible to the client
+static int sandbox_find(const Client *c, const char *arg) {
+	pid_t pid;
+	if (*arg == '\0')
+		return -1;
+	const char *ptr = arg;
+	while (isdigit((unsigned char) *ptr))
+		ptr++;
+	if (*ptr == '\0')
+		pid = (pid_t) strtol(arg, NULL, 10);
+	else if (name2pid(arg, &pid))
+		return -1;
+
+	int index = pid_find(pid);
+	if (index == -1 || pids[index].level != 1 || pids[index].zombie || pids[index].pid == skip_process)
+		return -1;
+	if (c->uid != 0 && pids[index].uid != c->uid)
+		return -1;
+	return index;
+}
+
+static void sandbox_totals(int index, Totals *t) {
+	memset(t, 0, sizeof(Totals));
+	CgroupStats cg;
+	cgroup_stats(pids[index].pid, &cg);
+	if (cg.cpu) {
+		unsigned utime;
+		unsigned stime;
+		cgroup_cpu_ticks(&cg, &utime, &stime);
+		t->cpu = (unsigned long long) utime + stime;
+	}
+	if (cg.mem) {
+		t->rss = cg.memory / getpagesize();
+		t->shared = cg.shared / getpagesize();
+	}
+
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level <= 1 || sandbox_of(i) != index)
+			continue;
+		unsigned utime = 0;
+		unsigned stime = 0;
+		unsigned threads = 0;
+		if (pid_read_stat(i, &utime, &stime, &threads) == -1)
+			continue;
+		t->processes++;
+		t->threads += threads;
+		if (!cg.cpu)
+			t->cpu += (unsigned long long) utime + stime;
+		if (!cg.mem)
+			pid_getmem(pids[i].pid, &t->rss, &t->shared);
+	}
+}
+
+static void sandbox_object(Reply *r, int index, int details) {
+	pid_t pid = pids[index].pid;
+	RunRecord rec;
+	int have_rec = (run_record_read(pid, &rec) == 0);
+
+	reply_add(r, "{\"pid\":%d,\"uid\":%u,\"user\":", pid, (unsigned) pids[index].uid);
+	char *user = pid_get_user_name(pids[index].uid);
+	reply_string(r, user);
+	free(user);
+	reply_add(r, ",\"name\":");
+	reply_string(r, (have_rec && *rec.name) ? rec.name : NULL);
+	reply_add(r, ",\"child\":%d,\"command\":", find_child(index));
+	char *cmd = pid_proc_cmdline(pid);
+	reply_string(r, cmd);
+	free(cmd);
+
+	if (details) {
+		static long clocktick = 0;
+		if (clocktick == 0)
+			clocktick = sysconf(_SC_CLK_TCK);
+		long pgsz = getpagesize();
+
+		Totals t;
+		sandbox_totals(index, &t);
+		reply_add(r, ",\"processes\":%u,\"threads\":%u,\"rss_kb\":%llu,\"shared_kb\":%llu,\"cpu_sec\":%.2f",
+			  t.processes, t.threads,
+			  (unsigned long long) t.rss * pgsz / 1024,
+			  (unsigned long long) t.shared * pgsz / 1024,
+			  (double) t.cpu / clocktick);
+
+		// totals since the interface was created, the clients compute the rates
+		unsigned long long rx;
+		unsigned long long tx;
+		int child = find_child(index);
+		if (have_rec && (rec.options & RUN_RECORD_NETWORK) && child != -1 &&
+		    netstats_read(child, &rx, &tx) == 0)
+			reply_add(r, ",\"rx_bytes\":%llu,\"tx_bytes\":%llu", rx, tx);
+		else
+			reply_add(r, ",\"rx_bytes\":null,\"tx_bytes\":null");
+	}
+	reply_add(r, "}");
+}
+
+static void request_list(const Client *c, Reply *r, int details) {
+	reply_add(r, "{\"sandboxes\":[");
+	int first = 1;
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		// the sandboxes shutting down stay in the table until they are collected
+		if (pids[i].level != 1 || pids[i].zombie || pids[i].pid == skip_process)
+			continue;
+		if (c->uid != 0 && pids[i].uid != c->uid)
+			continue;
+		if (!first)
+			reply_add(r, ",");
+		first = 0;
+		sandbox_object(r, i, details);
+	}
+	reply_add(r, "]}");
+	netstats_prune();
+}
+
+static void request_status(const Client *c, Reply *r, const char *arg) {
+	int index = sandbox_find(c, arg);
+	if (index == -1) {
+		reply_error(r, "cannot find sandbox");
+		return;
+	}
+	sandbox_object(r, index, 1);
+}
+
+// the pid could have been reused since the last pid_read(): check the
+// process again, after the pidfd was opened. A firejail process of the same
+// user, started at the time in the run record, was already running when the
+// pidfd was opened, and the pidfd refers to it.
+static int sandbox_verify(const Client *c, int index) {
+	pid_t pid = pids[index].pid;
+	uid_t uid = pid_get_uid(pid);
+	if (uid != pids[index].uid || (c->uid != 0 && uid != c->uid))
+		return -1;
+
+	char *comm = pid_proc_comm(pid);
+	int rv = (comm && strcmp(comm, "firejail") == 0) ? 0 : -1;
+	free(comm);
+	if (rv)
+		return -1;
+
+	RunRecord rec;
+	unsigned long long start = pid_proc_start_time(pid);
+	if (run_record_read(pid, &rec) == -1 || start == 0 || rec.start != start)
+		return -1;
+	return 0;
+}
+
+// SIGTERM now, SIGKILL after the grace period, like firejail --shutdown
+static void request_shutdown(const Client *c, Reply *r, const char *arg) {
+	int index = sandbox_find(c, arg);
+	if (index == -1) {
+		reply_error(r, "cannot find sandbox");
+		return;
+	}
+	if (shutdown_cnt == SHUTDOWN_MAX) {
+		reply_error(r, "too many sandboxes shutting down");
+		return;
+	}
+
+	// the pidfd protects against pid reuse during the grace period
+	int pidfd = (int) syscall(SYS_pidfd_open, pids[index].pid, 0);
+	if (pidfd == -1) {
+		reply_error(r, strerror(errno));
+		return;
+	}
+	if (sandbox_verify(c, index) == -1) {
+		close(pidfd);
+		reply_error(r, "cannot find sandbox");
+		return;
+	}
+	if (syscall(SYS_pidfd_send_signal, pidfd, SIGTERM, NULL, 0) == -1) {
+		close(pidfd);
+		reply_error(r, strerror(errno));
+		return;
+	}
+
+	Shutdown *s = &shutdown_list[shutdown_cnt++];
+	s->pidfd = pidfd;
+	deadline_set(&s->deadline, SHUTDOWN_GRACE);
+	reply_add(r, "{\"ok\":true,\"pid\":%d}", pids[index].pid);
+}
+
+// milliseconds to the next SIGKILL, -1 if none; the sandboxes gone or
+// past their deadline are removed
+static int shutdown_check(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int timeout = -1;
+	int i = 0;
+	while (i < shutdown_cnt) {
+		Shutdown *s = &shutdown_list[i];
+		long long ms = deadline_ms(&s->deadline, &now);
+		// the pidfd is readable when the process is gone
+		struct pollfd pfd = { s->pidfd, POLLIN, 0 };
+		int gone = (poll(&pfd, 1, 0) == 1);
+		if (!gone && ms > 0) {
+			if (timeout == -1 || ms < timeout)
+				timeout = (int) ms;
+			i++;
+			continue;
+		}
+		if (!gone)
+			syscall(SYS_pidfd_send_signal, s->pidfd, SIGKILL, NULL, 0);
+		close(s->pidfd);
+		shutdown_list[i] = shutdown_list[--shutdown_cnt];
+	}
+	return timeout;
+}
+
+static int valid_number(const char *str) {
+	if (*str == '\0')
+		return 0;
+	for (; *str; str++) {
+		if (!isdigit((unsigned char) *str))
+			return 0;
+	}
+	return 1;
+}
+
+// firejail --bandwidth=pid command..., run with the credentials of the client;
+// returns 1 if the command was started, the reply is sent when it exits
+static int request_bandwidth(int epfd, int slot, Reply *r, char **argv, int argc) {
+	Client *c = clients[slot];
+	if (argc < 2) {
+		reply_error(r, "invalid bandwidth request");
+		return 0;
+	}
+	int index = sandbox_find(c, argv[0]);
+	if (index == -1) {
+		reply_error(r, "cannot find sandbox");
+		return 0;
+	}
+	const char *cmd = argv[1];
+	if (!((strcmp(cmd, "status") == 0 && argc == 2) ||
+	      (strcmp(cmd, "clear") == 0 && argc == 3) ||
+	      (strcmp(cmd, "set") == 0 && argc == 5 && valid_number(argv[3]) && valid_number(argv[4])))) {
+		reply_error(r, "invalid bandwidth request");
+		return 0;
+	}
+	if (argc >= 3) {
+		const char *ptr;
+		for (ptr = argv[2]; *ptr; ptr++) {
+			if (!isalnum((unsigned char) *ptr) && *ptr != '-' && *ptr != '_' && *ptr != '.')
+				break;
+		}
+		if (*ptr || ptr == argv[2] || ptr - argv[2] >= 16) {
+			reply_error(r, "invalid network device name");
+			return 0;
+		}
+	}
+
+	char *opt;
+	if (asprintf(&opt, "--bandwidth=%d", pids[index].pid) == -1)
+		errExit("asprintf");
+	char *args[8];
+	int n = 0;
+	args[n++] = "firejail";
+	args[n++] = opt;
+	int i;
+	for (i = 1; i < argc; i++)
+		args[n++] = argv[i];
+	args[n] = NULL;
+
+	int pipefd[2];
+	if (pipe2(pipefd, O_CLOEXEC) == -1)
+		errExit("pipe2");
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child == 0) {
+		int devnull = open("/dev/null", O_RDONLY);
+		if (devnull != -1)
+			dup2(devnull, STDIN_FILENO);
+		dup2(pipefd[1], STDOUT_FILENO);
+		dup2(pipefd[1], STDERR_FILENO);
+		if (c->uid != 0) {
+			struct passwd *pw = getpwuid(c->uid);
+			if (!pw ||
+			    initgroups(pw->pw_name, c->gid) == -1 ||
+			    setresgid(c->gid, c->gid, c->gid) == -1 ||
+			    setresuid(c->uid, c->uid, c->uid) == -1) {
+				fprintf(stderr, "Error: cannot switch to user %u\n", (unsigned) c->uid);
+				_exit(1);
+			}
+		}
+		execv(BINDIR "/firejail", args);
+		fprintf(stderr, "Error: cannot run %s/firejail: %s\n", BINDIR, strerror(errno));
+		_exit(1);
+	}
+	close(pipefd[1]);
+	free(opt);
+
+	c->child = child;
+	c->out_fd = pipefd[0];
+	c->out_len = 0;
+	c->out = malloc(CONTROL_OUTPUT);
+	if (!c->out)
+		errExit("malloc");
+	deadline_set(&c->deadline, COMMAND_TIMEOUT);
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = ID_COMMAND(slot);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->out_fd, &ev) == -1)
+		errExit("epoll_ctl");
+	// no requests from the client until the reply is sent
+	ev.events = 0;
+	ev.data.u32 = ID_CLIENT(slot);
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) == -1)
+		errExit("epoll_ctl");
+	return 1;
+}
+
+// returns 1 if the reply is sent later
+static int request(int epfd, int slot, char *line, Reply *r) {
+	const Client *c = clients[slot];
+	// split the words
+	char *argv[8];
+	int argc = 0;
+	char *ptr = strtok(line, " \t");
+	while (ptr && argc < 8) {
+		argv[argc++] = ptr;
+		ptr = strtok(NULL, " \t");
+	}
+	if (argc == 0 || ptr) {
+		reply_error(r, "invalid request");
+		return 0;
+	}
+
+	// events since the last request
+	pid_read(0);
+
+	if (strcmp(argv[0], "list") == 0 && argc == 1)
+		request_list(c, r, 0);
+	else if (strcmp(argv[0], "stats") == 0 && argc == 1)
+		request_list(c, r, 1);
+	else if (strcmp(argv[0], "status") == 0 && argc == 2)
+		request_status(c, r, argv[1]);
+	else if (strcmp(argv[0], "shutdown") == 0 && argc == 2)
+		request_shutdown(c, r, argv[1]);
+	else if (strcmp(argv[0], "bandwidth") == 0)
+		return request_bandwidth(epfd, slot, r, argv + 1, argc - 1);
+	else
+		reply_error(r, "invalid request");
+	return 0;
+}
+
+//*************************
+// connections
+//*************************
+static void command_stop(int epfd, Client *c) {
+	if (c->out_fd != -1) {
+		epoll_ctl(epfd, EPOLL_CTL_DEL, c->out_fd, NULL);
+		close(c->out_fd);
+		c->out_fd = -1;
+	}
+	if (c->child) {
+		kill(c->child, SIGKILL);
+		while (waitpid(c->child, NULL, 0) == -1 && errno == EINTR)
+			;
+		c->child = 0;
+	}
+	free(c->out);
+	c->out = NULL;
+}
+
+static void client_close(int epfd, int slot) {
+	Client *c = clients[slot];
+	command_stop(epfd, c);
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c);
+	clients[slot] = NULL;
+}
+
+static void client_accept(int epfd, int sock) {
+	int fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+	if (fd == -1)
+		return;
+
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+		close(fd);
+		return;
+	}
+
+	int slot;
+	for (slot = 0; slot < CONTROL_CLIENTS; slot++) {
+		if (!clients[slot])
+			break;
+	}
+	if (slot == CONTROL_CLIENTS) {
+		const char *msg = "{\"error\":\"too many connections\"}\n";
+		send(fd, msg, strlen(msg), MSG_NOSIGNAL | MSG_DONTWAIT);
+		close(fd);
+		return;
+	}
+
+	// a client not reading its replies does not block the others for long
+	struct timeval tv = { CONTROL_TIMEOUT, 0 };
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	Client *c = calloc(1, sizeof(Client));
+	if (!c)
+		errExit("calloc");
+	c->fd = fd;
+	c->uid = cred.uid;
+	c->gid = cred.gid;
+	c->out_fd = -1;
+	clients[slot] = c;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = ID_CLIENT(slot);
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		errExit("epoll_ctl");
+}
+
+// process the complete lines, until a reply is delayed by a command;
+// returns -1 if the connection is closed
+static int client_lines(int epfd, int slot, Reply *r) {
+	Client *c = clients[slot];
+	char *start = c->buf;
+	char *end;
+	while (!c->child && (end = memchr(start, '\n', c->len - (start - c->buf))) != NULL) {
+		*end = '\0';
+		if (end > start && end[-1] == '\r')
+			end[-1] = '\0';
+		r->len = 0;
+		int delayed = request(epfd, slot, start, r);
+		start = end + 1;
+		if (delayed)
+			break;
+		reply_add(r, "\n");
+		if (send(c->fd, r->data, r->len, MSG_NOSIGNAL) != (ssize_t) r->len)
+			return -1;
+	}
+
+	size_t left = c->len - (start - c->buf);
+	if (left == sizeof(c->buf)) {
+		const char *msg = "{\"error\":\"request too long\"}\n";
+		send(c->fd, msg, strlen(msg), MSG_NOSIGNAL);
+		return -1;
+	}
+	memmove(c->buf, start, left);
+	c->len = left;
+	return 0;
+}
+
+// returns -1 if the connection is closed
+static int client_read(int epfd, int slot, Reply *r) {
+	Client *c = clients[slot];
+	ssize_t len = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, MSG_DONTWAIT);
+	if (len == -1 && (errno == EINTR || errno == EAGAIN))
+		return 0;
+	if (len <= 0)
+		return -1;
+	c->len += len;
+	return client_lines(epfd, slot, r);
+}
+
+// send the reply of the command and go on with the requests of the client;
+// returns -1 if the connection is closed
+static int command_reply(int epfd, int slot, Reply *r, int status, const char *error) {
+	Client *c = clients[slot];
+	r->len = 0;
+	if (error)
+		reply_error(r, error);
+	else {
+		int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		c->out[c->out_len] = '\0';
+		reply_add(r, "{\"ok\":%s,\"output\":", (ok) ? "true" : "false");
+		reply_string(r, c->out);
+		reply_add(r, "}");
+	}
+	reply_add(r, "\n");
+	command_stop(epfd, c);
+	if (send(c->fd, r->data, r->len, MSG_NOSIGNAL) != (ssize_t) r->len)
+		return -1;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = ID_CLIENT(slot);
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev) == -1)
+		errExit("epoll_ctl");
+	return client_lines(epfd, slot, r);
+}
+
+// reply if the command exited, after the end of its output; returns -1 if
+// the connection is closed
+static int command_wait(int epfd, int slot, Reply *r) {
+	Client *c = clients[slot];
+	int status = 0;
+	pid_t rv = waitpid(c->child, &status, WNOHANG);
+	if (rv == 0 || (rv == -1 && errno == EINTR))
+		return 0;
+	c->child = 0;
+	return command_reply(epfd, slot, r, status, (rv == -1) ? "cannot run the bandwidth command" : NULL);
+}
+
+// returns -1 if the connection is closed
+static int command_read(int epfd, int slot, Reply *r) {
+	Client *c = clients[slot];
+	char drain[256];
+	ssize_t len;
+	if (c->out_len < CONTROL_OUTPUT - 1)
+		len = read(c->out_fd, c->out + c->out_len, CONTROL_OUTPUT - 1 - c->out_len);
+	else
+		len = read(c->out_fd, drain, sizeof(drain));	// drop the rest
+	if (len == -1 && (errno == EINTR || errno == EAGAIN))
+		return 0;
+	if (len > 0) {
+		if (c->out_len < CONTROL_OUTPUT - 1)
+			c->out_len += len;
+		return 0;
+	}
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->out_fd, NULL);
+	close(c->out_fd);
+	c->out_fd = -1;
+	return command_wait(epfd, slot, r);
+}
+
+// milliseconds to the next command check, -1 if none; the commands exited
+// are collected, the ones past their deadline are killed
+static int command_check(int epfd, Reply *r) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int timeout = -1;
+	int slot;
+	for (slot = 0; slot < CONTROL_CLIENTS; slot++) {
+		Client *c = clients[slot];
+		if (!c || !c->child)
+			continue;
+		int rv = 0;
+		if (c->out_fd == -1)
+			rv = command_wait(epfd, slot, r);
+		if (rv == 0 && c->child) {
+			long long ms = deadline_ms(&c->deadline, &now);
+			if (ms <= 0)
+				rv = command_reply(epfd, slot, r, 0, "bandwidth command timed out");
+			else {
+				// the output is closed, the command is exiting
+				if (c->out_fd == -1 && ms > 100)
+					ms = 100;
+				if (timeout == -1 || ms < timeout)
+					timeout = (int) ms;
+			}
+		}
+		if (rv == -1)
+			client_close(epfd, slot);
+	}
+	return timeout;
+}
+
+static int control_open(void) {
+	// another server on the socket?
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock == -1)
+		errExit("socket");
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, RUN_CONTROL_SOCKET);
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+		fprintf(stderr, "Error: %s is already served by another process\n", RUN_CONTROL_SOCKET);
+		exit(1);
+	}
+	close(sock);
+
+	if (mkdir(RUN_FIREJAIL_DIR, 0755) == -1 && errno != EEXIST)
+		errExit("mkdir");
+	struct stat s;
+	if (lstat(RUN_CONTROL_SOCKET, &s) == 0) {
+		if (!S_ISSOCK(s.st_mode)) {
+			fprintf(stderr, "Error: %s is not a socket\n", RUN_CONTROL_SOCKET);
+			exit(1);
+		}
+		unlink(RUN_CONTROL_SOCKET);
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock == -1)
+		errExit("socket");
+	// all users can connect, the requests are checked with the peer credentials
+	mode_t old = umask(0);
+	int rv = bind(sock, (struct sockaddr *) &addr, sizeof(addr));
+	umask(old);
+	if (rv == -1)
+		errExit("bind");
+	if (listen(sock, 16) == -1)
+		errExit("listen");
+	return sock;
+}
+
+void control(void) {
+	if (getuid() != 0) {
+		fprintf(stderr, "Error: you need to be root to run this command\n");
+		exit(1);
+	}
+
+	int sock = control_open();
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		errExit("epoll_create1");
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = 0;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) == -1)
+		errExit("epoll_ctl");
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = control_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pid_track_events();
+	pid_read(0);
+	if (arg_debug)
+		printf("Serving %s\n", RUN_CONTROL_SOCKET);
+
+	Reply r;
+	memset(&r, 0, sizeof(r));
+	while (!control_exit) {
+		// the process events are drained every second even without requests
+		int timeout = shutdown_check();
+		int t = command_check(epfd, &r);
+		if (t != -1 && (timeout == -1 || t < timeout))
+			timeout = t;
+		if (timeout == -1 || timeout > 1000)
+			timeout = 1000;
+
+		struct epoll_event events[16];
+		int cnt = epoll_wait(epfd, events, 16, timeout);
+		if (cnt == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("epoll_wait");
+		}
+		if (cnt == 0) {
+			pid_read(0);
+			continue;
+		}
+
+		int i;
+		for (i = 0; i < cnt; i++) {
+			unsigned id = events[i].data.u32;
+			if (id == 0) {
+				client_accept(epfd, sock);
+				continue;
+			}
+			if (id > CONTROL_CLIENTS) {
+				int slot = id - 1 - CONTROL_CLIENTS;
+				if (clients[slot] && clients[slot]->out_fd != -1 &&
+				    command_read(epfd, slot, &r) == -1)
+					client_close(epfd, slot);
+				continue;
+			}
+			int slot = id - 1;
+			if (clients[slot] && client_read(epfd, slot, &r) == -1)
+				client_close(epfd, slot);
+		}
+	}
+
+	int i;
+	for (i = 0; i < CONTROL_CLIENTS; i++) {
+		if (clients[i])
+			client_close(epfd, i);
+	}
+	free(r.data);
+	close(epfd);
+	close(sock);
+	unlink(RUN_CONTROL_SOCKET);
+}
@@ -18,40 +18,18 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "firemon.h"
-#define MAXBUF 4098
 
 static void print_cpu(int pid) {
-	char *file;
-	if (asprintf(&file, "/proc/%d/status", pid) == -1) {
-		errExit("asprintf");
-		exit(1);
-	}
-
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		printf("  Error: cannot open %s\n", file);
-		free(file);
-		return;
-	}
-
-	char buf[MAXBUF];
-	while (fgets(buf, MAXBUF, fp)) {
-		if (strncmp(buf, "Cpus_allowed_list:", 18) == 0) {
-			printf("  %s", buf);
-			fflush(0);
-			break;
-		}
-	}
-	fclose(fp);
-	free(file);
+	static const char *const fields[] = { "Cpus_allowed_list:", NULL };
+	proc_print_status_pid(pid, fields);
 }
 
 void cpu(pid_t pid, int print_procs) {
-	pid_read(pid);
+	pid_snapshot(pid);
 
 	// print processes
 	int i;
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
 			if (print_procs || pid == 0)
 				pid_print_list(i, arg_wrap);
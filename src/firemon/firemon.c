@@ -29,15 +29,24 @@ pid_t skip_process = 0;
 int arg_debug = 0;
 static int arg_route = 0;
 static int arg_arp = 0;
+static int arg_tcpinfo = 0;
 static int arg_tree = 0;
 static int arg_seccomp = 0;
 static int arg_caps = 0;
 static int arg_cpu = 0;
+static int arg_memory = 0;
 static int arg_x11 = 0;
 static int arg_top = 0;
 static int arg_list = 0;
 static int arg_netstats = 0;
 static int arg_apparmor = 0;
+static int arg_hot = 0;	// seconds
+static int arg_perf = 0;	// seconds
+static int arg_jsonl = 0;
+static int arg_control = 0;
+static int arg_stats = 0;
+static int arg_all = 0;
+static int arg_interval = 3000;	// milliseconds
 int arg_wrap = 0;
 
 static struct termios tlocal;	// startup terminal setting
@@ -61,21 +70,22 @@ static void my_handler(int s){
 //  14777:netblue:/usr/bin/firejail /usr/bin/transmission-qt
 //    14792:netblue:/usr/bin/transmission-qt
 // We need 14792, the first real sandboxed process
-int find_child(int id) {
+// index: the firejail process in pids[]
+int find_child(int index) {
 	int i;
-	int first_child = -1;
+	pid_t first_child = -1;
 
 	// find the first child
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 2 && pids[i].parent == id) {
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level == 2 && pids[i].parent == pids[index].pid) {
 			// skip /usr/bin/xdg-dbus-proxy (started by firejail for dbus filtering)
-			char *cmdline = pid_proc_cmdline(i);
+			char *cmdline = pid_proc_cmdline(pids[i].pid);
 			if (strncmp(cmdline, XDG_DBUS_PROXY_PATH, strlen(XDG_DBUS_PROXY_PATH)) == 0) {
 				free(cmdline);
 				continue;
 			}
 			free(cmdline);
-			first_child = i;
+			first_child = pids[i].pid;
 			break;
 		}
 	}
@@ -84,9 +94,9 @@ int find_child(int id) {
 		return -1;
 
 	// find the second-level child
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 3 && pids[i].parent == first_child)
-			return i;
+			return pids[i].pid;
 	}
 
 	// if a second child is not found, return the first child pid
@@ -94,6 +104,18 @@ int find_child(int id) {
 	return first_child;
 }
 
+// sandbox index in pids[] for a process, -1 if not running in a sandbox
+int sandbox_of(int index) {
+	int level = pids[index].level;
+	while (level > 1) {
+		index = pid_find(pids[index].parent);
+		if (index == -1)
+			return -1;
+		level = pids[index].level;
+	}
+	return (level == 1) ? index : -1;
+}
+
 // sleep and wait for a key to be pressed
 void firemon_sleep(int st) {
 	if (terminal_set == 0) {
@@ -157,6 +179,42 @@ int main(int argc, char **argv) {
 			arg_list = 1;
 		else if (strcmp(argv[i], "--tree") == 0)
 			arg_tree = 1;
+		else if (strcmp(argv[i], "--stats") == 0)
+			arg_stats = 1;
+		else if (strcmp(argv[i], "--control") == 0)
+			arg_control = 1;
+		else if (strcmp(argv[i], "--seccomp.hot") == 0)
+			arg_hot = 10;
+		else if (strncmp(argv[i], "--seccomp.hot=", 14) == 0) {
+			arg_hot = atoi(argv[i] + 14);
+			if (arg_hot <= 0) {
+				fprintf(stderr, "Error: invalid sampling time\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--perf") == 0)
+			arg_perf = 5;
+		else if (strncmp(argv[i], "--perf=", 7) == 0) {
+			arg_perf = atoi(argv[i] + 7);
+			if (arg_perf <= 0) {
+				fprintf(stderr, "Error: invalid interval\n");
+				return 1;
+			}
+		}
+		else if (strncmp(argv[i], "--format=", 9) == 0) {
+			if (strcmp(argv[i] + 9, "jsonl") != 0) {
+				fprintf(stderr, "Error: invalid output format %s\n", argv[i] + 9);
+				return 1;
+			}
+			arg_jsonl = 1;
+		}
+		else if (strncmp(argv[i], "--interval=", 11) == 0) {
+			arg_interval = atoi(argv[i] + 11);
+			if (arg_interval <= 0) {
+				fprintf(stderr, "Error: invalid interval\n");
+				return 1;
+			}
+		}
 #ifdef HAVE_NETWORK
 		else if (strcmp(argv[i], "--netstats") == 0) {
 			struct stat s;
@@ -168,11 +226,17 @@ int main(int argc, char **argv) {
 		}
 #endif
 
+		// options with or without a pid argument
+		else if (strcmp(argv[i], "--all") == 0)
+			arg_all = 1;
+
 		// cumulative options with or without a pid argument
 		else if (strcmp(argv[i], "--x11") == 0)
 			arg_x11 = 1;
 		else if (strcmp(argv[i], "--cpu") == 0)
 			arg_cpu = 1;
+		else if (strcmp(argv[i], "--memory") == 0)
+			arg_memory = 1;
 		else if (strcmp(argv[i], "--seccomp") == 0)
 			arg_seccomp = 1;
 		else if (strcmp(argv[i], "--caps") == 0)
@@ -182,6 +246,8 @@ int main(int argc, char **argv) {
 			arg_route = 1;
 		else if (strcmp(argv[i], "--arp") == 0)
 			arg_arp = 1;
+		else if (strcmp(argv[i], "--tcpinfo") == 0)
+			arg_tcpinfo = 1;
 #endif
 		else if (strcmp(argv[i], "--apparmor") == 0)
 			arg_apparmor = 1;
@@ -222,6 +288,11 @@ int main(int argc, char **argv) {
 	}
 
 
+	if (arg_stats) {
+		stats(arg_jsonl);	// global counters, not per sandbox
+		return 0;
+	}
+
 	// if the parent is firejail, skip the process
 	pid_t ppid = getppid();
 	char *pcomm = pid_proc_comm(ppid);
@@ -234,6 +305,14 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	if (arg_control) {
+		control();	// serve all sandboxes, --name disregarded
+		return 0;
+	}
+	if (arg_jsonl) {
+		jsonl(arg_interval);	// stream all sandboxes, --name disregarded
+		return 0;
+	}
 	if (arg_top) {
 		top();	// print all sandboxes, --name disregarded
 		return 0;
@@ -250,10 +329,20 @@ int main(int argc, char **argv) {
 		tree(pid);
 		return 0;
 	}
+	if (arg_hot) {
+		hot((pid_t) pid, arg_hot);
+		return 0;
+	}
+	if (arg_perf)
+		perf((pid_t) pid, arg_perf);
+	if (arg_all) {
+		all((pid_t) pid);
+		return 0;
+	}
 
 	// if --name requested without other options, print all data
-	if (pid && !arg_cpu && !arg_seccomp && !arg_caps && !arg_apparmor &&
-	    !arg_x11  && !arg_route && !arg_arp) {
+	if (pid && !arg_cpu && !arg_memory && !arg_seccomp && !arg_caps && !arg_apparmor &&
+	    !arg_x11  && !arg_route && !arg_arp && !arg_tcpinfo) {
 		arg_tree = 1;
 		arg_cpu = 1;
 		arg_seccomp = 1;
@@ -270,6 +359,10 @@ int main(int argc, char **argv) {
 		cpu((pid_t) pid, print_procs);
 		print_procs = 0;
 	}
+	if (arg_memory) {
+		memory((pid_t) pid, print_procs);
+		print_procs = 0;
+	}
 	if (arg_seccomp) {
 		seccomp((pid_t) pid, print_procs);
 		print_procs = 0;
@@ -294,6 +387,10 @@ int main(int argc, char **argv) {
 		arp((pid_t) pid, print_procs);
 		print_procs = 0;
 	}
+	if (arg_tcpinfo) {
+		tcpinfo((pid_t) pid, print_procs);
+		print_procs = 0;
+	}
 	(void) print_procs;
 
 	if (getuid() == 0) {
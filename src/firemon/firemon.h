@@ -26,6 +26,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
+#include <unistd.h>
 #include "../include/pid.h"
 #include "../include/common.h"
 
@@ -41,7 +42,8 @@ static inline void firemon_clrscr(void) {
 // firemon.c
 extern pid_t skip_process;
 extern int arg_wrap;
-int find_child(int id);
+int find_child(int index);
+int sandbox_of(int index);
 void firemon_sleep(int st);
 
 
@@ -58,12 +60,31 @@ void top(void) __attribute__((noreturn));
 // list.c
 void list(void);
 
+// procfs.c
+void pid_snapshot(pid_t pid);
+int proc_open(pid_t pid);
+FILE *proc_fopen(int procfd, const char *name);
+void proc_print_status(pid_t pid, int procfd, const char *const fields[]);
+void proc_print_status_pid(pid_t pid, const char *const fields[]);
+
+// rtnl.c
+int netns_socket(int procfd, int protocol);
+int rtnl_open(int procfd);
+void rtnl_close(int sock);
+int rtnl_print_route(int sock);
+int rtnl_print_arp(int sock);
+
 // arp.c
+void arp_print(int procfd, int sock);
 void arp(pid_t pid, int print_procs);
 
 // route.c
+void route_print(int procfd, int sock);
 void route(pid_t pid, int print_procs);
 
+// tcpinfo.c
+void tcpinfo(pid_t pid, int print_procs);
+
 // caps.c
 void caps(pid_t pid, int print_procs);
 
@@ -73,16 +94,58 @@ void seccomp(pid_t pid, int print_procs);
 // cpu.c
 void cpu(pid_t pid, int print_procs);
 
+// memory.c
+unsigned long long memory_tmpfs(pid_t pid, int print);
+void memory(pid_t pid, int print_procs);
+
+// hot.c
+void hot(pid_t pid, int seconds);
+
+// perf.c
+void perf(pid_t pid, int seconds) __attribute__((noreturn));
+
 // tree.c
 void tree(pid_t pid);
 
 // netstats.c
 void netstats(void) __attribute__((noreturn));
+int netstats_read(pid_t pid, unsigned long long *rx, unsigned long long *tx);
+void netstats_prune(void);
+
+// cgroup.c
+typedef struct {
+	int cpu;	// user_usec and system_usec are valid
+	unsigned long long user_usec;
+	unsigned long long system_usec;
+	int mem;	// memory and shared are valid
+	unsigned long long memory;	// bytes
+	unsigned long long shared;	// bytes
+	int io;		// rbytes and wbytes are valid
+	unsigned long long rbytes;
+	unsigned long long wbytes;
+} CgroupStats;
+int cgroup_stats(pid_t pid, CgroupStats *st);
+void cgroup_cpu_ticks(const CgroupStats *st, unsigned *utime, unsigned *stime);
+int cgroup_open(pid_t pid);
+
+// jsonl.c
+void jsonl(int interval_ms) __attribute__((noreturn));
+
+// control.c
+void control(void);
+
+// stats.c
+void stats(int jsonl);
 
 // x11.c
+void x11_print(pid_t pid);
 void x11(pid_t pid, int print_procs);
 
 //apparmor.c
+void apparmor_print(pid_t pid);
 void apparmor(pid_t pid, int print_procs);
 
+// all.c
+void all(pid_t pid);
+
 #endif
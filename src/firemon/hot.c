@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include "../include/syscall.h"
+#include <dirent.h>
+#include <time.h>
+
+// The system call each thread is executing is sampled from
+// /proc/PID/task/TID/syscall. The samples are weighted by the time spent
+// in the call, blocking calls such as futex or poll rank higher than
+// with a real call count, but the result is good enough to order the
+// checks in the seccomp filter.
+#define HOT_SAMPLE_USEC 10000	// sample every 10 ms
+#define HOT_MAX_NR 4096
+#define HOT_PRINT 8
+
+// dummy versions, syscall.c is only used for the syscall names
+int arg_quiet = 0;
+void filter_add_errno(int fd, int syscall, int arg, void *ptrarg, bool native) {
+	(void) fd;
+	(void) syscall;
+	(void) arg;
+	(void) ptrarg;
+	(void) native;
+}
+
+void filter_add_blacklist_override(int fd, int syscall, int arg, void *ptrarg, bool native) {
+	(void) fd;
+	(void) syscall;
+	(void) arg;
+	(void) ptrarg;
+	(void) native;
+}
+
+typedef struct {
+	unsigned count[HOT_MAX_NR];
+	unsigned samples;
+	unsigned denied;
+} HotStats;
+
+// the sampled sandboxes, stored by the pid of the firejail process;
+// the indexes in pids[] change every time the process table is read
+typedef struct {
+	pid_t pid;
+	HotStats stats;
+} HotSandbox;
+static HotSandbox *sandboxes = NULL;
+static int sandboxes_cnt = 0;
+
+static HotStats *sandbox_stats(pid_t pid) {
+	int i;
+	for (i = 0; i < sandboxes_cnt; i++) {
+		if (sandboxes[i].pid == pid)
+			return &sandboxes[i].stats;
+	}
+
+	sandboxes = realloc(sandboxes, (sandboxes_cnt + 1) * sizeof(HotSandbox));
+	if (!sandboxes)
+		errExit("realloc");
+	HotSandbox *sb = &sandboxes[sandboxes_cnt++];
+	memset(sb, 0, sizeof(HotSandbox));
+	sb->pid = pid;
+	return &sb->stats;
+}
+
+static void sample_process(pid_t pid, HotStats *stats) {
+	char *dname;
+	if (asprintf(&dname, "/proc/%d/task", pid) == -1)
+		errExit("asprintf");
+	DIR *dir = opendir(dname);
+	free(dname);
+	if (!dir)
+		return;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!isdigit(entry->d_name[0]))
+			continue;
+
+		char *fname;
+		if (asprintf(&fname, "/proc/%d/task/%s/syscall", pid, entry->d_name) == -1)
+			errExit("asprintf");
+		FILE *fp = fopen(fname, "r");
+		free(fname);
+		if (!fp) {
+			stats->denied++;
+			continue;
+		}
+
+		// "running" or "-1" if the thread is not in a system call
+		int nr;
+		if (fscanf(fp, "%d", &nr) == 1 && nr >= 0 && nr < HOT_MAX_NR) {
+			stats->count[nr]++;
+			stats->samples++;
+		}
+		fclose(fp);
+	}
+	closedir(dir);
+}
+
+static void print_hot(HotStats *stats) {
+	if (stats->samples == 0) {
+		if (stats->denied)
+			printf("  Error: cannot read the system calls, you would need to be root\n");
+		else
+			printf("  no system calls sampled\n");
+		return;
+	}
+
+	printf("  %u samples\n", stats->samples);
+	char *list = NULL;
+	int i;
+	for (i = 0; i < HOT_PRINT; i++) {
+		int nr;
+		int max = 0;
+		for (nr = 1; nr < HOT_MAX_NR; nr++) {
+			if (stats->count[nr] > stats->count[max])
+				max = nr;
+		}
+		if (stats->count[max] == 0)
+			break;
+
+		// syscalls without a name are passed as $nr
+		char name[32];
+		const char *str = syscall_find_nr(max);
+		if (strcmp(str, "unknown") == 0)
+			snprintf(name, sizeof(name), "$%d", max);
+		else
+			snprintf(name, sizeof(name), "%s", str);
+		printf("  %-20s %5.1f%%\n", name, 100.0 * stats->count[max] / stats->samples);
+		stats->count[max] = 0;
+
+		char *tmp;
+		if (asprintf(&tmp, "%s%s%s", (list) ? list : "", (list) ? "," : "", name) == -1)
+			errExit("asprintf");
+		free(list);
+		list = tmp;
+	}
+
+	if (list)
+		printf("  seccomp.hot %s\n", list);
+	free(list);
+}
+
+// processes running in the sandboxes, with the sandbox pid
+typedef struct {
+	pid_t pid;
+	pid_t sandbox;
+} HotProc;
+
+static int hot_procs(pid_t pid, HotProc **proc) {
+	pid_read(pid);
+	*proc = realloc(*proc, (pids_cnt + 1) * sizeof(HotProc));
+	if (!*proc)
+		errExit("realloc");
+
+	int cnt = 0;
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		// level 2 is the firejail process running the sandbox
+		if (pids[i].level < 3)
+			continue;
+		int s = sandbox_of(i);
+		if (s == -1)
+			continue;
+		(*proc)[cnt].pid = pids[i].pid;
+		(*proc)[cnt].sandbox = pids[s].pid;
+		cnt++;
+	}
+	return cnt;
+}
+
+void hot(pid_t pid, int seconds) {
+	HotProc *proc = NULL;
+	// keep the process table current from the process events (root only)
+	pid_track_events();
+
+	printf("Sampling system calls for %d seconds...\n", seconds);
+	fflush(0);
+	int cnt = hot_procs(pid, &proc);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	time_t last = start.tv_sec;
+	while (1) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec - start.tv_sec >= seconds)
+			break;
+
+		// pick up new processes once a second
+		if (now.tv_sec != last) {
+			cnt = hot_procs(pid, &proc);
+			last = now.tv_sec;
+		}
+
+		int i;
+		for (i = 0; i < cnt; i++)
+			sample_process(proc[i].pid, sandbox_stats(proc[i].sandbox));
+		usleep(HOT_SAMPLE_USEC);
+	}
+	free(proc);
+
+	// print the sandboxes
+	pid_read(pid);
+	int i;
+	for (i = 0; i < sandboxes_cnt; i++) {
+		int index = pid_find(sandboxes[i].pid);
+		if (index != -1 && pids[index].level == 1)
+			pid_print_list(index, arg_wrap);
+		else
+			printf("%d: sandbox terminated\n", sandboxes[i].pid);
+		print_hot(&sandboxes[i].stats);
+	}
+	free(sandboxes);
+	sandboxes = NULL;
+	sandboxes_cnt = 0;
+	printf("\n");
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include "../include/rundefs.h"
+#include "../include/run_record.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// One JSON object per sandbox and per interval on stdout, for log
+// collectors and monitoring agents: no terminal handling, stdout is
+// flushed at the end of every interval. CPU and network values are
+// deltas over the last interval; the first interval only sets the
+// baseline and prints nothing.
+
+// the monitored sandboxes, stored by the pid of the firejail process;
+// the indexes in pids[] change every time the process table is read
+typedef struct {
+	pid_t pid;
+	unsigned generation;
+	// totals for the current interval
+	unsigned processes;
+	unsigned threads;
+	unsigned rss;		// pages
+	unsigned shared;	// pages
+	unsigned long long cpu;	// clock ticks
+	CgroupStats cgroup;	// --cgroup-leaf sandboxes
+	// totals at the end of the previous interval
+	unsigned long long prev_cpu;
+	unsigned long long prev_rx;
+	unsigned long long prev_tx;
+	unsigned long long prev_rbytes;
+	unsigned long long prev_wbytes;
+	int has_prev;
+} JsonSandbox;
+static JsonSandbox *sandboxes = NULL;
+static int sandboxes_cnt = 0;
+
+static JsonSandbox *sandbox_get(pid_t pid) {
+	int i;
+	for (i = 0; i < sandboxes_cnt; i++) {
+		if (sandboxes[i].pid == pid)
+			return &sandboxes[i];
+	}
+
+	sandboxes = realloc(sandboxes, (sandboxes_cnt + 1) * sizeof(JsonSandbox));
+	if (!sandboxes)
+		errExit("realloc");
+	JsonSandbox *sb = &sandboxes[sandboxes_cnt++];
+	memset(sb, 0, sizeof(JsonSandbox));
+	sb->pid = pid;
+	return sb;
+}
+
+// drop the sandboxes not seen in this interval
+static void sandbox_prune(unsigned generation) {
+	int i = 0;
+	while (i < sandboxes_cnt) {
+		if (sandboxes[i].generation != generation)
+			sandboxes[i] = sandboxes[--sandboxes_cnt];
+		else
+			i++;
+	}
+}
+
+// sandbox name set with --name, NULL if none
+static char *sandbox_name(pid_t pid) {
+	RunRecord rec;
+	if (run_record_read(pid, &rec) == -1 || *rec.name == '\0')
+		return NULL;
+
+	char *rv = strdup(rec.name);
+	if (!rv)
+		errExit("strdup");
+	return rv;
+}
+
+// rx and tx totals, -1 if the sandbox has no network namespace of its own
+static int sandbox_net(int index, unsigned long long *rx, unsigned long long *tx) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d-netmap", RUN_FIREJAIL_NETWORK_DIR, pids[index].pid) == -1)
+		errExit("asprintf");
+	struct stat s;
+	int rv = stat(fname, &s);
+	free(fname);
+	if (rv == -1)
+		return -1;
+
+	int child = find_child(index);
+	if (child == -1)
+		return -1;
+	return netstats_read(child, rx, tx);
+}
+
+static void print_sandbox(int index, JsonSandbox *sb, const struct timespec *ts, double itv) {
+	static long clocktick = 0;
+	static long pgsz = 0;
+	if (clocktick == 0)
+		clocktick = sysconf(_SC_CLK_TCK);
+	if (pgsz == 0)
+		pgsz = getpagesize();
+
+	unsigned long long rx = 0;
+	unsigned long long tx = 0;
+	int net = sandbox_net(index, &rx, &tx);
+
+	if (sb->has_prev) {
+		pid_t pid = pids[index].pid;
+		printf("{\"time\":%lld.%03ld,\"pid\":%d,\"name\":",
+		       (long long) ts->tv_sec, ts->tv_nsec / 1000000, pid);
+		char *name = sandbox_name(pid);
+		json_print_string(stdout, name);
+		free(name);
+
+		fputs(",\"user\":", stdout);
+		char *user = pid_get_user_name(pids[index].uid);
+		json_print_string(stdout, user);
+		free(user);
+
+		fputs(",\"command\":", stdout);
+		char *cmd = pid_proc_cmdline(pid);
+		json_print_string(stdout, cmd);
+		free(cmd);
+
+		// without --cgroup-leaf the processes exiting during the interval
+		// take their cpu time with them
+		unsigned long long cpu = (sb->cpu > sb->prev_cpu) ? sb->cpu - sb->prev_cpu : 0;
+		printf(",\"processes\":%u,\"threads\":%u,\"rss_kb\":%llu,\"shared_kb\":%llu,\"cpu\":%.1f",
+		       sb->processes, sb->threads,
+		       (unsigned long long) sb->rss * pgsz / 1024,
+		       (unsigned long long) sb->shared * pgsz / 1024,
+		       (double) cpu / (itv * clocktick) * 100);
+
+		if (net == 0 && sb->prev_rx != (unsigned long long) -1)
+			printf(",\"rx_bytes\":%llu,\"tx_bytes\":%llu",
+			       (rx > sb->prev_rx) ? rx - sb->prev_rx : 0,
+			       (tx > sb->prev_tx) ? tx - sb->prev_tx : 0);
+		else
+			fputs(",\"rx_bytes\":null,\"tx_bytes\":null", stdout);
+
+		if (sb->cgroup.io)
+			printf(",\"io_read_bytes\":%llu,\"io_write_bytes\":%llu}\n",
+			       (sb->cgroup.rbytes > sb->prev_rbytes) ? sb->cgroup.rbytes - sb->prev_rbytes : 0,
+			       (sb->cgroup.wbytes > sb->prev_wbytes) ? sb->cgroup.wbytes - sb->prev_wbytes : 0);
+		else
+			fputs(",\"io_read_bytes\":null,\"io_write_bytes\":null}\n", stdout);
+	}
+
+	sb->prev_cpu = sb->cpu;
+	sb->prev_rx = (net == 0) ? rx : (unsigned long long) -1;
+	sb->prev_tx = tx;
+	sb->prev_rbytes = sb->cgroup.rbytes;
+	sb->prev_wbytes = sb->cgroup.wbytes;
+	sb->has_prev = 1;
+}
+
+void jsonl(int interval_ms) {
+	unsigned generation = 0;
+	pid_track_events();
+
+	while (1) {
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		generation++;
+
+		pid_read(0);
+
+		// sum the processes of every sandbox
+		int i;
+		for (i = 0; i < pids_cnt; i++) {
+			if (pids[i].level <= 0 || pids[i].pid == skip_process)
+				continue;
+			int root = sandbox_of(i);
+			if (root == -1 || pids[root].pid == skip_process)
+				continue;
+
+			JsonSandbox *sb = sandbox_get(pids[root].pid);
+			if (sb->generation != generation) {
+				sb->generation = generation;
+				sb->processes = 0;
+				sb->threads = 0;
+				sb->rss = 0;
+				sb->shared = 0;
+				sb->cpu = 0;
+				// a single read for the whole sandbox
+				cgroup_stats(sb->pid, &sb->cgroup);
+				if (sb->cgroup.cpu) {
+					unsigned utime;
+					unsigned stime;
+					cgroup_cpu_ticks(&sb->cgroup, &utime, &stime);
+					sb->cpu = (unsigned long long) utime + stime;
+				}
+				if (sb->cgroup.mem) {
+					sb->rss = sb->cgroup.memory / getpagesize();
+					sb->shared = sb->cgroup.shared / getpagesize();
+				}
+			}
+
+			unsigned utime = 0;
+			unsigned stime = 0;
+			unsigned threads = 0;
+			if (pid_read_stat(i, &utime, &stime, &threads) == -1)
+				continue;
+			sb->processes++;
+			sb->threads += threads;
+			if (!sb->cgroup.cpu)
+				sb->cpu += (unsigned long long) utime + stime;
+			if (!sb->cgroup.mem)
+				pid_getmem(pids[i].pid, &sb->rss, &sb->shared);
+		}
+		sandbox_prune(generation);
+
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		for (i = 0; i < pids_cnt; i++) {
+			if (pids[i].level != 1 || pids[i].pid == skip_process)
+				continue;
+			JsonSandbox *sb = sandbox_get(pids[i].pid);
+			if (sb->generation != generation)
+				continue;
+			print_sandbox(i, sb, &now, interval_ms / 1000.0);
+		}
+		fflush(stdout);
+		netstats_prune();
+
+		// sleep for the rest of the interval
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		long long elapsed = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+		long long left = interval_ms * 1000000LL - elapsed;
+		if (left > 0) {
+			struct timespec ts = {
+				.tv_sec = left / 1000000000LL,
+				.tv_nsec = left % 1000000000LL
+			};
+			while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+				;
+		}
+	}
+}
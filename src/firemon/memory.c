@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// memory footprint of a sandbox: the tmpfs filesystems mounted in its mount
+// namespace, the RSS/PSS and the KSM merged memory of its processes, and the
+// RSS of the helper processes started by firejail outside the sandbox
+// (xdg-dbus-proxy, Xvfb etc.)
+//
+// The tmpfs mounts are listed in /proc/<pid>/mountinfo, and measured with
+// fstatfs() on the mount point opened in the root directory of the sandbox.
+// The path is resolved with RESOLVE_IN_ROOT, a symbolic link placed by the
+// sandbox cannot point outside. Bind mounts of the same tmpfs are counted
+// once; a tmpfs covered by another mount cannot be reached, it is reported
+// as hidden.
+
+#include "firemon.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#ifdef __NR_openat2
+#include <linux/openat2.h>
+#endif
+
+#define MAXBUF 4096
+#define MAX_TMPFS 256
+
+typedef struct {
+	dev_t dev;
+	int done;		// measured, or reported as hidden
+	unsigned long long used;	// bytes
+} Tmpfs;
+
+// restore the spaces etc. escaped as octal in mountinfo
+static void unmangle_path(char *path) {
+	char *r = path;
+	char *w = path;
+	while (*r) {
+		if (r[0] == '\\' && r[1] >= '0' && r[1] <= '7' && r[2] >= '0' && r[2] <= '7' &&
+		    r[3] >= '0' && r[3] <= '7') {
+			*w++ = (char) ((r[1] - '0') << 6 | (r[2] - '0') << 3 | (r[3] - '0'));
+			r += 4;
+		}
+		else
+			*w++ = *r++;
+	}
+	*w = '\0';
+}
+
+static int open_in_root(int rootfd, const char *path) {
+#ifdef __NR_openat2
+	while (*path == '/')
+		path++;
+	if (*path == '\0')
+		path = ".";
+	struct open_how oh;
+	memset(&oh, 0, sizeof(oh));
+	oh.flags = O_PATH | O_CLOEXEC;
+	oh.resolve = RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS;
+	return syscall(__NR_openat2, rootfd, path, &oh, sizeof(struct open_how));
+#else
+	(void) rootfd;
+	(void) path;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+// return the total, in bytes; with print set, print each tmpfs
+unsigned long long memory_tmpfs(pid_t pid, int print) {
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/mountinfo", pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (asprintf(&fname, "/proc/%d/root", pid) == -1)
+		errExit("asprintf");
+	int rootfd = open(fname, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	free(fname);
+	if (!fp || rootfd == -1) {
+		if (print)
+			printf("  tmpfs: cannot access the mount namespace\n");
+		if (fp)
+			fclose(fp);
+		if (rootfd != -1)
+			close(rootfd);
+		return 0;
+	}
+
+	Tmpfs tmpfs[MAX_TMPFS];
+	int cnt = 0;
+	unsigned long long total = 0;
+	int hidden = 0;
+	int header = 0;
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		// 36 35 0:34 / /etc rw,nosuid - tmpfs tmpfs rw,mode=755
+		unsigned major;
+		unsigned minor;
+		char dir[MAXBUF];
+		if (sscanf(buf, "%*d %*d %u:%u %*s %4095s", &major, &minor, dir) != 3)
+			continue;
+		char *ptr = strstr(buf, " - ");
+		if (!ptr || strncmp(ptr + 3, "tmpfs ", 6) != 0)
+			continue;
+		unmangle_path(dir);
+
+		dev_t dev = makedev(major, minor);
+		int i;
+		for (i = 0; i < cnt; i++) {
+			if (tmpfs[i].dev == dev)
+				break;
+		}
+		if (i == cnt) {
+			if (cnt == MAX_TMPFS)
+				continue;
+			tmpfs[cnt].dev = dev;
+			tmpfs[cnt].done = 0;
+			cnt++;
+		}
+		if (tmpfs[i].done)
+			continue;
+
+		// the mount point could be covered by another mount
+		int fd = open_in_root(rootfd, dir);
+		if (fd == -1)
+			continue;
+		struct stat s;
+		struct statfs sfs;
+		if (fstat(fd, &s) == 0 && s.st_dev == dev && fstatfs(fd, &sfs) == 0) {
+			tmpfs[i].done = 1;
+			tmpfs[i].used = (unsigned long long) (sfs.f_blocks - sfs.f_bfree) * sfs.f_bsize;
+			total += tmpfs[i].used;
+			if (print) {
+				if (!header)
+					printf("  %-40s %10s\n", "tmpfs", "KiB");
+				header = 1;
+				printf("    %-38s %10llu\n", dir, tmpfs[i].used / 1024);
+			}
+		}
+		close(fd);
+	}
+	fclose(fp);
+	close(rootfd);
+
+	int i;
+	for (i = 0; i < cnt; i++) {
+		if (!tmpfs[i].done)
+			hidden++;
+	}
+	if (print && hidden)
+		printf("    %d hidden tmpfs not measured\n", hidden);
+	return total;
+}
+
+// RSS and PSS in KiB, -1 if the process cannot be read
+static void read_rollup(pid_t pid, long long *rss, long long *pss) {
+	*rss = -1;
+	*pss = -1;
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/smaps_rollup", pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return;
+
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		long long val;
+		if (sscanf(buf, "Rss: %lld", &val) == 1)
+			*rss = val;
+		else if (sscanf(buf, "Pss: %lld", &val) == 1)
+			*pss = val;
+	}
+	fclose(fp);
+}
+
+// memory merged by KSM in KiB, -1 if not available
+static long long read_ksm(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/ksm_stat", pid) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return -1;
+
+	long long pages = -1;
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		if (sscanf(buf, "ksm_merging_pages %lld", &pages) == 1)
+			break;
+	}
+	fclose(fp);
+	if (pages < 0)
+		return -1;
+	return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void print_kib(long long val) {
+	if (val < 0)
+		printf(" %10s", "-");
+	else
+		printf(" %10lld", val);
+}
+
+typedef struct {
+	long long pss;	// sandbox processes
+	long long rss;
+	long long helper_rss;	// helper processes
+	long long ksm;		// sandbox processes, merged by KSM
+	int unreadable;
+} MemTotal;
+
+// recursivity!!!
+static void print_process(int index, int helper, MemTotal *t) {
+	pid_t pid = pids[index].pid;
+	long long rss;
+	long long pss;
+	read_rollup(pid, &rss, &pss);
+	long long ksm = read_ksm(pid);
+
+	char *comm = pid_proc_comm(pid);
+	printf("    %-7d %-20.20s", pid, (comm) ? comm : "");
+	free(comm);
+	print_kib(rss);
+	print_kib(pss);
+	print_kib(ksm);
+	printf("%s\n", (helper) ? "   helper" : "");
+
+	if (rss < 0)
+		t->unreadable++;
+	else if (helper)
+		t->helper_rss += rss;
+	else {
+		t->rss += rss;
+		t->pss += pss;
+		if (ksm > 0)
+			t->ksm += ksm;
+	}
+
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].parent == pid)
+			print_process(i, helper, t);
+	}
+}
+
+static void print_memory(int index) {
+	pid_t child = find_child(index);
+	if (child == -1) {
+		printf("  cannot find the sandbox\n");
+		return;
+	}
+	unsigned long long tmpfs = memory_tmpfs(child, 1);
+
+	printf("  %-28s %10s %10s %10s\n", "process", "RSS(KiB)", "PSS(KiB)", "KSM(KiB)");
+	MemTotal t;
+	memset(&t, 0, sizeof(t));
+
+	// the firejail process itself is not readable for a regular user
+	long long rss;
+	long long pss;
+	pid_t pid = pids[index].pid;
+	read_rollup(pid, &rss, &pss);
+	printf("    %-7d %-20.20s", pid, "firejail");
+	print_kib(rss);
+	print_kib(pss);
+	print_kib(read_ksm(pid));
+	printf("\n");
+
+	// the sandbox is the first child not started by firejail as a helper,
+	// see find_child()
+	int sandbox = -1;
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].parent != pid)
+			continue;
+		char *cmdline = pid_proc_cmdline(pids[i].pid);
+		int helper = (sandbox != -1) || !cmdline ||
+			strncmp(cmdline, XDG_DBUS_PROXY_PATH, strlen(XDG_DBUS_PROXY_PATH)) == 0;
+		free(cmdline);
+		if (!helper)
+			sandbox = i;
+		print_process(i, helper, &t);
+	}
+
+	printf("  total: tmpfs %llu KiB, sandbox RSS %lld KiB, PSS %lld KiB, KSM %lld KiB, helpers RSS %lld KiB\n",
+	       tmpfs / 1024, t.rss, t.pss, t.ksm, t.helper_rss);
+	if (t.unreadable)
+		printf("  %d processes not readable\n", t.unreadable);
+}
+
+void memory(pid_t pid, int print_procs) {
+	pid_snapshot(pid);
+
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level == 1) {
+			if (print_procs || pid == 0)
+				pid_print_list(i, arg_wrap);
+			print_memory(i);
+		}
+	}
+	printf("\n");
+}
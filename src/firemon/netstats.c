@@ -24,6 +24,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
 
 #define MAXBUF 4096
 
@@ -54,30 +60,163 @@ static char *get_header(void) {
 	return rv;
 }
 
-void get_stats(int parent) {
-	// find the first child
-	int child = -1;
-	for (child = parent + 1; child < max_pids; child++) {
-		if (pids[child].parent == parent)
+// rtnetlink sockets created in the network namespaces of the sandboxes;
+// a socket stays attached to its namespace, the namespace is entered only
+// once per sandbox. Entering another namespace requires CAP_SYS_ADMIN,
+// regular users fall back to /proc/<pid>/net/dev.
+typedef struct {
+	pid_t pid;
+	ino_t netns;	// detects a reused pid
+	int sock;	// -1 if the namespace cannot be entered
+	unsigned generation;
+} NetlinkSocket;
+static NetlinkSocket *sockets = NULL;
+static int sockets_cnt = 0;
+static unsigned sockets_generation = 0;
+
+static ino_t netns_ino(pid_t pid) {
+	char fname[64];
+	snprintf(fname, sizeof(fname), "/proc/%d/ns/net", pid);
+	struct stat s;
+	if (stat(fname, &s) == -1)
+		return 0;
+	return s.st_ino;
+}
+
+static int netlink_open(pid_t pid) {
+	int self = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+	if (self == -1)
+		return -1;
+	char dname[64];
+	snprintf(dname, sizeof(dname), "/proc/%d", pid);
+	int dirfd = open(dname, O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd == -1) {
+		close(self);
+		return -1;
+	}
+
+	int sock = -1;
+	if (join_namespace_by_fd(dirfd, "net") == 0) {
+		sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+		if (setns(self, CLONE_NEWNET) == -1)
+			errExit("setns");
+	}
+	close(dirfd);
+	close(self);
+	return sock;
+}
+
+static int netlink_socket(pid_t pid) {
+	ino_t ino = netns_ino(pid);
+	if (ino == 0)
+		return -1;
+
+	int i;
+	for (i = 0; i < sockets_cnt; i++) {
+		if (sockets[i].pid == pid) {
+			if (sockets[i].netns == ino) {
+				sockets[i].generation = sockets_generation;
+				return sockets[i].sock;
+			}
+			// a new process with the same pid
+			if (sockets[i].sock != -1)
+				close(sockets[i].sock);
+			sockets[i] = sockets[--sockets_cnt];
 			break;
+		}
 	}
 
-	if (child == -1)
-		goto errexit;
+	sockets = realloc(sockets, (sockets_cnt + 1) * sizeof(NetlinkSocket));
+	if (!sockets)
+		errExit("realloc");
+	NetlinkSocket *ns = &sockets[sockets_cnt++];
+	ns->pid = pid;
+	ns->netns = ino;
+	ns->sock = (getuid() == 0) ? netlink_open(pid) : -1;
+	ns->generation = sockets_generation;
+	return ns->sock;
+}
+
+// close the sockets not used since the previous call, once per interval
+void netstats_prune(void) {
+	int i = 0;
+	while (i < sockets_cnt) {
+		if (sockets[i].generation != sockets_generation) {
+			if (sockets[i].sock != -1)
+				close(sockets[i].sock);
+			sockets[i] = sockets[--sockets_cnt];
+		}
+		else
+			i++;
+	}
+	sockets_generation++;
+}
+
+// RTM_GETLINK dump, 64 bit counters of all the interfaces
+static int netlink_read(int sock, unsigned long long *rx, unsigned long long *tx) {
+	struct {
+		struct nlmsghdr nlh;
+		struct ifinfomsg ifm;
+	} req;
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = sizeof(req);
+	req.nlh.nlmsg_type = RTM_GETLINK;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	static unsigned seq = 0;
+	req.nlh.nlmsg_seq = ++seq;
+	req.ifm.ifi_family = AF_UNSPEC;
+	if (send(sock, &req, sizeof(req), 0) == -1)
+		return -1;
+
+	*rx = 0;
+	*tx = 0;
+	char buf[16384] __attribute__((aligned(NLMSG_ALIGNTO)));
+	while (1) {
+		ssize_t len = recv(sock, buf, sizeof(buf), 0);
+		if (len <= 0)
+			return -1;
+
+		struct nlmsghdr *nlh;
+		for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_seq != req.nlh.nlmsg_seq)
+				continue;
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (nlh->nlmsg_type == NLMSG_ERROR)
+				return -1;
+			if (nlh->nlmsg_type != RTM_NEWLINK)
+				continue;
+
+			struct ifinfomsg *ifm = NLMSG_DATA(nlh);
+			int attrlen = IFLA_PAYLOAD(nlh);
+			struct rtattr *rta;
+			for (rta = IFLA_RTA(ifm); RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+				if (rta->rta_type == IFLA_STATS64 &&
+				    RTA_PAYLOAD(rta) >= sizeof(struct rtnl_link_stats64)) {
+					struct rtnl_link_stats64 stats;
+					memcpy(&stats, RTA_DATA(rta), sizeof(stats));
+					*rx += stats.rx_bytes;
+					*tx += stats.tx_bytes;
+				}
+			}
+		}
+	}
+}
 
-	// open /proc/child/net/dev file and read rx and tx
+// total rx and tx bytes from /proc/<pid>/net/dev, -1 on error
+static int procfs_read(pid_t pid, unsigned long long *rx, unsigned long long *tx) {
+	// open /proc/pid/net/dev file and read rx and tx
 	char *fname;
-	if (asprintf(&fname, "/proc/%d/net/dev", child) == -1)
+	if (asprintf(&fname, "/proc/%d/net/dev", pid) == -1)
 		errExit("asprintf");
 	FILE *fp = fopen(fname, "r");
-	if (!fp) {
-		free(fname);
-		goto errexit;
-	}
+	free(fname);
+	if (!fp)
+		return -1;
 
 	char buf[MAXBUF];
-	long long unsigned rx = 0;
-	long long unsigned tx = 0;
+	*rx = 0;
+	*tx = 0;
 	while (fgets(buf, MAXBUF, fp)) {
 		if (strncmp(buf, "Inter", 5) == 0)
 			continue;
@@ -91,8 +230,7 @@ void get_stats(int parent) {
 
 		if (*ptr == '\0') {
 			fclose(fp);
-			free(fname);
-			goto errexit;
+			return -1;
 		}
 		ptr++;
 
@@ -101,17 +239,41 @@ void get_stats(int parent) {
 		unsigned a, b, c, d, e, f, g;
 		sscanf(ptr, "%llu %u %u %u %u %u %u %u %llu",
 			&rxval, &a, &b, &c, &d, &e, &f, &g, &txval);
-		rx += rxval;
-		tx += txval;
+		*rx += rxval;
+		*tx += txval;
 	}
+	fclose(fp);
+	return 0;
+}
+
+
+// total rx and tx bytes in the network namespace of the process, -1 on error
+int netstats_read(pid_t pid, unsigned long long *rx, unsigned long long *tx) {
+	int sock = netlink_socket(pid);
+	if (sock != -1 && netlink_read(sock, rx, tx) == 0)
+		return 0;
+	return procfs_read(pid, rx, tx);
+}
+
+void get_stats(int parent) {
+	// find the first child
+	int child = -1;
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].parent == pids[parent].pid) {
+			child = i;
+			break;
+		}
+	}
+
+	long long unsigned rx;
+	long long unsigned tx;
+	if (child == -1 || netstats_read(pids[child].pid, &rx, &tx) == -1)
+		goto errexit;
 
 	// store data
 	pids[parent].option.netstats.rx = rx - pids[parent].option.netstats.rx;
 	pids[parent].option.netstats.tx = tx - pids[parent].option.netstats.tx;
-
-
-	free(fname);
-	fclose(fp);
 	return;
 
 errexit:
@@ -132,7 +294,8 @@ static void print_proc(int index, int itv, int col) {
 	}
 
 	// command
-	char *cmd = pid_proc_cmdline(index);
+	pid_t pid = pids[index].pid;
+	char *cmd = pid_proc_cmdline(pid);
 	char *ptrcmd;
 	if (cmd == NULL) {
 		if (pids[index].zombie)
@@ -147,7 +310,7 @@ static void print_proc(int index, int itv, int col) {
 
 	// check network namespace
 	char *name;
-	if (asprintf(&name, "/run/firejail/network/%d-netmap", index) == -1)
+	if (asprintf(&name, "/run/firejail/network/%d-netmap", pid) == -1)
 		errExit("asprintf");
 	struct stat s;
 	if (stat(name, &s) == -1) {
@@ -161,7 +324,7 @@ static void print_proc(int index, int itv, int col) {
 
 	// pid
 	char pidstr[11];
-	snprintf(pidstr, 11, "%d", index);
+	snprintf(pidstr, 11, "%d", pid);
 
 	// user
 	char *user = get_user_name(pids[index].uid);
@@ -195,6 +358,8 @@ static void print_proc(int index, int itv, int col) {
 }
 
 void netstats(void) {
+	// keep the process table current from the process events (root only)
+	pid_track_events();
 	pid_read(0);	// include all processes
 
 	printf("Displaying network statistics only for sandboxes using a new network namespace.\n");
@@ -206,10 +371,14 @@ void netstats(void) {
 		int itv = 3; 	// 3 second interval
 		pid_read(0);
 
-		// start rx/tx measurements
-		for (i = 0; i < max_pids; i++) {
-			if (pids[i].level == 1)
+		// start rx/tx measurements, the process table is kept between
+		// cycles, clear the previous values
+		for (i = 0; i < pids_cnt; i++) {
+			if (pids[i].level == 1) {
+				pids[i].option.netstats.rx = 0;
+				pids[i].option.netstats.tx = 0;
 				get_stats(i);
+			}
 		}
 
 		// wait 1 seconds
@@ -235,12 +404,13 @@ void netstats(void) {
 		free(header);
 
 		// start rx/tx measurements
-		for (i = 0; i < max_pids; i++) {
+		for (i = 0; i < pids_cnt; i++) {
 			if (pids[i].level == 1) {
 				get_stats(i);
 				print_proc(i, itv, col);
 			}
 		}
+		netstats_prune();
 
 		__gcov_flush();
 	}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include "../include/perf_counters.h"
+#include <dirent.h>
+
+// The counters of a sandbox started with --cgroup-leaf are opened for its
+// cgroup, one counter per cpu; this needs CAP_PERFMON or
+// perf_event_paranoid 0. Otherwise every thread running in the sandbox
+// when it is first seen gets an inherited counter: the processes they
+// start later are counted, the processes joining with --join are not.
+
+// the sandboxes are stored by the pid of the firejail process
+typedef struct {
+	pid_t pid;
+	int seen;	// found in the last process table read
+	int opened;
+	PerfCounters counters;
+	PerfValues prev;
+} PerfSandbox;
+static PerfSandbox *sandboxes = NULL;
+static int sandboxes_cnt = 0;
+
+// the process is running in the sandbox of firejail process pid
+static int in_sandbox(int index, pid_t pid) {
+	while (pids[index].level > 1) {
+		index = pid_find(pids[index].parent);
+		if (index == -1)
+			return 0;
+	}
+	return pids[index].pid == pid;
+}
+
+static int open_tasks(PerfCounters *pc, pid_t pid) {
+	char *dname;
+	if (asprintf(&dname, "/proc/%d/task", pid) == -1)
+		errExit("asprintf");
+	DIR *dir = opendir(dname);
+	free(dname);
+	if (!dir)
+		return 0;
+
+	int opened = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (isdigit(entry->d_name[0]))
+			opened += perf_counters_task(pc, atoi(entry->d_name), 1);
+	}
+	closedir(dir);
+	return opened;
+}
+
+static void open_sandbox(PerfSandbox *sb) {
+	perf_counters_init(&sb->counters);
+	int fd = cgroup_open(sb->pid);
+	if (fd != -1) {
+		sb->opened = perf_counters_cgroup(&sb->counters, fd, 1);
+		close(fd);
+	}
+	if (!sb->opened) {
+		// level 2 is the firejail process running the sandbox
+		int i;
+		for (i = 0; i < pids_cnt; i++) {
+			if (pids[i].level >= 3 && in_sandbox(i, sb->pid))
+				sb->opened += open_tasks(&sb->counters, pids[i].pid);
+		}
+	}
+	perf_counters_read(&sb->counters, &sb->prev);
+}
+
+static void refresh_sandboxes(pid_t pid) {
+	pid_read(pid);
+	int j;
+	for (j = 0; j < sandboxes_cnt; j++)
+		sandboxes[j].seen = 0;
+
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level != 1)
+			continue;
+		for (j = 0; j < sandboxes_cnt; j++) {
+			if (sandboxes[j].pid == pids[i].pid)
+				break;
+		}
+		if (j == sandboxes_cnt) {
+			sandboxes = realloc(sandboxes, (sandboxes_cnt + 1) * sizeof(PerfSandbox));
+			if (!sandboxes)
+				errExit("realloc");
+			PerfSandbox *sb = &sandboxes[sandboxes_cnt++];
+			memset(sb, 0, sizeof(PerfSandbox));
+			sb->pid = pids[i].pid;
+			open_sandbox(sb);
+		}
+		sandboxes[j].seen = 1;
+	}
+
+	// drop the sandboxes terminated
+	j = 0;
+	for (i = 0; i < sandboxes_cnt; i++) {
+		if (sandboxes[i].seen)
+			sandboxes[j++] = sandboxes[i];
+		else
+			perf_counters_close(&sandboxes[i].counters);
+	}
+	sandboxes_cnt = j;
+}
+
+void perf(pid_t pid, int seconds) {
+	printf("Counting every %d seconds, press Ctrl-C to exit...\n", seconds);
+	fflush(0);
+	refresh_sandboxes(pid);
+
+	while (1) {
+		sleep(seconds);
+		printf("\n");
+		pid_read(pid);
+		int i;
+		for (i = 0; i < sandboxes_cnt; i++) {
+			PerfSandbox *sb = &sandboxes[i];
+			int index = pid_find(sb->pid);
+			if (index == -1 || pids[index].level != 1) {
+				printf("%d: sandbox terminated\n", sb->pid);
+				continue;
+			}
+			pid_print_list(index, arg_wrap);
+			if (!sb->opened) {
+				printf("  Error: cannot open the performance counters, you would need to be root\n");
+				continue;
+			}
+			PerfValues v;
+			perf_counters_read(&sb->counters, &v);
+			perf_values_print(stdout, &v, &sb->prev, "  ");
+			sb->prev = v;
+		}
+		fflush(0);
+
+		// pick up the new sandboxes
+		refresh_sandboxes(pid);
+	}
+}
@@ -30,8 +30,14 @@
 #include <time.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/epoll.h>
+#include <linux/filter.h>
+#include <stddef.h>
 
 #define PIDS_BUFLEN 4096
+#define BUFFSIZE 4096		// one connector datagram
+#define RECV_BATCH 32		// datagrams per recvmmsg() call
+#define RCVBUF_SIZE (16 * 1024 * 1024)
 #define SERVER_PORT 889	// 889-899 is left unassigned by IANA
 
 //#define DEBUG_PRCTL
@@ -43,6 +49,17 @@
 #define debug_prctl(...) ((void)0)
 #endif
 
+// level of a process in the table, 0 if the process is not tracked
+static int pid_level(pid_t pid) {
+	int index = pid_find(pid);
+	return (index == -1) ? 0 : pids[index].level;
+}
+
+static pid_t pid_parent(pid_t pid) {
+	int index = pid_find(pid);
+	return (index == -1) ? 0 : pids[index].parent;
+}
+
 static int pid_is_firejail(pid_t pid) {
 	debug_prctl("pid %d\n", pid);
 	uid_t rv = 0;
@@ -95,8 +112,8 @@ static int pid_is_firejail(pid_t pid) {
 		// the initial -- is not included
 		char *exclude_args[] = {
 			// all print options
-			"apparmor.print", "caps.print", "cpu.print", "dns.print", "fs.print", "netfilter.print",
-			"netfilter6.print", "profile.print", "protocol.print", "seccomp.print",
+			"apparmor.print", "caps.print", "cpu.print", "dns.print", "fs.print", "memory.print",
+			"netfilter.print", "netfilter6.print", "profile.print", "protocol.print", "seccomp.print",
 			// debug
 			"debug-caps", "debug-errnos", "debug-protocols", "debug-syscalls", "debug-syscalls32",
 			// file transfer
@@ -156,375 +173,413 @@ doexit:
 }
 
 
+// offsets in the connector datagram: netlink header, cn_msg and proc_event
+#define CN_OFF(field) (NLMSG_HDRLEN + offsetof(struct cn_msg, field))
+#define EV_OFF(field) (NLMSG_HDRLEN + offsetof(struct cn_msg, data) + offsetof(struct proc_event, field))
+
+// Drop in the kernel the datagrams procevent_datagram() ignores: messages
+// from other connectors, the listen acknowledgment, and the fork, exit and
+// comm events of threads. The sandbox tree itself is tracked in user space,
+// the filter cannot follow it. BPF loads words in network byte order, the
+// constants are converted the same way.
+static void procevent_filter(int sock) {
+	struct sock_filter code[] = {
+		// 0: connector id
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, CN_OFF(id.idx)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(CN_IDX_PROC), 0, 15),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, CN_OFF(id.val)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(CN_VAL_PROC), 0, 13),
+		// 4: fork, child_pid == child_tgid
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_OFF(what)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(PROC_EVENT_FORK), 0, 4),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_OFF(event_data.fork.child_pid)),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_OFF(event_data.fork.child_tgid)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 8, 7),
+		// 10: exit and comm, process_pid == process_tgid
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(PROC_EVENT_EXIT), 2, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(PROC_EVENT_COMM), 1, 0),
+		// 12: everything else except the acknowledgment
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, htonl(PROC_EVENT_NONE), 4, 5),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_OFF(event_data.exit.process_pid)),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, EV_OFF(event_data.exit.process_tgid)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 1, 0),
+		// 17: drop, 18: accept
+		BPF_STMT(BPF_RET | BPF_K, 0),
+		BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+	};
+	// process_pid and process_tgid are at the same offsets for comm events
+	_Static_assert(offsetof(struct proc_event, event_data.exit.process_tgid) ==
+		       offsetof(struct proc_event, event_data.comm.process_tgid), "proc_event layout");
+
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1)
+		fprintf(stderr, "Warning: cannot attach the socket filter, all events are received\n");
+}
+
 static int procevent_netlink_setup(void) {
-	// open socket for process event connector
-	int sock;
-	if ((sock = socket(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR)) < 0)
-		goto errexit;
-
-	// bind socket
-	struct sockaddr_nl addr;
-	memset(&addr, 0, sizeof(addr));
-	addr.nl_pid = getpid();
-	addr.nl_family = AF_NETLINK;
-	addr.nl_groups = CN_IDX_PROC;
-	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-		goto errexit;
-
-	// set a large socket rx buffer
-	// the regular default value as set in /proc/sys/net/core/rmem_default will fill the
-	//            buffer much quicker than we can process it
-	int bsize = 1024 * 1024; // 1MB
-	socklen_t blen = sizeof(int);
-	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bsize, blen) == -1)
-		fprintf(stderr, "Warning: cannot set rx buffer size, using default system value\n");
-	else if (arg_debug) {
+	int sock = pid_netlink_open();
+	if (sock == -1) {
+		fprintf(stderr, "Error: netlink socket problem\n");
+		exit(1);
+	}
+
+	// bursts of fork events fill the default buffer set in pid_netlink_open()
+	int bsize = RCVBUF_SIZE;
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bsize, sizeof(bsize)) == -1)
+		fprintf(stderr, "Warning: cannot set rx buffer size\n");
+	procevent_filter(sock);
+
+	if (arg_debug) {
+		int bsize;
+		socklen_t blen = sizeof(int);
 		if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bsize, &blen) == -1)
 			fprintf(stderr, "Error: cannot read rx buffer size\n");
 		else
 			printf("rx buffer size %d\n", bsize / 2); // the value returned is double the real one, see man 7 socket
 	}
-
-	// send monitoring message
-	struct nlmsghdr nlmsghdr;
-	memset(&nlmsghdr, 0, sizeof(nlmsghdr));
-	nlmsghdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
-	nlmsghdr.nlmsg_pid = getpid();
-	nlmsghdr.nlmsg_type = NLMSG_DONE;
-
-	struct cn_msg cn_msg;
-	memset(&cn_msg, 0, sizeof(cn_msg));
-	cn_msg.id.idx = CN_IDX_PROC;
-	cn_msg.id.val = CN_VAL_PROC;
-	cn_msg.len = sizeof(enum proc_cn_mcast_op);
-
-	struct iovec iov[3];
-	iov[0].iov_base = &nlmsghdr;
-	iov[0].iov_len = sizeof(nlmsghdr);
-	iov[1].iov_base = &cn_msg;
-	iov[1].iov_len = sizeof(cn_msg);
-
-	enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
-	iov[2].iov_base = &op;
-	iov[2].iov_len = sizeof(op);
-
-	if (writev(sock, iov, 3) == -1)
-		goto errexit;
-
 	return sock;
-errexit:
-	fprintf(stderr, "Error: netlink socket problem\n");
-	exit(1);
 }
 
 
-static void __attribute__((noreturn)) procevent_monitor(const int sock, pid_t mypid) {
-	ssize_t len;
+// one datagram received from the connector
+static void procevent_datagram(char *buf, ssize_t len, pid_t mypid) {
 	struct nlmsghdr *nlmsghdr;
+	for (nlmsghdr = (struct nlmsghdr *)buf;
+		NLMSG_OK (nlmsghdr, (unsigned) len);
+		nlmsghdr = NLMSG_NEXT (nlmsghdr, len)) {
 
-	// timeout in order to re-enable firejail module trace
-	struct timeval tv;
-	tv.tv_sec = 30;
-	tv.tv_usec = 0;
-
-	while (1) {
-		__gcov_flush();
-
-#define BUFFSIZE 4096
-		char __attribute__ ((aligned(NLMSG_ALIGNTO)))buf[BUFFSIZE];
+		struct cn_msg *cn_msg;
+		struct proc_event *proc_ev;
+		struct tm tm;
+		time_t now;
 
-		fd_set readfds;
-		int max;
-		FD_ZERO(&readfds);
-		FD_SET(sock, &readfds);
-		max = sock;
-		max++;
-
-		int rv = select(max, &readfds, NULL, NULL, &tv);
-		if (rv == -1) {
-			errExit("recv");
-		}
-
-		// timeout
-		if (rv == 0) {
-			tv.tv_sec = 30;
-			tv.tv_usec = 0;
+		if ((nlmsghdr->nlmsg_type == NLMSG_ERROR) ||
+		    (nlmsghdr->nlmsg_type == NLMSG_NOOP))
 			continue;
-		}
-
-
-		if ((len = recv(sock, buf, sizeof(buf), 0)) == 0)
-			exit(0);
-		if (len == -1) {
-			if (errno == EINTR)
-				continue;
-			else if (errno == ENOBUFS) {
-				// rx buffer is full, the kernel started dropping messages
-				printf("*** Waning *** - message burst received, not all events are printed\n");
-//return -1;
-				continue;
-			}
-			else {
-				fprintf(stderr,"Error: rx socket recv call, errno %d, %s\n", errno, strerror(errno));
-				exit(1);
-			}
-		}
 
-		for (nlmsghdr = (struct nlmsghdr *)buf;
-			NLMSG_OK (nlmsghdr, (unsigned) len);
-			nlmsghdr = NLMSG_NEXT (nlmsghdr, len)) {
-
-			struct cn_msg *cn_msg;
-			struct proc_event *proc_ev;
-			struct tm tm;
-			time_t now;
-
-			if ((nlmsghdr->nlmsg_type == NLMSG_ERROR) ||
-			    (nlmsghdr->nlmsg_type == NLMSG_NOOP))
-				continue;
+		cn_msg = NLMSG_DATA(nlmsghdr);
+		if ((cn_msg->id.idx != CN_IDX_PROC) ||
+		    (cn_msg->id.val != CN_VAL_PROC))
+			continue;
 
-			cn_msg = NLMSG_DATA(nlmsghdr);
-			if ((cn_msg->id.idx != CN_IDX_PROC) ||
-			    (cn_msg->id.val != CN_VAL_PROC))
-				continue;
+		(void)time(&now);
+		(void)localtime_r(&now, &tm);
+		char line[PIDS_BUFLEN];
+		char *lineptr = line;
+		sprintf(lineptr, "%2.2d:%2.2d:%2.2d", tm.tm_hour, tm.tm_min, tm.tm_sec);
+		lineptr += strlen(lineptr);
+
+		proc_ev = (struct proc_event *)cn_msg->data;
+		pid_t pid = 0;
+		pid_t child = 0;
+		char *new_comm = NULL;
+		int remove_pid = 0;
+		int nodisplay = 0;
+		switch (proc_ev->what) {
+			case PROC_EVENT_FORK:
+				debug_prctl("event fork\n");
+
+				if (proc_ev->event_data.fork.child_pid !=
+				    proc_ev->event_data.fork.child_tgid)
+					continue; // this is a thread, not a process
+
+				pid = proc_ev->event_data.fork.parent_tgid;
+				debug_prctl("event fork, pid %d\n", pid);
+
+				int parent = pid_find(pid);
+				if (parent != -1 && pids[parent].level > 0) {
+					child = proc_ev->event_data.fork.child_tgid;
+					int index = pid_add(child);
+					pids[index].level = pids[parent].level + 1;
+					pids[index].uid = pid_get_uid(child);
+					pids[index].parent = pid;
+				}
+				sprintf(lineptr, " fork");
+				nodisplay = 1;
+				break;
 
-			(void)time(&now);
-			(void)localtime_r(&now, &tm);
-			char line[PIDS_BUFLEN];
-			char *lineptr = line;
-			sprintf(lineptr, "%2.2d:%2.2d:%2.2d", tm.tm_hour, tm.tm_min, tm.tm_sec);
-			lineptr += strlen(lineptr);
+			case PROC_EVENT_EXEC:
+				pid = proc_ev->event_data.exec.process_tgid;
+				debug_prctl("event exec, pid %d\n", pid);
 
-			proc_ev = (struct proc_event *)cn_msg->data;
-			pid_t pid = 0;
-			pid_t child = 0;
-			char *new_comm = NULL;
-			int remove_pid = 0;
-			int nodisplay = 0;
-			switch (proc_ev->what) {
-				case PROC_EVENT_FORK:
-					debug_prctl("event fork\n");
-
-					if (proc_ev->event_data.fork.child_pid !=
-					    proc_ev->event_data.fork.child_tgid)
-						continue; // this is a thread, not a process
-
-					pid = proc_ev->event_data.fork.parent_tgid;
-					debug_prctl("event fork, pid %d\n", pid);
-
-					if (pids[pid].level > 0) {
-						child = proc_ev->event_data.fork.child_tgid;
-						child %= max_pids;
-						pids[child].level = pids[pid].level + 1;
-						pids[child].uid = pid_get_uid(child);
-						pids[child].parent = pid;
-					}
-					sprintf(lineptr, " fork");
-					nodisplay = 1;
-					break;
+				int index = pid_find(pid);
+				if (index != -1 && pids[index].level == -1) {
+					pids[index].level = 0; // start tracking
+				}
+				sprintf(lineptr, " exec");
+				break;
 
-				case PROC_EVENT_EXEC:
-					pid = proc_ev->event_data.exec.process_tgid;
-					debug_prctl("event exec, pid %d\n", pid);
+			case PROC_EVENT_EXIT:
+				if (proc_ev->event_data.exit.process_pid !=
+				    proc_ev->event_data.exit.process_tgid)
+					continue; // this is a thread, not a process
 
-					if (pids[pid].level == -1) {
-						pids[pid].level = 0; // start tracking
-					}
-					sprintf(lineptr, " exec");
-					break;
+				pid = proc_ev->event_data.exit.process_tgid;
+				debug_prctl("event exit, pid %d\n", pid);
 
-				case PROC_EVENT_EXIT:
-					if (proc_ev->event_data.exit.process_pid !=
-					    proc_ev->event_data.exit.process_tgid)
-						continue; // this is a thread, not a process
+				remove_pid = 1;
+				sprintf(lineptr, " exit");
+				break;
 
-					pid = proc_ev->event_data.exit.process_tgid;
-					debug_prctl("event exit, pid %d\n", pid);
+			case PROC_EVENT_UID:
+				pid = proc_ev->event_data.id.process_tgid;
+				debug_prctl("event uid, pid %d\n", pid);
 
-					remove_pid = 1;
-					sprintf(lineptr, " exit");
-					break;
+				if (pid_level(pid) == 1 ||
+				    pid_level(pid_parent(pid)) == 1) {
+					sprintf(lineptr, "\n");
+					continue;
+				}
+				else {
+					sprintf(lineptr, " uid (%d:%d)",
+					        proc_ev->event_data.id.r.ruid,
+					        proc_ev->event_data.id.e.euid);
+				}
+				nodisplay = 1;
+				break;
 
-				case PROC_EVENT_UID:
-					pid = proc_ev->event_data.id.process_tgid;
-					debug_prctl("event uid, pid %d\n", pid);
-
-					if (pids[pid].level == 1 ||
-					    pids[pids[pid].parent].level == 1) {
-						sprintf(lineptr, "\n");
-						continue;
-					}
-					else {
-						sprintf(lineptr, " uid (%d:%d)",
-						        proc_ev->event_data.id.r.ruid,
-						        proc_ev->event_data.id.e.euid);
-					}
-					nodisplay = 1;
-					break;
+			case PROC_EVENT_GID:
+				pid = proc_ev->event_data.id.process_tgid;
+				debug_prctl("event gid, pid %d\n", pid);
 
-				case PROC_EVENT_GID:
-					pid = proc_ev->event_data.id.process_tgid;
-					debug_prctl("event gid, pid %d\n", pid);
-
-					if (pids[pid].level == 1 ||
-					    pids[pids[pid].parent].level == 1) {
-						sprintf(lineptr, "\n");
-						continue;
-					}
-					else {
-						sprintf(lineptr, " gid (%d:%d)",
-						        proc_ev->event_data.id.r.rgid,
-						        proc_ev->event_data.id.e.egid);
-					}
-					nodisplay = 1;
-					break;
+				if (pid_level(pid) == 1 ||
+				    pid_level(pid_parent(pid)) == 1) {
+					sprintf(lineptr, "\n");
+					continue;
+				}
+				else {
+					sprintf(lineptr, " gid (%d:%d)",
+					        proc_ev->event_data.id.r.rgid,
+					        proc_ev->event_data.id.e.egid);
+				}
+				nodisplay = 1;
+				break;
 
-				case PROC_EVENT_SID:
-					pid = proc_ev->event_data.sid.process_tgid;
-					debug_prctl("event sid, pid %d\n", pid);
+			case PROC_EVENT_SID:
+				pid = proc_ev->event_data.sid.process_tgid;
+				debug_prctl("event sid, pid %d\n", pid);
 
-					sprintf(lineptr, " sid ");
-					break;
+				sprintf(lineptr, " sid ");
+				break;
 
 // Note: PROC_EVENT_COREDUMP only exists since Linux 3.10 (see #6414).
 #ifdef PROC_EVENT_COREDUMP
-				case PROC_EVENT_COREDUMP:
-					pid = proc_ev->event_data.coredump.process_tgid;
-					debug_prctl("event coredump, pid %d\n", pid);
+			case PROC_EVENT_COREDUMP:
+				pid = proc_ev->event_data.coredump.process_tgid;
+				debug_prctl("event coredump, pid %d\n", pid);
 
-					sprintf(lineptr, " coredump ");
-					break;
+				sprintf(lineptr, " coredump ");
+				break;
 #endif /* PROC_EVENT_COREDUMP */
 
-				case PROC_EVENT_COMM:
-					pid = proc_ev->event_data.comm.process_tgid;
-					debug_prctl("event comm, pid %d\n", pid);
-
-					if (proc_ev->event_data.comm.process_pid !=
-					    proc_ev->event_data.comm.process_tgid)
-						continue; // this is a thread, not a process
-
-					if (pids[pid].level == 1 ||
-					    pids[pids[pid].parent].level == 1) {
-						sprintf(lineptr, "\n");
-						continue;
-					}
-					else {
-						sprintf(lineptr, " comm  %s", proc_ev->event_data.comm.comm);
-					}
-					nodisplay = 1;
-					break;
-
-				case PROC_EVENT_PTRACE:
-					pid = proc_ev->event_data.ptrace.process_tgid;
-					debug_prctl("event ptrace, pid %d\n", pid);
-
-					sprintf(lineptr, " ptrace ");
-					break;
+			case PROC_EVENT_COMM:
+				pid = proc_ev->event_data.comm.process_tgid;
+				debug_prctl("event comm, pid %d\n", pid);
 
-				default:
-					debug_prctl("event unknown\n");
+				if (proc_ev->event_data.comm.process_pid !=
+				    proc_ev->event_data.comm.process_tgid)
+					continue; // this is a thread, not a process
 
+				if (pid_level(pid) == 1 ||
+				    pid_level(pid_parent(pid)) == 1) {
 					sprintf(lineptr, "\n");
 					continue;
-			}
-
-			int add_new = 0;
-			if (pids[pid].level < 0)	// not a firejail process
-				continue;
-			else if (pids[pid].level == 0) { // new process, do we track it?
-				if (pid_is_firejail(pid) && mypid == 0) {
-					pids[pid].level = 1;
-					add_new = 1;
 				}
 				else {
-					pids[pid].level = -1;
-					continue;
+					sprintf(lineptr, " comm  %s", proc_ev->event_data.comm.comm);
 				}
-			}
+				nodisplay = 1;
+				break;
 
-			lineptr += strlen(lineptr);
-			sprintf(lineptr, " %u", pid);
-			lineptr += strlen(lineptr);
+			case PROC_EVENT_PTRACE:
+				pid = proc_ev->event_data.ptrace.process_tgid;
+				debug_prctl("event ptrace, pid %d\n", pid);
+
+				sprintf(lineptr, " ptrace ");
+				break;
+
+			default:
+				debug_prctl("event unknown\n");
+
+				sprintf(lineptr, "\n");
+				continue;
+		}
 
-			char *user = pids[pid].option.event.user;
-			if (!user)
-				user = pid_get_user_name(pids[pid].uid);
-			if (user) {
-				pids[pid].option.event.user = user;
-				sprintf(lineptr, " (%s)", user);
-				lineptr += strlen(lineptr);
+		// processes not in the table yet start with level 0
+		int index = pid_add(pid);
+		int add_new = 0;
+		if (pids[index].level < 0) {	// not a firejail process
+			if (remove_pid)
+				pid_remove(index);
+			continue;
+		}
+		else if (pids[index].level == 0) { // new process, do we track it?
+			if (pid_is_firejail(pid) && mypid == 0) {
+				pids[index].level = 1;
+				add_new = 1;
+			}
+			else {
+				pids[index].level = -1;
+				if (remove_pid)
+					pid_remove(index);
+				continue;
 			}
+		}
+
+		lineptr += strlen(lineptr);
+		sprintf(lineptr, " %u", pid);
+		lineptr += strlen(lineptr);
 
-			int sandbox_closed = 0; // exit sandbox flag
-			int cmd_dup = 0;
-			char *cmd = pids[pid].option.event.cmd;
+		char *user = pids[index].option.event.user;
+		if (!user)
+			user = pid_get_user_name(pids[index].uid);
+		if (user) {
+			pids[index].option.event.user = user;
+			sprintf(lineptr, " (%s)", user);
+			lineptr += strlen(lineptr);
+		}
+
+		int sandbox_closed = 0; // exit sandbox flag
+		int cmd_dup = 0;
+		char *cmd = pids[index].option.event.cmd;
+		if (!cmd) {
+			cmd_dup = 1;
+			cmd = pid_proc_cmdline(pid);
+		}
+		if (add_new) {
+			if (!cmd)
+				sprintf(lineptr, " NEW SANDBOX\n");
+			else
+				sprintf(lineptr, " NEW SANDBOX: %s\n", cmd);
+			lineptr += strlen(lineptr);
+		}
+		else if (proc_ev->what == PROC_EVENT_EXIT && pids[index].level == 1) {
+			sprintf(lineptr, " EXIT SANDBOX\n");
+			lineptr += strlen(lineptr);
+			if (mypid == pid)
+				sandbox_closed = 1;
+		}
+		else {
 			if (!cmd) {
 				cmd_dup = 1;
 				cmd = pid_proc_cmdline(pid);
 			}
-			if (add_new) {
-				if (!cmd)
-					sprintf(lineptr, " NEW SANDBOX\n");
-				else
-					sprintf(lineptr, " NEW SANDBOX: %s\n", cmd);
-				lineptr += strlen(lineptr);
-			}
-			else if (proc_ev->what == PROC_EVENT_EXIT && pids[pid].level == 1) {
-				sprintf(lineptr, " EXIT SANDBOX\n");
-				lineptr += strlen(lineptr);
-				if (mypid == pid)
-					sandbox_closed = 1;
-			}
-			else {
-				if (!cmd) {
-					cmd_dup = 1;
-					cmd = pid_proc_cmdline(pid);
-				}
-				if (!cmd || nodisplay)
-					sprintf(lineptr, "\n");
-				else
-					sprintf(lineptr, " %s\n", cmd);
-				lineptr += strlen(lineptr);
-			}
-			(void) lineptr;
+			if (!cmd || nodisplay)
+				sprintf(lineptr, "\n");
+			else
+				sprintf(lineptr, " %s\n", cmd);
+			lineptr += strlen(lineptr);
+		}
+		(void) lineptr;
 
-			if (cmd && cmd_dup) {
-				free(cmd);
-				cmd = NULL;
-			}
+		if (cmd && cmd_dup) {
+			free(cmd);
+			cmd = NULL;
+		}
 
-			// print the event
-			printf("%s", line);
-			fflush(0);
-
-			// unflag pid for exit events
-			if (remove_pid) {
-				if (pids[pid].option.event.user)
-					free(pids[pid].option.event.user);
-				if (pids[pid].option.event.cmd)
-					free(pids[pid].option.event.cmd);
-				memset(&pids[pid], 0, sizeof(Process));
-			}
+		// print the event
+		printf("%s", line);
+		fflush(0);
+
+		// unflag pid for exit events
+		if (remove_pid) {
+			if (pids[index].option.event.user)
+				free(pids[index].option.event.user);
+			if (pids[index].option.event.cmd)
+				free(pids[index].option.event.cmd);
+			pid_remove(index);
+		}
+
+		// print forked child
+		if (child)
+			printf("\tchild %u\n", child);
+
+		// print new comm
+		if (new_comm)
+			printf("\tnew comm %s\n", new_comm);
+
+		// on uid events the uid is changing
+		if (proc_ev->what == PROC_EVENT_UID) {
+			if (pids[index].option.event.user)
+				free(pids[index].option.event.user);
+			pids[index].option.event.user = 0;
+			pids[index].uid = pid_get_uid(pid);
+		}
 
-			// print forked child
-			if (child)
-				printf("\tchild %u\n", child);
+		if (sandbox_closed)
+			exit(0);
+	}
+}
 
-			// print new comm
-			if (new_comm)
-				printf("\tnew comm %s\n", new_comm);
+static void __attribute__((noreturn)) procevent_monitor(const int sock, pid_t mypid) {
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		errExit("epoll_create1");
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = sock;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) == -1)
+		errExit("epoll_ctl");
+
+	static char __attribute__ ((aligned(NLMSG_ALIGNTO))) buf[RECV_BATCH][BUFFSIZE];
+	struct iovec iov[RECV_BATCH];
+	struct mmsghdr msg[RECV_BATCH];
+	int i;
+	for (i = 0; i < RECV_BATCH; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = BUFFSIZE;
+	}
 
-			// on uid events the uid is changing
-			if (proc_ev->what == PROC_EVENT_UID) {
-				if (pids[pid].option.event.user)
-					free(pids[pid].option.event.user);
-				pids[pid].option.event.user = 0;
-				pids[pid].uid = pid_get_uid(pid);
+	while (1) {
+		__gcov_flush();
+
+		// timeout in order to re-enable firejail module trace
+		int rv = epoll_wait(epfd, &ev, 1, 30 * 1000);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("epoll_wait");
+		}
+		if (rv == 0)	// timeout
+			continue;
+
+		// drain the socket, RECV_BATCH datagrams at a time
+		while (1) {
+			memset(msg, 0, sizeof(msg));
+			for (i = 0; i < RECV_BATCH; i++) {
+				msg[i].msg_hdr.msg_iov = &iov[i];
+				msg[i].msg_hdr.msg_iovlen = 1;
 			}
 
-			if (sandbox_closed)
+			int cnt = recvmmsg(sock, msg, RECV_BATCH, MSG_DONTWAIT, NULL);
+			if (cnt == -1) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+				if (errno == EINTR)
+					continue;
+				else if (errno == ENOBUFS) {
+					// rx buffer is full, the kernel started dropping messages
+					printf("*** Waning *** - message burst received, not all events are printed\n");
+					continue;
+				}
+				else {
+					fprintf(stderr,"Error: rx socket recv call, errno %d, %s\n", errno, strerror(errno));
+					exit(1);
+				}
+			}
+			if (cnt == 0)
 				exit(0);
+
+			for (i = 0; i < cnt; i++)
+				procevent_datagram(buf[i], msg[i].msg_len, mypid);
+			if (cnt < RECV_BATCH)
+				break;
 		}
 	}
 	__builtin_unreachable();
@@ -537,17 +592,6 @@ void procevent(pid_t pid) {
 		exit(1);
 	}
 
-	// set max_pids to the max value allowed by the kernel
-	FILE *fp = fopen("/proc/sys/kernel/pid_max", "r");
-	if (fp) {
-		int val;
-		if (fscanf(fp, "%d", &val) == 1) {
-			if (val >= max_pids)
-				max_pids = val + 1;
-		}
-		fclose(fp);
-	}
-
 	// monitor using netlink
 	int sock = procevent_netlink_setup();
 	if (sock < 0) {
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#define MAXBUF 4096
+
+// The views open /proc/<pid> once as a directory and read the files
+// through the descriptor. The descriptor stays bound to the process: once
+// the process is gone the files cannot be opened anymore, even if the pid
+// was reused in the meantime.
+
+static int snapshot_done = 0;
+
+// read the process table once for all the cumulative views
+void pid_snapshot(pid_t pid) {
+	if (snapshot_done)
+		return;
+	pid_read(pid);
+	snapshot_done = 1;
+}
+
+int proc_open(pid_t pid) {
+	char fname[32];
+	snprintf(fname, sizeof(fname), "/proc/%d", (int) pid);
+	return open(fname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+FILE *proc_fopen(int procfd, const char *name) {
+	int fd = openat(procfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+	FILE *fp = fdopen(fd, "r");
+	if (!fp)
+		close(fd);
+	return fp;
+}
+
+// print the lines of /proc/<pid>/status starting with one of the fields,
+// in the order of the file
+void proc_print_status(pid_t pid, int procfd, const char *const fields[]) {
+	FILE *fp = (procfd == -1) ? NULL : proc_fopen(procfd, "status");
+	if (!fp) {
+		printf("  Error: cannot open /proc/%d/status\n", (int) pid);
+		return;
+	}
+
+	int cnt = 0;
+	while (fields[cnt])
+		cnt++;
+
+	char buf[MAXBUF];
+	int found = 0;
+	while (found < cnt && fgets(buf, MAXBUF, fp)) {
+		int i;
+		for (i = 0; i < cnt; i++) {
+			if (strncmp(buf, fields[i], strlen(fields[i])) == 0) {
+				printf("  %s", buf);
+				found++;
+				break;
+			}
+		}
+	}
+	fflush(0);
+	fclose(fp);
+}
+
+// the same for a single pid
+void proc_print_status_pid(pid_t pid, const char *const fields[]) {
+	int procfd = proc_open(pid);
+	proc_print_status(pid, procfd, fields);
+	if (procfd != -1)
+		close(procfd);
+}
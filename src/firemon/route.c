@@ -40,7 +40,7 @@ static IfList *list_find(uint32_t ip, uint32_t mask) {
 	return NULL;
 }
 
-static void extract_if(const char *fname) {
+static void extract_if(FILE *fp) {
 	// clear interface list
 	while (ifs) {
 		IfList *tmp = ifs->next;
@@ -49,7 +49,6 @@ static void extract_if(const char *fname) {
 	}
 	assert(ifs == NULL);
 
-	FILE *fp = fopen(fname, "r");
 	if (!fp)
 		return;
 
@@ -111,8 +110,7 @@ static void extract_if(const char *fname) {
 
 }
 
-static void print_route(const char *fname) {
-	FILE *fp = fopen(fname, "r");
+static void print_route(FILE *fp) {
 	if (!fp)
 		return;
 
@@ -181,27 +179,35 @@ static void print_route(const char *fname) {
 
 }
 
+// route table of the network namespace of the process
+// sock: NETLINK_ROUTE socket opened with rtnl_open, or -1
+void route_print(int procfd, int sock) {
+	if (sock != -1 && rtnl_print_route(sock) == 0)
+		return;
+	if (procfd == -1)
+		return;
+
+	extract_if(proc_fopen(procfd, "net/fib_trie"));
+	print_route(proc_fopen(procfd, "net/route"));
+}
+
 void route(pid_t pid, int print_procs) {
-	pid_read(pid);
+	pid_snapshot(pid);
 
 	// print processes
 	int i;
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
 			if (print_procs || pid == 0)
 				pid_print_list(i, arg_wrap);
 			int child = find_child(i);
 			if (child != -1) {
-				char *fname;
-				if (asprintf(&fname, "/proc/%d/net/fib_trie", child) == -1)
-					errExit("asprintf");
-				extract_if(fname);
-				free(fname);
-
-				if (asprintf(&fname, "/proc/%d/net/route", child) == -1)
-					errExit("asprintf");
-				print_route(fname);
-				free(fname);
+				int procfd = proc_open(child);
+				int sock = rtnl_open(procfd);
+				route_print(procfd, sock);
+				rtnl_close(sock);
+				if (procfd != -1)
+					close(procfd);
 			}
 		}
 	}
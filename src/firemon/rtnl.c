@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+// route and ARP tables of a sandbox read with NETLINK_ROUTE dumps. A
+// netlink socket belongs to the network namespace it was created in: when
+// the sandbox has its own namespace firemon enters it (root only), creates
+// the socket and comes back. Otherwise the caller falls back to the text
+// files in /proc/<pid>/net. The same is used for the NETLINK_SOCK_DIAG
+// socket of --tcpinfo.
+#define RTNL_BUFSIZE 32768
+// not exported by the kernel headers
+#define NUD_VALID (NUD_PERMANENT | NUD_NOARP | NUD_REACHABLE | NUD_PROBE | NUD_STALE | NUD_DELAY)
+
+typedef struct {
+	int index;
+	char name[IF_NAMESIZE];
+} RtnlLink;
+
+static RtnlLink *links = NULL;
+static int links_cnt = 0;
+static int links_read = 0;
+
+// a netlink socket of the given protocol in the network namespace of the process
+int netns_socket(int procfd, int protocol) {
+	struct stat s1, s2;
+	if (procfd == -1 || fstatat(procfd, "ns/net", &s1, 0) == -1 || stat("/proc/self/ns/net", &s2) == -1)
+		return -1;
+
+	// same network namespace
+	if (s1.st_dev == s2.st_dev && s1.st_ino == s2.st_ino)
+		return socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+
+	if (geteuid() != 0)
+		return -1;
+	int self = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+	if (self == -1)
+		return -1;
+	int target = openat(procfd, "ns/net", O_RDONLY | O_CLOEXEC);
+	if (target == -1) {
+		close(self);
+		return -1;
+	}
+
+	int sock = -1;
+	if (setns(target, CLONE_NEWNET) == 0) {
+		sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+		if (setns(self, CLONE_NEWNET) == -1)
+			errExit("setns");
+	}
+	else if (arg_debug)
+		printf("Cannot enter the network namespace: %s\n", strerror(errno));
+	close(target);
+	close(self);
+	return sock;
+}
+
+int rtnl_open(int procfd) {
+	return netns_socket(procfd, NETLINK_ROUTE);
+}
+
+// send a dump request and pass every message to cb; returns -1 on error
+static int rtnl_dump(int sock, int type, unsigned char family, void (*cb)(struct nlmsghdr *h)) {
+	struct {
+		struct nlmsghdr h;
+		struct rtgenmsg g;
+	} req;
+	memset(&req, 0, sizeof(req));
+	req.h.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+	req.h.nlmsg_type = type;
+	req.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.h.nlmsg_seq = type;
+	req.g.rtgen_family = family;
+	if (send(sock, &req, req.h.nlmsg_len, 0) == -1)
+		return -1;
+
+	char *buf = malloc(RTNL_BUFSIZE);
+	if (!buf)
+		errExit("malloc");
+	int rv = -1;
+	while (1) {
+		ssize_t len = recv(sock, buf, RTNL_BUFSIZE, 0);
+		if (len <= 0)
+			break;
+		struct nlmsghdr *h = (struct nlmsghdr *) buf;
+		for (; NLMSG_OK(h, (size_t) len); h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_seq != (unsigned) type)
+				continue;
+			if (h->nlmsg_type == NLMSG_DONE) {
+				rv = 0;
+				goto out;
+			}
+			if (h->nlmsg_type == NLMSG_ERROR)
+				goto out;
+			cb(h);
+		}
+	}
+out:
+	free(buf);
+	return rv;
+}
+
+static void link_cb(struct nlmsghdr *h) {
+	if (h->nlmsg_type != RTM_NEWLINK)
+		return;
+	struct ifinfomsg *ifi = NLMSG_DATA(h);
+	int len = IFLA_PAYLOAD(h);
+	struct rtattr *rta = IFLA_RTA(ifi);
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type != IFLA_IFNAME)
+			continue;
+		links = realloc(links, (links_cnt + 1) * sizeof(RtnlLink));
+		if (!links)
+			errExit("realloc");
+		links[links_cnt].index = ifi->ifi_index;
+		snprintf(links[links_cnt].name, IF_NAMESIZE, "%.*s", (int) RTA_PAYLOAD(rta), (char *) RTA_DATA(rta));
+		links_cnt++;
+		break;
+	}
+}
+
+// interface names of the namespace, the indexes in the route and
+// neighbour tables are not the indexes of the namespace firemon runs in
+static int read_links(int sock) {
+	if (links_read)
+		return 0;
+	if (rtnl_dump(sock, RTM_GETLINK, AF_UNSPEC, link_cb))
+		return -1;
+	links_read = 1;
+	return 0;
+}
+
+void rtnl_close(int sock) {
+	if (sock != -1)
+		close(sock);
+	free(links);
+	links = NULL;
+	links_cnt = 0;
+	links_read = 0;
+}
+
+static const char *link_name(int index) {
+	int i;
+	for (i = 0; i < links_cnt; i++) {
+		if (links[i].index == index)
+			return links[i].name;
+	}
+	return "?";
+}
+
+static uint32_t rta_ip(struct rtattr *rta) {
+	uint32_t ip;
+	memcpy(&ip, RTA_DATA(rta), sizeof(ip));
+	return ntohl(ip);
+}
+
+static void route_cb(struct nlmsghdr *h) {
+	if (h->nlmsg_type != RTM_NEWROUTE)
+		return;
+	struct rtmsg *r = NLMSG_DATA(h);
+	if (r->rtm_family != AF_INET || r->rtm_type != RTN_UNICAST)
+		return;
+
+	uint32_t table = r->rtm_table;
+	uint32_t dest = 0, gw = 0, src = 0, metric = 0;
+	int oif = 0;
+	int len = RTM_PAYLOAD(h);
+	struct rtattr *rta = RTM_RTA(r);
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == RTA_TABLE)
+			memcpy(&table, RTA_DATA(rta), sizeof(table));
+		else if (rta->rta_type == RTA_DST)
+			dest = rta_ip(rta);
+		else if (rta->rta_type == RTA_GATEWAY)
+			gw = rta_ip(rta);
+		else if (rta->rta_type == RTA_PREFSRC)
+			src = rta_ip(rta);
+		else if (rta->rta_type == RTA_PRIORITY)
+			memcpy(&metric, RTA_DATA(rta), sizeof(metric));
+		else if (rta->rta_type == RTA_OIF)
+			memcpy(&oif, RTA_DATA(rta), sizeof(oif));
+	}
+	// /proc/net/route lists only the main table
+	if (table != RT_TABLE_MAIN)
+		return;
+
+	if (gw != 0)
+		printf("     %d.%d.%d.%d/%u via %d.%d.%d.%d, dev %s, metric %u\n",
+			PRINT_IP(dest), r->rtm_dst_len,
+			PRINT_IP(gw),
+			link_name(oif),
+			metric);
+	else if (src != 0)
+		printf("     %d.%d.%d.%d/%u, dev %s, scope link src %d.%d.%d.%d\n",
+			PRINT_IP(dest), r->rtm_dst_len,
+			link_name(oif),
+			PRINT_IP(src));
+}
+
+static void neigh_cb(struct nlmsghdr *h) {
+	if (h->nlmsg_type != RTM_NEWNEIGH)
+		return;
+	struct ndmsg *n = NLMSG_DATA(h);
+	// /proc/net/arp skips the NOARP entries
+	if (n->ndm_family != AF_INET || n->ndm_state == NUD_NOARP)
+		return;
+
+	uint32_t dest = 0;
+	const unsigned char *mac = NULL;
+	int len = h->nlmsg_len - NLMSG_LENGTH(sizeof(struct ndmsg));
+	struct rtattr *rta = (struct rtattr *) ((char *) n + NLMSG_ALIGN(sizeof(struct ndmsg)));
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == NDA_DST)
+			dest = rta_ip(rta);
+		else if (rta->rta_type == NDA_LLADDR && RTA_PAYLOAD(rta) == 6)
+			mac = RTA_DATA(rta);
+	}
+	if (dest == 0)
+		return;
+
+	if (!(n->ndm_state & NUD_VALID) || !mac)
+		printf("     %d.%d.%d.%d dev %s FAILED\n",
+			PRINT_IP(dest), link_name(n->ndm_ifindex));
+	else
+		printf("     %d.%d.%d.%d dev %s lladdr %02x:%02x:%02x:%02x:%02x:%02x REACHABLE\n",
+			PRINT_IP(dest), link_name(n->ndm_ifindex),
+			mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+// returns -1 if nothing was printed, the caller reads /proc/<pid>/net/route
+int rtnl_print_route(int sock) {
+	if (read_links(sock))
+		return -1;
+	printf("  Route table:\n");
+	rtnl_dump(sock, RTM_GETROUTE, AF_INET, route_cb);
+	return 0;
+}
+
+// returns -1 if nothing was printed, the caller reads /proc/<pid>/net/arp
+int rtnl_print_arp(int sock) {
+	if (read_links(sock))
+		return -1;
+	printf("  ARP Table:\n");
+	rtnl_dump(sock, RTM_GETNEIGH, AF_INET, neigh_cb);
+	return 0;
+}
@@ -19,37 +19,17 @@
 */
 #include "firemon.h"
 
-#define MAXBUF 4098
 static void print_seccomp(int pid) {
-	char *file;
-	if (asprintf(&file, "/proc/%d/status", pid) == -1)
-		errExit("asprintf");
-
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		printf("  Error: cannot open %s\n", file);
-		free(file);
-		return;
-	}
-
-	char buf[MAXBUF];
-	while (fgets(buf, MAXBUF, fp)) {
-		if (strncmp(buf, "Seccomp:", 8) == 0) {
-			printf("  %s", buf);
-			fflush(0);
-			break;
-		}
-	}
-	fclose(fp);
-	free(file);
+	static const char *const fields[] = { "Seccomp:", NULL };
+	proc_print_status_pid(pid, fields);
 }
 
 void seccomp(pid_t pid, int print_procs) {
-	pid_read(pid);	// include all processes
+	pid_snapshot(pid);	// include all processes
 
 	// print processes
 	int i;
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
 			if (print_procs || pid == 0)
 				pid_print_list(i, arg_wrap);
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include "../include/launch_stats.h"
+#include "../include/rundefs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// --stats: the launch counters written by firejail in RUN_STATS_FILE,
+// see launch_stats.h; the segment is mapped read-only
+
+static int phase_cmp(const void *a, const void *b) {
+	const StatsPhase *p1 = *(const StatsPhase * const *) a;
+	const StatsPhase *p2 = *(const StatsPhase * const *) b;
+	if (p1->usec != p2->usec)
+		return (p1->usec < p2->usec) ? 1 : -1;
+	return strcmp(p1->name, p2->name);
+}
+
+void stats(int jsonl) {
+	int fd = open(RUN_STATS_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1) {
+		if (errno == ENOENT) {
+			printf("No sandbox started since boot, or the launch statistics are disabled in firejail.config\n");
+			exit(0);
+		}
+		fprintf(stderr, "Error: cannot open %s: %s\n", RUN_STATS_FILE, strerror(errno));
+		exit(1);
+	}
+	struct stat s;
+	if (fstat(fd, &s) == -1)
+		errExit("fstat");
+	if (!S_ISREG(s.st_mode) || s.st_uid != 0 || s.st_size != sizeof(StatsSegment)) {
+		fprintf(stderr, "Error: %s was not created by this version of firejail\n", RUN_STATS_FILE);
+		exit(1);
+	}
+	const StatsSegment *seg = mmap(NULL, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+	if (seg == MAP_FAILED)
+		errExit("mmap");
+	close(fd);
+	if (seg->magic != STATS_MAGIC || seg->version != STATS_VERSION) {
+		fprintf(stderr, "Error: %s was not created by this version of firejail\n", RUN_STATS_FILE);
+		exit(1);
+	}
+
+	// a snapshot of the counters, the sandboxes keep updating them
+	uint64_t counter[STATS_COUNTER_MAX];
+	int i;
+	for (i = 0; i < STATS_COUNTER_MAX; i++)
+		counter[i] = __atomic_load_n(&seg->counter[i], __ATOMIC_RELAXED);
+	StatsPhase phase[STATS_PHASES];
+	const StatsPhase *sorted[STATS_PHASES];
+	int cnt = 0;
+	for (i = 0; i < STATS_PHASES; i++) {
+		if (__atomic_load_n(&seg->phase[i].state, __ATOMIC_ACQUIRE) != STATS_PHASE_READY)
+			continue;
+		StatsPhase *p = &phase[cnt];
+		memcpy(p->name, seg->phase[i].name, STATS_PHASE_NAME);
+		p->name[STATS_PHASE_NAME - 1] = '\0';
+		p->count = __atomic_load_n(&seg->phase[i].count, __ATOMIC_RELAXED);
+		p->usec = __atomic_load_n(&seg->phase[i].usec, __ATOMIC_RELAXED);
+		sorted[cnt] = p;
+		cnt++;
+	}
+	qsort(sorted, cnt, sizeof(sorted[0]), phase_cmp);
+	time_t created = (time_t) seg->created;
+	munmap((void *) seg, sizeof(StatsSegment));
+
+	if (jsonl) {
+		printf("{\"created\":%llu", (unsigned long long) created);
+		for (i = 0; i < STATS_COUNTER_MAX; i++) {
+			printf(",");
+			json_print_string(stdout, stats_names[i]);
+			printf(":%llu", (unsigned long long) counter[i]);
+		}
+		printf(",\"phases\":[");
+		for (i = 0; i < cnt; i++) {
+			printf("%s{\"name\":", (i) ? "," : "");
+			json_print_string(stdout, sorted[i]->name);
+			printf(",\"count\":%llu,\"usec\":%llu}",
+			       (unsigned long long) sorted[i]->count, (unsigned long long) sorted[i]->usec);
+		}
+		printf("]}\n");
+		return;
+	}
+
+	char tbuf[64];
+	struct tm tm;
+	if (localtime_r(&created, &tm) && strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &tm))
+		printf("Launch statistics since %s\n", tbuf);
+	for (i = 0; i < STATS_COUNTER_MAX; i++)
+		printf("  %-28s %12llu\n", stats_names[i], (unsigned long long) counter[i]);
+	if (counter[STATS_LOCK_WAITS])
+		printf("  %-28s %12.1f\n", "lock-wait-avg-ms",
+		       (double) counter[STATS_LOCK_WAIT_USEC] / counter[STATS_LOCK_WAITS] / 1000.0);
+
+	if (cnt == 0)
+		return;
+	printf("\n  %-40s %8s %12s %10s\n", "phase", "count", "total(ms)", "avg(ms)");
+	for (i = 0; i < cnt; i++) {
+		const StatsPhase *p = sorted[i];
+		printf("    %-38s %8llu %12.1f %10.2f\n", p->name, (unsigned long long) p->count,
+		       p->usec / 1000.0, (p->count) ? (double) p->usec / p->count / 1000.0 : 0.0);
+	}
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "firemon.h"
+#include <dirent.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+
+// --tcpinfo: the TCP connections of a sandbox, read with a SOCK_DIAG dump in
+// the network namespace of the sandbox (see rtnl.c), with the kernel
+// tcp_info of every socket. The values are grouped by remote address and
+// port: average and maximum smoothed RTT, retransmitted segments, average
+// congestion window and total pacing rate. When the sandbox uses the
+// network namespace of the host, only the sockets open by the processes of
+// the sandbox are counted.
+#define DIAG_BUFSIZE 32768
+#define INODES_MAX 4096
+
+// TCP states, see include/net/tcp_states.h in the kernel; the listening
+// sockets and the TIME_WAIT sockets don't have a tcp_info
+#define TCP_STATES ((1 << 1) | (1 << 2) | (1 << 3) | (1 << 4) | (1 << 5) | \
+	(1 << 8) | (1 << 9) | (1 << 11))	// ESTABLISHED to FIN_WAIT2, CLOSE_WAIT, LAST_ACK, CLOSING
+
+typedef struct {
+	unsigned char family;
+	uint8_t addr[16];
+	uint16_t port;		// host byte order
+	unsigned socks;
+	unsigned long long rtt_sum;	// usec
+	unsigned rtt_max;
+	unsigned long long retrans;
+	unsigned long long cwnd_sum;
+	unsigned long long pacing;	// bytes per second
+} TcpDest;
+
+static TcpDest *dest = NULL;
+static int dest_cnt = 0;
+static int dest_max = 0;
+
+// socket inodes of the sandbox processes, NULL if the sandbox has its own
+// network namespace
+static ino_t *inodes = NULL;
+static int inodes_cnt = 0;
+
+static TcpDest *dest_find(unsigned char family, const uint8_t *addr, uint16_t port) {
+	int i;
+	size_t len = (family == AF_INET) ? 4 : 16;
+	for (i = 0; i < dest_cnt; i++) {
+		if (dest[i].family == family && dest[i].port == port && memcmp(dest[i].addr, addr, len) == 0)
+			return &dest[i];
+	}
+
+	if (dest_cnt == dest_max) {
+		dest_max = (dest_max) ? dest_max * 2 : 32;
+		dest = realloc(dest, dest_max * sizeof(TcpDest));
+		if (!dest)
+			errExit("realloc");
+	}
+	TcpDest *d = &dest[dest_cnt++];
+	memset(d, 0, sizeof(TcpDest));
+	d->family = family;
+	memcpy(d->addr, addr, len);
+	d->port = port;
+	return d;
+}
+
+static int inode_cmp(const void *a, const void *b) {
+	ino_t i1 = *(const ino_t *) a;
+	ino_t i2 = *(const ino_t *) b;
+	return (i1 > i2) - (i1 < i2);
+}
+
+// the sockets in /proc/<pid>/fd of a process
+static void inodes_add(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/fd", pid) == -1)
+		errExit("asprintf");
+	DIR *dir = opendir(fname);
+	free(fname);
+	if (!dir)
+		return;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL && inodes_cnt < INODES_MAX) {
+		char link[64];
+		ssize_t len = readlinkat(dirfd(dir), entry->d_name, link, sizeof(link) - 1);
+		if (len <= 0)
+			continue;
+		link[len] = '\0';
+		unsigned long long ino;
+		if (sscanf(link, "socket:[%llu]", &ino) == 1)
+			inodes[inodes_cnt++] = (ino_t) ino;
+	}
+	closedir(dir);
+}
+
+static int in_sandbox(int index, int sandbox) {
+	while (index != -1) {
+		if (index == sandbox)
+			return 1;
+		if (pids[index].level <= 1)
+			return 0;
+		index = pid_find(pids[index].parent);
+	}
+	return 0;
+}
+
+static void inodes_read(int sandbox) {
+	inodes = malloc(INODES_MAX * sizeof(ino_t));
+	if (!inodes)
+		errExit("malloc");
+	inodes_cnt = 0;
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (in_sandbox(i, sandbox))
+			inodes_add(pids[i].pid);
+	}
+	qsort(inodes, inodes_cnt, sizeof(ino_t), inode_cmp);
+}
+
+static void inodes_free(void) {
+	free(inodes);
+	inodes = NULL;
+	inodes_cnt = 0;
+}
+
+static void diag_msg(struct nlmsghdr *h) {
+	struct inet_diag_msg *msg = NLMSG_DATA(h);
+	if (h->nlmsg_len < NLMSG_LENGTH(sizeof(*msg)))
+		return;
+	if (inodes) {
+		ino_t ino = msg->idiag_inode;
+		if (!bsearch(&ino, inodes, inodes_cnt, sizeof(ino_t), inode_cmp))
+			return;
+	}
+
+	struct rtattr *rta = (struct rtattr *) (msg + 1);
+	int len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type != INET_DIAG_INFO)
+			continue;
+		// older kernels return a shorter structure
+		struct tcp_info info;
+		memset(&info, 0, sizeof(info));
+		size_t size = RTA_PAYLOAD(rta);
+		memcpy(&info, RTA_DATA(rta), (size < sizeof(info)) ? size : sizeof(info));
+
+		TcpDest *d = dest_find(msg->idiag_family, (uint8_t *) msg->id.idiag_dst, ntohs(msg->id.idiag_dport));
+		d->socks++;
+		d->rtt_sum += info.tcpi_rtt;
+		if (info.tcpi_rtt > d->rtt_max)
+			d->rtt_max = info.tcpi_rtt;
+		d->retrans += info.tcpi_total_retrans;
+		d->cwnd_sum += info.tcpi_snd_cwnd;
+		if (size >= offsetof(struct tcp_info, tcpi_pacing_rate) + sizeof(info.tcpi_pacing_rate) &&
+		    info.tcpi_pacing_rate != ~0ULL)	// ~0: no pacing
+			d->pacing += info.tcpi_pacing_rate;
+		break;
+	}
+}
+
+// returns -1 on error
+static int diag_dump(int sock, unsigned char family) {
+	struct {
+		struct nlmsghdr h;
+		struct inet_diag_req_v2 r;
+	} req;
+	memset(&req, 0, sizeof(req));
+	req.h.nlmsg_len = sizeof(req);
+	req.h.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	req.h.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.h.nlmsg_seq = family;
+	req.r.sdiag_family = family;
+	req.r.sdiag_protocol = IPPROTO_TCP;
+	req.r.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+	req.r.idiag_states = TCP_STATES;
+	if (send(sock, &req, sizeof(req), 0) == -1)
+		return -1;
+
+	char *buf = malloc(DIAG_BUFSIZE);
+	if (!buf)
+		errExit("malloc");
+	int rv = -1;
+	while (1) {
+		ssize_t len = recv(sock, buf, DIAG_BUFSIZE, 0);
+		if (len <= 0)
+			break;
+		struct nlmsghdr *h = (struct nlmsghdr *) buf;
+		for (; NLMSG_OK(h, (size_t) len); h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_seq != family)
+				continue;
+			if (h->nlmsg_type == NLMSG_DONE) {
+				rv = 0;
+				goto out;
+			}
+			if (h->nlmsg_type == NLMSG_ERROR)
+				goto out;
+			diag_msg(h);
+		}
+	}
+out:
+	free(buf);
+	return rv;
+}
+
+static int dest_cmp(const void *a, const void *b) {
+	const TcpDest *d1 = a;
+	const TcpDest *d2 = b;
+	unsigned long long r1 = d1->rtt_sum / d1->socks;
+	unsigned long long r2 = d2->rtt_sum / d2->socks;
+	return (r1 < r2) - (r1 > r2);
+}
+
+static void rate_str(char *buf, size_t len, unsigned long long rate) {
+	if (rate == 0)
+		snprintf(buf, len, "-");
+	else if (rate >= 1024 * 1024)
+		snprintf(buf, len, "%.1f MB/s", (double) rate / (1024 * 1024));
+	else
+		snprintf(buf, len, "%.1f KB/s", (double) rate / 1024);
+}
+
+static void tcpinfo_print(int sock) {
+	if (diag_dump(sock, AF_INET) == -1 || diag_dump(sock, AF_INET6) == -1) {
+		printf("  TCP information not available\n");
+		return;
+	}
+
+	printf("  TCP connections:\n");
+	if (dest_cnt == 0)
+		return;
+	qsort(dest, dest_cnt, sizeof(TcpDest), dest_cmp);
+	printf("     %-46s %5s %8s %8s %7s %6s %12s\n",
+	       "destination", "socks", "rtt(ms)", "max(ms)", "retrans", "cwnd", "pacing");
+	int i;
+	for (i = 0; i < dest_cnt; i++) {
+		TcpDest *d = &dest[i];
+		char addr[INET6_ADDRSTRLEN];
+		inet_ntop(d->family, d->addr, addr, sizeof(addr));
+		char endpoint[INET6_ADDRSTRLEN + 16];
+		if (d->family == AF_INET6)
+			snprintf(endpoint, sizeof(endpoint), "[%s]:%u", addr, d->port);
+		else
+			snprintf(endpoint, sizeof(endpoint), "%s:%u", addr, d->port);
+		char pacing[32];
+		rate_str(pacing, sizeof(pacing), d->pacing);
+		printf("     %-46s %5u %8.2f %8.2f %7llu %6llu %12s\n",
+		       endpoint, d->socks, (double) d->rtt_sum / d->socks / 1000, d->rtt_max / 1000.0,
+		       d->retrans, d->cwnd_sum / d->socks, pacing);
+	}
+}
+
+void tcpinfo(pid_t pid, int print_procs) {
+	pid_snapshot(pid);
+
+	// print processes
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level == 1) {
+			if (print_procs || pid == 0)
+				pid_print_list(i, arg_wrap);
+			int child = find_child(i);
+			if (child == -1)
+				continue;
+			int procfd = proc_open(child);
+			int sock = netns_socket(procfd, NETLINK_SOCK_DIAG);
+			if (sock == -1) {
+				printf("  TCP information not available\n");
+				if (procfd != -1)
+					close(procfd);
+				continue;
+			}
+
+			struct stat s1, s2;
+			if (fstatat(procfd, "ns/net", &s1, 0) == 0 && stat("/proc/self/ns/net", &s2) == 0 &&
+			    s1.st_dev == s2.st_dev && s1.st_ino == s2.st_ino)
+				inodes_read(i);
+			tcpinfo_print(sock);
+			inodes_free();
+			dest_cnt = 0;
+			close(sock);
+			close(procfd);
+		}
+	}
+	printf("\n");
+}
@@ -19,6 +19,7 @@
 */
 #include "firemon.h"
 #include "../include/gcov_wrapper.h"
+#include "../include/term_frame.h"
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
@@ -30,6 +31,8 @@ static unsigned pgs_shared = 0;
 static unsigned clocktick = 0;
 static unsigned long long sysuptime = 0;
 static int pgsz = 0;
+// the sandbox being printed, if it runs in its own cgroup
+static CgroupStats cgroup;
 static uid_t cached_uid = 0;
 static char *cached_user_name = NULL;
 
@@ -47,8 +50,8 @@ static char *get_user_name(uid_t uid) {
 
 static char *get_header(void) {
 	char *rv;
-	if (asprintf(&rv, "%-7.7s %-9.9s %-8.8s %-8.8s %-5.5s %-4.4s %-9.9s %s",
-		"PID", "User", "RES(KiB)", "SHR(KiB)", "CPU%", "Prcs", "Uptime", "Command") == -1)
+	if (asprintf(&rv, "%-7.7s %-9.9s %-8.8s %-8.8s %-8.8s %-5.5s %-4.4s %-9.9s %s",
+		"PID", "User", "RES(KiB)", "SHR(KiB)", "TMP(KiB)", "CPU%", "Prcs", "Uptime", "Command") == -1)
 		errExit("asprintf");
 
 	return rv;
@@ -65,8 +68,9 @@ static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigne
 	// Remove unused parameter warning
 	(void)parent;
 
+	pid_t pid = pids[index].pid;
 	char procdir[20];
-	snprintf(procdir, 20, "/proc/%u", index);
+	snprintf(procdir, 20, "/proc/%d", pid);
 	struct stat s;
 	if (stat(procdir, &s) == -1)
 		return NULL;
@@ -77,20 +81,25 @@ static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigne
 		*utime = 0;
 		*stime = 0;
 		*cnt = 0;
+		// a single read for the whole sandbox
+		cgroup_stats(pid, &cgroup);
 	}
 
 	(*cnt)++;
-	pid_getmem(index, &pgs_rss, &pgs_shared);
-	unsigned utmp;
-	unsigned stmp;
-	pid_get_cpu_time(index, &utmp, &stmp);
-	*utime += utmp;
-	*stime += stmp;
+	if (!cgroup.mem)
+		pid_getmem(pid, &pgs_rss, &pgs_shared);
+	if (!cgroup.cpu) {
+		unsigned utmp = 0;
+		unsigned stmp = 0;
+		pid_read_cpu_time(index, &utmp, &stmp);
+		*utime += utmp;
+		*stime += stmp;
+	}
 
 
 	int i;
-	for (i = index + 1; i < max_pids; i++) {
-		if (pids[i].parent == (pid_t)index)
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].parent == pid)
 			print_top(i, index, utime, stime, itv, cpu, cnt);
 	}
 
@@ -104,10 +113,10 @@ static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigne
 	if (pids[index].level == 1) {
 		// pid
 		char pidstr[10];
-		snprintf(pidstr, 10, "%u", index);
+		snprintf(pidstr, 10, "%d", pid);
 
 		// command
-		char *cmd = pid_proc_cmdline(index);
+		char *cmd = pid_proc_cmdline(pid);
 		char *ptrcmd;
 		if (cmd == NULL) {
 			if (pids[index].zombie)
@@ -131,13 +140,23 @@ static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigne
 		// memory
 		if (pgsz == 0)
 			pgsz = getpagesize();
+		if (cgroup.mem) {
+			pgs_rss = cgroup.memory / pgsz;
+			pgs_shared = cgroup.shared / pgsz;
+		}
 		char rss[10];
 		snprintf(rss, 10, "%u", pgs_rss * pgsz / 1024);
 		char shared[10];
 		snprintf(shared, 10, "%u", pgs_shared * pgsz / 1024);
 
+		// tmpfs
+		char tmpfs[20] = "-";
+		int child = find_child(index);
+		if (child != -1)
+			snprintf(tmpfs, sizeof(tmpfs), "%llu", memory_tmpfs(child, 0) / 1024);
+
 		// uptime
-		unsigned long long uptime = pid_get_start_time(index);
+		unsigned long long uptime = pid_get_start_time(pid);
 		if (clocktick == 0)
 			clocktick = sysconf(_SC_CLK_TCK);
 		uptime /= clocktick;
@@ -153,6 +172,8 @@ static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigne
 		snprintf(uptime_str, 50, "%02u:%02u:%02u", hour, min, sec);
 
 		// cpu
+		if (cgroup.cpu)
+			cgroup_cpu_ticks(&cgroup, utime, stime);
 		itv *= clocktick;
 		float ud = (float) (*utime - pids[index].option.top.utime) / itv * 100;
 		float sd = (float) (*stime - pids[index].option.top.stime) / itv * 100;
@@ -165,8 +186,8 @@ static char *print_top(unsigned index, unsigned parent, unsigned *utime, unsigne
 		char prcs_str[10];
 		snprintf(prcs_str, 10, "%d", *cnt);
 
-		if (asprintf(&rv, "%-7.7s %-9.9s %-8.8s %-8.8s %-5.5s %-4.4s %-9.9s %s",
-			     pidstr, ptruser, rss, shared, cpu_str, prcs_str,
+		if (asprintf(&rv, "%-7.7s %-9.9s %-8.8s %-8.8s %-8.8s %-5.5s %-4.4s %-9.9s %s",
+			     pidstr, ptruser, rss, shared, tmpfs, cpu_str, prcs_str,
 			     uptime_str, ptrcmd) == -1)
 			errExit("asprintf");
 
@@ -185,6 +206,15 @@ void pid_store_cpu(unsigned index, unsigned parent, unsigned *utime, unsigned *s
 	if (pids[index].level == 1) {
 		*utime = 0;
 		*stime = 0;
+
+		// the cgroup has the time of the whole sandbox
+		CgroupStats st;
+		if (cgroup_stats(pids[index].pid, &st) == 0 && st.cpu) {
+			cgroup_cpu_ticks(&st, utime, stime);
+			pids[index].option.top.utime = *utime;
+			pids[index].option.top.stime = *stime;
+			return;
+		}
 	}
 
 	// Remove unused parameter warning
@@ -192,13 +222,13 @@ void pid_store_cpu(unsigned index, unsigned parent, unsigned *utime, unsigned *s
 
 	unsigned utmp = 0;
 	unsigned stmp = 0;
-	pid_get_cpu_time(index, &utmp, &stmp);
+	pid_read_cpu_time(index, &utmp, &stmp);
 	*utime += utmp;
 	*stime += stmp;
 
-	unsigned i;
-	for (i = index + 1; i < (unsigned)max_pids; i++) {
-		if (pids[i].parent == (pid_t)index)
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].parent == pids[index].pid)
 			pid_store_cpu(i, index, utime, stime);
 	}
 
@@ -209,91 +239,11 @@ void pid_store_cpu(unsigned index, unsigned parent, unsigned *utime, unsigned *s
 }
 
 
-typedef struct node_t {
-	struct node_t *next;
-	char *line;
-	float cpu;
-} Node;
-
-static Node *head = NULL;
-
-static void head_clear(void) {
-	Node *ptr = head;
-	while (ptr) {
-		if (ptr->line)
-			free(ptr->line);
-		Node *next = ptr->next;
-		free(ptr);
-		ptr = next;
-	}
-
-	head = NULL;
-}
-
-static void head_add(float cpu, char *line) {
-	// allocate a new node structure
-	Node *node = malloc(sizeof(Node));
-	if (!node)
-		errExit("malloc");
-	node->line = line;
-	node->cpu = cpu;
-	node->next = NULL;
-
-	// insert in first list position
-	if (head == NULL || head->cpu < cpu) {
-		node->next = head;
-		head = node;
-		return;
-	}
-
-	// insert in the right place
-	Node *ptr = head;
-	while (1) {
-		// last position
-		Node *current = ptr->next;
-		if (current == NULL) {
-			ptr->next = node;
-			return;
-		}
-
-		// current position
-		if (current->cpu < cpu) {
-			ptr->next = node;
-			node->next = current;
-			return;
-		}
-
-		ptr = current;
-	}
-}
-
-void head_print(int col, int row) {
-	Node *ptr = head;
-	int current = 0;
-	while (ptr) {
-		if (current >= row)
-			break;
-
-		if (strlen(ptr->line) > (size_t)col)
-			ptr->line[col] = '\0';
-
-		if (ptr->next == NULL || current == (row - 1)) {
-			printf("%s", ptr->line);
-			fflush(0);
-		}
-		else
-			printf("%s\n", ptr->line);
-
-		ptr = ptr->next;
-		current++;
-	}
-}
-
 void top(void) {
-	while (1) {
-		// clear linked list
-		head_clear();
+	// keep the process table current from the process events (root only)
+	pid_track_events();
 
+	while (1) {
 		// set pid table
 		int i;
 		int itv = 3; // 3 second interval
@@ -302,8 +252,8 @@ void top(void) {
 		// start cpu measurements
 		unsigned utime = 0;
 		unsigned stime = 0;
-		for (i = 0; i < max_pids; i++) {
-			if (i == skip_process)
+		for (i = 0; i < pids_cnt; i++) {
+			if (pids[i].pid == skip_process)
 				continue;
 			if (pids[i].level == 1)
 				pid_store_cpu(i, 0, &utime, &stime);
@@ -323,14 +273,11 @@ void top(void) {
 			}
 		}
 
-		// start printing
-		firemon_clrscr();
+		// start printing, only the changes since the last screen are sent
+		// to the terminal
+		term_frame_begin(row, col);
 		char *header = get_header();
-		if (strlen(header) > (size_t)col)
-			header[col] = '\0';
-		printf("%s\n", header);
-		if (row > 0)
-			row--;
+		term_frame_line(header);
 		free(header);
 
 		// find system uptime
@@ -343,19 +290,26 @@ void top(void) {
 			fclose(fp);
 		}
 
-		// print processes
-		for (i = 0; i < max_pids; i++) {
-			if (i == skip_process)
+		// print processes, sorted by CPU usage; only the sandboxes that
+		// fit on the screen are kept
+		TopN sorted;
+		topn_init(&sorted, row - 1);
+		for (i = 0; i < pids_cnt; i++) {
+			if (pids[i].pid == skip_process)
 				continue;
 			if (pids[i].level == 1) {
 				float cpu = 0;
 				int cnt = 0; // process count
 				char *line = print_top(i, 0, &utime, &stime, itv, &cpu, &cnt);
 				if (line)
-					head_add(cpu, line);
+					topn_add(&sorted, cpu, line);
 			}
 		}
-		head_print(col, row);
+		topn_sort(&sorted);
+		for (i = 0; i < sorted.cnt; i++)
+			term_frame_line(sorted.item[i].line);
+		topn_free(&sorted);
+		term_frame_end();
 
 		__gcov_flush();
 	}
@@ -26,19 +26,41 @@ static const char *const usage_str =
 	"are also being monitored. On Grsecurity systems only root user\n"
 	"can run this program.\n\n"
 	"Options:\n"
+	"\t--all - print the CPU affinity, capabilities, seccomp, AppArmor, X11,\n"
+	"\t\troute and ARP information of each sandbox in a single report.\n\n"
 	"\t--apparmor - print AppArmor confinement status for each sandbox.\n\n"
 	"\t--arp - print ARP table for each sandbox.\n\n"
 	"\t--caps - print capabilities configuration for each sandbox.\n\n"
+	"\t--control - serve list, status, stats, shutdown and bandwidth requests\n"
+	"\t\ton the unix socket /run/firejail/control.sock, root only.\n\n"
 	"\t--cpu - print CPU affinity for each sandbox.\n\n"
 	"\t--debug - print debug messages.\n\n"
+	"\t--format=jsonl - print the statistics of all sandboxes as JSON objects,\n"
+	"\t\tone line per sandbox and per interval; with --stats, print the\n"
+	"\t\tlaunch statistics as a single JSON object.\n\n"
 	"\t--help, -? - this help screen.\n\n"
 	"\t--interface - print network interface information for each sandbox.\n\n"
+	"\t--interval=milliseconds - --format=jsonl interval, default 3000.\n\n"
 	"\t--list - list all sandboxes.\n\n"
+	"\t--memory - print the memory used by each sandbox: tmpfs filesystems,\n"
+	"\t\tRSS, PSS and KSM merged memory of the sandbox processes, RSS of the\n"
+	"\t\thelper processes.\n\n"
 	"\t--name=name - print information only about named sandbox.\n\n"
 	"\t--netstats - monitor network statistics for sandboxes creating a new\n"
 	"\t\tnetwork namespace.\n\n"
+	"\t--perf[=seconds] - print the performance counters of each sandbox\n"
+	"\t\tevery 5 seconds or the specified time.\n\n"
 	"\t--route - print route table for each sandbox.\n\n"
 	"\t--seccomp - print seccomp configuration for each sandbox.\n\n"
+	"\t--seccomp.hot[=seconds] - sample the system calls running in each\n"
+	"\t\tsandbox for 10 seconds or the specified time, and print the most\n"
+	"\t\tfrequent ones as a seccomp.hot profile command.\n\n"
+	"\t--stats - print the launch statistics of all sandboxes started since\n"
+	"\t\tboot: launches, failures, time spent in each startup phase, helper\n"
+	"\t\tprograms, files copied, seccomp cache hits and lock waits.\n\n"
+	"\t--tcpinfo - print the TCP connections of each sandbox grouped by remote\n"
+	"\t\taddress: RTT, retransmitted segments, congestion window and pacing\n"
+	"\t\trate.\n\n"
 	"\t--tree - print a tree of all sandboxed processes.\n\n"
 	"\t--top - monitor the most CPU-intensive sandboxes.\n\n"
 	"\t--version - print program version and exit.\n\n"
@@ -71,6 +93,7 @@ static const char *const usage_str =
 	"\tSHR - Shared Memory Size (KiB), it reflects memory shared with other\n"
 	"\t      processes. It is a sum of the SHR values for all processes\n"
 	"\t      running in the sandbox, including the controlling process.\n"
+	"\tTMP - memory used by the tmpfs filesystems of the sandbox (KiB).\n"
 	"\tUptime - sandbox running time in hours:minutes:seconds format.\n"
 	"\tUser - The owner of the sandbox.\n"
 	"\n"
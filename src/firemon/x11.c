@@ -18,37 +18,28 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "firemon.h"
+#include "../include/run_record.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+// pid: the firejail process
+void x11_print(pid_t pid) {
+	RunRecord rec;
+	if (run_record_read(pid, &rec) == 0 && rec.x11)
+		printf("  DISPLAY :%d\n", rec.x11);
+}
+
 void x11(pid_t pid, int print_procs) {
-	pid_read(pid);
+	pid_snapshot(pid);
 
 	// print processes
 	int i;
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
 			if (print_procs || pid == 0)
 				pid_print_list(i, arg_wrap);
-
-			char *x11file;
-			// todo: use macro from src/firejail/firejail.h for /run/firejail/x11 directory
-			if (asprintf(&x11file, "/run/firejail/x11/%d", i) == -1)
-				errExit("asprintf");
-
-			FILE *fp = fopen(x11file, "r");
-			if (!fp) {
-				free(x11file);
-				continue;
-			}
-
-			int display;
-			int rv = fscanf(fp, "%d", &display);
-			if (rv == 1)
-				printf("  DISPLAY :%d\n", display);
-			fclose(fp);
-			free(x11file);
+			x11_print(pids[i].pid);
 		}
 	}
 	printf("\n");
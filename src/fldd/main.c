@@ -29,49 +29,134 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <time.h>
 
 
 static int arg_quiet = 0;
 static void copy_libs_for_lib(const char *lib);
 
-typedef struct storage_t {
-	struct storage_t *next;
-	const char *name;
+// Storage: a set of strings kept in insertion order. The strings live in
+// an arena, the lookups go through an open-addressing hash table holding
+// indexes in the insertion array.
+#define STORAGE_ARENA_SIZE (64 * 1024)
+
+typedef struct arena_t {
+	struct arena_t *next;
+	size_t used;
+	size_t size;
+	char data[];
+} Arena;
+
+typedef struct {
+	Arena *arena;
+	const char **names;	// insertion order
+	unsigned cnt;
+	unsigned max;
+	unsigned *table;	// 0 empty, otherwise index in names + 1
+	unsigned tsize;		// power of 2
 } Storage;
-static Storage *libs = NULL;
-static Storage *lib_paths = NULL;
+static Storage libs = { 0 };
+static Storage lib_paths = { 0 };
+static Storage resolved = { 0 };	// DT_NEEDED names found in lib_paths
+static Storage parsed = { 0 };		// device:inode of the files already parsed
+static Storage walked = { 0 };		// directories already walked
+
+// --stats
+static int arg_stats = 0;
+static unsigned stats_elf = 0;
+static unsigned stats_lookups = 0;
+
+static const char *arena_strdup(Arena **head, const char *name) {
+	size_t len = strlen(name) + 1;
+	Arena *a = *head;
+	if (!a || a->size - a->used < len) {
+		size_t size = (len > STORAGE_ARENA_SIZE) ? len : STORAGE_ARENA_SIZE;
+		a = malloc(sizeof(Arena) + size);
+		if (!a)
+			errExit("malloc");
+		a->next = *head;
+		a->used = 0;
+		a->size = size;
+		*head = a;
+	}
+
+	char *ptr = a->data + a->used;
+	memcpy(ptr, name, len);
+	a->used += len;
+	return ptr;
+}
+
+static void storage_rehash(Storage *st, unsigned tsize) {
+	free(st->table);
+	st->table = calloc(tsize, sizeof(unsigned));
+	if (!st->table)
+		errExit("calloc");
+	st->tsize = tsize;
+
+	unsigned i;
+	for (i = 0; i < st->cnt; i++) {
+		unsigned pos = fnv1a32_str(st->names[i]) & (tsize - 1);
+		while (st->table[pos])
+			pos = (pos + 1) & (tsize - 1);
+		st->table[pos] = i + 1;
+	}
+}
 
 // return 1 if found
-static int storage_find(Storage *ptr, const char *name) {
-	while (ptr) {
-		if (strcmp(ptr->name, name) == 0)
+static int storage_find(Storage *st, const char *name) {
+	stats_lookups++;
+	if (st->cnt == 0)
+		return 0;
+
+	unsigned pos = fnv1a32_str(name) & (st->tsize - 1);
+	while (st->table[pos]) {
+		if (strcmp(st->names[st->table[pos] - 1], name) == 0)
 			return 1;
-		ptr = ptr->next;
+		pos = (pos + 1) & (st->tsize - 1);
 	}
 
 	return 0;
 }
 
-static void storage_add(Storage **head, const char *name) {
-	if (storage_find(*head, name))
+static void storage_add(Storage *st, const char *name) {
+	if (storage_find(st, name))
 		return;
 
-	Storage *s = malloc(sizeof(Storage));
-	if (!s)
-		errExit("malloc");
-	s->next = *head;
-	*head = s;
-	s->name = strdup(name);
-	if (!s->name)
-		errExit("strdup");
-}
+	if (st->cnt == st->max) {
+		st->max = (st->max) ? st->max * 2 : 64;
+		st->names = realloc(st->names, st->max * sizeof(char *));
+		if (!st->names)
+			errExit("realloc");
+	}
+	st->names[st->cnt++] = arena_strdup(&st->arena, name);
 
+	// keep the load factor under 1/2
+	if (st->cnt * 2 > st->tsize)
+		storage_rehash(st, (st->tsize) ? st->tsize * 2 : 128);
+	else {
+		unsigned pos = fnv1a32_str(name) & (st->tsize - 1);
+		while (st->table[pos])
+			pos = (pos + 1) & (st->tsize - 1);
+		st->table[pos] = st->cnt;
+	}
+}
 
-static void storage_print(Storage *ptr, int fd) {
-	while (ptr) {
-		dprintf(fd, "%s\n", ptr->name);
-		ptr = ptr->next;
+static void storage_clear(Storage *st) {
+	while (st->arena) {
+		Arena *next = st->arena->next;
+		free(st->arena);
+		st->arena = next;
 	}
+	if (st->table)
+		memset(st->table, 0, st->tsize * sizeof(unsigned));
+	st->cnt = 0;
+}
+
+// the most recent entries first
+static void storage_print(Storage *st, int fd) {
+	unsigned i = st->cnt;
+	while (i-- > 0)
+		dprintf(fd, "%s\n", st->names[i]);
 }
 
 static bool ptr_ok(const void *ptr, const void *base, const void *end, const char *name) {
@@ -96,12 +181,21 @@ static void parse_elf(const char *exe) {
 	char *base = NULL, *end;
 	if (fstat(f, &s) == -1)
 		goto error_close;
+
+	// the same file is reached through several symlinks
+	char id[64];
+	snprintf(id, sizeof(id), "%lu:%lu", (unsigned long) s.st_dev, (unsigned long) s.st_ino);
+	if (storage_find(&parsed, id))
+		goto close;
+	storage_add(&parsed, id);
+
 	base = mmap(0, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, f, 0);
 	if (base == MAP_FAILED)
 		goto error_close;
 
 	end = base + s.st_size;
 
+	stats_elf++;
 	Elf_Ehdr *ebuf = (Elf_Ehdr *)base;
 	if (strncmp((const char *)ebuf->e_ident, ELFMAG, SELFMAG) != 0) {
 		if (!arg_quiet)
@@ -171,7 +265,12 @@ static void parse_elf(const char *exe) {
 					const char *searchpath = strbase + dbuf->d_un.d_ptr;
 					if (!ptr_ok(searchpath, base, end, "searchpath"))
 						goto close;
-					storage_add(&lib_paths, searchpath);
+					if (!storage_find(&lib_paths, searchpath)) {
+						storage_add(&lib_paths, searchpath);
+						// a new search path can change the result of a previous lookup
+						storage_clear(&resolved);
+						storage_clear(&parsed);
+					}
 				}
 				size -= sizeof(*dbuf);
 				dbuf++;
@@ -204,13 +303,19 @@ close:
 }
 
 static void copy_libs_for_lib(const char *lib) {
-	Storage *lib_path;
-	for (lib_path = lib_paths; lib_path; lib_path = lib_path->next) {
+	// already found in the current search paths
+	if (storage_find(&resolved, lib))
+		return;
+
+	// the most recent search paths first
+	unsigned i = lib_paths.cnt;
+	while (i-- > 0) {
 		char *fname;
-		if (asprintf(&fname, "%s/%s", lib_path->name, lib) == -1)
+		if (asprintf(&fname, "%s/%s", lib_paths.names[i], lib) == -1)
 			errExit("asprintf");
 		if (access(fname, R_OK) == 0 && is_lib_64(fname)) {
-			if (!storage_find(libs, fname)) {
+			storage_add(&resolved, lib);
+			if (!storage_find(&libs, fname)) {
 				storage_add(&libs, fname);
 				// libs may need other libs
 				parse_elf(fname);
@@ -236,6 +341,11 @@ static void lib_paths_init(void) {
 static void walk_directory(const char *dirname) {
 	assert(dirname);
 
+	// directory symlinks such as "lib -> ." would bring us back here
+	if (storage_find(&walked, dirname))
+		return;
+	storage_add(&walked, dirname);
+
 	DIR *dir = opendir(dirname);
 	if (dir) {
 		struct dirent *entry;
@@ -283,9 +393,10 @@ static void walk_directory(const char *dirname) {
 }
 
 static const char *const usage_str =
-	"Usage: fldd program_or_directory [file]\n"
+	"Usage: fldd [--stats] program_or_directory [file]\n"
 	"Print a list of libraries used by program or store it in the file.\n"
-	"Print a list of libraries used by all .so files in a directory or store it in the file.\n";
+	"Print a list of libraries used by all .so files in a directory or store it in the file.\n"
+	"--stats prints the number of ELF files parsed, the number of lookups and the elapsed time on stderr.\n";
 
 static void usage(void) {
 	puts(usage_str);
@@ -301,17 +412,24 @@ for (i = 0; i < argc; i++)
 printf("\n");
 }
 #endif
-	if (argc < 2) {
-		fprintf(stderr, "Error fldd: invalid arguments\n");
+	if (argc >= 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0)) {
 		usage();
-		exit(1);
+		return 0;
 	}
 
+	if (argc >= 2 && strcmp(argv[1], "--stats") == 0) {
+		arg_stats = 1;
+		argc--;
+		argv++;
+	}
 
-	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0) {
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Error fldd: invalid arguments\n");
 		usage();
-		return 0;
+		exit(1);
 	}
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	warn_dumpable();
 
@@ -354,9 +472,17 @@ printf("\n");
 
 
 	// print libraries and exit
-	storage_print(libs, fd);
+	storage_print(&libs, fd);
 	if (argc == 3)
 		close(fd);
+
+	if (arg_stats) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double ms = (double) (now.tv_sec - start.tv_sec) * 1000.0 + (double) (now.tv_nsec - start.tv_nsec) / 1000000.0;
+		fprintf(stderr, "fldd stats: %u ELF files parsed, %u lookups, %u libraries, %.02f ms\n",
+			stats_elf, stats_lookups, libs.cnt, ms);
+	}
 	return 0;
 }
 #else
@@ -27,6 +27,9 @@
 #include <linux/udp.h>
 #include <linux/tcp.h>
 #include <linux/if_packet.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
 
 typedef struct arp_hdr_t {
 	uint16_t htype;
@@ -41,7 +44,29 @@ typedef struct arp_hdr_t {
 } ArpHdr;
 
 
-// scan interface (--scan option)
+#define ARP_SCAN_TIMEOUT 1000	// ms, after the last request
+
+static ArpHdr *arp_reply(uint8_t *frame, int len) {
+	if ((unsigned int) len < 14 + sizeof(ArpHdr))
+		return NULL;
+	// look only at ARP packets
+	if (frame[12] != (ETH_P_ARP / 256) || frame[13] != (ETH_P_ARP % 256))
+		return NULL;
+	ArpHdr *hdr = (ArpHdr *) (frame + 14);
+	if (hdr->opcode != htons(2))
+		return NULL;
+	return hdr;
+}
+
+static int64_t now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// scan interface (--scan option): the requests for all the addresses in the
+// network are sent in one burst, and the replies are collected until a
+// single deadline; the hosts are printed in address order
 void arp_scan(const char *dev, uint32_t ifip, uint32_t ifmask) {
 	assert(dev);
 	assert(ifip);
@@ -67,137 +92,137 @@ void arp_scan(const char *dev, uint32_t ifip, uint32_t ifmask) {
 	uint8_t mac[6];
 	memcpy (mac, ifr.ifr_hwaddr.sa_data, 6);
 
-	// open layer2 socket
-	if ((sock = socket(PF_PACKET, SOCK_RAW, htons (ETH_P_ALL))) < 0)
-		errExit("socket");
-
 	// try all possible ip addresses in ascending order
 	uint32_t range = ~ifmask + 1; // the number of potential addresses
 	// this software is not supported for /31 networks
 	if (range < 4) {
 		fprintf(stderr, "Warning: this option is not supported for /31 networks\n");
-		close(sock);
 		return;
 	}
 
-	uint32_t dest = (ifip & ifmask) + 1;
-	uint32_t last = dest + range - 1;
+	// layer2 socket receiving only the ARP packets of the interface
+	struct sockaddr_ll addr;
+	memset(&addr, 0, sizeof(addr));
+	if ((addr.sll_ifindex = if_nametoindex(dev)) == 0)
+		errExit("if_nametoindex");
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ARP);
+	if ((sock = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ARP))) < 0)
+		errExit("socket");
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		errExit("bind");
+	// room for the replies arriving while the requests are sent
+	int rcvbuf = 4 * 1024 * 1024;
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	uint32_t network = ifip & ifmask;
 	uint32_t src = htonl(ifip);
 
-	// wait not more than one second for an answer
-	int header_printed = 0;
-	uint32_t last_ip = 0;
-	struct timeval ts;
-	ts.tv_sec = 2; // 2 seconds receive timeout
-	ts.tv_usec = 0;
-
+	// one bit for each address replying, and its mac address
+	uint8_t *found = calloc(range / 8 + 1, 1);
+	uint8_t (*found_mac)[6] = malloc(range * 6);
+	if (!found || !found_mac)
+		errExit("malloc");
+
+	// the request frame, only the target address changes
+	uint8_t frame[ETH_FRAME_LEN]; // includes eht header, vlan, and crc
+	memset(frame, 0, sizeof(frame));
+	frame[0] = frame[1] = frame[2] = frame[3] = frame[4] = frame[5] = 0xff;
+	memcpy(frame + 6, mac, 6);
+	frame[12] = ETH_P_ARP / 256;
+	frame[13] = ETH_P_ARP % 256;
+	ArpHdr *req = (ArpHdr *) (frame + 14);
+	req->htype = htons(1);
+	req->ptype = htons(ETH_P_IP);
+	req->hlen = 6;
+	req->plen = 4;
+	req->opcode = htons(1); //ARPOP_REQUEST
+	memcpy(req->sender_mac, mac, 6);
+	memcpy(req->sender_ip, (uint8_t *)&src, 4);
+
+	memcpy (addr.sll_addr, frame, 6);
+	addr.sll_halen = ETH_ALEN;
+
+	uint32_t i = 1;
+	int64_t deadline = 0;
 	while (1) {
-		fd_set rfds;
-		FD_ZERO(&rfds);
-		FD_SET(sock, &rfds);
-		fd_set wfds;
-		FD_ZERO(&wfds);
-		FD_SET(sock, &wfds);
-		int maxfd = sock;
-
-		uint8_t frame[ETH_FRAME_LEN]; // includes eht header, vlan, and crc
-		memset(frame, 0, ETH_FRAME_LEN);
-
-		int nready;
-		if (dest < last)
-			nready = select(maxfd + 1,  &rfds, &wfds, (fd_set *) 0, NULL);
-		else
-			nready = select(maxfd + 1,  &rfds,  (fd_set *) 0, (fd_set *) 0, &ts);
-
-		if (nready < 0)
-			errExit("select");
-
-		if (nready == 0) { // timeout
-			break;
+		struct pollfd pfd = { .fd = sock, .events = POLLIN };
+		if (i < range - 1)
+			pfd.events |= POLLOUT;
+
+		int timeout = -1;
+		if (i >= range - 1) {
+			if (deadline == 0)
+				deadline = now_ms() + ARP_SCAN_TIMEOUT;
+			timeout = deadline - now_ms();
+			if (timeout <= 0)
+				break;
 		}
 
-		if (FD_ISSET(sock, &wfds) && dest < last) {
-			// configure layer2 socket address information
-			struct sockaddr_ll addr;
-			memset(&addr, 0, sizeof(addr));
-			if ((addr.sll_ifindex = if_nametoindex(dev)) == 0)
-				errExit("if_nametoindex");
-			addr.sll_family = AF_PACKET;
-			memcpy (addr.sll_addr, mac, 6);
-			addr.sll_halen = ETH_ALEN;
-
-			// build the arp packet header
-			ArpHdr hdr;
-			memset(&hdr, 0, sizeof(hdr));
-			hdr.htype = htons(1);
-			hdr.ptype = htons(ETH_P_IP);
-			hdr.hlen = 6;
-			hdr.plen = 4;
-			hdr.opcode = htons(1); //ARPOP_REQUEST
-			memcpy(hdr.sender_mac, mac, 6);
-			memcpy(hdr.sender_ip, (uint8_t *)&src, 4);
-			uint32_t dst = htonl(dest);
-			memcpy(hdr.target_ip, (uint8_t *)&dst, 4);
-
-			// build ethernet frame
-			uint8_t frame[ETH_FRAME_LEN]; // includes eht header, vlan, and crc
-			memset(frame, 0, sizeof(frame));
-			frame[0] = frame[1] = frame[2] = frame[3] = frame[4] = frame[5] = 0xff;
-			memcpy(frame + 6, mac, 6);
-			frame[12] = ETH_P_ARP / 256;
-			frame[13] = ETH_P_ARP % 256;
-			memcpy (frame + 14, &hdr, sizeof(hdr));
-
-			// send packet
-			if (sendto (sock, frame, 14 + sizeof(ArpHdr), 0, (struct sockaddr *) &addr, sizeof (addr)) <= 0)
-				errExit("send");
-			fflush(0);
-			dest++;
+		int nready = poll(&pfd, 1, timeout);
+		if (nready < 0) {
+			if (errno == EINTR)
+				continue;
+			errExit("poll");
 		}
+		if (nready == 0) // timeout
+			break;
 
-		if (FD_ISSET(sock, &rfds)) {
-			// read the incoming packet
-			int len = recvfrom(sock, frame, ETH_FRAME_LEN, 0, NULL, NULL);
-			if (len < 0) {
-				perror("recvfrom");
+		// send the requests until the socket buffer is full
+		if (pfd.revents & POLLOUT) {
+			while (i < range - 1) {
+				uint32_t dst = htonl(network + i);
+				memcpy(req->target_ip, (uint8_t *)&dst, 4);
+				if (sendto(sock, frame, 14 + sizeof(ArpHdr), MSG_DONTWAIT, (struct sockaddr *) &addr, sizeof (addr)) <= 0) {
+					if (errno == EAGAIN || errno == ENOBUFS)
+						break;
+					errExit("send");
+				}
+				i++;
 			}
+		}
 
-			// parse the incoming packet
-			if ((unsigned int) len < 14 + sizeof(ArpHdr))
-				continue;
-
-			// look only at ARP packets
-			if (frame[12] != (ETH_P_ARP / 256) || frame[13] != (ETH_P_ARP % 256))
-				continue;
-
-			ArpHdr hdr;
-			memcpy(&hdr, frame + 14, sizeof(ArpHdr));
-
-			if (hdr.opcode == htons(2)) {
+		// read the replies waiting
+		if (pfd.revents & POLLIN) {
+			uint8_t buf[ETH_FRAME_LEN];
+			int len;
+			while ((len = recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+				ArpHdr *hdr = arp_reply(buf, len);
+				if (!hdr)
+					continue;
 				// check my mac and my address
-				if (memcmp(mac, hdr.target_mac, 6) != 0)
+				if (memcmp(mac, hdr->target_mac, 6) != 0)
 					continue;
 				uint32_t ip;
-				memcpy(&ip, hdr.target_ip, 4);
+				memcpy(&ip, hdr->target_ip, 4);
 				if (ip != src)
 					continue;
-				memcpy(&ip, hdr.sender_ip, 4);
+				memcpy(&ip, hdr->sender_ip, 4);
 				ip = ntohl(ip);
-
-				if (ip == last_ip) // filter duplicates
+				if ((ip & ifmask) != network)
 					continue;
-				last_ip = ip;
 
-				// printing
-				if (header_printed == 0) {
-					fmessage("   Network scan:\n");
-					header_printed = 1;
-				}
-				fmessage("   %02x:%02x:%02x:%02x:%02x:%02x\t%d.%d.%d.%d\n",
-					PRINT_MAC(hdr.sender_mac), PRINT_IP(ip));
+				uint32_t index = ip - network;
+				found[index / 8] |= 1 << (index % 8);
+				memcpy(found_mac[index], hdr->sender_mac, 6);
 			}
 		}
 	}
-
 	close(sock);
+
+	int header_printed = 0;
+	for (i = 1; i < range - 1; i++) {
+		if (!(found[i / 8] & (1 << (i % 8))))
+			continue;
+		// printing
+		if (header_printed == 0) {
+			fmessage("   Network scan:\n");
+			header_printed = 1;
+		}
+		fmessage("   %02x:%02x:%02x:%02x:%02x:%02x\t%d.%d.%d.%d\n",
+			PRINT_MAC(found_mac[i]), PRINT_IP(network + i));
+	}
+	free(found);
+	free(found_mac);
 }
@@ -35,7 +35,21 @@ extern void fmessage(char* fmt, ...); // TODO: this function is duplicated in sr
 int net_create_veth(const char *dev, const char *nsdev, unsigned pid);
 int net_create_macvlan(const char *dev, const char *parent, unsigned pid);
 int net_create_ipvlan(const char *dev, const char *parent, unsigned pid);
-int net_move_interface(const char *dev, unsigned pid);
+int net_move_interface(const char *dev, unsigned pid, const char *newname);
+int net_delete_interface(const char *dev);
+void net_batch_begin(void);
+void net_batch_flush(void);
+void net_batch_end(void);
+
+// pool.c
+int pool_claim(const char *bridge, const char *nsdev, unsigned pid, int size);
+void pool_fill(const char *bridge, int size);
+void pool_refill(void);
+
+// shape.c
+void shape_set(const char *dev, unsigned down, unsigned up);
+void shape_clear(const char *dev);
+void shape_status(void);
 
 // interface.c
 void net_bridge_add_interface(const char *bridge, const char *dev);
@@ -19,11 +19,11 @@
 */
 
 #include "fnet.h"
+#include "../include/libnetlink.h"
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <netdb.h>
-#include <ifaddrs.h>
 #include <net/if.h>
 #include <net/if_arp.h>
 #include <net/route.h>
@@ -165,86 +165,174 @@ void net_set_mtu(const char *ifname, int mtu) {
 	close(s);
 }
 
-// scan interfaces in current namespace and print IP address/mask for each interface
-void net_ifprint(int scan) {
+#define IFPRINT_MAX_LINKS 256
+#define IFPRINT_MAX_ADDRS 1024
+
+typedef struct {
+	int index;
+	unsigned flags;
+	char name[IFNAMSIZ];
+	unsigned char mac[6];
+	int has_ip6;
+	struct in6_addr ip6;	// the first IPv6 address
+} IfLink;
+
+typedef struct {
+	int index;
 	uint32_t ip;
 	uint32_t mask;
-	struct ifaddrs *ifaddr, *ifa;
+} IfAddr;
+
+static IfLink iflinks[IFPRINT_MAX_LINKS];
+static int iflinks_cnt = 0;
+static IfAddr ifaddrs4[IFPRINT_MAX_ADDRS];
+static int ifaddrs4_cnt = 0;
+
+static IfLink *iflink_find(int index) {
+	int i;
+	for (i = 0; i < iflinks_cnt; i++)
+		if (iflinks[i].index == index)
+			return &iflinks[i];
+	return NULL;
+}
+
+static int link_cb(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg) {
+	(void) who;
+	(void) arg;
+	if (n->nlmsg_type != RTM_NEWLINK || iflinks_cnt == IFPRINT_MAX_LINKS)
+		return 0;
+	struct ifinfomsg *ifi = NLMSG_DATA(n);
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+	if (len < 0)
+		return 0;
+	struct rtattr *tb[IFLA_MAX + 1];
+	parse_rtattr(tb, IFLA_MAX, IFLA_RTA(ifi), len);
+	if (!tb[IFLA_IFNAME])
+		return 0;
+
+	IfLink *l = &iflinks[iflinks_cnt++];
+	memset(l, 0, sizeof(IfLink));
+	l->index = ifi->ifi_index;
+	l->flags = ifi->ifi_flags;
+	snprintf(l->name, sizeof(l->name), "%s", rta_getattr_str(tb[IFLA_IFNAME]));
+	if (tb[IFLA_ADDRESS] && RTA_PAYLOAD(tb[IFLA_ADDRESS]) >= 6)
+		memcpy(l->mac, RTA_DATA(tb[IFLA_ADDRESS]), 6);
+	return 0;
+}
+
+static int addr_cb(const struct sockaddr_nl *who, struct nlmsghdr *n, void *arg) {
+	(void) who;
+	(void) arg;
+	if (n->nlmsg_type != RTM_NEWADDR)
+		return 0;
+	struct ifaddrmsg *ifa = NLMSG_DATA(n);
+	int len = n->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
+	if (len < 0)
+		return 0;
+	struct rtattr *tb[IFA_MAX + 1];
+	parse_rtattr(tb, IFA_MAX, IFA_RTA(ifa), len);
+	// IFA_LOCAL is the address of the interface, IFA_ADDRESS the peer on point-to-point links
+	struct rtattr *rta = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+	if (!rta)
+		return 0;
+
+	if (ifa->ifa_family == AF_INET && RTA_PAYLOAD(rta) >= 4 && ifaddrs4_cnt < IFPRINT_MAX_ADDRS) {
+		IfAddr *a = &ifaddrs4[ifaddrs4_cnt++];
+		a->index = ifa->ifa_index;
+		uint32_t ip;
+		memcpy(&ip, RTA_DATA(rta), 4);
+		a->ip = ntohl(ip);
+		a->mask = (ifa->ifa_prefixlen) ? ~0U << (32 - ifa->ifa_prefixlen) : 0;
+	}
+	else if (ifa->ifa_family == AF_INET6 && RTA_PAYLOAD(rta) >= sizeof(struct in6_addr)) {
+		IfLink *l = iflink_find(ifa->ifa_index);
+		if (l && !l->has_ip6) {
+			memcpy(&l->ip6, RTA_DATA(rta), sizeof(struct in6_addr));
+			l->has_ip6 = 1;
+		}
+	}
+	return 0;
+}
+
+// interfaces and addresses from two rtnetlink dumps
+static void ifprint_dump(void) {
+	struct rtnl_handle rth;
+	if (rtnl_open(&rth, 0) < 0) {
+		fprintf(stderr, "Error fnet: cannot open netlink socket\n");
+		exit(1);
+	}
+	if (rtnl_wilddump_request(&rth, AF_PACKET, RTM_GETLINK) < 0 ||
+	    rtnl_dump_filter(&rth, link_cb, NULL) < 0) {
+		fprintf(stderr, "Error fnet: cannot dump the network interfaces\n");
+		exit(1);
+	}
+	if (rtnl_wilddump_request(&rth, AF_UNSPEC, RTM_GETADDR) < 0 ||
+	    rtnl_dump_filter(&rth, addr_cb, NULL) < 0) {
+		fprintf(stderr, "Error fnet: cannot dump the network addresses\n");
+		exit(1);
+	}
+	rtnl_close(&rth);
+}
 
-	if (getifaddrs(&ifaddr) == -1)
-		errExit("getifaddrs");
+// scan interfaces in current namespace and print IP address/mask for each interface
+void net_ifprint(int scan) {
+	ifprint_dump();
 
 	fmessage("%-17.17s%-19.19s%-17.17s%-17.17s%-6.6s\n",
 		"Interface", "MAC", "IP", "Mask", "Status");
-	// walk through the linked list
-	for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-		if (ifa->ifa_addr == NULL)
+	int i;
+	for (i = 0; i < ifaddrs4_cnt; i++) {
+		IfLink *l = iflink_find(ifaddrs4[i].index);
+		if (!l)
 			continue;
-
-		if (ifa->ifa_addr->sa_family == AF_INET) {
-			struct sockaddr_in *si = (struct sockaddr_in *) ifa->ifa_netmask;
-			mask = ntohl(si->sin_addr.s_addr);
-			si = (struct sockaddr_in *) ifa->ifa_addr;
-			ip = ntohl(si->sin_addr.s_addr);
-
-			// interface status
-			char *status;
-			if (ifa->ifa_flags & IFF_RUNNING && ifa->ifa_flags & IFF_UP)
-				status = "UP";
-			else
-				status = "DOWN";
-
-			// ip address and mask
-			char ipstr[30];
-			sprintf(ipstr, "%d.%d.%d.%d", PRINT_IP(ip));
-			char maskstr[30];
-			sprintf(maskstr, "%d.%d.%d.%d", PRINT_IP(mask));
-
-			// mac address
-			unsigned char mac[6];
-			net_get_mac(ifa->ifa_name, mac);
-			char macstr[30];
-			if (strcmp(ifa->ifa_name, "lo") == 0)
-				macstr[0] = '\0';
-			else
-				sprintf(macstr, "%02x:%02x:%02x:%02x:%02x:%02x", PRINT_MAC(mac));
-
-			// print
-			fmessage("%-17.17s%-19.19s%-17.17s%-17.17s%-6.6s\n",
-				ifa->ifa_name, macstr, ipstr, maskstr, status);
-
-			// print ipv6 address
-			if (!scan) {
-				struct ifaddrs *ptr = ifa->ifa_next;
-				while (ptr) {
-					if (ptr->ifa_addr->sa_family == AF_INET6 && strcmp(ifa->ifa_name, ptr->ifa_name) == 0) {
-						struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)ptr->ifa_addr;
-						struct in6_addr *in_addr = &s6->sin6_addr;
-						char buf[64];
-						if(inet_ntop(ptr->ifa_addr->sa_family, in_addr, buf, sizeof(buf))) {
-							fmessage("%-35.35s %s\n", " ", buf);
-							break;
-						}
-					}
-					ptr = ptr->ifa_next;
-				}
-			}
-
-			// network scanning
-			if (!scan)				// scanning disabled
-				continue;
-			if (strcmp(ifa->ifa_name, "lo") == 0)	// no loopbabck scanning
-				continue;
-			if (mask2bits(mask) < 16)		// not scanning large networks
-				continue;
-			if (!ip)					// if not configured
-				continue;
-			// only if the interface is up and running
-			if (ifa->ifa_flags & IFF_RUNNING && ifa->ifa_flags & IFF_UP)
-				arp_scan(ifa->ifa_name, ip, mask);
+		uint32_t ip = ifaddrs4[i].ip;
+		uint32_t mask = ifaddrs4[i].mask;
+
+		// interface status
+		char *status;
+		int up = (l->flags & IFF_RUNNING) && (l->flags & IFF_UP);
+		if (up)
+			status = "UP";
+		else
+			status = "DOWN";
+
+		// ip address and mask
+		char ipstr[30];
+		sprintf(ipstr, "%d.%d.%d.%d", PRINT_IP(ip));
+		char maskstr[30];
+		sprintf(maskstr, "%d.%d.%d.%d", PRINT_IP(mask));
+
+		// mac address
+		char macstr[30];
+		if (strcmp(l->name, "lo") == 0)
+			macstr[0] = '\0';
+		else
+			sprintf(macstr, "%02x:%02x:%02x:%02x:%02x:%02x", PRINT_MAC(l->mac));
+
+		// print
+		fmessage("%-17.17s%-19.19s%-17.17s%-17.17s%-6.6s\n",
+			l->name, macstr, ipstr, maskstr, status);
+
+		// print ipv6 address
+		if (!scan) {
+			char buf[64];
+			if (l->has_ip6 && inet_ntop(AF_INET6, &l->ip6, buf, sizeof(buf)))
+				fmessage("%-35.35s %s\n", " ", buf);
 		}
+
+		// network scanning
+		if (!scan)				// scanning disabled
+			continue;
+		if (strcmp(l->name, "lo") == 0)	// no loopbabck scanning
+			continue;
+		if (mask2bits(mask) < 16)		// not scanning large networks
+			continue;
+		if (!ip)					// if not configured
+			continue;
+		// only if the interface is up and running
+		if (up)
+			arp_scan(l->name, ip, mask);
 	}
-	freeifaddrs(ifaddr);
 }
 
 int net_get_mac(const char *ifname, unsigned char mac[6]) {
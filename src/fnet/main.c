@@ -38,63 +38,77 @@ void fmessage(char* fmt, ...) { // TODO: this function is duplicated in src/fire
 static const char *const usage_str =
 	"Usage:\n"
 	"\tfnet create veth dev1 dev2 bridge child\n"
+	"\tfnet create veth dev1 dev2 bridge child poolsize\n"
 	"\tfnet create macvlan dev parent child\n"
 	"\tfnet moveif dev proc\n"
+	"\tfnet pool bridge size\n"
+	"\tfnet shape set dev download upload\n"
+	"\tfnet shape clear dev\n"
+	"\tfnet shape status\n"
 	"\tfnet printif\n"
 	"\tfnet printif scan\n"
 	"\tfnet config interface dev ip mask mtu\n"
 	"\tfnet config mac addr\n"
 	"\tfnet config ipv6 dev ip\n"
 	"\tfnet ifup dev\n"
-	"\tfnet waitll dev\n";
+	"\tfnet waitll dev\n"
+	"\tfnet script \"command args\" \"command args\" ...\n";
 
-static void usage(void) {
-	puts(usage_str);
-}
+// run a command, argv[0] is the program name; return 1 if the arguments are not valid
+#define PASS_NETLINK	1	// the requests sent over netlink
+#define PASS_OTHER	2	// everything else
+#define MAX_POOL_CLAIMS	16
+static char **pool_claimed[MAX_POOL_CLAIMS];	// the commands served from the veth pool
+static int pool_claimed_cnt = 0;
 
-int main(int argc, char **argv) {
-#if 0
-{
-//system("cat /proc/self/status");
-int i;
-for (i = 0; i < argc; i++)
-	printf("*%s* ", argv[i]);
-printf("\n");
+static int served_from_pool(char **argv) {
+	int i;
+	for (i = 0; i < pool_claimed_cnt; i++)
+		if (pool_claimed[i] == argv)
+			return 1;
+	return 0;
 }
-#endif
-	if (argc < 2) {
-		usage();
-		return 1;
-	}
-	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") ==0) {
-		usage();
-		return 0;
-	}
-
-	warn_dumpable();
-
-	char *quiet = getenv("FIREJAIL_QUIET");
-	if (quiet && strcmp(quiet, "yes") == 0)
-		arg_quiet = 1;
 
+static int command(int argc, char **argv, int pass) {
 	if (argc == 3 && strcmp(argv[1], "ifup") == 0) {
-		net_if_up(argv[2]);
+		if (pass & PASS_OTHER)
+			net_if_up(argv[2]);
 	}
 	else if (argc == 2 && strcmp(argv[1], "printif") == 0) {
-		net_ifprint(0);
+		if (pass & PASS_OTHER)
+			net_ifprint(0);
 	}
 	else if (argc == 3 && strcmp(argv[1], "printif") == 0 && strcmp(argv[2], "scan") == 0) {
-		net_ifprint(1);
+		if (pass & PASS_OTHER)
+			net_ifprint(1);
 	}
-	else if (argc == 7 && strcmp(argv[1], "create") == 0 && strcmp(argv[2], "veth") == 0) {
+	else if ((argc == 7 || argc == 8) && strcmp(argv[1], "create") == 0 && strcmp(argv[2], "veth") == 0) {
+		// take a pair from the veth pool of the bridge, if there is one
+		if (pass & PASS_NETLINK) {
+			int size = (argc == 8) ? atoi(argv[7]) : 0;
+			if (size > 0 && pool_claimed_cnt < MAX_POOL_CLAIMS &&
+			    pool_claim(argv[5], argv[4], atoi(argv[6]), size)) {
+				pool_claimed[pool_claimed_cnt++] = argv;
+				return 0;
+			}
+		}
+		if (served_from_pool(argv))
+			return 0;
+
 		// create veth pair and move one end in the the namespace
-		net_create_veth(argv[3], argv[4], atoi(argv[6]));
-		// connect the other veth end to the bridge ...
-		net_bridge_add_interface(argv[5], argv[3]);
-		// ... and bring it  up
-		net_if_up(argv[3]);
+		if (pass & PASS_NETLINK)
+			net_create_veth(argv[3], argv[4], atoi(argv[6]));
+		if (pass & PASS_OTHER) {
+			// connect the other veth end to the bridge ...
+			net_bridge_add_interface(argv[5], argv[3]);
+			// ... and bring it  up
+			net_if_up(argv[3]);
+		}
 	}
 	else if (argc == 6 && strcmp(argv[1], "create") == 0 && strcmp(argv[2], "macvlan") == 0) {
+		if ((pass & PASS_NETLINK) == 0)
+			return 0;
+
 		// use ipvlan for wireless devices
 		// ipvlan driver was introduced in Linux kernel 3.19
 
@@ -124,6 +138,8 @@ printf("\n");
 		}
 	}
 	else if (argc == 7 && strcmp(argv[1], "config") == 0 && strcmp(argv[2], "interface") == 0) {
+		if ((pass & PASS_OTHER) == 0)
+			return 0;
 		char *dev = argv[3];
 		uint32_t ip = (uint32_t)  atoll(argv[4]);
 		uint32_t mask = (uint32_t)  atoll(argv[5]);
@@ -134,6 +150,8 @@ printf("\n");
 		net_if_up(dev);
 	}
 	else if (argc == 5 && strcmp(argv[1], "config") == 0 && strcmp(argv[2], "mac") == 0) {
+		if ((pass & PASS_OTHER) == 0)
+			return 0;
 		unsigned char mac[6];
 		if (atomac(argv[4], mac)) {
 			fprintf(stderr, "Error fnet: invalid mac address %s\n", argv[4]);
@@ -141,18 +159,129 @@ printf("\n");
 		net_if_mac(argv[3], mac);
 	}
 	else if (argc == 4 && strcmp(argv[1], "moveif") == 0) {
-		net_move_interface(argv[2], atoi(argv[3]));
+		if (pass & PASS_NETLINK)
+			net_move_interface(argv[2], atoi(argv[3]), NULL);
+	}
+	else if (argc == 6 && strcmp(argv[1], "shape") == 0 && strcmp(argv[2], "set") == 0) {
+		// speeds in KB/s
+		int down = atoi(argv[4]);
+		int up = atoi(argv[5]);
+		if (down <= 0 || up <= 0)
+			return 1;
+		if (pass & PASS_OTHER)
+			shape_set(argv[3], down, up);
+	}
+	else if (argc == 4 && strcmp(argv[1], "shape") == 0 && strcmp(argv[2], "clear") == 0) {
+		if (pass & PASS_OTHER)
+			shape_clear(argv[3]);
+	}
+	else if (argc == 3 && strcmp(argv[1], "shape") == 0 && strcmp(argv[2], "status") == 0) {
+		if (pass & PASS_OTHER)
+			shape_status();
+	}
+	else if (argc == 4 && strcmp(argv[1], "pool") == 0) {
+		if (atoi(argv[3]) < 0)
+			return 1;
+		if (pass & PASS_OTHER)
+			pool_fill(argv[2], atoi(argv[3]));
 	}
 	else if (argc == 5 && strcmp(argv[1], "config") == 0 && strcmp(argv[2], "ipv6") == 0) {
-		net_if_ip6(argv[3], argv[4]);
+		if (pass & PASS_OTHER)
+			net_if_ip6(argv[3], argv[4]);
 	}
 	else if (argc == 3 && strcmp(argv[1], "waitll") == 0) {
-		net_if_waitll(argv[2]);
+		if (pass & PASS_OTHER)
+			net_if_waitll(argv[2]);
 	}
-	else {
+	else
+		return 1;
+
+	return 0;
+}
+
+// fnet script "command" "command" ...
+// The commands have the same arguments as on the command line, separated by
+// spaces. The netlink requests of all the commands are sent first, in one
+// batch, then the other operations run in the order of the commands.
+#define SCRIPT_MAX_ARGS 8
+static int script(int argc, char **argv) {
+	int cnt = argc - 2;
+	if (cnt <= 0) {
+		fprintf(stderr, "Error fnet: invalid arguments\n");
+		return 1;
+	}
+	char *args[cnt][SCRIPT_MAX_ARGS];
+	int nargs[cnt];
+
+	int i;
+	for (i = 0; i < cnt; i++) {
+		char *str = strdup(argv[i + 2]);
+		if (!str)
+			errExit("strdup");
+		args[i][0] = argv[0];
+		nargs[i] = 1;
+		char *tok = strtok(str, " ");
+		while (tok) {
+			if (nargs[i] == SCRIPT_MAX_ARGS) {
+				fprintf(stderr, "Error fnet: invalid command %s\n", argv[i + 2]);
+				return 1;
+			}
+			args[i][nargs[i]++] = tok;
+			tok = strtok(NULL, " ");
+		}
+	}
+
+	net_batch_begin();
+	for (i = 0; i < cnt; i++) {
+		if (command(nargs[i], args[i], PASS_NETLINK)) {
+			fprintf(stderr, "Error fnet: invalid command %s\n", argv[i + 2]);
+			return 1;
+		}
+	}
+	net_batch_end();
+	pool_refill();
+
+	for (i = 0; i < cnt; i++)
+		command(nargs[i], args[i], PASS_OTHER);
+	return 0;
+}
+
+static void usage(void) {
+	puts(usage_str);
+}
+
+int main(int argc, char **argv) {
+#if 0
+{
+//system("cat /proc/self/status");
+int i;
+for (i = 0; i < argc; i++)
+	printf("*%s* ", argv[i]);
+printf("\n");
+}
+#endif
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") ==0) {
+		usage();
+		return 0;
+	}
+
+	warn_dumpable();
+
+	char *quiet = getenv("FIREJAIL_QUIET");
+	if (quiet && strcmp(quiet, "yes") == 0)
+		arg_quiet = 1;
+
+	if (argc >= 2 && strcmp(argv[1], "script") == 0)
+		return script(argc, argv);
+	if (command(argc, argv, PASS_NETLINK | PASS_OTHER)) {
 		fprintf(stderr, "Error fnet: invalid arguments\n");
 		return 1;
 	}
+	pool_refill();
 
 	return 0;
 }
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// veth pool: pairs created in advance by firejail --net-pool=bridge,N
+//
+// Both ends of a free pair are in the host namespace: fjpN is connected to
+// the bridge and up, fjpNp is waiting for a sandbox. A sandbox claims a pair
+// by moving fjpNp in its namespace, renamed on the way, with a single netlink
+// request. The pair is destroyed by the kernel with the namespace. The pool is
+// refilled in the background after the sandbox is started.
+
+#include "fnet.h"
+#include "../include/rundefs.h"
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <net/if.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+
+#define POOL_PREFIX "fjp"
+#define POOL_MAX_CLAIMS 16	// claims in a single fnet run
+
+static unsigned claimed[POOL_MAX_CLAIMS];	// pairs claimed, not yet moved
+static int claimed_cnt = 0;
+
+static struct {
+	const char *bridge;
+	int size;
+} refill[POOL_MAX_CLAIMS];
+static int refill_cnt = 0;
+
+static int lock_fd = -1;
+
+// the pool lock is held from the claim to the end of the batch, and by the
+// refill for each pair created or deleted
+static void pool_lock(void) {
+	if (lock_fd != -1)
+		return;
+	lock_fd = open(RUN_FIREJAIL_NETWORK_DIR "/pool.lock", O_RDONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+	if (lock_fd == -1)
+		errExit("open");
+	if (flock(lock_fd, LOCK_EX) == -1)
+		errExit("flock");
+}
+
+static void pool_unlock(void) {
+	if (lock_fd != -1) {
+		close(lock_fd);
+		lock_fd = -1;
+	}
+}
+
+static int is_claimed(unsigned index) {
+	int i;
+	for (i = 0; i < claimed_cnt; i++)
+		if (claimed[i] == index)
+			return 1;
+	return 0;
+}
+
+// the pair is free if the peer is still in the host namespace,
+// and the other end is connected to the bridge
+static int pair_free(unsigned index, const char *bridge) {
+	if (is_claimed(index))
+		return 0;
+
+	char *fname;
+	if (asprintf(&fname, "/sys/class/net/" POOL_PREFIX "%up", index) == -1)
+		errExit("asprintf");
+	int rv = access(fname, F_OK);
+	free(fname);
+	if (rv)
+		return 0;
+
+	if (asprintf(&fname, "/sys/class/net/" POOL_PREFIX "%u/master", index) == -1)
+		errExit("asprintf");
+	char master[PATH_MAX];
+	ssize_t len = readlink(fname, master, sizeof(master) - 1);
+	free(fname);
+	if (len <= 0)
+		return 0;
+	master[len] = '\0';
+	const char *ptr = strrchr(master, '/');
+	return strcmp(ptr ? ptr + 1 : master, bridge) == 0;
+}
+
+// index of the pool pair for a device name, -1 if the device is not the
+// bridge end of a pool pair
+static long pair_index(const char *dev) {
+	if (strncmp(dev, POOL_PREFIX, strlen(POOL_PREFIX)))
+		return -1;
+	const char *start = dev + strlen(POOL_PREFIX);
+	if (!isdigit((unsigned char) *start))
+		return -1;
+	char *end;
+	long index = strtol(start, &end, 10);
+	if (*end != '\0' || index < 0 || index > 9999)
+		return -1;
+	return index;
+}
+
+// count the free pairs of the bridge; the last one free is stored in last
+static int pool_count(const char *bridge, long *last) {
+	DIR *dir = opendir("/sys/class/net");
+	if (!dir)
+		errExit("opendir");
+	int cnt = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		long index = pair_index(entry->d_name);
+		if (index != -1 && pair_free(index, bridge)) {
+			cnt++;
+			if (last)
+				*last = index;
+		}
+	}
+	closedir(dir);
+	return cnt;
+}
+
+// queue the move of a free pair in the namespace of pid, renamed nsdev;
+// size is the size of the pool, refilled later by pool_refill()
+// return 0 if there is no free pair and the caller has to create one
+int pool_claim(const char *bridge, const char *nsdev, unsigned pid, int size) {
+	assert(bridge);
+	assert(nsdev);
+	if (claimed_cnt == POOL_MAX_CLAIMS)
+		return 0;
+
+	pool_lock();
+	long index = -1;
+	pool_count(bridge, &index);
+	if (index == -1)
+		return 0;
+
+	char peer[IFNAMSIZ];
+	snprintf(peer, sizeof(peer), POOL_PREFIX "%ldp", index);
+	net_move_interface(peer, pid, nsdev);
+	claimed[claimed_cnt++] = index;
+
+	int i;
+	for (i = 0; i < refill_cnt; i++)
+		if (strcmp(refill[i].bridge, bridge) == 0)
+			return 1;
+	refill[refill_cnt].bridge = bridge;
+	refill[refill_cnt].size = size;
+	refill_cnt++;
+	return 1;
+}
+
+// create or delete pairs until the bridge has size free pairs
+void pool_fill(const char *bridge, int size) {
+	assert(bridge);
+	assert(size >= 0);
+
+	while (1) {
+		// a claim waits at most for one pair
+		pool_lock();
+		long last = -1;
+		int cnt = pool_count(bridge, &last);
+		if (cnt == size)
+			break;
+
+		char dev[IFNAMSIZ];
+		if (cnt > size) {
+			snprintf(dev, sizeof(dev), POOL_PREFIX "%ld", last);
+			net_delete_interface(dev);
+		}
+		else {
+			char peer[IFNAMSIZ];
+			unsigned index = 0;
+			while (1) {
+				snprintf(dev, sizeof(dev), POOL_PREFIX "%u", index);
+				snprintf(peer, sizeof(peer), POOL_PREFIX "%up", index);
+				if (if_nametoindex(dev) == 0 && if_nametoindex(peer) == 0)
+					break;
+				if (++index > 9999) {
+					fprintf(stderr, "Error fnet: too many veth pairs in the pool\n");
+					exit(1);
+				}
+			}
+			net_create_veth(dev, peer, 0);
+			net_bridge_add_interface(bridge, dev);
+			net_if_up(dev);
+		}
+		pool_unlock();
+	}
+	pool_unlock();
+}
+
+// called once the claims are sent: release the lock, and refill the pools
+// used in a process running in the background
+void pool_refill(void) {
+	pool_unlock();
+	if (refill_cnt == 0)
+		return;
+
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child)
+		return;
+
+	// detach from the sandbox startup: nobody waits for this process
+	setsid();
+	claimed_cnt = 0;
+	int fd = open("/dev/null", O_RDWR);
+	if (fd != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+
+	int i;
+	for (i = 0; i < refill_cnt; i++)
+		pool_fill(refill[i].bridge, refill[i].size);
+	_exit(0);
+}
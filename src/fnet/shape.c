@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// bandwidth shaping over rtnetlink, the same setup as
+//	tc qdisc add dev DEV handle ffff: ingress
+//	tc filter add dev DEV parent ffff: protocol ip prio 50 u32 match ip src
+//		0.0.0.0/0 police rate DOWNkbit burst 10k drop flowid :1
+//	tc qdisc add dev DEV root tbf rate UPkbit latency 25ms burst 10k
+// The rate tables and the tick conversions follow iproute2 tc/tc_core.c.
+
+#include "fnet.h"
+#include "../include/libnetlink.h"
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/if_ether.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <errno.h>
+
+#define TIME_UNITS_PER_SEC 1000000
+#define SHAPE_BURST (10 * 1024)		// bytes
+#define SHAPE_LATENCY 25000		// us
+#define SHAPE_PRIO 50
+#define RTAB_SIZE 256
+
+struct tc_req {
+	struct nlmsghdr n;
+	struct tcmsg t;
+	char buf[4096];
+};
+
+static struct rtnl_handle rth = { .fd = -1 };
+static double tick_in_usec = 1;
+
+// kernel clock, from /proc/net/psched
+static void tc_core_init(void) {
+	FILE *fp = fopen("/proc/net/psched", "re");
+	if (!fp)
+		errExit("fopen /proc/net/psched");
+	unsigned t2us, us2t, clock_res;
+	if (fscanf(fp, "%08x%08x%08x", &t2us, &us2t, &clock_res) != 3) {
+		fprintf(stderr, "Error fnet: cannot read /proc/net/psched\n");
+		exit(1);
+	}
+	fclose(fp);
+
+	// the kernel advertises a tick multiplier of 1000 for nanosecond resolution
+	if (clock_res == 1000000000)
+		t2us = us2t;
+	double clock_factor = (double) clock_res / TIME_UNITS_PER_SEC;
+	tick_in_usec = (double) t2us / us2t * clock_factor;
+}
+
+// ticks needed to send size bytes at rate bytes/s
+static unsigned calc_xmittime(uint64_t rate, unsigned size) {
+	return (unsigned) (TIME_UNITS_PER_SEC * ((double) size / (double) rate) * tick_in_usec);
+}
+
+// transmit time of the packet sizes, Ethernet link layer, default MTU
+static void calc_rtable(struct tc_ratespec *r, uint32_t *rtab) {
+	unsigned mtu = 2047;
+	int cell_log = 0;
+	while ((mtu >> cell_log) > 255)
+		cell_log++;
+
+	int i;
+	for (i = 0; i < RTAB_SIZE; i++)
+		rtab[i] = calc_xmittime(r->rate, (i + 1) << cell_log);
+	r->cell_align = -1;
+	r->cell_log = cell_log;
+	r->linklayer = TC_LINKLAYER_ETHERNET;
+}
+
+static struct rtattr *nest_begin(struct nlmsghdr *n, int type) {
+	struct rtattr *nest = NLMSG_TAIL(n);
+	addattr_l(n, sizeof(struct tc_req), type, NULL, 0);
+	return nest;
+}
+
+static void nest_end(struct nlmsghdr *n, struct rtattr *nest) {
+	nest->rta_len = (void *) NLMSG_TAIL(n) - (void *) nest;
+}
+
+static void req_init(struct tc_req *req, int type, int flags, int ifindex, uint32_t parent, uint32_t handle) {
+	memset(req, 0, sizeof(*req));
+	req->n.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+	req->n.nlmsg_flags = NLM_F_REQUEST | flags;
+	req->n.nlmsg_type = type;
+	req->t.tcm_family = AF_UNSPEC;
+	req->t.tcm_ifindex = ifindex;
+	req->t.tcm_parent = parent;
+	req->t.tcm_handle = handle;
+}
+
+// send the request and wait for the acknowledgement; return 0 or the error number
+static int tc_talk(struct nlmsghdr *n) {
+	struct sockaddr_nl nladdr;
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	n->nlmsg_flags |= NLM_F_ACK;
+	n->nlmsg_seq = ++rth.seq;
+	if (sendto(rth.fd, n, n->nlmsg_len, 0, (struct sockaddr *) &nladdr, sizeof(nladdr)) != (ssize_t) n->nlmsg_len) {
+		perror("Cannot talk to rtnetlink");
+		exit(2);
+	}
+
+	char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+	while (1) {
+		ssize_t len = recv(rth.fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			perror("Cannot talk to rtnetlink");
+			exit(2);
+		}
+		if (len == 0) {
+			fprintf(stderr, "EOF on netlink\n");
+			exit(2);
+		}
+
+		int l = (int) len;
+		struct nlmsghdr *h;
+		for (h = (struct nlmsghdr *) buf; NLMSG_OK(h, l); h = NLMSG_NEXT(h, l)) {
+			if (h->nlmsg_type != NLMSG_ERROR || h->nlmsg_seq != n->nlmsg_seq)
+				continue;
+			if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+				return EINVAL;
+			struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA(h);
+			return -err->error;
+		}
+	}
+}
+
+static int get_ifindex(const char *dev) {
+	int ifindex = if_nametoindex(dev);
+	if (ifindex <= 0) {
+		fprintf(stderr, "Error fnet: cannot find interface %s\n", dev);
+		exit(1);
+	}
+	return ifindex;
+}
+
+static void shape_open(void) {
+	if (rtnl_open(&rth, 0) < 0) {
+		fprintf(stderr, "cannot open netlink\n");
+		exit(1);
+	}
+}
+
+// remove the root and the ingress qdiscs; the filters go with them
+static void shape_delete(int ifindex) {
+	struct tc_req req;
+	// the qdiscs could be missing, the errors are ignored
+	req_init(&req, RTM_DELQDISC, 0, ifindex, TC_H_ROOT, 0);
+	tc_talk(&req.n);
+	req_init(&req, RTM_DELQDISC, 0, ifindex, TC_H_INGRESS, TC_H_MAKE(TC_H_INGRESS, 0));
+	tc_talk(&req.n);
+}
+
+// exit on error, without leaving a partial configuration behind
+static void tc_check(int err, const char *what, int ifindex) {
+	if (err) {
+		fprintf(stderr, "Error fnet: cannot %s: %s\n", what, strerror(err));
+		shape_delete(ifindex);
+		exit(1);
+	}
+}
+
+void shape_clear(const char *dev) {
+	assert(dev);
+	int ifindex = get_ifindex(dev);
+	shape_open();
+	shape_delete(ifindex);
+	rtnl_close(&rth);
+}
+
+// download and upload speeds in KB/s
+void shape_set(const char *dev, unsigned down, unsigned up) {
+	assert(dev);
+	if (down == 0 || up == 0) {
+		fprintf(stderr, "Error fnet: invalid bandwidth\n");
+		exit(1);
+	}
+	int ifindex = get_ifindex(dev);
+	tc_core_init();
+	shape_open();
+	shape_delete(ifindex);
+
+	struct tc_req req;
+	uint32_t rtab[RTAB_SIZE];
+	uint32_t burst = SHAPE_BURST;
+
+	// ingress qdisc
+	req_init(&req, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, ifindex, TC_H_INGRESS, TC_H_MAKE(TC_H_INGRESS, 0));
+	addattr_l(&req.n, sizeof(req), TCA_KIND, "ingress", strlen("ingress") + 1);
+	addattr_l(&req.n, sizeof(req), TCA_OPTIONS, NULL, 0);
+	tc_check(tc_talk(&req.n), "add the ingress qdisc", ifindex);
+
+	// police the traffic received on the interface
+	uint64_t rate = (uint64_t) down * 1000;	// bytes/s
+	struct tc_police p;
+	memset(&p, 0, sizeof(p));
+	p.action = TC_POLICE_SHOT;
+	p.rate.rate = (rate >= (1ULL << 32)) ? ~0U : (uint32_t) rate;
+	calc_rtable(&p.rate, rtab);
+	p.burst = calc_xmittime(rate, burst);
+
+	struct {
+		struct tc_u32_sel sel;
+		struct tc_u32_key key;
+	} sel;
+	memset(&sel, 0, sizeof(sel));
+	sel.sel.flags = TC_U32_TERMINAL;
+	sel.sel.nkeys = 1;
+	sel.key.off = 12;	// match ip src 0.0.0.0/0
+	uint32_t classid = TC_H_MAKE(0, 1);
+
+	req_init(&req, RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, ifindex, TC_H_MAKE(TC_H_INGRESS, 0), 0);
+	req.t.tcm_info = TC_H_MAKE(SHAPE_PRIO << 16, htons(ETH_P_IP));
+	addattr_l(&req.n, sizeof(req), TCA_KIND, "u32", strlen("u32") + 1);
+	struct rtattr *options = nest_begin(&req.n, TCA_OPTIONS);
+	addattr_l(&req.n, sizeof(req), TCA_U32_CLASSID, &classid, sizeof(classid));
+	struct rtattr *police = nest_begin(&req.n, TCA_U32_POLICE);
+	addattr_l(&req.n, sizeof(req), TCA_POLICE_TBF, &p, sizeof(p));
+	addattr_l(&req.n, sizeof(req), TCA_POLICE_RATE, rtab, sizeof(rtab));
+	if (rate >= (1ULL << 32))
+		addattr_l(&req.n, sizeof(req), TCA_POLICE_RATE64, &rate, sizeof(rate));
+	nest_end(&req.n, police);
+	addattr_l(&req.n, sizeof(req), TCA_U32_SEL, &sel, sizeof(sel));
+	nest_end(&req.n, options);
+	int err = tc_talk(&req.n);
+	if (err == ENOENT)
+		fprintf(stderr, "Error fnet: traffic policing is not available in the kernel (act_police)\n");
+	tc_check(err, "add the ingress filter", ifindex);
+
+	// token bucket on the traffic sent
+	rate = (uint64_t) up * 1000;
+	struct tc_tbf_qopt opt;
+	memset(&opt, 0, sizeof(opt));
+	opt.rate.rate = (rate >= (1ULL << 32)) ? ~0U : (uint32_t) rate;
+	opt.limit = (uint32_t) ((double) rate * SHAPE_LATENCY / TIME_UNITS_PER_SEC + burst);
+	calc_rtable(&opt.rate, rtab);
+	opt.buffer = calc_xmittime(rate, burst);
+
+	req_init(&req, RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, ifindex, TC_H_ROOT, 0);
+	addattr_l(&req.n, sizeof(req), TCA_KIND, "tbf", strlen("tbf") + 1);
+	options = nest_begin(&req.n, TCA_OPTIONS);
+	addattr_l(&req.n, sizeof(req), TCA_TBF_PARMS, &opt, sizeof(opt));
+	addattr_l(&req.n, sizeof(req), TCA_TBF_BURST, &burst, sizeof(burst));
+	if (rate >= (1ULL << 32))
+		addattr_l(&req.n, sizeof(req), TCA_TBF_RATE64, &rate, sizeof(rate));
+	addattr_l(&req.n, sizeof(req), TCA_TBF_RTAB, rtab, sizeof(rtab));
+	nest_end(&req.n, options);
+	tc_check(tc_talk(&req.n), "add the egress qdisc", ifindex);
+
+	rtnl_close(&rth);
+}
+
+//***********************************
+// status
+//***********************************
+static void parse_attrs(struct rtattr *tb[], int max, struct rtattr *rta, int len) {
+	memset(tb, 0, sizeof(struct rtattr *) * (max + 1));
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+		if (rta->rta_type <= max)
+			tb[rta->rta_type] = rta;
+}
+
+static void print_handle(const char *prefix, uint32_t h) {
+	printf("%s%x:", prefix, TC_H_MAJ(h) >> 16);
+	if (TC_H_MIN(h))
+		printf("%x", TC_H_MIN(h));
+}
+
+static void print_rate(const char *prefix, uint64_t rate) {
+	printf("%s%llukbit", prefix, (unsigned long long) (rate * 8 / 1000));
+}
+
+// police rate of the u32 filters
+static void print_filter(struct nlmsghdr *h) {
+	struct tcmsg *t = NLMSG_DATA(h);
+	struct rtattr *tb[TCA_MAX + 1];
+	parse_attrs(tb, TCA_MAX, TCA_RTA(t), h->nlmsg_len - NLMSG_LENGTH(sizeof(*t)));
+	if (!tb[TCA_KIND] || strcmp(RTA_DATA(tb[TCA_KIND]), "u32") || !tb[TCA_OPTIONS])
+		return;
+
+	struct rtattr *u32[TCA_U32_MAX + 1];
+	parse_attrs(u32, TCA_U32_MAX, RTA_DATA(tb[TCA_OPTIONS]), RTA_PAYLOAD(tb[TCA_OPTIONS]));
+	if (!u32[TCA_U32_POLICE])
+		return;
+	struct rtattr *pol[TCA_POLICE_MAX + 1];
+	parse_attrs(pol, TCA_POLICE_MAX, RTA_DATA(u32[TCA_U32_POLICE]), RTA_PAYLOAD(u32[TCA_U32_POLICE]));
+	if (!pol[TCA_POLICE_TBF] || RTA_PAYLOAD(pol[TCA_POLICE_TBF]) < sizeof(struct tc_police))
+		return;
+
+	struct tc_police *p = RTA_DATA(pol[TCA_POLICE_TBF]);
+	uint64_t rate = p->rate.rate;
+	if (pol[TCA_POLICE_RATE64] && RTA_PAYLOAD(pol[TCA_POLICE_RATE64]) >= sizeof(uint64_t))
+		rate = *(uint64_t *) RTA_DATA(pol[TCA_POLICE_RATE64]);
+	char dev[IF_NAMESIZE] = "unknown";
+	if_indextoname(t->tcm_ifindex, dev);
+	printf("filter u32 dev %s ingress prio %u", dev, TC_H_MAJ(t->tcm_info) >> 16);
+	print_rate(" police rate ", rate);
+	printf("\n");
+}
+
+static void print_qdisc(struct nlmsghdr *h) {
+	struct tcmsg *t = NLMSG_DATA(h);
+	struct rtattr *tb[TCA_MAX + 1];
+	parse_attrs(tb, TCA_MAX, TCA_RTA(t), h->nlmsg_len - NLMSG_LENGTH(sizeof(*t)));
+	if (!tb[TCA_KIND])
+		return;
+
+	char dev[IF_NAMESIZE] = "unknown";
+	if_indextoname(t->tcm_ifindex, dev);
+	printf("qdisc %s", (char *) RTA_DATA(tb[TCA_KIND]));
+	print_handle(" ", t->tcm_handle);
+	printf(" dev %s", dev);
+	if (t->tcm_parent == TC_H_ROOT)
+		printf(" root");
+	else if (t->tcm_parent == TC_H_INGRESS)
+		printf(" ingress");
+	else
+		print_handle(" parent ", t->tcm_parent);
+
+	if (strcmp(RTA_DATA(tb[TCA_KIND]), "tbf") == 0 && tb[TCA_OPTIONS]) {
+		struct rtattr *tbf[TCA_TBF_MAX + 1];
+		parse_attrs(tbf, TCA_TBF_MAX, RTA_DATA(tb[TCA_OPTIONS]), RTA_PAYLOAD(tb[TCA_OPTIONS]));
+		if (tbf[TCA_TBF_PARMS] && RTA_PAYLOAD(tbf[TCA_TBF_PARMS]) >= sizeof(struct tc_tbf_qopt)) {
+			struct tc_tbf_qopt *opt = RTA_DATA(tbf[TCA_TBF_PARMS]);
+			uint64_t rate = opt->rate.rate;
+			if (tbf[TCA_TBF_RATE64] && RTA_PAYLOAD(tbf[TCA_TBF_RATE64]) >= sizeof(uint64_t))
+				rate = *(uint64_t *) RTA_DATA(tbf[TCA_TBF_RATE64]);
+			print_rate(" rate ", rate);
+			printf(" limit %ub", opt->limit);
+		}
+	}
+	printf("\n");
+
+	if (tb[TCA_STATS] && RTA_PAYLOAD(tb[TCA_STATS]) >= sizeof(struct tc_stats)) {
+		struct tc_stats *st = RTA_DATA(tb[TCA_STATS]);
+		printf(" Sent %llu bytes %u pkt (dropped %u, overlimits %u)\n",
+		       (unsigned long long) st->bytes, st->packets, st->drops, st->overlimits);
+	}
+}
+
+// dump request; the messages received are passed to the callback
+static void tc_dump(int type, int ifindex, uint32_t parent, void (*cb)(struct nlmsghdr *)) {
+	struct tc_req req;
+	req_init(&req, type, NLM_F_DUMP, ifindex, parent, 0);
+	req.n.nlmsg_seq = ++rth.seq;
+	struct sockaddr_nl nladdr;
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(rth.fd, &req, req.n.nlmsg_len, 0, (struct sockaddr *) &nladdr, sizeof(nladdr)) < 0) {
+		perror("Cannot talk to rtnetlink");
+		exit(2);
+	}
+
+	char buf[16384] __attribute__((aligned(NLMSG_ALIGNTO)));
+	while (1) {
+		ssize_t len = recv(rth.fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			perror("Cannot talk to rtnetlink");
+			exit(2);
+		}
+		if (len == 0)
+			return;
+
+		int l = (int) len;
+		struct nlmsghdr *h;
+		for (h = (struct nlmsghdr *) buf; NLMSG_OK(h, l); h = NLMSG_NEXT(h, l)) {
+			if (h->nlmsg_seq != req.n.nlmsg_seq)
+				continue;
+			if (h->nlmsg_type == NLMSG_DONE || h->nlmsg_type == NLMSG_ERROR)
+				return;
+			cb(h);
+		}
+	}
+}
+
+#define MAX_INGRESS 64
+static int ingress_ifindex[MAX_INGRESS];
+static int ingress_cnt = 0;
+
+// the filters cannot be dumped during the qdisc dump, the ingress qdiscs are
+// stored for later
+static void qdisc_cb(struct nlmsghdr *h) {
+	struct tcmsg *t = NLMSG_DATA(h);
+	if (t->tcm_parent == TC_H_INGRESS && ingress_cnt < MAX_INGRESS)
+		ingress_ifindex[ingress_cnt++] = t->tcm_ifindex;
+	print_qdisc(h);
+}
+
+// all the qdiscs in the namespace, and the police rate on the ingress qdiscs
+void shape_status(void) {
+	shape_open();
+	tc_dump(RTM_GETQDISC, 0, 0, qdisc_cb);
+	int i;
+	for (i = 0; i < ingress_cnt; i++)
+		tc_dump(RTM_GETTFILTER, ingress_ifindex[i], TC_H_MAKE(TC_H_INGRESS, 0), print_filter);
+	rtnl_close(&rth);
+}
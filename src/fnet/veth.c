@@ -49,6 +49,7 @@
 #include "../include/libnetlink.h"
 #include <linux/veth.h>
 #include <net/if.h>
+#include <errno.h>
 
 // Debian Jessie and distributions before that don't have support for IPVLAN
 // in /usr/include/linux/if_link.h. We only need a definition for IPVLAN_MODE_L2.
@@ -66,18 +67,108 @@ struct iplink_req
 
 static struct rtnl_handle rth = { .fd = -1 };
 
-int net_create_veth(const char *dev, const char *nsdev, unsigned pid) {
-	int len;
-	struct iplink_req req;
+// fnet script: the requests are queued, and sent in one batch on a single
+// socket by net_batch_flush()
+static char batch[16384] __attribute__((aligned(NLMSG_ALIGNTO)));
+static unsigned batch_len = 0;
+static unsigned batch_cnt = 0;
+static int batching = 0;
 
-	assert(dev);
-	assert(nsdev);
-	assert(pid);
+void net_batch_begin(void) {
+	batching = 1;
+}
+
+// send the requests queued and wait for all the acknowledgements;
+// exit if any of them failed
+void net_batch_flush(void) {
+	if (batch_cnt == 0)
+		return;
 
 	if (rtnl_open(&rth, 0) < 0) {
 		fprintf(stderr, "cannot open netlink\n");
 		exit(1);
 	}
+	struct sockaddr_nl nladdr;
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(rth.fd, batch, batch_len, 0, (struct sockaddr *) &nladdr, sizeof(nladdr)) != (ssize_t) batch_len) {
+		perror("Cannot talk to rtnetlink");
+		exit(2);
+	}
+
+	// every request has NLM_F_ACK set, the kernel answers all of them
+	// even if some fail
+	char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+	unsigned acks = 0;
+	int failed = 0;
+	while (acks < batch_cnt) {
+		ssize_t len = recv(rth.fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			perror("Cannot talk to rtnetlink");
+			exit(2);
+		}
+		if (len == 0) {
+			fprintf(stderr, "EOF on netlink\n");
+			exit(2);
+		}
+
+		int l = (int) len;
+		struct nlmsghdr *h;
+		for (h = (struct nlmsghdr *) buf; NLMSG_OK(h, l); h = NLMSG_NEXT(h, l)) {
+			if (h->nlmsg_type != NLMSG_ERROR)
+				continue;
+			acks++;
+			struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA(h);
+			if (h->nlmsg_len < NLMSG_LENGTH(sizeof(struct nlmsgerr)))
+				failed = 1;
+			else if (err->error) {
+				fprintf(stderr, "RTNETLINK answers: %s\n", strerror(-err->error));
+				failed = 1;
+			}
+		}
+	}
+
+	rtnl_close(&rth);
+	batch_len = 0;
+	batch_cnt = 0;
+	if (failed)
+		exit(2);
+}
+
+// send the requests left and go back to one request at a time
+void net_batch_end(void) {
+	net_batch_flush();
+	batching = 0;
+}
+
+static void net_request(struct nlmsghdr *n) {
+	if (batching) {
+		if (batch_len + NLMSG_ALIGN(n->nlmsg_len) > sizeof(batch))
+			net_batch_flush();
+		n->nlmsg_flags |= NLM_F_ACK;
+		n->nlmsg_seq = ++batch_cnt;
+		memcpy(batch + batch_len, n, n->nlmsg_len);
+		batch_len += NLMSG_ALIGN(n->nlmsg_len);
+		return;
+	}
+
+	if (rtnl_open(&rth, 0) < 0) {
+		fprintf(stderr, "cannot open netlink\n");
+		exit(1);
+	}
+	if (rtnl_talk(&rth, n, 0, 0, NULL) < 0)
+		exit(2);
+	rtnl_close(&rth);
+}
+
+int net_create_veth(const char *dev, const char *nsdev, unsigned pid) {
+	int len;
+	struct iplink_req req;
+
+	assert(dev);
+	assert(nsdev);
 
 	memset(&req, 0, sizeof(req));
 
@@ -102,8 +193,9 @@ int net_create_veth(const char *dev, const char *nsdev, unsigned pid) {
 	addattr_l (&req.n, sizeof(req), VETH_INFO_PEER, NULL, 0);
 	req.n.nlmsg_len += sizeof(struct ifinfomsg);
 
-	// place the link in the child namespace
-	addattr_l (&req.n, sizeof(req), IFLA_NET_NS_PID, &pid, 4);
+	// place the link in the child namespace; pid 0 leaves it in the current one
+	if (pid)
+		addattr_l (&req.n, sizeof(req), IFLA_NET_NS_PID, &pid, 4);
 
 	if (nsdev) {
 		int len = strlen(nsdev) + 1;
@@ -114,11 +206,7 @@ int net_create_veth(const char *dev, const char *nsdev, unsigned pid) {
 	data->rta_len = (void *)NLMSG_TAIL(&req.n) - (void *)data;
 	linkinfo->rta_len = (void *)NLMSG_TAIL(&req.n) - (void *)linkinfo;
 
-	// send message
-	if (rtnl_talk(&rth, &req.n, 0, 0, NULL) < 0)
-		exit(2);
-
-	rtnl_close(&rth);
+	net_request(&req.n);
 
 	return 0;
 }
@@ -130,11 +218,6 @@ int net_create_macvlan(const char *dev, const char *parent, unsigned pid) {
 	assert(dev);
 	assert(parent);
 
-	if (rtnl_open(&rth, 0) < 0) {
-		fprintf(stderr, "cannot open netlink\n");
-		exit(1);
-	}
-
 	memset(&req, 0, sizeof(req));
 
 	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
@@ -174,11 +257,7 @@ int net_create_macvlan(const char *dev, const char *parent, unsigned pid) {
 	data->rta_len = (void *)NLMSG_TAIL(&req.n) - (void *)data;
 	linkinfo->rta_len = (void *)NLMSG_TAIL(&req.n) - (void *)linkinfo;
 
-	// send message
-	if (rtnl_talk(&rth, &req.n, 0, 0, NULL) < 0)
-		exit(2);
-
-	rtnl_close(&rth);
+	net_request(&req.n);
 
 	return 0;
 }
@@ -189,11 +268,6 @@ int net_create_ipvlan(const char *dev, const char *parent, unsigned pid) {
 	assert(dev);
 	assert(parent);
 
-	if (rtnl_open(&rth, 0) < 0) {
-		fprintf(stderr, "cannot open netlink\n");
-		exit(1);
-	}
-
 	memset(&req, 0, sizeof(req));
 
 	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
@@ -236,26 +310,17 @@ int net_create_ipvlan(const char *dev, const char *parent, unsigned pid) {
 	data->rta_len = (void *)NLMSG_TAIL(&req.n) - (void *)data;
 	linkinfo->rta_len = (void *)NLMSG_TAIL(&req.n) - (void *)linkinfo;
 
-	// send message
-	if (rtnl_talk(&rth, &req.n, 0, 0, NULL) < 0)
-		exit(2);
-
-	rtnl_close(&rth);
+	net_request(&req.n);
 
 	return 0;
 }
 
-// move the interface dev in namespace of program pid
+// move the interface dev in namespace of program pid, renamed newname if not NULL
 // when the interface is moved, netlink does not preserve interface configuration
-int net_move_interface(const char *dev, unsigned pid) {
+int net_move_interface(const char *dev, unsigned pid, const char *newname) {
 	struct iplink_req req;
 	assert(dev);
 
-	if (rtnl_open(&rth, 0) < 0) {
-		fprintf(stderr, "cannot open netlink\n");
-		exit(1);
-	}
-
 	memset(&req, 0, sizeof(req));
 
 	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
@@ -274,11 +339,34 @@ int net_move_interface(const char *dev, unsigned pid) {
 	// place the interface in child namespace
 	addattr_l (&req.n, sizeof(req), IFLA_NET_NS_PID, &pid, 4);
 
-	// send message
-	if (rtnl_talk(&rth, &req.n, 0, 0, NULL) < 0)
-		exit(2);
+	if (newname)
+		addattr_l(&req.n, sizeof(req), IFLA_IFNAME, newname, strlen(newname) + 1);
 
-	rtnl_close(&rth);
+	net_request(&req.n);
+
+	return 0;
+}
+
+// delete the interface; for a veth pair, the peer is deleted as well
+int net_delete_interface(const char *dev) {
+	struct iplink_req req;
+	assert(dev);
+
+	memset(&req, 0, sizeof(req));
+
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req.n.nlmsg_flags = NLM_F_REQUEST;
+	req.n.nlmsg_type = RTM_DELLINK;
+	req.i.ifi_family = 0;
+
+	int ifindex = if_nametoindex(dev);
+	if (ifindex <= 0) {
+		fprintf(stderr, "Error: cannot find interface %s\n", dev);
+		exit(1);
+	}
+	req.i.ifi_index = ifindex;
+
+	net_request(&req.n);
 
 	return 0;
 }
@@ -45,9 +45,41 @@ static char *default_filter =
 "-A OUTPUT -p tcp --dport 3479 -j DROP\n"
 "COMMIT\n";
 
+// the same filter for nftables, loaded by nft in a single transaction;
+// IPv6 traffic is not filtered, as with iptables
+static char *default_filter_nft =
+"flush ruleset\n"
+"table inet firejail {\n"
+"\tset icmp_accept {\n"
+"\t\ttype icmp_type\n"
+"\t\telements = { destination-unreachable, time-exceeded, echo-request }\n"
+"\t}\n"
+"\t# disable STUN\n"
+"\tset stun_ports {\n"
+"\t\ttype inet_service\n"
+"\t\telements = { 3478, 3479 }\n"
+"\t}\n"
+"\tchain input {\n"
+"\t\ttype filter hook input priority 0; policy drop;\n"
+"\t\tmeta nfproto ipv6 accept\n"
+"\t\tiif lo accept\n"
+"\t\tct state established,related accept\n"
+"\t\ticmp type @icmp_accept accept\n"
+"\t}\n"
+"\tchain forward {\n"
+"\t\ttype filter hook forward priority 0; policy drop;\n"
+"\t\tmeta nfproto ipv6 accept\n"
+"\t}\n"
+"\tchain output {\n"
+"\t\ttype filter hook output priority 0; policy accept;\n"
+"\t\tmeta nfproto ipv4 meta l4proto { tcp, udp } th dport @stun_ports drop\n"
+"\t}\n"
+"}\n";
+
 static const char *const usage_str =
 	"Usage:\n"
-	"\tfnetfilter netfilter-command destination-file\n";
+	"\tfnetfilter netfilter-command destination-file\n"
+	"\tfnetfilter --nftables destination-file\n";
 
 static void usage(void) {
 	puts(usage_str);
@@ -76,6 +108,103 @@ static void copy(const char *src, const char *dest) {
 	fclose(fp2);
 }
 
+// a template is a list of literal text segments and $ARGn references
+typedef struct {
+	size_t off;	// literal text in the template buffer
+	size_t len;
+	int arg;	// $ARGn index, 0 for literal text
+} Token;
+
+static char *load_template(const char *src, size_t *size) {
+	FILE *fp = fopen(src, "r");
+	if (!fp)
+		err_exit_cannot_open_file(src);
+
+	size_t len = 0;
+	size_t alloc = MAXBUF;
+	char *buf = malloc(alloc + 1);
+	if (!buf)
+		errExit("malloc");
+	size_t n;
+	while ((n = fread(buf + len, 1, alloc - len, fp)) > 0) {
+		len += n;
+		if (len == alloc) {
+			alloc *= 2;
+			buf = realloc(buf, alloc + 1);
+			if (!buf)
+				errExit("realloc");
+		}
+	}
+	if (ferror(fp))
+		err_exit_cannot_open_file(src);
+	fclose(fp);
+
+	buf[len] = '\0';
+	*size = len;
+	return buf;
+}
+
+// split the template in tokens; the $ARGn references are checked here,
+// before anything is written in the destination file
+static Token *parse_template(const char *buf, size_t size, size_t *cnt) {
+	size_t alloc = 64;
+	Token *tokens = malloc(alloc * sizeof(Token));
+	if (!tokens)
+		errExit("malloc");
+	*cnt = 0;
+
+	int line = 1;
+	size_t start = 0;
+	size_t i = 0;
+	while (i <= size) {
+		if (i < size && buf[i] != '$') {
+			if (buf[i] == '\n')
+				line++;
+			i++;
+			continue;
+		}
+
+		// at most two tokens are added: the literal text and the argument
+		if (*cnt + 2 > alloc) {
+			alloc *= 2;
+			tokens = realloc(tokens, alloc * sizeof(Token));
+			if (!tokens)
+				errExit("realloc");
+		}
+		if (i > start) {
+			tokens[*cnt].off = start;
+			tokens[*cnt].len = i - start;
+			tokens[*cnt].arg = 0;
+			(*cnt)++;
+		}
+		if (i == size)
+			break;
+
+		// parsing
+		int index = 0;
+		if (strncmp(buf + i, "$ARG", 4) || !isdigit((unsigned char) buf[i + 4]) ||
+		    sscanf(buf + i, "$ARG%d", &index) != 1) {
+			fprintf(stderr, "Error fnetfilter: invalid template argument on line %d\n", line);
+			exit(1);
+		}
+		if (index < 1 || index > argcnt) {
+			fprintf(stderr, "Error fnetfilter: $ARG%d on line %d was not defined\n", index, line);
+			exit(1);
+		}
+		tokens[*cnt].off = i;
+		tokens[*cnt].len = 0;
+		tokens[*cnt].arg = index;
+		(*cnt)++;
+
+		// march to the end of argument
+		i += 4;
+		while (i < size && isdigit((unsigned char) buf[i]))
+			i++;
+		start = i;
+	}
+	return tokens;
+}
+
 static void process_template(char *src, const char *dest) {
 	char *arg_start = strchr(src, ',');
 	assert(arg_start);
@@ -112,51 +241,26 @@ for (i = 0; i < argcnt; i++)
 }
 #endif
 
-	// open the files
-	FILE *fp1 = fopen(src, "r");
-	if (!fp1)
-		err_exit_cannot_open_file(src);
+	// parse the template, then print it in a single pass over the tokens
+	size_t size;
+	char *buf = load_template(src, &size);
+	size_t cnt;
+	Token *tokens = parse_template(buf, size, &cnt);
 
-	FILE *fp2 = fopen(dest, "w");
-	if (!fp2)
+	FILE *fp = fopen(dest, "w");
+	if (!fp)
 		err_exit_cannot_open_file(dest);
-
-	int line = 0;
-	char buf[MAXBUF];
-	while (fgets(buf, MAXBUF, fp1)) {
-		line++;
-		char *ptr = buf;
-		while (*ptr != '\0') {
-			if (*ptr != '$')
-				fputc(*ptr, fp2);
-			else {
-				// parsing
-				int index = 0;
-				int rv = sscanf(ptr, "$ARG%d", &index) ;
-				if (rv != 1) {
-					fprintf(stderr, "Error fnetfilter: invalid template argument on line %d\n", line);
-					exit(1);
-				}
-
-				// print argument
-				if (index < 1 || index > argcnt) {
-					fprintf(stderr, "Error fnetfilter: $ARG%d on line %d was not defined\n", index, line);
-					exit(1);
-				}
-				fprintf(fp2, "%s", args[index - 1]);
-
-				// march to the end of argument
-				ptr += 4;
-				while (isdigit(*ptr))
-					ptr++;
-				ptr--;
-			}
-			ptr++;
-		}
+	size_t i;
+	for (i = 0; i < cnt; i++) {
+		if (tokens[i].arg)
+			fputs(args[tokens[i].arg - 1], fp);
+		else
+			fwrite(buf + tokens[i].off, 1, tokens[i].len, fp);
 	}
+	fclose(fp);
 
-	fclose(fp1);
-	fclose(fp2);
+	free(tokens);
+	free(buf);
 }
 
 int main(int argc, char **argv) {
@@ -188,6 +292,11 @@ printf("\n");
 
 	char *destfile = (argc == 3)? argv[2]: argv[1];
 	char *command = (argc == 3)? argv[1]: NULL;
+	int nftables = 0;
+	if (command && strcmp(command, "--nftables") == 0) {
+		nftables = 1;
+		command = NULL;
+	}
 //printf("command %s\n", command);
 //printf("destfile %s\n", destfile);
 
@@ -200,7 +309,7 @@ printf("\n");
 		FILE *fp = fopen(destfile, "w");
 		if (!fp)
 			err_exit_cannot_open_file(destfile);
-		fprintf(fp, "%s\n", default_filter);
+		fprintf(fp, "%s\n", nftables ? default_filter_nft : default_filter);
 		fclose(fp);
 	}
 	else {
@@ -36,12 +36,6 @@
 
 #define NETLOCK_INTERVAL 60	// seconds
 
-static inline uint8_t hash(uint32_t ip) {
-	uint8_t *ptr = (uint8_t *) &ip;
-	// simple byte xor
-	return *ptr ^ *(ptr + 1) ^ *(ptr + 2) ^ *(ptr + 3);
-}
-
 // main.c
 void logprintf(char* fmt, ...);
 
@@ -18,93 +18,238 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "fnetlock.h"
+#include "../include/packet_ring.h"
+#include <linux/if_ether.h>
 #include <limits.h>
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
 #include <signal.h>
-#define MAX_BUF_SIZE (64 * 1024)
 
 static int arg_tail = 0;
 static char *arg_log = NULL;
 
 //*****************************************************************
-// traffic trace storage - hash table for fast access + linked list for display purposes
+// learned destinations - open addressing set on (address, protocol):
+// the firewall rules disregard the port number
 //*****************************************************************
-typedef struct hnode_t {
-	struct hnode_t *hnext;	// used for hash table and unused linked list
-	struct hnode_t *dnext;	// used to display streams on the screen
+typedef struct {
 	uint32_t ip_src;
-	uint16_t port_src;
-	uint8_t protocol;
+	uint8_t protocol;	// 0 for an empty slot
+} Dest;
+
+// the size is a power of 2 and the set is never more than half full
+#define DSET_MIN 256
+static Dest *dset = NULL;
+static unsigned dset_size = 0;
+static unsigned dset_cnt = 0;
+static int have_traffic = 0;
 
-	// the firewall is build based on source address, and in the linked list
-	// we could have elements with the same address but different ports
-	uint8_t ip_instance;
-} HNode;
+// nftables: the rules are in place from the start, with an accept policy;
+// the destinations are added to the set while the traffic is learned, and
+// the policy is switched to drop at the end of the learning window
+static char *nft = NULL;
+#define NFT_TABLE "firejail"
+#define NFT_SET "netlock"
+static char *nft_pending = NULL;	// elements not yet added to the set
+static size_t nft_pending_len = 0;
+
+static inline unsigned dest_hash(uint32_t ip, uint8_t protocol) {
+	uint32_t h = (ip ^ protocol) * 0x9e3779b1U;
+	h ^= h >> 15;
+	return h & (dset_size - 1);
+}
 
-// hash table
-#define HMAX 256
-HNode *htable[HMAX] = {NULL};
-static int have_traffic = 0;
+// the slot of the destination, or the empty slot where it goes
+static unsigned dest_slot(uint32_t ip, uint8_t protocol) {
+	unsigned i = dest_hash(ip, protocol);
+	while (dset[i].protocol) {
+		if (dset[i].ip_src == ip && dset[i].protocol == protocol)
+			break;
+		i = (i + 1) & (dset_size - 1);
+	}
+	return i;
+}
 
-// using protocol 0 and port 0 for ICMP
-static void hnode_add(uint32_t ip_src, uint8_t protocol, uint16_t port_src) {
-	uint8_t h = hash(ip_src);
-	int ip_instance = 0;
-	HNode *ptr = htable[h];
-	while (ptr) {
-		if (ptr->ip_src == ip_src) {
-			ip_instance++;
-			if (ptr->port_src == port_src && ptr->protocol == protocol)
-				return;
-		}
-		ptr = ptr->hnext;
+static void dset_resize(unsigned size) {
+	Dest *old = dset;
+	unsigned old_size = dset_size;
+
+	dset = calloc(size, sizeof(Dest));
+	if (!dset)
+		errExit("calloc");
+	dset_size = size;
+
+	unsigned i;
+	for (i = 0; i < old_size; i++) {
+		if (old[i].protocol)
+			dset[dest_slot(old[i].ip_src, old[i].protocol)] = old[i];
 	}
+	free(old);
+}
+
+static void nft_pending_add(uint32_t ip, uint8_t protocol) {
+	char elem[64];
+	int len = snprintf(elem, sizeof(elem), "%s%d.%d.%d.%d . %s",
+		(nft_pending_len) ? ", " : "", PRINT_IP(ip), (protocol == 6) ? "tcp" : "udp");
+	nft_pending = realloc(nft_pending, nft_pending_len + len + 1);
+	if (!nft_pending)
+		errExit("realloc");
+	memcpy(nft_pending + nft_pending_len, elem, len + 1);
+	nft_pending_len += len;
+}
+
+static void hnode_add(uint32_t ip_src, uint8_t protocol) {
+	if (dset == NULL)
+		dset_resize(DSET_MIN);
+
+	unsigned i = dest_slot(ip_src, protocol);
+	if (dset[i].protocol)
+		return;
 
 	logprintf("netlock: adding %d.%d.%d.%d\n", PRINT_IP(ip_src));
 	have_traffic = 1;
-	HNode *hnew = malloc(sizeof(HNode));
-	assert(hnew);
-	hnew->ip_src = ip_src;
-	hnew->port_src = port_src;
-	hnew->protocol = protocol;
-	hnew->hnext = NULL;
-	hnew->ip_instance = ip_instance + 1;
-	if (htable[h] == NULL)
-		htable[h] = hnew;
-	else {
-		hnew->hnext = htable[h];
-		htable[h] = hnew;
-	}
+	dset[i].ip_src = ip_src;
+	dset[i].protocol = protocol;
+	if (++dset_cnt * 2 > dset_size)
+		dset_resize(dset_size * 2);
+
+	if (nft)
+		nft_pending_add(ip_src, protocol);
+}
+
+//*****************************************************************
+// nftables
+//*****************************************************************
+// return 1 if error
+static int nft_run(const char *script) {
+	char *cmd;
+	if (asprintf(&cmd, "%s -f -", nft) == -1)
+		errExit("asprintf");
+	FILE *fp = popen(cmd, "w");
+	free(cmd);
+	if (!fp)
+		return 1;
+	fputs(script, fp);
+	return (pclose(fp) != 0);
 }
 
+static const char *const nft_table =
+	"table ip " NFT_TABLE "\n"
+	"delete table ip " NFT_TABLE "\n"
+	"table ip " NFT_TABLE " {\n"
+	"	set " NFT_SET " {\n"
+	"		type ipv4_addr . inet_proto\n"
+	"	}\n"
+	"	chain input {\n"
+	"		type filter hook input priority filter; policy accept;\n"
+	"		ip saddr 127.0.0.0/8 accept\n"
+	"		ip saddr . ip protocol @" NFT_SET " accept\n"
+	"	}\n"
+	"	chain forward {\n"
+	"		type filter hook forward priority filter; policy accept;\n"
+	"	}\n"
+	"	chain output {\n"
+	"		type filter hook output priority filter; policy accept;\n"
+	"		ip daddr 127.0.0.0/8 accept\n"
+	"		ip daddr . ip protocol @" NFT_SET " accept\n"
+	"	}\n"
+	"}\n";
+
+static void nft_init(void) {
+	if (access("/usr/sbin/nft", X_OK) == 0)
+		nft = "/usr/sbin/nft";
+	else if (access("/sbin/nft", X_OK) == 0)
+		nft = "/sbin/nft";
+	else
+		return;
+
+	// the table is replaced if it exists
+	if (nft_run(nft_table)) {
+		logprintf("netlock: cannot create the nftables table, using iptables\n");
+		nft = NULL;
+		return;
+	}
+	logprintf("netlock: using nftables set " NFT_TABLE "/" NFT_SET "\n");
+}
 
+// add the destinations learned since the last call, a single nft call
+static void nft_flush(void) {
+	if (!nft || nft_pending_len == 0)
+		return;
 
+	char *script;
+	if (asprintf(&script, "add element ip " NFT_TABLE " " NFT_SET " { %s }\n", nft_pending) == -1)
+		errExit("asprintf");
+	if (nft_run(script))
+		fprintf(stderr, "Warning: cannot update the nftables set\n");
+	free(script);
+	nft_pending_len = 0;
+	*nft_pending = '\0';
+}
 
 // trace rx traffic coming in
+// buf - start of the IP header
+static void process_packet(unsigned char *buf, unsigned bytes, unsigned char pkttype, void *arg) {
+	(void) arg;
+
+	// trace only rx traffic, as seen by the raw IP sockets used before
+	if (pkttype == PACKET_OUTGOING || pkttype == PACKET_OTHERHOST)
+		return;
+
+	if (bytes >= 20) { // size of IP header
+		uint8_t protocol = buf[9];
+		if (protocol != 6 && protocol != 17) // tcp and udp
+			return;
+#ifdef DEBUG
+		{
+			uint32_t ip_src;
+			memcpy(&ip_src, buf + 12, 4);
+			ip_src = ntohl(ip_src);
+
+			uint32_t ip_dst;
+			memcpy(&ip_dst, buf + 16, 4);
+			ip_dst = ntohl(ip_dst);
+			printf("%d.%d.%d.%d -> %d.%d.%d.%d, %u bytes\n", PRINT_IP(ip_src), PRINT_IP(ip_dst), bytes);
+		}
+#endif
+		// filter out loopback traffic
+		if (buf[12] != 127 && buf[16] != 127) {
+			uint32_t ip_src;
+			memcpy(&ip_src, buf + 12, 4);
+			ip_src = ntohl(ip_src);
+
+			hnode_add(ip_src, protocol);
+		}
+	}
+}
+
 static void run_trace(void) {
+	nft_init();
 	logprintf("netlock: accumulating traffic for %d seconds\n", NETLOCK_INTERVAL);
 
-	// trace only rx ipv4 tcp and upd
-	int s1 = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
-	int s2 = socket(AF_INET, SOCK_RAW, IPPROTO_UDP);
-	if (s1 < 0 || s2 < 0)
-		errExit("socket");
-
+	// IPv4 packets without the link layer, tcp and udp are selected in process_packet()
+	PacketRing ring;
+	packet_ring_open(&ring, SOCK_DGRAM);
+	packet_ring_bind(&ring, ETH_P_IP);
 
 	unsigned start = time(NULL);
-	unsigned char buf[MAX_BUF_SIZE];
-	// FIXME: error: variable 'bw' set but not used [-Werror,-Wunused-but-set-variable]
-	//unsigned bw = 0; // bandwidth calculations
-
 	int printed = 0;
+	unsigned flushed = 0;
 	while (1) {
 		unsigned runtime = time(NULL) - start;
 		if ( runtime >= NETLOCK_INTERVAL)
 			break;
+		// the new destinations are added to the nftables set once a second
+		if (runtime != flushed) {
+			nft_flush();
+			flushed = runtime;
+		}
 		if (runtime % 10 == 0) {
-			if (!printed)
+			if (!printed) {
 				logprintf("netlock: %u seconds remaining\n", NETLOCK_INTERVAL - runtime);
+				if (packet_ring_stats(&ring))
+					logprintf("netlock: %llu packets dropped\n", ring.drops);
+			}
 			printed = 1;
 		}
 		else
@@ -112,64 +257,23 @@ static void run_trace(void) {
 
 		fd_set rfds;
 		FD_ZERO(&rfds);
-		FD_SET(s1, &rfds);
-		FD_SET(s2, &rfds);
-		int maxfd = (s1 > s2) ? s1 : s2;
-		maxfd++;
+		FD_SET(ring.sock, &rfds);
 
 		struct timeval tv;
 		tv.tv_sec = 1;
 		tv.tv_usec = 0;
 
-		int rv = select(maxfd, &rfds, NULL, NULL, &tv);
+		int rv = select(ring.sock + 1, &rfds, NULL, NULL, &tv);
 		if (rv < 0)
 			errExit("select");
 		else if (rv == 0)
 			continue;
 
-
-		// rx tcp traffic by default
-		int sock = s1;
-
-		if (FD_ISSET(s2, &rfds))
-			sock = s2;
-
-		unsigned bytes = recvfrom(sock, buf, MAX_BUF_SIZE, 0, NULL, NULL);
-		if (bytes >= 20) { // size of IP header
-#ifdef DEBUG
-			{
-				uint32_t ip_src;
-				memcpy(&ip_src, buf + 12, 4);
-				ip_src = ntohl(ip_src);
-
-				uint32_t ip_dst;
-				memcpy(&ip_dst, buf + 16, 4);
-				ip_dst = ntohl(ip_dst);
-				printf("%d.%d.%d.%d -> %d.%d.%d.%d, %u bytes\n", PRINT_IP(ip_src), PRINT_IP(ip_dst), bytes);
-			}
-#endif
-			// filter out loopback traffic
-			if (buf[12] != 127 && buf[16] != 127) {
-				// FIXME: error: variable 'bw' set but not used [-Werror,-Wunused-but-set-variable]
-				//bw += bytes + 14; // assume a 14 byte Ethernet layer
-
-				uint32_t ip_src;
-				memcpy(&ip_src, buf + 12, 4);
-				ip_src = ntohl(ip_src);
-
-				uint8_t hlen = (buf[0] & 0x0f) * 4;
-				uint16_t port_src = 0;
-				memcpy(&port_src, buf + hlen, 2);
-				port_src = ntohs(port_src);
-
-				uint8_t protocol = buf[9];
-				hnode_add(ip_src, protocol, port_src);
-			}
-		}
+		packet_ring_read(&ring, process_packet, NULL);
 	}
 
-	close(s1);
-	close(s2);
+	packet_ring_close(&ring);
+	nft_flush();
 }
 
 static char *filter_start =
@@ -185,23 +289,19 @@ static int print_filter(FILE *fp) {
 	fprintf(fp, "-A OUTPUT -d 127.0.0.0/8 -j ACCEPT\n");
 	fprintf(fp, "\n");
 
-	int i;
-	for (i = 0; i < HMAX; i++) {
-		HNode *ptr = htable[i];
-		while (ptr) {
-			// filter rules are targeting ip address, the port number is disregarded,
-			// so we look only at the first instance of an address
-			if (ptr->ip_instance == 1) {
-				char *protocol = (ptr->protocol == 6) ? "tcp" : "udp";
-				fprintf(fp, "-A INPUT -s %d.%d.%d.%d -p %s  -j ACCEPT\n",
-					PRINT_IP(ptr->ip_src),
-					protocol);
-				fprintf(fp, "-A OUTPUT -d %d.%d.%d.%d -p %s  -j ACCEPT\n",
-					PRINT_IP(ptr->ip_src),
-					protocol);
-				fprintf(fp, "\n");
-			}
-			ptr = ptr->hnext;
+	// filter rules are targeting ip address, the port number is disregarded
+	unsigned i;
+	for (i = 0; i < dset_size; i++) {
+		Dest *ptr = &dset[i];
+		if (ptr->protocol) {
+			char *protocol = (ptr->protocol == 6) ? "tcp" : "udp";
+			fprintf(fp, "-A INPUT -s %d.%d.%d.%d -p %s  -j ACCEPT\n",
+				PRINT_IP(ptr->ip_src),
+				protocol);
+			fprintf(fp, "-A OUTPUT -d %d.%d.%d.%d -p %s  -j ACCEPT\n",
+				PRINT_IP(ptr->ip_src),
+				protocol);
+			fprintf(fp, "\n");
 		}
 	}
 	fprintf(fp, "COMMIT\n");
@@ -224,13 +324,57 @@ static char *flush_rules[] = {
 	NULL
 };
 
+static void flush_iptables(const char *iptables) {
+	int i = 0;
+	while (flush_rules[i]) {
+		char *cmd;
+		if (asprintf(&cmd, "%s %s", iptables, flush_rules[i]) == -1)
+			errExit("asprintf");
+		int rv = system(cmd);
+		(void) rv;
+		free(cmd);
+		i++;
+	}
+}
+
+// the set is already in place, only the chain policies are changed
+static void deploy_nft(const char *iptables) {
+	// the table accepts the set, the iptables rules would still drop the traffic
+	if (iptables)
+		flush_iptables(iptables);
+
+	if (nft_run(
+	    "table ip " NFT_TABLE " {\n"
+	    "	chain input { type filter hook input priority filter; policy drop; }\n"
+	    "	chain forward { type filter hook forward priority filter; policy drop; }\n"
+	    "	chain output { type filter hook output priority filter; policy drop; }\n"
+	    "}\n")) {
+		fprintf(stdout, "Warning: possible netfilter problem!");
+		return;
+	}
+
+	logprintf("\n\n");
+	logprintf(">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>\n");
+	char *cmd;
+	if (asprintf(&cmd, "%s list table ip " NFT_TABLE " | tee -a %s", nft, arg_log) == -1)
+		errExit("asprintf");
+	int rv = system(cmd);
+	(void) rv;
+	free(cmd);
+	logprintf("<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<\n");
+	logprintf("\nnetlock: firewall deployed, more destinations can be added with\n"
+		  "  nft add element ip " NFT_TABLE " " NFT_SET " { <address> . tcp }\n"
+		  "in the network namespace of the sandbox\n");
+}
+
 static void deploy_netfilter(void) {
 	int rv;
 	char *cmd;
-	int i;
 
 	if (have_traffic == 0) {
 		logprintf("Sorry, no network traffic was detected. The firewall was not configured.\n");
+		if (nft && nft_run("delete table ip " NFT_TABLE "\n"))
+			fprintf(stderr, "Warning: cannot remove the nftables table\n");
 		return;
 	}
 	// find iptables command
@@ -244,22 +388,17 @@ static void deploy_netfilter(void) {
 		iptables = "/usr/sbin/iptables";
 		iptables_restore = "/usr/sbin/iptables-restore";
 	}
+	if (nft) {
+		deploy_nft(iptables);
+		return;
+	}
 	if (iptables == NULL || iptables_restore == NULL) {
 		fprintf(stderr, "Error: iptables command not found, netfilter not configured\n");
 		exit(1);
 	}
 
 	// flush all netfilter rules
-	i = 0;
-	while (flush_rules[i]) {
-		char *cmd;
-		if (asprintf(&cmd, "%s %s", iptables, flush_rules[i]) == -1)
-			errExit("asprintf");
-		int rv = system(cmd);
-		(void) rv;
-		free(cmd);
-		i++;
-	}
+	flush_iptables(iptables);
 
 	// create temporary file
 	char fname[] = "/tmp/firejail-XXXXXX";
@@ -18,82 +18,284 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "fnettrace_dns.h"
+#include "../include/packet_ring.h"
 #include <sys/ioctl.h>
 #include <time.h>
 #include <linux/filter.h>
 #include <linux/if_ether.h>
 #include <sys/prctl.h>
 #include <signal.h>
-#define MAX_BUF_SIZE (64 * 1024)
+
+#include <errno.h>
+
+// The queries are matched with the answers by DNS ID, client address and
+// port, and server address. A query without an answer after DNS_TIMEOUT
+// seconds is a timeout. The answered queries are kept until the timeout
+// as well, the same packet is captured more than once on the loopback
+// interface and on the host bridges.
+#define DNS_TIMEOUT 5			// seconds
+#define QUERY_HASH 1024
+#define QUERY_MAX 4096			// pending queries, the new queries are not tracked above it
+#define HIST_CNT 11
+
+typedef struct dns_query_t {
+	struct dns_query_t *next;
+	uint32_t client;
+	uint32_t server;
+	uint16_t port;			// client port
+	uint16_t id;
+	uint16_t type;
+	int answered;
+	struct timespec ts;
+	char name[256];
+} DnsQuery;
+
+static DnsQuery *query_hash[QUERY_HASH];
+static int query_cnt = 0;
+
+static struct {
+	unsigned long long queries;
+	unsigned long long answers;
+	unsigned long long nxdomain;
+	unsigned long long timeouts;
+	unsigned long long hist[HIST_CNT];
+} stats;
+
+// latency histogram, upper limits in microseconds; the answers under 1 ms
+// come from a cache on the local machine or on the local network
+static const unsigned hist_limit[HIST_CNT - 1] = {
+	1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+static const char *const hist_label[HIST_CNT] = {
+	"< 1 ms", "1-2 ms", "2-5 ms", "5-10 ms", "10-20 ms", "20-50 ms",
+	"50-100 ms", "100-200 ms", "200-500 ms", "0.5-1 s", "> 1 s"
+};
 
 static int arg_nolocal = 0;
 static char last[512] = {'\0'};
+static volatile sig_atomic_t trace_exit = 0;
 
-// pkt - start of DNS layer
-void print_dns(uint32_t ip_src, unsigned char *pkt) {
-	assert(pkt);
+static void trace_signal(int sig) {
+	(void) sig;
+	trace_exit = 1;
+}
 
-	char ip[30];
-	sprintf(ip, "%d.%d.%d.%d", PRINT_IP(ip_src));
-	time_t seconds = time(NULL);
-	struct tm *t = localtime(&seconds);
+static void print_time(const struct timespec *ts) {
+	struct tm *t = localtime(&ts->tv_sec);
+	printf("%02d:%02d:%02d", t->tm_hour, t->tm_min, t->tm_sec);
+}
 
-	int nxdomain = ((*(pkt + 3) & 0x03) == 0x03)? 1: 0;
+// extract the question; pkt - start of DNS layer, returns -1 if the packet is invalid
+static int dns_question(const unsigned char *pkt, unsigned len, char *name, uint16_t *type) {
+	assert(pkt);
+	assert(name);
+	assert(type);
 
 	// expecting a single question count
-	if (pkt[4] != 0 || pkt[5] != 1)
-		goto errout;
+	if (len < 12 || pkt[4] != 0 || pkt[5] != 1)
+		return -1;
 
-	// check cname
-	unsigned char *ptr = pkt + 12;
-	int len = 0;
-	while (*ptr != 0 && len < 255) {	// 255 is the maximum length of a domain name including multiple '.'
+	const unsigned char *ptr = pkt + 12;
+	const unsigned char *end = pkt + len;
+	int namelen = 0;
+	while (ptr < end && *ptr != 0) {
 		if (*ptr > 63)	// the name left of a '.' is 63 length maximum
-			goto errout;
-
+			return -1;
 		int delta = *ptr + 1;
-		*ptr = '.';
-		len += delta;;
+		if (namelen + delta > 255 || ptr + delta >= end) // 255 is the maximum length of a domain name including multiple '.'
+			return -1;
+		if (namelen)
+			name[namelen - 1] = '.';
+		memcpy(name + namelen, ptr + 1, *ptr);
+		namelen += delta;
+		name[namelen - 1] = '\0';
 		ptr += delta;
 	}
-	if (*ptr  != 0)
-		goto errout;
+	if (ptr + 3 >= end)
+		return -1;
+	if (namelen == 0)
+		strcpy(name, ".");
 
 	ptr++;
+	memcpy(type, ptr, 2);
+	*type = ntohs(*type);
+	return 0;
+}
+
+static inline unsigned query_bucket(uint32_t client, uint16_t port, uint16_t id) {
+	return (client ^ (client >> 16) ^ port ^ (id * 2654435761U)) % QUERY_HASH;
+}
+
+static DnsQuery *query_find(uint32_t client, uint16_t port, uint32_t server, uint16_t id) {
+	DnsQuery *q = query_hash[query_bucket(client, port, id)];
+	while (q) {
+		if (q->client == client && q->port == port && q->server == server && q->id == id)
+			return q;
+		q = q->next;
+	}
+	return NULL;
+}
+
+static void dns_query(uint32_t client, uint16_t port, uint32_t server,
+		      const unsigned char *pkt, unsigned len, const struct timespec *ts) {
+	uint16_t id;
+	memcpy(&id, pkt, 2);
+	DnsQuery *q = query_find(client, port, server, id);
+	// the same query seen on another interface, or sent again by the client
+	if (q && !q->answered)
+		return;
+
+	char name[256];
 	uint16_t type;
-	memcpy(&type, ptr, 2);
-	type = ntohs(type);
+	if (dns_question(pkt, len, name, &type))
+		return;
+
+	if (!q) {
+		if (query_cnt >= QUERY_MAX)
+			return;
+		q = malloc(sizeof(DnsQuery));
+		if (!q)
+			errExit("malloc");
+		q->client = client;
+		q->port = port;
+		q->server = server;
+		q->id = id;
+		unsigned h = query_bucket(client, port, id);
+		q->next = query_hash[h];
+		query_hash[h] = q;
+		query_cnt++;
+	}
+	q->type = type;
+	q->answered = 0;
+	q->ts = *ts;
+	strcpy(q->name, name);
+	stats.queries++;
+}
+
+// pkt - start of DNS layer
+static void dns_answer(uint32_t client, uint16_t port, uint32_t server,
+		       const unsigned char *pkt, unsigned len, const struct timespec *ts) {
+	char ip[30];
+	sprintf(ip, "%d.%d.%d.%d", PRINT_IP(server));
+	int nxdomain = ((pkt[3] & 0x0f) == 0x03)? 1: 0;
+
+	uint16_t id;
+	memcpy(&id, pkt, 2);
+	DnsQuery *q = query_find(client, port, server, id);
+	if (q && q->answered) // duplicate
+		return;
+
+	if (q) {
+		long long usec = (long long) (ts->tv_sec - q->ts.tv_sec) * 1000000 + (ts->tv_nsec - q->ts.tv_nsec) / 1000;
+		if (usec < 0)
+			usec = 0;
+		int i;
+		for (i = 0; i < HIST_CNT - 1; i++) {
+			if (usec < hist_limit[i])
+				break;
+		}
+		stats.hist[i]++;
+		stats.answers++;
+		if (nxdomain)
+			stats.nxdomain++;
+		q->answered = 1;
 
-	// filter output
+		print_time(ts);
+		printf("  %-15s  DNS %s (type %u)%s %.1f ms\n", ip, q->name, q->type,
+		       (nxdomain)? " NXDOMAIN": "", (double) usec / 1000);
+		fflush(0);
+		return;
+	}
+
+	// the query was sent before the trace started, filter output
+	char name[256];
+	uint16_t type;
+	struct tm *t = localtime(&ts->tv_sec);
+	if (dns_question(pkt, len, name, &type)) {
+		printf("%02d:%02d:%02d  %15s  Error: invalid DNS packet\n", t->tm_hour, t->tm_min, t->tm_sec, ip);
+		fflush(0);
+		return;
+	}
 	char tmp[sizeof(last)];
 	snprintf(tmp, sizeof(last), "%02d:%02d:%02d  %-15s  DNS %s (type %u)%s",
-		t->tm_hour, t->tm_min, t->tm_sec, ip, pkt + 12 + 1,
+		t->tm_hour, t->tm_min, t->tm_sec, ip, name,
 		type, (nxdomain)? " NXDOMAIN": "");
 	if (strcmp(tmp, last)) {
 		printf("%s\n", tmp);
 		fflush(0);
 		strcpy(last, tmp);
 	}
+}
+
+// remove the queries older than DNS_TIMEOUT, the ones without an answer are timeouts
+static void query_expire(const struct timespec *now) {
+	int i;
+	for (i = 0; i < QUERY_HASH; i++) {
+		DnsQuery **pq = &query_hash[i];
+		while (*pq) {
+			DnsQuery *q = *pq;
+			if (now->tv_sec - q->ts.tv_sec < DNS_TIMEOUT) {
+				pq = &q->next;
+				continue;
+			}
+			if (!q->answered) {
+				char ip[30];
+				sprintf(ip, "%d.%d.%d.%d", PRINT_IP(q->server));
+				print_time(&q->ts);
+				printf("  %-15s  DNS %s (type %u) timeout\n", ip, q->name, q->type);
+				fflush(0);
+				stats.timeouts++;
+			}
+			*pq = q->next;
+			free(q);
+			query_cnt--;
+		}
+	}
+}
 
-	return;
+static void print_summary(void) {
+	printf("\nDNS summary: %llu queries, %llu answers", stats.queries, stats.answers);
+	if (stats.answers)
+		printf(", %llu NXDOMAIN (%.1f%%)", stats.nxdomain, 100.0 * stats.nxdomain / stats.answers);
+	if (stats.queries)
+		printf(", %llu timeouts (%.1f%%)", stats.timeouts, 100.0 * stats.timeouts / stats.queries);
+	printf("\n");
+	if (stats.answers == 0)
+		return;
 
-errout:
-	printf("%02d:%02d:%02d  %15s  Error: invalid DNS packet\n", t->tm_hour, t->tm_min, t->tm_sec, ip);
+	unsigned long long max = 0;
+	int i;
+	for (i = 0; i < HIST_CNT; i++) {
+		if (stats.hist[i] > max)
+			max = stats.hist[i];
+	}
+	for (i = 0; i < HIST_CNT; i++) {
+		char bar[41];
+		int n = (int) (stats.hist[i] * 40 / max);
+		memset(bar, '#', n);
+		bar[n] = '\0';
+		printf("  %10s %8llu %5.1f%%", hist_label[i], stats.hist[i], 100.0 * stats.hist[i] / stats.answers);
+		if (n)
+			printf("  %s%s", bar, (i == 0)? " (cached)": "");
+		printf("\n");
+	}
 	fflush(0);
 }
 
 // https://www.kernel.org/doc/html/latest/networking/filter.html
 static void custom_bpf(int sock) {
 	struct sock_filter code[] = {
-		//  sudo tcpdump ip and udp and src port 53 -dd
+		//  sudo tcpdump ip and udp and port 53 -dd
 		{ 0x28, 0, 0, 0x0000000c },
-		{ 0x15, 0, 8, 0x00000800 },
+		{ 0x15, 0, 10, 0x00000800 },
 		{ 0x30, 0, 0, 0x00000017 },
-		{ 0x15, 0, 6, 0x00000011 },
+		{ 0x15, 0, 8, 0x00000011 },
 		{ 0x28, 0, 0, 0x00000014 },
-		{ 0x45, 4, 0, 0x00001fff },
+		{ 0x45, 6, 0, 0x00001fff },
 		{ 0xb1, 0, 0, 0x0000000e },
 		{ 0x48, 0, 0, 0x0000000e },
+		{ 0x15, 2, 0, 0x00000035 },
+		{ 0x48, 0, 0, 0x00000010 },
 		{ 0x15, 0, 1, 0x00000035 },
 		{ 0x6, 0, 0, 0x00040000 },
 		{ 0x6, 0, 0, 0x00000000 },
@@ -123,58 +325,102 @@ static void print_date(void) {
 	fflush(0);
 }
 
+// buf - start of the Ethernet frame
+static void process_packet(unsigned char *buf, unsigned bytes, unsigned char pkttype, void *arg) {
+	(void) pkttype;
+	PacketRing *ring = arg;
+
+	if (bytes >= (14 + 20 + 8 + 12)) { // size of  MAC + IP + UDP + DNS headers
+		uint8_t ip_hlen = (buf[14] & 0x0f) * 4;
+		if (bytes < 14U + ip_hlen + 8 + 12)
+			return;
+		uint16_t port_src;
+		memcpy(&port_src, buf + 14 + ip_hlen, 2);
+		port_src = ntohs(port_src);
+		uint16_t port_dest;
+		memcpy(&port_dest, buf + 14 + ip_hlen + 2, 2);
+		port_dest = ntohs(port_dest);
+		uint32_t ip_src;
+		memcpy(&ip_src, buf + 14 + 12, 4);
+		ip_src = ntohl(ip_src);
+		uint32_t ip_dest;
+		memcpy(&ip_dest, buf + 14 + 16, 4);
+		ip_dest = ntohl(ip_dest);
+
+		unsigned char *dns = buf + 14 + ip_hlen + 8; // IP and UDP header len
+		unsigned len = bytes - (14 + ip_hlen + 8);
+		int answer = dns[2] & 0x80;	// QR bit
+		uint32_t server = (answer)? ip_src: ip_dest;
+		if (arg_nolocal) {
+			if ((server & 0xff000000) == 0x7f000000 ||	// 127.0.0.0/8
+			    (server & 0xff000000) == 0x0a000000 ||	// 10.0.0.0/8
+			    (server & 0xffff0000) == 0xc0a80000 ||	// 192.168.0.0/16
+			    (server & 0xfff00000) == 0xac100000)	// 172.16.0.0/12
+				return;
+		}
+
+		if (answer && port_src == 53)
+			dns_answer(ip_dest, port_dest, ip_src, dns, len, &ring->ts);
+		else if (!answer && port_dest == 53)
+			dns_query(ip_src, port_src, ip_dest, dns, len, &ring->ts);
+	}
+}
+
+// packets dropped by the kernel when the ring is full
+static void print_drops(PacketRing *ring) {
+	unsigned long long drops = packet_ring_stats(ring);
+	if (drops) {
+		printf("%llu packets dropped, %llu total\n", drops, ring->drops);
+		fflush(0);
+	}
+}
+
 static void run_trace(void) {
 	// grab all Ethernet packets and use a custom BPF filter to get only UDP from source port 53
-	int s = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-	if (s < 0)
-		errExit("socket");
-	custom_bpf(s);
+	PacketRing ring;
+	packet_ring_open(&ring, SOCK_RAW);
+	custom_bpf(ring.sock);
+	packet_ring_bind(&ring, ETH_P_ALL);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = trace_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
 
 	struct timeval tv;
-	tv.tv_sec = 10;
+	tv.tv_sec = 1;
 	tv.tv_usec = 0;
-	unsigned char buf[MAX_BUF_SIZE];
-	while (1) {
+	time_t last_expire = 0;
+	while (!trace_exit) {
 		fd_set rfds;
 		FD_ZERO(&rfds);
-		FD_SET(s, &rfds);
-		int rv = select(s + 1, &rfds, NULL, NULL, &tv);
-		if (rv < 0)
+		FD_SET(ring.sock, &rfds);
+		int rv = select(ring.sock + 1, &rfds, NULL, NULL, &tv);
+		if (rv < 0) {
+			if (errno == EINTR)
+				continue;
 			errExit("select");
+		}
 		else if (rv == 0) {
 			print_date();
-			tv.tv_sec = 10;
+			print_drops(&ring);
+			tv.tv_sec = 1;
 			tv.tv_usec = 0;
-			continue;
 		}
+		else
+			packet_ring_read(&ring, process_packet, &ring);
 
-		unsigned bytes = recvfrom(s, buf, MAX_BUF_SIZE, 0, NULL, NULL);
-
-		if (bytes >= (14 + 20 + 8)) { // size of  MAC + IP + UDP headers
-			uint8_t ip_hlen = (buf[14] & 0x0f) * 4;
-			uint16_t port_src;
-			memcpy(&port_src, buf + 14 + ip_hlen, 2);
-			port_src = ntohs(port_src);
-			uint8_t protocol = buf[14 + 9];
-			uint32_t ip_src;
-			memcpy(&ip_src, buf + 14 + 12, 4);
-			ip_src = ntohl(ip_src);
-
-			if (arg_nolocal) {
-				if ((ip_src & 0xff000000) == 0x7f000000 ||	// 127.0.0.0/8
-				    (ip_src & 0xff000000) == 0x0a000000 ||	// 10.0.0.0/8
-				    (ip_src & 0xffff0000) == 0xc0a80000 ||	// 192.168.0.0/16
-				    (ip_src & 0xfff00000) == 0xac100000)	// 172.16.0.0/12
-					continue;
-			}
-
-			// if DNS packet, extract the query
-			if (port_src == 53 && protocol == 0x11) // UDP protocol
-				print_dns(ip_src, buf + 14 + ip_hlen + 8); // IP and UDP header len
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (now.tv_sec != last_expire) {
+			query_expire(&now);
+			last_expire = now.tv_sec;
 		}
 	}
 
-	close(s);
+	print_summary();
+	packet_ring_close(&ring);
 }
 static const char *const usage_str =
 	"Usage: fnettrace-dns [OPTIONS]\n"
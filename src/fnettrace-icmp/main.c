@@ -18,13 +18,13 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "fnettrace_icmp.h"
+#include "../include/packet_ring.h"
 #include <sys/ioctl.h>
 #include <time.h>
 #include <linux/filter.h>
 #include <linux/if_ether.h>
 #include <sys/prctl.h>
 #include <signal.h>
-#define MAX_BUF_SIZE (64 * 1024)
 
 char *type_description[19] = {
 	"Echo reply",
@@ -155,50 +155,67 @@ static void print_date(void) {
 	fflush(0);
 }
 
+// packets dropped by the kernel when the ring is full
+static void print_drops(PacketRing *ring) {
+	unsigned long long drops = packet_ring_stats(ring);
+	if (drops) {
+		printf("%llu packets dropped, %llu total\n", drops, ring->drops);
+		fflush(0);
+	}
+}
+
+// buf - start of the Ethernet frame
+static void process_packet(unsigned char *buf, unsigned bytes, unsigned char pkttype, void *arg) {
+	(void) pkttype;
+	(void) arg;
+
+	if (bytes >= (14 + 20 + 2)) { // size of  MAC + IP + ICMP code and type fields
+		uint8_t ip_hlen = (buf[14] & 0x0f) * 4;
+		if (bytes < 14U + ip_hlen + 2)
+			return;
+		uint8_t type = *(buf + 14 +ip_hlen);
+		uint8_t code = *(buf + 14 + ip_hlen + 1);
+
+		uint32_t ip_dest;
+		memcpy(&ip_dest, buf + 14 + 16, 4);
+		ip_dest = ntohl(ip_dest);
+		uint32_t ip_src;
+		memcpy(&ip_src, buf + 14 + 12, 4);
+		ip_src = ntohl(ip_src);
+
+		print_icmp(ip_dest, ip_src, type, code, bytes);
+	}
+}
+
 static void run_trace(void) {
-	// grab all Ethernet packets and use a custom BPF filter to get TLS/SNI packets
-	int s = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-	if (s < 0)
-		errExit("socket");
-	custom_bpf(s);
+	// grab all Ethernet packets and use a custom BPF filter to get ICMP packets
+	PacketRing ring;
+	packet_ring_open(&ring, SOCK_RAW);
+	custom_bpf(ring.sock);
+	packet_ring_bind(&ring, ETH_P_ALL);
 
 	struct timeval tv;
 	tv.tv_sec = 10;
 	tv.tv_usec = 0;
-	unsigned char buf[MAX_BUF_SIZE];
 	while (1) {
 		fd_set rfds;
 		FD_ZERO(&rfds);
-		FD_SET(s, &rfds);
-		int rv = select(s + 1, &rfds, NULL, NULL, &tv);
+		FD_SET(ring.sock, &rfds);
+		int rv = select(ring.sock + 1, &rfds, NULL, NULL, &tv);
 		if (rv < 0)
 			errExit("select");
 		else if (rv == 0) {
 			print_date();
+			print_drops(&ring);
 			tv.tv_sec = 10;
 			tv.tv_usec = 0;
 			continue;
 		}
 
-		unsigned bytes = recvfrom(s, buf, MAX_BUF_SIZE, 0, NULL, NULL);
-
-		if (bytes >= (14 + 20 + 2)) { // size of  MAC + IP + ICMP code and type fields
-			uint8_t ip_hlen = (buf[14] & 0x0f) * 4;
-			uint8_t type = *(buf + 14 +ip_hlen);
-			uint8_t code = *(buf + 14 + ip_hlen + 1);
-
-			uint32_t ip_dest;
-			memcpy(&ip_dest, buf + 14 + 16, 4);
-			ip_dest = ntohl(ip_dest);
-			uint32_t ip_src;
-			memcpy(&ip_src, buf + 14 + 12, 4);
-			ip_src = ntohl(ip_src);
-
-			print_icmp(ip_dest, ip_src, type, code, bytes);
-		}
+		packet_ring_read(&ring, process_packet, NULL);
 	}
 
-	close(s);
+	packet_ring_close(&ring);
 }
 
 static const char *const usage_str =
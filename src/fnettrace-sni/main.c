@@ -18,18 +18,19 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 #include "fnettrace_sni.h"
+#include "../include/packet_ring.h"
 #include <sys/ioctl.h>
 #include <time.h>
 #include <linux/filter.h>
 #include <linux/if_ether.h>
 #include <sys/prctl.h>
 #include <signal.h>
-#define MAX_BUF_SIZE (64 * 1024)
 
 static char last[512] = {'\0'};
 
-// pkt - start of TLS layer
-static void print_tls(uint32_t ip_dest, unsigned char *pkt, unsigned len) {
+// pkt - start of TLS layer; port 853 is DNS over TLS, the queries are
+// encrypted, only the resolver name is visible
+static void print_tls(uint32_t ip_dest, uint16_t port_dest, unsigned char *pkt, unsigned len) {
 	assert(pkt);
 
 	// expecting a handshake packet and client hello
@@ -73,7 +74,8 @@ static void print_tls(uint32_t ip_dest, unsigned char *pkt, unsigned len) {
 	if (name) {
 		// filter output
 		char tmp[sizeof(last)];
-		snprintf(tmp, sizeof(last), "%02d:%02d:%02d  %-15s  SNI %s", t->tm_hour, t->tm_min, t->tm_sec, ip, name);
+		snprintf(tmp, sizeof(last), "%02d:%02d:%02d  %-15s  SNI %s%s", t->tm_hour, t->tm_min, t->tm_sec, ip, name,
+			(port_dest == 853)? " (DoT)": "");
 		if (strcmp(tmp, last)) {
 			printf("%s\n", tmp);
 			fflush(0);
@@ -85,7 +87,8 @@ static void print_tls(uint32_t ip_dest, unsigned char *pkt, unsigned len) {
 	return;
 
 nosni:
-	printf("%02d:%02d:%02d  %-15s  no SNI\n", t->tm_hour, t->tm_min, t->tm_sec, ip);
+	printf("%02d:%02d:%02d  %-15s  no SNI%s\n", t->tm_hour, t->tm_min, t->tm_sec, ip,
+		(port_dest == 853)? " (DoT)": "");
 	return;
 }
 
@@ -153,49 +156,68 @@ static void print_date(void) {
 	fflush(0);
 }
 
+// packets dropped by the kernel when the ring is full
+static void print_drops(PacketRing *ring) {
+	unsigned long long drops = packet_ring_stats(ring);
+	if (drops) {
+		printf("%llu packets dropped, %llu total\n", drops, ring->drops);
+		fflush(0);
+	}
+}
+
+// buf - start of the Ethernet frame
+static void process_packet(unsigned char *buf, unsigned bytes, unsigned char pkttype, void *arg) {
+	(void) pkttype;
+	(void) arg;
+
+	if (bytes >= (14 + 20 + 20)) { // size of  MAC + IP + TCP headers
+		uint8_t ip_hlen = (buf[14] & 0x0f) * 4;
+		if (bytes < 14U + ip_hlen + 20)
+			return;
+		uint16_t port_dest;
+		memcpy(&port_dest, buf + 14 + ip_hlen + 2, 2);
+		port_dest = ntohs(port_dest);
+		uint32_t ip_dest;
+		memcpy(&ip_dest, buf + 14 + 16, 4);
+		ip_dest = ntohl(ip_dest);
+		uint8_t tcp_hlen = (buf[14 + ip_hlen + 12] & 0xf0) >> 2;
+
+		// extract SNI; the TLS header and the search window need at least 20 bytes
+		unsigned hlen = 14 + ip_hlen + tcp_hlen;
+		if (bytes > hlen + 20)
+			print_tls(ip_dest, port_dest, buf + hlen, bytes - hlen); // IP and TCP header len
+	}
+}
+
 static void run_trace(void) {
 	// grab all Ethernet packets and use a custom BPF filter to get TLS/SNI packets
-	int s = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-	if (s < 0)
-		errExit("socket");
-	custom_bpf(s);
+	PacketRing ring;
+	packet_ring_open(&ring, SOCK_RAW);
+	custom_bpf(ring.sock);
+	packet_ring_bind(&ring, ETH_P_ALL);
 
 	struct timeval tv;
 	tv.tv_sec = 10;
 	tv.tv_usec = 0;
-	unsigned char buf[MAX_BUF_SIZE];
 	while (1) {
 		fd_set rfds;
 		FD_ZERO(&rfds);
-		FD_SET(s, &rfds);
-		int rv = select(s + 1, &rfds, NULL, NULL, &tv);
+		FD_SET(ring.sock, &rfds);
+		int rv = select(ring.sock + 1, &rfds, NULL, NULL, &tv);
 		if (rv < 0)
 			errExit("select");
 		else if (rv == 0) {
 			print_date();
+			print_drops(&ring);
 			tv.tv_sec = 10;
 			tv.tv_usec = 0;
 			continue;
 		}
 
-		unsigned bytes = recvfrom(s, buf, MAX_BUF_SIZE, 0, NULL, NULL);
-
-		if (bytes >= (14 + 20 + 20)) { // size of  MAC + IP + TCP headers
-			uint8_t ip_hlen = (buf[14] & 0x0f) * 4;
-			uint16_t port_dest;
-			memcpy(&port_dest, buf + 14 + ip_hlen + 2, 2);
-			port_dest = ntohs(port_dest);
-			uint32_t ip_dest;
-			memcpy(&ip_dest, buf + 14 + 16, 4);
-			ip_dest = ntohl(ip_dest);
-			uint8_t tcp_hlen = (buf[14 + ip_hlen + 12] & 0xf0) >> 2;
-
-			// extract SNI
-			print_tls(ip_dest, buf + 14 + ip_hlen + tcp_hlen, bytes - 14 - ip_hlen - tcp_hlen); // IP and TCP header len
-		}
+		packet_ring_read(&ring, process_packet, NULL);
 	}
 
-	close(s);
+	packet_ring_close(&ring);
 }
 
 static const char *const usage_str =
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fnettrace.h"
+
+// DNS and TLS/SNI events, extracted from the packets captured by
+// run_trace(); the same parsing as in fnettrace-dns and fnettrace-sni,
+// without running the two programs on their own capture sockets
+
+static void event_add(uint32_t ip, const uint8_t *ip6, const char *fmt, ...) {
+	time_t seconds = time(NULL);
+	struct tm *t = localtime(&seconds);
+	char ipstr[INET6_ADDRSTRLEN];
+	addr_str(ipstr, ip, ip6);
+
+	va_list args;
+	va_start(args, fmt);
+	char *data;
+	if (vasprintf(&data, fmt, args) == -1)
+		errExit("vasprintf");
+	va_end(args);
+
+	char *record;
+	if (asprintf(&record, "%02d:%02d:%02d  %-15s  %s", t->tm_hour, t->tm_min, t->tm_sec, ipstr, data) == -1)
+		errExit("asprintf");
+	ev_add(record);
+	free(record);
+	free(data);
+}
+
+// pkt - start of DNS layer
+static void dns_stage(uint32_t ip_src, const uint8_t *ip6_src, unsigned char *pkt, unsigned len) {
+	if (len < 12 + 1 + 4) // header, empty name, type and class
+		return;
+
+	int nxdomain = ((*(pkt + 3) & 0x03) == 0x03)? 1: 0;
+
+	// expecting a single question count
+	if (pkt[4] != 0 || pkt[5] != 1)
+		goto errout;
+
+	// check cname
+	unsigned char *ptr = pkt + 12;
+	unsigned char *end = pkt + len - 4;
+	int namelen = 0;
+	while (ptr < end && *ptr != 0 && namelen < 255) {	// 255 is the maximum length of a domain name including multiple '.'
+		if (*ptr > 63)	// the name left of a '.' is 63 length maximum
+			goto errout;
+
+		int delta = *ptr + 1;
+		*ptr = '.';
+		namelen += delta;
+		ptr += delta;
+	}
+	if (ptr >= end || *ptr != 0)
+		goto errout;
+
+	ptr++;
+	uint16_t type;
+	memcpy(&type, ptr, 2);
+	type = ntohs(type);
+
+	event_add(ip_src, ip6_src, "DNS %s (type %u)%s", (char *) pkt + 12 + 1, type, (nxdomain)? " NXDOMAIN": "");
+	flow_label(ip_src, ip6_src, 17, 53, (char *) pkt + 12 + 1);
+	return;
+
+errout:
+	event_add(ip_src, ip6_src, "Error: invalid DNS packet");
+}
+
+// pkt - start of TLS layer
+static void sni_stage(uint32_t ip_dest, const uint8_t *ip6_dest, uint16_t port_dest, unsigned char *pkt, unsigned len) {
+	// expecting a handshake packet and client hello
+	if (len <= 20 || pkt[0] != 0x16 || pkt[5] != 0x01)
+		return;
+
+	// look for server name indication
+	unsigned char *ptr = pkt;
+	unsigned int i = 0;
+	char *name = NULL;
+	while (i < (len - 20)) {
+		// 3 zeros and 3 matching length fields
+		if (*ptr == 0 && *(ptr + 1) == 0 && (*(ptr + 2) == 0 || *(ptr + 2) == 1) && *(ptr + 6) == 0) {
+			uint16_t len1;
+			memcpy(&len1, ptr + 2, 2);
+			len1 = ntohs(len1);
+
+			uint16_t len2;
+			memcpy(&len2, ptr + 4, 2);
+			len2 = ntohs(len2);
+
+			uint16_t len3;
+			memcpy(&len3, ptr + 7, 2);
+			len3 = ntohs(len3);
+
+			if (len1 == (len2 + 2) && len1 == (len3 + 5) && i + 9 + len3 < len) {
+				*(ptr + 9 + len3) = 0;
+				name = (char *) (ptr + 9);
+				break;
+			}
+		}
+		ptr++;
+		i++;
+	}
+
+	if (name) {
+		event_add(ip_dest, ip6_dest, "SNI %s", name);
+		// the rx flow from the server
+		flow_label(ip_dest, ip6_dest, 6, port_dest, name);
+	}
+	else
+		event_add(ip_dest, ip6_dest, "no SNI");
+}
+
+// l4 - start of the transport header of a packet coming in; ip6_src is
+// NULL for IPv4
+void dissect_rx(uint32_t ip_src, const uint8_t *ip6_src, int protocol, unsigned char *l4, unsigned len) {
+	if (protocol != 17 || len < 8) // udp
+		return;
+
+	uint16_t port_src;
+	memcpy(&port_src, l4, 2);
+	port_src = ntohs(port_src);
+	if (port_src != 53)
+		return;
+
+	dns_stage(ip_src, ip6_src, l4 + 8, len - 8);
+}
+
+// l4 - start of the transport header of a packet going out; ip6_dest is
+// NULL for IPv4
+void dissect_tx(uint32_t ip_dest, const uint8_t *ip6_dest, int protocol, unsigned char *l4, unsigned len) {
+	if (protocol != 6 || len < 20) // tcp
+		return;
+
+	// ports: 443 (regular TLS), 853 (DoT)
+	uint16_t port_dest;
+	memcpy(&port_dest, l4 + 2, 2);
+	port_dest = ntohs(port_dest);
+	if (port_dest != 443 && port_dest != 853)
+		return;
+
+	uint8_t tcp_hlen = (l4[12] & 0xf0) >> 2;
+	if (len <= tcp_hlen)
+		return;
+
+	sni_stage(ip_dest, ip6_dest, port_dest, l4 + tcp_hlen, len - tcp_hlen);
+}
@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fnettrace.h"
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+// --ebpf: the capture socket gets an eBPF socket filter instead of the
+// classic BPF filter. The filter adds the bytes and packets of the plain
+// rx TCP and UDP traffic to a hash map keyed by address, port and
+// protocol, and drops these packets before they are copied to the ring.
+// The packets still needed in user space are passed up: TLS handshakes
+// going out, DNS, SSH banners, ICMP, loopback traffic, fragments, IPv6
+// extension headers, and everything once the map is full. The map is
+// read and emptied once per display interval.
+//
+// The program is assembled here, there is no dependency on a BPF compiler.
+
+// hash map key and value, shared with the eBPF program
+typedef struct {
+	uint32_t addr[4];	// host byte order; IPv4 in addr[0]
+	uint16_t port;
+	uint8_t protocol;
+	uint8_t family;	// 4 or 6
+} EbpfKey;
+
+typedef struct {
+	uint64_t bytes;
+	uint64_t pkts;
+} EbpfValue;
+
+#define EBPF_MAP_MAX 65536
+#define EBPF_PROG_MAX 256
+#define EBPF_LOG_SIZE (1024 * 1024)
+
+// stack layout
+#define KEY_OFF (-24)
+#define KEY_PORT (KEY_OFF + 16)
+#define KEY_PROTOCOL (KEY_OFF + 18)
+#define KEY_FAMILY (KEY_OFF + 19)
+#define VALUE_OFF (-40)
+
+static int map_fd = -1;
+static int prog_fd = -1;
+
+//*****************************************************************
+// assembler
+//*****************************************************************
+enum {
+	L_V4 = 0,
+	L_V6,
+	L_V4_L4,
+	L_V6_L4,
+	L_L4,
+	L_COUNT,
+	L_NEW,
+	L_TX,
+	L_TX_TLS,
+	L_PASS,
+	L_DROP,
+	L_MAX
+};
+
+static struct bpf_insn prog[EBPF_PROG_MAX];
+static int prog_len = 0;
+static int label_pos[L_MAX];
+static struct {
+	int insn;
+	int label;
+} fixup[EBPF_PROG_MAX];
+static int fixup_cnt = 0;
+
+static void emit(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm) {
+	assert(prog_len < EBPF_PROG_MAX);
+	struct bpf_insn *insn = &prog[prog_len++];
+	memset(insn, 0, sizeof(*insn));
+	insn->code = code;
+	insn->dst_reg = dst;
+	insn->src_reg = src;
+	insn->off = off;
+	insn->imm = imm;
+}
+
+static void jump_to(int label) {
+	assert(fixup_cnt < EBPF_PROG_MAX);
+	fixup[fixup_cnt].insn = prog_len;
+	fixup[fixup_cnt].label = label;
+	fixup_cnt++;
+}
+
+// conditional jump against an immediate value, BPF_JA for unconditional
+static void jump(uint8_t op, uint8_t reg, int32_t imm, int label) {
+	jump_to(label);
+	emit(BPF_JMP | op | BPF_K, reg, 0, 0, imm);
+}
+
+// conditional jump against a register
+static void jump_reg(uint8_t op, uint8_t dst, uint8_t src, int label) {
+	jump_to(label);
+	emit(BPF_JMP | op | BPF_X, dst, src, 0, 0);
+}
+
+static void label(int label) {
+	label_pos[label] = prog_len;
+}
+
+static void resolve(void) {
+	int i;
+	for (i = 0; i < fixup_cnt; i++)
+		prog[fixup[i].insn].off = label_pos[fixup[i].label] - fixup[i].insn - 1;
+}
+
+#define MOV_REG(dst, src) emit(BPF_ALU64 | BPF_MOV | BPF_X, dst, src, 0, 0)
+#define MOV_IMM(dst, imm) emit(BPF_ALU64 | BPF_MOV | BPF_K, dst, 0, 0, imm)
+#define ALU_IMM(op, dst, imm) emit(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm)
+#define ALU_REG(op, dst, src) emit(BPF_ALU64 | op | BPF_X, dst, src, 0, 0)
+#define LDX(size, dst, src, off) emit(BPF_LDX | size | BPF_MEM, dst, src, off, 0)
+#define STX(size, dst, off, src) emit(BPF_STX | size | BPF_MEM, dst, src, off, 0)
+#define ST(size, dst, off, imm) emit(BPF_ST | size | BPF_MEM, dst, 0, off, imm)
+#define XADD(dst, off, src) emit(BPF_STX | BPF_DW | BPF_XADD, dst, src, off, 0)
+// packet loads in network byte order, the result in r0 is converted to host order;
+// the program exits returning 0 if the packet is too short
+#define LD_ABS(size, off) emit(BPF_LD | size | BPF_ABS, 0, 0, 0, off)
+#define LD_IND(size, src, off) emit(BPF_LD | size | BPF_IND, 0, src, 0, off)
+#define CALL(fn) emit(BPF_JMP | BPF_CALL, 0, 0, 0, fn)
+#define EXIT() emit(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+#define LD_MAP_FD(dst, fd) do { \
+	emit(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd); \
+	emit(0, 0, 0, 0, 0); \
+} while (0)
+
+// r6 - context, r7 - packet length, r8 - transport header offset,
+// r9 - scratch; the packet starts with the network header
+static void build_prog(void) {
+	prog_len = 0;
+	fixup_cnt = 0;
+
+	MOV_REG(BPF_REG_6, BPF_REG_1);
+	LDX(BPF_W, BPF_REG_7, BPF_REG_6, offsetof(struct __sk_buff, len));
+	LDX(BPF_W, BPF_REG_0, BPF_REG_6, offsetof(struct __sk_buff, pkt_type));
+	jump(BPF_JEQ, BPF_REG_0, PACKET_OTHERHOST, L_DROP);
+
+	// the key is initialized in full, padding included
+	ST(BPF_DW, BPF_REG_10, KEY_OFF, 0);
+	ST(BPF_DW, BPF_REG_10, KEY_OFF + 8, 0);
+	ST(BPF_DW, BPF_REG_10, KEY_OFF + 16, 0);
+
+	LDX(BPF_W, BPF_REG_0, BPF_REG_6, offsetof(struct __sk_buff, protocol));
+	jump(BPF_JEQ, BPF_REG_0, htons(ETH_P_IP), L_V4);
+	jump(BPF_JEQ, BPF_REG_0, htons(ETH_P_IPV6), L_V6);
+	jump(BPF_JA, 0, 0, L_DROP);
+
+	// IPv4
+	label(L_V4);
+	LD_ABS(BPF_B, 0);
+	MOV_REG(BPF_REG_8, BPF_REG_0);
+	ALU_IMM(BPF_AND, BPF_REG_8, 0x0f);
+	ALU_IMM(BPF_LSH, BPF_REG_8, 2);
+	LD_ABS(BPF_H, 6);	// fragment offset
+	ALU_IMM(BPF_AND, BPF_REG_0, 0x1fff);
+	jump(BPF_JNE, BPF_REG_0, 0, L_PASS);
+	LD_ABS(BPF_B, 12);	// loopback
+	jump(BPF_JEQ, BPF_REG_0, 127, L_PASS);
+	LD_ABS(BPF_B, 16);
+	jump(BPF_JEQ, BPF_REG_0, 127, L_PASS);
+	LD_ABS(BPF_B, 9);
+	jump(BPF_JEQ, BPF_REG_0, 6, L_V4_L4);
+	jump(BPF_JEQ, BPF_REG_0, 17, L_V4_L4);
+	jump(BPF_JA, 0, 0, L_PASS);
+	label(L_V4_L4);
+	STX(BPF_B, BPF_REG_10, KEY_PROTOCOL, BPF_REG_0);
+	ST(BPF_B, BPF_REG_10, KEY_FAMILY, 4);
+	LD_ABS(BPF_W, 12);
+	STX(BPF_W, BPF_REG_10, KEY_OFF, BPF_REG_0);
+	jump(BPF_JA, 0, 0, L_L4);
+
+	// IPv6, the packets with extension headers are passed up
+	label(L_V6);
+	LD_ABS(BPF_B, 6);
+	jump(BPF_JEQ, BPF_REG_0, 6, L_V6_L4);
+	jump(BPF_JEQ, BPF_REG_0, 17, L_V6_L4);
+	jump(BPF_JA, 0, 0, L_PASS);
+	label(L_V6_L4);
+	STX(BPF_B, BPF_REG_10, KEY_PROTOCOL, BPF_REG_0);
+	ST(BPF_B, BPF_REG_10, KEY_FAMILY, 6);
+	int i;
+	for (i = 0; i < 4; i++) {
+		LD_ABS(BPF_W, 8 + i * 4);
+		STX(BPF_W, BPF_REG_10, KEY_OFF + i * 4, BPF_REG_0);
+	}
+	// loopback ::1, source and destination
+	int addr;
+	for (addr = 8; addr <= 24; addr += 16) {
+		MOV_IMM(BPF_REG_9, 0);
+		for (i = 0; i < 3; i++) {
+			LD_ABS(BPF_W, addr + i * 4);
+			ALU_REG(BPF_OR, BPF_REG_9, BPF_REG_0);
+		}
+		LD_ABS(BPF_W, addr + 12);
+		ALU_IMM(BPF_XOR, BPF_REG_0, 1);
+		ALU_REG(BPF_OR, BPF_REG_9, BPF_REG_0);
+		jump(BPF_JEQ, BPF_REG_9, 0, L_PASS);
+	}
+	MOV_IMM(BPF_REG_8, 40);
+
+	// transport layer
+	label(L_L4);
+	LDX(BPF_W, BPF_REG_0, BPF_REG_6, offsetof(struct __sk_buff, pkt_type));
+	jump(BPF_JEQ, BPF_REG_0, PACKET_OUTGOING, L_TX);
+	LD_IND(BPF_H, BPF_REG_8, 0);	// source port
+	STX(BPF_H, BPF_REG_10, KEY_PORT, BPF_REG_0);
+	jump(BPF_JEQ, BPF_REG_0, 53, L_PASS);
+	LDX(BPF_B, BPF_REG_0, BPF_REG_10, KEY_PROTOCOL);
+	jump(BPF_JNE, BPF_REG_0, 6, L_COUNT);
+	// TCP payload starting with "SSH-"
+	LD_IND(BPF_B, BPF_REG_8, 12);
+	ALU_IMM(BPF_RSH, BPF_REG_0, 4);
+	ALU_IMM(BPF_LSH, BPF_REG_0, 2);
+	ALU_REG(BPF_ADD, BPF_REG_0, BPF_REG_8);
+	MOV_REG(BPF_REG_9, BPF_REG_0);
+	ALU_IMM(BPF_ADD, BPF_REG_0, 4);
+	jump_reg(BPF_JGT, BPF_REG_0, BPF_REG_7, L_COUNT);
+	LD_IND(BPF_W, BPF_REG_9, 0);
+	jump(BPF_JEQ, BPF_REG_0, 0x5353482d, L_PASS);
+
+	// add the packet to the map
+	label(L_COUNT);
+	LD_MAP_FD(BPF_REG_1, map_fd);
+	MOV_REG(BPF_REG_2, BPF_REG_10);
+	ALU_IMM(BPF_ADD, BPF_REG_2, KEY_OFF);
+	CALL(BPF_FUNC_map_lookup_elem);
+	jump(BPF_JEQ, BPF_REG_0, 0, L_NEW);
+	XADD(BPF_REG_0, offsetof(EbpfValue, bytes), BPF_REG_7);
+	MOV_IMM(BPF_REG_1, 1);
+	XADD(BPF_REG_0, offsetof(EbpfValue, pkts), BPF_REG_1);
+	jump(BPF_JA, 0, 0, L_DROP);
+	label(L_NEW);
+	STX(BPF_DW, BPF_REG_10, VALUE_OFF, BPF_REG_7);
+	ST(BPF_DW, BPF_REG_10, VALUE_OFF + 8, 1);
+	LD_MAP_FD(BPF_REG_1, map_fd);
+	MOV_REG(BPF_REG_2, BPF_REG_10);
+	ALU_IMM(BPF_ADD, BPF_REG_2, KEY_OFF);
+	MOV_REG(BPF_REG_3, BPF_REG_10);
+	ALU_IMM(BPF_ADD, BPF_REG_3, VALUE_OFF);
+	MOV_IMM(BPF_REG_4, BPF_NOEXIST);
+	CALL(BPF_FUNC_map_update_elem);
+	jump(BPF_JEQ, BPF_REG_0, 0, L_DROP);
+	// map full, or the flow was added on another CPU
+	jump(BPF_JA, 0, 0, L_PASS);
+
+	// tx, only TLS handshakes on 443 and 853
+	label(L_TX);
+	LDX(BPF_B, BPF_REG_0, BPF_REG_10, KEY_PROTOCOL);
+	jump(BPF_JNE, BPF_REG_0, 6, L_DROP);
+	LD_IND(BPF_H, BPF_REG_8, 2);	// destination port
+	jump(BPF_JEQ, BPF_REG_0, 443, L_TX_TLS);
+	jump(BPF_JEQ, BPF_REG_0, 853, L_TX_TLS);
+	jump(BPF_JA, 0, 0, L_DROP);
+	label(L_TX_TLS);
+	LD_IND(BPF_B, BPF_REG_8, 12);
+	ALU_IMM(BPF_RSH, BPF_REG_0, 4);
+	ALU_IMM(BPF_LSH, BPF_REG_0, 2);
+	ALU_REG(BPF_ADD, BPF_REG_0, BPF_REG_8);
+	MOV_REG(BPF_REG_9, BPF_REG_0);
+	ALU_IMM(BPF_ADD, BPF_REG_0, 1);
+	jump_reg(BPF_JGT, BPF_REG_0, BPF_REG_7, L_DROP);
+	LD_IND(BPF_B, BPF_REG_9, 0);
+	jump(BPF_JEQ, BPF_REG_0, 0x16, L_PASS); // handshake
+	jump(BPF_JA, 0, 0, L_DROP);
+
+	label(L_PASS);
+	MOV_IMM(BPF_REG_0, 0x40000);
+	EXIT();
+	label(L_DROP);
+	MOV_IMM(BPF_REG_0, 0);
+	EXIT();
+
+	resolve();
+}
+
+static inline int sys_bpf(int cmd, union bpf_attr *attr) {
+	return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+// -1 if eBPF is not available, the caller falls back to the classic filter
+int ebpf_attach(int sock) {
+	// kernels before 5.11 charge the maps to RLIMIT_MEMLOCK
+	struct rlimit rl = { RLIM_INFINITY, RLIM_INFINITY };
+	int rv = setrlimit(RLIMIT_MEMLOCK, &rl);
+	(void) rv;
+
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_HASH;
+	attr.key_size = sizeof(EbpfKey);
+	attr.value_size = sizeof(EbpfValue);
+	attr.max_entries = EBPF_MAP_MAX;
+	map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+	if (map_fd < 0) {
+		fprintf(stderr, "Warning: cannot create eBPF map: %s\n", strerror(errno));
+		return -1;
+	}
+
+	build_prog();
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+	attr.insns = (uint64_t) (unsigned long) prog;
+	attr.insn_cnt = prog_len;
+	attr.license = (uint64_t) (unsigned long) "GPL";
+	prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+	if (prog_fd < 0) {
+		fprintf(stderr, "Warning: cannot load eBPF program: %s\n", strerror(errno));
+		// load it again for the verifier messages, only the last lines are printed
+		char *log = malloc(EBPF_LOG_SIZE);
+		if (log) {
+			*log = '\0';
+			attr.log_buf = (uint64_t) (unsigned long) log;
+			attr.log_size = EBPF_LOG_SIZE;
+			attr.log_level = 1;
+			int fd = sys_bpf(BPF_PROG_LOAD, &attr);
+			if (fd >= 0)
+				close(fd);
+			size_t len = strlen(log);
+			fprintf(stderr, "%s\n", (len > 1024) ? log + len - 1024 : log);
+			free(log);
+		}
+		goto errout;
+	}
+
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd)) < 0) {
+		fprintf(stderr, "Warning: cannot attach eBPF program: %s\n", strerror(errno));
+		goto errout;
+	}
+	return 0;
+
+errout:
+	if (prog_fd >= 0)
+		close(prog_fd);
+	close(map_fd);
+	prog_fd = -1;
+	map_fd = -1;
+	return -1;
+}
+
+// empty the map, each flow is handed over to the callback
+void ebpf_read(EbpfHandler handler) {
+	assert(handler);
+	if (map_fd < 0)
+		return;
+
+	// collect the keys first, the iteration restarts when the current key
+	// is deleted
+	static EbpfKey *keys = NULL;
+	if (!keys) {
+		keys = malloc(EBPF_MAP_MAX * sizeof(EbpfKey));
+		if (!keys)
+			errExit("malloc");
+	}
+	int cnt = 0;
+	union bpf_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map_fd;
+	attr.key = 0;	// first key
+	while (cnt < EBPF_MAP_MAX) {
+		attr.next_key = (uint64_t) (unsigned long) &keys[cnt];
+		if (sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr) < 0)
+			break;
+		attr.key = attr.next_key;
+		cnt++;
+	}
+
+	// the packets counted between the lookup and the delete are lost
+	int i;
+	for (i = 0; i < cnt; i++) {
+		EbpfValue value;
+		memset(&attr, 0, sizeof(attr));
+		attr.map_fd = map_fd;
+		attr.key = (uint64_t) (unsigned long) &keys[i];
+		attr.value = (uint64_t) (unsigned long) &value;
+		if (sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr) < 0)
+			continue;
+		attr.value = 0;	// the fields after key must be 0
+		sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+
+		EbpfKey *key = &keys[i];
+		if (key->family == 6) {
+			uint32_t ip6[4];
+			int j;
+			for (j = 0; j < 4; j++)
+				ip6[j] = htonl(key->addr[j]);
+			handler(0, (uint8_t *) ip6, key->protocol, key->port, value.bytes, value.pkts);
+		}
+		else
+			handler(key->addr[0], NULL, key->protocol, key->port, value.bytes, value.pkts);
+	}
+}
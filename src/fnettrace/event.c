@@ -19,87 +19,155 @@
 */
 #include "fnettrace.h"
 
-typedef struct event_t {
-	struct event_t *next;
-	char *record;
+// The events are kept in a ring of preformatted records, the oldest one is
+// dropped when the ring is full. A record repeating the address and data of
+// a record still in the ring (a DNS answer, an SSH connection) is not added
+// again: the record moves to the end of the ring with the new time and a
+// counter, its old slot is left empty. The records are found through a hash
+// table chained on the ring slots.
+//
+// "HH:MM:SS  address  data" - the time is stored separately from the text
+#define EV_TEXT_MAX 320
+#define EV_HASH_SIZE 4096	// power of 2
+
+typedef struct {
+	char time[9];
+	char text[EV_TEXT_MAX];
+	unsigned count;		// 0 for an empty slot
+	uint32_t hash;
+	int hnext;		// next slot in the hash chain, -1 if none
+	unsigned char alert;	// printed in red
 } Event;
 
-static Event *event = NULL;
-static Event *last_event = NULL;
-int ev_cnt = 0;
+int ev_max = EV_RING_DEFAULT;
+int ev_cnt = 0;			// records in the ring
+unsigned long long ev_dropped = 0;	// records dropped from the ring
+static Event *ring = NULL;
+static int ring_first = 0;	// oldest slot
+static int ring_used = 0;	// slots from ring_first, including the empty ones
+static int hash_head[EV_HASH_SIZE];
+
+static void ring_init(void) {
+	ring = calloc(ev_max, sizeof(Event));
+	if (!ring)
+		errExit("calloc");
+	int i;
+	for (i = 0; i < EV_HASH_SIZE; i++)
+		hash_head[i] = -1;
+}
 
 void ev_clear(void) {
 	ev_cnt = 0;
-	Event *ev = event;
-	while (ev) {
-		Event *next = ev->next;
-		free(ev->record);
-		free(ev);
-		ev = next;
+	ev_dropped = 0;
+	ring_first = 0;
+	ring_used = 0;
+	int i;
+	for (i = 0; i < EV_HASH_SIZE; i++)
+		hash_head[i] = -1;
+}
+
+static void hash_unlink(int slot) {
+	int *ptr = &hash_head[ring[slot].hash & (EV_HASH_SIZE - 1)];
+	while (*ptr != -1) {
+		if (*ptr == slot) {
+			*ptr = ring[slot].hnext;
+			return;
+		}
+		ptr = &ring[*ptr].hnext;
 	}
-	event = NULL;
 }
 
-void ev_add(char *record) {
-	assert(record);
+static void add_line(const char *line) {
+	if (!ring)
+		ring_init();
 
-	// braking recursivity
-	if (*record == '\0')
-		return;
+	// split the time
+	char time[9] = "";
+	if (strlen(line) > 10 && line[2] == ':' && line[5] == ':' && line[8] == ' ' && line[9] == ' ') {
+		memcpy(time, line, 8);
+		line += 10;
+	}
+	char text[EV_TEXT_MAX];
+	snprintf(text, sizeof(text), "%s", line);
 
-	char *ptr = strchr(record, '\n');
-	if (ptr)
-		*ptr = '\0';
+	// duplicate
+	uint32_t h = fnv1a32_str(text);
+	unsigned count = 0;
+	int slot = hash_head[h & (EV_HASH_SIZE - 1)];
+	while (slot != -1) {
+		Event *ev = &ring[slot];
+		if (ev->hash == h && strcmp(ev->text, text) == 0) {
+			count = ev->count;
+			hash_unlink(slot);
+			ev->count = 0;
+			ev_cnt--;
+			break;
+		}
+		slot = ev->hnext;
+	}
 
-	// filter out duplicates
-	if (event && strcmp(event->record, record) == 0)
-		return;
+	// free the oldest slot
+	if (ring_used == ev_max) {
+		if (ring[ring_first].count) {
+			hash_unlink(ring_first);
+			ring[ring_first].count = 0;
+			ev_cnt--;
+			ev_dropped++;
+		}
+		ring_first = (ring_first + 1) % ev_max;
+		ring_used--;
+	}
 
-	Event *ev = malloc(sizeof(Event));
-	if (!ev)
-		errExit("malloc");
-	memset(ev, 0, sizeof(Event));
+	slot = (ring_first + ring_used) % ev_max;
+	Event *ev = &ring[slot];
+	memcpy(ev->time, time, sizeof(ev->time));
+	memcpy(ev->text, text, sizeof(ev->text));
+	ev->count = count + 1;
+	ev->hash = h;
+	ev->alert = (strstr(text, "NXDOMAIN") || strstr(text, "SSH connection"));
+	ev->hnext = hash_head[h & (EV_HASH_SIZE - 1)];
+	hash_head[h & (EV_HASH_SIZE - 1)] = slot;
+	ring_used++;
+	ev_cnt++;
+}
 
-	ev->record = strdup(record);
-	if (!ev->record)
-		errExit("strdup");
+// record - one or more lines
+void ev_add(char *record) {
+	assert(record);
 
-	if (event == NULL) {
-		event = ev;
-		last_event = ev;
-	}
-	else {
-		last_event->next = ev;
-		last_event = ev;
+	char *start = record;
+	while (*start) {
+		char *ptr = strchr(start, '\n');
+		if (ptr)
+			*ptr = '\0';
+		if (*start)
+			add_line(start);
+		if (!ptr)
+			break;
+		start = ptr + 1;
 	}
-	ev_cnt++;
-
-	// recursivity
-	if (ptr)
-		ev_add(++ptr);
 }
 
 void ev_print(FILE *fp) {
 	assert(fp);
 
-	Event *ev = event;
-	while (ev) {
+	if (ev_dropped)
+		fprintf(fp, "   (%llu older events dropped)\n", ev_dropped);
+	int i;
+	for (i = 0; i < ring_used; i++) {
+		const Event *ev = &ring[(ring_first + i) % ev_max];
+		if (ev->count == 0)
+			continue;
+		char line[EV_TEXT_MAX + 64];
+		int len = snprintf(line, sizeof(line), "%s%s%s", ev->time, (*ev->time) ? "  " : "", ev->text);
+		if (ev->count > 1)
+			snprintf(line + len, sizeof(line) - len, "  (x%u)", ev->count);
+
 		fprintf(fp, "   ");
-		if (strstr(ev->record, "NXDOMAIN")) {
-			if (fp == stdout)
-				ansi_red(ev->record);
-			else
-				fprintf(fp, "%s", ev->record);
-		}
-		else if (strstr(ev->record, "SSH connection")) {
-			if (fp == stdout)
-				ansi_red(ev->record);
-			else
-				fprintf(fp, "%s", ev->record);
-		}
+		if (ev->alert && fp == stdout)
+			ansi_red(line);
 		else
-			fprintf(fp, "%s", ev->record);
+			fprintf(fp, "%s", line);
 		fprintf(fp, "\n");
-		ev = ev->next;
 	}
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fnettrace.h"
+
+// --export file: JSON lines, rotated as in ftee when the file grows
+// over EXPORT_MAX; the rotation is done only at the end of an interval,
+// the records of an interval are always in the same file
+#define EXPORT_MAX (10 * 1024 * 1024)
+#define EXPORT_FILES 5	// fname, fname.1 ... fname.5
+
+static FILE *export_fp = NULL;
+static const char *export_fname = NULL;
+static long export_cnt = 0;
+
+static void export_rotate(void) {
+	assert(export_fname);
+	int len = strlen(export_fname);
+	char *name1 = malloc(len + 2 + 1);
+	char *name2 = malloc(len + 2 + 1);
+	if (!name1 || !name2)
+		errExit("malloc");
+	strcpy(name1, export_fname);
+	strcpy(name2, export_fname);
+
+	fclose(export_fp);
+	export_fp = NULL;
+
+	// delete fname.5, move files 1 to 4 down one position
+	sprintf(name1 + len, ".%d", EXPORT_FILES);
+	int rv = unlink(name1);
+	(void) rv;
+	int i;
+	for (i = EXPORT_FILES - 1; i > 0; i--) {
+		sprintf(name2 + len, ".%d", i);
+		if (rename(name2, name1) == -1 && errno != ENOENT)
+			perror("rename");
+		strcpy(name1 + len, name2 + len);
+	}
+
+	// move the first file
+	if (rename(export_fname, name1) == -1)
+		perror("rename");
+
+	free(name1);
+	free(name2);
+	export_open(export_fname);
+}
+
+void export_open(const char *fname) {
+	assert(fname);
+	export_fname = fname;
+	export_fp = fopen(fname, "a");
+	if (!export_fp) {
+		fprintf(stderr, "Error: cannot open export file %s\n", fname);
+		exit(1);
+	}
+	int rv = fchmod(fileno(export_fp), 0600);
+	(void) rv;
+
+	struct stat s;
+	export_cnt = (fstat(fileno(export_fp), &s) == 0) ? s.st_size : 0;
+}
+
+void export_printf(const char *fmt, ...) {
+	assert(export_fp);
+	va_list args;
+	va_start(args, fmt);
+	int rv = vfprintf(export_fp, fmt, args);
+	va_end(args);
+	if (rv > 0)
+		export_cnt += rv;
+}
+
+// JSON string, or null
+void export_string(const char *str) {
+	assert(export_fp);
+	char *json = json_string(str);
+	fputs(json, export_fp);
+	export_cnt += strlen(json);
+	free(json);
+}
+
+// end of interval
+void export_flush(void) {
+	assert(export_fp);
+	fflush(export_fp);
+	if (export_cnt >= EXPORT_MAX)
+		export_rotate();
+}
+
+void export_close(void) {
+	if (export_fp) {
+		fclose(export_fp);
+		export_fp = NULL;
+	}
+}
@@ -21,6 +21,7 @@
 #define FNETTRACE_H
 
 #include "../include/common.h"
+#include "../include/packet_ring.h"
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -30,6 +31,8 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <arpa/inet.h>
+#include <errno.h>
 
 
 //#define DEBUG 1
@@ -38,6 +41,8 @@
 #define DISPLAY_INTERVAL 2	// seconds
 #define DISPLAY_TTL 4		// display intervals (4 * 2 seconds)
 #define DISPLAY_BW_UNITS 20	// length of the bandwidth bar
+#define EXPORT_INTERVAL 60	// seconds
+#define EXPORT_INTERVAL_MAX 3600	// seconds
 
 
 static inline void ansi_topleft(void) {
@@ -74,19 +79,28 @@ static inline void ansi_red(const char *str) {
 	fflush(0);
 }
 
-static inline uint8_t hash(uint32_t ip) {
-	uint8_t *ptr = (uint8_t *) &ip;
-	// simple byte xor
-	return *ptr ^ *(ptr + 1) ^ *(ptr + 2) ^ *(ptr + 3);
+// IPv4 address, or IPv6 address if ip6 is not NULL; INET6_ADDRSTRLEN bytes in str
+static inline void addr_str(char *str, uint32_t ip, const uint8_t *ip6) {
+	if (ip6)
+		inet_ntop(AF_INET6, ip6, str, INET6_ADDRSTRLEN);
+	else
+		sprintf(str, "%d.%d.%d.%d", PRINT_IP(ip));
 }
 
 // main.c
 void logprintf(char* fmt, ...);
+void flow_label(uint32_t ip, const uint8_t *ip6, int protocol, uint16_t port, const char *label);
+typedef struct capture_t Capture;
+void capture_open(Capture *cap);
 
 // hostnames.c
 extern int geoip_calls;
 void load_hostnames(const char *fname);
-char* retrieve_hostname(uint32_t ip);
+int retrieve_hostname(uint32_t ip, char **name);
+int retrieve_hostname6(const uint8_t *ip6, char **name);
+void geoip_init(const char *fname);
+void geoip_flush(void);
+void geoip_save(void);
 
 // tail.c
 void tail(const char *logfile);
@@ -96,11 +110,44 @@ void terminal_handler(int s);
 void terminal_set(void);
 void terminal_restore(void);
 
-// runprog.c
-int runprog(const char *program);
+// dissect.c
+void dissect_rx(uint32_t ip_src, const uint8_t *ip6_src, int protocol, unsigned char *l4, unsigned len);
+void dissect_tx(uint32_t ip_dest, const uint8_t *ip6_dest, int protocol, unsigned char *l4, unsigned len);
+
+// ebpf.c
+typedef void (*EbpfHandler)(uint32_t ip, const uint8_t *ip6, int protocol, uint16_t port, uint64_t bytes, uint64_t pkts);
+int ebpf_attach(int sock);
+void ebpf_read(EbpfHandler handler);
+
+// sandbox.c
+struct capture_t {
+	PacketRing ring;
+	pid_t pid;	// the firejail process of the sandbox, 0 for the current network namespace
+	char *name;	// sandbox name, NULL if not set
+	unsigned generation;
+};
+extern Capture **captures;
+extern int captures_cnt;
+Capture *capture_add(int epfd, pid_t pid, char *name);
+void capture_close(int epfd, int index);
+unsigned long long capture_drops(void);
+void capture_clear_drops(void);
+const char *sandbox_name(pid_t pid);
+void sandbox_scan(int epfd);
+
+// export.c
+void export_open(const char *fname);
+void export_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void export_string(const char *str);
+void export_flush(void);
+void export_close(void);
 
 // event.c
+#define EV_RING_DEFAULT 1024
+#define EV_RING_MAX 100000
+extern int ev_max;
 extern int ev_cnt;
+extern unsigned long long ev_dropped;
 void ev_clear(void);
 void ev_add(char *record);
 void ev_print(FILE *fp);
@@ -19,39 +19,170 @@
 */
 #include "fnettrace.h"
 #include "radix.h"
+#include <pthread.h>
+#include <signal.h>
+#include <arpa/inet.h>
 #define MAXBUF 1024
 
+// The addresses not found in the IP map are sent to geoiplookup. The
+// lookups run in a worker thread, the display shows the address without
+// a name until the result is in the cache. The cache keeps the most
+// recently used GEOIP_CACHE_MAX results, including the addresses not
+// found, and it can be stored in a file across runs (--geoip-cache).
+#define GEOIP_QUEUE_MAX 64
+#define GEOIP_CACHE_MAX 4096
+#define GEOIP_HASH_SIZE 1024	// power of 2
+#define GEOIP_EXPIRE (7 * 24 * 3600)	// seconds, cache file entries
+#define GEOIP_SAVE_INTERVAL 60	// seconds
+#define GEOIP_NONE -1
+
 int geoip_calls = 0;
 static int geoip_not_found = 0;
-static char buf[MAXBUF];
+static int geoip6_not_found = 0;
 
-char *retrieve_hostname(uint32_t ip) {
-	if (geoip_not_found)
-		return NULL;
-	if (access("/usr/bin/geoiplookup", X_OK)) {
-		geoip_not_found = 1;
-		return NULL;
+// IPv4 addresses are stored as IPv4-mapped IPv6 addresses
+typedef struct {
+	uint8_t ip[16];
+	int pending;	// the request is in the queue or in progress
+	char *name;	// NULL if not found
+	time_t time;	// time of the lookup
+	int hnext;	// hash chain
+	int prev;	// LRU list, the most recently used first
+	int next;
+} GeoipEntry;
+
+static pthread_mutex_t geoip_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t geoip_cond = PTHREAD_COND_INITIALIZER;
+
+static GeoipEntry cache[GEOIP_CACHE_MAX];
+static int cache_cnt = 0;
+static int cache_hash[GEOIP_HASH_SIZE];
+static int lru_first = GEOIP_NONE;
+static int lru_last = GEOIP_NONE;
+static int cache_dirty = 0;
+static const char *cache_file = NULL;
+
+static uint8_t queue[GEOIP_QUEUE_MAX][16];
+static int queue_first = 0;
+static int queue_cnt = 0;
+
+static const uint8_t v4mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+static inline int is_v4(const uint8_t *ip) {
+	return memcmp(ip, v4mapped, 12) == 0;
+}
+
+static inline unsigned geoip_hash(const uint8_t *ip) {
+	uint32_t h = 0;
+	int i;
+	for (i = 0; i < 16; i += 4) {
+		uint32_t val;
+		memcpy(&val, ip + i, 4);
+		h = (h ^ val) * 0x9e3779b1U;
+	}
+	return h >> 22;
+}
+
+static void lru_unlink(int i) {
+	if (cache[i].prev == GEOIP_NONE)
+		lru_first = cache[i].next;
+	else
+		cache[cache[i].prev].next = cache[i].next;
+	if (cache[i].next == GEOIP_NONE)
+		lru_last = cache[i].prev;
+	else
+		cache[cache[i].next].prev = cache[i].prev;
+}
+
+static void lru_push(int i) {
+	cache[i].prev = GEOIP_NONE;
+	cache[i].next = lru_first;
+	if (lru_first != GEOIP_NONE)
+		cache[lru_first].prev = i;
+	lru_first = i;
+	if (lru_last == GEOIP_NONE)
+		lru_last = i;
+}
+
+// called with geoip_lock held
+static int cache_find(const uint8_t *ip) {
+	int i = cache_hash[geoip_hash(ip)];
+	while (i != GEOIP_NONE && memcmp(cache[i].ip, ip, 16) != 0)
+		i = cache[i].hnext;
+	if (i != GEOIP_NONE && i != lru_first) {
+		lru_unlink(i);
+		lru_push(i);
+	}
+	return i;
+}
+
+// a new entry, replacing the least recently used one if the cache is full;
+// called with geoip_lock held
+static int cache_new(const uint8_t *ip) {
+	int i;
+	if (cache_cnt < GEOIP_CACHE_MAX)
+		i = cache_cnt++;
+	else {
+		i = lru_last;
+		lru_unlink(i);
+		int *ptr = &cache_hash[geoip_hash(cache[i].ip)];
+		while (*ptr != i)
+			ptr = &cache[*ptr].hnext;
+		*ptr = cache[i].hnext;
+		free(cache[i].name);
 	}
-	geoip_calls++;
 
+	memset(&cache[i], 0, sizeof(GeoipEntry));
+	memcpy(cache[i].ip, ip, 16);
+	unsigned h = geoip_hash(ip);
+	cache[i].hnext = cache_hash[h];
+	cache_hash[h] = i;
+	lru_push(i);
+	return i;
+}
+
+// called with geoip_lock held
+static void cache_set(const uint8_t *ip, char *name, time_t t) {
+	int i = cache_find(ip);
+	if (i == GEOIP_NONE)
+		i = cache_new(ip);
+	free(cache[i].name);
+	cache[i].name = name;
+	cache[i].time = t;
+	cache[i].pending = 0;
+	cache_dirty = 1;
+}
+
+static void cache_addr_str(const uint8_t *ip, char *str) {
+	if (is_v4(ip))
+		inet_ntop(AF_INET, ip + 12, str, INET6_ADDRSTRLEN);
+	else
+		inet_ntop(AF_INET6, ip, str, INET6_ADDRSTRLEN);
+}
+
+static char *geoiplookup(const uint8_t *ip) {
 	char *rv = NULL;
+	char addr[INET6_ADDRSTRLEN];
+	cache_addr_str(ip, addr);
+	int v4 = is_v4(ip);
+	const char *edition = (v4) ? "GeoIP Country Edition:" : "GeoIP Country V6 Edition:";
+	int edition_len = strlen(edition);
 	char *cmd;
-	if (asprintf(&cmd, "/usr/bin/geoiplookup %d.%d.%d.%d", PRINT_IP(ip)) == -1)
+	if (asprintf(&cmd, "/usr/bin/geoiplookup%s %s", (v4) ? "" : "6", addr) == -1)
 		errExit("asprintf");
 
 	FILE *fp = popen(cmd, "r");
-	if (!fp) {
-		geoip_not_found = 1;
+	if (!fp)
 		goto out;
-	}
 
+	char buf[MAXBUF];
 	char *ptr;
 	if (fgets(buf, MAXBUF, fp)) {
 		ptr = strchr(buf, '\n');
 		if (ptr)
 			*ptr = '\0';
-		if (strncmp(buf, "GeoIP Country Edition:", 22) == 0) {
-			ptr = buf + 22;
+		if (strncmp(buf, edition, edition_len) == 0) {
+			ptr = buf + edition_len;
 			if (*ptr == ' ' && *(ptr + 3) == ',' && *(ptr + 4) == ' ') {
 				rv = ptr + 5;
 				if (strcmp(rv, "United States") == 0)
@@ -60,14 +191,209 @@ char *retrieve_hostname(uint32_t ip) {
 		}
 	}
 	pclose(fp);
-	if (rv)
+	if (rv) {
 		rv = strdup(rv);
+		if (!rv)
+			errExit("strdup");
+	}
 
 out:
 	free(cmd);
 	return rv;
 }
 
+static void *geoip_worker(void *arg) {
+	(void) arg;
+
+	pthread_mutex_lock(&geoip_lock);
+	while (1) {
+		while (queue_cnt == 0)
+			pthread_cond_wait(&geoip_cond, &geoip_lock);
+		uint8_t ip[16];
+		memcpy(ip, queue[queue_first], 16);
+		queue_first = (queue_first + 1) % GEOIP_QUEUE_MAX;
+		queue_cnt--;
+		geoip_calls++;
+		pthread_mutex_unlock(&geoip_lock);
+
+		char *name = geoiplookup(ip);
+
+		pthread_mutex_lock(&geoip_lock);
+		cache_set(ip, name, time(NULL));
+	}
+
+	return NULL;
+}
+
+static void load_cache(void) {
+	FILE *fp = fopen(cache_file, "r");
+	if (!fp)
+		return;
+
+	time_t now = time(NULL);
+	char buf[MAXBUF];
+	while (fgets(buf, MAXBUF, fp)) {
+		char *ptr = strchr(buf, '\n');
+		if (ptr)
+			*ptr = '\0';
+		if (*buf == '#')
+			continue;
+
+		// line format: address time [name]
+		char addr[INET6_ADDRSTRLEN];
+		long long t;
+		int len = 0;
+		if (sscanf(buf, "%45s %lld%n", addr, &t, &len) != 2)
+			continue;
+		uint8_t ip[16];
+		memcpy(ip, v4mapped, 12);
+		if (inet_pton(AF_INET, addr, ip + 12) != 1 && inet_pton(AF_INET6, addr, ip) != 1)
+			continue;
+		if (t > now || now - t > GEOIP_EXPIRE)
+			continue;
+
+		char *name = NULL;
+		ptr = buf + len;
+		if (*ptr == ' ' && *(ptr + 1) != '\0') {
+			name = strdup(ptr + 1);
+			if (!name)
+				errExit("strdup");
+		}
+		cache_set(ip, name, (time_t) t);
+	}
+	fclose(fp);
+	cache_dirty = 0;
+}
+
+void geoip_save(void) {
+	if (!cache_file)
+		return;
+	pthread_mutex_lock(&geoip_lock);
+	if (!cache_dirty)
+		goto out;
+
+	char *tmp;
+	if (asprintf(&tmp, "%s.tmp", cache_file) == -1)
+		errExit("asprintf");
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	FILE *fp = (fd == -1) ? NULL : fdopen(fd, "w");
+	if (!fp) {
+		if (fd != -1)
+			close(fd);
+		free(tmp);
+		goto out;
+	}
+
+	// the least recently used first, in the order load_cache() needs
+	fprintf(fp, "# fnettrace geoip cache: address time [name]\n");
+	int i;
+	for (i = lru_last; i != GEOIP_NONE; i = cache[i].prev) {
+		if (cache[i].pending)
+			continue;
+		char addr[INET6_ADDRSTRLEN];
+		cache_addr_str(cache[i].ip, addr);
+		fprintf(fp, "%s %lld", addr, (long long) cache[i].time);
+		if (cache[i].name)
+			fprintf(fp, " %s", cache[i].name);
+		fprintf(fp, "\n");
+	}
+	int err = ferror(fp);
+	if (fclose(fp) || err || rename(tmp, cache_file))
+		unlink(tmp);
+	else
+		cache_dirty = 0;
+	free(tmp);
+
+out:
+	pthread_mutex_unlock(&geoip_lock);
+}
+
+// save the cache from time to time, the program is usually stopped with CTRL-C
+void geoip_flush(void) {
+	static time_t last = 0;
+	time_t now = time(NULL);
+	if (now - last < GEOIP_SAVE_INTERVAL)
+		return;
+	last = now;
+	geoip_save();
+}
+
+void geoip_init(const char *fname) {
+	int i;
+	for (i = 0; i < GEOIP_HASH_SIZE; i++)
+		cache_hash[i] = GEOIP_NONE;
+	cache_file = fname;
+	if (cache_file) {
+		load_cache();
+		atexit(geoip_save);
+	}
+
+	geoip_not_found = access("/usr/bin/geoiplookup", X_OK);
+	geoip6_not_found = access("/usr/bin/geoiplookup6", X_OK);
+	if (geoip_not_found && geoip6_not_found)
+		return;
+
+	// the signals are handled in the main thread
+	sigset_t set;
+	sigset_t old;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, geoip_worker, NULL)) {
+		geoip_not_found = 1;
+		geoip6_not_found = 1;
+	}
+	else
+		pthread_detach(thread);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+// 0 and the name (NULL if not found) if the address was resolved, -1 if the
+// lookup is not finished yet
+static int retrieve(const uint8_t *ip, char **name) {
+	assert(name);
+	*name = NULL;
+	int not_found = (is_v4(ip)) ? geoip_not_found : geoip6_not_found;
+
+	int rv = -1;
+	pthread_mutex_lock(&geoip_lock);
+	int i = cache_find(ip);
+	if (i != GEOIP_NONE) {
+		if (!cache[i].pending) {
+			if (cache[i].name) {
+				*name = strdup(cache[i].name);
+				if (!*name)
+					errExit("strdup");
+			}
+			rv = 0;
+		}
+	}
+	else if (not_found)
+		rv = 0;
+	else if (queue_cnt < GEOIP_QUEUE_MAX) {
+		// a full queue is not an error, the address is tried again at the next display
+		i = cache_new(ip);
+		cache[i].pending = 1;
+		memcpy(queue[(queue_first + queue_cnt) % GEOIP_QUEUE_MAX], ip, 16);
+		queue_cnt++;
+		pthread_cond_signal(&geoip_cond);
+	}
+	pthread_mutex_unlock(&geoip_lock);
+	return rv;
+}
+
+int retrieve_hostname(uint32_t ip, char **name) {
+	uint8_t key[16];
+	memcpy(key, v4mapped, 12);
+	uint32_t val = htonl(ip);
+	memcpy(key + 12, &val, 4);
+	return retrieve(key, name);
+}
+
+int retrieve_hostname6(const uint8_t *ip6, char **name) {
+	return retrieve(ip6, name);
+}
+
 void load_hostnames(const char *fname) {
 	assert(fname);
 	FILE *fp = fopen(fname, "r");
@@ -110,6 +436,23 @@ void load_hostnames(const char *fname) {
 		if (*end == '\0')
 			goto errexit;
 
+		// IPv6: 2001:db8::/32
+		if (strchr(start, ':')) {
+			char *ptr = strchr(start, '/');
+			if (!ptr)
+				goto errexit;
+			*ptr++ = '\0';
+			uint8_t ip6[16];
+			char *endlen;
+			long len = strtol(ptr, &endlen, 10);
+			if (inet_pton(AF_INET6, start, ip6) != 1 || *endlen != '\0' || len < 1 || len > 128) {
+				fprintf(stderr, "Error: invalid CIDR address\n");
+				goto errexit;
+			}
+			radix6_add(ip6, len, end);
+			continue;
+		}
+
 		uint32_t ip;
 		uint32_t mask;
 		if (atocidr(start, &ip, &mask)) {
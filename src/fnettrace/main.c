@@ -19,13 +19,27 @@
 */
 #include "fnettrace.h"
 #include "radix.h"
+#include "../include/term_frame.h"
 #include <limits.h>
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
 #include <signal.h>
-#define MAX_BUF_SIZE (64 * 1024)
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <sys/epoll.h>
 
 static char *arg_log = NULL;
+static char *arg_geoip_cache = NULL;
+static char *arg_export = NULL;
+static int arg_interval = 0;
+static int arg_ebpf = 0;
+static int arg_sandboxes = 0;
+static volatile sig_atomic_t export_exit = 0;
+
+static void export_handler(int s) {
+	(void) s;
+	export_exit = 1;
+}
 
 // only 0 or negative values; positive values as defined in RFC
 #define PROTOCOL_ICMP 0
@@ -47,9 +61,13 @@ uint32_t stats_quic = 0;
 uint32_t stats_tor = 0;
 uint32_t stats_http = 0;
 uint32_t stats_ssh = 0;
+static unsigned long long bw = 0; // bandwidth calculations
+// the sandbox of the packet in process_packet(), 0 without --sandboxes
+static pid_t packet_sandbox = 0;
 
 static void clear_stats(void) {
 	stats_pkts = 0;
+	capture_clear_drops();
 	stats_icmp_echo = 0;
 	stats_dns = 0;
 	stats_dns_dot = 0;
@@ -63,31 +81,36 @@ static void clear_stats(void) {
 }
 
 //*****************************************************************
-// traffic trace storage - hash table for fast access + linked list for display purposes
+// traffic trace storage - open addressing flow table for fast access + linked list for display purposes
 //*****************************************************************
 typedef struct hnode_t {
-	struct hnode_t *hnext;	// used for hash table and unused linked list
+	struct hnode_t *hnext;	// used for the unused linked list
 	struct hnode_t *dnext;	// used to display streams on the screen
 	uint32_t ip_src;
+	uint8_t ip6_src[16];
+	uint8_t v6;	// ip6_src is used instead of ip_src
+	pid_t sandbox;	// --sandboxes: the firejail process of the sandbox
 	RNode *rnode;	// radix tree entry
+	char *label;	// SNI or DNS query name, NULL if none
 
 	// stats
-	uint32_t  bytes;	// number of bytes received in the last display interval
+	uint64_t  bytes;	// number of bytes received in the last display interval
 	uint32_t pkts;	// number of packets received in the last display interval
 	uint16_t port_src;
 	int protocol;
-
-	// the firewall is build based on source address, and in the linked list
-	// we could have elements with the same address but different ports
-	uint8_t ip_instance;
 	int ttl;
 } HNode;
 
-// hash table
-#define HMAX 256
-HNode *htable[HMAX] = {NULL};
-// display linked list
-HNode *dlist = NULL;
+// flow table: linear probing on (address, port, protocol), the display
+// merges rx traffic on these three fields; the size is a power of 2 and
+// the table is never more than half full
+#define FTABLE_MIN 256
+static HNode **ftable = NULL;
+static unsigned ftable_size = 0;
+static unsigned ftable_cnt = 0;
+// display linked list, new flows are added at the tail
+static HNode *dlist = NULL;
+static HNode *dlist_tail = NULL;
 
 
 // speed up malloc/free
@@ -117,83 +140,164 @@ void hfree(HNode *ptr) {
 	hnode_unused = ptr;
 }
 
-// using protocol 0 and port 0 for ICMP
-static void hnode_add(uint32_t ip_src, int protocol, uint16_t port_src, uint32_t bytes) {
-	uint8_t h = hash(ip_src);
+// ip6 - NULL for IPv4 flows; the IPv6 address is folded into 32 bits,
+// the IPv4 path stays a single multiplication
+static inline unsigned flow_hash(pid_t sandbox, uint32_t ip, const uint8_t *ip6, uint16_t port, int protocol) {
+	if (ip6) {
+		uint32_t w[4];
+		memcpy(w, ip6, 16);
+		ip = (w[0] * 0x85ebca6bU) ^ (w[1] * 0xc2b2ae35U) ^ (w[2] * 0x27d4eb2fU) ^ w[3];
+	}
+	uint32_t h = (ip ^ (uint32_t) sandbox) * 0x9e3779b1U;
+	h ^= ((uint32_t) port << 8 | (uint8_t) protocol) * 0x85ebca6bU;
+	h ^= h >> 15;
+	return h & (ftable_size - 1);
+}
 
-	// find
-	int ip_instance = 0;
-	HNode *ptr = htable[h];
-	while (ptr) {
-		if (ptr->ip_src == ip_src) {
-			ip_instance++;
-			if (ptr->port_src == port_src && ptr->protocol == protocol) {
-				ptr->bytes += bytes;
-				ptr->pkts++;
-				assert(ptr->rnode);
-				ptr->rnode->pkts++;
-				return;
-			}
-		}
-		ptr = ptr->hnext;
+// the slot of the flow, or the empty slot where the flow goes
+static unsigned flow_slot(pid_t sandbox, uint32_t ip, const uint8_t *ip6, uint16_t port, int protocol) {
+	unsigned i = flow_hash(sandbox, ip, ip6, port, protocol);
+	while (ftable[i]) {
+		HNode *ptr = ftable[i];
+		if (ptr->port_src == port && ptr->protocol == protocol && ptr->sandbox == sandbox &&
+		    ((ip6) ? ptr->v6 && memcmp(ptr->ip6_src, ip6, 16) == 0 : !ptr->v6 && ptr->ip_src == ip))
+			break;
+		i = (i + 1) & (ftable_size - 1);
 	}
+	return i;
+}
+
+static inline const uint8_t *hnode_ip6(HNode *ptr) {
+	return (ptr->v6) ? ptr->ip6_src : NULL;
+}
+
+static void ftable_resize(unsigned size) {
+	HNode **old = ftable;
+	unsigned old_size = ftable_size;
+
+	ftable = calloc(size, sizeof(HNode *));
+	if (!ftable)
+		errExit("calloc");
+	ftable_size = size;
+
+	unsigned i;
+	for (i = 0; i < old_size; i++) {
+		HNode *ptr = old[i];
+		if (ptr)
+			ftable[flow_slot(ptr->sandbox, ptr->ip_src, hnode_ip6(ptr), ptr->port_src, ptr->protocol)] = ptr;
+	}
+	free(old);
+}
+
+// the flow, created with no traffic if not found
+static HNode *hnode_get(pid_t sandbox, uint32_t ip_src, const uint8_t *ip6_src, int protocol, uint16_t port_src) {
+	if (ftable == NULL)
+		ftable_resize(FTABLE_MIN);
+
+	// find
+	unsigned i = flow_slot(sandbox, ip_src, ip6_src, port_src, protocol);
+	HNode *ptr = ftable[i];
+	if (ptr)
+		return ptr;
 
 #ifdef DEBUG
-	printf("malloc %d.%d.%d.%d\n", PRINT_IP(ip_src));
+	{
+		char addr[INET6_ADDRSTRLEN];
+		addr_str(addr, ip_src, ip6_src);
+		printf("malloc %s\n", addr);
+	}
 #endif
 	HNode *hnew = hmalloc();
 	assert(hnew);
 	hnew->ip_src = ip_src;
+	hnew->sandbox = sandbox;
+	if (ip6_src) {
+		memcpy(hnew->ip6_src, ip6_src, 16);
+		hnew->v6 = 1;
+	}
 	hnew->port_src = port_src;
 	hnew->protocol = protocol;
 	hnew->hnext = NULL;
-	hnew->bytes = bytes;
-	hnew->pkts = 1;
-	hnew->ip_instance = ip_instance + 1;
 	hnew->ttl = DISPLAY_TTL;
-	if (htable[h] == NULL)
-		htable[h] = hnew;
-	else {
-		hnew->hnext = htable[h];
-		htable[h] = hnew;
-	}
+	ftable[i] = hnew;
+	if (++ftable_cnt * 2 > ftable_size)
+		ftable_resize(ftable_size * 2);
 
 	// add to the end of list
 	hnew->dnext = NULL;
 	if (dlist == NULL)
 		dlist = hnew;
+	else
+		dlist_tail->dnext = hnew;
+	dlist_tail = hnew;
+
+	if (hnew->v6) {
+		hnew->rnode = radix6_longest_prefix_match(hnew->ip6_src);
+		if (!hnew->rnode)
+			hnew->rnode = radix6_add(hnew->ip6_src, 128, NULL);
+	}
 	else {
-		ptr = dlist;
-		while (ptr->dnext != NULL)
-			ptr = ptr->dnext;
-		ptr->dnext = hnew;
+		hnew->rnode = radix_longest_prefix_match(hnew->ip_src);
+		if (!hnew->rnode)
+			hnew->rnode = radix_add(hnew->ip_src, 0xffffffff, NULL);
 	}
+	return hnew;
+}
 
-	hnew->rnode = radix_longest_prefix_match(hnew->ip_src);
-	if (!hnew->rnode)
-		hnew->rnode = radix_add(hnew->ip_src, 0xffffffff, NULL);
-	hnew->rnode->pkts++;
+// using protocol 0 and port 0 for ICMP and ICMPv6; ip6_src is NULL for IPv4
+static void hnode_add(pid_t sandbox, uint32_t ip_src, const uint8_t *ip6_src, int protocol, uint16_t port_src, uint32_t bytes) {
+	HNode *ptr = hnode_get(sandbox, ip_src, ip6_src, protocol, port_src);
+	ptr->bytes += bytes;
+	ptr->pkts++;
+	assert(ptr->rnode);
+	ptr->rnode->pkts++;
 }
 
+// name the rx flow from ip:port, called by the DNS and SNI stages
+void flow_label(uint32_t ip, const uint8_t *ip6, int protocol, uint16_t port, const char *label) {
+	assert(label);
+	HNode *ptr = hnode_get(packet_sandbox, ip, ip6, protocol, port);
+	if (ptr->label && strcmp(ptr->label, label) == 0)
+		return;
+	free(ptr->label);
+	ptr->label = strdup(label);
+	if (!ptr->label)
+		errExit("strdup");
+}
+
+// the element is already removed from the display list
 static void hnode_free(HNode *elem) {
 	assert(elem);
 #ifdef DEBUG
-	printf("free %d.%d.%d.%d\n", PRINT_IP(elem->ip_src));
+	{
+		char addr[INET6_ADDRSTRLEN];
+		addr_str(addr, elem->ip_src, hnode_ip6(elem));
+		printf("free %s\n", addr);
+	}
 #endif
 
-	uint8_t h = hash(elem->ip_src);
-	HNode *ptr = htable[h];
-	assert(ptr);
+	unsigned i = flow_slot(elem->sandbox, elem->ip_src, hnode_ip6(elem), elem->port_src, elem->protocol);
+	assert(ftable[i] == elem);
+	ftable[i] = NULL;
+	ftable_cnt--;
 
-	HNode *prev = NULL;
-	while (ptr != elem) {
-		prev = ptr;
-		ptr = ptr->hnext;
+	// move back the elements of the probe sequence, no tombstones
+	unsigned mask = ftable_size - 1;
+	unsigned j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		HNode *ptr = ftable[j];
+		if (ptr == NULL)
+			break;
+		unsigned k = flow_hash(ptr->sandbox, ptr->ip_src, hnode_ip6(ptr), ptr->port_src, ptr->protocol);
+		// the element stays if its home slot k is cyclically in (i, j]
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		ftable[i] = ptr;
+		ftable[j] = NULL;
+		i = j;
 	}
-	if (prev == NULL)
-		htable[h] = elem->hnext;
-	else
-		prev->hnext = elem->hnext;
+	free(elem->label);
 	hfree(elem);
 }
 
@@ -201,17 +305,20 @@ static void hnode_free(HNode *elem) {
 static void debug_dlist(void) {
 	HNode *ptr = dlist;
 	while (ptr) {
-		printf("dlist %d.%d.%d.%d:%d\n", PRINT_IP(ptr->ip_src), ptr->port_src);
+		char addr[INET6_ADDRSTRLEN];
+		addr_str(addr, ptr->ip_src, hnode_ip6(ptr));
+		printf("dlist %s:%d\n", addr, ptr->port_src);
 		ptr = ptr->dnext;
 	}
 }
 static void debug_hnode(void) {
-	int i;
-	for (i = 0; i < HMAX; i++) {
-		HNode *ptr = htable[i];
-		while (ptr) {
-			printf("hnode (%d) %d.%d.%d.%d:%d\n", i, PRINT_IP(ptr->ip_src), ptr->port_src);
-			ptr = ptr->hnext;
+	unsigned i;
+	for (i = 0; i < ftable_size; i++) {
+		HNode *ptr = ftable[i];
+		if (ptr) {
+			char addr[INET6_ADDRSTRLEN];
+			addr_str(addr, ptr->ip_src, hnode_ip6(ptr));
+			printf("hnode (%u) %s:%d\n", i, addr, ptr->port_src);
 		}
 	}
 }
@@ -238,15 +345,6 @@ static char *print_bw(unsigned units) {
 	return bw_line[units];
 }
 
-static inline void adjust_line(char *str, int len, int cols) {
-	if (len > LINE_MAX) // functions such as snprintf truncate the string, and return the length of the untruncated string
-		len = LINE_MAX;
-	if (cols > 4 && len > cols) {
-		str[cols] = '\0';
-		str[cols - 1] = '\n';
-	}
-}
-
 #define BWMAX_CNT 8
 static unsigned adjust_bandwidth(unsigned bw) {
 	static unsigned array[BWMAX_CNT] = {0};
@@ -337,6 +435,74 @@ static inline const char *common_port(uint16_t port) {
 
 
 
+// the network from the IP map, NULL until the geoip lookup is done
+static const char *flow_network(HNode *ptr) {
+	if (!ptr->rnode->name) {
+		char *hostname;
+		int rv = (ptr->v6) ? retrieve_hostname6(ptr->ip6_src, &hostname) : retrieve_hostname(ptr->ip_src, &hostname);
+		if (rv == 0)
+			ptr->rnode->name = (hostname) ? hostname : " ";
+	}
+	return ptr->rnode->name;
+}
+
+// the protocol of the flow, NULL if unknown; the stats are updated with the
+// packets of the last interval
+static const char *flow_protocol(HNode *ptr, const char *name) {
+	const char *protocol = NULL;
+	if (ptr->port_src == 443 && ptr->protocol == 0x06) { // TCP
+		protocol = "TLS";
+		stats_tls += ptr->pkts;
+		if (strstr(name, "DNS")) {
+			protocol = "DoH";
+			stats_dns_doh += ptr->pkts;
+		}
+
+	}
+	else if (ptr->port_src == 443 && ptr->protocol == 0x11) { // UDP
+		protocol = "QUIC";
+		stats_quic +=  ptr->pkts;
+		if (strstr(name, "DNS")) {
+			protocol = "DoQ";
+			stats_dns_doq += ptr->pkts;
+		}
+	}
+	else if (ptr->port_src == 53) {
+		protocol = "DNS";
+		stats_dns += ptr->pkts;
+	}
+	else if (ptr->port_src == 853) {
+		if (ptr->protocol == 0x06) {
+			protocol = "DoT";
+			stats_dns_dot += ptr->pkts;
+		}
+		else if (ptr->protocol == 0x11) {
+			protocol = "DoQ";
+			stats_dns_doq += ptr->pkts;
+		}
+		else
+			protocol = NULL;
+	}
+	else if ((protocol = common_port(ptr->port_src)) != NULL) {
+		if (strcmp(protocol, "HTTP") == 0)
+			stats_http += ptr->pkts;
+		else if (strcmp(protocol, "Tor") == 0)
+			stats_tor += ptr->pkts;
+		else if (strcmp(protocol, "SSH") == 0)
+			stats_ssh += ptr->pkts;
+	}
+	else if (ptr->protocol == 0x11)
+		protocol = "UDP";
+	else if (ptr->protocol == 0x06)
+		protocol = "TCP";
+	else if (ptr->protocol == PROTOCOL_SSH) {
+		protocol = "SSH";
+		stats_ssh += ptr->pkts;
+	}
+
+	return protocol;
+}
+
 static void hnode_print(unsigned bw) {
 	bw = (bw < 1024 * DISPLAY_INTERVAL) ? 1024 * DISPLAY_INTERVAL : bw;
 #ifdef DEBUG
@@ -345,34 +511,45 @@ static void hnode_print(unsigned bw) {
 	printf("-----------------------------\n");
 	debug_hnode();
 	printf("*********************\n");
-#else
-	ansi_clrscr();
 #endif
 
 	// get terminal size
 	struct winsize sz;
 	int cols = 80;
+	int rows = 24;
 	if (isatty(STDIN_FILENO)) {
-		if (!ioctl(0, TIOCGWINSZ, &sz))
+		if (!ioctl(0, TIOCGWINSZ, &sz) && sz.ws_col > 0 && sz.ws_row > 0) {
 			cols  = sz.ws_col;
+			rows = sz.ws_row;
+		}
 	}
 	if (cols > LINE_MAX)
 		cols = LINE_MAX;
 	char line[LINE_MAX + 1];
+	// only the changes since the last display are sent to the terminal; the
+	// flows that do not fit between the stats line and the key line are
+	// still aged out, but not printed
+	term_frame_begin(rows, cols);
+	int flow_rows = rows - 2;
 
 	// print stats line
 	bw = adjust_bandwidth(bw);
-	char stats[31];
+	char stats[64];
+	int slen = 0;
+	unsigned long long drops = capture_drops();
+	if (drops)
+		slen = sprintf(stats, "%llu dropped, ", drops);
 	if (bw > (1024 * 1024 * DISPLAY_INTERVAL))
-		sprintf(stats, "%u MB/s ", bw / (1024 * 1024 * DISPLAY_INTERVAL));
+		sprintf(stats + slen, "%u MB/s ", bw / (1024 * 1024 * DISPLAY_INTERVAL));
 	else
-		sprintf(stats, "%u KB/s ", bw / (1024 * DISPLAY_INTERVAL));
+		sprintf(stats + slen, "%u KB/s ", bw / (1024 * DISPLAY_INTERVAL));
 //	int len = snprintf(line, LINE_MAX, "%32s geoip %d, IP database %d\n", stats, geoip_calls, radix_nodes);
 	char faint1[] = {0x1b, '[', '2', 'm', '\0'};
 	char faint2[] = {0x1b, '[', '0', 'm', '\0'};
-	int len = snprintf(line, LINE_MAX, "%32s %saddress:port (protocol) network%s\n", stats, faint1, faint2);
-	adjust_line(line, len, cols);
-	printf("%s", line);
+	// the lines are truncated at LINE_MAX characters
+	snprintf(line, LINE_MAX, "%32s %saddress:port (protocol) network%s", stats, faint1, faint2);
+	term_frame_line(line);
+	int len;
 
 	HNode *ptr = dlist;
 	HNode *prev = NULL;
@@ -389,11 +566,17 @@ static void hnode_print(unsigned bw) {
 			else
 				snprintf(bytes, 11, "%u B/s ", (unsigned) (ptr->bytes / DISPLAY_INTERVAL));
 
-			if (!ptr->rnode->name)
-				ptr->rnode->name = retrieve_hostname(ptr->ip_src);
-			if (!ptr->rnode->name)
-				ptr->rnode->name = " ";
-			assert(ptr->rnode->name);
+			const char *name = flow_network(ptr);
+			if (!name)
+				name = "...";
+			char sbox_name[LINE_MAX];
+			if (arg_sandboxes) {
+				const char *sbox = sandbox_name(ptr->sandbox);
+				if (sbox)
+					snprintf(sbox_name, sizeof(sbox_name), "%s [%s]", name, sbox);
+				else
+					snprintf(sbox_name, sizeof(sbox_name), "%s [%d]", name, ptr->sandbox);
+			}
 
 			unsigned bwunit = bw / DISPLAY_BW_UNITS;
 			char *bwline;
@@ -402,67 +585,29 @@ static void hnode_print(unsigned bw) {
 			else
 				bwline = print_bw(ptr->bytes / bwunit);
 
-			const char *protocol = NULL;
-			if (ptr->port_src == 443 && ptr->protocol == 0x06) { // TCP
-				protocol = "TLS";
-				stats_tls += ptr->pkts;
-				if (strstr(ptr->rnode->name, "DNS")) {
-					protocol = "DoH";
-					stats_dns_doh += ptr->pkts;
-				}
-
-			}
-			else if (ptr->port_src == 443 && ptr->protocol == 0x11) { // UDP
-				protocol = "QUIC";
-				stats_quic +=  ptr->pkts;
-				if (strstr(ptr->rnode->name, "DNS")) {
-					protocol = "DoQ";
-					stats_dns_doq += ptr->pkts;
-				}
-			}
-			else if (ptr->port_src == 53) {
-				protocol = "DNS";
-				stats_dns += ptr->pkts;
-			}
-			else if (ptr->port_src == 853) {
-				if (ptr->protocol == 0x06) {
-					protocol = "DoT";
-					stats_dns_dot += ptr->pkts;
-				}
-				else if (ptr->protocol == 0x11) {
-					protocol = "DoQ";
-					stats_dns_doq += ptr->pkts;
-				}
-				else
-					protocol = NULL;
-			}
-			else if ((protocol = common_port(ptr->port_src)) != NULL) {
-				if (strcmp(protocol, "HTTP") == 0)
-					stats_http += ptr->pkts;
-				else if (strcmp(protocol, "Tor") == 0)
-					stats_tor += ptr->pkts;
-				else if (strcmp(protocol, "SSH") == 0)
-					stats_ssh += ptr->pkts;
-			}
-			else if (ptr->protocol == 0x11)
-				protocol = "UDP";
-			else if (ptr->protocol == 0x06)
-				protocol = "TCP";
-			else if (ptr->protocol == PROTOCOL_SSH) {
-				protocol = "SSH";
-				stats_ssh += ptr->pkts;
-			}
-
+			const char *protocol = flow_protocol(ptr, name);
+			if (arg_sandboxes)
+				name = sbox_name;
 			if (protocol == NULL)
 				protocol = "";
-			if (ptr->port_src == PROTOCOL_ICMP)
-				len = snprintf(line, LINE_MAX, "%10s %s %d.%d.%d.%d (ICMP) %s\n",
-					       bytes, bwline, PRINT_IP(ptr->ip_src), ptr->rnode->name);
+			if (ptr->v6) {
+				char addr[INET6_ADDRSTRLEN];
+				inet_ntop(AF_INET6, ptr->ip6_src, addr, sizeof(addr));
+				if (ptr->port_src == PROTOCOL_ICMP)
+					len = snprintf(line, LINE_MAX, "%10s %s %s (ICMP) %s",
+						       bytes, bwline, addr, name);
+				else
+					len = snprintf(line, LINE_MAX, "%10s %s [%s]:%u (%s) %s",
+						       bytes, bwline, addr, ptr->port_src, protocol, name);
+			}
+			else if (ptr->port_src == PROTOCOL_ICMP)
+				len = snprintf(line, LINE_MAX, "%10s %s %d.%d.%d.%d (ICMP) %s",
+					       bytes, bwline, PRINT_IP(ptr->ip_src), name);
 			else
-				len = snprintf(line, LINE_MAX, "%10s %s %d.%d.%d.%d:%u (%s) %s\n",
-					       bytes, bwline, PRINT_IP(ptr->ip_src), ptr->port_src, protocol, ptr->rnode->name);
-			adjust_line(line, len, cols);
-			printf("%s", line);
+				len = snprintf(line, LINE_MAX, "%10s %s %d.%d.%d.%d:%u (%s) %s",
+					       bytes, bwline, PRINT_IP(ptr->ip_src), ptr->port_src, protocol, name);
+			if (len > 0 && flow_rows-- > 0)
+				term_frame_line(line);
 
 			if (ptr->bytes)
 				ptr->ttl = DISPLAY_TTL;
@@ -476,12 +621,16 @@ static void hnode_print(unsigned bw) {
 				dlist = next;
 			else
 				prev->dnext = next;
+			if (dlist_tail == ptr)
+				dlist_tail = prev;
 			hnode_free(ptr);
 		}
 
 		ptr = next;
 	}
-	ansi_faint("(D)isplay, (S)ave, (C)lear, e(X)it\n");
+	snprintf(line, LINE_MAX, "%s(D)isplay, (S)ave, (C)lear, e(X)it%s", faint1, faint2);
+	term_frame_line(line);
+	term_frame_end();
 
 #ifdef DEBUG
 	{
@@ -496,10 +645,84 @@ static void hnode_print(unsigned bw) {
 #endif
 }
 
+// --export: one interval record followed by the flows with rx traffic in
+// the interval; the flows without traffic are aged out as in hnode_print()
+static void export_flows(unsigned interval, unsigned long long bw) {
+	static uint32_t last_pkts = 0;
+	static unsigned long long last_drops = 0;
+	unsigned long long drops = capture_drops();
+
+	HNode *ptr = dlist;
+	unsigned flows = 0;
+	while (ptr) {
+		if (ptr->pkts)
+			flows++;
+		ptr = ptr->dnext;
+	}
+
+	time_t now = time(NULL);
+	export_printf("{\"time\":%lld,\"type\":\"interval\",\"interval\":%u,\"bytes\":%llu,"
+		"\"packets\":%u,\"dropped\":%llu,\"flows\":%u}\n",
+		(long long) now, interval, bw, stats_pkts - last_pkts, drops - last_drops, flows);
+	last_pkts = stats_pkts;
+	last_drops = drops;
+
+	ptr = dlist;
+	HNode *prev = NULL;
+	while (ptr) {
+		HNode *next = ptr->dnext;
+		if (ptr->pkts || --ptr->ttl > 0) {
+			if (ptr->pkts) {
+				const char *network = flow_network(ptr);
+				if (network && *network == ' ') // geoip not found
+					network = NULL;
+				const char *protocol = flow_protocol(ptr, (network) ? network : "");
+
+				char addr[INET6_ADDRSTRLEN];
+				addr_str(addr, ptr->ip_src, hnode_ip6(ptr));
+				export_printf("{\"time\":%lld,\"type\":\"flow\",\"address\":\"%s\",", (long long) now, addr);
+				if (ptr->port_src == PROTOCOL_ICMP)
+					export_printf("\"port\":null,\"protocol\":\"ICMP\"");
+				else {
+					export_printf("\"port\":%u,\"protocol\":", ptr->port_src);
+					export_string(protocol);
+				}
+				export_printf(",\"bytes\":%llu,\"packets\":%u,\"network\":",
+					(unsigned long long) ptr->bytes, ptr->pkts);
+				export_string(network);
+				export_printf(",\"name\":");
+				export_string(ptr->label);
+				if (arg_sandboxes) {
+					export_printf(",\"sandbox\":%d,\"sandbox_name\":", ptr->sandbox);
+					export_string(sandbox_name(ptr->sandbox));
+				}
+				export_printf("}\n");
+				ptr->ttl = DISPLAY_TTL;
+			}
+			ptr->bytes = 0;
+			ptr->pkts = 0;
+			prev = ptr;
+		}
+		else {
+			// free the element
+			if (prev == NULL)
+				dlist = next;
+			else
+				prev->dnext = next;
+			if (dlist_tail == ptr)
+				dlist_tail = prev;
+			hnode_free(ptr);
+		}
+
+		ptr = next;
+	}
+	export_flush();
+}
+
 static void print_stats(FILE *fp) {
 	assert(fp);
 
-	fprintf(fp, "Stats: %u packets\n", stats_pkts);
+	fprintf(fp, "Stats: %u packets, %llu dropped\n", stats_pkts, capture_drops());
 	fprintf(fp, "   encrypted: TLS %u, QUIC %u, Tor %u\n",
 		stats_tls, stats_quic, stats_tor);
 	fprintf(fp, "   unencrypted: HTTP %u\n", stats_http);
@@ -524,240 +747,327 @@ static void print_stats(FILE *fp) {
 
 
 
-// trace rx traffic coming in
-static void run_trace(void) {
-	// trace only rx ipv4 tcp and upd
-	int s1 = socket(AF_INET, SOCK_RAW, IPPROTO_TCP);
-	int s2 = socket(AF_INET, SOCK_RAW, IPPROTO_UDP);
-	int s3 = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-	if (s1 < 0 || s2 < 0 || s3 < 0)
-		errExit("socket");
+// buf - start of the IP header; a single capture feeds the stages:
+// TLS/SNI for tx, DNS and then traffic and ICMP for rx
+static void process_packet(unsigned char *buf, unsigned bytes, unsigned char pkttype, void *arg) {
+	Capture *cap = arg;
+	packet_sandbox = cap->pid;
 
+	if (bytes < 20) // minimum size of IP packet
+		return;
 
-	int p1 = runprog(LIBDIR "/firejail/fnettrace-sni");
-	if (p1 != -1)
-		printf("loading snitrace...");
+	uint32_t ip_src = 0;
+	uint32_t ip_dst = 0;
+	const uint8_t *ip6_src = NULL;
+	const uint8_t *ip6_dst = NULL;
+	int protocol;
+	unsigned hlen;
+	int loopback;
+	if ((buf[0] >> 4) == 4) {
+		protocol = (int) buf[9];
+		hlen = (buf[0] & 0x0f) * 4;
+		memcpy(&ip_src, buf + 12, 4);
+		ip_src = ntohl(ip_src);
+		memcpy(&ip_dst, buf + 16, 4);
+		ip_dst = ntohl(ip_dst);
+		loopback = (buf[12] == 127 || buf[16] == 127);
+	}
+	else if ((buf[0] >> 4) == 6) {
+		if (bytes < 40) // fixed IPv6 header
+			return;
+		protocol = (int) buf[6];
+		hlen = 40;
+		ip6_src = buf + 8;
+		ip6_dst = buf + 24;
+
+		// skip the extension headers: hop-by-hop, routing, destination options
+		while ((protocol == 0 || protocol == 43 || protocol == 60) && bytes >= hlen + 8) {
+			protocol = buf[hlen];
+			hlen += (buf[hlen + 1] + 1) * 8;
+		}
+		// fragment header: only the first fragment carries the transport header
+		if (protocol == 44 && bytes >= hlen + 8) {
+			if (((buf[hlen + 2] << 8 | buf[hlen + 3]) & 0xfff8) != 0)
+				return;
+			protocol = buf[hlen];
+			hlen += 8;
+		}
+		loopback = (memcmp(ip6_src, &in6addr_loopback, 16) == 0 || memcmp(ip6_dst, &in6addr_loopback, 16) == 0);
+	}
+	else
+		return;
 
-	int p2 = runprog(LIBDIR "/firejail/fnettrace-dns");
-	if (p2 != -1)
-		printf("loading dnstrace...");
-	unsigned last_print_traces = 0;
-	unsigned char buf[MAX_BUF_SIZE];
-	unsigned bw = 0; // bandwidth calculations
+	int icmp = (protocol == 1 || protocol == 58);
+	if (!icmp && protocol != 6 && protocol != 17)
+		return;
+	if (bytes < hlen + 4U)
+		return;
+	unsigned char *l4 = buf + hlen;
+	unsigned l4len = bytes - hlen;
 
-	while (1) {
-		unsigned end = time(NULL);
-		if (end % DISPLAY_INTERVAL == 1 && last_print_traces != end) { // first print after 1 second
-			hnode_print(bw);
-			last_print_traces = end;
-			bw = 0;
+	if (pkttype == PACKET_OUTGOING) {
+		dissect_tx(ip_dst, ip6_dst, protocol, l4, l4len);
+		return;
+	}
+	// trace only rx tcp, udp and icmp
+	if (pkttype == PACKET_OTHERHOST)
+		return;
+	dissect_rx(ip_src, ip6_src, protocol, l4, l4len);
+
+#ifdef DEBUG
+	{
+		char src[INET6_ADDRSTRLEN];
+		char dst[INET6_ADDRSTRLEN];
+		addr_str(src, ip_src, ip6_src);
+		addr_str(dst, ip_dst, ip6_dst);
+		printf("%s -> %s, %u bytes\n", src, dst, bytes);
+	}
+#endif
+	// filter out loopback traffic
+	if (!loopback) {
+		bw += bytes + 14; // assume a 14 byte Ethernet layer
+
+		uint16_t port_src = 0;
+		if (icmp)
+			hnode_add(cap->pid, ip_src, ip6_src, PROTOCOL_ICMP, 0, bytes + 14);
+		else { // itcp or udp
+			memcpy(&port_src, l4, 2);
+			port_src = ntohs(port_src);
+
+			// detect ssh on a standard or not so standard port (22)
+			if (protocol == 6 && l4len > 12U) { // tcp
+				uint8_t dataoffset = *(l4 + 12);
+				uint8_t tcphlen = (dataoffset >> 2);
+				if (l4len >= tcphlen + 4U &&
+				    memcmp(l4 + tcphlen, "SSH-", 4) == 0) {
+					time_t seconds = time(NULL);
+					struct tm *t = localtime(&seconds);
+					char ip[INET6_ADDRSTRLEN];
+					addr_str(ip, ip_src, ip6_src);
+					char *msg;
+					if (asprintf(&msg, "%02d:%02d:%02d  %-15s  SSH connection",
+						t->tm_hour, t->tm_min, t->tm_sec, ip) == -1)
+						errExit("asprintf");
+					ev_add(msg);
+					free(msg);
+					protocol = PROTOCOL_SSH;
+				}
+			}
+			hnode_add(cap->pid, ip_src, ip6_src, protocol, port_src, bytes + 14);
+		}
+
+		// stats
+		stats_pkts++;
+		if (icmp)  {
+			// echo reply/request: 0/8 for ICMP, 129/128 for ICMPv6
+			if ((protocol == 1 && (*l4 == 0 || *l4 == 8)) ||
+			    (protocol == 58 && (*l4 == 128 || *l4 == 129)))
+				stats_icmp_echo++;
 		}
+	}
+}
+
+// https://www.kernel.org/doc/html/latest/networking/filter.html
+static void custom_bpf(int sock) {
+	struct sock_filter code[] = {
+		// IPv4 and IPv6 only, the protocol is not in the packet for SOCK_DGRAM
+		{ BPF_LD | BPF_H | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_PROTOCOL },
+		{ BPF_JMP | BPF_JEQ | BPF_K, 1, 0, ETH_P_IP },
+		{ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, ETH_P_IPV6 },
+		{ BPF_RET | BPF_K, 0, 0, 0x00040000 },
+		{ BPF_RET | BPF_K, 0, 0, 0x00000000 },
+	};
+
+	struct sock_fprog bpf = {
+		.len = (unsigned short) sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	int rv = setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &bpf, sizeof(bpf));
+	if (rv < 0) {
+		fprintf(stderr, "Error: cannot attach BPF filter\n");
+		exit(1);
+	}
+}
 
-		fd_set rfds;
-		FD_ZERO(&rfds);
-		FD_SET(0, &rfds);
+// --ebpf: the traffic counted by the kernel since the last call
+static unsigned long long ebpf_bytes;
+static void ebpf_flow(uint32_t ip, const uint8_t *ip6, int protocol, uint16_t port, uint64_t bytes, uint64_t pkts) {
+	HNode *ptr = hnode_get(0, ip, ip6, protocol, port);
+	bytes += 14 * pkts; // assume a 14 byte Ethernet layer
+	ptr->bytes += bytes;
+	ptr->pkts += pkts;
+	ptr->rnode->pkts += pkts;
+	ebpf_bytes += bytes;
+	stats_pkts += pkts;
+}
 
-		FD_SET(s1, &rfds);
-		FD_SET(s2, &rfds);
-		FD_SET(s3, &rfds);
-		int maxfd = (s1 > s2) ? s1 : s2;
-		maxfd = (s3 > maxfd) ? s3 : maxfd;
+static unsigned long long ebpf_collect(void) {
+	ebpf_bytes = 0;
+	ebpf_read(ebpf_flow);
+	return ebpf_bytes;
+}
+
+// IPv4 and IPv6 packets without the link layer, the packets are selected in process_packet();
+// the sockets bound to ETH_P_IP don't get the tx packets
+static int ebpf = 0;
+void capture_open(Capture *cap) {
+	packet_ring_open(&cap->ring, SOCK_DGRAM);
+	if (arg_ebpf) {
+		if (ebpf_attach(cap->ring.sock) == 0)
+			ebpf = 1;
+		else
+			fprintf(stderr, "Warning: eBPF not available, all the packets are processed in user space\n");
+	}
+	if (!ebpf)
+		custom_bpf(cap->ring.sock);
+	packet_ring_bind(&cap->ring, ETH_P_ALL);
+}
 
-		if (p1 != -1) {
-			FD_SET(p1, &rfds);
-			maxfd = (p1 > maxfd) ? p1 : maxfd;
+// return 1 to exit
+static int handle_key(void) {
+	int c = getchar();
+	if (c == 'c' || c == 'C') {
+		clear_stats();
+		ev_clear();
+		radix_clear_data();
+	}
+	else if (c == 'd' || c == 'D') {
+		printf("\n\n");
+		ansi_bold("__________________________________________________________________________\n");
+		print_stats(stdout);
+		ansi_bold("__________________________________________________________________________\n");
+		ansi_faint("press any key to continue...");
+		fflush(0);
+
+		getchar();
+		term_frame_reset();
+	}
+	else if (c == 's' || c == 'S') {
+		term_frame_reset();
+		printf("The file is saved in /tmp directory. Please enter the file name: ");
+		fflush(0);
+
+		char buf[LINE_MAX + 5]; // eave some room to add /tmp/
+		strcpy(buf, "/tmp/");
+		terminal_restore();
+		if (fgets(buf + 5, LINE_MAX, stdin) == NULL)
+			errExit("fgets");
+		terminal_set();
+
+		// remove '\n' and open the file
+		char *ptr = strchr(buf, '\n');
+		if (!ptr) { // we should have a '\n'
+			printf("Error: invalid file name\n");
+			sleep(5);
+			return 0;
 		}
+		*ptr = '\0';
 
-		if (p2 != -1) {
-			FD_SET(p2, &rfds);
-			maxfd = (p2 > maxfd) ? p2 : maxfd;
+		FILE *fp = fopen(buf, "w");
+		if (!fp) {
+			printf("Error: cannot open file %s\n", buf);
+			perror("fopen");
+			sleep(5);
+			return 0;
 		}
-		maxfd++;
 
-		struct timeval tv;
-		tv.tv_sec = 1;
-		tv.tv_usec = 0;
+		printf("Saving stats in %s file...\n", buf);
+		print_stats(fp);
+		fclose(fp);
+		int rv = chmod(buf, 0600);
+		(void) rv;
+		sleep(1);
+	}
+	else if (c == 'x' || c == 'X')
+		return 1;
+	return 0;
+}
 
-		int rv = select(maxfd, &rfds, NULL, NULL, &tv);
-		if (rv < 0)
-			errExit("select");
-		else if (rv == 0)
-			continue;
+static void read_captures(void) {
+	int i;
+	for (i = 0; i < captures_cnt; i++)
+		packet_ring_read(&captures[i]->ring, process_packet, captures[i]);
+}
 
+// trace rx traffic coming in, and the TLS handshakes going out; a single
+// epoll loop for the keyboard and all the capture sockets
+static void run_trace(void) {
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+		errExit("epoll_create1");
+	if (!arg_export) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;	// stdin
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == -1)
+			errExit("epoll_ctl");
+	}
 
-		// rx tcp traffic by default
-		int sock = s1;
-		int icmp = 0;
+	if (arg_sandboxes)
+		sandbox_scan(epfd);
+	else
+		capture_add(epfd, 0, NULL);
 
-		if (FD_ISSET(0, &rfds)) {
-			int c = getchar();
-			if (c == 'c' || c == 'C') {
-				clear_stats();
-				ev_clear();
-				radix_clear_data();
-				continue;
-			}
-			else if (c == 'd' || c == 'D') {
-				printf("\n\n");
-				ansi_bold("__________________________________________________________________________\n");
-				print_stats(stdout);
-				ansi_bold("__________________________________________________________________________\n");
-				ansi_faint("press any key to continue...");
-				fflush(0);
-
-				getchar();
-				continue;
-			}
-			if (c == 's' || c == 'S') {
-				printf("The file is saved in /tmp directory. Please enter the file name: ");
-				fflush(0);
-
-				char buf[LINE_MAX + 5]; // eave some room to add /tmp/
-				strcpy(buf, "/tmp/");
-				terminal_restore();
-				if (fgets(buf + 5, LINE_MAX, stdin) == NULL)
-					errExit("fgets");
-				terminal_set();
-
-				// remove '\n' and open the file
-				char *ptr = strchr(buf, '\n');
-				if (!ptr) { // we should have a '\n'
-					printf("Error: invalid file name\n");
-					sleep(5);
-					continue;
-				}
-				*ptr = '\0';
-
-				FILE *fp = fopen(buf, "w");
-				if (!fp) {
-					printf("Error: cannot open file %s\n", buf);
-					perror("fopen");
-					sleep(5);
-					continue;
-				}
+	unsigned last_print_traces = 0;
+	if (arg_export)
+		last_print_traces = time(NULL);
 
-				printf("Saving stats in %s file...\n", buf);
-				print_stats(fp);
-				fclose(fp);
-				int rv = chmod(buf, 0600);
-				(void) rv;
-				sleep(1);
-				continue;
+	while (!export_exit) {
+		unsigned end = time(NULL);
+		if (arg_export) {
+			if (end - last_print_traces >= (unsigned) arg_interval) {
+				if (ebpf)
+					bw += ebpf_collect();
+				export_flows(end - last_print_traces, bw);
+				geoip_flush();
+				last_print_traces = end;
+				bw = 0;
+				if (arg_sandboxes)
+					sandbox_scan(epfd);
 			}
-			else if (c == 'x' || c == 'X')
-				break;
-			continue;
 		}
-		else if (FD_ISSET(p1, &rfds)) {
-			char buf[LINE_MAX];
-			ssize_t sz = read(p1, buf, LINE_MAX - 1);
-			if (sz == -1)
-				errExit("error reading snitrace");
-			if (sz == 0) {
-				fprintf(stderr, "Error: snitrace EOF!!!\n");
-				p1 = -1;
-			}
-			if (strncmp(buf, "SNI trace", 9) == 0)
-				continue;
-
-			buf[sz] = '\0';
-			ev_add(buf);
-			continue;
+		else if (end % DISPLAY_INTERVAL == 1 && last_print_traces != end) { // first print after 1 second
+			if (ebpf)
+				bw += ebpf_collect();
+			hnode_print(bw);
+			geoip_flush();
+			last_print_traces = end;
+			bw = 0;
+			if (arg_sandboxes)
+				sandbox_scan(epfd);
 		}
-		else if (FD_ISSET(p2, &rfds)) {
-			char buf[LINE_MAX];
-			ssize_t sz = read(p2, buf, LINE_MAX - 1);
-			if (sz == -1)
-				errExit("error reading dnstrace");
-			if (sz == 0) {
-				fprintf(stderr, "Error: dnstrace EOF!!!\n");
-				p2 = -1;
-			}
-			if (strncmp(buf, "DNS trace", 9) == 0)
-				continue;
 
-			buf[sz] = '\0';
-			ev_add(buf);
+		struct epoll_event events[16];
+		int rv = epoll_wait(epfd, events, 16, 1000);
+		if (rv < 0 && errno == EINTR)
 			continue;
-		}
-		// by default we assume TCP
-		else if (FD_ISSET(s2, &rfds))
-			sock = s2;
-		else if (FD_ISSET(s3, &rfds)) {
-			sock = s3;
-			icmp = 1;
-		}
-
-		unsigned bytes = recvfrom(sock, buf, MAX_BUF_SIZE, 0, NULL, NULL);
-		if (bytes >= 20) { // minimum size of IP packet
-#ifdef DEBUG
-			{
-				uint32_t ip_src;
-				memcpy(&ip_src, buf + 12, 4);
-				ip_src = ntohl(ip_src);
-
-				uint32_t ip_dst;
-				memcpy(&ip_dst, buf + 16, 4);
-				ip_dst = ntohl(ip_dst);
-				printf("%d.%d.%d.%d -> %d.%d.%d.%d, %u bytes\n", PRINT_IP(ip_src), PRINT_IP(ip_dst), bytes);
-			}
-#endif
-			// filter out loopback traffic
-			if (buf[12] != 127 && buf[16] != 127) {
-				bw += bytes + 14; // assume a 14 byte Ethernet layer
-
-				uint32_t ip_src;
-				memcpy(&ip_src, buf + 12, 4);
-				ip_src = ntohl(ip_src);
-
-				uint8_t hlen = (buf[0] & 0x0f) * 4;
-				uint16_t port_src = 0;
-				if (icmp)
-					hnode_add(ip_src, PROTOCOL_ICMP, 0, bytes + 14);
-				else { // itcp or udp
-					memcpy(&port_src, buf + hlen, 2);
-					port_src = ntohs(port_src);
-					int protocol = (int) buf[9];
-
-					// detect ssh on a standard or not so standard port (22)
-					if (protocol == 6) { // tcp
-						uint8_t dataoffset = *(buf + hlen + 12);
-						uint8_t tcphlen = (dataoffset >> 2);
-						if (memcmp(buf + hlen + tcphlen, "SSH-", 4) == 0) {
-							time_t seconds = time(NULL);
-							struct tm *t = localtime(&seconds);
-							char ip[30];
-							sprintf(ip, "%d.%d.%d.%d", PRINT_IP(ip_src));
-							char *msg;
-							if (asprintf(&msg, "%02d:%02d:%02d  %-15s  SSH connection",
-								t->tm_hour, t->tm_min, t->tm_sec, ip) == -1)
-								errExit("asprintf");
-							ev_add(msg);
-							free(msg);
-							protocol = PROTOCOL_SSH;
-						}
-					}
-					hnode_add(ip_src, protocol, port_src, bytes + 14);
-				}
-
-				// stats
-				stats_pkts++;
-				if (icmp)  {
-					if (*(buf + hlen) == 0 || *(buf + hlen) == 8)
-						stats_icmp_echo++;
-				}
+		if (rv < 0)
+			errExit("epoll_wait");
 
-			}
+		int i;
+		for (i = 0; i < rv; i++) {
+			Capture *cap = events[i].data.ptr;
+			if (cap)
+				packet_ring_read(&cap->ring, process_packet, cap);
+			else if (handle_key())
+				goto out;
 		}
 	}
 
-	close(s1);
-	close(s2);
-	close(s3);
-	if (p1 != -1)
-		close(p1);
-	if (p2 != -1)
-		close(p2);
+out:
+	// the last partial interval
+	if (arg_export) {
+		read_captures();
+		if (ebpf)
+			bw += ebpf_collect();
+		export_flows(time(NULL) - last_print_traces, bw);
+		export_close();
+	}
+	while (captures_cnt)
+		capture_close(epfd, 0);
+	close(epfd);
 }
 
 
@@ -783,9 +1093,17 @@ void logprintf(char *fmt, ...) {
 static const char *const usage_str =
 	"Usage: fnettrace [OPTIONS]\n"
 	"Options:\n"
+	"   --ebpf - count the traffic in the kernel, with an eBPF socket filter\n"
+	"   --events=number - keep the last number events, default 1024; a repeated\n"
+	"\tevent is counted instead of being added again\n"
+	"   --export=filename - headless mode, write the traffic as JSON lines\n"
+	"   --geoip-cache=filename - keep the geoip results across runs\n"
 	"   --help, -? - this help screen\n"
+	"   --interval=seconds - export interval, default 60 seconds\n"
 	"   --log=filename - netlocker logfile\n"
 	"   --print-map - print IP map\n"
+	"   --sandboxes - trace the sandboxes started with --net, inside their\n"
+	"\tnetwork namespaces\n"
 	"   --squash-map - compress IP map\n";
 
 static void usage(void) {
@@ -846,17 +1164,70 @@ int main(int argc, char **argv) {
 		}
 		else if (strncmp(argv[i], "--log=", 6) == 0)
 			arg_log = argv[i] + 6;
+		else if (strncmp(argv[i], "--geoip-cache=", 14) == 0)
+			arg_geoip_cache = argv[i] + 14;
+		else if (strcmp(argv[i], "--ebpf") == 0)
+			arg_ebpf = 1;
+		else if (strcmp(argv[i], "--sandboxes") == 0)
+			arg_sandboxes = 1;
+		else if (strncmp(argv[i], "--export=", 9) == 0)
+			arg_export = argv[i] + 9;
+		else if (strncmp(argv[i], "--events=", 9) == 0) {
+			ev_max = atoi(argv[i] + 9);
+			if (ev_max < 1 || ev_max > EV_RING_MAX) {
+				fprintf(stderr, "Error: invalid number of events, use a value between 1 and %d\n", EV_RING_MAX);
+				return 1;
+			}
+		}
+		else if (strncmp(argv[i], "--interval=", 11) == 0) {
+			arg_interval = atoi(argv[i] + 11);
+			if (arg_interval < 1 || arg_interval > EXPORT_INTERVAL_MAX) {
+				fprintf(stderr, "Error: invalid interval, use a value between 1 and %d seconds\n", EXPORT_INTERVAL_MAX);
+				return 1;
+			}
+		}
 		else {
 			fprintf(stderr, "Error: invalid argument\n");
 			return 1;
 		}
 	}
 
+	if (arg_ebpf && arg_sandboxes) {
+		fprintf(stderr, "Error: --ebpf and --sandboxes cannot be used together\n");
+		return 1;
+	}
+	if (arg_interval && !arg_export) {
+		fprintf(stderr, "Error: --interval requires --export\n");
+		return 1;
+	}
+	if (arg_export && *arg_export == '\0') {
+		fprintf(stderr, "Error: invalid export file\n");
+		return 1;
+	}
+
 	if (getuid() != 0) {
 		fprintf(stderr, "Error: you need to be root to run this program\n");
 		return 1;
 	}
 
+	if (arg_export) {
+		// long-running, no terminal and no parent death signal
+		if (!arg_interval)
+			arg_interval = EXPORT_INTERVAL;
+		export_open(arg_export);
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = export_handler;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+
+		char *fname = LIBDIR "/firejail/static-ip-map";
+		load_hostnames(fname);
+		geoip_init(arg_geoip_cache);
+		run_trace();
+		return 0;
+	}
+
 	terminal_set();
 	// handle CTRL-C
 	signal (SIGINT, terminal_handler);
@@ -869,6 +1240,7 @@ int main(int argc, char **argv) {
 	ansi_clrscr();
 	char *fname = LIBDIR "/firejail/static-ip-map";
 	load_hostnames(fname);
+	geoip_init(arg_geoip_cache);
 
 	run_trace();
 
@@ -24,10 +24,127 @@
 #include <assert.h>
 #include "radix.h"
 #include "fnettrace.h"
+#include <arpa/inet.h>
 
 RNode *head = 0;
 int radix_nodes = 0;
 
+// The binary tree above holds the IPv4 prefixes for radix_print() and
+// radix_squash(); the lookups go to multibit tries with 8 bit strides
+// stored in flat arrays of chunks, filled in by radix_add() and
+// radix6_add(). A prefix is expanded in the chunk of its last stride, the
+// longest prefix wins when two of them share a slot. An IPv4 lookup takes
+// at most 4 steps, an IPv6 lookup at most 16.
+typedef struct {
+	RNode *owner;		// longest prefix ending in this slot
+	uint32_t child;		// chunk for the next stride, 0 if none
+	uint8_t len;		// prefix length of owner
+} RSlot;
+
+#define RSTRIDE 8
+#define RSLOTS (1 << RSTRIDE)
+typedef struct {
+	RSlot slot[RSLOTS];
+} RChunk;
+
+// chunk 0 is the root
+typedef struct {
+	RChunk *chunks;
+	uint32_t cnt;
+	uint32_t max;
+} Trie;
+static Trie trie4 = { NULL, 0, 0 };
+static Trie trie6 = { NULL, 0, 0 };
+
+static uint32_t chunk_new(Trie *t) {
+	if (t->cnt == t->max) {
+		t->max = (t->max) ? t->max * 2 : 64;
+		t->chunks = realloc(t->chunks, t->max * sizeof(RChunk));
+		if (!t->chunks)
+			errExit("realloc");
+	}
+	memset(&t->chunks[t->cnt], 0, sizeof(RChunk));
+	return t->cnt++;
+}
+
+// the slot of the last stride, created if needed
+static RSlot *trie_slot(Trie *t, const uint8_t *key, int len, unsigned *cnt) {
+	assert(len > 0);
+	if (t->cnt == 0)
+		chunk_new(t);
+
+	// walk down to the chunk of the last stride
+	uint32_t c = 0;
+	int depth = RSTRIDE;
+	while (len > depth) {
+		unsigned byte = *key++;
+		if (t->chunks[c].slot[byte].child == 0) {
+			uint32_t child = chunk_new(t); // chunks can move
+			t->chunks[c].slot[byte].child = child;
+		}
+		c = t->chunks[c].slot[byte].child;
+		depth += RSTRIDE;
+	}
+
+	*cnt = 1U << (depth - len);
+	return &t->chunks[c].slot[*key & ~(*cnt - 1)];
+}
+
+static void trie_add(Trie *t, const uint8_t *key, int len, RNode *node) {
+	unsigned cnt;
+	RSlot *slot = trie_slot(t, key, len, &cnt);
+
+	// prefix expansion
+	unsigned i;
+	for (i = 0; i < cnt; i++, slot++) {
+		if (slot->owner == NULL || slot->len <= len) {
+			slot->owner = node;
+			slot->len = len;
+		}
+	}
+}
+
+static inline RNode *trie_match(const Trie *t, const uint8_t *key, int bytes) {
+	if (t->cnt == 0)
+		return NULL;
+
+	RNode *rv = NULL;
+	uint32_t c = 0;
+	int i;
+	for (i = 0; i < bytes; i++) {
+		const RSlot *slot = &t->chunks[c].slot[key[i]];
+		if (slot->owner && slot->owner->name)
+			rv = slot->owner;
+		c = slot->child;
+		if (c == 0)
+			break;
+	}
+
+	return rv;
+}
+
+static inline void ip_key(uint32_t ip, uint8_t *key) {
+	key[0] = ip >> 24;
+	key[1] = ip >> 16;
+	key[2] = ip >> 8;
+	key[3] = ip;
+}
+
+// rebuild the multibit trie from the binary tree
+static void trie_build(RNode *ptr, uint32_t ip, int level) {
+	if (!ptr)
+		return;
+	if (ptr->name) {
+		uint8_t key[4];
+		ip_key(ip << (32 - level), key);
+		trie_add(&trie4, key, level, ptr);
+	}
+	if (level == 32)
+		return;
+	trie_build(ptr->zero, ip << 1, level + 1);
+	trie_build(ptr->one, (ip << 1) | 1, level + 1);
+}
+
 // get rid of the malloc overhead
 #define RNODE_MAX_MALLOC 128
 static RNode *rnode_unused = NULL;
@@ -125,31 +242,96 @@ RNode *radix_add(uint32_t ip, uint32_t mask, char *name) {
 			errExit("duplicate_name");
 	}
 
+	// the nodes without a name are the /32 entries added for the addresses
+	// not in the map, there is no named prefix above them; the name is set
+	// later by the caller
+	if (i > 0) {
+		uint8_t key[4];
+		ip_key(ip & mask, key);
+		trie_add(&trie4, key, i, ptr);
+	}
 	return ptr;
 }
 
 // find last match
 RNode *radix_longest_prefix_match(uint32_t ip) {
-	if (!head)
-		return NULL;
+	uint8_t key[4];
+	ip_key(ip, key);
+	return trie_match(&trie4, key, 4);
+}
 
-	uint32_t m = 0x80000000;
-	RNode *ptr = head;
-	RNode *rv = NULL;
+//*****************************************************************
+// IPv6
+//*****************************************************************
+// the IPv6 prefixes are kept only in the trie, and in a list for printing
+typedef struct {
+	uint8_t ip6[16];
+	int len;
+	RNode *node;
+} R6Entry;
+static R6Entry *r6list = NULL;
+static int r6list_cnt = 0;
+static int r6list_max = 0;
+
+RNode *radix6_add(const uint8_t *ip6, int len, char *name) {
+	assert(ip6);
+	assert(len > 0 && len <= 128);
+
+	// the prefix bits only
+	uint8_t key[16];
+	int i;
+	for (i = 0; i < 16; i++) {
+		int bits = len - i * 8;
+		key[i] = (bits >= 8) ? ip6[i] : (bits <= 0) ? 0 : ip6[i] & (0xff << (8 - bits));
+	}
+
+	// a slot with the same length has the same prefix
+	unsigned cnt;
+	RSlot *slot = trie_slot(&trie6, key, len, &cnt);
+	RNode *ptr = NULL;
+	if (slot->owner && slot->len == len)
+		ptr = slot->owner;
+	else {
+		ptr = rmalloc();
+		if (r6list_cnt == r6list_max) {
+			r6list_max = (r6list_max) ? r6list_max * 2 : 64;
+			r6list = realloc(r6list, r6list_max * sizeof(R6Entry));
+			if (!r6list)
+				errExit("realloc");
+		}
+		memcpy(r6list[r6list_cnt].ip6, key, 16);
+		r6list[r6list_cnt].len = len;
+		r6list[r6list_cnt].node = ptr;
+		r6list_cnt++;
+		radix_nodes++;
+		trie_add(&trie6, key, len, ptr);
+	}
 
+	if (name && !ptr->name) {
+		ptr->name = duplicate_name(name);
+		if (!ptr->name)
+			errExit("duplicate_name");
+	}
+	return ptr;
+}
+
+RNode *radix6_longest_prefix_match(const uint8_t *ip6) {
+	return trie_match(&trie6, ip6, 16);
+}
+
+static void print6(FILE *fp, int pkts) {
 	int i;
-	for (i = 0; i < 32; i++, m >>= 1) {
-		if (m & ip)
-			ptr = ptr->one;
+	for (i = 0; i < r6list_cnt; i++) {
+		RNode *ptr = r6list[i].node;
+		if (!ptr->name || (pkts && !ptr->pkts))
+			continue;
+		char ip[INET6_ADDRSTRLEN];
+		inet_ntop(AF_INET6, r6list[i].ip6, ip, sizeof(ip));
+		if (pkts)
+			fprintf(fp, "   %s/%d %s (%u)\n", ip, r6list[i].len, ptr->name, ptr->pkts);
 		else
-			ptr = ptr->zero;
-		if (!ptr)
-			break;
-		if (ptr->name)
-			rv = ptr;
+			fprintf(fp, "%s/%d %s\n", ip, r6list[i].len, ptr->name);
 	}
-
-	return rv;
 }
 
 static uint32_t sum;
@@ -185,14 +367,15 @@ static void print(FILE *fp, RNode *ptr, int level, int pkts) {
 }
 
 void radix_print(FILE *fp, int pkts) {
-	if (!head)
-		return;
-	sum = 0;
-	print(fp, head->zero, 1, pkts);
-	assert(sum == 0);
-	sum = 1;
-	print(fp, head->one, 1, pkts);
-	assert(sum == 1);
+	if (head) {
+		sum = 0;
+		print(fp, head->zero, 1, pkts);
+		assert(sum == 0);
+		sum = 1;
+		print(fp, head->one, 1, pkts);
+		assert(sum == 1);
+	}
+	print6(fp, pkts);
 }
 
 static inline int strnullcmp(const char *a, const char *b) {
@@ -243,6 +426,9 @@ void radix_squash(void) {
 	squash(head->one, 1);
 	assert(sum == 1);
 
+	trie4.cnt = 0;
+	trie_build(head->zero, 0, 1);
+	trie_build(head->one, 1, 1);
 }
 
 static void clear_data(RNode *ptr) {
@@ -254,8 +440,11 @@ static void clear_data(RNode *ptr) {
 }
 
 void radix_clear_data(void) {
-	if (!head)
-		return;
-	clear_data(head->zero);
-	clear_data(head->one);
+	if (head) {
+		clear_data(head->zero);
+		clear_data(head->one);
+	}
+	int i;
+	for (i = 0; i < r6list_cnt; i++)
+		r6list[i].node->pkts = 0;
 }
@@ -30,6 +30,8 @@ typedef struct rnode_t {
 extern int radix_nodes;
 RNode *radix_longest_prefix_match(uint32_t ip);
 RNode*radix_add(uint32_t ip, uint32_t mask, char *name);
+RNode *radix6_longest_prefix_match(const uint8_t *ip6);
+RNode *radix6_add(const uint8_t *ip6, int len, char *name);
 void radix_print(FILE *fp, int pkts);
 void radix_squash(void);
 void radix_clear_data(void);
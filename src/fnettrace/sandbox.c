@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fnettrace.h"
+#include "../include/rundefs.h"
+#include "../include/run_record.h"
+#include <dirent.h>
+#include <sched.h>
+#include <sys/epoll.h>
+
+// The capture sockets, one for the current network namespace, or with
+// --sandboxes one in the network namespace of every sandbox started with
+// --net. A packet socket stays in the namespace it was created in, the
+// namespace is joined only for the socket setup.
+Capture **captures = NULL;
+int captures_cnt = 0;
+static unsigned long long closed_drops = 0;	// drops of the captures already closed
+static unsigned generation = 0;
+static int host_netns = -1;
+
+Capture *capture_add(int epfd, pid_t pid, char *name) {
+	Capture *cap = malloc(sizeof(Capture));
+	if (!cap)
+		errExit("malloc");
+	memset(cap, 0, sizeof(Capture));
+	cap->pid = pid;
+	cap->name = name;
+	cap->generation = generation;
+	capture_open(cap);
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = cap;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, cap->ring.sock, &ev) == -1)
+		errExit("epoll_ctl");
+
+	captures = realloc(captures, (captures_cnt + 1) * sizeof(Capture *));
+	if (!captures)
+		errExit("realloc");
+	captures[captures_cnt++] = cap;
+	return cap;
+}
+
+void capture_close(int epfd, int index) {
+	Capture *cap = captures[index];
+	epoll_ctl(epfd, EPOLL_CTL_DEL, cap->ring.sock, NULL);
+	packet_ring_stats(&cap->ring);
+	closed_drops += cap->ring.drops;
+	packet_ring_close(&cap->ring);
+	free(cap->name);
+	free(cap);
+	captures[index] = captures[--captures_cnt];
+}
+
+unsigned long long capture_drops(void) {
+	unsigned long long rv = closed_drops;
+	int i;
+	for (i = 0; i < captures_cnt; i++) {
+		packet_ring_stats(&captures[i]->ring);
+		rv += captures[i]->ring.drops;
+	}
+	return rv;
+}
+
+void capture_clear_drops(void) {
+	closed_drops = 0;
+	int i;
+	for (i = 0; i < captures_cnt; i++) {
+		packet_ring_stats(&captures[i]->ring);
+		captures[i]->ring.drops = 0;
+	}
+}
+
+// sandbox name, NULL if not found or not set
+const char *sandbox_name(pid_t pid) {
+	int i;
+	for (i = 0; i < captures_cnt; i++) {
+		if (captures[i]->pid == pid)
+			return captures[i]->name;
+	}
+	return NULL;
+}
+
+static char *read_name(pid_t pid) {
+	RunRecord rec;
+	if (run_record_read(pid, &rec) == -1 || *rec.name == '\0')
+		return NULL;
+
+	char *rv = strdup(rec.name);
+	if (!rv)
+		errExit("strdup");
+	return rv;
+}
+
+// the first process in the sandbox, from the pidfile written by the
+// firejail process; -1 if the pidfile is not locked by the firejail process
+static pid_t sandbox_child(pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_SANDBOX_DIR, pid) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_RDONLY | O_CLOEXEC);
+	free(fname);
+	if (fd < 0)
+		return -1;
+
+	struct flock lock = {
+		.l_type = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start = 0,
+		.l_len = 0,
+		.l_pid = 0,
+	};
+	if (fcntl(fd, F_GETLK, &lock) < 0 || lock.l_type == F_UNLCK || lock.l_pid != pid) {
+		close(fd);
+		return -1;
+	}
+
+	FILE *fp = fdopen(fd, "r");
+	if (!fp)
+		errExit("fdopen");
+	pid_t rv;
+	if (fscanf(fp, "%d", &rv) != 1)
+		rv = -1;
+	fclose(fp);
+	return rv;
+}
+
+// open the capture in the network namespace of the sandbox; -1 on error
+static int sandbox_capture(int epfd, pid_t pid) {
+	pid_t child = sandbox_child(pid);
+	if (child <= 0)
+		return -1;
+
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d", child);
+	int dirfd = open(path, O_PATH | O_CLOEXEC);
+	if (dirfd < 0)
+		return -1;
+	// a sandbox started with --net is in a network namespace of its own
+	int rv = join_namespace_by_fd(dirfd, "net");
+	close(dirfd);
+	if (rv)
+		return -1;
+
+	capture_add(epfd, pid, read_name(pid));
+
+	if (setns(host_netns, CLONE_NEWNET) == -1)
+		errExit("setns");
+	return 0;
+}
+
+// --sandboxes: open the captures for the new sandboxes, close the captures
+// of the sandboxes gone; the sandboxes are the RUN_FIREJAIL_NETWORK_DIR/<pid>-netmap files
+void sandbox_scan(int epfd) {
+	if (host_netns == -1) {
+		host_netns = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+		if (host_netns == -1)
+			errExit("open");
+	}
+	generation++;
+
+	DIR *dir = opendir(RUN_FIREJAIL_NETWORK_DIR);
+	if (dir) {
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			char *end;
+			pid_t pid = strtol(entry->d_name, &end, 10);
+			if (end == entry->d_name || strcmp(end, "-netmap") != 0 || pid <= 0)
+				continue;
+
+			int i;
+			for (i = 0; i < captures_cnt; i++) {
+				if (captures[i]->pid == pid) {
+					captures[i]->generation = generation;
+					break;
+				}
+			}
+			if (i == captures_cnt)
+				sandbox_capture(epfd, pid);
+		}
+		closedir(dir);
+	}
+
+	int i = 0;
+	while (i < captures_cnt) {
+		if (captures[i]->generation != generation)
+			capture_close(epfd, i);
+		else
+			i++;
+	}
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fsec_bench.h"
+#include <sys/wait.h>
+#include <signal.h>
+#include <time.h>
+
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#endif
+
+// a process running the kernel benchmark stops after BENCH_TIMEOUT seconds
+#define BENCH_TIMEOUT 60
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// the kernel runs all the filters and keeps the action with the highest
+// precedence, the lowest signed value of the action
+uint32_t bench_action(const Filter *filters, int cnt, const struct seccomp_data *data, unsigned *steps) {
+	uint32_t rv = SECCOMP_RET_ALLOW;
+	*steps = 0;
+	int i;
+	for (i = 0; i < cnt; i++) {
+		unsigned s;
+		uint32_t ret = bpf_run(filters + i, data, &s);
+		*steps += s;
+		if ((int32_t) (ret & SECCOMP_RET_ACTION_FULL) < (int32_t) (rv & SECCOMP_RET_ACTION_FULL))
+			rv = ret;
+	}
+	return rv;
+}
+
+// ns per syscall for the interpreter
+double bench_interpreter(const Filter *filters, int cnt, const struct seccomp_data *data, int syscalls, unsigned loops) {
+	volatile uint32_t sink = 0;
+	double start = now_ns();
+	unsigned l;
+	for (l = 0; l < loops; l++) {
+		int i;
+		for (i = 0; i < syscalls; i++) {
+			unsigned steps;
+			sink += bench_action(filters, cnt, data + i, &steps);
+		}
+	}
+	(void) sink;
+	return (now_ns() - start) / ((double) loops * syscalls);
+}
+
+// ns per syscall in a child process, with the filters installed if cnt is
+// not 0; the arguments are all -1, most syscalls fail early with EBADF,
+// EFAULT or EINVAL; returns -1 if the child did not finish
+double bench_kernel(const Filter *filters, int cnt, const int *nr, int syscalls, unsigned loops) {
+	// the result is passed in shared memory, the filters could block write()
+	double *result = mmap(NULL, sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (result == MAP_FAILED)
+		errExit("mmap");
+	*result = -1;
+
+	pid_t child = fork();
+	if (child == -1)
+		errExit("fork");
+	if (child == 0) {
+		// a syscall could block forever
+		alarm(BENCH_TIMEOUT);
+
+		if (cnt) {
+			if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+				errExit("prctl");
+			int i;
+			for (i = 0; i < cnt; i++) {
+				struct sock_fprog prog = {
+					.len = filters[i].entries,
+					.filter = filters[i].filter
+				};
+				if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == -1) {
+					fprintf(stderr, "Error fsec-bench: cannot install %s: %s\n", filters[i].fname, strerror(errno));
+					_exit(1);
+				}
+			}
+		}
+
+		double start = now_ns();
+		unsigned l;
+		for (l = 0; l < loops; l++) {
+			int i;
+			for (i = 0; i < syscalls; i++)
+				syscall(nr[i], -1L, -1L, -1L, -1L, -1L, -1L);
+		}
+		*result = (now_ns() - start) / ((double) loops * syscalls);
+		_exit(0);
+	}
+
+	int status;
+	if (waitpid(child, &status, 0) == -1)
+		errExit("waitpid");
+	// exit_group() could be blocked after the measure
+	if (*result < 0 && WIFSIGNALED(status)) {
+		if (WTERMSIG(status) == SIGSYS)
+			fprintf(stderr, "Error fsec-bench: the benchmark process was killed by the seccomp filter\n");
+		else if (WTERMSIG(status) == SIGALRM)
+			fprintf(stderr, "Error fsec-bench: the benchmark process timed out\n");
+		else
+			fprintf(stderr, "Error fsec-bench: the benchmark process was killed by signal %d\n", WTERMSIG(status));
+	}
+
+	double rv = *result;
+	munmap(result, sizeof(double));
+	return rv;
+}
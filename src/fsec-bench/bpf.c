@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fsec_bench.h"
+
+// classic BPF interpreter for seccomp filters, the subset of instructions
+// accepted by the kernel for seccomp
+static void __attribute__((noreturn)) bpf_error(const Filter *f, int pc, const char *msg) {
+	fprintf(stderr, "Error fsec-bench: %s, instruction %04x: %s\n", f->fname, pc, msg);
+	exit(1);
+}
+
+// check the filter once, bpf_run() only handles valid filters
+void bpf_check(const Filter *f) {
+	if (f->entries == 0 || f->entries > BPF_MAXINSNS)
+		bpf_error(f, 0, "invalid filter length");
+
+	int pc;
+	for (pc = 0; pc < f->entries; pc++) {
+		const struct sock_filter *s = f->filter + pc;
+		switch (BPF_CLASS(s->code)) {
+		case BPF_LD:
+			if (s->code == (BPF_LD | BPF_W | BPF_ABS)) {
+				if (s->k >= sizeof(struct seccomp_data) || (s->k & 3))
+					bpf_error(f, pc, "invalid seccomp_data offset");
+			}
+			else if (s->code != (BPF_LD | BPF_W | BPF_LEN) && s->code != (BPF_LD | BPF_IMM) &&
+				 s->code != (BPF_LD | BPF_MEM))
+				bpf_error(f, pc, "invalid load");
+			if (BPF_MODE(s->code) == BPF_MEM && s->k >= BPF_MEMWORDS)
+				bpf_error(f, pc, "invalid memory word");
+			break;
+		case BPF_LDX:
+			if (s->code != (BPF_LDX | BPF_W | BPF_LEN) && s->code != (BPF_LDX | BPF_IMM) &&
+			    s->code != (BPF_LDX | BPF_MEM))
+				bpf_error(f, pc, "invalid load");
+			if (BPF_MODE(s->code) == BPF_MEM && s->k >= BPF_MEMWORDS)
+				bpf_error(f, pc, "invalid memory word");
+			break;
+		case BPF_ST:
+		case BPF_STX:
+			if (s->k >= BPF_MEMWORDS)
+				bpf_error(f, pc, "invalid memory word");
+			break;
+		case BPF_ALU:
+			switch (BPF_OP(s->code)) {
+			case BPF_DIV:
+			case BPF_MOD:
+				if (BPF_SRC(s->code) == BPF_K && s->k == 0)
+					bpf_error(f, pc, "division by zero");
+				break;
+			case BPF_ADD:
+			case BPF_SUB:
+			case BPF_MUL:
+			case BPF_OR:
+			case BPF_AND:
+			case BPF_XOR:
+			case BPF_LSH:
+			case BPF_RSH:
+			case BPF_NEG:
+				break;
+			default:
+				bpf_error(f, pc, "invalid ALU operation");
+			}
+			break;
+		case BPF_JMP:
+			if (BPF_OP(s->code) == BPF_JA) {
+				if (s->k >= (uint32_t) (f->entries - pc - 1))
+					bpf_error(f, pc, "jump out of the filter");
+			}
+			else if (BPF_OP(s->code) == BPF_JEQ || BPF_OP(s->code) == BPF_JGT ||
+				 BPF_OP(s->code) == BPF_JGE || BPF_OP(s->code) == BPF_JSET) {
+				if (pc + 1 + s->jt >= f->entries || pc + 1 + s->jf >= f->entries)
+					bpf_error(f, pc, "jump out of the filter");
+			}
+			else
+				bpf_error(f, pc, "invalid jump");
+			break;
+		case BPF_RET:
+			if (BPF_RVAL(s->code) != BPF_K && BPF_RVAL(s->code) != BPF_A)
+				bpf_error(f, pc, "invalid return");
+			break;
+		case BPF_MISC:
+			if (BPF_MISCOP(s->code) != BPF_TAX && BPF_MISCOP(s->code) != BPF_TXA)
+				bpf_error(f, pc, "invalid instruction");
+			break;
+		default:
+			bpf_error(f, pc, "invalid instruction");
+		}
+	}
+
+	// the kernel requires a return at the end
+	if (BPF_CLASS(f->filter[f->entries - 1].code) != BPF_RET)
+		bpf_error(f, f->entries - 1, "the filter does not end with a return");
+}
+
+// run the filter, the number of instructions executed is returned in steps
+uint32_t bpf_run(const Filter *f, const struct seccomp_data *data, unsigned *steps) {
+	uint32_t A = 0;
+	uint32_t X = 0;
+	uint32_t mem[BPF_MEMWORDS];
+	memset(mem, 0, sizeof(mem));
+	const uint8_t *ptr = (const uint8_t *) data;
+	unsigned cnt = 0;
+
+	int pc = 0;
+	while (1) {
+		assert(pc < f->entries);
+		const struct sock_filter *s = f->filter + pc++;
+		cnt++;
+
+		uint32_t src = (BPF_SRC(s->code) == BPF_X) ? X : s->k;
+		switch (BPF_CLASS(s->code)) {
+		case BPF_LD:
+			if (BPF_MODE(s->code) == BPF_ABS)
+				memcpy(&A, ptr + s->k, sizeof(A));
+			else if (BPF_MODE(s->code) == BPF_LEN)
+				A = sizeof(struct seccomp_data);
+			else if (BPF_MODE(s->code) == BPF_IMM)
+				A = s->k;
+			else
+				A = mem[s->k];
+			break;
+		case BPF_LDX:
+			if (BPF_MODE(s->code) == BPF_LEN)
+				X = sizeof(struct seccomp_data);
+			else if (BPF_MODE(s->code) == BPF_IMM)
+				X = s->k;
+			else
+				X = mem[s->k];
+			break;
+		case BPF_ST:
+			mem[s->k] = A;
+			break;
+		case BPF_STX:
+			mem[s->k] = X;
+			break;
+		case BPF_ALU:
+			switch (BPF_OP(s->code)) {
+			case BPF_ADD:
+				A += src;
+				break;
+			case BPF_SUB:
+				A -= src;
+				break;
+			case BPF_MUL:
+				A *= src;
+				break;
+			case BPF_DIV:
+				// the kernel stops the filter on a division by zero
+				if (src == 0)
+					goto zero;
+				A /= src;
+				break;
+			case BPF_MOD:
+				if (src == 0)
+					goto zero;
+				A %= src;
+				break;
+			case BPF_OR:
+				A |= src;
+				break;
+			case BPF_AND:
+				A &= src;
+				break;
+			case BPF_XOR:
+				A ^= src;
+				break;
+			case BPF_LSH:
+				A = (src < 32) ? A << src : 0;
+				break;
+			case BPF_RSH:
+				A = (src < 32) ? A >> src : 0;
+				break;
+			case BPF_NEG:
+				A = -A;
+				break;
+			}
+			break;
+		case BPF_JMP:
+			switch (BPF_OP(s->code)) {
+			case BPF_JA:
+				pc += s->k;
+				break;
+			case BPF_JEQ:
+				pc += (A == src) ? s->jt : s->jf;
+				break;
+			case BPF_JGT:
+				pc += (A > src) ? s->jt : s->jf;
+				break;
+			case BPF_JGE:
+				pc += (A >= src) ? s->jt : s->jf;
+				break;
+			case BPF_JSET:
+				pc += (A & src) ? s->jt : s->jf;
+				break;
+			}
+			break;
+		case BPF_RET:
+			*steps = cnt;
+			return (BPF_RVAL(s->code) == BPF_A) ? A : s->k;
+		case BPF_MISC:
+			if (BPF_MISCOP(s->code) == BPF_TAX)
+				X = A;
+			else
+				A = X;
+			break;
+		}
+	}
+
+zero:
+	*steps = cnt;
+	return 0;
+}
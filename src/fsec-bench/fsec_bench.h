@@ -17,15 +17,26 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
-#include "fnettrace.h"
+#ifndef FSEC_BENCH_H
+#define FSEC_BENCH_H
+#include "../include/common.h"
+#include "../include/seccomp.h"
+#include "../include/syscall.h"
+#include <sys/mman.h>
 
-int runprog(const char *program) {
-	assert(program);
-	FILE *fp = popen(program, "r");
-	if (!fp) {
-		fprintf(stderr, "Error: cannot run %s\n", program);
-		return -1;
-	}
+typedef struct {
+	const char *fname;
+	struct sock_filter *filter;
+	int entries;
+} Filter;
 
-	return fileno(fp);
-}
+// bpf.c
+uint32_t bpf_run(const Filter *f, const struct seccomp_data *data, unsigned *steps);
+void bpf_check(const Filter *f);
+
+// bench.c
+uint32_t bench_action(const Filter *filters, int cnt, const struct seccomp_data *data, unsigned *steps);
+double bench_interpreter(const Filter *filters, int cnt, const struct seccomp_data *data, int syscalls, unsigned loops);
+double bench_kernel(const Filter *filters, int cnt, const int *nr, int syscalls, unsigned loops);
+
+#endif
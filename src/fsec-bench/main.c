@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "fsec_bench.h"
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+#define SECCOMP_RET_KILL_PROCESS 0x80000000U
+#endif
+#ifndef SECCOMP_RET_USER_NOTIF
+#define SECCOMP_RET_USER_NOTIF 0x7fc00000U
+#endif
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#endif
+
+#define DEFAULT_SYSCALLS "read,write,close,lseek,mmap,ioctl,futex,getpid"
+#define DEFAULT_LOOPS 100000
+// the kernel measures are repeated, the fastest run is reported
+#define KERNEL_RUNS 3
+
+// syscalls never run in the benchmark process, they don't return
+// or they change the process
+#define REFUSED_SYSCALLS "exit,exit_group,fork,vfork,clone,clone3,execve,execveat," \
+	"pause,alarm,rt_sigreturn,sigreturn,restart_syscall,vhangup"
+
+static const char *const usage_str =
+	"Usage:\n"
+	"\tfsec-bench [options] file [file] - benchmark seccomp filters\n"
+	"Options:\n"
+	"\t--32 - run the filters for the 32 bit syscalls, interpreter only\n"
+	"\t--loops=number - number of runs of the syscall list, default 100000\n"
+	"\t--syscalls=syscall,@group - the syscalls in the benchmark, default\n"
+	"\t\t" DEFAULT_SYSCALLS "\n";
+
+static void usage(void) {
+	puts(usage_str);
+}
+
+int arg_quiet = 0;
+void filter_add_errno(int fd, int syscall, int arg, void *ptrarg, bool native) {
+	(void) fd;
+	(void) syscall;
+	(void) arg;
+	(void) ptrarg;
+	(void) native;
+}
+
+void filter_add_blacklist_override(int fd, int syscall, int arg, void *ptrarg, bool native) {
+	(void) fd;
+	(void) syscall;
+	(void) arg;
+	(void) ptrarg;
+	(void) native;
+}
+
+static void load_filter(Filter *f, const char *fname) {
+	f->fname = fname;
+	int fd = open(fname, O_RDONLY);
+	if (fd == -1)
+		goto errexit;
+	int size = lseek(fd, 0, SEEK_END);
+	if (size == -1)
+		goto errexit;
+	f->entries = size / sizeof(struct sock_filter);
+	f->filter = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (f->filter == MAP_FAILED)
+		goto errexit;
+	close(fd);
+	bpf_check(f);
+	return;
+
+errexit:
+	fprintf(stderr, "Error fsec-bench: cannot read %s\n", fname);
+	exit(1);
+}
+
+static const char *action_str(uint32_t ret) {
+	static char buf[64];
+	switch (ret & SECCOMP_RET_ACTION_FULL) {
+	case SECCOMP_RET_KILL_PROCESS:
+		return "KILL_PROCESS";
+	case SECCOMP_RET_KILL:
+		return "KILL";
+	case SECCOMP_RET_TRAP:
+		return "TRAP";
+	case SECCOMP_RET_ERRNO:
+		snprintf(buf, sizeof(buf), "ERRNO %s", errno_find_nr(ret & SECCOMP_RET_DATA));
+		return buf;
+	case SECCOMP_RET_USER_NOTIF:
+		return "USER_NOTIF";
+	case SECCOMP_RET_TRACE:
+		return "TRACE";
+	case SECCOMP_RET_LOG:
+		return "LOG";
+	case SECCOMP_RET_ALLOW:
+		return "ALLOW";
+	default:
+		return "unknown";
+	}
+}
+
+// the syscalls run by the kernel with the filters installed
+static bool action_allows(uint32_t ret) {
+	ret &= SECCOMP_RET_ACTION_FULL;
+	return ret == SECCOMP_RET_ALLOW || ret == SECCOMP_RET_LOG;
+}
+
+static double kernel_min(const Filter *filters, int cnt, const int *nr, int syscalls, unsigned loops) {
+	double rv = -1;
+	int i;
+	for (i = 0; i < KERNEL_RUNS; i++) {
+		double ns = bench_kernel(filters, cnt, nr, syscalls, loops);
+		if (ns < 0)
+			return -1;
+		if (rv < 0 || ns < rv)
+			rv = ns;
+	}
+	return rv;
+}
+
+int main(int argc, char **argv) {
+	bool native = true;
+	unsigned loops = DEFAULT_LOOPS;
+	const char *list = DEFAULT_SYSCALLS;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-?") == 0) {
+			usage();
+			return 0;
+		}
+		else if (strcmp(argv[i], "--32") == 0)
+			native = false;
+		else if (strncmp(argv[i], "--loops=", 8) == 0) {
+			char *end;
+			loops = strtoul(argv[i] + 8, &end, 10);
+			if (*end != '\0' || loops == 0) {
+				fprintf(stderr, "Error fsec-bench: invalid number of loops %s\n", argv[i] + 8);
+				return 1;
+			}
+		}
+		else if (strncmp(argv[i], "--syscalls=", 11) == 0)
+			list = argv[i] + 11;
+		else if (*argv[i] == '-') {
+			fprintf(stderr, "Error fsec-bench: invalid option %s\n", argv[i]);
+			return 1;
+		}
+		else
+			break;
+	}
+	if (i == argc) {
+		usage();
+		return 1;
+	}
+
+	warn_dumpable();
+
+	// filters
+	int cnt = argc - i;
+	Filter *filters = malloc(cnt * sizeof(Filter));
+	if (!filters)
+		errExit("malloc");
+	int j;
+	for (j = 0; j < cnt; j++)
+		load_filter(filters + j, argv[i + j]);
+
+	// syscalls
+	SyscallSet set;
+	syscall_set_clear(&set);
+	syscall_set_build(&set, NULL, list, native);
+	if (set.rules) {
+		fprintf(stderr, "Error fsec-bench: argument rules are not supported in the syscall list\n");
+		return 1;
+	}
+	SyscallSet refused;
+	syscall_set_clear(&refused);
+	syscall_set_build(&refused, NULL, REFUSED_SYSCALLS, native);
+
+	int *nr = malloc(SYSCALL_SET_MAX * sizeof(int));
+	struct seccomp_data *data = malloc(SYSCALL_SET_MAX * sizeof(struct seccomp_data));
+	if (!nr || !data)
+		errExit("malloc");
+	int syscalls = 0;
+	for (j = 0; j < SYSCALL_SET_MAX; j++) {
+		if (!syscall_set_has(&set, j))
+			continue;
+		if (syscall_set_has(&refused, j)) {
+			fprintf(stderr, "Warning fsec-bench: %s skipped\n", (native) ? syscall_find_nr(j) : syscall_find_nr_32(j));
+			continue;
+		}
+		nr[syscalls] = j;
+		struct seccomp_data *d = data + syscalls;
+		memset(d, 0, sizeof(*d));
+		d->nr = j;
+		d->arch = (native) ? ARCH_NR : ARCH_32;
+		int k;
+		for (k = 0; k < 6; k++)
+			d->args[k] = (native) ? (uint64_t) -1 : 0xffffffff;
+		syscalls++;
+	}
+	if (syscalls == 0) {
+		fprintf(stderr, "Error fsec-bench: no syscalls to run\n");
+		return 1;
+	}
+
+	//**********************************
+	// interpreter
+	//**********************************
+	printf("%d filter%s, %d syscalls, %u loops\n", cnt, (cnt > 1) ? "s" : "", syscalls, loops);
+	printf("%-24s %-20s %s\n", "syscall", "action", "instructions");
+	unsigned total = 0;
+	unsigned max = 0;
+	int *knr = malloc(syscalls * sizeof(int));
+	if (!knr)
+		errExit("malloc");
+	int ksyscalls = 0;
+	for (j = 0; j < syscalls; j++) {
+		unsigned steps;
+		uint32_t ret = bench_action(filters, cnt, data + j, &steps);
+		printf("%-24s %-20s %u\n", (native) ? syscall_find_nr(nr[j]) : syscall_find_nr_32(nr[j]),
+		       action_str(ret), steps);
+		total += steps;
+		if (steps > max)
+			max = steps;
+		if (action_allows(ret))
+			knr[ksyscalls++] = nr[j];
+	}
+	printf("instructions per syscall: %.1f average, %u maximum\n", (double) total / syscalls, max);
+	printf("interpreter: %.1f ns per syscall\n", bench_interpreter(filters, cnt, data, syscalls, loops));
+
+	//**********************************
+	// kernel
+	//**********************************
+	if (!native)
+		printf("kernel: skipped, 32 bit syscalls\n");
+	else if (ksyscalls == 0)
+		printf("kernel: skipped, all the syscalls are blocked\n");
+	else {
+		// the same syscalls are run with and without the filters
+		if (ksyscalls < syscalls)
+			printf("kernel: %d syscalls allowed by the filters\n", ksyscalls);
+		double with = kernel_min(filters, cnt, knr, ksyscalls, loops);
+		double without = kernel_min(NULL, 0, knr, ksyscalls, loops);
+		if (with < 0 || without < 0)
+			return 1;
+		printf("kernel: %.1f ns per syscall with the filters, %.1f ns without, %.1f ns filter cost\n",
+		       with, without, with - without);
+	}
+
+	free(knr);
+	free(data);
+	free(nr);
+	for (j = 0; j < cnt; j++)
+		munmap(filters[j].filter, filters[j].entries * sizeof(struct sock_filter));
+	free(filters);
+	return 0;
+}
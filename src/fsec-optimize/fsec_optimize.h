@@ -23,6 +23,9 @@
 #include "../include/seccomp.h"
 #include <sys/mman.h>
 
+// main.c
+extern int arg_stats;
+
 // optimize.c
 struct sock_filter *duplicate(struct sock_filter *filter, int entries);
 int optimize(struct sock_filter * filter, int entries);
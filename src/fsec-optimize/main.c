@@ -21,10 +21,11 @@
 #include "../include/syscall.h"
 
 int arg_seccomp_error_action = SECCOMP_RET_ERRNO | EPERM; // error action: errno, log or kill
+int arg_stats = 0;
 
 static const char *const usage_str =
 	"Usage:\n"
-	"\tfsec-optimize file - optimize seccomp filter\n";
+	"\tfsec-optimize [--stats] file - optimize seccomp filter\n";
 
 static void usage(void) {
 	puts(usage_str);
@@ -40,6 +41,11 @@ for (i = 0; i < argc; i++)
 printf("\n");
 }
 #endif
+	if (argc == 3 && strcmp(argv[1], "--stats") == 0) {
+		arg_stats = 1;
+		argc--;
+		argv++;
+	}
 	if (argc != 2) {
 		usage();
 		return 1;
@@ -85,8 +91,12 @@ printf("\n");
 		goto errexit;
 	close(fd);
 
-	// duplicate the filter memory and unmap the file
-	struct sock_filter *outfilter = duplicate(filter, entries);
+	// duplicate the filter memory and unmap the file; the optimized
+	// filter can be longer than the original, up to BPF_MAXINSNS
+	struct sock_filter *outfilter = malloc(sizeof(struct sock_filter) * ((entries > BPF_MAXINSNS) ? entries : BPF_MAXINSNS));
+	if (!outfilter)
+		errExit("malloc");
+	memcpy(outfilter, filter, sizeof(struct sock_filter) * entries);
 	if (munmap(filter, size) == -1)
 		perror("Error un-mmapping the file");
 
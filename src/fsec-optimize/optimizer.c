@@ -28,98 +28,521 @@
 //};
 
 
-#define LIMIT_BLACKLISTS 4	// we optimize blacklists only if we have more than
+#define LIMIT_RULES 4	// we build a decision tree only if we have more rules than this
 
-static inline int is_blacklist(struct sock_filter *bpf) {
-	if (bpf->code == BPF_JMP + BPF_JEQ + BPF_K &&
-	    (bpf + 1)->code == BPF_RET + BPF_K &&
-	    (bpf + 1)->k == (__u32)arg_seccomp_error_action)
-		return 1;
-	return 0;
+//**********************************
+// binary decision tree
+//**********************************
+// Filters built by fseccomp are a prologue ending in "ld [nr]", followed
+// by a chain of "jeq nr; ret action" pairs and a final "ret default".
+// A syscall with argument rules has "jeq nr 0 len" and a block of len
+// statements instead of the ret, every path in the block ends in a ret.
+// The chain is replaced with a balanced tree of "jge" statements over the
+// sorted syscall numbers, contiguous numbers with the same action are
+// merged in a single range. The blocks are copied in the tree leaves.
+typedef struct {
+	__u32 nr;
+	__u32 action;
+	int block;	// start of the block in the chain, -1 for a ret
+	int len;	// statements in the leaf
+	int order;
+} Rule;
+
+typedef struct {
+	__u32 lo;	// the range ends where the next one starts
+	__u32 action;
+	int block;
+	int len;
+} Range;
+
+static int rule_cmp(const void *p1, const void *p2) {
+	const Rule *r1 = p1;
+	const Rule *r2 = p2;
+	if (r1->nr != r2->nr)
+		return (r1->nr < r2->nr) ? -1 : 1;
+	return r1->order - r2->order;
+}
+
+// add a range starting at lo, merging it with the previous ranges
+static void range_push(Range *range, int *rcnt, __u32 lo, __u32 action, int block, int len) {
+	if (*rcnt > 0 && range[*rcnt - 1].lo == lo)
+		(*rcnt)--;
+	if (*rcnt > 0 && block == -1 && range[*rcnt - 1].block == -1 &&
+	    range[*rcnt - 1].action == action)
+		return;
+	range[*rcnt].lo = lo;
+	range[*rcnt].action = action;
+	range[*rcnt].block = block;
+	range[*rcnt].len = len;
+	(*rcnt)++;
+}
+
+// start of the syscall chain, -1 if the filter is not in the expected form
+static int tree_chain_start(struct sock_filter *filter, int entries) {
+	int i;
+	for (i = 0; i < entries; i++) {
+		if (filter[i].code == BPF_LD + BPF_W + BPF_ABS &&
+		    filter[i].k == offsetof(struct seccomp_data, nr))
+			break;
+	}
+	if (i == entries)
+		return -1;
+	int start = i + 1;
+
+#if defined(__x86_64__)
+	// HANDLE_X32
+	if (start + 3 <= entries &&
+	    filter[start].code == BPF_JMP + BPF_JGE + BPF_K && filter[start].k == X32_SYSCALL_BIT &&
+	    filter[start + 1].code == BPF_JMP + BPF_JGE + BPF_K && filter[start + 1].k == 0 &&
+	    BPF_CLASS(filter[start + 2].code) == BPF_RET)
+		start += 3;
+#endif
+
+	// the prologue cannot jump over the start of the chain
+	for (i = 0; i < start; i++) {
+		if (BPF_CLASS(filter[i].code) != BPF_JMP)
+			continue;
+		if (BPF_OP(filter[i].code) == BPF_JA ||
+		    i + 1 + filter[i].jt > start || i + 1 + filter[i].jf > start)
+			return -1;
+	}
+	return start;
 }
 
-static int count_blacklists(struct sock_filter *filter, int entries) {
+// statements after the syscall check at pos, 0 if it is not a syscall check
+// followed by a ret or by a block ending before end
+static int tree_chain_item(struct sock_filter *filter, int pos, int end) {
+	struct sock_filter *jeq = filter + pos;
+	if (jeq->code != BPF_JMP + BPF_JEQ + BPF_K || jeq->jt != 0 || jeq->jf == 0)
+		return 0;
+	int last = pos + jeq->jf;
+	if (last >= end || BPF_CLASS(filter[last].code) != BPF_RET)
+		return 0;
+
+	int i;
+	for (i = pos + 1; i < last; i++) {
+		struct sock_filter *f = filter + i;
+		if (BPF_CLASS(f->code) != BPF_JMP)
+			continue;
+		if (BPF_OP(f->code) == BPF_JA) {
+			if (i + 1 + f->k > (__u32) last)
+				return 0;
+		}
+		else if (i + 1 + f->jt > last || i + 1 + f->jf > last)
+			return 0;
+	}
+	return jeq->jf;
+}
+
+// number of statements for ranges a..b
+static int tree_size(Range *range, int a, int b) {
+	if (a == b)
+		return range[a].len;
+	int mid = (a + b + 1) / 2;
+	int left = tree_size(range, a, mid - 1);
+	return 1 + ((left > 255) ? 1 : 0) + left + tree_size(range, mid, b);
+}
+
+static struct sock_filter *tree_emit(struct sock_filter *out, Range *range, int a, int b, struct sock_filter *chain) {
+	if (a == b) {
+		if (range[a].block != -1) {
+			memcpy(out, chain + range[a].block, range[a].len * sizeof(struct sock_filter));
+			return out + range[a].len;
+		}
+		out->code = BPF_RET + BPF_K;
+		out->jt = out->jf = 0;
+		out->k = range[a].action;
+		return out + 1;
+	}
+
+	// jump to the ranges starting at mid if nr >= range[mid].lo
+	int mid = (a + b + 1) / 2;
+	int left = tree_size(range, a, mid - 1);
+	out->code = BPF_JMP + BPF_JGE + BPF_K;
+	out->k = range[mid].lo;
+	if (left > 255) {
+		// jt/jf are only 8 bits wide
+		out->jt = 0;
+		out->jf = 1;
+		out++;
+		out->code = BPF_JMP + BPF_JA;
+		out->jt = out->jf = 0;
+		out->k = left;
+	}
+	else {
+		out->jt = left;
+		out->jf = 0;
+	}
+	out = tree_emit(out + 1, range, a, mid - 1, chain);
+	return tree_emit(out, range, mid, b, chain);
+}
+
+static int optimize_tree(struct sock_filter *filter, int entries) {
+	int start = tree_chain_start(filter, entries);
+	if (start == -1 || start >= entries)
+		return entries;
+	if (BPF_CLASS(filter[entries - 1].code) != BPF_RET || BPF_RVAL(filter[entries - 1].code) != BPF_K)
+		return entries;
+	__u32 def = filter[entries - 1].k;
+
+	// extract the rules
+	Rule *rule = malloc(entries * sizeof(Rule));
+	if (!rule)
+		errExit("malloc");
 	int cnt = 0;
+	int pos = start;
+	while (pos < entries - 1) {
+		int len = tree_chain_item(filter, pos, entries - 1);
+		if (len == 0) {
+			free(rule);
+			return entries;
+		}
+		rule[cnt].nr = filter[pos].k;
+		rule[cnt].action = filter[pos + 1].k;
+		rule[cnt].block = (len == 1) ? -1 : pos + 1 - start;
+		rule[cnt].len = len;
+		rule[cnt].order = cnt;
+		cnt++;
+		pos += 1 + len;
+	}
+	if (cnt <= LIMIT_RULES) {
+		free(rule);
+		return entries;
+	}
+
+	// sort, the first rule for a syscall number wins
+	qsort(rule, cnt, sizeof(Rule), rule_cmp);
+
+	// ranges covering all the 32 bit values
+	Range *range = malloc((2 * cnt + 1) * sizeof(Range));
+	if (!range)
+		errExit("malloc");
+	int rcnt = 0;
+	range_push(range, &rcnt, 0, def, -1, 1);
 	int i;
+	for (i = 0; i < cnt; i++) {
+		if (i > 0 && rule[i].nr == rule[i - 1].nr)
+			continue;
+		range_push(range, &rcnt, rule[i].nr, rule[i].action, rule[i].block, rule[i].len);
+		if (rule[i].nr != 0xffffffff)
+			range_push(range, &rcnt, rule[i].nr + 1, def, -1, 1);
+	}
+	free(rule);
 
-	for (i = 0; i < (entries - 1); i++, filter++) { // is_blacklist works on two consecutive lines; using entries - 1
-		if (is_blacklist(filter))
-			cnt++;
+	int size = tree_size(range, 0, rcnt - 1);
+	if (start + size > BPF_MAXINSNS) {
+		free(range);
+		return entries;
 	}
 
-	return cnt;
+	// the tree overwrites the chain, the blocks are copied from a saved chain
+	struct sock_filter *chain = duplicate(filter + start, entries - start);
+	struct sock_filter *end = tree_emit(filter + start, range, 0, rcnt - 1, chain);
+	free(chain);
+	free(range);
+	assert(end - filter == start + size);
+	return start + size;
 }
 
+//**********************************
+// pass pipeline
+//**********************************
+// The passes work on absolute jump targets; the filter is converted back
+// to relative offsets at the end. Jumps only go forward, so a single walk
+// in program order visits every instruction after all its predecessors.
 typedef struct {
-	int to_remove;
-	int to_fix_jumps;
-} Action;
+	struct sock_filter f;
+	int jt;		// absolute targets, jt is also used by ja
+	int jf;
+	int removed;
+} Node;
 
-static int optimize_blacklists(struct sock_filter *filter, int entries) {
-	assert(entries);
-	assert(filter);
+static inline int is_jump(Node *n) {
+	return BPF_CLASS(n->f.code) == BPF_JMP;
+}
+
+static inline int is_ja(Node *n) {
+	return n->f.code == BPF_JMP + BPF_JA;
+}
+
+static inline int is_ret(Node *n) {
+	return BPF_CLASS(n->f.code) == BPF_RET;
+}
+
+// conditional jumps are limited to 8 bit offsets
+static inline int cond_fits(int from, int to) {
+	return to > from && to - from - 1 <= 255;
+}
+
+static Node *nodes_build(struct sock_filter *filter, int entries) {
+	Node *node = calloc(entries, sizeof(Node));
+	if (!node)
+		errExit("calloc");
+
+	int i;
+	for (i = 0; i < entries; i++) {
+		Node *n = node + i;
+		n->f = filter[i];
+		if (is_ja(n))
+			n->jt = i + 1 + filter[i].k;
+		else if (is_jump(n)) {
+			n->jt = i + 1 + filter[i].jt;
+			n->jf = i + 1 + filter[i].jf;
+		}
+		else
+			continue;
+
+		// a filter the kernel would reject is left alone
+		if (n->jt >= entries || (!is_ja(n) && n->jf >= entries)) {
+			free(node);
+			return NULL;
+		}
+	}
+	if (!is_ret(node + entries - 1)) {
+		free(node);
+		return NULL;
+	}
+	return node;
+}
+
+// follow the target of a branch through ja statements, and through
+// conditional jumps testing the same condition the branch just tested
+static int thread_target(Node *node, int from, int target, int taken) {
+	Node *src = node + from;
+	int cnt = 0;
+	while (cnt++ < 64) {
+		Node *t = node + target;
+		int next;
+		if (t->removed)
+			next = target + 1;
+		else if (is_ja(t))
+			next = t->jt;
+		else if (!is_ja(src) && is_jump(t) && t->f.code == src->f.code && t->f.k == src->f.k)
+			next = (taken) ? t->jt : t->jf;
+		else
+			break;
+
+		if (!is_ja(src) && !cond_fits(from, next))
+			break;
+		target = next;
+	}
+	return target;
+}
+
+static int pass_thread(Node *node, int entries) {
+	int changes = 0;
+	int i;
+	for (i = 0; i < entries; i++) {
+		Node *n = node + i;
+		if (n->removed || !is_jump(n))
+			continue;
+
+		int jt = thread_target(node, i, n->jt, 1);
+		int jf = (is_ja(n)) ? 0 : thread_target(node, i, n->jf, 0);
+		if (jt != n->jt || (!is_ja(n) && jf != n->jf))
+			changes++;
+		n->jt = jt;
+		n->jf = jf;
+
+		if (is_ja(n) && is_ret(node + n->jt)) {
+			// ja to a ret statement: return directly
+			n->f = node[n->jt].f;
+			changes++;
+		}
+		else if (!is_ja(n) && n->jt == n->jf) {
+			// both branches go to the same place
+			n->f.code = BPF_JMP + BPF_JA;
+			n->f.jt = n->f.jf = 0;
+			changes++;
+		}
+	}
+	return changes;
+}
+
+// point the branches to a ret statement to the last identical ret in reach,
+// the local copies become dead code
+static int pass_merge_ret(Node *node, int entries) {
+	int changes = 0;
 	int i;
-	int j;
-
-	// step1: extract information
-	Action action[entries];
-	memset(&action[0], 0, sizeof(Action) * entries);
-	int remove_cnt = 0;
-	for (i = 0; i < (entries - 1); i++) { // is_blacklist works on two consecutive lines; using entries - 1
-		if (is_blacklist(filter + i)) {
-			action[i]. to_fix_jumps = 1;
-			i++;
-			action[i].to_remove = 1;
-			remove_cnt++;
+	for (i = 0; i < entries; i++) {
+		Node *n = node + i;
+		if (n->removed || !is_jump(n))
+			continue;
+
+		int *target[2] = { &n->jt, &n->jf };
+		int b;
+		for (b = 0; b < ((is_ja(n)) ? 1 : 2); b++) {
+			Node *t = node + *target[b];
+			if (!is_ret(t))
+				continue;
+			int limit = (is_ja(n)) ? entries - 1 : i + 1 + 255;
+			if (limit > entries - 1)
+				limit = entries - 1;
+			int j;
+			for (j = limit; j > *target[b]; j--) {
+				if (!node[j].removed && is_ret(node + j) &&
+				    node[j].f.code == t->f.code && node[j].f.k == t->f.k) {
+					*target[b] = j;
+					changes++;
+					break;
+				}
+			}
 		}
 	}
+	return changes;
+}
+
+// accumulator contents: a load from seccomp_data, or unknown
+#define ACC_UNSET -2
+#define ACC_UNKNOWN -1
+static inline void acc_meet(int *acc, int val) {
+	if (*acc == ACC_UNSET)
+		*acc = val;
+	else if (*acc != val)
+		*acc = ACC_UNKNOWN;
+}
 
-	// step2: remove lines
-	struct sock_filter *filter_step2 = duplicate(filter, entries);
-	Action action_step2[entries];
-	memset(&action_step2[0], 0, sizeof(Action) * entries);
-	for (i = 0, j = 0; i < entries; i++) {
-		if (!action[i].to_remove) {
-			memcpy(&filter_step2[j], &filter[i], sizeof(struct sock_filter));
-			memcpy(&action_step2[j], &action[i], sizeof(Action));
-			j++;
+// remove reloads of a value already in the accumulator, and unreachable code
+static int pass_dead(Node *node, int entries) {
+	int changes = 0;
+	int *acc = malloc(entries * sizeof(int));
+	if (!acc)
+		errExit("malloc");
+	int i;
+	for (i = 0; i < entries; i++)
+		acc[i] = ACC_UNSET;
+	acc[0] = ACC_UNKNOWN;
+
+	for (i = 0; i < entries; i++) {
+		Node *n = node + i;
+		int in = acc[i];
+		if (n->removed) {
+			if (in != ACC_UNSET && i + 1 < entries)
+				acc_meet(&acc[i + 1], in);
+			continue;
 		}
-		else {
-			// do nothing, we are removing this line
+		if (in == ACC_UNSET) {
+			// not reachable
+			n->removed = 1;
+			changes++;
+			continue;
+		}
+
+		if (is_ret(n))
+			continue;
+		if (is_jump(n)) {
+			acc_meet(&acc[n->jt], in);
+			if (!is_ja(n))
+				acc_meet(&acc[n->jf], in);
+			continue;
+		}
+
+		int out = ACC_UNKNOWN;
+		if (n->f.code == BPF_LD + BPF_W + BPF_ABS) {
+			if (in == (int) n->f.k) {
+				n->removed = 1;
+				changes++;
+			}
+			out = n->f.k;
+		}
+		else if (BPF_CLASS(n->f.code) == BPF_ST || BPF_CLASS(n->f.code) == BPF_STX ||
+			 BPF_CLASS(n->f.code) == BPF_LDX)
+			out = in;
+		acc_meet(&acc[i + 1], out);
+	}
+
+	// ja to the next statement left in the filter
+	for (i = 0; i < entries; i++) {
+		Node *n = node + i;
+		if (n->removed || !is_ja(n))
+			continue;
+		int j;
+		for (j = i + 1; j < n->jt && node[j].removed; j++);
+		if (j == n->jt) {
+			n->removed = 1;
+			changes++;
 		}
 	}
 
-	// step 3: add the new ret KILL/LOG/ERRNO, and recalculate entries
-	filter_step2[j].code = BPF_RET + BPF_K;
-	filter_step2[j].k = arg_seccomp_error_action;
-	entries = j + 1;
+	free(acc);
+	return changes;
+}
 
-	// step 4: recalculate jumps
+static int nodes_store(Node *node, int entries, struct sock_filter *filter) {
+	// new position of each statement, removed statements fall through
+	// to the next one left in the filter
+	int *pos = malloc((entries + 1) * sizeof(int));
+	if (!pos)
+		errExit("malloc");
+	int i;
+	int cnt = 0;
 	for (i = 0; i < entries; i++) {
-		if (action_step2[i].to_fix_jumps) {
-			filter_step2[i].jt = entries - i - 2;
-			filter_step2[i].jf = 0;
+		pos[i] = cnt;
+		if (!node[i].removed)
+			cnt++;
+	}
+	pos[entries] = cnt;
+
+	for (i = 0; i < entries; i++) {
+		Node *n = node + i;
+		if (n->removed)
+			continue;
+		struct sock_filter *f = filter + pos[i];
+		*f = n->f;
+		if (is_ja(n))
+			f->k = pos[n->jt] - pos[i] - 1;
+		else if (is_jump(n)) {
+			assert(pos[n->jt] - pos[i] - 1 <= 255);
+			assert(pos[n->jf] - pos[i] - 1 <= 255);
+			f->jt = pos[n->jt] - pos[i] - 1;
+			f->jf = pos[n->jf] - pos[i] - 1;
 		}
 	}
+	free(pos);
+	return cnt;
+}
+
+static int optimize_passes(struct sock_filter *filter, int entries) {
+	Node *node = nodes_build(filter, entries);
+	if (!node)
+		return entries;
+
+	int round;
+	for (round = 0; round < 8; round++) {
+		int changes = pass_thread(node, entries);
+		changes += pass_merge_ret(node, entries);
+		changes += pass_dead(node, entries);
+		if (!changes)
+			break;
+	}
 
-	// update
-	memcpy(filter, filter_step2, entries * sizeof(struct sock_filter));
-	free(filter_step2);
+	entries = nodes_store(node, entries, filter);
+	free(node);
 	return entries;
 }
 
 int optimize(struct sock_filter *filter, int entries) {
 	assert(filter);
 	assert(entries);
+	int start = entries;
 
 	//**********************************
-	// optimize blacklist statements
+	// build a decision tree for the syscall chain
 	//**********************************
-	// count "ret KILL"
-	int cnt = count_blacklists(filter, entries);
-	if (cnt > LIMIT_BLACKLISTS)
-		entries = optimize_blacklists(filter, entries);
-	return entries;
+	int rv = optimize_tree(filter, entries);
+	if (arg_stats)
+		printf("decision tree: %d -> %d instructions\n", entries, rv);
+	entries = rv;
+
+	//**********************************
+	// generic passes
+	//**********************************
+	rv = optimize_passes(filter, entries);
+	if (arg_stats) {
+		printf("thread jumps, merge returns, remove dead code: %d -> %d instructions\n", entries, rv);
+		printf("total: %d -> %d instructions\n", start, rv);
+	}
+	return rv;
 }
 
 struct sock_filter *duplicate(struct sock_filter *filter, int entries) {
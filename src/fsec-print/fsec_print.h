@@ -24,7 +24,11 @@
 #include "../include/syscall.h"
 #include <sys/mman.h>
 
+// main.c
+extern int arg_summary;
+extern int arg_jsonl;
+
 // print.c
-void print(struct sock_filter *filter, int entries);
+void print(const char *fname, struct sock_filter *filter, int entries);
 
 #endif
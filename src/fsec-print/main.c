@@ -21,13 +21,19 @@
 
 static const char *const usage_str =
 	"Usage:\n"
-	"\tfsec-print file - disassemble seccomp filter\n";
+	"\tfsec-print [options] file - disassemble seccomp filter\n"
+	"Options:\n"
+	"\t--format=jsonl - print a JSON object for every instruction, or for the\n"
+	"\t\tsummary\n"
+	"\t--summary - print the syscalls grouped by the action of the filter\n";
 
 static void usage(void) {
 	puts(usage_str);
 }
 
 int arg_quiet = 0;
+int arg_summary = 0;
+int arg_jsonl = 0;
 void filter_add_errno(int fd, int syscall, int arg, void *ptrarg, bool native) {
 	(void) fd;
 	(void) syscall;
@@ -54,19 +60,32 @@ for (i = 0; i < argc; i++)
 printf("\n");
 }
 #endif
-	if (argc != 2) {
+	int i;
+	for (i = 1; i < argc - 1; i++) {
+		if (strcmp(argv[i], "--summary") == 0)
+			arg_summary = 1;
+		else if (strcmp(argv[i], "--format=jsonl") == 0)
+			arg_jsonl = 1;
+		else if (strncmp(argv[i], "--format=", 9) == 0) {
+			fprintf(stderr, "Error: invalid output format %s\n", argv[i] + 9);
+			return 1;
+		}
+		else
+			break;
+	}
+	if (i != argc - 1) {
 		usage();
 		return 1;
 	}
 
-	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") == 0) {
+	if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-?") == 0) {
 		usage();
 		return 0;
 	}
 
 	warn_dumpable();
 
-	char *fname = argv[1];
+	char *fname = argv[i];
 
 	// open input file
 	int fd = open(fname, O_RDONLY);
@@ -86,7 +105,7 @@ printf("\n");
 
 
 	// print filter
-	print(filter, entries);
+	print(fname, filter, entries);
 
 	// free mapped memory
 	if (munmap(filter, size) == -1)
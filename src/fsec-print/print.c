@@ -52,281 +52,557 @@
 //	__u32	k;      /* Generic multiuse field */
 //};
 
+// the mnemonics, indexed by instruction code
+#define LD_MODES(size) \
+	[size+BPF_IMM] = NAME, [size+BPF_ABS] = NAME, [size+BPF_IND] = NAME, \
+	[size+BPF_MEM] = NAME, [size+BPF_LEN] = NAME, [size+BPF_MSH] = NAME
+#define KX(code) [code+BPF_K] = NAME, [code+BPF_X] = NAME
+#define OP_TABLE_SIZE 256
+static const char *const op_table[OP_TABLE_SIZE] = {
+#define NAME "ld"
+	LD_MODES(BPF_LD+BPF_W),
+#undef NAME
+#define NAME "ldh"
+	LD_MODES(BPF_LD+BPF_H),
+#undef NAME
+#define NAME "ldb"
+	LD_MODES(BPF_LD+BPF_B),
+#undef NAME
+#define NAME "ldx"
+	LD_MODES(BPF_LDX+BPF_W),
+	LD_MODES(BPF_LDX+BPF_H),
+	LD_MODES(BPF_LDX+BPF_B),
+#undef NAME
+	[BPF_ST] = "st",
+	[BPF_STX] = "stx",
+#define NAME "add"
+	KX(BPF_ALU+BPF_ADD),
+#undef NAME
+#define NAME "sub"
+	KX(BPF_ALU+BPF_SUB),
+#undef NAME
+#define NAME "mul"
+	KX(BPF_ALU+BPF_MUL),
+#undef NAME
+#define NAME "div"
+	KX(BPF_ALU+BPF_DIV),
+#undef NAME
+#define NAME "or"
+	KX(BPF_ALU+BPF_OR),
+#undef NAME
+#define NAME "and"
+	KX(BPF_ALU+BPF_AND),
+#undef NAME
+#define NAME "lsh"
+	KX(BPF_ALU+BPF_LSH),
+#undef NAME
+#define NAME "rsh"
+	KX(BPF_ALU+BPF_RSH),
+#undef NAME
+#define NAME "neg"
+	KX(BPF_ALU+BPF_NEG),
+#undef NAME
+#define NAME "mod"
+	KX(BPF_ALU+BPF_MOD),
+#undef NAME
+#define NAME "xor"
+	KX(BPF_ALU+BPF_XOR),
+#undef NAME
+#define NAME "jmp"
+	KX(BPF_JMP+BPF_JA),
+#undef NAME
+#define NAME "jeq"
+	KX(BPF_JMP+BPF_JEQ),
+#undef NAME
+#define NAME "jgt"
+	KX(BPF_JMP+BPF_JGT),
+#undef NAME
+#define NAME "jge"
+	KX(BPF_JMP+BPF_JGE),
+#undef NAME
+#define NAME "jset"
+	KX(BPF_JMP+BPF_JSET),
+#undef NAME
+#define NAME "ret"
+	KX(BPF_RET),
+	[BPF_RET+BPF_A] = NAME,
+#undef NAME
+	[BPF_MISC+BPF_TAX] = "tax",
+	[BPF_MISC+BPF_TXA] = "txa",
+};
+#undef LD_MODES
+#undef KX
 
 static const char *bpf_decode_op(const struct sock_filter *bpf) {
-	switch (bpf->code) {
-	case BPF_LD+BPF_W+BPF_IMM:
-	case BPF_LD+BPF_W+BPF_ABS:
-	case BPF_LD+BPF_W+BPF_IND:
-	case BPF_LD+BPF_W+BPF_MEM:
-	case BPF_LD+BPF_W+BPF_LEN:
-	case BPF_LD+BPF_W+BPF_MSH:
-		return "ld";
-	case BPF_LD+BPF_H+BPF_IMM:
-	case BPF_LD+BPF_H+BPF_ABS:
-	case BPF_LD+BPF_H+BPF_IND:
-	case BPF_LD+BPF_H+BPF_MEM:
-	case BPF_LD+BPF_H+BPF_LEN:
-	case BPF_LD+BPF_H+BPF_MSH:
-		return "ldh";
-	case BPF_LD+BPF_B+BPF_IMM:
-	case BPF_LD+BPF_B+BPF_ABS:
-	case BPF_LD+BPF_B+BPF_IND:
-	case BPF_LD+BPF_B+BPF_MEM:
-	case BPF_LD+BPF_B+BPF_LEN:
-	case BPF_LD+BPF_B+BPF_MSH:
-		return "ldb";
-	case BPF_LDX+BPF_W+BPF_IMM:
-	case BPF_LDX+BPF_W+BPF_ABS:
-	case BPF_LDX+BPF_W+BPF_IND:
-	case BPF_LDX+BPF_W+BPF_MEM:
-	case BPF_LDX+BPF_W+BPF_LEN:
-	case BPF_LDX+BPF_W+BPF_MSH:
-	case BPF_LDX+BPF_H+BPF_IMM:
-	case BPF_LDX+BPF_H+BPF_ABS:
-	case BPF_LDX+BPF_H+BPF_IND:
-	case BPF_LDX+BPF_H+BPF_MEM:
-	case BPF_LDX+BPF_H+BPF_LEN:
-	case BPF_LDX+BPF_H+BPF_MSH:
-	case BPF_LDX+BPF_B+BPF_IMM:
-	case BPF_LDX+BPF_B+BPF_ABS:
-	case BPF_LDX+BPF_B+BPF_IND:
-	case BPF_LDX+BPF_B+BPF_MEM:
-	case BPF_LDX+BPF_B+BPF_LEN:
-	case BPF_LDX+BPF_B+BPF_MSH:
-		return "ldx";
-	case BPF_ST:
-		return "st";
-	case BPF_STX:
-		return "stx";
-	case BPF_ALU+BPF_ADD+BPF_K:
-	case BPF_ALU+BPF_ADD+BPF_X:
-		return "add";
-	case BPF_ALU+BPF_SUB+BPF_K:
-	case BPF_ALU+BPF_SUB+BPF_X:
-		return "sub";
-	case BPF_ALU+BPF_MUL+BPF_K:
-	case BPF_ALU+BPF_MUL+BPF_X:
-		return "mul";
-	case BPF_ALU+BPF_DIV+BPF_K:
-	case BPF_ALU+BPF_DIV+BPF_X:
-		return "div";
-	case BPF_ALU+BPF_OR+BPF_K:
-	case BPF_ALU+BPF_OR+BPF_X:
-		return "or";
-	case BPF_ALU+BPF_AND+BPF_K:
-	case BPF_ALU+BPF_AND+BPF_X:
-		return "and";
-	case BPF_ALU+BPF_LSH+BPF_K:
-	case BPF_ALU+BPF_LSH+BPF_X:
-		return "lsh";
-	case BPF_ALU+BPF_RSH+BPF_K:
-	case BPF_ALU+BPF_RSH+BPF_X:
-		return "rsh";
-	case BPF_ALU+BPF_NEG+BPF_K:
-	case BPF_ALU+BPF_NEG+BPF_X:
-		return "neg";
-	case BPF_ALU+BPF_MOD+BPF_K:
-	case BPF_ALU+BPF_MOD+BPF_X:
-		return "mod";
-	case BPF_ALU+BPF_XOR+BPF_K:
-	case BPF_ALU+BPF_XOR+BPF_X:
-		return "xor";
-	case BPF_JMP+BPF_JA+BPF_K:
-	case BPF_JMP+BPF_JA+BPF_X:
-		return "jmp";
-	case BPF_JMP+BPF_JEQ+BPF_K:
-	case BPF_JMP+BPF_JEQ+BPF_X:
-		return "jeq";
-	case BPF_JMP+BPF_JGT+BPF_K:
-	case BPF_JMP+BPF_JGT+BPF_X:
-		return "jgt";
-	case BPF_JMP+BPF_JGE+BPF_K:
-	case BPF_JMP+BPF_JGE+BPF_X:
-		return "jge";
-	case BPF_JMP+BPF_JSET+BPF_K:
-	case BPF_JMP+BPF_JSET+BPF_X:
-		return "jset";
-	case BPF_RET+BPF_K:
-	case BPF_RET+BPF_X:
-	case BPF_RET+BPF_A:
-		return "ret";
-	case BPF_MISC+BPF_TAX:
-		return "tax";
-	case BPF_MISC+BPF_TXA:
-		return "txa";
-	}
-	return "???";
+	if (bpf->code >= OP_TABLE_SIZE || !op_table[bpf->code])
+		return "???";
+	return op_table[bpf->code];
 }
 
-static void bpf_decode_action(uint32_t k) {
+static void bpf_decode_action(uint32_t k, char *buf, size_t size) {
 	uint32_t act = k & SECCOMP_RET_ACTION;
 	uint32_t data = k & SECCOMP_RET_DATA;
 
 	switch (act) {
 	case SECCOMP_RET_KILL:
-		printf("KILL");
+		snprintf(buf, size, "KILL");
 		break;
 	case SECCOMP_RET_TRAP:
-		printf("TRAP");
+		snprintf(buf, size, "TRAP");
 		break;
 	case SECCOMP_RET_ERRNO:
-		printf("ERRNO(%u)", data);
+		snprintf(buf, size, "ERRNO(%u)", data);
 		break;
 	case SECCOMP_RET_TRACE:
-		printf("TRACE(%u)", data);
+		snprintf(buf, size, "TRACE(%u)", data);
 		break;
 	case SECCOMP_RET_LOG:
-		printf("LOG");
+		snprintf(buf, size, "LOG");
 		break;
 	case SECCOMP_RET_ALLOW:
-		printf("ALLOW");
+		snprintf(buf, size, "ALLOW");
 		break;
 	default:
-		printf("0x%.8x", k);
+		snprintf(buf, size, "0x%.8x", k);
 	}
 }
 
+// the fields of struct seccomp_data loaded by the filter
+static const char *bpf_decode_field(uint32_t k) {
+	if (k == offsetof(struct seccomp_data, arch))
+		return "data.architecture";
+	if (k == offsetof(struct seccomp_data, nr))
+		return "data.syscall-number";
+	if (k == offsetof(struct seccomp_data, instruction_pointer))
+		return "data.instruction_pointer";
+	return NULL;
+}
 
 // implementing a simple state machine around accumulator
 // in order to translate the syscall number
 int syscall_loaded = 0;
 int native_arch = 0;
 
-static void bpf_decode_args(const struct sock_filter *bpf, unsigned int line) {
+static void bpf_decode_args(const struct sock_filter *bpf, unsigned int line, char *buf, size_t size) {
+	*buf = '\0';
 	switch (BPF_CLASS(bpf->code)) {
 	case BPF_LD:
 	case BPF_LDX:
 		switch (BPF_MODE(bpf->code)) {
-		case BPF_ABS:
-			syscall_loaded = 0;
-			if (bpf->k == offsetof(struct seccomp_data, arch))
-				printf("data.architecture");
-			else if (bpf->k == offsetof(struct seccomp_data, nr)) {
-				printf("data.syscall-number");
-				syscall_loaded = 1;
-			}
-			else if (bpf->k == offsetof(struct seccomp_data, instruction_pointer))
-				printf("data.instruction_pointer");
+		case BPF_ABS: {
+			const char *field = bpf_decode_field(bpf->k);
+			syscall_loaded = (bpf->k == offsetof(struct seccomp_data, nr));
+			if (field)
+				snprintf(buf, size, "%s", field);
 			else {
 				int index = bpf->k - offsetof(struct seccomp_data, args);
-				printf("data.args[%x]", index);
+				snprintf(buf, size, "data.args[%x]", index);
 			}
 			break;
+		}
 		case BPF_MEM:
-			printf("$temp[%u]", bpf->k);
+			snprintf(buf, size, "$temp[%u]", bpf->k);
 			break;
 		case BPF_IMM:
-			printf("%x", bpf->k);
+			snprintf(buf, size, "%x", bpf->k);
 			break;
 		case BPF_IND:
-			printf("$data[X + %x]", bpf->k);
+			snprintf(buf, size, "$data[X + %x]", bpf->k);
 			break;
 		case BPF_LEN:
-			printf("len($data)");
+			snprintf(buf, size, "len($data)");
 			break;
 		case BPF_MSH:
-			printf("4 * $data[%x] & 0x0f", bpf->k);
+			snprintf(buf, size, "4 * $data[%x] & 0x0f", bpf->k);
 			break;
 		}
 		break;
 	case BPF_ST:
 	case BPF_STX:
-		printf("$temp[%u]", bpf->k);
+		snprintf(buf, size, "$temp[%u]", bpf->k);
 		break;
 	case BPF_ALU:
 		if (BPF_SRC(bpf->code) == BPF_K) {
 			switch (BPF_OP(bpf->code)) {
 			case BPF_OR:
 			case BPF_AND:
-				printf("%.8x", bpf->k);
+				snprintf(buf, size, "%.8x", bpf->k);
 				break;
 			default:
-				printf("%x", bpf->k);
+				snprintf(buf, size, "%x", bpf->k);
 			}
 		}
 		else
-			printf("%u", bpf->k);
+			snprintf(buf, size, "%u", bpf->k);
 		break;
 	case BPF_JMP:
 		if (BPF_OP(bpf->code) == BPF_JA) {
-			printf("%.4x", (line + 1) + bpf->k);
+			snprintf(buf, size, "%.4x", (line + 1) + bpf->k);
 		}
 		else {
 			const char *name = NULL;
+			char hex[16];
 			if (syscall_loaded && native_arch)
 				name = syscall_find_nr(bpf->k);
 			if (bpf->k == ARCH_32) {
-				printf("ARCH_32 %.4x (false %.4x)",
-				       (line + 1) + bpf->jt,
-				       (line + 1) + bpf->jf);
-				 native_arch = (ARCH_NR == ARCH_32)? 1: 0;
+				name = "ARCH_32";
+				native_arch = (ARCH_NR == ARCH_32)? 1: 0;
 			}
 			else if (bpf->k == ARCH_64) {
-				printf("ARCH_64 %.4x (false %.4x)",
-				       (line + 1) + bpf->jt,
-				       (line + 1) + bpf->jf);
-				 native_arch = (ARCH_NR == ARCH_64)? 1: 0;
+				name = "ARCH_64";
+				native_arch = (ARCH_NR == ARCH_64)? 1: 0;
 			}
 			else if (bpf->k == X32_SYSCALL_BIT)
-				printf("X32_ABI %.4x (false %.4x)",
-				       (line + 1) + bpf->jt,
-				       (line + 1) + bpf->jf);
-			else if (name)
-				printf("%s %.4x (false %.4x)",
-				       name,
-				       (line + 1) + bpf->jt,
-				       (line + 1) + bpf->jf);
-			else
-				printf("%x %.4x (false %.4x)",
-				       bpf->k,
-				       (line + 1) + bpf->jt,
-				       (line + 1) + bpf->jf);
+				name = "X32_ABI";
+			else if (!name) {
+				snprintf(hex, sizeof(hex), "%x", bpf->k);
+				name = hex;
+			}
+			snprintf(buf, size, "%s %.4x (false %.4x)",
+			         name,
+			         (line + 1) + bpf->jt,
+			         (line + 1) + bpf->jf);
 		}
 		break;
 	case BPF_RET:
 		if (BPF_RVAL(bpf->code) == BPF_A) {
 			/* XXX - accumulator? */
-			printf("$acc");
+			snprintf(buf, size, "$acc");
 		}
 		else if (BPF_SRC(bpf->code) == BPF_K) {
-			bpf_decode_action(bpf->k);
+			bpf_decode_action(bpf->k, buf, size);
 		}
 		else if (BPF_SRC(bpf->code) == BPF_X) {
 			/* XXX - any idea? */
-			printf("???");
+			snprintf(buf, size, "???");
 		}
 		break;
 	case BPF_MISC:
 		break;
 	default:
-		printf("???");
+		snprintf(buf, size, "???");
 	}
 }
 
-void print(struct sock_filter *filter, int entries) {
+static void print_listing(const char *fname, const struct sock_filter *filter, int entries) {
 	int i;
 
 	/* header */
-	printf(" line  OP JT JF    K\n");
-	printf("=================================\n");
-	struct sock_filter *bpf = filter;
+	if (!arg_jsonl) {
+		printf(" line  OP JT JF    K\n");
+		printf("=================================\n");
+	}
+	const struct sock_filter *bpf = filter;
 	for (i = 0; i < entries; i++, bpf++) {
+		char args[128];
 
 		/* convert the bpf statement */
 //		bpf.code = ttoh16(arch, bpf.code);
 //		bpf.k = ttoh32(arch, bpf.k);
 
-		/* display a hex dump */
-		printf(" %.4x: %.2x %.2x %.2x %.8x",
-		       i, bpf->code, bpf->jt, bpf->jf, bpf->k);
+		bpf_decode_args(bpf, i, args, sizeof(args));
+		if (arg_jsonl) {
+			fputs("{\"file\":", stdout);
+			json_print_string(stdout, fname);
+			printf(",\"line\":%d,\"code\":%u,\"jt\":%u,\"jf\":%u,\"k\":%u,\"op\":\"%s\",\"args\":",
+			       i, bpf->code, bpf->jt, bpf->jf, bpf->k, bpf_decode_op(bpf));
+			json_print_string(stdout, args);
+			fputs("}\n", stdout);
+		}
+		else
+			/* display a hex dump, followed by the assembler statement */
+			printf(" %.4x: %.2x %.2x %.2x %.8x   %-3s %s\n",
+			       i, bpf->code, bpf->jt, bpf->jf, bpf->k, bpf_decode_op(bpf), args);
+	}
+}
+
+//*******************************************
+// summary
+//*******************************************
+// The filter is evaluated for every syscall number known for the architecture
+// it checks. The values the filter could load besides the architecture and the
+// syscall number are unknown, both branches of a jump depending on them are
+// followed; the result is the set of actions the filter can return.
+#define MAX_ACTIONS 64
+#define MAX_NR 1024
+static uint32_t actions[MAX_ACTIONS];	// the ret values found in the filter
+static int actions_cnt = 0;
+typedef uint64_t ActionSet;		// bit i set for actions[i]
+
+static int action_index(uint32_t k) {
+	int i;
+	for (i = 0; i < actions_cnt; i++)
+		if (actions[i] == k)
+			return i;
+	if (actions_cnt == MAX_ACTIONS)
+		return -1;
+	actions[actions_cnt] = k;
+	return actions_cnt++;
+}
+
+typedef struct {
+	const struct sock_filter *filter;
+	int entries;
+	uint32_t arch;
+	uint32_t nr;
+	ActionSet *memo;	// for the unknown accumulator, by instruction
+	char *memo_done;
+	int invalid;
+} Eval;
+
+// return the actions reachable from instruction pc
+static ActionSet eval(Eval *e, int pc, int known, uint32_t a) {
+	while (pc >= 0 && pc < e->entries) {
+		if (!known && e->memo_done[pc])
+			return e->memo[pc];
+
+		const struct sock_filter *bpf = e->filter + pc;
+		ActionSet rv;
+		switch (BPF_CLASS(bpf->code)) {
+		case BPF_LD:
+			if (BPF_MODE(bpf->code) == BPF_ABS && bpf->k == offsetof(struct seccomp_data, arch)) {
+				known = 1;
+				a = e->arch;
+			}
+			else if (BPF_MODE(bpf->code) == BPF_ABS && bpf->k == offsetof(struct seccomp_data, nr)) {
+				known = 1;
+				a = e->nr;
+			}
+			else if (BPF_MODE(bpf->code) == BPF_IMM) {
+				known = 1;
+				a = bpf->k;
+			}
+			else
+				known = 0;
+			pc++;
+			continue;
+		case BPF_ALU:
+			if (known && BPF_SRC(bpf->code) == BPF_K) {
+				switch (BPF_OP(bpf->code)) {
+				case BPF_ADD: a += bpf->k; break;
+				case BPF_SUB: a -= bpf->k; break;
+				case BPF_MUL: a *= bpf->k; break;
+				case BPF_OR: a |= bpf->k; break;
+				case BPF_AND: a &= bpf->k; break;
+				case BPF_XOR: a ^= bpf->k; break;
+				case BPF_NEG: a = -a; break;
+				default: known = 0;
+				}
+			}
+			else
+				known = 0;
+			pc++;
+			continue;
+		case BPF_JMP:
+			if (BPF_OP(bpf->code) == BPF_JA) {
+				pc += 1 + bpf->k;
+				continue;
+			}
+			if (known && BPF_SRC(bpf->code) == BPF_K) {
+				int cond;
+				switch (BPF_OP(bpf->code)) {
+				case BPF_JEQ: cond = (a == bpf->k); break;
+				case BPF_JGT: cond = (a > bpf->k); break;
+				case BPF_JGE: cond = (a >= bpf->k); break;
+				case BPF_JSET: cond = ((a & bpf->k) != 0); break;
+				default: cond = -1;
+				}
+				if (cond != -1) {
+					pc += 1 + (cond ? bpf->jt : bpf->jf);
+					continue;
+				}
+			}
+			// the accumulator is known again only after a load
+			rv = eval(e, pc + 1 + bpf->jt, known, a) | eval(e, pc + 1 + bpf->jf, known, a);
+			break;
+		case BPF_RET: {
+			int index = (BPF_RVAL(bpf->code) == BPF_K) ? action_index(bpf->k) : -1;
+			if (index == -1) {
+				e->invalid = 1;
+				return 0;
+			}
+			rv = (ActionSet) 1 << index;
+			break;
+		}
+		case BPF_MISC:
+		case BPF_ST:
+		case BPF_STX:
+		case BPF_LDX:
+			// X and the scratch memory are not tracked
+			if (BPF_CLASS(bpf->code) == BPF_MISC && BPF_MISCOP(bpf->code) == BPF_TXA)
+				known = 0;
+			pc++;
+			continue;
+		default:
+			e->invalid = 1;
+			return 0;
+		}
+
+		if (!known) {
+			e->memo[pc] = rv;
+			e->memo_done[pc] = 1;
+		}
+		return rv;
+	}
+
+	// jump out of the filter
+	e->invalid = 1;
+	return 0;
+}
+
+static ActionSet eval_nr(Eval *e, uint32_t arch, uint32_t nr) {
+	e->arch = arch;
+	e->nr = nr;
+	memset(e->memo_done, 0, e->entries);
+	return eval(e, 0, 0, 0);
+}
+
+static const char *action_name(int index) {
+	static char buf[32];
+	bpf_decode_action(actions[index], buf, sizeof(buf));
+	return buf;
+}
 
-		/* display the assembler statements */
-		printf("   ");
-		printf("%-3s", bpf_decode_op(bpf));
-		printf(" ");
-		bpf_decode_args(bpf, i);
+// the architecture checked first by the filter
+static uint32_t filter_arch(const struct sock_filter *filter, int entries) {
+	int i;
+	for (i = 0; i + 1 < entries; i++) {
+		const struct sock_filter *bpf = filter + i;
+		if (bpf->code == BPF_LD+BPF_W+BPF_ABS && bpf->k == offsetof(struct seccomp_data, arch) &&
+		    bpf[1].code == BPF_JMP+BPF_JEQ+BPF_K)
+			return bpf[1].k;
+	}
+	return ARCH_NR;
+}
 
-		printf("\n");
+// the actions in the set, "ERRNO(1)|ALLOW" or ["ERRNO(1)","ALLOW"]
+static void print_set(ActionSet set) {
+	if (arg_jsonl)
+		putchar('[');
+	int i, first = 1;
+	for (i = 0; i < actions_cnt; i++) {
+		if (set & ((ActionSet) 1 << i)) {
+			if (arg_jsonl)
+				printf("%s\"%s\"", (first) ? "" : ",", action_name(i));
+			else
+				printf("%s%s", (first) ? "" : "|", action_name(i));
+			first = 0;
+		}
 	}
+	if (arg_jsonl)
+		putchar(']');
+}
+
+// the syscalls with a single action
+static void print_action(int index, const ActionSet *result, const char *(*find_nr)(int), int *first_group) {
+	ActionSet set = (ActionSet) 1 << index;
+	int nr, cnt = 0;
+	for (nr = 0; nr < MAX_NR; nr++) {
+		if (result[nr] != set)
+			continue;
+		if (cnt == 0) {
+			if (arg_jsonl)
+				printf("%s\"%s\":[", (*first_group) ? "" : ",", action_name(index));
+			else
+				printf("%s: ", action_name(index));
+			*first_group = 0;
+		}
+		if (arg_jsonl)
+			printf("%s\"%s\"", (cnt) ? "," : "", find_nr(nr));
+		else
+			printf("%s%s", (cnt) ? "," : "", find_nr(nr));
+		cnt++;
+	}
+	if (cnt)
+		fputs((arg_jsonl) ? "]" : "\n", stdout);
+}
+
+// the syscalls depending on the arguments
+static void print_conditional(const ActionSet *result, const char *(*find_nr)(int)) {
+	int nr, cnt = 0;
+	for (nr = 0; nr < MAX_NR; nr++) {
+		ActionSet set = result[nr];
+		if ((set & (set - 1)) == 0)
+			continue;
+		if (cnt == 0 && !arg_jsonl)
+			printf("conditional: ");
+		if (arg_jsonl) {
+			printf("%s\"%s\":", (cnt) ? "," : "", find_nr(nr));
+			print_set(set);
+		}
+		else {
+			printf("%s%s(", (cnt) ? "," : "", find_nr(nr));
+			print_set(set);
+			putchar(')');
+		}
+		cnt++;
+	}
+	if (cnt && !arg_jsonl)
+		putchar('\n');
+}
+
+static void print_summary(const char *fname, const struct sock_filter *filter, int entries) {
+	Eval e;
+	memset(&e, 0, sizeof(e));
+	e.filter = filter;
+	e.entries = entries;
+	e.memo = calloc(entries + 1, sizeof(ActionSet));
+	e.memo_done = calloc(entries + 1, 1);
+	if (!e.memo || !e.memo_done)
+		errExit("calloc");
+
+	uint32_t arch = filter_arch(filter, entries);
+	const char *arch_name = (arch == ARCH_64) ? "ARCH_64" : (arch == ARCH_32) ? "ARCH_32" : "unknown";
+	const char *(*find_nr)(int) = (arch == ARCH_NR) ? syscall_find_nr : syscall_find_nr_32;
+
+	// the syscalls of the other architectures
+	ActionSet other = eval_nr(&e, 0, 0);
+
+	// the actions of every known syscall
+	ActionSet *result = calloc(MAX_NR, sizeof(ActionSet));
+	if (!result)
+		errExit("calloc");
+	int nr;
+	for (nr = 0; nr < MAX_NR; nr++) {
+		if (strcmp(find_nr(nr), "unknown") != 0)
+			result[nr] = eval_nr(&e, arch, nr);
+	}
+	if (e.invalid) {
+		fprintf(stderr, "Error: cannot evaluate the filter\n");
+		exit(1);
+	}
+
+	if (arg_jsonl) {
+		fputs("{\"file\":", stdout);
+		json_print_string(stdout, fname);
+		printf(",\"arch\":\"%s\",\"other_arch\":", arch_name);
+		print_set(other);
+		fputs(",\"actions\":{", stdout);
+	}
+	else {
+		printf("arch: %s\nother architectures: ", arch_name);
+		print_set(other);
+		putchar('\n');
+	}
+
+	int i, first_group = 1;
+	for (i = 0; i < actions_cnt; i++)
+		print_action(i, result, find_nr, &first_group);
+
+	if (arg_jsonl)
+		fputs("},\"conditional\":{", stdout);
+	print_conditional(result, find_nr);
+	if (arg_jsonl)
+		puts("}}");
+
+	free(result);
+	free(e.memo);
+	free(e.memo_done);
+}
+
+void print(const char *fname, struct sock_filter *filter, int entries) {
+	if (arg_summary)
+		print_summary(fname, filter, entries);
+	else
+		print_listing(fname, filter, entries);
 }
@@ -28,6 +28,7 @@
 
 // main.c
 extern int arg_quiet;
+extern char *arg_seccomp_hot;
 
 // protocol.c
 void protocol_print(void);
@@ -42,11 +43,11 @@ void seccomp_secondary_block(const char *fname);
 void write_to_file(int fd, const void *data, size_t size);
 void filter_init(int fd, bool native);
 void filter_add_whitelist(int fd, int syscall, int arg, void *ptrarg, bool native);
-void filter_add_whitelist_for_excluded(int fd, int syscall, int arg, void *ptrarg, bool native);
 void filter_add_blacklist(int fd, int syscall, int arg, void *ptrarg, bool native);
-void filter_add_blacklist_for_excluded(int fd, int syscall, int arg, void *ptrarg, bool native);
+void filter_add_set(int fd, const SyscallSet *set, bool whitelist, bool native);
 void filter_end_blacklist(int fd);
 void filter_end_whitelist(int fd);
+void filter_hot_first(const char *fname, bool native);
 
 // seccomp.c
 // default list
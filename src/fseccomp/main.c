@@ -21,6 +21,7 @@
 #include "../include/seccomp.h"
 int arg_quiet = 0;
 int arg_seccomp_error_action = SECCOMP_RET_ERRNO | EPERM; // error action: errno, log or kill
+char *arg_seccomp_hot = NULL; // syscalls checked first, hottest first
 
 static const char *const usage_str =
 	"Usage:\n"
@@ -49,51 +50,14 @@ static const char *const usage_str =
 	"\tfseccomp memory-deny-write-execute file\n"
 	"\tfseccomp memory-deny-write-execute.32 file\n"
 	"\tfseccomp restrict-namespaces file list\n"
-	"\tfseccomp restrict-namespaces.32 file list\n";
+	"\tfseccomp restrict-namespaces.32 file list\n"
+	"\tfseccomp server\n";
 
 static void usage(void) {
 	puts(usage_str);
 }
 
-int main(int argc, char **argv) {
-#if 0
-{
-//system("cat /proc/self/status");
-int i;
-for (i = 0; i < argc; i++)
-	printf("*%s* ", argv[i]);
-printf("\n");
-}
-#endif
-	if (argc < 2) {
-		usage();
-		return 1;
-	}
-	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") ==0) {
-		usage();
-		return 0;
-	}
-
-	warn_dumpable();
-
-	char *quiet = getenv("FIREJAIL_QUIET");
-	if (quiet && strcmp(quiet, "yes") == 0)
-		arg_quiet = 1;
-
-	char *error_action = getenv("FIREJAIL_SECCOMP_ERROR_ACTION");
-	if (error_action) {
-		if (strcmp(error_action, "kill") == 0)
-			arg_seccomp_error_action = SECCOMP_RET_KILL;
-		else if (strcmp(error_action, "log") == 0)
-			arg_seccomp_error_action = SECCOMP_RET_LOG;
-		else {
-			arg_seccomp_error_action = errno_find_name(error_action);
-			if (arg_seccomp_error_action == -1)
-				errExit("seccomp-error-action: unknown errno");
-			arg_seccomp_error_action |= SECCOMP_RET_ERRNO;
-		}
-	}
-
+static int run_command(int argc, char **argv) {
 	if (argc == 2 && strcmp(argv[1], "debug-syscalls") == 0)
 		syscall_print();
 	else if (argc == 2 && strcmp(argv[1], "debug-syscalls32") == 0)
@@ -151,3 +115,93 @@ printf("\n");
 
 	return 0;
 }
+
+// server mode: read the commands from stdin, one per line, with the
+// arguments separated by tabs; "ok" is sent back on stdout after every
+// command. Errors terminate the program exactly as in the regular mode,
+// firejail sees the end of file and exits.
+#define SERVER_MAX_ARGS 16
+static int run_server(void) {
+	char *line = NULL;
+	size_t n = 0;
+	ssize_t len;
+	while ((len = getline(&line, &n, stdin)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		char *argv[SERVER_MAX_ARGS + 1];
+		int argc = 0;
+		argv[argc++] = "fseccomp";
+		char *ptr = line;
+		while (ptr && argc < SERVER_MAX_ARGS) {
+			argv[argc++] = ptr;
+			ptr = strchr(ptr, '\t');
+			if (ptr)
+				*ptr++ = '\0';
+		}
+		argv[argc] = NULL;
+
+		// the output goes back to firejail, no printing commands in server mode
+		if (ptr || strncmp(argv[1], "debug-", 6) == 0 || strcmp(argv[1], "server") == 0) {
+			fprintf(stderr, "Error fseccomp: invalid server command\n");
+			return 1;
+		}
+
+		int rv = run_command(argc, argv);
+		if (rv)
+			return rv;
+		printf("ok\n");
+		fflush(stdout);
+	}
+
+	free(line);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+#if 0
+{
+//system("cat /proc/self/status");
+int i;
+for (i = 0; i < argc; i++)
+	printf("*%s* ", argv[i]);
+printf("\n");
+}
+#endif
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-?") ==0) {
+		usage();
+		return 0;
+	}
+
+	warn_dumpable();
+
+	char *quiet = getenv("FIREJAIL_QUIET");
+	if (quiet && strcmp(quiet, "yes") == 0)
+		arg_quiet = 1;
+
+	char *error_action = getenv("FIREJAIL_SECCOMP_ERROR_ACTION");
+	if (error_action) {
+		if (strcmp(error_action, "kill") == 0)
+			arg_seccomp_error_action = SECCOMP_RET_KILL;
+		else if (strcmp(error_action, "log") == 0)
+			arg_seccomp_error_action = SECCOMP_RET_LOG;
+		else {
+			arg_seccomp_error_action = errno_find_name(error_action);
+			if (arg_seccomp_error_action == -1)
+				errExit("seccomp-error-action: unknown errno");
+			arg_seccomp_error_action |= SECCOMP_RET_ERRNO;
+		}
+	}
+
+	char *hot = getenv("FIREJAIL_SECCOMP_HOT");
+	if (hot && *hot)
+		arg_seccomp_hot = hot;
+
+	if (argc == 2 && strcmp(argv[1], "server") == 0)
+		return run_server();
+	return run_command(argc, argv);
+}
@@ -81,12 +81,31 @@ static int build_ns_mask(const char *list) {
 	return mask;
 }
 
-void deny_ns(const char *fname, const char *list) {
-	int mask = build_ns_mask(list);
-	// CLONE_NEWTIME means something different for clone
-	// create a second mask without it
-	int clone_mask = mask & ~CLONE_NEWTIME;
+// block the syscall if any bit in mask is set in argument arg
+static void add_mask_rule(SyscallSet *set, int nr, int arg, int mask) {
+	SyscallRule rule;
+	memset(&rule, 0, sizeof(rule));
+	rule.nr = nr;
+	rule.arg = arg;
+	rule.op = SYSCALL_CMP_NE;
+	rule.mask = (unsigned) mask;
+	rule.value = 0;
+	syscall_set_add_rule(set, &rule);
+}
+
+// always fail if the (int) argument is zero
+static void add_zero_rule(SyscallSet *set, int nr, int arg) {
+	SyscallRule rule;
+	memset(&rule, 0, sizeof(rule));
+	rule.nr = nr;
+	rule.arg = arg;
+	rule.op = SYSCALL_CMP_EQ;
+	rule.mask = 0xffffffff;
+	rule.value = 0;
+	syscall_set_add_rule(set, &rule);
+}
 
+static void write_ns_filter(const char *fname, const SyscallSet *set, bool native) {
 	// open file
 	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 	if (fd < 0) {
@@ -94,52 +113,45 @@ void deny_ns(const char *fname, const char *list) {
 		exit(1);
 	}
 
-	filter_init(fd, true);
+	filter_init(fd, native);
+	filter_add_set(fd, set, false, native);
+	filter_end_blacklist(fd);
+
+	// close file
+	close(fd);
+}
+
+void deny_ns(const char *fname, const char *list) {
+	int mask = build_ns_mask(list);
+	// CLONE_NEWTIME means something different for clone
+	// create a second mask without it
+	int clone_mask = mask & ~CLONE_NEWTIME;
 
 	// build filter
-	struct sock_filter filter[] = {
+	SyscallSet set;
+	syscall_set_clear(&set);
 #ifdef SYS_clone
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_clone, 0, 4),
-		// s390 has first and second argument flipped
+	// s390 has first and second argument flipped
 #if defined __s390__
-		EXAMINE_ARGUMENT(1),
+	add_mask_rule(&set, SYS_clone, 1, clone_mask);
 #else
-		EXAMINE_ARGUMENT(0),
+	add_mask_rule(&set, SYS_clone, 0, clone_mask);
 #endif
-		BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, clone_mask, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
 #endif
 #ifdef SYS_clone3
-		// cannot inspect clone3 argument because
-		// seccomp does not dereference pointers
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_clone3, 0, 1),
-		RETURN_ERRNO(ENOSYS), // hint to use clone instead
+	// cannot inspect clone3 argument because
+	// seccomp does not dereference pointers
+	syscall_set_add(&set, SYS_clone3, ENOSYS); // hint to use clone instead
 #endif
 #ifdef SYS_unshare
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_unshare, 0, 4),
-		EXAMINE_ARGUMENT(0),
-		BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, mask, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	add_mask_rule(&set, SYS_unshare, 0, mask);
 #endif
 #ifdef SYS_setns
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_setns, 0, 4),
-		EXAMINE_ARGUMENT(1),
-		// always fail if argument is zero
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0, 1, 0),
-		BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, mask, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW
+	add_zero_rule(&set, SYS_setns, 1);
+	add_mask_rule(&set, SYS_setns, 1, mask);
 #endif
-	};
-	if (sizeof(filter))
-		write_to_file(fd, filter, sizeof(filter));
-
-	filter_end_blacklist(fd);
 
-	// close file
-	close(fd);
+	write_ns_filter(fname, &set, true);
 }
 
 void deny_ns_32(const char *fname, const char *list) {
@@ -148,49 +160,26 @@ void deny_ns_32(const char *fname, const char *list) {
 	// create a second mask without it
 	int clone_mask = mask & ~CLONE_NEWTIME;
 
-	// open file
-	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
-		exit(1);
-	}
-
-	filter_init(fd, false);
-
 	// build filter
-	struct sock_filter filter[] = {
+	SyscallSet set;
+	syscall_set_clear(&set);
 #ifdef clone_32
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, clone_32, 0, 4),
-		EXAMINE_ARGUMENT(0),
-		BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, clone_mask, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	add_mask_rule(&set, clone_32, 0, clone_mask);
 #endif
 #ifdef clone3_32
-		// cannot inspect clone3 argument because
-		// seccomp does not dereference pointers
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, clone3_32, 0, 1),
-		RETURN_ERRNO(ENOSYS), // hint to use clone instead
+	// cannot inspect clone3 argument because
+	// seccomp does not dereference pointers
+	syscall_set_add(&set, clone3_32, ENOSYS); // hint to use clone instead
 #endif
 #ifdef unshare_32
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, unshare_32, 0, 4),
-		EXAMINE_ARGUMENT(0),
-		BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, mask, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	add_mask_rule(&set, unshare_32, 0, mask);
 #endif
 #ifdef setns_32
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, setns_32, 0, 4),
-		EXAMINE_ARGUMENT(1),
-		// always fail if argument is zero
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, 0, 1, 0),
-		BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, mask, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW
+	add_zero_rule(&set, setns_32, 1);
+	add_mask_rule(&set, setns_32, 1, mask);
 #endif
-	};
 
-	// For Debian 10 and older, the size of the filter[] array will be 0.
+	// For Debian 10 and older, the set is empty.
 	// The following filter will end up being generated:
 	//
 	//     FILE: /run/firejail/mnt/seccomp/seccomp.namespaces.32
@@ -202,11 +191,5 @@ void deny_ns_32(const char *fname, const char *list) {
 	//       0003: 20 00 00 00000000 ld data.syscall-number
 	//       0004: 06 00 00 7fff0000 ret ALLOW
 	//
-	if (sizeof(filter))
-		write_to_file(fd, filter, sizeof(filter));
-
-	filter_end_blacklist(fd);
-
-	// close file
-	close(fd);
+	write_ns_filter(fname, &set, false);
 }
@@ -24,14 +24,12 @@
 #include <sys/syscall.h>
 #include <sys/types.h>
 
-static void add_default_list(int fd, int allow_debuggers, bool native) {
-	int r;
+static void default_list(SyscallSet *set, int allow_debuggers, bool native) {
+	syscall_set_clear(set);
 	if (!allow_debuggers)
-		r = syscall_check_list("@default-nodebuggers", filter_add_blacklist, fd, 0, NULL, native);
+		syscall_set_build(set, NULL, "@default-nodebuggers", native);
 	else
-		r = syscall_check_list("@default", filter_add_blacklist, fd, 0, NULL, native);
-
-	assert(r == 0);
+		syscall_set_build(set, NULL, "@default", native);
 //#ifdef SYS_mknod - emoved in 0.9.29 - it breaks Zotero extension
 //		filter_add_blacklist(SYS_mknod, 0);
 //#endif
@@ -45,6 +43,29 @@ static void add_default_list(int fd, int allow_debuggers, bool native) {
 //#endif
 }
 
+// post-exec filter: blacklist the syscalls needed by firejail after the
+// pre-exec filter is installed
+static void seccomp_postexec(const char *fname, const SyscallSet *postlist, bool native) {
+	if (syscall_set_empty(postlist))
+		return;
+
+	// open file for post-exec filter
+	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0) {
+		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
+		exit(1);
+	}
+
+	// build post-exec filter: blacklist remaining syscalls
+	filter_init(fd, native);
+	filter_add_set(fd, postlist, false, native);
+	filter_end_blacklist(fd);
+
+	// close file
+	close(fd);
+	filter_hot_first(fname, native);
+}
+
 // default list
 void seccomp_default(const char *fname, int allow_debuggers, bool native) {
 	assert(fname);
@@ -57,12 +78,15 @@ void seccomp_default(const char *fname, int allow_debuggers, bool native) {
 	}
 
 	// build filter (no post-exec filter needed because default list is fine for us)
+	SyscallSet set;
+	default_list(&set, allow_debuggers, native);
 	filter_init(fd, native);
-	add_default_list(fd, allow_debuggers, native);
+	filter_add_set(fd, &set, false, native);
 	filter_end_blacklist(fd);
 
 	// close file
 	close(fd);
+	filter_hot_first(fname, native);
 }
 
 // drop list
@@ -78,43 +102,19 @@ void seccomp_drop(const char *fname1, const char *fname2, char *list, int allow_
 		exit(1);
 	}
 
-	// build pre-exec filter: don't blacklist any syscalls in @default-keep
+	// build pre-exec filter: don't blacklist any syscalls in @default-keep;
+	// exceptions in form of !syscall are not in the lists
+	SyscallSet prelist, postlist;
+	syscalls_in_list(list, "@default-keep", &prelist, &postlist, NULL, native);
 	filter_init(fd, native);
-
-	// allow exceptions in form of !syscall
-	syscall_check_list(list, filter_add_whitelist_for_excluded, fd, 0, NULL, native);
-
-	char *prelist, *postlist;
-	syscalls_in_list(list, "@default-keep", fd, &prelist, &postlist, native);
-	if (prelist)
-		if (syscall_check_list(prelist, filter_add_blacklist, fd, 0, NULL, native)) {
-			fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-			exit(1);
-		}
-	filter_end_blacklist(fd);
-	// close file
-	close(fd);
-
-	if (!postlist)
-		return;
-
-	// open file for post-exec filter
-	fd = open(fname2, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname2);
-		exit(1);
-	}
-
-	// build post-exec filter: blacklist remaining syscalls
-	filter_init(fd, native);
-	if (syscall_check_list(postlist, filter_add_blacklist, fd, 0, NULL, native)) {
-		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-		exit(1);
-	}
+	filter_add_set(fd, &prelist, false, native);
 	filter_end_blacklist(fd);
 
 	// close file
 	close(fd);
+	filter_hot_first(fname1, native);
+
+	seccomp_postexec(fname2, &postlist, native);
 }
 
 // default+drop
@@ -131,44 +131,25 @@ void seccomp_default_drop(const char *fname1, const char *fname2, char *list, in
 
 	// build pre-exec filter: blacklist @default, don't blacklist
 	// any listed syscalls in @default-keep
-	filter_init(fd, native);
+	SyscallSet set, prelist, postlist, excluded;
+	syscalls_in_list(list, "@default-keep", &prelist, &postlist, &excluded, native);
+	// the action from the list, syscall:errno or syscall:kill, wins
+	default_list(&set, allow_debuggers, native);
+	syscall_set_union(&prelist, &set);
+	set = prelist;
 
 	// allow exceptions in form of !syscall
-	syscall_check_list(list, filter_add_whitelist_for_excluded, fd, 0, NULL, native);
-
-	add_default_list(fd, allow_debuggers, native);
-	char *prelist, *postlist;
-	syscalls_in_list(list, "@default-keep", fd, &prelist, &postlist, native);
-	if (prelist)
-		if (syscall_check_list(prelist, filter_add_blacklist, fd, 0, NULL, native)) {
-			fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-			exit(1);
-		}
-	filter_end_blacklist(fd);
-
-	// close file
-	close(fd);
-
-	if (!postlist)
-		return;
+	syscall_set_subtract(&set, &excluded);
 
-	// open file for post-exec filter
-	fd = open(fname2, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname2);
-		exit(1);
-	}
-
-	// build post-exec filter: blacklist remaining syscalls
 	filter_init(fd, native);
-	if (syscall_check_list(postlist, filter_add_blacklist, fd, 0, NULL, native)) {
-		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-		exit(1);
-	}
+	filter_add_set(fd, &set, false, native);
 	filter_end_blacklist(fd);
 
 	// close file
 	close(fd);
+	filter_hot_first(fname1, native);
+
+	seccomp_postexec(fname2, &postlist, native);
 }
 
 void seccomp_keep(const char *fname1, const char *fname2, char *list, bool native) {
@@ -181,26 +162,26 @@ void seccomp_keep(const char *fname1, const char *fname2, char *list, bool nativ
 		exit(1);
 	}
 
-	// build pre-exec filter: whitelist also @default-keep
-	filter_init(fd, native);
-
-	// allow exceptions in form of !syscall
-	syscall_check_list(list, filter_add_blacklist_for_excluded, fd, 0, NULL, native);
-
+	// build pre-exec filter: whitelist also @default-keep;
 	// these syscalls are used by firejail after the seccomp filter is initialized
-	int r;
-	r = syscall_check_list("@default-keep", filter_add_whitelist, fd, 0, NULL, native);
-	assert(r == 0);
+	SyscallSet set, listed, excluded;
+	syscall_set_clear(&set);
+	syscall_set_clear(&listed);
+	syscall_set_clear(&excluded);
+	syscall_set_build(&set, NULL, "@default-keep", native);
+	syscall_set_build(&listed, &excluded, list, native);
+	syscall_set_union(&set, &listed);
 
-	if (syscall_check_list(list, filter_add_whitelist, fd, 0, NULL, native)) {
-		fprintf(stderr, "Error fseccomp: cannot build seccomp filter\n");
-		exit(1);
-	}
+	// exceptions in form of !syscall are not allowed
+	syscall_set_subtract(&set, &excluded);
 
+	filter_init(fd, native);
+	filter_add_set(fd, &set, true, native);
 	filter_end_whitelist(fd);
 
 	// close file
 	close(fd);
+	filter_hot_first(fname1, native);
 }
 
 #if defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__)
@@ -233,7 +214,19 @@ void seccomp_keep(const char *fname1, const char *fname2, char *list, bool nativ
 # undef memfd_create_32
 #endif
 
-void memory_deny_write_execute(const char *fname) {
+// block the syscall if argument arg, masked with mask, is equal to value
+static void add_masked_rule(SyscallSet *set, int nr, int arg, uint64_t mask, uint64_t value) {
+	SyscallRule rule;
+	memset(&rule, 0, sizeof(rule));
+	rule.nr = nr;
+	rule.arg = arg;
+	rule.op = SYSCALL_CMP_EQ;
+	rule.mask = mask;
+	rule.value = value;
+	syscall_set_add_rule(set, &rule);
+}
+
+static void write_mdwe_filter(const char *fname, const SyscallSet *set, bool native) {
 	// open file
 	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 	if (fd < 0) {
@@ -241,137 +234,83 @@ void memory_deny_write_execute(const char *fname) {
 		exit(1);
 	}
 
-	filter_init(fd, true);
+	filter_init(fd, native);
+	filter_add_set(fd, set, false, native);
+	filter_end_blacklist(fd);
+
+	// close file
+	close(fd);
+}
+
+void memory_deny_write_execute(const char *fname) {
+	SyscallSet set;
+	syscall_set_clear(&set);
 
-	// build filter
-	struct sock_filter filter[] = {
 #ifdef block_syscall
-		// block old multiplexing mmap syscall for i386
-		BLACKLIST(block_syscall),
+	// block old multiplexing mmap syscall for i386
+	syscall_set_add(&set, block_syscall, 0);
 #endif
 #ifdef filter_syscall
-		// block mmap(,,x|PROT_WRITE|PROT_EXEC) so W&X memory can't be created
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, filter_syscall, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, PROT_WRITE|PROT_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, PROT_WRITE|PROT_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// block mmap(,,x|PROT_WRITE|PROT_EXEC) so W&X memory can't be created
+	add_masked_rule(&set, filter_syscall, 2, PROT_WRITE|PROT_EXEC, PROT_WRITE|PROT_EXEC);
 #endif
 
-		// block mprotect(,,PROT_EXEC) so writable memory can't be turned into executable
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_mprotect, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, PROT_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, PROT_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// block mprotect(,,PROT_EXEC) so writable memory can't be turned into executable
+	add_masked_rule(&set, SYS_mprotect, 2, PROT_EXEC, PROT_EXEC);
 
-		// same for pkey_mprotect(,,PROT_EXEC), where available
+	// same for pkey_mprotect(,,PROT_EXEC), where available
 #ifdef SYS_pkey_mprotect
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_pkey_mprotect, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, PROT_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, PROT_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	add_masked_rule(&set, SYS_pkey_mprotect, 2, PROT_EXEC, PROT_EXEC);
 #endif
 
 // shmat is not implemented as a syscall on some platforms (i386, powerpc64, powerpc64le)
 #ifdef SYS_shmat
-		// block shmat(,,x|SHM_EXEC) so W&X shared memory can't be created
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_shmat, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, SHM_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SHM_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// block shmat(,,x|SHM_EXEC) so W&X shared memory can't be created
+	add_masked_rule(&set, SYS_shmat, 2, SHM_EXEC, SHM_EXEC);
 #endif
 #ifdef SYS_memfd_create
-		// block memfd_create as it can be used to create
-		// arbitrary memory contents which can be later mapped
-		// as executable
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SYS_memfd_create, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW
+	// block memfd_create as it can be used to create
+	// arbitrary memory contents which can be later mapped
+	// as executable
+	syscall_set_add(&set, SYS_memfd_create, 0);
 #endif
-	};
-	write_to_file(fd, filter, sizeof(filter));
 
-	filter_end_blacklist(fd);
-
-	// close file
-	close(fd);
+	write_mdwe_filter(fname, &set, true);
 }
 
 void memory_deny_write_execute_32(const char *fname) {
-	// open file
-	int fd = open(fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (fd < 0) {
-		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
-		exit(1);
-	}
+	SyscallSet set;
+	syscall_set_clear(&set);
 
-	filter_init(fd, false);
-
-	// build filter
-	struct sock_filter filter[] = {
 #if defined(__x86_64__)
 #ifdef block_syscall_32
-		// block old multiplexing mmap syscall for i386
-		BLACKLIST(block_syscall_32),
+	// block old multiplexing mmap syscall for i386
+	syscall_set_add(&set, block_syscall_32, 0);
 #endif
 #ifdef filter_syscall_32
-		// block mmap(,,x|PROT_WRITE|PROT_EXEC) so W&X memory can't be created
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, filter_syscall_32, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, PROT_WRITE|PROT_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, PROT_WRITE|PROT_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// block mmap(,,x|PROT_WRITE|PROT_EXEC) so W&X memory can't be created
+	add_masked_rule(&set, filter_syscall_32, 2, PROT_WRITE|PROT_EXEC, PROT_WRITE|PROT_EXEC);
 #endif
 #ifdef mprotect_32
-		// block mprotect(,,PROT_EXEC) so writable memory can't be turned into executable
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, mprotect_32, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, PROT_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, PROT_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// block mprotect(,,PROT_EXEC) so writable memory can't be turned into executable
+	add_masked_rule(&set, mprotect_32, 2, PROT_EXEC, PROT_EXEC);
 #endif
 #ifdef pkey_mprotect_32
-		// same for pkey_mprotect(,,PROT_EXEC), where available
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, pkey_mprotect_32, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, PROT_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, PROT_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// same for pkey_mprotect(,,PROT_EXEC), where available
+	add_masked_rule(&set, pkey_mprotect_32, 2, PROT_EXEC, PROT_EXEC);
 #endif
 
 #ifdef shmat_32
-		// block shmat(,,x|SHM_EXEC) so W&X shared memory can't be created
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, shmat_32, 0, 5),
-		EXAMINE_ARGUMENT(2),
-		BPF_STMT(BPF_ALU+BPF_AND+BPF_K, SHM_EXEC),
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, SHM_EXEC, 0, 1),
-		KILL_OR_RETURN_ERRNO,
-		RETURN_ALLOW,
+	// block shmat(,,x|SHM_EXEC) so W&X shared memory can't be created
+	add_masked_rule(&set, shmat_32, 2, SHM_EXEC, SHM_EXEC);
 #endif
 #ifdef memfd_create_32
-		// block memfd_create as it can be used to create
-		// arbitrary memory contents which can be later mapped
-		// as executable
-		BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, memfd_create_32, 0, 1),
-		KILL_OR_RETURN_ERRNO,
+	// block memfd_create as it can be used to create
+	// arbitrary memory contents which can be later mapped
+	// as executable
+	syscall_set_add(&set, memfd_create_32, 0);
 #endif
 #endif
-		RETURN_ALLOW
-	};
-	write_to_file(fd, filter, sizeof(filter));
-
-	filter_end_blacklist(fd);
 
-	// close file
-	close(fd);
+	write_mdwe_filter(fname, &set, false);
 }
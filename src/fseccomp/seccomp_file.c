@@ -89,17 +89,6 @@ void filter_add_whitelist(int fd, int syscall, int arg, void *ptrarg, bool nativ
 	}
 }
 
-// handle seccomp list exceptions (seccomp x,y,!z)
-void filter_add_whitelist_for_excluded(int fd, int syscall, int arg, void *ptrarg, bool native) {
-	(void) arg;
-	(void) ptrarg;
-	(void) native;
-
-	if (syscall < 0) {
-		write_whitelist(fd, -syscall);
-	}
-}
-
 void filter_add_blacklist(int fd, int syscall, int arg, void *ptrarg, bool native) {
 	(void) arg;
 	(void) ptrarg;
@@ -123,17 +112,6 @@ void filter_add_blacklist_override(int fd, int syscall, int arg, void *ptrarg, b
 	}
 }
 
-// handle seccomp list exceptions (seccomp x,y,!z)
-void filter_add_blacklist_for_excluded(int fd, int syscall, int arg, void *ptrarg, bool native) {
-	(void) arg;
-	(void) ptrarg;
-	(void) native;
-
-	if (syscall < 0) {
-		write_blacklist(fd, -syscall);
-	}
-}
-
 void filter_add_errno(int fd, int syscall, int arg, void *ptrarg, bool native) {
 	(void) ptrarg;
 	(void) native;
@@ -144,6 +122,191 @@ void filter_add_errno(int fd, int syscall, int arg, void *ptrarg, bool native) {
 	write_to_file(fd, filter, sizeof(filter));
 }
 
+//**********************************
+// argument rules
+//**********************************
+// The rules for a syscall are compiled in a block following the syscall
+// check, "jeq nr 0 len" and len statements. Every path in the block ends
+// in a ret statement. The 64 bit arguments are compared one 32 bit word
+// at a time, starting with the high word.
+#define RULE_MATCH 0xff		// jump to the action of the rule
+#define RULE_NEXT 0xfe		// jump to the next rule
+#define RULE_CHECK_MAX 8
+#define RULE_BLOCK_MAX 255	// jf in the syscall check is only 8 bits wide
+
+static inline struct sock_filter rule_stmt(__u16 code, __u32 k) {
+	struct sock_filter f = BPF_STMT(code, k);
+	return f;
+}
+
+static inline struct sock_filter rule_jump(__u16 code, __u32 k, __u8 jt, __u8 jf) {
+	struct sock_filter f = BPF_JUMP(code, k, jt, jf);
+	return f;
+}
+
+// statements checking the rule, 0 if the rule can never match
+static int rule_check(struct sock_filter *out, const SyscallRule *rule) {
+	__u32 mhi = rule->mask >> 32;
+	__u32 mlo = rule->mask & 0xffffffff;
+	__u32 vhi = rule->value >> 32;
+	__u32 vlo = rule->value & 0xffffffff;
+	int n = 0;
+
+	// argN&mask: a jset for each word
+	if (rule->op == SYSCALL_CMP_NE && rule->value == 0 && rule->mask != UINT64_MAX) {
+		if (mhi) {
+			out[n++] = rule_stmt(BPF_LD+BPF_W+BPF_ABS, ARGUMENT_HI(rule->arg));
+			out[n++] = rule_jump(BPF_JMP+BPF_JSET+BPF_K, mhi, RULE_MATCH, (mlo) ? 0 : RULE_NEXT);
+		}
+		if (mlo) {
+			out[n++] = rule_stmt(BPF_LD+BPF_W+BPF_ABS, ARGUMENT_LO(rule->arg));
+			out[n++] = rule_jump(BPF_JMP+BPF_JSET+BPF_K, mlo, RULE_MATCH, RULE_NEXT);
+		}
+		return n;
+	}
+
+	// the high word decides unless it is equal; it is skipped if the
+	// mask clears it and it is compared with 0
+	if (mhi || vhi) {
+		out[n++] = rule_stmt(BPF_LD+BPF_W+BPF_ABS, ARGUMENT_HI(rule->arg));
+		if (mhi != 0xffffffff)
+			out[n++] = rule_stmt(BPF_ALU+BPF_AND+BPF_K, mhi);
+		switch (rule->op) {
+		case SYSCALL_CMP_EQ:
+			out[n++] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, vhi, 0, RULE_NEXT);
+			break;
+		case SYSCALL_CMP_NE:
+			out[n++] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, vhi, 0, RULE_MATCH);
+			break;
+		case SYSCALL_CMP_GT:
+		case SYSCALL_CMP_GE:
+			out[n++] = rule_jump(BPF_JMP+BPF_JGT+BPF_K, vhi, RULE_MATCH, 0);
+			out[n++] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, vhi, 0, RULE_NEXT);
+			break;
+		case SYSCALL_CMP_LT:
+		case SYSCALL_CMP_LE:
+			out[n++] = rule_jump(BPF_JMP+BPF_JGT+BPF_K, vhi, RULE_NEXT, 0);
+			out[n++] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, vhi, 0, RULE_MATCH);
+			break;
+		}
+	}
+
+	// low word
+	out[n++] = rule_stmt(BPF_LD+BPF_W+BPF_ABS, ARGUMENT_LO(rule->arg));
+	if (mlo != 0xffffffff)
+		out[n++] = rule_stmt(BPF_ALU+BPF_AND+BPF_K, mlo);
+	switch (rule->op) {
+	case SYSCALL_CMP_EQ:
+		out[n++] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, vlo, RULE_MATCH, RULE_NEXT);
+		break;
+	case SYSCALL_CMP_NE:
+		out[n++] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, vlo, RULE_NEXT, RULE_MATCH);
+		break;
+	case SYSCALL_CMP_GT:
+		out[n++] = rule_jump(BPF_JMP+BPF_JGT+BPF_K, vlo, RULE_MATCH, RULE_NEXT);
+		break;
+	case SYSCALL_CMP_GE:
+		out[n++] = rule_jump(BPF_JMP+BPF_JGE+BPF_K, vlo, RULE_MATCH, RULE_NEXT);
+		break;
+	case SYSCALL_CMP_LT:
+		out[n++] = rule_jump(BPF_JMP+BPF_JGE+BPF_K, vlo, RULE_NEXT, RULE_MATCH);
+		break;
+	case SYSCALL_CMP_LE:
+		out[n++] = rule_jump(BPF_JMP+BPF_JGT+BPF_K, vlo, RULE_NEXT, RULE_MATCH);
+		break;
+	}
+	assert(n <= RULE_CHECK_MAX);
+	return n;
+}
+
+static inline void rule_resolve(__u8 *j, int n, int p) {
+	// the action of the rule follows the check, the next rule follows the action
+	if (*j == RULE_MATCH)
+		*j = n - p - 1;
+	else if (*j == RULE_NEXT)
+		*j = n - p;
+}
+
+// the rules for syscall nr; match is the action of a rule without an
+// action of its own, nomatch the action if no rule matches
+static void filter_add_rules(int fd, const SyscallSet *set, int nr, __u32 match, __u32 nomatch) {
+	struct sock_filter block[1 + RULE_BLOCK_MAX];
+	int len = 1;
+	int i;
+	for (i = 0; i < set->rules; i++) {
+		const SyscallRule *rule = set->rule + i;
+		if (rule->nr != nr)
+			continue;
+
+		struct sock_filter check[RULE_CHECK_MAX];
+		int n = rule_check(check, rule);
+		if (n == 0)
+			continue;
+		if (len + n + 2 > 1 + RULE_BLOCK_MAX) {
+			fprintf(stderr, "Error fseccomp: too many argument rules for syscall %d\n", nr);
+			exit(1);
+		}
+
+		int p;
+		for (p = 0; p < n; p++) {
+			if (BPF_CLASS(check[p].code) == BPF_JMP) {
+				rule_resolve(&check[p].jt, n, p);
+				rule_resolve(&check[p].jf, n, p);
+			}
+			block[len++] = check[p];
+		}
+
+		__u32 action = match;
+		if (rule->action > 0)
+			action = SECCOMP_RET_ERRNO | rule->action;
+		else if (rule->action == ERRNO_KILL)
+			action = SECCOMP_RET_KILL;
+		block[len++] = rule_stmt(BPF_RET+BPF_K, action);
+	}
+	if (len == 1)
+		return;
+
+	block[len++] = rule_stmt(BPF_RET+BPF_K, nomatch);
+	block[0] = rule_jump(BPF_JMP+BPF_JEQ+BPF_K, nr, 0, len - 1);
+	write_to_file(fd, block, len * sizeof(struct sock_filter));
+}
+
+// rules for a syscall set, in syscall number order; the syscall:errno and
+// syscall:kill entries get their own action, the others are whitelisted
+// or blacklisted; the argument rules are used for the syscalls not in the set
+void filter_add_set(int fd, const SyscallSet *set, bool whitelist, bool native) {
+	assert(set);
+	uint64_t rulebit[SYSCALL_SET_WORDS];
+	memset(rulebit, 0, sizeof(rulebit));
+	int i;
+	for (i = 0; i < set->rules; i++) {
+		int nr = set->rule[i].nr;
+		if (nr >= 0 && nr < SYSCALL_SET_MAX)
+			rulebit[nr / 64] |= (uint64_t) 1 << (nr % 64);
+	}
+
+	__u32 match = (whitelist) ? SECCOMP_RET_ALLOW : (__u32) arg_seccomp_error_action;
+	__u32 nomatch = (whitelist) ? (__u32) arg_seccomp_error_action : SECCOMP_RET_ALLOW;
+	for (i = 0; i < SYSCALL_SET_WORDS; i++) {
+		uint64_t bits = set->bit[i] | rulebit[i];
+		while (bits) {
+			int nr = i * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+
+			if (!syscall_set_has(set, nr))
+				filter_add_rules(fd, set, nr, match, nomatch);
+			else if (set->arg[nr] > 0)
+				filter_add_errno(fd, nr, set->arg[nr], NULL, native);
+			else if (set->arg[nr] == ERRNO_KILL)
+				filter_add_blacklist_override(fd, nr, 0, NULL, native);
+			else if (whitelist)
+				filter_add_whitelist(fd, nr, 0, NULL, native);
+			else
+				filter_add_blacklist(fd, nr, 0, NULL, native);
+		}
+	}
+}
+
 void filter_end_blacklist(int fd) {
 	struct sock_filter filter[] = {
 		RETURN_ALLOW
@@ -157,3 +320,163 @@ void filter_end_whitelist(int fd) {
 	};
 	write_to_file(fd, filter, sizeof(filter));
 }
+
+//**********************************
+// hot syscalls
+//**********************************
+// The checks for the syscalls in FIREJAIL_SECCOMP_HOT (hottest first) are
+// moved to the start of the syscall chain. A syscall without a rule of its
+// own gets a check returning the default action of the filter. Only the
+// first rule for a syscall number is ever reached, so the filter is the
+// same, the hot syscalls just exit the chain earlier.
+#define HOT_MAX 16
+typedef struct {
+	int nr[HOT_MAX];
+	int cnt;
+} HotList;
+
+static void hot_add(int fd, int syscall, int arg, void *ptrarg, bool native) {
+	(void) fd;
+	(void) arg;
+	(void) native;
+	HotList *hot = ptrarg;
+
+	// exceptions and error actions make no sense here
+	if (syscall < 0 || hot->cnt == HOT_MAX)
+		return;
+	int i;
+	for (i = 0; i < hot->cnt; i++) {
+		if (hot->nr[i] == syscall)
+			return;
+	}
+	hot->nr[hot->cnt++] = syscall;
+}
+
+// a syscall check at pos, followed by a ret statement or a rule block
+// ending before end
+static bool chain_item(const struct sock_filter *filter, int pos, int end) {
+	const struct sock_filter *jeq = filter + pos;
+	if (jeq->code != BPF_JMP + BPF_JEQ + BPF_K || jeq->jt != 0 || jeq->jf == 0)
+		return false;
+	int last = pos + jeq->jf;
+	if (last >= end || BPF_CLASS(filter[last].code) != BPF_RET)
+		return false;
+
+	// the jumps in the block stay in the block
+	int i;
+	for (i = pos + 1; i < last; i++) {
+		const struct sock_filter *f = filter + i;
+		if (BPF_CLASS(f->code) != BPF_JMP)
+			continue;
+		if (BPF_OP(f->code) == BPF_JA) {
+			if (i + 1 + f->k > (__u32) last)
+				return false;
+		}
+		else if (i + 1 + f->jt > last || i + 1 + f->jf > last)
+			return false;
+	}
+	return true;
+}
+
+void filter_hot_first(const char *fname, bool native) {
+	assert(fname);
+	if (!arg_seccomp_hot)
+		return;
+
+	HotList hot;
+	hot.cnt = 0;
+	syscall_check_list(arg_seccomp_hot, hot_add, 0, 0, &hot, native);
+	if (hot.cnt == 0)
+		return;
+
+	// read the filter
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
+		exit(1);
+	}
+	struct sock_filter filter[BPF_MAXINSNS + 1];
+	ssize_t size = read(fd, filter, sizeof(filter));
+	close(fd);
+	if (size <= 0 || size % sizeof(struct sock_filter) || size == sizeof(filter))
+		return;
+	int entries = size / sizeof(struct sock_filter);
+
+	// filter_init prologue, it ends with "ld [nr]"
+	int start;
+	for (start = 0; start < entries; start++) {
+		if (filter[start].code == BPF_LD + BPF_W + BPF_ABS &&
+		    filter[start].k == offsetof(struct seccomp_data, nr))
+			break;
+	}
+	start++;
+#if defined(__x86_64__)
+	if (native)
+		start += 3; // HANDLE_X32
+#endif
+
+	// the chain is a list of "jeq nr 0 1; ret action" pairs, or "jeq nr 0 len"
+	// followed by an argument rule block, and a final "ret default"
+	if (start >= entries || filter[entries - 1].code != BPF_RET + BPF_K)
+		return;
+	int item[BPF_MAXINSNS];	// start of each rule
+	int cnt = 0;
+	int pos = start;
+	while (pos < entries - 1) {
+		if (!chain_item(filter, pos, entries - 1))
+			return;
+		item[cnt++] = pos;
+		pos += 1 + filter[pos].jf;
+	}
+	item[cnt] = entries - 1;
+	if (entries + 2 * hot.cnt > BPF_MAXINSNS)
+		return;
+
+	// hot syscalls first, with their first rule; syscalls without a rule
+	// get the default action
+	struct sock_filter out[BPF_MAXINSNS];
+	memcpy(out, filter, start * sizeof(struct sock_filter));
+	int len = start;
+	int h;
+	int i;
+	for (h = 0; h < hot.cnt; h++) {
+		for (i = 0; i < cnt; i++) {
+			if (filter[item[i]].k == (__u32) hot.nr[h])
+				break;
+		}
+		if (i < cnt) {
+			int size = item[i + 1] - item[i];
+			memcpy(out + len, filter + item[i], size * sizeof(struct sock_filter));
+			len += size;
+			continue;
+		}
+		struct sock_filter rule[] = {
+			BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, hot.nr[h], 0, 1),
+			BPF_STMT(BPF_RET+BPF_K, filter[entries - 1].k)
+		};
+		memcpy(out + len, rule, sizeof(rule));
+		len += 2;
+	}
+
+	// the remaining rules, in the original order
+	for (i = 0; i < cnt; i++) {
+		for (h = 0; h < hot.cnt; h++) {
+			if (filter[item[i]].k == (__u32) hot.nr[h])
+				break;
+		}
+		if (h == hot.cnt) {
+			int size = item[i + 1] - item[i];
+			memcpy(out + len, filter + item[i], size * sizeof(struct sock_filter));
+			len += size;
+		}
+	}
+	out[len++] = filter[entries - 1];
+
+	fd = open(fname, O_WRONLY|O_TRUNC);
+	if (fd < 0) {
+		fprintf(stderr, "Error fseccomp: cannot open %s file\n", fname);
+		exit(1);
+	}
+	write_to_file(fd, out, len * sizeof(struct sock_filter));
+	close(fd);
+}
@@ -19,121 +19,262 @@
 */
 #include "ftee.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
-#define MAXBUF 512
 
-static unsigned char buf[MAXBUF];
+// The output is copied in chunks up to the size of a pipe buffer. When
+// stdout is a pipe, the data is duplicated in the kernel with tee(2) and
+// moved to the log file with splice(2). Otherwise the chunks are written to
+// stdout as they come in, and the log writes are buffered; the buffer is
+// written when it is full, and FLUSH_INTERVAL after the first byte buffered.
+//
+// On rotation the log file is renamed filename.0 and a new one is opened;
+// the older files are moved, and filename.0 is compressed, by a child
+// process running in the background.
+#define CHUNK (64 * 1024)
+#define FLUSH_INTERVAL 200	// ms
+#define LOG_KEEP 5		// filename.1 to filename.5
+
+static unsigned char buf[CHUNK];
+static unsigned char logbuf[CHUNK];
+static size_t loglen = 0;
+static long long flush_time = 0;	// CLOCK_MONOTONIC, ms
+
+static int out_fd = -1;
+static size_t out_cnt = 0;
+static size_t out_max = 500 * 1024;
+
+static const char *compress_prog = NULL;	// gzip or zstd
+static pid_t rotate_pid = 0;
+static const char *const log_suffix[] = { "", ".gz", ".zst", NULL };
+
+static long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-static FILE *out_fp = NULL;
-static int out_cnt = 0;
-static int out_max = 500 * 1024;
+static void write_all(int fd, const unsigned char *ptr, size_t len) {
+	while (len) {
+		ssize_t rv = write(fd, ptr, len);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		ptr += rv;
+		len -= rv;
+	}
+}
+
+static void log_flush(void) {
+	if (loglen && out_fd != -1)
+		write_all(out_fd, logbuf, loglen);
+	loglen = 0;
+}
 
 static void log_close(void) {
-	if (out_fp) {
-		fclose(out_fp);
-		out_fp = NULL;
+	log_flush();
+	if (out_fd != -1) {
+		close(out_fd);
+		out_fd = -1;
 	}
 }
 
-static void log_rotate(const char *fname) {
-	struct stat s;
-	int index = strlen(fname);
-	char *name1 = malloc(index + 2 + 1);
-	char *name2 = malloc(index + 2 + 1);
-	if (!name1 || !name2)
-		errExit("malloc");
-	strcpy(name1, fname);
-	strcpy(name2, fname);
-	fflush(0);
-
-	// delete filename.5
-	sprintf(name1 + index, ".5");
-	if (stat(name1, &s) == 0) {
-		int rv = unlink(name1);
-		if (rv == -1)
-			perror("unlink");
-	}
-
-	// move files 1 to 4 down one position
-	sprintf(name2 + index, ".4");
-	if (stat(name2, &s) == 0) {
-		int rv = rename(name2, name1);
-		if (rv == -1)
-			perror("rename");
+static void log_open(const char *fname) {
+	out_fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0666);
+	if (out_fd == -1) {
+		fprintf(stderr, "Error: cannot open log file %s\n", fname);
+		exit(1);
 	}
+	out_cnt = 0;
+}
 
-	sprintf(name1 + index, ".3");
-	if (stat(name1, &s) == 0) {
-		int rv = rename(name1, name2);
-		if (rv == -1)
-			perror("rename");
+static char *log_name(const char *fname, int index, const char *suffix) {
+	char *name;
+	if (asprintf(&name, "%s.%d%s", fname, index, suffix) == -1)
+		errExit("asprintf");
+	return name;
+}
+
+// filename.4 is moved to filename.5, and so on, compressed or not;
+// filename.0 becomes filename.1
+static void rotate_files(const char *fname) {
+	int i;
+	int j;
+	for (j = 0; log_suffix[j]; j++) {
+		char *name = log_name(fname, LOG_KEEP, log_suffix[j]);
+		unlink(name);
+		free(name);
 	}
 
-	sprintf(name2 + index, ".2");
-	if (stat(name2, &s) == 0) {
-		/* coverity[toctou] */
-		int rv = rename(name2, name1);
-		if (rv == -1)
-			perror("rename");
+	for (i = LOG_KEEP - 1; i >= 0; i--) {
+		for (j = 0; log_suffix[j]; j++) {
+			// filename.0 is never compressed
+			if (i == 0 && j > 0)
+				break;
+			char *src = log_name(fname, i, log_suffix[j]);
+			char *dest = log_name(fname, i + 1, log_suffix[j]);
+			/* coverity[toctou] */
+			if (rename(src, dest) == -1 && errno != ENOENT)
+				perror("rename");
+			free(src);
+			free(dest);
+		}
 	}
+}
 
-	sprintf(name1 + index, ".1");
-	if (stat(name1, &s) == 0) {
-		int rv = rename(name1, name2);
-		if (rv == -1)
-			perror("rename");
+// running in a child process
+static void __attribute__((noreturn)) rotate_child(const char *fname) {
+	int fd = open("/dev/null", O_RDWR);
+	if (fd != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
 	}
+	int rv = nice(10);	// the compression does not compete with the sandbox
+	(void) rv;
 
-	// move the first file
-	if (out_fp)
-		fclose(out_fp);
+	rotate_files(fname);
+	if (compress_prog) {
+		char *name = log_name(fname, 1, "");
+		if (strcmp(compress_prog, "zstd") == 0)
+			execlp("zstd", "zstd", "-q", "-f", "--rm", name, NULL);
+		else
+			execlp("gzip", "gzip", "-f", name, NULL);
+		fprintf(stderr, "Warning ftee: cannot run %s\n", compress_prog);
+	}
+	_exit(0);
+}
 
-	out_fp = NULL;
-	if (stat(fname, &s) == 0) {
-		int rv = rename(fname, name1);
-		if (rv == -1)
+// the writer only renames the log file, the rest is done in the background
+static void log_rotate(const char *fname) {
+	log_close();
+
+	// filename.0 is still used by the previous rotation
+	if (rotate_pid > 0) {
+		waitpid(rotate_pid, NULL, 0);
+		rotate_pid = 0;
+	}
+
+	char *name = log_name(fname, 0, "");
+	int rv = rename(fname, name);
+	free(name);
+	if (rv == -1) {
+		if (errno != ENOENT)
 			perror("rename");
+		return;
 	}
 
-	free(name1);
-	free(name2);
+	pid_t pid = fork();
+	if (pid == -1)
+		rotate_files(fname);
+	else if (pid == 0)
+		rotate_child(fname);
+	else
+		rotate_pid = pid;
 }
 
-static void log_write(const unsigned char *str, int len, const char *fname) {
+// len bytes are going to the log file; open it, or rotate the files when
+// the size limit is reached
+static void log_account(size_t len, const char *fname) {
+	if (out_fd == -1)
+		log_open(fname);
+	else if (out_cnt + len >= out_max) {
+		log_rotate(fname);
+		log_open(fname);
+	}
+	out_cnt += len;
+}
+
+static void log_write(const unsigned char *str, size_t len, const char *fname) {
 	assert(fname);
+	assert(len <= CHUNK);
+
+	log_account(len, fname);
+	if (loglen + len > CHUNK)
+		log_flush();
+	if (loglen == 0)
+		flush_time = now_ms() + FLUSH_INTERVAL;
+	memcpy(logbuf + loglen, str, len);
+	loglen += len;
+}
 
-	if (out_fp == NULL) {
-		out_fp = fopen(fname, "w");
-		if (!out_fp) {
-			fprintf(stderr, "Error: cannot open log file %s\n", fname);
-			exit(1);
+// copy stdin with read(2) and write(2)
+static void copy_data(const char *fname) {
+	while (1) {
+		// wait for the next chunk, up to the flush time
+		if (loglen) {
+			long long timeout = flush_time - now_ms();
+			struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+			if (timeout <= 0 || poll(&pfd, 1, (int) timeout) == 0) {
+				log_flush();
+				continue;
+			}
 		}
-		out_cnt = 0;
-	}
 
-	// rotate files
-	out_cnt += len;
-	if (out_cnt >= out_max) {
-		log_rotate(fname);
+		ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
 
-		// reopen the first file
-		if (out_fp)
-			fclose(out_fp);
-		out_fp = fopen(fname, "w");
-		if (!out_fp) {
-			fprintf(stderr, "Error: cannot open log file %s\n", fname);
-			exit(1);
-		}
-		out_cnt = len;
+		write_all(STDOUT_FILENO, buf, n);
+		log_write(buf, n, fname);
 	}
+}
 
-	int rv = fwrite(str, len, 1, out_fp);
-	(void) rv;
-	fflush(0);
+// duplicate stdin on stdout with tee(2), and move it to the log file with splice(2)
+// return 0 if the pipes cannot be used this way, before any data is copied
+static int splice_data(const char *fname) {
+	int log_splice = 1;
+	int first = 1;
+	while (1) {
+		ssize_t n = tee(STDIN_FILENO, STDOUT_FILENO, CHUNK, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && first)
+			return 0;
+		if (n <= 0)
+			break;
+		first = 0;
+
+		log_account(n, fname);
+		while (n > 0) {
+			ssize_t rv = -1;
+			if (log_splice) {
+				rv = splice(STDIN_FILENO, NULL, out_fd, NULL, n, SPLICE_F_MOVE);
+				if (rv < 0 && errno == EINTR)
+					continue;
+				if (rv < 0 && errno == EINVAL)
+					log_splice = 0;	// the filesystem does not support splice
+			}
+			if (rv < 0) {
+				// the data has to be taken out of the pipe anyway
+				rv = read(STDIN_FILENO, buf, (size_t) n < sizeof(buf) ? (size_t) n : sizeof(buf));
+				if (rv < 0 && errno == EINTR)
+					continue;
+				if (rv <= 0)
+					return 1;
+				write_all(out_fd, buf, rv);
+			}
+			n -= rv;
+		}
+	}
+	return 1;
 }
 
+static int is_pipe(int fd) {
+	struct stat s;
+	return fstat(fd, &s) == 0 && S_ISFIFO(s.st_mode);
+}
 
 // return 1 if the file is a directory
 static int is_dir(const char *fname) {
@@ -179,7 +320,7 @@ static int is_link(const char *fname) {
 }
 
 static const char *const usage_str =
-	"Usage: ftee filename\n";
+	"Usage: ftee [--compress=gzip|zstd] filename\n";
 
 static void usage(void) {
 	puts(usage_str);
@@ -195,7 +336,21 @@ int main(int argc, char **argv) {
 		usage();
 		return 0;
 	}
-	char *fname = argv[1];
+	int i = 1;
+	if (strncmp(argv[i], "--compress=", 11) == 0) {
+		compress_prog = argv[i] + 11;
+		if (strcmp(compress_prog, "gzip") != 0 && strcmp(compress_prog, "zstd") != 0) {
+			fprintf(stderr, "Error ftee: invalid compression program %s\n", compress_prog);
+			exit(1);
+		}
+		i++;
+	}
+	if (i >= argc) {
+		fprintf(stderr, "Error: please provide a filename to store the program output\n");
+		usage();
+		exit(1);
+	}
+	char *fname = argv[i];
 
 
 	// do not accept directories, links, and files with ".."
@@ -224,18 +379,8 @@ int main(int argc, char **argv) {
 	// preserve the last log file
 	log_rotate(fname);
 
-	setvbuf (stdout, NULL, _IONBF, 0);
-	while(1) {
-		int n = read(0, buf, sizeof(buf));
-		if (n < 0 && errno == EINTR)
-			continue;
-		if (n <= 0)
-			break;
-
-		int rv = fwrite(buf, n, 1, stdout);
-		(void) rv;
-		log_write(buf, n, fname);
-	}
+	if (!is_pipe(STDIN_FILENO) || !is_pipe(STDOUT_FILENO) || !splice_data(fname))
+		copy_data(fname);
 
 	log_close();
 	return 0;
@@ -145,10 +145,14 @@ static inline int mac_not_zero(const unsigned char mac[6]) {
 
 void timetrace_start(void);
 float timetrace_end(void);
+int namespace_type(const char *typestr);
+int open_namespace_by_fd(int dirfd, const char *typestr);
 int join_namespace_by_fd(int dirfd, char *typestr);
 int join_namespace(pid_t pid, char *typestr);
 int name2pid(const char *name, pid_t *pid);
 char *pid_proc_comm(const pid_t pid);
+unsigned long long pid_proc_start_time(const pid_t pid);
+int name_index_read(const char *name, pid_t *pid, unsigned long long *start);
 char *pid_proc_cmdline(const pid_t pid);
 int pid_proc_cmdline_x11_xpra_xephyr(const pid_t pid);
 int pid_hidepid(void);
@@ -161,4 +165,18 @@ void reject_meta_chars(const char *fname, int globbing);
 void warn_dumpable(void);
 const char *gnu_basename(const char *path);
 int *str_to_int_array(const char *str, size_t *sz);
+int copy_fd_data(int src, int dst);
+
+// FNV-1a hash; fnv1a32_update() continues a hash started with FNV1A32_INIT
+#define FNV1A32_INIT 2166136261U
+#define FNV1A64_INIT 0xcbf29ce484222325ULL
+uint32_t fnv1a32_update(uint32_t h, const void *data, size_t len);
+uint32_t fnv1a32(const void *data, size_t len);
+uint32_t fnv1a32_str(const char *str);
+uint64_t fnv1a64(const void *data, size_t len);
+uint64_t fnv1a64_str(const char *str);
+
+// JSON string, with the quotes; NULL is printed as null
+void json_print_string(FILE *fp, const char *str);
+char *json_string(const char *str);
 #endif
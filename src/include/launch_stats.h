@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef LAUNCH_STATS_H
+#define LAUNCH_STATS_H
+
+#include <stdint.h>
+
+// global launch counters in RUN_STATS_FILE, mapped shared by every firejail
+// process starting a sandbox and updated with atomic adds; firemon --stats
+// prints them. The counters are never reset, they start with the first
+// sandbox after boot. A phase slot is claimed by its first user with a
+// compare-and-swap on state, the name is published by storing
+// STATS_PHASE_READY.
+#define STATS_MAGIC 0x46535431		// "FST1"
+#define STATS_VERSION 1
+#define STATS_PHASES 64
+#define STATS_PHASE_NAME 48
+
+enum {
+	STATS_PHASE_FREE = 0,
+	STATS_PHASE_CLAIMED,		// the name is being written
+	STATS_PHASE_READY
+};
+
+enum {
+	STATS_LAUNCHES = 0,		// sandboxes started
+	STATS_STARTED,			// applications started
+	STATS_FAILURES,			// exited before starting the application
+	STATS_SBOX_RUNS,		// helper programs run with sbox_run
+	STATS_FCOPY_FILES,
+	STATS_FCOPY_BYTES,
+	STATS_SECCOMP_CACHE_HITS,
+	STATS_SECCOMP_CACHE_MISSES,
+	STATS_LOCK_WAITS,		// contended lock acquisitions
+	STATS_LOCK_WAIT_USEC,
+	STATS_COUNTER_MAX
+};
+
+static const char *const stats_names[STATS_COUNTER_MAX] __attribute__((unused)) = {
+	[STATS_LAUNCHES] = "launches",
+	[STATS_STARTED] = "started",
+	[STATS_FAILURES] = "failures",
+	[STATS_SBOX_RUNS] = "sbox-runs",
+	[STATS_FCOPY_FILES] = "fcopy-files",
+	[STATS_FCOPY_BYTES] = "fcopy-bytes",
+	[STATS_SECCOMP_CACHE_HITS] = "seccomp-cache-hits",
+	[STATS_SECCOMP_CACHE_MISSES] = "seccomp-cache-misses",
+	[STATS_LOCK_WAITS] = "lock-waits",
+	[STATS_LOCK_WAIT_USEC] = "lock-wait-usec",
+};
+
+typedef struct {
+	uint32_t state;
+	char name[STATS_PHASE_NAME];
+	uint64_t count;
+	uint64_t usec;		// cumulative, the nested phases are included
+} StatsPhase;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t created;	// time(NULL)
+	uint64_t counter[STATS_COUNTER_MAX] __attribute__((aligned(64)));
+	StatsPhase phase[STATS_PHASES] __attribute__((aligned(64)));
+} StatsSegment;
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include "../include/common.h"
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <time.h>
+
+// AF_PACKET capture with a TPACKET_V3 ring mapped in user space: the
+// kernel fills whole blocks of packets, and a single wakeup hands over
+// all the packets in the block
+typedef struct {
+	int sock;		// poll/select on this descriptor
+	unsigned char *map;
+	unsigned block_size;
+	unsigned block_cnt;
+	unsigned block;		// next block to process
+	struct timespec ts;	// kernel timestamp of the packet being handled
+	// PACKET_STATISTICS counters, accumulated
+	unsigned long long packets;
+	unsigned long long drops;
+} PacketRing;
+
+// pkt - the link layer header for SOCK_RAW, the network header for SOCK_DGRAM;
+// the packet can be modified in place, the block is returned to the kernel
+// only after all its packets are processed
+// pkttype - PACKET_HOST, PACKET_OUTGOING etc.
+typedef void (*PacketHandler)(unsigned char *pkt, unsigned len, unsigned char pkttype, void *arg);
+
+// type - SOCK_RAW or SOCK_DGRAM; no packet is received until packet_ring_bind
+void packet_ring_open(PacketRing *ring, int type);
+// protocol - ETH_P_ALL, ETH_P_IP etc.; attach the BPF filter before binding
+void packet_ring_bind(PacketRing *ring, int protocol);
+// process all the blocks released by the kernel, the number of packets is returned
+unsigned packet_ring_read(PacketRing *ring, PacketHandler handler, void *arg);
+// update the packets and drops counters; the number of packets dropped
+// since the last call is returned
+unsigned long long packet_ring_stats(PacketRing *ring);
+void packet_ring_close(PacketRing *ring);
+
+#endif
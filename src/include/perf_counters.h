@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include "../include/common.h"
+
+// perf_event counters for all the processes of a sandbox: either the
+// processes in a cgroup v2 (one counter on every cpu, PERF_FLAG_PID_CGROUP),
+// or a set of tasks and all the tasks they start after the counters are
+// opened (inherited counters)
+enum {
+	PERF_CYCLES = 0,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_CONTEXT_SWITCHES,
+	PERF_EVENT_MAX
+};
+
+typedef struct {
+	int *fd[PERF_EVENT_MAX];
+	int cnt[PERF_EVENT_MAX];	// descriptors opened
+	int user_only[PERF_EVENT_MAX];	// the kernel is not counted
+} PerfCounters;
+
+typedef struct {
+	unsigned long long val[PERF_EVENT_MAX];
+	int valid[PERF_EVENT_MAX];
+	int scaled[PERF_EVENT_MAX];	// estimated, the counter was multiplexed
+	int user_only[PERF_EVENT_MAX];
+} PerfValues;
+
+void perf_counters_init(PerfCounters *pc);
+// kernel - also count the hardware events in kernel mode, if allowed
+// the number of descriptors opened is returned, 0 if none
+int perf_counters_cgroup(PerfCounters *pc, int cgroup_fd, int kernel);
+int perf_counters_task(PerfCounters *pc, pid_t tid, int kernel);
+void perf_counters_read(const PerfCounters *pc, PerfValues *v);
+void perf_counters_close(PerfCounters *pc);
+// print one line per counter; with prev set, the values since prev
+void perf_values_print(FILE *fp, const PerfValues *v, const PerfValues *prev, const char *indent);
+
+#endif
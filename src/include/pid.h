@@ -19,19 +19,23 @@
 */
 #ifndef PID_H
 #define PID_H
-extern int max_pids;
-
-
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <sys/types.h>
 #include <unistd.h>
 typedef struct {
+	pid_t pid;
 	short level;  // -1 not a firejail process, 0 not investigated yet, 1 firejail process, > 1 firejail child
 	unsigned char zombie;
-	pid_t parent;
+	pid_t parent; // parent pid
 	uid_t uid;
 
+	// state kept across pid_read() calls
+	unsigned char firejail; // firejail process, level 1 unless started by another firejail process
+	unsigned seen; // last pid_read() call finding the process in /proc
+	ino_t ino; // inode of /proc/<pid>, a reused pid gets a new inode
+	int stat_fd; // /proc/<pid>/stat kept open for sandbox processes, -1 if not open
+
 	union {
 		struct event_t {
 			char *user;
@@ -49,12 +53,20 @@ typedef struct {
 		} netstats;
 	} option;
 } Process;
-//extern Process pids[max_pids];
+// dense process table, indexed by pid_find()
 extern Process *pids;
+extern int pids_cnt;
+
+// process table functions
+int pid_find(pid_t pid);
+int pid_add(pid_t pid);
+void pid_remove(int index);
 
 // pid functions
 void pid_getmem(unsigned pid, unsigned *rss, unsigned *shared);
 void pid_get_cpu_time(unsigned pid, unsigned *utime, unsigned *stime);
+void pid_read_cpu_time(int index, unsigned *utime, unsigned *stime);
+int pid_read_stat(int index, unsigned *utime, unsigned *stime, unsigned *threads);
 unsigned long long pid_get_start_time(unsigned pid);
 uid_t pid_get_uid(pid_t pid);
 char *pid_get_user_name(uid_t uid);
@@ -62,5 +74,8 @@ char *pid_get_user_name(uid_t uid);
 void pid_print_tree(unsigned index, unsigned parent, int nowrap);
 void pid_print_list(unsigned index, int nowrap);
 void pid_read(pid_t mon_pid);
+// process events
+int pid_netlink_open(void);
+void pid_track_events(void);
 
 #endif
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+#include <dlfcn.h>
+
+// The original functions of an LD_PRELOAD library, resolved with dlsym()
+// in a single pass from the library constructor. The library lists the
+// functions as
+//	X(return type, name, (parameters), (arguments))
+// and PRELOAD_TABLE(list) declares an orig_<name> pointer for each one.
+//
+// The constructors of the other libraries can run before ours, so every
+// pointer starts on a stub that resolves the whole table and calls the
+// original function; after that, the wrappers call straight through.
+#define PRELOAD_DECLARE(ret, name, params, args) \
+	typedef ret (*orig_##name##_t) params; \
+	static ret stub_##name params; \
+	static orig_##name##_t orig_##name = stub_##name;
+
+#define PRELOAD_RESOLVE(ret, name, params, args) \
+	orig_##name = (orig_##name##_t) dlsym(RTLD_NEXT, #name);
+
+#define PRELOAD_STUB(ret, name, params, args) \
+	static ret stub_##name params { \
+		preload_resolve(); \
+		return orig_##name args; \
+	}
+
+#define PRELOAD_TABLE(list) \
+	list(PRELOAD_DECLARE) \
+	static void preload_resolve(void) { \
+		list(PRELOAD_RESOLVE) \
+	} \
+	list(PRELOAD_STUB)
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PROFILE_BUNDLE_H
+#define PROFILE_BUNDLE_H
+#include <stdint.h>
+
+// The profile bundle is a snapshot of the profiles in SYSCONFDIR, built by
+// "profstats --bundle" during make install. The file starts with a header,
+// followed by an index sorted by file name, the file names and the file
+// contents. Offsets are relative to the start of the file.
+#define PROFILE_BUNDLE_MAGIC "FJPBNDL"	// 7 characters plus '\0'
+#define PROFILE_BUNDLE_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;		// number of files
+	// SYSCONFDIR when the bundle was built; a file added, removed or replaced
+	// changes the directory mtime and invalidates the bundle
+	uint64_t dir_dev;
+	uint64_t dir_ino;
+	int64_t dir_mtime_sec;
+	int64_t dir_mtime_nsec;
+} ProfileBundleHeader;
+
+typedef struct {
+	uint32_t name_off;	// '\0' terminated file name, no directory
+	uint32_t data_off;
+	uint32_t data_len;
+	uint32_t reserved;
+} ProfileBundleEntry;
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef RUN_RECORD_H
+#define RUN_RECORD_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+
+// RUN_FIREJAIL_RECORD_DIR/<pid>: everything the tools need to know about a
+// sandbox, in a single fixed-size record. The file is written by the firejail
+// process, and it is replaced atomically for every update.
+#define RUN_RECORD_MAGIC 0x464a5231	// "FJR1"
+#define RUN_RECORD_NAME_MAX 320		// --name, and the -pid suffix if the name is taken
+#define RUN_RECORD_POOL_MAX 64		// --pool
+
+// options
+#define RUN_RECORD_NETWORK	0x1	// network namespace
+
+typedef struct {
+	uint32_t magic;
+	uint32_t size;		// sizeof(RunRecord)
+	int32_t pid;		// firejail process
+	int32_t child;		// first process in the sandbox, 0 until it is started
+	uint64_t start;		// start time of the firejail process, clock ticks after boot
+	int32_t x11;		// X11 display, 0 if none
+	uint32_t options;	// RUN_RECORD_NETWORK etc.
+	char name[RUN_RECORD_NAME_MAX];	// empty if the sandbox has no name
+	char profile[PATH_MAX];		// empty if no profile was loaded
+	char pool[RUN_RECORD_POOL_MAX];	// empty if the sandbox is not in a pool
+} RunRecord;
+
+// read the record of the sandbox started by pid, return -1 if not found
+int run_record_read(pid_t pid, RunRecord *rec);
+
+#endif
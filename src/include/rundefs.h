@@ -25,23 +25,40 @@
 #define RUN_FIREJAIL_DIR		RUN_FIREJAIL_BASEDIR "/firejail"
 #define RUN_FIREJAIL_SANDBOX_DIR	RUN_FIREJAIL_DIR "/sandbox"
 #define RUN_FIREJAIL_APPIMAGE_DIR	RUN_FIREJAIL_DIR "/appimage"
-#define RUN_FIREJAIL_NAME_DIR		RUN_FIREJAIL_DIR "/name"
+#define RUN_FIREJAIL_ROOTFS_DIR		RUN_FIREJAIL_DIR "/rootfs"
+#define RUN_FIREJAIL_RECORD_DIR		RUN_FIREJAIL_DIR "/record"
+#define RUN_FIREJAIL_NAME_INDEX_DIR	RUN_FIREJAIL_DIR "/name-index"
 #define RUN_FIREJAIL_LIB_DIR		RUN_FIREJAIL_DIR "/lib"
-#define RUN_FIREJAIL_X11_DIR		RUN_FIREJAIL_DIR "/x11"
 #define RUN_FIREJAIL_NETWORK_DIR	RUN_FIREJAIL_DIR "/network"
 #define RUN_FIREJAIL_BANDWIDTH_DIR	RUN_FIREJAIL_DIR "/bandwidth"
-#define RUN_FIREJAIL_PROFILE_DIR	RUN_FIREJAIL_DIR "/profile"
+#define RUN_FIREJAIL_CGROUP_DIR	RUN_FIREJAIL_DIR "/cgroup"
+#define RUN_FIREJAIL_NUMA_DIR		RUN_FIREJAIL_DIR "/numa"
+#define RUN_FIREJAIL_X11_DIR		RUN_FIREJAIL_DIR "/x11"
+#define RUN_FIREJAIL_SNAPSHOT_DIR	RUN_FIREJAIL_DIR "/home-snapshot"
 #define RUN_FIREJAIL_DBUS_DIR RUN_FIREJAIL_DIR "/dbus"
+#define RUN_FIREJAIL_SECCOMP_CACHE_DIR	RUN_FIREJAIL_DIR "/seccomp-cache"
+#define RUN_FIREJAIL_FLDD_CACHE_DIR	RUN_FIREJAIL_DIR "/fldd-cache"
+#define RUN_FIREJAIL_DEV_CACHE_DIR	RUN_FIREJAIL_DIR "/dev-cache"
+#define RUN_FIREJAIL_USERS_CACHE_DIR	RUN_FIREJAIL_DIR "/users-cache"
+#define RUN_FIREJAIL_VAR_CACHE_DIR	RUN_FIREJAIL_DIR "/var-cache"
+#define RUN_FIREJAIL_KPATH_CACHE_DIR	RUN_FIREJAIL_DIR "/kpath-cache"
+#define RUN_FIREJAIL_HOSTS_CACHE_DIR	RUN_FIREJAIL_DIR "/hosts-cache"
+#define RUN_FIREJAIL_PULSE_CACHE_DIR	RUN_FIREJAIL_DIR "/pulse-cache"
+#define RUN_STATS_FILE			RUN_FIREJAIL_DIR "/stats"
+#define RUN_CONTROL_SOCKET		RUN_FIREJAIL_DIR "/control.sock"
 #define RUN_NETWORK_LOCK_FILE		RUN_FIREJAIL_DIR "/firejail-network.lock"
 #define RUN_DIRECTORY_LOCK_FILE		RUN_FIREJAIL_DIR "/firejail-run.lock"
+#define RUN_APPIMAGE_LOCK_FILE		RUN_FIREJAIL_DIR "/firejail-appimage.lock"
 #define RUN_RO_DIR			RUN_FIREJAIL_DIR "/firejail.ro.dir"
 #define RUN_RO_FILE			RUN_FIREJAIL_DIR "/firejail.ro.file"
 #define RUN_MNT_DIR			RUN_FIREJAIL_DIR "/mnt"	// a tmpfs is mounted on this directory before any of the files below are created
 #define RUN_CPU_CFG			RUN_MNT_DIR "/cpu"
+#define RUN_NUMA_CFG			RUN_MNT_DIR "/numa"
 #define RUN_GROUPS_CFG			RUN_MNT_DIR "/groups"
 #define RUN_PROTOCOL_CFG		RUN_MNT_DIR "/protocol"
 #define RUN_NONEWPRIVS_CFG		RUN_MNT_DIR "/nonewprivs"
 #define RUN_HOME_DIR			RUN_MNT_DIR "/home"
+#define RUN_HOME_UPPER_DIR		RUN_MNT_DIR "/home-upper"
 #define RUN_ETC_DIR			RUN_MNT_DIR "/etc"
 #define RUN_USR_ETC_DIR		RUN_MNT_DIR "/usretc"
 #define RUN_OPT_DIR			RUN_MNT_DIR "/opt"
@@ -50,6 +67,7 @@
 #define RUN_PULSE_DIR			RUN_MNT_DIR "/pulse"
 #define RUN_LIB_DIR			RUN_MNT_DIR "/lib"
 #define RUN_LIB_FILE			RUN_MNT_DIR "/libfiles"
+#define RUN_FCOPY_STATS_FILE		RUN_MNT_DIR "/fcopy-stats"
 #define RUN_DNS_ETC			RUN_MNT_DIR "/dns-etc"
 #define RUN_DHCLIENT_DIR			RUN_MNT_DIR "/dhclient-dir"
 #define RUN_DHCLIENT_4_LEASES_FILE		RUN_DHCLIENT_DIR "/dhclient.leases"
@@ -63,6 +81,7 @@
 
 #define RUN_SECCOMP_DIR			RUN_MNT_DIR "/seccomp"
 #define RUN_SECCOMP_LIST		RUN_SECCOMP_DIR "/seccomp.list"		// list of seccomp files installed
+#define RUN_SECCOMP_STACK		RUN_SECCOMP_DIR "/seccomp.stack"		// the same filters, merged, for --join
 #define RUN_SECCOMP_PROTOCOL		RUN_SECCOMP_DIR "/seccomp.protocol"		// protocol filter
 #define RUN_SECCOMP_CFG			RUN_SECCOMP_DIR "/seccomp"			// configured filter
 #define RUN_SECCOMP_32			RUN_SECCOMP_DIR "/seccomp.32"			// 32bit arch filter installed on 64bit architectures
@@ -73,6 +92,7 @@
 #define RUN_SECCOMP_BLOCK_SECONDARY	RUN_SECCOMP_DIR "/seccomp.block_secondary"	// secondary arch blocking filter
 #define RUN_SECCOMP_POSTEXEC		RUN_SECCOMP_DIR "/seccomp.postexec"		// filter for post-exec library
 #define RUN_SECCOMP_POSTEXEC_32		RUN_SECCOMP_DIR "/seccomp.postexec32"		// filter for post-exec library
+#define RUN_SECCOMP_FLAGS		RUN_SECCOMP_DIR "/seccomp.flags"		// SECCOMP_FILTER_FLAG_* for join and post-exec library
 #define PATH_SECCOMP_DEFAULT 		LIBDIR "/firejail/seccomp"			// default filter built during make
 #define PATH_SECCOMP_DEFAULT_DEBUG 	LIBDIR "/firejail/seccomp.debug"		// debug filter built during make
 #define PATH_SECCOMP_32 		LIBDIR "/firejail/seccomp.32"			// 32bit arch filter built during make
@@ -82,13 +102,12 @@
 #define PATH_SECCOMP_NAMESPACES	LIBDIR "/firejail/seccomp.namespaces"	// filter for restrict-namespaces
 #define PATH_SECCOMP_NAMESPACES_32	LIBDIR "/firejail/seccomp.namespaces.32"
 #define PATH_SECCOMP_BLOCK_SECONDARY 	LIBDIR "/firejail/seccomp.block_secondary"	// secondary arch blocking filter built during make
+#define PATH_PROFILE_BUNDLE		LIBDIR "/firejail/profiles.bundle"		// profile snapshot built during make install
+#define PATH_SECCOMP_STORE		LIBDIR "/firejail/seccomp.store"		// stock profile filters built during make install
 
 #define RUN_DEV_DIR			RUN_MNT_DIR "/dev"
 #define RUN_DEVLOG_FILE			RUN_MNT_DIR "/devlog"
-#define RUN_XAUTHORITY_FILE		RUN_MNT_DIR "/.Xauthority"		// private options
-#define RUN_XAUTH_FILE			RUN_MNT_DIR "/xauth"			// x11=xorg
 #define RUN_XAUTHORITY_SEC_DIR		RUN_MNT_DIR "/.sec.Xauthority"		// x11=xorg
-#define RUN_ASOUNDRC_FILE		RUN_MNT_DIR "/.asoundrc"
 #define RUN_HOSTNAME_FILE		RUN_MNT_DIR "/hostname"
 #define RUN_HOSTS_FILE			RUN_MNT_DIR "/hosts"
 #define RUN_HOSTS_FILE2			RUN_MNT_DIR "/hosts2"
@@ -99,8 +118,11 @@
 #define RUN_GROUP_FILE			RUN_MNT_DIR "/group"
 #define RUN_FSLOGGER_FILE		RUN_MNT_DIR "/fslogger"
 #define RUN_TRACE_FILE			RUN_MNT_DIR "/trace"
+#define RUN_TRACE_RING_FILE		RUN_MNT_DIR "/trace-ring"
 #define RUN_UMASK_FILE			RUN_MNT_DIR "/umask"
+#define RUN_BLACKLIST_LANDLOCK_FILE	RUN_MNT_DIR "/blacklist-landlock"
 #define RUN_JOIN_FILE	 		RUN_MNT_DIR "/join"
+#define RUN_JOIN_DESC_FILE		RUN_MNT_DIR "/join-desc"
 #define RUN_OVERLAY_ROOT		RUN_MNT_DIR "/oroot"
 #define RUN_RESOLVCONF_FILE		RUN_MNT_DIR "/resolv.conf"
 
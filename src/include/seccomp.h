@@ -101,6 +101,17 @@
 #define SECCOMP_RET_LOG		0x7ffc0000U
 #endif
 
+// seccomp(2) filter flags, Linux 3.17 and 4.17
+#ifndef SECCOMP_SET_MODE_FILTER
+#define SECCOMP_SET_MODE_FILTER 1
+#endif
+#ifndef SECCOMP_FILTER_FLAG_TSYNC
+#define SECCOMP_FILTER_FLAG_TSYNC (1UL << 0)
+#endif
+#ifndef SECCOMP_FILTER_FLAG_SPEC_ALLOW
+#define SECCOMP_FILTER_FLAG_SPEC_ALLOW (1UL << 2)
+#endif
+
 
 #if defined(__i386__)
 # define ARCH_NR	AUDIT_ARCH_I386
@@ -231,6 +242,15 @@
 #define EXAMINE_ARGUMENT(nr) BPF_STMT(BPF_LD+BPF_W+BPF_ABS,	\
 		 (offsetof(struct seccomp_data, args[nr])))
 
+// 32 bit halves of a 64 bit argument
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define ARGUMENT_LO(nr) (offsetof(struct seccomp_data, args[nr]))
+#define ARGUMENT_HI(nr) (offsetof(struct seccomp_data, args[nr]) + 4)
+#else
+#define ARGUMENT_LO(nr) (offsetof(struct seccomp_data, args[nr]) + 4)
+#define ARGUMENT_HI(nr) (offsetof(struct seccomp_data, args[nr]))
+#endif
+
 #define ONLY(syscall_nr)	\
 	BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K, syscall_nr, 1, 0),	\
 	BPF_STMT(BPF_RET+BPF_K, SECCOMP_RET_ALLOW)
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef SECCOMP_STORE_H
+#define SECCOMP_STORE_H
+#include <stdint.h>
+
+// The seccomp filter store holds the seccomp, seccomp.drop and seccomp.keep
+// filters used by the profiles in SYSCONFDIR, built and optimized by
+// "profstats --seccomp-store" during make install. The file starts with a
+// header, followed by an index sorted by hash, the specifications and the
+// filters. Offsets are relative to the start of the file.
+//
+// The specification is "command\nlist", the command and the syscall list
+// as they are passed to fseccomp by firejail: default, default32, drop,
+// drop32, keep or keep32. The filters are built with the default error
+// action (EPERM), without hot syscalls and without allow-debuggers.
+#define SECCOMP_STORE_MAGIC "FJSCSTR"	// 7 characters plus '\0'
+#define SECCOMP_STORE_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;		// number of filters
+	char fj_version[32];	// VERSION
+	// fseccomp and fsec-optimize as installed; a new build of either
+	// invalidates the store
+	int64_t fseccomp_size;
+	int64_t fseccomp_mtime;
+	int64_t optimize_size;
+	int64_t optimize_mtime;
+} SeccompStoreHeader;
+
+typedef struct {
+	uint64_t hash;		// fnv1a64() of the specification
+	uint32_t spec_off;	// not '\0' terminated
+	uint32_t spec_len;
+	uint32_t bpf_off;
+	uint32_t bpf_len;
+	uint32_t postexec_off;
+	uint32_t postexec_len;	// 0 if there is no postexec filter
+} SeccompStoreEntry;
+
+#endif
@@ -21,6 +21,7 @@
 #define SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 // main.c
 extern int arg_quiet;
@@ -35,11 +36,62 @@ int errno_find_name(const char *name);
 const char *errno_find_nr(int nr);
 
 // syscall.c
+#define ERRNO_KILL -2	// syscall:kill
+
+// argument rules, syscall:argN[&mask]OPvalue[:errno|:kill]; the argument,
+// masked with mask, is compared with value as a 64 bit unsigned number
+enum {
+	SYSCALL_CMP_EQ = 0,	// ==
+	SYSCALL_CMP_NE,		// !=, also argN&mask without a comparison
+	SYSCALL_CMP_LT,		// <
+	SYSCALL_CMP_LE,		// <=
+	SYSCALL_CMP_GT,		// >
+	SYSCALL_CMP_GE		// >=
+};
+typedef struct {
+	short nr;		// syscall number
+	short action;		// errno, ERRNO_KILL, 0 for the action of the filter
+	unsigned char arg;	// argument 0 to 5
+	unsigned char op;	// SYSCALL_CMP_*
+	uint64_t mask;
+	uint64_t value;
+} SyscallRule;
+
+// syscall sets, for syscall numbers 0 to SYSCALL_SET_MAX - 1; arg is
+// the errno for syscall:errno, ERRNO_KILL for syscall:kill, 0 otherwise;
+// the argument rules only apply to syscalls not in the set itself, the
+// first matching rule for a syscall wins
+#define SYSCALL_SET_MAX 1024
+#define SYSCALL_SET_WORDS (SYSCALL_SET_MAX / 64)
+#define SYSCALL_SET_RULES 64
+typedef struct {
+	uint64_t bit[SYSCALL_SET_WORDS];
+	short arg[SYSCALL_SET_MAX];
+	int rules;
+	SyscallRule rule[SYSCALL_SET_RULES];
+} SyscallSet;
+
+static inline bool syscall_set_has(const SyscallSet *set, int syscall) {
+	return syscall >= 0 && syscall < SYSCALL_SET_MAX &&
+		(set->bit[syscall / 64] & ((uint64_t) 1 << (syscall % 64)));
+}
+
 void syscall_print(void);
 void syscall_print_32(void);
 typedef void (filter_fn)(int fd, int syscall, int arg, void *ptrarg, bool native);
 int syscall_check_list(const char *slist, filter_fn *callback, int fd, int arg, void *ptrarg, bool native);
 const char *syscall_find_nr(int nr);
-void syscalls_in_list(const char *list, const char *slist, int fd, char **prelist, char **postlist, bool native);
+const char *syscall_find_nr_32(int nr);
+void syscall_set_clear(SyscallSet *set);
+bool syscall_set_empty(const SyscallSet *set);
+void syscall_set_union(SyscallSet *dst, const SyscallSet *src);
+void syscall_set_intersect(SyscallSet *dst, const SyscallSet *src);
+void syscall_set_subtract(SyscallSet *dst, const SyscallSet *src);
+void syscall_set_add(SyscallSet *set, int syscall, int arg);
+void syscall_set_add_rule(SyscallSet *set, const SyscallRule *rule);
+void syscall_set_build(SyscallSet *set, SyscallSet *excluded, const char *list, bool native);
+char *syscall_set_str(const SyscallSet *set, bool native);
+void syscalls_in_list(const char *list, const char *slist, SyscallSet *prelist, SyscallSet *postlist,
+		      SyscallSet *excluded, bool native);
 
 #endif
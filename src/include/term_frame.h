@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TERM_FRAME_H
+#define TERM_FRAME_H
+
+#include "../include/common.h"
+
+// Full-screen text display refreshed at regular intervals (firemon --top,
+// fnettrace). The previous frame is kept, and only the characters that
+// changed are sent to the terminal using ANSI cursor positioning, in a
+// single write. The lines can contain SGR escape sequences (bold, faint
+// etc.); they are cut at the terminal width.
+
+// start a new frame for a terminal of rows x cols characters; the screen is
+// cleared and fully repainted if the size changed
+void term_frame_begin(int rows, int cols);
+// add a line, a trailing '\n' is ignored; the lines past the last row
+// are dropped
+void term_frame_line(const char *str);
+// send the differences to the terminal
+void term_frame_end(void);
+// the screen was modified by other output, repaint it on the next frame
+void term_frame_reset(void);
+
+// Bounded top-N selection: a min-heap keeps the max lines with the
+// largest keys, the other lines are freed as they are added
+typedef struct {
+	double key;
+	unsigned seq;		// insertion order, for equal keys
+	char *line;
+} TopItem;
+
+typedef struct {
+	TopItem *item;
+	int cnt;
+	int max;
+	unsigned seq;
+} TopN;
+
+void topn_init(TopN *t, int max);
+// line is allocated with malloc, TopN takes ownership
+void topn_add(TopN *t, double key, char *line);
+// sort the lines in descending key order, the insertion order is kept for
+// equal keys; the lines are in t->item[0] to t->item[t->cnt - 1]
+void topn_sort(TopN *t);
+void topn_free(TopN *t);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <stdint.h>
+
+// --trace binary mode: libtrace.so writes fixed-size records in the
+// RUN_TRACE_RING_FILE segment, and the sandbox monitor decodes and prints
+// them. A thread writes in ring tid % TRACE_RINGS; a record is reserved
+// with a compare-and-swap on the ring head, and it is published by storing
+// its position + 1 in seq. When a ring is full the record is dropped,
+// the traced program never waits for the reader.
+#define TRACE_RING_MAGIC 0x46545231	// "FTR1"
+#define TRACE_RINGS 16
+#define TRACE_RING_RECORDS 2048		// power of 2
+#define TRACE_ARG_MAX 464		// longer arguments are truncated
+#define TRACE_NAME_MAX 16
+
+typedef struct {
+	uint32_t seq;		// position + 1 once the record is complete
+	uint16_t call;		// TRACE_OPEN etc.
+	uint16_t len;		// arg length
+	uint32_t pid;
+	uint32_t tid;
+	uint64_t time;		// CLOCK_MONOTONIC, ns
+	int64_t rv;
+	char name[TRACE_NAME_MAX];	// process name
+	char arg[TRACE_ARG_MAX];	// not '\0' terminated
+} TraceRecord;			// 512 bytes
+
+typedef struct {
+	// head and tail in different cache lines, the tail is written by the reader
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t tail __attribute__((aligned(64)));
+	TraceRecord rec[TRACE_RING_RECORDS] __attribute__((aligned(64)));
+} TraceRing;
+
+typedef struct {
+	uint32_t magic;
+	uint64_t drops;		// records dropped on full rings
+	TraceRing ring[TRACE_RINGS] __attribute__((aligned(64)));
+} TraceSegment;
+
+// intercepted calls
+enum {
+	TRACE_OPEN = 0,
+	TRACE_OPEN64,
+	TRACE_OPENAT,
+	TRACE_OPENAT64,
+	TRACE_FOPEN,
+	TRACE_FOPEN64,
+	TRACE_FREOPEN,
+	TRACE_FREOPEN64,
+	TRACE_UNLINK,
+	TRACE_UNLINKAT,
+	TRACE_MKDIR,
+	TRACE_MKDIRAT,
+	TRACE_RMDIR,
+	TRACE_STAT,
+	TRACE_LSTAT,
+	TRACE_FSTATAT,
+	TRACE_STATX,
+	TRACE_OPENDIR,
+	TRACE_ACCESS,
+	TRACE_FACCESSAT,
+	TRACE_CONNECT,
+	TRACE_SOCKET,
+	TRACE_BIND,
+	TRACE_SYSTEM,
+	TRACE_SETUID,
+	TRACE_SETGID,
+	TRACE_SETFSUID,
+	TRACE_SETFSGID,
+	TRACE_SETREUID,
+	TRACE_SETREGID,
+	TRACE_SETRESUID,
+	TRACE_SETRESGID,
+	TRACE_EXEC,
+	TRACE_KERNEL_OPEN,	// --trace-fanotify, not written by libtrace.so
+	TRACE_CALL_MAX
+};
+
+typedef struct {
+	const char *name;
+	const char *cls;	// file, network, process or id
+	int ptr;		// the return value is a pointer
+} TraceCall;
+
+static const TraceCall trace_calls[TRACE_CALL_MAX] __attribute__((unused)) = {
+	[TRACE_OPEN] = { "open", "file", 0 },
+	[TRACE_OPEN64] = { "open64", "file", 0 },
+	[TRACE_OPENAT] = { "openat", "file", 0 },
+	[TRACE_OPENAT64] = { "openat64", "file", 0 },
+	[TRACE_FOPEN] = { "fopen", "file", 1 },
+	[TRACE_FOPEN64] = { "fopen64", "file", 1 },
+	[TRACE_FREOPEN] = { "freopen", "file", 1 },
+	[TRACE_FREOPEN64] = { "freopen64", "file", 1 },
+	[TRACE_UNLINK] = { "unlink", "file", 0 },
+	[TRACE_UNLINKAT] = { "unlinkat", "file", 0 },
+	[TRACE_MKDIR] = { "mkdir", "file", 0 },
+	[TRACE_MKDIRAT] = { "mkdirat", "file", 0 },
+	[TRACE_RMDIR] = { "rmdir", "file", 0 },
+	[TRACE_STAT] = { "stat", "file", 0 },
+	[TRACE_LSTAT] = { "lstat", "file", 0 },
+	[TRACE_FSTATAT] = { "fstatat", "file", 0 },
+	[TRACE_STATX] = { "statx", "file", 0 },
+	[TRACE_OPENDIR] = { "opendir", "file", 1 },
+	[TRACE_ACCESS] = { "access", "file", 0 },
+	[TRACE_FACCESSAT] = { "faccessat", "file", 0 },
+	[TRACE_CONNECT] = { "connect", "network", 0 },
+	[TRACE_SOCKET] = { "socket", "network", 0 },
+	[TRACE_BIND] = { "bind", "network", 0 },
+	[TRACE_SYSTEM] = { "system", "process", 0 },
+	[TRACE_SETUID] = { "setuid", "id", 0 },
+	[TRACE_SETGID] = { "setgid", "id", 0 },
+	[TRACE_SETFSUID] = { "setfsuid", "id", 0 },
+	[TRACE_SETFSGID] = { "setfsgid", "id", 0 },
+	[TRACE_SETREUID] = { "setreuid", "id", 0 },
+	[TRACE_SETREGID] = { "setregid", "id", 0 },
+	[TRACE_SETRESUID] = { "setresuid", "id", 0 },
+	[TRACE_SETRESGID] = { "setresgid", "id", 0 },
+	[TRACE_EXEC] = { "exec", "process", 0 },
+	[TRACE_KERNEL_OPEN] = { "kernel-open", "file", 0 },
+};
+
+#endif
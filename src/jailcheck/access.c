@@ -19,7 +19,7 @@
 */
 #include "jailcheck.h"
 #include <dirent.h>
-#include <sys/wait.h>
+#include <fcntl.h>
 
 typedef struct {
 	char *tfile;
@@ -79,7 +79,7 @@ void access_setup(const char *directory) {
 
 	FILE *fp = fopen(test_file, "w");
 	if (!fp) {
-		printf("Warning: I cannot create test file in directory %s, skipping...\n", directory);
+		fprintf(stderr, "Warning: I cannot create test file in directory %s, skipping...\n", directory);
 		free(test_file);
 		free(path);
 		return;
@@ -110,37 +110,19 @@ void access_destroy(void) {
 	files_cnt = 0;
 }
 
-void access_test(void) {
-	// I am root in sandbox mount namespace
+void access_test(Report *r) {
+	// I am the user in sandbox mount namespace
 	assert(user_uid);
 	int i;
 
-	pid_t child = fork();
-	if (child == -1)
-		errExit("fork");
-
-	if (child == 0) { // child
-		// drop privileges
-		if (setgid(user_gid) != 0)
-			errExit("setgid");
-		if (setuid(user_uid) != 0)
-			errExit("setuid");
-
-		for (i = 0; i < files_cnt; i++) {
-			assert(td[i].tfile);
-
-			// try to open the file for reading
-			FILE *fp = fopen(td[i].tfile, "r");
-			if (fp) {
+	for (i = 0; i < files_cnt; i++) {
+		assert(td[i].tfile);
 
-				printf("   Warning: I can read %s\n", td[i].tdir);
-				fclose(fp);
-			}
+		// try to open the file for reading
+		int fd = open(td[i].tfile, O_RDONLY | O_CLOEXEC);
+		if (fd != -1) {
+			report_add(&r->readable, td[i].tdir);
+			close(fd);
 		}
-		exit(0);
 	}
-
-	// wait for the child to finish
-	int status;
-	wait(&status);
 }
@@ -19,21 +19,22 @@
 */
 #include "jailcheck.h"
 
+// return 1 if AppArmor is enabled, 0 if not, -1 if not tested
 #ifdef HAVE_APPARMOR
 #include <sys/apparmor.h>
 
-void apparmor_test(pid_t pid) {
+int apparmor_test(pid_t pid) {
 	char *label = NULL;
 	char *mode = NULL;
 	int rv = aa_gettaskcon(pid, &label, &mode);
-	if (rv == -1 || mode == NULL)
-		printf("   Warning: AppArmor not enabled\n");
+	free(label);
+	return (rv == -1 || mode == NULL) ? 0 : 1;
 }
 
 
 #else
-void apparmor_test(pid_t pid) {
+int apparmor_test(pid_t pid) {
 	(void) pid;
-	return;
+	return -1;
 }
 #endif
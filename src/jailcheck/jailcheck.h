@@ -28,37 +28,67 @@ extern gid_t user_gid;
 extern char *user_name;
 extern char *user_home_dir;
 extern char *user_run_dir;
+extern int arg_jsonl;
+
+// report.c
+// the results of the tests for a sandbox; the items are not copied, they
+// point to the test files set up in the parent process
+#define MAX_REPORT_ITEMS 32
+typedef struct {
+	const char *items[MAX_REPORT_ITEMS];
+	int cnt;
+} ReportList;
+
+typedef struct {
+	int apparmor;			// 1 enabled, 0 disabled, -1 not tested
+	int seccomp;			// 1 enabled, 0 disabled, -1 not tested
+	int network;			// 1 enabled, 0 disabled, -1 not tested
+	int fs_tested;			// the filesystem tests were run
+	char *command;			// the command of the sandbox, for --format=jsonl
+	ReportList virtual_dirs;	// directories private in the sandbox
+	ReportList exec;		// directories where the user can run programs
+	ReportList exec_skipped;	// directories where the user cannot create files
+	ReportList readable;		// access_setup() directories readable by the user
+	ReportList sysfiles;		// system files readable by the user
+	ReportList errors;
+} Report;
+
+void report_init(Report *r);
+void report_add(ReportList *l, const char *item);
+void report_start(int index, Report *r);
+void report_print(int index, pid_t pid, const Report *r);
 
 // access.c
 void access_setup(const char *directory);
-void access_test(void);
+void access_test(Report *r);
 void access_destroy(void);
 
 // noexec.c
 void noexec_setup(void);
-void noexec_test(const char *msg);
+void noexec_test(Report *r, const char *path);
 
 // sysfiles.c
 void sysfiles_setup(const char *file);
-void sysfiles_test(void);
+void sysfiles_test(Report *r);
 
 // virtual.c
 void virtual_setup(const char *directory);
 void virtual_destroy(void);
-void virtual_test(void);
+void virtual_test(Report *r);
 
 // apparmor.c
-void apparmor_test(pid_t pid);
+int apparmor_test(pid_t pid);
 
 // seccomp.c
-void seccomp_test(pid_t pid);
+int seccomp_test(pid_t pid);
 
 // network.c
-void network_test(void);
+int network_test(void);
+
 // utils.c
 char *get_sudo_user(void);
 char *get_homedir(const char *user, uid_t *uid, gid_t *gid);
-int find_child(pid_t pid);
+int find_child(int index);
 pid_t switch_to_child(pid_t pid);
 
 #endif
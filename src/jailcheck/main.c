@@ -21,6 +21,7 @@
 #include "../include/firejail_user.h"
 #include "../include/pid.h"
 #include <sys/wait.h>
+#include <errno.h>
 
 uid_t user_uid = 0;
 gid_t user_gid = 0;
@@ -28,12 +29,18 @@ char *user_name = NULL;
 char *user_home_dir = NULL;
 char *user_run_dir = NULL;
 int arg_debug = 0;
+int arg_jsonl = 0;
+static long arg_jobs = 1;
+#define MAX_JOBS 256
 
 static const char *const usage_str =
 	"Usage: jailcheck [options] directory [directory]\n\n"
 	"Options:\n"
 	"   --debug - print debug messages.\n"
+	"   --format=jsonl - print the results as a JSON object for each sandbox.\n"
 	"   --help, -? - this help screen.\n"
+	"   --parallel[=number] - check the sandboxes in parallel, by default in as\n"
+	"\tmany processes as CPUs.\n"
 	"   --version - print program version and exit.\n";
 
 static void print_version(void) {
@@ -55,6 +62,130 @@ static void cleanup(void) {
 	}
 }
 
+// all the tests for a sandbox, run in a child process; the child joins the
+// namespaces of the sandbox once, and drops the privileges once
+static void check_sandbox(int index) {
+	Report r;
+	report_init(&r);
+	report_start(index, &r);
+
+	// in case the pid is that of a firejail process, use the pid of the first child process
+	pid_t pid = find_child(index);
+	if (pid == -1) {
+		report_add(&r.errors, "I cannot find the sandboxed process");
+		goto out;
+	}
+	r.apparmor = apparmor_test(pid);
+	r.seccomp = seccomp_test(pid);
+
+	// network test, /proc is replaced when joining the mount namespace
+	if (join_namespace(pid, "net") == 0)
+		r.network = network_test();
+	else
+		report_add(&r.errors, "I cannot join the process network stack");
+
+	// filesystem tests
+	if (join_namespace(pid, "mnt") != 0) {
+		report_add(&r.errors, "I cannot join the process mount space");
+		goto out;
+	}
+
+	// drop privileges, this also keeps cleanup() from running in the child
+	if (setgid(user_gid) != 0)
+		errExit("setgid");
+	if (setuid(user_uid) != 0)
+		errExit("setuid");
+
+	r.fs_tested = 1;
+	virtual_test(&r);
+	noexec_test(&r, user_home_dir);
+	noexec_test(&r, "/tmp");
+	noexec_test(&r, "/var/tmp");
+	noexec_test(&r, user_run_dir);
+	access_test(&r);
+	sysfiles_test(&r);
+
+out:
+	report_print(index, pid, &r);
+}
+
+typedef struct {
+	pid_t child;	// 0 when the child is done
+	FILE *out;	// the output of the child, NULL if it goes directly to stdout
+} Job;
+
+static void print_job(Job *job) {
+	if (!job->out)
+		return;
+
+	rewind(job->out);
+	char buf[4096];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof(buf), job->out)) > 0)
+		fwrite(buf, 1, len, stdout);
+	fclose(job->out);
+	job->out = NULL;
+	fflush(0);
+}
+
+// check the sandboxes in at most arg_jobs child processes; the results
+// are printed in the order of the sandboxes
+static void check_sandboxes(const int *sandboxes, int cnt) {
+	if (cnt == 0)
+		return;
+
+	Job *jobs = calloc(cnt, sizeof(Job));
+	if (!jobs)
+		errExit("calloc");
+
+	int next = 0;
+	int running = 0;
+	int printed = 0;
+	while (printed < cnt) {
+		while (running < arg_jobs && next < cnt) {
+			Job *job = &jobs[next];
+			if (arg_jobs > 1) {
+				job->out = tmpfile();
+				if (!job->out)
+					errExit("tmpfile");
+			}
+			fflush(0);
+
+			job->child = fork();
+			if (job->child == -1)
+				errExit("fork");
+			if (job->child == 0) {
+				if (job->out && dup2(fileno(job->out), STDOUT_FILENO) == -1)
+					errExit("dup2");
+				check_sandbox(sandboxes[next]);
+				_exit(0);
+			}
+			next++;
+			running++;
+		}
+
+		int status;
+		pid_t child = wait(&status);
+		if (child == -1) {
+			if (errno == EINTR)
+				continue;
+			errExit("wait");
+		}
+		int i;
+		for (i = printed; i < next; i++) {
+			if (jobs[i].child == child) {
+				jobs[i].child = 0;
+				running--;
+				break;
+			}
+		}
+
+		while (printed < next && jobs[printed].child == 0)
+			print_job(&jobs[printed++]);
+	}
+	free(jobs);
+}
+
 int main(int argc, char **argv) {
 	int i;
 	int findex = 0;
@@ -68,12 +199,30 @@ int main(int argc, char **argv) {
 			print_version();
 			return 0;
 		}
-		else if (strncmp(argv[i], "--hello=", 8) == 0) { // used by noexec test
-			printf("   Warning: I can run programs in %s\n", argv[i] + 8);
+		else if (strncmp(argv[i], "--hello=", 8) == 0) // used by noexec test
 			return 0;
-		}
 		else if (strcmp(argv[i], "--debug") == 0)
 			arg_debug = 1;
+		else if (strncmp(argv[i], "--format=", 9) == 0) {
+			if (strcmp(argv[i] + 9, "jsonl") != 0) {
+				fprintf(stderr, "Error: invalid output format %s\n", argv[i] + 9);
+				return 1;
+			}
+			arg_jsonl = 1;
+		}
+		else if (strcmp(argv[i], "--parallel") == 0) {
+			arg_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+			if (arg_jobs < 1)
+				arg_jobs = 1;
+		}
+		else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+			char *end;
+			arg_jobs = strtol(argv[i] + 11, &end, 10);
+			if (*end != '\0' || arg_jobs < 1 || arg_jobs > MAX_JOBS) {
+				fprintf(stderr, "Error: invalid number of parallel checks\n");
+				return 1;
+			}
+		}
 		else if (strncmp(argv[i], "--", 2) == 0) {
 			fprintf(stderr, "Error: invalid option\n");
 			return 1;
@@ -145,75 +294,23 @@ int main(int argc, char **argv) {
 	sysfiles_setup("/usr/bin/xfce4-terminal");
 	sysfiles_setup("/usr/bin/lxterminal");
 
-	// print processes
+	// the sandboxes of the user
 	pid_read(0);
-	for (i = 0; i < max_pids; i++) {
+	int *sandboxes = malloc(pids_cnt * sizeof(int));
+	if (!sandboxes)
+		errExit("malloc");
+	int cnt = 0;
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 1) {
-			uid_t uid = pid_get_uid(i);
+			uid_t uid = pid_get_uid(pids[i].pid);
 			if (uid != user_uid) // not interested in other user sandboxes
 				continue;
-
-			// in case the pid is that of a firejail process, use the pid of the first child process
-			uid_t pid = find_child(i);
-			printf("\n");
-			pid_print_list(i, 0); //  no wrapping
-			apparmor_test(pid);
-			seccomp_test(pid);
-			fflush(0);
-
-			// filesystem tests
-			pid_t child = fork();
-			if (child == -1)
-				errExit("fork");
-			if (child == 0) {
-				int rv = join_namespace(pid, "mnt");
-				if (rv == 0) {
-					virtual_test();
-					noexec_test(user_home_dir);
-					noexec_test("/tmp");
-					noexec_test("/var/tmp");
-					noexec_test(user_run_dir);
-					access_test();
-					sysfiles_test();
-				}
-				else {
-					printf("   Error: I cannot join the process mount space\n");
-					exit(1);
-				}
-
-				// drop privileges in order not to trigger cleanup()
-				if (setgid(user_gid) != 0)
-					errExit("setgid");
-				if (setuid(user_uid) != 0)
-					errExit("setuid");
-				return 0;
-			}
-			int status;
-			wait(&status);
-
-			// network test
-			child = fork();
-			if (child == -1)
-				errExit("fork");
-			if (child == 0) {
-				int rv = join_namespace(pid, "net");
-				if (rv == 0)
-					network_test();
-				else {
-					printf("   Error: I cannot join the process network stack\n");
-					exit(1);
-				}
-
-				// drop privileges in order not to trigger cleanup()
-				if (setgid(user_gid) != 0)
-					errExit("setgid");
-				if (setuid(user_uid) != 0)
-					errExit("setuid");
-				return 0;
-			}
-			wait(&status);
+			sandboxes[cnt++] = i;
 		}
 	}
 
+	check_sandboxes(sandboxes, cnt);
+	free(sandboxes);
+
 	return 0;
 }
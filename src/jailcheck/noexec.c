@@ -46,7 +46,7 @@ void noexec_setup(void) {
 					// something went wrong!
 					free(execfile);
 					execfile = NULL;
-					printf("Warning: I cannot grab a copy of myself, skipping noexec test...\n");
+					fprintf(stderr, "Warning: I cannot grab a copy of myself, skipping noexec test...\n");
 					break;
 				}
 				len += rv;
@@ -60,10 +60,15 @@ void noexec_setup(void) {
 }
 
 
-void noexec_test(const char *path) {
+// the exit status of the test program
+#define NOEXEC_RUN 0	// jailcheck --hello
+#define NOEXEC_BLOCKED 1
+#define NOEXEC_SKIPPED 2
+
+void noexec_test(Report *r, const char *path) {
 	assert(user_uid);
 
-	// I am root in sandbox mount namespace
+	// I am the user in sandbox mount namespace
 	if (!execfile)
 		return;
 
@@ -76,24 +81,15 @@ void noexec_test(const char *path) {
 		errExit("fork");
 
 	if (child == 0) { // child
-		// drop privileges
-		if (setgid(user_gid) != 0)
-			errExit("setgid");
-		if (setuid(user_uid) != 0)
-			errExit("setuid");
-		int fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, 0700);
-		if (fd == -1) {
-			printf("   I cannot create files in %s, skipping noexec...\n", path);
-			exit(1);
-		}
+		int fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0700);
+		if (fd == -1)
+			_exit(NOEXEC_SKIPPED);
 
 		int len = 0;
 		while (len < execfile_len) {
 			int rv = write(fd, execfile + len, execfile_len - len);
-			if (rv == -1 || rv == 0) {
-				printf("   I cannot create files in %s, skipping noexec....\n", path);
-				exit(1);
-			}
+			if (rv == -1 || rv == 0)
+				_exit(NOEXEC_SKIPPED);
 			len += rv;
 		}
 		fchmod(fd, 0700);
@@ -104,11 +100,16 @@ void noexec_test(const char *path) {
 			errExit("asprintf");
 		int rv = execl(fname, fname, arg, NULL);
 		(void) rv; // if we get here execl failed
-		exit(0);
+		_exit(NOEXEC_BLOCKED);
 	}
 
 	int status;
-	wait(&status);
+	if (waitpid(child, &status, 0) == child && WIFEXITED(status)) {
+		if (WEXITSTATUS(status) == NOEXEC_RUN)
+			report_add(&r->exec, path);
+		else if (WEXITSTATUS(status) == NOEXEC_SKIPPED)
+			report_add(&r->exec_skipped, path);
+	}
 	int rv = unlink(fname);
 	(void) rv;
 	free(fname);
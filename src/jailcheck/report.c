@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "jailcheck.h"
+#include "../include/pid.h"
+
+void report_init(Report *r) {
+	assert(r);
+	memset(r, 0, sizeof(Report));
+	r->apparmor = -1;
+	r->seccomp = -1;
+	r->network = -1;
+}
+
+void report_add(ReportList *l, const char *item) {
+	assert(l);
+	assert(item);
+	if (l->cnt < MAX_REPORT_ITEMS)
+		l->items[l->cnt++] = item;
+}
+
+// the process list of the sandbox is read from /proc before joining the
+// mount namespace of the sandbox
+void report_start(int index, Report *r) {
+	assert(r);
+	if (arg_jsonl)
+		r->command = pid_proc_cmdline(pids[index].pid);
+	else {
+		printf("\n");
+		pid_print_list(index, 0); //  no wrapping
+		fflush(0);
+	}
+}
+
+static void print_text(const Report *r) {
+	int i;
+
+	if (r->apparmor == 0)
+		printf("   Warning: AppArmor not enabled\n");
+	if (r->seccomp == 0)
+		printf("   Warning: seccomp not enabled\n");
+	for (i = 0; i < r->errors.cnt; i++)
+		printf("   Error: %s\n", r->errors.items[i]);
+
+	if (r->fs_tested) {
+		int cnt = printf("   Virtual dirs: ");
+		for (i = 0; i < r->virtual_dirs.cnt; i++) {
+			if (cnt == 0)
+				cnt += printf("\n                 ");
+			cnt += printf("%s, ", r->virtual_dirs.items[i]);
+			if (cnt > 60)
+				cnt = 0;
+		}
+		printf("\n");
+	}
+
+	for (i = 0; i < r->exec.cnt; i++)
+		printf("   Warning: I can run programs in %s\n", r->exec.items[i]);
+	for (i = 0; i < r->exec_skipped.cnt; i++)
+		printf("   I cannot create files in %s, skipping noexec...\n", r->exec_skipped.items[i]);
+	for (i = 0; i < r->readable.cnt; i++)
+		printf("   Warning: I can read %s\n", r->readable.items[i]);
+	for (i = 0; i < r->sysfiles.cnt; i++)
+		printf("   Warning: I can access %s\n", r->sysfiles.items[i]);
+	if (r->network != -1)
+		printf("   Networking: %s\n", r->network ? "enabled" : "disabled");
+}
+
+static void print_bool(const char *key, int val) {
+	printf(",\"%s\":%s", key, (val == -1) ? "null" : (val ? "true" : "false"));
+}
+
+static void print_list(const char *key, const ReportList *l) {
+	printf(",\"%s\":[", key);
+	int i;
+	for (i = 0; i < l->cnt; i++) {
+		if (i)
+			putchar(',');
+		json_print_string(stdout, l->items[i]);
+	}
+	putchar(']');
+}
+
+// one JSON object on a single line
+static void print_jsonl(int index, pid_t pid, const Report *r) {
+	printf("{\"sandbox\":%d,\"pid\":%d,\"user\":", pids[index].pid, pid);
+	json_print_string(stdout, user_name);
+
+	fputs(",\"command\":", stdout);
+	json_print_string(stdout, r->command);
+
+	print_bool("apparmor", r->apparmor);
+	print_bool("seccomp", r->seccomp);
+	print_bool("network", r->network);
+	print_list("virtual_dirs", &r->virtual_dirs);
+	print_list("exec", &r->exec);
+	print_list("exec_skipped", &r->exec_skipped);
+	print_list("readable", &r->readable);
+	print_list("sysfiles", &r->sysfiles);
+	print_list("errors", &r->errors);
+	fputs("}\n", stdout);
+}
+
+// index: the firejail process in pids[]; pid: the process tested
+void report_print(int index, pid_t pid, const Report *r) {
+	assert(r);
+	if (arg_jsonl)
+		print_jsonl(index, pid, r);
+	else
+		print_text(r);
+	fflush(0);
+}
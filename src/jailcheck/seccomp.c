@@ -20,28 +20,27 @@
 #include "jailcheck.h"
 #define MAXBUF 4096
 
-void seccomp_test(pid_t pid) {
+// return 1 if seccomp is enabled, 0 if not, -1 if the process is gone
+int seccomp_test(pid_t pid) {
 	char *file;
 	if (asprintf(&file, "/proc/%d/status", pid) == -1)
 		errExit("asprintf");
 
 	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		printf("  Error: cannot open %s\n", file);
-		free(file);
-		return;
-	}
+	free(file);
+	if (!fp)
+		return -1;
 
+	int rv = 0;
 	char buf[MAXBUF];
 	while (fgets(buf, MAXBUF, fp)) {
 		if (strncmp(buf, "Seccomp:", 8) == 0) {
 			int val = -1;
-			int rv = sscanf(buf + 8, "\t%d", &val);
-			if (rv != 1 || val == 0)
-				printf("   Warning: seccomp not enabled\n");
+			if (sscanf(buf + 8, "\t%d", &val) == 1 && val != 0)
+				rv = 1;
 			break;
 		}
 	}
 	fclose(fp);
-	free(file);
+	return rv;
 }
@@ -70,15 +70,16 @@ errexit:
 //    14792:netblue:/usr/bin/transmission-qt
 // We need 14792, the first real sandboxed process
 // duplicate from src/firemon/main.c
-int find_child(int id) {
+// index: the firejail process in pids[]
+int find_child(int index) {
 	int i;
-	int first_child = -1;
+	pid_t first_child = -1;
 
 	// find the first child
-	for (i = 0; i < max_pids; i++) {
-		if (pids[i].level == 2 && pids[i].parent == id) {
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level == 2 && pids[i].parent == pids[index].pid) {
 			// skip /usr/bin/xdg-dbus-proxy (started by firejail for dbus filtering)
-			char *cmdline = pid_proc_cmdline(i);
+			char *cmdline = pid_proc_cmdline(pids[i].pid);
 			if (cmdline == NULL)
 				continue;
 			if (strncmp(cmdline, XDG_DBUS_PROXY_PATH, strlen(XDG_DBUS_PROXY_PATH)) == 0) {
@@ -86,7 +87,7 @@ int find_child(int id) {
 				continue;
 			}
 			free(cmdline);
-			first_child = i;
+			first_child = pids[i].pid;
 			break;
 		}
 	}
@@ -95,9 +96,9 @@ int find_child(int id) {
 		return -1;
 
 	// find the second-level child
-	for (i = 0; i < max_pids; i++) {
+	for (i = 0; i < pids_cnt; i++) {
 		if (pids[i].level == 3 && pids[i].parent == first_child)
-			return i;
+			return pids[i].pid;
 	}
 
 	// if a second child is not found, return the first child pid
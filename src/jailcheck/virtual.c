@@ -19,7 +19,7 @@
 */
 #include "jailcheck.h"
 #include <dirent.h>
-#include <sys/wait.h>
+#include <fcntl.h>
 
 
 #define MAX_TEST_FILES 16
@@ -48,7 +48,7 @@ void virtual_setup(const char *directory) {
 
 	FILE *fp = fopen(test_file, "w");
 	if (!fp) {
-		printf("Warning: I cannot create test file in directory %s, skipping...\n", directory);
+		fprintf(stderr, "Warning: I cannot create test file in directory %s, skipping...\n", directory);
 		free(test_file);
 		return;
 	}
@@ -79,48 +79,19 @@ void virtual_destroy(void) {
 	files_cnt = 0;
 }
 
-void virtual_test(void) {
-	// I am root in sandbox mount namespace
+void virtual_test(Report *r) {
+	// I am the user in sandbox mount namespace
 	assert(user_uid);
 	int i;
 
-	int cnt = 0;
-	cnt += printf("   Virtual dirs: "); fflush(0);
-
 	for (i = 0; i < files_cnt; i++) {
 		assert(files[i]);
 
-		// I am root!
-		pid_t child = fork();
-		if (child == -1)
-			errExit("fork");
-
-		if (child == 0) { // child
-			// drop privileges
-			if (setgid(user_gid) != 0)
-				errExit("setgid");
-			if (setuid(user_uid) != 0)
-				errExit("setuid");
-
-			// try to open the file for reading
-			FILE *fp = fopen(files[i], "r");
-			if (fp)
-				fclose(fp);
-			else {
-				if (cnt == 0)
-					cnt += printf("\n                 ");
-				cnt += printf("%s, ", dirs[i]);
-				if (cnt > 60)
-					cnt = 0;
-			}
-			fflush(0);
-			exit(cnt);
-		}
-
-		// wait for the child to finish
-		int status;
-		wait(&status);
-		cnt = WEXITSTATUS(status);
+		// the test file is not visible in a private directory
+		int fd = open(files[i], O_RDONLY | O_CLOEXEC);
+		if (fd != -1)
+			close(fd);
+		else
+			report_add(&r->virtual_dirs, dirs[i]);
 	}
-	printf("\n");
 }
@@ -34,6 +34,7 @@
 #include <sched.h>
 #include "../include/common.h"
 #include "../include/rundefs.h"
+#include "../include/run_record.h"
 
 #include <fcntl.h>
 #ifndef O_PATH
@@ -41,6 +42,10 @@
 #endif
 
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
 #ifndef NSIO
 #define NSIO 0xb7
 #endif
@@ -51,7 +56,7 @@
 #define BUFLEN 4096
 
 
-int join_namespace_by_fd(int dirfd, char *typestr) {
+int namespace_type(const char *typestr) {
 	int type;
 	if (strcmp(typestr, "net") == 0)
 		type = CLONE_NEWNET;
@@ -67,7 +72,11 @@ int join_namespace_by_fd(int dirfd, char *typestr) {
 		type = CLONE_NEWUSER;
 	else
 		assert(0);
+	return type;
+}
 
+// open ns/<typestr> in the /proc/<pid> directory, -1 on error
+int open_namespace_by_fd(int dirfd, const char *typestr) {
 	char *path;
 	if (asprintf(&path, "ns/%s", typestr) == -1)
 		errExit("asprintf");
@@ -75,7 +84,7 @@ int join_namespace_by_fd(int dirfd, char *typestr) {
 	int fd = openat(dirfd, path, O_RDONLY|O_CLOEXEC);
 	free(path);
 	if (fd < 0)
-		goto errout;
+		return -1;
 
 	// require that target namespace is owned by
 	// the current user namespace (Linux >= 4.9)
@@ -90,11 +99,20 @@ int join_namespace_by_fd(int dirfd, char *typestr) {
 			if (dest_userns.st_ino != self_userns.st_ino ||
 			    dest_userns.st_dev != self_userns.st_dev) {
 				close(fd);
-				goto errout;
+				return -1;
 			}
 		}
 	}
 
+	return fd;
+}
+
+int join_namespace_by_fd(int dirfd, char *typestr) {
+	int type = namespace_type(typestr);
+	int fd = open_namespace_by_fd(dirfd, typestr);
+	if (fd < 0)
+		goto errout;
+
 	if (syscall(__NR_setns, fd, type) < 0) {
 		close(fd);
 		goto errout;
@@ -124,70 +142,135 @@ int join_namespace(pid_t pid, char *typestr) {
 
 // return 1 if error
 // this function requires root access - todo: fix it!
+// the run record of the sandbox holds the name, the process is a firejail process
+static int name_check(pid_t pid, const char *name) {
+	// check if this is a firejail executable
+	char *comm = pid_proc_comm(pid);
+	if (comm) {
+		if (strcmp(comm, "firejail")) {
+			free(comm);
+			return 0;
+		}
+		free(comm);
+	}
+
+	// look for the sandbox name; the start time protects against pid reuse
+	RunRecord rec;
+	if (run_record_read(pid, &rec) == -1 || strcmp(rec.name, name))
+		return 0;
+	return rec.start == 0 || rec.start == pid_proc_start_time(pid);
+}
+
+int run_record_read(pid_t pid, RunRecord *rec) {
+	char *fname;
+	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_RECORD_DIR, pid) == -1)
+		errExit("asprintf");
+	int fd = open(fname, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	free(fname);
+	if (fd == -1)
+		return -1;
+
+	// the file is replaced atomically, a single read gets a consistent record
+	ssize_t len = read(fd, rec, sizeof(RunRecord));
+	close(fd);
+	if (len != sizeof(RunRecord) || rec->magic != RUN_RECORD_MAGIC ||
+	    rec->size != sizeof(RunRecord) || rec->pid != pid)
+		return -1;
+	rec->name[RUN_RECORD_NAME_MAX - 1] = '\0';
+	rec->profile[PATH_MAX - 1] = '\0';
+	rec->pool[RUN_RECORD_POOL_MAX - 1] = '\0';
+	return 0;
+}
+
+// RUN_FIREJAIL_NAME_INDEX_DIR/<name> holds the pid and the start time of the
+// sandbox; return 0 if found
+int name_index_read(const char *name, pid_t *pid, unsigned long long *start) {
+	// the index is only used for names valid as file names
+	if (*name == '\0' || *name == '.' || strchr(name, '/') || strlen(name) > 253)
+		return -1;
+
+	char *fname;
+	if (asprintf(&fname, "%s/%s", RUN_FIREJAIL_NAME_INDEX_DIR, name) == -1)
+		errExit("asprintf");
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return -1;
+
+	int rv = (fscanf(fp, "%d %llu", pid, start) == 2) ? 0 : -1;
+	fclose(fp);
+	return rv;
+}
+
 int name2pid(const char *name, pid_t *pid) {
 	pid_t parent = getpid();
 
-	DIR *dir;
-	if (!(dir = opendir("/proc"))) {
-		// sleep 2 seconds and try again
-		sleep(2);
-		if (!(dir = opendir("/proc"))) {
-			fprintf(stderr, "Error: cannot open /proc directory\n");
-			exit(1);
-		}
+	// the index resolves the name directly; the start time of the process
+	// protects against pid reuse
+	pid_t newpid;
+	unsigned long long start;
+	if (name_index_read(name, &newpid, &start) == 0 && newpid != parent &&
+	    start != 0 && pid_proc_start_time(newpid) == start && name_check(newpid, name)) {
+		*pid = newpid;
+		return 0;
 	}
 
+	// the sandbox names are stored in the run records,
+	// only the sandboxes are checked, not every process in /proc
+	DIR *dir = opendir(RUN_FIREJAIL_RECORD_DIR);
+	if (!dir)
+		return 1;
+
 	struct dirent *entry;
 	char *end;
 	while ((entry = readdir(dir))) {
-		pid_t newpid = strtol(entry->d_name, &end, 10);
+		newpid = strtol(entry->d_name, &end, 10);
 		if (end == entry->d_name || *end)
 			continue;
 		if (newpid == parent)
 			continue;
 
-		// check if this is a firejail executable
-		char *comm = pid_proc_comm(newpid);
-		if (comm) {
-			if (strcmp(comm, "firejail")) {
-				free(comm);
-				continue;
-			}
-			free(comm);
-		}
+		// skip stale files and processes not visible in /proc
+		char proc[64];
+		snprintf(proc, sizeof(proc), "/proc/%d", newpid);
+		struct stat s;
+		if (stat(proc, &s) == -1)
+			continue;
 
-		// look for the sandbox name
-		char *fname;
-		if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NAME_DIR, newpid) == -1)
-			errExit("asprintf");
-		FILE *fp = fopen(fname, "r");
-		if (fp) {
-			char buf[BUFLEN];
-			if (fgets(buf, BUFLEN, fp)) {
-				// remove \n
-				char *ptr = strchr(buf, '\n');
-				if (ptr) {
-					*ptr = '\0';
-					if (strcmp(buf, name) == 0) {
-						// we found it!
-						fclose(fp);
-						free(fname);
-						*pid = newpid;
-						closedir(dir);
-						return 0;
-					}
-				}
-				else
-					fprintf(stderr, "Error: invalid %s\n", fname);
-			}
-			fclose(fp);
+		if (name_check(newpid, name)) {
+			// we found it!
+			*pid = newpid;
+			closedir(dir);
+			return 0;
 		}
-		free(fname);
 	}
 	closedir(dir);
 	return 1;
 }
 
+// start time of the process in clock ticks after boot, 0 on error
+unsigned long long pid_proc_start_time(const pid_t pid) {
+	char *fname;
+	if (asprintf(&fname, "/proc/%d/stat", pid) == -1)
+		return 0;
+	FILE *fp = fopen(fname, "re");
+	free(fname);
+	if (!fp)
+		return 0;
+
+	unsigned long long rv = 0;
+	char buf[BUFLEN];
+	if (fgets(buf, BUFLEN, fp)) {
+		// the command name can contain spaces and parentheses
+		char *ptr = strrchr(buf, ')');
+		if (ptr == NULL ||
+		    sscanf(ptr + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &rv) != 1)
+			rv = 0;
+	}
+	fclose(fp);
+	return rv;
+}
+
 char *pid_proc_comm(const pid_t pid) {
 	// open /proc/pid/cmdline file
 	char *fname;
@@ -338,10 +421,15 @@ int pid_hidepid(void) {
 	while (fgets(buf, BUFLEN, fp)) {
 		if (strstr(buf, "proc /proc proc")) {
 			fclose(fp);
-			// check hidepid
-			if (strstr(buf, "hidepid="))
-				return 1;
-			return 0;
+			// check hidepid; 0 and off are the default, all the processes are visible
+			const char *ptr = strstr(buf, "hidepid=");
+			if (!ptr)
+				return 0;
+			ptr += 8;
+			size_t len = strcspn(ptr, ", ");
+			if ((len == 1 && *ptr == '0') || (len == 3 && strncmp(ptr, "off", 3) == 0))
+				return 0;
+			return 1;
 		}
 	}
 
@@ -591,3 +679,185 @@ float timetrace_end(void) {
 	free(t);
 	return rv;
 }
+
+// copy the data from src to dst file descriptors, starting at the current
+// offsets; return 0 if ok, -1 if error
+//
+// For regular files the kernel is asked to do the work: a reflink (FICLONE)
+// if the destination is empty and the filesystem supports it, then
+// copy_file_range() and sendfile(). Whatever is left is copied with
+// read/write, this also covers pipes and files in /proc reporting a wrong size.
+#define COPY_BUFLEN (128 * 1024)
+int copy_fd_data(int src, int dst) {
+	struct stat s;
+	if (fstat(src, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0) {
+		off_t start = lseek(src, 0, SEEK_CUR);
+		off_t dst_start = lseek(dst, 0, SEEK_CUR);
+
+		// reflink the full file
+		if (start == 0 && dst_start == 0 && ioctl(dst, FICLONE, src) == 0) {
+			if (lseek(src, 0, SEEK_END) == -1 || lseek(dst, 0, SEEK_END) == -1)
+				return -1;
+			return 0;
+		}
+
+		off_t left = (start >= 0) ? s.st_size - start : 0;
+#ifdef SYS_copy_file_range
+		while (left > 0) {
+			ssize_t rv = syscall(SYS_copy_file_range, src, NULL, dst, NULL, (size_t) left, 0);
+			if (rv <= 0)
+				break;
+			left -= rv;
+		}
+#endif
+		while (left > 0) {
+			ssize_t rv = sendfile(dst, src, NULL, (size_t) left);
+			if (rv <= 0)
+				break;
+			left -= rv;
+		}
+	}
+
+	// buffered copy
+	unsigned char *buf = malloc(COPY_BUFLEN);
+	if (!buf)
+		return -1;
+	ssize_t len;
+	while ((len = read(src, buf, COPY_BUFLEN)) != 0) {
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		ssize_t done = 0;
+		while (done != len) {
+			ssize_t rv = write(dst, buf + done, len - done);
+			if (rv == -1) {
+				if (errno == EINTR)
+					continue;
+				free(buf);
+				return -1;
+			}
+			done += rv;
+		}
+	}
+	free(buf);
+	return (len == 0) ? 0 : -1;
+}
+
+// FNV-1a hash
+uint32_t fnv1a32_update(uint32_t h, const void *data, size_t len) {
+	const unsigned char *ptr = data;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		h ^= ptr[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+uint32_t fnv1a32(const void *data, size_t len) {
+	return fnv1a32_update(FNV1A32_INIT, data, len);
+}
+
+uint32_t fnv1a32_str(const char *str) {
+	uint32_t h = FNV1A32_INIT;
+	while (*str) {
+		h ^= (unsigned char) *str++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+uint64_t fnv1a64(const void *data, size_t len) {
+	const unsigned char *ptr = data;
+	uint64_t h = FNV1A64_INIT;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		h ^= ptr[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+uint64_t fnv1a64_str(const char *str) {
+	uint64_t h = FNV1A64_INIT;
+	while (*str) {
+		h ^= (unsigned char) *str++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+// the escape sequence of a character, NULL if it is printed as is
+static const char *json_escape(unsigned char c, char *buf, size_t size) {
+	if (c == '"')
+		return "\\\"";
+	else if (c == '\\')
+		return "\\\\";
+	else if (c == '\n')
+		return "\\n";
+	else if (c == '\t')
+		return "\\t";
+	else if (c < 0x20 || c == 0x7f) {
+		snprintf(buf, size, "\\u%04x", c);
+		return buf;
+	}
+	return NULL;
+}
+
+void json_print_string(FILE *fp, const char *str) {
+	if (!str) {
+		fputs("null", fp);
+		return;
+	}
+
+	fputc('"', fp);
+	const unsigned char *ptr = (const unsigned char *) str;
+	for (; *ptr; ptr++) {
+		char buf[8];
+		const char *esc = json_escape(*ptr, buf, sizeof(buf));
+		if (esc)
+			fputs(esc, fp);
+		else
+			fputc(*ptr, fp);
+	}
+	fputc('"', fp);
+}
+
+// the same in an allocated string
+char *json_string(const char *str) {
+	if (!str) {
+		char *rv = strdup("null");
+		if (!rv)
+			errExit("strdup");
+		return rv;
+	}
+
+	size_t len = 2;
+	const unsigned char *ptr = (const unsigned char *) str;
+	for (; *ptr; ptr++) {
+		char buf[8];
+		const char *esc = json_escape(*ptr, buf, sizeof(buf));
+		len += (esc) ? strlen(esc) : 1;
+	}
+
+	char *rv = malloc(len + 1);
+	if (!rv)
+		errExit("malloc");
+	char *out = rv;
+	*out++ = '"';
+	for (ptr = (const unsigned char *) str; *ptr; ptr++) {
+		char buf[8];
+		const char *esc = json_escape(*ptr, buf, sizeof(buf));
+		if (esc) {
+			strcpy(out, esc);
+			out += strlen(esc);
+		}
+		else
+			*out++ = *ptr;
+	}
+	*out++ = '"';
+	*out = '\0';
+	return rv;
+}
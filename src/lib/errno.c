@@ -17,10 +17,13 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
+#include "../include/common.h"
 #include "../include/syscall.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 //#include <attr/xattr.h>
 
@@ -172,24 +175,65 @@ static ErrnoEntry errnolist[] = {
 #endif
 };
 
-int errno_find_name(const char *name) {
+// The table is indexed on the first lookup: an open addressing hash on the
+// upper-case name, and a direct-indexed array on the number. Aliases such as
+// EWOULDBLOCK share a number, the first entry wins, as with a linear scan.
+#define ERRNO_ELEMS ((int) (sizeof(errnolist) / sizeof(errnolist[0])))
+#define ERRNO_HASH_SIZE 512	// power of 2, more than twice the table
+static short errno_hash[ERRNO_HASH_SIZE];	// table index + 1, 0 for an empty slot
+static const char **errno_by_nr = NULL;
+static int errno_max_nr = -1;
+
+// case insensitive
+static unsigned errno_hash_name(const char *str) {
+	uint32_t h = FNV1A32_INIT;
+	while (*str) {
+		unsigned char c = toupper((unsigned char) *str++);
+		h = fnv1a32_update(h, &c, 1);
+	}
+	return h & (ERRNO_HASH_SIZE - 1);
+}
+
+static void errno_index_init(void) {
+	if (errno_by_nr)
+		return;
+
 	int i;
-	int elems = sizeof(errnolist) / sizeof(errnolist[0]);
-	for (i = 0; i < elems; i++) {
-		if (strcasecmp(name, errnolist[i].name) == 0)
-			return errnolist[i].nr;
+	for (i = 0; i < ERRNO_ELEMS; i++) {
+		unsigned h = errno_hash_name(errnolist[i].name);
+		while (errno_hash[h])
+			h = (h + 1) & (ERRNO_HASH_SIZE - 1);
+		errno_hash[h] = i + 1;
+		if (errnolist[i].nr > errno_max_nr)
+			errno_max_nr = errnolist[i].nr;
+	}
+
+	errno_by_nr = calloc(errno_max_nr + 1, sizeof(char *));
+	if (!errno_by_nr)
+		errExit("calloc");
+	for (i = 0; i < ERRNO_ELEMS; i++) {
+		if (errnolist[i].nr >= 0 && !errno_by_nr[errnolist[i].nr])
+			errno_by_nr[errnolist[i].nr] = errnolist[i].name;
+	}
+}
+
+int errno_find_name(const char *name) {
+	errno_index_init();
+	unsigned h = errno_hash_name(name);
+	while (errno_hash[h]) {
+		const ErrnoEntry *e = &errnolist[errno_hash[h] - 1];
+		if (strcasecmp(name, e->name) == 0)
+			return e->nr;
+		h = (h + 1) & (ERRNO_HASH_SIZE - 1);
 	}
 
 	return -1;
 }
 
 const char *errno_find_nr(int nr) {
-	int i;
-	int elems = sizeof(errnolist) / sizeof(errnolist[0]);
-	for (i = 0; i < elems; i++) {
-		if (nr == errnolist[i].nr)
-			return errnolist[i].name;
-	}
+	errno_index_init();
+	if (nr >= 0 && nr <= errno_max_nr && errno_by_nr[nr])
+		return errno_by_nr[nr];
 
 	return "unknown";
 }
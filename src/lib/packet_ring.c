@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "../include/packet_ring.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// 16 blocks of 256 KB; a block holds a full 64 KB GRO packet, and it is
+// handed over to user space when it is full or after RING_BLOCK_TIMEOUT
+#define RING_BLOCK_SIZE (256 * 1024)
+#define RING_BLOCK_CNT 16
+#define RING_FRAME_SIZE 2048
+#define RING_BLOCK_TIMEOUT 100 // ms
+
+void packet_ring_open(PacketRing *ring, int type) {
+	assert(ring);
+	memset(ring, 0, sizeof(PacketRing));
+
+	// protocol 0: nothing is queued before the socket is bound
+	ring->sock = socket(AF_PACKET, type, 0);
+	if (ring->sock < 0)
+		errExit("socket");
+
+	int version = TPACKET_V3;
+	if (setsockopt(ring->sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+		errExit("setsockopt PACKET_VERSION");
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = RING_BLOCK_SIZE;
+	req.tp_block_nr = RING_BLOCK_CNT;
+	req.tp_frame_size = RING_FRAME_SIZE;
+	req.tp_frame_nr = (RING_BLOCK_SIZE / RING_FRAME_SIZE) * RING_BLOCK_CNT;
+	req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT;
+	if (setsockopt(ring->sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+		errExit("setsockopt PACKET_RX_RING");
+
+	ring->map = mmap(NULL, (size_t) RING_BLOCK_SIZE * RING_BLOCK_CNT, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_LOCKED, ring->sock, 0);
+	if (ring->map == MAP_FAILED) {
+		// MAP_LOCKED fails above RLIMIT_MEMLOCK
+		ring->map = mmap(NULL, (size_t) RING_BLOCK_SIZE * RING_BLOCK_CNT, PROT_READ | PROT_WRITE,
+			MAP_SHARED, ring->sock, 0);
+		if (ring->map == MAP_FAILED)
+			errExit("mmap");
+	}
+	ring->block_size = RING_BLOCK_SIZE;
+	ring->block_cnt = RING_BLOCK_CNT;
+}
+
+void packet_ring_bind(PacketRing *ring, int protocol) {
+	assert(ring);
+	struct sockaddr_ll sll;
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(protocol);
+	sll.sll_ifindex = 0; // all interfaces
+	if (bind(ring->sock, (struct sockaddr *) &sll, sizeof(sll)) < 0)
+		errExit("bind");
+}
+
+unsigned packet_ring_read(PacketRing *ring, PacketHandler handler, void *arg) {
+	assert(ring);
+	assert(handler);
+
+	unsigned rv = 0;
+	while (1) {
+		struct tpacket_block_desc *bd = (struct tpacket_block_desc *) (ring->map + (size_t) ring->block * ring->block_size);
+		if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+			break;
+
+		unsigned cnt = bd->hdr.bh1.num_pkts;
+		unsigned char *ptr = (unsigned char *) bd + bd->hdr.bh1.offset_to_first_pkt;
+		unsigned i;
+		for (i = 0; i < cnt; i++) {
+			struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) ptr;
+			struct sockaddr_ll *sll = (struct sockaddr_ll *) (ptr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+			ring->ts.tv_sec = hdr->tp_sec;
+			ring->ts.tv_nsec = hdr->tp_nsec;
+			// for SOCK_DGRAM tp_mac is the start of the network header
+			handler(ptr + hdr->tp_mac, hdr->tp_snaplen, sll->sll_pkttype, arg);
+			ptr += hdr->tp_next_offset;
+		}
+		rv += cnt;
+
+		// give the block back to the kernel
+		__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		ring->block = (ring->block + 1) % ring->block_cnt;
+	}
+
+	return rv;
+}
+
+unsigned long long packet_ring_stats(PacketRing *ring) {
+	assert(ring);
+	// the kernel resets the counters on every read
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+	memset(&st, 0, sizeof(st));
+	if (getsockopt(ring->sock, SOL_PACKET, PACKET_STATISTICS, &st, &len) < 0)
+		return 0;
+
+	// tp_packets includes the drops
+	ring->packets += st.tp_packets;
+	ring->drops += st.tp_drops;
+	return st.tp_drops;
+}
+
+void packet_ring_close(PacketRing *ring) {
+	assert(ring);
+	if (ring->map && ring->map != MAP_FAILED)
+		munmap(ring->map, (size_t) ring->block_size * ring->block_cnt);
+	if (ring->sock >= 0)
+		close(ring->sock);
+	ring->map = NULL;
+	ring->sock = -1;
+}
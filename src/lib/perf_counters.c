@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "../include/perf_counters.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef PERF_FLAG_FD_CLOEXEC
+#define PERF_FLAG_FD_CLOEXEC (1UL << 3)
+#endif
+
+static const struct {
+	const char *name;
+	unsigned type;
+	unsigned long long config;
+} events[PERF_EVENT_MAX] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+void perf_counters_init(PerfCounters *pc) {
+	memset(pc, 0, sizeof(PerfCounters));
+}
+
+// with perf_event_paranoid 2 a regular user can count only in user space;
+// the context switches happen in the kernel, they are always counted there,
+// the same numbers are in /proc/<pid>/status
+static int event_open(PerfCounters *pc, int ev, pid_t pid, int cpu, unsigned long flags, int kernel) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[ev].type;
+	attr.config = events[ev].config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.inherit = (pid != -1 && !(flags & PERF_FLAG_PID_CGROUP));
+	attr.exclude_hv = 1;
+	if (events[ev].type == PERF_TYPE_HARDWARE)
+		attr.exclude_kernel = !kernel || pc->user_only[ev];
+
+	int fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, flags | PERF_FLAG_FD_CLOEXEC);
+	if (fd == -1 && !attr.exclude_kernel && (errno == EACCES || errno == EPERM) &&
+	    events[ev].type == PERF_TYPE_HARDWARE) {
+		attr.exclude_kernel = 1;
+		fd = syscall(SYS_perf_event_open, &attr, pid, cpu, -1, flags | PERF_FLAG_FD_CLOEXEC);
+	}
+	if (fd == -1)
+		return -1;
+
+	pc->user_only[ev] = attr.exclude_kernel;
+	int *tmp = realloc(pc->fd[ev], (pc->cnt[ev] + 1) * sizeof(int));
+	if (!tmp)
+		errExit("realloc");
+	pc->fd[ev] = tmp;
+	pc->fd[ev][pc->cnt[ev]++] = fd;
+	return 0;
+}
+
+int perf_counters_cgroup(PerfCounters *pc, int cgroup_fd, int kernel) {
+	assert(cgroup_fd >= 0);
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+	int opened = 0;
+	int ev;
+	for (ev = 0; ev < PERF_EVENT_MAX; ev++) {
+		int cpu;
+		for (cpu = 0; cpu < cpus; cpu++) {
+			// an offline cpu fails with ENODEV
+			if (event_open(pc, ev, cgroup_fd, cpu, PERF_FLAG_PID_CGROUP, kernel) == 0)
+				opened++;
+		}
+	}
+	return opened;
+}
+
+int perf_counters_task(PerfCounters *pc, pid_t tid, int kernel) {
+	assert(tid > 0);
+	int opened = 0;
+	int ev;
+	for (ev = 0; ev < PERF_EVENT_MAX; ev++) {
+		if (event_open(pc, ev, tid, -1, 0, kernel) == 0)
+			opened++;
+	}
+	return opened;
+}
+
+void perf_counters_read(const PerfCounters *pc, PerfValues *v) {
+	memset(v, 0, sizeof(PerfValues));
+	int ev;
+	for (ev = 0; ev < PERF_EVENT_MAX; ev++) {
+		int i;
+		for (i = 0; i < pc->cnt[ev]; i++) {
+			// value, time enabled, time running
+			uint64_t data[3];
+			if (read(pc->fd[ev][i], data, sizeof(data)) != sizeof(data))
+				continue;
+			v->valid[ev] = 1;
+			if (data[2] == 0)
+				continue;
+			if (data[2] < data[1]) {
+				// the counter shared the hardware with other counters
+				data[0] = (uint64_t) ((double) data[0] * data[1] / data[2]);
+				v->scaled[ev] = 1;
+			}
+			v->val[ev] += data[0];
+		}
+		v->user_only[ev] = pc->user_only[ev];
+	}
+}
+
+void perf_counters_close(PerfCounters *pc) {
+	int ev;
+	for (ev = 0; ev < PERF_EVENT_MAX; ev++) {
+		int i;
+		for (i = 0; i < pc->cnt[ev]; i++)
+			close(pc->fd[ev][i]);
+		free(pc->fd[ev]);
+	}
+	perf_counters_init(pc);
+}
+
+void perf_values_print(FILE *fp, const PerfValues *v, const PerfValues *prev, const char *indent) {
+	unsigned long long val[PERF_EVENT_MAX];
+	int ev;
+	for (ev = 0; ev < PERF_EVENT_MAX; ev++) {
+		val[ev] = v->val[ev];
+		if (prev)
+			val[ev] = (val[ev] > prev->val[ev]) ? val[ev] - prev->val[ev] : 0;
+	}
+
+	for (ev = 0; ev < PERF_EVENT_MAX; ev++) {
+		char name[32];
+		snprintf(name, sizeof(name), "%s%s", events[ev].name, (v->user_only[ev]) ? ":u" : "");
+		if (!v->valid[ev]) {
+			fprintf(fp, "%s%-20s %16s\n", indent, name, "not supported");
+			continue;
+		}
+		fprintf(fp, "%s%-20s %16llu", indent, name, val[ev]);
+		if (ev == PERF_INSTRUCTIONS && v->valid[PERF_CYCLES] && val[PERF_CYCLES])
+			fprintf(fp, "   %.2f per cycle", (double) val[ev] / val[PERF_CYCLES]);
+		if (v->scaled[ev])
+			fprintf(fp, "   (scaled)");
+		fprintf(fp, "\n");
+	}
+}
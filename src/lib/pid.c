@@ -21,17 +21,132 @@
 #include "../include/common.h"
 #include "../include/pid.h"
 #include "../include/rundefs.h"
+#include "../include/run_record.h"
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <pwd.h>
 #include <sys/ioctl.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <linux/cn_proc.h>
 
 #define PIDS_BUFLEN 4096
-//Process pids[max_pids];
+#define PIDS_INITIAL 1024	// initial allocation, the table grows by doubling
+
+// the processes are stored in a dense array, the hash table maps pids to array indexes;
+// the size of the table follows the number of processes in /proc, not pid_max
 Process *pids = NULL;
-int max_pids=32769; // recalculated for every read_pid() call
+int pids_cnt = 0;
+static int pids_size = 0;	// allocated entries in pids[]
+static int *pids_hash = NULL;	// array index + 1, 0 for an empty slot
+static unsigned hash_size = 0;	// power of 2, at least twice pids_cnt
+
+static inline unsigned hash_slot(pid_t pid) {
+	return ((uint32_t) pid * 2654435761U) & (hash_size - 1);
+}
+
+static void hash_rebuild(unsigned size) {
+	free(pids_hash);
+	hash_size = size;
+	pids_hash = calloc(hash_size, sizeof(int));
+	if (!pids_hash)
+		errExit("calloc");
+
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		unsigned slot = hash_slot(pids[i].pid);
+		while (pids_hash[slot])
+			slot = (slot + 1) & (hash_size - 1);
+		pids_hash[slot] = i + 1;
+	}
+}
+
+// hash slot of an existing pid, -1 if not found
+static int hash_find(pid_t pid) {
+	if (hash_size == 0)
+		return -1;
+
+	unsigned slot = hash_slot(pid);
+	while (pids_hash[slot]) {
+		if (pids[pids_hash[slot] - 1].pid == pid)
+			return slot;
+		slot = (slot + 1) & (hash_size - 1);
+	}
+	return -1;
+}
+
+// index of the process in pids[], -1 if not found
+int pid_find(pid_t pid) {
+	int slot = hash_find(pid);
+	if (slot == -1)
+		return -1;
+	return pids_hash[slot] - 1;
+}
+
+// index of the process in pids[], a new zeroed entry is added if not found;
+// pids[] can be reallocated, pointers into the table are not valid after this call
+int pid_add(pid_t pid) {
+	int index = pid_find(pid);
+	if (index != -1)
+		return index;
+
+	if (pids_cnt == pids_size) {
+		pids_size = (pids_size) ? pids_size * 2 : PIDS_INITIAL;
+		pids = realloc(pids, pids_size * sizeof(Process));
+		if (!pids)
+			errExit("realloc");
+	}
+	// keep the hash table at most half full
+	if ((unsigned) (pids_cnt + 1) * 2 > hash_size)
+		hash_rebuild((hash_size) ? hash_size * 2 : PIDS_INITIAL * 2);
+
+	index = pids_cnt++;
+	memset(&pids[index], 0, sizeof(Process));
+	pids[index].pid = pid;
+	pids[index].stat_fd = -1;
+
+	unsigned slot = hash_slot(pid);
+	while (pids_hash[slot])
+		slot = (slot + 1) & (hash_size - 1);
+	pids_hash[slot] = index + 1;
+	return index;
+}
+
+// remove the entry, the last entry in pids[] is moved in its place
+void pid_remove(int index) {
+	assert(index >= 0 && index < pids_cnt);
+	if (pids[index].stat_fd != -1)
+		close(pids[index].stat_fd);
+	unsigned mask = hash_size - 1;
+	int slot = hash_find(pids[index].pid);
+	assert(slot != -1);
+
+	// backward shift deletion, no tombstones in the hash table
+	unsigned hole = slot;
+	unsigned next = (hole + 1) & mask;
+	while (pids_hash[next]) {
+		unsigned home = hash_slot(pids[pids_hash[next] - 1].pid);
+		// the entry can fill the hole if the hole is between its home slot and its current slot
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			pids_hash[hole] = pids_hash[next];
+			hole = next;
+		}
+		next = (next + 1) & mask;
+	}
+	pids_hash[hole] = 0;
+
+	int last = --pids_cnt;
+	if (index != last) {
+		pids[index] = pids[last];
+		pids_hash[hash_find(pids[index].pid)] = index + 1;
+	}
+}
 
 // get the memory associated with this pid
 void pid_getmem(unsigned pid, unsigned *rss, unsigned *shared) {
@@ -58,43 +173,87 @@ void pid_getmem(unsigned pid, unsigned *rss, unsigned *shared) {
 }
 
 
-void pid_get_cpu_time(unsigned pid, unsigned *utime, unsigned *stime) {
+// /proc/<pid>/stat fields used by firemon
+typedef struct {
+	char state;
+	pid_t ppid;
+	unsigned utime;
+	unsigned stime;
+	unsigned threads;
+} StatFields;
+
+static int stat_parse(const char *buf, StatFields *f) {
+	// the command name can contain spaces and parentheses
+	const char *ptr = strrchr(buf, ')');
+	if (!ptr)
+		return -1;
+	ptr++;
+
+	if (sscanf(ptr, " %c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %u %u %*d %*d %*d %*d %u",
+		   &f->state, &f->ppid, &f->utime, &f->stime, &f->threads) != 5)
+		return -1;
+	return 0;
+}
+
+// the file descriptor is attached to the process, reading it fails
+// with ESRCH once the process is gone, even if the pid is reused
+static int stat_pread(int fd, StatFields *f) {
+	char buf[PIDS_BUFLEN];
+	ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	return stat_parse(buf, f);
+}
+
+static int stat_read(pid_t pid, StatFields *f) {
 	// open stat file
 	char *file;
 	if (asprintf(&file, "/proc/%u/stat", pid) == -1)
 		errExit("asprintf");
 
-	FILE *fp = fopen(file, "r");
-	if (!fp) {
-		free(file);
-		return;
-	}
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
 	free(file);
+	if (fd == -1)
+		return -1;
 
-	char line[PIDS_BUFLEN];
-	if (fgets(line, PIDS_BUFLEN - 1, fp)) {
-		char *ptr = line;
-		// jump 13 fields
+	int rv = stat_pread(fd, f);
+	close(fd);
+	return rv;
+}
 
-		// end of comm string
-		ptr = strchr(ptr, ')');
-		if (ptr == NULL)
-			goto myexit;
+void pid_get_cpu_time(unsigned pid, unsigned *utime, unsigned *stime) {
+	StatFields f;
+	if (stat_read(pid, &f) == 0) {
+		*utime = f.utime;
+		*stime = f.stime;
+	}
+}
 
-		int i;
-		for (i = 0; i < 11; i++) {
-			while (*ptr != ' ' && *ptr != '\t' && *ptr != '\0')
-				ptr++;
-			if (*ptr == '\0')
-				goto myexit;
-			ptr++;
-		}
-		if (2 != sscanf(ptr, "%u %u", utime, stime))
-			goto myexit;
+// cpu time and thread count for a process in the table, using the open
+// stat file if available; returns -1 if the process is gone. The path is
+// read only without an open file: once the process is gone, the pid could
+// belong to another process.
+int pid_read_stat(int index, unsigned *utime, unsigned *stime, unsigned *threads) {
+	StatFields f;
+	int rv;
+	if (pids[index].stat_fd != -1)
+		rv = stat_pread(pids[index].stat_fd, &f);
+	else
+		rv = stat_read(pids[index].pid, &f);
+	if (rv == 0) {
+		*utime = f.utime;
+		*stime = f.stime;
+		*threads = f.threads;
+		return 0;
 	}
+	return -1;
+}
 
-myexit:
-	fclose(fp);
+// cpu time for a process in the table
+void pid_read_cpu_time(int index, unsigned *utime, unsigned *stime) {
+	unsigned threads;
+	pid_read_stat(index, utime, stime, &threads);
 }
 
 unsigned long long pid_get_start_time(unsigned pid) {
@@ -190,7 +349,8 @@ static void print_elem(unsigned index, int nowrap) {
 
 	// get data
 	uid_t uid = pids[index].uid;
-	char *cmd = pid_proc_cmdline(index);
+	pid_t pid = pids[index].pid;
+	char *cmd = pid_proc_cmdline(pid);
 	char *user = pid_get_user_name(uid);
 	char *user_allocated = user;
 
@@ -200,41 +360,20 @@ static void print_elem(unsigned index, int nowrap) {
 		cmd = cmd_escaped;
 	}
 
-	// extract sandbox name - pid == index
-	char *sandbox_name = "";
-	char *sandbox_name_allocated = NULL;
-	char *fname;
-	if (asprintf(&fname, "%s/%d", RUN_FIREJAIL_NAME_DIR, index) == -1)
-		errExit("asprintf");
-	struct stat s;
-	if (stat(fname, &s) == 0) {
-		FILE *fp = fopen(fname, "r");
-		if (fp) {
-			sandbox_name = malloc(s.st_size + 1);
-			if (!sandbox_name)
-				errExit("malloc");
-			sandbox_name_allocated = sandbox_name;
-			char *rv = fgets(sandbox_name, s.st_size + 1, fp);
-			if (!rv)
-				*sandbox_name = '\0';
-			else {
-				char *ptr = strchr(sandbox_name, '\n');
-				if (ptr)
-					*ptr = '\0';
-			}
-			fclose(fp);
-		}
-	}
-	free(fname);
+	// extract sandbox name
+	RunRecord rec;
+	const char *sandbox_name = "";
+	if (run_record_read(pid, &rec) == 0)
+		sandbox_name = rec.name;
 
 	if (user == NULL)
 		user = "";
 	if (cmd) {
 		if (col < 4 || nowrap)
-			printf("%s%u:%s:%s:%s\n", indent, index, user, sandbox_name, cmd);
+			printf("%s%d:%s:%s:%s\n", indent, pid, user, sandbox_name, cmd);
 		else {
 			char *out;
-			if (asprintf(&out, "%s%u:%s:%s:%s\n", indent, index, user, sandbox_name, cmd) == -1)
+			if (asprintf(&out, "%s%d:%s:%s:%s\n", indent, pid, user, sandbox_name, cmd) == -1)
 				errExit("asprintf");
 			int len = strlen(out);
 			if (len > col) {
@@ -249,14 +388,12 @@ static void print_elem(unsigned index, int nowrap) {
 	}
 	else {
 		if (pids[index].zombie)
-			printf("%s%u: (zombie)\n", indent, index);
+			printf("%s%d: (zombie)\n", indent, pid);
 		else
-			printf("%s%u:\n", indent, index);
+			printf("%s%d:\n", indent, pid);
 	}
 	if (user_allocated)
 		free(user_allocated);
-	if (sandbox_name_allocated)
-		free(sandbox_name_allocated);
 }
 
 // recursivity!!!
@@ -266,14 +403,9 @@ void pid_print_tree(unsigned index, unsigned parent, int nowrap) {
 	// Remove unused parameter warning
 	(void)parent;
 
-	unsigned i;
-	for (i = index + 1; i < (unsigned)max_pids; i++) {
-		if (pids[i].parent == (pid_t)index)
-			pid_print_tree(i, index, nowrap);
-	}
-
-	for (i = 0; i < index; i++) {
-		if (pids[i].parent == (pid_t)index)
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].parent == pids[index].pid)
 			pid_print_tree(i, index, nowrap);
 	}
 }
@@ -282,27 +414,356 @@ void pid_print_list(unsigned index, int nowrap) {
 	print_elem(index, nowrap);
 }
 
-// mon_pid: pid of sandbox to be monitored, 0 if all sandboxes are included
-void pid_read(pid_t mon_pid) {
-	unsigned old_max_pids = max_pids;
-	FILE *fp = fopen("/proc/sys/kernel/pid_max", "r");
-	if (fp) {
-		int val;
-		if (fscanf(fp, "%d", &val) == 1) {
-			if (val >= max_pids)
-				max_pids = val + 1;
+// firejail children: the level of the parent + 1; done[] breaks parent loops
+static short pid_set_level(int index, unsigned char *done) {
+	if (done[index])
+		return pids[index].level;
+	done[index] = 1;
+
+	int parent = pid_find(pids[index].parent);
+	if (parent != -1) {
+		short level = pid_set_level(parent, done);
+		if (level > 0)
+			pids[index].level = level + 1;
+	}
+	return pids[index].level;
+}
+
+// read /proc/<pid>/status for a process not in the table yet
+static void pid_read_status(pid_t pid, ino_t ino, pid_t mon_pid) {
+	// open status file
+	char *file;
+	if (asprintf(&file, "/proc/%u/status", pid) == -1)
+		errExit("asprintf");
+
+	FILE *fp = fopen(file, "r");
+	if (!fp) {
+		free(file);
+		return;
+	}
+	int index = pid_add(pid);
+	Process *p = &pids[index];
+	p->ino = ino;
+
+	// look for firejail executable name
+	char buf[PIDS_BUFLEN];
+	while (fgets(buf, PIDS_BUFLEN - 1, fp)) {
+		if (strncmp(buf, "Name:", 5) == 0) {
+			char *ptr = strchr(buf, '\n');
+			if (ptr)
+				*ptr = '\0';
+			ptr = buf + 5;
+			while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
+				ptr++;
+			}
+			if (*ptr == '\0') {
+				fprintf(stderr, "Error: cannot read /proc file\n");
+				exit(1);
+			}
+
+			if ((strcmp(ptr, "firejail") == 0) && (mon_pid == 0 || mon_pid == pid)) {
+				if (!pid_proc_cmdline_x11_xpra_xephyr(pid))
+					p->firejail = 1;
+			}
+		}
+		if (strncmp(buf, "State:", 6) == 0) {
+			if (strstr(buf, "(zombie)"))
+				p->zombie = 1;
+		}
+		else if (strncmp(buf, "PPid:", 5) == 0) {
+			char *ptr = buf + 5;
+			while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
+				ptr++;
+			}
+			if (*ptr == '\0') {
+				fprintf(stderr, "Error: cannot read /proc file\n");
+				exit(1);
+			}
+			p->parent = atoi(ptr);
+		}
+		else if (strncmp(buf, "Uid:", 4) == 0) {
+			char *ptr = buf + 4;
+			while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
+				ptr++;
+			}
+			if (*ptr == '\0') {
+				fprintf(stderr, "Error: cannot read /proc file\n");
+				exit(1);
+			}
+			p->uid = atoi(ptr);
+			break;
+		}
+	}
+	fclose(fp);
+	free(file);
+}
+
+// the table is kept between pid_read() calls: only the new processes are
+// read from /proc/<pid>/status, the sandbox processes are refreshed from
+// their open stat files, and the processes gone from /proc are dropped
+static unsigned read_gen = 0;
+static pid_t read_mon_pid = 0;
+
+static void pid_clear(void) {
+	int i;
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].stat_fd != -1)
+			close(pids[i].stat_fd);
+	}
+	pids_cnt = 0;
+	if (pids_hash)
+		memset(pids_hash, 0, hash_size * sizeof(int));
+}
+
+// levels and stat files after the process table changed
+static void pid_update(void) {
+	int i;
+	// a process is reparented when its parent exits, the parent is refreshed
+	// for sandbox processes with an open stat file
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].stat_fd != -1 && pid_find(pids[i].parent) == -1) {
+			StatFields f;
+			if (stat_pread(pids[i].stat_fd, &f) == 0)
+				pids[i].parent = f.ppid;
+		}
+	}
+
+	// zombie sandbox processes are dropped once they are collected
+	for (i = pids_cnt - 1; i >= 0; i--) {
+		if (pids[i].zombie && pids[i].stat_fd != -1) {
+			StatFields f;
+			if (stat_pread(pids[i].stat_fd, &f) == -1)
+				pid_remove(i);
+		}
+	}
+	if (pids_cnt <= 0)
+		return;
+
+	// the parent of a process can have a higher pid, the levels are
+	// set after all the processes are read
+	for (i = 0; i < pids_cnt; i++)
+		pids[i].level = (pids[i].firejail) ? 1 : -1;
+	unsigned char *done = calloc(pids_cnt, 1);
+	if (!done)
+		errExit("calloc");
+	for (i = 0; i < pids_cnt; i++)
+		pid_set_level(i, done);
+	free(done);
+
+	// keep the stat files of the sandbox processes open; if the process runs
+	// out of file descriptors, the stat file is opened on every read
+	for (i = 0; i < pids_cnt; i++) {
+		if (pids[i].level > 0 && pids[i].stat_fd == -1) {
+			char *file;
+			if (asprintf(&file, "/proc/%d/stat", pids[i].pid) == -1)
+				errExit("asprintf");
+			pids[i].stat_fd = open(file, O_RDONLY | O_CLOEXEC);
+			free(file);
+		}
+	}
+}
+
+//*******************************************************************
+// process events
+//*******************************************************************
+// with a proc connector socket, the table is updated from the fork, exec and exit
+// events instead of walking /proc; the socket is only available to root
+static int events_sock = -1;
+static int events_resync = 1;	// a full /proc scan is needed
+
+// netlink socket subscribed to the process events connector, -1 on error
+int pid_netlink_open(void) {
+	// open socket for process event connector
+	int sock;
+	if ((sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR)) < 0)
+		return -1;
+
+	// bind socket
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_pid = 0; // assigned by the kernel, several sockets can be open
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto errexit;
+
+	// set a large socket rx buffer
+	// the regular default value as set in /proc/sys/net/core/rmem_default will fill the
+	//            buffer much quicker than we can process it
+	int bsize = 1024 * 1024; // 1MB
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &bsize, sizeof(bsize)) == -1)
+		fprintf(stderr, "Warning: cannot set rx buffer size, using default system value\n");
+
+	// send monitoring message
+	struct nlmsghdr nlmsghdr;
+	memset(&nlmsghdr, 0, sizeof(nlmsghdr));
+	nlmsghdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+	nlmsghdr.nlmsg_pid = getpid();
+	nlmsghdr.nlmsg_type = NLMSG_DONE;
+
+	struct cn_msg cn_msg;
+	memset(&cn_msg, 0, sizeof(cn_msg));
+	cn_msg.id.idx = CN_IDX_PROC;
+	cn_msg.id.val = CN_VAL_PROC;
+	cn_msg.len = sizeof(enum proc_cn_mcast_op);
+
+	struct iovec iov[3];
+	iov[0].iov_base = &nlmsghdr;
+	iov[0].iov_len = sizeof(nlmsghdr);
+	iov[1].iov_base = &cn_msg;
+	iov[1].iov_len = sizeof(cn_msg);
+
+	enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+	iov[2].iov_base = &op;
+	iov[2].iov_len = sizeof(op);
+
+	if (writev(sock, iov, 3) == -1)
+		goto errexit;
+
+	return sock;
+
+errexit:
+	close(sock);
+	return -1;
+}
+
+// keep the process table current from the process events, pid_read() falls
+// back to the /proc scan if the socket cannot be opened
+void pid_track_events(void) {
+	if (events_sock != -1 || getuid() != 0)
+		return;
+	events_sock = pid_netlink_open();
+	events_resync = 1;
+}
+
+static int comm_is_firejail(pid_t pid) {
+	char *comm = pid_proc_comm(pid);
+	int rv = (comm && strcmp(comm, "firejail") == 0);
+	free(comm);
+	return rv;
+}
+
+static void pid_event(const struct proc_event *ev, pid_t mon_pid, pid_t mypid) {
+	int index;
+	switch (ev->what) {
+	case PROC_EVENT_FORK: {
+		if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+			return; // this is a thread, not a process
+
+		// only the children of the sandbox processes are tracked
+		pid_t child = ev->event_data.fork.child_tgid;
+		int parent = pid_find(ev->event_data.fork.parent_tgid);
+		if (parent == -1 || (pids[parent].level <= 0 && !pids[parent].firejail) ||
+		    child == mypid || pid_find(child) != -1)
+			return;
+		// the levels are set again after the events are read
+		index = pid_add(child);
+		pids[index].parent = pids[parent].pid;
+		pids[index].uid = pids[parent].uid;
+		pids[index].level = ((pids[parent].level > 0) ? pids[parent].level : 1) + 1;
+		// the command name is inherited
+		pids[index].firejail = (mon_pid == 0) ? pids[parent].firejail : 0;
+		break;
+	}
+
+	case PROC_EVENT_EXEC: {
+		pid_t pid = ev->event_data.exec.process_tgid;
+		if (pid == mypid || pid == 1)
+			return;
+		index = pid_find(pid);
+		if (index == -1) {
+			// a new sandbox
+			if (comm_is_firejail(pid))
+				pid_read_status(pid, 0, mon_pid);
+		}
+		else
+			pids[index].firejail = comm_is_firejail(pid) && (mon_pid == 0 || mon_pid == pid) &&
+				!pid_proc_cmdline_x11_xpra_xephyr(pid);
+		break;
+	}
+
+	case PROC_EVENT_EXIT:
+		if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid)
+			return; // this is a thread, not a process
+
+		index = pid_find(ev->event_data.exit.process_tgid);
+		if (index == -1)
+			return;
+		// sandbox processes stay in the table as zombies until they are collected
+		if (pids[index].stat_fd != -1)
+			pids[index].zombie = 1;
+		else
+			pid_remove(index);
+		break;
+
+	case PROC_EVENT_UID:
+		index = pid_find(ev->event_data.id.process_tgid);
+		if (index != -1)
+			pids[index].uid = ev->event_data.id.r.ruid;
+		break;
+
+	default:
+		break;
+	}
+}
+
+// read the pending events; a full /proc scan is requested if events were lost
+static void pid_events_read(pid_t mon_pid) {
+	pid_t mypid = getpid();
+	char buf[PIDS_BUFLEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+	while (1) {
+		ssize_t len = recv(events_sock, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				// rx buffer is full, the kernel started dropping messages
+				events_resync = 1;
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				// stop using the events
+				close(events_sock);
+				events_sock = -1;
+				events_resync = 1;
+			}
+			return;
+		}
+		if (len == 0)
+			return;
+
+		struct nlmsghdr *nlmsghdr;
+		for (nlmsghdr = (struct nlmsghdr *) buf;
+		     NLMSG_OK(nlmsghdr, (unsigned) len);
+		     nlmsghdr = NLMSG_NEXT(nlmsghdr, len)) {
+			if (nlmsghdr->nlmsg_type == NLMSG_ERROR || nlmsghdr->nlmsg_type == NLMSG_NOOP)
+				continue;
+			struct cn_msg *cn_msg = NLMSG_DATA(nlmsghdr);
+			if (cn_msg->id.idx != CN_IDX_PROC || cn_msg->id.val != CN_VAL_PROC)
+				continue;
+			// the events are also read during a resync, the scan runs after them
+			pid_event((struct proc_event *) cn_msg->data, mon_pid, mypid);
 		}
-		fclose(fp);
 	}
+}
 
-	if (pids == NULL) {
-		old_max_pids = max_pids;
-		pids = malloc(sizeof(Process) * max_pids);
-		if (pids == NULL)
-			errExit("malloc");
+// mon_pid: pid of sandbox to be monitored, 0 if all sandboxes are included
+void pid_read(pid_t mon_pid) {
+	// the firejail processes depend on mon_pid
+	if (mon_pid != read_mon_pid) {
+		pid_clear();
+		read_mon_pid = mon_pid;
+		events_resync = 1;
 	}
 
-	memset(pids, 0, sizeof(Process) * old_max_pids);
+	if (events_sock != -1) {
+		pid_events_read(mon_pid);
+		if (!events_resync) {
+			pid_update();
+			return;
+		}
+	}
+	read_gen++;
 	pid_t mypid = getpid();
 
 	DIR *dir;
@@ -317,12 +778,8 @@ void pid_read(pid_t mon_pid) {
 
 	struct dirent *entry;
 	char *end;
-	pid_t new_max_pids = 0;
 	while ((entry = readdir(dir))) {
 		pid_t pid = strtol(entry->d_name, &end, 10);
-		pid %= max_pids;
-		if (pid > new_max_pids)
-			new_max_pids = pid;
 		if (end == entry->d_name || *end)
 			continue;
 		if (pid == mypid)
@@ -332,88 +789,37 @@ void pid_read(pid_t mon_pid) {
 		if (pid == 1)
 			continue;
 
-		// open stat file
-		char *file;
-		if (asprintf(&file, "/proc/%u/status", pid) == -1)
-			errExit("asprintf");
-
-		FILE *fp = fopen(file, "r");
-		if (!fp) {
-			free(file);
-			continue;
-		}
-
-		// look for firejail executable name
-		char buf[PIDS_BUFLEN];
-		while (fgets(buf, PIDS_BUFLEN - 1, fp)) {
-			if (strncmp(buf, "Name:", 5) == 0) {
-				char *ptr = strchr(buf, '\n');
-				if (ptr)
-					*ptr = '\0';
-				ptr = buf + 5;
-				while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
-					ptr++;
-				}
-				if (*ptr == '\0') {
-					fprintf(stderr, "Error: cannot read /proc file\n");
-					exit(1);
-				}
-
-				if ((strcmp(ptr, "firejail") == 0) && (mon_pid == 0 || mon_pid == pid)) {
-					if (pid_proc_cmdline_x11_xpra_xephyr(pid))
-						pids[pid].level = -1;
-					else
-						pids[pid].level = 1;
-				}
-				else
-					pids[pid].level = -1;
-			}
-			if (strncmp(buf, "State:", 6) == 0) {
-				if (strstr(buf, "(zombie)"))
-					pids[pid].zombie = 1;
-			}
-			else if (strncmp(buf, "PPid:", 5) == 0) {
-				char *ptr = buf + 5;
-				while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
-					ptr++;
-				}
-				if (*ptr == '\0') {
-					fprintf(stderr, "Error: cannot read /proc file\n");
-					exit(1);
-				}
-				unsigned parent = atoi(ptr);
-				parent %= max_pids;
-				if (pids[parent].level > 0) {
-					pids[pid].level = pids[parent].level + 1;
-				}
-				pids[pid].parent = parent;
+		int index = pid_find(pid);
+		if (index != -1 && pids[index].ino == entry->d_ino) {
+			StatFields f;
+			if (pids[index].stat_fd == -1) {
+				pids[index].seen = read_gen;
+				continue;
 			}
-			else if (strncmp(buf, "Uid:", 4) == 0) {
-				char *ptr = buf + 4;
-				while (*ptr != '\0' && (*ptr == ' ' || *ptr == '\t')) {
-					ptr++;
-				}
-				if (*ptr == '\0') {
-					fprintf(stderr, "Error: cannot read /proc file\n");
-					exit(1);
-				}
-				pids[pid].uid = atoi(ptr);
-				break;
+			if (stat_pread(pids[index].stat_fd, &f) == 0) {
+				pids[index].zombie = (f.state == 'Z');
+				pids[index].parent = f.ppid;
+				pids[index].seen = read_gen;
+				continue;
 			}
 		}
-		fclose(fp);
-		free(file);
+
+		// a new process, or the pid was reused
+		if (index != -1)
+			pid_remove(index);
+		pid_read_status(pid, entry->d_ino, mon_pid);
+		index = pid_find(pid);
+		if (index != -1)
+			pids[index].seen = read_gen;
 	}
 	closedir(dir);
 
-	// update max_pid
-	max_pids = new_max_pids + 1;
-
-	pid_t pid;
-	for (pid = 0; pid < max_pids; pid++) {
-		int parent = pids[pid].parent;
-		if (pids[parent].level > 0) {
-			pids[pid].level = pids[parent].level + 1;
-		}
+	// drop the processes gone from /proc, pid_remove() moves the last entry in place
+	int i;
+	for (i = pids_cnt - 1; i >= 0; i--) {
+		if (pids[i].seen != read_gen)
+			pid_remove(i);
 	}
+	pid_update();
+	events_resync = 0;
 }
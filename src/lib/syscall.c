@@ -29,7 +29,6 @@
 #include "../include/seccomp.h"
 
 #define SYSCALL_ERROR INT_MAX
-#define ERRNO_KILL -2
 
 typedef struct {
 	const char * const name;
@@ -41,13 +40,6 @@ typedef struct {
 	const char * const list;
 } SyscallGroupList;
 
-typedef struct {
-	const char *slist;
-	char *prelist, *postlist;
-	bool found;
-	int syscall;
-} SyscallCheckList;
-
 // Native syscalls (64-bit versions for 64-bit archs, etc)
 static const SyscallEntry syslist[] = {
 #if defined(__aarch64__)
@@ -1521,49 +1513,118 @@ static const SyscallGroupList sysgroups[] = {
 	}
 };
 
-// return SYSCALL_ERROR if error, or syscall number
-static int syscall_find_name(const char *name) {
-	int i;
-	int elems = sizeof(syslist) / sizeof(syslist[0]);
-	for (i = 0; i < elems; i++) {
-		if (strcmp(name, syslist[i].name) == 0)
-			return syslist[i].nr;
-	}
+//**********************************
+// lookup tables
+//**********************************
+// The syscall and group tables are indexed on the first lookup: an open
+// addressing hash on the name, and a direct-indexed array on the number.
+// If a name or a number is listed twice, the first entry wins, as with
+// a linear scan of the table.
+typedef struct {
+	const char **key;	// names
+	int *idx;		// table index, -1 for an empty slot
+	unsigned mask;
+} NameIndex;
+
+typedef struct {
+	NameIndex name;
+	const char **by_nr;
+	int max_nr;
+	bool ready;
+} SyscallIndex;
+
+static SyscallIndex sysindex;
+static SyscallIndex sysindex32;
+static NameIndex groupindex;
 
-	return SYSCALL_ERROR;
+static void name_index_init(NameIndex *index, int cnt) {
+	unsigned size = 16;
+	while (size < 2 * (unsigned) cnt)
+		size <<= 1;
+	index->key = malloc(size * sizeof(char *));
+	index->idx = malloc(size * sizeof(int));
+	if (!index->key || !index->idx)
+		errExit("malloc");
+	memset(index->idx, 0xff, size * sizeof(int));
+	index->mask = size - 1;
 }
 
-static int syscall_find_name_32(const char *name) {
-	int i;
-	int elems = sizeof(syslist32) / sizeof(syslist32[0]);
-	for (i = 0; i < elems; i++) {
-		if (strcmp(name, syslist32[i].name) == 0)
-			return syslist32[i].nr;
+static void name_index_add(NameIndex *index, const char *name, int i) {
+	unsigned h = fnv1a32_str(name) & index->mask;
+	while (index->idx[h] != -1) {
+		if (strcmp(index->key[h], name) == 0)
+			return;
+		h = (h + 1) & index->mask;
 	}
+	index->key[h] = name;
+	index->idx[h] = i;
+}
 
-	return SYSCALL_ERROR;
+// return the table index, -1 if not found
+static int name_index_find(const NameIndex *index, const char *name) {
+	unsigned h = fnv1a32_str(name) & index->mask;
+	while (index->idx[h] != -1) {
+		if (strcmp(index->key[h], name) == 0)
+			return index->idx[h];
+		h = (h + 1) & index->mask;
+	}
+	return -1;
 }
 
-const char *syscall_find_nr(int nr) {
+static void syscall_index_init(SyscallIndex *index, const SyscallEntry *list, int elems) {
+	name_index_init(&index->name, elems);
+	index->max_nr = -1;
 	int i;
-	int elems = sizeof(syslist) / sizeof(syslist[0]);
 	for (i = 0; i < elems; i++) {
-		if (nr == syslist[i].nr)
-			return syslist[i].name;
+		name_index_add(&index->name, list[i].name, i);
+		if (list[i].nr > index->max_nr)
+			index->max_nr = list[i].nr;
 	}
 
-	return "unknown";
+	index->by_nr = calloc(index->max_nr + 1, sizeof(char *));
+	if (!index->by_nr)
+		errExit("calloc");
+	for (i = 0; i < elems; i++) {
+		if (list[i].nr >= 0 && !index->by_nr[list[i].nr])
+			index->by_nr[list[i].nr] = list[i].name;
+	}
+	index->ready = true;
 }
 
-const char *syscall_find_nr_32(int nr) {
-	int i;
-	int elems = sizeof(syslist32) / sizeof(syslist32[0]);
-	for (i = 0; i < elems; i++) {
-		if (nr == syslist32[i].nr)
-			return syslist32[i].name;
+static const SyscallIndex *syscall_index(bool native) {
+	if (native) {
+		if (!sysindex.ready)
+			syscall_index_init(&sysindex, syslist, sizeof(syslist) / sizeof(syslist[0]));
+		return &sysindex;
 	}
+	if (!sysindex32.ready)
+		syscall_index_init(&sysindex32, syslist32, sizeof(syslist32) / sizeof(syslist32[0]));
+	return &sysindex32;
+}
 
-	return "unknown";
+// return SYSCALL_ERROR if error, or syscall number
+static int syscall_find_name(const char *name) {
+	int i = name_index_find(&syscall_index(true)->name, name);
+	return (i == -1) ? SYSCALL_ERROR : syslist[i].nr;
+}
+
+static int syscall_find_name_32(const char *name) {
+	int i = name_index_find(&syscall_index(false)->name, name);
+	return (i == -1) ? SYSCALL_ERROR : syslist32[i].nr;
+}
+
+static const char *index_find_nr(const SyscallIndex *index, int nr) {
+	if (nr < 0 || nr > index->max_nr || !index->by_nr[nr])
+		return "unknown";
+	return index->by_nr[nr];
+}
+
+const char *syscall_find_nr(int nr) {
+	return index_find_nr(syscall_index(true), nr);
+}
+
+const char *syscall_find_nr_32(int nr) {
+	return index_find_nr(syscall_index(false), nr);
 }
 
 void syscall_print(void) {
@@ -1585,24 +1646,104 @@ void syscall_print_32(void) {
 }
 
 static const char *syscall_find_group(const char *name) {
-	int i;
 	int elems = sizeof(sysgroups) / sizeof(sysgroups[0]);
-	for (i = 0; i < elems; i++) {
-		if (strcmp(name, sysgroups[i].name) == 0)
-			return sysgroups[i].list;
+	if (!groupindex.key) {
+		name_index_init(&groupindex, elems);
+		int i;
+		for (i = 0; i < elems; i++)
+			name_index_add(&groupindex, sysgroups[i].name, i);
+	}
+
+	int i = name_index_find(&groupindex, name);
+	return (i == -1) ? NULL : sysgroups[i].list;
+}
+
+// argument rule of the entry passed to the syscall_check_list() callback,
+// NULL if the entry has no argument rule
+static const SyscallRule *entry_rule = NULL;
+
+// argument rule, argN[&mask][OP value]; returns the string following the
+// rule, NULL if error
+static char *syscall_process_rule(char *str, SyscallRule *rule) {
+	assert(str);
+	assert(rule);
+	memset(rule, 0, sizeof(SyscallRule));
+
+	// argN
+	if (strncmp(str, "arg", 3) != 0 || str[3] < '0' || str[3] > '5')
+		return NULL;
+	rule->arg = str[3] - '0';
+	char *ptr = str + 4;
+
+	// &mask
+	char *end;
+	rule->mask = UINT64_MAX;
+	bool masked = false;
+	if (*ptr == '&') {
+		ptr++;
+		errno = 0;
+		rule->mask = strtoull(ptr, &end, 0);
+		if (end == ptr || errno)
+			return NULL;
+		ptr = end;
+		masked = true;
+	}
+
+	// a mask without a comparison tests for any bit set
+	if (*ptr == '\0' || *ptr == ':') {
+		if (!masked)
+			return NULL;
+		rule->op = SYSCALL_CMP_NE;
+		rule->value = 0;
+		return ptr;
 	}
 
-	return NULL;
+	if (strncmp(ptr, "==", 2) == 0) {
+		rule->op = SYSCALL_CMP_EQ;
+		ptr += 2;
+	}
+	else if (strncmp(ptr, "!=", 2) == 0) {
+		rule->op = SYSCALL_CMP_NE;
+		ptr += 2;
+	}
+	else if (strncmp(ptr, "<=", 2) == 0) {
+		rule->op = SYSCALL_CMP_LE;
+		ptr += 2;
+	}
+	else if (strncmp(ptr, ">=", 2) == 0) {
+		rule->op = SYSCALL_CMP_GE;
+		ptr += 2;
+	}
+	else if (*ptr == '<') {
+		rule->op = SYSCALL_CMP_LT;
+		ptr++;
+	}
+	else if (*ptr == '>') {
+		rule->op = SYSCALL_CMP_GT;
+		ptr++;
+	}
+	else
+		return NULL;
+
+	// negative numbers are stored in two's complement
+	errno = 0;
+	rule->value = strtoull(ptr, &end, 0);
+	if (end == ptr || errno || (*end != '\0' && *end != ':'))
+		return NULL;
+	return end;
 }
 
 // allowed input:
 // - syscall
-// - syscall(error)
-static void syscall_process_name(const char *name, int *syscall_nr, int *error_nr, bool native) {
+// - syscall:error
+// - syscall:argN[&mask]OPvalue
+// - syscall:argN[&mask]OPvalue:error
+static void syscall_process_name(const char *name, int *syscall_nr, int *error_nr, SyscallRule *rule, bool *has_rule, bool native) {
 	assert(name);
 	if (strlen(name) == 0)
 		goto error;
 	*error_nr = -1;
+	*has_rule = false;
 
 	// syntax check
 	char *str = strdup(name);
@@ -1614,6 +1755,16 @@ static void syscall_process_name(const char *name, int *syscall_nr, int *error_n
 	if (error_name) {
 		*error_name = '\0';
 		error_name++;
+
+		if (strncmp(error_name, "arg", 3) == 0) {
+			char *ptr = syscall_process_rule(error_name, rule);
+			if (!ptr) {
+				free(str);
+				goto error;
+			}
+			*has_rule = true;
+			error_name = (*ptr == ':') ? ptr + 1 : NULL;
+		}
 	}
 	if (strlen(syscall_name) == 0) {
 		free(str);
@@ -1669,6 +1820,8 @@ int syscall_check_list(const char *slist, filter_fn *callback, int fd, int arg,
 	while (ptr) {
 		int syscall_nr;
 		int error_nr;
+		SyscallRule rule;
+		bool has_rule;
 		if (*ptr == '@') {
 			const char *new_list = syscall_find_group(ptr);
 			if (!new_list) {
@@ -1683,16 +1836,27 @@ int syscall_check_list(const char *slist, filter_fn *callback, int fd, int arg,
 				negate = true;
 				ptr++;
 			}
-			syscall_process_name(ptr, &syscall_nr, &error_nr, native);
+			syscall_process_name(ptr, &syscall_nr, &error_nr, &rule, &has_rule, native);
+			if (has_rule && negate) {
+				fprintf(stderr, "Error fseccomp: argument rules cannot be excluded, !%s\n", ptr);
+				exit(1);
+			}
 			if (syscall_nr != SYSCALL_ERROR && callback != NULL) {
 				if (negate) {
 					syscall_nr = -syscall_nr;
 				}
-				if (error_nr >= 0 && fd > 0)
+				if (has_rule) {
+					rule.nr = syscall_nr;
+					rule.action = (error_nr == -1) ? 0 : error_nr;
+					entry_rule = &rule;
+					callback(fd, syscall_nr, rule.action, ptrarg, native);
+					entry_rule = NULL;
+				}
+				else if (error_nr >= 0 && fd > 0)
 					filter_add_errno(fd, syscall_nr, error_nr, ptrarg, native);
 				else if (error_nr == ERRNO_KILL && fd > 0)
 					filter_add_blacklist_override(fd, syscall_nr, 0, ptrarg, native);
-				else if (error_nr >= 0 && fd == 0) {
+				else if ((error_nr >= 0 || error_nr == ERRNO_KILL) && fd == 0) {
 					callback(fd, syscall_nr, error_nr, ptrarg, native);
 				}
 				else {
@@ -1707,83 +1871,228 @@ int syscall_check_list(const char *slist, filter_fn *callback, int fd, int arg,
 	return 0;
 }
 
-static void find_syscall(int fd, int syscall, int arg, void *ptrarg, bool native) {
-	(void)fd;
-	(void) arg;
-	(void)native;
-	SyscallCheckList *ptr = ptrarg;
-	if (abs(syscall) == ptr->syscall)
-		ptr->found = true;
+//**********************************
+// syscall sets
+//**********************************
+void syscall_set_clear(SyscallSet *set) {
+	assert(set);
+	memset(set->bit, 0, sizeof(set->bit));
+	set->rules = 0;
 }
 
-// go through list2 and find matches for problem syscall
-static void syscall_in_list(int fd, int syscall, int arg, void *ptrarg, bool native) {
-	(void) fd;
-	(void)arg;
-	SyscallCheckList *ptr = ptrarg;
-	SyscallCheckList sl;
-	const char *name;
-
-	sl.found = false;
-	sl.syscall = syscall;
-	syscall_check_list(ptr->slist, find_syscall, fd, 0, &sl, native);
+bool syscall_set_empty(const SyscallSet *set) {
+	assert(set);
+	if (set->rules)
+		return false;
+	int i;
+	for (i = 0; i < SYSCALL_SET_WORDS; i++) {
+		if (set->bit[i])
+			return false;
+	}
+	return true;
+}
 
-	if (native)
-		name = syscall_find_nr(syscall);
-	else
-		name = syscall_find_nr_32(syscall);
+// rules are added in list order, identical rules only once
+void syscall_set_add_rule(SyscallSet *set, const SyscallRule *rule) {
+	assert(set);
+	assert(rule);
+	int i;
+	for (i = 0; i < set->rules; i++) {
+		const SyscallRule *r = set->rule + i;
+		if (r->nr == rule->nr && r->action == rule->action && r->arg == rule->arg &&
+		    r->op == rule->op && r->mask == rule->mask && r->value == rule->value)
+			return;
+	}
+	if (set->rules == SYSCALL_SET_RULES) {
+		fprintf(stderr, "Error fseccomp: too many argument rules, the maximum is %d\n", SYSCALL_SET_RULES);
+		exit(1);
+	}
+	set->rule[set->rules++] = *rule;
+}
 
-	// if found in the problem list, add to post-exec list
-	if (sl.found) {
-		if (ptr->postlist) {
-			if (asprintf(&ptr->postlist, "%s,%s", ptr->postlist, name) == -1)
-				errExit("asprintf");
-		}
-		else
-			ptr->postlist = strdup(name);
+// keep the rules for the syscalls in src, or the rules for the syscalls not in src
+static void syscall_set_filter_rules(SyscallSet *dst, const SyscallSet *src, bool in) {
+	int cnt = 0;
+	int i;
+	for (i = 0; i < dst->rules; i++) {
+		if (syscall_set_has(src, dst->rule[i].nr) == in)
+			dst->rule[cnt++] = dst->rule[i];
 	}
-	else { // no problem, add to pre-exec list
-		// build syscall:error_no
-		char *newcall = NULL;
-		if (arg != 0) {
-			if (asprintf(&newcall, "%s:%s", name, errno_find_nr(arg)) == -1)
-				errExit("asprintf");
-		}
-		else {
-			newcall = strdup(name);
-			if (!newcall)
-				errExit("strdup");
-		}
+	dst->rules = cnt;
+}
 
-		if (ptr->prelist) {
-			if (asprintf(&ptr->prelist, "%s,%s", ptr->prelist, newcall) == -1)
-				errExit("asprintf");
-			free(newcall);
+// the first entry for a syscall wins, as in a filter
+void syscall_set_add(SyscallSet *set, int syscall, int arg) {
+	assert(set);
+	assert(syscall >= 0 && syscall < SYSCALL_SET_MAX);
+	if (syscall_set_has(set, syscall))
+		return;
+	set->bit[syscall / 64] |= (uint64_t) 1 << (syscall % 64);
+	set->arg[syscall] = arg;
+}
+
+// add the syscalls in src missing in dst
+void syscall_set_union(SyscallSet *dst, const SyscallSet *src) {
+	assert(dst);
+	assert(src);
+	int i;
+	for (i = 0; i < SYSCALL_SET_WORDS; i++) {
+		uint64_t add = src->bit[i] & ~dst->bit[i];
+		while (add) {
+			int nr = i * 64 + __builtin_ctzll(add);
+			dst->arg[nr] = src->arg[nr];
+			add &= add - 1;
 		}
-		else
-			ptr->prelist = newcall;
+		dst->bit[i] |= src->bit[i];
 	}
+	for (i = 0; i < src->rules; i++)
+		syscall_set_add_rule(dst, src->rule + i);
+}
+
+void syscall_set_intersect(SyscallSet *dst, const SyscallSet *src) {
+	assert(dst);
+	assert(src);
+	int i;
+	for (i = 0; i < SYSCALL_SET_WORDS; i++)
+		dst->bit[i] &= src->bit[i];
+	syscall_set_filter_rules(dst, src, true);
+}
+
+void syscall_set_subtract(SyscallSet *dst, const SyscallSet *src) {
+	assert(dst);
+	assert(src);
+	int i;
+	for (i = 0; i < SYSCALL_SET_WORDS; i++)
+		dst->bit[i] &= ~src->bit[i];
+	syscall_set_filter_rules(dst, src, false);
 }
 
-// go through list and find matches for syscalls in list @default-keep
-void syscalls_in_list(const char *list, const char *slist, int fd, char **prelist, char **postlist, bool native) {
+typedef struct {
+	SyscallSet *set;
+	SyscallSet *excluded;
+} SyscallSetBuild;
+
+static void set_build(int fd, int syscall, int arg, void *ptrarg, bool native) {
 	(void) fd;
-	SyscallCheckList sl;
+	(void) native;
+	SyscallSetBuild *ptr = ptrarg;
+
+	SyscallSet *set = ptr->set;
+	if (syscall < 0) {
+		set = ptr->excluded;
+		syscall = -syscall;
+		arg = 0;
+	}
+	if (!set)
+		return;
+	if (syscall >= SYSCALL_SET_MAX) {
+		fprintf(stderr, "Warning fseccomp: syscall %d out of range, ignored\n", syscall);
+		return;
+	}
+	if (entry_rule)
+		syscall_set_add_rule(set, entry_rule);
+	else
+		syscall_set_add(set, syscall, arg);
+}
+
+// add the syscalls in the list to set, and the excluded ones (!syscall) to
+// excluded; excluded can be NULL
+void syscall_set_build(SyscallSet *set, SyscallSet *excluded, const char *list, bool native) {
+	assert(set);
+	SyscallSetBuild sb;
+	sb.set = set;
+	sb.excluded = excluded;
+	syscall_check_list(list, set_build, 0, 0, &sb, native);
+}
+
+static char *set_str_append(char *str, char *entry) {
+	if (!str)
+		return entry;
+	char *rv;
+	if (asprintf(&rv, "%s,%s", str, entry) == -1)
+		errExit("asprintf");
+	free(str);
+	free(entry);
+	return rv;
+}
+
+static const char *set_str_action(int action) {
+	if (action > 0)
+		return errno_find_nr(action);
+	return (action == ERRNO_KILL) ? "kill" : NULL;
+}
+
+// string in syscall list format, NULL for an empty set
+char *syscall_set_str(const SyscallSet *set, bool native) {
+	assert(set);
+	char *rv = NULL;
+	int nr;
+	for (nr = 0; nr < SYSCALL_SET_MAX; nr++) {
+		if (!syscall_set_has(set, nr))
+			continue;
+
+		const char *name = (native) ? syscall_find_nr(nr) : syscall_find_nr_32(nr);
+		const char *action = set_str_action(set->arg[nr]);
+		char *entry;
+		if (asprintf(&entry, "%s%s%s", name, (action) ? ":" : "", (action) ? action : "") == -1)
+			errExit("asprintf");
+		rv = set_str_append(rv, entry);
+	}
+
+	static const char *const op[] = { "==", "!=", "<", "<=", ">", ">=" };
+	int i;
+	for (i = 0; i < set->rules; i++) {
+		const SyscallRule *r = set->rule + i;
+		const char *name = (native) ? syscall_find_nr(r->nr) : syscall_find_nr_32(r->nr);
+		const char *action = set_str_action(r->action);
+		char mask[32] = "";
+		if (r->mask != UINT64_MAX)
+			snprintf(mask, sizeof(mask), "&0x%llx", (unsigned long long) r->mask);
+		char *entry;
+		if (asprintf(&entry, "%s:arg%u%s%s0x%llx%s%s", name, r->arg, mask, op[r->op],
+			     (unsigned long long) r->value, (action) ? ":" : "", (action) ? action : "") == -1)
+			errExit("asprintf");
+		rv = set_str_append(rv, entry);
+	}
+	return rv;
+}
+
+// split the syscalls in list: the ones also found in slist go in postlist,
+// the rest in prelist; the syscalls excluded with !syscall are in neither,
+// they are returned in excluded if not NULL
+void syscalls_in_list(const char *list, const char *slist, SyscallSet *prelist, SyscallSet *postlist,
+		      SyscallSet *excluded, bool native) {
+	assert(prelist);
+	assert(postlist);
+
+	SyscallSet ex;
+	syscall_set_clear(prelist);
+	syscall_set_clear(&ex);
+	syscall_set_build(prelist, &ex, list, native);
+	syscall_set_subtract(prelist, &ex);
+	if (excluded)
+		*excluded = ex;
+
 	// these syscalls are used by firejail after the seccomp filter is initialized
-	sl.slist = slist;
-	sl.prelist = NULL;
-	sl.postlist = NULL;
-	syscall_check_list(list, syscall_in_list, 0, 0, &sl, native);
+	SyscallSet keep;
+	syscall_set_clear(&keep);
+	syscall_set_build(&keep, NULL, slist, native);
+
+	*postlist = *prelist;
+	syscall_set_intersect(postlist, &keep);
+	syscall_set_subtract(prelist, &keep);
+
 	if (!arg_quiet) {
+		char *pre = syscall_set_str(prelist, native);
+		char *post = syscall_set_str(postlist, native);
 		fprintf(stderr, "Seccomp list in: %s,", list);
-		if (sl.slist)
-			fprintf(stderr, " check list: %s,", sl.slist);
-		if (sl.prelist)
-			fprintf(stderr, " prelist: %s,", sl.prelist);
-		if (sl.postlist)
-			fprintf(stderr, " postlist: %s", sl.postlist);
+		fprintf(stderr, " check list: %s,", slist);
+		if (pre)
+			fprintf(stderr, " prelist: %s,", pre);
+		if (post)
+			fprintf(stderr, " postlist: %s", post);
 		fprintf(stderr, "\n");
+		free(pre);
+		free(post);
 	}
-	*prelist = sl.prelist;
-	*postlist = sl.postlist;
 }
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include "../include/term_frame.h"
+
+#define ESC '\033'
+
+typedef struct {
+	char **line;
+	int cnt;
+} Frame;
+
+static Frame prev = { NULL, 0 };	// on the screen
+static Frame cur = { NULL, 0 };		// being built
+static int frame_rows = 0;
+static int frame_cols = 0;
+static int repaint = 1;
+
+// output buffer, sent in a single write
+static char *out = NULL;
+static size_t out_len = 0;
+static size_t out_max = 0;
+
+static void out_add(const char *str, size_t len) {
+	if (out_len + len > out_max) {
+		out_max = (out_max + len) * 2;
+		out = realloc(out, out_max);
+		if (!out)
+			errExit("realloc");
+	}
+	memcpy(out + out_len, str, len);
+	out_len += len;
+}
+
+static void out_str(const char *str) {
+	out_add(str, strlen(str));
+}
+
+static void out_move(int row, int col) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "\033[%d;%dH", row + 1, col + 1);
+	out_str(buf);
+}
+
+static void frame_free(Frame *f) {
+	int i;
+	for (i = 0; i < f->cnt; i++)
+		free(f->line[i]);
+	free(f->line);
+	f->line = NULL;
+	f->cnt = 0;
+}
+
+void term_frame_reset(void) {
+	repaint = 1;
+}
+
+void term_frame_begin(int rows, int cols) {
+	if (rows < 1)
+		rows = 1;
+	if (cols < 1)
+		cols = 1;
+	if (rows != frame_rows || cols != frame_cols)
+		repaint = 1;
+	frame_rows = rows;
+	frame_cols = cols;
+
+	frame_free(&cur);
+	cur.line = calloc(rows, sizeof(char *));
+	if (!cur.line)
+		errExit("calloc");
+}
+
+// copy a line cut at frame_cols characters; escape sequences and UTF-8
+// continuation bytes take no space on the screen
+void term_frame_line(const char *str) {
+	assert(str);
+	assert(cur.line);
+	if (cur.cnt >= frame_rows)
+		return;
+
+	size_t len = strlen(str);
+	char *line = malloc(len + 1);
+	if (!line)
+		errExit("malloc");
+	const char *ptr = str;
+	char *dest = line;
+	int col = 0;
+	int sgr = 0;
+	while (*ptr && *ptr != '\n') {
+		if (*ptr == ESC) {
+			sgr = 1;
+			*dest++ = *ptr++;
+			if (*ptr == '[') {
+				*dest++ = *ptr++;
+				while (*ptr && (*ptr < 0x40 || *ptr > 0x7e))
+					*dest++ = *ptr++;
+				if (*ptr)
+					*dest++ = *ptr++;
+			}
+			continue;
+		}
+		if ((*ptr & 0xc0) != 0x80) {
+			if (col == frame_cols)
+				break;
+			col++;
+		}
+		*dest++ = *ptr++;
+	}
+	*dest = '\0';
+
+	// an attribute cut with the line is not carried to the next one
+	if (sgr && *ptr && *ptr != '\n') {
+		char *tmp;
+		if (asprintf(&tmp, "%s\033[0m", line) == -1)
+			errExit("asprintf");
+		free(line);
+		line = tmp;
+	}
+	cur.line[cur.cnt++] = line;
+}
+
+// the common prefix of two lines, if it is made of plain ASCII characters
+// the cursor can be placed after it
+static size_t common_prefix(const char *s1, const char *s2) {
+	size_t i = 0;
+	while (s1[i] && s1[i] == s2[i]) {
+		if (s1[i] == ESC || (s1[i] & 0x80))
+			return 0;
+		i++;
+	}
+	return i;
+}
+
+void term_frame_end(void) {
+	assert(cur.line);
+	out_len = 0;
+
+	if (repaint)
+		out_str("\033[2J");
+	int i;
+	for (i = 0; i < cur.cnt; i++) {
+		const char *line = cur.line[i];
+		size_t start = 0;
+		if (!repaint && i < prev.cnt) {
+			if (strcmp(line, prev.line[i]) == 0)
+				continue;
+			start = common_prefix(line, prev.line[i]);
+		}
+		out_move(i, (int) start);
+		out_str(line + start);
+		out_str("\033[K");
+	}
+	// the unused rows at the end
+	if (cur.cnt < frame_rows) {
+		out_move(cur.cnt, 0);
+		if (!repaint && cur.cnt < prev.cnt)
+			out_str("\033[J");
+	}
+
+	fflush(0);
+	if (out_len && fwrite(out, 1, out_len, stdout) != out_len)
+		errExit("fwrite");
+	fflush(0);
+
+	frame_free(&prev);
+	prev = cur;
+	cur.line = NULL;
+	cur.cnt = 0;
+	repaint = 0;
+}
+
+void topn_init(TopN *t, int max) {
+	assert(t);
+	memset(t, 0, sizeof(TopN));
+	t->max = (max > 0) ? max : 0;
+	if (t->max) {
+		t->item = malloc(t->max * sizeof(TopItem));
+		if (!t->item)
+			errExit("malloc");
+	}
+}
+
+// the item ranked lower: smaller key, or added later for equal keys
+static inline int topn_lower(const TopItem *a, const TopItem *b) {
+	if (a->key != b->key)
+		return a->key < b->key;
+	return a->seq > b->seq;
+}
+
+static void topn_sift_down(TopItem *item, int cnt, int i) {
+	while (1) {
+		int min = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+		if (l < cnt && topn_lower(&item[l], &item[min]))
+			min = l;
+		if (r < cnt && topn_lower(&item[r], &item[min]))
+			min = r;
+		if (min == i)
+			return;
+		TopItem tmp = item[i];
+		item[i] = item[min];
+		item[min] = tmp;
+		i = min;
+	}
+}
+
+void topn_add(TopN *t, double key, char *line) {
+	assert(t);
+	TopItem new_item = { key, t->seq++, line };
+	if (t->cnt < t->max) {
+		// sift up
+		int i = t->cnt++;
+		while (i > 0) {
+			int parent = (i - 1) / 2;
+			if (!topn_lower(&new_item, &t->item[parent]))
+				break;
+			t->item[i] = t->item[parent];
+			i = parent;
+		}
+		t->item[i] = new_item;
+		return;
+	}
+
+	// replace the lowest item
+	if (t->cnt == 0 || topn_lower(&new_item, &t->item[0])) {
+		free(line);
+		return;
+	}
+	free(t->item[0].line);
+	t->item[0] = new_item;
+	topn_sift_down(t->item, t->cnt, 0);
+}
+
+void topn_sort(TopN *t) {
+	assert(t);
+	// heap sort: the lowest item goes to the end
+	int cnt = t->cnt;
+	while (cnt > 1) {
+		TopItem tmp = t->item[0];
+		t->item[0] = t->item[cnt - 1];
+		t->item[cnt - 1] = tmp;
+		cnt--;
+		topn_sift_down(t->item, cnt, 0);
+	}
+}
+
+void topn_free(TopN *t) {
+	assert(t);
+	int i;
+	for (i = 0; i < t->cnt; i++)
+		free(t->item[i].line);
+	free(t->item);
+	memset(t, 0, sizeof(TopN));
+}
@@ -25,10 +25,51 @@
 #include <sys/prctl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The filter is inherited across fork() and execve(), it is installed only
+// once: the process that installs it stores the number of seccomp filters in
+// POSTEXEC_ENV, and a process started from it skips the installation if it
+// has at least as many filters. firejail removes the variable from the
+// environment of the sandbox and of --join.
+#define POSTEXEC_ENV "FIREJAIL_POSTEXEC_SECCOMP"
+
+// number of seccomp filters from /proc/self/status, -1 if not available
+// (Linux 5.9 or newer)
+static int seccomp_filters(void) {
+	int fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	char buf[4096];
+	size_t len = 0;
+	ssize_t rv;
+	while (len < sizeof(buf) - 1 && (rv = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+		len += rv;
+	close(fd);
+	buf[len] = '\0';
+
+	const char *ptr = strstr(buf, "\nSeccomp_filters:");
+	if (!ptr)
+		return -1;
+	return atoi(ptr + 17);
+}
+
+// the filter was installed by a parent process
+static int postexec_installed(void) {
+	const char *str = getenv(POSTEXEC_ENV);
+	if (!str)
+		return 0;
+	int expected = atoi(str);
+	return expected > 0 && seccomp_filters() >= expected;
+}
 
 __attribute__((constructor))
 static void load_seccomp(void) {
-	int fd = open(RUN_SECCOMP_POSTEXEC, O_RDONLY);
+	if (postexec_installed())
+		return;
+
+	int fd = open(RUN_SECCOMP_POSTEXEC, O_RDONLY | O_CLOEXEC);
 	if (fd == -1) {
 		fprintf(stderr, "Error: cannot open seccomp postexec filter file %s\n", RUN_SECCOMP_POSTEXEC);
 		return;
@@ -54,11 +95,41 @@ static void load_seccomp(void) {
 		.filter = filter,
 	};
 
+	// SECCOMP_FILTER_FLAG_SPEC_ALLOW and SECCOMP_FILTER_FLAG_TSYNC, as used by the sandbox
+	unsigned flags = 0;
+	FILE *fp = fopen(RUN_SECCOMP_FLAGS, "re");
+	if (fp) {
+		if (fscanf(fp, "%u", &flags) != 1)
+			flags = 0;
+		flags &= SECCOMP_FILTER_FLAG_SPEC_ALLOW | SECCOMP_FILTER_FLAG_TSYNC;
+		fclose(fp);
+	}
+
 	prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
 #ifdef SECCOMP_FILTER_FLAG_LOG
-	syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_LOG, &prog);
-#else
-	prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+	flags |= SECCOMP_FILTER_FLAG_LOG;
 #endif
+	int rv;
+	if (flags) {
+		rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+		if (rv == -1 && (flags & SECCOMP_FILTER_FLAG_SPEC_ALLOW)) {
+			flags &= ~SECCOMP_FILTER_FLAG_SPEC_ALLOW;
+			rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+		}
+		if (rv > 0) {
+			// the thread could not be synchronized, install the filter for this thread
+			fprintf(stderr, "Warning: cannot synchronize the seccomp postexec filter with thread %d\n", rv);
+			rv = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags & ~SECCOMP_FILTER_FLAG_TSYNC, &prog);
+		}
+	}
+	else
+		rv = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
 	munmap(filter, size);
+
+	int cnt = (rv == 0) ? seccomp_filters() : -1;
+	if (cnt > 0) {
+		char buf[16];
+		snprintf(buf, sizeof(buf), "%d", cnt);
+		setenv(POSTEXEC_ENV, buf, 1);
+	}
 }
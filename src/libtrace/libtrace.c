@@ -32,86 +32,307 @@
 #include <sys/stat.h>
 #include <syslog.h>
 #include <dirent.h>
+#include <linux/fcntl.h>	// fcntl.h would declare open()
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "../include/rundefs.h"
+#include "../include/trace_ring.h"
+#include "../include/preload.h"
 
-#define tprintf(fp, args...) \
-	do { \
-		if (!fp)\
-			init(); \
-		fprintf(fp, args); \
-	} while(0)
-
-// break recursivity on fopen call
-typedef FILE *(*orig_fopen_t)(const char *pathname, const char *mode);
-static orig_fopen_t orig_fopen = NULL;
-typedef int (*orig_access_t)(const char *pathname, int mode);
-static orig_access_t orig_access = NULL;
+// the original functions, resolved once in init()
+#ifndef fopen64
+#define LIBTRACE_FOPEN64(X) \
+	X(FILE *, fopen64, (const char *pathname, const char *mode), (pathname, mode))
+#else
+#define LIBTRACE_FOPEN64(X)
+#endif
+#ifndef freopen64
+#define LIBTRACE_FREOPEN64(X) \
+	X(FILE *, freopen64, (const char *pathname, const char *mode, FILE *stream), (pathname, mode, stream))
+#else
+#define LIBTRACE_FREOPEN64(X)
+#endif
+// stat64, lstat64 and fstatat64 are exported functions since glibc 2.33
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+#define LIBTRACE_STAT64(X) \
+	X(int, stat64, (const char *pathname, struct stat64 *statbuf), (pathname, statbuf)) \
+	X(int, lstat64, (const char *pathname, struct stat64 *statbuf), (pathname, statbuf)) \
+	X(int, fstatat64, (int dirfd, const char *pathname, struct stat64 *statbuf, int flags), (dirfd, pathname, statbuf, flags))
+#else
+#define LIBTRACE_STAT64(X)
+#endif
+#ifdef STATX_TYPE
+#define LIBTRACE_STATX(X) \
+	X(int, statx, (int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *statxbuf), (dirfd, pathname, flags, mask, statxbuf))
+#else
+#define LIBTRACE_STATX(X)
+#endif
+#define LIBTRACE_CALLS(X) \
+	X(int, open, (const char *pathname, int flags, mode_t mode), (pathname, flags, mode)) \
+	X(int, open64, (const char *pathname, int flags, mode_t mode), (pathname, flags, mode)) \
+	X(int, openat, (int dirfd, const char *pathname, int flags, mode_t mode), (dirfd, pathname, flags, mode)) \
+	X(int, openat64, (int dirfd, const char *pathname, int flags, mode_t mode), (dirfd, pathname, flags, mode)) \
+	X(int, __open_2, (const char *pathname, int flags), (pathname, flags)) \
+	X(int, __open64_2, (const char *pathname, int flags), (pathname, flags)) \
+	X(int, __openat_2, (int dirfd, const char *pathname, int flags), (dirfd, pathname, flags)) \
+	X(int, __openat64_2, (int dirfd, const char *pathname, int flags), (dirfd, pathname, flags)) \
+	X(FILE *, fopen, (const char *pathname, const char *mode), (pathname, mode)) \
+	LIBTRACE_FOPEN64(X) \
+	X(FILE *, freopen, (const char *pathname, const char *mode, FILE *stream), (pathname, mode, stream)) \
+	LIBTRACE_FREOPEN64(X) \
+	X(int, unlink, (const char *pathname), (pathname)) \
+	X(int, unlinkat, (int dirfd, const char *pathname, int flags), (dirfd, pathname, flags)) \
+	X(int, mkdir, (const char *pathname, mode_t mode), (pathname, mode)) \
+	X(int, mkdirat, (int dirfd, const char *pathname, mode_t mode), (dirfd, pathname, mode)) \
+	X(int, rmdir, (const char *pathname), (pathname)) \
+	X(int, stat, (const char *pathname, struct stat *statbuf), (pathname, statbuf)) \
+	X(int, lstat, (const char *pathname, struct stat *statbuf), (pathname, statbuf)) \
+	X(int, fstatat, (int dirfd, const char *pathname, struct stat *statbuf, int flags), (dirfd, pathname, statbuf, flags)) \
+	LIBTRACE_STAT64(X) \
+	LIBTRACE_STATX(X) \
+	X(DIR *, opendir, (const char *pathname), (pathname)) \
+	X(int, access, (const char *pathname, int mode), (pathname, mode)) \
+	X(int, faccessat, (int dirfd, const char *pathname, int mode, int flags), (dirfd, pathname, mode, flags)) \
+	X(int, connect, (int sockfd, const struct sockaddr *addr, socklen_t addrlen), (sockfd, addr, addrlen)) \
+	X(int, socket, (int domain, int type, int protocol), (domain, type, protocol)) \
+	X(int, bind, (int sockfd, const struct sockaddr *addr, socklen_t addrlen), (sockfd, addr, addrlen)) \
+	X(int, system, (const char *command), (command)) \
+	X(int, setuid, (uid_t uid), (uid)) \
+	X(int, setgid, (gid_t gid), (gid)) \
+	X(int, setfsuid, (uid_t uid), (uid)) \
+	X(int, setfsgid, (gid_t gid), (gid)) \
+	X(int, setreuid, (uid_t ruid, uid_t euid), (ruid, euid)) \
+	X(int, setregid, (gid_t rgid, gid_t egid), (rgid, egid)) \
+	X(int, setresuid, (uid_t ruid, uid_t euid, uid_t suid), (ruid, euid, suid)) \
+	X(int, setresgid, (gid_t rgid, gid_t egid, gid_t sgid), (rgid, egid, sgid))
+
+PRELOAD_TABLE(LIBTRACE_CALLS)
 
 //
 // library constructor/destructor
 //
 // Using fprintf to /dev/tty instead of printf in order to fix #561
 static FILE *ftty = NULL;
+// binary mode: the records go to the segment set up by firejail --trace
+static TraceSegment *seg = NULL;
+static int initialized = 0;
 static pid_t mypid = 0;
+static __thread pid_t mytid = 0;
 #define MAXNAME 16 // 8 or larger
 static char myname[MAXNAME] = "unknown";
 
+static void init(void);
+
+// filters, set once in init() from FIREJAIL_TRACE_CALLS, FIREJAIL_TRACE_FAILED
+// and FIREJAIL_TRACE_SAMPLE; they are checked before the record is formatted
+static char trace_call[TRACE_CALL_MAX];	// the calls traced
+static int trace_failed = 0;		// only the calls that failed
+static unsigned trace_sample = 1;	// one call in trace_sample
+static __thread unsigned sample_cnt = 0;
+
+static int traced(int call, long rv) {
+	if (!initialized)
+		init();
+
+	if (!trace_call[call])
+		return 0;
+	if (trace_failed && (trace_calls[call].ptr ? rv != 0 : rv >= 0))
+		return 0;
+	// per thread, no shared counter on the hot path
+	if (trace_sample > 1 && sample_cnt++ % trace_sample)
+		return 0;
+	return 1;
+}
+
+// FIREJAIL_TRACE_CALLS: comma-separated call names or classes (file, network,
+// process, id); the unknown names are ignored
+static void set_filters(void) {
+	const char *str = getenv("FIREJAIL_TRACE_CALLS");
+	if (str && *str) {
+		memset(trace_call, 0, sizeof(trace_call));
+		while (*str) {
+			size_t len = strcspn(str, ",");
+			int i;
+			for (i = 0; i < TRACE_CALL_MAX; i++) {
+				if ((strlen(trace_calls[i].name) == len && strncmp(str, trace_calls[i].name, len) == 0) ||
+				    (strlen(trace_calls[i].cls) == len && strncmp(str, trace_calls[i].cls, len) == 0))
+					trace_call[i] = 1;
+			}
+			str += len;
+			if (*str == ',')
+				str++;
+		}
+	}
+	else
+		memset(trace_call, 1, sizeof(trace_call));
+
+	str = getenv("FIREJAIL_TRACE_FAILED");
+	if (str && strcmp(str, "yes") == 0)
+		trace_failed = 1;
+
+	str = getenv("FIREJAIL_TRACE_SAMPLE");
+	if (str) {
+		char *end;
+		unsigned long n = strtoul(str, &end, 10);
+		if (end != str && *end == '\0' && n > 0 && n <= UINT32_MAX)
+			trace_sample = n;
+	}
+}
+
+// arg is the text between the call name and the return value;
+// the wrappers go through the tlog() macro, the arguments are not evaluated
+// if the call is filtered out
+static void tlog_record(int call, long rv, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+static void tlog_record(int call, long rv, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	if (seg) {
+		if (!mytid)
+			mytid = syscall(SYS_gettid);
+		TraceRing *ring = &seg->ring[mytid % TRACE_RINGS];
+
+		// reserve a record, drop it if the ring is full
+		uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		do {
+			uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+			if (head - tail >= TRACE_RING_RECORDS) {
+				__atomic_fetch_add(&seg->drops, 1, __ATOMIC_RELAXED);
+				va_end(args);
+				return;
+			}
+		} while (!__atomic_compare_exchange_n(&ring->head, &head, head + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+		TraceRecord *rec = &ring->rec[head & (TRACE_RING_RECORDS - 1)];
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		rec->time = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		rec->call = call;
+		rec->pid = mypid;
+		rec->tid = mytid;
+		rec->rv = rv;
+		memcpy(rec->name, myname, TRACE_NAME_MAX);
+		int len = vsnprintf(rec->arg, TRACE_ARG_MAX, fmt, args);
+		if (len < 0)
+			len = 0;
+		else if (len >= TRACE_ARG_MAX)
+			len = TRACE_ARG_MAX - 1;
+		rec->len = len;
+
+		// publish the record
+		__atomic_store_n(&rec->seq, head + 1, __ATOMIC_RELEASE);
+	}
+	else if (ftty) {
+		flockfile(ftty);
+		fprintf(ftty, "%u:%s:%s ", mypid, myname, trace_calls[call].name);
+		vfprintf(ftty, fmt, args);
+		if (trace_calls[call].ptr)
+			fprintf(ftty, ":%p\n", (void *) rv);
+		else
+			fprintf(ftty, ":%d\n", (int) rv);
+		funlockfile(ftty);
+	}
+	va_end(args);
+}
+
+#define tlog(call, rv, ...) \
+	do { \
+		if (traced(call, rv)) \
+			tlog_record(call, rv, __VA_ARGS__); \
+	} while (0)
+
+// map the segment created by firejail --trace, NULL if not available
+static TraceSegment *map_segment(void) {
+	int fd = orig_open(RUN_TRACE_RING_FILE, O_RDWR | O_CLOEXEC, 0);
+	if (fd == -1)
+		return NULL;
+
+	TraceSegment *rv = mmap(NULL, sizeof(TraceSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rv == MAP_FAILED)
+		return NULL;
+	if (rv->magic != TRACE_RING_MAGIC) {
+		munmap(rv, sizeof(TraceSegment));
+		return NULL;
+	}
+	return rv;
+}
+
+// process name; only async-signal-safe calls, it runs in the child of fork()
+static void read_name(void) {
+	int fd = orig_open("/proc/self/comm", O_RDONLY | O_CLOEXEC, 0);
+	if (fd == -1)
+		return;
+	char buf[MAXNAME];
+	ssize_t len = read(fd, buf, MAXNAME - 1);
+	close(fd);
+	if (len <= 0)
+		return;
+	buf[len] = '\0';
+
+	// clean '\n'
+	char *ptr = strchr(buf, '\n');
+	if (ptr)
+		*ptr = '\0';
+	memcpy(myname, buf, MAXNAME);
+}
+
+// the child of a fork() has its own pid and thread id
+static void atfork_child(void) {
+	mypid = getpid();
+	mytid = 0;
+	read_name();
+}
+
 static void init(void) __attribute__((constructor));
 void init(void) {
-	if (ftty)
+	if (initialized)
 		return;
+	initialized = 1;
 
-	orig_fopen = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen");
-	orig_access = (orig_access_t)dlsym(RTLD_NEXT, "access");
+	preload_resolve();
+	set_filters();
 
 	// allow environment variable to override defaults
 	char *logfile = getenv("FIREJAIL_TRACEFILE");
-	if (!logfile) {
-		// if exists, log to trace file
-		logfile = RUN_TRACE_FILE;
-		if (orig_access(logfile, F_OK))
-			// else log to associated tty
-			logfile = "/dev/tty";
-	}
+	if (!logfile)
+		seg = map_segment();
+	if (!seg) {
+		if (!logfile) {
+			// if exists, log to trace file
+			logfile = RUN_TRACE_FILE;
+			if (orig_access(logfile, F_OK))
+				// else log to associated tty
+				logfile = "/dev/tty";
+		}
 
-	// logfile
-	unsigned cnt = 0;
-	while ((ftty = orig_fopen(logfile, "a")) == NULL) {
-		if (++cnt > 10) { // 10 sec
-			perror("Cannot open trace log file");
-			exit(1);
+		// logfile
+		unsigned cnt = 0;
+		while ((ftty = orig_fopen(logfile, "a")) == NULL) {
+			if (++cnt > 10) { // 10 sec
+				perror("Cannot open trace log file");
+				exit(1);
+			}
+			sleep(1);
 		}
-		sleep(1);
+		// line buffered stream
+		setvbuf(ftty, NULL, _IOLBF, BUFSIZ);
 	}
-	// line buffered stream
-	setvbuf(ftty, NULL, _IOLBF, BUFSIZ);
 
 	// pid
 	mypid = getpid();
+	pthread_atfork(NULL, NULL, atfork_child);
 
-	// process name
-	char *fname;
-	if (asprintf(&fname, "/proc/%u/comm", mypid) != -1) {
-		FILE *fp = orig_fopen(fname, "r");
-		free(fname);
-		if (fp) {
-			if (fgets(myname, MAXNAME, fp) == NULL)
-				strcpy(myname, "unknown");
-			fclose(fp);
-		}
-	}
-
-	// clean '\n'
-	char *ptr = strchr(myname, '\n');
-	if (ptr)
-		*ptr = '\0';
-
-//	tprintf(ftty, "=== tracelib init() [%d:%s] === \n", mypid, myname);
+	read_name();
 }
 
 static void fini(void) __attribute__((destructor));
 void fini(void) {
-	fclose(ftty);
+	if (ftty)
+		fclose(ftty);
 }
 
 //
@@ -255,26 +476,29 @@ static char *translate(XTable *table, int val) {
 	return NULL;
 }
 
-static void print_sockaddr(int sockfd, const char *call, const struct sockaddr *addr, int rv) {
+static void print_sockaddr(int sockfd, int call, const struct sockaddr *addr, int rv) {
+	if (!traced(call, rv))
+		return;
+
 	if (addr->sa_family == AF_INET) {
 		struct sockaddr_in *a = (struct sockaddr_in *) addr;
-		tprintf(ftty, "%u:%s:%s %d %s port %u:%d\n", mypid, myname, call, sockfd, inet_ntoa(a->sin_addr), ntohs(a->sin_port), rv);
+		tlog_record(call, rv, "%d %s port %u", sockfd, inet_ntoa(a->sin_addr), ntohs(a->sin_port));
 	}
 	else if (addr->sa_family == AF_INET6) {
 		struct sockaddr_in6 *a = (struct sockaddr_in6 *) addr;
 		char str[INET6_ADDRSTRLEN];
 		inet_ntop(AF_INET6, &(a->sin6_addr), str, INET6_ADDRSTRLEN);
-		tprintf(ftty, "%u:%s:%s %d %s:%d\n", mypid, myname, call, sockfd, str, rv);
+		tlog_record(call, rv, "%d %s", sockfd, str);
 	}
 	else if (addr->sa_family == AF_UNIX) {
 		struct sockaddr_un *a = (struct sockaddr_un *) addr;
 		if (a->sun_path[0])
-			tprintf(ftty, "%u:%s:%s %d %s:%d\n", mypid, myname, call, sockfd, a->sun_path, rv);
+			tlog_record(call, rv, "%d %s", sockfd, a->sun_path);
 		else
-			tprintf(ftty, "%u:%s:%s %d @%s:%d\n", mypid, myname, call, sockfd, a->sun_path + 1, rv);
+			tlog_record(call, rv, "%d @%s", sockfd, a->sun_path + 1);
 	}
 	else {
-		tprintf(ftty, "%u:%s:%s %d family %d:%d\n", mypid, myname, call, sockfd, addr->sa_family, rv);
+		tlog_record(call, rv, "%d family %d", sockfd, addr->sa_family);
 	}
 }
 
@@ -283,255 +507,208 @@ static void print_sockaddr(int sockfd, const char *call, const struct sockaddr *
 //
 
 // open
-typedef int (*orig_open_t)(const char *pathname, int flags, mode_t mode);
-static orig_open_t orig_open = NULL;
 int open(const char *pathname, int flags, mode_t mode) {
-	if (!orig_open)
-		orig_open = (orig_open_t)dlsym(RTLD_NEXT, "open");
-
 	int rv = orig_open(pathname, flags, mode);
-	tprintf(ftty, "%u:%s:open %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_OPEN, rv, "%s", pathname);
 	return rv;
 }
 
-typedef int (*orig_open64_t)(const char *pathname, int flags, mode_t mode);
-static orig_open64_t orig_open64 = NULL;
 int open64(const char *pathname, int flags, mode_t mode) {
-	if (!orig_open64)
-		orig_open64 = (orig_open64_t)dlsym(RTLD_NEXT, "open64");
-
 	int rv = orig_open64(pathname, flags, mode);
-	tprintf(ftty, "%u:%s:open64 %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_OPEN64, rv, "%s", pathname);
 	return rv;
 }
 
 // openat
-typedef int (*orig_openat_t)(int dirfd, const char *pathname, int flags, mode_t mode);
-static orig_openat_t orig_openat = NULL;
 int openat(int dirfd, const char *pathname, int flags, mode_t mode) {
-	if (!orig_openat)
-		orig_openat = (orig_openat_t)dlsym(RTLD_NEXT, "openat");
-
 	int rv = orig_openat(dirfd, pathname, flags, mode);
-	tprintf(ftty, "%u:%s:openat %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_OPENAT, rv, "%s", pathname);
 	return rv;
 }
 
-typedef int (*orig_openat64_t)(int dirfd, const char *pathname, int flags, mode_t mode);
-static orig_openat64_t orig_openat64 = NULL;
 int openat64(int dirfd, const char *pathname, int flags, mode_t mode) {
-	if (!orig_openat64)
-		orig_openat64 = (orig_openat64_t)dlsym(RTLD_NEXT, "openat64");
-
 	int rv = orig_openat64(dirfd, pathname, flags, mode);
-	tprintf(ftty, "%u:%s:openat64 %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_OPENAT64, rv, "%s", pathname);
+	return rv;
+}
+
+// open and openat with _FORTIFY_SOURCE, glibc calls the system call directly
+int __open_2(const char *pathname, int flags) {
+	int rv = orig___open_2(pathname, flags);
+	tlog(TRACE_OPEN, rv, "%s", pathname);
+	return rv;
+}
+
+int __open64_2(const char *pathname, int flags) {
+	int rv = orig___open64_2(pathname, flags);
+	tlog(TRACE_OPEN64, rv, "%s", pathname);
+	return rv;
+}
+
+int __openat_2(int dirfd, const char *pathname, int flags) {
+	int rv = orig___openat_2(dirfd, pathname, flags);
+	tlog(TRACE_OPENAT, rv, "%s", pathname);
+	return rv;
+}
+
+int __openat64_2(int dirfd, const char *pathname, int flags) {
+	int rv = orig___openat64_2(dirfd, pathname, flags);
+	tlog(TRACE_OPENAT64, rv, "%s", pathname);
 	return rv;
 }
 
 
 // fopen
 FILE *fopen(const char *pathname, const char *mode) {
-	if (!orig_fopen)
-		orig_fopen = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen");
-
 	FILE *rv = orig_fopen(pathname, mode);
-	tprintf(ftty, "%u:%s:fopen %s:%p\n", mypid, myname, pathname, rv);
+	tlog(TRACE_FOPEN, (long) rv, "%s", pathname);
 	return rv;
 }
 
 #ifndef fopen64
-typedef FILE *(*orig_fopen64_t)(const char *pathname, const char *mode);
-static orig_fopen64_t orig_fopen64 = NULL;
 FILE *fopen64(const char *pathname, const char *mode) {
-	if (!orig_fopen64)
-		orig_fopen64 = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen64");
-
 	FILE *rv = orig_fopen64(pathname, mode);
-	tprintf(ftty, "%u:%s:fopen64 %s:%p\n", mypid, myname, pathname, rv);
+	tlog(TRACE_FOPEN64, (long) rv, "%s", pathname);
 	return rv;
 }
 #endif
 
 
 // freopen
-typedef FILE *(*orig_freopen_t)(const char *pathname, const char *mode, FILE *stream);
-static orig_freopen_t orig_freopen = NULL;
 FILE *freopen(const char *pathname, const char *mode, FILE *stream) {
-	if (!orig_freopen)
-		orig_freopen = (orig_freopen_t)dlsym(RTLD_NEXT, "freopen");
-
 	FILE *rv = orig_freopen(pathname, mode, stream);
-	tprintf(ftty, "%u:%s:freopen %s:%p\n", mypid, myname, pathname, rv);
+	tlog(TRACE_FREOPEN, (long) rv, "%s", pathname);
 	return rv;
 }
 
 #ifndef freopen64
-typedef FILE *(*orig_freopen64_t)(const char *pathname, const char *mode, FILE *stream);
-static orig_freopen64_t orig_freopen64 = NULL;
 FILE *freopen64(const char *pathname, const char *mode, FILE *stream) {
-	if (!orig_freopen64)
-		orig_freopen64 = (orig_freopen64_t)dlsym(RTLD_NEXT, "freopen64");
-
 	FILE *rv = orig_freopen64(pathname, mode, stream);
-	tprintf(ftty, "%u:%s:freopen64 %s:%p\n", mypid, myname, pathname, rv);
+	tlog(TRACE_FREOPEN64, (long) rv, "%s", pathname);
 	return rv;
 }
 #endif
 
 // unlink
-typedef int (*orig_unlink_t)(const char *pathname);
-static orig_unlink_t orig_unlink = NULL;
 int unlink(const char *pathname) {
-	if (!orig_unlink)
-		orig_unlink = (orig_unlink_t)dlsym(RTLD_NEXT, "unlink");
-
 	int rv = orig_unlink(pathname);
-	tprintf(ftty, "%u:%s:unlink %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_UNLINK, rv, "%s", pathname);
 	return rv;
 }
 
-typedef int (*orig_unlinkat_t)(int dirfd, const char *pathname, int flags);
-static orig_unlinkat_t orig_unlinkat = NULL;
 int unlinkat(int dirfd, const char *pathname, int flags) {
-	if (!orig_unlinkat)
-		orig_unlinkat = (orig_unlinkat_t)dlsym(RTLD_NEXT, "unlinkat");
-
 	int rv = orig_unlinkat(dirfd, pathname, flags);
-	tprintf(ftty, "%u:%s:unlinkat %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_UNLINKAT, rv, "%s", pathname);
 	return rv;
 }
 
 // mkdir/mkdirat/rmdir
-typedef int (*orig_mkdir_t)(const char *pathname, mode_t mode);
-static orig_mkdir_t orig_mkdir = NULL;
 int mkdir(const char *pathname, mode_t mode) {
-	if (!orig_mkdir)
-		orig_mkdir = (orig_mkdir_t)dlsym(RTLD_NEXT, "mkdir");
-
 	int rv = orig_mkdir(pathname, mode);
-	tprintf(ftty, "%u:%s:mkdir %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_MKDIR, rv, "%s", pathname);
 	return rv;
 }
 
-typedef int (*orig_mkdirat_t)(int dirfd, const char *pathname, mode_t mode);
-static orig_mkdirat_t orig_mkdirat = NULL;
 int mkdirat(int dirfd, const char *pathname, mode_t mode) {
-	if (!orig_mkdirat)
-		orig_mkdirat = (orig_mkdirat_t)dlsym(RTLD_NEXT, "mkdirat");
-
 	int rv = orig_mkdirat(dirfd, pathname, mode);
-	tprintf(ftty, "%u:%s:mkdirat %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_MKDIRAT, rv, "%s", pathname);
 	return rv;
 }
 
-typedef int (*orig_rmdir_t)(const char *pathname);
-static orig_rmdir_t orig_rmdir = NULL;
 int rmdir(const char *pathname) {
-	if (!orig_rmdir)
-		orig_rmdir = (orig_rmdir_t)dlsym(RTLD_NEXT, "rmdir");
-
 	int rv = orig_rmdir(pathname);
-	tprintf(ftty, "%u:%s:rmdir %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_RMDIR, rv, "%s", pathname);
 	return rv;
 }
 
 // stat
-typedef int (*orig_stat_t)(const char *pathname, struct stat *statbuf);
-static orig_stat_t orig_stat = NULL;
 int stat(const char *pathname, struct stat *statbuf) {
-	if (!orig_stat)
-		orig_stat = (orig_stat_t)dlsym(RTLD_NEXT, "stat");
-
 	int rv = orig_stat(pathname, statbuf);
-	tprintf(ftty, "%u:%s:stat %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_STAT, rv, "%s", pathname);
 	return rv;
 }
 
-//#ifndef stat64
-//typedef int (*orig_stat64_t)(const char *pathname, struct stat64 *statbuf);
-//static orig_stat64_t orig_stat64 = NULL;
-//int stat64(const char *pathname, struct stat64 *statbuf) {
-//	if (!orig_stat64)
-//		orig_stat64 = (orig_stat64_t)dlsym(RTLD_NEXT, "stat64");
-//
-//	int rv = orig_stat64(pathname, statbuf);
-//	tprintf(ftty, "%u:%s:stat64 %s:%d\n", mypid, myname, pathname, rv);
-//	return rv;
-//}
-//#endif
-
 // lstat
-typedef int (*orig_lstat_t)(const char *pathname, struct stat *statbuf);
-static orig_lstat_t orig_lstat = NULL;
 int lstat(const char *pathname, struct stat *statbuf) {
-	if (!orig_lstat)
-		orig_lstat = (orig_lstat_t)dlsym(RTLD_NEXT, "lstat");
-
 	int rv = orig_lstat(pathname, statbuf);
-	tprintf(ftty, "%u:%s:lstat %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_LSTAT, rv, "%s", pathname);
 	return rv;
 }
 
-//#ifndef lstat64
-//typedef int (*orig_lstat64_t)(const char *pathname, struct stat64 *statbuf);
-//static orig_lstat64_t orig_lstat64 = NULL;
-//int lstat64(const char *pathname, struct stat64 *statbuf) {
-//	if (!orig_lstat64)
-//		orig_lstat64 = (orig_lstat64_t)dlsym(RTLD_NEXT, "lstat64");
-//
-//	int rv = orig_lstat64(pathname, statbuf);
-//	tprintf(ftty, "%u:%s:lstat64 %s:%d\n", mypid, myname, pathname, rv);
-//	return rv;
-//}
-//#endif
+// fstatat, the newfstatat system call
+int fstatat(int dirfd, const char *pathname, struct stat *statbuf, int flags) {
+	int rv = orig_fstatat(dirfd, pathname, statbuf, flags);
+	tlog(TRACE_FSTATAT, rv, "%s", pathname);
+	return rv;
+}
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+int stat64(const char *pathname, struct stat64 *statbuf) {
+	int rv = orig_stat64(pathname, statbuf);
+	tlog(TRACE_STAT, rv, "%s", pathname);
+	return rv;
+}
+
+int lstat64(const char *pathname, struct stat64 *statbuf) {
+	int rv = orig_lstat64(pathname, statbuf);
+	tlog(TRACE_LSTAT, rv, "%s", pathname);
+	return rv;
+}
+
+int fstatat64(int dirfd, const char *pathname, struct stat64 *statbuf, int flags) {
+	int rv = orig_fstatat64(dirfd, pathname, statbuf, flags);
+	tlog(TRACE_FSTATAT, rv, "%s", pathname);
+	return rv;
+}
+#endif
+
+#ifdef STATX_TYPE
+// statx
+int statx(int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *statxbuf) {
+	int rv = orig_statx(dirfd, pathname, flags, mask, statxbuf);
+	tlog(TRACE_STATX, rv, "%s", pathname);
+	return rv;
+}
+#endif
 
 // opendir
-typedef DIR *(*orig_opendir_t)(const char *pathname);
-static orig_opendir_t orig_opendir = NULL;
 DIR *opendir(const char *pathname) {
-	if (!orig_opendir)
-		orig_opendir = (orig_opendir_t)dlsym(RTLD_NEXT, "opendir");
-
 	DIR *rv = orig_opendir(pathname);
-	tprintf(ftty, "%u:%s:opendir %s:%p\n", mypid, myname, pathname, rv);
+	tlog(TRACE_OPENDIR, (long) rv, "%s", pathname);
 	return rv;
 }
 
 // access
 int access(const char *pathname, int mode) {
-	if (!orig_access)
-		orig_access = (orig_access_t)dlsym(RTLD_NEXT, "access");
-
 	int rv = orig_access(pathname, mode);
-	tprintf(ftty, "%u:%s:access %s:%d\n", mypid, myname, pathname, rv);
+	tlog(TRACE_ACCESS, rv, "%s", pathname);
+	return rv;
+}
+
+// faccessat, the faccessat2 system call when flags are set
+int faccessat(int dirfd, const char *pathname, int mode, int flags) {
+	int rv = orig_faccessat(dirfd, pathname, mode, flags);
+	tlog(TRACE_FACCESSAT, rv, "%s", pathname);
 	return rv;
 }
 
 
 // connect
-typedef int (*orig_connect_t)(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
-static orig_connect_t orig_connect = NULL;
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-	if (!orig_connect)
-		orig_connect = (orig_connect_t)dlsym(RTLD_NEXT, "connect");
-
 	int rv = orig_connect(sockfd, addr, addrlen);
-	print_sockaddr(sockfd, "connect", addr, rv);
+	print_sockaddr(sockfd, TRACE_CONNECT, addr, rv);
 
 	return rv;
 }
 
 // socket
-typedef int (*orig_socket_t)(int domain, int type, int protocol);
-static orig_socket_t orig_socket = NULL;
 static char socketbuf[1024];
 int socket(int domain, int type, int protocol) {
-	if (!orig_socket)
-		orig_socket = (orig_socket_t)dlsym(RTLD_NEXT, "socket");
-
 	int rv = orig_socket(domain, type, protocol);
+	if (!traced(TRACE_SOCKET, rv))
+		return rv;
+
 	char *ptr = socketbuf;
-	ptr += sprintf(ptr, "%u:%s:socket ", mypid, myname);
 	char *str = translate(socket_domain, domain);
 	if (str == NULL)
 		ptr += sprintf(ptr, "%d ", domain);
@@ -561,19 +738,14 @@ int socket(int domain, int type, int protocol) {
 			sprintf(ptr, "%s", str);
 	}
 
-	tprintf(ftty, "%s:%d\n", socketbuf, rv);
+	tlog_record(TRACE_SOCKET, rv, "%s", socketbuf);
 	return rv;
 }
 
 // bind
-typedef int (*orig_bind_t)(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
-static orig_bind_t orig_bind = NULL;
 int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-	if (!orig_bind)
-		orig_bind = (orig_bind_t)dlsym(RTLD_NEXT, "bind");
-
 	int rv = orig_bind(sockfd, addr, addrlen);
-	print_sockaddr(sockfd, "bind", addr, rv);
+	print_sockaddr(sockfd, TRACE_BIND, addr, rv);
 
 	return rv;
 }
@@ -592,110 +764,65 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t addrlen) {
 }
 #endif
 
-typedef int (*orig_system_t)(const char *command);
-static orig_system_t orig_system = NULL;
 int system(const char *command) {
-	if (!orig_system)
-		orig_system = (orig_system_t)dlsym(RTLD_NEXT, "system");
-
 	int rv = orig_system(command);
-	tprintf(ftty, "%u:%s:system %s:%d\n", mypid, myname, command, rv);
+	tlog(TRACE_SYSTEM, rv, "%s", command);
 
 	return rv;
 }
 
-typedef int (*orig_setuid_t)(uid_t uid);
-static orig_setuid_t orig_setuid = NULL;
 int setuid(uid_t uid) {
-	if (!orig_setuid)
-		orig_setuid = (orig_setuid_t)dlsym(RTLD_NEXT, "setuid");
-
 	int rv = orig_setuid(uid);
-	tprintf(ftty, "%u:%s:setuid %d:%d\n", mypid, myname, uid, rv);
+	tlog(TRACE_SETUID, rv, "%d", uid);
 
 	return rv;
 }
 
-typedef int (*orig_setgid_t)(gid_t gid);
-static orig_setgid_t orig_setgid = NULL;
 int setgid(gid_t gid) {
-	if (!orig_setgid)
-		orig_setgid = (orig_setgid_t)dlsym(RTLD_NEXT, "setgid");
-
 	int rv = orig_setgid(gid);
-	tprintf(ftty, "%u:%s:setgid %d:%d\n", mypid, myname, gid, rv);
+	tlog(TRACE_SETGID, rv, "%d", gid);
 
 	return rv;
 }
 
-typedef int (*orig_setfsuid_t)(uid_t uid);
-static orig_setfsuid_t orig_setfsuid = NULL;
 int setfsuid(uid_t uid) {
-	if (!orig_setfsuid)
-		orig_setfsuid = (orig_setfsuid_t)dlsym(RTLD_NEXT, "setfsuid");
-
 	int rv = orig_setfsuid(uid);
-	tprintf(ftty, "%u:%s:setfsuid %d:%d\n", mypid, myname, uid, rv);
+	tlog(TRACE_SETFSUID, rv, "%d", uid);
 
 	return rv;
 }
 
-typedef int (*orig_setfsgid_t)(gid_t gid);
-static orig_setfsgid_t orig_setfsgid = NULL;
 int setfsgid(gid_t gid) {
-	if (!orig_setfsgid)
-		orig_setfsgid = (orig_setfsgid_t)dlsym(RTLD_NEXT, "setfsgid");
-
 	int rv = orig_setfsgid(gid);
-	tprintf(ftty, "%u:%s:setfsgid %d:%d\n", mypid, myname, gid, rv);
+	tlog(TRACE_SETFSGID, rv, "%d", gid);
 
 	return rv;
 }
 
-typedef int (*orig_setreuid_t)(uid_t ruid, uid_t euid);
-static orig_setreuid_t orig_setreuid = NULL;
 int setreuid(uid_t ruid, uid_t euid) {
-	if (!orig_setreuid)
-		orig_setreuid = (orig_setreuid_t)dlsym(RTLD_NEXT, "setreuid");
-
 	int rv = orig_setreuid(ruid, euid);
-	tprintf(ftty, "%u:%s:setreuid %d %d:%d\n", mypid, myname, ruid, euid, rv);
+	tlog(TRACE_SETREUID, rv, "%d %d", ruid, euid);
 
 	return rv;
 }
 
-typedef int (*orig_setregid_t)(gid_t rgid, gid_t egid);
-static orig_setregid_t orig_setregid = NULL;
 int setregid(gid_t rgid, gid_t egid) {
-	if (!orig_setregid)
-		orig_setregid = (orig_setregid_t)dlsym(RTLD_NEXT, "setregid");
-
 	int rv = orig_setregid(rgid, egid);
-	tprintf(ftty, "%u:%s:setregid %d %d:%d\n", mypid, myname, rgid, egid, rv);
+	tlog(TRACE_SETREGID, rv, "%d %d", rgid, egid);
 
 	return rv;
 }
 
-typedef int (*orig_setresuid_t)(uid_t ruid, uid_t euid, uid_t suid);
-static orig_setresuid_t orig_setresuid = NULL;
 int setresuid(uid_t ruid, uid_t euid, uid_t suid) {
-	if (!orig_setresuid)
-		orig_setresuid = (orig_setresuid_t)dlsym(RTLD_NEXT, "setresuid");
-
 	int rv = orig_setresuid(ruid, euid, suid);
-	tprintf(ftty, "%u:%s:setresuid %d %d %d:%d\n", mypid, myname, ruid, euid, suid, rv);
+	tlog(TRACE_SETRESUID, rv, "%d %d %d", ruid, euid, suid);
 
 	return rv;
 }
 
-typedef int (*orig_setresgid_t)(gid_t rgid, gid_t egid, gid_t sgid);
-static orig_setresgid_t orig_setresgid = NULL;
 int setresgid(gid_t rgid, gid_t egid, gid_t sgid) {
-	if (!orig_setresgid)
-		orig_setresgid = (orig_setresgid_t)dlsym(RTLD_NEXT, "setresgid");
-
 	int rv = orig_setresgid(rgid, egid, sgid);
-	tprintf(ftty, "%u:%s:setresgid %d %d %d:%d\n", mypid, myname, rgid, egid, sgid, rv);
+	tlog(TRACE_SETRESGID, rv, "%d %d %d", rgid, egid, sgid);
 
 	return rv;
 }
@@ -709,11 +836,11 @@ static void log_exec(int argc, char** argv) {
 	char *buf = realpath("/proc/self/exe", NULL);
 	if (buf == NULL) {
 		if (errno == ENOMEM) {
-			tprintf(ftty, "realpath: %s\n", strerror(errno));
+			fprintf(stderr, "realpath: %s\n", strerror(errno));
 			exit(1);
 		}
 	} else {
-		tprintf(ftty, "%u:%s:exec %s:0\n", mypid, myname, buf);
+		tlog(TRACE_EXEC, 0, "%s", buf);
 		free(buf);
 	}
 }
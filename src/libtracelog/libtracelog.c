@@ -32,34 +32,111 @@
 #include <syslog.h>
 #include <dirent.h>
 #include <limits.h>
+#include <linux/fcntl.h>	// fcntl.h would declare open()
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
 #include "../include/rundefs.h"
+#include "../include/preload.h"
 
 //#define DEBUG
 
-// break recursivity on fopen call
-typedef FILE *(*orig_fopen_t)(const char *pathname, const char *mode);
-static orig_fopen_t orig_fopen = NULL;
+// the original functions, resolved once in init()
+#ifndef fopen64
+#define LIBTRACELOG_FOPEN64(X) \
+	X(FILE *, fopen64, (const char *pathname, const char *mode), (pathname, mode))
+#else
+#define LIBTRACELOG_FOPEN64(X)
+#endif
+#ifndef freopen64
+#define LIBTRACELOG_FREOPEN64(X) \
+	X(FILE *, freopen64, (const char *pathname, const char *mode, FILE *stream), (pathname, mode, stream))
+#else
+#define LIBTRACELOG_FREOPEN64(X)
+#endif
+// stat64, lstat64 and fstatat64 are exported functions since glibc 2.33
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+#define LIBTRACELOG_STAT64(X) \
+	X(int, stat64, (const char *pathname, struct stat64 *buf), (pathname, buf)) \
+	X(int, lstat64, (const char *pathname, struct stat64 *buf), (pathname, buf)) \
+	X(int, fstatat64, (int dirfd, const char *pathname, struct stat64 *buf, int flags), (dirfd, pathname, buf, flags))
+#else
+#define LIBTRACELOG_STAT64(X)
+#endif
+#ifdef STATX_TYPE
+#define LIBTRACELOG_STATX(X) \
+	X(int, statx, (int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *buf), (dirfd, pathname, flags, mask, buf))
+#else
+#define LIBTRACELOG_STATX(X)
+#endif
+#define LIBTRACELOG_CALLS(X) \
+	X(int, open, (const char *pathname, int flags, mode_t mode), (pathname, flags, mode)) \
+	X(int, open64, (const char *pathname, int flags, mode_t mode), (pathname, flags, mode)) \
+	X(int, openat, (int dirfd, const char *pathname, int flags, mode_t mode), (dirfd, pathname, flags, mode)) \
+	X(int, openat64, (int dirfd, const char *pathname, int flags, mode_t mode), (dirfd, pathname, flags, mode)) \
+	X(int, __open_2, (const char *pathname, int flags), (pathname, flags)) \
+	X(int, __open64_2, (const char *pathname, int flags), (pathname, flags)) \
+	X(int, __openat_2, (int dirfd, const char *pathname, int flags), (dirfd, pathname, flags)) \
+	X(int, __openat64_2, (int dirfd, const char *pathname, int flags), (dirfd, pathname, flags)) \
+	X(FILE *, fopen, (const char *pathname, const char *mode), (pathname, mode)) \
+	LIBTRACELOG_FOPEN64(X) \
+	X(FILE *, freopen, (const char *pathname, const char *mode, FILE *stream), (pathname, mode, stream)) \
+	LIBTRACELOG_FREOPEN64(X) \
+	X(int, unlink, (const char *pathname), (pathname)) \
+	X(int, unlinkat, (int dirfd, const char *pathname, int flags), (dirfd, pathname, flags)) \
+	X(int, mkdir, (const char *pathname, mode_t mode), (pathname, mode)) \
+	X(int, mkdirat, (int dirfd, const char *pathname, mode_t mode), (dirfd, pathname, mode)) \
+	X(int, rmdir, (const char *pathname), (pathname)) \
+	X(int, stat, (const char *pathname, struct stat *buf), (pathname, buf)) \
+	X(int, lstat, (const char *pathname, struct stat *buf), (pathname, buf)) \
+	X(int, fstatat, (int dirfd, const char *pathname, struct stat *buf, int flags), (dirfd, pathname, buf, flags)) \
+	LIBTRACELOG_STAT64(X) \
+	LIBTRACELOG_STATX(X) \
+	X(int, access, (const char *pathname, int mode), (pathname, mode)) \
+	X(int, faccessat, (int dirfd, const char *pathname, int mode, int flags), (dirfd, pathname, mode, flags)) \
+	X(DIR *, opendir, (const char *pathname), (pathname)) \
+	X(int, chdir, (const char *pathname), (pathname)) \
+	X(int, fchdir, (int fd), (fd))
+
+PRELOAD_TABLE(LIBTRACELOG_CALLS)
 
 //
-// blacklist storage
+// blacklist storage - a trie of path components; a path matches if it is
+// blacklisted or it is under a blacklisted directory
 //
-typedef struct list_elem_t {
-	struct list_elem_t *next;
-	char *path;
-} ListElem;
-
-#define HMASK 0x0ff
-ListElem *storage[HMASK + 1];
-
-// djb2
-static inline uint32_t hash(const char *str) {
-	uint32_t hash = 5381;
-	int c;
-
-	while ((c = *str++) != '\0')
-		hash = ((hash << 5) + hash) + c; // hash * 33 + c; another variant would be hash * 33 ^ c
+typedef struct node_t {
+	char *name;		// path component
+	unsigned len;
+	int blacklisted;
+	unsigned cnt;		// children, sorted by storage_compile()
+	unsigned size;
+	struct node_t *child;
+} Node;
+
+static Node root;
+
+// the next component of the path, skipping the empty and "." components;
+// NULL at the end of the path
+static const char *next_component(const char *path, unsigned *len) {
+	while (1) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return NULL;
+		const char *end = strchrnul(path, '/');
+		*len = end - path;
+		if (*len != 1 || *path != '.')
+			return path;
+		path = end;
+	}
+}
 
-	return hash & HMASK;
+static int node_compare(const void *p1, const void *p2) {
+	const Node *n1 = p1;
+	const Node *n2 = p2;
+	if (n1->len != n2->len)
+		return (n1->len < n2->len) ? -1 : 1;
+	return memcmp(n1->name, n2->name, n1->len);
 }
 
 static void storage_add(const char *str) {
@@ -74,88 +151,113 @@ static void storage_add(const char *str) {
 	printf("add %s\n", str);
 #endif
 
-	ListElem *ptr = malloc(sizeof(ListElem));
-	if (!ptr) {
-		fprintf(stderr, "Error: cannot allocate memory\n");
-		return;
-	}
-	ptr->path = strdup(str);
-	if (!ptr->path) {
-		fprintf(stderr, "Error: cannot allocate memory\n");
-		free(ptr);
-		return;
+	Node *node = &root;
+	const char *comp;
+	unsigned len;
+	while ((comp = next_component(str, &len)) != NULL) {
+		str = comp + len;
+
+		// the children are not sorted yet
+		unsigned i;
+		for (i = 0; i < node->cnt; i++) {
+			if (node->child[i].len == len && memcmp(node->child[i].name, comp, len) == 0)
+				break;
+		}
+		if (i == node->cnt) {
+			if (node->cnt == node->size) {
+				unsigned size = (node->size) ? node->size * 2 : 4;
+				Node *child = realloc(node->child, size * sizeof(Node));
+				if (!child) {
+					fprintf(stderr, "Error: cannot allocate memory\n");
+					return;
+				}
+				node->child = child;
+				node->size = size;
+			}
+			Node *n = &node->child[node->cnt];
+			memset(n, 0, sizeof(Node));
+			n->name = strndup(comp, len);
+			if (!n->name) {
+				fprintf(stderr, "Error: cannot allocate memory\n");
+				return;
+			}
+			n->len = len;
+			node->cnt++;
+		}
+		node = &node->child[i];
 	}
+	node->blacklisted = 1;
+}
 
-	// insert it into the hash table
-	uint32_t h = hash(ptr->path);
-	ptr->next = storage[h];
-	storage[h] = ptr;
+// sort the children for the binary search in storage_find()
+static void storage_compile(Node *node) {
+	qsort(node->child, node->cnt, sizeof(Node), node_compare);
+	unsigned i;
+	for (i = 0; i < node->cnt; i++)
+		storage_compile(&node->child[i]);
 }
 
 // global variable to keep current working directory
 static char* cwd = NULL;
 
-static char *storage_find(const char *str) {
+static int storage_lookup(const char *path) {
+	const Node *node = &root;
+	const char *comp;
+	unsigned len;
+	while ((comp = next_component(path, &len)) != NULL) {
+		path = comp + len;
+
+		Node key = { .name = (char *) comp, .len = len };
+		node = bsearch(&key, node->child, node->cnt, sizeof(Node), node_compare);
+		if (!node)
+			return 0;
+		if (node->blacklisted)
+			return 1;
+	}
+	return node->blacklisted;
+}
+
+static int storage_find(const char *str) {
 	if (!str) {
 #ifdef DEBUG
 		printf("null pointer passed to storage_find\n");
 #endif
-		return NULL;
+		return 0;
 	}
 
 #ifdef DEBUG
 	printf("storage find %s\n", str);
 #endif
 
-	const char *tofind = str;
-	int allocated = 0;
+	// fast path: an absolute path without "..", the empty and "." components
+	// are skipped in the trie walk
+	if (str[0] == '/' && !strstr(str, ".."))
+		return storage_lookup(str);
 
-	if (strstr(str, "..") || strstr(str, "/./") || strstr(str, "//") || str[0] != '/') {
-		if (cwd != NULL && str[0] != '/') {
-			char *fullpath=malloc(PATH_MAX);
-			if (!fullpath) {
-				fprintf(stderr, "Error: cannot allocate memory\n");
-				return NULL;
-			}
-			if (snprintf(fullpath, PATH_MAX, "%s/%s", cwd, str)<3) {
-				fprintf(stderr, "Error: snprintf failed\n");
-				free(fullpath);
-				return NULL;
-			}
-			tofind = realpath(fullpath, NULL);
-			free(fullpath);
-		} else {
-			tofind = realpath(str, NULL);
-		}
-		if (!tofind) {
-#ifdef DEBUG
-			printf("realpath failed\n");
-#endif
-			return NULL;
+	char *tofind;
+	if (cwd != NULL && str[0] != '/') {
+		char fullpath[PATH_MAX];
+		if (snprintf(fullpath, PATH_MAX, "%s/%s", cwd, str) < 3) {
+			fprintf(stderr, "Error: snprintf failed\n");
+			return 0;
 		}
-		allocated = 1;
+		tofind = realpath(fullpath, NULL);
+	} else {
+		tofind = realpath(str, NULL);
 	}
-
-	uint32_t h = hash(tofind);
-	ListElem *ptr = storage[h];
-	while (ptr) {
-		if (strcmp(tofind, ptr->path) == 0) {
-			if (allocated)
-				free((char *) tofind);
+	if (!tofind) {
 #ifdef DEBUG
-			printf("storage found\n");
+		printf("realpath failed\n");
 #endif
-			return ptr->path;
-		}
-		ptr = ptr->next;
+		return 0;
 	}
 
-	if (allocated)
-		free((char *) tofind);
+	int rv = storage_lookup(tofind);
+	free(tofind);
 #ifdef DEBUG
-	printf("storage not found\n");
+	printf("storage %s\n", (rv) ? "found" : "not found");
 #endif
-	return NULL;
+	return rv;
 }
 
 
@@ -169,10 +271,10 @@ static char *sandbox_name_str = NULL;
 static void load_blacklist(void) {
 	if (blacklist_loaded)
 		return;
+	// the file is written before the sandbox starts, it is not looked for again
+	blacklist_loaded = 1;
 
 	// open filesystem log
-	if (!orig_fopen)
-		orig_fopen = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen");
 	FILE *fp = orig_fopen(RUN_FSLOGGER_FILE, "r");
 	if (!fp)
 		return;
@@ -208,28 +310,83 @@ static void load_blacklist(void) {
 		}
 	}
 	fclose(fp);
-	blacklist_loaded = 1;
+	storage_compile(&root);
 #ifdef DEBUG
 	printf("Monitoring %d blacklists\n", cnt);
-	{
-		int i;
-		for (i = 0; i <= HMASK; i++) {
-			int cnt = 0;
-			ListElem *ptr = storage[i];
-			while (ptr) {
-				cnt++;
-				ptr = ptr->next;
-			}
+#endif
+}
 
-			if ((i % 16) == 0)
-				printf("\n");
-			printf("%02d ", cnt);
-		}
-		printf("\n");
+
+//
+// syslog reporting: a violation is logged the first time it is seen, the
+// repeats are counted and summarized every TRACELOG_FLUSH seconds and when
+// the process exits; a token bucket limits the lines sent per second
+//
+#define TRACELOG_ENTRIES 256	// power of 2, distinct (call, path) pairs
+#define TRACELOG_BURST 10	// lines
+#define TRACELOG_RATE 1		// lines per second
+#define TRACELOG_FLUSH 60	// seconds
+
+typedef struct {
+	const char *call;	// __FUNCTION__ of the wrapper, NULL for an empty slot
+	char *path;
+	unsigned cnt;		// violations not logged yet
+} Violation;
+
+static Violation violation[TRACELOG_ENTRIES];
+static unsigned violation_overflow = 0;	// violations not stored, the table was full
+static pthread_mutex_t violation_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned tokens = TRACELOG_BURST;
+static time_t tokens_time = 0;
+static time_t flush_time = 0;
+static int log_open = 0;
+
+static time_t now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void logline(const char *name, const char *call, const char *path, unsigned repeated) {
+	if (!log_open) {
+		openlog ("firejail", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_LOCAL1);
+		log_open = 1;
 	}
-#endif
+
+	char rep[64] = "";
+	if (repeated)
+		snprintf(rep, sizeof(rep), ", %u occurrences not reported", repeated);
+
+	if (sandbox_pid_str && sandbox_name_str)
+		syslog (LOG_INFO, "blacklist violation - sandbox %s, name %s, exe %s, syscall %s, path %s%s",
+			sandbox_pid_str, sandbox_name_str, name, call, path, rep);
+	else if (sandbox_pid_str)
+		syslog (LOG_INFO, "blacklist violation - sandbox %s, exe %s, syscall %s, path %s%s",
+			sandbox_pid_str, name, call, path, rep);
+	else
+		syslog (LOG_INFO, "blacklist violation - exe %s, syscall %s, path %s%s",
+			name, call, path, rep);
 }
 
+// called with violation_lock held
+static void flush_violations(const char *name) {
+	unsigned i;
+	for (i = 0; i < TRACELOG_ENTRIES; i++) {
+		if (violation[i].call && violation[i].cnt) {
+			logline(name, violation[i].call, violation[i].path, violation[i].cnt);
+			violation[i].cnt = 0;
+		}
+	}
+	if (violation_overflow) {
+		if (!log_open) {
+			openlog ("firejail", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_LOCAL1);
+			log_open = 1;
+		}
+		syslog (LOG_INFO, "blacklist violation - exe %s, %u more violations not logged", name, violation_overflow);
+		violation_overflow = 0;
+	}
+	flush_time = now();
+}
 
 static void sendlog(const char *name, const char *call, const char *path) {
 	if (!name || !call || !path) {
@@ -239,70 +396,110 @@ static void sendlog(const char *name, const char *call, const char *path) {
 		return;
 	}
 
-	openlog ("firejail", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_LOCAL1);
-	if (sandbox_pid_str && sandbox_name_str)
-		syslog (LOG_INFO, "blacklist violation - sandbox %s, name %s, exe %s, syscall %s, path %s",
-			sandbox_pid_str, sandbox_name_str, name, call, path);
-	else if (sandbox_pid_str)
-		syslog (LOG_INFO, "blacklist violation - sandbox %s, exe %s, syscall %s, path %s",
-			sandbox_pid_str, name, call, path);
+	pthread_mutex_lock(&violation_lock);
+	time_t t = now();
+	if (flush_time == 0)
+		flush_time = t;
+	else if (t - flush_time >= TRACELOG_FLUSH)
+		flush_violations(name);
+
+	// refill the token bucket
+	if (t != tokens_time) {
+		unsigned long refill = (unsigned long) (t - tokens_time) * TRACELOG_RATE;
+		tokens = (refill >= TRACELOG_BURST || tokens + refill >= TRACELOG_BURST) ? TRACELOG_BURST : tokens + refill;
+		tokens_time = t;
+	}
+
+	// find the violation, or the empty slot for it
+	uint32_t h = 5381;
+	const char *ptr;
+	for (ptr = path; *ptr; ptr++)
+		h = ((h << 5) + h) + *ptr;
+	h ^= (uint32_t) (uintptr_t) call;
+	unsigned i = h & (TRACELOG_ENTRIES - 1);
+	unsigned probe;
+	for (probe = 0; probe < TRACELOG_ENTRIES; probe++) {
+		Violation *v = &violation[i];
+		if (v->call == NULL || (v->call == call && strcmp(v->path, path) == 0))
+			break;
+		i = (i + 1) & (TRACELOG_ENTRIES - 1);
+	}
+
+	Violation *v = (probe < TRACELOG_ENTRIES) ? &violation[i] : NULL;
+	if (v && v->call) {
+		// seen before, reported with the next summary
+		v->cnt++;
+	}
+	else if (v && (v->path = strdup(path)) != NULL) {
+		v->call = call;
+		if (tokens) {
+			tokens--;
+			logline(name, call, path, 0);
+		}
+		else
+			v->cnt++;
+	}
 	else
-		syslog (LOG_INFO, "blacklist violation - exe %s, syscall %s, path %s",
-			name, call, path);
-	closelog ();
+		violation_overflow++;
+	pthread_mutex_unlock(&violation_lock);
 }
 
 
 //
-// pid
+// process name, refreshed in the child of fork()
 //
-static pid_t mypid = 0;
-static inline pid_t pid(void) {
-	if (!mypid)
-		mypid = getpid();
-	return mypid;
+#define MAXNAME 16
+static char myname[MAXNAME] = "unknown";
+
+static inline char *name(void) {
+	return myname;
 }
 
-//
-// process name
-//
-#define MAXNAME 16
-static char myname[MAXNAME];
-static int nameinit = 0;
-static char *name(void) {
-	if (!nameinit) {
-
-		// initialize the name of the process based on /proc/PID/comm
-		memset(myname, 0, MAXNAME);
-
-		pid_t p = pid();
-		char *fname;
-		if (asprintf(&fname, "/proc/%u/comm", p) == -1)
-			return "unknown";
-
-		// read file
-		if (!orig_fopen)
-			orig_fopen = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen");
-		FILE *fp  = orig_fopen(fname, "r");
-		if (!fp)
-			return "unknown";
-		if (fgets(myname, MAXNAME, fp) == NULL) {
-			fclose(fp);
-			free(fname);
-			return "unknown";
-		}
+// only async-signal-safe calls, it runs in the child of fork()
+static void read_name(void) {
+	int fd = orig_open("/proc/self/comm", O_RDONLY | O_CLOEXEC, 0);
+	if (fd == -1)
+		return;
+	char buf[MAXNAME];
+	ssize_t len = read(fd, buf, MAXNAME - 1);
+	close(fd);
+	if (len <= 0)
+		return;
+	buf[len] = '\0';
 
-		// clean '\n'
-		char *ptr = strchr(myname, '\n');
-		if (ptr)
-			*ptr = '\0';
+	// clean '\n'
+	char *ptr = strchr(buf, '\n');
+	if (ptr)
+		*ptr = '\0';
+	memcpy(myname, buf, MAXNAME);
+}
 
-		fclose(fp);
-		free(fname);
-		nameinit = 1;
-	}
+static void atfork_child(void) {
+	read_name();
 
-	return myname;
+	// the parent reports its own violations
+	pthread_mutex_init(&violation_lock, NULL);
+	unsigned i;
+	for (i = 0; i < TRACELOG_ENTRIES; i++)
+		violation[i].cnt = 0;
+	violation_overflow = 0;
+}
+
+static void init(void) __attribute__((constructor));
+void init(void) {
+	preload_resolve();
+	read_name();
+	load_blacklist();
+	pthread_atfork(NULL, NULL, atfork_child);
+}
+
+static void fini(void) __attribute__((destructor));
+void fini(void) {
+	pthread_mutex_lock(&violation_lock);
+	flush_violations(name());
+	pthread_mutex_unlock(&violation_lock);
+	if (log_open)
+		closelog ();
 }
 
 //
@@ -310,14 +507,10 @@ static char *name(void) {
 //
 
 // open
-typedef int (*orig_open_t)(const char *pathname, int flags, mode_t mode);
-static orig_open_t orig_open = NULL;
 int open(const char *pathname, int flags, mode_t mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_open)
-		orig_open = (orig_open_t)dlsym(RTLD_NEXT, "open");
 
 	if (!blacklist_loaded)
 		load_blacklist();
@@ -332,14 +525,10 @@ int open(const char *pathname, int flags, mode_t mode) {
 
 
 //#if 0 - todo: fix problems on google-chrome and opera - seems to be crashing when open64 is called
-typedef int (*orig_open64_t)(const char *pathname, int flags, mode_t mode);
-static orig_open64_t orig_open64 = NULL;
 int open64(const char *pathname, int flags, mode_t mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_open64)
-		orig_open64 = (orig_open64_t)dlsym(RTLD_NEXT, "open64");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -352,14 +541,10 @@ int open64(const char *pathname, int flags, mode_t mode) {
 
 
 // openat
-typedef int (*orig_openat_t)(int dirfd, const char *pathname, int flags, mode_t mode);
-static orig_openat_t orig_openat = NULL;
 int openat(int dirfd, const char *pathname, int flags, mode_t mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_openat)
-		orig_openat = (orig_openat_t)dlsym(RTLD_NEXT, "openat");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -369,14 +554,10 @@ int openat(int dirfd, const char *pathname, int flags, mode_t mode) {
 	return rv;
 }
 
-typedef int (*orig_openat64_t)(int dirfd, const char *pathname, int flags, mode_t mode);
-static orig_openat64_t orig_openat64 = NULL;
 int openat64(int dirfd, const char *pathname, int flags, mode_t mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_openat64)
-		orig_openat64 = (orig_openat64_t)dlsym(RTLD_NEXT, "openat64");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -386,14 +567,65 @@ int openat64(int dirfd, const char *pathname, int flags, mode_t mode) {
 	return rv;
 }
 
+// open and openat with _FORTIFY_SOURCE, glibc calls the system call directly
+int __open_2(const char *pathname, int flags) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig___open_2(pathname, flags);
+	return rv;
+}
+
+int __open64_2(const char *pathname, int flags) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig___open64_2(pathname, flags);
+	return rv;
+}
+
+int __openat_2(int dirfd, const char *pathname, int flags) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig___openat_2(dirfd, pathname, flags);
+	return rv;
+}
+
+int __openat64_2(int dirfd, const char *pathname, int flags) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig___openat64_2(dirfd, pathname, flags);
+	return rv;
+}
+
 
 // fopen
 FILE *fopen(const char *pathname, const char *mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_fopen)
-		orig_fopen = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -404,14 +636,10 @@ FILE *fopen(const char *pathname, const char *mode) {
 }
 
 #ifndef fopen64
-typedef FILE *(*orig_fopen64_t)(const char *pathname, const char *mode);
-static orig_fopen64_t orig_fopen64 = NULL;
 FILE *fopen64(const char *pathname, const char *mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_fopen64)
-		orig_fopen64 = (orig_fopen_t)dlsym(RTLD_NEXT, "fopen64");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -424,14 +652,10 @@ FILE *fopen64(const char *pathname, const char *mode) {
 
 
 // freopen
-typedef FILE *(*orig_freopen_t)(const char *pathname, const char *mode, FILE *stream);
-static orig_freopen_t orig_freopen = NULL;
 FILE *freopen(const char *pathname, const char *mode, FILE *stream) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_freopen)
-		orig_freopen = (orig_freopen_t)dlsym(RTLD_NEXT, "freopen");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -442,14 +666,10 @@ FILE *freopen(const char *pathname, const char *mode, FILE *stream) {
 }
 
 #ifndef freopen64
-typedef FILE *(*orig_freopen64_t)(const char *pathname, const char *mode, FILE *stream);
-static orig_freopen64_t orig_freopen64 = NULL;
 FILE *freopen64(const char *pathname, const char *mode, FILE *stream) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_freopen64)
-		orig_freopen64 = (orig_freopen64_t)dlsym(RTLD_NEXT, "freopen64");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -461,14 +681,10 @@ FILE *freopen64(const char *pathname, const char *mode, FILE *stream) {
 #endif
 
 // unlink
-typedef int (*orig_unlink_t)(const char *pathname);
-static orig_unlink_t orig_unlink = NULL;
 int unlink(const char *pathname) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_unlink)
-		orig_unlink = (orig_unlink_t)dlsym(RTLD_NEXT, "unlink");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -478,14 +694,10 @@ int unlink(const char *pathname) {
 	return rv;
 }
 
-typedef int (*orig_unlinkat_t)(int dirfd, const char *pathname, int flags);
-static orig_unlinkat_t orig_unlinkat = NULL;
 int unlinkat(int dirfd, const char *pathname, int flags) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_unlinkat)
-		orig_unlinkat = (orig_unlinkat_t)dlsym(RTLD_NEXT, "unlinkat");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -496,14 +708,10 @@ int unlinkat(int dirfd, const char *pathname, int flags) {
 }
 
 // mkdir/mkdirat/rmdir
-typedef int (*orig_mkdir_t)(const char *pathname, mode_t mode);
-static orig_mkdir_t orig_mkdir = NULL;
 int mkdir(const char *pathname, mode_t mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_mkdir)
-		orig_mkdir = (orig_mkdir_t)dlsym(RTLD_NEXT, "mkdir");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -513,14 +721,10 @@ int mkdir(const char *pathname, mode_t mode) {
 	return rv;
 }
 
-typedef int (*orig_mkdirat_t)(int dirfd, const char *pathname, mode_t mode);
-static orig_mkdirat_t orig_mkdirat = NULL;
 int mkdirat(int dirfd, const char *pathname, mode_t mode) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_mkdirat)
-		orig_mkdirat = (orig_mkdirat_t)dlsym(RTLD_NEXT, "mkdirat");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -530,14 +734,10 @@ int mkdirat(int dirfd, const char *pathname, mode_t mode) {
 	return rv;
 }
 
-typedef int (*orig_rmdir_t)(const char *pathname);
-static orig_rmdir_t orig_rmdir = NULL;
 int rmdir(const char *pathname) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_rmdir)
-		orig_rmdir = (orig_rmdir_t)dlsym(RTLD_NEXT, "rmdir");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -548,14 +748,10 @@ int rmdir(const char *pathname) {
 }
 
 // stat
-typedef int (*orig_stat_t)(const char *pathname, struct stat *buf);
-static orig_stat_t orig_stat = NULL;
 int stat(const char *pathname, struct stat *buf) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_stat)
-		orig_stat = (orig_stat_t)dlsym(RTLD_NEXT, "stat");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -565,33 +761,10 @@ int stat(const char *pathname, struct stat *buf) {
 	return rv;
 }
 
-//#ifndef stat64
-//typedef int (*orig_stat64_t)(const char *pathname, struct stat64 *buf);
-//static orig_stat64_t orig_stat64 = NULL;
-//int stat64(const char *pathname, struct stat64 *buf) {
-//#ifdef DEBUG
-//	printf("%s %s\n", __FUNCTION__, pathname);
-//#endif
-//	if (!orig_stat64)
-//		orig_stat64 = (orig_stat64_t)dlsym(RTLD_NEXT, "stat64");
-//	if (!blacklist_loaded)
-//		load_blacklist();
-//
-//	if (storage_find(pathname))
-//		sendlog(name(), __FUNCTION__, pathname);
-//	int rv = orig_stat64(pathname, buf);
-//	return rv;
-//}
-//#endif
-
-typedef int (*orig_lstat_t)(const char *pathname, struct stat *buf);
-static orig_lstat_t orig_lstat = NULL;
 int lstat(const char *pathname, struct stat *buf) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_lstat)
-		orig_lstat = (orig_lstat_t)dlsym(RTLD_NEXT, "lstat");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -601,34 +774,82 @@ int lstat(const char *pathname, struct stat *buf) {
 	return rv;
 }
 
-//#ifndef lstat64
-//typedef int (*orig_lstat64_t)(const char *pathname, struct stat64 *buf);
-//static orig_lstat64_t orig_lstat64 = NULL;
-//int lstat64(const char *pathname, struct stat64 *buf) {
-//#ifdef DEBUG
-//	printf("%s %s\n", __FUNCTION__, pathname);
-//#endif
-//	if (!orig_lstat64)
-//		orig_lstat64 = (orig_lstat64_t)dlsym(RTLD_NEXT, "lstat64");
-//	if (!blacklist_loaded)
-//		load_blacklist();
-//
-//	if (storage_find(pathname))
-//		sendlog(name(), __FUNCTION__, pathname);
-//	int rv = orig_lstat64(pathname, buf);
-//	return rv;
-//}
-//#endif
+// fstatat, the newfstatat system call
+int fstatat(int dirfd, const char *pathname, struct stat *buf, int flags) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig_fstatat(dirfd, pathname, buf, flags);
+	return rv;
+}
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+int stat64(const char *pathname, struct stat64 *buf) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig_stat64(pathname, buf);
+	return rv;
+}
+
+int lstat64(const char *pathname, struct stat64 *buf) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig_lstat64(pathname, buf);
+	return rv;
+}
+
+int fstatat64(int dirfd, const char *pathname, struct stat64 *buf, int flags) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig_fstatat64(dirfd, pathname, buf, flags);
+	return rv;
+}
+#endif
+
+#ifdef STATX_TYPE
+// statx
+int statx(int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *buf) {
+#ifdef DEBUG
+	printf("%s %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig_statx(dirfd, pathname, flags, mask, buf);
+	return rv;
+}
+#endif
 
 // access
-typedef int (*orig_access_t)(const char *pathname, int mode);
-static orig_access_t orig_access = NULL;
 int access(const char *pathname, int mode) {
 #ifdef DEBUG
 	printf("%s, %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_access)
-		orig_access = (orig_access_t)dlsym(RTLD_NEXT, "access");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -638,15 +859,25 @@ int access(const char *pathname, int mode) {
 	return rv;
 }
 
+// faccessat, the faccessat2 system call when flags are set
+int faccessat(int dirfd, const char *pathname, int mode, int flags) {
+#ifdef DEBUG
+	printf("%s, %s\n", __FUNCTION__, pathname);
+#endif
+	if (!blacklist_loaded)
+		load_blacklist();
+
+	if (storage_find(pathname))
+		sendlog(name(), __FUNCTION__, pathname);
+	int rv = orig_faccessat(dirfd, pathname, mode, flags);
+	return rv;
+}
+
 // opendir
-typedef DIR *(*orig_opendir_t)(const char *pathname);
-static orig_opendir_t orig_opendir = NULL;
 DIR *opendir(const char *pathname) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_opendir)
-		orig_opendir = (orig_opendir_t)dlsym(RTLD_NEXT, "opendir");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -657,14 +888,10 @@ DIR *opendir(const char *pathname) {
 }
 
 // chdir
-typedef int (*orig_chdir_t)(const char *pathname);
-static orig_chdir_t orig_chdir = NULL;
 int chdir(const char *pathname) {
 #ifdef DEBUG
 	printf("%s %s\n", __FUNCTION__, pathname);
 #endif
-	if (!orig_chdir)
-		orig_chdir = (orig_chdir_t)dlsym(RTLD_NEXT, "chdir");
 	if (!blacklist_loaded)
 		load_blacklist();
 
@@ -679,14 +906,10 @@ int chdir(const char *pathname) {
 }
 
 // fchdir
-typedef int (*orig_fchdir_t)(int fd);
-static orig_fchdir_t orig_fchdir = NULL;
 int fchdir(int fd) {
 #ifdef DEBUG
 	printf("%s %d\n", __FUNCTION__, fd);
 #endif
-	if (!orig_fchdir)
-		orig_fchdir = (orig_fchdir_t)dlsym(RTLD_NEXT, "fchdir");
 
 	free(cwd);
 	char *pathname=malloc(PATH_MAX);
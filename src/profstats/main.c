@@ -19,37 +19,52 @@
 */
 
 #include "../include/common.h"
+#include "../include/etc_groups.h"
+#include "../include/profile_bundle.h"
+#include "../include/seccomp_store.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <ftw.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
 
 #define MAXBUF 2048
+#define MAX_THREADS 64
+
 // stats
-static int cnt_profiles = 0;
-static int cnt_apparmor = 0;
-static int cnt_seccomp = 0;
-static int cnt_restrict_namespaces = 0;
-static int cnt_caps = 0;
-static int cnt_dbus_system_none = 0;
-static int cnt_dbus_user_none = 0;
-static int cnt_dbus_system_filter = 0;
-static int cnt_dbus_user_filter = 0;
-static int cnt_dotlocal = 0;
-static int cnt_globalsdotlocal = 0;
-static int cnt_netnone = 0;
-static int cnt_noexec = 0;	// include disable-exec.inc
-static int cnt_privatebin = 0;
-static int cnt_privatedev = 0;
-static int cnt_privatetmp = 0;
-static int cnt_privateetc = 0;
-static int cnt_privatecache = 0;
-static int cnt_privatelib = 0;
-static int cnt_whitelistvar = 0;	// include whitelist-var-common.inc
-static int cnt_whitelistrunuser = 0;	// include whitelist-runuser-common.inc
-static int cnt_whitelistusrshare = 0;	// include whitelist-usr-share-common.inc
-static int cnt_ssh = 0;
-static int cnt_mdwx = 0;
-static int cnt_whitelisthome = 0;
-static int cnt_noroot = 0;
-
-static int level = 0;
+typedef struct {
+	int profiles;
+	int apparmor;
+	int seccomp;
+	int restrict_namespaces;
+	int caps;
+	int dbus_system_none;
+	int dbus_user_none;
+	int dbus_system_filter;
+	int dbus_user_filter;
+	int dotlocal;
+	int globalsdotlocal;
+	int netnone;
+	int noexec;		// include disable-exec.inc
+	int privatebin;
+	int privatedev;
+	int privatetmp;
+	int privateetc;
+	int privatecache;
+	int privatelib;
+	int whitelistvar;	// include whitelist-var-common.inc
+	int whitelistrunuser;	// include whitelist-runuser-common.inc
+	int whitelistusrshare;	// include whitelist-usr-share-common.inc
+	int ssh;
+	int mdwx;
+	int whitelisthome;
+	int noroot;
+} Counters;
+static Counters total;
+
 static int arg_debug = 0;
 static int arg_apparmor = 0;
 static int arg_caps = 0;
@@ -74,8 +89,10 @@ static int arg_noroot = 0;
 static int arg_print_blacklist = 0;
 static int arg_print_whitelist = 0;
 static int arg_restrict_namespaces = 0;
-
-static char *profile = NULL;
+static int arg_estimate_cost = 0;
+static int arg_seccomp_store = 0;
+static int arg_jsonl = 0;
+static long arg_jobs = 1;
 
 static const char *const usage_str =
 	"profstats - print profile statistics\n"
@@ -103,119 +120,1361 @@ static const char *const usage_str =
 	"   --whitelist-var - print profiles without \"include whitelist-var-common.inc\"\n"
 	"   --whitelist-runuser - print profiles without \"include whitelist-runuser-common.inc\" or \"blacklist ${RUNUSER}\"\n"
 	"   --whitelist-usrshare - print profiles without \"include whitelist-usr-share-common.inc\"\n"
+	"   --estimate-cost - rank profiles by the mounts and copies they generate\n"
+	"\ton this host\n"
+	"   --format=jsonl - print a JSON object for each profile\n"
+	"   --parallel[=number] - process the profiles in parallel, by default in as\n"
+	"\tmany threads as CPUs\n"
+	"   --bundle=file directory - store the profiles found in directory\n"
+	"\tin a profile bundle file\n"
+	"   --seccomp-store=file directory - build the seccomp filters used by the\n"
+	"\tprofiles found in directory and store them in file; fseccomp and\n"
+	"\tfsec-optimize are run from the directory of file\n"
 	"   --debug\n";
 
 static void usage(void) {
 	puts(usage_str);
 }
 
-static void process_file(char *fname) {
-	assert(fname);
-	char *tmpfname = NULL;
+//*******************************************
+// startup cost estimation
+//*******************************************
+// The commands are collected while the include tree is walked and evaluated
+// once the profile is complete, since noblacklist and nowhitelist apply
+// regardless of their position in the profile. The paths are expanded on the
+// current host and filtered the way the sandbox would see them: files dropped
+// by private-bin, private-etc or a whitelisted top-level directory are not
+// mounted, and neither are the paths under an already blacklisted directory.
+typedef struct {
+	char *name;
+	int mounts;		// expected mount operations
+	int blacklist;		// blacklist, blacklist-nolog
+	int whitelist;		// whitelist, whitelist-ro, including the top-level tmpfs
+	int remount;		// read-only, read-write, noexec, tmpfs
+	int private;		// private-* options
+	int globs;		// wildcard patterns expanded
+	int unresolved;		// macros not expanded by profstats
+	unsigned long long bytes;	// bytes copied by private-bin, private-etc, private-opt, private-srv
+} Cost;
 
-	if (arg_debug)
-		printf("processing #%s#\n", fname);
-	level++;
-	assert(level < 32); // to do - check in firejail code
+typedef struct {
+	char **s;
+	int cnt;
+	int max;
+} StrList;
+
+static Cost *costs = NULL;
+static int costs_cnt = 0;
+static int costs_max = 0;
+
+// the seccomp commands with a syscall list, as firejail passes them to fseccomp
+enum {
+	SC_DEFAULT = 0,	// seccomp list
+	SC_DEFAULT32,	// seccomp.32 list
+	SC_DROP,	// seccomp.drop list
+	SC_DROP32,	// seccomp.32.drop list
+	SC_KEEP,	// seccomp.keep list
+	SC_KEEP32,	// seccomp.32.keep list
+	SC_MAX
+};
+
+static const struct {
+	const char *line;	// profile command, followed by a space
+	const char *command;	// command in the filter specification
+} sc_commands[SC_MAX] = {
+	[SC_DEFAULT] = { "seccomp", "default" },
+	[SC_DEFAULT32] = { "seccomp.32", "default32" },
+	[SC_DROP] = { "seccomp.drop", "drop" },
+	[SC_DROP32] = { "seccomp.32.drop", "drop32" },
+	[SC_KEEP] = { "seccomp.keep", "keep" },
+	[SC_KEEP32] = { "seccomp.32.keep", "keep32" },
+};
+
+// a profile and the files it includes, processed in a single thread; the
+// messages are printed once all the profiles before it are printed
+typedef struct {
+	char *name;
+	int level;
+	Counters cnt;
+	Cost cost;
+	StrList cost_lines;
+	StrList inc_seen;	// .inc files are read only once, as in firejail
+	StrList warnings;	// for --format=jsonl
+	char *seccomp[SC_MAX];	// for --seccomp-store, the last list of each command
+	FILE *out;
+	char *outbuf;
+	size_t outlen;
+	FILE *err;
+	char *errbuf;
+	size_t errlen;
+} Profile;
+
+// The results of the file reads, glob() and realpath() calls are shared by
+// all the profiles: the entries are loaded on first use and never removed.
+// The lock is not held while an entry is loaded; if two threads load the
+// same entry, the first one stored is kept.
+typedef struct CacheEntry {
+	struct CacheEntry *next;
+	char *key;
+	void *data;
+} CacheEntry;
+
+#define CACHE_SIZE 4096
+typedef struct {
+	CacheEntry *bucket[CACHE_SIZE];
+	pthread_mutex_t mutex;
+	void *(*load)(const char *key);
+	void (*free)(void *data);
+} Cache;
+
+static unsigned cache_hash(const char *str) {
+	unsigned hash = 5381;
+	while (*str)
+		hash = hash * 33 + (unsigned char) *str++;
+	return hash % CACHE_SIZE;
+}
+
+static void *cache_find(Cache *c, unsigned h, const char *key) {
+	CacheEntry *e = c->bucket[h];
+	while (e && strcmp(e->key, key) != 0)
+		e = e->next;
+	return (e) ? e->data : NULL;
+}
+
+static void *cache_get(Cache *c, const char *key) {
+	unsigned h = cache_hash(key);
+	pthread_mutex_lock(&c->mutex);
+	void *data = cache_find(c, h, key);
+	pthread_mutex_unlock(&c->mutex);
+	if (data)
+		return data;
+
+	void *loaded = c->load(key);
+	pthread_mutex_lock(&c->mutex);
+	data = cache_find(c, h, key);
+	if (!data) {
+		CacheEntry *e = malloc(sizeof(CacheEntry));
+		if (!e)
+			errExit("malloc");
+		e->key = strdup(key);
+		if (!e->key)
+			errExit("strdup");
+		e->data = data = loaded;
+		e->next = c->bucket[h];
+		c->bucket[h] = e;
+		loaded = NULL;
+	}
+	pthread_mutex_unlock(&c->mutex);
+	if (loaded)
+		c->free(loaded);
+	return data;
+}
+
+// the matches of a pattern, and the paths with the symlinks resolved
+typedef struct {
+	char **paths;
+	char **real;		// NULL if realpath() failed
+	size_t cnt;
+} GlobResult;
+
+static void *glob_load(const char *pattern) {
+	GlobResult *g = calloc(1, sizeof(GlobResult));
+	if (!g)
+		errExit("calloc");
+	glob_t gl;
+	if (glob(pattern, GLOB_NOSORT, NULL, &gl) != 0)
+		return g;
+
+	g->paths = calloc(gl.gl_pathc, sizeof(char *));
+	g->real = calloc(gl.gl_pathc, sizeof(char *));
+	if (!g->paths || !g->real)
+		errExit("calloc");
+	for (g->cnt = 0; g->cnt < gl.gl_pathc; g->cnt++) {
+		g->paths[g->cnt] = strdup(gl.gl_pathv[g->cnt]);
+		if (!g->paths[g->cnt])
+			errExit("strdup");
+		g->real[g->cnt] = realpath(gl.gl_pathv[g->cnt], NULL);
+	}
+	globfree(&gl);
+	return g;
+}
+
+static void glob_free(void *data) {
+	GlobResult *g = data;
+	size_t i;
+	for (i = 0; i < g->cnt; i++) {
+		free(g->paths[i]);
+		free(g->real[i]);
+	}
+	free(g->paths);
+	free(g->real);
+	free(g);
+}
+
+static Cache glob_cache = { { NULL }, PTHREAD_MUTEX_INITIALIZER, glob_load, glob_free };
+
+static const char *const bin_dirs[] = {
+	"/usr/local/bin",
+	"/usr/bin",
+	"/bin",
+	"/usr/games",
+	"/usr/local/games",
+	"/usr/local/sbin",
+	"/usr/sbin",
+	"/sbin",
+	NULL
+};
+#define BIN_DIRS_CNT (sizeof(bin_dirs) / sizeof(bin_dirs[0]) - 1)
+
+static void strlist_add(StrList *l, const char *str) {
+	if (l->cnt == l->max) {
+		l->max = (l->max) ? l->max * 2 : 64;
+		l->s = realloc(l->s, l->max * sizeof(char *));
+		if (!l->s)
+			errExit("realloc");
+	}
+	l->s[l->cnt] = strdup(str);
+	if (!l->s[l->cnt])
+		errExit("strdup");
+	l->cnt++;
+}
+
+static int strlist_find(const StrList *l, const char *str) {
+	int i;
+	for (i = 0; i < l->cnt; i++)
+		if (strcmp(l->s[i], str) == 0)
+			return 1;
+	return 0;
+}
+
+static void strlist_add_unique(StrList *l, const char *str) {
+	if (*str != '\0' && !strlist_find(l, str))
+		strlist_add(l, str);
+}
+
+static void strlist_add_group(StrList *l, char **group) {
+	while (*group) {
+		strlist_add_unique(l, *group);
+		group++;
+	}
+}
+
+static void strlist_free(StrList *l) {
+	int i;
+	for (i = 0; i < l->cnt; i++)
+		free(l->s[i]);
+	free(l->s);
+	l->s = NULL;
+	l->cnt = 0;
+	l->max = 0;
+}
+
+static int strlist_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// return 1 if the .inc file was already processed for this profile
+static int cost_inc_seen(Profile *p, const char *fname) {
+	const char *base = strrchr(fname, '/');
+	base = (base) ? base + 1 : fname;
+	size_t len = strlen(base);
+	if (len < 4 || strcmp(base + len - 4, ".inc") != 0)
+		return 0;
+
+	if (strlist_find(&p->inc_seen, base))
+		return 1;
+	strlist_add(&p->inc_seen, base);
+	return 0;
+}
+
+// return 1 if path is dir or a file under dir
+static int path_under(const char *path, const char *dir) {
+	size_t len = strlen(dir);
+	if (strncmp(path, dir, len) != 0)
+		return 0;
+	return path[len] == '\0' || path[len] == '/' || (len == 1 && *dir == '/');
+}
+
+// expand the macros in a path and add the result to the list; ${PATH}
+// produces one pattern for every directory in bin_dirs.
+// Return -1 if the path uses a macro profstats does not know about.
+static int cost_expand(const char *path, StrList *out) {
+	const char *home = getenv("HOME");
+	if (!home)
+		home = "/";
+	const char *prefix = "";
+	const char *rest = path;
+	char runuser[64];
+	char *str;
+
+	if (strncmp(path, "${PATH}", 7) == 0) {
+		int i;
+		for (i = 0; bin_dirs[i]; i++) {
+			if (asprintf(&str, "%s%s", bin_dirs[i], path + 7) == -1)
+				errExit("asprintf");
+			strlist_add(out, str);
+			free(str);
+		}
+		return 0;
+	}
+
+	if (strncmp(path, "${HOME}", 7) == 0) {
+		prefix = home;
+		rest = path + 7;
+	}
+	else if (*path == '~') {
+		prefix = home;
+		rest = path + 1;
+	}
+	else if (strncmp(path, "${CFG}", 6) == 0) {
+		prefix = SYSCONFDIR;
+		rest = path + 6;
+	}
+	else if (strncmp(path, "${RUNUSER}", 10) == 0) {
+		snprintf(runuser, sizeof(runuser), "/run/user/%d", (int) getuid());
+		prefix = runuser;
+		rest = path + 10;
+	}
+
+	if (strstr(rest, "${"))
+		return -1;
+	if (asprintf(&str, "%s%s", prefix, rest) == -1)
+		errExit("asprintf");
+	strlist_add(out, str);
+	free(str);
+	return 0;
+}
+
+// expand the arguments of the lines starting with cmd, once for every profile
+static void cost_excl_patterns(const Profile *p, const char *cmd, StrList *out) {
+	size_t len = strlen(cmd);
+	int i;
+	for (i = 0; i < p->cost_lines.cnt; i++) {
+		const char *line = p->cost_lines.s[i];
+		if (strncmp(line, cmd, len) == 0 && line[len] == ' ')
+			cost_expand(line + len + 1, out);
+	}
+}
+
+// return 1 if the path is matched by one of the patterns
+static int cost_excluded(const StrList *excl, const char *path) {
+	int i;
+	for (i = 0; i < excl->cnt; i++)
+		if (fnmatch(excl->s[i], path, 0) == 0)
+			return 1;
+	return 0;
+}
+
+typedef struct {
+	StrList etc;		// private-etc files
+	StrList bin;		// private-bin programs
+	StrList wl;		// whitelisted paths
+	StrList top;		// whitelisted top-level directories
+	StrList bin_real;	// bin_dirs, with and without the symlinks resolved
+	int have_etc;
+	int have_bin;
+} CostView;
+
+// return 1 if the path is still present in the sandbox when the blacklists are applied
+static int cost_visible(const CostView *v, const char *path) {
+	int i;
+	if (v->have_etc && strncmp(path, "/etc/", 5) == 0) {
+		const char *name = path + 5;
+		size_t len = strcspn(name, "/");
+		for (i = 0; i < v->etc.cnt; i++)
+			if (strlen(v->etc.s[i]) == len && strncmp(v->etc.s[i], name, len) == 0)
+				break;
+		if (i == v->etc.cnt)
+			return 0;
+	}
+
+	if (v->have_bin) {
+		for (i = 0; i < v->bin_real.cnt; i++) {
+			const char *dir = v->bin_real.s[i];
+			size_t len = strlen(dir);
+			if (strncmp(path, dir, len) == 0 && path[len] == '/') {
+				const char *name = path + len + 1;
+				if (strchr(name, '/') || !strlist_find(&v->bin, name))
+					return 0;
+				break;
+			}
+		}
+	}
 
+	for (i = 0; i < v->top.cnt; i++) {
+		if (!path_under(path, v->top.s[i]) || strcmp(path, v->top.s[i]) == 0)
+			continue;
+		// only the whitelisted files and their parent directories are left
+		int j;
+		for (j = 0; j < v->wl.cnt; j++)
+			if (path_under(path, v->wl.s[j]) || path_under(v->wl.s[j], path))
+				return 1;
+		return 0;
+	}
+	return 1;
+}
+
+// add the existing paths matching the argument of a command to the list, resolving symlinks
+// excl: the patterns of the lines cancelling the command (noblacklist, nowhitelist), or NULL
+// view: if not NULL, the matches not present in the sandbox are dropped
+// raw: if not NULL, the matches are also stored here without resolving the symlinks
+static void cost_match(Profile *p, const char *arg, const StrList *excl, const CostView *view, StrList *out, StrList *raw) {
+	Cost *c = &p->cost;
+	StrList pat = { NULL, 0, 0 };
+	if (cost_expand(arg, &pat) == -1) {
+		c->unresolved++;
+		return;
+	}
+	if (strpbrk(arg, "*?["))
+		c->globs++;
+
+	int i;
+	for (i = 0; i < pat.cnt; i++) {
+		const GlobResult *g = cache_get(&glob_cache, pat.s[i]);
+		size_t j;
+		for (j = 0; j < g->cnt; j++) {
+			if (excl && cost_excluded(excl, g->paths[j]))
+				continue;
+			if (view && !cost_visible(view, g->paths[j]))
+				continue;
+			if (g->real[j]) {
+				strlist_add_unique(out, g->real[j]);
+				if (raw)
+					strlist_add_unique(raw, g->paths[j]);
+			}
+		}
+	}
+	strlist_free(&pat);
+}
+
+static __thread unsigned long long du_bytes;	// nftw() has no callback argument
+
+static int du_cb(const char *fpath, const struct stat *s, int type, struct FTW *ftw) {
+	(void) fpath;
+	(void) type;
+	(void) ftw;
+	if (S_ISREG(s->st_mode))
+		du_bytes += s->st_size;
+	return 0;
+}
+
+// bytes copied for a file or a directory tree
+static void *du_load(const char *path) {
+	unsigned long long *bytes = malloc(sizeof(unsigned long long));
+	if (!bytes)
+		errExit("malloc");
+	*bytes = 0;
+
+	struct stat s;
+	if (stat(path, &s) == -1)
+		return bytes;
+	if (S_ISREG(s.st_mode))
+		*bytes = s.st_size;
+	else if (S_ISDIR(s.st_mode)) {
+		du_bytes = 0;
+		nftw(path, du_cb, 32, FTW_PHYS);
+		*bytes = du_bytes;
+	}
+	return bytes;
+}
+
+static Cache du_cache = { { NULL }, PTHREAD_MUTEX_INITIALIZER, du_load, free };
+
+static unsigned long long cost_du(const char *path) {
+	return *(unsigned long long *) cache_get(&du_cache, path);
+}
+
+// add the names in a comma-separated private-* list
+static void cost_list_parse(StrList *l, const char *str, int etc) {
+	char *dup = strdup(str);
+	if (!dup)
+		errExit("strdup");
+	char *saveptr;
+	char *tok = strtok_r(dup, ",", &saveptr);
+	while (tok) {
+		while (*tok == ' ' || *tok == '\t')
+			tok++;
+		char *end = tok + strlen(tok);
+		while (end > tok && (end[-1] == ' ' || end[-1] == '\t'))
+			*--end = '\0';
+		if (etc && strncmp(tok, "/etc/", 5) == 0)
+			tok += 5;
+
+		if (etc && *tok == '@') {
+			if (strcmp(tok, "@games") == 0)
+				strlist_add_group(l, etc_group_games);
+			else if (strcmp(tok, "@network") == 0)
+				strlist_add_group(l, etc_group_network);
+			else if (strcmp(tok, "@sound") == 0)
+				strlist_add_group(l, etc_group_sound);
+			else if (strcmp(tok, "@tls-ca") == 0)
+				strlist_add_group(l, etc_group_tls_ca);
+			else if (strcmp(tok, "@x11") == 0)
+				strlist_add_group(l, etc_group_x11);
+		}
+		else
+			strlist_add_unique(l, tok);
+		tok = strtok_r(NULL, ",", &saveptr);
+	}
+	free(dup);
+}
+
+static int cost_cmd(const char *line, const char *cmd, const char **arg) {
+	size_t len = strlen(cmd);
+	if (strncmp(line, cmd, len) != 0)
+		return 0;
+	if (line[len] == '\0') {
+		*arg = line + len;
+		return 1;
+	}
+	if (line[len] != ' ')
+		return 0;
+	*arg = line + len + 1;
+	return 1;
+}
+
+// sort the paths and count them, skipping the ones under a directory already counted
+static int cost_count(Profile *p, StrList *l) {
+	qsort(l->s, l->cnt, sizeof(char *), strlist_cmp);
+	int cnt = 0;
+	const char *last = NULL;
+	int i;
+	for (i = 0; i < l->cnt; i++) {
+		if (last && path_under(l->s[i], last))
+			continue;
+		last = l->s[i];
+		cnt++;
+		if (arg_debug)
+			fprintf(p->out, "mount %s\n", last);
+	}
+	return cnt;
+}
+
+static void cost_evaluate(Profile *p) {
+	Cost *c = &p->cost;
+	CostView v;
+	memset(&v, 0, sizeof(v));
+	StrList bl = { NULL, 0, 0 };
+	StrList rm = { NULL, 0, 0 };
+	StrList opt = { NULL, 0, 0 };
+	StrList srv = { NULL, 0, 0 };
+	StrList wl_raw = { NULL, 0, 0 };
+	StrList nowl = { NULL, 0, 0 };
+	StrList nobl = { NULL, 0, 0 };
+	int have_opt = 0, have_srv = 0;
+	const char *home = getenv("HOME");
+	char *path;
+	int i;
+
+	cost_excl_patterns(p, "nowhitelist", &nowl);
+	cost_excl_patterns(p, "noblacklist", &nobl);
+
+	// private-* options and whitelists define what is left in the sandbox
+	for (i = 0; i < p->cost_lines.cnt; i++) {
+		const char *line = p->cost_lines.s[i];
+		const char *arg;
+
+		if (cost_cmd(line, "whitelist", &arg) ||
+		    cost_cmd(line, "whitelist-ro", &arg))
+			cost_match(p, arg, &nowl, NULL, &v.wl, &wl_raw);
+		else if (cost_cmd(line, "private-etc", &arg)) {
+			if (!v.have_etc)
+				strlist_add_group(&v.etc, etc_list);
+			v.have_etc = 1;
+			cost_list_parse(&v.etc, arg, 1);
+		}
+		else if (cost_cmd(line, "private-bin", &arg)) {
+			v.have_bin = 1;
+			cost_list_parse(&v.bin, arg, 0);
+		}
+		else if (cost_cmd(line, "private-opt", &arg)) {
+			have_opt = 1;
+			cost_list_parse(&opt, arg, 0);
+		}
+		else if (cost_cmd(line, "private-srv", &arg)) {
+			have_srv = 1;
+			cost_list_parse(&srv, arg, 0);
+		}
+		else if (strncmp(line, "private", 7) == 0)
+			c->private++;
+	}
+
+	// every whitelisted top-level directory is mounted on a tmpfs first;
+	// the top-level directories are extracted as in fs_whitelist.c
+	char runuser[64];
+	snprintf(runuser, sizeof(runuser), "/run/user/%d", (int) getuid());
+	for (i = 0; i < wl_raw.cnt; i++) {
+		char *t = strdup(wl_raw.s[i]);
+		if (!t)
+			errExit("strdup");
+		char *s = NULL;
+		if (home && strcmp(home, "/") != 0 && path_under(t, home))
+			s = t + strlen(home);
+		else if (path_under(t, runuser))
+			s = t + strlen(runuser);
+		else if (strncmp(t, "/sys/module/", 12) == 0)
+			s = t + 11;
+		else if (strncmp(t, "/usr/", 5) == 0)
+			s = strchr(t + 5, '/');
+		else
+			s = strchr(t + 1, '/');
+		if (s)
+			*s = '\0';
+		strlist_add_unique(&v.top, t);
+		free(t);
+		// symlinked whitelists are checked against their unresolved path too
+		strlist_add_unique(&v.wl, wl_raw.s[i]);
+	}
+	c->whitelist = wl_raw.cnt + v.top.cnt;
+	strlist_free(&wl_raw);
+
+	if (v.have_bin) {
+		for (i = 0; bin_dirs[i]; i++) {
+			char *rp = realpath(bin_dirs[i], NULL);
+			if (rp) {
+				strlist_add_unique(&v.bin_real, rp);
+				free(rp);
+			}
+		}
+		// the copies are mounted over every bin directory present
+		c->private += v.bin_real.cnt;
+		for (i = 0; bin_dirs[i]; i++)
+			strlist_add_unique(&v.bin_real, bin_dirs[i]);
+		for (i = 0; i < v.bin.cnt; i++) {
+			size_t j;
+			for (j = 0; j < BIN_DIRS_CNT; j++) {
+				if (asprintf(&path, "%s/%s", bin_dirs[j], v.bin.s[i]) == -1)
+					errExit("asprintf");
+				unsigned long long b = cost_du(path);
+				free(path);
+				if (b) {
+					c->bytes += b;
+					break;
+				}
+			}
+		}
+	}
+	if (v.have_etc) {
+		c->private++;
+		for (i = 0; i < v.etc.cnt; i++) {
+			if (asprintf(&path, "/etc/%s", v.etc.s[i]) == -1)
+				errExit("asprintf");
+			c->bytes += cost_du(path);
+			free(path);
+		}
+	}
+	if (have_opt) {
+		c->private++;
+		for (i = 0; i < opt.cnt; i++) {
+			if (asprintf(&path, "/opt/%s", opt.s[i]) == -1)
+				errExit("asprintf");
+			c->bytes += cost_du(path);
+			free(path);
+		}
+	}
+	if (have_srv) {
+		c->private++;
+		for (i = 0; i < srv.cnt; i++) {
+			if (asprintf(&path, "/srv/%s", srv.s[i]) == -1)
+				errExit("asprintf");
+			c->bytes += cost_du(path);
+			free(path);
+		}
+	}
+
+	// blacklists and remounts on what is left
+	for (i = 0; i < p->cost_lines.cnt; i++) {
+		const char *line = p->cost_lines.s[i];
+		const char *arg;
+
+		if (cost_cmd(line, "blacklist", &arg) ||
+		    cost_cmd(line, "blacklist-nolog", &arg))
+			cost_match(p, arg, &nobl, &v, &bl, NULL);
+		else if (cost_cmd(line, "read-only", &arg) ||
+			 cost_cmd(line, "read-write", &arg) ||
+			 cost_cmd(line, "noexec", &arg) ||
+			 cost_cmd(line, "tmpfs", &arg))
+			cost_match(p, arg, NULL, &v, &rm, NULL);
+	}
+
+	c->blacklist = cost_count(p, &bl);
+	c->remount = rm.cnt;
+	c->mounts = c->blacklist + c->whitelist + c->remount + c->private;
+
+	strlist_free(&bl);
+	strlist_free(&rm);
+	strlist_free(&nowl);
+	strlist_free(&nobl);
+	strlist_free(&opt);
+	strlist_free(&srv);
+	strlist_free(&v.etc);
+	strlist_free(&v.bin);
+	strlist_free(&v.wl);
+	strlist_free(&v.top);
+	strlist_free(&v.bin_real);
+}
+
+static void cost_profile(Profile *p) {
+	p->cost.name = p->name;
+	cost_evaluate(p);
+	strlist_free(&p->cost_lines);
+	strlist_free(&p->inc_seen);
+}
+
+static void cost_add(const Cost *c) {
+	if (costs_cnt == costs_max) {
+		costs_max = (costs_max) ? costs_max * 2 : 64;
+		costs = realloc(costs, costs_max * sizeof(Cost));
+		if (!costs)
+			errExit("realloc");
+	}
+	costs[costs_cnt++] = *c;
+}
+
+static int cost_cmp(const void *a, const void *b) {
+	const Cost *c1 = a;
+	const Cost *c2 = b;
+	if (c1->mounts != c2->mounts)
+		return (c1->mounts < c2->mounts) ? 1 : -1;
+	if (c1->bytes != c2->bytes)
+		return (c1->bytes < c2->bytes) ? 1 : -1;
+	return strcmp(c1->name, c2->name);
+}
+
+static void print_json_cost(const Cost *c);
+
+static void cost_print(void) {
+	qsort(costs, costs_cnt, sizeof(Cost), cost_cmp);
+	if (arg_jsonl) {
+		int i;
+		for (i = 0; i < costs_cnt; i++)
+			print_json_cost(&costs[i]);
+		return;
+	}
+
+	printf("%-8s %-8s %-8s %-8s %-8s %-6s %-10s %s\n",
+	       "mounts", "blist", "wlist", "remount", "private", "globs", "copy-KiB", "profile");
+	int i;
+	for (i = 0; i < costs_cnt; i++) {
+		Cost *c = &costs[i];
+		printf("%-8d %-8d %-8d %-8d %-8d %-6d %-10llu %s",
+		       c->mounts, c->blacklist, c->whitelist, c->remount, c->private,
+		       c->globs, c->bytes / 1024, c->name);
+		if (c->unresolved)
+			printf(" (%d unresolved)", c->unresolved);
+		printf("\n");
+	}
+}
+
+//*******************************************
+// profile bundle
+//*******************************************
+static int bundle_name_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static int bundle_wanted(const char *name) {
+	size_t len = strlen(name);
+	return (len > 8 && strcmp(name + len - 8, ".profile") == 0) ||
+	       (len > 4 && strcmp(name + len - 4, ".inc") == 0) ||
+	       (len > 6 && strcmp(name + len - 6, ".local") == 0);
+}
+
+static void bundle_write(int fd, const void *buf, size_t len, const char *fname) {
+	const char *ptr = buf;
+	while (len) {
+		ssize_t rv = write(fd, ptr, len);
+		if (rv == -1) {
+			fprintf(stderr, "Error: cannot write %s\n", fname);
+			exit(1);
+		}
+		ptr += rv;
+		len -= rv;
+	}
+}
+
+// build a profile bundle with the .profile, .inc and .local files in dir
+static int bundle_build(const char *out, const char *dir) {
+	// the directory is checked before the files are read; a change while
+	// the files are read invalidates the bundle
+	struct stat sdir;
+	if (stat(dir, &sdir) == -1 || !S_ISDIR(sdir.st_mode)) {
+		fprintf(stderr, "Error: cannot access directory %s\n", dir);
+		return 1;
+	}
+
+	DIR *d = opendir(dir);
+	if (!d) {
+		fprintf(stderr, "Error: cannot open directory %s\n", dir);
+		return 1;
+	}
+	StrList names = { NULL, 0, 0 };
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL)
+		if (bundle_wanted(entry->d_name))
+			strlist_add(&names, entry->d_name);
+	closedir(d);
+	qsort(names.s, names.cnt, sizeof(char *), bundle_name_cmp);
+
+	// read the files
+	char **data = calloc(names.cnt ? names.cnt : 1, sizeof(char *));
+	uint32_t *len = calloc(names.cnt ? names.cnt : 1, sizeof(uint32_t));
+	if (!data || !len)
+		errExit("calloc");
+	int i;
+	for (i = 0; i < names.cnt; i++) {
+		char *fname;
+		if (asprintf(&fname, "%s/%s", dir, names.s[i]) == -1)
+			errExit("asprintf");
+		FILE *fp = fopen(fname, "r");
+		struct stat s;
+		if (!fp || fstat(fileno(fp), &s) == -1 || !S_ISREG(s.st_mode) || s.st_size > 0x1000000) {
+			fprintf(stderr, "Error: cannot read %s\n", fname);
+			return 1;
+		}
+		data[i] = malloc(s.st_size + 1);
+		if (!data[i])
+			errExit("malloc");
+		len[i] = fread(data[i], 1, s.st_size, fp);
+		fclose(fp);
+		free(fname);
+	}
+
+	// header, index, names, data
+	ProfileBundleHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PROFILE_BUNDLE_MAGIC, sizeof(hdr.magic));
+	hdr.version = PROFILE_BUNDLE_VERSION;
+	hdr.count = names.cnt;
+	hdr.dir_dev = sdir.st_dev;
+	hdr.dir_ino = sdir.st_ino;
+	hdr.dir_mtime_sec = sdir.st_mtim.tv_sec;
+	hdr.dir_mtime_nsec = sdir.st_mtim.tv_nsec;
+
+	ProfileBundleEntry *index = calloc(names.cnt ? names.cnt : 1, sizeof(ProfileBundleEntry));
+	if (!index)
+		errExit("calloc");
+	uint64_t off = sizeof(hdr) + (uint64_t) names.cnt * sizeof(ProfileBundleEntry);
+	for (i = 0; i < names.cnt; i++) {
+		index[i].name_off = off;
+		off += strlen(names.s[i]) + 1;
+	}
+	for (i = 0; i < names.cnt; i++) {
+		index[i].data_off = off;
+		index[i].data_len = len[i];
+		off += len[i];
+	}
+	if (off > UINT32_MAX) {
+		fprintf(stderr, "Error: the profile bundle is too large\n");
+		return 1;
+	}
+
+	char *tmp;
+	if (asprintf(&tmp, "%s.tmp", out) == -1)
+		errExit("asprintf");
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot create %s\n", tmp);
+		return 1;
+	}
+	bundle_write(fd, &hdr, sizeof(hdr), tmp);
+	bundle_write(fd, index, names.cnt * sizeof(ProfileBundleEntry), tmp);
+	for (i = 0; i < names.cnt; i++)
+		bundle_write(fd, names.s[i], strlen(names.s[i]) + 1, tmp);
+	for (i = 0; i < names.cnt; i++)
+		bundle_write(fd, data[i], len[i], tmp);
+	if (fchmod(fd, 0644) == -1 || close(fd) == -1 || rename(tmp, out) == -1) {
+		fprintf(stderr, "Error: cannot create %s\n", out);
+		unlink(tmp);
+		return 1;
+	}
+	printf("%d files stored in %s, %llu bytes\n", names.cnt, out, (unsigned long long) off);
+
+	free(tmp);
+	for (i = 0; i < names.cnt; i++)
+		free(data[i]);
+	free(data);
+	free(len);
+	free(index);
+	strlist_free(&names);
+	return 0;
+}
+
+//*******************************************
+// seccomp filter store
+//*******************************************
+static StrList store_specs = { NULL, 0, 0 };	// "command\nlist", filled by profile_done()
+static void process_profiles(char **names, int cnt);
+
+typedef struct {
+	SeccompStoreEntry e;
+	char *spec;
+	char *bpf;
+	char *postexec;
+} StoreFilter;
+
+static int store_filter_cmp(const void *a, const void *b) {
+	const StoreFilter *f1 = a;
+	const StoreFilter *f2 = b;
+	if (f1->e.hash != f2->e.hash)
+		return (f1->e.hash < f2->e.hash) ? -1 : 1;
+	return strcmp(f1->spec, f2->spec);
+}
+
+// run a helper program in the environment of sbox_run() in firejail, with
+// the default error action (EPERM, set in firejail main.c) and without hot
+// syscalls
+static int store_run(char *const argv[]) {
+	pid_t pid = fork();
+	if (pid == -1)
+		errExit("fork");
+	if (pid == 0) {
+		char *envp[] = { "FIREJAIL_SECCOMP_ERROR_ACTION=EPERM", "FIREJAIL_PLUGIN=", NULL };
+		// the failures are reported by the caller
+		if (!arg_debug) {
+			int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+			if (fd != -1) {
+				dup2(fd, STDOUT_FILENO);
+				dup2(fd, STDERR_FILENO);
+			}
+		}
+		execve(argv[0], argv, envp);
+		_exit(127);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+	return 0;
+}
+
+// read a filter file, a missing file is an empty filter
+static char *store_read(const char *fname, uint32_t *len) {
+	*len = 0;
 	FILE *fp = fopen(fname, "r");
-	if (!fp) {
-		// the file was not found in the current directory
-		// look for it in /etc/firejail directory
-		if (asprintf(&tmpfname, "%s/%s", SYSCONFDIR, fname) == -1)
+	if (!fp)
+		return NULL;
+	struct stat s;
+	if (fstat(fileno(fp), &s) == -1 || !S_ISREG(s.st_mode) || s.st_size > 0x100000) {
+		fclose(fp);
+		return NULL;
+	}
+	char *data = malloc(s.st_size + 1);
+	if (!data)
+		errExit("malloc");
+	*len = fread(data, 1, s.st_size, fp);
+	fclose(fp);
+	return data;
+}
+
+// build the filters used by the profiles in dir with the fseccomp and
+// fsec-optimize programs installed next to out
+static int store_build(const char *out, const char *dir) {
+	char *libdir = strdup(out);
+	if (!libdir)
+		errExit("strdup");
+	char *ptr = strrchr(libdir, '/');
+	if (ptr)
+		*ptr = '\0';
+	else
+		strcpy(libdir, ".");
+	char *fseccomp, *optimize;
+	if (asprintf(&fseccomp, "%s/fseccomp", libdir) == -1 ||
+	    asprintf(&optimize, "%s/fsec-optimize", libdir) == -1)
+		errExit("asprintf");
+	struct stat sfseccomp, soptimize;
+	if (stat(fseccomp, &sfseccomp) == -1 || stat(optimize, &soptimize) == -1) {
+		fprintf(stderr, "Error: cannot find fseccomp and fsec-optimize in %s\n", libdir);
+		return 1;
+	}
+
+	// collect the syscall lists, the include files are found in dir
+	int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (cwd == -1 || chdir(dir) == -1) {
+		fprintf(stderr, "Error: cannot access directory %s\n", dir);
+		return 1;
+	}
+	glob_t gl;
+	if (glob("*.profile", 0, NULL, &gl) == 0) {
+		arg_seccomp_store = 1;
+		process_profiles(gl.gl_pathv, gl.gl_pathc);
+		globfree(&gl);
+	}
+	if (fchdir(cwd) == -1)
+		errExit("fchdir");
+	close(cwd);
+
+	char tmpdir[] = "/tmp/profstats-XXXXXX";
+	if (!mkdtemp(tmpdir))
+		errExit("mkdtemp");
+	char *filter, *postexec;
+	if (asprintf(&filter, "%s/seccomp", tmpdir) == -1 ||
+	    asprintf(&postexec, "%s/seccomp.postexec", tmpdir) == -1)
+		errExit("asprintf");
+
+	StoreFilter *filters = calloc(store_specs.cnt ? store_specs.cnt : 1, sizeof(StoreFilter));
+	if (!filters)
+		errExit("calloc");
+	int cnt = 0;
+	int i;
+	for (i = 0; i < store_specs.cnt; i++) {
+		char *spec = store_specs.s[i];
+		char *command = strdup(spec);
+		if (!command)
+			errExit("strdup");
+		char *list = strchr(command, '\n');
+		assert(list);
+		*list++ = '\0';
+
+		// the same arguments as seccomp_filter_drop() and seccomp_filter_keep()
+		char *fs_argv[7];
+		int k = 0;
+		fs_argv[k++] = fseccomp;
+		if (strncmp(command, "default", 7) == 0) {
+			fs_argv[k++] = command;
+			fs_argv[k++] = "drop";
+		}
+		else if (strncmp(command, "drop", 4) == 0)
+			fs_argv[k++] = command;
+		else
+			fs_argv[k++] = "keep";
+		fs_argv[k++] = filter;
+		fs_argv[k++] = postexec;
+		fs_argv[k++] = list;
+		fs_argv[k] = NULL;
+		char *opt_argv[] = { optimize, filter, NULL };
+
+		unlink(filter);
+		unlink(postexec);
+		if (store_run(fs_argv) || store_run(opt_argv)) {
+			fprintf(stderr, "Warning: cannot build seccomp filter \"%s %s\"\n", command, list);
+			free(command);
+			continue;
+		}
+		free(command);
+
+		StoreFilter *f = &filters[cnt];
+		f->spec = spec;
+		f->e.spec_len = strlen(spec);
+		f->e.hash = fnv1a64(spec, f->e.spec_len);
+		f->bpf = store_read(filter, &f->e.bpf_len);
+		f->postexec = store_read(postexec, &f->e.postexec_len);
+		if (!f->bpf || f->e.bpf_len == 0) {
+			fprintf(stderr, "Warning: cannot build seccomp filter \"%s\"\n", spec);
+			free(f->bpf);
+			free(f->postexec);
+			continue;
+		}
+		cnt++;
+	}
+	unlink(filter);
+	unlink(postexec);
+	rmdir(tmpdir);
+	qsort(filters, cnt, sizeof(StoreFilter), store_filter_cmp);
+
+	// header, index, specifications, filters
+	SeccompStoreHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SECCOMP_STORE_MAGIC, sizeof(hdr.magic));
+	hdr.version = SECCOMP_STORE_VERSION;
+	hdr.count = cnt;
+	snprintf(hdr.fj_version, sizeof(hdr.fj_version), "%s", VERSION);
+	hdr.fseccomp_size = sfseccomp.st_size;
+	hdr.fseccomp_mtime = sfseccomp.st_mtime;
+	hdr.optimize_size = soptimize.st_size;
+	hdr.optimize_mtime = soptimize.st_mtime;
+
+	uint64_t off = sizeof(hdr) + (uint64_t) cnt * sizeof(SeccompStoreEntry);
+	for (i = 0; i < cnt; i++) {
+		filters[i].e.spec_off = off;
+		off += filters[i].e.spec_len;
+	}
+	for (i = 0; i < cnt; i++) {
+		filters[i].e.bpf_off = off;
+		off += filters[i].e.bpf_len;
+		filters[i].e.postexec_off = off;
+		off += filters[i].e.postexec_len;
+	}
+	if (off > UINT32_MAX) {
+		fprintf(stderr, "Error: the seccomp filter store is too large\n");
+		return 1;
+	}
+
+	char *tmp;
+	if (asprintf(&tmp, "%s.tmp", out) == -1)
+		errExit("asprintf");
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot create %s\n", tmp);
+		return 1;
+	}
+	bundle_write(fd, &hdr, sizeof(hdr), tmp);
+	for (i = 0; i < cnt; i++)
+		bundle_write(fd, &filters[i].e, sizeof(SeccompStoreEntry), tmp);
+	for (i = 0; i < cnt; i++)
+		bundle_write(fd, filters[i].spec, filters[i].e.spec_len, tmp);
+	for (i = 0; i < cnt; i++) {
+		bundle_write(fd, filters[i].bpf, filters[i].e.bpf_len, tmp);
+		if (filters[i].e.postexec_len)
+			bundle_write(fd, filters[i].postexec, filters[i].e.postexec_len, tmp);
+	}
+	if (fchmod(fd, 0644) == -1 || close(fd) == -1 || rename(tmp, out) == -1) {
+		fprintf(stderr, "Error: cannot create %s\n", out);
+		unlink(tmp);
+		return 1;
+	}
+	printf("%d seccomp filters stored in %s, %llu bytes\n", cnt, out, (unsigned long long) off);
+
+	for (i = 0; i < cnt; i++) {
+		free(filters[i].bpf);
+		free(filters[i].postexec);
+	}
+	free(filters);
+	free(tmp);
+	free(filter);
+	free(postexec);
+	free(fseccomp);
+	free(optimize);
+	free(libdir);
+	strlist_free(&store_specs);
+	return 0;
+}
+
+// open an included .local file: the user directory is checked first, then SYSCONFDIR
+static FILE *cost_open_local(const char *fname, char **tmpfname) {
+	const char *home = getenv("HOME");
+	FILE *fp = NULL;
+	if (home && strchr(fname, '/') == NULL) {
+		if (asprintf(tmpfname, "%s/.config/firejail/%s", home, fname) == -1)
 			errExit("asprintf");
+		fp = fopen(*tmpfname, "r");
+		if (fp)
+			return fp;
+		free(*tmpfname);
+	}
+	if (asprintf(tmpfname, "%s/%s", SYSCONFDIR, fname) == -1)
+		errExit("asprintf");
+	fp = fopen(*tmpfname, "r");
+	if (!fp) {
+		free(*tmpfname);
+		*tmpfname = NULL;
+	}
+	return fp;
+}
 
-		fp = fopen(tmpfname, "r");
-		if (!fp) {
-			fprintf(stderr, "Warning: cannot open %s or %s, while processing %s\n", fname, tmpfname, profile);
-			free(tmpfname);
-			level--;
-			return;
+//*******************************************
+// file cache
+//*******************************************
+// The files are read once, and the lines are shared by all the profiles
+// including them. The entries are never removed.
+typedef struct {
+	char *path;		// the file read, NULL if the file was not found
+	char **lines;
+	int cnt;
+} CachedFile;
+
+static void *file_load(const char *fname) {
+	CachedFile *f = calloc(1, sizeof(CachedFile));
+	if (!f)
+		errExit("calloc");
+
+	size_t len = strlen(fname);
+	FILE *fp;
+	if (arg_estimate_cost && len > 6 && strcmp(fname + len - 6, ".local") == 0)
+		fp = cost_open_local(fname, &f->path);
+	else {
+		fp = fopen(fname, "r");
+		if (fp) {
+			f->path = strdup(fname);
+			if (!f->path)
+				errExit("strdup");
+		}
+		else {
+			// the file was not found in the current directory
+			// look for it in /etc/firejail directory
+			if (asprintf(&f->path, "%s/%s", SYSCONFDIR, fname) == -1)
+				errExit("asprintf");
+			fp = fopen(f->path, "r");
+			if (!fp) {
+				free(f->path);
+				f->path = NULL;
+			}
 		}
-		fname = tmpfname;
 	}
+	if (!fp)
+		return f;
 
-	int have_include_local = 0;
+	int max = 0;
 	char buf[MAXBUF];
 	while (fgets(buf, MAXBUF, fp)) {
 		char *ptr = strchr(buf, '\n');
 		if (ptr)
 			*ptr = '\0';
-		ptr = buf;
+		if (f->cnt == max) {
+			max = (max) ? max * 2 : 64;
+			f->lines = realloc(f->lines, max * sizeof(char *));
+			if (!f->lines)
+				errExit("realloc");
+		}
+		f->lines[f->cnt] = strdup(buf);
+		if (!f->lines[f->cnt])
+			errExit("strdup");
+		f->cnt++;
+	}
+	fclose(fp);
+	return f;
+}
+
+static void file_free(void *data) {
+	CachedFile *f = data;
+	int i;
+	for (i = 0; i < f->cnt; i++)
+		free(f->lines[i]);
+	free(f->lines);
+	free(f->path);
+	free(f);
+}
+
+static Cache file_cache = { { NULL }, PTHREAD_MUTEX_INITIALIZER, file_load, file_free };
+
+//*******************************************
+// profile processing
+//*******************************************
+static void process_file(Profile *p, const char *fname) {
+	assert(fname);
+
+	if (arg_debug)
+		fprintf(p->out, "processing #%s#\n", fname);
+	if (arg_estimate_cost && cost_inc_seen(p, fname))
+		return;
+	p->level++;
+	assert(p->level < 32); // to do - check in firejail code
+
+	const CachedFile *f = cache_get(&file_cache, fname);
+	if (!f->path) {
+		size_t len = strlen(fname);
+		// missing .local files are normal
+		if (!arg_estimate_cost || len <= 6 || strcmp(fname + len - 6, ".local") != 0) {
+			fprintf(p->err, "Warning: cannot open %s or %s/%s, while processing %s\n",
+				fname, SYSCONFDIR, fname, p->name);
+			strlist_add(&p->warnings, "cannot open an include file");
+		}
+		p->level--;
+		return;
+	}
+	fname = f->path;
+
+	int have_include_local = 0;
+	int line;
+	for (line = 0; line < f->cnt; line++) {
+		char buf[MAXBUF];
+		snprintf(buf, MAXBUF, "%s", f->lines[line]);
+		char *ptr = buf;
 
 		while (*ptr == ' ' || *ptr == '\t')
 			ptr++;
 		if (*ptr == '\n' || *ptr == '#')
 			continue;
 
+		if (arg_estimate_cost) {
+			// the counters below stop at some includes, follow all of them here
+			if (strncmp(ptr, "include ", 8) == 0) {
+				char *name = ptr + 8;
+				while (*name == ' ' || *name == '\t')
+					name++;
+				name[strcspn(name, " \t")] = '\0';
+				process_file(p, name);
+			}
+			else if (*ptr != '\0')
+				strlist_add(&p->cost_lines, ptr);
+			continue;
+		}
+
 		if (arg_print_blacklist) {
 			if (strncmp(ptr, "blacklist", 9) == 0 ||
 			    strncmp(ptr, "noblacklist", 11) == 0)
-				printf("%s: %s\n", fname, ptr);
+				fprintf(p->out, "%s: %s\n", fname, ptr);
 		}
 		else if (arg_print_whitelist) {
 			if (strncmp(ptr, "whitelist", 9) == 0 ||
 			    strncmp(ptr, "nowhitelist", 11) == 0 ||
 			    strncmp(ptr, "private", 7) == 0)
-				printf("%s: %s\n", fname, ptr);
+				fprintf(p->out, "%s: %s\n", fname, ptr);
 		}
 
+		if (arg_seccomp_store && strncmp(ptr, "seccomp", 7) == 0) {
+			// the last list wins, as in firejail
+			int k;
+			for (k = 0; k < SC_MAX; k++) {
+				size_t len = strlen(sc_commands[k].line);
+				if (strncmp(ptr, sc_commands[k].line, len) == 0 && ptr[len] == ' ') {
+					char *list = ptr + len + 1;
+					list[strcspn(list, " \t\n")] = '\0';
+					free(p->seccomp[k]);
+					p->seccomp[k] = strdup(list);
+					if (!p->seccomp[k])
+						errExit("strdup");
+					break;
+				}
+			}
+		}
+
+		Counters *c = &p->cnt;
 		if (strncmp(ptr, "seccomp", 7) == 0)
-			cnt_seccomp++;
+			c->seccomp++;
 		if (strncmp(ptr, "restrict-namespaces", 19) == 0)
-			cnt_restrict_namespaces++;
+			c->restrict_namespaces++;
 		else if (strncmp(ptr, "caps", 4) == 0)
-			cnt_caps++;
+			c->caps++;
 		else if (strncmp(ptr, "include disable-exec.inc", 24) == 0)
-			cnt_noexec++;
+			c->noexec++;
 		else if (strncmp(ptr, "noroot", 6) == 0)
-			cnt_noroot++;
+			c->noroot++;
 		else if (strncmp(ptr, "include whitelist-var-common.inc", 32) == 0)
-			cnt_whitelistvar++;
+			c->whitelistvar++;
 		else if (strncmp(ptr, "include whitelist-runuser-common.inc", 36) == 0 ||
 			strncmp(ptr, "blacklist ${RUNUSER}", 20) == 0)
-			cnt_whitelistrunuser++;
+			c->whitelistrunuser++;
 		else if (strncmp(ptr, "include whitelist-common.inc", 28) == 0)
-			cnt_whitelisthome++;
+			c->whitelisthome++;
 		else if (strncmp(ptr, "include whitelist-usr-share-common.inc", 38) == 0)
-			cnt_whitelistusrshare++;
+			c->whitelistusrshare++;
 		else if (strncmp(ptr, "include disable-common.inc", 26) == 0)
-			cnt_ssh++;
+			c->ssh++;
 		else if (strncmp(ptr, "memory-deny-write-execute", 25) == 0)
-			cnt_mdwx++;
+			c->mdwx++;
 		else if (strncmp(ptr, "net none", 8) == 0)
-			cnt_netnone++;
+			c->netnone++;
 		else if (strncmp(ptr, "apparmor", 8) == 0)
-			cnt_apparmor++;
+			c->apparmor++;
 		else if (strncmp(ptr, "private-bin", 11) == 0)
-			cnt_privatebin++;
+			c->privatebin++;
 		else if (strncmp(ptr, "private-dev", 11) == 0)
-			cnt_privatedev++;
+			c->privatedev++;
 		else if (strncmp(ptr, "private-tmp", 11) == 0)
-			cnt_privatetmp++;
+			c->privatetmp++;
 		else if (strncmp(ptr, "private-etc", 11) == 0)
-			cnt_privateetc++;
+			c->privateetc++;
 		else if (strncmp(ptr, "private-cache", 11) == 0)
-			cnt_privatecache++;
+			c->privatecache++;
 		else if (strncmp(ptr, "private-lib", 11) == 0)
-			cnt_privatelib++;
+			c->privatelib++;
 		else if (strncmp(ptr, "dbus-system none", 16) == 0)
-			cnt_dbus_system_none++;
+			c->dbus_system_none++;
 		else if (strncmp(ptr, "dbus-system", 11) == 0)
-			cnt_dbus_system_filter++;
+			c->dbus_system_filter++;
 		else if (strncmp(ptr, "dbus-user none", 14) == 0)
-			cnt_dbus_user_none++;
+			c->dbus_user_none++;
 		else if (strncmp(ptr, "dbus-user", 9) == 0)
-			cnt_dbus_user_filter++;
+			c->dbus_user_filter++;
 		else if (strncmp(ptr, "include ", 8) == 0) {
-			// not processing .local files
-			if (strstr(ptr, ".local")) {
+			// not processing .local files, unless the startup cost is estimated
+			if (strstr(ptr, ".local") && !arg_estimate_cost) {
 				have_include_local = 1;
-//printf("dotlocal %d, level %d - #%s#, redirect #%s#\n", cnt_dotlocal, level, fname, buf + 8);
 				if (strstr(ptr, "globals.local"))
-					cnt_globalsdotlocal++;
+					c->globalsdotlocal++;
 				else
-					cnt_dotlocal++;
+					c->dotlocal++;
 				continue;
 			}
 			// clean blanks
@@ -223,16 +1482,255 @@ static void process_file(char *fname) {
 			while (*ptr != '\0' && *ptr != ' ' && *ptr != '\t')
 				ptr++;
 			*ptr = '\0';
-			process_file(buf + 8);
+			process_file(p, buf + 8);
 		}
 	}
 
-	fclose(fp);
-	if (!have_include_local)
-		printf("No include .local found in %s\n", fname);
-	level--;
-	if (tmpfname)
-		free(tmpfname);
+	if (!have_include_local && !arg_estimate_cost)
+		fprintf(p->out, "No include .local found in %s\n", fname);
+	p->level--;
+}
+
+static void process_profile(Profile *p) {
+	p->out = open_memstream(&p->outbuf, &p->outlen);
+	p->err = open_memstream(&p->errbuf, &p->errlen);
+	if (!p->out || !p->err)
+		errExit("open_memstream");
+
+	process_file(p, p->name);
+	assert(p->level == 0);
+	if (arg_seccomp_store)
+		goto out;
+	if (arg_estimate_cost) {
+		cost_profile(p);
+		goto out;
+	}
+
+	// warnings
+	Counters *c = &p->cnt;
+	if (c->caps >= 2) {
+		fprintf(p->out, "Warning: multiple caps in %s\n", p->name);
+		strlist_add(&p->warnings, "multiple caps");
+		c->caps = 1;
+	}
+
+	// fix redirections
+	if (c->dotlocal > 1)
+		c->dotlocal = 1;
+	if (c->globalsdotlocal > 1)
+		c->globalsdotlocal = 1;
+	if (c->whitelistrunuser > 1)
+		c->whitelistrunuser = 1;
+	if (c->seccomp > 1)
+		c->seccomp = 1;
+	if (c->restrict_namespaces > 1)
+		c->restrict_namespaces = 1;
+	if (c->dbus_user_none > 1)
+		c->dbus_user_none = 1;
+	if (c->dbus_user_filter > 1)
+		c->dbus_user_filter = 1;
+	if (c->dbus_system_none > 1)
+		c->dbus_system_none = 1;
+	if (c->dbus_system_filter > 1)
+		c->dbus_system_filter = 1;
+
+	const char *name = p->name;
+	FILE *out = p->out;
+	if (arg_dbus_system_none && !c->dbus_system_none)
+		fprintf(out, "No dbus-system none found in %s\n", name);
+	if (arg_dbus_user_none && !c->dbus_user_none)
+		fprintf(out, "No dbus-user none found in %s\n", name);
+	if (arg_apparmor && !c->apparmor)
+		fprintf(out, "No apparmor found in %s\n", name);
+	if (arg_caps && !c->caps)
+		fprintf(out, "No caps found in %s\n", name);
+	if (arg_seccomp && !c->seccomp)
+		fprintf(out, "No seccomp found in %s\n", name);
+	if (arg_restrict_namespaces && !c->restrict_namespaces)
+		fprintf(out, "No restrict-namespaces found in %s\n", name);
+	if (arg_noexec && !c->noexec)
+		fprintf(out, "No include disable-exec.inc found in %s\n", name);
+	if (arg_noroot && !c->noroot)
+		fprintf(out, "No noroot found in %s\n", name);
+	if (arg_privatedev && !c->privatedev)
+		fprintf(out, "No private-dev found in %s\n", name);
+	if (arg_privatebin && !c->privatebin)
+		fprintf(out, "No private-bin found in %s\n", name);
+	if (arg_privatetmp && !c->privatetmp)
+		fprintf(out, "No private-tmp found in %s\n", name);
+	if (arg_privateetc && !c->privateetc)
+		fprintf(out, "No private-etc found in %s\n", name);
+	if (arg_privatecache && !c->privatecache)
+		fprintf(out, "No private-cache found in %s\n", name);
+	if (arg_privatelib && !c->privatelib)
+		fprintf(out, "No private-lib found in %s\n", name);
+	if (arg_whitelisthome && !c->whitelisthome)
+		fprintf(out, "Home directory not whitelisted in %s\n", name);
+	if (arg_whitelistvar && !c->whitelistvar)
+		fprintf(out, "No include whitelist-var-common.inc found in %s\n", name);
+	if (arg_whitelistrunuser && !c->whitelistrunuser)
+		fprintf(out, "No include whitelist-runuser-common.inc found in %s\n", name);
+	if (arg_whitelistusrshare && !c->whitelistusrshare)
+		fprintf(out, "No include whitelist-usr-share-common.inc found in %s\n", name);
+	if (arg_ssh && !c->ssh)
+		fprintf(out, "No include disable-common.inc found in %s\n", name);
+	if (arg_mdwx && !c->mdwx)
+		fprintf(out, "No memory-deny-write-execute found in %s\n", name);
+	if (arg_netnone && !c->netnone)
+		fprintf(out, "No \"net none\" in %s\n", name);
+
+out:
+	fclose(p->out);
+	fclose(p->err);
+	p->out = NULL;
+	p->err = NULL;
+}
+
+//*******************************************
+// JSON output
+//*******************************************
+// the keys are the names in the stats printed at the end
+static void print_json(const Profile *p) {
+	const Counters *c = &p->cnt;
+	fputs("{\"profile\":", stdout);
+	json_print_string(stdout, p->name);
+	printf(",\"include_local\":%d,\"include_globals\":%d,\"disable_common\":%d"
+	       ",\"seccomp\":%d,\"caps\":%d,\"noexec\":%d,\"noroot\":%d"
+	       ",\"memory_deny_write_execute\":%d,\"restrict_namespaces\":%d,\"apparmor\":%d"
+	       ",\"private_bin\":%d,\"private_dev\":%d,\"private_etc\":%d,\"private_cache\":%d"
+	       ",\"private_lib\":%d,\"private_tmp\":%d,\"whitelist_home\":%d,\"whitelist_var\":%d"
+	       ",\"whitelist_runuser\":%d,\"whitelist_usrshare\":%d,\"net_none\":%d"
+	       ",\"dbus_user_none\":%d,\"dbus_user_filter\":%d"
+	       ",\"dbus_system_none\":%d,\"dbus_system_filter\":%d",
+	       c->dotlocal, c->globalsdotlocal, c->ssh,
+	       c->seccomp, c->caps, c->noexec, c->noroot,
+	       c->mdwx, c->restrict_namespaces, c->apparmor,
+	       c->privatebin, c->privatedev, c->privateetc, c->privatecache,
+	       c->privatelib, c->privatetmp, c->whitelisthome, c->whitelistvar,
+	       c->whitelistrunuser, c->whitelistusrshare, c->netnone,
+	       c->dbus_user_none, c->dbus_user_filter,
+	       c->dbus_system_none, c->dbus_system_filter);
+	fputs(",\"warnings\":[", stdout);
+	int i;
+	for (i = 0; i < p->warnings.cnt; i++) {
+		if (i)
+			putchar(',');
+		json_print_string(stdout, p->warnings.s[i]);
+	}
+	fputs("]}\n", stdout);
+}
+
+static void print_json_cost(const Cost *c) {
+	fputs("{\"profile\":", stdout);
+	json_print_string(stdout, c->name);
+	printf(",\"mounts\":%d,\"blacklist\":%d,\"whitelist\":%d,\"remount\":%d,\"private\":%d"
+	       ",\"globs\":%d,\"unresolved\":%d,\"copy_bytes\":%llu}\n",
+	       c->mounts, c->blacklist, c->whitelist, c->remount, c->private,
+	       c->globs, c->unresolved, c->bytes);
+}
+
+//*******************************************
+// thread pool
+//*******************************************
+static void counters_add(Counters *dst, const Counters *src) {
+	int *d = (int *) dst;
+	const int *s = (const int *) src;
+	size_t i;
+	for (i = 0; i < sizeof(Counters) / sizeof(int); i++)
+		d[i] += s[i];
+}
+
+// print the messages of the profile and add it to the totals
+static void profile_done(Profile *p) {
+	if (arg_jsonl) {
+		// the debug messages are printed anyway
+		if (arg_debug)
+			fwrite(p->outbuf, 1, p->outlen, stdout);
+		if (!arg_estimate_cost)
+			print_json(p);
+	}
+	else if (!arg_seccomp_store)
+		fwrite(p->outbuf, 1, p->outlen, stdout);
+	fwrite(p->errbuf, 1, p->errlen, stderr);
+	free(p->outbuf);
+	free(p->errbuf);
+	strlist_free(&p->warnings);
+	int k;
+	for (k = 0; k < SC_MAX; k++) {
+		if (p->seccomp[k]) {
+			char *spec;
+			if (asprintf(&spec, "%s\n%s", sc_commands[k].command, p->seccomp[k]) == -1)
+				errExit("asprintf");
+			strlist_add_unique(&store_specs, spec);
+			free(spec);
+			free(p->seccomp[k]);
+		}
+	}
+
+	total.profiles++;
+	counters_add(&total, &p->cnt);
+	if (arg_estimate_cost)
+		cost_add(&p->cost);
+}
+
+typedef struct {
+	Profile *profiles;
+	int cnt;
+	int next;
+	pthread_mutex_t mutex;
+} Pool;
+
+static void *pool_worker(void *arg) {
+	Pool *pool = arg;
+	while (1) {
+		pthread_mutex_lock(&pool->mutex);
+		int i = pool->next++;
+		pthread_mutex_unlock(&pool->mutex);
+		if (i >= pool->cnt)
+			return NULL;
+		process_profile(&pool->profiles[i]);
+	}
+}
+
+// process the profiles in arg_jobs threads; the messages are printed in the
+// order of the profiles
+static void process_profiles(char **names, int cnt) {
+	Profile *profiles = calloc(cnt, sizeof(Profile));
+	if (!profiles)
+		errExit("calloc");
+	int i;
+	for (i = 0; i < cnt; i++)
+		profiles[i].name = names[i];
+
+	if (arg_jobs == 1) {
+		for (i = 0; i < cnt; i++) {
+			process_profile(&profiles[i]);
+			profile_done(&profiles[i]);
+		}
+		free(profiles);
+		return;
+	}
+
+	Pool pool;
+	pool.profiles = profiles;
+	pool.cnt = cnt;
+	pool.next = 0;
+	pthread_mutex_init(&pool.mutex, NULL);
+
+	pthread_t tid[MAX_THREADS];
+	long started = 0;
+	while (started < arg_jobs && started < cnt &&
+	       pthread_create(&tid[started], NULL, pool_worker, &pool) == 0)
+		started++;
+	if (started == 0)
+		pool_worker(&pool);	// no threads, process the profiles here
+	for (i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	pthread_mutex_destroy(&pool.mutex);
+
+	for (i = 0; i < cnt; i++)
+		profile_done(&profiles[i]);
+	free(profiles);
 }
 
 int main(int argc, char **argv) {
@@ -294,6 +1792,44 @@ int main(int argc, char **argv) {
 			arg_dbus_system_none = 1;
 		else if (strcmp(argv[i], "--dbus-user-none") == 0)
 			arg_dbus_user_none = 1;
+		else if (strcmp(argv[i], "--estimate-cost") == 0)
+			arg_estimate_cost = 1;
+		else if (strncmp(argv[i], "--format=", 9) == 0) {
+			if (strcmp(argv[i] + 9, "jsonl") != 0) {
+				fprintf(stderr, "Error: invalid output format %s\n", argv[i] + 9);
+				return 1;
+			}
+			arg_jsonl = 1;
+		}
+		else if (strcmp(argv[i], "--parallel") == 0) {
+			arg_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+			if (arg_jobs < 1)
+				arg_jobs = 1;
+			if (arg_jobs > MAX_THREADS)
+				arg_jobs = MAX_THREADS;
+		}
+		else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+			char *end;
+			arg_jobs = strtol(argv[i] + 11, &end, 10);
+			if (*end != '\0' || arg_jobs < 1 || arg_jobs > MAX_THREADS) {
+				fprintf(stderr, "Error: invalid number of threads\n");
+				return 1;
+			}
+		}
+		else if (strncmp(argv[i], "--bundle=", 9) == 0) {
+			if (i + 2 != argc) {
+				fprintf(stderr, "Error: --bundle expects a single directory\n");
+				return 1;
+			}
+			return bundle_build(argv[i] + 9, argv[i + 1]);
+		}
+		else if (strncmp(argv[i], "--seccomp-store=", 16) == 0) {
+			if (i + 2 != argc) {
+				fprintf(stderr, "Error: --seccomp-store expects a single directory\n");
+				return 1;
+			}
+			return store_build(argv[i] + 16, argv[i + 1]);
+		}
 		else if (*argv[i] == '-') {
 			fprintf(stderr, "Error: invalid option %s\n", argv[i]);
 			return 1;
@@ -307,144 +1843,49 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "Error: no profile file specified\n");
 		return 1;
 	}
+	if (arg_jsonl && (arg_print_blacklist || arg_print_whitelist)) {
+		fprintf(stderr, "Error: --format=jsonl is not supported with --print-blacklist and --print-whitelist\n");
+		return 1;
+	}
+
+	process_profiles(argv + start, argc - start);
 
-	for (i = start; i < argc; i++) {
-		cnt_profiles++;
-
-		int restrict_namespaces = cnt_restrict_namespaces;
-		int seccomp = cnt_seccomp;
-		int caps = cnt_caps;
-		int apparmor = cnt_apparmor;
-		int noexec = cnt_noexec;
-		int netnone = cnt_netnone;
-		int noroot = cnt_noroot;
-		int privatebin = cnt_privatebin;
-		int privatetmp = cnt_privatetmp;
-		int privatedev = cnt_privatedev;
-		int privateetc = cnt_privateetc;
-		int privatecache = cnt_privatecache;
-		int privatelib = cnt_privatelib;
-		int dotlocal = cnt_dotlocal;
-		int globalsdotlocal = cnt_globalsdotlocal;
-		int whitelisthome = cnt_whitelisthome;
-		int whitelistvar = cnt_whitelistvar;
-		int whitelistrunuser = cnt_whitelistrunuser;
-		int whitelistusrshare = cnt_whitelistusrshare;
-		int dbussystemnone = cnt_dbus_system_none;
-		int dbussystemfilter = cnt_dbus_system_filter;
-		int dbususernone = cnt_dbus_user_none;
-		int dbususerfilter = cnt_dbus_user_filter;
-		int ssh = cnt_ssh;
-		int mdwx = cnt_mdwx;
-
-		// process file
-		profile = argv[i];
-		process_file(argv[i]);
-
-		// warnings
-		if ((caps + 2) <= cnt_caps) {
-			printf("Warning: multiple caps in %s\n", argv[i]);
-			cnt_caps = caps + 1;
-		}
-
-		// fix redirections
-		if (cnt_dotlocal > (dotlocal + 1))
-			cnt_dotlocal = dotlocal + 1;
-		if (cnt_globalsdotlocal > (globalsdotlocal + 1))
-			cnt_globalsdotlocal = globalsdotlocal + 1;
-		if (cnt_whitelistrunuser > (whitelistrunuser + 1))
-			cnt_whitelistrunuser = whitelistrunuser + 1;
-		if (cnt_seccomp > (seccomp + 1))
-			cnt_seccomp = seccomp + 1;
-		if (cnt_restrict_namespaces > (restrict_namespaces + 1))
-			cnt_restrict_namespaces = restrict_namespaces + 1;
-		if (cnt_dbus_user_none > (dbususernone + 1))
-			cnt_dbus_user_none = dbususernone + 1;
-		if (cnt_dbus_user_filter > (dbususerfilter + 1))
-			cnt_dbus_user_filter = dbususerfilter + 1;
-		if (cnt_dbus_system_none > (dbussystemnone + 1))
-			cnt_dbus_system_none = dbussystemnone + 1;
-		if (cnt_dbus_system_filter > (dbussystemfilter + 1))
-			cnt_dbus_system_filter = dbussystemfilter + 1;
-
-		if (arg_dbus_system_none && dbussystemnone == cnt_dbus_system_none)
-			printf("No dbus-system none found in %s\n", argv[i]);
-		if (arg_dbus_user_none && dbususernone == cnt_dbus_user_none)
-			printf("No dbus-user none found in %s\n", argv[i]);
-		if (arg_apparmor && apparmor == cnt_apparmor)
-			printf("No apparmor found in %s\n", argv[i]);
-		if (arg_caps && caps == cnt_caps)
-			printf("No caps found in %s\n", argv[i]);
-		if (arg_seccomp && seccomp == cnt_seccomp)
-			printf("No seccomp found in %s\n", argv[i]);
-		if (arg_restrict_namespaces && restrict_namespaces == cnt_restrict_namespaces)
-			printf("No restrict-namespaces found in %s\n", argv[i]);
-		if (arg_noexec && noexec == cnt_noexec)
-			printf("No include disable-exec.inc found in %s\n", argv[i]);
-		if (arg_noroot && noroot == cnt_noroot)
-			printf("No noroot found in %s\n", argv[i]);
-		if (arg_privatedev && privatedev == cnt_privatedev)
-			printf("No private-dev found in %s\n", argv[i]);
-		if (arg_privatebin && privatebin == cnt_privatebin)
-			printf("No private-bin found in %s\n", argv[i]);
-		if (arg_privatetmp && privatetmp == cnt_privatetmp)
-			printf("No private-tmp found in %s\n", argv[i]);
-		if (arg_privateetc && privateetc == cnt_privateetc)
-			printf("No private-etc found in %s\n", argv[i]);
-		if (arg_privatecache && privatecache == cnt_privatecache)
-			printf("No private-cache found in %s\n", argv[i]);
-		if (arg_privatelib && privatelib == cnt_privatelib)
-			printf("No private-lib found in %s\n", argv[i]);
-		if (arg_whitelisthome && whitelisthome == cnt_whitelisthome)
-			printf("Home directory not whitelisted in %s\n", argv[i]);
-		if (arg_whitelistvar && whitelistvar == cnt_whitelistvar)
-			printf("No include whitelist-var-common.inc found in %s\n", argv[i]);
-		if (arg_whitelistrunuser && whitelistrunuser == cnt_whitelistrunuser)
-			printf("No include whitelist-runuser-common.inc found in %s\n", argv[i]);
-		if (arg_whitelistusrshare && whitelistusrshare == cnt_whitelistusrshare)
-			printf("No include whitelist-usr-share-common.inc found in %s\n", argv[i]);
-		if (arg_ssh && ssh == cnt_ssh)
-			printf("No include disable-common.inc found in %s\n", argv[i]);
-		if (arg_mdwx && mdwx == cnt_mdwx)
-			printf("No memory-deny-write-execute found in %s\n", argv[i]);
-		if (arg_netnone && netnone == cnt_netnone)
-			printf("No \"net none\" in %s\n", argv[i]);
-
-		assert(level == 0);
-	}
-
-	if (arg_print_blacklist || arg_print_whitelist)
+	if (arg_estimate_cost) {
+		cost_print();
+		return 0;
+	}
+	if (arg_print_blacklist || arg_print_whitelist || arg_jsonl)
 		return 0;
 
 	printf("\n");
 	printf("Stats:\n");
-	printf("    profiles\t\t\t%d\n", cnt_profiles);
-	printf("    include local profile\t%d   (include profile-name.local)\n", cnt_dotlocal);
-	printf("    include globals\t\t%d   (include globals.local)\n", cnt_globalsdotlocal);
-	printf("    blacklist ~/.ssh\t\t%d   (include disable-common.inc)\n", cnt_ssh);
-	printf("    seccomp\t\t\t%d\n", cnt_seccomp);
-	printf("    capabilities\t\t%d\n", cnt_caps);
-	printf("    noexec\t\t\t%d   (include disable-exec.inc)\n", cnt_noexec);
-	printf("    noroot\t\t\t%d\n", cnt_noroot);
-	printf("    memory-deny-write-execute\t%d\n", cnt_mdwx);
-	printf("    restrict-namespaces\t\t%d\n", cnt_restrict_namespaces);
-	printf("    apparmor\t\t\t%d\n", cnt_apparmor);
-	printf("    private-bin\t\t\t%d\n", cnt_privatebin);
-	printf("    private-dev\t\t\t%d\n", cnt_privatedev);
-	printf("    private-etc\t\t\t%d\n", cnt_privateetc);
-	printf("    private-cache\t\t%d\n", cnt_privatecache);
-	printf("    private-lib\t\t\t%d\n", cnt_privatelib);
-	printf("    private-tmp\t\t\t%d\n", cnt_privatetmp);
-	printf("    whitelist home directory\t%d\n", cnt_whitelisthome);
-	printf("    whitelist var\t\t%d   (include whitelist-var-common.inc)\n", cnt_whitelistvar);
-	printf("    whitelist run/user\t\t%d   (include whitelist-runuser-common.inc\n", cnt_whitelistrunuser);
+	printf("    profiles\t\t\t%d\n", total.profiles);
+	printf("    include local profile\t%d   (include profile-name.local)\n", total.dotlocal);
+	printf("    include globals\t\t%d   (include globals.local)\n", total.globalsdotlocal);
+	printf("    blacklist ~/.ssh\t\t%d   (include disable-common.inc)\n", total.ssh);
+	printf("    seccomp\t\t\t%d\n", total.seccomp);
+	printf("    capabilities\t\t%d\n", total.caps);
+	printf("    noexec\t\t\t%d   (include disable-exec.inc)\n", total.noexec);
+	printf("    noroot\t\t\t%d\n", total.noroot);
+	printf("    memory-deny-write-execute\t%d\n", total.mdwx);
+	printf("    restrict-namespaces\t\t%d\n", total.restrict_namespaces);
+	printf("    apparmor\t\t\t%d\n", total.apparmor);
+	printf("    private-bin\t\t\t%d\n", total.privatebin);
+	printf("    private-dev\t\t\t%d\n", total.privatedev);
+	printf("    private-etc\t\t\t%d\n", total.privateetc);
+	printf("    private-cache\t\t%d\n", total.privatecache);
+	printf("    private-lib\t\t\t%d\n", total.privatelib);
+	printf("    private-tmp\t\t\t%d\n", total.privatetmp);
+	printf("    whitelist home directory\t%d\n", total.whitelisthome);
+	printf("    whitelist var\t\t%d   (include whitelist-var-common.inc)\n", total.whitelistvar);
+	printf("    whitelist run/user\t\t%d   (include whitelist-runuser-common.inc\n", total.whitelistrunuser);
 	printf("\t\t\t\t\tor blacklist ${RUNUSER})\n");
-	printf("    whitelist usr/share\t\t%d   (include whitelist-usr-share-common.inc\n", cnt_whitelistusrshare);
-	printf("    net none\t\t\t%d\n", cnt_netnone);
-	printf("    dbus-user none \t\t%d\n", cnt_dbus_user_none);
-	printf("    dbus-user filter \t\t%d\n", cnt_dbus_user_filter);
-	printf("    dbus-system none \t\t%d\n", cnt_dbus_system_none);
-	printf("    dbus-system filter \t\t%d\n", cnt_dbus_system_filter);
+	printf("    whitelist usr/share\t\t%d   (include whitelist-usr-share-common.inc\n", total.whitelistusrshare);
+	printf("    net none\t\t\t%d\n", total.netnone);
+	printf("    dbus-user none \t\t%d\n", total.dbus_user_none);
+	printf("    dbus-user filter \t\t%d\n", total.dbus_user_filter);
+	printf("    dbus-system none \t\t%d\n", total.dbus_system_none);
+	printf("    dbus-system filter \t\t%d\n", total.dbus_system_filter);
 	printf("\n");
 	return 0;
 }
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+# This file is part of Firejail project
+# Copyright (C) 2014-2026 Firejail Authors
+# License GPL v2
+"""
+Sandbox startup benchmark.
+
+Every configuration starts /bin/true in a new sandbox a number of times. The
+wall time of each run is measured from the outside, and the startup phases
+are read from the trace written by --profile-startup. The report has the
+p50/p95/p99 wall time and the median duration of the slowest phases.
+
+The results can be saved as a baseline and compared with it on the next run;
+a p50 regression above the threshold is reported as "TESTING ERROR", the
+same way as the functional tests.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+PROFILE_DIRS = [os.path.join(ROOT, "etc", d)
+                for d in ("profile-a-l", "profile-m-z", "inc")]
+
+# the top 20 stock profiles
+PROFILES = [
+    "firefox", "chromium", "thunderbird", "vlc", "mpv", "libreoffice",
+    "gimp", "evince", "transmission-gtk", "telegram", "discord",
+    "signal-desktop", "spotify", "steam", "keepassxc", "okular", "eog",
+    "totem", "gedit", "code",
+]
+
+# name, firejail options, requirement checked before running
+CONFIGS = [
+    ("noprofile", ["--noprofile"], None),
+    ("private", ["--noprofile", "--private"], None),
+    ("private-etc", ["--noprofile", "--private-etc"], None),
+    ("private-bin", ["--noprofile", "--private-bin=true"], None),
+    ("private-lib", ["--noprofile", "--private-lib"], None),
+    ("net-br0", ["--noprofile", "--net=br0"], "br0"),
+    ("x11-xvfb", ["--noprofile", "--x11=xvfb"], "xvfb"),
+] + [("profile-" + p, ["--profile=" + p], None) for p in PROFILES]
+
+TOP_PHASES = 5
+
+
+def find_profile(name):
+    for d in PROFILE_DIRS:
+        fname = os.path.join(d, name)
+        if os.path.isfile(fname):
+            return fname
+    return None
+
+
+def profile_has(name, command, seen=None):
+    """Return True if the profile or one of its includes uses the command."""
+    seen = set() if seen is None else seen
+    if name in seen:
+        return False
+    seen.add(name)
+    fname = find_profile(name)
+    if not fname:
+        return False
+    with open(fname, encoding="utf-8") as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith(command + " "):
+                return True
+            if line.startswith("include ") and "${" not in line:
+                if profile_has(line.split()[1], command, seen):
+                    return True
+    return False
+
+
+def missing_requirement(req):
+    if req == "br0":
+        if not os.path.exists("/sys/class/net/br0"):
+            return "bridge br0 not found"
+    elif req == "xvfb":
+        if not shutil.which("Xvfb"):
+            return "Xvfb not found"
+    return None
+
+
+def command(firejail, opts, trace):
+    cmd = [firejail, "--quiet", "--profile-startup=" + trace] + opts
+    for o in opts:
+        if o.startswith("--profile=") and profile_has(o[10:] + ".profile", "private-bin"):
+            # the options are merged with the private-bin list of the profile
+            cmd.append("--private-bin=true")
+    return cmd + ["/bin/true"]
+
+
+def read_trace(fname):
+    """Return {phase: duration in microseconds} from a trace file."""
+    try:
+        with open(fname, encoding="utf-8") as f:
+            data = f.read().strip()
+    except OSError:
+        return {}
+    if not data.endswith("]"):
+        # the sandbox exited before closing the array
+        data = data.rstrip(",") + "\n]"
+    try:
+        events = json.loads(data)
+    except ValueError:
+        return {}
+
+    phases = {}
+    for e in events:
+        if e.get("ph") == "X":
+            phases[e["name"]] = phases.get(e["name"], 0) + e["dur"]
+    return phases
+
+
+def percentile(values, p):
+    """Nearest-rank percentile."""
+    values = sorted(values)
+    rank = max(1, -(-len(values) * p // 100))
+    return values[int(rank) - 1]
+
+
+def run_config(firejail, opts, runs, tmpdir):
+    trace = os.path.join(tmpdir, "trace.json")
+    walls = []
+    phases = {}
+    for _ in range(runs):
+        cmd = command(firejail, opts, trace)
+        start = time.monotonic()
+        rv = subprocess.run(cmd, stdin=subprocess.DEVNULL,
+                            stdout=subprocess.DEVNULL,
+                            stderr=subprocess.PIPE, check=False)
+        walls.append((time.monotonic() - start) * 1000.0)
+        if rv.returncode != 0:
+            err = rv.stderr.decode(errors="replace").strip().splitlines()
+            return None, err[-1] if err else "exit status %d" % rv.returncode
+        for name, dur in read_trace(trace).items():
+            phases.setdefault(name, []).append(dur / 1000.0)
+
+    result = {
+        "runs": runs,
+        "p50": percentile(walls, 50),
+        "p95": percentile(walls, 95),
+        "p99": percentile(walls, 99),
+        "phases": {name: percentile(v, 50) for name, v in phases.items()},
+    }
+    return result, None
+
+
+def print_result(name, res, base):
+    line = "   %-24s p50 %7.1f ms   p95 %7.1f ms   p99 %7.1f ms" % (
+        name, res["p50"], res["p95"], res["p99"])
+    if base:
+        diff = (res["p50"] - base["p50"]) * 100.0 / base["p50"]
+        line += "   (baseline p50 %.1f ms, %+.1f%%)" % (base["p50"], diff)
+    print(line)
+
+    slowest = sorted(res["phases"].items(), key=lambda x: -x[1])
+    for phase, ms in slowest[:TOP_PHASES]:
+        old = ""
+        if base and phase in base.get("phases", {}):
+            old = "   (baseline %.1f ms)" % base["phases"][phase]
+        print("      %-40s %7.1f ms%s" % (phase, ms, old))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="sandbox startup benchmark")
+    parser.add_argument("--runs", type=int, default=20,
+                        help="runs for each configuration")
+    parser.add_argument("--config", action="append", default=[],
+                        help="run only the configurations matching the regex")
+    parser.add_argument("--firejail", default="firejail",
+                        help="firejail executable")
+    parser.add_argument("--baseline", help="baseline file")
+    parser.add_argument("--save", action="store_true",
+                        help="save the results in the baseline file")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="p50 regression reported as an error, in percent")
+    args = parser.parse_args()
+    if args.runs < 1:
+        parser.error("invalid number of runs")
+
+    baseline = {}
+    if args.baseline:
+        try:
+            with open(args.baseline, encoding="utf-8") as f:
+                baseline = json.load(f)
+        except (OSError, ValueError):
+            if not args.save:
+                print("TESTING SKIP: no baseline in %s" % args.baseline)
+
+    results = {}
+    with tempfile.TemporaryDirectory(prefix="firejail-bench-",
+                                     dir=os.path.expanduser("~")) as tmpdir:
+        for name, opts, req in CONFIGS:
+            if args.config and not any(re.search(r, name) for r in args.config):
+                continue
+            why = missing_requirement(req)
+            if why:
+                print("TESTING SKIP: %s, %s" % (name, why))
+                continue
+
+            print("TESTING: startup %s (%s)" % (name, " ".join(opts)))
+            sys.stdout.flush()
+            res, err = run_config(args.firejail, opts, args.runs, tmpdir)
+            if not res:
+                print("TESTING ERROR: %s: %s" % (name, err))
+                continue
+            results[name] = res
+            base = None if args.save else baseline.get(name)
+            print_result(name, res, base)
+            if base and res["p50"] > base["p50"] * (1 + args.threshold / 100.0):
+                print("TESTING ERROR: %s p50 regression above %.0f%%" % (
+                    name, args.threshold))
+            sys.stdout.flush()
+
+    if args.save and args.baseline:
+        # the configurations not run this time are kept
+        baseline.update(results)
+        os.makedirs(os.path.dirname(os.path.abspath(args.baseline)), exist_ok=True)
+        with open(args.baseline, "w", encoding="utf-8") as f:
+            json.dump(baseline, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print("TESTING: baseline saved in %s" % args.baseline)
+
+
+if __name__ == "__main__":
+    main()
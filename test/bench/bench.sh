@@ -0,0 +1,23 @@
+#!/bin/bash
+# This file is part of Firejail project
+# Copyright (C) 2014-2026 Firejail Authors
+# License GPL v2
+
+# Sandbox startup benchmark, run with "make bench".
+#
+# BENCH_RUNS        number of runs for each configuration (default 20)
+# BENCH_BASELINE    baseline file (default ~/.cache/firejail-bench.json)
+# BENCH_SAVE        set to 1 to store the results as the new baseline
+# BENCH_THRESHOLD   p50 regression reported as an error, in percent (default 10)
+# BENCH_ARGS        extra arguments passed to bench.py, e.g. "--config private"
+
+export LC_ALL=C
+
+args=(--runs "${BENCH_RUNS:-20}" --threshold "${BENCH_THRESHOLD:-10}")
+args+=(--baseline "${BENCH_BASELINE:-$HOME/.cache/firejail-bench.json}")
+if [[ "$BENCH_SAVE" == "1" ]]; then
+	args+=(--save)
+fi
+
+# shellcheck disable=SC2086
+./bench.py "${args[@]}" $BENCH_ARGS
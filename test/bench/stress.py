@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# This file is part of Firejail project
+# Copyright (C) 2014-2026 Firejail Authors
+# License GPL v2
+"""
+Concurrency stress benchmark, run with "make bench-stress".
+
+K sandboxes are started at the same moment, or at a fixed rate, and the
+report has the throughput (launches/s), the startup latency distribution,
+and the time spent waiting for each firejail lock (/run/firejail/*.lock).
+
+The startup latency is measured from the launch to the end of the last span
+in the --profile-startup trace, that is right before the application is
+started; the trace and time.monotonic() use the same clock. The lock waits
+are the "lock wait" spans written by preproc_lock_file().
+
+Examples:
+    ./stress.py --count 10,50,100,200
+    ./stress.py --count 100 --rate 50 --hold 2 --opts "--net=br0"
+"""
+
+import argparse
+import json
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+def read_trace(fname):
+    """Return the complete events of a trace file."""
+    try:
+        with open(fname, encoding="utf-8") as f:
+            data = f.read().strip()
+    except OSError:
+        return []
+    if not data.endswith("]"):
+        data = data.rstrip(",") + "\n]"
+    try:
+        return [e for e in json.loads(data) if e.get("ph") == "X"]
+    except ValueError:
+        return []
+
+
+def percentile(values, p):
+    """Nearest-rank percentile."""
+    if not values:
+        return 0.0
+    values = sorted(values)
+    rank = max(1, -(-len(values) * p // 100))
+    return values[int(rank) - 1]
+
+
+class Launch:
+    def __init__(self, index, trace):
+        self.index = index
+        self.trace = trace
+        self.start = 0.0
+        self.end = 0.0
+        self.ready = None    # end of the startup, from the trace
+        self.error = None
+        self.locks = {}      # lock name: (wait in ms, retries)
+
+
+def run_one(launch, cmd, when):
+    delay = when - time.monotonic()
+    if delay > 0:
+        time.sleep(delay)
+    launch.start = time.monotonic()
+    rv = subprocess.run(cmd, stdin=subprocess.DEVNULL,
+                        stdout=subprocess.DEVNULL,
+                        stderr=subprocess.PIPE, check=False)
+    launch.end = time.monotonic()
+    if rv.returncode != 0:
+        err = rv.stderr.decode(errors="replace").strip().splitlines()
+        launch.error = err[-1] if err else "exit status %d" % rv.returncode
+
+    for e in read_trace(launch.trace):
+        end = (e["ts"] + e["dur"]) / 1e6
+        if launch.ready is None or end > launch.ready:
+            launch.ready = end
+        if e["name"].startswith("lock wait "):
+            lock = e["name"][10:]
+            wait, retries = launch.locks.get(lock, (0.0, 0))
+            launch.locks[lock] = (wait + e["dur"] / 1000.0,
+                                  retries + e.get("args", {}).get("retries", 0))
+
+
+def run_round(args, count, tmpdir):
+    firejail_opts = shlex.split(args.opts)
+    app = ["sleep", str(args.hold)] if args.hold > 0 else ["/bin/true"]
+    launches = []
+    threads = []
+
+    # all the threads are created before the first launch
+    t0 = time.monotonic() + 0.2 + count * 0.001
+    for i in range(count):
+        trace = os.path.join(tmpdir, "trace-%d-%d.json" % (count, i))
+        launch = Launch(i, trace)
+        cmd = [args.firejail, "--quiet", "--profile-startup=" + trace] + \
+            firejail_opts + app
+        when = t0 + (i / args.rate if args.rate > 0 else 0)
+        t = threading.Thread(target=run_one, args=(launch, cmd, when))
+        t.start()
+        launches.append(launch)
+        threads.append(t)
+    for t in threads:
+        t.join()
+
+    ok = [l for l in launches if not l.error and l.ready is not None]
+    latencies = [(l.ready - l.start) * 1000.0 for l in ok]
+    first = min((l.start for l in launches), default=t0)
+    last = max((l.ready for l in ok), default=first)
+    result = {
+        "count": count,
+        "rate": args.rate,
+        "failed": count - len(ok),
+        "errors": sorted({l.error for l in launches if l.error}),
+        "throughput": len(ok) / (last - first) if last > first else 0.0,
+        "latency": {
+            "p50": percentile(latencies, 50),
+            "p95": percentile(latencies, 95),
+            "p99": percentile(latencies, 99),
+            "max": max(latencies, default=0.0),
+        },
+        "locks": {},
+    }
+
+    names = sorted({name for l in ok for name in l.locks})
+    for name in names:
+        waits = [l.locks.get(name, (0.0, 0))[0] for l in ok]
+        retries = [l.locks.get(name, (0.0, 0))[1] for l in ok]
+        result["locks"][name] = {
+            "total": sum(waits),
+            "p50": percentile(waits, 50),
+            "p95": percentile(waits, 95),
+            "max": max(waits, default=0.0),
+            "contended": sum(1 for r in retries if r),
+        }
+    return result
+
+
+def print_result(res):
+    lat = res["latency"]
+    rate = "%g/s" % res["rate"] if res["rate"] > 0 else "burst"
+    print("K=%d (%s): %.1f launches/s, latency p50 %.1f ms, p95 %.1f ms, "
+          "p99 %.1f ms, max %.1f ms" % (res["count"], rate, res["throughput"],
+                                        lat["p50"], lat["p95"], lat["p99"],
+                                        lat["max"]))
+    if res["failed"]:
+        print("   failed: %d" % res["failed"])
+        for err in res["errors"]:
+            print("      %s" % err)
+    for name, l in res["locks"].items():
+        print("   %-24s wait p50 %7.1f ms, p95 %7.1f ms, max %7.1f ms, "
+              "total %8.1f ms, contended %d/%d" % (
+                  name, l["p50"], l["p95"], l["max"], l["total"],
+                  l["contended"], res["count"] - res["failed"]))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="concurrency stress benchmark for sandbox startup")
+    parser.add_argument("--count", default="50",
+                        help="sandboxes started, a comma-separated list runs "
+                             "one round for each value")
+    parser.add_argument("--rate", type=float, default=0,
+                        help="launches per second, 0 starts all of them at "
+                             "the same moment")
+    parser.add_argument("--hold", type=float, default=0,
+                        help="keep every sandbox running for the number of "
+                             "seconds, instead of starting /bin/true")
+    parser.add_argument("--opts", default="--noprofile",
+                        help="firejail options")
+    parser.add_argument("--firejail", default="firejail",
+                        help="firejail executable")
+    parser.add_argument("--format", choices=("text", "jsonl"), default="text",
+                        help="output format")
+    args = parser.parse_args()
+
+    try:
+        counts = [int(c) for c in args.count.split(",")]
+    except ValueError:
+        parser.error("invalid count %s" % args.count)
+    if any(c < 1 for c in counts) or args.rate < 0 or args.hold < 0:
+        parser.error("invalid argument")
+
+    with tempfile.TemporaryDirectory(prefix="firejail-stress-",
+                                     dir=os.path.expanduser("~")) as tmpdir:
+        for count in counts:
+            res = run_round(args, count, tmpdir)
+            if args.format == "jsonl":
+                print(json.dumps(res, sort_keys=True,
+                                 separators=(",", ":")))
+                sys.stdout.flush()
+            else:
+                print_result(res)
+
+
+if __name__ == "__main__":
+    main()
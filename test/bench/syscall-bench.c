@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014-2026 Firejail Authors
+ *
+ * This file is part of firejail project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+// syscall-bench: a fixed mix of system calls timed in a loop, one
+// "<name> <ns/op>" line for each test; started by syscall.py inside and
+// outside the sandbox. The best of several rounds is reported, the
+// scheduler noise only goes one way.
+//
+// usage: syscall-bench [iterations] [rounds]
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int zero_fd = -1;
+static int sock[2] = {-1, -1};
+static uint32_t futex_word = 0;
+
+static void errExit(const char *msg) {
+	fprintf(stderr, "Error: %s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// glibc doesn't cache the pid any more, but the raw syscall makes sure
+static void test_getpid(void) {
+	syscall(SYS_getpid);
+}
+
+static void test_read(void) {
+	char buf[64];
+	if (read(zero_fd, buf, sizeof(buf)) != sizeof(buf))
+		errExit("read");
+}
+
+static void test_openat(void) {
+	int fd = openat(AT_FDCWD, "/dev/null", O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		errExit("openat");
+	close(fd);
+}
+
+// no waiters, the wake-up returns right away
+static void test_futex(void) {
+	syscall(SYS_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// the datagram is read back, the socket buffer doesn't fill up
+static void test_sendmsg(void) {
+	char buf[16] = "firejail";
+	struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (sendmsg(sock[0], &msg, 0) != sizeof(buf))
+		errExit("sendmsg");
+	if (recv(sock[1], buf, sizeof(buf), 0) != sizeof(buf))
+		errExit("recv");
+}
+
+typedef struct {
+	const char *name;
+	void (*run)(void);
+} Test;
+
+static const Test tests[] = {
+	{ "getpid", test_getpid },
+	{ "read", test_read },
+	{ "openat+close", test_openat },
+	{ "futex", test_futex },
+	{ "sendmsg+recv", test_sendmsg },
+};
+
+int main(int argc, char **argv) {
+	long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+	int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+	if (iterations <= 0 || rounds <= 0) {
+		fprintf(stderr, "usage: syscall-bench [iterations] [rounds]\n");
+		return 1;
+	}
+
+	zero_fd = open("/dev/zero", O_RDONLY | O_CLOEXEC);
+	if (zero_fd == -1)
+		errExit("open /dev/zero");
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sock) == -1)
+		errExit("socketpair");
+
+	size_t i;
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		uint64_t best = UINT64_MAX;
+		int r;
+		for (r = 0; r < rounds; r++) {
+			uint64_t start = now_ns();
+			long n;
+			for (n = 0; n < iterations; n++)
+				tests[i].run();
+			uint64_t t = now_ns() - start;
+			if (t < best)
+				best = t;
+		}
+		printf("%s %.1f\n", tests[i].name, (double) best / (double) iterations);
+	}
+
+	return 0;
+}
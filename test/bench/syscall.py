@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+# This file is part of Firejail project
+# Copyright (C) 2014-2026 Firejail Authors
+# License GPL v2
+"""
+Syscall overhead benchmark, run with "make bench-syscall".
+
+syscall-bench.c times a fixed mix of system calls: getpid, read on
+/dev/zero, openat/close, futex and sendmsg over a socketpair. It runs
+outside the sandbox first, then inside every configuration, and the report
+has the ns/op of each test and the delta against the unsandboxed run: the
+runtime cost of the seccomp filters, Landlock and the preload libraries.
+
+The program is built in ~/firejail-bench with the system compiler,
+dynamically linked, the preload libraries need the dynamic loader. For the
+stock profiles the noexec commands are ignored, and the directory is added
+with --whitelist and --landlock.fs.execute if the profile uses whitelisting
+or Landlock; none of them changes the cost of the system calls tested.
+
+The unsandboxed program runs again before every configuration, and the
+delta is computed against the best unsandboxed result so far; the CPU
+frequency and the cache state drift during a long run.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+from bench import PROFILES, profile_has
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+# outside ~/.cache, some profiles mount a tmpfs or blacklist there
+BUILD_DIR = os.path.expanduser("~/firejail-bench")
+
+# name, firejail options
+CONFIGS = [
+    ("noprofile", ["--noprofile"]),
+    ("nonewprivs-caps", ["--noprofile", "--nonewprivs", "--caps.drop=all"]),
+    ("protocol", ["--noprofile", "--protocol=unix"]),
+    ("memory-deny-write-execute",
+     ["--noprofile", "--memory-deny-write-execute"]),
+    ("restrict-namespaces", ["--noprofile", "--restrict-namespaces"]),
+    ("postexecseccomp", ["--noprofile", "--seccomp.drop=execve"]),
+    ("landlock", ["--noprofile", "--landlock.fs.read=/",
+                  "--landlock.fs.execute=/"]),
+    ("trace", ["--noprofile", "--trace"]),
+    ("tracelog", ["--noprofile", "--tracelog"]),
+] + [("profile-" + p, ["--profile=" + p]) for p in PROFILES]
+
+
+def build():
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    src = os.path.join(HERE, "syscall-bench.c")
+    prog = os.path.join(BUILD_DIR, "syscall-bench")
+    if not os.path.exists(prog) or \
+            os.path.getmtime(prog) < os.path.getmtime(src):
+        cc = os.environ.get("CC", "cc")
+        subprocess.run([cc, "-O2", "-o", prog, src], check=True)
+    return prog
+
+
+def run(cmd):
+    """Return {test: ns/op}, or an error message."""
+    rv = subprocess.run(cmd, stdin=subprocess.DEVNULL, capture_output=True,
+                        check=False)
+    if rv.returncode != 0:
+        err = rv.stderr.decode(errors="replace").strip().splitlines()
+        return None, err[-1] if err else "exit status %d" % rv.returncode
+
+    result = {}
+    for line in rv.stdout.decode(errors="replace").splitlines():
+        # --trace output could be mixed in
+        m = re.match(r"^(\S+) ([0-9.]+)$", line)
+        if m:
+            result[m.group(1)] = float(m.group(2))
+    if not result:
+        return None, "no results"
+    return result, None
+
+
+def sandbox_cmd(args, opts, prog):
+    # --ignore has to come before --profile
+    cmd = [args.firejail, "--quiet"]
+    for o in opts:
+        if o.startswith("--profile="):
+            profile = o[10:] + ".profile"
+            if profile_has(profile, "noexec"):
+                cmd.append("--ignore=noexec")
+            if profile_has(profile, "whitelist"):
+                cmd.append("--whitelist=" + BUILD_DIR)
+            if profile_has(profile, "landlock.fs.execute"):
+                cmd.append("--landlock.fs.execute=" + BUILD_DIR)
+    return cmd + opts + [prog, str(args.iterations), str(args.rounds)]
+
+
+def print_result(name, res, native):
+    cols = []
+    for test, ns in res.items():
+        if native and test in native:
+            cols.append("%s %.1f (%+.1f)" % (test, ns, ns - native[test]))
+        else:
+            cols.append("%s %.1f" % (test, ns))
+    print("   %-28s %s" % (name, ", ".join(cols)))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="syscall overhead benchmark")
+    parser.add_argument("--iterations", type=int, default=200000,
+                        help="system calls in each round")
+    parser.add_argument("--rounds", type=int, default=5,
+                        help="rounds for each test, the best one is reported")
+    parser.add_argument("--config", action="append", default=[],
+                        help="run only the configurations matching the regex")
+    parser.add_argument("--firejail", default="firejail",
+                        help="firejail executable")
+    parser.add_argument("--format", choices=("text", "jsonl"), default="text",
+                        help="output format")
+    args = parser.parse_args()
+    if args.iterations < 1 or args.rounds < 1:
+        parser.error("invalid argument")
+
+    prog = build()
+    native, err = run([prog, str(args.iterations), str(args.rounds)])
+    if not native:
+        print("Error: %s: %s" % (prog, err), file=sys.stderr)
+        sys.exit(1)
+
+    if args.format == "jsonl":
+        print(json.dumps({"config": "native", "ns": native}, sort_keys=True))
+    else:
+        print("ns/op, delta against the unsandboxed run in parentheses")
+        print_result("native", native, None)
+
+    for name, opts in CONFIGS:
+        if args.config and not any(re.search(r, name) for r in args.config):
+            continue
+        again, _ = run([prog, str(args.iterations), str(args.rounds)])
+        for test, ns in (again or {}).items():
+            native[test] = min(native.get(test, ns), ns)
+        res, err = run(sandbox_cmd(args, opts, prog))
+        if args.format == "jsonl":
+            rec = {"config": name, "options": opts}
+            if res:
+                rec["ns"] = res
+                rec["delta"] = {t: res[t] - native[t] for t in res
+                                if t in native}
+            else:
+                rec["error"] = err
+            print(json.dumps(rec, sort_keys=True))
+            sys.stdout.flush()
+        elif res:
+            print_result(name, res, native)
+        else:
+            print("   %-28s error: %s" % (name, err))
+
+
+if __name__ == "__main__":
+    main()
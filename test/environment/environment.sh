@@ -93,6 +93,9 @@ echo "TESTING: deterministic exit code (test/environment/deterministic-exit-code
 echo "TESTING: deterministic shutdown (test/environment/deterministic-shutdown.exp)"
 ./deterministic-shutdown.exp
 
+echo "TESTING: profile startup (test/environment/profile-startup.exp)"
+./profile-startup.exp
+
 echo "TESTING: keep fd (test/environment/keep-fd.exp)"
 ./keep-fd.exp
 
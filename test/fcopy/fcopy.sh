@@ -28,5 +28,8 @@ echo "TESTING: fcopy link (test/fcopy/linkcopy.exp)"
 echo "TESTING: fcopy directory (test/fcopy/dircopy.exp)"
 ./dircopy.exp
 
+echo "TESTING: fcopy batch (test/fcopy/batchcopy.exp)"
+./batchcopy.exp
+
 rm -fr dest/*
 rm -f src/dircopy.exp
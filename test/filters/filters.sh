@@ -53,6 +53,11 @@ fi
 echo "TESTING: seccomp postexec (test/filters/seccomp-postexec.exp)"
 ./seccomp-postexec.exp
 
+rm -f seccomp-test-file
+touch seccomp-test-file
+echo "TESTING: seccomp cache (test/filters/seccomp-cache.exp)"
+./seccomp-cache.exp
+
 
 #if grep -q "^CapBnd:\\s0000003fffffffff" /proc/self/status; then
 #	echo "TESTING: capabilities (test/filters/caps.exp)"
@@ -100,6 +105,12 @@ fi
 echo "TESTING: seccomp errno (test/filters/seccomp-errno.exp)"
 ./seccomp-errno.exp
 
+echo "TESTING: seccomp argument rules (test/filters/seccomp-args.exp)"
+./seccomp-args.exp
+
+echo "TESTING: seccomp supervisor (test/filters/seccomp-notify.exp)"
+./seccomp-notify.exp
+
 echo "TESTING: seccomp su (test/filters/seccomp-su.exp)"
 ./seccomp-su.exp
 
@@ -119,6 +119,13 @@ echo "TESTING: blacklist glob (test/fs/option_blacklist_glob.exp)"
 ./option_blacklist_glob.exp
 rm -fr ~/_firejail_test_dir
 
+if [ -z "$(firejail --version | grep 'Landlock support is disabled')" ]; then
+	echo "TESTING: blacklist-mode landlock (test/fs/option_blacklist_landlock.exp)"
+	./option_blacklist_landlock.exp
+else
+	echo "TESTING SKIP: no Landlock support (test/fs/option_blacklist_landlock.exp)"
+fi
+
 echo "TESTING: noblacklist blacklist noexec (test/fs/noblacklist-blacklist-noexec.exp)"
 ./noblacklist-blacklist-noexec.exp
 
@@ -132,6 +139,10 @@ echo "TESTING: double whitelist (test/fs/whitelist-double.exp)"
 ./whitelist-double.exp
 rm -f /tmp/_firejail_test_file
 
+echo "TESTING: nested whitelist (test/fs/whitelist-nested.exp)"
+./whitelist-nested.exp
+rm -fr /tmp/_firejail_test_dir
+
 echo "TESTING: whitelist (test/fs/whitelist.exp)"
 ./whitelist.exp
 rm -fr ~/_firejail_test_*
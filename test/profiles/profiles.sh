@@ -43,6 +43,9 @@ echo "TESTING: profile no permissions (test/profiles/profile_noperm.exp)"
 echo "TESTING: multiple profiles (test/profiles/profile_multiple.exp)"
 ./profile_multiple.exp
 
+echo "TESTING: include .inc files once (test/profiles/profile_include_once.exp)"
+./profile_include_once.exp
+
 echo "TESTING: profiles bad appname (test/profiles/profile_app_name.exp)"
 ./profile_bad_appname.exp
 